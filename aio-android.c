@@ -146,6 +146,9 @@ void qemu_aio_wait(void)
     int ret;
     IoLooper*  looper;
 
+    /* The caller waits for its requests, don't delay them. */
+    bdrv_throttle_drain();
+
     if (qemu_bh_poll())
         return;
 
@@ -847,6 +847,13 @@ case "$HOST_OS" in
         ;;
 esac
 
+# the native AIO engine uses the kernel interface directly, without libaio
+case "$HOST_OS" in
+    linux)
+        echo "#define CONFIG_LINUX_AIO    1" >> $config_h
+        ;;
+esac
+
 case "$HOST_OS" in
     linux|darwin)
         echo "#define CONFIG_MADVISE  1" >> $config_h
@@ -340,7 +340,7 @@ if [ -z "$NO_TESTS" ]; then
 
     if [ "$RUN_32BIT_TESTS" ]; then
         echo "Running 32-bit unit test suite."
-        for UNIT_TEST in emulator_unittests emugl_common_host_unittests android_skin_unittests; do
+        for UNIT_TEST in emulator_unittests emugl_common_host_unittests emugl_GLcommon_host_unittests android_skin_unittests; do
         echo "   - $UNIT_TEST"
         run $TEST_SHELL $OUT_DIR/$UNIT_TEST$EXE_SUFFIX || FAILURES="$FAILURES $UNIT_TEST"
         done
@@ -348,7 +348,7 @@ if [ -z "$NO_TESTS" ]; then
 
     if [ "$RUN_64BIT_TESTS" ]; then
         echo "Running 64-bit unit test suite."
-        for UNIT_TEST in emulator64_unittests emugl64_common_host_unittests android64_skin_unittests; do
+        for UNIT_TEST in emulator64_unittests emugl64_common_host_unittests emugl64_GLcommon_host_unittests android64_skin_unittests; do
             echo "   - $UNIT_TEST"
             run $TEST_SHELL $OUT_DIR/$UNIT_TEST$EXE_SUFFIX || FAILURES="$FAILURES $UNIT_TEST"
         done
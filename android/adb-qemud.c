@@ -23,6 +23,8 @@
 #include "android/utils/debug.h"
 #include "android/adb-server.h"
 #include "android/adb-qemud.h"
+#include "android/looper.h"
+#include "hw/android/goldfish/pipe.h"
 
 #define  E(...)    derror(__VA_ARGS__)
 #define  W(...)    dwarning(__VA_ARGS__)
@@ -35,8 +37,12 @@
 
 #define SERVICE_NAME        "adb"
 #define DEBUG_SERVICE_NAME  "adb-debug"
+/* Name of the goldfish pipe service carrying ADB data without qemud. */
+#define PIPE_SERVICE_NAME   "adb"
 /* Maximum length of the message that can be received from the guest. */
 #define ADB_MAX_MSG_LEN     8
+/* Maximum length of a control message sent to an 'adb' pipe guest. */
+#define ADB_MAX_REPLY_LEN   24
 /* Enumerates ADB client state values. */
 typedef enum AdbClientState {
     /* Waiting on a connection from ADB host. */
@@ -57,14 +63,26 @@ typedef struct AdbClient AdbClient;
 struct AdbClient {
     /* Opaque pointer returned from adb_server_register_guest API. */
     void*           opaque;
-    /* QEMUD client pipe for this client. */
+    /* QEMUD client pipe for this client, or NULL for an 'adb' pipe client. */
     QemudClient*    qemud_client;
+    /* Goldfish pipe for an 'adb' pipe client, or NULL for a QEMUD client. */
+    void*           hwpipe;
     /* Connection state. */
     AdbClientState  state;
     /* Buffer, collecting accept / stop messages from client. */
     char            msg_buffer[ADB_MAX_MSG_LEN];
     /* Current position in message buffer. */
     int             msg_cur;
+    /* Control message pending to be read by an 'adb' pipe guest. */
+    uint8_t         reply[ADB_MAX_REPLY_LEN];
+    /* Size of the pending control message. */
+    int             reply_size;
+    /* Number of bytes of the control message already read by the guest. */
+    int             reply_pos;
+    /* Whether the host socket may have data to read, or room to write, for
+     * an 'adb' pipe client. */
+    int             host_readable;
+    int             host_writable;
 };
 
 /* ADB debugging client descriptor. */
@@ -74,6 +92,25 @@ struct AdbDbgClient {
     QemudClient*    qemud_client;
 };
 
+/* Sends a control message to the ADB guest. */
+static void
+_adb_client_reply(AdbClient* adb_client, const void* msg, int msglen)
+{
+    if (adb_client->qemud_client != NULL) {
+        qemud_client_send(adb_client->qemud_client, (const uint8_t*)msg, msglen);
+        return;
+    }
+
+    /* 'adb' pipe client: keep the message until the guest reads it. A new
+     * message replaces one that wasn't read yet, as only the last state
+     * change matters to the guest. */
+    assert(msglen <= ADB_MAX_REPLY_LEN);
+    memcpy(adb_client->reply, msg, msglen);
+    adb_client->reply_size = msglen;
+    adb_client->reply_pos = 0;
+    goldfish_pipe_wake(adb_client->hwpipe, PIPE_WAKE_READ);
+}
+
 /********************************************************************************
  *                      ADB host communication.
  *******************************************************************************/
@@ -99,7 +136,7 @@ _adb_on_host_connected(void* opaque, void* connection)
          * the guest from a 'read', then guest will register the transport, and
          * will send 'setart' request, indicating that it is ready to receive
          * data from the host. */
-        qemud_client_send(adb_client->qemud_client, (const uint8_t*)"ok", 2);
+        _adb_client_reply(adb_client, "ok", 2);
     } else {
         D("Unexpected ADB host connection while state is %d", adb_client->state);
     }
@@ -137,9 +174,7 @@ _adb_on_host_disconnect(void* opaque, void* connection)
         0,
         kAdbCommandSync ^ 0xffffffffU,
     };
-    qemud_client_send(adb_client->qemud_client,
-                      (const uint8_t*)&message,
-                      sizeof(message));
+    _adb_client_reply(adb_client, &message, sizeof(message));
     adb_client->state = ADBC_STATE_HOST_DISCONNECTED;
 }
 
@@ -166,6 +201,30 @@ _adb_on_host_data(void* opaque, void* connection, const void* buff, int size)
     }
 }
 
+/* A callback that is invoked when the host socket of an 'adb' pipe client is
+ * ready for I/O.
+ * Param:
+ *  opaque - AdbClient instance.
+ *  connection - An opaque pointer that identifies connection with the ADB host.
+ *  events - LOOP_IO_READ and / or LOOP_IO_WRITE.
+ */
+static void
+_adb_on_host_io(void* opaque, void* connection, unsigned events)
+{
+    AdbClient* const adb_client = (AdbClient*)opaque;
+    unsigned wake = 0;
+
+    if (events & LOOP_IO_READ) {
+        adb_client->host_readable = 1;
+        wake |= PIPE_WAKE_READ;
+    }
+    if (events & LOOP_IO_WRITE) {
+        adb_client->host_writable = 1;
+        wake |= PIPE_WAKE_WRITE;
+    }
+    goldfish_pipe_wake(adb_client->hwpipe, wake);
+}
+
 /* ADB guest API required for adb_server_register_guest */
 static AdbGuestRoutines _adb_client_routines = {
     /* A callback that is invoked when the host is connected. */
@@ -174,6 +233,17 @@ static AdbGuestRoutines _adb_client_routines = {
     _adb_on_host_disconnect,
     /* A callback that is invoked when the host sends data. */
     _adb_on_host_data,
+    /* QEMUD clients receive host data through the callback above. */
+    NULL,
+};
+
+/* ADB guest API for 'adb' pipe clients, which move data directly between the
+ * host socket and the guest buffers. */
+static AdbGuestRoutines _adb_pipe_routines = {
+    _adb_on_host_connected,
+    _adb_on_host_disconnect,
+    _adb_on_host_data,
+    _adb_on_host_io,
 };
 
 /********************************************************************************
@@ -247,12 +317,14 @@ _adb_client_recv(void* opaque, uint8_t* msg, int msglen, QemudClient* client)
                 adb_client->msg_cur = 0;
                 /* Register ADB guest connection with the ADB server. */
                 adb_client->opaque =
-                    adb_server_register_guest(adb_client, &_adb_client_routines);
+                    adb_server_register_guest(adb_client,
+                                              adb_client->hwpipe
+                                                  ? &_adb_pipe_routines
+                                                  : &_adb_client_routines);
                 if (adb_client->opaque == NULL) {
                     D("Unable to register ADB guest with the ADB server.");
                     /* KO the guest. */
-                    qemud_client_send(adb_client->qemud_client,
-                                      (const uint8_t*)"ko", 2);
+                    _adb_client_reply(adb_client, "ko", 2);
                 }
             } else {
                 D("Unexpected guest request while waiting on ADB host to connect.");
@@ -321,6 +393,183 @@ _adb_service_connect(void*          opaque,
     return adb_client->qemud_client;
 }
 
+/********************************************************************************
+ *                      ADB pipe guest communication.
+ *******************************************************************************/
+
+/*
+ * The 'adb' goldfish pipe service is an alternative to the 'adb' QEMUD
+ * service, for guests that open "pipe:adb" instead of "pipe:qemud:adb". It
+ * uses the same 'accept' / 'ok' / 'start' handshake, but once the connection
+ * is established, guest writes are sent to the host ADB socket straight from
+ * the guest buffers, and guest reads receive host data straight from the
+ * socket. There is no QEMUD framing, no intermediate message allocation, and
+ * a full host socket pushes back on the guest instead of being buffered.
+ */
+
+/* A callback that is invoked when ADB daemon running inside the guest opens
+ * an 'adb' pipe. */
+static void*
+_adbPipe_init(void* hwpipe, void* looper, const char* args)
+{
+    AdbClient* const adb_client = _adb_client_new();
+
+    D("Connecting ADB pipe guest: '%s'", args ? args : "<null>");
+    adb_client->hwpipe = hwpipe;
+    adb_client->host_writable = 1;
+    return adb_client;
+}
+
+/* A callback that is invoked when the guest closes the pipe. */
+static void
+_adbPipe_closeFromGuest(void* opaque)
+{
+    _adb_client_close(opaque);
+}
+
+/* A callback that is invoked when the guest writes to the pipe. */
+static int
+_adbPipe_sendBuffers(void* opaque, const GoldfishPipeBuffer* buffers,
+                     int numBuffers)
+{
+    AdbClient* const adb_client = (AdbClient*)opaque;
+    int transferred = 0;
+    int n;
+
+    if (adb_client->state != ADBC_STATE_CONNECTED) {
+        /* Handshake messages. They are tiny, gather them on the stack. */
+        uint8_t msg[ADB_MAX_MSG_LEN + 1];
+        for (n = 0; n < numBuffers; n++) {
+            int size = buffers[n].size;
+            if (transferred + size > (int)sizeof(msg)) {
+                size = sizeof(msg) - transferred;
+            }
+            memcpy(msg + transferred, buffers[n].data, size);
+            transferred += size;
+        }
+        _adb_client_recv(adb_client, msg, transferred, NULL);
+        /* Consume everything, like the QEMUD service does. */
+        transferred = 0;
+        for (n = 0; n < numBuffers; n++) {
+            transferred += buffers[n].size;
+        }
+        return transferred;
+    }
+
+    for (n = 0; n < numBuffers; n++) {
+        const int sent = adb_server_host_send(adb_client->opaque,
+                                              buffers[n].data,
+                                              buffers[n].size);
+        if (sent <= 0) {
+            if (sent == 0) {
+                /* The host is gone, drop the data like the QEMUD service
+                 * does. The guest is told with a SYNC message. */
+                D("ADB host is disconnected, dropping %d bytes from guest.",
+                  buffers[n].size);
+                return transferred + buffers[n].size;
+            }
+            adb_client->host_writable = 0;
+            break;
+        }
+        transferred += sent;
+        if (sent < (int)buffers[n].size) {
+            adb_client->host_writable = 0;
+            break;
+        }
+    }
+
+    return transferred ? transferred : PIPE_ERROR_AGAIN;
+}
+
+/* A callback that is invoked when the guest reads from the pipe. */
+static int
+_adbPipe_recvBuffers(void* opaque, GoldfishPipeBuffer* buffers, int numBuffers)
+{
+    AdbClient* const adb_client = (AdbClient*)opaque;
+    int transferred = 0;
+    int n;
+
+    if (adb_client->reply_pos < adb_client->reply_size) {
+        /* Control messages are delivered alone. */
+        for (n = 0; n < numBuffers &&
+                    adb_client->reply_pos < adb_client->reply_size; n++) {
+            int size = adb_client->reply_size - adb_client->reply_pos;
+            if (size > (int)buffers[n].size) {
+                size = buffers[n].size;
+            }
+            memcpy(buffers[n].data, adb_client->reply + adb_client->reply_pos,
+                   size);
+            adb_client->reply_pos += size;
+            transferred += size;
+        }
+        return transferred;
+    }
+
+    if (adb_client->state != ADBC_STATE_CONNECTED ||
+        !adb_client->host_readable) {
+        return PIPE_ERROR_AGAIN;
+    }
+
+    for (n = 0; n < numBuffers; n++) {
+        const int received = adb_server_host_recv(adb_client->opaque,
+                                                  buffers[n].data,
+                                                  buffers[n].size);
+        if (received <= 0) {
+            /* Either there is nothing left to read, and the host socket will
+             * be polled again, or the host got disconnected, and a SYNC
+             * message is now pending. */
+            adb_client->host_readable = 0;
+            break;
+        }
+        transferred += received;
+        if (received < (int)buffers[n].size) {
+            /* Most likely drained, don't try another read for now. */
+            break;
+        }
+    }
+
+    if (transferred == 0 && adb_client->reply_size > adb_client->reply_pos) {
+        return _adbPipe_recvBuffers(opaque, buffers, numBuffers);
+    }
+    return transferred ? transferred : PIPE_ERROR_AGAIN;
+}
+
+static unsigned
+_adbPipe_poll(void* opaque)
+{
+    AdbClient* const adb_client = (AdbClient*)opaque;
+    unsigned ret = 0;
+
+    if (adb_client->reply_pos < adb_client->reply_size ||
+        (adb_client->state == ADBC_STATE_CONNECTED &&
+         adb_client->host_readable)) {
+        ret |= PIPE_POLL_IN;
+    }
+    if (adb_client->state != ADBC_STATE_CONNECTED ||
+        adb_client->host_writable) {
+        ret |= PIPE_POLL_OUT;
+    }
+    return ret;
+}
+
+static void
+_adbPipe_wakeOn(void* opaque, int flags)
+{
+    /* Wake-ups are sent from _adb_on_host_io() and _adb_client_reply(). */
+    D("%s: -> %X", __FUNCTION__, flags);
+}
+
+static const GoldfishPipeFuncs _adbPipe_funcs = {
+    _adbPipe_init,
+    _adbPipe_closeFromGuest,
+    _adbPipe_sendBuffers,
+    _adbPipe_recvBuffers,
+    _adbPipe_poll,
+    _adbPipe_wakeOn,
+    NULL,  /* The host connection can't be saved, */
+    NULL,  /* so the guest reconnects after a snapshot load. */
+};
+
 /********************************************************************************
  *                      Debugging ADB guest communication.
  *******************************************************************************/
@@ -431,5 +680,12 @@ static int _inited = 0;
             dwarning("%s: Could not register '%s' service",
                    __FUNCTION__, DEBUG_SERVICE_NAME);
         }
+
+        /* Register the ADB pipe service. */
+        goldfish_pipe_add_type(PIPE_SERVICE_NAME, looper_newCore(),
+                               &_adbPipe_funcs);
+        D("%s: Registered '%s' pipe service", __FUNCTION__, PIPE_SERVICE_NAME);
+
+        _inited = 1;
     }
 }
@@ -152,7 +152,7 @@ _adb_host_free(AdbHost* adb_host)
 static void
 _adb_host_append_message(AdbHost* adb_host, const void* msg, int msglen)
 {
-    printf("Append %d bytes to ADB host buffer.\n", msglen);
+    D("Append %d bytes to ADB host buffer.", msglen);
 
     /* Make sure that buffer can contain the appending data. */
     if (adb_host->pending_send_buffer == NULL) {
@@ -177,6 +177,7 @@ _adb_host_append_message(AdbHost* adb_host, const void* msg, int msglen)
 
     memcpy(adb_host->pending_send_buffer + adb_host->pending_send_data_size,
            msg, msglen);
+    adb_host->pending_send_data_size += msglen;
     loopIo_wantWrite(adb_host->io);
 }
 
@@ -226,6 +227,17 @@ _on_adb_host_read(AdbHost* adb_host)
     char tmp[FHP_MAX];
     char buff[4096];
 
+    AdbGuest* const direct_guest = adb_host->adb_guest;
+    if (direct_guest != NULL && direct_guest->is_connected &&
+        direct_guest->callbacks->on_io != NULL) {
+        /* The guest reads the socket itself. Don't poll it again until the
+         * guest drained it, see adb_server_host_recv(). */
+        loopIo_dontWantRead(adb_host->io);
+        direct_guest->callbacks->on_io(direct_guest->opaque, direct_guest,
+                                       LOOP_IO_READ);
+        return;
+    }
+
     /* Read data from the socket. */
     const int size = socket_recv(adb_host->host_so, buff, sizeof(buff));
     if (size < 0) {
@@ -269,6 +281,16 @@ _on_adb_host_read(AdbHost* adb_host)
 static void
 _on_adb_host_write(AdbHost* adb_host)
 {
+    AdbGuest* const direct_guest = adb_host->adb_guest;
+    if (adb_host->pending_send_data_size == 0 && direct_guest != NULL &&
+        direct_guest->callbacks->on_io != NULL) {
+        /* The guest writes the socket itself, and waits for it. */
+        loopIo_dontWantWrite(adb_host->io);
+        direct_guest->callbacks->on_io(direct_guest->opaque, direct_guest,
+                                       LOOP_IO_WRITE);
+        return;
+    }
+
     while (adb_host->pending_send_data_size && adb_host->pending_send_buffer != NULL) {
         const int sent = socket_send(adb_host->host_so,
                                      adb_host->pending_send_buffer,
@@ -498,6 +520,12 @@ adb_server_complete_connection(void* opaque)
     /* Mark the guest as fully connected and ready for the host data. */
     adb_guest->is_connected = 1;
 
+    if (adb_guest->callbacks->on_io != NULL) {
+        /* The guest reads the pending data with adb_server_host_recv(). */
+        adb_guest->callbacks->on_io(adb_guest->opaque, adb_guest, LOOP_IO_READ);
+        return;
+    }
+
     /* Lets see if there is a host data pending transmission to the guest. */
     if (adb_host->pending_data != NULL && adb_host->pending_data_size != 0) {
         /* Send the pending data to the guest. */
@@ -529,6 +557,8 @@ adb_server_on_guest_message(void* opaque, const uint8_t* msg, int msglen)
             const int sent = socket_send(adb_host->host_so, msg, msglen);
             if (sent < 0) {
                 if (errno == EWOULDBLOCK) {
+                    /* Schedule write via I/O callback. */
+                    _adb_host_append_message(adb_host, msg, msglen);
                 } else {
                     D("Unable to send data to ADB host: %s", strerror(errno));
                 }
@@ -550,6 +580,72 @@ adb_server_on_guest_message(void* opaque, const uint8_t* msg, int msglen)
     }
 }
 
+int
+adb_server_host_recv(void* opaque, void* buff, int size)
+{
+    AdbGuest* const adb_guest = (AdbGuest*)opaque;
+    AdbHost* const adb_host = adb_guest->adb_host;
+    int received;
+
+    if (adb_host == NULL) {
+        return 0;
+    }
+
+    /* Deliver the data received before the connection was completed, first. */
+    if (adb_host->pending_data_size > 0) {
+        received = adb_host->pending_data_size;
+        if (received > size) {
+            received = size;
+        }
+        memcpy(buff, adb_host->pending_data, received);
+        adb_host->pending_data_size -= received;
+        memmove(adb_host->pending_data, adb_host->pending_data + received,
+                adb_host->pending_data_size);
+        return received;
+    }
+
+    received = socket_recv(adb_host->host_so, buff, size);
+    if (received < 0 && errno == EWOULDBLOCK) {
+        /* Drained, wait for more data. */
+        loopIo_wantRead(adb_host->io);
+    } else if (received <= 0) {
+        if (received < 0) {
+            D("Error while reading from ADB host %p(so=%d). Error: %s",
+              adb_host, adb_host->host_so, strerror(errno));
+        }
+        _on_adb_host_disconnected(adb_host);
+        received = 0;
+    }
+    return received;
+}
+
+int
+adb_server_host_send(void* opaque, const void* data, int size)
+{
+    AdbGuest* const adb_guest = (AdbGuest*)opaque;
+    AdbHost* const adb_host = adb_guest->adb_host;
+    int sent;
+
+    if (adb_host == NULL) {
+        return 0;
+    }
+
+    sent = socket_send(adb_host->host_so, data, size);
+    if (sent < 0 && errno == EWOULDBLOCK) {
+        loopIo_wantWrite(adb_host->io);
+    } else if (sent <= 0) {
+        if (sent < 0) {
+            D("Unable to send data to ADB host: %s", strerror(errno));
+        }
+        _on_adb_host_disconnected(adb_host);
+        sent = 0;
+    } else if (sent < size) {
+        /* Socket buffer is full, wait until it can be written again. */
+        loopIo_wantWrite(adb_host->io);
+    }
+    return sent;
+}
+
 void
 adb_server_on_guest_closed(void* opaque)
 {
@@ -59,6 +59,19 @@ typedef void (*adbguest_read)(void* opaque,
  */
 typedef void (*adbguest_disconnect)(void* opaque, void* connection);
 
+/* Callback to be invoked when the host ADB socket is ready for I/O, for a
+ * guest that reads and writes it directly (see adb_server_host_recv()).
+ * Param:
+ *  opaque - An opaque pointer associated with the guest. This pointer contains
+ *      the 'opaque' parameter that was passed to the adb_server_register_guest
+ *      routine.
+ *  connection - An opaque pointer defining the connection between the host and
+ *      the guest ADB.
+ *  events - A mask of LOOP_IO_READ and LOOP_IO_WRITE flags, telling whether
+ *      the host socket can be read, or written to.
+ */
+typedef void (*adbguest_io)(void* opaque, void* connection, unsigned events);
+
 /* Defines a set of callbacks for a guest ADB. */
 typedef struct AdbGuestRoutines AdbGuestRoutines;
 struct AdbGuestRoutines {
@@ -68,6 +81,11 @@ struct AdbGuestRoutines {
     adbguest_disconnect  on_disconnect;
     /* Callback to invoke when ADB host sends data. */
     adbguest_read        on_read;
+    /* Callback to invoke when the host socket is ready for I/O. If not NULL,
+     * the guest receives host data with adb_server_host_recv() once the
+     * connection is complete, instead of through |on_read|, and sends its
+     * data with adb_server_host_send(). */
+    adbguest_io          on_io;
 };
 
 /* Initializes ADB server.
@@ -119,6 +137,32 @@ extern void adb_server_on_guest_message(void* opaque,
                                         const uint8_t* data,
                                         int size);
 
+/* Reads data sent by the ADB host directly into a guest buffer, for guests
+ * that provide the 'on_io' callback.
+ * Param:
+ *  opaque - An opaque pointer returned from adb_server_register_guest.
+ *  buff, size - Buffer receiving the host data.
+ * Return:
+ *  Number of bytes read, 0 if the host got disconnected (the 'on_disconnect'
+ *  callback has been called then), or -1 with errno set. If errno is
+ *  EWOULDBLOCK, the 'on_io' callback will be called with LOOP_IO_READ once
+ *  more data are available.
+ */
+extern int adb_server_host_recv(void* opaque, void* buff, int size);
+
+/* Sends guest data directly to the ADB host, for guests that provide the
+ * 'on_io' callback.
+ * Param:
+ *  opaque - An opaque pointer returned from adb_server_register_guest.
+ *  data, size - Data to send to the host.
+ * Return:
+ *  Number of bytes sent, which can be less than |size|, 0 if the host got
+ *  disconnected, or -1 with errno set. If fewer than |size| bytes could be
+ *  sent, the 'on_io' callback will be called with LOOP_IO_WRITE once the
+ *  host socket can be written to again.
+ */
+extern int adb_server_host_send(void* opaque, const void* data, int size);
+
 /* Notifies the ADB server that the guest has closed its connection.
  * Param:
  *  opaque - An opaque pointer returned from adb_server_register_guest.
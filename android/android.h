@@ -102,4 +102,8 @@ extern char android_gl_version[ANDROID_GLSTRING_BUF_SIZE];
 extern void  android_emulation_setup( void );
 extern void  android_emulation_teardown( void );
 
+/* Hide the window, save the snapshot and exit, see -fast-exit. Never
+ * returns. */
+extern void  android_fast_exit( void );
+
 #endif /* _qemu_android_h */
@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Resolves host names on worker threads, and caches the results.
+ *
+ * Workers append the completed requests to a list, and write a byte to a
+ * socket pair, whose other end is watched by the main loop to invoke the
+ * callbacks, like the render channel of the opengles ring pipes.
+ */
+
+#include "android/async-resolver.h"
+#include "android/looper.h"
+#include "android/utils/debug.h"
+#include "android/utils/system.h"
+#include "android/utils/thread_pool.h"
+
+#include "qemu-common.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+
+#define  D(...)    VERBOSE_PRINT(socket,__VA_ARGS__)
+
+/* Maximum number of cached host names */
+#define AR_CACHE_SIZE  256
+
+/* Maximum length of a host name, excluding the final dot */
+#define AR_MAX_NAME_SIZE  255
+
+struct AsyncResolveRequest {
+    /* Next request in the list of completed requests */
+    AsyncResolveRequest*  next;
+    char*                 hostname;
+    uint16_t              port;
+    int                   preferIn6;
+    AsyncResolverFunc     func;
+    void*                 opaque;
+    /* Set on the main loop by async_resolver_cancel() */
+    int                   cancelled;
+    /* Result, set by the worker */
+    int                   error;
+    SockAddress           address;
+};
+
+typedef struct {
+    char      name[AR_MAX_NAME_SIZE + 1];
+    uint32_t  ips[ASYNC_RESOLVER_MAX_ADDRESSES];
+    int       count;
+    /* Expiration time, in ms of QEMU_CLOCK_REALTIME */
+    int64_t   expires;
+} ARCacheEntry;
+
+typedef struct {
+    int                   initialized;
+    /* Protects the list of completed requests */
+    QemuMutex             lock;
+    AsyncResolveRequest*  completed;
+    AsyncResolveRequest** completed_tail;
+    /* Write end of the socket pair, the read end is watched by 'io' */
+    int                   wake_fd;
+    Looper*               looper;
+    LoopIo                io[1];
+
+    ARCacheEntry          cache[AR_CACHE_SIZE];
+    int                   cache_count;
+} AsyncResolver;
+
+static AsyncResolver  _async_resolver[1];
+
+/********************************************************************************
+ *                            Host name cache
+ *******************************************************************************/
+
+/* Copies a host name into 'dst', in lower case and without the final dot.
+ * Returns -1 if it is too long or empty. */
+static int
+_ar_normalize_name(char* dst, const char* hostname)
+{
+    size_t len = strlen(hostname);
+    size_t nn;
+
+    if (len > 0 && hostname[len - 1] == '.') {
+        len--;
+    }
+    if (len == 0 || len > AR_MAX_NAME_SIZE) {
+        return -1;
+    }
+    for (nn = 0; nn < len; nn++) {
+        dst[nn] = tolower((unsigned char)hostname[nn]);
+    }
+    dst[len] = 0;
+    return 0;
+}
+
+/* Returns the cache entry of a normalized host name, or NULL. Drops the
+ * expired entries on the way. */
+static ARCacheEntry*
+_ar_cache_find(AsyncResolver* ar, const char* name, int64_t now)
+{
+    int nn = 0;
+
+    while (nn < ar->cache_count) {
+        ARCacheEntry* entry = &ar->cache[nn];
+        if (entry->expires <= now) {
+            *entry = ar->cache[--ar->cache_count];
+            continue;
+        }
+        if (!strcmp(entry->name, name)) {
+            return entry;
+        }
+        nn++;
+    }
+    return NULL;
+}
+
+int
+async_resolver_cache_lookup(const char* hostname,
+                            uint32_t* ips,
+                            int max_ips,
+                            int* ttl)
+{
+    AsyncResolver* ar = _async_resolver;
+    const int64_t  now = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    char           name[AR_MAX_NAME_SIZE + 1];
+    ARCacheEntry*  entry;
+    int            count;
+
+    if (_ar_normalize_name(name, hostname) < 0) {
+        return 0;
+    }
+    entry = _ar_cache_find(ar, name, now);
+    if (entry == NULL) {
+        return 0;
+    }
+
+    count = MIN(entry->count, max_ips);
+    memcpy(ips, entry->ips, count * sizeof(ips[0]));
+    *ttl = (int)((entry->expires - now + 999) / 1000);
+    return count;
+}
+
+void
+async_resolver_cache_add(const char* hostname,
+                         const uint32_t* ips,
+                         int count,
+                         int ttl)
+{
+    AsyncResolver* ar = _async_resolver;
+    const int64_t  now = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    char           name[AR_MAX_NAME_SIZE + 1];
+    ARCacheEntry*  entry;
+
+    if (count <= 0 || ttl <= 0 || _ar_normalize_name(name, hostname) < 0) {
+        return;
+    }
+
+    entry = _ar_cache_find(ar, name, now);
+    if (entry == NULL) {
+        if (ar->cache_count < AR_CACHE_SIZE) {
+            entry = &ar->cache[ar->cache_count++];
+        } else {
+            /* Replace the entry that expires first. */
+            int nn;
+            entry = &ar->cache[0];
+            for (nn = 1; nn < ar->cache_count; nn++) {
+                if (ar->cache[nn].expires < entry->expires) {
+                    entry = &ar->cache[nn];
+                }
+            }
+        }
+        strcpy(entry->name, name);
+    }
+
+    entry->count = MIN(count, ASYNC_RESOLVER_MAX_ADDRESSES);
+    memcpy(entry->ips, ips, entry->count * sizeof(ips[0]));
+    entry->expires = now + (int64_t)ttl * 1000;
+    D("Cached %d address(es) of '%s' for %d s", entry->count, name, ttl);
+}
+
+/********************************************************************************
+ *                            Asynchronous resolution
+ *******************************************************************************/
+
+static void
+_ar_free_request(AsyncResolveRequest* req)
+{
+    sock_address_done(&req->address);
+    AFREE(req->hostname);
+    AFREE(req);
+}
+
+/* Runs in a worker thread of the thread pool. */
+static void
+_ar_resolve_task(void* opaque)
+{
+    AsyncResolveRequest* req = opaque;
+    AsyncResolver*       ar = _async_resolver;
+    char                 c = 0;
+
+    if (sock_address_init_resolve(&req->address, req->hostname, req->port,
+                                  req->preferIn6) < 0) {
+        req->error = errno;
+    }
+
+    qemu_mutex_lock(&ar->lock);
+    req->next = NULL;
+    *ar->completed_tail = req;
+    ar->completed_tail = &req->next;
+    qemu_mutex_unlock(&ar->lock);
+
+    /* Ignore errors, if the socket pair is full, the main loop will be
+     * woken up anyway. */
+    (void)socket_send(ar->wake_fd, &c, 1);
+}
+
+/* Invoked on the main loop when workers have completed requests. */
+static void
+_ar_io_func(void* opaque, int fd, unsigned events)
+{
+    AsyncResolver*       ar = opaque;
+    AsyncResolveRequest* req;
+    char                 buf[64];
+
+    /* Drain the socket pair */
+    while (socket_recv(fd, buf, sizeof(buf)) > 0) {
+    }
+
+    qemu_mutex_lock(&ar->lock);
+    req = ar->completed;
+    ar->completed = NULL;
+    ar->completed_tail = &ar->completed;
+    qemu_mutex_unlock(&ar->lock);
+
+    while (req != NULL) {
+        AsyncResolveRequest* next = req->next;
+
+        if (req->error == 0 && !req->preferIn6 &&
+            sock_address_get_family(&req->address) == SOCKET_INET) {
+            uint32_t ip = sock_address_get_ip(&req->address);
+            async_resolver_cache_add(req->hostname, &ip, 1,
+                                     ASYNC_RESOLVER_DEFAULT_TTL);
+        }
+        if (!req->cancelled) {
+            D("Resolved '%s': %s", req->hostname,
+              req->error ? strerror(req->error)
+                         : sock_address_to_string(&req->address));
+            req->func(req->opaque, req->error ? NULL : &req->address,
+                      req->error);
+        }
+        _ar_free_request(req);
+        req = next;
+    }
+}
+
+static int
+_ar_init(AsyncResolver* ar)
+{
+    int read_fd;
+
+    if (ar->initialized) {
+        return 0;
+    }
+    if (socket_pair(&read_fd, &ar->wake_fd) < 0) {
+        D("%s: Could not create socket pair: %s", __FUNCTION__, errno_str);
+        return -1;
+    }
+    socket_set_nonblock(read_fd);
+    socket_set_nonblock(ar->wake_fd);
+
+    qemu_mutex_init(&ar->lock);
+    ar->completed = NULL;
+    ar->completed_tail = &ar->completed;
+    ar->looper = looper_newCore();
+    loopIo_init(ar->io, ar->looper, read_fd, _ar_io_func, ar);
+    loopIo_wantRead(ar->io);
+    ar->initialized = 1;
+    return 0;
+}
+
+AsyncResolveRequest*
+async_resolver_resolve(const char* hostname,
+                       uint16_t port,
+                       int preferIn6,
+                       AsyncResolverFunc func,
+                       void* opaque)
+{
+    AsyncResolver*       ar = _async_resolver;
+    AsyncResolveRequest* req;
+
+    if (!preferIn6) {
+        uint32_t ip;
+        int      ttl;
+        if (async_resolver_cache_lookup(hostname, &ip, 1, &ttl) > 0) {
+            SockAddress address;
+            sock_address_init_inet(&address, ip, port);
+            func(opaque, &address, 0);
+            sock_address_done(&address);
+            return NULL;
+        }
+    }
+
+    /* Without a socket pair, resolve synchronously as before. */
+    if (_ar_init(ar) < 0) {
+        SockAddress address;
+        if (sock_address_init_resolve(&address, hostname, port,
+                                      preferIn6) < 0) {
+            func(opaque, NULL, errno);
+        } else {
+            func(opaque, &address, 0);
+            sock_address_done(&address);
+        }
+        return NULL;
+    }
+
+    ANEW0(req);
+    req->hostname = ASTRDUP(hostname);
+    req->port = port;
+    req->preferIn6 = preferIn6;
+    req->func = func;
+    req->opaque = opaque;
+    thread_pool_post(_ar_resolve_task, req, THREAD_POOL_PRIORITY_NORMAL,
+                     THREAD_POOL_ANY_WORKER);
+    return req;
+}
+
+void
+async_resolver_cancel(AsyncResolveRequest* req)
+{
+    /* The worker may still be using the request, it is freed by
+     * _ar_io_func() once completed. */
+    req->cancelled = 1;
+}
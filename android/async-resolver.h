@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ASYNC_RESOLVER_H_
+#define ANDROID_ASYNC_RESOLVER_H_
+
+#include "android/sockets.h"
+
+#include <stdint.h>
+
+/*
+ * Contains declaration of an API that resolves host names without blocking
+ * the main loop, and of the host name cache in front of it.
+ *
+ * sock_address_init_resolve() waits for the DNS servers, which can take
+ * seconds. async_resolver_resolve() runs it on a worker thread of the shared
+ * thread pool instead, and reports the result on the main loop.
+ *
+ * Successful IPv4 resolutions are kept in a cache, which also stores the
+ * answers of the DNS servers to the queries that slirp forwards for the
+ * guest, with their TTL. The cache is only accessed from the main loop.
+ */
+
+/* Maximum number of IPv4 addresses cached per host name */
+#define ASYNC_RESOLVER_MAX_ADDRESSES  8
+
+/* Time to live of the cached results of getaddrinfo(), which doesn't report
+ * the TTL of the DNS records, in seconds. */
+#define ASYNC_RESOLVER_DEFAULT_TTL  60
+
+typedef struct AsyncResolveRequest AsyncResolveRequest;
+
+/* Callback invoked on the main loop when a resolution completes.
+ * Param:
+ *  opaque - Client's opaque value passed to async_resolver_resolve().
+ *  address - Resolved address, with the requested port, or NULL on failure.
+ *  error - On failure, the errno value set by sock_address_init_resolve().
+ */
+typedef void (*AsyncResolverFunc)(void* opaque,
+                                  const SockAddress* address,
+                                  int error);
+
+/* Resolves a host name without blocking.
+ * Param:
+ *  hostname - Host name or numeric address to resolve.
+ *  port - Port of the resolved address.
+ *  preferIn6 - Same as for sock_address_init_resolve(). IPv6 resolutions
+ *      are not cached.
+ *  func, opaque - Callback to invoke with the result.
+ * Return:
+ *  A request that can be cancelled until its callback is invoked, or NULL
+ *  if the result was in the cache, in which case the callback has already
+ *  been invoked.
+ */
+extern AsyncResolveRequest* async_resolver_resolve(const char* hostname,
+                                                   uint16_t port,
+                                                   int preferIn6,
+                                                   AsyncResolverFunc func,
+                                                   void* opaque);
+
+/* Cancels a pending request, its callback won't be invoked. */
+extern void async_resolver_cancel(AsyncResolveRequest* req);
+
+/* Looks up the IPv4 addresses of a host name in the cache.
+ * Param:
+ *  hostname - Host name, case insensitive, with or without the final dot.
+ *  ips - Receives up to 'max_ips' addresses, in host byte order.
+ *  ttl - Receives the remaining time to live of the entry, in seconds.
+ * Return:
+ *  Number of addresses returned, 0 if the name isn't cached.
+ */
+extern int async_resolver_cache_lookup(const char* hostname,
+                                       uint32_t* ips,
+                                       int max_ips,
+                                       int* ttl);
+
+/* Adds the 'count' IPv4 addresses in 'ips', in host byte order, of a host
+ * name to the cache, for 'ttl' seconds. Replaces any previous entry. */
+extern void async_resolver_cache_add(const char* hostname,
+                                     const uint32_t* ips,
+                                     int count,
+                                     int ttl);
+
+#endif  /* ANDROID_ASYNC_RESOLVER_H_ */
@@ -139,6 +139,9 @@ _async_socket_connector_open_socket(AsyncSocketConnector* connector)
 
     /* Prepare for async I/O on the connector. */
     socket_set_nonblock(connector->fd);
+    /* Small messages, like sensor events, must not wait for the
+     * acknowledgement of the previous ones. */
+    socket_set_nodelay(connector->fd);
 
     T("ASC %s: Connector socket is opened with FD = %d",
       _asc_socket_string(connector), connector->fd);
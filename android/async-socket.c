@@ -34,6 +34,17 @@
 
 #define TRACE_ON    0
 
+/* Maximum number of queued writes that are sent with a single system call. */
+#define AS_MAX_BATCHED_WRITES   SOCKET_SENDV_MAX
+
+/* Size of the buffer that holds data received ahead of the readers. Reads
+ * that are at least this large bypass it. */
+#define AS_READ_BUFFER_SIZE     8192
+
+/* Maximum number of reads completed in a single I/O callback, so that a
+ * stream of incoming data doesn't starve the rest of the main loop. */
+#define AS_MAX_READS_PER_EVENT  64
+
 #if TRACE_ON
 #define  T(...)    VERBOSE_PRINT(asyncsocket,__VA_ARGS__)
 #else
@@ -69,6 +80,8 @@ struct AsyncSocketIO {
     AsyncSocket*        as;
     /* Timer used for time outs on this I/O. */
     LoopTimer           timer[1];
+    /* Looper the timer has been initialized with. */
+    Looper*             timer_looper;
     /* An opaque pointer associated with this I/O. */
     void*               io_opaque;
     /* Buffer where to read / write data. */
@@ -93,7 +106,8 @@ struct AsyncSocketIO {
  * Recycling I/O instances.
  * Since AsyncSocketIO instances are not that large, it makes sence to recycle
  * them for faster allocation, rather than allocating and freeing them for each
- * I/O on the socket.
+ * I/O on the socket. Recycled descriptors keep their timer, which is only
+ * initialized again if the next I/O uses another looper.
  */
 
 /* List of recycled I/O descriptors. */
@@ -101,7 +115,7 @@ static AsyncSocketIO* _asio_recycled    = NULL;
 /* Number of I/O descriptors that are recycled in the _asio_recycled list. */
 static int _recycled_asio_count         = 0;
 /* Maximum number of I/O descriptors that can be recycled. */
-static const int _max_recycled_asio_num = 32;
+static const int _max_recycled_asio_num = 64;
 
 /* Handler for an I/O time-out timer event.
  * When this routine is invoked, it indicates that a time out has occurred on an
@@ -153,8 +167,14 @@ _async_socket_rw_new(AsyncSocket* as,
     asio->state         = ASIO_STATE_QUEUED;
     asio->ref_count     = 1;
     asio->deadline      = deadline;
-    loopTimer_init(asio->timer, _async_socket_get_looper(as),
-                   _on_async_socket_io_timed_out, asio);
+    if (asio->timer_looper != _async_socket_get_looper(as)) {
+        if (asio->timer_looper != NULL) {
+            loopTimer_done(asio->timer);
+        }
+        asio->timer_looper = _async_socket_get_looper(as);
+        loopTimer_init(asio->timer, asio->timer_looper,
+                       _on_async_socket_io_timed_out, asio);
+    }
     loopTimer_startAbsolute(asio->timer, deadline);
 
     /* Reference socket that is holding this I/O. */
@@ -166,6 +186,28 @@ _async_socket_rw_new(AsyncSocket* as,
     return asio;
 }
 
+/* Frees the recycled I/O descriptors whose timer uses a looper that is about to
+ * be destroyed.
+ * Param:
+ *  looper - Looper that is about to be destroyed.
+ */
+static void
+_async_socket_io_purge_recycled(Looper* looper)
+{
+    AsyncSocketIO** pasio = &_asio_recycled;
+    while (*pasio != NULL) {
+        AsyncSocketIO* const asio = *pasio;
+        if (asio->timer_looper == looper) {
+            *pasio = asio->next;
+            _recycled_asio_count--;
+            loopTimer_done(asio->timer);
+            AFREE(asio);
+        } else {
+            pasio = &asio->next;
+        }
+    }
+}
+
 /* Destroys and frees I/O descriptor. */
 static void
 _async_socket_io_free(AsyncSocketIO* asio)
@@ -175,14 +217,14 @@ _async_socket_io_free(AsyncSocketIO* asio)
     T("ASocket %s: %s I/O descriptor %p is destroyed.",
       _async_socket_string(as), asio->is_io_read ? "READ" : "WRITE", asio);
 
-    loopTimer_done(asio->timer);
-
     /* Try to recycle it first, and free the memory if recycler is full. */
     if (_recycled_asio_count < _max_recycled_asio_num) {
+        loopTimer_stop(asio->timer);
         asio->next = _asio_recycled;
         _asio_recycled = asio;
         _recycled_asio_count++;
     } else {
+        loopTimer_done(asio->timer);
         AFREE(asio);
     }
 
@@ -368,6 +410,13 @@ struct AsyncSocket {
     LoopIo              io[1];
     /* Timer to use for reconnection attempts. */
     LoopTimer           reconnect_timer[1];
+    /* Timer to hand buffered data to readers that have been queued outside
+     * of the I/O callback. */
+    LoopTimer           read_timer[1];
+    /* Data received ahead of the readers, from 'read_start' to 'read_end'. */
+    uint8_t*            read_buffer;
+    uint32_t            read_start;
+    uint32_t            read_end;
     /* Head of the list of the active readers. */
     AsyncSocketIO*      readers_head;
     /* Tail of the list of the active readers. */
@@ -664,6 +713,7 @@ _async_socket_cancel_all_io(AsyncSocket* as)
 {
     /* Stop the reconnection timer. */
     loopTimer_stop(as->reconnect_timer);
+    loopTimer_stop(as->read_timer);
 
     /* Stop read / write on the socket. */
     loopIo_dontWantWrite(as->io);
@@ -687,6 +737,8 @@ _async_socket_close_socket(AsyncSocket* as)
         loopIo_done(as->io);
         socket_close(as->fd);
         as->fd = -1;
+        /* Data received ahead belongs to the closed connection. */
+        as->read_start = as->read_end = 0;
     }
 }
 
@@ -706,10 +758,13 @@ _async_socket_free(AsyncSocket* as)
         /* Free allocated resources. */
         if (as->looper != NULL) {
             loopTimer_done(as->reconnect_timer);
+            loopTimer_done(as->read_timer);
             if (as->owns_looper) {
+                _async_socket_io_purge_recycled(as->looper);
                 looper_free(as->looper);
             }
         }
+        AFREE(as->read_buffer);
         sock_address_done(&as->address);
         AFREE(as);
     }
@@ -782,7 +837,56 @@ _on_async_socket_failure(AsyncSocket* as, AsyncSocketIO* asio)
     return _async_socket_io_failure(as, asio, errno);
 }
 
+/* Receives data for a reader, handing it buffered data first.
+ * Param:
+ *  as - Initialized AsyncSocket instance.
+ *  asr - Reader at the head of the list.
+ * Return:
+ *  Number of bytes transferred to the reader, 0 if the socket has been
+ *  disconnected, or -1 on failure, with errno set accordingly.
+ */
+static int
+_async_socket_recv_data(AsyncSocket* as, AsyncSocketIO* asr)
+{
+    const uint32_t to_read = asr->to_transfer - asr->transferred;
+    uint32_t avail = as->read_end - as->read_start;
+
+    if (avail == 0) {
+        int res;
+
+        if (to_read >= AS_READ_BUFFER_SIZE) {
+            /* Large reads go straight to the reader's buffer. */
+            return HANDLE_EINTR(socket_recv(as->fd,
+                                            asr->buffer + asr->transferred,
+                                            to_read));
+        }
+
+        /* Read as much as available, so the data for the next readers is
+         * received with the same system call. */
+        if (as->read_buffer == NULL) {
+            as->read_buffer = android_alloc(AS_READ_BUFFER_SIZE);
+        }
+        res = HANDLE_EINTR(socket_recv(as->fd, as->read_buffer,
+                                       AS_READ_BUFFER_SIZE));
+        if (res <= 0) {
+            return res;
+        }
+        as->read_start = 0;
+        as->read_end = avail = res;
+    }
+
+    if (avail > to_read) {
+        avail = to_read;
+    }
+    memcpy(asr->buffer + asr->transferred, as->read_buffer + as->read_start,
+           avail);
+    as->read_start += avail;
+    return avail;
+}
+
 /* A callback that is invoked when there is data available to read.
+ * Readers are served one after another, as long as there is data available,
+ * up to AS_MAX_READS_PER_EVENT of them.
  * Param:
  *  as - Initialized AsyncSocket instance.
  * Return:
@@ -793,103 +897,108 @@ static int
 _on_async_socket_recv(AsyncSocket* as)
 {
     AsyncIOAction action;
+    int reads;
+
+    for (reads = 0; reads < AS_MAX_READS_PER_EVENT; reads++) {
+        /* Get current reader. */
+        AsyncSocketIO* const asr = as->readers_head;
+        if (asr == NULL) {
+            if (reads == 0) {
+                D("ASocket %s: No reader is available.",
+                  _async_socket_string(as));
+            }
+            break;
+        }
 
-    /* Get current reader. */
-    AsyncSocketIO* const asr = as->readers_head;
-    if (asr == NULL) {
-        D("ASocket %s: No reader is available.", _async_socket_string(as));
-        loopIo_dontWantRead(as->io);
-        return 0;
-    }
-
-    /* Reference the reader while we're working with it in this callback. */
-    async_socket_io_reference(asr);
+        /* Reference the reader while we're working with it in this callback. */
+        async_socket_io_reference(asr);
 
-    /* Bump I/O state, and inform the client that I/O is in progress. */
-    if (asr->state == ASIO_STATE_QUEUED) {
-        asr->state = ASIO_STATE_STARTED;
-    } else {
-        asr->state = ASIO_STATE_CONTINUES;
-    }
-    action = asr->on_io(asr->io_opaque, asr, asr->state);
-    if (action == ASIO_ACTION_ABORT) {
-        D("ASocket %s: Read is aborted by the client.", _async_socket_string(as));
-        /* Move on to the next reader. */
-        _async_socket_advance_reader(as);
-        /* Lets see if there are still active readers, and enable, or disable
-         * read I/O callback accordingly. */
-        if (as->readers_head != NULL) {
-            loopIo_wantRead(as->io);
+        /* Bump I/O state, and inform the client that I/O is in progress. */
+        if (asr->state == ASIO_STATE_QUEUED) {
+            asr->state = ASIO_STATE_STARTED;
         } else {
-            loopIo_dontWantRead(as->io);
+            asr->state = ASIO_STATE_CONTINUES;
+        }
+        action = asr->on_io(asr->io_opaque, asr, asr->state);
+        if (action == ASIO_ACTION_ABORT) {
+            D("ASocket %s: Read is aborted by the client.", _async_socket_string(as));
+            /* Move on to the next reader. */
+            _async_socket_advance_reader(as);
+            async_socket_io_release(asr);
+            continue;
         }
-        async_socket_io_release(asr);
-        return 0;
-    }
 
-    /* Read next chunk of data. */
-    int res = HANDLE_EINTR(
-            socket_recv(as->fd,
-                        asr->buffer + asr->transferred,
-                        asr->to_transfer - asr->transferred));
-    if (res == 0) {
-        /* Socket has been disconnected. */
-        errno = ECONNRESET;
-        _on_async_socket_disconnected(as);
-        async_socket_io_release(asr);
-        return -1;
-    }
+        /* Read next chunk of data. */
+        int res = _async_socket_recv_data(as, asr);
+        if (res == 0) {
+            /* Socket has been disconnected. */
+            errno = ECONNRESET;
+            _on_async_socket_disconnected(as);
+            async_socket_io_release(asr);
+            return -1;
+        }
 
-    if (res < 0) {
-        if (errno == EWOULDBLOCK || errno == EAGAIN) {
-            /* Yield to writes behind this read. */
-            loopIo_wantRead(as->io);
+        if (res < 0) {
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                /* Yield to writes behind this read. */
+                async_socket_io_release(asr);
+                break;
+            }
+
+            /* An I/O error. */
+            action = _on_async_socket_failure(as, asr);
+            if (action != ASIO_ACTION_RETRY) {
+                D("ASocket %s: Read is aborted on failure.", _async_socket_string(as));
+                /* Move on to the next reader. */
+                _async_socket_advance_reader(as);
+                /* Lets see if there are still active readers, and enable, or disable
+                 * read I/O callback accordingly. */
+                if (as->readers_head != NULL) {
+                    loopIo_wantRead(as->io);
+                } else {
+                    loopIo_dontWantRead(as->io);
+                }
+            }
             async_socket_io_release(asr);
-            return 0;
+            return -1;
         }
 
-        /* An I/O error. */
-        action = _on_async_socket_failure(as, asr);
-        if (action != ASIO_ACTION_RETRY) {
-            D("ASocket %s: Read is aborted on failure.", _async_socket_string(as));
-            /* Move on to the next reader. */
+        /* Update the reader's descriptor. */
+        asr->transferred += res;
+        if (asr->transferred == asr->to_transfer) {
+            /* This read is completed. Move on to the next reader. */
             _async_socket_advance_reader(as);
-            /* Lets see if there are still active readers, and enable, or disable
-             * read I/O callback accordingly. */
-            if (as->readers_head != NULL) {
-                loopIo_wantRead(as->io);
-            } else {
-                loopIo_dontWantRead(as->io);
-            }
+
+            /* Notify reader completion. */
+            _async_socket_complete_io(as, asr);
         }
-        async_socket_io_release(asr);
-        return -1;
-    }
 
-    /* Update the reader's descriptor. */
-    asr->transferred += res;
-    if (asr->transferred == asr->to_transfer) {
-        /* This read is completed. Move on to the next reader. */
-        _async_socket_advance_reader(as);
+        async_socket_io_release(asr);
 
-        /* Notify reader completion. */
-        _async_socket_complete_io(as, asr);
+        /* The client may have disconnected the socket in the callbacks. */
+        if (!async_socket_is_connected(as)) {
+            return -1;
+        }
     }
 
     /* Lets see if there are still active readers, and enable, or disable read
      * I/O callback accordingly. */
     if (as->readers_head != NULL) {
         loopIo_wantRead(as->io);
+        /* Don't wait for the socket to hand the data already received. */
+        if (as->read_start != as->read_end) {
+            loopTimer_startRelative(as->read_timer, 0);
+        }
     } else {
         loopIo_dontWantRead(as->io);
     }
 
-    async_socket_io_release(asr);
-
     return 0;
 }
 
 /* A callback that is invoked when there is data available to write.
+ * The data of up to AS_MAX_BATCHED_WRITES queued writers is sent with a single
+ * system call.
  * Param:
  *  as - Initialized AsyncSocket instance.
  * Return:
@@ -900,29 +1009,58 @@ static int
 _on_async_socket_send(AsyncSocket* as)
 {
     AsyncIOAction action;
+    AsyncSocketIO* batch[AS_MAX_BATCHED_WRITES];
+    SocketBuffer bufs[AS_MAX_BATCHED_WRITES];
+    int count = 0;
+    int n;
 
     /* Get current writer. */
-    AsyncSocketIO* const asw = as->writers_head;
+    AsyncSocketIO* asw = as->writers_head;
     if (asw == NULL) {
         D("ASocket %s: No writer is available.", _async_socket_string(as));
         loopIo_dontWantWrite(as->io);
         return 0;
     }
 
-    /* Reference the writer while we're working with it in this callback. */
-    async_socket_io_reference(asw);
+    /* Collect the writers at the head of the list. Writers aborted by the
+     * client are removed, so that the collected ones stay at the head. */
+    while (asw != NULL && count < AS_MAX_BATCHED_WRITES) {
+        /* Reference the writer while we're working with it in this callback. */
+        async_socket_io_reference(asw);
 
-    /* Bump I/O state, and inform the client that I/O is in progress. */
-    if (asw->state == ASIO_STATE_QUEUED) {
-        asw->state = ASIO_STATE_STARTED;
-    } else {
-        asw->state = ASIO_STATE_CONTINUES;
+        /* Bump I/O state, and inform the client that I/O is in progress. */
+        if (asw->state == ASIO_STATE_QUEUED) {
+            asw->state = ASIO_STATE_STARTED;
+        } else {
+            asw->state = ASIO_STATE_CONTINUES;
+        }
+        action = asw->on_io(asw->io_opaque, asw, asw->state);
+
+        if (!async_socket_is_connected(as)) {
+            /* The client has disconnected the socket in the callback. */
+            async_socket_io_release(asw);
+            for (n = 0; n < count; n++) {
+                async_socket_io_release(batch[n]);
+            }
+            return -1;
+        }
+
+        AsyncSocketIO* const next = asw->next;
+        if (action == ASIO_ACTION_ABORT) {
+            D("ASocket %s: Write is aborted by the client.", _async_socket_string(as));
+            _async_socket_remove_io(as, &as->writers_head, &as->writers_tail,
+                                    asw);
+            async_socket_io_release(asw);
+        } else {
+            batch[count] = asw;
+            bufs[count].base = asw->buffer + asw->transferred;
+            bufs[count].len = asw->to_transfer - asw->transferred;
+            count++;
+        }
+        asw = next;
     }
-    action = asw->on_io(asw->io_opaque, asw, asw->state);
-    if (action == ASIO_ACTION_ABORT) {
-        D("ASocket %s: Write is aborted by the client.", _async_socket_string(as));
-        /* Move on to the next writer. */
-        _async_socket_advance_writer(as);
+
+    if (count == 0) {
         /* Lets see if there are still active writers, and enable, or disable
          * write I/O callback accordingly. */
         if (as->writers_head != NULL) {
@@ -930,20 +1068,18 @@ _on_async_socket_send(AsyncSocket* as)
         } else {
             loopIo_dontWantWrite(as->io);
         }
-        async_socket_io_release(asw);
         return 0;
     }
 
     /* Write next chunk of data. */
-    int res = HANDLE_EINTR(
-            socket_send(as->fd,
-                        asw->buffer + asw->transferred,
-                        asw->to_transfer - asw->transferred));
+    int res = HANDLE_EINTR(socket_sendv(as->fd, bufs, count));
     if (res == 0) {
         /* Socket has been disconnected. */
         errno = ECONNRESET;
         _on_async_socket_disconnected(as);
-        async_socket_io_release(asw);
+        for (n = 0; n < count; n++) {
+            async_socket_io_release(batch[n]);
+        }
         return -1;
     }
 
@@ -951,12 +1087,15 @@ _on_async_socket_send(AsyncSocket* as)
         if (errno == EWOULDBLOCK || errno == EAGAIN) {
             /* Yield to reads behind this write. */
             loopIo_wantWrite(as->io);
-            async_socket_io_release(asw);
+            for (n = 0; n < count; n++) {
+                async_socket_io_release(batch[n]);
+            }
             return 0;
         }
 
-        /* An I/O error. */
-        action = _on_async_socket_failure(as, asw);
+        /* An I/O error. It is reported to the first writer, the others get
+         * their turn with the next attempts. */
+        action = _on_async_socket_failure(as, batch[0]);
         if (action != ASIO_ACTION_RETRY) {
             D("ASocket %s: Write is aborted on failure.", _async_socket_string(as));
             /* Move on to the next writer. */
@@ -969,18 +1108,39 @@ _on_async_socket_send(AsyncSocket* as)
                 loopIo_dontWantWrite(as->io);
             }
         }
-        async_socket_io_release(asw);
+        for (n = 0; n < count; n++) {
+            async_socket_io_release(batch[n]);
+        }
         return -1;
     }
 
-    /* Update the writer descriptor. */
-    asw->transferred += res;
-    if (asw->transferred == asw->to_transfer) {
+    /* Update the writer descriptors, completing those that have been fully
+     * sent, in order. */
+    for (n = 0; n < count && async_socket_is_connected(as); n++) {
+        AsyncSocketIO* const done = batch[n];
+        uint32_t sent = done->to_transfer - done->transferred;
+        if (sent > (uint32_t)res) {
+            sent = res;
+        }
+        done->transferred += sent;
+        res -= sent;
+        if (done->transferred != done->to_transfer) {
+            break;
+        }
         /* This write is completed. Move on to the next writer. */
         _async_socket_advance_writer(as);
 
         /* Notify writer completion. */
-        _async_socket_complete_io(as, asw);
+        _async_socket_complete_io(as, done);
+    }
+
+    for (n = 0; n < count; n++) {
+        async_socket_io_release(batch[n]);
+    }
+
+    /* The client may have disconnected the socket in the callbacks. */
+    if (!async_socket_is_connected(as)) {
+        return -1;
     }
 
     /* Lets see if there are still active writers, and enable, or disable write
@@ -991,8 +1151,6 @@ _on_async_socket_send(AsyncSocket* as)
         loopIo_dontWantWrite(as->io);
     }
 
-    async_socket_io_release(asw);
-
     return 0;
 }
 
@@ -1050,6 +1208,7 @@ _on_connector_events(void* opaque,
     if (event == ASIO_STATE_SUCCEEDED) {
         /* Accept the connection. */
         as->fd = async_socket_connector_pull_fd(connector);
+        as->read_start = as->read_end = 0;
         loopIo_init(as->io, as->looper, as->fd, _on_async_socket_io, as);
     }
 
@@ -1088,6 +1247,23 @@ _on_async_socket_reconnect(void* opaque)
 }
 
 
+/* Timer callback invoked to hand buffered data to the readers.
+ * Param:
+ *  as - Initialized AsyncSocket instance.
+ */
+static void
+_on_async_socket_read_buffered(void* opaque)
+{
+    AsyncSocket* as = (AsyncSocket*)opaque;
+
+    /* Reference the socket while we're working with it in this callback. */
+    async_socket_reference(as);
+    if (async_socket_is_connected(as)) {
+        _on_async_socket_recv(as);
+    }
+    async_socket_release(as);
+}
+
 /********************************************************************************
  *                  Android Device Socket public API
  *******************************************************************************/
@@ -1131,6 +1307,7 @@ async_socket_new(int port,
     }
 
     loopTimer_init(as->reconnect_timer, as->looper, _on_async_socket_reconnect, as);
+    loopTimer_init(as->read_timer, as->looper, _on_async_socket_read_buffered, as);
 
     T("ASocket %s: Descriptor is created.", _async_socket_string(as));
 
@@ -1220,6 +1397,10 @@ async_socket_read_abs(AsyncSocket* as,
             as->readers_tail = asr;
         }
         loopIo_wantRead(as->io);
+        /* The socket won't signal the data that has already been received. */
+        if (as->read_start != as->read_end) {
+            loopTimer_startRelative(as->read_timer, 0);
+        }
     } else {
         D("ASocket %s: Read on a disconnected socket.", _async_socket_string(as));
         errno = ECONNRESET;
@@ -32,6 +32,11 @@
  * operation results are reported back to the client of this API via set of
  * callbacks that client supplied to this API.
  *
+ * Any number of reads and writes can be queued on a socket. They complete in
+ * the order they have been queued. Data received ahead of the queued reads is
+ * kept by the socket for the next ones, and queued writes are sent together,
+ * so that a stream of small messages doesn't cost a system call each.
+ *
  * Since it's hard to control lifespan of an object in asynchronous environment,
  * we make AsyncSocketConnector a referenced object, that will self-destruct when
  * its reference count drops to zero, indicating that the last client has
@@ -27,6 +27,11 @@ ANDROID_BEGIN_HEADER
 //     }
 //     avdScanner_free(scanner);
 //
+// Note that the scan is a single read of the $ANDROID_SDK_HOME/avd/
+// directory, looking for <name>.ini files. The AVD content directories
+// and their config.ini files are never opened, so that listing remains
+// cheap even with hundreds of AVDs.
+//
 
 // Opaque type to an object used to scan all available AVDs
 // under $ANDROID_SDK_HOME.
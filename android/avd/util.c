@@ -13,8 +13,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "android/utils/debug.h"
 #include "android/utils/bufprint.h"
+#include "android/utils/dirscanner.h"
 #include "android/utils/ini.h"
 #include "android/utils/property_file.h"
 #include "android/utils/panic.h"
@@ -337,6 +345,298 @@ path_getAvdGpuMode(const char* avdName)
     return gpuMode;
 }
 
+/* Writes |value| in big-endian order at |p|, as stored in qcow2 headers. */
+static void
+_putBe32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static void
+_putBe64(uint8_t* p, uint64_t value)
+{
+    _putBe32(p, (uint32_t)(value >> 32));
+    _putBe32(p + 4, (uint32_t)value);
+}
+
+/* Create an empty qcow2 image at |path|, of |size| bytes, whose unwritten
+ * clusters are read from the |backing| image file. This writes the same
+ * layout as qcow_create2() in block/qcow2.c, which the launcher can't use:
+ * the header and backing file name in cluster 0, the L1 table from cluster
+ * 1, then the refcount table and its only refcount block. See QCowHeader
+ * in block/qcow2.h for the header fields.
+ */
+static int
+_createQcow2Overlay(const char* path, const char* backing, uint64_t size)
+{
+    const uint32_t clusterBits = 16;
+    const uint64_t clusterSize = 1ULL << clusterBits;
+    const uint64_t l2Coverage = clusterSize / 8 * clusterSize;
+    const size_t headerSize = 72;
+    size_t backingLen = strlen(backing);
+    uint64_t l1Size = (size + l2Coverage - 1) / l2Coverage;
+    uint64_t l1Clusters = (l1Size * 8 + clusterSize - 1) / clusterSize;
+    uint64_t refcountTableOffset = (1 + l1Clusters) * clusterSize;
+    uint64_t clusters = 3 + l1Clusters;
+    uint8_t* buf;
+    uint64_t n;
+    int fd, ret = 0;
+
+    if (l1Size == 0 || headerSize + backingLen > clusterSize ||
+        clusters > clusterSize / 2) {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    buf = android_alloc0(clusterSize);
+
+    _putBe32(buf, 0x514649fb);                    /* magic: 'QFI\xfb' */
+    _putBe32(buf + 4, 2);                         /* version */
+    _putBe64(buf + 8, headerSize);                /* backing_file_offset */
+    _putBe32(buf + 16, (uint32_t)backingLen);     /* backing_file_size */
+    _putBe32(buf + 20, clusterBits);
+    _putBe64(buf + 24, size);
+    _putBe32(buf + 32, 0);                        /* crypt_method */
+    _putBe32(buf + 36, (uint32_t)l1Size);
+    _putBe64(buf + 40, clusterSize);              /* l1_table_offset */
+    _putBe64(buf + 48, refcountTableOffset);
+    _putBe32(buf + 56, 1);                        /* refcount_table_clusters */
+    memcpy(buf + headerSize, backing, backingLen);
+    if (write(fd, buf, clusterSize) != (ssize_t)clusterSize) {
+        ret = -1;
+    }
+
+    /* The L1 table is all zeroes, leave a hole. */
+    memset(buf, 0, clusterSize);
+    _putBe64(buf, refcountTableOffset + clusterSize);
+    if (ret == 0 &&
+        (lseek(fd, refcountTableOffset, SEEK_SET) < 0 ||
+         write(fd, buf, clusterSize) != (ssize_t)clusterSize)) {
+        ret = -1;
+    }
+
+    memset(buf, 0, clusterSize);
+    for (n = 0; n < clusters; n++) {
+        buf[2 * n + 1] = 1;                       /* 16-bit refcounts */
+    }
+    if (ret == 0 && write(fd, buf, clusterSize) != (ssize_t)clusterSize) {
+        ret = -1;
+    }
+
+    AFREE(buf);
+    close(fd);
+    if (ret < 0) {
+        int savedErrno = errno;
+        path_delete_file(path);
+        errno = savedErrno;
+    }
+    return ret;
+}
+
+/* Clone the file or directory |name| of a golden AVD content directory
+ * |srcDir|, to the new content directory |dstDir|. Return 0 on success.
+ */
+static int
+_cloneAvdEntry(const char* srcDir, const char* dstDir, const char* name)
+{
+    char src[PATH_MAX], dst[PATH_MAX];
+    size_t len = strlen(name);
+    int ret;
+
+    if (bufprint(src, src + sizeof(src), "%s" PATH_SEP "%s",
+                 srcDir, name) >= src + sizeof(src) ||
+        bufprint(dst, dst + sizeof(dst), "%s" PATH_SEP "%s",
+                 dstDir, name) >= dst + sizeof(dst)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    /* Lock files belong to the running golden AVD, and hardware-qemu.ini
+     * is regenerated at each start, with absolute paths to its images. */
+    if ((len > 5 && !strcmp(name + len - 5, ".lock")) ||
+        !strcmp(name, "hardware-qemu.ini")) {
+        return 0;
+    }
+
+    if (path_is_dir(src)) {
+        /* The 'snapshots' directory holds the flat snapshot files of
+         * '-snapshot-flat <content>/snapshots', which are replaced instead
+         * of modified when saved. Hard links make them the shared read-only
+         * base snapshot of all the clones: restoring them maps their RAM
+         * pages from a single file, and so from the same page cache. */
+        DirScanner* scanner;
+        const char* entry;
+
+        if (strcmp(name, "snapshots") != 0) {
+            D("Not cloning directory %s", src);
+            return 0;
+        }
+        if (path_mkdir_if_needed(dst, 0755) < 0 ||
+            (scanner = dirScanner_new(src)) == NULL) {
+            return -1;
+        }
+        ret = 0;
+        while (ret == 0 && (entry = dirScanner_next(scanner)) != NULL) {
+            char from[PATH_MAX], to[PATH_MAX];
+            len = strlen(entry);
+            if (len <= 5 || strcmp(entry + len - 5, ".snap") != 0) {
+                continue;
+            }
+            bufprint(from, from + sizeof(from), "%s" PATH_SEP "%s",
+                     src, entry);
+            bufprint(to, to + sizeof(to), "%s" PATH_SEP "%s", dst, entry);
+#ifdef _WIN32
+            ret = path_copy_file(to, from);
+#else
+            ret = link(from, to);
+#endif
+        }
+        dirScanner_free(scanner);
+        return ret;
+    }
+
+    if (!strcmp(name, "config.ini")) {
+        /* Keep an SD Card image located in the golden AVD's directory
+         * pointing to the clone's one. */
+        IniFile* ini = iniFile_newFromFile(src);
+        const char* sdcard;
+        char prefix[PATH_MAX];
+        size_t prefixLen;
+
+        if (ini == NULL) {
+            return -1;
+        }
+        bufprint(prefix, prefix + sizeof(prefix), "%s" PATH_SEP, srcDir);
+        prefixLen = strlen(prefix);
+        sdcard = iniFile_getValue(ini, SDCARD_PATH);
+        if (sdcard && !strncmp(sdcard, prefix, prefixLen)) {
+            char temp[PATH_MAX];
+            bufprint(temp, temp + sizeof(temp), "%s" PATH_SEP "%s",
+                     dstDir, sdcard + prefixLen);
+            iniFile_setValue(ini, SDCARD_PATH, temp);
+        }
+        ret = iniFile_saveToFile(ini, dst);
+        iniFile_free(ini);
+        return ret;
+    }
+
+    if (len > 4 && !strcmp(name + len - 4, ".img")) {
+        uint64_t size;
+
+        if (path_clone_file(dst, src) == 0) {
+            D("Cloned %s to %s", src, dst);
+            return 0;
+        }
+        /* The SD Card image is the only writable image opened through the
+         * block layer with its format probed, which lets it be a qcow2
+         * overlay. The NAND partitions are read raw, and the qcow2 snapshot
+         * storage keeps its snapshots in the image itself. */
+        if (!strcmp(name, "sdcard.img") && path_get_size(src, &size) == 0 &&
+            _createQcow2Overlay(dst, src, size) == 0) {
+            D("Created %s as a qcow2 overlay of %s", dst, src);
+            return 0;
+        }
+        dwarning("Copying %s, the file system doesn't support clones", src);
+    }
+    return path_copy_file(dst, src);
+}
+
+int
+path_cloneAvd(const char* goldenName, const char* cloneName)
+{
+    char temp[PATH_MAX], *p = temp, *end = p + sizeof(temp);
+    char* iniPath = path_getRootIniPath(goldenName);
+    char* srcDir = NULL;
+    char* parentDir = NULL;
+    char* dstDir = NULL;
+    IniFile* ini = NULL;
+    DirScanner* scanner = NULL;
+    const char* name;
+    const char* relPath;
+    int ret = -1;
+
+    if (iniPath == NULL) {
+        derror("Unknown AVD name: %s", goldenName);
+        return -1;
+    }
+    ini = iniFile_newFromFile(iniPath);
+    if (ini == NULL) {
+        derror("Could not parse file: %s", iniPath);
+        goto EXIT;
+    }
+    AFREE(iniPath);
+    iniPath = NULL;
+
+    p = bufprint_avd_home_path(temp, end);
+    p = bufprint(p, end, PATH_SEP "%s.ini", cloneName);
+    if (p >= end || path_exists(temp)) {
+        derror("An AVD named '%s' already exists", cloneName);
+        goto EXIT;
+    }
+    iniPath = ASTRDUP(temp);
+
+    /* The clone's content directory goes next to the golden one. */
+    srcDir = _getAvdContentPath(goldenName);
+    if (srcDir == NULL || path_split(srcDir, &parentDir, NULL) < 0) {
+        derror("Could not find the content directory of AVD '%s'",
+               goldenName);
+        goto EXIT;
+    }
+    p = bufprint(temp, end, "%s" PATH_SEP "%s.avd", parentDir, cloneName);
+    if (p >= end || path_exists(temp)) {
+        derror("Clone directory already exists: %s", temp);
+        goto EXIT;
+    }
+    dstDir = ASTRDUP(temp);
+    if (path_mkdir_if_needed(dstDir, 0755) < 0 ||
+        (scanner = dirScanner_new(srcDir)) == NULL) {
+        derror("Could not create %s: %s", dstDir, strerror(errno));
+        goto EXIT;
+    }
+
+    while ((name = dirScanner_next(scanner)) != NULL) {
+        if (_cloneAvdEntry(srcDir, dstDir, name) < 0) {
+            derror("Could not clone %s" PATH_SEP "%s: %s", srcDir, name,
+                   strerror(errno));
+            derror("Please remove the incomplete clone: %s", dstDir);
+            goto EXIT;
+        }
+    }
+
+    /* Written last, so that only complete clones can be started. */
+    iniFile_setValue(ini, ROOT_ABS_PATH_KEY, dstDir);
+    relPath = iniFile_getValue(ini, ROOT_REL_PATH_KEY);
+    if (relPath != NULL) {
+        bufprint(temp, end, ANDROID_AVD_DIR PATH_SEP "%s.avd", cloneName);
+        iniFile_setValue(ini, ROOT_REL_PATH_KEY, temp);
+    }
+    if (iniFile_saveToFile(ini, iniPath) < 0) {
+        derror("Could not write %s: %s", iniPath, strerror(errno));
+        goto EXIT;
+    }
+    D("Cloned AVD '%s' to '%s' in %s", goldenName, cloneName, dstDir);
+    ret = 0;
+
+EXIT:
+    if (scanner) {
+        dirScanner_free(scanner);
+    }
+    if (ini) {
+        iniFile_free(ini);
+    }
+    AFREE(iniPath);
+    AFREE(srcDir);
+    AFREE(parentDir);
+    AFREE(dstDir);
+    return ret;
+}
+
 const char*
 emulator_getBackendSuffix(const char* targetArch)
 {
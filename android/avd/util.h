@@ -50,6 +50,21 @@ char* path_getAvdTargetArch( const char* avdName );
  */
 char* path_getAvdGpuMode(const char* avdName);
 
+/* Create a new AVD named |cloneName| as a clone of the |goldenName| one,
+ * with its content directory next to the golden AVD's one.
+ *
+ * The writable images are copy-on-write clones of the golden ones where
+ * the file system supports it, so that creating the clone only takes
+ * metadata, and untouched data is shared with the golden AVD. Otherwise,
+ * the SD Card becomes a qcow2 overlay of the golden one, and the other
+ * images are copied. The flat snapshot files of the golden AVD's
+ * 'snapshots' directory are hard-linked, as a base snapshot shared with
+ * all the clones. The golden AVD must not be modified after that.
+ *
+ * Return 0 on success, or -1 on failure, after printing an error message.
+ */
+int path_cloneAvd(const char* goldenName, const char* cloneName);
+
 typedef enum {
     RESULT_INVALID   = -1, // key was found but value contained invalid data
     RESULT_FOUND     =  0, // key was found and value parsed correctly
@@ -10,10 +10,37 @@
 // GNU General Public License for more details.
 
 #include "android/avd/util.h"
+#include "android/base/system/System.h"
+#include "android/base/testing/TestTempDir.h"
 #include "android/utils/file_data.h"
+#include "android/utils/ini.h"
+#include "android/utils/path.h"
+#include "android/utils/system.h"
 
 #include <gtest/gtest.h>
 
+#include <string.h>
+
+using android::base::String;
+using android::base::StringFormat;
+using android::base::System;
+using android::base::TestTempDir;
+
+static void writeFile(const String& path, const char* content) {
+  FILE* f = fopen(path.c_str(), "wb");
+  ASSERT_TRUE(f);
+  fputs(content, f);
+  fclose(f);
+}
+
+static String readFile(const String& path) {
+  size_t size = 0;
+  char* data = static_cast<char*>(path_load_file(path.c_str(), &size));
+  String result(data ? data : "", size);
+  free(data);
+  return result;
+}
+
 TEST(AvdUtil, emulator_getBackendSuffix) {
   EXPECT_STREQ("arm", emulator_getBackendSuffix("arm"));
   EXPECT_STREQ("x86", emulator_getBackendSuffix("x86"));
@@ -129,3 +156,61 @@ TEST(AvdUtil, propertyFile_getAdbdCommunicationMode) {
   EXPECT_EQ(0, propertyFile_getAdbdCommunicationMode(&fd));
 }
 
+
+TEST(AvdUtil, path_cloneAvd) {
+  TestTempDir dir("avdutil");
+  String oldHome;
+  if (System::get()->envGet("ANDROID_AVD_HOME")) {
+    oldHome = System::get()->envGet("ANDROID_AVD_HOME");
+  }
+  System::get()->envSet("ANDROID_AVD_HOME", dir.path());
+
+  String golden = dir.makeSubPath("golden.avd");
+  ASSERT_TRUE(dir.makeSubDir("golden.avd"));
+  ASSERT_TRUE(dir.makeSubDir("golden.avd/snapshots"));
+  writeFile(dir.makeSubPath("golden.ini"),
+            StringFormat("path=%s\ntarget=android-21\n",
+                         golden.c_str()).c_str());
+  writeFile(dir.makeSubPath("golden.avd/config.ini"),
+            StringFormat("hw.cpu.arch=x86\nsdcard.path=%s/sdcard.img\n",
+                         golden.c_str()).c_str());
+  writeFile(dir.makeSubPath("golden.avd/hardware-qemu.ini"), "x=y\n");
+  writeFile(dir.makeSubPath("golden.avd/userdata-qemu.img"), "userdata");
+  writeFile(dir.makeSubPath("golden.avd/sdcard.img"), "sdcard");
+  writeFile(dir.makeSubPath("golden.avd/snapshots/default.snap"), "snap");
+
+  EXPECT_EQ(0, path_cloneAvd("golden", "clone"));
+  // Neither name can be cloned to again.
+  EXPECT_EQ(-1, path_cloneAvd("golden", "clone"));
+  EXPECT_EQ(-1, path_cloneAvd("unknown", "clone2"));
+
+  String clone = dir.makeSubPath("clone.avd");
+  IniFile* ini = iniFile_newFromFile(dir.makeSubPath("clone.ini").c_str());
+  ASSERT_TRUE(ini);
+  EXPECT_STREQ(clone.c_str(), iniFile_getValue(ini, "path"));
+  EXPECT_STREQ("android-21", iniFile_getValue(ini, "target"));
+  iniFile_free(ini);
+
+  ini = iniFile_newFromFile(dir.makeSubPath("clone.avd/config.ini").c_str());
+  ASSERT_TRUE(ini);
+  EXPECT_STREQ("x86", iniFile_getValue(ini, "hw.cpu.arch"));
+  EXPECT_STREQ(StringFormat("%s/sdcard.img", clone.c_str()).c_str(),
+               iniFile_getValue(ini, "sdcard.path"));
+  iniFile_free(ini);
+
+  EXPECT_FALSE(path_exists(
+      dir.makeSubPath("clone.avd/hardware-qemu.ini").c_str()));
+  EXPECT_STREQ("userdata",
+               readFile(dir.makeSubPath("clone.avd/userdata-qemu.img")).c_str());
+  EXPECT_STREQ("snap",
+               readFile(dir.makeSubPath("clone.avd/snapshots/default.snap")).c_str());
+
+  // Without copy-on-write support, the SD Card is a qcow2 overlay.
+  String sdcard = readFile(dir.makeSubPath("clone.avd/sdcard.img"));
+  if (strcmp(sdcard.c_str(), "sdcard")) {
+    EXPECT_EQ(0, memcmp(sdcard.c_str(), "QFI\xfb", 4));
+  }
+
+  System::get()->envSet("ANDROID_AVD_HOME", oldHome.size() ? oldHome.c_str()
+                                                           : NULL);
+}
@@ -0,0 +1,418 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/AsyncLog.h"
+
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/threads/Thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+// NOTE: This file must not use LOG() and friends, since android/base/Log.cpp
+// writes its messages through the AsyncLog.
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Each message is stored in a ring as a RecordHeader followed by its data,
+// padded to kRecordAlignment bytes. A record never wraps around the end of
+// the ring: when it doesn't fit there, the end of the ring is skipped,
+// and marked with a header whose size is kPaddingSize if there is room for
+// one.
+struct RecordHeader {
+    FILE* file;
+    uint32_t size;
+};
+
+const uint32_t kRecordAlignment = 8;
+const uint32_t kPaddingSize = 0xffffffffU;
+
+// Maximum number of distinct files the writer flushes after a pass, it
+// uses fflush(NULL) when there are more.
+const int kMaxFlushedFiles = 8;
+
+uint32_t recordSize(size_t len) {
+    return (uint32_t)((sizeof(RecordHeader) + len + kRecordAlignment - 1) &
+                      ~(size_t)(kRecordAlignment - 1));
+}
+
+}  // namespace
+
+// A single-producer, single-consumer ring. The producer is the thread that
+// owns it and only updates |writePos| and |dropped|, while the writer only
+// updates |readPos| and |droppedReported|. Positions are free-running
+// counters, their value modulo |size| is the offset in |data|.
+// Rings are never freed until the AsyncLog is destroyed: when its thread
+// exits, a ring is released and reused by the next new thread.
+struct AsyncLog::Ring {
+    explicit Ring(size_t ringSize) :
+            next(NULL),
+            owned(1),
+            writePos(0),
+            readPos(0),
+            dropped(0),
+            droppedReported(0),
+            size((uint32_t)ringSize),
+            data(static_cast<char*>(::malloc(ringSize))) {}
+
+    ~Ring() {
+        ::free(data);
+    }
+
+    Ring* next;
+    volatile int owned;
+    volatile uint32_t writePos;
+    volatile uint32_t readPos;
+    volatile uint32_t dropped;
+    uint32_t droppedReported;
+    uint32_t size;
+    char* data;
+};
+
+class AsyncLog::Writer : public Thread {
+public:
+    explicit Writer(AsyncLog* log) : Thread(), mLog(log) {}
+
+    virtual intptr_t main() {
+#ifndef _WIN32
+        // Let the other threads handle all signals.
+        sigset_t set;
+        sigfillset(&set);
+        pthread_sigmask(SIG_SETMASK, &set, NULL);
+#endif
+        mLog->runWriter();
+        return 0;
+    }
+
+private:
+    AsyncLog* mLog;
+};
+
+AsyncLog::AsyncLog(size_t ringSize) :
+        mRingSize(ringSize),
+        mRings(NULL),
+        mRingStore(releaseRing),
+        mWriter(NULL),
+        mLock(),
+        mCanWrite(),
+        mFlushed(),
+        mWriterWaiting(0),
+        mFlushRequests(0),
+        mFlushesDone(0),
+        mFlushWaiters(0),
+        mExiting(false) {
+    mWriter = new Writer(this);
+    if (!mWriter->start()) {
+        fprintf(stderr, "Could not start log writer thread\n");
+        abort();
+    }
+}
+
+AsyncLog::~AsyncLog() {
+    {
+        AutoLock lock(mLock);
+        mExiting = true;
+        mCanWrite.signal();
+    }
+    mWriter->wait(NULL);
+    delete mWriter;
+
+    Ring* ring = mRings;
+    while (ring) {
+        Ring* next = ring->next;
+        delete ring;
+        ring = next;
+    }
+}
+
+namespace {
+
+void flushAtExit();
+
+struct SharedAsyncLog {
+    SharedAsyncLog() : log(AsyncLog::kDefaultRingSize) {
+        atexit(flushAtExit);
+    }
+
+    AsyncLog log;
+};
+
+LazyInstance<SharedAsyncLog> sSharedLog = LAZY_INSTANCE_INIT;
+
+volatile int sStarted = 0;
+
+void flushAtExit() {
+    sSharedLog->log.flush();
+}
+
+}  // namespace
+
+// static
+void AsyncLog::start() {
+    sSharedLog.ptr();
+    __sync_synchronize();
+    sStarted = 1;
+}
+
+// static
+bool AsyncLog::isStarted() {
+    return sStarted != 0;
+}
+
+// static
+AsyncLog* AsyncLog::get() {
+    return &sSharedLog->log;
+}
+
+void AsyncLog::vprint(FILE* file, const char* format, va_list args) {
+    char temp[1024];
+    char* message = temp;
+    size_t capacity = sizeof(temp);
+    for (;;) {
+        va_list args2;
+        va_copy(args2, args);
+        int ret = vsnprintf(message, capacity, format, args2);
+        va_end(args2);
+        if (ret >= 0 && size_t(ret) < capacity) {
+            write(file, message, size_t(ret));
+            break;
+        }
+        // The message can't be larger than a ring anyway.
+        if (capacity >= mRingSize) {
+            write(file, message, capacity - 1);
+            break;
+        }
+        capacity *= 2;
+        if (message != temp) {
+            ::free(message);
+        }
+        message = static_cast<char*>(::malloc(capacity));
+    }
+    if (message != temp) {
+        ::free(message);
+    }
+}
+
+void AsyncLog::print(FILE* file, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vprint(file, format, args);
+    va_end(args);
+}
+
+void AsyncLog::write(FILE* file, const char* data, size_t len) {
+    Ring* ring = getRing();
+    const uint32_t size = ring->size;
+    const size_t maxLen = size / 4 - sizeof(RecordHeader);
+    if (len > maxLen) {
+        len = maxLen;
+    }
+
+    uint32_t total = recordSize(len);
+    uint32_t writePos = ring->writePos;
+    uint32_t offset = writePos & (size - 1);
+    uint32_t skip = (size - offset < total) ? size - offset : 0;
+
+    if (size - (writePos - ring->readPos) < skip + total) {
+        ring->dropped++;
+        return;
+    }
+    // Don't overwrite data before the writer is done reading it.
+    __sync_synchronize();
+
+    if (skip >= sizeof(RecordHeader)) {
+        RecordHeader padding = { NULL, kPaddingSize };
+        ::memcpy(ring->data + offset, &padding, sizeof(padding));
+    }
+    offset = (writePos + skip) & (size - 1);
+
+    RecordHeader header = { file, (uint32_t)len };
+    ::memcpy(ring->data + offset, &header, sizeof(header));
+    ::memcpy(ring->data + offset + sizeof(header), data, len);
+
+    // Publish the record, then wake up the writer if it is waiting.
+    __sync_synchronize();
+    ring->writePos = writePos + skip + total;
+    __sync_synchronize();
+    if (mWriterWaiting) {
+        AutoLock lock(mLock);
+        mCanWrite.signal();
+    }
+}
+
+void AsyncLog::flush() {
+    AutoLock lock(mLock);
+    uint64_t request = ++mFlushRequests;
+    mFlushWaiters++;
+    mCanWrite.signal();
+    while (mFlushesDone < request) {
+        mFlushed.wait(&mLock);
+    }
+    mFlushWaiters--;
+}
+
+uint64_t AsyncLog::getDroppedCount() const {
+    uint64_t count = 0;
+    for (Ring* ring = mRings; ring; ring = ring->next) {
+        count += ring->dropped;
+    }
+    return count;
+}
+
+AsyncLog::Ring* AsyncLog::getRing() {
+    Ring* ring = static_cast<Ring*>(mRingStore.get());
+    if (ring) {
+        return ring;
+    }
+    // Reuse the ring of a thread that exited, if any.
+    for (Ring* r = mRings; r; r = r->next) {
+        if (!r->owned && __sync_bool_compare_and_swap(&r->owned, 0, 1)) {
+            ring = r;
+            break;
+        }
+    }
+    if (!ring) {
+        // Rings are only ever added at the head of the list.
+        ring = new Ring(mRingSize);
+        do {
+            ring->next = mRings;
+        } while (!__sync_bool_compare_and_swap(&mRings, ring->next, ring));
+    }
+    mRingStore.set(ring);
+    return ring;
+}
+
+// static
+void AsyncLog::releaseRing(void* opaque) {
+    Ring* ring = static_cast<Ring*>(opaque);
+    __sync_synchronize();
+    ring->owned = 0;
+}
+
+bool AsyncLog::isEmpty() const {
+    for (Ring* ring = mRings; ring; ring = ring->next) {
+        if (ring->readPos != ring->writePos) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write all the records of |ring|, and add their files to |files|.
+// Return true if there was any.
+bool AsyncLog::drainRing(Ring* ring, FILE** files, int* fileCount) {
+    const uint32_t size = ring->size;
+    uint32_t readPos = ring->readPos;
+    uint32_t writePos = ring->writePos;
+    if (readPos == writePos) {
+        return false;
+    }
+    // Don't read data before it was published.
+    __sync_synchronize();
+
+    while (readPos != writePos) {
+        uint32_t offset = readPos & (size - 1);
+        RecordHeader header;
+        if (size - offset < sizeof(RecordHeader)) {
+            readPos += size - offset;
+            continue;
+        }
+        ::memcpy(&header, ring->data + offset, sizeof(header));
+        if (header.size == kPaddingSize) {
+            readPos += size - offset;
+            continue;
+        }
+
+        uint32_t dropped = ring->dropped;
+        if (dropped != ring->droppedReported) {
+            fprintf(header.file, "<%u log messages dropped>\n",
+                    dropped - ring->droppedReported);
+            ring->droppedReported = dropped;
+        }
+        fwrite(ring->data + offset + sizeof(header), 1, header.size,
+               header.file);
+
+        // A count larger than kMaxFlushedFiles means all files.
+        if (*fileCount <= kMaxFlushedFiles) {
+            int n = 0;
+            while (n < *fileCount && files[n] != header.file) {
+                n++;
+            }
+            if (n == *fileCount) {
+                if (n < kMaxFlushedFiles) {
+                    files[n] = header.file;
+                }
+                (*fileCount)++;
+            }
+        }
+
+        readPos += recordSize(header.size);
+        __sync_synchronize();
+        ring->readPos = readPos;
+    }
+    return true;
+}
+
+void AsyncLog::runWriter() {
+    for (;;) {
+        mLock.lock();
+        // Everything published before these are read is written below.
+        uint64_t requests = mFlushRequests;
+        bool exiting = mExiting;
+        mLock.unlock();
+
+        FILE* files[kMaxFlushedFiles];
+        int fileCount = 0;
+        bool busy = false;
+        for (Ring* ring = mRings; ring; ring = ring->next) {
+            busy |= drainRing(ring, files, &fileCount);
+        }
+        if (fileCount > kMaxFlushedFiles) {
+            fflush(NULL);
+        } else {
+            for (int n = 0; n < fileCount; ++n) {
+                fflush(files[n]);
+            }
+        }
+
+        AutoLock lock(mLock);
+        if (mFlushesDone < requests) {
+            mFlushesDone = requests;
+            for (int n = 0; n < mFlushWaiters; ++n) {
+                mFlushed.signal();
+            }
+        }
+        if (exiting) {
+            break;
+        }
+        if (!busy && !mExiting && mFlushRequests == requests) {
+            mWriterWaiting = 1;
+            __sync_synchronize();
+            if (isEmpty()) {
+                mCanWrite.wait(&mLock);
+            }
+            mWriterWaiting = 0;
+        }
+    }
+}
+
+}  // namespace base
+}  // namespace android
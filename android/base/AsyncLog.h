@@ -0,0 +1,133 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_ASYNC_LOG_H
+#define ANDROID_BASE_ASYNC_LOG_H
+
+#include "android/base/Compiler.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/ThreadStore.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace android {
+namespace base {
+
+// An AsyncLog moves the cost of writing log messages out of the threads
+// that produce them, e.g. vCPU or render threads.
+//
+// Each thread that logs gets its own bounded ring buffer, and a log
+// message is appended to it without taking any lock or making any system
+// call. A background writer thread drains all the rings and writes the
+// messages to their FILE*, then flushes them.
+//
+// A thread doesn't wait when its ring is full: the message is dropped and
+// counted instead. The writer notes the number of dropped messages in the
+// output before the next message of the same thread.
+//
+// Messages from a given thread are written in order, but messages from
+// different threads can be reordered.
+//
+// Since the writer only writes a message later, the FILE* it targets must
+// not be closed before flush() is called, and anything written to it
+// without the AsyncLog must be preceded by a flush() too, to preserve
+// the order of the output.
+//
+// Usage example:
+//
+//    AsyncLog::get()->print(stderr, "Value is %d\n", value);
+//
+class AsyncLog {
+public:
+    // Default size in bytes of each thread's ring.
+    static const size_t kDefaultRingSize = 64 * 1024;
+
+    // Create a new instance, whose threads use rings of |ringSize| bytes.
+    // |ringSize| must be a power of 2. The writer thread is started
+    // immediately.
+    explicit AsyncLog(size_t ringSize);
+
+    // Destructor. Writes all pending messages, then stops the writer.
+    // No other thread must use the instance at this point.
+    ~AsyncLog();
+
+    // Start the instance shared by the whole program. Until this is
+    // called, isStarted() returns false and the callers are expected to
+    // write their messages directly. Pending messages are written when
+    // the program exits through exit().
+    static void start();
+
+    // Return true if start() was called.
+    static bool isStarted();
+
+    // Return the instance shared by the whole program, started on demand.
+    static AsyncLog* get();
+
+    // Queue the printf()-like message given by |format| and |args| for
+    // |file|. The message is formatted by the calling thread, because
+    // its arguments may not outlive the call.
+    void vprint(FILE* file, const char* format, va_list args);
+
+    // Same as vprint(), with variable arguments.
+    void print(FILE* file, const char* format, ...);
+
+    // Queue |len| bytes from |data| for |file|. Data that is larger than
+    // a quarter of the ring is truncated.
+    void write(FILE* file, const char* data, size_t len);
+
+    // Wait until all messages queued by any thread before this call have
+    // been written, and their FILE* flushed. Must not be called from the
+    // writer thread.
+    void flush();
+
+    // Return the total number of dropped messages.
+    uint64_t getDroppedCount() const;
+
+private:
+    struct Ring;
+    class Writer;
+
+    Ring* getRing();
+    bool isEmpty() const;
+    bool drainRing(Ring* ring, FILE** files, int* fileCount);
+    void runWriter();
+    static void releaseRing(void* ring);
+
+    size_t mRingSize;
+    Ring* volatile mRings;
+    ThreadStoreBase mRingStore;
+    Writer* mWriter;
+    // The lock and condition variables are only used when the writer
+    // has nothing to do, or when a thread waits in flush(). Setting
+    // mWriterWaiting tells the logging threads that they must signal it.
+    Lock mLock;
+    ConditionVariable mCanWrite;
+    ConditionVariable mFlushed;
+    volatile int mWriterWaiting;
+    uint64_t mFlushRequests;
+    uint64_t mFlushesDone;
+    int mFlushWaiters;
+    bool mExiting;
+
+    DISALLOW_COPY_AND_ASSIGN(AsyncLog);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_ASYNC_LOG_H
@@ -0,0 +1,177 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/AsyncLog.h"
+
+#include "android/base/threads/Thread.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Return the content of |file|.
+std::string readFile(FILE* file) {
+    std::string result;
+    char buffer[256];
+    size_t len;
+    rewind(file);
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        result.append(buffer, len);
+    }
+    return result;
+}
+
+// A thread that logs |count| numbered messages.
+class LogThread : public Thread {
+public:
+    LogThread(AsyncLog* log, FILE* file, int id, int count) :
+            Thread(), mLog(log), mFile(file), mId(id), mCount(count) {}
+
+    virtual intptr_t main() {
+        for (int n = 0; n < mCount; ++n) {
+            mLog->print(mFile, "T%d %d\n", mId, n);
+        }
+        return 0;
+    }
+
+private:
+    AsyncLog* mLog;
+    FILE* mFile;
+    int mId;
+    int mCount;
+};
+
+}  // namespace
+
+TEST(AsyncLog, WritesMessages) {
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file);
+    {
+        AsyncLog log(4096);
+        log.print(file, "Hello %d\n", 42);
+        log.write(file, "World\n", 6);
+        log.flush();
+        EXPECT_EQ(std::string("Hello 42\nWorld\n"), readFile(file));
+        EXPECT_EQ(0U, log.getDroppedCount());
+    }
+    fclose(file);
+}
+
+TEST(AsyncLog, WritesPendingMessagesOnDestruction) {
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file);
+    {
+        AsyncLog log(4096);
+        log.print(file, "Bye\n");
+    }
+    EXPECT_EQ(std::string("Bye\n"), readFile(file));
+    fclose(file);
+}
+
+TEST(AsyncLog, WrapsAroundTheRing) {
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file);
+    std::string expected;
+    {
+        AsyncLog log(1024);
+        for (int n = 0; n < 100; ++n) {
+            char line[64];
+            snprintf(line, sizeof(line), "%*d\n", 10 + n % 40, n);
+            expected += line;
+            log.print(file, "%s", line);
+            log.flush();
+        }
+        EXPECT_EQ(0U, log.getDroppedCount());
+    }
+    EXPECT_EQ(expected, readFile(file));
+    fclose(file);
+}
+
+TEST(AsyncLog, TruncatesLargeMessages) {
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file);
+    {
+        AsyncLog log(1024);
+        std::string message(1000, 'x');
+        log.print(file, "%s", message.c_str());
+        log.flush();
+    }
+    std::string result = readFile(file);
+    EXPECT_GT(result.size(), 0U);
+    EXPECT_LE(result.size(), 1024U / 4);
+    EXPECT_EQ(std::string(result.size(), 'x'), result);
+    fclose(file);
+}
+
+TEST(AsyncLog, KeepsOrderOfEachThread) {
+    const int kThreadCount = 4;
+    const int kMessageCount = 1000;
+
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file);
+    uint64_t dropped;
+    {
+        AsyncLog log(AsyncLog::kDefaultRingSize);
+        LogThread* threads[kThreadCount];
+        for (int n = 0; n < kThreadCount; ++n) {
+            threads[n] = new LogThread(&log, file, n, kMessageCount);
+            ASSERT_TRUE(threads[n]->start());
+        }
+        for (int n = 0; n < kThreadCount; ++n) {
+            EXPECT_TRUE(threads[n]->wait(NULL));
+            delete threads[n];
+        }
+        log.flush();
+        dropped = log.getDroppedCount();
+    }
+
+    // Messages may be dropped if the writer can't keep up, but the others
+    // must appear in order.
+    std::string result = readFile(file);
+    int next[kThreadCount] = { 0 };
+    int count = 0;
+    uint64_t droppedNoted = 0;
+    const char* line = result.c_str();
+    while (*line) {
+        int id, value;
+        unsigned notes;
+        if (sscanf(line, "T%d %d", &id, &value) == 2) {
+            ASSERT_GE(id, 0);
+            ASSERT_LT(id, kThreadCount);
+            EXPECT_LE(next[id], value);
+            next[id] = value + 1;
+            count++;
+        } else {
+            ASSERT_EQ(1, sscanf(line, "<%u log messages dropped>", &notes));
+            droppedNoted += notes;
+        }
+        line = strchr(line, '\n');
+        ASSERT_TRUE(line);
+        line++;
+    }
+    EXPECT_EQ(uint64_t(kThreadCount * kMessageCount), count + dropped);
+    EXPECT_GE(dropped, droppedNoted);
+    fclose(file);
+}
+
+}  // namespace base
+}  // namespace android
@@ -9,9 +9,11 @@
 // MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 // GNU General Public License for more details.
 
-#define __STDC_LIMIT_MACROS
+#include "android/base/Limits.h"
 #include "android/base/Log.h"
 
+#include "android/base/AsyncLog.h"
+
 #include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -42,6 +44,22 @@ const char* severityLevelToString(LogSeverity severity) {
 void defaultLogMessage(const LogParams& params,
                        const char* message,
                        size_t messageLen) {
+    if (AsyncLog::isStarted()) {
+        // Info and warning messages are written by the log writer thread,
+        // so that they don't slow down the calling thread. Errors are
+        // still written right away, in case the program crashes next.
+        if (params.severity < LOG_ERROR) {
+            AsyncLog::get()->print(stderr,
+                                   "%s:%s:%d:%.*s\n",
+                                   severityLevelToString(params.severity),
+                                   params.file,
+                                   params.lineno,
+                                   int(messageLen),
+                                   message);
+            return;
+        }
+        AsyncLog::get()->flush();
+    }
     fprintf(stderr,
             "%s:%s:%d:%.*s\n",
             severityLevelToString(params.severity),
@@ -0,0 +1,322 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/Metrics.h"
+
+#include "android/base/Limits.h"
+#include "android/base/Log.h"
+#include "android/base/StringFormat.h"
+#include "android/base/memory/LazyInstance.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+namespace android {
+namespace base {
+
+Metric::Metric(Type type,
+               const char* name,
+               const char* labels,
+               const char* help) :
+        mNext(NULL),
+        mType(type),
+        mName(name),
+        mLabels(labels ? labels : ""),
+        mHelp(help ? help : "") {}
+
+Histogram::Histogram(const char* name, const char* labels, const char* help) :
+        Metric(kTypeHistogram, name, labels, help),
+        mCount(0),
+        mSum(0) {
+    for (int n = 0; n < kBucketCount; ++n) {
+        mBuckets[n] = 0;
+    }
+}
+
+void Histogram::record(uint64_t value) {
+    int bucket = 0;
+    if (value > 1) {
+        bucket = 64 - __builtin_clzll(value - 1);
+        if (bucket >= kBucketCount) {
+            bucket = kBucketCount - 1;
+        }
+    }
+    __sync_fetch_and_add(&mBuckets[bucket], 1);
+    __sync_fetch_and_add(&mSum, value);
+    __sync_fetch_and_add(&mCount, 1);
+}
+
+uint64_t Histogram::percentileBound(int percent) const {
+    // The buckets are read one at a time, so their total can differ from
+    // |mCount| while values are recorded.
+    uint64_t counts[kBucketCount];
+    uint64_t total = 0;
+    for (int n = 0; n < kBucketCount; ++n) {
+        counts[n] = mBuckets[n];
+        total += counts[n];
+    }
+    if (!total) {
+        return 0;
+    }
+    uint64_t target = (total * percent + 99) / 100;
+    if (!target) {
+        target = 1;
+    }
+    uint64_t sum = 0;
+    for (int n = 0; n < kBucketCount - 1; ++n) {
+        sum += counts[n];
+        if (sum >= target) {
+            return 1ULL << n;
+        }
+    }
+    return UINT64_MAX;
+}
+
+class MetricsRegistry::CallbackMetric : public Metric {
+public:
+    CallbackMetric(Type type,
+                   const char* name,
+                   const char* labels,
+                   const char* help,
+                   CallbackFunction* func,
+                   void* opaque) :
+            Metric(type, name, labels, help), mFunc(func), mOpaque(opaque) {}
+
+    virtual int64_t value() const { return mFunc(mOpaque); }
+
+private:
+    CallbackFunction* mFunc;
+    void* mOpaque;
+};
+
+MetricsRegistry::MetricsRegistry() : mFirst(NULL), mLast(NULL), mLock() {}
+
+MetricsRegistry::~MetricsRegistry() {
+    Metric* metric = mFirst;
+    while (metric) {
+        Metric* next = metric->mNext;
+        delete metric;
+        metric = next;
+    }
+}
+
+namespace {
+
+LazyInstance<MetricsRegistry> sRegistry = LAZY_INSTANCE_INIT;
+
+const char* const kTypeNames[] = { "counter", "gauge", "histogram" };
+
+// Append |name|, followed by |labels| and |extraLabel| in braces if any
+// of them isn't empty, to |out|.
+void appendMetricName(String* out,
+                      const char* name,
+                      const char* labels,
+                      const char* extraLabel) {
+    out->append(name);
+    if (!labels[0] && !extraLabel[0]) {
+        return;
+    }
+    out->append('{');
+    out->append(labels);
+    if (labels[0] && extraLabel[0]) {
+        out->append(',');
+    }
+    out->append(extraLabel);
+    out->append('}');
+}
+
+}  // namespace
+
+// static
+MetricsRegistry* MetricsRegistry::get() {
+    return sRegistry.ptr();
+}
+
+Metric* MetricsRegistry::find(const char* name,
+                              const char* labels,
+                              Metric::Type type) {
+    if (!labels) {
+        labels = "";
+    }
+    for (Metric* metric = mFirst; metric; metric = metric->mNext) {
+        if (strcmp(metric->name(), name)) {
+            continue;
+        }
+        CHECK(metric->type() == type) << "Metric " << name
+                                      << " registered with another type";
+        if (!strcmp(metric->labels(), labels)) {
+            return metric;
+        }
+    }
+    return NULL;
+}
+
+void MetricsRegistry::add(Metric* metric) {
+    // Publish the metric only once it is fully constructed.
+    __sync_synchronize();
+    if (mLast) {
+        mLast->mNext = metric;
+    } else {
+        mFirst = metric;
+    }
+    mLast = metric;
+}
+
+Counter* MetricsRegistry::counter(const char* name,
+                                  const char* labels,
+                                  const char* help) {
+    AutoLock lock(mLock);
+    Metric* metric = find(name, labels, Metric::kTypeCounter);
+    if (!metric) {
+        metric = new Counter(name, labels, help);
+        add(metric);
+    }
+    return static_cast<Counter*>(metric);
+}
+
+Gauge* MetricsRegistry::gauge(const char* name,
+                              const char* labels,
+                              const char* help) {
+    AutoLock lock(mLock);
+    Metric* metric = find(name, labels, Metric::kTypeGauge);
+    if (!metric) {
+        metric = new Gauge(name, labels, help);
+        add(metric);
+    }
+    return static_cast<Gauge*>(metric);
+}
+
+Histogram* MetricsRegistry::histogram(const char* name,
+                                      const char* labels,
+                                      const char* help) {
+    AutoLock lock(mLock);
+    Metric* metric = find(name, labels, Metric::kTypeHistogram);
+    if (!metric) {
+        metric = new Histogram(name, labels, help);
+        add(metric);
+    }
+    return static_cast<Histogram*>(metric);
+}
+
+void MetricsRegistry::addCallback(Metric::Type type,
+                                  const char* name,
+                                  const char* labels,
+                                  const char* help,
+                                  CallbackFunction* func,
+                                  void* opaque) {
+    CHECK(type != Metric::kTypeHistogram);
+    AutoLock lock(mLock);
+    CHECK(!find(name, labels, type)) << "Metric " << name
+                                     << " already registered";
+    add(new CallbackMetric(type, name, labels, help, func, opaque));
+}
+
+void MetricsRegistry::print(const char* prefix,
+                            LineFunction* func,
+                            void* opaque) const {
+    size_t prefixLen = prefix ? strlen(prefix) : 0;
+    String line;
+    for (Metric* metric = mFirst; metric; metric = metric->mNext) {
+        if (prefixLen && strncmp(metric->name(), prefix, prefixLen)) {
+            continue;
+        }
+        line.clear();
+        appendMetricName(&line, metric->name(), metric->labels(), "");
+        if (metric->type() != Metric::kTypeHistogram) {
+            StringAppendFormat(&line, ": %" PRId64 "\r\n", metric->value());
+        } else {
+            const Histogram* h = static_cast<const Histogram*>(metric);
+            uint64_t count = h->count();
+            uint64_t sum = h->sum();
+            StringAppendFormat(&line, ": count=%" PRIu64 " sum=%" PRIu64
+                               " mean=%.1f",
+                               count, sum, count ? (double)sum / count : 0.);
+            static const int kPercents[] = { 50, 90, 99 };
+            for (size_t n = 0; n < sizeof(kPercents) / sizeof(kPercents[0]);
+                 ++n) {
+                uint64_t bound = h->percentileBound(kPercents[n]);
+                if (bound == UINT64_MAX) {
+                    StringAppendFormat(&line, " p%d>%" PRIu64, kPercents[n],
+                                       1ULL << (Histogram::kBucketCount - 2));
+                } else {
+                    StringAppendFormat(&line, " p%d<=%" PRIu64, kPercents[n],
+                                       bound);
+                }
+            }
+            line.append("\r\n");
+        }
+        func(opaque, line.c_str());
+    }
+}
+
+void MetricsRegistry::writePrometheus(String* out) const {
+    // All the metrics that share a name are written after a single
+    // HELP/TYPE header, as the format requires, in registration order.
+    for (Metric* metric = mFirst; metric; metric = metric->mNext) {
+        bool first = true;
+        for (Metric* m = mFirst; m != metric; m = m->mNext) {
+            if (!strcmp(m->name(), metric->name())) {
+                first = false;
+                break;
+            }
+        }
+        if (!first) {
+            continue;
+        }
+        const char* name = metric->name();
+        StringAppendFormat(out, "# HELP %s %s\n# TYPE %s %s\n",
+                           name, metric->help(),
+                           name, kTypeNames[metric->type()]);
+
+        for (Metric* m = metric; m; m = m->mNext) {
+            if (strcmp(m->name(), name)) {
+                continue;
+            }
+            if (m->type() != Metric::kTypeHistogram) {
+                appendMetricName(out, name, m->labels(), "");
+                StringAppendFormat(out, " %" PRId64 "\n", m->value());
+                continue;
+            }
+            const Histogram* h = static_cast<const Histogram*>(m);
+            String bucketName(name);
+            bucketName.append("_bucket");
+            uint64_t cumulated = 0;
+            for (int n = 0; n < Histogram::kBucketCount; ++n) {
+                cumulated += h->bucketCount(n);
+                String le;
+                if (n < Histogram::kBucketCount - 1) {
+                    le = StringFormat("le=\"%" PRIu64 "\"", 1ULL << n);
+                } else {
+                    le = "le=\"+Inf\"";
+                }
+                appendMetricName(out, bucketName.c_str(), m->labels(),
+                                 le.c_str());
+                StringAppendFormat(out, " %" PRIu64 "\n", cumulated);
+            }
+            // Report the bucket total as the count, so that the +Inf
+            // bucket and the count always match.
+            String sumName(name);
+            sumName.append("_sum");
+            appendMetricName(out, sumName.c_str(), m->labels(), "");
+            StringAppendFormat(out, " %" PRIu64 "\n", h->sum());
+            String countName(name);
+            countName.append("_count");
+            appendMetricName(out, countName.c_str(), m->labels(), "");
+            StringAppendFormat(out, " %" PRIu64 "\n", cumulated);
+        }
+    }
+}
+
+}  // namespace base
+}  // namespace android
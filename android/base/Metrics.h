@@ -0,0 +1,206 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_METRICS_H
+#define ANDROID_BASE_METRICS_H
+
+#include "android/base/Compiler.h"
+#include "android/base/String.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <stdint.h>
+
+namespace android {
+namespace base {
+
+// A registry of named performance metrics, that any thread can update
+// without taking a lock, and that can be printed at any time.
+//
+// Each metric has a name, e.g. "emulator_nand_ops_total", and optional
+// labels in the Prometheus syntax, e.g. 'op="read"'. Metrics with the
+// same name and different labels are reported together.
+//
+// There are three kinds of metrics:
+//
+//  - A Counter only goes up, e.g. the number of NAND reads.
+//  - A Gauge is the current value of something, e.g. a queue length.
+//  - A Histogram counts the values it records, e.g. latencies, in
+//    buckets whose upper bounds are powers of 2, and keeps their sum.
+//
+// Counters and gauges can also be computed by a callback when they are
+// printed, to expose values that are already counted elsewhere.
+//
+// Metrics are never unregistered: the pointers returned by the registry
+// are valid until it is destroyed, and are meant to be looked up once and
+// kept by their users.
+//
+// Usage example:
+//
+//    static Counter* sReads = MetricsRegistry::get()->counter(
+//            "emulator_nand_ops_total", "op=\"read\"",
+//            "Number of NAND operations");
+//    ...
+//    sReads->add(1);
+//
+class Metric {
+public:
+    enum Type {
+        kTypeCounter = 0,
+        kTypeGauge,
+        kTypeHistogram,
+    };
+
+    Type type() const { return mType; }
+    const char* name() const { return mName.c_str(); }
+    const char* labels() const { return mLabels.c_str(); }
+    const char* help() const { return mHelp.c_str(); }
+
+protected:
+    Metric(Type type, const char* name, const char* labels, const char* help);
+    virtual ~Metric() {}
+
+    // Return the current value of a counter or gauge.
+    virtual int64_t value() const = 0;
+
+private:
+    friend class MetricsRegistry;
+
+    Metric* volatile mNext;
+    Type mType;
+    String mName;
+    String mLabels;
+    String mHelp;
+
+    DISALLOW_COPY_AND_ASSIGN(Metric);
+};
+
+class Counter : public Metric {
+public:
+    void add(int64_t delta) { __sync_fetch_and_add(&mValue, delta); }
+    virtual int64_t value() const { return mValue; }
+
+private:
+    friend class MetricsRegistry;
+
+    Counter(const char* name, const char* labels, const char* help) :
+            Metric(kTypeCounter, name, labels, help), mValue(0) {}
+
+    volatile int64_t mValue;
+};
+
+class Gauge : public Metric {
+public:
+    void set(int64_t value) { mValue = value; }
+    void add(int64_t delta) { __sync_fetch_and_add(&mValue, delta); }
+    virtual int64_t value() const { return mValue; }
+
+private:
+    friend class MetricsRegistry;
+
+    Gauge(const char* name, const char* labels, const char* help) :
+            Metric(kTypeGauge, name, labels, help), mValue(0) {}
+
+    volatile int64_t mValue;
+};
+
+class Histogram : public Metric {
+public:
+    // Bucket |n| counts the values up to 2^n, the last one all the others.
+    static const int kBucketCount = 24;
+
+    // Record |value|. Histograms can't record negative values.
+    void record(uint64_t value);
+
+    uint64_t count() const { return mCount; }
+    uint64_t sum() const { return mSum; }
+    uint64_t bucketCount(int bucket) const { return mBuckets[bucket]; }
+
+    // Return an upper bound of the |percent|-th percentile of the recorded
+    // values, i.e. the bound of the bucket that contains it, or 0 if the
+    // histogram is empty. Return UINT64_MAX for the last bucket.
+    uint64_t percentileBound(int percent) const;
+
+private:
+    friend class MetricsRegistry;
+
+    Histogram(const char* name, const char* labels, const char* help);
+
+    virtual int64_t value() const { return (int64_t)mCount; }
+
+    volatile uint64_t mCount;
+    volatile uint64_t mSum;
+    volatile uint64_t mBuckets[kBucketCount];
+};
+
+class MetricsRegistry {
+public:
+    // Type of the functions that compute callback metrics.
+    typedef int64_t (CallbackFunction)(void* opaque);
+
+    // Type of the functions that receive printed lines.
+    typedef void (LineFunction)(void* opaque, const char* line);
+
+    MetricsRegistry();
+
+    // Destructor. Frees all the metrics.
+    ~MetricsRegistry();
+
+    // Return the registry shared by the whole program.
+    static MetricsRegistry* get();
+
+    // Return the metric with |name| and |labels|, or create it with the
+    // description |help|. |labels| can be NULL. All metrics that share a
+    // name must have the same type, it is a fatal error otherwise.
+    Counter* counter(const char* name, const char* labels, const char* help);
+    Gauge* gauge(const char* name, const char* labels, const char* help);
+    Histogram* histogram(const char* name,
+                         const char* labels,
+                         const char* help);
+
+    // Add a counter or gauge whose value is |func(opaque)|. |func| can be
+    // called from any thread, and must not use the registry.
+    void addCallback(Metric::Type type,
+                     const char* name,
+                     const char* labels,
+                     const char* help,
+                     CallbackFunction* func,
+                     void* opaque);
+
+    // Print all metrics in a human-readable form through |func|, one line
+    // at a time terminated by '\r\n'. Only the metrics whose name starts
+    // with |prefix| are printed, if it isn't NULL.
+    void print(const char* prefix, LineFunction* func, void* opaque) const;
+
+    // Append all metrics to |out| in the Prometheus text exposition format.
+    void writePrometheus(String* out) const;
+
+private:
+    class CallbackMetric;
+
+    Metric* find(const char* name, const char* labels, Metric::Type type);
+    void add(Metric* metric);
+
+    // The list is only ever appended to, under |mLock|, and can be read
+    // at any time.
+    Metric* volatile mFirst;
+    Metric* mLast;
+    Lock mLock;
+
+    DISALLOW_COPY_AND_ASSIGN(MetricsRegistry);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_METRICS_H
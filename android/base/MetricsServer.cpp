@@ -0,0 +1,154 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/MetricsServer.h"
+
+#include "android/base/Metrics.h"
+#include "android/base/String.h"
+#include "android/base/StringFormat.h"
+#include "android/base/sockets/ScopedSocket.h"
+#include "android/base/sockets/SocketUtils.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Requests larger than this are rejected, the server only needs their
+// first line anyway.
+const size_t kMaxRequestSize = 4096;
+
+bool sendAll(int socket, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t ret = socketSend(socket, data, len);
+        if (ret <= 0) {
+            return false;
+        }
+        data += ret;
+        len -= (size_t)ret;
+    }
+    return true;
+}
+
+void sendResponse(int socket, const char* status, const String& body) {
+    String response = StringFormat(
+            "HTTP/1.0 %s\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %d\r\n"
+            "Connection: close\r\n"
+            "\r\n",
+            status, (int)body.size());
+    response.append(body);
+    sendAll(socket, response.c_str(), response.size());
+}
+
+}  // namespace
+
+// static
+MetricsServer* MetricsServer::create(MetricsRegistry* registry, int port) {
+    ScopedSocket s(socketTcpLoopbackServer(port));
+    if (!s.valid()) {
+        return NULL;
+    }
+    int boundPort = socketGetPort(s.get());
+    if (boundPort < 0) {
+        return NULL;
+    }
+    MetricsServer* server = new MetricsServer(registry, s.release(),
+                                              boundPort);
+    if (!server->start()) {
+        delete server;
+        return NULL;
+    }
+    return server;
+}
+
+MetricsServer::MetricsServer(MetricsRegistry* registry, int socket, int port) :
+        Thread(),
+        mRegistry(registry),
+        mSocket(socket),
+        mPort(port),
+        mStopping(false) {}
+
+MetricsServer::~MetricsServer() {
+    // Wake up the thread blocked in accept() with a last connection.
+    mStopping = true;
+    ScopedSocket client(socketTcpLoopbackClient(mPort));
+    wait(NULL);
+    socketClose(mSocket);
+}
+
+intptr_t MetricsServer::main() {
+#ifndef _WIN32
+    // Let the other threads handle all signals.
+    sigset_t set;
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, NULL);
+#endif
+    while (!mStopping) {
+        ScopedSocket client(socketAcceptAny(mSocket));
+        if (!client.valid() || mStopping) {
+            continue;
+        }
+        serveClient(client.get());
+    }
+    return 0;
+}
+
+void MetricsServer::serveClient(int socket) {
+    // Only the headers are read, requests are never expected to have
+    // a body.
+    char request[kMaxRequestSize + 1];
+    size_t size = 0;
+    for (;;) {
+        ssize_t ret = socketRecv(socket, request + size,
+                                 kMaxRequestSize - size);
+        if (ret <= 0) {
+            return;
+        }
+        size += (size_t)ret;
+        request[size] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+            break;
+        }
+        if (size == kMaxRequestSize) {
+            sendResponse(socket, "413 Request Entity Too Large", String());
+            return;
+        }
+    }
+
+    if (strncmp(request, "GET ", 4)) {
+        sendResponse(socket, "405 Method Not Allowed", String());
+        return;
+    }
+    const char* path = request + 4;
+    size_t pathLen = strcspn(path, " ?\r\n");
+    if ((pathLen == 1 && path[0] == '/') ||
+        (pathLen == 8 && !memcmp(path, "/metrics", 8))) {
+        String body;
+        mRegistry->writePrometheus(&body);
+        sendResponse(socket, "200 OK", body);
+    } else {
+        sendResponse(socket, "404 Not Found", String());
+    }
+}
+
+}  // namespace base
+}  // namespace android
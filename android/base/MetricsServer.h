@@ -0,0 +1,63 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_METRICS_SERVER_H
+#define ANDROID_BASE_METRICS_SERVER_H
+
+#include "android/base/Compiler.h"
+#include "android/base/threads/Thread.h"
+
+namespace android {
+namespace base {
+
+class MetricsRegistry;
+
+// A minimal HTTP server that lets a Prometheus instance scrape the metrics
+// of a MetricsRegistry, i.e. answers 'GET /metrics' requests with their
+// text exposition.
+//
+// It only listens on the loopback interface, and serves one connection at
+// a time from its own thread, so that scraping never blocks the emulator.
+class MetricsServer : public Thread {
+public:
+    // Create a new server for |registry| that listens on TCP |port|, or on
+    // a free port if |port| is 0, and start its thread. Return NULL if the
+    // port can't be bound.
+    static MetricsServer* create(MetricsRegistry* registry, int port);
+
+    // Destructor. Stops the server thread.
+    virtual ~MetricsServer();
+
+    // Return the port the server listens on.
+    int port() const { return mPort; }
+
+    virtual intptr_t main();
+
+private:
+    MetricsServer(MetricsRegistry* registry, int socket, int port);
+
+    void serveClient(int socket);
+
+    MetricsRegistry* mRegistry;
+    int mSocket;
+    int mPort;
+    volatile bool mStopping;
+
+    DISALLOW_COPY_AND_ASSIGN(MetricsServer);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_METRICS_SERVER_H
@@ -0,0 +1,86 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/MetricsServer.h"
+
+#include "android/base/Metrics.h"
+#include "android/base/sockets/ScopedSocket.h"
+#include "android/base/sockets/SocketUtils.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Send |request| to the server on |port| and return its whole response.
+String query(int port, const char* request) {
+    String response;
+    ScopedSocket s(socketTcpLoopbackClient(port));
+    EXPECT_TRUE(s.valid());
+    if (!s.valid()) {
+        return response;
+    }
+    size_t len = strlen(request);
+    EXPECT_EQ((ssize_t)len, socketSend(s.get(), request, len));
+    char buffer[256];
+    ssize_t ret;
+    while ((ret = socketRecv(s.get(), buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, (size_t)ret);
+    }
+    return response;
+}
+
+}  // namespace
+
+TEST(MetricsServer, ServesMetrics) {
+    MetricsRegistry registry;
+    registry.counter("ops_total", NULL, "Number of ops")->add(7);
+    MetricsServer* server = MetricsServer::create(&registry, 0);
+    ASSERT_TRUE(server);
+    EXPECT_GT(server->port(), 0);
+
+    String response = query(server->port(),
+                            "GET /metrics HTTP/1.1\r\nHost: x\r\n\r\n");
+    EXPECT_EQ(0, strncmp("HTTP/1.0 200 OK\r\n", response.c_str(), 17))
+            << response.c_str();
+    EXPECT_TRUE(strstr(response.c_str(), "\r\n\r\n# HELP ops_total"));
+    EXPECT_TRUE(strstr(response.c_str(), "\nops_total 7\n"));
+
+    // The registry is read again for each request.
+    registry.counter("ops_total", NULL, "Number of ops")->add(1);
+    response = query(server->port(), "GET / HTTP/1.0\r\n\r\n");
+    EXPECT_TRUE(strstr(response.c_str(), "\nops_total 8\n"));
+
+    delete server;
+}
+
+TEST(MetricsServer, RejectsOtherRequests) {
+    MetricsRegistry registry;
+    MetricsServer* server = MetricsServer::create(&registry, 0);
+    ASSERT_TRUE(server);
+
+    String response = query(server->port(), "GET /other HTTP/1.0\r\n\r\n");
+    EXPECT_EQ(0, strncmp("HTTP/1.0 404", response.c_str(), 12));
+    response = query(server->port(), "POST /metrics HTTP/1.0\r\n\r\n");
+    EXPECT_EQ(0, strncmp("HTTP/1.0 405", response.c_str(), 12));
+
+    delete server;
+}
+
+}  // namespace base
+}  // namespace android
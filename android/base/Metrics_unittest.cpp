@@ -0,0 +1,137 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/Metrics.h"
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Append each printed line to the String pointed to by |opaque|.
+void appendLine(void* opaque, const char* line) {
+    static_cast<String*>(opaque)->append(line);
+}
+
+String printAll(const MetricsRegistry& registry, const char* prefix) {
+    String result;
+    registry.print(prefix, appendLine, &result);
+    return result;
+}
+
+int64_t callbackValue(void* opaque) {
+    return *static_cast<int64_t*>(opaque);
+}
+
+}  // namespace
+
+TEST(Metrics, ReturnsSameMetricForSameNameAndLabels) {
+    MetricsRegistry registry;
+    Counter* a = registry.counter("a_total", NULL, "Help");
+    EXPECT_EQ(a, registry.counter("a_total", "", "Help"));
+    Counter* b = registry.counter("a_total", "x=\"1\"", "Help");
+    EXPECT_NE(a, b);
+    EXPECT_EQ(b, registry.counter("a_total", "x=\"1\"", "Help"));
+    EXPECT_STREQ("a_total", b->name());
+    EXPECT_STREQ("x=\"1\"", b->labels());
+}
+
+TEST(Metrics, CountersAndGauges) {
+    MetricsRegistry registry;
+    Counter* counter = registry.counter("ops_total", "op=\"read\"", "Ops");
+    Gauge* gauge = registry.gauge("queue_length", NULL, "Length");
+    counter->add(3);
+    counter->add(2);
+    gauge->set(10);
+    gauge->add(-4);
+    EXPECT_EQ(5, counter->value());
+    EXPECT_EQ(6, gauge->value());
+    EXPECT_STREQ("ops_total{op=\"read\"}: 5\r\nqueue_length: 6\r\n",
+                 printAll(registry, NULL).c_str());
+    EXPECT_STREQ("queue_length: 6\r\n", printAll(registry, "queue").c_str());
+}
+
+TEST(Metrics, HistogramBuckets) {
+    MetricsRegistry registry;
+    Histogram* h = registry.histogram("latency_us", NULL, "Latency");
+    EXPECT_EQ(0U, h->percentileBound(50));
+    h->record(0);
+    h->record(1);
+    h->record(2);
+    h->record(3);
+    h->record(4);
+    h->record(5);
+    h->record(UINT64_C(1) << 40);
+    EXPECT_EQ(7U, h->count());
+    EXPECT_EQ(2U, h->bucketCount(0));
+    EXPECT_EQ(1U, h->bucketCount(1));
+    EXPECT_EQ(2U, h->bucketCount(2));
+    EXPECT_EQ(1U, h->bucketCount(3));
+    EXPECT_EQ(1U, h->bucketCount(Histogram::kBucketCount - 1));
+    EXPECT_EQ(4U, h->percentileBound(50));
+    EXPECT_EQ(UINT64_MAX, h->percentileBound(99));
+}
+
+TEST(Metrics, Callbacks) {
+    MetricsRegistry registry;
+    int64_t value = 42;
+    registry.addCallback(Metric::kTypeCounter, "cb_total", NULL, "Help",
+                         callbackValue, &value);
+    EXPECT_STREQ("cb_total: 42\r\n", printAll(registry, NULL).c_str());
+    value = 43;
+    EXPECT_STREQ("cb_total: 43\r\n", printAll(registry, NULL).c_str());
+}
+
+TEST(Metrics, WritePrometheus) {
+    MetricsRegistry registry;
+    registry.counter("ops_total", "op=\"read\"", "Number of ops")->add(1);
+    registry.gauge("queue_length", NULL, "Queue length")->set(2);
+    registry.counter("ops_total", "op=\"write\"", "Number of ops")->add(3);
+    Histogram* h = registry.histogram("latency_us", "dev=\"a\"", "Latency");
+    h->record(1);
+    h->record(3);
+
+    String out;
+    registry.writePrometheus(&out);
+    const char kExpectedStart[] =
+            "# HELP ops_total Number of ops\n"
+            "# TYPE ops_total counter\n"
+            "ops_total{op=\"read\"} 1\n"
+            "ops_total{op=\"write\"} 3\n"
+            "# HELP queue_length Queue length\n"
+            "# TYPE queue_length gauge\n"
+            "queue_length 2\n"
+            "# HELP latency_us Latency\n"
+            "# TYPE latency_us histogram\n"
+            "latency_us_bucket{dev=\"a\",le=\"1\"} 1\n"
+            "latency_us_bucket{dev=\"a\",le=\"2\"} 1\n"
+            "latency_us_bucket{dev=\"a\",le=\"4\"} 2\n";
+    EXPECT_EQ(0, strncmp(kExpectedStart, out.c_str(),
+                         sizeof(kExpectedStart) - 1)) << out.c_str();
+    const char kExpectedEnd[] =
+            "latency_us_bucket{dev=\"a\",le=\"+Inf\"} 2\n"
+            "latency_us_sum{dev=\"a\"} 4\n"
+            "latency_us_count{dev=\"a\"} 2\n";
+    size_t endLen = sizeof(kExpectedEnd) - 1;
+    ASSERT_GE(out.size(), endLen);
+    EXPECT_STREQ(kExpectedEnd, out.c_str() + out.size() - endLen);
+}
+
+}  // namespace base
+}  // namespace android
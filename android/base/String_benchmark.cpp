@@ -0,0 +1,81 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/String.h"
+
+#include "android/base/StringFormat.h"
+#include "android/base/testing/Benchmark.h"
+
+namespace android {
+namespace base {
+
+BENCHMARK(String_ConstructShort) {
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        String s("hello");
+        Benchmark::doNotOptimize(s);
+    }
+}
+
+BENCHMARK(String_ConstructLong) {
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        String s("The quick brown fox jumps over the lazy dog, twice over.");
+        Benchmark::doNotOptimize(s);
+    }
+}
+
+BENCHMARK(String_Copy) {
+    String s("The quick brown fox jumps over the lazy dog, twice over.");
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        String copy(s);
+        Benchmark::doNotOptimize(copy);
+    }
+}
+
+// Appending characters one at a time, including the amortized cost of the
+// reallocations.
+BENCHMARK(String_AppendChar) {
+    String s;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        if (s.size() == 4096) {
+            s.clear();
+        }
+        s.append("x", 1);
+    }
+    Benchmark::doNotOptimize(s);
+}
+
+BENCHMARK(StringFormat_Int) {
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        String s = StringFormat("%d", (int)n);
+        Benchmark::doNotOptimize(s);
+    }
+}
+
+BENCHMARK(StringFormat_Mixed) {
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        String s = StringFormat("%s:%d:%g", "sensor", (int)n, 1.5);
+        Benchmark::doNotOptimize(s);
+    }
+}
+
+BENCHMARK(StringAppendFormat) {
+    String s;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        if (s.size() >= 4096) {
+            s.clear();
+        }
+        StringAppendFormat(&s, "%d,", (int)(n & 1023));
+    }
+    Benchmark::doNotOptimize(s);
+}
+
+}  // namespace base
+}  // namespace android
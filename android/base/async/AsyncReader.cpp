@@ -20,24 +20,58 @@ namespace base {
 void AsyncReader::reset(void* buffer,
                         size_t bufferSize,
                         Looper::FdWatch* watch) {
-    mBuffer = reinterpret_cast<uint8_t*>(buffer);
-    mBufferSize = bufferSize;
+    mSingleBuffer.data = buffer;
+    mSingleBuffer.size = bufferSize;
+    resetv(NULL, 1U, watch);
+}
+
+void AsyncReader::resetv(const SocketBuffer* buffers,
+                         size_t count,
+                         Looper::FdWatch* watch) {
+    mBuffers = buffers;
+    mBufferCount = count;
+    mIndex = 0U;
     mPos = 0U;
     mFdWatch = watch;
-    if (bufferSize > 0) {
+    if (skipFullBuffers()) {
         watch->wantRead();
     }
 }
 
+bool AsyncReader::skipFullBuffers() {
+    const SocketBuffer* bufs = buffers();
+    while (mIndex < mBufferCount && mPos >= bufs[mIndex].size) {
+        mPos -= bufs[mIndex].size;
+        mIndex++;
+    }
+    return mIndex < mBufferCount;
+}
+
 AsyncStatus AsyncReader::run() {
-    if (mPos >= mBufferSize) {
+    if (!skipFullBuffers()) {
         return kAsyncCompleted;
     }
 
     do {
-        ssize_t ret = socketRecv(mFdWatch->fd(),
-                                 mBuffer + mPos,
-                                 mBufferSize - mPos);
+        const SocketBuffer* bufs = buffers();
+        ssize_t ret;
+        if (mIndex + 1U == mBufferCount) {
+            ret = socketRecv(mFdWatch->fd(),
+                             static_cast<uint8_t*>(bufs[mIndex].data) + mPos,
+                             bufs[mIndex].size - mPos);
+        } else {
+            // Read into as many of the remaining buffers as possible.
+            SocketBuffer chain[kMaxSocketBuffers];
+            size_t count = 0;
+            while (count < kMaxSocketBuffers &&
+                   mIndex + count < mBufferCount) {
+                chain[count] = bufs[mIndex + count];
+                count++;
+            }
+            chain[0].data = static_cast<uint8_t*>(chain[0].data) + mPos;
+            chain[0].size -= mPos;
+            ret = socketRecvv(mFdWatch->fd(), chain, count);
+        }
         if (ret == 0) {
             // Disconnection!
             errno = ECONNRESET;
@@ -52,7 +86,7 @@ AsyncStatus AsyncReader::run() {
             return kAsyncError;
         }
         mPos += static_cast<size_t>(ret);
-    } while (mPos < mBufferSize);
+    } while (skipFullBuffers());
 
     mFdWatch->dontWantRead();
     return kAsyncCompleted;
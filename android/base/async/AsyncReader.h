@@ -14,6 +14,7 @@
 
 #include "android/base/async/AsyncStatus.h"
 #include "android/base/async/Looper.h"
+#include "android/base/sockets/SocketUtils.h"
 
 #include <stdint.h>
 
@@ -44,21 +45,45 @@ namespace base {
 //         // still more data needed to fill the buffer.
 //     }
 //
+// Use resetv() instead to read into a chain of buffers, e.g. a header
+// and a payload, with a single readv() per i/o event.
+//
 class AsyncReader {
 public:
     AsyncReader() :
-            mBuffer(NULL),
-            mBufferSize(0U),
+            mBuffers(NULL),
+            mBufferCount(0U),
+            mIndex(0U),
             mPos(0),
-            mFdWatch(NULL) {}
+            mFdWatch(NULL) {
+        mSingleBuffer.data = NULL;
+        mSingleBuffer.size = 0U;
+    }
 
     void reset(void* buffer, size_t buffSize, Looper::FdWatch* watch);
 
+    // Same as reset(), but fills the |count| buffers described by
+    // |buffers| in order. The descriptors are not copied, and must remain
+    // valid until the read completes.
+    void resetv(const SocketBuffer* buffers,
+                size_t count,
+                Looper::FdWatch* watch);
+
     AsyncStatus run();
 
 private:
-    uint8_t* mBuffer;
-    size_t mBufferSize;
+    const SocketBuffer* buffers() const {
+        return mBuffers ? mBuffers : &mSingleBuffer;
+    }
+
+    // Skip over the buffers that are already full.
+    bool skipFullBuffers();
+
+    SocketBuffer mSingleBuffer;
+    const SocketBuffer* mBuffers;
+    size_t mBufferCount;
+    // Index of the current buffer, and position in it.
+    size_t mIndex;
     size_t mPos;
     Looper::FdWatch* mFdWatch;
 };
@@ -0,0 +1,142 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/async/AsyncReader.h"
+#include "android/base/async/AsyncWriter.h"
+
+#include "android/base/memory/ScopedPtr.h"
+#include "android/base/sockets/ScopedSocket.h"
+#include "android/base/sockets/SocketUtils.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+void onEvent(void*, int, unsigned) {}
+
+class AsyncReaderTest : public ::testing::Test {
+public:
+    virtual void SetUp() {
+        int s1, s2;
+        ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+        mReadSocket.reset(s1);
+        mWriteSocket.reset(s2);
+        mLooper.reset(Looper::create());
+        mReadWatch.reset(
+                mLooper->createFdWatch(mReadSocket.get(), onEvent, NULL));
+        mWriteWatch.reset(
+                mLooper->createFdWatch(mWriteSocket.get(), onEvent, NULL));
+    }
+
+protected:
+    ScopedSocket mReadSocket;
+    ScopedSocket mWriteSocket;
+    ScopedPtr<Looper> mLooper;
+    ScopedPtr<Looper::FdWatch> mReadWatch;
+    ScopedPtr<Looper::FdWatch> mWriteWatch;
+};
+
+}  // namespace
+
+TEST_F(AsyncReaderTest, SingleBuffer) {
+    char buffer[5];
+    AsyncReader reader;
+    reader.reset(buffer, sizeof(buffer), mReadWatch.get());
+    EXPECT_EQ(kAsyncAgain, reader.run());
+
+    ASSERT_EQ(3, socketSend(mWriteSocket.get(), "abc", 3));
+    EXPECT_EQ(kAsyncAgain, reader.run());
+    ASSERT_EQ(2, socketSend(mWriteSocket.get(), "de", 2));
+    EXPECT_EQ(kAsyncCompleted, reader.run());
+    EXPECT_EQ(0, ::memcmp(buffer, "abcde", 5));
+}
+
+TEST_F(AsyncReaderTest, VectoredRead) {
+    char header[4];
+    char empty[1];
+    char payload[6];
+    const SocketBuffer buffers[] = {
+        { header, sizeof(header) },
+        { empty, 0 },
+        { payload, sizeof(payload) },
+    };
+    AsyncReader reader;
+    reader.resetv(buffers, 3, mReadWatch.get());
+    EXPECT_EQ(kAsyncAgain, reader.run());
+
+    // Data that spans the buffers in both chunks.
+    ASSERT_EQ(6, socketSend(mWriteSocket.get(), "HEADpa", 6));
+    EXPECT_EQ(kAsyncAgain, reader.run());
+    ASSERT_EQ(4, socketSend(mWriteSocket.get(), "yldX", 4));
+    EXPECT_EQ(kAsyncCompleted, reader.run());
+    EXPECT_EQ(0, ::memcmp(header, "HEAD", 4));
+    EXPECT_EQ(0, ::memcmp(payload, "payldX", 6));
+}
+
+TEST_F(AsyncReaderTest, Disconnection) {
+    char buffer[4];
+    AsyncReader reader;
+    reader.reset(buffer, sizeof(buffer), mReadWatch.get());
+    mWriteSocket.close();
+    EXPECT_EQ(kAsyncError, reader.run());
+}
+
+TEST_F(AsyncReaderTest, VectoredWrite) {
+    char header[] = "HEAD";
+    char payload[] = "payload";
+    const SocketBuffer buffers[] = {
+        { header, 4 },
+        { payload, 7 },
+    };
+    AsyncWriter writer;
+    writer.resetv(buffers, 2, mWriteWatch.get());
+    EXPECT_EQ(kAsyncCompleted, writer.run());
+
+    char result[11];
+    AsyncReader reader;
+    reader.reset(result, sizeof(result), mReadWatch.get());
+    EXPECT_EQ(kAsyncCompleted, reader.run());
+    EXPECT_EQ(0, ::memcmp(result, "HEADpayload", 11));
+}
+
+TEST_F(AsyncReaderTest, ManyBuffers) {
+    // More buffers than a single system call can transfer.
+    static const size_t kCount = kMaxSocketBuffers * 3 + 1;
+    char input[kCount];
+    char output[kCount];
+    SocketBuffer inputs[kCount];
+    SocketBuffer outputs[kCount];
+    for (size_t n = 0; n < kCount; ++n) {
+        input[n] = static_cast<char>('A' + n % 26);
+        output[n] = 0;
+        inputs[n].data = &input[n];
+        inputs[n].size = 1;
+        outputs[n].data = &output[n];
+        outputs[n].size = 1;
+    }
+
+    AsyncWriter writer;
+    writer.resetv(inputs, kCount, mWriteWatch.get());
+    EXPECT_EQ(kAsyncCompleted, writer.run());
+
+    AsyncReader reader;
+    reader.resetv(outputs, kCount, mReadWatch.get());
+    EXPECT_EQ(kAsyncCompleted, reader.run());
+    EXPECT_EQ(0, ::memcmp(input, output, kCount));
+}
+
+}  // namespace base
+}  // namespace android
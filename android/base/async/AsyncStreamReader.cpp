@@ -0,0 +1,132 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/async/AsyncStreamReader.h"
+
+#include "android/base/Log.h"
+#include "android/base/sockets/SocketErrors.h"
+#include "android/base/sockets/SocketUtils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+namespace base {
+
+AsyncStreamReader::AsyncStreamReader(size_t capacity) :
+        mBuffer(static_cast<uint8_t*>(::malloc(capacity))),
+        mCapacity(capacity),
+        mStart(0U),
+        mSize(0U),
+        mFdWatch(NULL) {
+    CHECK(capacity > 0U);
+    if (!mBuffer) {
+        LOG(FATAL) << "Out of memory allocating " << capacity
+                   << " bytes stream buffer";
+    }
+}
+
+AsyncStreamReader::~AsyncStreamReader() {
+    ::free(mBuffer);
+}
+
+void AsyncStreamReader::reset(Looper::FdWatch* watch) {
+    mStart = 0U;
+    mSize = 0U;
+    mFdWatch = watch;
+    watch->wantRead();
+}
+
+AsyncStatus AsyncStreamReader::run() {
+    while (mSize < mCapacity) {
+        // The free space is made of at most two segments: from the end of
+        // the data to the end of the buffer, then from its start.
+        SocketBuffer chain[2];
+        size_t count = 1U;
+        size_t end = mStart + mSize;
+        if (end >= mCapacity) {
+            end -= mCapacity;
+            chain[0].data = mBuffer + end;
+            chain[0].size = mStart - end;
+        } else {
+            chain[0].data = mBuffer + end;
+            chain[0].size = mCapacity - end;
+            if (mStart > 0U) {
+                chain[1].data = mBuffer;
+                chain[1].size = mStart;
+                count = 2U;
+            }
+        }
+
+        ssize_t ret = socketRecvv(mFdWatch->fd(), chain, count);
+        if (ret == 0) {
+            // Disconnection!
+            errno = ECONNRESET;
+            return kAsyncError;
+        }
+        if (ret < 0) {
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                mFdWatch->wantRead();
+                return kAsyncAgain;
+            }
+            return kAsyncError;
+        }
+        mSize += static_cast<size_t>(ret);
+    }
+
+    // Stop polling until the client consumes some data.
+    mFdWatch->dontWantRead();
+    return kAsyncCompleted;
+}
+
+size_t AsyncStreamReader::peek(void* buffer, size_t len) const {
+    if (len > mSize) {
+        len = mSize;
+    }
+    uint8_t* dst = static_cast<uint8_t*>(buffer);
+    size_t first = mCapacity - mStart;
+    if (first >= len) {
+        ::memcpy(dst, mBuffer + mStart, len);
+    } else {
+        ::memcpy(dst, mBuffer + mStart, first);
+        ::memcpy(dst + first, mBuffer, len - first);
+    }
+    return len;
+}
+
+void AsyncStreamReader::consume(size_t len) {
+    DCHECK(len <= mSize);
+    if (len == 0U) {
+        return;
+    }
+    bool wasFull = (mSize == mCapacity);
+    mSize -= len;
+    mStart += len;
+    if (mStart >= mCapacity) {
+        mStart -= mCapacity;
+    }
+    if (mSize == 0U) {
+        // Restart at the beginning to reduce wrap-arounds.
+        mStart = 0U;
+    }
+    if (wasFull && mFdWatch) {
+        mFdWatch->wantRead();
+    }
+}
+
+size_t AsyncStreamReader::read(void* buffer, size_t len) {
+    len = peek(buffer, len);
+    consume(len);
+    return len;
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,95 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_BASE_ASYNC_ASYNC_STREAM_READER_H
+#define ANDROID_BASE_ASYNC_ASYNC_STREAM_READER_H
+
+#include "android/base/Compiler.h"
+#include "android/base/async/AsyncStatus.h"
+#include "android/base/async/Looper.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace base {
+
+// Helper class to read a stream of data from a socket asynchronously,
+// when the amount of data to read is not known in advance.
+//
+// Unlike AsyncReader, it owns a fixed-size ring buffer, and each call to
+// run() reads as much data as possible into it, until the socket would
+// block or the buffer is full. The ring is filled with vectored reads,
+// so that wrapping around doesn't require an extra system call.
+//
+// Usage example:
+//
+//     AsyncStreamReader myReader(65536);
+//     myReader.reset(myFdWatch);
+//     ...
+//     // when an event happens on myFdWatch
+//     AsyncStatus status = myReader.run();
+//     while (myReader.size() >= kHeaderSize) {
+//         .. use peek() and read() to parse the data.
+//     }
+//     if (status == kAsyncError) {
+//         // i/o error (i.e. socket disconnection).
+//     }
+//
+class AsyncStreamReader {
+public:
+    // Create a new instance with a ring buffer of |capacity| bytes.
+    explicit AsyncStreamReader(size_t capacity);
+
+    ~AsyncStreamReader();
+
+    // Discard any buffered data and start reading from |watch|.
+    void reset(Looper::FdWatch* watch);
+
+    // Read data from the socket until it would block or the buffer is
+    // full. Return kAsyncAgain in the first case, kAsyncCompleted in the
+    // second one, after which no more read events are requested until
+    // some data is consumed, or kAsyncError on i/o error or disconnection.
+    // Data read before an error remains available.
+    AsyncStatus run();
+
+    // Return the number of buffered bytes.
+    size_t size() const { return mSize; }
+
+    // Return the capacity of the ring buffer.
+    size_t capacity() const { return mCapacity; }
+
+    // Copy up to |len| buffered bytes to |buffer| without consuming them.
+    // Return the number of bytes copied.
+    size_t peek(void* buffer, size_t len) const;
+
+    // Discard the first |len| buffered bytes, which must not be more
+    // than size().
+    void consume(size_t len);
+
+    // Equivalent to peek() followed by consume().
+    size_t read(void* buffer, size_t len);
+
+private:
+    uint8_t* mBuffer;
+    size_t mCapacity;
+    // Position of the first buffered byte, and number of buffered bytes.
+    size_t mStart;
+    size_t mSize;
+    Looper::FdWatch* mFdWatch;
+
+    DISALLOW_COPY_AND_ASSIGN(AsyncStreamReader);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_ASYNC_ASYNC_STREAM_READER_H
@@ -0,0 +1,124 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/async/AsyncStreamReader.h"
+
+#include "android/base/memory/ScopedPtr.h"
+#include "android/base/sockets/ScopedSocket.h"
+#include "android/base/sockets/SocketUtils.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+void onEvent(void*, int, unsigned) {}
+
+class AsyncStreamReaderTest : public ::testing::Test {
+public:
+    virtual void SetUp() {
+        int s1, s2;
+        ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+        mReadSocket.reset(s1);
+        mWriteSocket.reset(s2);
+        mLooper.reset(Looper::create());
+        mWatch.reset(
+                mLooper->createFdWatch(mReadSocket.get(), onEvent, NULL));
+    }
+
+    void send(const char* str) {
+        ssize_t len = static_cast<ssize_t>(::strlen(str));
+        ASSERT_EQ(len, socketSend(mWriteSocket.get(), str, len));
+    }
+
+protected:
+    ScopedSocket mReadSocket;
+    ScopedSocket mWriteSocket;
+    ScopedPtr<Looper> mLooper;
+    ScopedPtr<Looper::FdWatch> mWatch;
+};
+
+}  // namespace
+
+TEST_F(AsyncStreamReaderTest, ReadsUntilWouldBlock) {
+    AsyncStreamReader reader(64);
+    reader.reset(mWatch.get());
+    EXPECT_EQ(kAsyncAgain, reader.run());
+    EXPECT_EQ(0U, reader.size());
+
+    send("hello ");
+    send("world");
+    EXPECT_EQ(kAsyncAgain, reader.run());
+    EXPECT_EQ(11U, reader.size());
+
+    char buffer[16];
+    EXPECT_EQ(5U, reader.peek(buffer, 5));
+    EXPECT_EQ(0, ::memcmp(buffer, "hello", 5));
+    EXPECT_EQ(11U, reader.size());
+
+    EXPECT_EQ(11U, reader.read(buffer, sizeof(buffer)));
+    EXPECT_EQ(0, ::memcmp(buffer, "hello world", 11));
+    EXPECT_EQ(0U, reader.size());
+}
+
+TEST_F(AsyncStreamReaderTest, FullBuffer) {
+    AsyncStreamReader reader(8);
+    reader.reset(mWatch.get());
+
+    send("0123456789");
+    EXPECT_EQ(kAsyncCompleted, reader.run());
+    EXPECT_EQ(8U, reader.size());
+
+    char buffer[8];
+    EXPECT_EQ(8U, reader.read(buffer, 8));
+    EXPECT_EQ(0, ::memcmp(buffer, "01234567", 8));
+
+    EXPECT_EQ(kAsyncAgain, reader.run());
+    EXPECT_EQ(2U, reader.read(buffer, 8));
+    EXPECT_EQ(0, ::memcmp(buffer, "89", 2));
+}
+
+TEST_F(AsyncStreamReaderTest, WrapAround) {
+    AsyncStreamReader reader(8);
+    reader.reset(mWatch.get());
+
+    send("012345");
+    EXPECT_EQ(kAsyncAgain, reader.run());
+    char buffer[8];
+    EXPECT_EQ(4U, reader.read(buffer, 4));
+
+    // The new data fills the end of the ring, then its start.
+    send("abcdef");
+    EXPECT_EQ(kAsyncCompleted, reader.run());
+    EXPECT_EQ(8U, reader.size());
+    EXPECT_EQ(8U, reader.read(buffer, 8));
+    EXPECT_EQ(0, ::memcmp(buffer, "45abcdef", 8));
+}
+
+TEST_F(AsyncStreamReaderTest, DataRemainsAfterDisconnection) {
+    AsyncStreamReader reader(64);
+    reader.reset(mWatch.get());
+    send("bye");
+    mWriteSocket.close();
+    EXPECT_EQ(kAsyncError, reader.run());
+    ASSERT_EQ(3U, reader.size());
+
+    char buffer[3];
+    EXPECT_EQ(3U, reader.read(buffer, 3));
+    EXPECT_EQ(0, ::memcmp(buffer, "bye", 3));
+}
+
+}  // namespace base
+}  // namespace android
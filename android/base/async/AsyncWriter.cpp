@@ -9,24 +9,58 @@ namespace base {
 void AsyncWriter::reset(const void* buffer,
                         size_t bufferSize,
                         Looper::FdWatch* watch) {
-    mBuffer = reinterpret_cast<const uint8_t*>(buffer);
-    mBufferSize = bufferSize;
-    mPos = 0;
+    mSingleBuffer.data = const_cast<void*>(buffer);
+    mSingleBuffer.size = bufferSize;
+    resetv(NULL, 1U, watch);
+}
+
+void AsyncWriter::resetv(const SocketBuffer* buffers,
+                         size_t count,
+                         Looper::FdWatch* watch) {
+    mBuffers = buffers;
+    mBufferCount = count;
+    mIndex = 0U;
+    mPos = 0U;
     mFdWatch = watch;
-    if (bufferSize > 0) {
+    if (skipSentBuffers()) {
         watch->wantWrite();
     }
 }
 
+bool AsyncWriter::skipSentBuffers() {
+    const SocketBuffer* bufs = buffers();
+    while (mIndex < mBufferCount && mPos >= bufs[mIndex].size) {
+        mPos -= bufs[mIndex].size;
+        mIndex++;
+    }
+    return mIndex < mBufferCount;
+}
+
 AsyncStatus AsyncWriter::run() {
-    if (mPos >= mBufferSize) {
+    if (!skipSentBuffers()) {
         return kAsyncCompleted;
     }
 
     do {
-        ssize_t ret = socketSend(mFdWatch->fd(),
-                                 mBuffer + mPos,
-                                 mBufferSize - mPos);
+        const SocketBuffer* bufs = buffers();
+        ssize_t ret;
+        if (mIndex + 1U == mBufferCount) {
+            ret = socketSend(mFdWatch->fd(),
+                             static_cast<uint8_t*>(bufs[mIndex].data) + mPos,
+                             bufs[mIndex].size - mPos);
+        } else {
+            // Send as many of the remaining buffers as possible.
+            SocketBuffer chain[kMaxSocketBuffers];
+            size_t count = 0;
+            while (count < kMaxSocketBuffers &&
+                   mIndex + count < mBufferCount) {
+                chain[count] = bufs[mIndex + count];
+                count++;
+            }
+            chain[0].data = static_cast<uint8_t*>(chain[0].data) + mPos;
+            chain[0].size -= mPos;
+            ret = socketSendv(mFdWatch->fd(), chain, count);
+        }
         if (ret == 0) {
             // Disconnection!
             errno = ECONNRESET;
@@ -39,7 +73,7 @@ AsyncStatus AsyncWriter::run() {
             return kAsyncError;
         }
         mPos += static_cast<size_t>(ret);
-    } while (mPos < mBufferSize);
+    } while (skipSentBuffers());
 
     mFdWatch->dontWantWrite();
     return kAsyncCompleted;
@@ -14,29 +14,55 @@
 
 #include "android/base/async/AsyncStatus.h"
 #include "android/base/async/Looper.h"
+#include "android/base/sockets/SocketUtils.h"
 
 #include <stdint.h>
 
 namespace android {
 namespace base {
 
+// Counterpart of AsyncReader, used to write data to a socket
+// asynchronously. Call reset() or resetv() to set the data to send, then
+// run() on i/o write events until it returns kAsyncCompleted.
 class AsyncWriter {
 public:
     AsyncWriter() :
-            mBuffer(NULL),
-            mBufferSize(0U),
+            mBuffers(NULL),
+            mBufferCount(0U),
+            mIndex(0U),
             mPos(0U),
-            mFdWatch(NULL) {}
+            mFdWatch(NULL) {
+        mSingleBuffer.data = NULL;
+        mSingleBuffer.size = 0U;
+    }
 
     void reset(const void* buffer,
                size_t bufferSize,
                Looper::FdWatch* watch);
 
+    // Same as reset(), but sends the content of the |count| buffers
+    // described by |buffers| in order, with a single writev() per i/o
+    // event. The descriptors are not copied, and must remain valid until
+    // the write completes.
+    void resetv(const SocketBuffer* buffers,
+                size_t count,
+                Looper::FdWatch* watch);
+
     AsyncStatus run();
 
 private:
-    const uint8_t* mBuffer;
-    size_t mBufferSize;
+    const SocketBuffer* buffers() const {
+        return mBuffers ? mBuffers : &mSingleBuffer;
+    }
+
+    // Skip over the buffers that were completely sent.
+    bool skipSentBuffers();
+
+    SocketBuffer mSingleBuffer;
+    const SocketBuffer* mBuffers;
+    size_t mBufferCount;
+    // Index of the current buffer, and position in it.
+    size_t mIndex;
     size_t mPos;
     Looper::FdWatch* mFdWatch;
 };
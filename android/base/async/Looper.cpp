@@ -11,6 +11,7 @@
 
 #include "android/base/async/Looper.h"
 
+#include "android/base/containers/PodVector.h"
 #include "android/base/containers/ScopedPointerSet.h"
 #include "android/base/containers/TailQueueList.h"
 #include "android/base/Log.h"
@@ -38,6 +39,7 @@ public:
             mTimers(),
             mActiveTimers(),
             mPendingTimers(),
+            mNextTimerOrder(0),
             mForcedExit(false) {}
 
     virtual ~GenLooper() {}
@@ -181,6 +183,8 @@ public:
         Timer(GenLooper* looper, Callback callback, void* opaque) :
                 Looper::Timer(looper, callback, opaque),
                 mDeadline(kDurationInfinite),
+                mOrder(0),
+                mHeapIndex(kNotInHeap),
                 mPending(false),
                 mPendingLink() {
             DCHECK(mCallback);
@@ -193,13 +197,23 @@ public:
 
         virtual ~Timer() {
             clearPending();
+            if (mHeapIndex != kNotInHeap) {
+                genLooper()->disableTimer(this);
+            }
             genLooper()->delTimer(this);
         }
 
-        Timer* next() const { return mPendingLink.next(); }
-
         Duration deadline() const { return mDeadline; }
 
+        // Returns true iff this timer must fire before |other|. Timers
+        // with the same deadline fire in the order they were started.
+        bool before(const Timer* other) const {
+            if (mDeadline != other->mDeadline) {
+                return mDeadline < other->mDeadline;
+            }
+            return mOrder < other->mOrder;
+        }
+
         virtual void startRelative(Duration deadlineMs) {
             if (deadlineMs != kDurationInfinite) {
                 deadlineMs += mLooper->nowMs();
@@ -208,7 +222,10 @@ public:
         }
 
         virtual void startAbsolute(Duration deadlineMs) {
-            if (mDeadline != kDurationInfinite) {
+            // A timer restarted or stopped while it is pending must not
+            // fire for its previous deadline.
+            clearPending();
+            if (mHeapIndex != kNotInHeap) {
                 genLooper()->disableTimer(this);
             }
             mDeadline = deadlineMs;
@@ -234,8 +251,8 @@ public:
             if (mPending) {
                 genLooper()->delPendingTimer(this);
                 mPending = false;
-                // resets mDeadline so it can be added to active timers list again later
-                // without assertion failure inside startAbsolute (genLooper->disableTimer)
+                // The timer is no longer in the active heap, so it is
+                // not active until it is started again.
                 mDeadline = kDurationInfinite;
             }
         }
@@ -247,7 +264,13 @@ public:
         TAIL_QUEUE_LIST_TRAITS(Traits, Timer, mPendingLink);
 
     private:
+        friend class GenLooper;
+
+        static const size_t kNotInHeap = static_cast<size_t>(-1);
+
         Duration mDeadline;
+        uint64_t mOrder;      // Start sequence number, breaks ties.
+        size_t mHeapIndex;    // Position in mActiveTimers, or kNotInHeap.
         bool mPending;
         TailQueueLink<Timer> mPendingLink;
     };
@@ -260,22 +283,71 @@ public:
         mTimers.pick(timer);
     }
 
+    // Active timers are kept in a binary min-heap ordered by deadline,
+    // so that starting, stopping and expiring a timer is O(log n) and
+    // the next deadline is always mActiveTimers[0].
+
     void enableTimer(Timer* timer) {
-        // Find the first timer that expires after this one.
-        Timer* item = mActiveTimers.front();
-        while (item && item->deadline() < timer->deadline()) {
-            item = item->next();
+        DCHECK(timer->mHeapIndex == Timer::kNotInHeap);
+        timer->mOrder = mNextTimerOrder++;
+        size_t index = mActiveTimers.size();
+        mActiveTimers.push_back(timer);
+        timer->mHeapIndex = index;
+        fixTimerHeap(index);
+    }
+
+    void disableTimer(Timer* timer) {
+        size_t index = timer->mHeapIndex;
+        DCHECK(index < mActiveTimers.size());
+        DCHECK(mActiveTimers[index] == timer);
+        size_t last = mActiveTimers.size() - 1;
+        timer->mHeapIndex = Timer::kNotInHeap;
+        if (index != last) {
+            setTimerHeap(index, mActiveTimers[last]);
         }
-        if (item) {
-            mActiveTimers.insertBefore(item, timer);
-        } else {
-            mActiveTimers.insertTail(timer);
+        mActiveTimers.resize(last);
+        if (index != last) {
+            fixTimerHeap(index);
         }
     }
 
-    void disableTimer(Timer* timer) {
-        // Simply remove from the list.
-        mActiveTimers.remove(timer);
+    Timer* firstTimer() const {
+        return mActiveTimers.empty() ? NULL : mActiveTimers[0];
+    }
+
+    void setTimerHeap(size_t index, Timer* timer) {
+        mActiveTimers[index] = timer;
+        timer->mHeapIndex = index;
+    }
+
+    // Move the timer at |index| up or down until the heap order holds.
+    void fixTimerHeap(size_t index) {
+        Timer* timer = mActiveTimers[index];
+        while (index > 0) {
+            size_t parent = (index - 1) / 2;
+            if (!timer->before(mActiveTimers[parent])) {
+                break;
+            }
+            setTimerHeap(index, mActiveTimers[parent]);
+            index = parent;
+        }
+        const size_t count = mActiveTimers.size();
+        for (;;) {
+            size_t child = 2 * index + 1;
+            if (child >= count) {
+                break;
+            }
+            if (child + 1 < count &&
+                mActiveTimers[child + 1]->before(mActiveTimers[child])) {
+                child++;
+            }
+            if (!mActiveTimers[child]->before(timer)) {
+                break;
+            }
+            setTimerHeap(index, mActiveTimers[child]);
+            index = child;
+        }
+        setTimerHeap(index, timer);
     }
 
     void addPendingTimer(Timer* timer) {
@@ -308,9 +380,9 @@ public:
             // Compute next deadline from timers.
             Duration nextDeadline = kDurationInfinite;
 
-            Timer* firstTimer = mActiveTimers.front();
-            if (firstTimer) {
-                nextDeadline = firstTimer->deadline();
+            Timer* first = firstTimer();
+            if (first) {
+                nextDeadline = first->deadline();
             }
 
             if (nextDeadline > deadlineMs) {
@@ -357,16 +429,15 @@ public:
             DCHECK(mPendingTimers.empty());
 
             const Duration kNow = nowMs();
-            Timer* timer = mActiveTimers.front();
-            while (timer) {
-                if (timer->deadline() > kNow) {
+            for (;;) {
+                Timer* timer = firstTimer();
+                if (!timer || timer->deadline() > kNow) {
                     break;
                 }
 
-                // Remove from active list, add to pending list.
-                mActiveTimers.remove(timer);
+                // Remove from active heap, add to pending list.
+                disableTimer(timer);
                 timer->setPending();
-                timer = timer->next();
             }
 
             // Fire the pending timers, this is done in a separate step
@@ -399,6 +470,7 @@ public:
         return 0;
     }
 
+    typedef PodVector<Timer*> TimerHeap;
     typedef TailQueueList<Timer> TimerList;
     typedef ScopedPointerSet<Timer> TimerSet;
 
@@ -411,8 +483,9 @@ private:
     FdWatchList mPendingFdWatches;  // Queue of pending fd watches.
 
     TimerSet  mTimers;        // Set of all timers.
-    TimerList mActiveTimers;  // Sorted list of active timers.
+    TimerHeap mActiveTimers;  // Min-heap of active timers.
     TimerList mPendingTimers; // Sorted list of pending timers.
+    uint64_t mNextTimerOrder; // Sequence number of the next started timer.
 
     bool mForcedExit;
 };
@@ -0,0 +1,127 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/async/Looper.h"
+
+#include "android/base/memory/ScopedPtr.h"
+#include "android/base/sockets/SocketUtils.h"
+#include "android/base/testing/Benchmark.h"
+
+namespace android {
+namespace base {
+
+namespace {
+
+typedef Looper::Timer Timer;
+typedef Looper::FdWatch FdWatch;
+
+// Counts expirations of a timer that restarts itself.
+struct TimerLoop {
+    Timer* timer;
+    size_t count;
+    size_t remaining;
+};
+
+void onTimerLoop(void* opaque) {
+    TimerLoop* loop = static_cast<TimerLoop*>(opaque);
+    loop->count++;
+    if (loop->count < loop->remaining) {
+        loop->timer->startRelative(0);
+    }
+}
+
+void onTimer(void* opaque) {}
+
+// Bounces a byte between the two ends of a socket pair, each read event
+// sending the next byte, until the looper must stop.
+struct FdLoop {
+    Looper* looper;
+    int readFd;
+    int writeFd;
+    size_t count;
+    size_t remaining;
+};
+
+void onFdLoop(void* opaque, int fd, unsigned events) {
+    FdLoop* loop = static_cast<FdLoop*>(opaque);
+    char c;
+    socketRecv(loop->readFd, &c, 1);
+    loop->count++;
+    if (loop->count == loop->remaining) {
+        loop->looper->forceQuit();
+        return;
+    }
+    socketSend(loop->writeFd, &c, 1);
+}
+
+}  // namespace
+
+BENCHMARK(Looper_TimerCreateDelete) {
+    ScopedPtr<Looper> looper(Looper::create());
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        Timer* timer = looper->createTimer(onTimer, NULL);
+        delete timer;
+    }
+}
+
+BENCHMARK(Looper_TimerStartStop) {
+    ScopedPtr<Looper> looper(Looper::create());
+    ScopedPtr<Timer> timer(looper->createTimer(onTimer, NULL));
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        timer->startRelative(1000);
+        timer->stop();
+    }
+}
+
+// Dispatching an expired timer from the event loop. Without fd watches,
+// each run of the loop returns after firing the timer.
+BENCHMARK(Looper_TimerFire) {
+    ScopedPtr<Looper> looper(Looper::create());
+    TimerLoop loop;
+    loop.timer = looper->createTimer(onTimerLoop, &loop);
+    loop.count = 0;
+    loop.remaining = b->iterations();
+    loop.timer->startRelative(0);
+    while (loop.count < loop.remaining) {
+        looper->runWithDeadlineMs(Looper::kDurationInfinite);
+    }
+    delete loop.timer;
+}
+
+// Dispatching a read event from the event loop, including the cost of the
+// socket system calls.
+BENCHMARK(Looper_FdWatchRead) {
+    ScopedPtr<Looper> looper(Looper::create());
+    int fds[2];
+    b->stopTiming();
+    if (socketCreatePair(&fds[0], &fds[1]) < 0) {
+        return;
+    }
+    FdLoop loop;
+    loop.looper = looper.get();
+    loop.readFd = fds[0];
+    loop.writeFd = fds[1];
+    loop.count = 0;
+    loop.remaining = b->iterations();
+    ScopedPtr<FdWatch> watch(looper->createFdWatch(fds[0], onFdLoop, &loop));
+    watch->wantRead();
+    char c = 0;
+    socketSend(fds[1], &c, 1);
+    b->startTiming();
+    looper->run();
+    b->stopTiming();
+    watch.reset(NULL);
+    socketClose(fds[0]);
+    socketClose(fds[1]);
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,162 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/async/Looper.h"
+
+#include "android/base/containers/PodVector.h"
+#include "android/base/memory/ScopedPtr.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+typedef Looper::Timer Timer;
+
+// Records the index of each timer when it fires.
+struct TimerTest {
+    PodVector<int> fired;
+    Timer* timers[16];
+    int stopIndex;   // Index of the timer stopped by the first callback.
+
+    TimerTest() : fired(), stopIndex(-1) {
+        for (size_t n = 0; n < 16; ++n) {
+            timers[n] = NULL;
+        }
+    }
+};
+
+struct TimerInfo {
+    TimerTest* test;
+    int index;
+};
+
+void onTimer(void* opaque) {
+    TimerInfo* info = static_cast<TimerInfo*>(opaque);
+    TimerTest* test = info->test;
+    if (test->fired.empty() && test->stopIndex >= 0) {
+        test->timers[test->stopIndex]->stop();
+    }
+    test->fired.push_back(info->index);
+}
+
+}  // namespace
+
+// Timers whose deadlines are in the past all expire during the same
+// iteration of the loop (there are no fd watches, so run() returns after
+// a single one), in deadline order.
+TEST(Looper, ExpiredTimersFireInDeadlineOrder) {
+    ScopedPtr<Looper> looper(Looper::create());
+    static const Looper::Duration kDeadlines[] = { 50, 10, 40, 20, 30, 0 };
+    const int kCount = sizeof(kDeadlines) / sizeof(kDeadlines[0]);
+    TimerTest test;
+    TimerInfo infos[kCount];
+    for (int n = 0; n < kCount; ++n) {
+        infos[n].test = &test;
+        infos[n].index = n;
+        test.timers[n] = looper->createTimer(onTimer, &infos[n]);
+        test.timers[n]->startAbsolute(kDeadlines[n]);
+        EXPECT_TRUE(test.timers[n]->isActive());
+    }
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithDeadlineMs(Looper::kDurationInfinite));
+
+    static const int kExpected[] = { 5, 1, 3, 4, 2, 0 };
+    ASSERT_EQ(static_cast<size_t>(kCount), test.fired.size());
+    for (int n = 0; n < kCount; ++n) {
+        EXPECT_EQ(kExpected[n], test.fired[n]) << "at " << n;
+        EXPECT_FALSE(test.timers[n]->isActive());
+    }
+
+    // No more active timers.
+    EXPECT_EQ(EWOULDBLOCK,
+              looper->runWithDeadlineMs(Looper::kDurationInfinite));
+}
+
+TEST(Looper, TimersWithSameDeadlineFireInStartOrder) {
+    ScopedPtr<Looper> looper(Looper::create());
+    const int kCount = 10;
+    TimerTest test;
+    TimerInfo infos[kCount];
+    for (int n = 0; n < kCount; ++n) {
+        infos[n].test = &test;
+        infos[n].index = n;
+        test.timers[n] = looper->createTimer(onTimer, &infos[n]);
+    }
+    // Start them in a scrambled order, restarting some of them.
+    static const int kStartOrder[] = { 3, 7, 1, 9, 0, 7, 5, 2, 8, 6, 4, 3 };
+    const int kStarts = sizeof(kStartOrder) / sizeof(kStartOrder[0]);
+    for (int n = 0; n < kStarts; ++n) {
+        test.timers[kStartOrder[n]]->startAbsolute(100);
+    }
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithDeadlineMs(Looper::kDurationInfinite));
+
+    static const int kExpected[] = { 1, 9, 0, 7, 5, 2, 8, 6, 4, 3 };
+    ASSERT_EQ(static_cast<size_t>(kCount), test.fired.size());
+    for (int n = 0; n < kCount; ++n) {
+        EXPECT_EQ(kExpected[n], test.fired[n]) << "at " << n;
+    }
+    for (int n = 0; n < kCount; ++n) {
+        delete test.timers[n];
+    }
+}
+
+TEST(Looper, StoppedPendingTimerDoesNotFire) {
+    ScopedPtr<Looper> looper(Looper::create());
+    TimerTest test;
+    TimerInfo infos[3];
+    for (int n = 0; n < 3; ++n) {
+        infos[n].test = &test;
+        infos[n].index = n;
+        test.timers[n] = looper->createTimer(onTimer, &infos[n]);
+        test.timers[n]->startAbsolute(n);
+    }
+    // The first callback stops the last timer, which already expired.
+    test.stopIndex = 2;
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithDeadlineMs(Looper::kDurationInfinite));
+
+    ASSERT_EQ(2U, test.fired.size());
+    EXPECT_EQ(0, test.fired[0]);
+    EXPECT_EQ(1, test.fired[1]);
+    EXPECT_FALSE(test.timers[2]->isActive());
+}
+
+TEST(Looper, StopAndDeleteActiveTimers) {
+    ScopedPtr<Looper> looper(Looper::create());
+    TimerTest test;
+    TimerInfo infos[8];
+    for (int n = 0; n < 8; ++n) {
+        infos[n].test = &test;
+        infos[n].index = n;
+        test.timers[n] = looper->createTimer(onTimer, &infos[n]);
+        test.timers[n]->startAbsolute((n * 5) % 8);
+    }
+    test.timers[4]->stop();
+    EXPECT_FALSE(test.timers[4]->isActive());
+    delete test.timers[0];
+    delete test.timers[6];
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithDeadlineMs(Looper::kDurationInfinite));
+
+    // Deadlines are 5, 2, 7, 1 and 3 for timers 1, 2, 3, 5 and 7.
+    static const int kExpected[] = { 5, 2, 7, 1, 3 };
+    ASSERT_EQ(5U, test.fired.size());
+    for (int n = 0; n < 5; ++n) {
+        EXPECT_EQ(kExpected[n], test.fired[n]) << "at " << n;
+    }
+}
+
+}  // namespace base
+}  // namespace android
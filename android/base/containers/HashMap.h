@@ -0,0 +1,320 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_CONTAINERS_HASH_MAP_H
+#define ANDROID_BASE_CONTAINERS_HASH_MAP_H
+
+#include "android/base/Compiler.h"
+#include "android/base/containers/HashUtils.h"
+
+#include <new>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace android {
+namespace base {
+
+// Default hashing traits for HashMap keys: integer types hash to their
+// value, and pointers to their address. Provide your own traits class
+// with a static hash() method for other key types. Keys are compared
+// with operator==.
+template <typename K>
+struct HashMapTraits {
+    static size_t hash(const K& key) {
+        return static_cast<size_t>(key);
+    }
+};
+
+template <typename T>
+struct HashMapTraits<T*> {
+    static size_t hash(T* const& key) {
+        return internal::pointerHash(key);
+    }
+};
+
+// Base class for HashMap<K,V>, to reduce the code generated for each
+// template instance. It manages the index of the map, an array of slots
+// that each hold the hash of a key and the position of its entry, using
+// open addressing with Robin Hood probing.
+class HashMapBase {
+protected:
+    struct Slot {
+        uint32_t hash;
+        uint32_t entry;
+    };
+
+    enum {
+        kEmptyEntry = 0xffffffffU,
+    };
+
+    static const size_t kNotFound = ~static_cast<size_t>(0);
+
+    HashMapBase();
+    ~HashMapBase();
+
+    // Mix the bits of |hash| into a 32-bit value. The index uses its
+    // high bits, so that sequential keys such as handles spread well.
+    static uint32_t mixHash(size_t hash) {
+        uint64_t h = hash;
+        return static_cast<uint32_t>(h ^ (h >> 32)) * 2654435769U;
+    }
+
+    size_t capacity() const { return mSlots ? (1U << mShift) : 0U; }
+
+    size_t slotIndex(uint32_t hash) const {
+        return hash >> (32U - mShift);
+    }
+
+    size_t probeDistance(uint32_t hash, size_t pos) const {
+        return (pos - slotIndex(hash)) & (capacity() - 1U);
+    }
+
+    // Add a slot for the entry at |entry| with |hash|. |count| is the
+    // number of entries once it is added, used to grow the index.
+    void insertSlot(uint32_t hash, uint32_t entry, size_t count);
+
+    // Remove the slot at |pos|.
+    void removeSlot(size_t pos);
+
+    // Return the position of the slot of the entry at |entry| with |hash|.
+    size_t findEntrySlot(uint32_t hash, uint32_t entry) const;
+
+    // Release the index.
+    void clearSlots();
+
+    Slot* mSlots;
+    size_t mShift;
+
+private:
+    void placeSlot(Slot slot);
+
+    DISALLOW_COPY_AND_ASSIGN(HashMapBase);
+};
+
+// A HashMap<K,V> maps keys of type |K| to values of type |V|.
+//
+// Unlike std::map, lookups don't chase pointers: the index is a flat
+// array of (hash, position) slots, and the entries are stored contiguously
+// in a second array, so that a lookup typically touches one slot and one
+// entry, and iterating over the map scans a single array.
+//
+// Keys and values are copied in the map, and must be copy-constructible
+// and assignable. Pointers or references to values are invalidated by any
+// insertion or removal.
+//
+// Usage example:
+//
+//     HashMap<int, Foo> map;
+//     map.set(1, foo1);               // Add or replace a value.
+//     Foo* foo = map.find(1);         // Return NULL if not in the map.
+//     if (map.contains(2)) {
+//         map.erase(2);
+//     }
+//
+// Iterating over the map, in no particular order:
+//
+//     HashMap<int, Foo>::Iterator iter(&map);
+//     while (iter.hasNext()) {
+//         iter.next();
+//         .. do something with iter.key() and iter.value().
+//         if (...) {
+//             iter.erase();    // Remove the current item.
+//         }
+//     }
+//
+// Erasing the current item through the iterator is safe, and doesn't
+// change the items visited by the iteration. Adding items, or removing
+// them with erase(), makes the iterator invalid.
+template <typename K, typename V, typename TRAITS = HashMapTraits<K> >
+class HashMap : public HashMapBase {
+public:
+    // Create a new empty map.
+    HashMap() :
+            HashMapBase(), mEntries(NULL), mCount(0), mEntryCapacity(0) {}
+
+    // Destructor.
+    ~HashMap() { clear(); }
+
+    // Return true iff the map is empty.
+    bool empty() const { return mCount == 0; }
+
+    // Return the number of items in the map.
+    size_t size() const { return mCount; }
+
+    // Remove all items from the map.
+    void clear() {
+        for (size_t n = 0; n < mCount; ++n) {
+            mEntries[n].~Entry();
+        }
+        ::free(mEntries);
+        mEntries = NULL;
+        mCount = 0;
+        mEntryCapacity = 0;
+        clearSlots();
+    }
+
+    // Return true iff the map contains |key|.
+    bool contains(const K& key) const {
+        return findSlot(key, mixHash(TRAITS::hash(key))) != kNotFound;
+    }
+
+    // Return a pointer to the value of |key|, which is still owned by
+    // the map, or NULL if it is not in the map.
+    V* find(const K& key) {
+        size_t pos = findSlot(key, mixHash(TRAITS::hash(key)));
+        if (pos == kNotFound) {
+            return NULL;
+        }
+        return &mEntries[mSlots[pos].entry].value;
+    }
+
+    const V* find(const K& key) const {
+        return const_cast<HashMap*>(this)->find(key);
+    }
+
+    // Associate |value| with |key|. Return true if |key| was added to the
+    // map, or false if its previous value was replaced.
+    bool set(const K& key, const V& value) {
+        uint32_t hash = mixHash(TRAITS::hash(key));
+        size_t pos = findSlot(key, hash);
+        if (pos != kNotFound) {
+            mEntries[mSlots[pos].entry].value = value;
+            return false;
+        }
+        if (mCount == mEntryCapacity) {
+            reserveEntries(mEntryCapacity ? 2 * mEntryCapacity
+                                          : (size_t)internal::kMinCapacity);
+        }
+        new (&mEntries[mCount]) Entry(key, value, hash);
+        mCount++;
+        insertSlot(hash, static_cast<uint32_t>(mCount - 1), mCount);
+        return true;
+    }
+
+    // Remove |key| from the map. Return true if it was in the map, or
+    // false otherwise.
+    bool erase(const K& key) {
+        uint32_t hash = mixHash(TRAITS::hash(key));
+        size_t pos = findSlot(key, hash);
+        if (pos == kNotFound) {
+            return false;
+        }
+        eraseEntry(mSlots[pos].entry, pos);
+        return true;
+    }
+
+    // Iterator over the items of the map. See the class documentation.
+    class Iterator {
+    public:
+        explicit Iterator(HashMap* map) : mMap(map), mPos(map->mCount) {}
+
+        // Return true iff there are items left, i.e. next() can be called.
+        bool hasNext() const { return mPos > 0; }
+
+        // Move to the next item.
+        void next() { mPos--; }
+
+        // Return the key and value of the current item.
+        const K& key() const { return mMap->mEntries[mPos].key; }
+        V& value() const { return mMap->mEntries[mPos].value; }
+
+        // Remove the current item from the map. key() and value() must
+        // not be called again before next().
+        void erase() {
+            mMap->eraseEntry(
+                    mPos,
+                    mMap->findEntrySlot(mMap->mEntries[mPos].hash, mPos));
+        }
+
+    private:
+        HashMap* mMap;
+        // Position of the current entry. Entries are visited from the last
+        // one, so that erasing one only moves a visited entry in its place.
+        size_t mPos;
+
+        DISALLOW_COPY_AND_ASSIGN(Iterator);
+    };
+
+private:
+    struct Entry {
+        Entry(const K& k, const V& v, uint32_t h) :
+                key(k), value(v), hash(h) {}
+
+        K key;
+        V value;
+        uint32_t hash;
+    };
+
+    // Return the position of the slot of |key| with |hash|, or kNotFound.
+    size_t findSlot(const K& key, uint32_t hash) const {
+        if (!mSlots) {
+            return kNotFound;
+        }
+        size_t mask = capacity() - 1U;
+        size_t pos = slotIndex(hash);
+        for (size_t dist = 0; ; ++dist) {
+            const Slot& slot = mSlots[pos];
+            // With Robin Hood probing, the key can't be further than a
+            // slot whose entry is closer to its ideal position.
+            if (slot.entry == kEmptyEntry ||
+                probeDistance(slot.hash, pos) < dist) {
+                return kNotFound;
+            }
+            if (slot.hash == hash && mEntries[slot.entry].key == key) {
+                return pos;
+            }
+            pos = (pos + 1U) & mask;
+        }
+    }
+
+    // Remove the entry at |entry|, whose slot is at |pos|. The last entry
+    // is moved in its place to keep the entries contiguous.
+    void eraseEntry(size_t entry, size_t pos) {
+        removeSlot(pos);
+        size_t last = mCount - 1U;
+        if (entry != last) {
+            mSlots[findEntrySlot(mEntries[last].hash,
+                                 static_cast<uint32_t>(last))].entry =
+                    static_cast<uint32_t>(entry);
+            mEntries[entry] = mEntries[last];
+        }
+        mEntries[last].~Entry();
+        mCount--;
+    }
+
+    void reserveEntries(size_t capacity) {
+        Entry* entries =
+                static_cast<Entry*>(::malloc(capacity * sizeof(Entry)));
+        for (size_t n = 0; n < mCount; ++n) {
+            new (&entries[n]) Entry(mEntries[n]);
+            mEntries[n].~Entry();
+        }
+        ::free(mEntries);
+        mEntries = entries;
+        mEntryCapacity = capacity;
+    }
+
+    Entry* mEntries;
+    size_t mCount;
+    size_t mEntryCapacity;
+
+    DISALLOW_COPY_AND_ASSIGN(HashMap);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_CONTAINERS_HASH_MAP_H
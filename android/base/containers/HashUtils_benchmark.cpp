@@ -0,0 +1,36 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/containers/HashUtils.h"
+
+#include "android/base/testing/Benchmark.h"
+
+namespace android {
+namespace base {
+
+BENCHMARK(HashUtils_PointerHash) {
+    size_t sum = 0;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        sum += internal::pointerHash(reinterpret_cast<const void*>(n * 8));
+    }
+    Benchmark::doNotOptimize(sum);
+}
+
+BENCHMARK(HashUtils_HashShiftAdjust) {
+    size_t shift = internal::kMinShift;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        shift = internal::hashShiftAdjust(n & 65535, shift);
+    }
+    Benchmark::doNotOptimize(shift);
+}
+
+}  // namespace base
+}  // namespace android
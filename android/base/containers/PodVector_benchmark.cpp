@@ -0,0 +1,76 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/containers/PodVector.h"
+
+#include "android/base/testing/Benchmark.h"
+
+namespace android {
+namespace base {
+
+// Appending to a vector that grows, i.e. including the amortized cost of
+// the reallocations.
+BENCHMARK(PodVector_PushBack) {
+    PodVector<int> v;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        if (v.size() == 4096) {
+            v.resize(0);
+        }
+        v.push_back((int)n);
+    }
+    Benchmark::doNotOptimize(v);
+}
+
+// Building a vector of 1000 items from scratch.
+BENCHMARK(PodVector_Build1000) {
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        PodVector<int> v;
+        for (int i = 0; i < 1000; ++i) {
+            v.push_back(i);
+        }
+        Benchmark::doNotOptimize(v);
+    }
+}
+
+// Same as above, with the storage reserved first.
+BENCHMARK(PodVector_Build1000Reserved) {
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        PodVector<int> v;
+        v.reserve(1000);
+        for (int i = 0; i < 1000; ++i) {
+            v.push_back(i);
+        }
+        Benchmark::doNotOptimize(v);
+    }
+}
+
+BENCHMARK(PodVector_Copy1000) {
+    PodVector<int> v;
+    v.resize(1000);
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        PodVector<int> copy(v);
+        Benchmark::doNotOptimize(copy);
+    }
+}
+
+// Inserting then removing an item at the front of a 1000 item vector.
+BENCHMARK(PodVector_InsertRemoveFront1000) {
+    PodVector<int> v;
+    v.resize(1000);
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        v.insert(0, (int)n);
+        v.remove(0);
+    }
+    Benchmark::doNotOptimize(v);
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,91 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/containers/PointerSet.h"
+
+#include "android/base/testing/Benchmark.h"
+
+namespace android {
+namespace base {
+
+namespace {
+
+const size_t kItemCount = 1024;
+
+// Distinct addresses to store in the sets.
+int sItems[kItemCount];
+
+}  // namespace
+
+// Filling an empty set, including the cost of growing it.
+BENCHMARK(PointerSet_Add1024) {
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        PointerSet<int> set;
+        for (size_t i = 0; i < kItemCount; ++i) {
+            set.add(&sItems[i]);
+        }
+        Benchmark::doNotOptimize(set);
+    }
+}
+
+BENCHMARK(PointerSet_ContainsHit) {
+    PointerSet<int> set;
+    for (size_t i = 0; i < kItemCount; ++i) {
+        set.add(&sItems[i]);
+    }
+    size_t found = 0;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        found += set.contains(&sItems[n & (kItemCount - 1)]);
+    }
+    Benchmark::doNotOptimize(found);
+}
+
+BENCHMARK(PointerSet_ContainsMiss) {
+    PointerSet<int> set;
+    for (size_t i = 0; i < kItemCount; i += 2) {
+        set.add(&sItems[i]);
+    }
+    size_t found = 0;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        found += set.contains(&sItems[(n & (kItemCount - 1)) | 1]);
+    }
+    Benchmark::doNotOptimize(found);
+}
+
+// Removing an item then adding it back, in a set of constant size.
+BENCHMARK(PointerSet_RemoveAdd) {
+    PointerSet<int> set;
+    for (size_t i = 0; i < kItemCount; ++i) {
+        set.add(&sItems[i]);
+    }
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        int* item = &sItems[n & (kItemCount - 1)];
+        set.remove(item);
+        set.add(item);
+    }
+    Benchmark::doNotOptimize(set);
+}
+
+BENCHMARK(PointerSet_Iterate1024) {
+    PointerSet<int> set;
+    for (size_t i = 0; i < kItemCount; ++i) {
+        set.add(&sItems[i]);
+    }
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        PointerSet<int>::Iterator iter(&set);
+        while (iter.hasNext()) {
+            Benchmark::doNotOptimize(iter.next());
+        }
+    }
+}
+
+}  // namespace base
+}  // namespace android
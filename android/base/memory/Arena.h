@@ -0,0 +1,127 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_MEMORY_ARENA_H
+#define ANDROID_BASE_MEMORY_ARENA_H
+
+#include "android/base/Compiler.h"
+
+#include <stddef.h>
+
+namespace android {
+namespace base {
+
+// A bump allocator for short-lived temporaries, e.g. the buffers needed
+// while processing a single frame or command.
+//
+// Memory is taken from large heap chunks by incrementing a pointer, and
+// is only released all at once, by calling reset() or when an
+// Arena::Frame goes out of scope. The chunks are kept for reuse, so that
+// once the arena has grown to the size needed by an operation, repeating
+// it doesn't touch the heap at all.
+//
+// Arenas are not thread-safe, use getThreadLocal() to get one for the
+// current thread.
+//
+// Usage example:
+//
+//    void processCommand(...) {
+//        Arena::Frame frame(Arena::getThreadLocal());
+//        float* tmp = frame.arena()->allocArray<float>(count);
+//        ...
+//    }   // |tmp| is released here.
+//
+// NOTE: No constructor or destructor is called on the allocated memory,
+//       only use it for plain-old-data.
+class Arena {
+    struct Chunk;
+
+public:
+    // Default size of the heap chunks.
+    static const size_t kDefaultChunkSize = 16384;
+
+    // Alignment of all allocations, enough for any scalar type.
+    static const size_t kAlignment = 8;
+
+    // Create a new empty arena that allocates heap chunks of |chunkSize|
+    // bytes, or larger for allocations that don't fit in one.
+    explicit Arena(size_t chunkSize = kDefaultChunkSize);
+
+    // Destructor. Releases all memory.
+    ~Arena();
+
+    // Return a new block of |size| bytes, aligned to kAlignment.
+    void* alloc(size_t size);
+
+    // Return a new array of |count| items of type |T|.
+    template <typename T>
+    T* allocArray(size_t count) {
+        return static_cast<T*>(alloc(count * sizeof(T)));
+    }
+
+    // Release all blocks allocated so far, keeping the chunks for reuse.
+    void reset();
+
+    // Return the number of chunks allocated from the heap since this
+    // arena was created. Useful to check that a hot path doesn't allocate.
+    size_t getChunkAllocationCount() const { return mChunkAllocationCount; }
+
+    // Return an arena owned by the current thread, created on demand and
+    // destroyed when the thread exits.
+    static Arena* getThreadLocal();
+
+    // Scoped helper that releases all blocks allocated from an arena
+    // during its lifetime, when it goes out of scope. Frames can be
+    // nested, but must be destroyed in reverse order of creation.
+    class Frame {
+    public:
+        explicit Frame(Arena* arena) :
+                mArena(arena),
+                mChunk(arena->mCurrent),
+                mPos(arena->mPos) {}
+
+        ~Frame() {
+            mArena->mCurrent = mChunk;
+            mArena->mPos = mPos;
+        }
+
+        Arena* arena() const { return mArena; }
+
+    private:
+        Arena* mArena;
+        Chunk* mChunk;
+        size_t mPos;
+
+        DISALLOW_COPY_AND_ASSIGN(Frame);
+    };
+
+private:
+    friend class Frame;
+
+    Chunk* mFirst;
+    Chunk* mLast;
+    // Chunk of the next allocation, or NULL before the first one.
+    Chunk* mCurrent;
+    // Offset of the next allocation in |mCurrent|.
+    size_t mPos;
+    size_t mChunkSize;
+    size_t mChunkAllocationCount;
+
+    DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_MEMORY_ARENA_H
@@ -19,6 +19,7 @@
 #include "android/base/sockets/Winsock.h"
 #else
 #  include <sys/socket.h>
+#  include <sys/uio.h>
 #  include <unistd.h>
 #  include <fcntl.h>
 #  include <netinet/in.h>
@@ -304,6 +305,61 @@ ssize_t socketSend(int socket, const void* buffer, size_t bufferLen) {
     return ret;
 }
 
+ssize_t socketRecvv(int socket, const SocketBuffer* buffers, size_t count) {
+    if (count > kMaxSocketBuffers) {
+        count = kMaxSocketBuffers;
+    }
+#ifdef _WIN32
+    WSABUF bufs[kMaxSocketBuffers];
+    for (size_t n = 0; n < count; ++n) {
+        bufs[n].buf = reinterpret_cast<char*>(buffers[n].data);
+        bufs[n].len = static_cast<ULONG>(buffers[n].size);
+    }
+    DWORD received = 0;
+    DWORD flags = 0;
+    int ret = ::WSARecv(socket, bufs, static_cast<DWORD>(count),
+                        &received, &flags, NULL, NULL);
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return static_cast<ssize_t>(received);
+#else  // !_WIN32
+    struct iovec iov[kMaxSocketBuffers];
+    for (size_t n = 0; n < count; ++n) {
+        iov[n].iov_base = buffers[n].data;
+        iov[n].iov_len = buffers[n].size;
+    }
+    ssize_t ret = HANDLE_EINTR(::readv(socket, iov, static_cast<int>(count)));
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return ret;
+#endif  // !_WIN32
+}
+
+ssize_t socketSendv(int socket, const SocketBuffer* buffers, size_t count) {
+    if (count > kMaxSocketBuffers) {
+        count = kMaxSocketBuffers;
+    }
+#ifdef _WIN32
+    WSABUF bufs[kMaxSocketBuffers];
+    for (size_t n = 0; n < count; ++n) {
+        bufs[n].buf = reinterpret_cast<char*>(buffers[n].data);
+        bufs[n].len = static_cast<ULONG>(buffers[n].size);
+    }
+    DWORD sent = 0;
+    int ret = ::WSASend(socket, bufs, static_cast<DWORD>(count),
+                        &sent, 0, NULL, NULL);
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return static_cast<ssize_t>(sent);
+#else  // !_WIN32
+    struct iovec iov[kMaxSocketBuffers];
+    for (size_t n = 0; n < count; ++n) {
+        iov[n].iov_base = buffers[n].data;
+        iov[n].iov_len = buffers[n].size;
+    }
+    ssize_t ret = HANDLE_EINTR(::writev(socket, iov, static_cast<int>(count)));
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return ret;
+#endif  // !_WIN32
+}
+
 void socketShutdownWrites(int socket) {
 #ifdef _WIN32
     ::shutdown(socket, SD_SEND);
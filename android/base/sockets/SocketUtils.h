@@ -33,6 +33,29 @@ ssize_t socketRecv(int socket, void* buffer, size_t bufferLen);
 // a convenience.
 ssize_t socketSend(int socket, const void* buffer, size_t bufferLen);
 
+// A buffer descriptor for socketRecvv() and socketSendv(), similar to
+// the Posix struct iovec.
+struct SocketBuffer {
+    void* data;
+    size_t size;
+};
+
+// Maximum number of buffers transferred by a single call to socketRecvv()
+// or socketSendv(). Extra buffers are ignored.
+static const size_t kMaxSocketBuffers = 16;
+
+// Try to receive data from |socket| into the |count| buffers described by
+// |buffers|, in order, with a single system call. Return the total number
+// of bytes read, 0 in case of disconnection, or -1/errno in case of
+// error. Note that this loops around EINTR as a convenience.
+ssize_t socketRecvv(int socket, const SocketBuffer* buffers, size_t count);
+
+// Try to send the data of the |count| buffers described by |buffers|, in
+// order, to |socket| with a single system call. Return the total number
+// of bytes sent, 0 in case of disconnection, or -1/errno in case of error.
+// Note that this loops around EINTR as a convenience.
+ssize_t socketSendv(int socket, const SocketBuffer* buffers, size_t count);
+
 // Shutdown all writes to a socket.
 void socketShutdownWrites(int socket);
 
@@ -13,6 +13,7 @@
 #include "android/base/Limits.h"
 #include "android/base/sockets/SocketWaiter.h"
 
+#include "android/base/containers/PodVector.h"
 #include "android/base/Log.h"
 #include "android/base/sockets/SocketErrors.h"
 
@@ -21,10 +22,20 @@
 #else
 #  include <sys/types.h>
 #  include <sys/select.h>
+#  include <unistd.h>
 #endif
 
+#ifdef __linux__
+#  include <sys/epoll.h>
+#endif
+
+#ifdef __APPLE__
+#  include <sys/event.h>
+#  include <sys/time.h>
+#endif
 
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 
 namespace android {
@@ -249,11 +260,352 @@ private:
     int mPendingFd;
 };
 
+#if defined(__linux__) || defined(__APPLE__)
+
+// Base class for the waiters that use a kernel event queue (epoll or
+// kqueue). The queue records the watched descriptors, so unlike select()
+// there is nothing to rebuild before each wait, and no FD_SETSIZE limit.
+// Only the changes are sent to the kernel, through changeEvents().
+//
+// Events are level-triggered, as with select(): a descriptor stays
+// pending as long as it is readable or writable. Callers of this
+// interface don't always drain their sockets, which edge-triggered
+// notifications would require.
+class QueueSocketWaiter : public SocketWaiter {
+public:
+    QueueSocketWaiter() :
+            SocketWaiter(),
+            mWanted(),
+            mPending(),
+            mPendingFds(),
+            mPendingIndex(0),
+            mFdCount(0) {}
+
+    virtual ~QueueSocketWaiter() {}
+
+    virtual void reset() {
+        clearPending();
+        for (size_t fd = 0; fd < mWanted.size(); ++fd) {
+            if (mWanted[fd]) {
+                changeEvents(static_cast<int>(fd), mWanted[fd], 0);
+                mWanted[fd] = 0;
+            }
+        }
+        mFdCount = 0;
+    }
+
+    virtual unsigned wantedEventsFor(int fd) const {
+        if (fd < 0 || static_cast<size_t>(fd) >= mWanted.size()) {
+            return 0U;
+        }
+        return mWanted[fd];
+    }
+
+    virtual unsigned pendingEventsFor(int fd) const {
+        if (fd < 0 || static_cast<size_t>(fd) >= mPending.size()) {
+            return 0U;
+        }
+        return mPending[fd];
+    }
+
+    virtual bool hasFds() const {
+        return mFdCount > 0;
+    }
+
+    virtual void update(int fd, unsigned events) {
+        DCHECK(fd >= 0) << "fd " << fd;
+
+        events &= (kEventRead | kEventWrite);
+        unsigned oldEvents = wantedEventsFor(fd);
+        if (events == oldEvents) {
+            return;
+        }
+        growTo(fd);
+        changeEvents(fd, oldEvents, events);
+        mWanted[fd] = events;
+        // Events that are no longer wanted aren't reported anymore.
+        mPending[fd] &= events;
+
+        if (oldEvents == 0) {
+            mFdCount++;
+        } else if (events == 0) {
+            mFdCount--;
+        }
+    }
+
+    virtual int wait(int64_t timeout_ms) {
+        clearPending();
+
+        // Nothing to wait on.
+        if (mFdCount <= 0) {
+            return 0;
+        }
+
+        int ret;
+        do {
+            ret = waitEvents(timeout_ms);
+            if (ret == 0) {
+                errno = ETIMEDOUT;
+            }
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret < 0) {
+            LOG(ERROR) << LogString("Error: %s\n", strerror(errno));
+            return ret;
+        }
+        return static_cast<int>(mPendingFds.size());
+    }
+
+    virtual int nextPendingFd(unsigned *fdEvents) {
+        while (mPendingIndex < mPendingFds.size()) {
+            int fd = mPendingFds[mPendingIndex++];
+            unsigned events = mPending[fd];
+            if (events) {
+                *fdEvents = events;
+                return fd;
+            }
+        }
+        *fdEvents = 0;
+        return -1;
+    }
+
+protected:
+    // Tell the kernel queue that the events wanted for |fd| change
+    // from |oldEvents| to |newEvents|, either of which can be 0.
+    virtual void changeEvents(int fd, unsigned oldEvents,
+                              unsigned newEvents) = 0;
+
+    // Wait for events, and call addPending() for each of them. Return
+    // the number of kernel events, 0 on timeout, or -1/errno.
+    virtual int waitEvents(int64_t timeout_ms) = 0;
+
+    // Record |events| as pending for |fd|, ignoring unwanted ones.
+    void addPending(int fd, unsigned events) {
+        events &= wantedEventsFor(fd);
+        if (!events) {
+            return;
+        }
+        if (!mPending[fd]) {
+            mPendingFds.append(fd);
+        }
+        mPending[fd] |= events;
+    }
+
+    // Convert a wait() timeout into milliseconds for the kernel, where
+    // -1 means an infinite wait.
+    static int toTimeoutMs(int64_t timeout_ms) {
+        if (timeout_ms < 0 || timeout_ms == INT64_MAX) {
+            return -1;
+        }
+        if (timeout_ms > INT_MAX) {
+            return INT_MAX;
+        }
+        return static_cast<int>(timeout_ms);
+    }
+
+    int fdCount() const { return mFdCount; }
+
+private:
+    void growTo(int fd) {
+        size_t oldSize = mWanted.size();
+        if (static_cast<size_t>(fd) < oldSize) {
+            return;
+        }
+        size_t newSize = static_cast<size_t>(fd) + 1;
+        mWanted.resize(newSize);
+        mPending.resize(newSize);
+        for (size_t n = oldSize; n < newSize; ++n) {
+            mWanted[n] = 0;
+            mPending[n] = 0;
+        }
+    }
+
+    void clearPending() {
+        for (size_t n = 0; n < mPendingFds.size(); ++n) {
+            mPending[mPendingFds[n]] = 0;
+        }
+        mPendingFds.resize(0);
+        mPendingIndex = 0;
+    }
+
+    PodVector<unsigned> mWanted;
+    PodVector<unsigned> mPending;
+    PodVector<int> mPendingFds;
+    size_t mPendingIndex;
+    int mFdCount;
+};
+
+#endif  // __linux__ || __APPLE__
+
+#ifdef __linux__
+
+class EpollSocketWaiter : public QueueSocketWaiter {
+public:
+    // Return a new instance, or NULL if epoll isn't available.
+    static EpollSocketWaiter* create() {
+        int epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            return NULL;
+        }
+        return new EpollSocketWaiter(epollFd);
+    }
+
+    virtual ~EpollSocketWaiter() {
+        ::close(mEpollFd);
+    }
+
+protected:
+    virtual void changeEvents(int fd, unsigned oldEvents,
+                              unsigned newEvents) {
+        if (!newEvents) {
+            // Fails with EBADF or ENOENT if |fd| was closed before being
+            // removed, which already removed it from the epoll set.
+            ::epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
+            return;
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        if (newEvents & kEventRead) {
+            ev.events |= EPOLLIN;
+        }
+        if (newEvents & kEventWrite) {
+            ev.events |= EPOLLOUT;
+        }
+        ev.data.fd = fd;
+
+        int op = oldEvents ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (::epoll_ctl(mEpollFd, op, fd, &ev) < 0) {
+            // Retry with the other operation, in case |fd| was closed
+            // and reused without being removed from the waiter.
+            op = (op == EPOLL_CTL_MOD) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+            if (::epoll_ctl(mEpollFd, op, fd, &ev) < 0) {
+                LOG(ERROR) << LogString("epoll_ctl(%d): %s\n",
+                                        fd, strerror(errno));
+            }
+        }
+    }
+
+    virtual int waitEvents(int64_t timeout_ms) {
+        mEvents.resize(static_cast<size_t>(fdCount()));
+        int ret = ::epoll_wait(mEpollFd, mEvents.begin(),
+                               static_cast<int>(mEvents.size()),
+                               toTimeoutMs(timeout_ms));
+        for (int n = 0; n < ret; ++n) {
+            const struct epoll_event& ev = mEvents[n];
+            unsigned events = 0;
+            // Like select(), report errors and hang-ups as both readable
+            // and writable, so the next read or write sees them.
+            if (ev.events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                events |= kEventRead;
+            }
+            if (ev.events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                events |= kEventWrite;
+            }
+            addPending(ev.data.fd, events);
+        }
+        return ret;
+    }
+
+private:
+    explicit EpollSocketWaiter(int epollFd) :
+            QueueSocketWaiter(), mEpollFd(epollFd), mEvents() {}
+
+    int mEpollFd;
+    PodVector<struct epoll_event> mEvents;
+};
+
+#endif  // __linux__
+
+#ifdef __APPLE__
+
+class KqueueSocketWaiter : public QueueSocketWaiter {
+public:
+    // Return a new instance, or NULL if kqueue isn't available.
+    static KqueueSocketWaiter* create() {
+        int kq = ::kqueue();
+        if (kq < 0) {
+            return NULL;
+        }
+        return new KqueueSocketWaiter(kq);
+    }
+
+    virtual ~KqueueSocketWaiter() {
+        ::close(mKqueueFd);
+    }
+
+protected:
+    virtual void changeEvents(int fd, unsigned oldEvents,
+                              unsigned newEvents) {
+        // Read and write readiness are two separate filters.
+        struct kevent changes[2];
+        int count = 0;
+        unsigned changed = oldEvents ^ newEvents;
+        if (changed & kEventRead) {
+            EV_SET(&changes[count++], fd, EVFILT_READ,
+                   (newEvents & kEventRead) ? EV_ADD : EV_DELETE,
+                   0, 0, NULL);
+        }
+        if (changed & kEventWrite) {
+            EV_SET(&changes[count++], fd, EVFILT_WRITE,
+                   (newEvents & kEventWrite) ? EV_ADD : EV_DELETE,
+                   0, 0, NULL);
+        }
+        // Deleting a filter fails with ENOENT if |fd| was closed before
+        // being removed, which already removed its filters.
+        for (int n = 0; n < count; ++n) {
+            ::kevent(mKqueueFd, &changes[n], 1, NULL, 0, NULL);
+        }
+    }
+
+    virtual int waitEvents(int64_t timeout_ms) {
+        struct timespec ts, *pts = NULL;
+        int timeout = toTimeoutMs(timeout_ms);
+        if (timeout >= 0) {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000L;
+            pts = &ts;
+        }
+
+        mEvents.resize(2 * static_cast<size_t>(fdCount()));
+        int ret = ::kevent(mKqueueFd, NULL, 0, mEvents.begin(),
+                           static_cast<int>(mEvents.size()), pts);
+        for (int n = 0; n < ret; ++n) {
+            const struct kevent& ev = mEvents[n];
+            if (ev.flags & EV_ERROR) {
+                continue;
+            }
+            addPending(static_cast<int>(ev.ident),
+                       (ev.filter == EVFILT_READ) ? kEventRead
+                                                  : kEventWrite);
+        }
+        return ret;
+    }
+
+private:
+    explicit KqueueSocketWaiter(int kq) :
+            QueueSocketWaiter(), mKqueueFd(kq), mEvents() {}
+
+    int mKqueueFd;
+    PodVector<struct kevent> mEvents;
+};
+
+#endif  // __APPLE__
+
 }  // namespace
 
 // static
 SocketWaiter* SocketWaiter::create() {
-    return new SelectSocketWaiter();
+    SocketWaiter* waiter = NULL;
+#if defined(__linux__)
+    waiter = EpollSocketWaiter::create();
+#elif defined(__APPLE__)
+    waiter = KqueueSocketWaiter::create();
+#endif
+    if (!waiter) {
+        waiter = new SelectSocketWaiter();
+    }
+    return waiter;
 }
 
 }  // namespace base
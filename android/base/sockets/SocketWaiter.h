@@ -59,6 +59,14 @@ namespace base {
 //
 //        waiter->update(fd2, 0);
 //
+//     Do that before closing a descriptor: some implementations register
+//     the descriptors with the kernel, and only send it the changes.
+//
+// On Linux and OS X, the waiter is based on epoll and kqueue respectively,
+// so the cost of wait() doesn't depend on the number of watched
+// descriptors, and there is no FD_SETSIZE limit on their values. Other
+// hosts use select(). In all cases, events are level-triggered.
+//
 class SocketWaiter {
 public:
     enum Event {
@@ -121,6 +121,80 @@ TEST(SocketWaiter, waitOnWriteEvent) {
     socketClose(s1);
 }
 
+TEST(SocketWaiter, removedFdIsNotReported) {
+    ScopedPtr<SocketWaiter> waiter(SocketWaiter::create());
+
+    int s1, s2;
+
+    ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+
+    waiter->update(s1, SocketWaiter::kEventRead | SocketWaiter::kEventWrite);
+    EXPECT_EQ(1, socketSend(s2, "!", 1));
+    EXPECT_EQ(1, waiter->wait(0));
+    EXPECT_EQ(SocketWaiter::kEventRead | SocketWaiter::kEventWrite,
+              waiter->pendingEventsFor(s1));
+
+    // Events are level-triggered: they're reported again until the
+    // data is read.
+    waiter->update(s1, SocketWaiter::kEventRead);
+    EXPECT_EQ(1, waiter->wait(0));
+    EXPECT_EQ(SocketWaiter::kEventRead, waiter->pendingEventsFor(s1));
+
+    waiter->update(s1, 0);
+    EXPECT_FALSE(waiter->hasFds());
+    EXPECT_EQ(0, waiter->wait(0));
+    EXPECT_EQ(0U, waiter->pendingEventsFor(s1));
+
+    // Watching it again works.
+    waiter->update(s1, SocketWaiter::kEventRead);
+    EXPECT_EQ(1, waiter->wait(0));
+    unsigned events = 0;
+    EXPECT_EQ(s1, waiter->nextPendingFd(&events));
+    EXPECT_EQ(SocketWaiter::kEventRead, events);
+
+    socketClose(s2);
+    socketClose(s1);
+}
+
+TEST(SocketWaiter, waitOnManyFds) {
+    ScopedPtr<SocketWaiter> waiter(SocketWaiter::create());
+
+    const int kCount = 16;
+    int fds[kCount][2];
+
+    for (int n = 0; n < kCount; ++n) {
+        ASSERT_EQ(0, socketCreatePair(&fds[n][0], &fds[n][1]));
+        waiter->update(fds[n][0], SocketWaiter::kEventRead);
+    }
+
+    // Only the odd pairs get data.
+    for (int n = 1; n < kCount; n += 2) {
+        EXPECT_EQ(1, socketSend(fds[n][1], "!", 1));
+    }
+
+    EXPECT_EQ(kCount / 2, waiter->wait(0));
+    int found = 0;
+    for (;;) {
+        unsigned events = 0;
+        int fd = waiter->nextPendingFd(&events);
+        if (fd < 0) {
+            break;
+        }
+        EXPECT_EQ(SocketWaiter::kEventRead, events);
+        found++;
+    }
+    EXPECT_EQ(kCount / 2, found);
+    for (int n = 0; n < kCount; ++n) {
+        EXPECT_EQ((n & 1) ? SocketWaiter::kEventRead : 0U,
+                  waiter->pendingEventsFor(fds[n][0]));
+    }
+
+    for (int n = 0; n < kCount; ++n) {
+        waiter->update(fds[n][0], 0);
+        socketClose(fds[n][0]);
+        socketClose(fds[n][1]);
+    }
+}
 
 }  // namespace base
 }  // namespace android
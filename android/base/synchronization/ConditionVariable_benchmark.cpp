@@ -0,0 +1,94 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/synchronization/ConditionVariable.h"
+
+#include "android/base/synchronization/Lock.h"
+#include "android/base/testing/Benchmark.h"
+#include "android/base/threads/Thread.h"
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Two threads passing a token back and forth, each waiting on its own
+// condition variable for its turn.
+struct PingPong {
+    Lock lock;
+    ConditionVariable pingCv;
+    ConditionVariable pongCv;
+    size_t count;
+    bool pingTurn;
+
+    PingPong(size_t count_) : lock(), pingCv(), pongCv(), count(count_),
+                              pingTurn(true) {}
+};
+
+class PongThread : public Thread {
+public:
+    explicit PongThread(PingPong* state) : Thread(), mState(state) {}
+
+    virtual intptr_t main() {
+        PingPong* s = mState;
+        AutoLock lock(s->lock);
+        for (size_t n = 0; n < s->count; ++n) {
+            while (s->pingTurn) {
+                s->pongCv.wait(&s->lock);
+            }
+            s->pingTurn = true;
+            s->pingCv.signal();
+        }
+        return 0;
+    }
+
+private:
+    PingPong* mState;
+};
+
+}  // namespace
+
+BENCHMARK(ConditionVariable_SignalNoWaiter) {
+    ConditionVariable cv;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        cv.signal();
+    }
+}
+
+// A round trip between two threads, i.e. two waits and two signals.
+BENCHMARK(ConditionVariable_PingPong) {
+    b->stopTiming();
+    PingPong state(b->iterations());
+    PongThread thread(&state);
+    thread.start();
+    b->startTiming();
+    {
+        AutoLock lock(state.lock);
+        for (size_t n = 0; n < b->iterations(); ++n) {
+            while (!state.pingTurn) {
+                state.pingCv.wait(&state.lock);
+            }
+            state.pingTurn = false;
+            state.pongCv.signal();
+        }
+        while (!state.pingTurn) {
+            state.pingCv.wait(&state.lock);
+        }
+    }
+    b->stopTiming();
+    thread.wait(NULL);
+}
+
+}  // namespace base
+}  // namespace android
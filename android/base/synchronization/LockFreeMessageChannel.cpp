@@ -0,0 +1,159 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/synchronization/LockFreeMessageChannel.h"
+
+#include "android/base/Log.h"
+
+#include <stdint.h>
+
+// Positions are ever-increasing message counters, the slot of a position
+// is (pos & (capacity - 1)), which stays correct when they wrap around.
+// The sequence number of a slot is:
+//
+//   - |pos| when the slot is free for the sender of message |pos|.
+//   - |pos + 1| once message |pos| has been written to it.
+//   - |pos + capacity| once the receiver has read message |pos|, i.e.
+//     when it is free for the sender of the next message using this slot.
+
+namespace android {
+namespace base {
+
+namespace {
+
+size_t loadAcquire(volatile size_t* ptr) {
+    size_t value = *ptr;
+    __sync_synchronize();
+    return value;
+}
+
+void storeRelease(volatile size_t* ptr, size_t value) {
+    __sync_synchronize();
+    *ptr = value;
+}
+
+}  // namespace
+
+LockFreeMessageChannelBase::LockFreeMessageChannelBase(size_t capacity) :
+        mSequences(new size_t[capacity]),
+        mCapacity(capacity),
+        mWritePos(0U),
+        mReadPos(0U),
+        mLock(),
+        mCanRead(),
+        mCanWrite(),
+        mReaderWaiting(0),
+        mWritersWaiting(0) {
+    DCHECK(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    for (size_t n = 0; n < capacity; ++n) {
+        mSequences[n] = n;
+    }
+}
+
+LockFreeMessageChannelBase::~LockFreeMessageChannelBase() {
+    delete [] mSequences;
+}
+
+bool LockFreeMessageChannelBase::tryBeforeWrite(size_t* pos) {
+    size_t writePos = loadAcquire(&mWritePos);
+    for (;;) {
+        size_t slot = writePos & (mCapacity - 1);
+        intptr_t diff = (intptr_t)(loadAcquire(&mSequences[slot]) - writePos);
+        if (diff == 0) {
+            // The slot is free, try to reserve it.
+            size_t prev = __sync_val_compare_and_swap(
+                    &mWritePos, writePos, writePos + 1);
+            if (prev == writePos) {
+                *pos = slot;
+                return true;
+            }
+            writePos = prev;
+        } else if (diff < 0) {
+            // The receiver didn't read the message in this slot yet.
+            return false;
+        } else {
+            // Another sender reserved this slot first.
+            writePos = loadAcquire(&mWritePos);
+        }
+    }
+}
+
+size_t LockFreeMessageChannelBase::beforeWrite() {
+    size_t pos;
+    if (tryBeforeWrite(&pos)) {
+        return pos;
+    }
+    mLock.lock();
+    mWritersWaiting++;
+    __sync_synchronize();
+    while (!tryBeforeWrite(&pos)) {
+        mCanWrite.wait(&mLock);
+    }
+    mWritersWaiting--;
+    mLock.unlock();
+    return pos;
+}
+
+void LockFreeMessageChannelBase::afterWrite(size_t pos) {
+    // Only this sender owns the slot until it is published.
+    storeRelease(&mSequences[pos], mSequences[pos] + 1);
+    // Pairs with the barrier in beforeRead(): either the receiver sees the
+    // new message, or this sees that it is waiting.
+    __sync_synchronize();
+    if (mReaderWaiting) {
+        mLock.lock();
+        mCanRead.signal();
+        mLock.unlock();
+    }
+}
+
+bool LockFreeMessageChannelBase::tryBeforeRead(size_t* pos) {
+    size_t slot = mReadPos & (mCapacity - 1);
+    if (loadAcquire(&mSequences[slot]) != mReadPos + 1) {
+        return false;
+    }
+    *pos = slot;
+    return true;
+}
+
+size_t LockFreeMessageChannelBase::beforeRead() {
+    size_t pos;
+    if (tryBeforeRead(&pos)) {
+        return pos;
+    }
+    mLock.lock();
+    mReaderWaiting = 1;
+    __sync_synchronize();
+    while (!tryBeforeRead(&pos)) {
+        mCanRead.wait(&mLock);
+    }
+    mReaderWaiting = 0;
+    mLock.unlock();
+    return pos;
+}
+
+void LockFreeMessageChannelBase::afterRead(size_t pos) {
+    storeRelease(&mSequences[pos], mReadPos + mCapacity);
+    mReadPos++;
+    // Pairs with the barrier in beforeWrite().
+    __sync_synchronize();
+    if (mWritersWaiting) {
+        mLock.lock();
+        mCanWrite.signal();
+        mLock.unlock();
+    }
+}
+
+}  // namespace base
+}  // namespace android
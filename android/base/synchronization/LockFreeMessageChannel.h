@@ -0,0 +1,148 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_SYNCHRONIZATION_LOCK_FREE_MESSAGE_CHANNEL_H
+#define ANDROID_BASE_SYNCHRONIZATION_LOCK_FREE_MESSAGE_CHANNEL_H
+
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <stddef.h>
+
+namespace android {
+namespace base {
+
+// Base non-templated class used to reduce the amount of template
+// specialization. This implements a bounded multi-producer/single-consumer
+// queue of slot positions, where each slot has a sequence number telling
+// whether it is free for the next writer, or ready for the reader.
+class LockFreeMessageChannelBase {
+public:
+    // Constructor. |capacity| is the buffer capacity in messages, it must
+    // be a power of 2.
+    LockFreeMessageChannelBase(size_t capacity);
+
+    // Destructor.
+    ~LockFreeMessageChannelBase();
+
+protected:
+    // Call this method in a sender thread to reserve a slot for a new
+    // message. On success, return true and set |*pos| to the position
+    // of the slot in the message array where to copy the message, then
+    // call afterWrite(). Return false if the channel is full.
+    bool tryBeforeWrite(size_t* pos);
+
+    // Same as tryBeforeWrite(), but block until a slot is available.
+    size_t beforeWrite();
+
+    // To be called after beforeWrite() or a successful tryBeforeWrite(),
+    // and copying the new message into the array. This publishes the
+    // message, and wakes up the receiver thread if it is waiting.
+    void afterWrite(size_t pos);
+
+    // Call this method in the receiver thread to get the next message.
+    // On success, return true and set |*pos| to the position in the
+    // message array where it can be read, then call afterRead(). Return
+    // false if the channel is empty.
+    bool tryBeforeRead(size_t* pos);
+
+    // Same as tryBeforeRead(), but block until a message is available.
+    size_t beforeRead();
+
+    // To be called in the receiver thread after beforeRead() or a
+    // successful tryBeforeRead(), and processing the message. This frees
+    // the slot, and wakes up the sender threads if they're waiting.
+    void afterRead(size_t pos);
+
+private:
+    volatile size_t* mSequences;
+    size_t mCapacity;
+    // Position of the next slot to write, shared by all senders.
+    volatile size_t mWritePos;
+    // Position of the next slot to read, only used by the receiver.
+    size_t mReadPos;
+    // The lock and condition variables are only used when a thread has
+    // to wait, i.e. when the receiver finds the channel empty, or a
+    // sender finds it full. Setting mReaderWaiting or mWritersWaiting
+    // tells the other side that it must signal them.
+    Lock mLock;
+    ConditionVariable mCanRead;
+    ConditionVariable mCanWrite;
+    volatile int mReaderWaiting;
+    volatile int mWritersWaiting;
+};
+
+// A variant of MessageChannel for several sender threads and a single
+// receiver thread, that doesn't take a lock to send or receive a message,
+// except when the receiver has to wait for a message, or a sender for a
+// free slot.
+//
+// Usage is pretty straightforward:
+//
+//   - From any sender thread, call send(msg), or trySend(msg) to avoid
+//     blocking when the channel is full.
+//
+//   - From the receiver thread, call receive(&msg), or tryReceive(&msg)
+//     to avoid blocking when the channel is empty.
+//
+// Only one thread can receive at a time. |CAPACITY| must be a power of 2.
+template <typename T, size_t CAPACITY>
+class LockFreeMessageChannel : public LockFreeMessageChannelBase {
+public:
+    LockFreeMessageChannel() : LockFreeMessageChannelBase(CAPACITY) {}
+
+    // Fails to compile if CAPACITY isn't a power of 2.
+    typedef char CapacityMustBeAPowerOfTwo[
+            (CAPACITY & (CAPACITY - 1)) == 0 ? 1 : -1];
+
+    void send(const T& msg) {
+        size_t pos = beforeWrite();
+        mItems[pos] = msg;
+        afterWrite(pos);
+    }
+
+    bool trySend(const T& msg) {
+        size_t pos;
+        if (!tryBeforeWrite(&pos)) {
+            return false;
+        }
+        mItems[pos] = msg;
+        afterWrite(pos);
+        return true;
+    }
+
+    void receive(T* msg) {
+        size_t pos = beforeRead();
+        *msg = mItems[pos];
+        afterRead(pos);
+    }
+
+    bool tryReceive(T* msg) {
+        size_t pos;
+        if (!tryBeforeRead(&pos)) {
+            return false;
+        }
+        *msg = mItems[pos];
+        afterRead(pos);
+        return true;
+    }
+
+private:
+    T mItems[CAPACITY];
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_SYNCHRONIZATION_LOCK_FREE_MESSAGE_CHANNEL_H
@@ -0,0 +1,171 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/synchronization/LockFreeMessageChannel.h"
+
+#include "android/base/synchronization/MessageChannel.h"
+#include "android/base/testing/TestThread.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <stdio.h>
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN 1
+#  include <windows.h>
+#else
+#  include <sys/time.h>
+#endif
+
+namespace android {
+namespace base {
+
+namespace {
+
+const size_t kSenderCount = 4;
+
+// Each message is (sender << 24) | counter.
+template <class CHANNEL>
+struct ContentionState {
+    CHANNEL channel;
+    size_t sender;
+    size_t count;
+};
+
+template <class CHANNEL>
+void* senderFunction(void* param) {
+    ContentionState<CHANNEL>* s = static_cast<ContentionState<CHANNEL>*>(param);
+    size_t sender = __sync_fetch_and_add(&s->sender, 1);
+    for (size_t n = 0; n < s->count; ++n) {
+        s->channel.send((sender << 24) | n);
+    }
+    return 0;
+}
+
+// Start kSenderCount threads that each send |count| messages to a single
+// receiver, and check that the messages of each sender are received in
+// order. Return the time in milliseconds taken to receive them all.
+template <class CHANNEL>
+double runContention(size_t count) {
+    ContentionState<CHANNEL>* state = new ContentionState<CHANNEL>();
+    state->sender = 0;
+    state->count = count;
+
+#ifdef _WIN32
+    DWORD start = GetTickCount();
+#else
+    struct timeval start;
+    gettimeofday(&start, NULL);
+#endif
+    TestThread* threads[kSenderCount];
+    for (size_t n = 0; n < kSenderCount; ++n) {
+        threads[n] = new TestThread(senderFunction<CHANNEL>, state);
+    }
+
+    size_t expected[kSenderCount] = { 0 };
+    for (size_t n = 0; n < count * kSenderCount; ++n) {
+        size_t msg;
+        state->channel.receive(&msg);
+        size_t sender = msg >> 24;
+        EXPECT_GT(kSenderCount, sender);
+        if (sender < kSenderCount) {
+            EXPECT_EQ(expected[sender], msg & 0xffffff);
+            expected[sender]++;
+        }
+    }
+    for (size_t n = 0; n < kSenderCount; ++n) {
+        threads[n]->join();
+        delete threads[n];
+    }
+    delete state;
+
+#ifdef _WIN32
+    return (double)(GetTickCount() - start);
+#else
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start.tv_sec) * 1000. +
+           (end.tv_usec - start.tv_usec) / 1000.;
+#endif
+}
+
+}  // namespace
+
+TEST(LockFreeMessageChannel, SingleThreadWithInt) {
+    LockFreeMessageChannel<int, 4U> channel;
+    channel.send(1);
+    channel.send(2);
+    channel.send(3);
+
+    int ret;
+    channel.receive(&ret);
+    EXPECT_EQ(1, ret);
+    channel.receive(&ret);
+    EXPECT_EQ(2, ret);
+    channel.receive(&ret);
+    EXPECT_EQ(3, ret);
+}
+
+TEST(LockFreeMessageChannel, SingleThreadWithStdString) {
+    LockFreeMessageChannel<std::string, 4U> channel;
+    channel.send(std::string("foo"));
+    channel.send(std::string("bar"));
+    channel.send(std::string("zoo"));
+
+    std::string str;
+    channel.receive(&str);
+    EXPECT_STREQ("foo", str.c_str());
+    channel.receive(&str);
+    EXPECT_STREQ("bar", str.c_str());
+    channel.receive(&str);
+    EXPECT_STREQ("zoo", str.c_str());
+}
+
+TEST(LockFreeMessageChannel, TrySendAndTryReceive) {
+    LockFreeMessageChannel<int, 2U> channel;
+    int ret = 0;
+    EXPECT_FALSE(channel.tryReceive(&ret));
+
+    // Wrap around the buffer a few times.
+    for (int n = 0; n < 5; ++n) {
+        EXPECT_TRUE(channel.trySend(n));
+        EXPECT_TRUE(channel.trySend(n + 100));
+        EXPECT_FALSE(channel.trySend(n + 200));
+
+        EXPECT_TRUE(channel.tryReceive(&ret));
+        EXPECT_EQ(n, ret);
+        EXPECT_TRUE(channel.tryReceive(&ret));
+        EXPECT_EQ(n + 100, ret);
+        EXPECT_FALSE(channel.tryReceive(&ret));
+    }
+}
+
+TEST(LockFreeMessageChannel, MultipleSenders) {
+    runContention<LockFreeMessageChannel<size_t, 8U> >(10000);
+}
+
+// Compare the lock-free channel with MessageChannel, with several senders.
+// Run with --gtest_also_run_disabled_tests.
+TEST(LockFreeMessageChannel, DISABLED_ContentionBenchmark) {
+    const size_t kCount = 1000000;
+    double locked = runContention<MessageChannel<size_t, 64U> >(kCount);
+    double lockFree = runContention<LockFreeMessageChannel<size_t, 64U> >(kCount);
+    printf("%u senders x %u messages: MessageChannel %.1f ms, "
+           "LockFreeMessageChannel %.1f ms\n",
+           (unsigned)kSenderCount, (unsigned)kCount, locked, lockFree);
+}
+
+}  // namespace base
+}  // namespace android
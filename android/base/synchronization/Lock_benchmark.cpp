@@ -0,0 +1,83 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/synchronization/Lock.h"
+
+#include "android/base/testing/Benchmark.h"
+#include "android/base/threads/Thread.h"
+
+namespace android {
+namespace base {
+
+namespace {
+
+// A thread that keeps locking and unlocking a lock until told to stop.
+class ContendingThread : public Thread {
+public:
+    explicit ContendingThread(Lock* lock) :
+            Thread(), mLock(lock), mStop(false) {}
+
+    void stop() {
+        mStop = true;
+        wait(NULL);
+    }
+
+    virtual intptr_t main() {
+        while (!mStop) {
+            mLock->lock();
+            mLock->unlock();
+        }
+        return 0;
+    }
+
+private:
+    Lock* mLock;
+    volatile bool mStop;
+};
+
+}  // namespace
+
+BENCHMARK(Lock_LockUnlock) {
+    Lock lock;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        lock.lock();
+        lock.unlock();
+    }
+}
+
+BENCHMARK(Lock_AutoLock) {
+    Lock lock;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        AutoLock l(lock);
+        Benchmark::doNotOptimize(l);
+    }
+}
+
+// Locking and unlocking while another thread does the same.
+BENCHMARK(Lock_LockUnlockContended) {
+    Lock lock;
+    b->stopTiming();
+    ContendingThread thread(&lock);
+    thread.start();
+    b->startTiming();
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        lock.lock();
+        lock.unlock();
+    }
+    b->stopTiming();
+    thread.stop();
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,114 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/synchronization/MessageChannel.h"
+
+#include "android/base/testing/Benchmark.h"
+#include "android/base/threads/Thread.h"
+
+namespace android {
+namespace base {
+
+namespace {
+
+typedef MessageChannel<size_t, 16> Channel;
+
+// A thread that sends back every message it receives, until it receives
+// the last one.
+class EchoThread : public Thread {
+public:
+    EchoThread(Channel* in, Channel* out, size_t count) :
+            Thread(), mIn(in), mOut(out), mCount(count) {}
+
+    virtual intptr_t main() {
+        for (size_t n = 0; n < mCount; ++n) {
+            size_t msg;
+            mIn->receive(&msg);
+            mOut->send(msg);
+        }
+        return 0;
+    }
+
+private:
+    Channel* mIn;
+    Channel* mOut;
+    size_t mCount;
+};
+
+// A thread that receives messages, until it receives the last one.
+class SinkThread : public Thread {
+public:
+    SinkThread(Channel* in, size_t count) :
+            Thread(), mIn(in), mCount(count) {}
+
+    virtual intptr_t main() {
+        for (size_t n = 0; n < mCount; ++n) {
+            size_t msg;
+            mIn->receive(&msg);
+        }
+        return 0;
+    }
+
+private:
+    Channel* mIn;
+    size_t mCount;
+};
+
+}  // namespace
+
+// Sending then receiving a message from the same thread, which never
+// blocks.
+BENCHMARK(MessageChannel_SendReceive) {
+    Channel channel;
+    size_t msg = 0;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        channel.send(n);
+        channel.receive(&msg);
+    }
+    Benchmark::doNotOptimize(msg);
+}
+
+// Streaming messages to another thread, blocking when the channel is full.
+BENCHMARK(MessageChannel_Stream) {
+    Channel channel;
+    b->stopTiming();
+    SinkThread thread(&channel, b->iterations());
+    thread.start();
+    b->startTiming();
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        channel.send(n);
+    }
+    b->stopTiming();
+    thread.wait(NULL);
+}
+
+// A round trip to another thread.
+BENCHMARK(MessageChannel_RoundTrip) {
+    Channel in, out;
+    b->stopTiming();
+    EchoThread thread(&in, &out, b->iterations());
+    thread.start();
+    b->startTiming();
+    size_t msg = 0;
+    for (size_t n = 0; n < b->iterations(); ++n) {
+        in.send(n);
+        out.receive(&msg);
+    }
+    b->stopTiming();
+    thread.wait(NULL);
+    Benchmark::doNotOptimize(msg);
+}
+
+}  // namespace base
+}  // namespace android
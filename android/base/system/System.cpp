@@ -196,6 +196,17 @@ public:
         return false;
     }
 
+    virtual int getCpuCoreCount() const {
+#ifdef _WIN32
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        return si.dwNumberOfProcessors < 1 ? 1 : si.dwNumberOfProcessors;
+#else
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count < 1 ? 1 : (int)count;
+#endif
+    }
+
     virtual bool pathExists(const char* path) {
         return pathExistsInternal(path);
     }
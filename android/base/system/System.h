@@ -118,6 +118,9 @@ public:
     // session type. Otherwise, just return false.
     virtual bool isRemoteSession(String* sessionType) const = 0;
 
+    // Return the number of host CPU cores that are online, at least 1.
+    virtual int getCpuCoreCount() const = 0;
+
 protected:
     static System* setForTesting(System* system);
 
@@ -0,0 +1,242 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/testing/Benchmark.h"
+
+#include <new>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN 1
+#  include <windows.h>
+#elif defined(__APPLE__)
+#  include <mach/mach_time.h>
+#else
+#  include <time.h>
+#endif
+
+namespace {
+
+volatile uint64_t sAllocations = 0;
+
+inline void countAllocation() {
+    __sync_fetch_and_add(&sAllocations, 1);
+}
+
+}  // namespace
+
+// With glibc, the C library allocator is wrapped, so that allocations of
+// android/base, which mostly uses it directly (e.g. PodVector and String),
+// are counted along with those of operator new(). Elsewhere, only the
+// allocations of C++ objects are counted.
+
+#if defined(__linux__) && defined(__GLIBC__)
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) {
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+
+}  // extern "C"
+
+#else  // !(__linux__ && __GLIBC__)
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+    countAllocation();
+    void* ptr = ::malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) throw() {
+    ::free(ptr);
+}
+
+void operator delete[](void* ptr) throw() {
+    ::free(ptr);
+}
+
+#endif  // !(__linux__ && __GLIBC__)
+
+namespace android {
+namespace base {
+
+namespace {
+
+struct Entry {
+    const char* name;
+    Benchmark::Function func;
+};
+
+// Benchmarks are registered by static constructors, so use a plain array
+// that is already initialized when they run.
+const size_t kMaxBenchmarks = 256;
+Entry sEntries[kMaxBenchmarks];
+size_t sEntryCount = 0;
+
+uint64_t nowNs() {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart * (1e9 / freq.QuadPart));
+#elif defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
+    if (!timebase.denom) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+// Never run a benchmark for more iterations than this.
+const size_t kMaxIterations = 1000000000;
+
+}  // namespace
+
+Benchmark::Registrar::Registrar(const char* name, Function func) {
+    if (sEntryCount == kMaxBenchmarks) {
+        fprintf(stderr, "Too many benchmarks, ignoring %s\n", name);
+        return;
+    }
+    sEntries[sEntryCount].name = name;
+    sEntries[sEntryCount].func = func;
+    sEntryCount++;
+}
+
+Benchmark::Benchmark(size_t iterations) :
+        mIterations(iterations),
+        mTiming(false),
+        mStartNs(0),
+        mStartAllocs(0),
+        mElapsedNs(0),
+        mAllocs(0) {}
+
+void Benchmark::stopTiming() {
+    if (mTiming) {
+        mElapsedNs += nowNs() - mStartNs;
+        mAllocs += allocationCount() - mStartAllocs;
+        mTiming = false;
+    }
+}
+
+void Benchmark::startTiming() {
+    if (!mTiming) {
+        mStartAllocs = allocationCount();
+        mStartNs = nowNs();
+        mTiming = true;
+    }
+}
+
+void Benchmark::run(Function func) {
+    mElapsedNs = 0;
+    mAllocs = 0;
+    startTiming();
+    func(this);
+    stopTiming();
+}
+
+// static
+uint64_t Benchmark::allocationCount() {
+    return sAllocations;
+}
+
+// static
+int Benchmark::runAll(const char* filter, int minTimeMs) {
+    const uint64_t minTimeNs = (uint64_t)minTimeMs * 1000000ULL;
+    int count = 0;
+
+    printf("%-48s %12s %14s %12s\n",
+           "Benchmark", "Iterations", "ns/op", "allocs/op");
+    for (size_t n = 0; n < sEntryCount; ++n) {
+        const Entry& entry = sEntries[n];
+        if (filter && !strstr(entry.name, filter)) {
+            continue;
+        }
+
+        // Grow the number of iterations until the run lasts long enough,
+        // predicting the count from the previous run.
+        Benchmark b(1);
+        for (;;) {
+            b.run(entry.func);
+            if (b.mElapsedNs >= minTimeNs || b.mIterations >= kMaxIterations) {
+                break;
+            }
+            uint64_t perOp = b.mElapsedNs / b.mIterations;
+            if (perOp == 0) {
+                perOp = 1;
+            }
+            uint64_t next = minTimeNs * 6 / 5 / perOp;
+            if (next > (uint64_t)b.mIterations * 100) {
+                next = (uint64_t)b.mIterations * 100;
+            }
+            if (next <= b.mIterations) {
+                next = b.mIterations + 1;
+            }
+            if (next > kMaxIterations) {
+                next = kMaxIterations;
+            }
+            b.mIterations = (size_t)next;
+        }
+
+        printf("%-48s %12lu %14.1f %12.2f\n",
+               entry.name,
+               (unsigned long)b.mIterations,
+               (double)b.mElapsedNs / b.mIterations,
+               (double)b.mAllocs / b.mIterations);
+        fflush(stdout);
+        count++;
+    }
+    return count;
+}
+
+}  // namespace base
+}  // namespace android
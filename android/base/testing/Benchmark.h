@@ -0,0 +1,107 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_TESTING_BENCHMARK_H
+#define ANDROID_BASE_TESTING_BENCHMARK_H
+
+#include "android/base/Compiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace base {
+
+// A minimal micro-benchmark framework, used by the emulator_benchmarks
+// program to measure the cost of the android/base primitives.
+//
+// Define a benchmark with the BENCHMARK() macro, and perform the measured
+// operation |b->iterations()| times, e.g.:
+//
+//     BENCHMARK(PodVector_PushBack) {
+//         PodVector<int> v;
+//         for (size_t n = 0; n < b->iterations(); ++n) {
+//             v.push_back((int)n);
+//         }
+//     }
+//
+// The framework runs each benchmark with an increasing number of
+// iterations until it lasts long enough to be measured reliably, then
+// reports the time and the number of heap allocations per iteration.
+// Use stopTiming() and startTiming() to exclude setup code that can't be
+// moved out of the iterations loop.
+class Benchmark {
+public:
+    typedef void (*Function)(Benchmark* b);
+
+    // Number of times the measured operation must be performed.
+    size_t iterations() const { return mIterations; }
+
+    // Stop counting time and allocations, e.g. before a setup step.
+    void stopTiming();
+
+    // Resume counting time and allocations.
+    void startTiming();
+
+    // Run all registered benchmarks whose name contains |filter|, or all
+    // of them if |filter| is NULL, for at least |minTimeMs| milliseconds
+    // each. Print one result line per benchmark to stdout, and return the
+    // number of benchmarks run.
+    static int runAll(const char* filter, int minTimeMs);
+
+    // Return the number of heap allocations performed by all threads
+    // since the start of the program.
+    static uint64_t allocationCount();
+
+    // Prevent the compiler from optimizing away the computation of
+    // |value| in a benchmark.
+    template <typename T>
+    static void doNotOptimize(const T& value) {
+        __asm__ __volatile__("" : : "g"(&value) : "memory");
+    }
+
+    // Used by the BENCHMARK() macro to register a benchmark.
+    class Registrar {
+    public:
+        Registrar(const char* name, Function func);
+    };
+
+private:
+    explicit Benchmark(size_t iterations);
+
+    // Run |func| for |mIterations| and record its cost.
+    void run(Function func);
+
+    size_t mIterations;
+    bool mTiming;
+    uint64_t mStartNs;
+    uint64_t mStartAllocs;
+    uint64_t mElapsedNs;
+    uint64_t mAllocs;
+
+    DISALLOW_COPY_AND_ASSIGN(Benchmark);
+};
+
+}  // namespace base
+}  // namespace android
+
+// Define a new benchmark named |name|. The body that follows receives
+// an android::base::Benchmark* named |b|.
+#define BENCHMARK(name) \
+    static void benchmark_##name(::android::base::Benchmark* b); \
+    static ::android::base::Benchmark::Registrar \
+            benchmark_registrar_##name(#name, benchmark_##name); \
+    static void benchmark_##name(::android::base::Benchmark* b)
+
+#endif  // ANDROID_BASE_TESTING_BENCHMARK_H
@@ -0,0 +1,69 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Entry point of the emulator_benchmarks program.
+
+#include "android/base/testing/Benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using android::base::Benchmark;
+
+namespace {
+
+// Default minimum duration of a benchmark run, in milliseconds.
+const int kDefaultMinTimeMs = 500;
+
+void usage(const char* program) {
+    printf("Usage: %s [--filter=<text>] [--min-time-ms=<ms>]\n\n"
+           "Run the benchmarks whose name contains <text>, or all of them,\n"
+           "each for at least <ms> milliseconds (default %d), and print\n"
+           "their cost in nanoseconds and heap allocations per operation.\n",
+           program, kDefaultMinTimeMs);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const char* filter = NULL;
+    int minTimeMs = kDefaultMinTimeMs;
+
+    for (int n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        if (!strncmp(arg, "--filter=", 9)) {
+            filter = arg + 9;
+        } else if (!strncmp(arg, "--min-time-ms=", 14)) {
+            minTimeMs = atoi(arg + 14);
+            if (minTimeMs <= 0) {
+                fprintf(stderr, "Invalid duration: %s\n", arg + 14);
+                return 1;
+            }
+        } else if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) {
+            usage(argv[0]);
+            return 0;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (Benchmark::runAll(filter, minTimeMs) == 0) {
+        fprintf(stderr, "No benchmark matches '%s'\n", filter ? filter : "");
+        return 1;
+    }
+    return 0;
+}
@@ -32,6 +32,7 @@ public:
             mHostBitness(hostBitness),
             mIsRemoteSession(false),
             mRemoteSessionType(),
+            mCpuCoreCount(4),
             mTempDir(NULL),
             mTempRootPrefix(),
             mEnvPairs(),
@@ -150,6 +151,15 @@ public:
         }
     }
 
+    virtual int getCpuCoreCount() const {
+        return mCpuCoreCount;
+    }
+
+    // Force the number of CPU cores returned by getCpuCoreCount().
+    void setCpuCoreCount(int count) {
+        mCpuCoreCount = count;
+    }
+
 private:
     String toTempRoot(const char* path) {
         String result = mTempRootPrefix;
@@ -169,6 +179,7 @@ private:
     int mHostBitness;
     bool mIsRemoteSession;
     String mRemoteSessionType;
+    int mCpuCoreCount;
     mutable TestTempDir* mTempDir;
     mutable String mTempRootPrefix;
     StringVector mEnvPairs;
@@ -0,0 +1,113 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/threads/TaskGraph.h"
+
+#include "android/base/Log.h"
+#include "android/base/threads/ThreadPool.h"
+
+namespace android {
+namespace base {
+
+struct TaskGraph::Task {
+    TaskGraph* graph;
+    TaskFunction* func;
+    void* opaque;
+    int pendingDeps;  // Dependencies not completed yet.
+    bool done;
+    PodVector<TaskId> dependents;
+};
+
+TaskGraph::TaskGraph(ThreadPool* pool) :
+        mPool(pool), mLock(), mDone(), mTasks(), mPendingCount(0) {}
+
+TaskGraph::~TaskGraph() {
+    waitAll();
+    for (size_t n = 0; n < mTasks.size(); ++n) {
+        delete mTasks[n];
+    }
+}
+
+TaskGraph::TaskId TaskGraph::add(TaskFunction* func,
+                                 void* opaque,
+                                 const TaskId* deps,
+                                 int depCount) {
+    Task* task = new Task;
+    task->graph = this;
+    task->func = func;
+    task->opaque = opaque;
+    task->pendingDeps = 0;
+    task->done = false;
+
+    AutoLock lock(mLock);
+    TaskId id = static_cast<TaskId>(mTasks.size());
+    for (int n = 0; n < depCount; ++n) {
+        CHECK(deps[n] >= 0 && deps[n] < id) << "Invalid task dependency";
+        Task* dep = mTasks[deps[n]];
+        if (!dep->done) {
+            dep->dependents.push_back(id);
+            task->pendingDeps++;
+        }
+    }
+    mTasks.push_back(task);
+    mPendingCount++;
+    if (!task->pendingDeps) {
+        postTask(task);
+    }
+    return id;
+}
+
+bool TaskGraph::isDone(TaskId id) {
+    AutoLock lock(mLock);
+    return mTasks[id]->done;
+}
+
+void TaskGraph::wait(TaskId id) {
+    AutoLock lock(mLock);
+    while (!mTasks[id]->done) {
+        mDone.wait(&mLock);
+    }
+}
+
+void TaskGraph::waitAll() {
+    AutoLock lock(mLock);
+    while (mPendingCount > 0) {
+        mDone.wait(&mLock);
+    }
+}
+
+void TaskGraph::postTask(Task* task) {
+    mPool->post(runTask, task);
+}
+
+// static
+void TaskGraph::runTask(void* opaque) {
+    Task* task = static_cast<Task*>(opaque);
+    TaskGraph* graph = task->graph;
+    task->func(task->opaque);
+
+    AutoLock lock(graph->mLock);
+    task->done = true;
+    for (size_t n = 0; n < task->dependents.size(); ++n) {
+        Task* dependent = graph->mTasks[task->dependents[n]];
+        if (--dependent->pendingDeps == 0) {
+            graph->postTask(dependent);
+        }
+    }
+    graph->mPendingCount--;
+    graph->mDone.signal();
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,95 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_THREADS_TASK_GRAPH_H
+#define ANDROID_BASE_THREADS_TASK_GRAPH_H
+
+#include "android/base/Compiler.h"
+#include "android/base/containers/PodVector.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+
+namespace android {
+namespace base {
+
+class ThreadPool;
+
+// A graph of tasks that run on a ThreadPool as soon as all the tasks they
+// depend on have completed, e.g. to run the independent steps of a long
+// initialization concurrently, while the thread that builds the graph
+// does its own work and only waits for the results it needs.
+//
+// Usage example:
+//
+//    TaskGraph graph(ThreadPool::get());
+//    TaskGraph::TaskId load = graph.add(loadLibrary, NULL, NULL, 0);
+//    TaskGraph::TaskId probe = graph.add(probeLibrary, NULL, &load, 1);
+//    ... do something else.
+//    graph.wait(probe);
+//
+class TaskGraph {
+public:
+    // Type of the functions run by the tasks.
+    typedef void (TaskFunction)(void* opaque);
+
+    // Identifies a task of the graph.
+    typedef int TaskId;
+
+    // Create a new graph whose tasks run on |pool|.
+    explicit TaskGraph(ThreadPool* pool);
+
+    // Destructor. Waits for all tasks to complete.
+    ~TaskGraph();
+
+    // Add a task that calls |func(opaque)| once the |depCount| tasks of
+    // |deps| have completed, or immediately if they already have, and
+    // return its id. |deps| can be NULL if |depCount| is 0. Can be called
+    // from any thread, including from a task.
+    TaskId add(TaskFunction* func,
+               void* opaque,
+               const TaskId* deps,
+               int depCount);
+
+    // Return true if task |id| has completed.
+    bool isDone(TaskId id);
+
+    // Block until task |id| has completed. Must not be called from a task,
+    // nor from more than one thread at a time.
+    void wait(TaskId id);
+
+    // Block until all the tasks added so far have completed, with the same
+    // restrictions as wait().
+    void waitAll();
+
+private:
+    struct Task;
+
+    static void runTask(void* opaque);
+
+    // Post |task| to the pool. Must be called with |mLock| held.
+    void postTask(Task* task);
+
+    ThreadPool* mPool;
+    Lock mLock;
+    ConditionVariable mDone;
+    PodVector<Task*> mTasks;
+    int mPendingCount;  // Tasks added, but not completed yet.
+
+    DISALLOW_COPY_AND_ASSIGN(TaskGraph);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_THREADS_TASK_GRAPH_H
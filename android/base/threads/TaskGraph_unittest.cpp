@@ -0,0 +1,125 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/threads/TaskGraph.h"
+
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/ThreadPool.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace android {
+namespace base {
+
+namespace {
+
+void incrementFunction(void* opaque) {
+    __sync_fetch_and_add(static_cast<int*>(opaque), 1);
+}
+
+// Records the order in which tasks run.
+struct OrderState {
+    Lock lock;
+    std::vector<int> order;
+};
+
+struct OrderTask {
+    OrderState* state;
+    int value;
+
+    static void run(void* opaque) {
+        OrderTask* task = static_cast<OrderTask*>(opaque);
+        AutoLock locker(task->state->lock);
+        task->state->order.push_back(task->value);
+    }
+};
+
+int indexOf(const std::vector<int>& order, int value) {
+    for (size_t n = 0; n < order.size(); ++n) {
+        if (order[n] == value) {
+            return static_cast<int>(n);
+        }
+    }
+    return -1;
+}
+
+}  // namespace
+
+TEST(TaskGraph, RunsIndependentTasks) {
+    ThreadPool pool(4);
+    int counter = 0;
+    {
+        TaskGraph graph(&pool);
+        for (int n = 0; n < 100; ++n) {
+            graph.add(incrementFunction, &counter, NULL, 0);
+        }
+        graph.waitAll();
+        EXPECT_EQ(100, counter);
+    }
+    EXPECT_EQ(100, counter);
+}
+
+TEST(TaskGraph, RunsTasksAfterTheirDependencies) {
+    ThreadPool pool(4);
+    OrderState state;
+    //     0
+    //    / \
+    //   1   2
+    //    \ / \
+    //     3   4
+    OrderTask tasks[5];
+    for (int n = 0; n < 5; ++n) {
+        tasks[n].state = &state;
+        tasks[n].value = n;
+    }
+    TaskGraph graph(&pool);
+    TaskGraph::TaskId ids[5];
+    ids[0] = graph.add(OrderTask::run, &tasks[0], NULL, 0);
+    ids[1] = graph.add(OrderTask::run, &tasks[1], &ids[0], 1);
+    ids[2] = graph.add(OrderTask::run, &tasks[2], &ids[0], 1);
+    ids[3] = graph.add(OrderTask::run, &tasks[3], &ids[1], 2);
+    ids[4] = graph.add(OrderTask::run, &tasks[4], &ids[2], 1);
+
+    graph.wait(ids[3]);
+    EXPECT_TRUE(graph.isDone(ids[0]));
+    EXPECT_TRUE(graph.isDone(ids[1]));
+    EXPECT_TRUE(graph.isDone(ids[2]));
+    EXPECT_TRUE(graph.isDone(ids[3]));
+    graph.waitAll();
+
+    ASSERT_EQ(5U, state.order.size());
+    EXPECT_EQ(0, state.order[0]);
+    EXPECT_LT(indexOf(state.order, 1), indexOf(state.order, 3));
+    EXPECT_LT(indexOf(state.order, 2), indexOf(state.order, 3));
+    EXPECT_LT(indexOf(state.order, 2), indexOf(state.order, 4));
+}
+
+TEST(TaskGraph, AddsTasksThatDependOnCompletedOnes) {
+    ThreadPool pool(2);
+    int counter = 0;
+    TaskGraph graph(&pool);
+    TaskGraph::TaskId first = graph.add(incrementFunction, &counter, NULL, 0);
+    graph.wait(first);
+    EXPECT_EQ(1, counter);
+
+    TaskGraph::TaskId second = graph.add(incrementFunction, &counter,
+                                         &first, 1);
+    graph.wait(second);
+    EXPECT_EQ(2, counter);
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,243 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/threads/ThreadPool.h"
+
+#include "android/base/Log.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/threads/Thread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace android {
+namespace base {
+
+struct ThreadPool::Task {
+    Task* next;
+    TaskFunction* func;
+    void* opaque;
+};
+
+// A worker's queue, with one FIFO list per priority.
+struct ThreadPool::TaskQueue {
+    TaskQueue() : lock() {
+        for (int n = 0; n < kPriorityCount; ++n) {
+            first[n] = NULL;
+            last[n] = NULL;
+        }
+    }
+
+    void push(Task* task, Priority priority) {
+        AutoLock locker(lock);
+        task->next = NULL;
+        if (last[priority]) {
+            last[priority]->next = task;
+        } else {
+            first[priority] = task;
+        }
+        last[priority] = task;
+    }
+
+    // Remove and return the first task of the highest priority, or NULL.
+    Task* pop() {
+        AutoLock locker(lock);
+        for (int n = kPriorityCount - 1; n >= 0; --n) {
+            Task* task = first[n];
+            if (task) {
+                first[n] = task->next;
+                if (!first[n]) {
+                    last[n] = NULL;
+                }
+                return task;
+            }
+        }
+        return NULL;
+    }
+
+    Lock lock;
+    Task* first[kPriorityCount];
+    Task* last[kPriorityCount];
+};
+
+class ThreadPool::Worker : public Thread {
+public:
+    Worker(ThreadPool* pool, int index) :
+            Thread(), mPool(pool), mIndex(index) {}
+
+    virtual intptr_t main() {
+#ifndef _WIN32
+        // Let the other threads handle all signals.
+        sigset_t set;
+        sigfillset(&set);
+        pthread_sigmask(SIG_SETMASK, &set, NULL);
+#endif
+        mPool->runWorker(mIndex);
+        return 0;
+    }
+
+private:
+    ThreadPool* mPool;
+    int mIndex;
+};
+
+ThreadPool::ThreadPool(int workerCount) :
+        mWorkerCount(workerCount > 0 ? workerCount : getHostCpuCount()),
+        mQueues(NULL),
+        mWorkers(NULL),
+        mNextWorker(0),
+        mLock(),
+        mCanRun(),
+        mIdle(),
+        mPendingCount(0),
+        mActiveCount(0),
+        mExiting(false) {
+    mQueues = new TaskQueue[mWorkerCount];
+    mWorkers = new Worker*[mWorkerCount];
+    for (int n = 0; n < mWorkerCount; ++n) {
+        mWorkers[n] = new Worker(this, n);
+        if (!mWorkers[n]->start()) {
+            LOG(FATAL) << "Could not start thread pool worker " << n;
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        AutoLock locker(mLock);
+        mExiting = true;
+        for (int n = 0; n < mWorkerCount; ++n) {
+            mCanRun.signal();
+        }
+    }
+    for (int n = 0; n < mWorkerCount; ++n) {
+        mWorkers[n]->wait(NULL);
+        delete mWorkers[n];
+    }
+    delete [] mWorkers;
+    delete [] mQueues;
+}
+
+// static
+int ThreadPool::getHostCpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return (count > 0) ? count : 1;
+}
+
+namespace {
+
+struct SharedThreadPool {
+    SharedThreadPool() : pool(sharedWorkerCount()) {}
+
+    static int sharedWorkerCount() {
+        int count = 2 * ThreadPool::getHostCpuCount();
+        return (count < 4) ? 4 : count;
+    }
+
+    ThreadPool pool;
+};
+
+LazyInstance<SharedThreadPool> sSharedPool = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+// static
+ThreadPool* ThreadPool::get() {
+    return &sSharedPool->pool;
+}
+
+void ThreadPool::post(TaskFunction* func,
+                      void* opaque,
+                      Priority priority,
+                      int affinity) {
+    Task* task = new Task;
+    task->func = func;
+    task->opaque = opaque;
+
+    int index;
+    if (affinity >= 0) {
+        index = affinity % mWorkerCount;
+    } else {
+        index = (int)(__sync_fetch_and_add(&mNextWorker, 1U) % mWorkerCount);
+    }
+    mQueues[index].push(task, priority);
+
+    AutoLock locker(mLock);
+    mPendingCount++;
+    mCanRun.signal();
+}
+
+void ThreadPool::waitIdle() {
+    AutoLock locker(mLock);
+    while (mPendingCount > 0 || mActiveCount > 0) {
+        mIdle.wait(&mLock);
+    }
+}
+
+ThreadPool::Task* ThreadPool::takeTask(int index) {
+    // Own queue first, then steal from the next workers in turn.
+    for (int n = 0; n < mWorkerCount; ++n) {
+        Task* task = mQueues[(index + n) % mWorkerCount].pop();
+        if (task) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+void ThreadPool::runWorker(int index) {
+    for (;;) {
+        Task* task = takeTask(index);
+        if (task) {
+            {
+                // NOTE: mPendingCount can become negative for a short
+                // time if the task is taken before post() counted it.
+                AutoLock locker(mLock);
+                mPendingCount--;
+                mActiveCount++;
+            }
+            task->func(task->opaque);
+            delete task;
+
+            AutoLock locker(mLock);
+            mActiveCount--;
+            if (mPendingCount <= 0 && mActiveCount == 0) {
+                mIdle.signal();
+            }
+            continue;
+        }
+
+        AutoLock locker(mLock);
+        while (mPendingCount <= 0 && !mExiting) {
+            mCanRun.wait(&mLock);
+        }
+        if (mPendingCount <= 0) {
+            // Exiting, and all tasks were taken.
+            break;
+        }
+    }
+}
+
+}  // namespace base
+}  // namespace android
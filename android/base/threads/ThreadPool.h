@@ -0,0 +1,131 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_THREADS_THREAD_POOL_H
+#define ANDROID_BASE_THREADS_THREAD_POOL_H
+
+#include "android/base/Compiler.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <stddef.h>
+
+namespace android {
+namespace base {
+
+// A fixed-size pool of worker threads that run tasks posted from any
+// thread.
+//
+// Each worker has its own queue. A task is posted to the queue of the
+// worker given by its affinity hint, or to the next worker in turn. A
+// worker runs the tasks of its own queue first, then steals tasks from the
+// other queues when it has nothing to do, so that no worker stays idle
+// while tasks are pending. Within a queue, higher priority tasks run
+// first, and tasks of the same priority run in the order they were posted.
+//
+// Use ThreadPool::get() to access the pool shared by the whole program
+// instead of creating threads for each background job, so that they don't
+// oversubscribe the host.
+//
+// Worker threads block all signals, so that they are always delivered to
+// the other threads of the program.
+//
+// Usage example:
+//
+//    static void doWork(void* opaque) {
+//        ... runs in a worker thread.
+//    }
+//
+//    ThreadPool::get()->post(doWork, data);
+//
+class ThreadPool {
+public:
+    // Type of the functions run by the pool.
+    typedef void (TaskFunction)(void* opaque);
+
+    // Task priorities.
+    enum Priority {
+        kPriorityLow = 0,
+        kPriorityNormal,
+        kPriorityHigh,
+        kPriorityCount
+    };
+
+    // Affinity value to use when any worker can run a task.
+    static const int kAnyWorker = -1;
+
+    // Create a new pool with |workerCount| threads, or one per host CPU
+    // if |workerCount| is 0. The threads are started immediately.
+    explicit ThreadPool(int workerCount);
+
+    // Destructor. Runs all the pending tasks, then stops the threads.
+    ~ThreadPool();
+
+    // Return the pool shared by the whole program. It has twice as many
+    // workers as the host has CPUs, and at least 4, because many of its
+    // tasks block on disk I/O.
+    static ThreadPool* get();
+
+    // Return the number of CPUs of the host.
+    static int getHostCpuCount();
+
+    // Return the number of worker threads.
+    int getWorkerCount() const { return mWorkerCount; }
+
+    // Post a new task that calls |func(opaque)| in a worker thread.
+    // |priority| is the task priority. |affinity| is a hint for the worker
+    // that should run it, modulo the worker count: e.g. posting related
+    // tasks with the same affinity keeps them on the same worker's queue,
+    // unless another worker is idle. Use kAnyWorker to let the pool
+    // choose. Can be called from any thread, including worker threads.
+    void post(TaskFunction* func,
+              void* opaque,
+              Priority priority = kPriorityNormal,
+              int affinity = kAnyWorker);
+
+    // Block until all the tasks posted so far have run. Must not be called
+    // from a worker thread.
+    void waitIdle();
+
+private:
+    class Worker;
+    struct Task;
+    struct TaskQueue;
+
+    // Take the next task to run by worker |index|, from its own queue or
+    // from the queue of another worker. Return NULL if there is none.
+    Task* takeTask(int index);
+
+    // Main loop of worker |index|.
+    void runWorker(int index);
+
+    int mWorkerCount;
+    TaskQueue* mQueues;
+    Worker** mWorkers;
+    unsigned mNextWorker;
+    // Protects the counters below, used to wake up idle workers.
+    Lock mLock;
+    ConditionVariable mCanRun;
+    ConditionVariable mIdle;
+    int mPendingCount;  // Tasks posted, but not taken yet.
+    int mActiveCount;   // Tasks taken, but not finished yet.
+    bool mExiting;
+
+    DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_THREADS_THREAD_POOL_H
@@ -0,0 +1,162 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/threads/ThreadPool.h"
+
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace android {
+namespace base {
+
+namespace {
+
+void incrementFunction(void* opaque) {
+    __sync_fetch_and_add(static_cast<int*>(opaque), 1);
+}
+
+// A task that blocks its worker until release() is called.
+class Gate {
+public:
+    Gate() : mLock(), mCond(), mOpen(false) {}
+
+    static void waitFunction(void* opaque) {
+        Gate* gate = static_cast<Gate*>(opaque);
+        AutoLock locker(gate->mLock);
+        while (!gate->mOpen) {
+            gate->mCond.wait(&gate->mLock);
+        }
+    }
+
+    void release() {
+        AutoLock locker(mLock);
+        mOpen = true;
+        mCond.signal();
+    }
+
+private:
+    Lock mLock;
+    ConditionVariable mCond;
+    bool mOpen;
+};
+
+// Records the order in which tasks run.
+struct OrderState {
+    Lock lock;
+    std::vector<int> order;
+};
+
+struct OrderTask {
+    OrderState* state;
+    int value;
+
+    static void run(void* opaque) {
+        OrderTask* task = static_cast<OrderTask*>(opaque);
+        AutoLock locker(task->state->lock);
+        task->state->order.push_back(task->value);
+    }
+};
+
+}  // namespace
+
+TEST(ThreadPool, RunsAllTasks) {
+    ThreadPool pool(4);
+    EXPECT_EQ(4, pool.getWorkerCount());
+
+    int count = 0;
+    const int kCount = 1000;
+    for (int n = 0; n < kCount; ++n) {
+        pool.post(incrementFunction, &count);
+    }
+    pool.waitIdle();
+    EXPECT_EQ(kCount, count);
+}
+
+TEST(ThreadPool, DefaultWorkerCount) {
+    ThreadPool pool(0);
+    EXPECT_EQ(ThreadPool::getHostCpuCount(), pool.getWorkerCount());
+}
+
+TEST(ThreadPool, DestructorRunsPendingTasks) {
+    int count = 0;
+    {
+        ThreadPool pool(2);
+        for (int n = 0; n < 100; ++n) {
+            pool.post(incrementFunction, &count);
+        }
+    }
+    EXPECT_EQ(100, count);
+}
+
+TEST(ThreadPool, Priorities) {
+    ThreadPool pool(1);
+    Gate gate;
+    OrderState state;
+    OrderTask tasks[3] = {
+        { &state, ThreadPool::kPriorityLow },
+        { &state, ThreadPool::kPriorityNormal },
+        { &state, ThreadPool::kPriorityHigh },
+    };
+
+    // Block the only worker while the tasks are queued.
+    pool.post(Gate::waitFunction, &gate);
+    for (int n = 0; n < 3; ++n) {
+        pool.post(OrderTask::run, &tasks[n],
+                  static_cast<ThreadPool::Priority>(tasks[n].value));
+    }
+    gate.release();
+    pool.waitIdle();
+
+    ASSERT_EQ(3U, state.order.size());
+    EXPECT_EQ(ThreadPool::kPriorityHigh, state.order[0]);
+    EXPECT_EQ(ThreadPool::kPriorityNormal, state.order[1]);
+    EXPECT_EQ(ThreadPool::kPriorityLow, state.order[2]);
+}
+
+TEST(ThreadPool, IdleWorkerStealsTasks) {
+    ThreadPool pool(2);
+    Gate gate;
+    int count = 0;
+
+    // Block worker 0, then queue tasks for it: worker 1 must run them.
+    pool.post(Gate::waitFunction, &gate, ThreadPool::kPriorityNormal, 0);
+    for (int n = 0; n < 10; ++n) {
+        pool.post(incrementFunction, &count, ThreadPool::kPriorityNormal, 0);
+    }
+    while (__sync_fetch_and_add(&count, 0) < 10) {
+        // Busy wait, this fails with a timeout if tasks aren't stolen.
+    }
+    gate.release();
+    pool.waitIdle();
+    EXPECT_EQ(10, count);
+}
+
+TEST(ThreadPool, SharedPool) {
+    ThreadPool* pool = ThreadPool::get();
+    ASSERT_TRUE(pool);
+    EXPECT_EQ(pool, ThreadPool::get());
+    EXPECT_LE(4, pool->getWorkerCount());
+
+    int count = 0;
+    pool->post(incrementFunction, &count);
+    pool->waitIdle();
+    EXPECT_EQ(1, count);
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,551 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Contains code of a synthetic camera device, which renders frames instead of
+ * capturing them from a camera connected to the host.
+ *
+ * A synthetic camera is selected with a 'synthetic' camera mode, which renders
+ * animated color bars, or with a 'synthetic:<file>' mode, which loops over the
+ * frames of a YUV4MPEG2 (.y4m) file with 4:2:0 chroma subsampling. Frames only
+ * depend on the number of frames read since capturing was started, and are
+ * produced as fast as the camera service asks for them, which makes camera
+ * tests deterministic, and lets them run on hosts without any camera.
+ *
+ * Frames are written directly into YUV 4:2:0 framebuffers, which is what the
+ * guest asks for almost all the time. Other pixel formats, and frames that
+ * need white balance or exposure compensation, go through the format
+ * converters.
+ */
+
+#include "android/camera/camera-capture.h"
+#include "android/camera/camera-format-converters.h"
+
+#define  E(...)    derror(__VA_ARGS__)
+#define  W(...)    dwarning(__VA_ARGS__)
+#define  D(...)    VERBOSE_PRINT(camera,__VA_ARGS__)
+#define  D_ACTIVE  VERBOSE_CHECK(camera)
+
+/* Prefix of the camera modes, and of the device names, of synthetic cameras. */
+#define SYNTHETIC_PREFIX        "synthetic"
+#define SYNTHETIC_PREFIX_LEN    (sizeof(SYNTHETIC_PREFIX) - 1)
+
+/* Maximum number of synthetic cameras, i.e. one facing back, and one facing
+ * front. */
+#define SYNTHETIC_MAX_CAMERAS   2
+
+/* Frame dimensions supported by the color bars. */
+static const CameraFrameDim _synthetic_frame_dims[] = {
+    { 640, 480 },
+    { 352, 288 },
+    { 320, 240 },
+    { 176, 144 },
+    { 1280, 720 },
+};
+
+/* Y, U, and V values of the color bars: white, yellow, cyan, green, magenta,
+ * red, blue, and black. */
+static const uint8_t _synthetic_bars[8][3] = {
+    { 235, 128, 128 },
+    { 210,  16, 146 },
+    { 170, 166,  16 },
+    { 145,  54,  34 },
+    { 106, 202, 222 },
+    {  81,  90, 240 },
+    {  41, 240, 110 },
+    {  16, 128, 128 },
+};
+
+/* Source of the frames of a synthetic camera, registered when the camera
+ * service sets the camera up. */
+typedef struct SyntheticSource {
+    /* Device name reported for the camera. */
+    char*   device_name;
+    /* Video file to replay, or NULL for color bars. */
+    char*   file_name;
+} SyntheticSource;
+
+static SyntheticSource _synthetic_sources[SYNTHETIC_MAX_CAMERAS];
+
+/* Describes a synthetic camera device. */
+typedef struct SyntheticCameraDevice {
+    /* Common header. */
+    CameraDevice    header;
+    /* Source of the frames. */
+    const SyntheticSource*  source;
+    /* Opened video file, or NULL for color bars. */
+    FILE*           file;
+    /* Offset of the first frame in the video file. */
+    long            first_frame;
+    /* Dimensions of the frames of the video file. */
+    int             file_width;
+    int             file_height;
+    /* Frame dimensions, or zero when not capturing. */
+    int             width;
+    int             height;
+    /* Number of frames read since capturing was started. */
+    uint32_t        frame_count;
+    /* Frame rendered in YUV420 format, when it can't be rendered directly
+     * into the client framebuffers. */
+    uint8_t*        frame;
+} SyntheticCameraDevice;
+
+/* Planes of a YUV 4:2:0 framebuffer. */
+typedef struct SyntheticPlanes {
+    uint8_t*    y;
+    uint8_t*    u;
+    uint8_t*    v;
+    /* Distance between adjacent U and V values. */
+    int         uv_inc;
+} SyntheticPlanes;
+
+/* Gets the planes of a YUV 4:2:0 framebuffer.
+ * Return:
+ *  0 on success, or -1 if the pixel format isn't YUV 4:2:0.
+ */
+static int
+_synthetic_get_planes(uint32_t pixel_format,
+                      void* framebuffer,
+                      int width,
+                      int height,
+                      SyntheticPlanes* planes)
+{
+    uint8_t* const y = (uint8_t*)framebuffer;
+    const int y_size = width * height;
+    const int uv_size = (width / 2) * (height / 2);
+
+    planes->y = y;
+    switch (pixel_format) {
+        case V4L2_PIX_FMT_YUV420:
+            planes->u = y + y_size;
+            planes->v = planes->u + uv_size;
+            planes->uv_inc = 1;
+            return 0;
+        case V4L2_PIX_FMT_YVU420:
+            planes->v = y + y_size;
+            planes->u = planes->v + uv_size;
+            planes->uv_inc = 1;
+            return 0;
+        case V4L2_PIX_FMT_NV12:
+            planes->u = y + y_size;
+            planes->v = planes->u + 1;
+            planes->uv_inc = 2;
+            return 0;
+        case V4L2_PIX_FMT_NV21:
+            planes->v = y + y_size;
+            planes->u = planes->v + 1;
+            planes->uv_inc = 2;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/* Renders animated color bars into YUV 4:2:0 planes. A black square moves
+ * along the bars by a few pixels every frame. */
+static void
+_synthetic_draw_bars(const SyntheticPlanes* planes,
+                     int width,
+                     int height,
+                     uint32_t frame_count)
+{
+    const int box = (height / 4) & ~1;
+    const int box_x = (int)((frame_count * 4) % (uint32_t)width) & ~1;
+    const int box_y = (height / 2 - box / 2) & ~1;
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        const int in_box_y = y >= box_y && y < box_y + box;
+        uint8_t* pY = planes->y + y * width;
+        uint8_t* pU = planes->u + (y / 2) * (width / 2) * planes->uv_inc;
+        uint8_t* pV = planes->v + (y / 2) * (width / 2) * planes->uv_inc;
+        for (x = 0; x < width; x += 2) {
+            const int in_box = in_box_y && ((x - box_x + width) % width) < box;
+            const uint8_t* color = in_box ? _synthetic_bars[7] :
+                                            _synthetic_bars[x * 8 / width];
+            pY[x] = pY[x + 1] = color[0];
+            if ((y & 1) == 0) {
+                *pU = color[1];
+                *pV = color[2];
+                pU += planes->uv_inc;
+                pV += planes->uv_inc;
+            }
+        }
+    }
+}
+
+/* Reads the next frame of the video file into planar YUV 4:2:0 planes, going
+ * back to the first frame at the end of the file.
+ * Return:
+ *  0 on success, or -1 on failure.
+ */
+static int
+_synthetic_read_file(SyntheticCameraDevice* cd, const SyntheticPlanes* planes)
+{
+    char header[128];
+    const int y_size = cd->width * cd->height;
+    const int uv_size = (cd->width / 2) * (cd->height / 2);
+
+    if (fgets(header, sizeof(header), cd->file) == NULL) {
+        /* Loop over. */
+        if (fseek(cd->file, cd->first_frame, SEEK_SET) != 0 ||
+            fgets(header, sizeof(header), cd->file) == NULL) {
+            E("%s: Unable to rewind '%s'", __FUNCTION__,
+              cd->source->file_name);
+            return -1;
+        }
+    }
+    if (strncmp(header, "FRAME", 5) != 0 || strchr(header, '\n') == NULL) {
+        E("%s: Invalid frame header in '%s'", __FUNCTION__,
+          cd->source->file_name);
+        return -1;
+    }
+    if (fread(planes->y, y_size, 1, cd->file) != 1 ||
+        fread(planes->u, uv_size, 1, cd->file) != 1 ||
+        fread(planes->v, uv_size, 1, cd->file) != 1) {
+        E("%s: Truncated frame in '%s'", __FUNCTION__, cd->source->file_name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Parses the stream header of a YUV4MPEG2 file.
+ * Param:
+ *  file - File positioned at its beginning. Upon successful return, positioned
+ *      at the first frame.
+ *  width, height - Upon success contain the dimensions of the frames.
+ * Return:
+ *  0 on success, or -1 if the file isn't a YUV4MPEG2 file with 4:2:0 frames.
+ */
+static int
+_synthetic_parse_y4m(FILE* file, int* width, int* height)
+{
+    char header[256];
+    char* token;
+
+    *width = *height = 0;
+    if (fgets(header, sizeof(header), file) == NULL ||
+        strncmp(header, "YUV4MPEG2 ", 10) != 0 ||
+        strchr(header, '\n') == NULL) {
+        return -1;
+    }
+    for (token = strtok(header + 10, " \n"); token != NULL;
+         token = strtok(NULL, " \n")) {
+        if (token[0] == 'W') {
+            *width = atoi(token + 1);
+        } else if (token[0] == 'H') {
+            *height = atoi(token + 1);
+        } else if (token[0] == 'C' && strncmp(token, "C420", 4) != 0) {
+            /* Only 4:2:0 chroma subsampling is supported. */
+            return -1;
+        }
+    }
+    if (*width <= 0 || *height <= 0 || (*width & 1) || (*height & 1)) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Gets the source registered for the given device name. */
+static const SyntheticSource*
+_synthetic_get_source(const char* name)
+{
+    int n;
+    for (n = 0; n < SYNTHETIC_MAX_CAMERAS; n++) {
+        if (_synthetic_sources[n].device_name != NULL &&
+            !strcmp(_synthetic_sources[n].device_name, name)) {
+            return &_synthetic_sources[n];
+        }
+    }
+    return NULL;
+}
+
+static void
+_synthetic_camera_device_free(SyntheticCameraDevice* cd)
+{
+    if (cd->file != NULL) {
+        fclose(cd->file);
+    }
+    if (cd->frame != NULL) {
+        free(cd->frame);
+    }
+    AFREE(cd);
+}
+
+/*******************************************************************************
+ *                     Synthetic CameraDevice API
+ ******************************************************************************/
+
+int
+synthetic_camera_is_mode(const char* name)
+{
+    return name != NULL &&
+           !strncmp(name, SYNTHETIC_PREFIX, SYNTHETIC_PREFIX_LEN) &&
+           (name[SYNTHETIC_PREFIX_LEN] == '\0' ||
+            name[SYNTHETIC_PREFIX_LEN] == ':' ||
+            name[SYNTHETIC_PREFIX_LEN] == '-');
+}
+
+int
+synthetic_camera_setup(const char* mode, const char* dir, CameraInfo* ci)
+{
+    SyntheticSource* source = NULL;
+    const char* file_name = NULL;
+    char device_name[64];
+    int n;
+
+    if (!synthetic_camera_is_mode(mode)) {
+        return -1;
+    }
+    if (mode[SYNTHETIC_PREFIX_LEN] == ':') {
+        file_name = mode + SYNTHETIC_PREFIX_LEN + 1;
+    }
+    snprintf(device_name, sizeof(device_name), SYNTHETIC_PREFIX "-%s", dir);
+    for (n = 0; n < SYNTHETIC_MAX_CAMERAS && source == NULL; n++) {
+        if (_synthetic_sources[n].device_name == NULL ||
+            !strcmp(_synthetic_sources[n].device_name, device_name)) {
+            source = &_synthetic_sources[n];
+        }
+    }
+    if (source == NULL) {
+        E("%s: Too many synthetic cameras", __FUNCTION__);
+        return -1;
+    }
+
+    memset(ci, 0, sizeof(*ci));
+    if (file_name != NULL) {
+        int width, height;
+        FILE* file = fopen(file_name, "rb");
+        if (file == NULL) {
+            E("%s: Unable to open video file '%s': %s",
+              __FUNCTION__, file_name, strerror(errno));
+            return -1;
+        }
+        if (_synthetic_parse_y4m(file, &width, &height)) {
+            E("%s: '%s' is not a YUV4MPEG2 file with 4:2:0 frames",
+              __FUNCTION__, file_name);
+            fclose(file);
+            return -1;
+        }
+        fclose(file);
+        /* Frames are replayed with the dimensions of the video. */
+        ci->frame_sizes = (CameraFrameDim*)malloc(sizeof(CameraFrameDim));
+        ci->frame_sizes->width = width;
+        ci->frame_sizes->height = height;
+        ci->frame_sizes_num = 1;
+    } else {
+        ci->frame_sizes = (CameraFrameDim*)malloc(sizeof(_synthetic_frame_dims));
+        memcpy(ci->frame_sizes, _synthetic_frame_dims,
+               sizeof(_synthetic_frame_dims));
+        ci->frame_sizes_num =
+            sizeof(_synthetic_frame_dims) / sizeof(*_synthetic_frame_dims);
+    }
+
+    AFREE(source->device_name);
+    AFREE(source->file_name);
+    source->device_name = ASTRDUP(device_name);
+    source->file_name = file_name != NULL ? ASTRDUP(file_name) : NULL;
+
+    ci->display_name = ASTRDUP(mode);
+    ci->device_name = ASTRDUP(device_name);
+    ci->direction = ASTRDUP(dir);
+    ci->inp_channel = 0;
+    ci->pixel_format = V4L2_PIX_FMT_YVU420;
+    ci->in_use = 0;
+    return 0;
+}
+
+CameraDevice*
+synthetic_camera_device_open(const char* name, int inp_channel)
+{
+    SyntheticCameraDevice* cd;
+    const SyntheticSource* source = _synthetic_get_source(name);
+
+    if (source == NULL) {
+        E("%s: Unknown synthetic camera '%s'", __FUNCTION__, name);
+        return NULL;
+    }
+
+    ANEW0(cd);
+    cd->header.opaque = cd;
+    cd->source = source;
+    if (source->file_name != NULL) {
+        cd->file = fopen(source->file_name, "rb");
+        if (cd->file == NULL ||
+            _synthetic_parse_y4m(cd->file, &cd->file_width, &cd->file_height)) {
+            E("%s: Unable to open video file '%s'",
+              __FUNCTION__, source->file_name);
+            _synthetic_camera_device_free(cd);
+            return NULL;
+        }
+        cd->first_frame = ftell(cd->file);
+    }
+
+    return &cd->header;
+}
+
+int
+synthetic_camera_device_start_capturing(CameraDevice* ccd,
+                                        uint32_t pixel_format,
+                                        int frame_width,
+                                        int frame_height)
+{
+    SyntheticCameraDevice* cd;
+
+    /* Sanity checks. */
+    if (ccd == NULL || ccd->opaque == NULL) {
+      E("%s: Invalid camera device descriptor", __FUNCTION__);
+      return -1;
+    }
+    cd = (SyntheticCameraDevice*)ccd->opaque;
+    if (cd->width != 0) {
+        W("%s: Camera '%s' is already capturing", __FUNCTION__,
+          cd->source->device_name);
+        return 0;
+    }
+    if (pixel_format != V4L2_PIX_FMT_YVU420 ||
+        frame_width <= 0 || frame_height <= 0 ||
+        (frame_width & 1) || (frame_height & 1) ||
+        (cd->file != NULL && (frame_width != cd->file_width ||
+                              frame_height != cd->file_height))) {
+        E("%s: Unsupported frame %dx%d, %.4s for camera '%s'", __FUNCTION__,
+          frame_width, frame_height, (const char*)&pixel_format,
+          cd->source->device_name);
+        return -1;
+    }
+
+    cd->frame = (uint8_t*)malloc(frame_width * frame_height * 3 / 2);
+    if (cd->frame == NULL) {
+        E("%s: Not enough memory for a %dx%d frame", __FUNCTION__,
+          frame_width, frame_height);
+        return -1;
+    }
+    if (cd->file != NULL) {
+        fseek(cd->file, cd->first_frame, SEEK_SET);
+    }
+    cd->width = frame_width;
+    cd->height = frame_height;
+    cd->frame_count = 0;
+
+    return 0;
+}
+
+int
+synthetic_camera_device_stop_capturing(CameraDevice* ccd)
+{
+    SyntheticCameraDevice* cd;
+
+    /* Sanity checks. */
+    if (ccd == NULL || ccd->opaque == NULL) {
+      E("%s: Invalid camera device descriptor", __FUNCTION__);
+      return -1;
+    }
+    cd = (SyntheticCameraDevice*)ccd->opaque;
+    if (cd->frame != NULL) {
+        free(cd->frame);
+        cd->frame = NULL;
+    }
+    cd->width = cd->height = 0;
+
+    return 0;
+}
+
+int
+synthetic_camera_device_read_frame(CameraDevice* ccd,
+                                   ClientFrameBuffer* framebuffers,
+                                   int fbs_num,
+                                   float r_scale,
+                                   float g_scale,
+                                   float b_scale,
+                                   float exp_comp)
+{
+    SyntheticCameraDevice* cd;
+    SyntheticPlanes planes;
+    const void* frame;
+    uint32_t frame_format;
+    int n;
+
+    /* Sanity checks. */
+    if (ccd == NULL || ccd->opaque == NULL) {
+      E("%s: Invalid camera device descriptor", __FUNCTION__);
+      return -1;
+    }
+    cd = (SyntheticCameraDevice*)ccd->opaque;
+    if (cd->width == 0) {
+      E("%s: Camera device is not capturing", __FUNCTION__);
+      return -1;
+    }
+
+    /* Render directly into the first framebuffer that allows it, unless the
+     * frame must be color corrected. Video files can only be read into planar
+     * framebuffers. */
+    for (n = 0; n < fbs_num; n++) {
+        if (r_scale != 1.0f || g_scale != 1.0f || b_scale != 1.0f ||
+            exp_comp != 1.0f) {
+            n = fbs_num;
+        } else if (!_synthetic_get_planes(framebuffers[n].pixel_format,
+                                          framebuffers[n].framebuffer,
+                                          cd->width, cd->height, &planes) &&
+                   (cd->file == NULL || planes.uv_inc == 1)) {
+            break;
+        }
+    }
+    if (n < fbs_num) {
+        frame = framebuffers[n].framebuffer;
+        frame_format = framebuffers[n].pixel_format;
+    } else {
+        frame = cd->frame;
+        frame_format = V4L2_PIX_FMT_YUV420;
+        _synthetic_get_planes(frame_format, cd->frame, cd->width, cd->height,
+                              &planes);
+    }
+
+    if (cd->file != NULL) {
+        if (_synthetic_read_file(cd, &planes)) {
+            return -1;
+        }
+    } else {
+        _synthetic_draw_bars(&planes, cd->width, cd->height, cd->frame_count);
+    }
+    cd->frame_count++;
+
+    /* Convert the rendered frame to the other framebuffers. */
+    if (n < fbs_num) {
+        if (convert_frame(frame, frame_format, 0, cd->width, cd->height,
+                          framebuffers, n, r_scale, g_scale, b_scale,
+                          exp_comp) ||
+            convert_frame(frame, frame_format, 0, cd->width, cd->height,
+                          framebuffers + n + 1, fbs_num - n - 1,
+                          r_scale, g_scale, b_scale, exp_comp)) {
+            return -1;
+        }
+        return 0;
+    }
+    return convert_frame(frame, frame_format, 0, cd->width, cd->height,
+                         framebuffers, fbs_num,
+                         r_scale, g_scale, b_scale, exp_comp);
+}
+
+void
+synthetic_camera_device_close(CameraDevice* ccd)
+{
+    /* Sanity checks. */
+    if (ccd != NULL && ccd->opaque != NULL) {
+        _synthetic_camera_device_free((SyntheticCameraDevice*)ccd->opaque);
+    } else {
+        E("%s: Invalid camera device descriptor", __FUNCTION__);
+    }
+}
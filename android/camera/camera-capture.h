@@ -117,4 +117,53 @@ extern void camera_device_close(CameraDevice* cd);
  */
 extern int enumerate_camera_devices(CameraInfo* cis, int max);
 
+/*
+ * Synthetic camera devices.
+ *
+ * A synthetic camera renders frames instead of capturing them from a camera
+ * connected to the host, and is available on all hosts. Its devices implement
+ * the same API as above, with a synthetic_ prefix.
+ */
+
+/* Checks if a camera mode, or a device name, selects a synthetic camera, i.e.
+ * is 'synthetic', or 'synthetic:<file>'.
+ */
+extern int synthetic_camera_is_mode(const char* name);
+
+/* Sets up a synthetic camera, and collects information about it.
+ * Param:
+ *  mode - Camera mode, either 'synthetic' to render animated color bars, or
+ *      'synthetic:<file>' to replay the frames of a YUV4MPEG2 file with 4:2:0
+ *      chroma subsampling.
+ *  dir - Direction ('back', or 'front') that the camera is facing, which also
+ *      makes the device name of the camera.
+ *  ci - Upon success contains information about the camera. It's
+ *      responsibility of the caller to free the memory allocated for it.
+ * Return:
+ *  0 on success, or -1 on failure.
+ */
+extern int synthetic_camera_setup(const char* mode,
+                                  const char* dir,
+                                  CameraInfo* ci);
+
+extern CameraDevice* synthetic_camera_device_open(const char* name,
+                                                  int inp_channel);
+
+extern int synthetic_camera_device_start_capturing(CameraDevice* cd,
+                                                   uint32_t pixel_format,
+                                                   int frame_width,
+                                                   int frame_height);
+
+extern int synthetic_camera_device_stop_capturing(CameraDevice* cd);
+
+extern int synthetic_camera_device_read_frame(CameraDevice* cd,
+                                              ClientFrameBuffer* framebuffers,
+                                              int fbs_num,
+                                              float r_scale,
+                                              float g_scale,
+                                              float b_scale,
+                                              float exp_comp);
+
+extern void synthetic_camera_device_close(CameraDevice* cd);
+
 #endif  /* ANDROID_CAMERA_CAMERA_CAPTURE_H */
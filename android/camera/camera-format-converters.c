@@ -17,12 +17,24 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef _WIN32
 #elif _DARWIN_C_SOURCE
 #else
 #include <linux/videodev2.h>
 #endif
-#include "android/camera/camera-format-converters.h"
+#include "android/camera/camera-format-converters.h"
+
+/* SSE2 fast paths are compiled in when the compiler targets SSE2 (always the
+ * case for x86_64 hosts), and enabled after checking CPUID at runtime. */
+#if !defined(HOST_WORDS_BIGENDIAN) && defined(__SSE2__) && \
+    (defined(__i386__) || defined(__x86_64__))
+#define CAMERA_CONVERTERS_USE_SSE2 1
+#include <emmintrin.h>
+#include "android/utils/x86_cpuid.h"
+#else
+#define CAMERA_CONVERTERS_USE_SSE2 0
+#endif
 
 #define  E(...)    derror(__VA_ARGS__)
 #define  W(...)    dwarning(__VA_ARGS__)
@@ -260,82 +272,6 @@ _change_exposure(uint8_t inputY, float exp_comp)
     return (uint8_t)clamp((float)inputY * exp_comp);
 }
 
-/* Adjusts an RGB pixel for the given exposure compensation. */
-static __inline__ void
-_change_exposure_RGB(uint8_t* r, uint8_t* g, uint8_t* b, float exp_comp)
-{
-    uint8_t y, u, v;
-    R8G8B8ToYUV(*r, *g, *b, &y, &u, &v);
-    YUVToRGBPix(_change_exposure(y, exp_comp), u, v, r, g, b);
-}
-
-/* Adjusts an RGB pixel for the given exposure compensation. */
-static __inline__ void
-_change_exposure_RGB_i(int* r, int* g, int* b, float exp_comp)
-{
-    uint8_t y, u, v;
-    R8G8B8ToYUV(*r, *g, *b, &y, &u, &v);
-    y = _change_exposure(y, exp_comp);
-    *r = YUV2RO(y,u,v);
-    *g = YUV2GO(y,u,v);
-    *b = YUV2BO(y,u,v);
-}
-
-/* Computes the pixel value after adjusting the white balance to the current
- * one. The input the y, u, v channel of the pixel and the adjusted value will
- * be stored in place. The adjustment is done in RGB space.
- */
-static __inline__ void
-_change_white_balance_YUV(uint8_t* y,
-                          uint8_t* u,
-                          uint8_t* v,
-                          float r_scale,
-                          float g_scale,
-                          float b_scale)
-{
-    int r = (float)(YUV2R((int)*y, (int)*u, (int)*v)) / r_scale;
-    int g = (float)(YUV2G((int)*y, (int)*u, (int)*v)) / g_scale;
-    int b = (float)(YUV2B((int)*y, (int)*u, (int)*v)) / b_scale;
-
-    *y = RGB2Y(r, g, b);
-    *u = RGB2U(r, g, b);
-    *v = RGB2V(r, g, b);
-}
-
-/* Computes the pixel value after adjusting the white balance to the current
- * one. The input the r, and b channels of the pixel and the adjusted value will
- * be stored in place.
- */
-static __inline__ void
-_change_white_balance_RGB(int* r,
-                          int* g,
-                          int* b,
-                          float r_scale,
-                          float g_scale,
-                          float b_scale)
-{
-    *r = (float)*r / r_scale;
-    *g = (float)*g / g_scale;
-    *b = (float)*b / b_scale;
-}
-
-/* Computes the pixel value after adjusting the white balance to the current
- * one. The input the r, and b channels of the pixel and the adjusted value will
- * be stored in place.
- */
-static __inline__ void
-_change_white_balance_RGB_b(uint8_t* r,
-                            uint8_t* g,
-                            uint8_t* b,
-                            float r_scale,
-                            float g_scale,
-                            float b_scale)
-{
-    *r = (float)*r / r_scale;
-    *g = (float)*g / g_scale;
-    *b = (float)*b / b_scale;
-}
-
 /********************************************************************************
  * Generic converters between YUV and RGB formats
  *******************************************************************************/
@@ -1001,128 +937,16 @@ _get_bayerRGB(const BayerDesc* desc,
  * Generic YUV/RGB/BAYER converters
  *******************************************************************************/
 
-/* Generic converter from an RGB/BRG format to a YUV format. */
-static void
-RGBToYUV(const RGBDesc* rgb_fmt,
-         const YUVDesc* yuv_fmt,
-         const void* rgb,
-         void* yuv,
-         int width,
-         int height,
-         float r_scale,
-         float g_scale,
-         float b_scale,
-         float exp_comp)
-{
-    int y, x;
-    const int Y_Inc = yuv_fmt->Y_inc;
-    const int UV_inc = yuv_fmt->UV_inc;
-    const int Y_next_pair = yuv_fmt->Y_next_pair;
-    uint8_t* pY = (uint8_t*)yuv + yuv_fmt->Y_offset;
-    for (y = 0; y < height; y++) {
-        uint8_t* pU =
-            (uint8_t*)yuv + yuv_fmt->u_offset(yuv_fmt, y, width, height);
-        uint8_t* pV =
-            (uint8_t*)yuv + yuv_fmt->v_offset(yuv_fmt, y, width, height);
-        for (x = 0; x < width; x += 2,
-                               pY += Y_next_pair, pU += UV_inc, pV += UV_inc) {
-            uint8_t r, g, b;
-            rgb = rgb_fmt->load_rgb(rgb, &r, &g, &b);
-            _change_white_balance_RGB_b(&r, &g, &b, r_scale, g_scale, b_scale);
-            _change_exposure_RGB(&r, &g, &b, exp_comp);
-            R8G8B8ToYUV(r, g, b, pY, pU, pV);
-            rgb = rgb_fmt->load_rgb(rgb, &r, &g, &b);
-            _change_white_balance_RGB_b(&r, &g, &b, r_scale, g_scale, b_scale);
-            _change_exposure_RGB(&r, &g, &b, exp_comp);
-            pY[Y_Inc] = RGB2Y((int)r, (int)g, (int)b);
-        }
-        /* Aling rgb_ptr to 16 bit */
-        if (((uintptr_t)rgb & 1) != 0) rgb = (const uint8_t*)rgb + 1;
-    }
-}
-
-/* Generic converter from one RGB/BRG format to another RGB/BRG format. */
-static void
-RGBToRGB(const RGBDesc* src_rgb_fmt,
-         const RGBDesc* dst_rgb_fmt,
-         const void* src_rgb,
-         void* dst_rgb,
-         int width,
-         int height,
-         float r_scale,
-         float g_scale,
-         float b_scale,
-         float exp_comp)
-{
-    int x, y;
-    for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            uint8_t r, g, b;
-            src_rgb = src_rgb_fmt->load_rgb(src_rgb, &r, &g, &b);
-            _change_white_balance_RGB_b(&r, &g, &b, r_scale, g_scale, b_scale);
-            _change_exposure_RGB(&r, &g, &b, exp_comp);
-            dst_rgb = dst_rgb_fmt->save_rgb(dst_rgb, r, g, b);
-        }
-        /* Aling rgb pinters to 16 bit */
-        if (((uintptr_t)src_rgb & 1) != 0) src_rgb = (uint8_t*)src_rgb + 1;
-        if (((uintptr_t)dst_rgb & 1) != 0) dst_rgb = (uint8_t*)dst_rgb + 1;
-    }
-}
-
-/* Generic converter from a YUV format to an RGB/BRG format. */
-static void
-YUVToRGB(const YUVDesc* yuv_fmt,
-         const RGBDesc* rgb_fmt,
-         const void* yuv,
-         void* rgb,
-         int width,
-         int height,
-         float r_scale,
-         float g_scale,
-         float b_scale,
-         float exp_comp)
-{
-    int y, x;
-    const int Y_Inc = yuv_fmt->Y_inc;
-    const int UV_inc = yuv_fmt->UV_inc;
-    const int Y_next_pair = yuv_fmt->Y_next_pair;
-    const uint8_t* pY = (const uint8_t*)yuv + yuv_fmt->Y_offset;
-    for (y = 0; y < height; y++) {
-        const uint8_t* pU =
-            (const uint8_t*)yuv + yuv_fmt->u_offset(yuv_fmt, y, width, height);
-        const uint8_t* pV =
-            (const uint8_t*)yuv + yuv_fmt->v_offset(yuv_fmt, y, width, height);
-        for (x = 0; x < width; x += 2,
-                               pY += Y_next_pair, pU += UV_inc, pV += UV_inc) {
-            uint8_t r, g, b;
-            const uint8_t U = *pU;
-            const uint8_t V = *pV;
-            YUVToRGBPix(*pY, U, V, &r, &g, &b);
-            _change_white_balance_RGB_b(&r, &g, &b, r_scale, g_scale, b_scale);
-            _change_exposure_RGB(&r, &g, &b, exp_comp);
-            rgb = rgb_fmt->save_rgb(rgb, r, g, b);
-            YUVToRGBPix(pY[Y_Inc], U, V, &r, &g, &b);
-            _change_white_balance_RGB_b(&r, &g, &b, r_scale, g_scale, b_scale);
-            _change_exposure_RGB(&r, &g, &b, exp_comp);
-            rgb = rgb_fmt->save_rgb(rgb, r, g, b);
-        }
-        /* Aling rgb_ptr to 16 bit */
-        if (((uintptr_t)rgb & 1) != 0) rgb = (uint8_t*)rgb + 1;
-    }
-}
-
-/* Generic converter from one YUV format to another YUV format. */
+/* Generic converter from one YUV format to another YUV format. Since both
+ * formats share the same color space, pixels are simply moved around, so this
+ * is only used when no color correction has to be applied. */
 static void
 YUVToYUV(const YUVDesc* src_fmt,
          const YUVDesc* dst_fmt,
          const void* src,
          void* dst,
          int width,
-         int height,
-         float r_scale,
-         float g_scale,
-         float b_scale,
-         float exp_comp)
+         int height)
 {
     int y, x;
     const int Y_Inc_src = src_fmt->Y_inc;
@@ -1149,79 +973,7 @@ YUVToYUV(const YUVDesc* src_fmt,
                                        pUdst += UV_inc_dst,
                                        pVdst += UV_inc_dst) {
             *pYdst = *pYsrc; *pUdst = *pUsrc; *pVdst = *pVsrc;
-            _change_white_balance_YUV(pYdst, pUdst, pVdst, r_scale, g_scale, b_scale);
-            *pYdst = _change_exposure(*pYdst, exp_comp);
-            pYdst[Y_Inc_dst] = _change_exposure(pYsrc[Y_Inc_src], exp_comp);
-        }
-    }
-}
-
-/* Generic converter from a BAYER format to an RGB/BRG format. */
-static void
-BAYERToRGB(const BayerDesc* bayer_fmt,
-           const RGBDesc* rgb_fmt,
-           const void* bayer,
-           void* rgb,
-           int width,
-           int height,
-           float r_scale,
-           float g_scale,
-           float b_scale,
-           float exp_comp)
-{
-    int y, x;
-    for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            int r, g, b;
-            _get_bayerRGB(bayer_fmt, bayer, x, y, width, height, &r, &g, &b);
-            if (bayer_fmt->mask == kBayer10) {
-                r >>= 2; g >>= 2; b >>= 2;
-            } else if (bayer_fmt->mask == kBayer12) {
-                r >>= 4; g >>= 4; b >>= 4;
-            }
-            _change_white_balance_RGB(&r, &g, &b, r_scale, g_scale, b_scale);
-            _change_exposure_RGB_i(&r, &g, &b, exp_comp);
-            rgb = rgb_fmt->save_rgb(rgb, r, g, b);
-        }
-        /* Aling rgb_ptr to 16 bit */
-        if (((uintptr_t)rgb & 1) != 0) rgb = (uint8_t*)rgb + 1;
-    }
-}
-
-/* Generic converter from a BAYER format to a YUV format. */
-static void
-BAYERToYUV(const BayerDesc* bayer_fmt,
-           const YUVDesc* yuv_fmt,
-           const void* bayer,
-           void* yuv,
-           int width,
-           int height,
-           float r_scale,
-           float g_scale,
-           float b_scale,
-           float exp_comp)
-{
-    int y, x;
-    const int Y_Inc = yuv_fmt->Y_inc;
-    const int UV_inc = yuv_fmt->UV_inc;
-    const int Y_next_pair = yuv_fmt->Y_next_pair;
-    uint8_t* pY = (uint8_t*)yuv + yuv_fmt->Y_offset;
-    for (y = 0; y < height; y++) {
-        uint8_t* pU =
-            (uint8_t*)yuv + yuv_fmt->u_offset(yuv_fmt, y, width, height);
-        uint8_t* pV =
-            (uint8_t*)yuv + yuv_fmt->v_offset(yuv_fmt, y, width, height);
-        for (x = 0; x < width; x += 2,
-                               pY += Y_next_pair, pU += UV_inc, pV += UV_inc) {
-            int r, g, b;
-            _get_bayerRGB(bayer_fmt, bayer, x, y, width, height, &r, &g, &b);
-            _change_white_balance_RGB(&r, &g, &b, r_scale, g_scale, b_scale);
-            _change_exposure_RGB_i(&r, &g, &b, exp_comp);
-            R8G8B8ToYUV(r, g, b, pY, pU, pV);
-            _get_bayerRGB(bayer_fmt, bayer, x + 1, y, width, height, &r, &g, &b);
-            _change_white_balance_RGB(&r, &g, &b, r_scale, g_scale, b_scale);
-            _change_exposure_RGB_i(&r, &g, &b, exp_comp);
-            pY[Y_Inc] = RGB2Y(r, g, b);
+            pYdst[Y_Inc_dst] = pYsrc[Y_Inc_src];
         }
     }
 }
@@ -1602,6 +1354,657 @@ _get_pixel_format_descriptor(uint32_t pixel_format)
     return NULL;
 }
 
+/********************************************************************************
+ * SSE2 fast paths.
+ *
+ * The generic converters above go through the load_rgb / save_rgb / u_offset
+ * callbacks for every single pixel, which is too slow for streaming webcam
+ * frames at 720p. The fast paths below handle the most common conversions
+ * (any YUV format to RGB32 / RGB565, and RGB32 to any YUV format) one row
+ * chunk at a time, 8 pixels per iteration.
+ *
+ * They are only used when no white balance or exposure compensation has to be
+ * applied, and the result of YUV -> RGB and RGB -> YUV conversions is then
+ * computed with the exact same integer arithmetic as RGB2Y / YUV2RO, etc.
+ * Pixels that don't fit in a multiple of 8 at the end of a row go through
+ * the scalar macros.
+ *******************************************************************************/
+
+#if CAMERA_CONVERTERS_USE_SSE2
+
+/* Maximum number of pixels converted by a single call to a row routine. */
+#define SSE2_ROW_CHUNK  256
+
+/* Builds a vector of 32-bit lanes, each containing the 16-bit |lo| and |hi|
+ * values, suitable as a coefficient operand for _mm_madd_epi16(). */
+#define SSE2_COEFFS(lo, hi) \
+    _mm_set1_epi32((int)(((uint32_t)(uint16_t)(hi) << 16) | (uint16_t)(lo)))
+
+/* Returns non-zero if the host CPU supports SSE2. */
+static int
+_sse2_supported(void)
+{
+    static int supported = -1;
+    if (supported < 0) {
+        uint32_t edx = 0;
+        android_get_x86_cpuid(1, 0, NULL, NULL, NULL, &edx);
+        supported = (edx & CPUID_EDX_SSE2) != 0;
+        D("%s: SSE2 camera converters are %s", __FUNCTION__,
+          supported ? "enabled" : "disabled");
+    }
+    return supported;
+}
+
+/* Converts 8 pixels described by 8 Y values, and 4 U and V values (shared by
+ * pixel pairs), to eight 16-bit R, G and B values, clamped to [0 - 255]. */
+static __inline__ void
+_sse2_YUVToRGB8(const uint8_t* Y,
+                const uint8_t* U,
+                const uint8_t* V,
+                __m128i* r,
+                __m128i* g,
+                __m128i* b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rnd = _mm_set1_epi32(128);
+    __m128i c, d, e, t, ce_lo, ce_hi, cd_lo, cd_hi, e1_lo, e1_hi, lo, hi;
+    int u4, v4;
+
+    memcpy(&u4, U, 4);
+    memcpy(&v4, V, 4);
+    c = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)Y), zero);
+    c = _mm_sub_epi16(c, _mm_set1_epi16(16));
+    t = _mm_cvtsi32_si128(u4);
+    d = _mm_unpacklo_epi8(_mm_unpacklo_epi8(t, t), zero);
+    d = _mm_sub_epi16(d, _mm_set1_epi16(128));
+    t = _mm_cvtsi32_si128(v4);
+    e = _mm_unpacklo_epi8(_mm_unpacklo_epi8(t, t), zero);
+    e = _mm_sub_epi16(e, _mm_set1_epi16(128));
+
+    ce_lo = _mm_unpacklo_epi16(c, e);
+    ce_hi = _mm_unpackhi_epi16(c, e);
+    cd_lo = _mm_unpacklo_epi16(c, d);
+    cd_hi = _mm_unpackhi_epi16(c, d);
+    e1_lo = _mm_unpacklo_epi16(e, _mm_set1_epi16(1));
+    e1_hi = _mm_unpackhi_epi16(e, _mm_set1_epi16(1));
+
+    /* R = (298 * C + 409 * E + 128) >> 8 */
+    t = SSE2_COEFFS(298, 409);
+    lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_lo, t), rnd), 8);
+    hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_hi, t), rnd), 8);
+    *r = _mm_packs_epi32(lo, hi);
+
+    /* G = (298 * C - 100 * D - 208 * E + 128) >> 8 */
+    t = SSE2_COEFFS(298, -100);
+    lo = _mm_madd_epi16(cd_lo, t);
+    hi = _mm_madd_epi16(cd_hi, t);
+    t = SSE2_COEFFS(-208, 128);
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, _mm_madd_epi16(e1_lo, t)), 8);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, _mm_madd_epi16(e1_hi, t)), 8);
+    *g = _mm_packs_epi32(lo, hi);
+
+    /* B = (298 * C + 516 * D + 128) >> 8 */
+    t = SSE2_COEFFS(298, 516);
+    lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_lo, t), rnd), 8);
+    hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_hi, t), rnd), 8);
+    *b = _mm_packs_epi32(lo, hi);
+
+    /* Clamp to [0 - 255], like clamp() does. */
+    *r = _mm_unpacklo_epi8(_mm_packus_epi16(*r, *r), zero);
+    *g = _mm_unpacklo_epi8(_mm_packus_epi16(*g, *g), zero);
+    *b = _mm_unpacklo_epi8(_mm_packus_epi16(*b, *b), zero);
+}
+
+/* Converts a row of |count| pixels (a multiple of 8) from planar Y, U, and V
+ * (U and V being subsampled horizontally) to RGB32. Like _save_RGB32(), this
+ * doesn't touch the 4-th byte of the destination pixels. */
+static void
+_sse2_YUVToRGB32Row(const uint8_t* Y,
+                    const uint8_t* U,
+                    const uint8_t* V,
+                    uint8_t* rgb,
+                    int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i keep = _mm_set1_epi32((int)0xff000000U);
+    int x;
+    for (x = 0; x < count; x += 8, Y += 8, U += 4, V += 4, rgb += 32) {
+        __m128i r, g, b, rg, b0, px;
+        _sse2_YUVToRGB8(Y, U, V, &r, &g, &b);
+        r = _mm_packus_epi16(r, r);
+        g = _mm_packus_epi16(g, g);
+        b = _mm_packus_epi16(b, b);
+        rg = _mm_unpacklo_epi8(r, g);
+        b0 = _mm_unpacklo_epi8(b, zero);
+
+        px = _mm_unpacklo_epi16(rg, b0);
+        px = _mm_or_si128(px, _mm_and_si128(
+                _mm_loadu_si128((const __m128i*)rgb), keep));
+        _mm_storeu_si128((__m128i*)rgb, px);
+        px = _mm_unpackhi_epi16(rg, b0);
+        px = _mm_or_si128(px, _mm_and_si128(
+                _mm_loadu_si128((const __m128i*)(rgb + 16)), keep));
+        _mm_storeu_si128((__m128i*)(rgb + 16), px);
+    }
+}
+
+/* Same as _sse2_YUVToRGB32Row(), but for RGB565, using the same bit layout
+ * as _save_RGB16(). */
+static void
+_sse2_YUVToRGB16Row(const uint8_t* Y,
+                    const uint8_t* U,
+                    const uint8_t* V,
+                    uint8_t* rgb,
+                    int count)
+{
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+    int x;
+    for (x = 0; x < count; x += 8, Y += 8, U += 4, V += 4, rgb += 16) {
+        __m128i r, g, b, px;
+        _sse2_YUVToRGB8(Y, U, V, &r, &g, &b);
+        px = _mm_and_si128(r, mask5);
+        px = _mm_or_si128(px, _mm_slli_epi16(_mm_and_si128(g, mask6), 5));
+        px = _mm_or_si128(px, _mm_slli_epi16(_mm_and_si128(b, mask5), 11));
+        _mm_storeu_si128((__m128i*)rgb, px);
+    }
+}
+
+/* Splits four RGB32 pixels into the 'r | g << 16' and 'b | 1 << 16' 32-bit
+ * lanes used by _sse2_RGBTo(). */
+static __inline__ void
+_sse2_splitRGB32(__m128i px, __m128i* rg, __m128i* b1)
+{
+    const __m128i mask_lo = _mm_set1_epi32(0x000000ff);
+    const __m128i mask_hi = _mm_set1_epi32(0x00ff0000);
+    *rg = _mm_or_si128(_mm_and_si128(px, mask_lo),
+                       _mm_and_si128(_mm_slli_epi32(px, 8), mask_hi));
+    *b1 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(px, 16), mask_lo),
+                       _mm_set1_epi32(1 << 16));
+}
+
+/* Computes '(cr * R + cg * G + cb * B + 128) >> 8' for four pixels. */
+static __inline__ __m128i
+_sse2_RGBTo(__m128i rg, __m128i b1, int cr, int cg, int cb)
+{
+    return _mm_srai_epi32(
+            _mm_add_epi32(_mm_madd_epi16(rg, SSE2_COEFFS(cr, cg)),
+                          _mm_madd_epi16(b1, SSE2_COEFFS(cb, 128))), 8);
+}
+
+/* Converts a row of |count| RGB32 pixels (a multiple of 8) to planar Y, U,
+ * and V. Like RGBToYUV(), U and V are taken from the first pixel of each
+ * pair. */
+static void
+_sse2_RGB32ToYUVRow(const uint8_t* rgb,
+                    uint8_t* Y,
+                    uint8_t* U,
+                    uint8_t* V,
+                    int count)
+{
+    int x;
+    for (x = 0; x < count; x += 8, rgb += 32, Y += 8, U += 4, V += 4) {
+        const __m128i p0 = _mm_loadu_si128((const __m128i*)rgb);
+        const __m128i p1 = _mm_loadu_si128((const __m128i*)(rgb + 16));
+        __m128i rg, b1, lo, hi, uv;
+        int u4, v4;
+
+        _sse2_splitRGB32(p0, &rg, &b1);
+        lo = _sse2_RGBTo(rg, b1, 66, 129, 25);
+        _sse2_splitRGB32(p1, &rg, &b1);
+        hi = _sse2_RGBTo(rg, b1, 66, 129, 25);
+        lo = _mm_add_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(16));
+        _mm_storel_epi64((__m128i*)Y, _mm_packus_epi16(lo, lo));
+
+        /* Pixels 0, 2, 4, and 6. */
+        lo = _mm_unpacklo_epi64(_mm_shuffle_epi32(p0, _MM_SHUFFLE(3, 1, 2, 0)),
+                                _mm_shuffle_epi32(p1, _MM_SHUFFLE(3, 1, 2, 0)));
+        _sse2_splitRGB32(lo, &rg, &b1);
+        uv = _mm_packs_epi32(_sse2_RGBTo(rg, b1, -38, -74, 112),
+                             _sse2_RGBTo(rg, b1, 112, -94, -18));
+        uv = _mm_add_epi16(uv, _mm_set1_epi16(128));
+        uv = _mm_packus_epi16(uv, uv);
+        u4 = _mm_cvtsi128_si32(uv);
+        v4 = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+        memcpy(U, &u4, 4);
+        memcpy(V, &v4, 4);
+    }
+}
+
+/* Returns non-zero if the fast paths can be used with the given white
+ * balance and exposure compensation parameters. */
+static __inline__ int
+_sse2_can_convert(float r_scale, float g_scale, float b_scale, float exp_comp)
+{
+    return r_scale == 1.0f && g_scale == 1.0f && b_scale == 1.0f &&
+           exp_comp == 1.0f && _sse2_supported();
+}
+
+/* Fast converter from a YUV format to RGB32 or RGB565.
+ * Return:
+ *  Non-zero if the frame has been converted, or zero if the generic
+ *  converter must be used instead.
+ */
+static int
+_sse2_YUVToRGB(const YUVDesc* yuv_fmt,
+               const RGBDesc* rgb_fmt,
+               const void* yuv,
+               void* rgb,
+               int width,
+               int height,
+               float r_scale,
+               float g_scale,
+               float b_scale,
+               float exp_comp)
+{
+    int y, x, n;
+    uint8_t rowY[SSE2_ROW_CHUNK];
+    uint8_t rowU[SSE2_ROW_CHUNK / 2];
+    uint8_t rowV[SSE2_ROW_CHUNK / 2];
+    const int Y_Inc = yuv_fmt->Y_inc;
+    const int UV_inc = yuv_fmt->UV_inc;
+    const int Y_next_pair = yuv_fmt->Y_next_pair;
+    const int planarY = (Y_Inc == 1 && Y_next_pair == 2);
+    const int planarUV = (UV_inc == 1);
+    const uint8_t* pY = (const uint8_t*)yuv + yuv_fmt->Y_offset;
+    uint8_t* dst = (uint8_t*)rgb;
+    void (*convert_row)(const uint8_t*, const uint8_t*, const uint8_t*,
+                        uint8_t*, int);
+
+    if (rgb_fmt == &_RGB32) {
+        convert_row = _sse2_YUVToRGB32Row;
+    } else if (rgb_fmt == &_RGB16) {
+        convert_row = _sse2_YUVToRGB16Row;
+    } else {
+        return 0;
+    }
+    if (!_sse2_can_convert(r_scale, g_scale, b_scale, exp_comp)) {
+        return 0;
+    }
+
+    for (y = 0; y < height; y++) {
+        const uint8_t* pU =
+            (const uint8_t*)yuv + yuv_fmt->u_offset(yuv_fmt, y, width, height);
+        const uint8_t* pV =
+            (const uint8_t*)yuv + yuv_fmt->v_offset(yuv_fmt, y, width, height);
+        for (x = 0; x + 8 <= width; x += n) {
+            const uint8_t* srcY = pY;
+            const uint8_t* srcU = pU;
+            const uint8_t* srcV = pV;
+            int i;
+            n = (width - x) & ~7;
+            if (n > SSE2_ROW_CHUNK) n = SSE2_ROW_CHUNK;
+            if (!planarY) {
+                for (i = 0; i < n / 2; i++) {
+                    rowY[2 * i] = pY[i * Y_next_pair];
+                    rowY[2 * i + 1] = pY[i * Y_next_pair + Y_Inc];
+                }
+                srcY = rowY;
+            }
+            if (!planarUV) {
+                for (i = 0; i < n / 2; i++) {
+                    rowU[i] = pU[i * UV_inc];
+                    rowV[i] = pV[i * UV_inc];
+                }
+                srcU = rowU;
+                srcV = rowV;
+            }
+            convert_row(srcY, srcU, srcV, dst, n);
+            pY += (n / 2) * Y_next_pair;
+            pU += (n / 2) * UV_inc;
+            pV += (n / 2) * UV_inc;
+            dst += n * rgb_fmt->rgb_inc;
+        }
+        for (; x < width; x += 2,
+                          pY += Y_next_pair, pU += UV_inc, pV += UV_inc) {
+            uint8_t r, g, b;
+            YUVToRGBPix(*pY, *pU, *pV, &r, &g, &b);
+            dst = rgb_fmt->save_rgb(dst, r, g, b);
+            YUVToRGBPix(pY[Y_Inc], *pU, *pV, &r, &g, &b);
+            dst = rgb_fmt->save_rgb(dst, r, g, b);
+        }
+    }
+    return 1;
+}
+
+/* Fast converter from RGB32 to a YUV format.
+ * Return:
+ *  Non-zero if the frame has been converted, or zero if the generic
+ *  converter must be used instead.
+ */
+static int
+_sse2_RGBToYUV(const RGBDesc* rgb_fmt,
+               const YUVDesc* yuv_fmt,
+               const void* rgb,
+               void* yuv,
+               int width,
+               int height,
+               float r_scale,
+               float g_scale,
+               float b_scale,
+               float exp_comp)
+{
+    int y, x, n;
+    uint8_t rowY[SSE2_ROW_CHUNK];
+    uint8_t rowU[SSE2_ROW_CHUNK / 2];
+    uint8_t rowV[SSE2_ROW_CHUNK / 2];
+    const int Y_Inc = yuv_fmt->Y_inc;
+    const int UV_inc = yuv_fmt->UV_inc;
+    const int Y_next_pair = yuv_fmt->Y_next_pair;
+    const int planarY = (Y_Inc == 1 && Y_next_pair == 2);
+    const int planarUV = (UV_inc == 1);
+    uint8_t* pY = (uint8_t*)yuv + yuv_fmt->Y_offset;
+    const uint8_t* src = (const uint8_t*)rgb;
+
+    if (rgb_fmt != &_RGB32 ||
+        !_sse2_can_convert(r_scale, g_scale, b_scale, exp_comp)) {
+        return 0;
+    }
+
+    for (y = 0; y < height; y++) {
+        uint8_t* pU =
+            (uint8_t*)yuv + yuv_fmt->u_offset(yuv_fmt, y, width, height);
+        uint8_t* pV =
+            (uint8_t*)yuv + yuv_fmt->v_offset(yuv_fmt, y, width, height);
+        for (x = 0; x + 8 <= width; x += n) {
+            uint8_t* dstY = planarY ? pY : rowY;
+            uint8_t* dstU = planarUV ? pU : rowU;
+            uint8_t* dstV = planarUV ? pV : rowV;
+            int i;
+            n = (width - x) & ~7;
+            if (n > SSE2_ROW_CHUNK) n = SSE2_ROW_CHUNK;
+            _sse2_RGB32ToYUVRow(src, dstY, dstU, dstV, n);
+            if (!planarY) {
+                for (i = 0; i < n / 2; i++) {
+                    pY[i * Y_next_pair] = rowY[2 * i];
+                    pY[i * Y_next_pair + Y_Inc] = rowY[2 * i + 1];
+                }
+            }
+            if (!planarUV) {
+                for (i = 0; i < n / 2; i++) {
+                    pU[i * UV_inc] = rowU[i];
+                    pV[i * UV_inc] = rowV[i];
+                }
+            }
+            src += n * 4;
+            pY += (n / 2) * Y_next_pair;
+            pU += (n / 2) * UV_inc;
+            pV += (n / 2) * UV_inc;
+        }
+        for (; x < width; x += 2,
+                          pY += Y_next_pair, pU += UV_inc, pV += UV_inc) {
+            uint8_t r, g, b;
+            src = _load_RGB32(src, &r, &g, &b);
+            R8G8B8ToYUV(r, g, b, pY, pU, pV);
+            src = _load_RGB32(src, &r, &g, &b);
+            pY[Y_Inc] = RGB2Y((int)r, (int)g, (int)b);
+        }
+    }
+    return 1;
+}
+
+#else  /* !CAMERA_CONVERTERS_USE_SSE2 */
+
+#define _sse2_YUVToRGB(...)  0
+#define _sse2_RGBToYUV(...)  0
+
+#endif  /* !CAMERA_CONVERTERS_USE_SSE2 */
+
+/********************************************************************************
+ * Fused converter.
+ *
+ * When the camera service replies to a 'frame' query, the captured frame is
+ * usually converted twice: once for video, and once for preview. Instead of
+ * walking the source frame once per framebuffer, the fused converter decodes
+ * each line of the source frame into a line of R, G, and B values, applies
+ * white balance and exposure compensation to it, and then encodes the line
+ * into each of the framebuffers.
+ *
+ * White balance and exposure compensation are applied through lookup tables
+ * computed once per frame, and are skipped entirely when no correction is
+ * requested.
+ *******************************************************************************/
+
+/* Maximum number of framebuffers converted in one pass. The camera service
+ * never asks for more than a video, and a preview framebuffer. */
+#define MAX_CONVERT_FBS  2
+
+/* Color correction lookup tables. */
+typedef struct ColorCorrection {
+    /* Non-zero if white balance must be applied. */
+    int     white_balance;
+    /* Non-zero if exposure compensation must be applied. */
+    int     exposure;
+    /* White balance tables for R, G, and B values. */
+    uint8_t r[256];
+    uint8_t g[256];
+    uint8_t b[256];
+    /* Exposure compensation table for Y values. */
+    uint8_t y[256];
+} ColorCorrection;
+
+/* Fills a white balance table for the given scale. */
+static void
+_init_white_balance_table(uint8_t* table, float scale)
+{
+    int i;
+    for (i = 0; i < 256; i++) {
+        const float value = (float)i / scale;
+        table[i] = value >= 255.0f ? 255 : (value > 0.0f ? (uint8_t)value : 0);
+    }
+}
+
+/* Initializes color correction tables for the given white balance and exposure
+ * compensation parameters.
+ * Return:
+ *  Non-zero if any color correction must be applied, or zero if the frame can
+ *  be converted as is.
+ */
+static int
+_init_color_correction(ColorCorrection* cc,
+                       float r_scale,
+                       float g_scale,
+                       float b_scale,
+                       float exp_comp)
+{
+    int i;
+
+    cc->white_balance = r_scale != 1.0f || g_scale != 1.0f || b_scale != 1.0f;
+    cc->exposure = exp_comp != 1.0f;
+    if (cc->white_balance) {
+        _init_white_balance_table(cc->r, r_scale);
+        _init_white_balance_table(cc->g, g_scale);
+        _init_white_balance_table(cc->b, b_scale);
+    }
+    if (cc->exposure) {
+        for (i = 0; i < 256; i++) {
+            cc->y[i] = _change_exposure((uint8_t)i, exp_comp);
+        }
+    }
+    return cc->white_balance || cc->exposure;
+}
+
+/* Applies color correction to a line of R, G, and B values. */
+static void
+_correct_line(const ColorCorrection* cc, uint8_t* line, int width)
+{
+    int x;
+    for (x = 0; x < width; x++, line += 3) {
+        if (cc->white_balance) {
+            line[0] = cc->r[line[0]];
+            line[1] = cc->g[line[1]];
+            line[2] = cc->b[line[2]];
+        }
+        if (cc->exposure) {
+            uint8_t y, u, v;
+            R8G8B8ToYUV(line[0], line[1], line[2], &y, &u, &v);
+            YUVToRGBPix(cc->y[y], u, v, &line[0], &line[1], &line[2]);
+        }
+    }
+}
+
+/* Position of the fused converter in a framebuffer. */
+typedef struct FusedPos {
+    /* Format of the framebuffer. */
+    const PIXFormat*    desc;
+    /* Beginning of the framebuffer. */
+    uint8_t*            buf;
+    /* Next RGB pixel, or next Y value for YUV framebuffers. */
+    uint8_t*            cur;
+} FusedPos;
+
+/* Initializes a position at the beginning of a framebuffer. */
+static void
+_fused_pos_init(FusedPos* pos, const PIXFormat* desc, const void* buf)
+{
+    pos->desc = desc;
+    pos->buf = (uint8_t*)buf;
+    pos->cur = pos->buf;
+    if (desc->format_sel == PIX_FMT_YUV) {
+        pos->cur += desc->desc.yuv_desc->Y_offset;
+    }
+}
+
+/* Decodes a line of the source frame into R, G, and B values. */
+static void
+_fused_decode_line(FusedPos* src, uint8_t* line, int y, int width, int height)
+{
+    int x;
+
+    switch (src->desc->format_sel) {
+        case PIX_FMT_RGB: {
+            const RGBDesc* rgb_fmt = src->desc->desc.rgb_desc;
+            const void* rgb = src->cur;
+            for (x = 0; x < width; x++, line += 3) {
+                rgb = rgb_fmt->load_rgb(rgb, &line[0], &line[1], &line[2]);
+            }
+            /* Aling rgb_ptr to 16 bit */
+            if (((uintptr_t)rgb & 1) != 0) rgb = (const uint8_t*)rgb + 1;
+            src->cur = (uint8_t*)rgb;
+            break;
+        }
+        case PIX_FMT_YUV: {
+            const YUVDesc* yuv_fmt = src->desc->desc.yuv_desc;
+            const int Y_Inc = yuv_fmt->Y_inc;
+            const int UV_inc = yuv_fmt->UV_inc;
+            const int Y_next_pair = yuv_fmt->Y_next_pair;
+            const uint8_t* pY = src->cur;
+            const uint8_t* pU =
+                src->buf + yuv_fmt->u_offset(yuv_fmt, y, width, height);
+            const uint8_t* pV =
+                src->buf + yuv_fmt->v_offset(yuv_fmt, y, width, height);
+            for (x = 0; x < width; x += 2, line += 6,
+                                   pY += Y_next_pair, pU += UV_inc, pV += UV_inc) {
+                YUVToRGBPix(*pY, *pU, *pV, &line[0], &line[1], &line[2]);
+                YUVToRGBPix(pY[Y_Inc], *pU, *pV, &line[3], &line[4], &line[5]);
+            }
+            src->cur = (uint8_t*)pY;
+            break;
+        }
+        case PIX_FMT_BAYER: {
+            const BayerDesc* bayer_fmt = src->desc->desc.bayer_desc;
+            const int shift = bayer_fmt->mask == kBayer12 ? 4 :
+                              (bayer_fmt->mask == kBayer10 ? 2 : 0);
+            for (x = 0; x < width; x++, line += 3) {
+                int r, g, b;
+                _get_bayerRGB(bayer_fmt, src->buf, x, y, width, height,
+                              &r, &g, &b);
+                line[0] = (uint8_t)(r >> shift);
+                line[1] = (uint8_t)(g >> shift);
+                line[2] = (uint8_t)(b >> shift);
+            }
+            break;
+        }
+    }
+}
+
+/* Encodes a line of R, G, and B values into a framebuffer. */
+static void
+_fused_encode_line(FusedPos* dst,
+                   const uint8_t* line,
+                   int y,
+                   int width,
+                   int height)
+{
+    int x;
+
+    if (dst->desc->format_sel == PIX_FMT_RGB) {
+        const RGBDesc* rgb_fmt = dst->desc->desc.rgb_desc;
+        void* rgb = dst->cur;
+        for (x = 0; x < width; x++, line += 3) {
+            rgb = rgb_fmt->save_rgb(rgb, line[0], line[1], line[2]);
+        }
+        /* Aling rgb_ptr to 16 bit */
+        if (((uintptr_t)rgb & 1) != 0) rgb = (uint8_t*)rgb + 1;
+        dst->cur = rgb;
+    } else {
+        const YUVDesc* yuv_fmt = dst->desc->desc.yuv_desc;
+        const int Y_Inc = yuv_fmt->Y_inc;
+        const int UV_inc = yuv_fmt->UV_inc;
+        const int Y_next_pair = yuv_fmt->Y_next_pair;
+        uint8_t* pY = dst->cur;
+        uint8_t* pU = dst->buf + yuv_fmt->u_offset(yuv_fmt, y, width, height);
+        uint8_t* pV = dst->buf + yuv_fmt->v_offset(yuv_fmt, y, width, height);
+        for (x = 0; x < width; x += 2, line += 6,
+                               pY += Y_next_pair, pU += UV_inc, pV += UV_inc) {
+            R8G8B8ToYUV(line[0], line[1], line[2], pY, pU, pV);
+            pY[Y_Inc] = RGB2Y((int)line[3], (int)line[4], (int)line[5]);
+        }
+        dst->cur = pY;
+    }
+}
+
+/* Converts a frame into several framebuffers in one pass over the frame.
+ * Param:
+ *  src_desc - Source frame format.
+ *  frame - Frame to convert.
+ *  width, height - Frame dimensions.
+ *  dst_descs - Formats of the framebuffers, which can't be BAYER.
+ *  framebuffers - Framebuffers where to convert the frame.
+ *  fbs_num - Number of framebuffers to convert the frame to.
+ *  cc - Color correction to apply to the frame, or NULL for none.
+ * Return:
+ *  0 on success, or -1 if the line buffer can't be allocated.
+ */
+static int
+_fused_convert(const PIXFormat* src_desc,
+               const void* frame,
+               int width,
+               int height,
+               const PIXFormat* const* dst_descs,
+               ClientFrameBuffer* framebuffers,
+               int fbs_num,
+               const ColorCorrection* cc)
+{
+    FusedPos src;
+    FusedPos dst[MAX_CONVERT_FBS];
+    uint8_t* line;
+    int n, y;
+
+    /* Leave room for the last pixel pair of odd width frames. */
+    line = malloc((width + 1) * 3);
+    if (line == NULL) {
+        return -1;
+    }
+
+    _fused_pos_init(&src, src_desc, frame);
+    for (n = 0; n < fbs_num; n++) {
+        _fused_pos_init(&dst[n], dst_descs[n], framebuffers[n].framebuffer);
+    }
+    for (y = 0; y < height; y++) {
+        _fused_decode_line(&src, line, y, width, height);
+        if (cc != NULL) {
+            _correct_line(cc, line, width);
+        }
+        for (n = 0; n < fbs_num; n++) {
+            _fused_encode_line(&dst[n], line, y, width, height);
+        }
+    }
+
+    free(line);
+    return 0;
+}
+
 /********************************************************************************
  * Public API
  *******************************************************************************/
@@ -1631,6 +2034,12 @@ convert_frame(const void* frame,
               float exp_comp)
 {
     int n;
+    int fused_num = 0;
+    const PIXFormat* fused_descs[MAX_CONVERT_FBS];
+    ClientFrameBuffer fused_fbs[MAX_CONVERT_FBS];
+    ColorCorrection cc;
+    const int correct =
+        _init_color_correction(&cc, r_scale, g_scale, b_scale, exp_comp);
     const PIXFormat* src_desc = _get_pixel_format_descriptor(pixel_format);
     if (src_desc == NULL) {
         E("%s: Source pixel format %.4s is unknown",
@@ -1650,57 +2059,62 @@ convert_frame(const void* frame,
               __FUNCTION__, (const char*)&framebuffers[n].pixel_format);
             return -1;
         }
-        switch (src_desc->format_sel) {
-            case PIX_FMT_RGB:
-                if (dst_desc->format_sel == PIX_FMT_RGB) {
-                    RGBToRGB(src_desc->desc.rgb_desc, dst_desc->desc.rgb_desc,
-                             frame, framebuffers[n].framebuffer, width, height,
-                             r_scale, g_scale, b_scale, exp_comp);
-                } else if (dst_desc->format_sel == PIX_FMT_YUV) {
-                    RGBToYUV(src_desc->desc.rgb_desc, dst_desc->desc.yuv_desc,
-                             frame, framebuffers[n].framebuffer, width, height,
-                             r_scale, g_scale, b_scale, exp_comp);
-                } else {
-                    E("%s: Unexpected destination pixel format %d",
-                      __FUNCTION__, dst_desc->format_sel);
-                    return -1;
-                }
-                break;
-            case PIX_FMT_YUV:
-                if (dst_desc->format_sel == PIX_FMT_RGB) {
-                    YUVToRGB(src_desc->desc.yuv_desc, dst_desc->desc.rgb_desc,
-                             frame, framebuffers[n].framebuffer, width, height,
-                             r_scale, g_scale, b_scale, exp_comp);
-                } else if (dst_desc->format_sel == PIX_FMT_YUV) {
-                    YUVToYUV(src_desc->desc.yuv_desc, dst_desc->desc.yuv_desc,
-                             frame, framebuffers[n].framebuffer, width, height,
-                             r_scale, g_scale, b_scale, exp_comp);
-                } else {
-                    E("%s: Unexpected destination pixel format %d",
-                      __FUNCTION__, dst_desc->format_sel);
-                    return -1;
-                }
-                break;
-            case PIX_FMT_BAYER:
-                if (dst_desc->format_sel == PIX_FMT_RGB) {
-                    BAYERToRGB(src_desc->desc.bayer_desc, dst_desc->desc.rgb_desc,
-                              frame, framebuffers[n].framebuffer, width, height,
-                              r_scale, g_scale, b_scale, exp_comp);
-                } else if (dst_desc->format_sel == PIX_FMT_YUV) {
-                    BAYERToYUV(src_desc->desc.bayer_desc, dst_desc->desc.yuv_desc,
-                               frame, framebuffers[n].framebuffer, width, height,
-                               r_scale, g_scale, b_scale, exp_comp);
-                } else {
-                    E("%s: Unexpected destination pixel format %d",
-                      __FUNCTION__, dst_desc->format_sel);
-                    return -1;
-                }
-                break;
-            default:
-                E("%s: Unexpected source pixel format %d",
-                  __FUNCTION__, dst_desc->format_sel);
+        if (dst_desc->format_sel != PIX_FMT_RGB &&
+            dst_desc->format_sel != PIX_FMT_YUV) {
+            E("%s: Unexpected destination pixel format %d",
+              __FUNCTION__, dst_desc->format_sel);
+            return -1;
+        }
+
+        /* Without color correction, some conversions have their own faster
+         * converters. */
+        if (!correct) {
+            if (src_desc->format_sel == PIX_FMT_RGB &&
+                dst_desc->format_sel == PIX_FMT_YUV &&
+                _sse2_RGBToYUV(src_desc->desc.rgb_desc,
+                               dst_desc->desc.yuv_desc,
+                               frame, framebuffers[n].framebuffer,
+                               width, height,
+                               r_scale, g_scale, b_scale, exp_comp)) {
+                continue;
+            }
+            if (src_desc->format_sel == PIX_FMT_YUV &&
+                dst_desc->format_sel == PIX_FMT_RGB &&
+                _sse2_YUVToRGB(src_desc->desc.yuv_desc,
+                               dst_desc->desc.rgb_desc,
+                               frame, framebuffers[n].framebuffer,
+                               width, height,
+                               r_scale, g_scale, b_scale, exp_comp)) {
+                continue;
+            }
+            if (src_desc->format_sel == PIX_FMT_YUV &&
+                dst_desc->format_sel == PIX_FMT_YUV) {
+                YUVToYUV(src_desc->desc.yuv_desc, dst_desc->desc.yuv_desc,
+                         frame, framebuffers[n].framebuffer, width, height);
+                continue;
+            }
+        }
+
+        /* Everything else goes through the fused converter, which reads the
+         * source frame only once for all these framebuffers. */
+        if (fused_num == MAX_CONVERT_FBS) {
+            if (_fused_convert(src_desc, frame, width, height, fused_descs,
+                               fused_fbs, fused_num, correct ? &cc : NULL)) {
+                E("%s: Unable to allocate a line buffer", __FUNCTION__);
                 return -1;
+            }
+            fused_num = 0;
         }
+        fused_descs[fused_num] = dst_desc;
+        fused_fbs[fused_num] = framebuffers[n];
+        fused_num++;
+    }
+
+    if (fused_num != 0 &&
+        _fused_convert(src_desc, frame, width, height, fused_descs,
+                       fused_fbs, fused_num, correct ? &cc : NULL)) {
+        E("%s: Unable to allocate a line buffer", __FUNCTION__);
+        return -1;
     }
 
     return 0;
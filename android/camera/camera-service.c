@@ -19,8 +19,11 @@
  */
 
 #include "qemu-common.h"
+#include "qemu/thread.h"
+#include "sysemu/char.h"
 #include "android/globals.h"  /* for android_hw */
 #include "android/hw-qemud.h"
+#include "android/opengles.h"
 #include "android/utils/misc.h"
 #include "android/utils/system.h"
 #include "android/utils/debug.h"
@@ -48,6 +51,44 @@
 /* Maximum number of supported emulated cameras. */
 #define MAX_CAMERA      8
 
+typedef struct CameraClient CameraClient;
+
+/* Camera capturing API of a kind of camera devices. */
+typedef struct CameraBackend {
+    CameraDevice*   (*open)(const char* name, int inp_channel);
+    int             (*start_capturing)(CameraDevice* cd,
+                                       uint32_t pixel_format,
+                                       int frame_width,
+                                       int frame_height);
+    int             (*stop_capturing)(CameraDevice* cd);
+    int             (*read_frame)(CameraDevice* cd,
+                                  ClientFrameBuffer* framebuffers,
+                                  int fbs_num,
+                                  float r_scale,
+                                  float g_scale,
+                                  float b_scale,
+                                  float exp_comp);
+    void            (*close)(CameraDevice* cd);
+} CameraBackend;
+
+/* Cameras connected to the host. */
+static const CameraBackend _host_camera_backend = {
+    camera_device_open,
+    camera_device_start_capturing,
+    camera_device_stop_capturing,
+    camera_device_read_frame,
+    camera_device_close,
+};
+
+/* Synthetic cameras. */
+static const CameraBackend _synthetic_camera_backend = {
+    synthetic_camera_device_open,
+    synthetic_camera_device_start_capturing,
+    synthetic_camera_device_stop_capturing,
+    synthetic_camera_device_read_frame,
+    synthetic_camera_device_close,
+};
+
 /* Camera sevice descriptor. */
 typedef struct CameraServiceDesc CameraServiceDesc;
 struct CameraServiceDesc {
@@ -57,11 +98,16 @@ struct CameraServiceDesc {
     CameraInfo  camera_info[MAX_CAMERA];
     /* Number of camera devices connected to the host. */
     int         camera_count;
+    /* Emulated camera client connected to each camera device, or NULL. */
+    CameraClient*   clients[MAX_CAMERA];
 };
 
 /* One and only one camera service. */
 static CameraServiceDesc    _camera_service_desc;
 
+/* Qemud service the camera clients are connected to. */
+static QemudService*        _camera_service;
+
 /********************************************************************************
  * Helper routines
  *******************************************************************************/
@@ -307,6 +353,27 @@ _wecam_setup(CameraServiceDesc* csd,
       csd->camera_count++;
 }
 
+/* Initialized synthetic camera emulation record in camera service descriptor.
+ * Param:
+ *  csd - Camera service descriptor to initialize a record in.
+ *  mode - Synthetic camera mode ('synthetic', or 'synthetic:<file>').
+ *  dir - Direction ('back', or 'front') that emulated camera is facing.
+ */
+static void
+_synthetic_setup(CameraServiceDesc* csd, const char* mode, const char* dir)
+{
+    CameraInfo* ci = csd->camera_info + csd->camera_count;
+
+    if (synthetic_camera_setup(mode, dir, ci)) {
+        W("Unable to set up synthetic camera '%s' facing %s\n", mode, dir);
+        return;
+    }
+    D("Camera %d '%s' connected to '%s' facing %s using %.4s pixel format",
+      csd->camera_count, ci->display_name, ci->device_name, ci->direction,
+      (const char*)(&ci->pixel_format));
+    csd->camera_count++;
+}
+
 /* Initializes camera service descriptor.
  */
 static void
@@ -320,6 +387,14 @@ _camera_service_init(CameraServiceDesc* csd)
     memset(csd->camera_info, 0, sizeof(CameraInfo) * MAX_CAMERA);
     csd->camera_count = 0;
 
+    /* Synthetic cameras don't need any camera connected to the host. */
+    if (synthetic_camera_is_mode(android_hw->hw_camera_back)) {
+        _synthetic_setup(csd, android_hw->hw_camera_back, "back");
+    }
+    if (synthetic_camera_is_mode(android_hw->hw_camera_front)) {
+        _synthetic_setup(csd, android_hw->hw_camera_front, "front");
+    }
+
     /* Lets see if HW config uses web cameras. */
     if (memcmp(android_hw->hw_camera_back, "webcam", 6) &&
         memcmp(android_hw->hw_camera_front, "webcam", 6)) {
@@ -573,9 +648,11 @@ _factory_client_close(void*  opaque)
  * Camera client API
  *******************************************************************************/
 
+typedef struct CameraStream CameraStream;
+typedef struct CameraStreamChannel CameraStreamChannel;
+
 /* Describes an emulated camera client.
  */
-typedef struct CameraClient CameraClient;
 struct CameraClient
 {
     /* Client name.
@@ -589,6 +666,8 @@ struct CameraClient
     const CameraInfo*   camera_info;
     /* Emulated camera device descriptor. */
     CameraDevice*       camera;
+    /* Capturing API for the camera device. */
+    const CameraBackend*    backend;
     /* Buffer allocated for video frames.
      * Note that memory allocated for this buffer
      * also contains preview framebuffer. */
@@ -610,19 +689,378 @@ struct CameraClient
     int                 pixel_num;
     /* Status of video and preview frame cache. */
     int                 frames_cached;
+    /* Stream channel opened by the guest for this camera, or NULL. */
+    CameraStreamChannel*    stream_channel;
+    /* Streaming state, or NULL if frames are not streamed. */
+    CameraStream*       stream;
 };
 
+/********************************************************************************
+ * Camera streaming
+ *******************************************************************************/
+
+/*
+ * In streaming mode, frames are not queried one at a time by the guest.
+ * Instead, a capture thread keeps reading frames from the camera device into
+ * a ring of converted frames, and each new frame is pushed to the guest on a
+ * dedicated stream channel, which the guest opens by connecting to the camera
+ * service with "name=<device> stream=1" parameters.
+ *
+ * Each frame is sent as a header of CAMERA_STREAM_HEADER_SIZE bytes, made of
+ * little-endian 32-bit values:
+ *
+ *     magic         CAMERA_STREAM_MAGIC
+ *     sequence      frame number, starting at 1, may skip dropped frames
+ *     timestamp     host capture time in microseconds, low then high 32 bits
+ *     video_size    size of the video frame that follows the header
+ *     preview_size  size of the preview frame that follows the video frame
+ *
+ * The guest writes a byte on the stream channel each time it is done reading
+ * a frame, and no more than CAMERA_STREAM_CREDITS unread frames are pushed to
+ * it. Frames captured meanwhile replace the previous ones in the ring, so the
+ * guest always gets the newest one.
+ *
+ * The capture thread is the only one to use the camera device while the
+ * camera is streaming. It notifies the main loop of new frames through a
+ * socket pair, and the main loop copies them to the stream channel, so that
+ * neither capture nor conversion ever block it.
+ */
+
+/* Number of frames in the ring: one being captured, the newest one captured,
+ * and one being sent to the guest. */
+#define CAMERA_STREAM_RING          3
+/* Number of pushed frames that the guest didn't read yet. */
+#define CAMERA_STREAM_CREDITS       2
+/* "CSTR" in little-endian order. */
+#define CAMERA_STREAM_MAGIC         0x52545343
+#define CAMERA_STREAM_HEADER_SIZE   24
+/* Some devices (e.g. on Mac) return their last frame again until a new one
+ * is captured, so frames are read at most this often. */
+#define CAMERA_STREAM_MIN_PERIOD_US 16000
+/* How long to wait for a frame when the device has none ready. */
+#define CAMERA_STREAM_POLL_MS       5
+
+typedef struct CameraStreamFrame {
+    /* Video frame, followed by the preview frame. */
+    uint8_t*    video;
+    uint8_t*    preview;
+    uint32_t    sequence;
+    uint64_t    timestamp;
+} CameraStreamFrame;
+
+struct CameraStream {
+    CameraClient*       cc;
+    QemuThread          thread;
+    /* Protects the fields below, up to 'error'. */
+    QemuMutex           lock;
+    /* Set to ask the capture thread to exit. */
+    int                 stop;
+    /* Index of the newest captured frame not sent yet, or -1. */
+    int                 ready;
+    /* Index of the frame being sent by the main loop, or -1. */
+    int                 busy;
+    /* Color correction of the captured frames. */
+    float               r_scale, g_scale, b_scale, exp_comp;
+    /* errno value if capture failed, 0 otherwise. */
+    int                 error;
+    /* Set while a call to _camera_stream_notify() is posted. */
+    int                 notified;
+    /* Fields below are only accessed by the main loop, or by the capture
+     * thread only. */
+    uint32_t            sequence;
+    int                 credits;
+    size_t              video_size;
+    size_t              preview_size;
+    CameraStreamFrame   frames[CAMERA_STREAM_RING];
+};
+
+/* Stream channel of a camera. Pipe channels are only closed by the guest, so
+ * this outlives the camera client when the latter closes first. */
+struct CameraStreamChannel {
+    /* Camera client the channel belongs to, or NULL once it is closed. */
+    CameraClient*   cc;
+    QemudClient*    client;
+};
+
+/* Stores |value| at |p| in little-endian order. */
+static void
+_put_le32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static void _camera_stream_notify(void* opaque);
+
+/* Capture thread of a streaming camera. */
+static void*
+_camera_stream_thread(void* opaque)
+{
+    CameraStream* cs = (CameraStream*)opaque;
+    CameraClient* cc = cs->cc;
+    uint64_t last_read = 0;
+
+    for (;;) {
+        ClientFrameBuffer fbs[2];
+        CameraStreamFrame* frame;
+        float r_scale, g_scale, b_scale, exp_comp;
+        int fbs_num = 0;
+        int index, res;
+        uint64_t now;
+
+        qemu_mutex_lock(&cs->lock);
+        if (cs->stop) {
+            qemu_mutex_unlock(&cs->lock);
+            break;
+        }
+        /* Never overwrite the frames waiting for, or being sent. */
+        for (index = 0; index == cs->ready || index == cs->busy; index++) {
+        }
+        r_scale = cs->r_scale;
+        g_scale = cs->g_scale;
+        b_scale = cs->b_scale;
+        exp_comp = cs->exp_comp;
+        qemu_mutex_unlock(&cs->lock);
+
+        now = _get_timestamp();
+        if (now - last_read < CAMERA_STREAM_MIN_PERIOD_US) {
+            _camera_sleep((CAMERA_STREAM_MIN_PERIOD_US - (now - last_read)) /
+                          1000 + 1);
+        }
+        last_read = _get_timestamp();
+
+        frame = &cs->frames[index];
+        if (cs->video_size) {
+            fbs[fbs_num].pixel_format = cc->pixel_format;
+            fbs[fbs_num].framebuffer = frame->video;
+            fbs_num++;
+        }
+        if (cs->preview_size) {
+            fbs[fbs_num].pixel_format = V4L2_PIX_FMT_RGB32;
+            fbs[fbs_num].framebuffer = frame->preview;
+            fbs_num++;
+        }
+        res = cc->backend->read_frame(cc->camera, fbs, fbs_num,
+                                       r_scale, g_scale, b_scale, exp_comp);
+        if (res == 1) {
+            /* No frame ready yet. */
+            _camera_sleep(CAMERA_STREAM_POLL_MS);
+            continue;
+        }
+
+        qemu_mutex_lock(&cs->lock);
+        if (res < 0) {
+            cs->error = errno ? errno : EIO;
+        } else {
+            frame->sequence = ++cs->sequence;
+            frame->timestamp = last_read;
+            cs->ready = index;
+        }
+        if (!cs->notified) {
+            cs->notified = 1;
+            qemud_service_post(_camera_service, _camera_stream_notify, cs);
+        }
+        qemu_mutex_unlock(&cs->lock);
+
+        if (res < 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Pushes the newest captured frame to the guest, if it can take one. */
+static void
+_camera_stream_push(CameraStream* cs)
+{
+    CameraStreamFrame* frame;
+    uint8_t header[CAMERA_STREAM_HEADER_SIZE];
+    CameraStreamChannel* channel = cs->cc->stream_channel;
+    QemudClient* qc;
+    int index;
+
+    if (cs->credits <= 0 || channel == NULL) {
+        return;
+    }
+    qc = channel->client;
+
+    qemu_mutex_lock(&cs->lock);
+    index = cs->ready;
+    if (index >= 0) {
+        cs->busy = index;
+        cs->ready = -1;
+    }
+    qemu_mutex_unlock(&cs->lock);
+    if (index < 0) {
+        return;
+    }
+
+    frame = &cs->frames[index];
+    _put_le32(header, CAMERA_STREAM_MAGIC);
+    _put_le32(header + 4, frame->sequence);
+    _put_le32(header + 8, (uint32_t)frame->timestamp);
+    _put_le32(header + 12, (uint32_t)(frame->timestamp >> 32));
+    _put_le32(header + 16, cs->video_size);
+    _put_le32(header + 20, cs->preview_size);
+    qemud_client_send(qc, header, sizeof(header));
+    if (cs->video_size) {
+        qemud_client_send(qc, frame->video, cs->video_size);
+    }
+    if (cs->preview_size) {
+        qemud_client_send(qc, frame->preview, cs->preview_size);
+    }
+    cs->credits--;
+
+    qemu_mutex_lock(&cs->lock);
+    cs->busy = -1;
+    qemu_mutex_unlock(&cs->lock);
+}
+
+/* Posted to the camera service by the capture thread when it has a new
+ * frame. */
+static void
+_camera_stream_notify(void* opaque)
+{
+    CameraStream* cs = (CameraStream*)opaque;
+    int error;
+
+    qemu_mutex_lock(&cs->lock);
+    error = cs->error;
+    cs->error = 0;
+    cs->notified = 0;
+    qemu_mutex_unlock(&cs->lock);
+    if (error) {
+        E("%s: Unable to obtain video frame from the camera '%s': %s.",
+          __FUNCTION__, cs->cc->device_name, strerror(error));
+    }
+
+    _camera_stream_push(cs);
+}
+
+/* Stops streaming frames from the camera. */
+static void
+_camera_stream_stop(CameraClient* cc)
+{
+    CameraStream* cs = cc->stream;
+    int n;
+
+    if (cs == NULL) {
+        return;
+    }
+
+    qemu_mutex_lock(&cs->lock);
+    cs->stop = 1;
+    qemu_mutex_unlock(&cs->lock);
+    qemu_thread_join(&cs->thread);
+
+    qemud_service_cancel(_camera_service, _camera_stream_notify, cs);
+    qemu_mutex_destroy(&cs->lock);
+    for (n = 0; n < CAMERA_STREAM_RING; n++) {
+        free(cs->frames[n].video);
+    }
+    AFREE(cs);
+    cc->stream = NULL;
+
+    D("%s: Camera '%s' stopped streaming", __FUNCTION__, cc->device_name);
+}
+
+/* Starts streaming frames of |video_size| and |preview_size| bytes from the
+ * started camera. Return 0 on success, or -1 on failure. */
+static int
+_camera_stream_start(CameraClient* cc, size_t video_size, size_t preview_size)
+{
+    CameraStream* cs;
+    int n;
+
+    ANEW0(cs);
+    cs->cc = cc;
+    cs->ready = -1;
+    cs->busy = -1;
+    cs->r_scale = cs->g_scale = cs->b_scale = cs->exp_comp = 1.0f;
+    cs->credits = CAMERA_STREAM_CREDITS;
+    cs->video_size = video_size;
+    cs->preview_size = preview_size;
+
+    for (n = 0; n < CAMERA_STREAM_RING; n++) {
+        /* The buffer is never empty, even if no frame is requested. */
+        cs->frames[n].video = (uint8_t*)malloc(video_size + preview_size + 1);
+        if (cs->frames[n].video == NULL) {
+            E("%s: Not enough memory for streamed frames", __FUNCTION__);
+            while (--n >= 0) {
+                free(cs->frames[n].video);
+            }
+            AFREE(cs);
+            return -1;
+        }
+        cs->frames[n].preview = cs->frames[n].video + video_size;
+    }
+
+    qemu_mutex_init(&cs->lock);
+    cc->stream = cs;
+    qemu_thread_create(&cs->thread, _camera_stream_thread, cs,
+                       QEMU_THREAD_JOINABLE);
+
+    D("%s: Camera '%s' is now streaming", __FUNCTION__, cc->device_name);
+    return 0;
+}
+
+/* Handles a message received on a stream channel: each byte tells that the
+ * guest is done reading a frame. */
+static void
+_camera_stream_client_recv(void*         opaque,
+                           uint8_t*      msg,
+                           int           msglen,
+                           QemudClient*  client)
+{
+    CameraStreamChannel* channel = (CameraStreamChannel*)opaque;
+    CameraStream* cs = channel->cc ? channel->cc->stream : NULL;
+
+    if (cs == NULL) {
+        return;
+    }
+    cs->credits += msglen;
+    if (cs->credits > CAMERA_STREAM_CREDITS) {
+        cs->credits = CAMERA_STREAM_CREDITS;
+    }
+    _camera_stream_push(cs);
+}
+
+/* Stream channel has been closed by the guest. */
+static void
+_camera_stream_client_close(void* opaque)
+{
+    CameraStreamChannel* channel = (CameraStreamChannel*)opaque;
+
+    if (channel->cc != NULL) {
+        _camera_stream_stop(channel->cc);
+        channel->cc->stream_channel = NULL;
+    }
+    AFREE(channel);
+}
+
 /* Frees emulated camera client descriptor. */
 static void
 _camera_client_free(CameraClient* cc)
 {
+    _camera_stream_stop(cc);
+    if (cc->stream_channel != NULL) {
+        /* The guest closes the channel later on. */
+        CameraStreamChannel* channel = cc->stream_channel;
+        channel->cc = NULL;
+        cc->stream_channel = NULL;
+        qemud_client_close(channel->client);
+    }
     /* The only exception to the "read only" rule: we have to mark the camera
      * as being not used when we destroy a service for it. */
     if (cc->camera_info != NULL) {
         ((CameraInfo*)cc->camera_info)->in_use = 0;
+        _camera_service_desc.clients[cc->camera_info -
+                                     _camera_service_desc.camera_info] = NULL;
     }
     if (cc->camera != NULL) {
-        camera_device_close(cc->camera);
+        cc->backend->close(cc->camera);
     }
     if (cc->video_frame != NULL) {
         free(cc->video_frame);
@@ -664,6 +1102,9 @@ _camera_client_create(CameraServiceDesc* csd, const char* param)
         return NULL;
     }
 
+    cc->backend = synthetic_camera_is_mode(cc->device_name) ?
+                  &_synthetic_camera_backend : &_host_camera_backend;
+
     /* Pull optional input channel. */
     res = get_token_value_int(param, "inp_channel", &cc->inp_channel);
     if (res != 0) {
@@ -705,6 +1146,7 @@ _camera_client_create(CameraServiceDesc* csd, const char* param)
     /* We're done. Set camera in use, and succeed the connection. */
     ci->in_use = 1;
     cc->camera_info = ci;
+    csd->clients[ci - csd->camera_info] = cc;
 
     D("%s: Camera service is created for device '%s' using input channel %d",
       __FUNCTION__, cc->device_name, cc->inp_channel);
@@ -733,7 +1175,7 @@ _camera_client_query_connect(CameraClient* cc, QemudClient* qc, const char* para
     }
 
     /* Open camera device. */
-    cc->camera = camera_device_open(cc->device_name, cc->inp_channel);
+    cc->camera = cc->backend->open(cc->device_name, cc->inp_channel);
     if (cc->camera == NULL) {
         E("%s: Unable to open camera device '%s'", __FUNCTION__, cc->device_name);
         _qemu_client_reply_ko(qc, "Unable to open camera device.");
@@ -773,7 +1215,7 @@ _camera_client_query_disconnect(CameraClient* cc,
     }
 
     /* Close camera device. */
-    camera_device_close(cc->camera);
+    cc->backend->close(cc->camera);
     cc->camera = NULL;
 
     D("Camera device '%s' is now disconnected", cc->device_name);
@@ -929,8 +1371,8 @@ _camera_client_query_start(CameraClient* cc, QemudClient* qc, const char* param)
     cc->preview_frame = (uint16_t*)(cc->video_frame + cc->video_frame_size);
 
     /* Start the camera. */
-    if (camera_device_start_capturing(cc->camera, cc->camera_info->pixel_format,
-                                      cc->width, cc->height)) {
+    if (cc->backend->start_capturing(cc->camera, cc->camera_info->pixel_format,
+                                     cc->width, cc->height)) {
         E("%s: Cannot start camera '%s' for %.4s[%dx%d]: %s",
           __FUNCTION__, cc->device_name, (const char*)&cc->pixel_format,
           cc->width, cc->height, strerror(errno));
@@ -963,8 +1405,10 @@ _camera_client_query_stop(CameraClient* cc, QemudClient* qc, const char* param)
         return;
     }
 
+    _camera_stream_stop(cc);
+
     /* Stop the camera. */
-    if (camera_device_stop_capturing(cc->camera)) {
+    if (cc->backend->stop_capturing(cc->camera)) {
         E("%s: Cannot stop camera device '%s': %s",
           __FUNCTION__, cc->device_name, strerror(errno));
         _qemu_client_reply_ko(qc, "Cannot stop camera device");
@@ -984,6 +1428,7 @@ _camera_client_query_stop(CameraClient* cc, QemudClient* qc, const char* param)
  *  qc - Qemu client for the emulated camera.
  *  param - Query parameters. Parameters for this query are formatted as such:
  *          video=<size> preview=<size> whiteb=<red>,<green>,<blue> expcomp=<comp>
+ *          [colorbuffer=<handle>]
  *      where:
  *       - 'video', and 'preview' both must be decimal values, defining size of
  *         requested video, and preview frames respectively. Zero value for any
@@ -991,12 +1436,20 @@ _camera_client_query_stop(CameraClient* cc, QemudClient* qc, const char* param)
  *       - whiteb contains float values required to calculate whilte balance.
  *       - expcomp contains a float value required to calculate exposure
  *         compensation.
+ *       - colorbuffer is the optional decimal host handle of a GPU emulation
+ *         color buffer, e.g. that of the gralloc buffer of the preview window.
+ *         The frame is then uploaded into it, and converted from the video
+ *         pixel format to RGB by the host GPU, instead of being converted to
+ *         RGB32 and sent back as the preview frame, so that the guest only
+ *         has to post the buffer. The preview frame is never sent in this
+ *         case, whatever the 'preview' value.
  */
 static void
 _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
 {
     int video_size = 0;
     int preview_size = 0;
+    int color_buffer = 0;
     int repeat;
     ClientFrameBuffer fbs[2];
     int fbs_num = 0;
@@ -1012,6 +1465,12 @@ _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
         _qemu_client_reply_ko(qc, "Camera is not started");
         return;
     }
+    if (cc->stream != NULL) {
+        /* The capture thread owns the device. */
+        E("%s: Camera '%s' is streaming", __FUNCTION__, cc->device_name);
+        _qemu_client_reply_ko(qc, "Camera is streaming");
+        return;
+    }
 
     /* Pull required parameters. */
     if (get_token_value_int(param, "video", &video_size) ||
@@ -1023,6 +1482,12 @@ _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
         return;
     }
 
+    /* The preview frame may go straight to a host color buffer. */
+    if (get_token_value_int(param, "colorbuffer", &color_buffer) == -2) {
+        _qemu_client_reply_ko(qc, "Invalid 'colorbuffer' parameter");
+        return;
+    }
+
     /* Pull white balance values. */
     if (!get_token_value(param, "whiteb", tmp, sizeof(tmp))) {
         if (sscanf(tmp, "%g,%g,%g", &r_scale, &g_scale, &b_scale) != 3) {
@@ -1055,12 +1520,16 @@ _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
      * Initialize framebuffer array for frame read.
      */
 
-    if (video_size) {
+    if (video_size || color_buffer) {
+        /* The color buffer is updated from the video frame, which is in one
+         * of the YUV 4:2:0 formats the GPU can convert. */
         fbs[fbs_num].pixel_format = cc->pixel_format;
         fbs[fbs_num].framebuffer = cc->video_frame;
         fbs_num++;
     }
-    if (preview_size) {
+    if (color_buffer) {
+        preview_size = 0;
+    } else if (preview_size) {
         /* TODO: Watch out for preview format changes! */
         fbs[fbs_num].pixel_format = V4L2_PIX_FMT_RGB32;
         fbs[fbs_num].framebuffer = cc->preview_frame;
@@ -1069,7 +1538,7 @@ _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
 
     /* Capture new frame. */
     tick = _get_timestamp();
-    repeat = camera_device_read_frame(cc->camera, fbs, fbs_num,
+    repeat = cc->backend->read_frame(cc->camera, fbs, fbs_num,
                                       r_scale, g_scale, b_scale, exp_comp);
 
     /* Note that there is no (known) way how to wait on next frame being
@@ -1087,7 +1556,7 @@ _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
            (_get_timestamp() - tick) < 2000000LL) {
         /* Sleep for 10 millisec before repeating the attempt. */
         _camera_sleep(10);
-        repeat = camera_device_read_frame(cc->camera, fbs, fbs_num,
+        repeat = cc->backend->read_frame(cc->camera, fbs, fbs_num,
                                           r_scale, g_scale, b_scale, exp_comp);
     }
     if (repeat == 1 && !cc->frames_cached) {
@@ -1108,6 +1577,17 @@ _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
     /* We have cached something... */
     cc->frames_cached = 1;
 
+    if (color_buffer &&
+        android_updateOpenglesColorBufferYuv((uint32_t)color_buffer,
+                                             cc->width, cc->height,
+                                             cc->pixel_format,
+                                             cc->video_frame) < 0) {
+        E("%s: Unable to update color buffer %d from the camera '%s'",
+          __FUNCTION__, color_buffer, cc->device_name);
+        _qemu_client_reply_ko(qc, "Unable to update the color buffer");
+        return;
+    }
+
     /*
      * Build the reply.
      */
@@ -1138,6 +1618,124 @@ _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
     }
 }
 
+/* Client has queried to stream frames.
+ * Param:
+ *  cc - Queried camera client descriptor.
+ *  qc - Qemu client for the emulated camera.
+ *  param - Query parameters, formatted as the parameters of the 'frame' query:
+ *          video=<size> preview=<size> whiteb=<red>,<green>,<blue> expcomp=<comp>
+ *      Sending this query again while streaming updates the white balance and
+ *      the exposure compensation of the next frames.
+ */
+static void
+_camera_client_query_stream(CameraClient* cc, QemudClient* qc, const char* param)
+{
+    int video_size = 0;
+    int preview_size = 0;
+    float r_scale = 1.0f, g_scale = 1.0f, b_scale = 1.0f, exp_comp = 1.0f;
+    char tmp[256];
+
+    /* Sanity check. */
+    if (cc->video_frame == NULL) {
+        /* Not started. */
+        E("%s: Camera '%s' is not started", __FUNCTION__, cc->device_name);
+        _qemu_client_reply_ko(qc, "Camera is not started");
+        return;
+    }
+    if (cc->stream_channel == NULL) {
+        E("%s: Camera '%s' has no stream channel", __FUNCTION__, cc->device_name);
+        _qemu_client_reply_ko(qc, "No stream channel");
+        return;
+    }
+#ifdef _WIN32
+    /* Frames are captured through a window owned by the main thread, which
+     * can't be used from the capture thread. */
+    _qemu_client_reply_ko(qc, "Streaming is not supported on this host");
+    return;
+#endif
+
+    /* Pull required parameters. */
+    if (param == NULL ||
+        get_token_value_int(param, "video", &video_size) ||
+        get_token_value_int(param, "preview", &preview_size)) {
+        E("%s: Invalid or missing 'video', or 'preview' parameter in '%s'",
+          __FUNCTION__, param ? param : "");
+        _qemu_client_reply_ko(qc,
+            "Invalid or missing 'video', or 'preview' parameter");
+        return;
+    }
+
+    /* Pull white balance values. */
+    if (!get_token_value(param, "whiteb", tmp, sizeof(tmp))) {
+        if (sscanf(tmp, "%g,%g,%g", &r_scale, &g_scale, &b_scale) != 3) {
+            D("Invalid value '%s' for parameter 'whiteb'", tmp);
+            r_scale = g_scale = b_scale = 1.0f;
+        }
+    }
+
+    /* Pull exposure compensation. */
+    if (!get_token_value(param, "expcomp", tmp, sizeof(tmp))) {
+        if (sscanf(tmp, "%g", &exp_comp) != 1) {
+            D("Invalid value '%s' for parameter 'expcomp'", tmp);
+            exp_comp = 1.0f;
+        }
+    }
+
+    /* Verify that framebuffer sizes match the ones that the started camera
+     * operates with. */
+    if ((video_size != 0 && cc->video_frame_size != (size_t)video_size) ||
+        (preview_size != 0 && cc->preview_frame_size != (size_t)preview_size)) {
+        E("%s: Frame sizes don't match for camera '%s':\n"
+          "Expected %d for video, and %d for preview. Requested %d, and %d",
+          __FUNCTION__, cc->device_name, cc->video_frame_size,
+          cc->preview_frame_size, video_size, preview_size);
+        _qemu_client_reply_ko(qc, "Frame size mismatch");
+        return;
+    }
+
+    /* Restart streaming if other frames are requested. */
+    if (cc->stream != NULL &&
+        (cc->stream->video_size != (size_t)video_size ||
+         cc->stream->preview_size != (size_t)preview_size)) {
+        _camera_stream_stop(cc);
+    }
+    if (cc->stream == NULL &&
+        _camera_stream_start(cc, video_size, preview_size)) {
+        _qemu_client_reply_ko(qc, "Unable to start streaming");
+        return;
+    }
+
+    qemu_mutex_lock(&cc->stream->lock);
+    cc->stream->r_scale = r_scale;
+    cc->stream->g_scale = g_scale;
+    cc->stream->b_scale = b_scale;
+    cc->stream->exp_comp = exp_comp;
+    qemu_mutex_unlock(&cc->stream->lock);
+
+    _qemu_client_reply_ok(qc, NULL);
+}
+
+/* Client has queried to stop streaming frames.
+ * Param:
+ *  cc - Queried camera client descriptor.
+ *  qc - Qemu client for the emulated camera.
+ *  param - Query parameters. There are no parameters expected for this query.
+ */
+static void
+_camera_client_query_unstream(CameraClient* cc,
+                              QemudClient* qc,
+                              const char* param)
+{
+    if (cc->stream == NULL) {
+        W("%s: Camera '%s' is not streaming", __FUNCTION__, cc->device_name);
+        _qemu_client_reply_ok(qc, "Camera is not streaming");
+        return;
+    }
+
+    _camera_stream_stop(cc);
+    _qemu_client_reply_ok(qc, NULL);
+}
+
 /* Handles a message received from the emulated camera client.
  * Queries received here are represented as strings:
  * - 'connect' - Connects to the camera device (opens it).
@@ -1145,6 +1743,8 @@ _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
  * - 'start' - Starts capturing video from the connected camera device.
  * - 'stop' - Stop capturing video from the connected camera device.
  * - 'frame' - Queries video and preview frames captured from the camera.
+ * - 'stream' - Starts pushing frames to the stream channel of the camera.
+ * - 'unstream' - Stops pushing frames to the stream channel.
  * Param:
  *  opaque - Camera service descriptor.
  *  msg, msglen - Message received from the camera factory client.
@@ -1170,6 +1770,10 @@ _camera_client_recv(void*         opaque,
     static const char _query_stop[]       = "stop";
     /* Query frame(s). */
     static const char _query_frame[]      = "frame";
+    /* Start streaming frames. */
+    static const char _query_stream[]     = "stream";
+    /* Stop streaming frames. */
+    static const char _query_unstream[]   = "unstream";
 
     char query_name[64];
     const char* query_param = NULL;
@@ -1204,6 +1808,12 @@ _camera_client_recv(void*         opaque,
     } else if (!strcmp(query_name, _query_stop)) {
         /* Stop capturing is queried. */
         _camera_client_query_stop(cc, client, query_param);
+    } else if (!strcmp(query_name, _query_stream)) {
+        /* Start streaming is queried. */
+        _camera_client_query_stream(cc, client, query_param);
+    } else if (!strcmp(query_name, _query_unstream)) {
+        /* Stop streaming is queried. */
+        _camera_client_query_unstream(cc, client, query_param);
     } else {
         E("%s: Unknown query '%s'", __FUNCTION__, (char*)msg);
         _qemu_client_reply_ko(client, "Unknown query");
@@ -1226,6 +1836,46 @@ _camera_client_close(void* opaque)
  * Camera service API
  *******************************************************************************/
 
+/* Connects the stream channel of the camera client connected to the device
+ * named in |param|. Return the new channel, or NULL on failure. */
+static QemudClient*
+_camera_stream_connect(CameraServiceDesc* csd,
+                       QemudService* serv,
+                       int channel,
+                       const char* param)
+{
+    CameraStreamChannel* sc;
+    CameraClient* cc;
+    CameraInfo* ci;
+    char* device_name;
+
+    if (get_token_value_alloc(param, "name", &device_name)) {
+        E("%s: Required 'name' parameter is missing, or misformed in '%s'",
+          __FUNCTION__, param);
+        return NULL;
+    }
+    ci = _camera_service_get_camera_info_by_device_name(csd, device_name);
+    free(device_name);
+    cc = ci ? csd->clients[ci - csd->camera_info] : NULL;
+    if (cc == NULL || cc->stream_channel != NULL) {
+        E("%s: No camera client to stream to in '%s'", __FUNCTION__, param);
+        return NULL;
+    }
+
+    ANEW0(sc);
+    sc->cc = cc;
+    sc->client = qemud_client_new(serv, channel, param, sc,
+                                  _camera_stream_client_recv,
+                                  _camera_stream_client_close,
+                                  NULL, NULL);
+    if (sc->client == NULL) {
+        AFREE(sc);
+        return NULL;
+    }
+    cc->stream_channel = sc;
+    return sc->client;
+}
+
 /* Connects a client to the camera service.
  * There are two classes of the client that can connect to the service:
  *  - Camera factory that is insterested only in listing camera devices attached
@@ -1244,6 +1894,7 @@ _camera_service_connect(void*          opaque,
 {
     QemudClient*  client = NULL;
     CameraServiceDesc* csd = (CameraServiceDesc*)opaque;
+    int stream = 0;
 
     D("%s: Connecting camera client '%s'",
       __FUNCTION__, client_param ? client_param : "Factory");
@@ -1252,6 +1903,10 @@ _camera_service_connect(void*          opaque,
         client = qemud_client_new(serv, channel, client_param, csd,
                                   _factory_client_recv, _factory_client_close,
                                   NULL, NULL);
+    } else if (!get_token_value_int(client_param, "stream", &stream) &&
+               stream) {
+        /* This is the stream channel of an emulated camera client. */
+        client = _camera_stream_connect(csd, serv, channel, client_param);
     } else {
         /* This is an emulated camera client. */
         CameraClient* cc = _camera_client_create(csd, client_param);
@@ -1281,6 +1936,13 @@ android_camera_service_init(void)
                    __FUNCTION__, SERVICE_NAME);
             return;
         }
+        _camera_service = serv;
+#ifndef _WIN32
+        /* Frame queries read from the camera, and convert the frames, which
+         * takes milliseconds. On Windows, frames are captured through a
+         * window owned by the main thread. */
+        qemud_service_set_worker(serv);
+#endif
         D("%s: Registered '%s' qemud service", __FUNCTION__, SERVICE_NAME);
     }
 }
@@ -142,8 +142,8 @@ cbuffer_read( CBuffer*  cb, void*  to, int  len )
         len2 -= avail;
         cb->count -= avail;
         cb->rpos  += avail;
-        if (cb->rpos >= cb->size)
-            cb->rpos -= cb->size;
+        if (cb->rpos >= cb->size || cb->count == 0)
+            cb->rpos = 0;
     }
     return len - len2;
 }
@@ -177,6 +177,21 @@ cbuffer_read_step( CBuffer*  cb, int  len )
         cb->rpos -= cb->size;
 
     cb->count -= len;
+    if (cb->count == 0)
+        cb->rpos = 0;
+}
+
+void
+cbuffer_resize( CBuffer*  cb, void*  buff, int  size )
+{
+    int  count = cb->count;
+
+    CBUFFER_ASSERT(cb);
+    ASSERT(size >= count, "new size is too small: %d (count=%d)", size, count);
+
+    cbuffer_read( cb, buff, count );
+    cbuffer_reset( cb, buff, size );
+    cb->count = count;
 }
 
 const char*
@@ -10,6 +10,7 @@
 ** GNU General Public License for more details.
 */
 #include "sysemu/char.h"
+#include "qemu/timer.h"
 #include "android/cbuffer.h"
 #include "android/qemu-debug.h"
 
@@ -26,177 +27,263 @@
  * between two QEMU character drivers that merge well into the
  * QEMU event loop.
  *
- * each half of the channel has its own object and buffer, and
- * we implement communication through charpipe_poll() which
- * must be called by the main event loop after its call to select()
+ * each half of the channel has its own object and ring buffer. data
+ * that cannot be delivered immediately is queued in the ring, which
+ * grows as needed, and a bottom half delivers it once the writer is
+ * done, in the largest contiguous runs that the receiver accepts.
  *
+ * when the receiver is busy, delivery resumes as soon as it calls
+ * qemu_chr_accept_input() or registers new handlers, or after a retry
+ * delay for receivers that never signal that they are ready again.
  */
 
-#define  BIP_BUFFER_SIZE  512
+/* initial size of a ring, doubled each time it is full */
+#define  CHAR_RING_MIN_SIZE    512
 
-typedef struct BipBuffer {
-    struct BipBuffer*  next;
-    CBuffer            cb[1];
-    char               buff[ BIP_BUFFER_SIZE ];
-} BipBuffer;
+/* rings that grew bigger than this are freed once drained */
+#define  CHAR_RING_KEEP_SIZE   8192
 
-static BipBuffer*  _free_bip_buffers;
+/* delays before trying to deliver data to a busy receiver again */
+#define  CHAR_RING_RETRY_MIN_MS  1
+#define  CHAR_RING_RETRY_MAX_MS  64
 
-static BipBuffer*
-bip_buffer_alloc( void )
+/* send 'len' bytes to the receiver of a ring. returns the number of bytes
+ * accepted, 0 if the receiver is busy, or -1 if there is no receiver. */
+typedef int  (*CharRingSendFunc)( void*  opaque, uint8_t*  data, int  len );
+
+typedef struct CharRing {
+    CBuffer           cb[1];
+    QEMUBH*           bh;
+    QEMUTimer*        retry_timer;
+    int               retry_ms;
+    CharRingSendFunc  send;
+    void*             opaque;
+    uint8_t*          stale;     /* storage the receiver may still read */
+    char              flushing;
+} CharRing;
+
+static void  char_ring_flush( void*  opaque );
+
+static void
+char_ring_init( CharRing*  ring, CharRingSendFunc  send, void*  opaque )
 {
-    BipBuffer*  bip = _free_bip_buffers;
-    if (bip != NULL) {
-        _free_bip_buffers = bip->next;
-    } else {
-        bip = malloc( sizeof(*bip) );
-        if (bip == NULL) {
-            derror( "%s: not enough memory", __FUNCTION__ );
-            exit(1);
-        }
-    }
-    bip->next = NULL;
-    cbuffer_reset( bip->cb, bip->buff, sizeof(bip->buff) );
-    return bip;
+    cbuffer_reset( ring->cb, NULL, 0 );
+    ring->retry_ms = CHAR_RING_RETRY_MIN_MS;
+    ring->send     = send;
+    ring->opaque   = opaque;
+    ring->stale    = NULL;
+    ring->flushing = 0;
+    if (ring->bh == NULL)
+        ring->bh = qemu_bh_new( char_ring_flush, ring );
 }
 
+/* free storage that is no longer used by the ring. when a flush is in
+ * progress, the receiver may be parsing it in place, so keep it until
+ * the flush returns. */
 static void
-bip_buffer_free( BipBuffer*  bip )
+char_ring_release( CharRing*  ring, uint8_t*  buff )
 {
-    bip->next         = _free_bip_buffers;
-    _free_bip_buffers = bip;
+    if (ring->flushing && ring->stale == NULL)
+        ring->stale = buff;
+    else
+        g_free(buff);
 }
 
-/* this models each half of the charpipe */
-typedef struct CharPipeHalf {
-    CharDriverState       cs[1];
-    BipBuffer*            bip_first;
-    BipBuffer*            bip_last;
-    struct CharPipeHalf*  peer;         /* NULL if closed */
-} CharPipeHalf;
+static void
+char_ring_done( CharRing*  ring )
+{
+    qemu_bh_cancel(ring->bh);
+    if (ring->retry_timer != NULL)
+        timer_del(ring->retry_timer);
 
+    char_ring_release( ring, ring->cb->buff );
+    cbuffer_reset( ring->cb, NULL, 0 );
+}
+
+static __inline__ int
+char_ring_is_empty( CharRing*  ring )
+{
+    return cbuffer_read_avail(ring->cb) == 0;
+}
 
+/* schedule the delivery of the ring's content */
+static __inline__ void
+char_ring_kick( CharRing*  ring )
+{
+    if (!char_ring_is_empty(ring))
+        qemu_bh_schedule(ring->bh);
+}
 
+/* queue data in the ring, growing it as needed */
 static void
-charpipehalf_close( CharDriverState*  cs )
+char_ring_write( CharRing*  ring, const uint8_t*  buf, int  len )
 {
-    CharPipeHalf*  ph = cs->opaque;
+    CBuffer*  cb = ring->cb;
 
-    while (ph->bip_first) {
-        BipBuffer*  bip = ph->bip_first;
-        ph->bip_first = bip->next;
-        bip_buffer_free(bip);
+    if (cbuffer_write_avail(cb) < len) {
+        uint8_t*  old  = cb->buff;
+        int       size = cb->size ? cb->size : CHAR_RING_MIN_SIZE;
+
+        while (size - cbuffer_read_avail(cb) < len)
+            size *= 2;
+
+        cbuffer_resize( cb, g_malloc(size), size );
+        char_ring_release( ring, old );
     }
-    ph->bip_last    = NULL;
-    ph->peer        = NULL;
+    cbuffer_write( cb, buf, len );
+    qemu_bh_schedule(ring->bh);
 }
 
+static void
+char_ring_retry( CharRing*  ring )
+{
+    if (ring->retry_timer == NULL)
+        ring->retry_timer = timer_new_ms( QEMU_CLOCK_REALTIME,
+                                          char_ring_flush, ring );
 
-static int
-charpipehalf_write( CharDriverState*  cs, const uint8_t*  buf, int  len )
+    timer_mod( ring->retry_timer,
+               qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + ring->retry_ms );
+
+    /* back off for receivers that stay busy */
+    ring->retry_ms *= 2;
+    if (ring->retry_ms > CHAR_RING_RETRY_MAX_MS)
+        ring->retry_ms = CHAR_RING_RETRY_MAX_MS;
+}
+
+/* deliver as much of the ring's content as the receiver accepts */
+static void
+char_ring_flush( void*  opaque )
 {
-    CharPipeHalf*  ph   = cs->opaque;
-    CharPipeHalf*  peer = ph->peer;
-    BipBuffer*     bip  = ph->bip_last;
-    int            ret  = 0;
+    CharRing*  ring = opaque;
 
-    D("%s: writing %d bytes to %p: '%s'", __FUNCTION__,
-      len, ph, quote_bytes( buf, len ));
+    /* the receiver may flush the ring again from its handlers */
+    if (ring->flushing)
+        return;
 
-    if (bip == NULL && peer != NULL && peer->cs->chr_read != NULL) {
-        /* no buffered data, try to write directly to the peer */
-        while (len > 0) {
-            int  size;
+    ring->flushing = 1;
+    while (1) {
+        uint8_t*  base;
+        int       avail = cbuffer_read_peek( ring->cb, &base );
+        int       size;
 
-            if (peer->cs->chr_can_read) {
-                size = qemu_chr_can_read( peer->cs );
-                if (size == 0)
-                    break;
+        if (avail == 0)
+            break;
 
-                if (size > len)
-                    size = len;
-            } else
-                size = len;
+        D("%s: sending %d bytes from %p: '%s'", __FUNCTION__,
+          avail, ring, quote_bytes( base, avail ));
 
-            qemu_chr_read( peer->cs, (uint8_t*)buf, size );
-            buf += size;
-            len -= size;
-            ret += size;
+        size = ring->send( ring->opaque, base, avail );
+        if (size <= 0) {
+            if (size == 0)
+                char_ring_retry(ring);
+            break;
         }
+        if (size > avail)  /* just to be safe */
+            size = avail;
+
+        cbuffer_read_step( ring->cb, size );
+        ring->retry_ms = CHAR_RING_RETRY_MIN_MS;
     }
+    ring->flushing = 0;
 
-    if (len == 0)
-        return ret;
+    g_free(ring->stale);
+    ring->stale = NULL;
 
-    /* buffer the remaining data */
-    if (bip == NULL) {
-        bip = bip_buffer_alloc();
-        ph->bip_first = ph->bip_last = bip;
+    /* don't keep the memory of a burst around */
+    if (char_ring_is_empty(ring) && ring->cb->size > CHAR_RING_KEEP_SIZE) {
+        g_free(ring->cb->buff);
+        cbuffer_reset( ring->cb, NULL, 0 );
     }
+}
 
-    while (len > 0) {
-        int  len2 = cbuffer_write( bip->cb, buf, len );
+/* this models each half of the charpipe */
+typedef struct CharPipeHalf {
+    CharDriverState       cs[1];
+    CharRing              ring[1];
+    struct CharPipeHalf*  peer;         /* NULL if closed */
+} CharPipeHalf;
 
-        buf += len2;
-        ret += len2;
-        len -= len2;
-        if (len == 0)
-            break;
 
-        /* ok, we need another buffer */
-        ph->bip_last = bip_buffer_alloc();
-        bip->next = ph->bip_last;
-        bip       = ph->bip_last;
-    }
-    return  ret;
+
+static void
+charpipehalf_close( CharDriverState*  cs )
+{
+    CharPipeHalf*  ph = cs->opaque;
+
+    char_ring_done(ph->ring);
+    ph->peer        = NULL;
 }
 
 
-static void
-charpipehalf_poll( CharPipeHalf*  ph )
+/* send data to the peer's receiver, in chunks that it can accept */
+static int
+charpipehalf_send( void*  opaque, uint8_t*  buf, int  len )
 {
-    CharPipeHalf*   peer = ph->peer;
-    int             size;
+    CharPipeHalf*  ph   = opaque;
+    CharPipeHalf*  peer = ph->peer;
+    int            ret  = 0;
 
     if (peer == NULL || peer->cs->chr_read == NULL)
-        return;
+        return -1;
 
-    while (1) {
-        BipBuffer*  bip = ph->bip_first;
-        uint8_t*    base;
-        int         avail;
+    while (len > 0) {
+        int  size = len;
 
-        if (bip == NULL)
+        /* the receiver may close the pipe from its handler */
+        if (ph->peer == NULL || peer->cs->chr_read == NULL)
             break;
 
-        size = cbuffer_read_avail(bip->cb);
-        if (size == 0) {
-            ph->bip_first = bip->next;
-            if (ph->bip_first == NULL)
-                ph->bip_last = NULL;
-            bip_buffer_free(bip);
-            continue;
+        if (peer->cs->chr_can_read) {
+            size = qemu_chr_can_read( peer->cs );
+            if (size == 0)
+                break;
+
+            if (size > len)
+                size = len;
         }
 
-        if (ph->cs->chr_can_read) {
-            int  size2 = qemu_chr_can_read(peer->cs);
+        qemu_chr_read( peer->cs, buf, size );
+        buf += size;
+        len -= size;
+        ret += size;
+    }
+    return ret;
+}
 
-            if (size2 == 0)
-                break;
 
-            if (size > size2)
-                size = size2;
-        }
+static int
+charpipehalf_write( CharDriverState*  cs, const uint8_t*  buf, int  len )
+{
+    CharPipeHalf*  ph   = cs->opaque;
+    int            ret  = 0;
 
-        avail = cbuffer_read_peek( bip->cb, &base );
-        if (avail > size)
-            avail = size;
-        D("%s: sending %d bytes from %p: '%s'", __FUNCTION__,
-            avail, ph, quote_bytes( base, avail ));
+    D("%s: writing %d bytes to %p: '%s'", __FUNCTION__,
+      len, ph, quote_bytes( buf, len ));
 
-        qemu_chr_read( peer->cs, base, avail );
-        cbuffer_read_step( bip->cb, avail );
+    if (char_ring_is_empty(ph->ring)) {
+        /* no buffered data, try to write directly to the peer */
+        ret = charpipehalf_send( ph, (uint8_t*)buf, len );
+        if (ret < 0)
+            ret = 0;
     }
+
+    /* buffer the remaining data */
+    if (ret < len)
+        char_ring_write( ph->ring, buf + ret, len - ret );
+
+    return  len;
+}
+
+
+/* called when the receiver of this half is ready to read again, which
+ * means that the data buffered by the peer can be delivered. */
+static void
+charpipehalf_accept_input( CharDriverState*  cs )
+{
+    CharPipeHalf*  ph = cs->opaque;
+
+    if (ph->peer != NULL)
+        char_ring_kick(ph->peer->ring);
 }
 
 
@@ -205,15 +292,16 @@ charpipehalf_init( CharPipeHalf*  ph, CharPipeHalf*  peer )
 {
     CharDriverState*  cs = ph->cs;
 
-    ph->bip_first   = NULL;
-    ph->bip_last    = NULL;
+    char_ring_init( ph->ring, charpipehalf_send, ph );
     ph->peer        = peer;
 
-    cs->chr_write            = charpipehalf_write;
-    cs->chr_ioctl            = NULL;
-    cs->chr_send_event       = NULL;
-    cs->chr_close            = charpipehalf_close;
-    cs->opaque               = ph;
+    cs->chr_write               = charpipehalf_write;
+    cs->chr_ioctl               = NULL;
+    cs->chr_send_event          = NULL;
+    cs->chr_close               = charpipehalf_close;
+    cs->chr_accept_input        = charpipehalf_accept_input;
+    cs->chr_update_read_handler = charpipehalf_accept_input;
+    cs->opaque                  = ph;
 }
 
 
@@ -264,8 +352,7 @@ qemu_chr_open_charpipe( CharDriverState*  *pfirst, CharDriverState*  *psecond )
 
 typedef struct CharBuffer {
     CharDriverState  cs[1];
-    BipBuffer*       bip_first;
-    BipBuffer*       bip_last;
+    CharRing         ring[1];
     CharDriverState* endpoint;  /* NULL if closed */
     char             closing;
 } CharBuffer;
@@ -276,12 +363,7 @@ charbuffer_close( CharDriverState*  cs )
 {
     CharBuffer*  cbuf = cs->opaque;
 
-    while (cbuf->bip_first) {
-        BipBuffer*  bip = cbuf->bip_first;
-        cbuf->bip_first = bip->next;
-        bip_buffer_free(bip);
-    }
-    cbuf->bip_last = NULL;
+    char_ring_done(cbuf->ring);
     cbuf->endpoint = NULL;
 
     if (cbuf->endpoint != NULL) {
@@ -291,95 +373,44 @@ charbuffer_close( CharDriverState*  cs )
 }
 
 static int
-charbuffer_write( CharDriverState*  cs, const uint8_t*  buf, int  len )
+charbuffer_send( void*  opaque, uint8_t*  buf, int  len )
 {
-    CharBuffer*       cbuf = cs->opaque;
-    CharDriverState*  peer = cbuf->endpoint;
-    BipBuffer*        bip  = cbuf->bip_last;
-    int               ret  = 0;
+    CharBuffer*  cbuf = opaque;
+    int          size;
 
-    D("%s: writing %d bytes to %p: '%s'", __FUNCTION__,
-      len, cbuf, quote_bytes( buf, len ));
-
-    if (bip == NULL && peer != NULL) {
-        /* no buffered data, try to write directly to the peer */
-        int  size = qemu_chr_write(peer, buf, len);
-
-        if (size < 0)  /* just to be safe */
-            size = 0;
-        else if (size > len)
-            size = len;
-
-        buf += size;
-        ret += size;
-        len -= size;
-    }
-
-    if (len == 0)
-        return ret;
-
-    /* buffer the remaining data */
-    if (bip == NULL) {
-        bip = bip_buffer_alloc();
-        cbuf->bip_first = cbuf->bip_last = bip;
-    }
-
-    while (len > 0) {
-        int  len2 = cbuffer_write( bip->cb, buf, len );
+    if (cbuf->endpoint == NULL)
+        return -1;
 
-        buf += len2;
-        ret += len2;
-        len -= len2;
-        if (len == 0)
-            break;
+    size = qemu_chr_write( cbuf->endpoint, buf, len );
+    if (size < 0)  /* just to be safe */
+        size = 0;
 
-        /* ok, we need another buffer */
-        cbuf->bip_last = bip_buffer_alloc();
-        bip->next = cbuf->bip_last;
-        bip       = cbuf->bip_last;
-    }
-    return  ret;
+    return size;
 }
 
-
-static void
-charbuffer_poll( CharBuffer*  cbuf )
+static int
+charbuffer_write( CharDriverState*  cs, const uint8_t*  buf, int  len )
 {
-    CharDriverState*  peer = cbuf->endpoint;
-
-    if (peer == NULL)
-        return;
-
-    while (1) {
-        BipBuffer*  bip = cbuf->bip_first;
-        uint8_t*    base;
-        int         avail;
-        int         size;
-
-        if (bip == NULL)
-            break;
-
-        avail = cbuffer_read_peek( bip->cb, &base );
-        if (avail == 0) {
-            cbuf->bip_first = bip->next;
-            if (cbuf->bip_first == NULL)
-                cbuf->bip_last = NULL;
-            bip_buffer_free(bip);
-            continue;
-        }
+    CharBuffer*  cbuf = cs->opaque;
+    int          ret  = 0;
 
-        size = qemu_chr_write( peer, base, avail );
+    D("%s: writing %d bytes to %p: '%s'", __FUNCTION__,
+      len, cbuf, quote_bytes( buf, len ));
 
-        if (size < 0)  /* just to be safe */
-            size = 0;
-        else if (size > avail)
-            size = avail;
+    if (char_ring_is_empty(cbuf->ring)) {
+        /* no buffered data, try to write directly to the peer */
+        ret = charbuffer_send( cbuf, (uint8_t*)buf, len );
+        if (ret < 0)
+            ret = 0;
+        else if (ret > len)
+            ret = len;
+    }
 
-        cbuffer_read_step( bip->cb, size );
+    /* buffer the remaining data */
+    if (ret < len)
+        char_ring_write( cbuf->ring, buf + ret, len - ret );
 
-        if (size < avail)
-            break;
-    }
+    return  len;
 }
 
 
@@ -396,13 +427,22 @@ charbuffer_update_handlers( CharDriverState*  cs )
 }
 
 
+static void
+charbuffer_accept_input( CharDriverState*  cs )
+{
+    CharBuffer*  cbuf = cs->opaque;
+
+    if (cbuf->endpoint != NULL)
+        qemu_chr_accept_input(cbuf->endpoint);
+}
+
+
 static void
 charbuffer_init( CharBuffer*  cbuf, CharDriverState*  endpoint )
 {
     CharDriverState*  cs = cbuf->cs;
 
-    cbuf->bip_first   = NULL;
-    cbuf->bip_last    = NULL;
+    char_ring_init( cbuf->ring, charbuffer_send, cbuf );
     cbuf->endpoint    = endpoint;
 
     cs->chr_write               = charbuffer_write;
@@ -410,6 +450,7 @@ charbuffer_init( CharBuffer*  cbuf, CharDriverState*  endpoint )
     cs->chr_send_event          = NULL;
     cs->chr_close               = charbuffer_close;
     cs->chr_update_read_handler = charbuffer_update_handlers;
+    cs->chr_accept_input        = charbuffer_accept_input;
     cs->opaque                  = cbuf;
 }
 
@@ -437,33 +478,3 @@ qemu_chr_open_buffer( CharDriverState*  endpoint )
     charbuffer_init(cbuf, endpoint);
     return cbuf->cs;
 }
-
-
-void
-charpipe_poll( void )
-{
-    CharPipeState*  cp     = _s_charpipes;
-    CharPipeState*  cp_end = cp + MAX_CHAR_PIPES;
-
-    CharBuffer*     cb     = _s_charbuffers;
-    CharBuffer*     cb_end = cb + MAX_CHAR_BUFFERS;
-
-    /* poll the charpipes */
-    for ( ; cp < cp_end; cp++ ) {
-        CharPipeHalf*  half;
-
-        half = cp->a;
-        if (half->peer != NULL)
-            charpipehalf_poll(half);
-
-        half = cp->b;
-        if (half->peer != NULL)
-            charpipehalf_poll(half);
-    }
-
-    /* poll the charbuffers */
-    for ( ; cb < cb_end; cb++ ) {
-        if (cb->endpoint != NULL)
-            charbuffer_poll(cb);
-    }
-}
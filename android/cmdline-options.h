@@ -82,11 +82,16 @@ OPT_FLAG ( no_snapstorage, "do not mount a snapshot storage file (this disables
 OPT_PARAM( snapshot,       "<name>", "name of snapshot within storage file for auto-start and auto-save (default 'default-boot')" )
 OPT_FLAG ( no_snapshot,    "perform a full boot and do not do not auto-save, but qemu vmload and vmsave operate on snapstorage" )
 OPT_FLAG ( no_snapshot_save, "do not auto-save to snapshot on exit: abandon changed state" )
+OPT_FLAG ( fast_exit,      "hide the window as soon as the emulator is closed, and skip the teardown" )
 OPT_FLAG ( no_snapshot_load, "do not auto-start from snapshot: perform a full boot" )
 OPT_FLAG ( snapshot_list,  "show a list of available snapshots" )
 OPT_FLAG ( no_snapshot_update_time, "do not do try to correct snapshot time on restore" )
+OPT_FLAG ( snapshot_lazy_ram, "restore snapshot RAM pages on first access instead of at startup" )
+OPT_FLAG ( snapshot_shared_ram, "share snapshot RAM pages with other emulators restoring the same snapshot" )
+OPT_PARAM( qcow2_cache_size, "<size>", "metadata cache size of each qcow2 image in MBs" )
 OPT_FLAG ( wipe_data, "reset the user data image (copy it from initdata)" )
 CFG_PARAM( avd, "<name>", "use a specific android virtual device" )
+OPT_PARAM( clone_avd, "<name>", "create AVD <name> as a clone of the -avd one, then exit" )
 CFG_PARAM( skindir, "<dir>", "search skins in <dir> (default <system>/skins)" )
 CFG_PARAM( skin, "<name>", "select a given skin" )
 CFG_FLAG ( no_skin, "don't use any emulator skin" )
@@ -129,6 +134,15 @@ OPT_PARAM( http_proxy, "<proxy>", "make TCP connections through a HTTP/HTTPS pro
 OPT_PARAM( timezone, "<timezone>", "use this timezone instead of the host's default" )
 OPT_PARAM( dns_server, "<servers>", "use this DNS server(s) in the emulated system" )
 OPT_PARAM( cpu_delay, "<cpudelay>", "throttle CPU emulation" )
+OPT_PARAM( timer_slack, "<usecs>", "let emulator timers fire late to save host wakeups" )
+OPT_PARAM( stats_port, "<port>", "serve performance metrics to Prometheus on TCP <port>" )
+OPT_PARAM( qos, "<limits>", "limit the host CPU, disk I/O and render priority of the instance" )
+OPT_FLAG ( startup_profile, "print how long each startup phase takes" )
+OPT_PARAM( sample_profile, "<hz>", "sample the guest processes <hz> times per second" )
+OPT_FLAG ( iothread, "run the emulated CPU and the I/O processing in separate threads" )
+OPT_FLAG ( mem_hugepages, "back the emulated RAM with huge host pages when possible" )
+OPT_FLAG ( mem_prefault, "populate the emulated RAM with host pages in the background at startup" )
+OPT_FLAG ( mem_lock, "lock the emulated RAM in host memory, implies -mem-prefault" )
 OPT_FLAG ( no_boot_anim, "disable animation for faster boot" )
 
 OPT_FLAG( no_window, "disable graphical window display" )
@@ -153,6 +167,7 @@ OPT_PARAM( nand_limits, "<nlimits>", "enforce NAND/Flash read/write thresholds"
 #endif
 
 OPT_PARAM( gpu, "<mode>", "set hardware OpenGLES emulation mode" )
+OPT_PARAM( vsync_offset, "<ms>", "raise the guest vsync <ms> milliseconds before the host one" )
 
 OPT_PARAM( camera_back, "<mode>", "set emulation mode for a camera facing back" )
 OPT_PARAM( camera_front, "<mode>", "set emulation mode for a camera facing front" )
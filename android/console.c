@@ -24,9 +24,11 @@
 #include "android/sockets.h"
 #include "sysemu/char.h"
 #include "sysemu/sysemu.h"
+#include "sysemu/cpus.h"
 #include "android/android.h"
 #include "cpu.h"
 #include "hw/android/goldfish/device.h"
+#include "hw/android/goldfish/pipe.h"
 #include "hw/power_supply.h"
 #include "android/shaper.h"
 #include "modem_driver.h"
@@ -36,10 +38,16 @@
 #include "android/utils/debug.h"
 #include "android/utils/eintr_wrapper.h"
 #include "android/utils/http_utils.h"
+#include "android/utils/metrics.h"
 #include "android/utils/stralloc.h"
+#include "android/utils/trace.h"
 #include "android/utils/utf8_utils.h"
 #include "android/config/config.h"
 #include "android/tcpdump.h"
+#include "audio/audio.h"
+#include "block/block.h"
+#include "exec/code-profile.h"
+#include "hw/android/goldfish/profile.h"
 #include "net/net.h"
 #include "monitor/monitor.h"
 
@@ -51,11 +59,15 @@
 #include <fcntl.h>
 #include "android/hw-events.h"
 #include "android/user-events.h"
+#include "android/hw-balloon.h"
+#include "android/qos.h"
 #include "android/hw-fingerprint.h"
+#include "android/hw-kmsg.h"
 #include "android/hw-sensors.h"
 #include "android/skin/charmap.h"
 #include "android/skin/keycode-buffer.h"
 #include "android/display-core.h"
+#include "android/gpu_frame.h"
 
 #if defined(CONFIG_SLIRP)
 #include "libslirp.h"
@@ -99,6 +111,13 @@ typedef struct ControlClientRec_
     char                       finished;
     char                       buff[ 4096 ];
     int                        buff_len;
+    LogBrokerReader*           kmsg_reader; /* when tailing kernel messages */
+
+    char                       binary;     /* 1 after the 'binary' command */
+    char                       in_request; /* 1 while running a binary request */
+    stralloc_t                 bin_in[1];  /* incomplete binary requests */
+    stralloc_t                 bin_out[1]; /* binary responses not sent yet */
+    stralloc_t                 reply[1];   /* output of the current request */
 
 } ControlClientRec;
 
@@ -244,10 +263,19 @@ control_client_destroy( ControlClient  client )
     }
 #endif  // CONFIG_STANDALONE_CORE
 
+    if (client->kmsg_reader) {
+        logBroker_removeReader( android_kmsg_get_broker(), client->kmsg_reader );
+        client->kmsg_reader = NULL;
+    }
+
     sock = control_client_detach( client );
     if (sock >= 0)
         socket_close(sock);
 
+    stralloc_reset( client->bin_in );
+    stralloc_reset( client->bin_out );
+    stralloc_reset( client->reply );
+
     for ( ;; ) {
         ControlClient  node = *pnode;
         if ( node == NULL )
@@ -265,12 +293,57 @@ control_client_destroy( ControlClient  client )
 
 
 
-static void  control_control_write( ControlClient  client, const char*  buff, int  len )
+/* Binary protocol, see the description of the 'binary' command.
+ *
+ * All integers are little-endian. Each request is a header made of the
+ * payload size, a request ID chosen by the client and an operation, then
+ * the payload. Each response has the same header, with the request ID and
+ * a status instead of the operation, followed by the text output of the
+ * request. Output that isn't the result of a request is sent with
+ * request ID 0.
+ */
+#define  CONSOLE_BINARY_VERSION     1
+#define  CONSOLE_BINARY_HEADER      12
+#define  CONSOLE_BINARY_MAX_FRAME   65536
+
+#define  CONSOLE_BINARY_OP_COMMAND  1   /* a text command, without newline */
+#define  CONSOLE_BINARY_OP_EVENTS   2   /* events, see control_binary_events */
+#define  CONSOLE_BINARY_OP_REPLAY   3   /* timed events, see control_binary_replay */
+
+#define  CONSOLE_BINARY_STATUS_OK   0
+#define  CONSOLE_BINARY_STATUS_KO   1
+
+static uint32_t
+control_get_le32( const uint8_t*  p )
 {
-    int ret;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
 
-    if (len < 0)
-        len = strlen(buff);
+static void
+control_put_le32( uint8_t*  p, uint32_t  value )
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static void
+control_add_frame( stralloc_t*  out, uint32_t  id, uint32_t  status,
+                   const void*  data, unsigned  len )
+{
+    uint8_t  header[CONSOLE_BINARY_HEADER];
+
+    control_put_le32( header, len );
+    control_put_le32( header + 4, id );
+    control_put_le32( header + 8, status );
+    stralloc_add_bytes( out, header, sizeof(header) );
+    stralloc_add_bytes( out, data, len );
+}
+
+static void  control_client_send( ControlClient  client, const char*  buff, int  len )
+{
+    int ret;
 
     while (len > 0) {
         ret = HANDLE_EINTR(socket_send( client->sock, buff, len));
@@ -284,6 +357,24 @@ static void  control_control_write( ControlClient  client, const char*  buff, in
     }
 }
 
+static void  control_control_write( ControlClient  client, const char*  buff, int  len )
+{
+    if (len < 0)
+        len = strlen(buff);
+
+    if (!client->binary) {
+        control_client_send( client, buff, len );
+    } else if (client->in_request) {
+        stralloc_add_bytes( client->reply, buff, len );
+    } else {
+        STRALLOC_DEFINE(frame);
+
+        control_add_frame( frame, 0, CONSOLE_BINARY_STATUS_OK, buff, len );
+        control_client_send( client, frame->s, frame->n );
+        stralloc_reset( frame );
+    }
+}
+
 static int  control_vwrite( ControlClient  client, const char*  format, va_list args )
 {
     static char  temp[1024];
@@ -408,7 +499,8 @@ dump_help( ControlClient  client,
 
 static int do_quit(ControlClient client, char* args);  // forward
 
-static void
+/* Run the command in client->buff. Returns 0 on success, -1 otherwise. */
+static int
 control_client_do_command( ControlClient  client )
 {
     char*       line     = client->buff;
@@ -428,31 +520,33 @@ control_client_do_command( ControlClient  client )
         } else {
             control_write( client, "KO: unknown command, try 'help'\r\n" );
         }
-        return;
+        return -1;
     }
 
     for (;;) {
         CommandDef  subcmd;
 
         if (cmd->handler) {
-            if ( !cmd->handler( client, args ) ) {
+            if ( cmd->handler( client, args ) < 0 )
+                return -1;
+            /* binary responses carry the status instead */
+            if (!client->binary)
                 control_write( client, "OK\r\n" );
-            }
-            break;
+            return 0;
         }
 
         /* no handler means we should have sub-commands */
         if (cmd->subcommands == NULL) {
             control_write( client, "KO: internal error: buggy command table for '%.*s'\r\n",
                            cmdend - client->buff, client->buff );
-            break;
+            return -1;
         }
 
         /* we need a sub-command here */
         if ( !args ) {
             dump_help( client, cmd, "" );
             control_write( client, "KO: missing sub-command\r\n" );
-            break;
+            return -1;
         }
 
         line     = args;
@@ -461,7 +555,7 @@ control_client_do_command( ControlClient  client )
         if (subcmd == NULL) {
             dump_help( client, cmd, "" );
             control_write( client, "KO:  bad sub-command\r\n" );
-            break;
+            return -1;
         }
         cmd = subcmd;
     }
@@ -536,6 +630,137 @@ control_client_read_byte( ControlClient  client, unsigned char  ch )
     }
 }
 
+/* Inject a batch of events, each made of a 16-bit type, a 16-bit code
+ * and a 32-bit signed value. */
+static int
+control_binary_events( ControlClient  client, const uint8_t*  data, unsigned  len )
+{
+    if (len % 8) {
+        control_write( client, "KO: truncated event\r\n" );
+        return -1;
+    }
+    for ( ; len > 0; data += 8, len -= 8 ) {
+        user_event_generic( data[0] | (data[1] << 8),
+                            data[2] | (data[3] << 8),
+                            (int32_t)control_get_le32( data + 4 ) );
+    }
+    return 0;
+}
+
+/* Replay a batch of events, each made of a 32-bit time in microseconds,
+ * then of an event as for control_binary_events. */
+static int
+control_binary_replay( ControlClient  client, const uint8_t*  data, unsigned  len )
+{
+    UserTimedEvent*  events;
+    unsigned         count = len / 12, nn;
+    int              ret;
+
+    if (len % 12) {
+        control_write( client, "KO: truncated event\r\n" );
+        return -1;
+    }
+    events = malloc( (count + 1) * sizeof(*events) );
+    if (events == NULL) {
+        control_write( client, "KO: out of memory\r\n" );
+        return -1;
+    }
+    for (nn = 0; nn < count; nn++, data += 12) {
+        events[nn].time_us = control_get_le32( data );
+        events[nn].type    = data[4] | (data[5] << 8);
+        events[nn].code    = data[6] | (data[7] << 8);
+        events[nn].value   = (int32_t)control_get_le32( data + 8 );
+    }
+    ret = user_event_replay( events, count );
+    free( events );
+    if (ret < 0) {
+        control_write( client, "KO: event times must not decrease, and at most 65536 events can be pending\r\n" );
+        return -1;
+    }
+    return 0;
+}
+
+static void
+control_client_do_binary( ControlClient  client, uint32_t  id, uint32_t  op,
+                          const uint8_t*  data, unsigned  len )
+{
+    int  ret = -1;
+
+    client->in_request = 1;
+    client->reply->n   = 0;
+
+    switch (op) {
+    case CONSOLE_BINARY_OP_COMMAND:
+        if (len >= sizeof(client->buff)) {
+            control_write( client, "KO: command too long\r\n" );
+            break;
+        }
+        memcpy( client->buff, data, len );
+        client->buff[len] = 0;
+        ret = control_client_do_command( client );
+        break;
+
+    case CONSOLE_BINARY_OP_EVENTS:
+        ret = control_binary_events( client, data, len );
+        break;
+
+    case CONSOLE_BINARY_OP_REPLAY:
+        ret = control_binary_replay( client, data, len );
+        break;
+
+    default:
+        control_write( client, "KO: unknown operation %u\r\n", op );
+    }
+
+    client->in_request = 0;
+    control_add_frame( client->bin_out, id,
+                       ret < 0 ? CONSOLE_BINARY_STATUS_KO : CONSOLE_BINARY_STATUS_OK,
+                       client->reply->s, client->reply->n );
+}
+
+/* Run all the complete requests received so far, then send all their
+ * responses at once, so that pipelined requests don't wait for each
+ * other's round trip. */
+static void
+control_client_read_binary( ControlClient  client, const uint8_t*  data, int  len )
+{
+    stralloc_t*  in  = client->bin_in;
+    unsigned     pos = 0;
+
+    stralloc_add_bytes( in, data, len );
+
+    while (in->n - pos >= CONSOLE_BINARY_HEADER) {
+        const uint8_t*  p    = (const uint8_t*)in->s + pos;
+        uint32_t        size = control_get_le32( p );
+
+        if (size > CONSOLE_BINARY_MAX_FRAME) {
+            static const char  msg[] = "KO: request too large. Aborting\r\n";
+
+            control_add_frame( client->bin_out, control_get_le32( p + 4 ),
+                               CONSOLE_BINARY_STATUS_KO, msg, sizeof(msg) - 1 );
+            client->finished = 1;
+            break;
+        }
+        if (in->n - pos < CONSOLE_BINARY_HEADER + size)
+            break;
+
+        control_client_do_binary( client, control_get_le32( p + 4 ),
+                                  control_get_le32( p + 8 ),
+                                  p + CONSOLE_BINARY_HEADER, size );
+        pos += CONSOLE_BINARY_HEADER + size;
+        if (client->finished)
+            break;
+    }
+
+    if (pos > 0) {
+        memmove( in->s, in->s + pos, in->n - pos );
+        in->n -= pos;
+    }
+
+    control_client_send( client, client->bin_out->s, client->bin_out->n );
+    client->bin_out->n = 0;
+}
+
 static void
 control_client_read( void*  _client )
 {
@@ -578,13 +803,19 @@ control_client_read( void*  _client )
 #else
         D(( "received %.*s\n", size, buf ));
 #endif
-        for (nn = 0; nn < size; nn++) {
+        for (nn = 0; nn < size && !client->binary; nn++) {
             control_client_read_byte( client, buf[nn] );
             if (client->finished) {
                 control_client_destroy(client);
                 return;
             }
         }
+        /* the rest follows the binary protocol, if it was just enabled */
+        if (client->binary) {
+            control_client_read_binary( client, buf + nn, size - nn );
+            if (client->finished)
+                control_client_destroy(client);
+        }
     }
 }
 
@@ -669,6 +900,28 @@ do_quit( ControlClient  client, char*  args )
     return -1;
 }
 
+static int
+do_binary( ControlClient  client, char*  args )
+{
+    char*  end;
+    long   version = args ? strtol(args, &end, 10) : 0;
+
+    if (!args || *end || version != CONSOLE_BINARY_VERSION) {
+        control_write( client, "KO: unsupported protocol version, use 'binary %d'\r\n",
+                       CONSOLE_BINARY_VERSION );
+        return -1;
+    }
+    /* kernel messages are written as they come, outside of any frame */
+    if (client->kmsg_reader) {
+        control_write( client, "KO: stop 'kmsg tail' first\r\n" );
+        return -1;
+    }
+    /* this is the last text reply, everything after it is binary */
+    control_write( client, "OK\r\n" );
+    client->binary = 1;
+    return 0;
+}
+
 /********************************************************************************************/
 /********************************************************************************************/
 /*****                                                                                 ******/
@@ -819,6 +1072,139 @@ static const CommandDefRec  network_commands[] =
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                        K E R N E L   M E S S A G E S                            ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+/* send kernel messages to a console client, without ever blocking: if the
+ * socket is full, the messages are kept until the next ones arrive, and
+ * dropped if the client falls too far behind */
+static int
+control_client_kmsg_write( void*  opaque, const uint8_t*  data, int  len )
+{
+    ControlClient  client = opaque;
+    int            ret;
+
+    if (client->sock < 0)
+        return 0;
+
+    ret = HANDLE_EINTR(socket_send( client->sock, data, len ));
+    return (ret < 0) ? 0 : ret;
+}
+
+static int
+do_kmsg_tail_start( ControlClient  client, char*  args )
+{
+    if (client->binary) {
+        control_write( client, "KO: not available with the binary protocol\r\n" );
+        return -1;
+    }
+    if (client->kmsg_reader == NULL) {
+        client->kmsg_reader = logBroker_addReader( android_kmsg_get_broker(),
+                                                   control_client_kmsg_write,
+                                                   client );
+        logBrokerReader_flush( client->kmsg_reader );
+    }
+    return 0;
+}
+
+static int
+do_kmsg_tail_stop( ControlClient  client, char*  args )
+{
+    if (client->kmsg_reader != NULL) {
+        logBroker_removeReader( android_kmsg_get_broker(), client->kmsg_reader );
+        client->kmsg_reader = NULL;
+    }
+    return 0;
+}
+
+static const CommandDefRec  kmsg_tail_commands[] =
+{
+    { "start", "start sending kernel messages to this console",
+      "'kmsg tail start' sends the most recent kernel messages, then all new ones,\r\n"
+      "to this console session until 'kmsg tail stop' is used or the session ends.\r\n"
+      "if the console doesn't read them fast enough, some messages are dropped,\r\n"
+      "see 'kmsg status'. The emulated system is never slowed down.\r\n", NULL,
+      do_kmsg_tail_start, NULL },
+
+    { "stop", "stop sending kernel messages to this console", NULL, NULL,
+      do_kmsg_tail_stop, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+static int
+do_kmsg_capture_start( ControlClient  client, char*  args )
+{
+    if ( !args ) {
+        control_write( client, "KO: missing <file> argument, see 'help kmsg capture start'\r\n" );
+        return -1;
+    }
+    if ( android_kmsg_capture_start(args) < 0) {
+        control_write( client, "KO: could not start capture: %s\r\n", strerror(errno) );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_kmsg_capture_stop( ControlClient  client, char*  args )
+{
+    /* no need to return an error here */
+    android_kmsg_capture_stop();
+    return 0;
+}
+
+static const CommandDefRec  kmsg_capture_commands[] =
+{
+    { "start", "start saving kernel messages to a file",
+      "'kmsg capture start <file>' saves the most recent kernel messages, then all\r\n"
+      "new ones, into a specific <file>. This will stop any capture already in progress.\r\n\r\n"
+      "you can stop the capture anytime with 'kmsg capture stop'\r\n", NULL,
+      do_kmsg_capture_start, NULL },
+
+    { "stop", "stop saving kernel messages",
+      "'kmsg capture stop' stops a currently running capture, if any.\r\n"
+      "you can start one with 'kmsg capture start <file>'\r\n", NULL,
+      do_kmsg_capture_stop, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+static int
+do_kmsg_status( ControlClient  client, char*  args )
+{
+    if (client->kmsg_reader == NULL) {
+        control_write( client, "kernel messages are not sent to this console\r\n" );
+        return 0;
+    }
+    control_write( client, "dropped bytes:  %llu\r\n",
+                   (unsigned long long) logBrokerReader_getDropped( client->kmsg_reader ) );
+    control_write( client, "pending bytes:  %d\r\n",
+                   logBrokerReader_getPending( client->kmsg_reader ) );
+    return 0;
+}
+
+static const CommandDefRec  kmsg_commands[] =
+{
+    { "tail", "send kernel messages to this console",
+      "allows to start/stop sending kernel messages to this console session\r\n", NULL,
+      NULL, kmsg_tail_commands },
+
+    { "capture", "save kernel messages to a file",
+      "allows to start/stop saving kernel messages to a file\r\n", NULL,
+      NULL, kmsg_capture_commands },
+
+    { "status", "display kernel message statistics for this console", NULL, NULL,
+      do_kmsg_status, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
 /********************************************************************************************/
 /********************************************************************************************/
 /*****                                                                                 ******/
@@ -1574,7 +1960,6 @@ do_sms_send( ControlClient  client, char*  args )
     int            textlen;
     SmsAddressRec  sender;
     SmsPDU*        pdus;
-    int            nn;
 
     /* check that we have a phone number made of digits */
     if (!args) {
@@ -1620,13 +2005,24 @@ do_sms_send( ControlClient  client, char*  args )
         return -1;
     }
 
-    for (nn = 0; pdus[nn] != NULL; nn++)
-        amodem_receive_sms( android_modem, pdus[nn] );
+    amodem_receive_sms_list( android_modem, pdus );
 
     smspdu_free_list( pdus );
     return 0;
 }
 
+static int
+do_sms_status( ControlClient  client, char*  args )
+{
+    if (!android_modem) {
+        control_write( client, "KO: modem emulation not running\r\n" );
+        return -1;
+    }
+    control_write( client, "pending: %d\r\n",
+                   amodem_get_pending_sms_count( android_modem ) );
+    return 0;
+}
+
 static int
 do_sms_sendpdu( ControlClient  client, char*  args )
 {
@@ -1666,6 +2062,12 @@ static const CommandDefRec  sms_commands[] =
     "you probably don't want to play with this at all\r\n", NULL,
     do_sms_sendpdu, NULL },
 
+    { "status", "display the inbound SMS queue",
+    "'sms status' displays the number of inbound SMS PDUs that the system hasn't\r\n"
+    "acknowledged yet. they are delivered one at a time, as the previous one is\r\n"
+    "acknowledged.\r\n", NULL,
+    do_sms_status, NULL },
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
@@ -1887,6 +2289,71 @@ do_event_send( ControlClient  client, char*  args )
     return 0;
 }
 
+static int
+do_event_replay( ControlClient  client, char*  args )
+{
+    UserTimedEvent*  events;
+    char*            p;
+    int              count = 0, max;
+
+    if (!args) {
+        control_write( client, "KO: Usage: event replay <time>:<type>:<code>:<value> ...\r\n" );
+        return -1;
+    }
+    if (!strcmp(args, "cancel")) {
+        user_event_replay_cancel();
+        return 0;
+    }
+
+    /* each event takes at least 7 characters and a space */
+    max    = strlen(args) / 8 + 1;
+    events = malloc( max * sizeof(*events) );
+    if (events == NULL) {
+        control_write( client, "KO: out of memory\r\n" );
+        return -1;
+    }
+
+    p = args;
+    for (;;) {
+        char*          q;
+        char*          end;
+        char           temp[128];
+        unsigned long  time_us;
+
+        p += strspn( p, " \t" );  /* skip spaces */
+        if (*p == 0)
+            break;
+
+        q = p + strcspn( p, " \t" );
+        time_us = strtoul( p, &end, 10 );
+        if (end == p || *end != ':' || end >= q || count >= max) {
+            control_write( client, "KO: invalid event time in '%.*s'\r\n", q-p, p );
+            free( events );
+            return -1;
+        }
+
+        snprintf(temp, sizeof temp, "%.*s", (int)(intptr_t)(q-end-1), end+1);
+        if (android_event_from_str( temp, &events[count].type,
+                                    &events[count].code,
+                                    &events[count].value ) < 0) {
+            control_write( client, "KO: invalid event in '%.*s', see 'help event send'\r\n",
+                           q-p, p );
+            free( events );
+            return -1;
+        }
+        events[count++].time_us = (uint32_t)time_us;
+        p = q;
+    }
+
+    if (user_event_replay( events, count ) < 0) {
+        control_write( client, "KO: event times must not decrease, and at most 65536 events can be pending\r\n" );
+        free( events );
+        return -1;
+    }
+    free( events );
+    return 0;
+}
+
 static int
 do_event_types( ControlClient  client, char*  args )
 {
@@ -2041,6 +2508,12 @@ static const CommandDefRec  event_commands[] =
     "according to the current device keyboard. unsupported characters will be discarded\r\n"
     "silently\r\n", NULL, do_event_text, NULL },
 
+    { "replay", "replay a timed sequence of events",
+    "'event replay <time>:<type>:<code>:<value> ...' sends each event <time> microseconds\r\n"
+    "from now, with the syntax of 'event send' for the rest. Events due at the same time\r\n"
+    "reach the system together. 'event replay cancel' drops the events not sent yet.\r\n",
+    NULL, do_event_replay, NULL },
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
@@ -2103,6 +2576,34 @@ do_snapshot_save( ControlClient  client, char*  args )
     return ret > 0; // no output on error channel indicates success
 }
 
+static int
+do_snapshot_save_live( ControlClient  client, char*  args )
+{
+    int64_t ret;
+
+    if (args == NULL) {
+        control_write(client, "KO: argument missing, try 'avd snapshot save-live <name>'\r\n");
+        return -1;
+    }
+
+    Monitor *err = monitor_fake_new(client, control_write_err_cb);
+    do_savevm_live(err, args);
+    ret = monitor_fake_get_bytes(err);
+    monitor_fake_free(err);
+
+    return ret > 0;
+}
+
+static int
+do_snapshot_status( ControlClient  client, char*  args )
+{
+    Monitor *out = monitor_fake_new(client, control_write_out_cb);
+    do_info_savevm_live(out);
+    monitor_fake_free(out);
+
+    return 0;
+}
+
 static int
 do_snapshot_load( ControlClient  client, char*  args )
 {
@@ -2149,6 +2650,16 @@ static const CommandDefRec  snapshot_commands[] =
     "'avd snapshot save <name>' will save the current (run-time) state to a snapshot with the given name\r\n",
     NULL, do_snapshot_save, NULL },
 
+    { "save-live", "save state snapshot while the virtual device keeps running",
+    "'avd snapshot save-live <name>' starts saving the current (run-time) state to a snapshot with\r\n"
+    "the given name, without stopping the virtual device until the end of the save. Use\r\n"
+    "'avd snapshot status' to know when it completes\r\n",
+    NULL, do_snapshot_save_live, NULL },
+
+    { "status", "show the status of the last live snapshot save",
+    "'avd snapshot status' shows the progress or the result of the last 'avd snapshot save-live'\r\n",
+    NULL, do_snapshot_status, NULL },
+
     { "load", "load state snapshot",
     "'avd snapshot load <name>' will load the state snapshot of the given name\r\n",
     NULL, do_snapshot_load, NULL },
@@ -2199,6 +2710,29 @@ do_avd_status( ControlClient  client, char*  args )
     return 0;
 }
 
+static int
+do_avd_idle( ControlClient  client, char*  args )
+{
+    static int64_t  last_idle_ns, last_elapsed_ns;
+    int64_t         idle_ns, elapsed_ns, delta_idle, delta_elapsed;
+
+    qemu_cpu_idle_get_stats(&idle_ns, &elapsed_ns);
+    delta_idle    = idle_ns - last_idle_ns;
+    delta_elapsed = elapsed_ns - last_elapsed_ns;
+    last_idle_ns    = idle_ns;
+    last_elapsed_ns = elapsed_ns;
+
+    if (elapsed_ns <= 0 || delta_elapsed <= 0) {
+        control_write( client, "KO: no idle statistics available\r\n" );
+        return -1;
+    }
+    control_write( client, "idle: %.1f%% since last query, %.1f%% since start (%.1f s)\r\n",
+                   100. * delta_idle / delta_elapsed,
+                   100. * idle_ns / elapsed_ns,
+                   elapsed_ns / 1e9 );
+    return 0;
+}
+
 static int
 do_avd_name( ControlClient  client, char*  args )
 {
@@ -2220,6 +2754,11 @@ static const CommandDefRec  vm_commands[] =
     "'avd status' will indicate whether the virtual device is running or not\r\n",
     NULL, do_avd_status, NULL },
 
+    { "idle", "query virtual device idle time",
+    "'avd idle' reports the share of wall-clock time the emulated CPUs spent halted\r\n"
+    "waiting for an interrupt, since the previous 'avd idle' and since startup\r\n",
+    NULL, do_avd_idle, NULL },
+
     { "name", "query virtual device name",
     "'avd name' will return the name of this virtual device\r\n",
     NULL, do_avd_name, NULL },
@@ -2385,6 +2924,112 @@ do_geo_fix( ControlClient  client, char*  args )
     return 0;
 }
 
+static int
+do_geo_route_play( ControlClient  client, char*  args )
+{
+    if (!args) {
+        control_write( client, "KO: missing route file, try 'help geo route play'\r\n" );
+        return -1;
+    }
+    if (!android_gps_cs) {
+        control_write( client, "KO: no GPS emulation in this virtual device\r\n" );
+        return -1;
+    }
+    if (android_gps_route_play( args ) < 0) {
+        control_write( client, "KO: cannot load a GPX or KML route from '%s'\r\n", args );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_geo_route_stop( ControlClient  client, char*  args )
+{
+    android_gps_route_stop();
+    return 0;
+}
+
+static int
+do_geo_route_speed( ControlClient  client, char*  args )
+{
+    char*   end;
+    double  speed;
+
+    if (!args) {
+        control_write( client, "KO: missing speed, try 'help geo route speed'\r\n" );
+        return -1;
+    }
+    speed = strtod( args, &end );
+    if (end == args || *end || android_gps_route_set_speed( speed ) < 0) {
+        control_write( client, "KO: invalid speed '%s'\r\n", args );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_geo_route_rate( ControlClient  client, char*  args )
+{
+    char*  end;
+    long   rate;
+
+    if (!args) {
+        control_write( client, "KO: missing rate, try 'help geo route rate'\r\n" );
+        return -1;
+    }
+    rate = strtol( args, &end, 10 );
+    if (end == args || *end || rate > INT_MAX ||
+        android_gps_route_set_rate( (int)rate ) < 0) {
+        control_write( client, "KO: rate must be between 10 and 60000 ms\r\n" );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_geo_route_status( ControlClient  client, char*  args )
+{
+    AndroidGpsRouteStatus  status;
+
+    android_gps_route_get_status(&status);
+    control_write( client, "state: %s\r\n", status.playing ? "playing" : "stopped" );
+    if (status.points > 0) {
+        control_write( client, "points: %d, position: %.1f s of %.1f s\r\n",
+                       status.points, status.position, status.duration );
+    }
+    control_write( client, "speed: %g, rate: %d ms\r\n", status.speed, status.rate_ms );
+    return 0;
+}
+
+static const CommandDefRec  geo_route_commands[] =
+{
+    { "play", "play a GPX or KML route",
+    "'geo route play <file>' loads a GPX or KML track from <file> and plays it back\r\n"
+    "by sending interpolated GPS fixes from the emulator at the configured rate.\r\n"
+    "Tracks with timestamps are played with the recorded timing, others at 10 m/s.\r\n",
+    NULL, do_geo_route_play, NULL },
+
+    { "stop", "stop playing the current route",
+    "'geo route stop' stops sending the fixes of the current route.\r\n",
+    NULL, do_geo_route_stop, NULL },
+
+    { "speed", "change the route playback speed",
+    "'geo route speed <factor>' plays routes <factor> times faster than recorded,\r\n"
+    "e.g. 0.5 for half speed. This applies to the route being played.\r\n",
+    NULL, do_geo_route_speed, NULL },
+
+    { "rate", "change the rate of route fixes",
+    "'geo route rate <ms>' sets the time between two GPS fixes, between 10 and\r\n"
+    "60000 milliseconds. The default is 1000.\r\n",
+    NULL, do_geo_route_rate, NULL },
+
+    { "status", "show the state of route playback",
+    "'geo route status' shows whether a route is being played, and where.\r\n",
+    NULL, do_geo_route_status, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
 static const CommandDefRec  geo_commands[] =
 {
     { "nmea", "send a GPS NMEA sentence",
@@ -2404,6 +3049,10 @@ static const CommandDefRec  geo_commands[] =
     "\r\n",
     NULL, do_geo_fix, NULL },
 
+    { "route", "play a GPS route from the emulator",
+    "allows you to play a GPX or KML route without sending each fix from the host\r\n",
+    NULL, NULL, geo_route_commands },
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
@@ -2584,6 +3233,29 @@ do_sensors_status( ControlClient client, char* args )
     return 0;
 }
 
+/* get or set the period of sensor keepalive reports. */
+static int
+do_sensors_keepalive( ControlClient client, char* args )
+{
+    if (!args) {
+        int delay_ms = android_sensors_get_keepalive();
+        if (delay_ms > 0)
+            control_write( client, "keepalive: %d ms\r\n", delay_ms );
+        else
+            control_write( client, "keepalive: disabled\r\n" );
+        return 0;
+    }
+
+    char* end;
+    long delay_ms = strtol( args, &end, 10 );
+    if (end == args || *end != 0 || delay_ms < 0 || delay_ms > INT_MAX) {
+        control_write( client, "KO: Usage: \"keepalive [<delay-ms>]\"\r\n" );
+        return -1;
+    }
+    android_sensors_set_keepalive( (int)delay_ms );
+    return 0;
+}
+
 /* Sensor commands for get/set sensor values and get available sensor names. */
 static const CommandDefRec sensor_commands[] =
 {
@@ -2599,6 +3271,13 @@ static const CommandDefRec sensor_commands[] =
       "'set <sensorname> <value-a>[:<value-b>[:<value-c>]]' set the values of a given sensor.\r\n",
       NULL, do_sensors_set, NULL },
 
+    { "keepalive", "get or set the sensor keepalive period",
+      "'keepalive [<delay-ms>]' sensor values are only reported to the emulated system\r\n"
+      "when they change. Use this to also report them every <delay-ms> milliseconds\r\n"
+      "when nothing changes, 0 disables it (the default). Without arguments, prints the\r\n"
+      "current period.\r\n",
+      NULL, do_sensors_keepalive, NULL },
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
@@ -2645,6 +3324,527 @@ static const CommandDefRec fingerprint_commands[] =
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                        B A L L O O N   C O M M A N D S                          ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+static int
+do_balloon_status( ControlClient  client, char*  args )
+{
+    AndroidBalloonStatus  status;
+
+    android_hw_balloon_get_status(&status);
+    control_write( client, "guest driver: %s\r\n",
+                   status.connected ? "connected" : "not connected" );
+    control_write( client, "target: %llu MB, inflated: %llu MB, released to host: %llu MB\r\n",
+                   (unsigned long long)(status.target >> 20),
+                   (unsigned long long)(status.inflated >> 20),
+                   (unsigned long long)(status.released >> 20) );
+    if (status.policy) {
+        control_write( client, "policy: low %llu MB, high %llu MB\r\n",
+                       (unsigned long long)(status.policy_low >> 20),
+                       (unsigned long long)(status.policy_high >> 20) );
+    } else {
+        control_write( client, "policy: off\r\n" );
+    }
+    if (status.host_available) {
+        control_write( client, "host available: %llu MB\r\n",
+                       (unsigned long long)(status.host_available >> 20) );
+    }
+    return 0;
+}
+
+static int
+do_balloon_target( ControlClient  client, char*  args )
+{
+    char*               end;
+    unsigned long long  mb;
+
+    if (!args) {
+        control_write( client, "KO: missing size, see 'help balloon target'\r\n" );
+        return -1;
+    }
+    mb = strtoull(args, &end, 10);
+    if (end == args || *end) {
+        control_write( client, "KO: invalid size '%s', see 'help balloon target'\r\n", args );
+        return -1;
+    }
+    if (android_hw_balloon_set_target((uint64_t)mb << 20) < 0) {
+        control_write( client, "KO: size larger than the emulated RAM\r\n" );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_balloon_policy( ControlClient  client, char*  args )
+{
+    unsigned long long  low, high;
+    char                extra;
+
+    if (args && !strcmp(args, "off")) {
+        android_hw_balloon_set_policy(0, 0);
+        return 0;
+    }
+    if (!args || sscanf(args, "%llu %llu %c", &low, &high, &extra) != 2 ||
+        low == 0 || low > high) {
+        control_write( client, "KO: invalid policy, see 'help balloon policy'\r\n" );
+        return -1;
+    }
+    if (android_hw_balloon_set_policy((uint64_t)low << 20,
+                                      (uint64_t)high << 20) < 0) {
+        control_write( client, "KO: cannot measure the available host memory\r\n" );
+        return -1;
+    }
+    return 0;
+}
+
+static const CommandDefRec  balloon_commands[] =
+{
+    { "status", "display the state of the memory balloon",
+    "'balloon status' displays whether a guest balloon driver is connected, the amount of\r\n"
+    "guest RAM it should hold and holds, and the host memory given back so far.\r\n", NULL,
+    do_balloon_status, NULL },
+
+    { "target", "set the size of the memory balloon",
+    "'balloon target <size>' asks the guest to hold <size> MB of its RAM in the balloon,\r\n"
+    "so that the host can reuse the memory backing it. Use 0 to give it all back.\r\n", NULL,
+    do_balloon_target, NULL },
+
+    { "policy", "drive the memory balloon from host memory pressure",
+    "'balloon policy <low> <high>' grows the balloon while the available host memory is\r\n"
+    "below <low> MB, up to half of the emulated RAM, and shrinks it while it is above\r\n"
+    "<high> MB. 'balloon policy off' stops this and leaves the current target.\r\n", NULL,
+    do_balloon_policy, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                           D I S K   C O M M A N D S                             ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+static void
+disk_status_one( void*  opaque, BlockDriverState*  bs )
+{
+    ControlClient    client = opaque;
+    BlockMergeStats  stats;
+
+    if (!bdrv_is_inserted(bs))
+        return;
+
+    bdrv_get_merge_stats(bs, &stats);
+    control_write( client, "%s: %llu requests, %llu merged (%.1f%%)\r\n",
+                   bdrv_get_device_name(bs),
+                   (unsigned long long)stats.requests,
+                   (unsigned long long)stats.merged,
+                   stats.requests ? 100. * stats.merged / stats.requests : 0. );
+    control_write( client, "  readahead: %llu hits in %llu reads (%.1f%%), %llu KB read ahead\r\n",
+                   (unsigned long long)stats.readahead_hits,
+                   (unsigned long long)stats.reads,
+                   stats.reads ? 100. * stats.readahead_hits / stats.reads : 0.,
+                   (unsigned long long)(stats.readahead_bytes / 1024) );
+}
+
+static int
+do_disk_status( ControlClient  client, char*  args )
+{
+    bdrv_iterate(disk_status_one, client);
+    return 0;
+}
+
+static const CommandDefRec  disk_commands[] =
+{
+    { "status", "display disk request statistics",
+    "'disk status' displays, for each emulated disk, how many guest requests were merged\r\n"
+    "with an adjacent one before reaching the disk image, and how many reads were served\r\n"
+    "by the sequential readahead cache.\r\n", NULL,
+    do_disk_status, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                           P I P E   C O M M A N D S                             ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+#define  PIPE_BENCH_DURATION_MS  200
+
+static const int  pipe_bench_default_sizes[] = { 64, 512, 4096, 32768, 262144 };
+
+static int
+pipe_bench_one( ControlClient  client, const char*  service, int  size )
+{
+    GoldfishPipeBenchResult  result;
+
+    if (goldfish_pipe_bench(service, size, PIPE_BENCH_DURATION_MS, &result) < 0) {
+        control_write( client, "KO: could not benchmark the '%s' pipe service\r\n", service );
+        return -1;
+    }
+    control_write( client, "%s %7d bytes: %9.1f MB/s, %9.2f us per round trip (%llu round trips)\r\n",
+                   service, size,
+                   result.bytes * 1000. / result.elapsedNs,
+                   result.elapsedNs / 1000. / result.roundTrips,
+                   (unsigned long long)result.roundTrips );
+    return 0;
+}
+
+static int
+do_pipe_bench( ControlClient  client, char*  args )
+{
+    const char*  service = "pingpong";
+    char*        p = args;
+    int          nn;
+
+    if (p && !isdigit((unsigned char)p[0])) {
+        service = p;
+        p = strchr(p, ' ');
+        if (p) {
+            *p++ = 0;
+        }
+    }
+
+    if (!p || !p[0]) {
+        for (nn = 0; nn < (int)ARRAY_SIZE(pipe_bench_default_sizes); nn++) {
+            if (pipe_bench_one(client, service, pipe_bench_default_sizes[nn]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+
+    while (p[0]) {
+        char*  end;
+        long   size = strtol(p, &end, 10);
+        if (end == p || (end[0] && end[0] != ' ') || size <= 0 || size > (16 << 20)) {
+            control_write( client, "KO: invalid size '%s', see 'help pipe bench'\r\n", p );
+            return -1;
+        }
+        if (pipe_bench_one(client, service, (int)size) < 0)
+            return -1;
+        p = end;
+        while (p[0] == ' ')
+            p++;
+    }
+    return 0;
+}
+
+static const CommandDefRec  pipe_commands[] =
+{
+    { "bench", "measure the throughput and latency of a pipe service",
+    "'pipe bench [zero|pingpong] [<size> ...]' writes buffers of <size> bytes to a test\r\n"
+    "pipe service, and reads them back, for 200 ms per size, without involving the guest.\r\n"
+    "It reports the throughput and the round trip time of the host side of the pipes, by\r\n"
+    "default of 'pingpong' with sizes from 64 to 262144 bytes. The last results are also\r\n"
+    "available through 'stats emulator_pipe_bench'. Guest programs can measure the whole\r\n"
+    "path by doing the same through /dev/qemu_pipe, 'stats emulator_pipe' then reports\r\n"
+    "the bytes they transferred and the pingpong round trip times seen by the emulator.\r\n", NULL,
+    do_pipe_bench, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                          A U D I O   C O M M A N D S                            ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+static int
+do_audio_status( ControlClient  client, char*  args )
+{
+    AudioOutStats  stats;
+
+    if (AUD_get_out_stats(&stats) < 0) {
+        control_write( client, "KO: the audio backend doesn't measure playback, use '-audio pa_lowlat'\r\n" );
+        return -1;
+    }
+    if (stats.latency_usec >= 0) {
+        control_write( client, "latency: %lld ms\r\n",
+                       (long long)(stats.latency_usec / 1000) );
+    } else {
+        control_write( client, "latency: unknown\r\n" );
+    }
+    control_write( client, "jitter buffer: %lld ms\r\n",
+                   (long long)(stats.buffer_usec / 1000) );
+    control_write( client, "underruns: %llu, frames played: %llu\r\n",
+                   (unsigned long long)stats.underruns,
+                   (unsigned long long)stats.frames );
+    return 0;
+}
+
+static const CommandDefRec  audio_commands[] =
+{
+    { "status", "display audio playback statistics",
+    "'audio status' displays the playback latency, from mixing to the speakers, the size of\r\n"
+    "the adaptive jitter buffer and the number of underruns, for the backends that\r\n"
+    "measure them.\r\n", NULL,
+    do_audio_status, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                              T R A C I N G                                      ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+static void
+do_trace_list_categories( ControlClient  client, unsigned  categories )
+{
+    int  n, count = 0;
+
+    for (n = 0; n < TRACE_CATEGORY_COUNT; n++) {
+        if (categories & (1U << n)) {
+            control_write( client, "%s%s", count ? "," : "",
+                           trace_category_name((TraceCategory)n) );
+            count++;
+        }
+    }
+    if (!count)
+        control_write( client, "none" );
+    control_write( client, "\r\n" );
+}
+
+static int
+do_trace_start( ControlClient  client, char*  args )
+{
+    unsigned  categories = TRACE_ALL_CATEGORIES;
+
+    if (args && !trace_parse_categories(args, &categories)) {
+        control_write( client, "KO: invalid categories '%s', use some of: ", args );
+        do_trace_list_categories( client, TRACE_ALL_CATEGORIES );
+        return -1;
+    }
+    trace_set_categories(categories);
+    return 0;
+}
+
+static int
+do_trace_stop( ControlClient  client, char*  args )
+{
+    trace_set_categories(0);
+    return 0;
+}
+
+static int
+do_trace_clear( ControlClient  client, char*  args )
+{
+    trace_clear();
+    return 0;
+}
+
+static int
+do_trace_status( ControlClient  client, char*  args )
+{
+    control_write( client, "enabled: " );
+    do_trace_list_categories( client, android_trace_categories );
+    control_write( client, "available: " );
+    do_trace_list_categories( client, TRACE_ALL_CATEGORIES );
+    return 0;
+}
+
+static int
+do_trace_save( ControlClient  client, char*  args )
+{
+    FILE*  file;
+    int    ret;
+
+    if (!args) {
+        control_write( client, "KO: missing file name, see 'help trace save'\r\n" );
+        return -1;
+    }
+    file = fopen(args, "w");
+    if (!file) {
+        control_write( client, "KO: can't create '%s': %s\r\n", args, strerror(errno) );
+        return -1;
+    }
+    ret = trace_write_json(file);
+    if (fclose(file) != 0)
+        ret = -1;
+    if (ret < 0) {
+        control_write( client, "KO: can't write '%s'\r\n", args );
+        return -1;
+    }
+    return 0;
+}
+
+static const CommandDefRec  trace_commands[] =
+{
+    { "start", "start recording trace events",
+    "'trace start [<categories>]' starts recording the tracepoints of the given comma-\r\n"
+    "separated categories, or of all of them by default. Each thread keeps its most\r\n"
+    "recent events in a ring buffer. See 'trace status' for the available categories.\r\n", NULL,
+    do_trace_start, NULL },
+
+    { "stop", "stop recording trace events",
+    "'trace stop' disables all tracepoints, the recorded events can still be saved\r\n", NULL,
+    do_trace_stop, NULL },
+
+    { "clear", "discard the recorded trace events",
+    "'trace clear' discards all the trace events recorded so far\r\n", NULL,
+    do_trace_clear, NULL },
+
+    { "status", "list the trace categories",
+    "'trace status' lists the enabled and the available trace categories\r\n", NULL,
+    do_trace_status, NULL },
+
+    { "save", "save the recorded trace events",
+    "'trace save <file>' writes the recorded trace events to <file> on the host, in the\r\n"
+    "JSON trace event format that chrome://tracing and the Perfetto UI can open. This\r\n"
+    "doesn't stop recording.\r\n", NULL,
+    do_trace_save, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                            S T A T I S T I C S                                  ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+static void
+do_stats_write_line( void*  opaque, const char*  line )
+{
+    control_control_write( (ControlClient)opaque, line, -1 );
+}
+
+static int
+do_stats( ControlClient  client, char*  args )
+{
+    metrics_print( args, do_stats_write_line, client );
+    return 0;
+}
+
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                                Q O S                                            ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+static void
+do_qos_write(void* data, const char* line)
+{
+    control_write((ControlClient)data, "%s", line);
+}
+
+static int
+do_qos_cpu( ControlClient  client, char*  args )
+{
+    char*  end;
+    long   percent;
+
+    if (!args) {
+        control_write( client, "KO: missing percentage, see 'help qos cpu'\r\n" );
+        return -1;
+    }
+    percent = strtol(args, &end, 10);
+    if (end == args || *end || android_qos_set_cpu((int)percent) < 0) {
+        control_write( client, "KO: invalid percentage '%s', see 'help qos cpu'\r\n", args );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_qos_io( ControlClient  client, char*  args )
+{
+    char                device[64];
+    unsigned long long  bps, iops = 0;
+    int                 count;
+
+    if (!args) {
+        control_write( client, "KO: missing arguments, see 'help qos io'\r\n" );
+        return -1;
+    }
+    count = sscanf(args, "%63s %llu %llu", device, &bps, &iops);
+    if (count < 2) {
+        control_write( client, "KO: invalid arguments, see 'help qos io'\r\n" );
+        return -1;
+    }
+    if (android_qos_set_io(strcmp(device, "all") ? device : NULL,
+                           bps, iops) < 0) {
+        control_write( client, "KO: no device named '%s'\r\n", device );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_qos_render( ControlClient  client, char*  args )
+{
+    AndroidQosRenderPriority  priority;
+
+    if (args && !strcmp(args, "low")) {
+        priority = ANDROID_QOS_RENDER_LOW;
+    } else if (args && !strcmp(args, "normal")) {
+        priority = ANDROID_QOS_RENDER_NORMAL;
+    } else if (args && !strcmp(args, "high")) {
+        priority = ANDROID_QOS_RENDER_HIGH;
+    } else {
+        control_write( client, "KO: expecting low, normal or high, see 'help qos render'\r\n" );
+        return -1;
+    }
+    android_qos_set_render(priority);
+    return 0;
+}
+
+static int
+do_qos_status( ControlClient  client, char*  args )
+{
+    android_qos_dump(do_qos_write, client);
+    return 0;
+}
+
+static const CommandDefRec  qos_commands[] =
+{
+    { "cpu", "limit the time the emulated CPUs run",
+    "'qos cpu <percent>' lets each emulated CPU run at most <percent> of the time, from 1\r\n"
+    "to 100, in 10 ms slices. 'qos cpu 100' removes the limit.\r\n", NULL,
+    do_qos_cpu, NULL },
+
+    { "io", "limit the disk bandwidth and operations",
+    "'qos io <device> <bps> [<iops>]' limits the NAND or block <device>, e.g. 'system' or\r\n"
+    "'userdata', or all of them if <device> is 'all', to <bps> bytes and <iops> operations\r\n"
+    "per second. 0 means no limit. 'qos status' lists the devices.\r\n", NULL,
+    do_qos_io, NULL },
+
+    { "render", "limit the priority of the GPU emulation threads",
+    "'qos render low|normal|high' limits the host scheduling priority of the threads that\r\n"
+    "render for the emulated GPU. 'high' removes the limit. Raising it again may need the\r\n"
+    "host privileges to do so, and has no effect with an external render service.\r\n", NULL,
+    do_qos_render, NULL },
+
+    { "status", "display the current limits",
+    "'qos status' prints the CPU, render and per-device I/O limits\r\n", NULL,
+    do_qos_status, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+
 /********************************************************************************************/
 /********************************************************************************************/
 /*****                                                                                 ******/
@@ -2681,6 +3881,145 @@ do_window_scale( ControlClient  client, char*  args )
     return 0;
 }
 
+#define  WINDOW_RECORD_DEFAULT_FPS  30
+
+static int
+do_window_record_start( ControlClient  client, char*  args )
+{
+    char*  path;
+    char*  end;
+    long   fps = WINDOW_RECORD_DEFAULT_FPS;
+
+    if (!args) {
+        control_write( client, "KO: missing <file> argument, see 'help window record start'\r\n" );
+        return -1;
+    }
+
+    path = args;
+    end  = strchr( args, ' ' );
+    if (end != NULL) {
+        *end++ = 0;
+        fps = strtol( end, &end, 10 );
+        if (end[0] || fps <= 0 || fps > 60) {
+            control_write( client, "KO: argument <fps> must be an integer between 1 and 60\r\n" );
+            return -1;
+        }
+    }
+
+    if (gpu_frame_start_recording( path, (int)fps ) < 0) {
+        control_write( client, "KO: could not start recording: %s\r\n", strerror(errno) );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_window_record_stop( ControlClient  client, char*  args )
+{
+    /* no need to return an error here */
+    gpu_frame_stop_recording();
+    return 0;
+}
+
+static int
+do_window_screenshot( ControlClient  client, char*  args )
+{
+    if (!args) {
+        control_write( client, "KO: missing <file> argument, see 'help window screenshot'\r\n" );
+        return -1;
+    }
+    if (gpu_frame_save_screenshot( args ) < 0) {
+        control_write( client, "KO: could not take screenshot\r\n" );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_window_timings( ControlClient  client, char*  args )
+{
+    char*  report;
+    char*  line;
+    char*  end;
+
+    if (args && !strcmp(args, "reset")) {
+        gpu_frame_reset_timings();
+        return 0;
+    }
+    if (args) {
+        control_write( client, "KO: unknown argument '%s', see 'help window timings'\r\n", args );
+        return -1;
+    }
+
+    report = gpu_frame_get_timings();
+    if (report == NULL) {
+        control_write( client, "KO: out of memory\r\n" );
+        return -1;
+    }
+    for (line = report; *line; line = end + 1) {
+        end = strchr( line, '\n' );
+        if (end == NULL)
+            break;
+        *end = 0;
+        control_write( client, "%s\r\n", line );
+    }
+    free(report);
+    return 0;
+}
+
+static int
+do_window_trace_start( ControlClient  client, char*  args )
+{
+    if (!args) {
+        control_write( client, "KO: missing <file> argument, see 'help window trace start'\r\n" );
+        return -1;
+    }
+    if (gpu_frame_start_trace( args ) < 0) {
+        control_write( client, "KO: could not create trace file: %s\r\n", strerror(errno) );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_window_trace_stop( ControlClient  client, char*  args )
+{
+    gpu_frame_stop_trace();
+    return 0;
+}
+
+static const CommandDefRec  window_trace_commands[] =
+{
+    { "start", "start tracing the GPU frames",
+      "'window trace start <file>' writes the timings of each stage of the GPU frames\r\n"
+      "sent to the window into <file>, in the Chrome trace event format that can be\r\n"
+      "loaded into chrome://tracing. This replaces any trace already in progress.\r\n", NULL,
+      do_window_trace_start, NULL },
+
+    { "stop", "stop tracing the GPU frames",
+      "'window trace stop' stops and closes the current trace file, if any.\r\n", NULL,
+      do_window_trace_stop, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+static const CommandDefRec  window_record_commands[] =
+{
+    { "start", "start recording the window content",
+      "'window record start <file> [<fps>]' starts recording the GPU display into a\r\n"
+      "Motion-JPEG AVI <file>, at <fps> frames per second (30 by default). This will\r\n"
+      "stop any recording already in progress. Only works with '-gpu on'.\r\n\r\n"
+      "you can stop the recording anytime with 'window record stop'\r\n", NULL,
+      do_window_record_start, NULL },
+
+    { "stop", "stop recording the window content",
+      "'window record stop' stops the current recording, if any.\r\n"
+      "you can start one with 'window record start <file>'\r\n", NULL,
+      do_window_record_stop, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
 static const CommandDefRec  window_commands[] =
 {
     { "scale", "change the window scale",
@@ -2689,6 +4028,27 @@ static const CommandDefRec  window_commands[] =
     "the 'dpi' prefix (as in '120dpi')\r\n",
     NULL, do_window_scale, NULL },
 
+    { "screenshot", "save the window content to a file",
+    "'window screenshot <file>' saves the current GPU display into a JPEG <file>.\r\n"
+    "the image is written in the background, and <file> only appears once it is\r\n"
+    "complete. Only works with '-gpu on'.\r\n",
+    NULL, do_window_screenshot, NULL },
+
+    { "record", "record the window content to a file",
+      "allows to start/stop recording the emulator display to a video file\r\n", NULL,
+      NULL, window_record_commands },
+
+    { "timings", "show the latency of the GPU frames",
+    "'window timings' shows histograms of the time spent by the GPU frames in each\r\n"
+    "stage, from the guest post to the window update, and the number of frames\r\n"
+    "dropped because a newer one was posted. 'window timings reset' clears them.\r\n"
+    "Only works with '-gpu on', when the window is not an EmuGL subwindow.\r\n",
+    NULL, do_window_timings, NULL },
+
+    { "trace", "trace the GPU frames to a file",
+      "allows to start/stop writing the timings of each GPU frame to a trace file\r\n", NULL,
+      NULL, window_trace_commands },
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
@@ -2932,6 +4292,175 @@ static const CommandDefRec  qemu_commands[] =
 };
 
 
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                           P R O F I L I N G                                     ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+#define  PROFILE_SHOW_DEFAULT_COUNT  20
+
+static void
+do_profile_write(void* data, const char* line)
+{
+    /* lines contain '%' signs */
+    control_write((ControlClient)data, "%s", line);
+}
+
+static int
+do_profile_start( ControlClient  client, char*  args )
+{
+    tb_profile_start();
+    return 0;
+}
+
+static int
+do_profile_stop( ControlClient  client, char*  args )
+{
+    tb_profile_stop();
+    return 0;
+}
+
+static int
+do_profile_reset( ControlClient  client, char*  args )
+{
+    tb_profile_reset();
+    return 0;
+}
+
+static int
+do_profile_show( ControlClient  client, char*  args )
+{
+    long  count = PROFILE_SHOW_DEFAULT_COUNT;
+
+    if (args) {
+        char*  end;
+        count = strtol(args, &end, 10);
+        if (end == args || *end || count <= 0) {
+            control_write( client, "KO: invalid count '%s', see 'help profile show'\r\n", args );
+            return -1;
+        }
+    }
+    tb_profile_dump((int)count, do_profile_write, client);
+    return 0;
+}
+
+static int
+do_profile_counters( ControlClient  client, char*  args )
+{
+    tb_profile_dump_counters(do_profile_write, client);
+    return 0;
+}
+
+static int
+do_profile_memory( ControlClient  client, char*  args )
+{
+    qemu_ram_dump_page_stats(do_profile_write, client);
+    return 0;
+}
+
+#define  PROFILE_SAMPLE_DEFAULT_HZ  1000
+
+static int
+do_profile_sample_start( ControlClient  client, char*  args )
+{
+    long  hz = PROFILE_SAMPLE_DEFAULT_HZ;
+
+    if (args) {
+        char*  end;
+        hz = strtol(args, &end, 10);
+        if (end == args || *end || hz <= 0 || hz > 10000) {
+            control_write( client, "KO: invalid rate '%s', see 'help profile sample-start'\r\n", args );
+            return -1;
+        }
+    }
+    if (profile_sampling_start((int)hz) < 0) {
+        control_write( client, "KO: the emulator must be started with -sample-profile\r\n" );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_profile_sample_stop( ControlClient  client, char*  args )
+{
+    profile_sampling_stop();
+    return 0;
+}
+
+static int
+do_profile_sample_save( ControlClient  client, char*  args )
+{
+    if (!args) {
+        control_write( client, "KO: missing file name, see 'help profile sample-save'\r\n" );
+        return -1;
+    }
+    if (profile_sampling_write(args) < 0) {
+        control_write( client, "KO: could not write '%s'\r\n", args );
+        return -1;
+    }
+    control_write( client, "%d samples written\r\n", profile_sampling_count() );
+    return 0;
+}
+
+static const CommandDefRec  profile_commands[] =
+{
+    { "start", "start translation block profiling",
+    "'profile start' starts counting the executions of each translated guest block and\r\n"
+    "the host time spent in them. This slows down the emulated system noticeably, and\r\n"
+    "has no effect with hardware acceleration. Data is kept until 'profile reset'.\r\n", NULL,
+    do_profile_start, NULL },
+
+    { "stop", "stop translation block profiling",
+    "'profile stop' stops profiling, the collected data can still be displayed\r\n", NULL,
+    do_profile_stop, NULL },
+
+    { "reset", "discard profiling data",
+    "'profile reset' discards all data collected since profiling was started\r\n", NULL,
+    do_profile_reset, NULL },
+
+    { "show", "display the hottest guest code",
+    "'profile show [<count>]' lists the <count> guest PCs where most of the host time\r\n"
+    "was spent (20 by default), with their execution counts and symbols when the\r\n"
+    "guest kernel symbols are known, followed by the number of blocks translated,\r\n"
+    "the time spent translating them and the number of translation cache flushes.\r\n", NULL,
+    do_profile_show, NULL },
+
+    { "counters", "display the execution counters",
+    "'profile counters' prints counters kept since startup, even when profiling is\r\n"
+    "disabled: host time, guest instructions (only with '-qemu -icount'), blocks\r\n"
+    "translated and the time it took, and softmmu TLB misses. Sample them before and\r\n"
+    "after a workload to measure it, see android/scripts/benchmark-tcg.sh.\r\n", NULL,
+    do_profile_counters, NULL },
+
+    { "memory", "display the host pages backing guest RAM",
+    "'profile memory' lists the guest RAM blocks with the size of the host pages that\r\n"
+    "back them, see '-mem-hugepages', followed by the number of host TLB entries needed\r\n"
+    "to map all of them, compared to normal pages. Fewer entries mean fewer TLB misses.\r\n", NULL,
+    do_profile_memory, NULL },
+
+    { "sample-start", "start sampling the guest processes",
+    "'profile sample-start [<hz>]' discards the previous samples, then records the guest\r\n"
+    "PC and current thread <hz> times per second (1000 by default), resolving the PC to\r\n"
+    "the file mapped there. This needs the '-sample-profile' option and a guest kernel\r\n"
+    "with the qemu_trace driver, and is only accurate without hardware acceleration.\r\n", NULL,
+    do_profile_sample_start, NULL },
+
+    { "sample-stop", "stop sampling the guest processes",
+    "'profile sample-stop' stops sampling, the samples can still be saved\r\n", NULL,
+    do_profile_sample_stop, NULL },
+
+    { "sample-save", "save the guest process samples",
+    "'profile sample-save <file>' writes the samples to <file> in the 'perf script'\r\n"
+    "text format, that FlameGraph, speedscope or pprof (with perf_to_profile) read.\r\n", NULL,
+    do_profile_sample_save, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+
 /********************************************************************************************/
 /********************************************************************************************/
 /*****                                                                                 ******/
@@ -2970,6 +4499,11 @@ static const CommandDefRec   main_commands[] =
     { "kill", "kill the emulator instance", NULL, NULL,
       do_kill, NULL },
 
+    { "kmsg", "manage kernel messages",
+      "allows you to send the kernel messages of the emulated system to several\r\n"
+      "consoles and files at the same time.\r\n", NULL,
+      NULL, kmsg_commands },
+
     { "network", "manage network settings",
       "allows you to manage the settings related to the network data connection of the\r\n"
       "emulated device.\r\n", NULL,
@@ -2979,6 +4513,39 @@ static const CommandDefRec   main_commands[] =
       "allows to change battery and AC power status\r\n", NULL,
       NULL, power_commands },
 
+    { "profile", "guest code profiling",
+      "allows you to find the guest code where the emulator spends its time\r\n", NULL,
+      NULL, profile_commands },
+
+    { "qos", "limit the host resources used by the emulator",
+      "allows you to limit the CPU time, disk I/O and render thread priority of this\r\n"
+      "instance, so that it shares the host with others.\r\n", NULL,
+      NULL, qos_commands },
+
+    { "trace", "record emulator trace events",
+      "allows you to record what the emulator threads do over time, without restarting\r\n"
+      "it, and save it for chrome://tracing or the Perfetto UI.\r\n", NULL,
+      NULL, trace_commands },
+
+    { "stats", "display emulator performance metrics",
+      "'stats [<prefix>]' prints the current value of the emulator's counters, gauges and\r\n"
+      "latency histograms, or only of those whose name starts with <prefix>. Histograms\r\n"
+      "report upper bounds of their percentiles. Start the emulator with '-stats-port <port>'\r\n"
+      "to also let Prometheus scrape them from http://127.0.0.1:<port>/metrics.\r\n", NULL,
+      do_stats, NULL },
+
+    { "binary", "switch to the binary console protocol",
+      "'binary <version>' switches this console to the binary protocol, where requests can\r\n"
+      "be sent without waiting for the previous responses. The only <version> is 1.\r\n"
+      "Every request and response starts with three little-endian 32-bit integers: the\r\n"
+      "payload size, a request ID and, for requests, the operation or, for responses, the\r\n"
+      "status, 0 for OK and 1 for KO. Operation 1 runs the text command in the payload and\r\n"
+      "responds with its text output. Operation 2 injects events, each made of a 16-bit\r\n"
+      "type, a 16-bit code and a 32-bit value. Operation 3 replays events like 'event replay',\r\n"
+      "each made of a 32-bit time followed by an event as for operation 2. Kernel messages\r\n"
+      "can't be tailed in this mode.\r\n",
+      NULL, do_binary, NULL },
+
     { "quit|exit", "quit control session", NULL, NULL,
       do_quit, NULL },
 
@@ -3012,6 +4579,22 @@ static const CommandDefRec   main_commands[] =
       "allows you to touch the emulator finger print sensor\r\n", NULL,
       NULL, fingerprint_commands},
 
+    { "balloon", "manage the memory balloon",
+      "allows you to give unused emulated RAM back to the host\r\n", NULL,
+      NULL, balloon_commands},
+
+    { "audio", "audio playback statistics",
+      "allows you to check how the audio backend keeps up with playback\r\n", NULL,
+      NULL, audio_commands},
+
+    { "disk", "disk request statistics",
+      "allows you to check how guest disk requests are merged and read ahead\r\n", NULL,
+      NULL, disk_commands},
+
+    { "pipe", "goldfish pipe benchmarks",
+      "allows you to measure how fast data goes through the goldfish pipe services\r\n", NULL,
+      NULL, pipe_commands},
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
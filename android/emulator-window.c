@@ -121,6 +121,15 @@ static int emulator_window_opengles_show_window(
     }
 }
 
+static int emulator_window_opengles_attach_window(
+    void* window, int w, int h, float rotation) {
+    if (s_use_emugl_subwindow) {
+        return android_attachOpenglesWindow(window, w, h, rotation);
+    } else {
+        return -1;
+    }
+}
+
 static int emulator_window_opengles_hide_window(void) {
     if (s_use_emugl_subwindow) {
         return android_hideOpenglesWindow();
@@ -139,12 +148,21 @@ static void emulator_window_opengles_redraw_window(void) {
 static void _emulator_window_on_gpu_frame(void* context,
                                           int width,
                                           int height,
-                                          const void* pixels) {
+                                          const void* pixels,
+                                          int damageX,
+                                          int damageY,
+                                          int damageWidth,
+                                          int damageHeight) {
     EmulatorWindow* emulator = (EmulatorWindow*)context;
     // This function is called from an EmuGL thread, which cannot
     // call the skin_ui_update_gpu_frame() function. Create a GpuFrame
     // instance, and send its address into the pipe.
-    skin_ui_update_gpu_frame(emulator->ui, width, height, pixels);
+    SkinRect damage = {
+        .pos.x = damageX,
+        .pos.y = damageY,
+        .size.w = damageWidth,
+        .size.h = damageHeight };
+    skin_ui_update_gpu_frame(emulator->ui, width, height, pixels, &damage);
 }
 
 static void
@@ -155,6 +173,7 @@ emulator_window_setup( EmulatorWindow*  emulator )
         .mouse_event = &emulator_window_window_mouse_event,
         .generic_event = &emulator_window_window_generic_event,
         .opengles_show = &emulator_window_opengles_show_window,
+        .opengles_attach = &emulator_window_opengles_attach_window,
         .opengles_hide = &emulator_window_opengles_hide_window,
         .opengles_redraw = &emulator_window_opengles_redraw_window,
         .opengles_free = &android_stopOpenglesRenderer,
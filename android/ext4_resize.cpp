@@ -27,13 +27,23 @@ using android::base::Win32Utils;
 #endif
 
 #include "android/base/String.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/Thread.h"
 #include "android/ext4_resize.h"
+#include "android/filesystems/ext4_utils.h"
 #include "android/utils/path.h"
 #include "base/system/System.h"
 #include "main-common.h"
 
+#include <errno.h>
+
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
 using android::base::String;
 using android::base::System;
+using android::base::Thread;
 
 // Convenience function for formatting and printing system call/library
 // function errors that show up regardless of host platform. Equivalent
@@ -63,6 +73,17 @@ int resizeExt4Partition (const char * partitionPath, int64_t newByteSize) {
         return -1;
     }
 
+    // Growing an image only requires adding block groups, which can be done
+    // in place much faster than resize2fs does, for most images.
+    int ret = android_growExt4Image(partitionPath, newByteSize);
+    if (ret == 0) {
+        return 0;
+    }
+    if (ret != -ENOTSUP) {
+        fprintf(stderr, "WARNING: couldn't grow partition in place (%s), "
+                "using resize2fs\n", strerror(-ret));
+    }
+
     // format common arguments once
     String executable = System::get()->findBundledExecutable("resize2fs");
     if(executable.empty()) {
@@ -154,6 +175,65 @@ int resizeExt4Partition (const char * partitionPath, int64_t newByteSize) {
     return 0;
 }
 
+namespace {
+
+class ResizeThread : public Thread {
+public:
+    ResizeThread(const char* partitionPath, int64_t newByteSize) :
+            Thread(), mPartitionPath(partitionPath),
+            mNewByteSize(newByteSize) {}
+
+    virtual intptr_t main() {
+        return resizeExt4Partition(mPartitionPath.c_str(), mNewByteSize);
+    }
+
+private:
+    String mPartitionPath;
+    int64_t mNewByteSize;
+};
+
+// The pending asynchronous resize.
+struct ResizeState {
+    ResizeState() : lock(), thread(NULL), result(0) {}
+
+    Lock lock;
+    ResizeThread* thread;
+    // Result of the last resize when it couldn't be started in a thread.
+    int result;
+};
+
+LazyInstance<ResizeState> sResizeState = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+void resizeExt4PartitionAsync(const char* partitionPath, int64_t newByteSize) {
+    waitExt4PartitionResize();
+
+    ResizeState* state = sResizeState.ptr();
+    AutoLock lock(state->lock);
+    state->thread = new ResizeThread(partitionPath, newByteSize);
+    if (!state->thread->start()) {
+        delete state->thread;
+        state->thread = NULL;
+        state->result = resizeExt4Partition(partitionPath, newByteSize);
+    }
+}
+
+int waitExt4PartitionResize(void) {
+    ResizeState* state = sResizeState.ptr();
+    AutoLock lock(state->lock);
+    if (!state->thread) {
+        int result = state->result;
+        state->result = 0;
+        return result;
+    }
+    intptr_t status = 0;
+    state->thread->wait(&status);
+    delete state->thread;
+    state->thread = NULL;
+    return (int)status;
+}
+
 bool checkExt4PartitionSize (int64_t byteSize) {
     uint64_t maxSizeMB = 16 * 1024 * 1024; // (16 TiB) * (1024 GiB / TiB) * (1024 MiB / GiB)
     uint64_t minSizeMB = 128;
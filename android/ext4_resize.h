@@ -37,6 +37,17 @@ ANDROID_BEGIN_HEADER
 //		Otherwise the exit code of the resize2fs process is returned.
 int resizeExt4Partition(const char * partitionPath, int64_t newByteSize);
 
+// Same as resizeExt4Partition(), but performed in a background thread so
+// that startup can go on meanwhile. Only one resize can be pending at a
+// time, a previous one is waited for first. The image must not be accessed
+// before waitExt4PartitionResize() returns.
+void resizeExt4PartitionAsync(const char* partitionPath, int64_t newByteSize);
+
+// Wait for the completion of the resize started by
+// resizeExt4PartitionAsync(), if any, and return its result, which uses
+// the same values as resizeExt4Partition(). Returns 0 if there is none.
+int waitExt4PartitionResize(void);
+
 // Returns true if |byteSize| is a valid ext4 partition size; i.e. within the
 // range of 128 MiB and 16 TiB inclusive, false otherwise.
 //
@@ -11,13 +11,23 @@
 
 #include "android/filesystems/ext4_utils.h"
 
+#include "android/base/EintrWrapper.h"
 #include "android/base/Log.h"
+#include "android/base/containers/PodVector.h"
+#include "android/base/files/ScopedFd.h"
 #include "android/base/files/ScopedStdioFile.h"
+#include "android/utils/path.h"
 
 #include "make_ext4fs.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#ifdef _WIN32
+#include <io.h>
+#endif
 
 #define DEBUG_EXT4  0
 
@@ -76,3 +86,574 @@ int android_createEmptyExt4Image(const char *filePath,
         EXT4_ERROR << "Failed to create ext4 image at: " << filePath;
     return ret;
 }
+
+namespace {
+
+using android::base::PodVector;
+using android::base::ScopedFd;
+
+// Little-endian accessors for on-disk structures.
+uint16_t get16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void put16(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+void put32(uint8_t* p, uint32_t value) {
+    put16(p, value);
+    put16(p + 2, value >> 16);
+}
+
+void setBits(uint8_t* bitmap, uint32_t from, uint32_t to) {
+    for (uint32_t n = from; n < to; ++n) {
+        bitmap[n >> 3] |= (uint8_t)(1 << (n & 7));
+    }
+}
+
+void clearBits(uint8_t* bitmap, uint32_t from, uint32_t to) {
+    for (uint32_t n = from; n < to; ++n) {
+        bitmap[n >> 3] &= (uint8_t)~(1 << (n & 7));
+    }
+}
+
+// Superblock fields.
+const size_t kSbOffset = 1024U;
+const size_t kSbSize = 1024U;
+const size_t kSbInodesCount = 0x00;
+const size_t kSbBlocksCount = 0x04;
+const size_t kSbReservedBlocksCount = 0x08;
+const size_t kSbFreeBlocksCount = 0x0c;
+const size_t kSbFreeInodesCount = 0x10;
+const size_t kSbFirstDataBlock = 0x14;
+const size_t kSbLogBlockSize = 0x18;
+const size_t kSbBlocksPerGroup = 0x20;
+const size_t kSbInodesPerGroup = 0x28;
+const size_t kSbMagic = 0x38;
+const size_t kSbState = 0x3a;
+const size_t kSbRevLevel = 0x4c;
+const size_t kSbInodeSize = 0x58;
+const size_t kSbBlockGroupNr = 0x5a;
+const size_t kSbFeatureCompat = 0x5c;
+const size_t kSbFeatureIncompat = 0x60;
+const size_t kSbFeatureRoCompat = 0x64;
+const size_t kSbUuid = 0x68;
+const size_t kSbReservedGdtBlocks = 0xce;
+
+const uint32_t kCompatHasJournal = 0x0004;
+const uint32_t kCompatExtAttr = 0x0008;
+const uint32_t kCompatResizeInode = 0x0010;
+const uint32_t kCompatDirIndex = 0x0020;
+const uint32_t kIncompatFiletype = 0x0002;
+const uint32_t kIncompatExtents = 0x0040;
+const uint32_t kRoCompatSparseSuper = 0x0001;
+const uint32_t kRoCompatLargeFile = 0x0002;
+const uint32_t kRoCompatHugeFile = 0x0008;
+const uint32_t kRoCompatGdtCsum = 0x0010;
+const uint32_t kRoCompatDirNlink = 0x0020;
+const uint32_t kRoCompatExtraIsize = 0x0040;
+
+// Features that don't change the layout of the block groups.
+const uint32_t kSupportedCompat =
+        kCompatHasJournal | kCompatExtAttr | kCompatResizeInode |
+        kCompatDirIndex;
+const uint32_t kSupportedIncompat = kIncompatFiletype | kIncompatExtents;
+const uint32_t kSupportedRoCompat =
+        kRoCompatSparseSuper | kRoCompatLargeFile | kRoCompatHugeFile |
+        kRoCompatGdtCsum | kRoCompatDirNlink | kRoCompatExtraIsize;
+
+const uint16_t kStateValid = 0x0001;
+const uint16_t kStateError = 0x0002;
+
+// Group descriptor fields, for the 32-byte descriptors of non-64bit images.
+const size_t kDescSize = 32U;
+const size_t kBgBlockBitmap = 0x00;
+const size_t kBgInodeBitmap = 0x04;
+const size_t kBgInodeTable = 0x08;
+const size_t kBgFreeBlocksCount = 0x0c;
+const size_t kBgFreeInodesCount = 0x0e;
+const size_t kBgFlags = 0x12;
+const size_t kBgItableUnused = 0x1c;
+const size_t kBgChecksum = 0x1e;
+
+const uint16_t kBgInodeUninit = 0x0001;
+const uint16_t kBgBlockUninit = 0x0002;
+
+// Resize inode, which keeps track of the reserved group descriptor blocks.
+const uint32_t kResizeInode = 7U;
+const size_t kInodeSize = 0x04;
+const size_t kInodeBlocks = 0x1c;
+const size_t kInodeDoubleIndirectBlock = 0x28 + 13 * 4;
+const size_t kInodeSizeHigh = 0x6c;
+const size_t kInodeBlocksHigh = 0x74;
+const uint32_t kInodeDirectBlocks = 12U;
+const size_t kInodeMinSize = 128U;
+
+// The last group is dropped when it would have less free blocks than this,
+// like resize2fs does.
+const uint32_t kMinGroupFreeBlocks = 50U;
+
+// The CRC16 used by ext4 group descriptor checksums.
+uint16_t crc16(uint16_t crc, const uint8_t* data, size_t size) {
+    for (size_t n = 0; n < size; ++n) {
+        crc ^= data[n];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+bool readAt(int fd, uint64_t offset, void* buffer, size_t size) {
+    uint8_t* p = static_cast<uint8_t*>(buffer);
+#ifdef _WIN32
+    if (::_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return false;
+    }
+#endif
+    while (size > 0) {
+#ifdef _WIN32
+        int ret = ::read(fd, p, size);
+#else
+        ssize_t ret = HANDLE_EINTR(::pread(fd, p, size, offset));
+#endif
+        if (ret <= 0) {
+            return false;
+        }
+        p += ret;
+        offset += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+bool writeAt(int fd, uint64_t offset, const void* buffer, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(buffer);
+#ifdef _WIN32
+    if (::_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return false;
+    }
+#endif
+    while (size > 0) {
+#ifdef _WIN32
+        int ret = ::write(fd, p, size);
+#else
+        ssize_t ret = HANDLE_EINTR(::pwrite(fd, p, size, offset));
+#endif
+        if (ret <= 0) {
+            return false;
+        }
+        p += ret;
+        offset += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+bool growFile(int fd, uint64_t size) {
+#ifdef _WIN32
+    int64_t current = ::_lseeki64(fd, 0, SEEK_END);
+    return current >= 0 &&
+           ((uint64_t)current >= size || ::_chsize_s(fd, size) == 0);
+#else
+    off_t current = ::lseek(fd, 0, SEEK_END);
+    return current >= 0 &&
+           ((uint64_t)current >= size ||
+            HANDLE_EINTR(::ftruncate(fd, size)) == 0);
+#endif
+}
+
+bool isPowerOf(uint32_t value, uint32_t base) {
+    while (value > 1 && value % base == 0) {
+        value /= base;
+    }
+    return value == 1;
+}
+
+// The layout of the block groups of an image.
+struct Ext4Layout {
+    uint32_t blockSize;
+    uint32_t firstDataBlock;
+    uint32_t blocksPerGroup;
+    uint32_t inodesPerGroup;
+    uint32_t gdtBlocks;
+    uint32_t reservedGdtBlocks;
+    uint32_t inodeTableBlocks;
+    bool sparseSuper;
+    bool gdtCsum;
+    const uint8_t* uuid;
+
+    uint64_t groupStart(uint32_t group) const {
+        return firstDataBlock + (uint64_t)group * blocksPerGroup;
+    }
+
+    uint32_t groupCount(uint64_t blocks) const {
+        return (uint32_t)((blocks - firstDataBlock + blocksPerGroup - 1) /
+                          blocksPerGroup);
+    }
+
+    // Returns true if |group| has a copy of the superblock and of the
+    // group descriptors.
+    bool hasSuper(uint32_t group) const {
+        return !sparseSuper || group <= 1 || isPowerOf(group, 3) ||
+               isPowerOf(group, 5) || isPowerOf(group, 7);
+    }
+
+    // Number of blocks before the bitmaps of |group|.
+    uint32_t superBlocks(uint32_t group) const {
+        return hasSuper(group) ? 1 + gdtBlocks + reservedGdtBlocks : 0;
+    }
+
+    // Number of metadata blocks at the start of |group|.
+    uint32_t overhead(uint32_t group) const {
+        return superBlocks(group) + 2 + inodeTableBlocks;
+    }
+
+    uint64_t superOffset(uint32_t group) const {
+        return group ? groupStart(group) * blockSize : kSbOffset;
+    }
+
+    uint64_t gdtOffset(uint32_t group) const {
+        return (groupStart(group) + 1) * blockSize;
+    }
+
+    void updateChecksum(uint32_t group, uint8_t* desc) const {
+        if (!gdtCsum) {
+            return;
+        }
+        uint8_t groupLe[4];
+        put32(groupLe, group);
+        uint16_t crc = crc16(0xffff, uuid, 16);
+        crc = crc16(crc, groupLe, sizeof(groupLe));
+        crc = crc16(crc, desc, kBgChecksum);
+        put16(desc + kBgChecksum, crc);
+    }
+};
+
+int growImage(int fd, uint64_t newSize) {
+    uint8_t sb[kSbSize];
+    if (!readAt(fd, kSbOffset, sb, sizeof(sb))) {
+        return -EIO;
+    }
+    if (get16(sb + kSbMagic) != 0xef53) {
+        EXT4_ERROR << "Not an Ext4 partition image";
+        return -EINVAL;
+    }
+    uint32_t logBlockSize = get32(sb + kSbLogBlockSize);
+    uint16_t state = get16(sb + kSbState);
+    if (get32(sb + kSbRevLevel) < 1 || logBlockSize > 6 ||
+        (get32(sb + kSbFeatureCompat) & ~kSupportedCompat) ||
+        (get32(sb + kSbFeatureIncompat) & ~kSupportedIncompat) ||
+        (get32(sb + kSbFeatureRoCompat) & ~kSupportedRoCompat) ||
+        !(state & kStateValid) || (state & kStateError)) {
+        EXT4_LOG << "Unsupported features or state, can't grow in place";
+        return -ENOTSUP;
+    }
+
+    Ext4Layout layout;
+    layout.blockSize = 1024U << logBlockSize;
+    layout.firstDataBlock = get32(sb + kSbFirstDataBlock);
+    layout.blocksPerGroup = get32(sb + kSbBlocksPerGroup);
+    layout.inodesPerGroup = get32(sb + kSbInodesPerGroup);
+    layout.reservedGdtBlocks = get16(sb + kSbReservedGdtBlocks);
+    layout.sparseSuper =
+            (get32(sb + kSbFeatureRoCompat) & kRoCompatSparseSuper) != 0;
+    layout.gdtCsum = (get32(sb + kSbFeatureRoCompat) & kRoCompatGdtCsum) != 0;
+    layout.uuid = sb + kSbUuid;
+    const bool hasResizeInode =
+            (get32(sb + kSbFeatureCompat) & kCompatResizeInode) &&
+            layout.reservedGdtBlocks > 0;
+    const uint32_t bitsPerBlock = layout.blockSize * 8;
+    const uint32_t inodeSize = get16(sb + kSbInodeSize);
+    if (layout.blocksPerGroup == 0 || layout.blocksPerGroup > bitsPerBlock ||
+        layout.inodesPerGroup == 0 || layout.inodesPerGroup > bitsPerBlock ||
+        inodeSize < kInodeMinSize || inodeSize > layout.blockSize) {
+        EXT4_ERROR << "Invalid superblock";
+        return -EINVAL;
+    }
+    layout.inodeTableBlocks =
+            (layout.inodesPerGroup * inodeSize + layout.blockSize - 1) /
+            layout.blockSize;
+
+    const uint64_t oldBlocks = get32(sb + kSbBlocksCount);
+    const uint32_t oldGroups = layout.groupCount(oldBlocks);
+    layout.gdtBlocks =
+            (oldGroups * kDescSize + layout.blockSize - 1) / layout.blockSize;
+
+    uint64_t newBlocks = newSize / layout.blockSize;
+    if (newBlocks < oldBlocks || newBlocks > UINT32_MAX) {
+        EXT4_LOG << "Can't resize from " << oldBlocks << " to " << newBlocks
+                 << " blocks in place";
+        return -ENOTSUP;
+    }
+    uint32_t newGroups = layout.groupCount(newBlocks);
+    if (newGroups > oldGroups) {
+        uint64_t lastStart = layout.groupStart(newGroups - 1);
+        if (newBlocks - lastStart <
+            layout.overhead(newGroups - 1) + kMinGroupFreeBlocks) {
+            newBlocks = lastStart;
+            newGroups--;
+        }
+    }
+    if (newBlocks == oldBlocks) {
+        return 0;
+    }
+    if ((uint64_t)newGroups * kDescSize >
+        (uint64_t)layout.gdtBlocks * layout.blockSize) {
+        EXT4_LOG << "No room for " << newGroups << " group descriptors";
+        return -ENOTSUP;
+    }
+
+    PodVector<uint8_t> gdt;
+    gdt.resize(layout.gdtBlocks * layout.blockSize);
+    if (!readAt(fd, layout.gdtOffset(0), gdt.begin(), gdt.size())) {
+        return -EIO;
+    }
+
+    // Check the resize inode before modifying anything. Each reserved
+    // group descriptor block is an indirect block listing its copies in
+    // the groups that have a superblock backup, except the first one.
+    PodVector<uint8_t> inode;
+    uint64_t inodeOffset = 0;
+    uint32_t backups = 0;
+    uint32_t newBackups = 0;
+    uint32_t references = 0;
+    uint64_t lastLogicalBlock = 0;
+    if (hasResizeInode) {
+        inode.resize(inodeSize);
+        inodeOffset = (uint64_t)get32(&gdt[kBgInodeTable]) * layout.blockSize +
+                      (kResizeInode - 1) * inodeSize;
+        if (!readAt(fd, inodeOffset, inode.begin(), inode.size())) {
+            return -EIO;
+        }
+        for (uint32_t group = 1; group < newGroups; ++group) {
+            if (layout.hasSuper(group)) {
+                (group < oldGroups ? backups : newBackups)++;
+            }
+        }
+        const uint32_t perBlock = layout.blockSize / 4;
+        if (backups + newBackups > perBlock) {
+            return -ENOTSUP;
+        }
+
+        // Find the references to the reserved blocks, to update the block
+        // count and size of the inode once the new copies are added. Note
+        // that make_ext4fs doesn't reference all of them, and some twice.
+        PodVector<uint8_t> dind;
+        dind.resize(layout.blockSize);
+        uint32_t dindBlock = get32(&inode[kInodeDoubleIndirectBlock]);
+        if (dindBlock == 0 ||
+            !readAt(fd, (uint64_t)dindBlock * layout.blockSize, dind.begin(),
+                    dind.size())) {
+            EXT4_LOG << "Invalid resize inode";
+            return -ENOTSUP;
+        }
+        const uint32_t firstReserved =
+                layout.firstDataBlock + 1 + layout.gdtBlocks;
+        for (uint32_t index = 0; index < perBlock; ++index) {
+            uint32_t block = get32(&dind[index * 4]);
+            if (block < firstReserved ||
+                block >= firstReserved + layout.reservedGdtBlocks) {
+                continue;
+            }
+            references++;
+            uint64_t last = kInodeDirectBlocks + perBlock +
+                            (uint64_t)index * perBlock + backups +
+                            newBackups - 1;
+            if (last > lastLogicalBlock) {
+                lastLogicalBlock = last;
+            }
+        }
+        if (references == 0) {
+            EXT4_LOG << "Invalid resize inode";
+            return -ENOTSUP;
+        }
+    }
+
+    if (!growFile(fd, newBlocks * layout.blockSize)) {
+        return -errno;
+    }
+
+    PodVector<uint8_t> block;
+    block.resize(layout.blockSize);
+    uint64_t addedFreeBlocks = 0;
+
+    // The last group may have been partial.
+    const uint32_t lastGroup = oldGroups - 1;
+    const uint64_t lastStart = layout.groupStart(lastGroup);
+    uint64_t lastEnd = lastStart + layout.blocksPerGroup;
+    if (lastEnd > newBlocks) {
+        lastEnd = newBlocks;
+    }
+    if (lastEnd > oldBlocks) {
+        uint8_t* desc = &gdt[lastGroup * kDescSize];
+        if (!layout.gdtCsum || !(get16(desc + kBgFlags) & kBgBlockUninit)) {
+            uint64_t offset =
+                    (uint64_t)get32(desc + kBgBlockBitmap) * layout.blockSize;
+            if (!readAt(fd, offset, block.begin(), block.size())) {
+                return -EIO;
+            }
+            clearBits(block.begin(), oldBlocks - lastStart, lastEnd - lastStart);
+            if (!writeAt(fd, offset, block.begin(), block.size())) {
+                return -EIO;
+            }
+        }
+        put16(desc + kBgFreeBlocksCount,
+              get16(desc + kBgFreeBlocksCount) + (lastEnd - oldBlocks));
+        layout.updateChecksum(lastGroup, desc);
+        addedFreeBlocks += lastEnd - oldBlocks;
+    }
+
+    // Initialize the bitmaps of the new groups. With uninit_bg, their inode
+    // tables are left to be zeroed lazily by the kernel.
+    PodVector<uint8_t> zeroes;
+    for (uint32_t group = oldGroups; group < newGroups; ++group) {
+        const uint64_t start = layout.groupStart(group);
+        uint32_t blocks = layout.blocksPerGroup;
+        if (blocks > newBlocks - start) {
+            blocks = newBlocks - start;
+        }
+        const uint32_t used = layout.overhead(group);
+        const uint64_t bitmaps = start + layout.superBlocks(group);
+
+        ::memset(block.begin(), 0, block.size());
+        setBits(block.begin(), 0, used);
+        setBits(block.begin(), blocks, bitsPerBlock);
+        if (!writeAt(fd, bitmaps * layout.blockSize, block.begin(),
+                     block.size())) {
+            return -EIO;
+        }
+        ::memset(block.begin(), 0, block.size());
+        setBits(block.begin(), layout.inodesPerGroup, bitsPerBlock);
+        if (!writeAt(fd, (bitmaps + 1) * layout.blockSize, block.begin(),
+                     block.size())) {
+            return -EIO;
+        }
+
+        uint32_t zeroBlocks = 0;
+        uint64_t zeroStart = 0;
+        if (!layout.gdtCsum) {
+            zeroBlocks = layout.inodeTableBlocks;
+            zeroStart = bitmaps + 2;
+        } else if (hasResizeInode && layout.hasSuper(group)) {
+            zeroBlocks = layout.reservedGdtBlocks;
+            zeroStart = start + 1 + layout.gdtBlocks;
+        }
+        if (zeroBlocks > 0) {
+            zeroes.resize((size_t)zeroBlocks * layout.blockSize);
+            ::memset(zeroes.begin(), 0, zeroes.size());
+            if (!writeAt(fd, zeroStart * layout.blockSize, zeroes.begin(),
+                         zeroes.size())) {
+                return -EIO;
+            }
+        }
+
+        uint8_t* desc = &gdt[group * kDescSize];
+        ::memset(desc, 0, kDescSize);
+        put32(desc + kBgBlockBitmap, bitmaps);
+        put32(desc + kBgInodeBitmap, bitmaps + 1);
+        put32(desc + kBgInodeTable, bitmaps + 2);
+        put16(desc + kBgFreeBlocksCount, blocks - used);
+        put16(desc + kBgFreeInodesCount, layout.inodesPerGroup);
+        if (layout.gdtCsum) {
+            put16(desc + kBgFlags, kBgInodeUninit);
+            put16(desc + kBgItableUnused, layout.inodesPerGroup);
+        }
+        layout.updateChecksum(group, desc);
+        addedFreeBlocks += blocks - used;
+    }
+
+    // Register the reserved group descriptor blocks of the new backups.
+    if (hasResizeInode && newBackups > 0) {
+        for (uint32_t n = 0; n < layout.reservedGdtBlocks; ++n) {
+            const uint64_t primary =
+                    layout.firstDataBlock + 1 + layout.gdtBlocks + n;
+            if (!readAt(fd, primary * layout.blockSize, block.begin(),
+                        block.size())) {
+                return -EIO;
+            }
+            uint32_t index = backups;
+            for (uint32_t group = oldGroups; group < newGroups; ++group) {
+                if (layout.hasSuper(group)) {
+                    put32(&block[index++ * 4],
+                          layout.groupStart(group) + 1 + layout.gdtBlocks + n);
+                }
+            }
+            if (!writeAt(fd, primary * layout.blockSize, block.begin(),
+                         block.size())) {
+                return -EIO;
+            }
+        }
+        uint64_t sectors = get32(&inode[kInodeBlocks]) |
+                           ((uint64_t)get16(&inode[kInodeBlocksHigh]) << 32);
+        sectors += (uint64_t)references * newBackups * (layout.blockSize / 512);
+        put32(&inode[kInodeBlocks], (uint32_t)sectors);
+        put16(&inode[kInodeBlocksHigh], (uint32_t)(sectors >> 32));
+        uint64_t size = get32(&inode[kInodeSize]) |
+                        ((uint64_t)get32(&inode[kInodeSizeHigh]) << 32);
+        if (size < (lastLogicalBlock + 1) * layout.blockSize) {
+            size = (lastLogicalBlock + 1) * layout.blockSize;
+            put32(&inode[kInodeSize], (uint32_t)size);
+            put32(&inode[kInodeSizeHigh], (uint32_t)(size >> 32));
+        }
+        if (!writeAt(fd, inodeOffset, inode.begin(), inode.size())) {
+            return -EIO;
+        }
+    }
+
+    // Write the group descriptors, then the superblock, and their backups.
+    for (uint32_t group = 0; group < newGroups; ++group) {
+        if (layout.hasSuper(group) &&
+            !writeAt(fd, layout.gdtOffset(group), gdt.begin(), gdt.size())) {
+            return -EIO;
+        }
+    }
+
+    const uint32_t addedInodes =
+            (newGroups - oldGroups) * layout.inodesPerGroup;
+    put32(sb + kSbBlocksCount, newBlocks);
+    put32(sb + kSbReservedBlocksCount,
+          get32(sb + kSbReservedBlocksCount) * newBlocks / oldBlocks);
+    put32(sb + kSbFreeBlocksCount,
+          get32(sb + kSbFreeBlocksCount) + addedFreeBlocks);
+    put32(sb + kSbInodesCount, get32(sb + kSbInodesCount) + addedInodes);
+    put32(sb + kSbFreeInodesCount,
+          get32(sb + kSbFreeInodesCount) + addedInodes);
+    for (uint32_t group = 0; group < newGroups; ++group) {
+        if (!layout.hasSuper(group)) {
+            continue;
+        }
+        put16(sb + kSbBlockGroupNr, group);
+        if (!writeAt(fd, layout.superOffset(group), sb, sizeof(sb))) {
+            return -EIO;
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+int android_growExt4Image(const char* filePath, uint64_t newSize) {
+    ScopedFd fd(::open(filePath, O_RDWR | O_BINARY));
+    if (!fd.valid()) {
+        int err = errno;
+        EXT4_PERROR << "Could not open file: " << filePath;
+        return -err;
+    }
+    int ret = growImage(fd.get(), newSize);
+#ifndef _WIN32
+    if (ret == 0 && ::fsync(fd.get()) < 0) {
+        ret = -errno;
+    }
+#endif
+    if (ret < 0 && ret != -ENOTSUP) {
+        EXT4_ERROR << "Could not grow " << filePath << ": " << strerror(-ret);
+    }
+    return ret;
+}
@@ -30,6 +30,16 @@ int android_createEmptyExt4Image(const char *filePath,
 // Returns true iff the file at |filePath| is an actual EXT4 partition image.
 bool android_pathIsExt4PartitionImage(const char* filePath);
 
+// Grow the EXT4 partition image at |filePath| to |newSize| bytes, in place.
+// This only adds block groups and updates the metadata that describes them,
+// without scanning the rest of the image, and only supports images without
+// the flex_bg, meta_bg, 64bit or metadata_csum features (like the ones
+// created by make_ext4fs) whose group descriptor blocks have room for the
+// new groups. A trailing group too small to be useful is dropped.
+// Returns 0 on success, -ENOTSUP if the image must be resized with
+// resize2fs instead, or another negative errno value on failure.
+int android_growExt4Image(const char* filePath, uint64_t newSize);
+
 
 ANDROID_END_HEADER
 
@@ -21,6 +21,7 @@
 
 #include <string>
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -108,3 +109,71 @@ TEST_F(Ext4UtilsTest, android_createEmptyExt4Partition) {
     EXPECT_EQ(0, ret);
     EXPECT_TRUE(android_pathIsExt4PartitionImage(tempPath));
 }
+
+namespace {
+
+// Read the 32-bit little-endian superblock field at |offset| of the image
+// at |path|.
+uint32_t readSuperblockField(const char* path, size_t offset) {
+    ScopedStdioFile file(fopen(path, "rb"));
+    uint8_t bytes[4] = {};
+    if (!file.get() || ::fseek(file.get(), 1024 + offset, SEEK_SET) != 0 ||
+        ::fread(bytes, sizeof(bytes), 1, file.get()) != 1) {
+        return 0;
+    }
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+           ((uint32_t)bytes[3] << 24);
+}
+
+const size_t kBlocksCountOffset = 0x04;
+const size_t kLogBlockSizeOffset = 0x18;
+const size_t kFeatureIncompatOffset = 0x60;
+
+}  // namespace
+
+TEST_F(Ext4UtilsTest, android_growExt4Image) {
+    const char* tempPath = createTempPath();
+    const uint64_t kSize = 32 * 1024 * 1024;
+    const uint64_t kNewSize = 200 * 1024 * 1024;
+    ASSERT_EQ(0, android_createEmptyExt4Image(tempPath, kSize, "cache"));
+    uint32_t blockSize =
+            1024U << readSuperblockField(tempPath, kLogBlockSizeOffset);
+    EXPECT_EQ(kSize / blockSize,
+              readSuperblockField(tempPath, kBlocksCountOffset));
+
+    EXPECT_EQ(0, android_growExt4Image(tempPath, kNewSize));
+    EXPECT_TRUE(android_pathIsExt4PartitionImage(tempPath));
+    EXPECT_EQ(kNewSize / blockSize,
+              readSuperblockField(tempPath, kBlocksCountOffset));
+    ScopedStdioFile file(fopen(tempPath, "rb"));
+    ASSERT_TRUE(file.get());
+    ASSERT_EQ(0, ::fseek(file.get(), 0, SEEK_END));
+    EXPECT_EQ((long)kNewSize, ::ftell(file.get()));
+    file.close();
+
+    // Nothing to do for the same size, shrinking is not supported.
+    EXPECT_EQ(0, android_growExt4Image(tempPath, kNewSize));
+    EXPECT_EQ(-ENOTSUP, android_growExt4Image(tempPath, kSize));
+}
+
+TEST_F(Ext4UtilsTest, android_growExt4ImageUnsupportedFeatures) {
+    const char* tempPath = createTempPath();
+    const uint64_t kSize = 32 * 1024 * 1024;
+    ASSERT_EQ(0, android_createEmptyExt4Image(tempPath, kSize, "cache"));
+
+    // Pretend the image uses flex_bg.
+    uint32_t features = readSuperblockField(tempPath, kFeatureIncompatOffset);
+    features |= 0x200;
+    ScopedStdioFile file(fopen(tempPath, "r+b"));
+    ASSERT_TRUE(file.get());
+    ASSERT_EQ(0, ::fseek(file.get(), 1024 + kFeatureIncompatOffset, SEEK_SET));
+    uint8_t bytes[4] = { (uint8_t)features, (uint8_t)(features >> 8),
+                         (uint8_t)(features >> 16), (uint8_t)(features >> 24) };
+    ASSERT_EQ(1U, ::fwrite(bytes, sizeof(bytes), 1, file.get()));
+    file.close();
+
+    EXPECT_EQ(-ENOTSUP, android_growExt4Image(tempPath, 2 * kSize));
+    EXPECT_EQ(kSize / (1024U << readSuperblockField(tempPath,
+                                                   kLogBlockSizeOffset)),
+              readSuperblockField(tempPath, kBlocksCountOffset));
+}
@@ -58,7 +58,8 @@ bool android_parseFstabPartitionFormat(const char* fstabData,
     while (p < end) {
         // Find end of current line, and start of next one.
         const char* line = p;
-        const char* line_end = ::strchr(p, '\n');
+        const char* line_end =
+                static_cast<const char*>(::memchr(p, '\n', end - p));
         if (!line_end) {
             line_end = end;
             p = end;
@@ -0,0 +1,572 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/gps-route.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Tracks are text files of a few MB at most, anything larger is a
+ * mistake. */
+#define  GPS_ROUTE_MAX_FILE_SIZE  (64 * 1024 * 1024)
+
+#define  EARTH_RADIUS  6371000.0
+
+#ifndef M_PI
+#define  M_PI  3.14159265358979323846
+#endif
+
+/* A point while parsing, with its absolute timestamp if it has one. */
+typedef struct {
+    GpsRoutePoint  point;
+    double         stamp;
+    int            has_stamp;
+} ParsedPoint;
+
+typedef struct {
+    ParsedPoint*  points;
+    int           count;
+    int           max;
+    /* the GPX point being parsed, or -1 */
+    int           current;
+    /* the <gx:Track> being parsed: its first point, and its timestamps */
+    int           track_start;
+    int           in_track;
+    double*       whens;
+    int           when_count;
+    int           when_max;
+} RouteParser;
+
+static ParsedPoint*
+parser_add_point( RouteParser*  p, double  lat, double  lon, double  alt )
+{
+    ParsedPoint*  pt;
+
+    if (p->count == p->max) {
+        int           max = p->max ? 2 * p->max : 256;
+        ParsedPoint*  points = realloc(p->points, max * sizeof(*points));
+
+        if (points == NULL)
+            return NULL;
+        p->points = points;
+        p->max    = max;
+    }
+    pt = &p->points[p->count++];
+    memset(pt, 0, sizeof(*pt));
+    pt->point.latitude  = lat;
+    pt->point.longitude = lon;
+    pt->point.altitude  = alt;
+    return pt;
+}
+
+static void
+parser_add_when( RouteParser*  p, double  stamp )
+{
+    if (p->when_count == p->when_max) {
+        int      max = p->when_max ? 2 * p->when_max : 256;
+        double*  whens = realloc(p->whens, max * sizeof(*whens));
+
+        if (whens == NULL)
+            return;
+        p->whens    = whens;
+        p->when_max = max;
+    }
+    p->whens[p->when_count++] = stamp;
+}
+
+/* Number of days between 1970-01-01 and the given date of the proleptic
+ * Gregorian calendar. */
+static int64_t
+days_from_civil( int64_t  y, int  m, int  d )
+{
+    int64_t  era;
+    int64_t  yoe, doy, doe;
+
+    y  -= (m <= 2);
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* The reverse of days_from_civil(). */
+static void
+civil_from_days( int64_t  z, int*  year, int*  month, int*  day )
+{
+    int64_t  era, doe, yoe, doy, mp;
+
+    z  += 719468;
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = z - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp  = (5 * doy + 2) / 153;
+    *day   = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *year  = (int)(yoe + era * 400 + (*month <= 2));
+}
+
+/* Parse an ISO 8601 timestamp, e.g. "2015-05-12T08:30:12.5Z", into
+ * seconds since the epoch. Return 0 on success, -1 otherwise. */
+static int
+parse_timestamp( const char*  s, double*  stamp )
+{
+    int     year, month, day, hour, minute, len = 0;
+    double  second;
+
+    while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')
+        s++;
+    if (sscanf(s, "%d-%d-%dT%d:%d:%lf%n", &year, &month, &day,
+               &hour, &minute, &second, &len) != 6 ||
+        month < 1 || month > 12 || day < 1 || day > 31)
+        return -1;
+
+    *stamp = (double)days_from_civil(year, month, day) * 86400 +
+             hour * 3600 + minute * 60 + second;
+
+    /* An optional time zone, UTC is assumed without one. */
+    s += len;
+    if (*s == '+' || *s == '-') {
+        int  tz_hour = 0, tz_minute = 0;
+        int  sign = (*s == '-') ? -1 : 1;
+
+        if (sscanf(s + 1, "%2d:%2d", &tz_hour, &tz_minute) < 1 &&
+            sscanf(s + 1, "%2d%2d", &tz_hour, &tz_minute) < 1)
+            return -1;
+        *stamp -= sign * (tz_hour * 3600 + tz_minute * 60);
+    }
+    return 0;
+}
+
+/* Find the value of attribute |name| in the attributes of a tag, between
+ * |attrs| and |end|, and parse it as a number. */
+static int
+parse_attribute( const char*  attrs, const char*  end, const char*  name,
+                 double*  value )
+{
+    size_t  len = strlen(name);
+    const char*  p;
+
+    for (p = attrs; p + len < end; p++) {
+        char  quote;
+        char*  stop;
+
+        if (memcmp(p, name, len) != 0 ||
+            (p > attrs && p[-1] != ' ' && p[-1] != '\t' &&
+             p[-1] != '\r' && p[-1] != '\n'))
+            continue;
+        p += len;
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (p >= end || *p != '=')
+            continue;
+        p++;
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (p >= end || (*p != '"' && *p != '\''))
+            continue;
+        quote = *p++;
+        *value = strtod(p, &stop);
+        return (stop != p && stop < end && *stop == quote) ? 0 : -1;
+    }
+    return -1;
+}
+
+/* Parse the "lon,lat[,alt]" tuples of a KML <coordinates> element. */
+static void
+parse_coordinates( RouteParser*  p, const char*  s, const char*  end )
+{
+    while (s < end) {
+        double  v[3] = { 0, 0, 0 };
+        int     n;
+        char*   stop;
+
+        while (s < end && (*s == ' ' || *s == '\t' || *s == '\r' ||
+                           *s == '\n'))
+            s++;
+        if (s >= end)
+            break;
+
+        for (n = 0; n < 3; n++) {
+            v[n] = strtod(s, &stop);
+            if (stop == s || stop > end)
+                break;
+            s = stop;
+            if (s >= end || *s != ',') {
+                n++;
+                break;
+            }
+            s++;
+        }
+        if (n < 2)
+            return;
+        parser_add_point(p, v[1], v[0], v[2]);
+    }
+}
+
+/* Return a pointer to the local name of a tag, i.e. without its namespace
+ * prefix, and its length. */
+static const char*
+tag_local_name( const char*  name, const char*  end, size_t*  len )
+{
+    const char*  p = name;
+    const char*  local = name;
+
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' &&
+           *p != '\n' && *p != '/' && *p != '>') {
+        if (*p == ':')
+            local = p + 1;
+        p++;
+    }
+    *len = p - local;
+    return local;
+}
+
+static int
+tag_is( const char*  local, size_t  len, const char*  name )
+{
+    return len == strlen(name) && !memcmp(local, name, len);
+}
+
+static void
+parser_run( RouteParser*  p, const char*  text, const char*  end )
+{
+    const char*  s = text;
+
+    p->current = -1;
+
+    while (s < end) {
+        const char*  tag = memchr(s, '<', end - s);
+        const char*  tag_end;
+        const char*  body;
+        const char*  body_end;
+        const char*  local;
+        size_t       len;
+        int          closing;
+
+        if (tag == NULL)
+            break;
+
+        /* Skip comments, CDATA sections and declarations. */
+        if (end - tag >= 4 && !memcmp(tag, "<!--", 4)) {
+            const char*  q;
+
+            for (q = tag + 4; q + 3 <= end && memcmp(q, "-->", 3); q++)
+                ;
+            s = q + 3;
+            continue;
+        }
+
+        tag_end = memchr(tag, '>', end - tag);
+        if (tag_end == NULL)
+            break;
+        s = tag_end + 1;
+        if (tag[1] == '?' || tag[1] == '!')
+            continue;
+
+        closing = (tag[1] == '/');
+        local   = tag_local_name(tag + 1 + closing, tag_end, &len);
+
+        /* The text content, up to the next tag. */
+        body     = s;
+        body_end = memchr(s, '<', end - s);
+        if (body_end == NULL)
+            body_end = end;
+
+        if (tag_is(local, len, "trkpt") || tag_is(local, len, "rtept") ||
+            tag_is(local, len, "wpt")) {
+            double  lat, lon;
+
+            if (closing) {
+                p->current = -1;
+            } else if (!parse_attribute(local + len, tag_end, "lat", &lat) &&
+                       !parse_attribute(local + len, tag_end, "lon", &lon) &&
+                       parser_add_point(p, lat, lon, 0.) != NULL) {
+                p->current = (tag_end[-1] == '/') ? -1 : p->count - 1;
+            }
+        } else if (closing) {
+            if (tag_is(local, len, "Track") && p->in_track) {
+                int  nn;
+
+                /* Timestamps are only used if there is one per point. */
+                if (p->when_count == p->count - p->track_start) {
+                    for (nn = 0; nn < p->when_count; nn++) {
+                        p->points[p->track_start + nn].stamp = p->whens[nn];
+                        p->points[p->track_start + nn].has_stamp = 1;
+                    }
+                }
+                p->in_track = 0;
+            }
+        } else if (tag_is(local, len, "ele") && p->current >= 0) {
+            p->points[p->current].point.altitude = strtod(body, NULL);
+        } else if (tag_is(local, len, "time") && p->current >= 0) {
+            ParsedPoint*  pt = &p->points[p->current];
+
+            pt->has_stamp = !parse_timestamp(body, &pt->stamp);
+        } else if (tag_is(local, len, "coordinates")) {
+            parse_coordinates(p, body, body_end);
+        } else if (tag_is(local, len, "Track")) {
+            p->in_track    = 1;
+            p->track_start = p->count;
+            p->when_count  = 0;
+        } else if (tag_is(local, len, "when") && p->in_track) {
+            double  stamp;
+
+            /* Keep the count right even if a timestamp is invalid. */
+            parser_add_when(p, parse_timestamp(body, &stamp) ? NAN : stamp);
+        } else if (tag_is(local, len, "coord") && p->in_track) {
+            double  lon, lat, alt = 0.;
+            char   *q, *r;
+
+            lon = strtod(body, &q);
+            lat = strtod(q, &r);
+            if (q != body && r != q) {
+                alt = strtod(r, NULL);
+                parser_add_point(p, lat, lon, alt);
+            }
+        }
+    }
+}
+
+/* Great-circle distance between two points, in meters. */
+static double
+route_distance( const GpsRoutePoint*  a, const GpsRoutePoint*  b )
+{
+    double  lat1 = a->latitude  * M_PI / 180.;
+    double  lat2 = b->latitude  * M_PI / 180.;
+    double  dlat = lat2 - lat1;
+    double  dlon = (b->longitude - a->longitude) * M_PI / 180.;
+    double  h    = sin(dlat / 2) * sin(dlat / 2) +
+                   cos(lat1) * cos(lat2) * sin(dlon / 2) * sin(dlon / 2);
+
+    return 2 * EARTH_RADIUS * atan2(sqrt(h), sqrt(1 - h));
+}
+
+/* Initial bearing from |a| to |b|, in degrees clockwise from the north. */
+static double
+route_bearing( const GpsRoutePoint*  a, const GpsRoutePoint*  b )
+{
+    double  lat1 = a->latitude  * M_PI / 180.;
+    double  lat2 = b->latitude  * M_PI / 180.;
+    double  dlon = (b->longitude - a->longitude) * M_PI / 180.;
+    double  y    = sin(dlon) * cos(lat2);
+    double  x    = cos(lat1) * sin(lat2) - sin(lat1) * cos(lat2) * cos(dlon);
+    double  deg  = atan2(y, x) * 180. / M_PI;
+
+    return (deg < 0) ? deg + 360. : deg;
+}
+
+int
+gps_route_parse( GpsRoute*  route, const char*  text, size_t  size )
+{
+    RouteParser  p[1];
+    int          nn, use_stamps;
+
+    route->points = NULL;
+    route->count  = 0;
+
+    memset(p, 0, sizeof(p));
+    parser_run(p, text, text + size);
+    free(p->whens);
+
+    if (p->count == 0) {
+        free(p->points);
+        return -1;
+    }
+
+    use_stamps = 1;
+    for (nn = 0; nn < p->count && use_stamps; nn++) {
+        if (!p->points[nn].has_stamp || isnan(p->points[nn].stamp) ||
+            (nn > 0 && p->points[nn].stamp < p->points[nn - 1].stamp))
+            use_stamps = 0;
+    }
+
+    route->points = malloc(p->count * sizeof(route->points[0]));
+    if (route->points == NULL) {
+        free(p->points);
+        return -1;
+    }
+    route->count = p->count;
+
+    for (nn = 0; nn < p->count; nn++) {
+        GpsRoutePoint*  pt = &route->points[nn];
+
+        *pt = p->points[nn].point;
+        if (nn == 0) {
+            pt->time = 0.;
+        } else if (use_stamps) {
+            pt->time = p->points[nn].stamp - p->points[0].stamp;
+        } else {
+            pt->time = pt[-1].time +
+                       route_distance(pt - 1, pt) / GPS_ROUTE_DEFAULT_SPEED;
+        }
+    }
+    free(p->points);
+    return 0;
+}
+
+int
+gps_route_load( GpsRoute*  route, const char*  path )
+{
+    FILE*  f = fopen(path, "rb");
+    char*  text;
+    long   size;
+    int    ret;
+
+    route->points = NULL;
+    route->count  = 0;
+
+    if (f == NULL)
+        return -1;
+    if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) <= 0 ||
+        size > GPS_ROUTE_MAX_FILE_SIZE || fseek(f, 0, SEEK_SET) < 0) {
+        fclose(f);
+        return -1;
+    }
+    text = malloc(size);
+    if (text == NULL || fread(text, size, 1, f) != 1) {
+        free(text);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    ret = gps_route_parse(route, text, size);
+    free(text);
+    return ret;
+}
+
+void
+gps_route_done( GpsRoute*  route )
+{
+    free(route->points);
+    route->points = NULL;
+    route->count  = 0;
+}
+
+double
+gps_route_duration( const GpsRoute*  route )
+{
+    return route->count ? route->points[route->count - 1].time : 0.;
+}
+
+void
+gps_route_get_fix( const GpsRoute*  route, double  time, GpsRouteFix*  fix )
+{
+    const GpsRoutePoint*  a;
+    const GpsRoutePoint*  b;
+    int     lo = 0, hi = route->count - 1;
+    double  dt, f;
+
+    if (route->count == 1 || time <= 0.) {
+        fix->point = route->points[0];
+        fix->point.time = 0.;
+        fix->speed   = 0.;
+        fix->bearing = (route->count > 1) ?
+                       route_bearing(&route->points[0], &route->points[1]) : 0.;
+        return;
+    }
+    if (time > route->points[hi].time)
+        time = route->points[hi].time;
+
+    /* Find the last segment that starts at or before |time|. */
+    while (hi - lo > 1) {
+        int  mid = (lo + hi) / 2;
+
+        if (route->points[mid].time <= time)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    a  = &route->points[lo];
+    b  = &route->points[lo + 1];
+    dt = b->time - a->time;
+    f  = (dt > 0.) ? (time - a->time) / dt : 1.;
+
+    /* Linear interpolation is plenty for the distance between two points
+     * of a track. */
+    fix->point.latitude  = a->latitude  + f * (b->latitude  - a->latitude);
+    fix->point.longitude = a->longitude + f * (b->longitude - a->longitude);
+    fix->point.altitude  = a->altitude  + f * (b->altitude  - a->altitude);
+    fix->point.time      = time;
+    fix->speed   = (dt > 0.) ? route_distance(a, b) / dt : 0.;
+    fix->bearing = route_bearing(a, b);
+}
+
+/* Format an angle as NMEA degrees and minutes, e.g. "4807.0380,N". */
+static void
+format_angle( char*  buf, size_t  size, double  val, int  deg_digits,
+              char  positive, char  negative )
+{
+    char     hemi = positive;
+    int64_t  units;
+
+    if (val < 0) {
+        hemi = negative;
+        val  = -val;
+    }
+    /* in 1/10000th of minutes, rounded once to avoid printing 60 minutes */
+    units = (int64_t)(val * 600000. + 0.5);
+    snprintf(buf, size, "%0*d%02d.%04d,%c", deg_digits,
+             (int)(units / 600000), (int)(units % 600000 / 10000),
+             (int)(units % 10000), hemi);
+}
+
+/* Append the checksum of the sentence in |buf|. */
+static int
+finish_sentence( char*  buf, size_t  size, int  len )
+{
+    unsigned  sum = 0;
+    int       nn;
+
+    if (len < 0 || (size_t)len + 3 >= size)
+        return -1;
+    /* The checksum covers everything between '$' and '*'. */
+    for (nn = 1; nn < len; nn++)
+        sum ^= (unsigned char)buf[nn];
+    snprintf(buf + len, size - len, "*%02X", sum & 0xff);
+    return 0;
+}
+
+int
+gps_route_format_nmea( const GpsRouteFix*  fix, time_t  utc, int  msecs,
+                       char*  gga, size_t  gga_size,
+                       char*  rmc, size_t  rmc_size )
+{
+    int64_t  secs = (int64_t)utc;
+    int64_t  days = (secs >= 0 ? secs : secs - 86399) / 86400;
+    int      tod  = (int)(secs - days * 86400);
+    int      year, month, day;
+    char     lat[24], lon[24], hms[32];
+    int      len;
+
+    civil_from_days(days, &year, &month, &day);
+    snprintf(hms, sizeof(hms), "%02d%02d%02d.%03d", tod / 3600,
+             tod / 60 % 60, tod % 60, msecs);
+    format_angle(lat, sizeof(lat), fix->point.latitude,  2, 'N', 'S');
+    format_angle(lon, sizeof(lon), fix->point.longitude, 3, 'E', 'W');
+
+    /* Fix quality 1, and 8 satellites with a good dilution. */
+    len = snprintf(gga, gga_size, "$GPGGA,%s,%s,%s,1,08,1.0,%.1f,M,0.0,M,,",
+                   hms, lat, lon, fix->point.altitude);
+    if (finish_sentence(gga, gga_size, len) < 0)
+        return -1;
+
+    /* Speed over ground in knots. */
+    len = snprintf(rmc, rmc_size, "$GPRMC,%s,A,%s,%s,%.1f,%.1f,%02d%02d%02d,,",
+                   hms, lat, lon, fix->speed * 3600. / 1852.,
+                   fix->bearing, day, month, year % 100);
+    return finish_sentence(rmc, rmc_size, len);
+}
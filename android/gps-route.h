@@ -0,0 +1,88 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _android_gps_route_h
+#define _android_gps_route_h
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+#include <time.h>
+
+ANDROID_BEGIN_HEADER
+
+/* A GPS track, loaded from a GPX or KML file, that the emulated GPS can
+ * play back without any help from the host.
+ *
+ * The following elements are recognized, wherever they appear:
+ *
+ *   GPX:  <trkpt>, <rtept> and <wpt> points, with their optional <ele>
+ *         and <time> children.
+ *   KML:  <coordinates> lists of "lon,lat[,alt]" tuples, and <gx:Track>
+ *         elements made of <when> and <gx:coord> pairs.
+ *
+ * If every point has a timestamp, and timestamps never go back, the route
+ * is played with the recorded timing. Otherwise, it is played at a constant
+ * speed of GPS_ROUTE_DEFAULT_SPEED.
+ */
+
+/* Speed of routes without usable timestamps, in meters per second. */
+#define  GPS_ROUTE_DEFAULT_SPEED  10.0
+
+typedef struct {
+    double  latitude;   /* decimal degrees, north is positive */
+    double  longitude;  /* decimal degrees, east is positive */
+    double  altitude;   /* meters above sea level */
+    double  time;       /* seconds since the first point of the route */
+} GpsRoutePoint;
+
+typedef struct {
+    GpsRoutePoint*  points;
+    int             count;
+} GpsRoute;
+
+/* An interpolated position along a route. */
+typedef struct {
+    GpsRoutePoint  point;
+    double         speed;    /* meters per second */
+    double         bearing;  /* degrees clockwise from the true north */
+} GpsRouteFix;
+
+/* Parse the |size| bytes of GPX or KML at |text| into |route|. Return 0
+ * on success, or -1 if no point could be found. */
+extern int     gps_route_parse( GpsRoute*  route, const char*  text,
+                                size_t  size );
+
+/* Same as gps_route_parse() for the content of the file at |path|. */
+extern int     gps_route_load( GpsRoute*  route, const char*  path );
+
+/* Release the points of |route|. */
+extern void    gps_route_done( GpsRoute*  route );
+
+/* Return the duration of |route| in seconds. */
+extern double  gps_route_duration( const GpsRoute*  route );
+
+/* Return the position at |time| seconds into |route|, which must have at
+ * least one point. |time| is clamped to the duration of the route. */
+extern void    gps_route_get_fix( const GpsRoute*  route, double  time,
+                                  GpsRouteFix*  fix );
+
+/* Format $GPGGA and $GPRMC sentences, with valid checksums and without
+ * line terminators, for |fix| at the UTC time |utc| + |msecs|. Return 0
+ * on success, or -1 if a sentence doesn't fit in its buffer. */
+extern int     gps_route_format_nmea( const GpsRouteFix*  fix,
+                                      time_t  utc, int  msecs,
+                                      char*  gga, size_t  gga_size,
+                                      char*  rmc, size_t  rmc_size );
+
+ANDROID_END_HEADER
+
+#endif /* _android_gps_route_h */
@@ -0,0 +1,187 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/gps-route.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace {
+
+int parseString(GpsRoute* route, const char* text) {
+    return gps_route_parse(route, text, strlen(text));
+}
+
+}  // namespace
+
+TEST(GpsRoute, ParseGpxWithTimestamps) {
+    static const char kGpx[] =
+        "<?xml version=\"1.0\"?>\n"
+        "<gpx version=\"1.1\" creator=\"test\">\n"
+        "<!-- a comment with <trkpt lat=\"1\" lon=\"1\"> inside -->\n"
+        "<trk><trkseg>\n"
+        "<trkpt lat=\"37.4220\" lon=\"-122.0841\"><ele>10</ele>"
+        "<time>2015-05-12T08:30:00Z</time></trkpt>\n"
+        "<trkpt lon='-122.0831' lat='37.4230'><ele>20.5</ele>"
+        "<time>2015-05-12T08:30:10.5Z</time></trkpt>\n"
+        "<trkpt lat=\"37.4240\" lon=\"-122.0821\">"
+        "<time>2015-05-12T10:31:00+02:00</time></trkpt>\n"
+        "</trkseg></trk></gpx>\n";
+    GpsRoute route;
+
+    ASSERT_EQ(0, parseString(&route, kGpx));
+    ASSERT_EQ(3, route.count);
+    EXPECT_DOUBLE_EQ(37.4220, route.points[0].latitude);
+    EXPECT_DOUBLE_EQ(-122.0841, route.points[0].longitude);
+    EXPECT_DOUBLE_EQ(10., route.points[0].altitude);
+    EXPECT_DOUBLE_EQ(20.5, route.points[1].altitude);
+    EXPECT_DOUBLE_EQ(0., route.points[2].altitude);
+    EXPECT_DOUBLE_EQ(0., route.points[0].time);
+    EXPECT_DOUBLE_EQ(10.5, route.points[1].time);
+    EXPECT_DOUBLE_EQ(60., route.points[2].time);
+    EXPECT_DOUBLE_EQ(60., gps_route_duration(&route));
+    gps_route_done(&route);
+    EXPECT_EQ(0, route.count);
+}
+
+TEST(GpsRoute, ParseGpxWithoutTimestamps) {
+    // One minute of latitude is one nautical mile, i.e. 1852 meters.
+    static const char kGpx[] =
+        "<gpx><rte>"
+        "<rtept lat=\"0\" lon=\"0\"/>"
+        "<rtept lat=\"0.0166666667\" lon=\"0\"/>"
+        "</rte></gpx>";
+    GpsRoute route;
+
+    ASSERT_EQ(0, parseString(&route, kGpx));
+    ASSERT_EQ(2, route.count);
+    EXPECT_NEAR(1853.2 / GPS_ROUTE_DEFAULT_SPEED, route.points[1].time, 0.5);
+    gps_route_done(&route);
+}
+
+TEST(GpsRoute, ParseKmlCoordinates) {
+    static const char kKml[] =
+        "<kml xmlns=\"http://www.opengis.net/kml/2.2\"><Document>"
+        "<Placemark><LineString><coordinates>\n"
+        "  -122.0841,37.4220,10\n"
+        "  -122.0831,37.4230\n"
+        "</coordinates></LineString></Placemark>"
+        "</Document></kml>";
+    GpsRoute route;
+
+    ASSERT_EQ(0, parseString(&route, kKml));
+    ASSERT_EQ(2, route.count);
+    EXPECT_DOUBLE_EQ(37.4220, route.points[0].latitude);
+    EXPECT_DOUBLE_EQ(-122.0841, route.points[0].longitude);
+    EXPECT_DOUBLE_EQ(10., route.points[0].altitude);
+    EXPECT_DOUBLE_EQ(37.4230, route.points[1].latitude);
+    EXPECT_DOUBLE_EQ(0., route.points[1].altitude);
+    EXPECT_LT(0., route.points[1].time);
+    gps_route_done(&route);
+}
+
+TEST(GpsRoute, ParseKmlTrack) {
+    static const char kKml[] =
+        "<kml><Placemark><gx:Track>"
+        "<when>2015-05-12T08:30:00Z</when>"
+        "<when>2015-05-12T08:30:20Z</when>"
+        "<gx:coord>-122.0841 37.4220 10</gx:coord>"
+        "<gx:coord>-122.0831 37.4230 30</gx:coord>"
+        "</gx:Track></Placemark></kml>";
+    GpsRoute route;
+
+    ASSERT_EQ(0, parseString(&route, kKml));
+    ASSERT_EQ(2, route.count);
+    EXPECT_DOUBLE_EQ(30., route.points[1].altitude);
+    EXPECT_DOUBLE_EQ(20., route.points[1].time);
+    gps_route_done(&route);
+}
+
+TEST(GpsRoute, ParseErrors) {
+    GpsRoute route;
+
+    EXPECT_EQ(-1, parseString(&route, ""));
+    EXPECT_EQ(-1, parseString(&route, "<gpx><trk></trk></gpx>"));
+    EXPECT_EQ(-1, parseString(&route, "<gpx><trkpt lat=\"1\"/></gpx>"));
+    EXPECT_EQ(0, route.count);
+    EXPECT_EQ(-1, gps_route_load(&route, "/this/file/does/not/exist.gpx"));
+}
+
+TEST(GpsRoute, GetFix) {
+    static const char kGpx[] =
+        "<gpx>"
+        "<trkpt lat=\"10\" lon=\"20\"><ele>100</ele>"
+        "<time>2015-01-01T00:00:00Z</time></trkpt>"
+        "<trkpt lat=\"10.001\" lon=\"20\"><ele>200</ele>"
+        "<time>2015-01-01T00:00:10Z</time></trkpt>"
+        "<trkpt lat=\"10.001\" lon=\"20.001\"><ele>200</ele>"
+        "<time>2015-01-01T00:00:20Z</time></trkpt>"
+        "</gpx>";
+    GpsRoute route;
+    GpsRouteFix fix;
+
+    ASSERT_EQ(0, parseString(&route, kGpx));
+
+    gps_route_get_fix(&route, 5., &fix);
+    EXPECT_NEAR(10.0005, fix.point.latitude, 1e-9);
+    EXPECT_NEAR(20., fix.point.longitude, 1e-9);
+    EXPECT_NEAR(150., fix.point.altitude, 1e-9);
+    // 0.001 degree of latitude is about 111 meters.
+    EXPECT_NEAR(11.1, fix.speed, 0.1);
+    EXPECT_NEAR(0., fix.bearing, 0.01);
+
+    gps_route_get_fix(&route, 15., &fix);
+    EXPECT_NEAR(20.0005, fix.point.longitude, 1e-9);
+    EXPECT_NEAR(90., fix.bearing, 0.01);
+
+    // Times out of the route are clamped.
+    gps_route_get_fix(&route, -1., &fix);
+    EXPECT_DOUBLE_EQ(10., fix.point.latitude);
+    gps_route_get_fix(&route, 1000., &fix);
+    EXPECT_DOUBLE_EQ(20.001, fix.point.longitude);
+    EXPECT_DOUBLE_EQ(20., fix.point.time);
+
+    gps_route_done(&route);
+}
+
+TEST(GpsRoute, FormatNmea) {
+    GpsRouteFix fix;
+    char gga[128], rmc[128];
+
+    fix.point.latitude = 48.1173;
+    fix.point.longitude = 11.5166667;
+    fix.point.altitude = 545.4;
+    fix.point.time = 0.;
+    fix.speed = 1852. / 3600. * 22.4;
+    fix.bearing = 84.4;
+
+    // 1994-03-23 12:35:19 UTC.
+    ASSERT_EQ(0, gps_route_format_nmea(&fix, 764426119, 0, gga, sizeof(gga),
+                                       rmc, sizeof(rmc)));
+    EXPECT_STREQ(
+        "$GPGGA,123519.000,4807.0380,N,01131.0000,E,1,08,1.0,545.4,M,0.0,M,,"
+        "*6A", gga);
+    EXPECT_STREQ(
+        "$GPRMC,123519.000,A,4807.0380,N,01131.0000,E,22.4,84.4,230394,,"
+        "*0F", rmc);
+
+    fix.point.latitude = -0.5;
+    fix.point.longitude = -179.99999999;
+    ASSERT_EQ(0, gps_route_format_nmea(&fix, 764426119, 250, gga, sizeof(gga),
+                                       rmc, sizeof(rmc)));
+    EXPECT_EQ(0, strncmp("$GPGGA,123519.250,0030.0000,S,18000.0000,W,",
+                         gga, 43));
+
+    // Too small buffers.
+    EXPECT_EQ(-1, gps_route_format_nmea(&fix, 0, 0, gga, 20, rmc,
+                                        sizeof(rmc)));
+}
@@ -10,7 +10,9 @@
 ** GNU General Public License for more details.
 */
 #include "android/gps.h"
+#include "android/gps-route.h"
 #include "android/utils/debug.h"
+#include "qemu/timer.h"
 #include "sysemu/char.h"
 
 CharDriverState*   android_gps_cs;
@@ -34,4 +36,130 @@ android_gps_send_nmea( const char*  sentence )
     qemu_chr_write( android_gps_cs, (const void*)"\n", 1 );
 }
 
+/* The default rate of route fixes, once per second like most receivers. */
+#define  GPS_ROUTE_DEFAULT_RATE_MS  1000
 
+typedef struct {
+    GpsRoute    route;
+    int         playing;
+    double      position;  /* seconds into the route */
+    double      speed;
+    int         rate_ms;
+    int64_t     last_ms;   /* host time of the last fix */
+    QEMUTimer*  timer;
+} GpsRoutePlayer;
+
+static GpsRoutePlayer  _routePlayer[1] = {
+    { .speed = 1.0, .rate_ms = GPS_ROUTE_DEFAULT_RATE_MS }
+};
+
+static void
+_gpsRoute_sendFix( GpsRoutePlayer*  p )
+{
+    GpsRouteFix  fix;
+    char         gga[128], rmc[128];
+    int64_t      now = qemu_clock_get_ms(QEMU_CLOCK_HOST);
+
+    gps_route_get_fix(&p->route, p->position, &fix);
+    if (gps_route_format_nmea(&fix, (time_t)(now / 1000), (int)(now % 1000),
+                              gga, sizeof(gga), rmc, sizeof(rmc)) < 0)
+        return;
+    android_gps_send_nmea(gga);
+    android_gps_send_nmea(rmc);
+}
+
+static void
+_gpsRoute_tick( void*  opaque )
+{
+    GpsRoutePlayer*  p = opaque;
+    int64_t          now = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    double           duration = gps_route_duration(&p->route);
+
+    p->position += (now - p->last_ms) / 1000. * p->speed;
+    p->last_ms   = now;
+    if (p->position > duration)
+        p->position = duration;
+
+    _gpsRoute_sendFix(p);
+
+    if (p->position >= duration) {
+        D("route playback complete");
+        p->playing = 0;
+        return;
+    }
+    timer_mod(p->timer, now + p->rate_ms);
+}
+
+int
+android_gps_route_play( const char*  path )
+{
+    GpsRoutePlayer*  p = _routePlayer;
+    GpsRoute         route;
+
+    if (gps_route_load(&route, path) < 0) {
+        D("cannot load route from '%s'", path);
+        return -1;
+    }
+    android_gps_route_stop();
+    gps_route_done(&p->route);
+    p->route = route;
+
+    D("playing %d points, %.1f seconds, from '%s'", route.count,
+      gps_route_duration(&route), path);
+
+    if (p->timer == NULL)
+        p->timer = timer_new(QEMU_CLOCK_REALTIME, SCALE_MS,
+                             _gpsRoute_tick, p);
+    p->playing  = 1;
+    p->position = 0.;
+    p->last_ms  = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    _gpsRoute_tick(p);
+    return 0;
+}
+
+void
+android_gps_route_stop( void )
+{
+    GpsRoutePlayer*  p = _routePlayer;
+
+    if (p->timer)
+        timer_del(p->timer);
+    p->playing = 0;
+}
+
+int
+android_gps_route_set_speed( double  speed )
+{
+    GpsRoutePlayer*  p = _routePlayer;
+
+    if (!(speed > 0.))
+        return -1;
+    p->speed = speed;
+    return 0;
+}
+
+int
+android_gps_route_set_rate( int  rate_ms )
+{
+    GpsRoutePlayer*  p = _routePlayer;
+
+    if (rate_ms < 10 || rate_ms > 60000)
+        return -1;
+    p->rate_ms = rate_ms;
+    if (p->playing)
+        timer_mod(p->timer, p->last_ms + rate_ms);
+    return 0;
+}
+
+void
+android_gps_route_get_status( AndroidGpsRouteStatus*  status )
+{
+    GpsRoutePlayer*  p = _routePlayer;
+
+    status->playing  = p->playing;
+    status->points   = p->route.count;
+    status->position = p->position;
+    status->duration = gps_route_duration(&p->route);
+    status->speed    = p->speed;
+    status->rate_ms  = p->rate_ms;
+}
@@ -20,4 +20,36 @@ extern CharDriverState*  android_gps_cs;
 
 extern void  android_gps_send_nmea( const char*  sentence );
 
+/* Route playback: the emulated GPS follows a GPX or KML track, see
+ * android/gps-route.h, by sending new $GPGGA and $GPRMC fixes at a regular
+ * rate, without any traffic from the host after the route is loaded. */
+
+typedef struct {
+    int     playing;    /* 1 if a route is being played */
+    int     points;     /* number of points in the route */
+    double  position;   /* seconds into the route */
+    double  duration;   /* duration of the route, in seconds */
+    double  speed;      /* playback speed, 1.0 is the recorded speed */
+    int     rate_ms;    /* milliseconds between fixes */
+} AndroidGpsRouteStatus;
+
+/* Load the route at |path| and start playing it from the beginning,
+ * replacing any route being played. Return -1 if the file can't be read
+ * or has no points, 0 otherwise. */
+extern int   android_gps_route_play( const char*  path );
+
+/* Stop playing the current route, if any. */
+extern void  android_gps_route_stop( void );
+
+/* Change the playback speed, e.g. 2.0 to play routes twice as fast. Takes
+ * effect immediately, including for the route being played. Return -1 if
+ * |speed| isn't strictly positive, 0 otherwise. */
+extern int   android_gps_route_set_speed( double  speed );
+
+/* Change the number of milliseconds between two fixes, between 10 and
+ * 60000. Return -1 if |rate_ms| is out of range, 0 otherwise. */
+extern int   android_gps_route_set_rate( int  rate_ms );
+
+extern void  android_gps_route_get_status( AndroidGpsRouteStatus*  status );
+
 #endif /* _android_gps_h */
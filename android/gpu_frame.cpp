@@ -19,18 +19,112 @@
 
 #include "android/base/Log.h"
 #include "android/base/memory/LazyInstance.h"
+#include "android/base/String.h"
+#include "android/base/synchronization/Lock.h"
 #include "android/looper-base.h"
 #include "android/opengl/GpuFrameBridge.h"
+#include "android/opengl/GpuFrameRecorder.h"
+#include "android/opengl/GpuFrameTimings.h"
+#include "android/opengl/ScreenshotWriter.h"
 #include "android/opengles.h"
+#include "android/utils/jpeg-compress.h"
+
+#include <string.h>
+#include <sys/time.h>
 
 // Standard values from Khronos.
 #define GL_RGBA 0x1908
 #define GL_UNSIGNED_BYTE 0x1401
 
+// JPEG quality of recorded frames and screenshots.
+#define RECORDING_JPEG_QUALITY 80
+#define SCREENSHOT_JPEG_QUALITY 90
+
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+using android::base::String;
 using android::opengl::GpuFrameBridge;
+using android::opengl::GpuFrameRecorder;
+using android::opengl::GpuFrameTimings;
+using android::opengl::ScreenshotWriter;
 
 static GpuFrameBridge* sBridge = NULL;
 
+// The UI callback and its context, called by sBridge.
+static void (*sCallback)(void*, int, int, const void*, int, int, int, int) =
+        NULL;
+static void* sCallbackContext = NULL;
+
+namespace {
+
+// A JPEG compressor, used from the worker thread of a GpuFrameRecorder
+// or ScreenshotWriter.
+struct JpegEncoder {
+    explicit JpegEncoder(int quality) :
+            jpeg(jpeg_compressor_create(0, 65536)), quality(quality) {}
+
+    ~JpegEncoder() {
+        jpeg_compressor_destroy(jpeg);
+    }
+
+    static bool encode(void* opaque,
+                       int width,
+                       int height,
+                       const void* pixels,
+                       const void** data,
+                       size_t* size) {
+        JpegEncoder* encoder = static_cast<JpegEncoder*>(opaque);
+        jpeg_compressor_compress_fb(encoder->jpeg, 0, 0, width, height,
+                                    height, 4, width * 4,
+                                    static_cast<const uint8_t*>(pixels),
+                                    encoder->quality, -1);
+        *data = jpeg_compressor_get_buffer(encoder->jpeg);
+        *size = static_cast<size_t>(
+                jpeg_compressor_get_jpeg_size(encoder->jpeg));
+        return *size > 0U;
+    }
+
+    AJPEGDesc* jpeg;
+    int quality;
+};
+
+// State of the screen recording and screenshots. |lock| protects the
+// fields used from the EmuGL thread, i.e. |recorder| and
+// |screenshotPath|.
+struct CaptureState {
+    CaptureState() :
+            lock(),
+            recorder(NULL),
+            recorderEncoder(NULL),
+            screenshots(NULL),
+            screenshotEncoder(SCREENSHOT_JPEG_QUALITY),
+            screenshotPath() {}
+
+    Lock lock;
+    GpuFrameRecorder* recorder;
+    JpegEncoder* recorderEncoder;
+    // Created on first use, and kept until the process exits.
+    ScreenshotWriter* screenshots;
+    JpegEncoder screenshotEncoder;
+    // Path of the requested screenshot, empty if there is none.
+    String screenshotPath;
+};
+
+LazyInstance<CaptureState> sCapture = LAZY_INSTANCE_INIT;
+
+// Latency of the frames sent to the UI.
+LazyInstance<GpuFrameTimings> sTimings = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+// Return the current time in microseconds.
+static int64_t nowUs() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000000LL + now.tv_usec;
+}
+
 // Called from an EmuGL thread to transfer a new frame of the GPU display
 // to the main loop.
 static void onNewGpuFrame(void* opaque,
@@ -39,24 +133,177 @@ static void onNewGpuFrame(void* opaque,
                           int ydir,
                           int format,
                           int type,
-                          unsigned char* pixels) {
+                          unsigned char* pixels,
+                          int damageX,
+                          int damageY,
+                          int damageWidth,
+                          int damageHeight) {
     DCHECK(ydir == -1);
     DCHECK(format == GL_RGBA);
     DCHECK(type == GL_UNSIGNED_BYTE);
 
-    GpuFrameBridge* bridge = reinterpret_cast<GpuFrameBridge*>(opaque);
-    bridge->postFrame(width, height, pixels);
+    if (sBridge) {
+        // EmuGL reports how long ago each of its stages happened, since
+        // it doesn't use the same clock.
+        int64_t times[GpuFrameTimings::kBridgePost + 1];
+        long long ages[GpuFrameTimings::kBridgePost];
+        int count = android_getPostTimings(ages, GpuFrameTimings::kBridgePost);
+        int64_t now = nowUs();
+        for (int n = 0; n < GpuFrameTimings::kBridgePost; ++n) {
+            times[n] = (n < count) ? now - ages[n] : -1;
+        }
+        times[GpuFrameTimings::kBridgePost] = now;
+        sTimings->framePosted(times);
+
+        sBridge->postFrame(width, height, pixels,
+                           damageX, damageY, damageWidth, damageHeight);
+    }
+
+    CaptureState* state = sCapture.ptr();
+    AutoLock lock(state->lock);
+    if (!state->screenshotPath.empty()) {
+        if (!state->screenshots->saveFrame(state->screenshotPath.c_str(),
+                                           width, height, pixels)) {
+            LOG(WARNING) << "Too many pending screenshots, dropping "
+                         << state->screenshotPath.c_str();
+        }
+        state->screenshotPath.clear();
+    }
+    if (state->recorder) {
+        state->recorder->postFrame(nowUs(), width, height, pixels,
+                                   damageX, damageY, damageWidth, damageHeight);
+    }
+}
+
+// Called from the main loop by sBridge, to pass a new frame to the UI.
+static void onGpuFrameDelivered(void* opaque,
+                                int width,
+                                int height,
+                                const void* pixels,
+                                int damageX,
+                                int damageY,
+                                int damageWidth,
+                                int damageHeight) {
+    int64_t delivered = nowUs();
+    sCallback(sCallbackContext, width, height, pixels,
+              damageX, damageY, damageWidth, damageHeight);
+    sTimings->frameDisplayed(delivered, nowUs());
 }
 
 void gpu_frame_set_post_callback(
         Looper* looper,
         void* context,
-        void (*callback)(void*, int, int, const void*)) {
+        void (*callback)(void*, int, int, const void*, int, int, int, int)) {
     DCHECK(!sBridge);
 
+    sCallback = callback;
+    sCallbackContext = context;
     sBridge = android::opengl::GpuFrameBridge::create(
-            android::internal::toBaseLooper(looper), callback, context);
+            android::internal::toBaseLooper(looper), onGpuFrameDelivered,
+            NULL);
     CHECK(sBridge);
 
-    android_setPostCallback(onNewGpuFrame, sBridge);
+    android_setPostCallback(onNewGpuFrame, NULL);
+}
+
+// Install or remove the EmuGL post callback, depending on whether frames
+// are needed. The EmuGL subwindow doesn't need them, and installing the
+// callback forces a full readback of the next frame.
+static void updatePostCallback(bool needed) {
+    if (sBridge) {
+        // The callback is always installed.
+        return;
+    }
+    android_setPostCallback(needed ? onNewGpuFrame : NULL, NULL);
+}
+
+int gpu_frame_start_recording(const char* path, int fps) {
+    gpu_frame_stop_recording();
+
+    CaptureState* state = sCapture.ptr();
+    JpegEncoder* encoder = new JpegEncoder(RECORDING_JPEG_QUALITY);
+    GpuFrameRecorder* recorder = GpuFrameRecorder::create(
+            path, fps, &JpegEncoder::encode, encoder);
+    if (!recorder) {
+        delete encoder;
+        return -1;
+    }
+    {
+        AutoLock lock(state->lock);
+        state->recorder = recorder;
+        state->recorderEncoder = encoder;
+    }
+    updatePostCallback(true);
+    return 0;
+}
+
+void gpu_frame_stop_recording(void) {
+    CaptureState* state = sCapture.ptr();
+    GpuFrameRecorder* recorder;
+    JpegEncoder* encoder;
+    {
+        AutoLock lock(state->lock);
+        recorder = state->recorder;
+        encoder = state->recorderEncoder;
+        state->recorder = NULL;
+        state->recorderEncoder = NULL;
+    }
+    if (!recorder) {
+        return;
+    }
+    updatePostCallback(false);
+    // This waits for the last frame to be compressed.
+    delete recorder;
+    delete encoder;
+}
+
+int gpu_frame_save_screenshot(const char* path) {
+    CaptureState* state = sCapture.ptr();
+    bool recording;
+    {
+        AutoLock lock(state->lock);
+        if (!state->screenshots) {
+            state->screenshots = ScreenshotWriter::create(
+                    &JpegEncoder::encode, &state->screenshotEncoder);
+            if (!state->screenshots) {
+                return -1;
+            }
+        }
+        state->screenshotPath = path;
+        recording = (state->recorder != NULL);
+    }
+
+    // Installing the callback again makes EmuGL read back the whole next
+    // frame, and the repaint posts the current one synchronously, so
+    // the screenshot is taken before it returns, if the GPU display is
+    // active at all.
+    android_setPostCallback(onNewGpuFrame, NULL);
+    android_redrawOpenglesWindow();
+
+    bool taken;
+    {
+        AutoLock lock(state->lock);
+        taken = state->screenshotPath.empty();
+        state->screenshotPath.clear();
+    }
+    updatePostCallback(recording);
+    return taken ? 0 : -1;
+}
+
+char* gpu_frame_get_timings(void) {
+    String report;
+    sTimings->getReport(&report);
+    return ::strdup(report.c_str());
+}
+
+void gpu_frame_reset_timings(void) {
+    sTimings->reset();
+}
+
+int gpu_frame_start_trace(const char* path) {
+    return sTimings->startTrace(path) ? 0 : -1;
+}
+
+void gpu_frame_stop_trace(void) {
+    sTimings->stopTrace();
 }
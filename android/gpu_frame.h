@@ -23,14 +23,55 @@ ANDROID_BEGIN_HEADER
 // Initialize state to ensure that new GPU frame data is passed to the caller
 // in the appropriate thread. |looper| is a Looper instance, |context| is an
 // opaque handle passed to |callback| at runtime, which is a function called
-// from the looper's thread whenever a new frame is available.
+// from the looper's thread whenever a new frame is available. The
+// |damageX|, |damageY|, |damageWidth| and |damageHeight| parameters give
+// the rectangle of pixels that changed since the previous call.
 void gpu_frame_set_post_callback(
         Looper* looper,
         void* context,
         void (*callback)(void* context,
                          int width,
                          int height,
-                         const void* pixels));
+                         const void* pixels,
+                         int damageX,
+                         int damageY,
+                         int damageWidth,
+                         int damageHeight));
+
+// Start recording the GPU display into a Motion-JPEG AVI file at |path|,
+// at |fps| frames per second. Frames are compressed and written by a
+// background thread, and frames that don't change the display are not
+// compressed at all. This stops any recording already in progress.
+// Return 0 on success, or -1 on failure.
+int gpu_frame_start_recording(const char* path, int fps);
+
+// Stop the current GPU display recording, if any, and finalize its file.
+void gpu_frame_stop_recording(void);
+
+// Save the current content of the GPU display into a JPEG file at |path|.
+// This only copies the pixels, the image is compressed and written by a
+// background thread, into a temporary file that is renamed to |path| once
+// complete. Return 0 on success, or -1 if the GPU display has no content
+// or too many screenshots are pending.
+int gpu_frame_save_screenshot(const char* path);
+
+// Return a report of the latency of the GPU frames sent to the UI, from
+// the guest post to the UI update, as a heap-allocated string that the
+// caller must free(). Each line of the report describes one stage of the
+// pipeline, and ends with a '\n'. Only available if the UI uses
+// gpu_frame_set_post_callback() to receive frames.
+char* gpu_frame_get_timings(void);
+
+// Reset the statistics reported by gpu_frame_get_timings().
+void gpu_frame_reset_timings(void);
+
+// Start writing the stages of each GPU frame sent to the UI into a new
+// Chrome trace event file at |path|, which can be loaded into
+// chrome://tracing. Return 0 on success, or -1 on failure.
+int gpu_frame_start_trace(const char* path);
+
+// Stop writing the current GPU frame trace, if any.
+void gpu_frame_stop_trace(void);
 
 ANDROID_END_HEADER
 
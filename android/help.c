@@ -485,6 +485,29 @@ help_avd(stralloc_t*  out)
     );
 }
 
+static void
+help_clone_avd(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-avd <golden> -clone-avd <name>' to create a new AVD named <name>\n"
+    "  with the configuration and disk images of the <golden> one, then exit.\n"
+    "  Use it to provision several identical emulators from one golden AVD.\n\n"
+
+    "  On file systems that support it (e.g. btrfs or XFS on Linux), the disk\n"
+    "  images of the new AVD are copy-on-write clones: creating it doesn't copy\n"
+    "  any data, and the data none of the AVDs modify is stored once on disk.\n"
+    "  Otherwise, its SD Card image is a qcow2 overlay of the golden one, and\n"
+    "  the other images are copied.\n\n"
+
+    "  The flat snapshots of the golden AVD, saved with\n"
+    "  '-qemu -snapshot-flat <content-dir>/snapshots', are shared as is. When\n"
+    "  restored with '-snapshot-shared-ram', the RAM pages all the clones keep\n"
+    "  unmodified are read once, into a single copy in the host page cache.\n\n"
+
+    "  Don't start or modify the golden AVD after cloning it.\n\n"
+    );
+}
+
 static void
 help_sysdir(stralloc_t*  out)
 {
@@ -728,6 +751,20 @@ help_no_snapshot_save(stralloc_t*  out)
     );
 }
 
+static void
+help_fast_exit(stralloc_t*  out)
+{
+    PRINTF(
+    "  Hide the emulator window as soon as it is closed, then save the AVD's\n"
+    "  state to the snapshot storage, unless -no-snapshot-save is used, and\n"
+    "  exit without the usual cleanup, which only releases memory.\n\n"
+
+    "  The exit status is still non-zero if the snapshot couldn't be saved,\n"
+    "  so scripts can wait for the emulator process to tell when the state\n"
+    "  is safely on disk.\n\n"
+    );
+}
+
 static void
 help_no_snapshot_update_time(stralloc_t*  out)
 {
@@ -739,6 +776,46 @@ help_no_snapshot_update_time(stralloc_t*  out)
     );
 }
 
+static void
+help_qcow2_cache_size(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-qcow2-cache-size <size>' to set the size in MB of the metadata cache\n"
+    "  kept in memory for each qcow2 image (e.g. the snapshot storage). The default\n"
+    "  is 2MB. A larger cache avoids re-reading L2 tables and refcount blocks\n"
+    "  during random I/O on large images. The cache hit and miss counts are\n"
+    "  reported with the block statistics.\n\n"
+    );
+}
+
+static void
+help_snapshot_lazy_ram(stralloc_t*  out)
+{
+    PRINTF(
+    "  When starting from a snapshot, resume the AVD without waiting for its\n"
+    "  RAM to be restored. Each page is read from the snapshot storage the first\n"
+    "  time it is accessed, and the remaining ones are read in the background.\n\n"
+
+    "  This has no effect with hardware acceleration (KVM or HAXM), or with\n"
+    "  snapshots saved by older emulator versions.\n\n"
+    );
+}
+
+static void
+help_snapshot_shared_ram(stralloc_t*  out)
+{
+    PRINTF(
+    "  When starting from a snapshot, map its RAM pages copy-on-write from the\n"
+    "  snapshot storage file instead of reading them. Emulators that start from\n"
+    "  the same snapshot storage file then share the host memory of the pages\n"
+    "  their guests don't modify.\n\n"
+
+    "  Only the pages saved uncompressed can be shared, so the snapshot must\n"
+    "  also be saved with this option, at the cost of a larger snapshot storage\n"
+    "  file. This has no effect on Windows, with HAXM, or with -mem-hugepages.\n\n"
+    );
+}
+
 static void
 help_snapshot_list(stralloc_t*  out)
 {
@@ -952,6 +1029,10 @@ help_audio(stralloc_t*  out)
     "  to be used to both play and record audio in the Android emulator.\n\n"
 
     "  use '-audio none' to disable audio completely.\n\n"
+
+    "  on Linux, '-audio pa_lowlat' plays through PulseAudio with a small adaptive\n"
+    "  buffer, which lowers the latency. use the 'audio status' console command to\n"
+    "  check its latency and underruns.\n\n"
     );
 }
 
@@ -1281,6 +1362,122 @@ help_cpu_delay(stralloc_t*  out)
     );
 }
 
+static void
+help_timer_slack(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-timer-slack <usecs>' to allow the emulator's timers to fire up to\n"
+    "  <usecs> microseconds (between 0 and 100000) after their deadline. Timers\n"
+    "  that expire close to each other are then handled by a single wakeup of the\n"
+    "  host CPU, which saves power when the emulated system is idle, at the cost\n"
+    "  of timer precision. The default is 0, i.e. no slack.\n\n"
+    );
+}
+
+static void
+help_stats_port(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-stats-port <port>' to serve the emulator's performance metrics on\n"
+    "  TCP <port> of the loopback interface, in the text format scraped by\n"
+    "  Prometheus, at http://127.0.0.1:<port>/metrics. The same metrics can be\n"
+    "  displayed with the 'stats' console command.\n\n"
+    );
+}
+
+static void
+help_qos(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-qos <limits>' to limit the host resources used by the emulator, so\n"
+    "  that a busy instance doesn't slow down the others running on the same host.\n"
+    "  <limits> is a comma-separated list of:\n\n"
+    "     cpu=<percent>            let each emulated CPU run at most <percent> of\n"
+    "                              the time, from 1 to 100\n"
+    "     io=<bps>[:<iops>]        limit every disk to <bps> bytes (with an optional\n"
+    "                              K, M or G suffix) and <iops> operations per second\n"
+    "     io.<name>=<bps>[:<iops>] the same for the disk <name> only, e.g. 'userdata'\n"
+    "     render=low|normal|high   limit the priority of the GPU emulation threads\n\n"
+    "  e.g. '-qos cpu=50,io=20M:500,render=low'. 0 means no limit. The limits can\n"
+    "  be changed while the emulator runs with the 'qos' console command.\n\n"
+    );
+}
+
+static void
+help_startup_profile(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-startup-profile' to print how long each phase of the emulator's\n"
+    "  initialization took once it is complete, including the steps that run\n"
+    "  concurrently in the background, and how long startup waited for them.\n\n"
+    );
+}
+
+static void
+help_sample_profile(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-sample-profile <hz>' to record the guest PC and the current guest thread\n"
+    "  <hz> times per second from boot, with 0 to only prepare the profiler. The PCs\n"
+    "  are resolved to the files the guest processes mapped at these addresses.\n"
+    "  Use the 'profile sample-*' console commands to restart the sampling and save\n"
+    "  the samples as 'perf script' output, for flame graphs or pprof.\n\n"
+
+    "  IMPORTANT: This requires a guest kernel with the qemu_trace driver, and the\n"
+    "  samples are only accurate without hardware acceleration.\n\n"
+    );
+}
+
+static void
+help_iothread(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-iothread' to run the emulated CPU in its own thread, while the main\n"
+    "  thread handles the network, the disks, the console and the timers. This\n"
+    "  reduces the latency of I/O (e.g. adb or network traffic) when the emulated\n"
+    "  CPU is busy. With KVM or HAXM, each emulated CPU gets its own thread, which\n"
+    "  is always the case when the guest has more than one CPU.\n\n"
+    );
+}
+
+static void
+help_mem_hugepages(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-mem-hugepages' to back the emulated RAM with huge host pages (e.g. 2 MB\n"
+    "  instead of 4 KB), which reduces host TLB misses and page faults with large\n"
+    "  RAM sizes. Explicit huge pages are used when the host has enough of them\n"
+    "  reserved (/proc/sys/vm/nr_hugepages on Linux, the 'Lock pages in memory'\n"
+    "  privilege on Windows), otherwise the host is asked to use transparent huge\n"
+    "  pages where supported. This is ignored with HAXM, which allocates the guest\n"
+    "  RAM itself. Use the 'profile memory' console command to see the result.\n\n"
+    );
+}
+
+static void
+help_mem_prefault(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-mem-prefault' to populate the emulated RAM with host pages at startup,\n"
+    "  in background threads that run while the emulator initializes and the system\n"
+    "  boots. Otherwise, the host allocates and clears each page the first time the\n"
+    "  guest touches it, which can cause multi-millisecond stalls during the first\n"
+    "  minute after boot. The whole RAM size is then committed on the host, and\n"
+    "  this has no effect with HAXM, which already does it, or when the RAM is\n"
+    "  mapped from a snapshot with -snapshot-shared-ram.\n\n"
+    );
+}
+
+static void
+help_mem_lock(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-mem-lock' to also lock the emulated RAM in host memory after\n"
+    "  populating it, see '-mem-prefault', so that it is never swapped out. This\n"
+    "  requires a large enough locked memory limit (see 'ulimit -l' on Linux).\n\n"
+    );
+}
+
 
 static void
 help_no_boot_anim(stralloc_t*  out)
@@ -1452,7 +1649,15 @@ help_gpu(stralloc_t* out)
     "     off      -> disable GPU emulation\n"
     "     auto     -> use the setting from the AVD\n"
     "     enabled  -> same as 'on'\n"
-    "     disabled -> same as 'off'\n\n"
+    "     disabled -> same as 'off'\n"
+    "     host     -> translate to the host's OpenGL\n"
+    "     <name>   -> use the backend in lib/gles_<name>, e.g. 'swiftshader'\n"
+    "                 or 'mesa' for multi-threaded software rendering\n\n"
+
+    "  Under remote desktop sessions, or with -no-window, 'auto' selects the\n"
+    "  'swiftshader' or 'mesa' software backend when it is available. Mesa's\n"
+    "  rasterizer uses half of the host cores, up to 8, unless LP_NUM_THREADS\n"
+    "  is defined.\n\n"
 
     "  Note that enabling GPU emulation if the system image does not support it\n"
     "  will prevent the proper display of the emulated framebuffer.\n\n"
@@ -1471,6 +1676,20 @@ help_gpu(stralloc_t* out)
     );
 }
 
+static void
+help_vsync_offset(stralloc_t* out)
+{
+    PRINTF(
+    "  With GPU emulation, the emulated display's VSYNC interrupts follow the\n"
+    "  vsync of the host display, as measured when the emulator presents the\n"
+    "  guest frames, instead of a fixed 60 Hz timer.\n\n"
+
+    "  Use -vsync-offset <ms> to raise them <ms> milliseconds earlier, which may\n"
+    "  be a decimal number, so that the guest has that much time to render and\n"
+    "  post its frame before the next host vblank. The default is 0.\n\n"
+    );
+}
+
 static void
 help_camera_back(stralloc_t* out)
 {
@@ -1480,7 +1699,14 @@ help_camera_back(stralloc_t* out)
 
     "     emulated  -> camera will be emulated using software ('fake') camera emulation\n"
     "     webcam<N> -> camera will be emulated using a webcamera connected to the host\n"
+    "     synthetic -> camera will render animated color bars\n"
+    "     synthetic:<file>\n"
+    "               -> camera will loop over the frames of a YUV4MPEG2 file <file>\n"
+    "                  with 4:2:0 chroma subsampling\n"
     "     none      -> camera emulation will be disabled\n\n"
+
+    "  Synthetic cameras produce the same frames on every run, as fast as the\n"
+    "  system asks for them, and don't need any camera on the host.\n\n"
     );
 }
 
@@ -1493,7 +1719,14 @@ help_camera_front(stralloc_t* out)
 
     "     emulated  -> camera will be emulated using software ('fake') camera emulation\n"
     "     webcam<N> -> camera will be emulated using a webcamera connected to the host\n"
+    "     synthetic -> camera will render animated color bars\n"
+    "     synthetic:<file>\n"
+    "               -> camera will loop over the frames of a YUV4MPEG2 file <file>\n"
+    "                  with 4:2:0 chroma subsampling\n"
     "     none      -> camera emulation will be disabled\n\n"
+
+    "  Synthetic cameras produce the same frames on every run, as fast as the\n"
+    "  system asks for them, and don't need any camera on the host.\n\n"
     );
 }
 
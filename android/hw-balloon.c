@@ -0,0 +1,302 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+#include "android/hw-balloon.h"
+#include "android/utils/debug.h"
+#include "android/utils/system.h"
+#include "android/hw-qemud.h"
+#include "exec/cpu-common.h"
+#include "hw/hw.h"
+#include "qemu/timer.h"
+#include "sysemu/sysemu.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+#define  D(...)  VERBOSE_PRINT(init,__VA_ARGS__)
+
+/* How often the memory-pressure policy checks the host, in ms. */
+#define  BALLOON_POLICY_PERIOD_MS  1000
+
+/* How much the policy changes the target at each step. */
+#define  BALLOON_POLICY_STEP       (32ULL << 20)
+
+typedef struct {
+    QemudService*  service;
+    QemudClient*   client;
+    uint64_t       target;
+    uint64_t       inflated;
+    uint64_t       released;
+    int            policy;
+    uint64_t       policy_low;
+    uint64_t       policy_high;
+    QEMUTimer*     policy_timer;
+} HwBalloon;
+
+/* the only static variable */
+static HwBalloon  _balloonState[1];
+
+/* Return the amount of memory the host can give to new allocations
+ * without swapping, in bytes, or 0 if unknown. */
+static uint64_t
+_hwBalloon_hostAvailable( void )
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX  status;
+
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status))
+        return 0;
+    return status.ullAvailPhys;
+#elif defined(__APPLE__)
+    vm_statistics64_data_t  stats;
+    mach_msg_type_number_t  count = HOST_VM_INFO64_COUNT;
+
+    if (host_statistics64(mach_host_self(), HOST_VM_INFO64,
+                          (host_info64_t)&stats, &count) != KERN_SUCCESS)
+        return 0;
+    return ((uint64_t)stats.free_count + stats.inactive_count) * vm_page_size;
+#else
+    FILE*          f = fopen("/proc/meminfo", "r");
+    char           line[128];
+    unsigned long  kb, available = 0, free_kb = 0, cached = 0;
+    int            has_available = 0;
+
+    if (f == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "MemAvailable: %lu kB", &kb) == 1) {
+            available = kb;
+            has_available = 1;
+        } else if (sscanf(line, "MemFree: %lu kB", &kb) == 1) {
+            free_kb = kb;
+        } else if (sscanf(line, "Cached: %lu kB", &kb) == 1) {
+            cached = kb;
+        }
+    }
+    fclose(f);
+    /* MemAvailable only exists since Linux 3.14. */
+    if (!has_available)
+        available = free_kb + cached;
+    return (uint64_t)available * 1024;
+#endif
+}
+
+static void
+_hwBalloon_sendTarget( HwBalloon*  b )
+{
+    char  msg[64];
+
+    if (b->client == NULL)
+        return;
+    snprintf(msg, sizeof(msg), "target:%" PRIu64, b->target);
+    qemud_client_send(b->client, (const uint8_t*)msg, strlen(msg));
+}
+
+/* Parse a "<addr>:<size>" message argument. */
+static int
+_hwBalloon_parseRange( const char*  args, uint64_t*  addr, uint64_t*  size )
+{
+    char  extra;
+
+    if (sscanf(args, "%" SCNx64 ":%" SCNx64 "%c", addr, size, &extra) != 2 ||
+        *size == 0 || *addr + *size < *addr)
+        return -1;
+    return 0;
+}
+
+/* Give the host memory backing a free guest range back to the host. */
+static void
+_hwBalloon_discard( HwBalloon*  b, uint64_t  addr, uint64_t  size )
+{
+    int64_t  done = qemu_ram_discard_range(addr, size);
+
+    if (done > 0)
+        b->released += done;
+}
+
+static void
+_hwBalloonClient_recv( void*  opaque, uint8_t*  msg, int  msglen,
+                       QemudClient*  client )
+{
+    HwBalloon*  b = opaque;
+    char        buf[128];
+    uint64_t    addr, size;
+
+    if (msglen <= 0 || msglen >= (int)sizeof(buf)) {
+        D("%s: ignoring message of %d bytes\n", __FUNCTION__, msglen);
+        return;
+    }
+    memcpy(buf, msg, msglen);
+    buf[msglen] = 0;
+
+    if (!strncmp(buf, "inflate:", 8) &&
+        !_hwBalloon_parseRange(buf + 8, &addr, &size)) {
+        b->inflated += size;
+        _hwBalloon_discard(b, addr, size);
+    } else if (!strncmp(buf, "deflate:", 8) &&
+               !_hwBalloon_parseRange(buf + 8, &addr, &size)) {
+        /* The pages simply fault back in when the guest touches them. */
+        b->inflated = (size < b->inflated) ? b->inflated - size : 0;
+    } else if (!strncmp(buf, "free:", 5) &&
+               !_hwBalloon_parseRange(buf + 5, &addr, &size)) {
+        _hwBalloon_discard(b, addr, size);
+    } else {
+        D("%s: ignoring unknown message '%s'\n", __FUNCTION__, buf);
+    }
+}
+
+static void
+_hwBalloonClient_close( void*  opaque )
+{
+    HwBalloon*  b = opaque;
+
+    b->client = NULL;
+}
+
+static QemudClient*
+_hwBalloon_connect( void*  opaque, QemudService*  service, int  channel,
+                    const char*  client_param )
+{
+    HwBalloon*    b = opaque;
+    QemudClient*  client;
+
+    client = qemud_client_new(service, channel, client_param, b,
+                              _hwBalloonClient_recv,
+                              _hwBalloonClient_close,
+                              NULL, /* no save */
+                              NULL  /* no load */ );
+    qemud_client_set_framing(client, 1);
+    b->client = client;
+
+    D("%s: balloon driver connected\n", __FUNCTION__);
+    _hwBalloon_sendTarget(b);
+    return client;
+}
+
+static void
+_hwBalloon_save( QEMUFile*  f, QemudService*  sv, void*  opaque )
+{
+    HwBalloon*  b = opaque;
+
+    qemu_put_be64(f, b->target);
+    qemu_put_be64(f, b->inflated);
+}
+
+static int
+_hwBalloon_load( QEMUFile*  f, QemudService*  sv, void*  opaque )
+{
+    HwBalloon*  b = opaque;
+
+    b->target   = qemu_get_be64(f);
+    b->inflated = qemu_get_be64(f);
+    return 0;
+}
+
+static void
+_hwBalloon_policyTick( void*  opaque )
+{
+    HwBalloon*  b = opaque;
+    uint64_t    available = _hwBalloon_hostAvailable();
+    /* Never take more than half of the guest RAM. */
+    uint64_t    limit = (uint64_t)ram_size / 2;
+    uint64_t    target = b->target;
+
+    if (available && available < b->policy_low) {
+        target = (target + BALLOON_POLICY_STEP < limit) ?
+                 target + BALLOON_POLICY_STEP : limit;
+    } else if (available > b->policy_high) {
+        target = (target > BALLOON_POLICY_STEP) ?
+                 target - BALLOON_POLICY_STEP : 0;
+    }
+    if (target != b->target) {
+        D("%s: host has %" PRIu64 " MB available, balloon target %" PRIu64
+          " MB\n", __FUNCTION__, available >> 20, target >> 20);
+        b->target = target;
+        _hwBalloon_sendTarget(b);
+    }
+
+    timer_mod(b->policy_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                               BALLOON_POLICY_PERIOD_MS);
+}
+
+void
+android_hw_balloon_init( void )
+{
+    HwBalloon*  b = _balloonState;
+
+    if (b->service == NULL) {
+        b->service = qemud_service_register("balloon", 1, b,
+                                            _hwBalloon_connect,
+                                            _hwBalloon_save,
+                                            _hwBalloon_load);
+        D("%s: balloon qemud service initialized\n", __FUNCTION__);
+    }
+}
+
+int
+android_hw_balloon_set_target( uint64_t  target )
+{
+    HwBalloon*  b = _balloonState;
+
+    if (target > (uint64_t)ram_size)
+        return -1;
+    b->target = target;
+    _hwBalloon_sendTarget(b);
+    return 0;
+}
+
+int
+android_hw_balloon_set_policy( uint64_t  low, uint64_t  high )
+{
+    HwBalloon*  b = _balloonState;
+
+    if (high == 0) {
+        b->policy = 0;
+        if (b->policy_timer)
+            timer_del(b->policy_timer);
+        return 0;
+    }
+    if (low > high || _hwBalloon_hostAvailable() == 0)
+        return -1;
+
+    b->policy      = 1;
+    b->policy_low  = low;
+    b->policy_high = high;
+    if (b->policy_timer == NULL)
+        b->policy_timer = timer_new(QEMU_CLOCK_REALTIME, SCALE_MS,
+                                    _hwBalloon_policyTick, b);
+    _hwBalloon_policyTick(b);
+    return 0;
+}
+
+void
+android_hw_balloon_get_status( AndroidBalloonStatus*  status )
+{
+    HwBalloon*  b = _balloonState;
+
+    status->connected      = (b->client != NULL);
+    status->target         = b->target;
+    status->inflated       = b->inflated;
+    status->released       = b->released;
+    status->policy         = b->policy;
+    status->policy_low     = b->policy_low;
+    status->policy_high    = b->policy_high;
+    status->host_available = _hwBalloon_hostAvailable();
+}
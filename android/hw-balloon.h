@@ -0,0 +1,67 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _android_hw_balloon_h
+#define _android_hw_balloon_h
+
+#include <stdint.h>
+
+/* A memory balloon, implemented as the "balloon" qemud service.
+ *
+ * The host asks the guest balloon driver to hold a target amount of guest
+ * RAM, and the guest reports the pages it took or gave back. The host
+ * memory backing the pages held by the balloon, as well as the free pages
+ * that the guest reports spontaneously, is then given back to the host,
+ * which lets more emulator instances share a host.
+ *
+ * All messages are framed strings. The host sends:
+ *
+ *     target:<size>          hold <size> bytes of guest RAM in the balloon
+ *
+ * and the guest sends, with guest physical addresses and sizes in hex:
+ *
+ *     inflate:<addr>:<size>  the range was added to the balloon
+ *     deflate:<addr>:<size>  the range was returned to the guest
+ *     free:<addr>:<size>     the range is free and may be discarded
+ *
+ * When the memory-pressure policy is enabled, the target grows while the
+ * available host memory is below a low watermark, and shrinks when it is
+ * above a high one.
+ */
+
+typedef struct {
+    int       connected;      /* 1 if a guest balloon driver is connected */
+    uint64_t  target;         /* bytes the balloon should hold */
+    uint64_t  inflated;       /* bytes the balloon holds */
+    uint64_t  released;       /* bytes given back to the host so far */
+    int       policy;         /* 1 if the memory-pressure policy is on */
+    uint64_t  policy_low;     /* policy watermarks, in bytes */
+    uint64_t  policy_high;
+    uint64_t  host_available; /* available host memory, 0 if unknown */
+} AndroidBalloonStatus;
+
+/* Register the balloon qemud service. */
+extern void  android_hw_balloon_init( void );
+
+/* Ask the guest to hold |target| bytes in its balloon. Returns -1 if the
+ * target is larger than the guest RAM, 0 otherwise. */
+extern int   android_hw_balloon_set_target( uint64_t  target );
+
+/* Enable the memory-pressure policy with watermarks |low| and |high|, in
+ * bytes of available host memory, or disable it if |high| is 0. Returns -1
+ * if the watermarks are invalid, or if the available host memory can't be
+ * measured, 0 otherwise. */
+extern int   android_hw_balloon_set_policy( uint64_t  low, uint64_t  high );
+
+/* Retrieve the current state of the balloon. */
+extern void  android_hw_balloon_get_status( AndroidBalloonStatus*  status );
+
+#endif /* _android_hw_balloon_h */
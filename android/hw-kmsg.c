@@ -13,12 +13,22 @@
 #include "sysemu/char.h"
 #include "android/charpipe.h"
 #include "android/utils/debug.h"
+#include "android/utils/log_broker.h"
+
+#include <stdio.h>
+
+/* size of the in-memory buffer that keeps the most recent kernel messages,
+ * this is also how far behind a slow reader can be before it drops some */
+#define  KERNEL_LOG_BUFFER_SIZE  (64*1024)
 
 static CharDriverState*  android_kmsg_cs;
 
 typedef struct {
     CharDriverState*  cs;
     AndroidKmsgFlags  flags;
+    LogBroker*        broker;
+    FILE*             capture_file;
+    LogBrokerReader*  capture_reader;
 } KernelLog;
 
 static int
@@ -32,10 +42,23 @@ kernel_log_read( void*  opaque, const uint8_t*  from, int  len )
 {
     KernelLog*  k = opaque;
 
-    if (k->flags & ANDROID_KMSG_PRINT_MESSAGES)
-        printf( "%.*s", len, (const char*)from );
+    logBroker_write( k->broker, from, len );
+}
+
+static int
+kernel_log_print( void*  opaque, const uint8_t*  data, int  len )
+{
+    printf( "%.*s", len, (const char*)data );
+    return len;
+}
 
-    /* XXXX: TODO: save messages into in-memory buffer for later retrieval */
+static int
+kernel_log_capture( void*  opaque, const uint8_t*  data, int  len )
+{
+    /* a file never exerts backpressure, ignore write errors */
+    fwrite( data, 1, len, opaque );
+    fflush( opaque );
+    return len;
 }
 
 static void
@@ -48,7 +71,11 @@ kernel_log_init( KernelLog*  k, AndroidKmsgFlags  flags )
 
     qemu_chr_add_handlers( k->cs, kernel_log_can_read, kernel_log_read, NULL, k );
 
-    k->flags = flags;
+    k->flags  = flags;
+    k->broker = logBroker_new( KERNEL_LOG_BUFFER_SIZE );
+
+    if (flags & ANDROID_KMSG_PRINT_MESSAGES)
+        logBroker_addReader( k->broker, kernel_log_print, k );
 }
 
 static KernelLog  _kernel_log[1];
@@ -68,3 +95,40 @@ CharDriverState*  android_kmsg_get_cs( void )
     }
     return android_kmsg_cs;
 }
+
+LogBroker*  android_kmsg_get_broker( void )
+{
+    android_kmsg_get_cs();
+    return _kernel_log->broker;
+}
+
+void  android_kmsg_capture_stop( void )
+{
+    KernelLog*  k = _kernel_log;
+
+    if (k->capture_file == NULL)
+        return;
+
+    logBroker_removeReader( k->broker, k->capture_reader );
+    fclose( k->capture_file );
+    k->capture_file   = NULL;
+    k->capture_reader = NULL;
+}
+
+int  android_kmsg_capture_start( const char*  filepath )
+{
+    KernelLog*  k = _kernel_log;
+    FILE*       f;
+
+    android_kmsg_get_cs();
+    android_kmsg_capture_stop();
+
+    f = fopen( filepath, "wb" );
+    if (f == NULL)
+        return -1;
+
+    k->capture_file   = f;
+    k->capture_reader = logBroker_addReader( k->broker, kernel_log_capture, f );
+    logBrokerReader_flush( k->capture_reader );
+    return 0;
+}
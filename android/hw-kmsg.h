@@ -13,10 +13,15 @@
 #define _android_kmsg_h
 
 #include "qemu-common.h"
+#include "android/utils/log_broker.h"
 
 /* this chardriver is used to read the kernel messages coming
  * from the first serial port (i.e. /dev/ttyS0) and store them
  * in memory for later...
+ *
+ * the messages are received once, and fanned out through a LogBroker
+ * to any number of readers. A slow reader drops messages instead of
+ * slowing down the guest.
  */
 
 typedef enum {
@@ -28,4 +33,17 @@ extern void  android_kmsg_init( AndroidKmsgFlags  flags );
 
 extern CharDriverState*  android_kmsg_get_cs( void );
 
+/* return the LogBroker that receives the kernel messages, use it to
+ * add new readers. A new reader first receives the most recent messages
+ * kept in memory. */
+extern LogBroker*  android_kmsg_get_broker( void );
+
+/* start saving the kernel messages to a file, starting with the most
+ * recent ones kept in memory. This stops any capture in progress.
+ * return 0 on success, or -1 on failure (with errno set) */
+extern int   android_kmsg_capture_start( const char*  filepath );
+
+/* stop the current kernel messages capture, if any */
+extern void  android_kmsg_capture_stop( void );
+
 #endif /* _android_kmsg_h */
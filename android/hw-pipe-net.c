@@ -16,6 +16,16 @@
 
 /* This file implements the 'tcp:' goldfish pipe type which allows
  * guest clients to directly connect to a TCP port through /dev/qemu_pipe.
+ *
+ * It also implements the reverse direction, where host clients connect to
+ * a guest server without going through the slirp TCP/IP stack: a guest
+ * daemon opens 'tcp:accept:<port>' (or 'unix:accept:<path>') pipes, and the
+ * emulator listens on the host loopback <port> (or the Unix socket <path>).
+ * Each host connection is handed to the oldest waiting pipe, which then
+ * relays its bytes like a connected 'tcp:<port>' pipe. The daemon opens a
+ * new accept pipe for each connection it wants to serve. Host connections
+ * wait in the listen backlog while no pipe is waiting, and the listener is
+ * kept until the emulator exits.
  */
 
 #include "android/sockets.h"
@@ -57,25 +67,52 @@
 
 enum {
     STATE_INIT,
+    STATE_ACCEPTING,
     STATE_CONNECTING,
     STATE_CONNECTED,
     STATE_CLOSING_GUEST,
     STATE_CLOSING_SOCKET
 };
 
-typedef struct {
+typedef struct NetListener  NetListener;
+
+typedef struct NetPipe {
     void*           hwpipe;
     int             state;
     int             wakeWanted;
     LoopIo          io[1];
     AsyncConnector  connector[1];
+    /* In STATE_ACCEPTING, the listener and the next pipe waiting on it */
+    NetListener*    listener;
+    struct NetPipe* nextWaiting;
 } NetPipe;
 
+/* A host socket listening for the connections of 'accept:' pipes */
+struct NetListener {
+    NetListener*  next;
+    char*         name;      /* '<service>:<address>' */
+    Looper*       looper;
+    LoopIo        io[1];
+    NetPipe*      waiting;   /* FIFO of the pipes waiting for a connection */
+    NetPipe**     waitingTail;
+};
+
+static NetListener*  _netListeners;
+
+static void netListener_removePipe( NetListener* listener, NetPipe* pipe );
+
 static void
 netPipe_free( NetPipe*  pipe )
 {
     int  fd;
 
+    /* A pipe that hasn't been accepted yet has no socket */
+    if (pipe->state == STATE_ACCEPTING) {
+        netListener_removePipe(pipe->listener, pipe);
+        AFREE(pipe);
+        return;
+    }
+
     /* Close the socket */
     fd = pipe->io->fd;
     loopIo_done(pipe->io);
@@ -89,6 +126,9 @@ netPipe_free( NetPipe*  pipe )
 static void
 netPipe_resetState( NetPipe* pipe )
 {
+    if (pipe->state == STATE_ACCEPTING)
+        return;
+
     if ((pipe->wakeWanted & PIPE_WAKE_WRITE) != 0) {
         loopIo_wantWrite(pipe->io);
     } else {
@@ -237,7 +277,7 @@ static int netPipeReadySend(NetPipe *pipe)
 {
     if (pipe->state == STATE_CONNECTED)
         return 0;
-    else if (pipe->state == STATE_CONNECTING)
+    else if (pipe->state == STATE_CONNECTING || pipe->state == STATE_ACCEPTING)
         return PIPE_ERROR_AGAIN;
     else if (pipe->hwpipe == NULL)
         return PIPE_ERROR_INVAL;
@@ -313,6 +353,9 @@ netPipe_recvBuffers( void* opaque, GoldfishPipeBuffer*  buffers, int  numBuffers
     GoldfishPipeBuffer* buff = buffers;
     GoldfishPipeBuffer* buffEnd = buff + numBuffers;
 
+    if (pipe->state == STATE_ACCEPTING)
+        return PIPE_ERROR_AGAIN;
+
     for (; buff < buffEnd; buff++)
         count += buff->size;
 
@@ -360,9 +403,14 @@ static unsigned
 netPipe_poll( void* opaque )
 {
     NetPipe*  pipe = opaque;
-    unsigned  mask = loopIo_poll(pipe->io);
+    unsigned  mask;
     unsigned  ret  = 0;
 
+    if (pipe->state == STATE_ACCEPTING)
+        return 0;
+
+    mask = loopIo_poll(pipe->io);
+
     if (mask & LOOP_IO_READ)
         ret |= PIPE_POLL_IN;
     if (mask & LOOP_IO_WRITE)
@@ -383,20 +431,141 @@ netPipe_wakeOn( void* opaque, int flags )
 }
 
 
+/* Called when a host client connects to a listener */
+static void
+netListener_io_func( void* opaque, int fd, unsigned events )
+{
+    NetListener*  listener = opaque;
+
+    while (listener->waiting != NULL) {
+        NetPipe*  pipe = listener->waiting;
+        int       sock = socket_accept(fd, NULL);
+
+        if (sock < 0)
+            break;
+
+        D("%s: %s accepted connection", __FUNCTION__, listener->name);
+        socket_set_nonblock(sock);
+        /* Relay small messages without delay, like a local connection */
+        if (!strncmp(listener->name, "tcp:", 4))
+            socket_set_nodelay(sock);
+        netListener_removePipe(listener, pipe);
+
+        pipe->state = STATE_CONNECTED;
+        loopIo_init(pipe->io, listener->looper, sock, netPipe_io_func, pipe);
+        netPipe_resetState(pipe);
+    }
+
+    /* Leave the next connections in the backlog until a pipe waits */
+    if (listener->waiting == NULL)
+        loopIo_dontWantRead(listener->io);
+}
+
+static void
+netListener_removePipe( NetListener* listener, NetPipe* pipe )
+{
+    NetPipe**  pnode = &listener->waiting;
+
+    while (*pnode != NULL) {
+        if (*pnode == pipe) {
+            *pnode = pipe->nextWaiting;
+            break;
+        }
+        pnode = &(*pnode)->nextWaiting;
+    }
+    /* Find the new tail */
+    listener->waitingTail = &listener->waiting;
+    while (*listener->waitingTail != NULL)
+        listener->waitingTail = &(*listener->waitingTail)->nextWaiting;
+    pipe->nextWaiting = NULL;
+}
+
+/* Return the listener named 'name', creating it on first use with the
+ * socket returned by 'createFd(address)'. Returns NULL if that fails. */
+static NetListener*
+netListener_get( const char* name, Looper* looper, int (*createFd)(const char*), const char* address )
+{
+    NetListener*  listener;
+    int           fd;
+
+    for (listener = _netListeners; listener != NULL; listener = listener->next) {
+        if (!strcmp(listener->name, name))
+            return listener;
+    }
+
+    fd = createFd(address);
+    if (fd < 0) {
+        D("%s: Could not listen on %s: %s", __FUNCTION__, name, errno_str);
+        return NULL;
+    }
+    socket_set_nonblock(fd);
+
+    ANEW0(listener);
+    listener->name = ASTRDUP(name);
+    listener->looper = looper;
+    listener->waitingTail = &listener->waiting;
+    loopIo_init(listener->io, looper, fd, netListener_io_func, listener);
+
+    listener->next = _netListeners;
+    _netListeners = listener;
+    return listener;
+}
+
+/* Create a pipe that waits for a connection to 'listener' */
+static void*
+netPipe_initAccept( void* hwpipe, NetListener* listener )
+{
+    NetPipe*  pipe;
+
+    ANEW0(pipe);
+    pipe->hwpipe   = hwpipe;
+    pipe->state    = STATE_ACCEPTING;
+    pipe->listener = listener;
+
+    *listener->waitingTail = pipe;
+    listener->waitingTail  = &pipe->nextWaiting;
+    loopIo_wantRead(listener->io);
+    return pipe;
+}
+
+/* Prefix of the pipe arguments that wait for host connections */
+#define ACCEPT_PREFIX      "accept:"
+#define ACCEPT_PREFIX_LEN  (sizeof(ACCEPT_PREFIX) - 1)
+
+static int
+netListener_createTcp( const char* address )
+{
+    return socket_loopback_server(atoi(address), SOCKET_STREAM);
+}
+
+#ifndef _WIN32
+static int
+netListener_createUnix( const char* address )
+{
+    return socket_unix_server(address, SOCKET_STREAM);
+}
+#endif
+
 void*
 netPipe_initTcp( void* hwpipe, void* _looper, const char* args )
 {
     /* Build SockAddress from arguments. Acceptable formats are:
      *   <port>
+     *   accept:<port>
      */
     SockAddress  address;
     uint16_t     port;
     void*        ret;
+    int          accept = 0;
 
     if (args == NULL) {
         D("%s: Missing address!", __FUNCTION__);
         return NULL;
     }
+    if (!strncmp(args, ACCEPT_PREFIX, ACCEPT_PREFIX_LEN)) {
+        args += ACCEPT_PREFIX_LEN;
+        accept = 1;
+    }
     D("%s: Port is '%s'", __FUNCTION__, args);
 
     /* Now, look at the port number */
@@ -405,9 +574,21 @@ netPipe_initTcp( void* hwpipe, void* _looper, const char* args )
         long  val = strtol(args, &end, 10);
         if (end == NULL || *end != '\0' || val <= 0 || val > 65535) {
             D("%s: Invalid port number: '%s'", __FUNCTION__, args);
+            if (accept)
+                return NULL;
         }
         port = (uint16_t)val;
     }
+
+    if (accept) {
+        char          name[16];
+        NetListener*  listener;
+
+        snprintf(name, sizeof(name), "tcp:%d", port);
+        listener = netListener_get(name, _looper, netListener_createTcp, args);
+        return listener ? netPipe_initAccept(hwpipe, listener) : NULL;
+    }
+
     sock_address_init_inet(&address, SOCK_ADDRESS_INET_LOOPBACK, port);
 
     ret = netPipe_initFromAddress(hwpipe, &address, _looper);
@@ -423,6 +604,7 @@ netPipe_initUnix( void* hwpipe, void* _looper, const char* args )
     /* Build SockAddress from arguments. Acceptable formats are:
      *
      *   <path>
+     *   accept:<path>
      */
     SockAddress  address;
     void*        ret;
@@ -433,6 +615,20 @@ netPipe_initUnix( void* hwpipe, void* _looper, const char* args )
     }
     D("%s: Address is '%s'", __FUNCTION__, args);
 
+    if (!strncmp(args, ACCEPT_PREFIX, ACCEPT_PREFIX_LEN)) {
+        NetListener*  listener;
+        char*         name;
+
+        args += ACCEPT_PREFIX_LEN;
+        if (args[0] == '\0')
+            return NULL;
+        name = android_alloc(strlen(args) + 6);
+        sprintf(name, "unix:%s", args);
+        listener = netListener_get(name, _looper, netListener_createUnix, args);
+        AFREE(name);
+        return listener ? netPipe_initAccept(hwpipe, listener) : NULL;
+    }
+
     sock_address_init_unix(&address, args);
 
     ret = netPipe_initFromAddress(hwpipe, &address, _looper);
@@ -473,6 +669,222 @@ static const GoldfishPipeFuncs  netPipeUnix_funcs = {
 };
 #endif
 
+/**********************************************************************
+ **********************************************************************
+ *****
+ *****  R I N G   P I P E S
+ *****
+ *****/
+
+/* A RingPipe is an opengles pipe that exchanges data with a renderer
+ * thread through an in-process render channel, instead of a socket
+ * connected to the renderer's server. This avoids the kernel copies and
+ * syscalls for each chunk of GL commands.
+ *
+ * The channel's wake callback is invoked from the renderer thread, so
+ * it only writes a byte to a socket pair, whose other end is watched by
+ * the pipe's looper to send the wake signals to the guest.
+ */
+typedef struct {
+    void*   hwpipe;
+    void*   channel;
+    int     wakeWanted;
+    int     wakeFd;     /* write end of the socket pair */
+    LoopIo  io[1];      /* watches the read end of the socket pair */
+} RingPipe;
+
+/* Convert PIPE_WAKE_XXX flags to ANDROID_GLES_CHANNEL_XXX ones */
+static unsigned
+ringPipe_channelFlags( int wakeFlags )
+{
+    unsigned  flags = 0;
+
+    if (wakeFlags & PIPE_WAKE_READ)
+        flags |= ANDROID_GLES_CHANNEL_CAN_READ;
+    if (wakeFlags & PIPE_WAKE_WRITE)
+        flags |= ANDROID_GLES_CHANNEL_CAN_WRITE;
+
+    return flags;
+}
+
+/* Called from the renderer thread */
+static void
+ringPipe_onChannelWake( void* opaque )
+{
+    RingPipe*  pipe = opaque;
+    char       c = 0;
+
+    /* Ignore errors, if the socket pair is full, the looper will
+     * be woken up anyway. */
+    (void)socket_send(pipe->wakeFd, &c, 1);
+}
+
+static void
+ringPipe_io_func( void* opaque, int fd, unsigned events )
+{
+    RingPipe*  pipe = opaque;
+    char       buf[64];
+    unsigned   state;
+    int        wakeFlags = 0;
+
+    /* Drain the socket pair */
+    while (socket_recv(fd, buf, sizeof(buf)) > 0) {
+    }
+
+    state = android_openglesChannelPoll(pipe->channel);
+    if (state & ANDROID_GLES_CHANNEL_CLOSED) {
+        /* Let the guest see the error on its next operation */
+        wakeFlags = pipe->wakeWanted;
+    } else {
+        if ((state & ANDROID_GLES_CHANNEL_CAN_READ) != 0)
+            wakeFlags |= pipe->wakeWanted & PIPE_WAKE_READ;
+        if ((state & ANDROID_GLES_CHANNEL_CAN_WRITE) != 0)
+            wakeFlags |= pipe->wakeWanted & PIPE_WAKE_WRITE;
+    }
+
+    if (wakeFlags != 0) {
+        goldfish_pipe_wake(pipe->hwpipe, wakeFlags);
+        pipe->wakeWanted &= ~wakeFlags;
+    }
+
+    /* The channel only reports a condition once, ask again for the
+     * remaining ones. */
+    if (pipe->wakeWanted != 0 && !(state & ANDROID_GLES_CHANNEL_CLOSED)) {
+        android_openglesChannelWakeOn(pipe->channel,
+                                      ringPipe_channelFlags(pipe->wakeWanted));
+    }
+}
+
+static void*
+ringPipe_init( void* hwpipe, Looper* looper )
+{
+    RingPipe*  pipe;
+    int        readFd;
+
+    ANEW0(pipe);
+    pipe->hwpipe = hwpipe;
+
+    if (socket_pair(&readFd, &pipe->wakeFd) < 0) {
+        D("%s: Could not create socket pair: %s", __FUNCTION__, errno_str);
+        AFREE(pipe);
+        return NULL;
+    }
+    loopIo_init(pipe->io, looper, readFd, ringPipe_io_func, pipe);
+    loopIo_wantRead(pipe->io);
+
+    pipe->channel = android_openglesChannelOpen(ringPipe_onChannelWake, pipe);
+    if (pipe->channel == NULL) {
+        D("%s: Could not open render channel", __FUNCTION__);
+        loopIo_done(pipe->io);
+        socket_close(readFd);
+        socket_close(pipe->wakeFd);
+        AFREE(pipe);
+        return NULL;
+    }
+    return pipe;
+}
+
+static void
+ringPipe_closeFromGuest( void* opaque )
+{
+    RingPipe*  pipe = opaque;
+    int        fd = pipe->io->fd;
+
+    /* Closing the channel guarantees that the wake callback will not
+     * be called anymore, so the socket pair can be closed safely. */
+    android_openglesChannelClose(pipe->channel);
+    loopIo_done(pipe->io);
+    socket_close(fd);
+    socket_close(pipe->wakeFd);
+    AFREE(pipe);
+}
+
+static int
+ringPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    RingPipe*  pipe = opaque;
+    int        ret = 0;
+    const GoldfishPipeBuffer* buff = buffers;
+    const GoldfishPipeBuffer* buffEnd = buff + numBuffers;
+
+    for (; buff < buffEnd; buff++) {
+        int  len = android_openglesChannelWrite(pipe->channel,
+                                                buff->data, buff->size);
+        if (len < 0) {
+            return (ret > 0) ? ret : PIPE_ERROR_IO;
+        }
+        ret += len;
+        if ((size_t)len < buff->size) {
+            break;
+        }
+    }
+    return (ret > 0) ? ret : PIPE_ERROR_AGAIN;
+}
+
+static int
+ringPipe_recvBuffers( void* opaque, GoldfishPipeBuffer*  buffers, int  numBuffers )
+{
+    RingPipe*  pipe = opaque;
+    int        ret = 0;
+    int        spun = 0;
+    GoldfishPipeBuffer* buff = buffers;
+    GoldfishPipeBuffer* buffEnd = buff + numBuffers;
+
+    while (buff < buffEnd) {
+        int  len = android_openglesChannelRead(pipe->channel,
+                                               buff->data, buff->size);
+        if (len < 0) {
+            return (ret > 0) ? ret : PIPE_ERROR_IO;
+        }
+        if (len == 0 && ret == 0 && !spun) {
+            /* The guest is usually waiting for the answer of a call the
+             * renderer is decoding right now: poll for it briefly rather
+             * than make the guest block and wait for a wake-up. */
+            spun = 1;
+            if (android_openglesChannelSpin(pipe->channel,
+                                            ANDROID_GLES_CHANNEL_CAN_READ) &
+                ANDROID_GLES_CHANNEL_CAN_READ) {
+                continue;
+            }
+        }
+        ret += len;
+        if ((size_t)len < buff->size) {
+            break;
+        }
+        buff++;
+    }
+    return (ret > 0) ? ret : PIPE_ERROR_AGAIN;
+}
+
+static unsigned
+ringPipe_poll( void* opaque )
+{
+    RingPipe*  pipe = opaque;
+    unsigned   state = android_openglesChannelPoll(pipe->channel);
+    unsigned   ret = 0;
+
+    if (state & ANDROID_GLES_CHANNEL_CAN_READ)
+        ret |= PIPE_POLL_IN;
+    if (state & ANDROID_GLES_CHANNEL_CAN_WRITE)
+        ret |= PIPE_POLL_OUT;
+    if (state & ANDROID_GLES_CHANNEL_CLOSED)
+        ret |= PIPE_POLL_HUP;
+
+    return ret;
+}
+
+static void
+ringPipe_wakeOn( void* opaque, int flags )
+{
+    RingPipe*  pipe = opaque;
+
+    DD("%s: flags=%d", __FUNCTION__, flags);
+
+    pipe->wakeWanted |= flags;
+    android_openglesChannelWakeOn(pipe->channel,
+                                  ringPipe_channelFlags(pipe->wakeWanted));
+}
+
 /* This is set to 1 in android_init_opengles() below, and tested
  * by openglesPipe_init() to refuse a pipe connection if the function
  * was never called.
@@ -491,6 +903,11 @@ openglesPipe_init( void* hwpipe, void* _looper, const char* args )
         return NULL;
     }
 
+    if (android_gles_ring_pipes) {
+        D("Creating ring OpenGLES pipe for GPU emulation!");
+        return ringPipe_init(hwpipe, _looper);
+    }
+
     char server_addr[PATH_MAX];
     android_gles_server_path(server_addr, sizeof(server_addr));
 #ifndef _WIN32
@@ -526,13 +943,58 @@ openglesPipe_init( void* hwpipe, void* _looper, const char* args )
     return pipe;
 }
 
+/* The functions below dispatch to the ring pipe implementation when
+ * android_gles_ring_pipes is set. This is only decided once, in
+ * android_loadOpenglesEmulation(), before any opengles pipe is opened. */
+static void
+openglesPipe_closeFromGuest( void* opaque )
+{
+    if (android_gles_ring_pipes)
+        ringPipe_closeFromGuest(opaque);
+    else
+        netPipe_closeFromGuest(opaque);
+}
+
+static int
+openglesPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    if (android_gles_ring_pipes)
+        return ringPipe_sendBuffers(opaque, buffers, numBuffers);
+    return netPipe_sendBuffers(opaque, buffers, numBuffers);
+}
+
+static int
+openglesPipe_recvBuffers( void* opaque, GoldfishPipeBuffer*  buffers, int  numBuffers )
+{
+    if (android_gles_ring_pipes)
+        return ringPipe_recvBuffers(opaque, buffers, numBuffers);
+    return netPipe_recvBuffers(opaque, buffers, numBuffers);
+}
+
+static unsigned
+openglesPipe_poll( void* opaque )
+{
+    if (android_gles_ring_pipes)
+        return ringPipe_poll(opaque);
+    return netPipe_poll(opaque);
+}
+
+static void
+openglesPipe_wakeOn( void* opaque, int flags )
+{
+    if (android_gles_ring_pipes)
+        ringPipe_wakeOn(opaque, flags);
+    else
+        netPipe_wakeOn(opaque, flags);
+}
+
 static const GoldfishPipeFuncs  openglesPipe_funcs = {
     openglesPipe_init,
-    netPipe_closeFromGuest,
-    netPipe_sendBuffers,
-    netPipe_recvBuffers,
-    netPipe_poll,
-    netPipe_wakeOn,
+    openglesPipe_closeFromGuest,
+    openglesPipe_sendBuffers,
+    openglesPipe_recvBuffers,
+    openglesPipe_poll,
+    openglesPipe_wakeOn,
     NULL,  /* we can't save these */
     NULL,  /* we can't load these */
 };
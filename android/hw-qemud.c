@@ -17,6 +17,7 @@
 #include "android/looper.h"
 #include "hw/hw.h"
 #include "hw/android/goldfish/pipe.h"
+#include "qemu/thread.h"
 #include "sysemu/char.h"
 #include "android/charpipe.h"
 #include "android/cbuffer.h"
@@ -599,10 +600,70 @@ struct QemudPipeMessage {
     /* Offset in the message buffer of the chunk, that has not been sent
      * to the pipe yet. */
     size_t              offset;
+    /* Size of the buffer following the descriptor, which can be larger
+     * than |size| for pooled messages. */
+    size_t              capacity;
     /* Links next message in the client. */
     QemudPipeMessage*   next;
 };
 
+/* Pipe message buffers of this size are kept in a free list when they are
+ * released, instead of being freed. Nearly all service messages (sensors,
+ * GPS, fingerprint, control messages, and their frame header) fit in one.
+ */
+#define  PIPE_MESSAGE_POOL_CAPACITY   4096
+
+/* Max number of message buffers kept in the free list. */
+#define  PIPE_MESSAGE_POOL_MAX        32
+
+static QemudPipeMessage*  _pipe_message_pool;
+static int                _pipe_message_pool_count;
+
+/* Allocates a pipe message able to hold |size| bytes, from the free list if
+ * possible. The descriptor and the message buffer are allocated at once.
+ */
+static QemudPipeMessage*
+_qemud_pipe_message_alloc(size_t size)
+{
+    QemudPipeMessage* msg;
+
+    if (size <= PIPE_MESSAGE_POOL_CAPACITY && _pipe_message_pool != NULL) {
+        msg = _pipe_message_pool;
+        _pipe_message_pool = msg->next;
+        _pipe_message_pool_count--;
+    } else {
+        size_t capacity = size;
+        if (capacity < PIPE_MESSAGE_POOL_CAPACITY) {
+            capacity = PIPE_MESSAGE_POOL_CAPACITY;
+        }
+        msg = (QemudPipeMessage*)malloc(sizeof(QemudPipeMessage) + capacity);
+        if (msg == NULL) {
+            return NULL;
+        }
+        /* Message starts right after the descriptor. */
+        msg->message = (uint8_t*)(msg + 1);
+        msg->capacity = capacity;
+    }
+    msg->size = size;
+    msg->offset = 0;
+    msg->next = NULL;
+    return msg;
+}
+
+/* Releases a message allocated with _qemud_pipe_message_alloc(). */
+static void
+_qemud_pipe_message_free(QemudPipeMessage* msg)
+{
+    if (msg->capacity == PIPE_MESSAGE_POOL_CAPACITY &&
+        _pipe_message_pool_count < PIPE_MESSAGE_POOL_MAX) {
+        msg->next = _pipe_message_pool;
+        _pipe_message_pool = msg;
+        _pipe_message_pool_count++;
+    } else {
+        free(msg);
+    }
+}
+
 
 /* A QemudClient models a single client as seen by the emulator.
  * Each client has its own channel id (for the serial qemud), or pipe descriptor
@@ -638,6 +699,11 @@ typedef struct QemudPipe {
     QemudService*   service;
     /* Client for this pipe. */
     QemudClient*    client;
+    /* Buffer used to gather guest writes that span several pipe buffers,
+     * kept for the next ones. */
+    uint8_t*        gather;
+    /* Size of the |gather| buffer. */
+    size_t          gather_size;
 } QemudPipe;
 
 struct QemudClient {
@@ -675,6 +741,9 @@ struct QemudClient {
         struct {
             QemudPipe*          qemud_pipe;
             QemudPipeMessage*   messages;
+            /* Points to the 'next' field of the last message, or to
+             * |messages| if the list is empty. */
+            QemudPipeMessage**  messages_tail;
         } Pipe;
     } ProtocolSelector;
 };
@@ -711,6 +780,9 @@ qemud_client_prepend( QemudClient*  c, QemudClient** plist )
         c->next->pref = &c->next;
 }
 
+/* pass a complete message to the service implementation, see below */
+static void  qemud_client_dispatch( QemudClient*  c, uint8_t*  msg, int  msglen );
+
 /* receive a new message from a client, and dispatch it to
  * the real service implementation.
  */
@@ -721,8 +793,7 @@ qemud_client_recv( void*  opaque, uint8_t*  msg, int  msglen )
 
     /* no framing, things are simple */
     if (!c->framing) {
-        if (c->clie_recv)
-            c->clie_recv( c->clie_opaque, msg, msglen, c );
+        qemud_client_dispatch( c, msg, msglen );
         return;
     }
 
@@ -740,10 +811,9 @@ qemud_client_recv( void*  opaque, uint8_t*  msg, int  msglen )
         int  len = hex2int( msg, FRAME_HEADER_SIZE );
 
         if (len >= 0 && msglen == len + FRAME_HEADER_SIZE) {
-            if (c->clie_recv)
-                c->clie_recv( c->clie_opaque,
-                              msg+FRAME_HEADER_SIZE,
-                              msglen-FRAME_HEADER_SIZE, c );
+            qemud_client_dispatch( c,
+                                   msg+FRAME_HEADER_SIZE,
+                                   msglen-FRAME_HEADER_SIZE );
             return;
         }
     }
@@ -788,8 +858,7 @@ qemud_client_recv( void*  opaque, uint8_t*  msg, int  msglen )
         /* Technically, calling 'clie_recv' can destroy client object 'c'
          * if it decides to close the connection, so ensure we don't
          * use/dereference it after the call. */
-        if (c->clie_recv)
-            c->clie_recv( c->clie_opaque, c->payload->buff, c->payload->size, c );
+        qemud_client_dispatch( c, c->payload->buff, c->payload->size );
 
         AFREE(data);
     }
@@ -812,7 +881,7 @@ _qemud_client_free(QemudClient* c)
             while (*msg_list != NULL) {
                 QemudPipeMessage* to_free = *msg_list;
                 *msg_list = to_free->next;
-                free(to_free);
+                _qemud_pipe_message_free(to_free);
             }
         }
         if (c->param != NULL) {
@@ -822,6 +891,11 @@ _qemud_client_free(QemudClient* c)
     }
 }
 
+/* worker thread support, see below */
+typedef struct QemudWorker  QemudWorker;
+static void  qemud_worker_close_client( QemudClient*  c );
+static void  _qemud_main_cancel_client( QemudClient*  c );
+
 /* disconnect a client. this automatically frees the QemudClient.
  * note that this also removes the client from the global list
  * and from its service's list, if any.
@@ -872,7 +946,9 @@ qemud_client_disconnect( void*  opaque, int guest_close )
         qemud_serial_send(c->ProtocolSelector.Serial.serial, 0, 0, (uint8_t*)tmp, p-tmp);
     }
 
-    /* call the client close callback */
+    /* call the client close callback, in the worker thread of the service,
+     * if any, once it is done with the messages it is handling */
+    qemud_worker_close_client(c);
     if (c->clie_close) {
         c->clie_close(c->clie_opaque);
         c->clie_close = NULL;
@@ -885,6 +961,9 @@ qemud_client_disconnect( void*  opaque, int guest_close )
         c->service = NULL;
     }
 
+    /* drop what the service asked to send to it from its worker thread */
+    _qemud_main_cancel_client(c);
+
     _qemud_client_free(c);
 }
 
@@ -911,6 +990,8 @@ qemud_client_alloc( int               channel_id,
         /* Allocating a pipe client. */
         c->protocol = QEMUD_PROTOCOL_PIPE;
         c->ProtocolSelector.Pipe.messages   = NULL;
+        c->ProtocolSelector.Pipe.messages_tail =
+                &c->ProtocolSelector.Pipe.messages;
         c->ProtocolSelector.Pipe.qemud_pipe = NULL;
     } else {
         /* Allocating a serial client. */
@@ -1076,9 +1157,340 @@ struct QemudService {
     QemudServiceSave     serv_save;
     QemudServiceLoad     serv_load;
     void*                serv_opaque;
+    /* worker thread, see qemud_service_set_worker(), or NULL */
+    QemudWorker*         worker;
     QemudService*        next;
 };
 
+/** SERVICE WORKER THREADS
+ **/
+
+/* The callbacks of a service registered with qemud_service_set_worker() run
+ * in its own thread: the main loop queues the received messages, and the
+ * connections and disconnections, as QemudTasks to the worker. The latter
+ * queues the messages, broadcasts and closes requested by the service back
+ * to the main loop, which handles them from a bottom half, in order.
+ *
+ * Connections and disconnections are synchronous, i.e. the main loop waits
+ * for the worker to handle them. This way, the service code runs in a single
+ * thread, and a client is never freed while the worker still uses it.
+ */
+typedef enum {
+    QEMUD_TASK_RECV,        /* call clie_recv() with the message */
+    QEMUD_TASK_SEND,        /* qemud_client_send() the message */
+    QEMUD_TASK_BROADCAST,   /* qemud_service_broadcast() the message */
+    QEMUD_TASK_CLOSE,       /* qemud_client_close() the client */
+    QEMUD_TASK_CALL,        /* call func(opaque) */
+} QemudTaskType;
+
+typedef struct QemudTask  QemudTask;
+struct QemudTask {
+    QemudTaskType   type;
+    QemudClient*    client;
+    QemudService*   service;
+    void          (*func)(void*);
+    void*           opaque;
+    /* Set with the worker lock held once a synchronous call returned,
+     * or NULL for asynchronous tasks. */
+    int*            done;
+    /* Message, zero-terminated like framed ones, following the task. */
+    uint8_t*        msg;
+    int             msglen;
+    QemudTask*      next;
+};
+
+typedef struct {
+    QemudTask*   first;
+    QemudTask**  last;
+} QemudTaskQueue;
+
+struct QemudWorker {
+    QemuThread      thread;
+    /* Protects |tasks| and the |done| flags of the synchronous calls. */
+    QemuMutex       lock;
+    /* Signaled when a task is queued, or a synchronous call returned. */
+    QemuCond        cond;
+    QemudTaskQueue  tasks;
+};
+
+/* Tasks queued to the main loop by the workers, and by other threads with
+ * qemud_service_post(). */
+static struct {
+    int             inited;
+    QemuMutex       lock;
+    QEMUBH*         bh;
+    QemudTaskQueue  tasks;
+} _qemud_main[1];
+
+static QemudTask*
+_qemud_task_new( QemudTaskType  type, const uint8_t*  msg, int  msglen )
+{
+    QemudTask*  t;
+
+    if (msglen < 0)
+        msglen = 0;
+    t = g_malloc0(sizeof(*t) + msglen + 1);
+    t->type   = type;
+    t->msg    = (uint8_t*)(t + 1);
+    t->msglen = msglen;
+    if (msglen > 0)
+        memcpy(t->msg, msg, msglen);
+    t->msg[msglen] = 0;
+    return t;
+}
+
+static void
+_qemud_task_queue_init( QemudTaskQueue*  q )
+{
+    q->first = NULL;
+    q->last  = &q->first;
+}
+
+static void
+_qemud_task_queue_push( QemudTaskQueue*  q, QemudTask*  t )
+{
+    t->next  = NULL;
+    *q->last = t;
+    q->last  = &t->next;
+}
+
+static QemudTask*
+_qemud_task_queue_pop( QemudTaskQueue*  q )
+{
+    QemudTask*  t = q->first;
+
+    if (t != NULL) {
+        q->first = t->next;
+        if (q->first == NULL)
+            q->last = &q->first;
+    }
+    return t;
+}
+
+/* Free the asynchronous tasks of |q| for |client|, or calling
+ * |func(opaque)|. */
+static void
+_qemud_task_queue_remove( QemudTaskQueue*  q,
+                          QemudClient*     client,
+                          void           (*func)(void*),
+                          void*            opaque )
+{
+    QemudTask**  pnode = &q->first;
+    QemudTask*   t;
+
+    while ((t = *pnode) != NULL) {
+        if (t->done == NULL &&
+            ((client != NULL && t->client == client) ||
+             (func != NULL && t->func == func && t->opaque == opaque))) {
+            *pnode = t->next;
+            g_free(t);
+        } else {
+            pnode = &t->next;
+        }
+    }
+    q->last = pnode;
+}
+
+/* Handle the tasks queued to the main loop. */
+static void
+_qemud_main_run( void*  opaque )
+{
+    for (;;) {
+        QemudTask*  t;
+
+        qemu_mutex_lock(&_qemud_main->lock);
+        t = _qemud_task_queue_pop(&_qemud_main->tasks);
+        qemu_mutex_unlock(&_qemud_main->lock);
+        if (t == NULL)
+            break;
+
+        switch (t->type) {
+        case QEMUD_TASK_SEND:
+            qemud_client_send(t->client, t->msg, t->msglen);
+            break;
+        case QEMUD_TASK_BROADCAST:
+            qemud_service_broadcast(t->service, t->msg, t->msglen);
+            break;
+        case QEMUD_TASK_CLOSE:
+            qemud_client_close(t->client);
+            break;
+        case QEMUD_TASK_CALL:
+            t->func(t->opaque);
+            break;
+        default:
+            break;
+        }
+        g_free(t);
+    }
+}
+
+/* Must be called from the main loop before any other thread can queue
+ * tasks to it. */
+static void
+_qemud_main_init( void )
+{
+    if (_qemud_main->inited)
+        return;
+    _qemud_main->inited = 1;
+    qemu_mutex_init(&_qemud_main->lock);
+    _qemud_task_queue_init(&_qemud_main->tasks);
+    _qemud_main->bh = qemu_bh_new(_qemud_main_run, NULL);
+}
+
+static void
+_qemud_main_push( QemudTask*  t )
+{
+    qemu_mutex_lock(&_qemud_main->lock);
+    _qemud_task_queue_push(&_qemud_main->tasks, t);
+    qemu_bh_schedule(_qemud_main->bh);
+    qemu_mutex_unlock(&_qemud_main->lock);
+}
+
+static void
+_qemud_main_cancel_client( QemudClient*  c )
+{
+    if (!_qemud_main->inited)
+        return;
+    qemu_mutex_lock(&_qemud_main->lock);
+    _qemud_task_queue_remove(&_qemud_main->tasks, c, NULL, NULL);
+    qemu_mutex_unlock(&_qemud_main->lock);
+}
+
+static void*
+_qemud_worker_main( void*  opaque )
+{
+    QemudWorker*  w = opaque;
+
+    qemu_mutex_lock(&w->lock);
+    for (;;) {
+        QemudTask*  t = _qemud_task_queue_pop(&w->tasks);
+        if (t == NULL) {
+            qemu_cond_wait(&w->cond, &w->lock);
+            continue;
+        }
+        qemu_mutex_unlock(&w->lock);
+
+        if (t->type == QEMUD_TASK_RECV) {
+            QemudClient*  c = t->client;
+            if (c->clie_recv)
+                c->clie_recv(c->clie_opaque, t->msg, t->msglen, c);
+        } else {
+            t->func(t->opaque);
+        }
+
+        qemu_mutex_lock(&w->lock);
+        if (t->done != NULL) {
+            /* The caller owns the task. */
+            *t->done = 1;
+            qemu_cond_broadcast(&w->cond);
+        } else {
+            g_free(t);
+        }
+    }
+    return NULL;
+}
+
+static ABool
+_qemud_on_worker( QemudService*  sv )
+{
+    return sv != NULL && sv->worker != NULL &&
+           qemu_thread_is_self(&sv->worker->thread);
+}
+
+static void
+qemud_worker_push( QemudWorker*  w, QemudTask*  t )
+{
+    qemu_mutex_lock(&w->lock);
+    _qemud_task_queue_push(&w->tasks, t);
+    qemu_cond_broadcast(&w->cond);
+    qemu_mutex_unlock(&w->lock);
+}
+
+/* Call |func(opaque)| in the worker thread once the tasks queued before
+ * are done, and wait for it to return. */
+static void
+qemud_worker_call( QemudWorker*  w, void (*func)(void*), void*  opaque )
+{
+    QemudTask*  t;
+    int         done = 0;
+
+    if (qemu_thread_is_self(&w->thread)) {
+        func(opaque);
+        return;
+    }
+    t = _qemud_task_new(QEMUD_TASK_CALL, NULL, 0);
+    t->func   = func;
+    t->opaque = opaque;
+    t->done   = &done;
+
+    qemu_mutex_lock(&w->lock);
+    _qemud_task_queue_push(&w->tasks, t);
+    qemu_cond_broadcast(&w->cond);
+    while (!done)
+        qemu_cond_wait(&w->cond, &w->lock);
+    qemu_mutex_unlock(&w->lock);
+    g_free(t);
+}
+
+static void
+_qemud_client_close_task( void*  opaque )
+{
+    QemudClient*  c = opaque;
+
+    c->clie_close(c->clie_opaque);
+    c->clie_close = NULL;
+}
+
+/* Drop the messages of a disconnected client that its service's worker, if
+ * any, didn't handle yet, and call its clie_close() there once it is done
+ * with the current one. */
+static void
+qemud_worker_close_client( QemudClient*  c )
+{
+    QemudWorker*  w = c->service ? c->service->worker : NULL;
+
+    if (w == NULL)
+        return;
+    qemu_mutex_lock(&w->lock);
+    _qemud_task_queue_remove(&w->tasks, c, NULL, NULL);
+    qemu_mutex_unlock(&w->lock);
+    if (c->clie_close)
+        qemud_worker_call(w, _qemud_client_close_task, c);
+}
+
+static void
+_qemud_nop( void*  opaque )
+{
+}
+
+/* Wait for the workers to handle the messages received so far, then
+ * deliver what they sent, e.g. before saving a snapshot. */
+static void
+qemud_workers_flush( QemudService*  services )
+{
+    QemudService*  s;
+
+    for (s = services; s; s = s->next) {
+        if (s->worker)
+            qemud_worker_call(s->worker, _qemud_nop, NULL);
+    }
+    if (_qemud_main->inited)
+        _qemud_main_run(NULL);
+}
+
+static void
+qemud_client_dispatch( QemudClient*  c, uint8_t*  msg, int  msglen )
+{
+    if (c->service && c->service->worker) {
+        QemudTask*  t = _qemud_task_new(QEMUD_TASK_RECV, msg, msglen);
+        t->client = c;
+        qemud_worker_push(c->service->worker, t);
+        return;
+    }
+    if (c->clie_recv)
+        c->clie_recv( c->clie_opaque, msg, msglen, c );
+}
+
 /* Create a new QemudService object */
 static QemudService*
 qemud_service_new( const char*          name,
@@ -1149,13 +1561,36 @@ qemud_service_remove_client( QemudService*  s, QemudClient*  c )
  *
  * returns the client or NULL if an error occurred
  */
+typedef struct {
+    QemudService*  sv;
+    int            channel_id;
+    const char*    client_param;
+    QemudClient*   client;
+} QemudConnectCall;
+
+static void
+_qemud_service_connect_task( void*  opaque )
+{
+    QemudConnectCall*  call = opaque;
+    QemudService*      sv = call->sv;
+
+    call->client = sv->serv_connect( sv->serv_opaque, sv, call->channel_id,
+                                     call->client_param );
+}
+
 static QemudClient*
 qemud_service_connect_client(QemudService *sv,
                              int channel_id,
                              const char* client_param)
 {
-    QemudClient* client =
-        sv->serv_connect( sv->serv_opaque, sv, channel_id, client_param );
+    QemudConnectCall  call = { sv, channel_id, client_param, NULL };
+    QemudClient*      client;
+
+    if (sv->worker)
+        qemud_worker_call(sv->worker, _qemud_service_connect_task, &call);
+    else
+        _qemud_service_connect_task(&call);
+    client = call.client;
     if (client == NULL) {
         D("%s: registration failed for '%s' service",
           __FUNCTION__, sv->name);
@@ -1603,43 +2038,31 @@ qemud_client_new( QemudService*     service,
     return c;
 }
 
-/* Caches a service message into the client's descriptor.
+/* Queues a service message into the client's descriptor.
  *
  * See comments on QemudPipeMessage structure for more info.
  */
 static void
-_qemud_pipe_cache_buffer(QemudClient* client, const uint8_t*  msg, int  msglen)
+_qemud_pipe_queue_message(QemudClient* client, QemudPipeMessage* msg)
 {
-    QemudPipeMessage* buf;
-    QemudPipeMessage** ins_at = &client->ProtocolSelector.Pipe.messages;
-
-    /* Allocate descriptor big enough to contain message as well. */
-    buf = (QemudPipeMessage*)malloc(msglen + sizeof(QemudPipeMessage));
-    if (buf != NULL) {
-        /* Message starts right after the descriptor. */
-        buf->message = (uint8_t*)buf + sizeof(QemudPipeMessage);
-        buf->size = msglen;
-        memcpy(buf->message, msg, msglen);
-        buf->offset = 0;
-        buf->next = NULL;
-        while (*ins_at != NULL) {
-            ins_at = &(*ins_at)->next;
-        }
-        *ins_at = buf;
-        /* Notify the pipe that there is data to read. */
-        goldfish_pipe_wake(client->ProtocolSelector.Pipe.qemud_pipe->hwpipe,
-                           PIPE_WAKE_READ);
-    }
+    *client->ProtocolSelector.Pipe.messages_tail = msg;
+    client->ProtocolSelector.Pipe.messages_tail = &msg->next;
+    /* Notify the pipe that there is data to read. */
+    goldfish_pipe_wake(client->ProtocolSelector.Pipe.qemud_pipe->hwpipe,
+                       PIPE_WAKE_READ);
 }
 
 /* Sends service message to the client.
+ *
+ * Unlike the serial port, pipes have no MTU, so the whole message, with its
+ * frame header if any, is copied once into a single pipe message.
  */
 static void
 _qemud_pipe_send(QemudClient*  client, const uint8_t*  msg, int  msglen)
 {
-    uint8_t   frame[FRAME_HEADER_SIZE];
-    int       avail, len = msglen;
-    int framing = client->framing;
+    QemudPipeMessage* buf;
+    uint8_t* data;
+    int len = msglen;
 
     if (msglen <= 0)
         return;
@@ -1647,33 +2070,27 @@ _qemud_pipe_send(QemudClient*  client, const uint8_t*  msg, int  msglen)
     D("%s: len=%3d '%s'",
       __FUNCTION__, msglen, quote_bytes((const void*)msg, msglen));
 
-    if (framing) {
+    if (client->framing) {
         len += FRAME_HEADER_SIZE;
     }
 
-    /* packetize the payload for the serial MTU */
-    while (len > 0)
-    {
-        avail = len;
-        if (avail > MAX_SERIAL_PAYLOAD)
-            avail = MAX_SERIAL_PAYLOAD;
-
-        /* insert frame header when needed */
-        if (framing) {
-            int2hex(frame, FRAME_HEADER_SIZE, msglen);
-            T("%s: '%.*s'", __FUNCTION__, FRAME_HEADER_SIZE, frame);
-            _qemud_pipe_cache_buffer(client, frame, FRAME_HEADER_SIZE);
-            avail  -= FRAME_HEADER_SIZE;
-            len    -= FRAME_HEADER_SIZE;
-            framing = 0;
-        }
+    buf = _qemud_pipe_message_alloc(len);
+    if (buf == NULL) {
+        return;
+    }
+    data = buf->message;
 
-        /* write message content */
-        T("%s: '%.*s'", __FUNCTION__, avail, msg);
-        _qemud_pipe_cache_buffer(client, msg, avail);
-        msg += avail;
-        len -= avail;
+    /* insert frame header when needed */
+    if (client->framing) {
+        int2hex(data, FRAME_HEADER_SIZE, msglen);
+        T("%s: '%.*s'", __FUNCTION__, FRAME_HEADER_SIZE, data);
+        data += FRAME_HEADER_SIZE;
     }
+
+    /* write message content */
+    T("%s: '%.*s'", __FUNCTION__, msglen, msg);
+    memcpy(data, msg, msglen);
+    _qemud_pipe_queue_message(client, buf);
 }
 
 /* this can be used by a service implementation to send an answer
@@ -1682,6 +2099,12 @@ _qemud_pipe_send(QemudClient*  client, const uint8_t*  msg, int  msglen)
 void
 qemud_client_send ( QemudClient*  client, const uint8_t*  msg, int  msglen )
 {
+    if (_qemud_on_worker(client->service)) {
+        QemudTask*  t = _qemud_task_new(QEMUD_TASK_SEND, msg, msglen);
+        t->client = client;
+        _qemud_main_push(t);
+        return;
+    }
     if (_is_pipe_client(client)) {
         _qemud_pipe_send(client, msg, msglen);
     } else {
@@ -1714,6 +2137,12 @@ qemud_client_set_framing( QemudClient*  client, int  framing )
 void
 qemud_client_close( QemudClient*  client )
 {
+    if (_qemud_on_worker(client->service)) {
+        QemudTask*  t = _qemud_task_new(QEMUD_TASK_CLOSE, NULL, 0);
+        t->client = client;
+        _qemud_main_push(t);
+        return;
+    }
     qemud_client_disconnect(client, 0);
 }
 
@@ -1760,6 +2189,8 @@ qemud_save(QEMUFile* f, void* opaque)
 {
     QemudMultiplexer *m = opaque;
 
+    qemud_workers_flush(m->services);
+
     qemud_serial_save(f, m->serial);
 
     /* save service states */
@@ -1859,35 +2290,27 @@ _save_pipe_message(QEMUFile* f, QemudPipeMessage* msg)
     qemu_put_buffer(f, msg->message, msg->size);
 }
 
-/* Loads pending pipe messages from the snapshot file.
- * Return:
- *  List of pending pipe messages loaded from snapshot, or NULL if snapshot didn't
- *  contain saved messages.
+/* Loads pending pipe messages from the snapshot file, and appends them to
+ * the pending messages of client |c|.
  */
-static QemudPipeMessage*
-_load_pipe_message(QEMUFile* f)
+static void
+_load_pipe_message(QEMUFile* f, QemudClient* c)
 {
-    QemudPipeMessage* ret = NULL;
-    QemudPipeMessage** next = &ret;
+    QemudPipeMessage** next = c->ProtocolSelector.Pipe.messages_tail;
 
     uint32_t size = qemu_get_be32(f);
     while (size != 0) {
-        QemudPipeMessage* wrk;
-        ANEW0(wrk);
-        *next = wrk;
-        wrk->size = size;
-        wrk->offset = qemu_get_be32(f);
-        wrk->message = malloc(wrk->size);
-        if (wrk->message == NULL) {
+        QemudPipeMessage* wrk = _qemud_pipe_message_alloc(size);
+        if (wrk == NULL) {
             APANIC("Unable to allocate buffer for pipe's pending message.");
         }
+        *next = wrk;
+        wrk->offset = qemu_get_be32(f);
         qemu_get_buffer(f, wrk->message, wrk->size);
         next = &wrk->next;
-        *next = NULL;
         size = qemu_get_be32(f);
     }
-
-    return ret;
+    c->ProtocolSelector.Pipe.messages_tail = next;
 }
 
 /* This is a callback that gets invoked when guest is connecting to the service.
@@ -1967,6 +2390,9 @@ _qemudPipe_closeFromGuest( void* opaque )
     } else {
         D("%s: Unexpected NULL client", __FUNCTION__);
     }
+    /* The pipe doesn't call us back after closing. */
+    free(pipe->gather);
+    AFREE(pipe);
 }
 
 /* Called when the guest has sent some data to the client.
@@ -1992,21 +2418,29 @@ _qemudPipe_sendBuffers(void* opaque,
         transferred = buffers->size;
     } else {
         /* If there are multiple buffers involved, collect all data in one buffer
-         * before calling the high level client. */
-        uint8_t* msg, *wrk;
+         * before calling the high level client. The buffer is kept by the
+         * pipe, so that the next large writes don't need an allocation. */
+        uint8_t* wrk;
         int n;
         for (n = 0; n < numBuffers; n++) {
             transferred += buffers[n].size;
         }
-        msg = malloc(transferred);
-        wrk = msg;
+        if (transferred > pipe->gather_size) {
+            free(pipe->gather);
+            pipe->gather = malloc(transferred);
+            if (pipe->gather == NULL) {
+                pipe->gather_size = 0;
+                return PIPE_ERROR_NOMEM;
+            }
+            pipe->gather_size = transferred;
+        }
+        wrk = pipe->gather;
         for (n = 0; n < numBuffers; n++) {
             memcpy(wrk, buffers[n].data, buffers[n].size);
             wrk += buffers[n].size;
         }
-        D("%s: %s", __FUNCTION__, quote_bytes((char*)msg, transferred));
-        qemud_client_recv(client, msg, transferred);
-        free(msg);
+        D("%s: %s", __FUNCTION__, quote_bytes((char*)pipe->gather, transferred));
+        qemud_client_recv(client, pipe->gather, transferred);
     }
 
     return transferred;
@@ -2051,7 +2485,10 @@ _qemudPipe_recvBuffers(void* opaque, GoldfishPipeBuffer* buffers, int numBuffers
         if (msg->size == msg->offset) {
             /* We're done with the current message. Go to the next one. */
             *msg_list = msg->next;
-            free(msg);
+            if (*msg_list == NULL) {
+                client->ProtocolSelector.Pipe.messages_tail = msg_list;
+            }
+            _qemud_pipe_message_free(msg);
         }
         if (off_in_buff == buff->size) {
             /* Current pipe buffer is full. Continue with the next one. */
@@ -2151,7 +2588,7 @@ _qemudPipe_load(void* hwpipe, void* pipeOpaque, const char* args, QEMUFile* f)
         return NULL;
 
     /* Load pending messages. */
-    c->ProtocolSelector.Pipe.messages = _load_pipe_message(f);
+    _load_pipe_message(f, c);
 
     /* load client-specific state */
     if (c->clie_load && c->clie_load(f, c, c->clie_opaque)) {
@@ -2313,6 +2750,7 @@ qemud_service_register( const char*          service_name,
     QemudMultiplexer*  m  = _multiplexer;
 
     android_qemud_init();
+    _qemud_main_init();
 
     sv = qemud_service_new(service_name,
                            max_clients,
@@ -2334,10 +2772,64 @@ qemud_service_broadcast( QemudService*  sv,
 {
     QemudClient*  c;
 
+    if (_qemud_on_worker(sv)) {
+        QemudTask*  t = _qemud_task_new(QEMUD_TASK_BROADCAST, msg, msglen);
+        t->service = sv;
+        _qemud_main_push(t);
+        return;
+    }
     for (c = sv->clients; c; c = c->next_serv)
         qemud_client_send(c, msg, msglen);
 }
 
+void
+qemud_service_set_worker( QemudService*  sv )
+{
+    QemudWorker*  w;
+
+    if (sv->worker)
+        return;
+    w = g_malloc0(sizeof(*w));
+    qemu_mutex_init(&w->lock);
+    qemu_cond_init(&w->cond);
+    _qemud_task_queue_init(&w->tasks);
+    qemu_thread_create(&w->thread, _qemud_worker_main, w,
+                       QEMU_THREAD_DETACHED);
+    sv->worker = w;
+    D("Service %s runs in its own thread", sv->name);
+}
+
+void
+qemud_service_post( QemudService*     sv,
+                    QemudServiceTask  task,
+                    void*             opaque )
+{
+    QemudTask*  t = _qemud_task_new(QEMUD_TASK_CALL, NULL, 0);
+
+    t->func   = task;
+    t->opaque = opaque;
+    if (sv->worker)
+        qemud_worker_push(sv->worker, t);
+    else
+        _qemud_main_push(t);
+}
+
+void
+qemud_service_cancel( QemudService*     sv,
+                      QemudServiceTask  task,
+                      void*             opaque )
+{
+    if (sv->worker) {
+        qemu_mutex_lock(&sv->worker->lock);
+        _qemud_task_queue_remove(&sv->worker->tasks, NULL, task, opaque);
+        qemu_mutex_unlock(&sv->worker->lock);
+    } else {
+        qemu_mutex_lock(&_qemud_main->lock);
+        _qemud_task_queue_remove(&_qemud_main->tasks, NULL, task, opaque);
+        qemu_mutex_unlock(&_qemud_main->lock);
+    }
+}
+
 
 
 /*
@@ -146,4 +146,38 @@ extern void           qemud_service_broadcast( QemudService*   sv,
                                                const uint8_t*  msg,
                                                int             msglen );
 
+/* Run the service in its own worker thread, so that slow requests, e.g.
+ * camera frame conversions, don't delay the main loop. Must be called right
+ * after qemud_service_register().
+ *
+ * The 'serv_connect' callback, and the 'clie_recv' and 'clie_close'
+ * callbacks of its clients then run in the worker thread: messages are
+ * received in order, and 'serv_connect' and 'clie_close' block the main
+ * loop until they return, so that all the service code runs in a single
+ * thread. It must not call main loop functions (timers, fd handlers, etc.),
+ * but qemud_client_send(), qemud_client_close() and
+ * qemud_service_broadcast() can be called from it, and are delivered by the
+ * main loop in order.
+ */
+extern void           qemud_service_set_worker( QemudService*  sv );
+
+/* A function posted with qemud_service_post().
+ */
+typedef void (*QemudServiceTask)( void*  opaque );
+
+/* Run 'task(opaque)' in the thread of the service, i.e. its worker thread
+ * after qemud_service_set_worker(), or the main loop otherwise. Can be
+ * called from any thread.
+ */
+extern void           qemud_service_post( QemudService*     sv,
+                                          QemudServiceTask  task,
+                                          void*             opaque );
+
+/* Cancel the calls to 'task(opaque)' posted to the service that didn't run
+ * yet. Must be called from the thread of the service.
+ */
+extern void           qemud_service_cancel( QemudService*     sv,
+                                            QemudServiceTask  task,
+                                            void*             opaque );
+
 #endif /* _android_qemud_h */
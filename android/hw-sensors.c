@@ -132,9 +132,11 @@ typedef struct {
  *   a given sensor (e.g. "accelerometer"), and <flag> must be either
  *   "1" (to enable) or "0" (to disable).
  *
- * - Once at least one sensor is "enabled", this code should periodically
- *   send information about the corresponding enabled sensors. The default
- *   period is 200ms.
+ * - Once at least one sensor is "enabled", this code sends information
+ *   about the corresponding enabled sensors. Reports are only sent when
+ *   a sensor value changes, at most once per delay (see "set-delay"
+ *   below), and optionally every keepalive period (disabled by default,
+ *   see android_sensors_set_keepalive()) when nothing changes.
  *
  * - the HAL module sends "set-delay:<delay>", where <delay> is an integer
  *   corresponding to a time delay in milli-seconds. This corresponds to
@@ -146,8 +148,9 @@ typedef struct {
  *   blocking read that happens in a different thread. This ping-pong makes
  *   the code in the HAL module very simple.
  *
- * - each timer tick, this code sends sensor reports in the following
- *   format (each line corresponds to a different line sent to the module):
+ * - each report is made of the following messages (each line corresponds
+ *   to a different message sent to the module, because the HAL module
+ *   parses one line per message):
  *
  *      acceleration:<x>:<y>:<z>
  *      magnetic-field:<x>:<y>:<z>
@@ -156,16 +159,78 @@ typedef struct {
  *      sync:<time_us>
  *
  *   Where each line before the sync:<time_us> is optional and will only
- *   appear if the corresponding sensor has been enabled by the HAL module.
+ *   appear if the corresponding sensor has been enabled by the HAL module,
+ *   and its value changed since the previous report. A keepalive report
+ *   includes all enabled sensors.
  *
  *   Note that <time_us> is the VM time in micro-seconds when the report
  *   was "taken" by this code. This is adjusted by the HAL module to
  *   emulated system time (using the first sync: to compute an adjustment
  *   offset).
+ *
+ * - the HAL module can send "set-batch:<latency>[:<resample>]", where
+ *   <latency> is the maximum report latency in milli-seconds (at most
+ *   BATCH_MAX_LATENCY_MS), like in the batch() call of the Android sensors
+ *   HAL, and 0 to stop batching. While batching, reports are sent at most
+ *   once per latency, and each report is a single message holding all the
+ *   samples received from a connected device since the previous report,
+ *   with their own time stamps instead of only the last value:
+ *
+ *      batch:<count>\n
+ *      acceleration:<x>:<y>:<z>\n
+ *      sync:<time_us>\n
+ *      acceleration:<x>:<y>:<z>\n
+ *      sync:<time_us>\n
+ *      ...
+ *
+ *   Where <count> is the number of samples, each of them followed by the
+ *   VM time in micro-seconds when it was received. Samples are ordered by
+ *   time for each sensor, but not across sensors. A sensor that changed
+ *   without device samples (e.g. from the console) has a single sample
+ *   taken at the time of the report. Large reports are split into several
+ *   messages.
+ *
+ *   When <resample> is 1, the samples of each sensor are instead linearly
+ *   interpolated at a regular interval given by "set-delay", so that the
+ *   guest receives the rate it requested whatever the rate of the device.
+ *
+ *   Batching is not saved in snapshots, the HAL module receives unbatched
+ *   reports after a snapshot is loaded until it sends "set-batch" again.
+ *
+ * - the HAL module can send "flush" to get a report of pending samples
+ *   right away, without waiting for the batching latency.
  */
 #define  HEADER_SIZE  4
 #define  BUFFER_SIZE  512
 
+/* Number of device samples kept per sensor, must be a power of 2. This is
+ * enough for BATCH_MAX_LATENCY_MS of a 200 Hz stream. */
+#define  SAMPLE_RING_SIZE      256
+
+/* Maximum latency of batched reports, in milli-seconds. */
+#define  BATCH_MAX_LATENCY_MS  1000
+
+/* Maximum size of a batched report message. */
+#define  BATCH_MESSAGE_SIZE    4000
+
+/* Samples further apart than this are not interpolated, the device stopped
+ * sending them in-between. */
+#define  RESAMPLE_MAX_GAP_NS   1000000000LL
+
+/* A sensor value received from a connected device, with the VM time it
+ * was received at. */
+typedef struct {
+    int64_t       time_ns;
+    SensorValues  value;
+} SensorSample;
+
+/* The last samples received for a sensor. |write_pos| is a free-running
+ * counter, whose value modulo SAMPLE_RING_SIZE is the next slot to write. */
+typedef struct {
+    SensorSample  samples[SAMPLE_RING_SIZE];
+    uint32_t      write_pos;
+} SensorSampleRing;
+
 typedef struct HwSensorClient   HwSensorClient;
 
 typedef struct {
@@ -173,6 +238,8 @@ typedef struct {
     Sensor              sensors[MAX_SENSORS];
     HwSensorClient*     clients;
     AndroidSensorsPort* sensors_port;
+    int32_t             keepalive_ms;  /* 0 to disable keepalive reports */
+    SensorSampleRing    samples[MAX_SENSORS];
 } HwSensors;
 
 struct HwSensorClient {
@@ -181,7 +248,13 @@ struct HwSensorClient {
     QemudClient*     client;
     QEMUTimer*       timer;
     uint32_t         enabledMask;
+    uint32_t         changedMask;   /* sensors changed since last report */
     int32_t          delay_ms;
+    int64_t          last_report_ns;
+    int32_t          batch_latency_ms;  /* 0 if reports are not batched */
+    int              resample;
+    uint32_t         sample_pos[MAX_SENSORS];  /* next sample to report */
+    int64_t          resample_next_ns[MAX_SENSORS];
 };
 
 static void
@@ -226,6 +299,7 @@ static HwSensorClient*
 _hwSensorClient_new( HwSensors*  sensors )
 {
     HwSensorClient*  cl;
+    int              nn;
 
     ANEW0(cl);
 
@@ -234,6 +308,9 @@ _hwSensorClient_new( HwSensors*  sensors )
     cl->delay_ms    = 800;
     cl->timer       = timer_new(QEMU_CLOCK_VIRTUAL, SCALE_NS, _hwSensorClient_tick, cl);
 
+    for (nn = 0; nn < MAX_SENSORS; nn++)
+        cl->sample_pos[nn] = sensors->samples[nn].write_pos;
+
     cl->next         = sensors->clients;
     sensors->clients = cl;
 
@@ -275,84 +352,284 @@ _hwSensorClient_send( HwSensorClient*  cl, const uint8_t*  msg, int  msglen )
     qemud_client_send(cl->client, msg, msglen);
 }
 
-static int
-_hwSensorClient_enabled( HwSensorClient*  cl, int  sensorId )
+/* return the minimum delay between two reports, in nanoseconds */
+static int64_t
+_hwSensorClient_delay_ns( HwSensorClient*  cl )
 {
-    return (cl->enabledMask & (1 << sensorId)) != 0;
+    /* use a minimum delay of 20 ms, just to be safe. */
+    int64_t  delay = cl->delay_ms;
+
+    if (delay < 20)
+        delay = 20;
+
+    return delay * 1000000LL;
 }
 
-/* this function is called periodically to send sensor reports
- * to the HAL module, and re-arm the timer if necessary
- */
-static void
-_hwSensorClient_tick( void*  opaque )
+/* return the minimum delay between two reports, in nanoseconds, which is
+ * the batching latency when reports are batched */
+static int64_t
+_hwSensorClient_report_delay_ns( HwSensorClient*  cl )
 {
-    HwSensorClient*  cl = opaque;
-    HwSensors*       hw  = cl->sensors;
-    int64_t          delay = cl->delay_ms;
-    int64_t          now_ns;
-    uint32_t         mask  = cl->enabledMask;
-    Sensor*          sensor;
-    char             buffer[128];
+    int64_t  delay = _hwSensorClient_delay_ns(cl);
+    int64_t  latency = cl->batch_latency_ms * 1000000LL;
 
-    if (_hwSensorClient_enabled(cl, ANDROID_SENSOR_ACCELERATION)) {
-        sensor = &hw->sensors[ANDROID_SENSOR_ACCELERATION];
-        snprintf(buffer, sizeof buffer, "acceleration:%g:%g:%g",
-                 sensor->u.acceleration.x,
-                 sensor->u.acceleration.y,
-                 sensor->u.acceleration.z);
-        _hwSensorClient_send(cl, (uint8_t*)buffer, strlen(buffer));
-    }
+    return (latency > delay) ? latency : delay;
+}
+
+/* format the report line of a sensor value, return its length */
+static int
+_hwSensors_formatValue( int  sensor_id, const SensorValues*  v,
+                        char*  buffer, int  size )
+{
+    int  len = 0;
 
-    if (_hwSensorClient_enabled(cl, ANDROID_SENSOR_MAGNETIC_FIELD)) {
-        sensor = &hw->sensors[ANDROID_SENSOR_MAGNETIC_FIELD];
+    switch (sensor_id) {
+    case ANDROID_SENSOR_ACCELERATION:
+        len = snprintf(buffer, size, "acceleration:%g:%g:%g", v->a, v->b, v->c);
+        break;
+    case ANDROID_SENSOR_MAGNETIC_FIELD:
         /* NOTE: sensors HAL expects "magnetic", not "magnetic-field" name here. */
-        snprintf(buffer, sizeof buffer, "magnetic:%g:%g:%g",
-                 sensor->u.magnetic.x,
-                 sensor->u.magnetic.y,
-                 sensor->u.magnetic.z);
-        _hwSensorClient_send(cl, (uint8_t*)buffer, strlen(buffer));
+        len = snprintf(buffer, size, "magnetic:%g:%g:%g", v->a, v->b, v->c);
+        break;
+    case ANDROID_SENSOR_ORIENTATION:
+        len = snprintf(buffer, size, "orientation:%g:%g:%g", v->a, v->b, v->c);
+        break;
+    case ANDROID_SENSOR_TEMPERATURE:
+        len = snprintf(buffer, size, "temperature:%g", v->a);
+        break;
+    case ANDROID_SENSOR_PROXIMITY:
+        len = snprintf(buffer, size, "proximity:%g", v->a);
+        break;
     }
+    if (len < 0 || len >= size)
+        len = 0;
+    return len;
+}
+
+/* a batched report being built */
+typedef struct {
+    HwSensorClient*  cl;
+    int              count;
+    int              len;
+    char             body[BATCH_MESSAGE_SIZE];
+} HwSensorBatch;
+
+/* send the samples added to a batched report, if any */
+static void
+_hwSensorBatch_flush( HwSensorBatch*  batch )
+{
+    char  msg[BATCH_MESSAGE_SIZE + 32];
+    int   len;
+
+    if (batch->count == 0)
+        return;
+
+    len = snprintf(msg, sizeof msg, "batch:%d\n", batch->count);
+    memcpy(msg + len, batch->body, batch->len);
+    _hwSensorClient_send(batch->cl, (uint8_t*)msg, len + batch->len);
 
-    if (_hwSensorClient_enabled(cl, ANDROID_SENSOR_ORIENTATION)) {
-        sensor = &hw->sensors[ANDROID_SENSOR_ORIENTATION];
-        snprintf(buffer, sizeof buffer, "orientation:%g:%g:%g",
-                 sensor->u.orientation.azimuth,
-                 sensor->u.orientation.pitch,
-                 sensor->u.orientation.roll);
-        _hwSensorClient_send(cl, (uint8_t*)buffer, strlen(buffer));
+    batch->count = 0;
+    batch->len   = 0;
+}
+
+/* add a sample to a batched report */
+static void
+_hwSensorBatch_add( HwSensorBatch*  batch, int  sensor_id,
+                    const SensorValues*  v, int64_t  time_ns )
+{
+    char  line[128];
+    int   len = _hwSensors_formatValue(sensor_id, v, line, sizeof line);
+
+    if (len == 0)
+        return;
+
+    len += snprintf(line + len, sizeof line - len, "\nsync:%" PRId64 "\n",
+                    time_ns/1000);
+    if (len >= (int)sizeof line)
+        return;
+
+    if (batch->len + len > BATCH_MESSAGE_SIZE)
+        _hwSensorBatch_flush(batch);
+
+    memcpy(batch->body + batch->len, line, len);
+    batch->len += len;
+    batch->count++;
+}
+
+/* add the samples of a sensor received since the previous report to a
+ * batched report, return the number of samples added */
+static int
+_hwSensorBatch_addSamples( HwSensorBatch*  batch, int  sensor_id )
+{
+    HwSensorClient*          cl   = batch->cl;
+    const SensorSampleRing*  ring = &cl->sensors->samples[sensor_id];
+    uint32_t                 end  = ring->write_pos;
+    uint32_t                 avail = (end < SAMPLE_RING_SIZE) ? end : SAMPLE_RING_SIZE;
+    uint32_t                 first = end - avail;
+    uint32_t                 pos  = cl->sample_pos[sensor_id];
+    int                      count = 0;
+
+    /* samples overwritten before they could be reported are lost */
+    if (end - pos > avail)
+        pos = first;
+
+    cl->sample_pos[sensor_id] = end;
+
+    if (!cl->resample) {
+        for ( ; pos != end; pos++) {
+            const SensorSample*  s = &ring->samples[pos & (SAMPLE_RING_SIZE-1)];
+            _hwSensorBatch_add(batch, sensor_id, &s->value, s->time_ns);
+            count++;
+        }
+        return count;
     }
 
-    if (_hwSensorClient_enabled(cl, ANDROID_SENSOR_TEMPERATURE)) {
-        sensor = &hw->sensors[ANDROID_SENSOR_TEMPERATURE];
-        snprintf(buffer, sizeof buffer, "temperature:%g",
-                 sensor->u.temperature.celsius);
-        _hwSensorClient_send(cl, (uint8_t*)buffer, strlen(buffer));
+    if (pos == end)
+        return 0;
+
+    /* interpolate from the last reported sample, which is still needed */
+    {
+        int64_t  period = _hwSensorClient_delay_ns(cl);
+        int64_t  next   = cl->resample_next_ns[sensor_id];
+
+        if (pos != first)
+            pos--;
+
+        if (next < ring->samples[pos & (SAMPLE_RING_SIZE-1)].time_ns)
+            next = ring->samples[pos & (SAMPLE_RING_SIZE-1)].time_ns;
+
+        for ( ; pos + 1 != end; pos++) {
+            const SensorSample*  s0 = &ring->samples[pos & (SAMPLE_RING_SIZE-1)];
+            const SensorSample*  s1 = &ring->samples[(pos+1) & (SAMPLE_RING_SIZE-1)];
+            int64_t              span = s1->time_ns - s0->time_ns;
+
+            if (span > RESAMPLE_MAX_GAP_NS && next < s1->time_ns)
+                next = s1->time_ns;
+
+            for ( ; next <= s1->time_ns; next += period) {
+                SensorValues  v;
+                double        f = (span > 0) ? (double)(next - s0->time_ns)/span : 1.;
+
+                v.a = s0->value.a + (s1->value.a - s0->value.a)*f;
+                v.b = s0->value.b + (s1->value.b - s0->value.b)*f;
+                v.c = s0->value.c + (s1->value.c - s0->value.c)*f;
+                _hwSensorBatch_add(batch, sensor_id, &v, next);
+                count++;
+            }
+        }
+        cl->resample_next_ns[sensor_id] = next;
     }
+    return count;
+}
 
-    if (_hwSensorClient_enabled(cl, ANDROID_SENSOR_PROXIMITY)) {
-        sensor = &hw->sensors[ANDROID_SENSOR_PROXIMITY];
-        snprintf(buffer, sizeof buffer, "proximity:%g",
-                 sensor->u.proximity.value);
-        _hwSensorClient_send(cl, (uint8_t*) buffer, strlen(buffer));
+/* send a single-message report of the sensors in |mask| */
+static void
+_hwSensorClient_sendBatch( HwSensorClient*  cl, uint32_t  mask, int64_t  now_ns )
+{
+    HwSensorBatch  batch[1];
+    int            nn;
+
+    batch->cl    = cl;
+    batch->count = 0;
+    batch->len   = 0;
+
+    for (nn = 0; nn < MAX_SENSORS; nn++) {
+        if (!(mask & (1 << nn)))
+            continue;
+        if (_hwSensorBatch_addSamples(batch, nn) > 0)
+            continue;
+
+        /* no device sample, report the current value */
+        _hwSensorBatch_add(batch, nn, &cl->sensors->sensors[nn].u.value,
+                           now_ns);
+        /* and keep resampled time stamps increasing */
+        if (cl->resample)
+            cl->resample_next_ns[nn] = now_ns + _hwSensorClient_delay_ns(cl);
     }
+    _hwSensorBatch_flush(batch);
+}
 
-    now_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+/* send a report of the sensors in |mask|, one message per line */
+static void
+_hwSensorClient_sendReport( HwSensorClient*  cl, uint32_t  mask, int64_t  now_ns )
+{
+    HwSensors*  hw = cl->sensors;
+    char        buffer[128];
+    int         len;
+    int         nn;
+
+    for (nn = 0; nn < MAX_SENSORS; nn++) {
+        if (!(mask & (1 << nn)))
+            continue;
+        len = _hwSensors_formatValue(nn, &hw->sensors[nn].u.value,
+                                     buffer, sizeof buffer);
+        if (len > 0)
+            _hwSensorClient_send(cl, (uint8_t*)buffer, len);
+    }
 
     snprintf(buffer, sizeof buffer, "sync:%" PRId64, now_ns/1000);
     _hwSensorClient_send(cl, (uint8_t*)buffer, strlen(buffer));
+}
 
-    /* rearm timer, use a minimum delay of 20 ms, just to
-     * be safe.
-     */
+/* arm the timer to send a report of the changed sensor values, as soon as
+ * the minimum delay since the previous report allows it */
+static void
+_hwSensorClient_schedule( HwSensorClient*  cl )
+{
+    int64_t  when;
+
+    if ((cl->changedMask & cl->enabledMask) == 0)
+        return;
+
+    when = cl->last_report_ns + _hwSensorClient_report_delay_ns(cl);
+    if (timer_pending(cl->timer) &&
+        (int64_t)timer_expire_time_ns(cl->timer) <= when)
+        return;
+
+    timer_mod(cl->timer, when);
+}
+
+/* this function is called to send sensor reports to the HAL module, when
+ * sensor values changed or the keepalive period expired, and re-arm the
+ * timer for the next keepalive report if necessary
+ */
+static void
+_hwSensorClient_tick( void*  opaque )
+{
+    HwSensorClient*  cl = opaque;
+    HwSensors*       hw  = cl->sensors;
+    int64_t          now_ns;
+    uint32_t         mask  = cl->enabledMask & cl->changedMask;
+
+    /* nothing changed, this is a keepalive report of all enabled sensors */
     if (mask == 0)
+        mask = cl->enabledMask;
+
+    cl->changedMask = 0;
+
+    now_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    if (cl->batch_latency_ms > 0)
+        _hwSensorClient_sendBatch(cl, mask, now_ns);
+    else
+        _hwSensorClient_sendReport(cl, mask, now_ns);
+
+    cl->last_report_ns = now_ns;
+
+    /* rearm timer for the next keepalive report, if any */
+    if (cl->enabledMask == 0 || hw->keepalive_ms <= 0) {
+        timer_del(cl->timer);
         return;
+    }
 
-    if (delay < 20)
-        delay = 20;
+    {
+        int64_t  delay = hw->keepalive_ms * 1000000LL;
+
+        if (delay < _hwSensorClient_report_delay_ns(cl))
+            delay = _hwSensorClient_report_delay_ns(cl);
 
-    delay *= 1000000LL;  /* convert to nanoseconds */
-    timer_mod(cl->timer, now_ns + delay);
+        timer_mod(cl->timer, now_ns + delay);
+    }
 }
 
 /* handle incoming messages from the HAL module */
@@ -401,6 +678,48 @@ _hwSensorClient_receive( HwSensorClient*  cl, uint8_t*  msg, int  msglen )
         return;
     }
 
+    /* "set-batch:<latency>[:<resample>]" is used to batch the samples
+     * received in each report, see the protocol description above
+     */
+    if (msglen > 10 && !memcmp(msg, "set-batch:", 10)) {
+        const char*  q = strchr((const char*)msg + 10, ':');
+        int          latency = atoi((const char*)msg + 10);
+        int          nn;
+
+        if (latency < 0)
+            latency = 0;
+        if (latency > BATCH_MAX_LATENCY_MS)
+            latency = BATCH_MAX_LATENCY_MS;
+
+        cl->batch_latency_ms = latency;
+        cl->resample = (q != NULL && q[1] == '1');
+
+        /* only report the samples received from now on */
+        for (nn = 0; nn < MAX_SENSORS; nn++) {
+            cl->sample_pos[nn] = hw->samples[nn].write_pos;
+            cl->resample_next_ns[nn] = 0;
+        }
+
+        D("%s: %s reports, %d ms latency%s", __FUNCTION__,
+          latency ? "batching" : "not batching", latency,
+          cl->resample ? ", resampled" : "");
+
+        if (cl->enabledMask != 0)
+            _hwSensorClient_tick(cl);
+
+        return;
+    }
+
+    /* "flush" is used to get the pending samples without waiting for
+     * the batching latency
+     */
+    if (msglen == 5 && !memcmp(msg, "flush", 5)) {
+        if (cl->enabledMask != 0)
+            _hwSensorClient_tick(cl);
+
+        return;
+    }
+
     /* "set:<name>:<state>" is used to enable/disable a given
      * sensor. <state> must be 0 or 1
      */
@@ -427,9 +746,10 @@ _hwSensorClient_receive( HwSensorClient*  cl, uint8_t*  msg, int  msglen )
         }
         enabled = (q[0] == '1');
 
-        if (enabled)
+        if (enabled) {
             cl->enabledMask |= (1 << id);
-        else
+            cl->changedMask |= (1 << id);
+        } else
             cl->enabledMask &= ~(1 << id);
 
         if (cl->enabledMask != (uint32_t)oldEnabledMask) {
@@ -496,15 +816,62 @@ _hwSensors_connect( void*  opaque,
     return client;
 }
 
+/* tell all clients that the value of a sensor changed */
+static void
+_hwSensors_notifyChange( HwSensors*  h, int sensor_id )
+{
+    HwSensorClient*  cl;
+
+    for (cl = h->clients; cl != NULL; cl = cl->next) {
+        cl->changedMask |= (1 << sensor_id);
+        _hwSensorClient_schedule(cl);
+    }
+}
+
 /* change the value of the emulated sensor vector */
 static void
 _hwSensors_setSensorValue( HwSensors*  h, int sensor_id, float a, float b, float c )
 {
     Sensor* s = &h->sensors[sensor_id];
 
+    if (s->u.value.a == a && s->u.value.b == b && s->u.value.c == c)
+        return;
+
     s->u.value.a = a;
     s->u.value.b = b;
     s->u.value.c = c;
+
+    _hwSensors_notifyChange(h, sensor_id);
+}
+
+/* record a sample received from a connected device, and change the value of
+ * the emulated sensor vector */
+static void
+_hwSensors_addSample( HwSensors*  h, int sensor_id, float a, float b, float c )
+{
+    SensorSampleRing*  ring = &h->samples[sensor_id];
+    SensorSample*      s    = &ring->samples[ring->write_pos & (SAMPLE_RING_SIZE-1)];
+    Sensor*            sensor = &h->sensors[sensor_id];
+    HwSensorClient*    cl;
+
+    s->time_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    s->value.a = a;
+    s->value.b = b;
+    s->value.c = c;
+    ring->write_pos++;
+
+    if (sensor->u.value.a != a || sensor->u.value.b != b || sensor->u.value.c != c) {
+        _hwSensors_setSensorValue(h, sensor_id, a, b, c);
+        return;
+    }
+
+    /* batched reports include unchanged samples too */
+    for (cl = h->clients; cl != NULL; cl = cl->next) {
+        if (cl->batch_latency_ms > 0) {
+            cl->changedMask |= (1 << sensor_id);
+            _hwSensorClient_schedule(cl);
+        }
+    }
 }
 
 /* Saves available sensors to allow checking availability when loaded.
@@ -619,7 +986,12 @@ static void
 _hwSensors_setProximity( HwSensors*  h, float value )
 {
     Sensor*  s = &h->sensors[ANDROID_SENSOR_PROXIMITY];
+
+    if (s->u.proximity.value == value)
+        return;
+
     s->u.proximity.value = value;
+    _hwSensors_notifyChange(h, ANDROID_SENSOR_PROXIMITY);
 }
 
 /* change the coarse orientation (landscape/portrait) of the emulated device */
@@ -809,6 +1181,49 @@ android_sensors_set( int sensor_id, float a, float b, float c )
     return SENSOR_STATUS_OK;
 }
 
+/* Interface of adding a sample received from a connected device */
+extern int
+android_sensors_add_sample( int sensor_id, float a, float b, float c )
+{
+    HwSensors* hw = _sensorsState;
+
+    if (sensor_id < 0 || sensor_id >= MAX_SENSORS)
+        return SENSOR_STATUS_UNKNOWN;
+
+    if (hw->service != NULL) {
+        if (! hw->sensors[sensor_id].enabled)
+            return SENSOR_STATUS_DISABLED;
+    } else
+        return SENSOR_STATUS_NO_SERVICE;
+
+    _hwSensors_addSample(hw, sensor_id, a, b, c);
+
+    return SENSOR_STATUS_OK;
+}
+
+/* Set the keepalive period */
+extern void
+android_sensors_set_keepalive( int delay_ms )
+{
+    HwSensors*       hw = _sensorsState;
+    HwSensorClient*  cl;
+
+    hw->keepalive_ms = (delay_ms > 0) ? delay_ms : 0;
+
+    /* send a report now, which re-arms or cancels the keepalive timer */
+    for (cl = hw->clients; cl != NULL; cl = cl->next) {
+        if (cl->enabledMask != 0)
+            _hwSensorClient_tick(cl);
+    }
+}
+
+/* Get the keepalive period */
+extern int
+android_sensors_get_keepalive( void )
+{
+    return _sensorsState->keepalive_ms;
+}
+
 /* Get Sensor from sensor id */
 extern uint8_t
 android_sensors_get_sensor_status( int sensor_id )
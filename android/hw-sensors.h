@@ -73,6 +73,11 @@ extern int android_sensors_get( int sensor_id, float* a, float* b, float* c );
 /* set sensor values */
 extern int android_sensors_set( int sensor_id, float a, float b, float c );
 
+/* set sensor values from a sample received from a connected device. Unlike
+ * android_sensors_set(), the sample is kept with the time it was received,
+ * so that the guest can get all of them in batched reports. */
+extern int android_sensors_add_sample( int sensor_id, float a, float b, float c );
+
 /* Get sensor id from sensor name */
 extern int android_sensors_get_id_from_name( char* sensorname );
 
@@ -82,4 +87,12 @@ extern const char* android_sensors_get_name_from_id( int sensor_id );
 /* Get sensor from sensor id */
 extern uint8_t android_sensors_get_sensor_status( int sensor_id );
 
+/* Sensor reports are only sent to the guest when a value changes. Also
+ * send a report of all enabled sensors every |delay_ms| milliseconds when
+ * nothing changes, or never when |delay_ms| is 0 (the default). */
+extern void android_sensors_set_keepalive( int delay_ms );
+
+/* Get the keepalive period in milliseconds, 0 if disabled */
+extern int android_sensors_get_keepalive( void );
+
 #endif /* _android_gps_h */
@@ -43,6 +43,10 @@ void iolooper_modify(IoLooper* iol, int fd, int oldflags, int newflags) {
     asWaiter(iol)->update(fd, toWaiterEvents(newflags));
 }
 
+void iolooper_set(IoLooper* iol, int fd, int flags) {
+    asWaiter(iol)->update(fd, toWaiterEvents(flags));
+}
+
 void iolooper_add_read(IoLooper* iol, int fd) {
     SocketWaiter* waiter = asWaiter(iol);
     unsigned events = waiter->wantedEventsFor(fd);
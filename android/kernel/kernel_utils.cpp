@@ -17,13 +17,13 @@
 #include "android/utils/file_data.h"
 #include "android/utils/path.h"
 #include "android/utils/string.h"
-#include "android/utils/uncompress.h"
 
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <zlib.h>
 
 #define DEBUG_KERNEL  0
 
@@ -67,6 +67,108 @@ const void* memmem(const void* haystack, size_t haystackLen,
 }
 #endif
 
+namespace {
+
+// Copy the NUL-terminated string at |src|, of at most |srcLen| characters,
+// into |dst|, truncating it to |dstLen - 1| characters.
+void copyVersionString(const uint8_t* src, size_t srcLen,
+                       char* dst, size_t dstLen) {
+    if (dstLen == 0) {
+        return;
+    }
+    size_t len = srcLen < dstLen - 1 ? srcLen : dstLen - 1;
+    const void* end = memchr(src, 0, len);
+    if (end) {
+        len = (const uint8_t*)end - src;
+    }
+    memcpy(dst, src, len);
+    dst[len] = 0;
+}
+
+// Inflate the gzip stream of |srcLen| bytes at |src| one chunk at a time,
+// looking for the 'Linux version ' string, and copy it into |dst| like
+// android_imageProbeKernelVersionString(). This stops as soon as the
+// string is found, and never needs to hold the whole uncompressed kernel
+// in memory.
+bool findGzipVersionString(const uint8_t* src, size_t srcLen,
+                           char* dst, size_t dstLen) {
+    const size_t kChunkSize = 64 * 1024;
+    // Large enough to hold the whole string once found, plus a new chunk.
+    const size_t capacity = (dstLen > kChunkSize ? dstLen : kChunkSize) +
+            kChunkSize;
+    PodVector<uint8_t> buffer;
+    buffer.resize(capacity);
+    uint8_t* const buf = buffer.begin();
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.next_in = (Bytef*)src;
+    stream.avail_in = srcLen;
+
+    // magic number from gz_read
+    const int GZIP_WINDOW_BITS = 15 + 16;
+    if (inflateInit2(&stream, GZIP_WINDOW_BITS) != Z_OK) {
+        KERNEL_ERROR << "Kernel decompression error";
+        return false;
+    }
+
+    // Number of bytes in |buf|, which starts with the version string once
+    // |found| is true, or with the last bytes of the previous chunk that
+    // could be the start of it otherwise.
+    size_t len = 0;
+    bool found = false;
+    bool result = false;
+    for (;;) {
+        stream.next_out = buf + len;
+        stream.avail_out = capacity - len;
+        int ret = inflate(&stream, Z_NO_FLUSH);
+        len = capacity - stream.avail_out;
+        // Z_BUF_ERROR means the input is exhausted.
+        bool done = (ret != Z_OK);
+        if (done && ret != Z_STREAM_END) {
+            KERNEL_ERROR << "Kernel decompression error";
+            // it may have been partially decompressed, so we're going to
+            // try to find the version string anyway
+        }
+
+        if (!found) {
+            const uint8_t* start = (const uint8_t*)memmem(
+                    buf, len,
+                    kLinuxVersionStringPrefix,
+                    kLinuxVersionStringPrefixLen);
+            if (start) {
+                len -= start - buf;
+                memmove(buf, start, len);
+                found = true;
+            } else {
+                size_t keep = kLinuxVersionStringPrefixLen - 1;
+                if (keep > len) {
+                    keep = len;
+                }
+                memmove(buf, buf + len - keep, keep);
+                len = keep;
+            }
+        }
+
+        if (found && (done || len + 1 >= dstLen || memchr(buf, 0, len))) {
+            copyVersionString(buf, len, dst, dstLen);
+            result = true;
+            break;
+        }
+        if (done) {
+            break;
+        }
+    }
+    inflateEnd(&stream);
+
+    if (!result) {
+        KERNEL_ERROR << "Could not find 'Linux version ' in kernel!";
+    }
+    return result;
+}
+
+}  // namespace
+
 
 bool android_parseLinuxVersionString(const char* versionString,
                                      KernelVersion* kernelVersion) {
@@ -113,8 +215,6 @@ bool android_imageProbeKernelVersionString(const uint8_t* kernelFileData,
                                            size_t kernelFileSize,
                                            char* dst/*[dstLen]*/,
                                            size_t dstLen) {
-    PodVector<uint8_t> uncompressed;
-
     const uint8_t* uncompressedKernel = NULL;
     size_t uncompressedKernelLen = 0;
 
@@ -157,22 +257,10 @@ bool android_imageProbeKernelVersionString(const uint8_t* kernelFileData,
             size_t compressedKernelLen = kernelFileSize -
                 (compressedKernel - kernelFileData);
 
-            // inflate ratios for all prebuilt kernels on 2014-07-14 is 1.9:1 ~
-            // 3.43:1 not sure how big the uncompressed size is, so make an
-            // absurdly large buffer
-            uncompressedKernelLen = compressedKernelLen * 10;
-            uncompressed.resize(uncompressedKernelLen);
-            uncompressedKernel = uncompressed.begin();
-
-            bool zOk = uncompress_gzipStream(uncompressed.begin(),
-                                            &uncompressedKernelLen,
-                                            compressedKernel,
-                                            compressedKernelLen);
-            if (!zOk) {
-                KERNEL_ERROR << "Kernel decompression error";
-                // it may have been partially decompressed, so we're going to
-                // try to find the version string anyway
-            }
+            return findGzipVersionString(compressedKernel,
+                                         compressedKernelLen,
+                                         dst,
+                                         dstLen);
         }
     }
 
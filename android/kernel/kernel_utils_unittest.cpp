@@ -13,8 +13,13 @@
 
 #include "android/kernel/kernel_utils_testing.h"
 
+#include "android/base/containers/PodVector.h"
+
 #include <gtest/gtest.h>
 
+#include <string.h>
+#include <zlib.h>
+
 namespace android {
 namespace kernel {
 
@@ -149,6 +154,57 @@ TEST(KernelUtils, ProbeKernelVersionString) {
     EXPECT_EQ(127, kernelVersionString[0]);
 }
 
+TEST(KernelUtils, ProbeLargeCompressedKernelVersionString) {
+    using android::base::PodVector;
+
+    const char kVersion[] = "Linux version 3.10.0+ (test) #1\n";
+
+    // A mock uncompressed kernel larger than the decompression chunks,
+    // whose version string straddles a chunk boundary.
+    const size_t kSize = 256 * 1024;
+    const size_t kOffset = 64 * 1024 - 5;
+    PodVector<uint8_t> kernel;
+    kernel.resize(kSize);
+    memset(kernel.begin(), 'x', kSize);
+    memcpy(&kernel[kOffset], kVersion, sizeof(kVersion));
+
+    // Compress it after a few bytes of padding.
+    const size_t kPadding = 16;
+    PodVector<uint8_t> image;
+    image.resize(kPadding + compressBound(kSize) + 32);
+    memset(image.begin(), '0', kPadding);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    ASSERT_EQ(Z_OK, deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16,
+                                 8, Z_DEFAULT_STRATEGY));
+    stream.next_in = kernel.begin();
+    stream.avail_in = kSize;
+    stream.next_out = &image[kPadding];
+    stream.avail_out = image.size() - kPadding;
+    ASSERT_EQ(Z_STREAM_END, deflate(&stream, Z_FINISH));
+    size_t imageSize = kPadding + stream.total_out;
+    deflateEnd(&stream);
+
+    char kernelVersionString[256];
+    kernelVersionString[0] = 0;
+    EXPECT_TRUE(android_imageProbeKernelVersionString(
+        image.begin(),
+        imageSize,
+        kernelVersionString,
+        sizeof(kernelVersionString)));
+    EXPECT_STREQ(kVersion, kernelVersionString);
+
+    // The result is truncated to the size of the destination buffer.
+    char shortVersionString[8];
+    EXPECT_TRUE(android_imageProbeKernelVersionString(
+        image.begin(),
+        imageSize,
+        shortVersionString,
+        sizeof(shortVersionString)));
+    EXPECT_STREQ("Linux v", shortVersionString);
+}
+
 void ParseKernelVersionString(const char* versionString,
                               KernelVersion expectedVersion) {
     KernelVersion actualVersion;
@@ -574,6 +574,23 @@ FOUND_SKIN:
         }
     }
 
+    if (opts->no_window) {
+        /* Without a window, only the display dimensions matter. Replace
+         * the skin with a display-only one, as for "-skin <width>x<height>",
+         * so that no skin image is decoded and no surface is allocated for
+         * its backgrounds and buttons. */
+        snprintf(tmp, sizeof tmp,
+                 "display {\n  width %d\n  height %d\n bpp %d}\n",
+                 hwConfig->hw_lcd_width, hwConfig->hw_lcd_height,
+                 hwConfig->hw_lcd_depth);
+        root = aconfig_node("", "");
+        aconfig_load(root, strdup(tmp));
+        path = ":";
+        D("headless mode, using display-only skin %dx%dx%d",
+          hwConfig->hw_lcd_width, hwConfig->hw_lcd_height,
+          hwConfig->hw_lcd_depth);
+    }
+
     *skinConfig = root;
     *skinPath   = strdup(path);
     return;
@@ -662,7 +679,7 @@ init_sdl_ui(AConfig*         skinConfig,
     }
 
     /* add an onion overlay image if needed */
-    if (opts->onion) {
+    if (opts->onion && !opts->no_window) {
         SkinImage*  onion = skin_image_find_simple( opts->onion );
         int         alpha, rotate;
 
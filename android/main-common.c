@@ -17,6 +17,7 @@
 #include "android/utils/eintr_wrapper.h"
 #include "android/utils/path.h"
 #include "android/utils/dirscanner.h"
+#include "android/utils/probe_cache.h"
 #include "android/utils/x86_cpuid.h"
 #include "android/cpu_accelerator.h"
 #include "android/main-common.h"
@@ -470,6 +471,37 @@ AvdInfo* createAVD(AndroidOptions* opts, int* inAndroidBuild)
     return ret;
 }
 
+// Same as android_pathProbeKernelVersionString(), but reuse the result of
+// a previous run as long as the kernel image didn't change, which avoids
+// decompressing it at each startup.
+static bool probeKernelVersionString(const char* kernelPath,
+                                     char* dst,
+                                     size_t dstLen) {
+    const char* cacheDir = probe_cache_default_dir();
+    char* cached = NULL;
+    size_t cachedSize = 0;
+    if (cacheDir && probe_cache_find(cacheDir, "kernel-version", kernelPath,
+                                     &cached, &cachedSize)) {
+        bool ok = (cachedSize > 0);
+        if (ok) {
+            snprintf(dst, dstLen, "%s", cached);
+        }
+        free(cached);
+        if (ok) {
+            return true;
+        }
+    }
+
+    if (!android_pathProbeKernelVersionString(kernelPath, dst, dstLen)) {
+        return false;
+    }
+    if (cacheDir) {
+        probe_cache_store(cacheDir, "kernel-version", kernelPath,
+                          dst, strlen(dst));
+    }
+    return true;
+}
+
 void handleCommonEmulatorOptions(AndroidOptions* opts,
                                  AndroidHwConfig* hw,
                                  AvdInfo* avd) {
@@ -543,9 +575,9 @@ void handleCommonEmulatorOptions(AndroidOptions* opts,
     }
 
     char versionString[256];
-    if (!android_pathProbeKernelVersionString(hw->kernel_path,
-                                              versionString,
-                                              sizeof(versionString))) {
+    if (!probeKernelVersionString(hw->kernel_path,
+                                  versionString,
+                                  sizeof(versionString))) {
         derror("Can't find 'Linux version ' string in kernel image file: %s",
                hw->kernel_path);
         exit(2);
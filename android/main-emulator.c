@@ -84,6 +84,7 @@ static char* getTargetEmulatorPath(const char* progDir,
 int main(int argc, char** argv)
 {
     const char* avdName = NULL;
+    const char* cloneName = NULL;
     char*       avdArch = NULL;
     const char* gpu = NULL;
     char*       emulatorPath;
@@ -139,6 +140,12 @@ int main(int argc, char** argv)
             continue;
         }
 
+        if (!strcmp(opt,"-clone-avd") && nn + 1 < argc) {
+            cloneName = argv[nn + 1];
+            nn++;
+            continue;
+        }
+
         if (!strcmp(opt,"-list-avds")) {
             AvdScanner* scanner = avdScanner_new(NULL);
             for (;;) {
@@ -162,6 +169,16 @@ int main(int argc, char** argv)
         }
     }
 
+    /* Clone the AVD without starting any emulator. */
+    if (cloneName != NULL) {
+        if (avdName == NULL) {
+            fprintf(stderr, "ERROR: -clone-avd needs the name of the AVD "
+                            "to clone, given with -avd <name>\n");
+            exit(1);
+        }
+        exit(path_cloneAvd(avdName, cloneName) < 0 ? 1 : 0);
+    }
+
     /* If ANDROID_EMULATOR_FORCE_32BIT is set to 'true' or '1' in the
      * environment, set -force-32bit automatically.
      */
@@ -40,6 +40,7 @@
 
 #include "android/config/config.h"
 
+#include "android/avd/util.h"
 #include "android/kernel/kernel_utils.h"
 #include "android/skin/charmap.h"
 #include "android/user-config.h"
@@ -51,6 +52,7 @@
 #include "android/utils/lineinput.h"
 #include "android/utils/path.h"
 #include "android/utils/property_file.h"
+#include "android/utils/startup.h"
 #include "android/utils/tempfile.h"
 
 #include "android/main-common.h"
@@ -195,6 +197,8 @@ int main(int argc, char **argv) {
 
     args[0] = argv[0];
 
+    startup_phase_begin("options");
+
     if ( android_parse_options( &argc, &argv, opts ) < 0 ) {
         exit(1);
     }
@@ -271,6 +275,15 @@ int main(int argc, char **argv) {
         exit(0);
     }
 
+    if (opts->clone_avd) {
+        if (!opts->avd) {
+            derror("-clone-avd needs the name of the AVD to clone, given "
+                   "with -avd <name>");
+            exit(1);
+        }
+        exit(path_cloneAvd(opts->avd, opts->clone_avd) < 0 ? 1 : 0);
+    }
+
     if (opts->snapshot_list) {
         if (opts->snapstorage == NULL) {
             /* Need to find the default snapstorage */
@@ -327,6 +340,8 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+    startup_phase_begin("avd");
+
     /* Parses options and builds an appropriate AVD. */
     avd = android_avdInfo = createAVD(opts, &inAndroidBuild);
 
@@ -407,6 +422,8 @@ int main(int argc, char **argv) {
     }
 
 
+    startup_phase_begin("skin");
+
     user_config_init();
     parse_skin_files(opts->skindir, opts->skin, opts, hw,
                      &skinConfig, &skinPath);
@@ -453,8 +470,12 @@ int main(int argc, char **argv) {
 #endif
     }
 
+    startup_phase_begin("kernel");
+
     handleCommonEmulatorOptions(opts, hw, avd);
 
+    startup_phase_begin("core-options");
+
     n = 1;
 
     if (boot_prop_ip[0]) {
@@ -501,6 +522,46 @@ int main(int argc, char **argv) {
         args[n++] = opts->cpu_delay;
     }
 
+    if (opts->timer_slack) {
+        args[n++] = "-timer-slack";
+        args[n++] = opts->timer_slack;
+    }
+
+    if (opts->stats_port) {
+        args[n++] = "-stats-port";
+        args[n++] = opts->stats_port;
+    }
+
+    if (opts->qos) {
+        args[n++] = "-qos";
+        args[n++] = opts->qos;
+    }
+
+    if (opts->startup_profile) {
+        args[n++] = "-startup-profile";
+    }
+
+    if (opts->sample_profile) {
+        args[n++] = "-sample-profile";
+        args[n++] = opts->sample_profile;
+    }
+
+    if (opts->iothread) {
+        args[n++] = "-iothread";
+    }
+
+    if (opts->mem_hugepages) {
+        args[n++] = "-mem-hugepages";
+    }
+
+    if (opts->mem_prefault) {
+        args[n++] = "-mem-prefault";
+    }
+
+    if (opts->mem_lock) {
+        args[n++] = "-mem-lock";
+    }
+
     if (opts->dns_server) {
         args[n++] = "-dns-server";
         args[n++] = opts->dns_server;
@@ -583,6 +644,28 @@ int main(int argc, char **argv) {
         if (opts->no_snapshot_update_time) {
             args[n++] = "-snapshot-no-time-update";
         }
+
+        if (opts->snapshot_lazy_ram) {
+            args[n++] = "-snapshot-lazy-ram";
+        }
+
+        if (opts->snapshot_shared_ram) {
+            args[n++] = "-snapshot-shared-ram";
+        }
+    }
+
+    if (opts->fast_exit) {
+        args[n++] = "-fast-exit";
+    }
+
+    if (opts->vsync_offset) {
+        args[n++] = "-vsync-offset";
+        args[n++] = opts->vsync_offset;
+    }
+
+    if (opts->qcow2_cache_size) {
+        args[n++] = "-qcow2-cache-size";
+        args[n++] = opts->qcow2_cache_size;
     }
 
     if (!opts->logcat || opts->logcat[0] == 0) {
@@ -822,9 +905,12 @@ int main(int argc, char **argv) {
         /* Validate parameter. */
         if (memcmp(opts->camera_back, "webcam", 6) &&
             strcmp(opts->camera_back, "emulated") &&
+            strcmp(opts->camera_back, "synthetic") &&
+            strncmp(opts->camera_back, "synthetic:", 10) &&
             strcmp(opts->camera_back, "none")) {
             derror("Invalid value for -camera-back <mode> parameter: %s\n"
-                   "Valid values are: 'emulated', 'webcam<N>', or 'none'\n",
+                   "Valid values are: 'emulated', 'webcam<N>', 'synthetic',\n"
+                   "'synthetic:<file>', or 'none'\n",
                    opts->camera_back);
             exit(1);
         }
@@ -835,9 +921,12 @@ int main(int argc, char **argv) {
         /* Validate parameter. */
         if (memcmp(opts->camera_front, "webcam", 6) &&
             strcmp(opts->camera_front, "emulated") &&
+            strcmp(opts->camera_front, "synthetic") &&
+            strncmp(opts->camera_front, "synthetic:", 10) &&
             strcmp(opts->camera_front, "none")) {
             derror("Invalid value for -camera-front <mode> parameter: %s\n"
-                   "Valid values are: 'emulated', 'webcam<N>', or 'none'\n",
+                   "Valid values are: 'emulated', 'webcam<N>', 'synthetic',\n"
+                   "'synthetic:<file>', or 'none'\n",
                    opts->camera_front);
             exit(1);
         }
@@ -984,6 +1073,8 @@ int main(int argc, char **argv) {
         printf("\n");
     }
 
+    startup_phase_begin("ui");
+
     /* Setup SDL UI just before calling the code */
 #if defined(CONFIG_SDL)
     init_sdl_ui(skinConfig, skinPath, opts);
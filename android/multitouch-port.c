@@ -26,8 +26,13 @@
 #include "android/utils/jpeg-compress.h"
 #include "android/utils/misc.h"
 #include "android/utils/panic.h"
+#include "android/utils/system.h"
+#include "android/utils/thread_pool.h"
 
 #include "qemu-common.h"
+#include "qemu/atomic.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
 
 #define  E(...)    derror(__VA_ARGS__)
 #define  W(...)    dwarning(__VA_ARGS__)
@@ -45,6 +50,18 @@
 /* Timeout (millisec) to use when communicating with SDK controller. */
 #define SDKCTL_MT_TIMEOUT      3000
 
+/* Bounds, and initial value of the JPEG quality used for framebuffer updates.
+ * 10% provides pretty decent image for the purpose of multi-touch emulation. */
+#define MTS_JPEG_QUALITY_MIN        4
+#define MTS_JPEG_QUALITY_MAX        40
+#define MTS_JPEG_QUALITY_DEFAULT    10
+#define MTS_JPEG_QUALITY_STEP       2
+
+/* Time (millisec) a full screen update should take to reach the device. The
+ * JPEG quality is lowered when the measured throughput can't sustain it, and
+ * raised again when a full screen would take less than half of it. */
+#define MTS_FRAME_BUDGET_MS         50
+
 /*
  * Message types used in multi-touch emulation.
  */
@@ -76,6 +93,52 @@ struct AndroidMTSPort {
     AJPEGDesc*          jpeg_compressor;
     /* Direct packet descriptor for framebuffer updates. */
     SDKCtlDirectPacket* fb_packet;
+
+    /*
+     * Framebuffer updates are copied, and then compressed in a worker thread.
+     * The compressor is used by one update at a time, from its copy until
+     * its transmission completes.
+     */
+
+    /* Bottom half that sends an update once it has been compressed. */
+    QEMUBH*             fb_bh;
+    /* Protects 'fb_busy', and 'fb_compressing'. */
+    QemuMutex           fb_lock;
+    /* Signaled when 'fb_compressing' is cleared. */
+    QemuCond            fb_cond;
+    /* Set while an update uses the compressor. */
+    int                 fb_busy;
+    /* Set while a worker compresses an update. */
+    int                 fb_compressing;
+    /* Header of the update being compressed or sent. */
+    MTFrameHeader       fb_header;
+    /* Callback, and its opaque, to invoke once the update is sent. */
+    on_sdkctl_direct_cb fb_cb;
+    void*               fb_cb_opaque;
+    /* Copy of the updated region, lines arranged top-down. */
+    uint8_t*            fb_copy;
+    int                 fb_copy_size;
+    /* Last frame sent to the device, lines arranged top-down. The updated
+     * region is compared with it to only send what has really changed. */
+    uint8_t*            fb_shadow;
+    int                 fb_shadow_size;
+    int                 fb_shadow_width;
+    int                 fb_shadow_height;
+    int                 fb_shadow_valid;
+    /* Set when the device screen may no longer match the shadow frame. */
+    int                 fb_shadow_reset;
+    /* Set by the worker when the update has no changes at all. */
+    int                 fb_unchanged;
+    /* JPEG quality to use for the next update. */
+    int                 jpeg_quality;
+    /* Compressed / raw size ratio of the last update. */
+    float               comp_ratio;
+    /* Time (millisec), and size of the last update sent to the device. */
+    int64_t             fb_send_time;
+    int                 fb_send_size;
+    /* Smoothed throughput of the link to the device in bytes per second, or
+     * 0 if it hasn't been measured yet. */
+    int64_t             throughput;
 };
 
 /* Data sent with SDKCTL_MT_QUERY_START */
@@ -109,6 +172,19 @@ static void
 _mts_port_free(AndroidMTSPort* mtsp)
 {
     if (mtsp != NULL) {
+        if (mtsp->fb_bh != NULL) {
+            /* Wait for the worker, it uses the compressor. */
+            qemu_mutex_lock(&mtsp->fb_lock);
+            while (mtsp->fb_compressing) {
+                qemu_cond_wait(&mtsp->fb_cond, &mtsp->fb_lock);
+            }
+            qemu_mutex_unlock(&mtsp->fb_lock);
+            qemu_bh_delete(mtsp->fb_bh);
+            qemu_cond_destroy(&mtsp->fb_cond);
+            qemu_mutex_destroy(&mtsp->fb_lock);
+        }
+        AFREE(mtsp->fb_copy);
+        AFREE(mtsp->fb_shadow);
         if (mtsp->fb_packet != NULL) {
             sdkctl_direct_packet_release(mtsp->fb_packet);
         }
@@ -247,6 +323,8 @@ _on_multitouch_port_connection(void* opaque,
                                SDKCtlSocket* sdkctl,
                                SdkCtlPortStatus status)
 {
+    AndroidMTSPort* const mtsp = (AndroidMTSPort*)opaque;
+
     switch (status) {
         case SDKCTL_PORT_CONNECTED:
             D("Multi-touch: SDK Controller is connected");
@@ -262,6 +340,8 @@ _on_multitouch_port_connection(void* opaque,
 
         case SDKCTL_PORT_ENABLED:
             D("Multi-touch: SDK Controller port is enabled.");
+            /* The device screen must be fully redrawn. */
+            mtsp->fb_shadow_reset = 1;
             // Enable OpenGLES framebuffer updates.
             if (android_hw->hw_gpu_enabled) {
                 android_setPostCallback(multitouch_opengles_fb_update, NULL);
@@ -304,6 +384,8 @@ _on_multitouch_port_connection(void* opaque,
     }
 }
 
+static void _fb_adapt_quality(AndroidMTSPort* mtsp);
+
 /* A callback that is invoked when a message is received from the device. */
 static void
 _on_multitouch_message(void* client_opaque,
@@ -340,6 +422,7 @@ _on_multitouch_message(void* client_opaque,
 
         case SDKCTL_MT_FB_UPDATE_RECEIVED:
             D("Framebuffer update ACK.");
+            _fb_adapt_quality((AndroidMTSPort*)client_opaque);
             break;
 
         case SDKCTL_MT_FB_UPDATE_HANDLED:
@@ -357,6 +440,8 @@ _on_multitouch_message(void* client_opaque,
  *                          MTS port API
  *******************************************************************************/
 
+static void _fb_send_compressed(void* opaque);
+
 AndroidMTSPort*
 mts_port_create(void* opaque)
 {
@@ -364,6 +449,7 @@ mts_port_create(void* opaque)
 
     ANEW0(mtsp);
     mtsp->opaque                = opaque;
+    mtsp->jpeg_quality          = MTS_JPEG_QUALITY_DEFAULT;
 
     /* Initialize default MTS descriptor. */
     multitouch_init(mtsp);
@@ -384,6 +470,10 @@ mts_port_create(void* opaque)
      * we need to do this after we have initialized the recycler! */
     mtsp->fb_packet = sdkctl_direct_packet_new(mtsp->sdkctl);
 
+    qemu_mutex_init(&mtsp->fb_lock);
+    qemu_cond_init(&mtsp->fb_cond);
+    mtsp->fb_bh = qemu_bh_new(_fb_send_compressed, mtsp);
+
     /* Now we can initiate connection witm MT port on the device. */
     sdkctl_socket_connect(mtsp->sdkctl, SDKCTL_DEFAULT_TCP_PORT,
                           SDKCTL_MT_TIMEOUT);
@@ -401,49 +491,201 @@ mts_port_destroy(AndroidMTSPort* mtsp)
  *                       Handling framebuffer updates
  *******************************************************************************/
 
-/* Compresses a framebuffer region into JPEG image.
+/* Copies a framebuffer region, arranging its lines top-down.
  * Param:
- *  mtsp - Multi-touch port descriptor with initialized JPEG compressor.
- *  fmt Descriptor for framebuffer region to compress.
- *  fb Beginning of the framebuffer.
- *  jpeg_quality JPEG compression quality. A number from 1 to 100. Note that
- *      value 10 provides pretty decent image for the purpose of multi-touch
- *      emulation.
+ *  mtsp - Multi-touch port descriptor.
+ *  fmt - Descriptor for framebuffer region to copy.
+ *  fb - Beginning of the framebuffer.
+ *  ydir - Direction in which lines are arranged in the framebuffer.
  */
 static void
-_fb_compress(const AndroidMTSPort* mtsp,
-             const MTFrameHeader* fmt,
-             const uint8_t* fb,
-             int jpeg_quality,
-             int ydir)
+_fb_copy_region(AndroidMTSPort* mtsp,
+                const MTFrameHeader* fmt,
+                const uint8_t* fb,
+                int ydir)
 {
-    T("Multi-touch: compressing %d bytes frame buffer", fmt->w * fmt->h * fmt->bpp);
+    const int line_size = fmt->w * fmt->bpp;
+    const int size = line_size * fmt->h;
+    int n;
 
-    jpeg_compressor_compress_fb(mtsp->jpeg_compressor, fmt->x, fmt->y, fmt->w,
-                                fmt->h, fmt->disp_height, fmt->bpp, fmt->bpl,
-                                fb, jpeg_quality, ydir);
+    if (mtsp->fb_copy_size < size) {
+        mtsp->fb_copy = android_realloc(mtsp->fb_copy, size);
+        mtsp->fb_copy_size = size;
+    }
+
+    for (n = 0; n < fmt->h; n++) {
+        const int line = (ydir >= 0) ? fmt->y + n
+                                     : fmt->disp_height - fmt->y - n - 1;
+        memcpy(mtsp->fb_copy + n * line_size,
+               fb + line * fmt->bpl + fmt->x * fmt->bpp, line_size);
+    }
 }
 
-int
-mts_port_send_frame(AndroidMTSPort* mtsp,
-                    MTFrameHeader* fmt,
-                    const uint8_t* fb,
-                    on_sdkctl_direct_cb cb,
-                    void* cb_opaque,
-                    int ydir)
+/* Shrinks the region in the update header to the pixels that differ from the
+ * shadow frame, and copies the region to the shadow frame.
+ * Return:
+ *  Boolean: 1 if nothing has changed in the region, or 0 otherwise.
+ */
+static int
+_fb_diff_region(AndroidMTSPort* mtsp)
 {
-    /* Make sure that port is connected. */
-    if (!sdkctl_socket_is_port_ready(mtsp->sdkctl)) {
-        return -1;
+    MTFrameHeader* const fmt = &mtsp->fb_header;
+    const int bpp = fmt->bpp;
+    const int line_size = fmt->w * bpp;
+    const int shadow_bpl = fmt->disp_width * bpp;
+    const int shadow_size = shadow_bpl * fmt->disp_height;
+    int first = -1, last = -1, left = line_size, right = 0;
+    int n;
+
+    if (mtsp->fb_shadow_reset) {
+        mtsp->fb_shadow_reset = 0;
+        mtsp->fb_shadow_valid = 0;
+    }
+    if (mtsp->fb_shadow_width != fmt->disp_width ||
+        mtsp->fb_shadow_height != fmt->disp_height ||
+        mtsp->fb_shadow_size != shadow_size) {
+        AFREE(mtsp->fb_shadow);
+        mtsp->fb_shadow = android_alloc(shadow_size);
+        mtsp->fb_shadow_size = shadow_size;
+        mtsp->fb_shadow_width = fmt->disp_width;
+        mtsp->fb_shadow_height = fmt->disp_height;
+        mtsp->fb_shadow_valid = 0;
+    }
+    for (n = 0; n < fmt->h; n++) {
+        const uint8_t* src = mtsp->fb_copy + n * line_size;
+        uint8_t* dst = mtsp->fb_shadow + (fmt->y + n) * shadow_bpl + fmt->x * bpp;
+        int l, r;
+
+        if (mtsp->fb_shadow_valid) {
+            if (!memcmp(src, dst, line_size)) {
+                continue;
+            }
+            /* Find the leftmost, and rightmost changed bytes. */
+            for (l = 0; src[l] == dst[l]; l++) {
+            }
+            for (r = line_size; src[r - 1] == dst[r - 1]; r--) {
+            }
+            if (left > l) {
+                left = l;
+            }
+            if (right < r) {
+                right = r;
+            }
+            if (first < 0) {
+                first = n;
+            }
+            last = n;
+        }
+        memcpy(dst, src, line_size);
     }
 
-    /* Compress framebuffer region. 10% quality seems to be sufficient. */
-    fmt->format = MTFB_JPEG;
-    _fb_compress(mtsp, fmt, fb, 10, ydir);
+    if (!mtsp->fb_shadow_valid) {
+        /* Send the entire region, the shadow only covers it now. Unless the
+         * region is the whole screen, the shadow stays invalid. */
+        mtsp->fb_shadow_valid = fmt->x == 0 && fmt->y == 0 &&
+                                fmt->w == fmt->disp_width &&
+                                fmt->h == fmt->disp_height;
+        return 0;
+    }
+    if (first < 0) {
+        return 1;
+    }
+
+    /* Round to whole pixels. */
+    left = left / bpp;
+    right = (right + bpp - 1) / bpp;
+    fmt->x += left;
+    fmt->y += first;
+    fmt->w = right - left;
+    fmt->h = last - first + 1;
+    return 0;
+}
+
+/* Compresses the copied framebuffer region in a worker thread, and schedules
+ * the bottom half that sends it.
+ * Param:
+ *  opaque - Multi-touch port descriptor.
+ */
+static void
+_fb_compress_task(void* opaque)
+{
+    AndroidMTSPort* const mtsp = (AndroidMTSPort*)opaque;
+    MTFrameHeader* const fmt = &mtsp->fb_header;
+    /* Position of the region in the copy, before it is shrunk. */
+    const int x = fmt->x;
+    const int y = fmt->y;
+    const int copy_bpl = fmt->w * fmt->bpp;
+    const int copy_lines = fmt->h;
+
+    mtsp->fb_unchanged = _fb_diff_region(mtsp);
+    if (!mtsp->fb_unchanged) {
+        T("Multi-touch: compressing %d bytes frame buffer at %d%% quality",
+          fmt->w * fmt->h * fmt->bpp, mtsp->jpeg_quality);
+
+        jpeg_compressor_compress_fb(mtsp->jpeg_compressor,
+                                    fmt->x - x, fmt->y - y, fmt->w, fmt->h,
+                                    copy_lines, fmt->bpp, copy_bpl,
+                                    mtsp->fb_copy, mtsp->jpeg_quality, 1);
+    }
+
+    /* The bottom half must be scheduled before the destructor can run. */
+    qemu_mutex_lock(&mtsp->fb_lock);
+    qemu_bh_schedule(mtsp->fb_bh);
+    mtsp->fb_compressing = 0;
+    qemu_cond_broadcast(&mtsp->fb_cond);
+    qemu_mutex_unlock(&mtsp->fb_lock);
+}
+
+/* Lets the next framebuffer update use the compressor. */
+static void
+_fb_release(AndroidMTSPort* mtsp)
+{
+    qemu_mutex_lock(&mtsp->fb_lock);
+    mtsp->fb_busy = 0;
+    qemu_mutex_unlock(&mtsp->fb_lock);
+}
+
+/* Callback that is invoked when a framebuffer update has been transmitted to
+ * the device, or the transmission has failed, or has been cancelled. */
+static AsyncIOAction
+_on_fb_packet_sent(void* opaque, SDKCtlDirectPacket* packet, AsyncIOState status)
+{
+    AndroidMTSPort* const mtsp = (AndroidMTSPort*)opaque;
+
+    /* The message in the compressor buffer is no longer in use. */
+    _fb_release(mtsp);
+    return mtsp->fb_cb(mtsp->fb_cb_opaque, packet, status);
+}
+
+/* Bottom half that sends a compressed framebuffer update to the device.
+ * Param:
+ *  opaque - Multi-touch port descriptor.
+ */
+static void
+_fb_send_compressed(void* opaque)
+{
+    AndroidMTSPort* const mtsp = (AndroidMTSPort*)opaque;
+    MTFrameHeader* const fmt = &mtsp->fb_header;
+
+    smp_rmb();
+
+    if (mtsp->fb_unchanged || !sdkctl_socket_is_port_ready(mtsp->sdkctl)) {
+        if (!mtsp->fb_unchanged) {
+            /* The device missed this update. */
+            mtsp->fb_shadow_reset = 1;
+        }
+        T("Multi-touch: dropped %s framebuffer update",
+          mtsp->fb_unchanged ? "unchanged" : "unsent");
+        _fb_release(mtsp);
+        /* Conclude the update, as the device won't handle it. */
+        multitouch_fb_updated();
+        return;
+    }
+
+    const int jpeg_size = jpeg_compressor_get_jpeg_size(mtsp->jpeg_compressor);
 
     /* Total size of the update data: header + JPEG image. */
-    const int update_size =
-        sizeof(MTFrameHeader) + jpeg_compressor_get_jpeg_size(mtsp->jpeg_compressor);
+    const int update_size = sizeof(MTFrameHeader) + jpeg_size;
 
     /* Update message starts at the beginning of the buffer allocated by the
      * compressor's destination manager. */
@@ -456,17 +698,99 @@ mts_port_send_frame(AndroidMTSPort* mtsp,
     memcpy(msg + sdkctl_message_get_header_size(), fmt, sizeof(MTFrameHeader));
 
     /* Compression rate... */
-    const float comp_rate = ((float)jpeg_compressor_get_jpeg_size(mtsp->jpeg_compressor) / (fmt->w * fmt->h * fmt->bpp)) * 100;
-
-    /* Zeroing the rectangle in the update header we indicate that it contains
-     * no updates. */
-    fmt->x = fmt->y = fmt->w = fmt->h = 0;
+    mtsp->comp_ratio = (float)jpeg_size / (fmt->w * fmt->h * fmt->bpp);
+    const float comp_rate = mtsp->comp_ratio * 100;
 
     /* Send update to the device. */
-    sdkctl_direct_packet_send(mtsp->fb_packet, msg, cb, cb_opaque);
+    mtsp->fb_send_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    mtsp->fb_send_size = update_size;
+    sdkctl_direct_packet_send(mtsp->fb_packet, msg, _on_fb_packet_sent, mtsp);
 
     T("Multi-touch: Sent %d bytes in framebuffer update. Compression rate is %.2f%%",
       update_size, comp_rate);
+}
+
+/* Adjusts the JPEG quality to the throughput of the link to the device, when
+ * the device acknowledges the reception of an update.
+ * Param:
+ *  mtsp - Multi-touch port descriptor.
+ */
+static void
+_fb_adapt_quality(AndroidMTSPort* mtsp)
+{
+    const MTFrameHeader* const fmt = &mtsp->fb_header;
+    int64_t elapsed;
+    int64_t sample;
+    int64_t budget;
+    int64_t estimate;
+
+    if (mtsp->fb_send_time == 0) {
+        return;
+    }
+    elapsed = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) - mtsp->fb_send_time;
+    mtsp->fb_send_time = 0;
+    if (elapsed < 1) {
+        elapsed = 1;
+    }
+
+    sample = (int64_t)mtsp->fb_send_size * 1000 / elapsed;
+    mtsp->throughput = mtsp->throughput ? (mtsp->throughput * 3 + sample) / 4
+                                        : sample;
+
+    /* Compare the size a full screen update would have at the current
+     * quality with what the link can transfer within the budget. */
+    budget = mtsp->throughput * MTS_FRAME_BUDGET_MS / 1000;
+    estimate = (int64_t)(mtsp->comp_ratio *
+                         fmt->disp_width * fmt->disp_height * fmt->bpp);
+    if (estimate > budget && mtsp->jpeg_quality > MTS_JPEG_QUALITY_MIN) {
+        mtsp->jpeg_quality = MAX(mtsp->jpeg_quality - MTS_JPEG_QUALITY_STEP,
+                                 MTS_JPEG_QUALITY_MIN);
+    } else if (estimate * 2 < budget &&
+               mtsp->jpeg_quality < MTS_JPEG_QUALITY_MAX) {
+        mtsp->jpeg_quality = MIN(mtsp->jpeg_quality + MTS_JPEG_QUALITY_STEP,
+                                 MTS_JPEG_QUALITY_MAX);
+    }
+
+    T("Multi-touch: %lld bytes/s to the device, JPEG quality is %d%%",
+      (long long)mtsp->throughput, mtsp->jpeg_quality);
+}
+
+int
+mts_port_send_frame(AndroidMTSPort* mtsp,
+                    MTFrameHeader* fmt,
+                    const uint8_t* fb,
+                    on_sdkctl_direct_cb cb,
+                    void* cb_opaque,
+                    int ydir)
+{
+    /* Make sure that port is connected. */
+    if (!sdkctl_socket_is_port_ready(mtsp->sdkctl)) {
+        return -1;
+    }
+
+    /* The previous update may still use the compressor. */
+    qemu_mutex_lock(&mtsp->fb_lock);
+    if (mtsp->fb_busy) {
+        qemu_mutex_unlock(&mtsp->fb_lock);
+        return -1;
+    }
+
+    /* Copy the region, so the framebuffer can change while it gets
+     * compressed. */
+    fmt->format = MTFB_JPEG;
+    _fb_copy_region(mtsp, fmt, fb, ydir);
+    mtsp->fb_header = *fmt;
+    mtsp->fb_cb = cb;
+    mtsp->fb_cb_opaque = cb_opaque;
+
+    /* Zeroing the rectangle in the update header we indicate that it contains
+     * no updates. */
+    fmt->x = fmt->y = fmt->w = fmt->h = 0;
 
+    mtsp->fb_busy = 1;
+    mtsp->fb_compressing = 1;
+    qemu_mutex_unlock(&mtsp->fb_lock);
+    thread_pool_post(_fb_compress_task, mtsp, THREAD_POOL_PRIORITY_NORMAL,
+                     THREAD_POOL_ANY_WORKER);
     return 0;
 }
@@ -87,7 +87,10 @@ extern AndroidMTSPort* mts_port_create(void* opaque);
 extern void mts_port_destroy(AndroidMTSPort* amtp);
 
 /* Sends framebuffer update to the multi-touch emulation application, running on
- * the android device.
+ * the android device. The updated region is copied before this routine
+ * returns, then compressed in a worker thread, and sent from the main loop.
+ * Regions that haven't changed since the last update sent are skipped, and
+ * the JPEG quality adapts to the throughput of the link to the device.
  * Param:
  *  mtsp - Android multi-touch port instance returned from mts_port_create.
  *  fmt - Framebuffer update descriptor.
@@ -99,7 +102,8 @@ extern void mts_port_destroy(AndroidMTSPort* amtp);
  *      this value is negative, lines are arranged in bottom-up format (i.e. the
  *      bottom line is at the beginning of the buffer).
  * Return:
- *  0 on success, or != 0 on failure.
+ *  0 on success, or != 0 on failure, or if the previous update is still in
+ *  progress.
  */
 extern int mts_port_send_frame(AndroidMTSPort* mtsp,
                                MTFrameHeader* fmt,
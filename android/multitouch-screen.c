@@ -354,7 +354,9 @@ void
 multitouch_opengles_fb_update(void* context,
                               int w, int h, int ydir,
                               int format, int type,
-                              unsigned char* pixels)
+                              unsigned char* pixels,
+                              int damageX, int damageY,
+                              int damageWidth, int damageHeight)
 {
     MTSState* const mts_state = &_MTSState;
 
@@ -363,7 +365,12 @@ multitouch_opengles_fb_update(void* context,
         return;
     }
 
-    T("Multi-touch: openGLES framebuffer update: 0:0 -> %dx%d", w, h);
+    T("Multi-touch: openGLES framebuffer update: %d:%d -> %dx%d",
+      damageX, damageY, damageWidth, damageHeight);
+
+    if (damageWidth <= 0 || damageHeight <= 0) {
+        return;
+    }
 
     /* GLES format is always RGBA8888 */
     mts_state->fb_header.bpp = 4;
@@ -373,8 +380,13 @@ multitouch_opengles_fb_update(void* context,
     mts_state->current_fb = pixels;
     mts_state->ydir = ydir;
 
-    /* GLES emulator alwas update the entire framebuffer. */
-    _mt_fb_common_update(mts_state, 0, 0, w, h);
+    /* Only send the damaged area. Its rows are in the framebuffer order,
+     * while the update header is in the top-down display order. */
+    if (ydir < 0) {
+        damageY = h - damageY - damageHeight;
+    }
+    _mt_fb_common_update(mts_state, damageX, damageY, damageWidth,
+                         damageHeight);
 }
 
 void
@@ -82,6 +82,10 @@ extern int multitouch_get_max_slot();
  *   format, type   Format and type GL enums, as used in glTexImage2D() or
  *                  glReadPixels(), describing the pixel format.
  *   pixels         The framebuffer image.
+ *   damageX, damageY, damageWidth, damageHeight
+ *                  The rectangle of pixels that changed since the previous
+ *                  call, using the same row order as |pixels|. Only this
+ *                  area is sent to the device.
  *
  * In the first implementation, ydir is always -1 (bottom to top), format and
  * type are always GL_RGBA and GL_UNSIGNED_BYTE, and the width and height will
@@ -93,7 +97,11 @@ extern void multitouch_opengles_fb_update(void* context,
                                           int ydir,
                                           int format,
                                           int type,
-                                          unsigned char* pixels);
+                                          unsigned char* pixels,
+                                          int damageX,
+                                          int damageY,
+                                          int damageWidth,
+                                          int damageHeight);
 
 /* Pushes the entire framebuffer to the device. This will force the device to
  * refresh the entire screen.
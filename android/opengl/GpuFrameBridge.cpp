@@ -18,7 +18,6 @@
 #include "android/base/Log.h"
 #include "android/base/synchronization/Lock.h"
 #include "android/base/sockets/SocketUtils.h"
-#include "android/base/synchronization/MessageChannel.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -30,30 +29,76 @@
 namespace android {
 namespace opengl {
 
+using android::base::Lock;
 using android::base::Looper;
-using android::base::MessageChannel;
 
 namespace {
 
 // A small structure to model a single frame of the GPU display,
-// as passed between the EmuGL and main loop thread.
+// as passed between the EmuGL and main loop thread. Instances are
+// recycled between posts, and their pixel buffer is only reallocated
+// when it is too small for a new frame.
 struct Frame {
     int width;
     int height;
+    size_t capacity;
     void* pixels;
-
-    Frame(int w, int h, const void* pixels) :
-            width(w), height(h), pixels(NULL) {
-        this->pixels = ::calloc(w * 4, h);
-        ::memcpy(this->pixels, pixels, w * 4 * h);
-    }
+    // Damage rectangle, as [x0,x1) x [y0,y1).
+    int damageX0;
+    int damageY0;
+    int damageX1;
+    int damageY1;
+
+    Frame() :
+            width(0),
+            height(0),
+            capacity(0U),
+            pixels(NULL),
+            damageX0(0),
+            damageY0(0),
+            damageX1(0),
+            damageY1(0) {}
 
     ~Frame() {
         ::free(pixels);
     }
+
+    // Copy a new |w| x |h| frame of 32-bit pixels into this instance.
+    void copyFrom(int w, int h, const void* src) {
+        size_t size = static_cast<size_t>(w) * 4U * static_cast<size_t>(h);
+        if (size > capacity) {
+            ::free(pixels);
+            pixels = ::malloc(size);
+            capacity = size;
+        }
+        width = w;
+        height = h;
+        ::memcpy(pixels, src, size);
+    }
+
+    // Set the damage rectangle, or merge it with the current one if
+    // |merge| is true.
+    void setDamage(int x, int y, int w, int h, bool merge) {
+        if (merge && damageX0 < damageX1 && damageY0 < damageY1) {
+            if (x < damageX0) damageX0 = x;
+            if (y < damageY0) damageY0 = y;
+            if (x + w > damageX1) damageX1 = x + w;
+            if (y + h > damageY1) damageY1 = y + h;
+        } else {
+            damageX0 = x;
+            damageY0 = y;
+            damageX1 = x + w;
+            damageY1 = y + h;
+        }
+    }
 };
 
 // Real implementation of GpuFrameBridge interface.
+//
+// Only the latest posted frame is kept: if the main loop thread falls
+// behind, stale frames are overwritten instead of being queued. At most
+// three Frame instances are used at any time: the pending one, the
+// one being passed to the callback, and a spare one.
 class Bridge : public GpuFrameBridge {
 public:
     // Constructor.
@@ -63,7 +108,10 @@ public:
             mInSocket(-1),
             mOutSocket(-1),
             mFdWatch(NULL),
-            mFrames(),
+            mLock(),
+            mPending(NULL),
+            mSpare(NULL),
+            mSignaled(false),
             mCallback(callback),
             mCallbackOpaque(callbackOpaque) {
         if (::android::base::socketCreatePair(&mInSocket, &mOutSocket) < 0) {
@@ -89,39 +137,88 @@ public:
         delete mFdWatch;
         android::base::socketClose(mOutSocket);
         android::base::socketClose(mInSocket);
+        delete mPending;
+        delete mSpare;
     }
 
     // Implementation of the GpuFrameBridge::postFrame() method, must be
     // called from the EmuGL thread.
-    virtual void postFrame(int width, int height, const void* pixels) {
+    virtual void postFrame(int width,
+                           int height,
+                           const void* pixels,
+                           int damageX,
+                           int damageY,
+                           int damageWidth,
+                           int damageHeight) {
         if (mInSocket < 0) {
             return;
         }
-        Frame* frame = new Frame(width, height, pixels);
-        ::memcpy(frame->pixels, pixels, width * 4 * height);
-        mFrames.send(frame);
-        char c = 1;
-        android::base::socketSend(mInSocket, &c, 1);
+        // Grab a frame to copy the pixels into, reusing the pending one
+        // if the main loop didn't pick it up yet.
+        Frame* frame;
+        bool stale = false;
+        mLock.lock();
+        if (mPending) {
+            frame = mPending;
+            mPending = NULL;
+            stale = true;
+        } else if (mSpare) {
+            frame = mSpare;
+            mSpare = NULL;
+        } else {
+            frame = NULL;
+        }
+        mLock.unlock();
+
+        if (!frame) {
+            frame = new Frame();
+        }
+        frame->copyFrom(width, height, pixels);
+        frame->setDamage(damageX, damageY, damageWidth, damageHeight, stale);
+
+        mLock.lock();
+        mPending = frame;
+        bool needSignal = !mSignaled;
+        mSignaled = true;
+        mLock.unlock();
+
+        if (needSignal) {
+            char c = 1;
+            android::base::socketSend(mInSocket, &c, 1);
+        }
     }
 
 private:
-    enum {
-        kMaxFrames = 16
-    };
-
     // Called from the looper thread when a new Frame instance is available.
     static void onSocketEvent(void* opaque, int fd, unsigned events) {
         Bridge* bridge = reinterpret_cast<Bridge*>(opaque);
         if (events & Looper::FdWatch::kEventRead) {
             char c = 0;
             android::base::socketRecv(bridge->mOutSocket, &c, 1);
-            Frame* frame = NULL;
-            bridge->mFrames.receive(&frame);
+
+            bridge->mLock.lock();
+            Frame* frame = bridge->mPending;
+            bridge->mPending = NULL;
+            bridge->mSignaled = false;
+            bridge->mLock.unlock();
+
             if (frame) {
                 bridge->mCallback(bridge->mCallbackOpaque,
                                   frame->width,
                                   frame->height,
-                                  frame->pixels);
+                                  frame->pixels,
+                                  frame->damageX0,
+                                  frame->damageY0,
+                                  frame->damageX1 - frame->damageX0,
+                                  frame->damageY1 - frame->damageY0);
+
+                // Recycle the frame for the next post.
+                bridge->mLock.lock();
+                if (!bridge->mSpare) {
+                    bridge->mSpare = frame;
+                    frame = NULL;
+                }
+                bridge->mLock.unlock();
                 delete frame;
             }
         }
@@ -131,7 +228,14 @@ private:
     int mInSocket;
     int mOutSocket;
     Looper::FdWatch* mFdWatch;
-    MessageChannel<Frame*, kMaxFrames> mFrames;
+    // Protects |mPending|, |mSpare| and |mSignaled|.
+    Lock mLock;
+    // Latest frame posted but not yet passed to the callback.
+    Frame* mPending;
+    // A recycled frame, ready for the next post.
+    Frame* mSpare;
+    // True iff a byte was sent to |mInSocket| and not yet received.
+    bool mSignaled;
     Callback* mCallback;
     void* mCallbackOpaque;
 };
@@ -43,12 +43,19 @@ public:
     // Type of function that is called to transfer the content of a new
     // GPU frame to the main thread. |opaque| is a user-provided pointer,
     // |width| and |height| are dimensions in pixels, and |pixels| is
-    // the memory buffer of 32-bit RGBA image data. This buffer is freed
-    // when the function returns.
+    // the memory buffer of 32-bit RGBA image data. This buffer is only
+    // valid until the function returns, since it is recycled for the
+    // next frame. |damageX|, |damageY|, |damageWidth| and |damageHeight|
+    // describe the rectangle of pixels that changed since the previous
+    // call, only this area needs to be redisplayed.
     typedef void (Callback)(void* opaque,
                             int width,
                             int height,
-                            const void* pixels);
+                            const void* pixels,
+                            int damageX,
+                            int damageY,
+                            int damageWidth,
+                            int damageHeight);
 
     // Create a new GpuFrameBridge instance. |looper| is a handle to the main
     // loop's Looper instance, and |callback| is a function that will be
@@ -60,8 +67,17 @@ public:
     // Destructor
     virtual ~GpuFrameBridge() {}
 
-    // Post a new frame from the EmuGL thread.
-    virtual void postFrame(int width, int height, const void* pixels) = 0;
+    // Post a new frame from the EmuGL thread. The damage rectangle is the
+    // area that changed since the previous post. If the previous frame was
+    // not sent to the callback yet, it is dropped and replaced by this one,
+    // and its damage rectangle is merged into the new one.
+    virtual void postFrame(int width,
+                           int height,
+                           const void* pixels,
+                           int damageX,
+                           int damageY,
+                           int damageWidth,
+                           int damageHeight) = 0;
 
 protected:
     GpuFrameBridge() {}
@@ -33,9 +33,13 @@ using android::base::Looper;
 namespace {
 
 struct Frame {
-    Frame(int w, int h, const void* pixels) {
+    Frame(int w, int h, const void* pixels, int dx, int dy, int dw, int dh) {
         this->width = w;
         this->height = h;
+        this->damageX = dx;
+        this->damageY = dy;
+        this->damageWidth = dw;
+        this->damageHeight = dh;
         this->pixels = ::malloc(w * 4 * h);
         ::memcpy(this->pixels, pixels, w * h * 4);
     }
@@ -46,6 +50,10 @@ struct Frame {
 
     int width;
     int height;
+    int damageX;
+    int damageY;
+    int damageWidth;
+    int damageHeight;
     void* pixels;
 };
 
@@ -80,10 +88,17 @@ public:
         }
     }
 
-    static void add(void* context, int w, int h, const void* pixels) {
+    static void add(void* context,
+                    int w,
+                    int h,
+                    const void* pixels,
+                    int dx,
+                    int dy,
+                    int dw,
+                    int dh) {
         FrameList* list = reinterpret_cast<FrameList*>(context);
         CHECK(list->mCount < kMaxFrames);
-        Frame* frame = new Frame(w, h, pixels);
+        Frame* frame = new Frame(w, h, pixels, dx, dy, dw, dh);
         list->mFrames[list->mCount++] = frame;
     }
 
@@ -111,7 +126,7 @@ TEST(GpuFrameBridge, postFrameWithinSingleThread) {
         0xff, 0x80, 0x40, 0xff,
     };
 
-    bridge->postFrame(1, 1, kFrame0);
+    bridge->postFrame(1, 1, kFrame0, 0, 0, 1, 1);
 
     EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
 
@@ -120,11 +135,57 @@ TEST(GpuFrameBridge, postFrameWithinSingleThread) {
     EXPECT_TRUE(frame.get());
     EXPECT_EQ(1, frame->width);
     EXPECT_EQ(1, frame->height);
+    EXPECT_EQ(0, frame->damageX);
+    EXPECT_EQ(0, frame->damageY);
+    EXPECT_EQ(1, frame->damageWidth);
+    EXPECT_EQ(1, frame->damageHeight);
     for (size_t n = 0; n < sizeof(kFrame0); ++n) {
         EXPECT_EQ(kFrame0[n], reinterpret_cast<unsigned char*>(frame->pixels)[n])
                 << "# " << n;
     }
 }
 
+TEST(GpuFrameBridge, postFrameDropsStaleFrames) {
+    ScopedPtr<Looper> looper(Looper::create());
+    ASSERT_TRUE(looper.get());
+
+    FrameList list;
+    ScopedPtr<GpuFrameBridge> bridge(
+            GpuFrameBridge::create(looper.get(), FrameList::add, &list));
+    EXPECT_TRUE(bridge.get());
+
+    static const unsigned char kFrame0[4] = { 0x10, 0x20, 0x30, 0xff };
+    static const unsigned char kFrame1[8] = {
+        0x40, 0x50, 0x60, 0xff, 0x70, 0x80, 0x90, 0xff,
+    };
+
+    // Post two frames before the looper has a chance to run, only the
+    // second one should be received, with the union of both damages.
+    bridge->postFrame(2, 1, kFrame0, 0, 0, 1, 1);
+    bridge->postFrame(2, 1, kFrame1, 1, 0, 1, 1);
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(1, list.count());
+    ScopedPtr<Frame> frame(list.popFront());
+    EXPECT_TRUE(frame.get());
+    EXPECT_EQ(2, frame->width);
+    EXPECT_EQ(1, frame->height);
+    EXPECT_EQ(0, frame->damageX);
+    EXPECT_EQ(2, frame->damageWidth);
+    EXPECT_EQ(0, ::memcmp(kFrame1, frame->pixels, sizeof(kFrame1)));
+
+    // A new frame posted after that must still be received, with its
+    // own damage only.
+    bridge->postFrame(1, 1, kFrame0, 0, 0, 1, 1);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    EXPECT_EQ(1, list.count());
+    frame.reset(list.popFront());
+    EXPECT_TRUE(frame.get());
+    EXPECT_EQ(1, frame->width);
+    EXPECT_EQ(1, frame->damageWidth);
+    EXPECT_EQ(0, ::memcmp(kFrame0, frame->pixels, sizeof(kFrame0)));
+}
+
 }  // namespace opengl
 }  // namespace android
@@ -0,0 +1,492 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/opengl/GpuFrameRecorder.h"
+
+#include "android/base/containers/PodVector.h"
+#include "android/base/Log.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/Thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#undef ERROR
+#endif
+
+namespace android {
+namespace opengl {
+
+using android::base::ConditionVariable;
+using android::base::Lock;
+using android::base::PodVector;
+using android::base::Thread;
+
+namespace {
+
+// Size of the AVI headers that precede the frame data, i.e. the RIFF
+// header, the 'hdrl' list and the header of the 'movi' list.
+const size_t kHeaderSize = 224U;
+
+// Stop recording before the 'movi' list reaches this size, since the
+// 32-bit offsets of the AVI 1.0 index can't go beyond it.
+const uint32_t kMaxMoviSize = 0x7ff00000U;
+
+// Flags used in the AVI headers and index.
+const uint32_t kAviHasIndex = 0x10U;
+const uint32_t kAviKeyFrame = 0x10U;
+
+// A small helper to serialize little-endian AVI structures.
+class ByteWriter {
+public:
+    explicit ByteWriter(uint8_t* buffer) : mPos(buffer) {}
+
+    void put16(uint16_t value) {
+        mPos[0] = static_cast<uint8_t>(value);
+        mPos[1] = static_cast<uint8_t>(value >> 8);
+        mPos += 2;
+    }
+
+    void put32(uint32_t value) {
+        put16(static_cast<uint16_t>(value));
+        put16(static_cast<uint16_t>(value >> 16));
+    }
+
+    void putTag(const char* tag) {
+        ::memcpy(mPos, tag, 4);
+        mPos += 4;
+    }
+
+private:
+    uint8_t* mPos;
+};
+
+// A frame of the GPU display, as passed from the EmuGL thread to the
+// worker thread. Instances are recycled, see GpuFrameBridge.cpp.
+struct Frame {
+    int64_t timeUs;
+    int width;
+    int height;
+    size_t capacity;
+    void* pixels;
+
+    Frame() : timeUs(0), width(0), height(0), capacity(0U), pixels(NULL) {}
+
+    ~Frame() {
+        ::free(pixels);
+    }
+
+    // Copy a new |w| x |h| frame of 32-bit pixels into this instance.
+    void copyFrom(int w, int h, const void* src) {
+        size_t size = static_cast<size_t>(w) * 4U * static_cast<size_t>(h);
+        if (size > capacity) {
+            ::free(pixels);
+            pixels = ::malloc(size);
+            capacity = size;
+        }
+        width = w;
+        height = h;
+        ::memcpy(pixels, src, size);
+    }
+};
+
+// An entry of the 'idx1' index of the AVI file.
+struct IndexEntry {
+    uint32_t flags;
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Real implementation of the GpuFrameRecorder interface.
+//
+// The EmuGL thread only touches |mPending| and |mSpare|, under |mLock|.
+// Everything else belongs to the worker thread.
+class Recorder : public GpuFrameRecorder {
+public:
+    Recorder(FILE* file, int fps, EncodeFunc* encode, void* encodeOpaque) :
+            GpuFrameRecorder(),
+            mThread(this),
+            mLock(),
+            mCond(),
+            mPending(NULL),
+            mSpare(NULL),
+            mQuit(false),
+            mFile(file),
+            mFps(fps),
+            mEncode(encode),
+            mEncodeOpaque(encodeOpaque),
+            mStarted(false),
+            mFailed(false),
+            mWidth(0),
+            mHeight(0),
+            mStartUs(0),
+            mHeld(NULL),
+            mMoviSize(0U),
+            mMaxChunkSize(0U),
+            mIndex() {}
+
+    // Write placeholder headers, and start the worker thread. Return
+    // true on success.
+    bool start() {
+        if (!writeHeaders()) {
+            return false;
+        }
+        return mThread.start();
+    }
+
+    // Destructor. Stops the worker thread, which finalizes the file.
+    virtual ~Recorder() {
+        mLock.lock();
+        mQuit = true;
+        mCond.signal();
+        mLock.unlock();
+        mThread.wait(NULL);
+
+        delete mPending;
+        delete mSpare;
+        delete mHeld;
+        ::fclose(mFile);
+    }
+
+    // Implementation of GpuFrameRecorder::postFrame(), called from the
+    // EmuGL thread. This only copies the pixels.
+    virtual void postFrame(int64_t timeUs,
+                           int width,
+                           int height,
+                           const void* pixels,
+                           int damageX,
+                           int damageY,
+                           int damageWidth,
+                           int damageHeight) {
+        if (damageWidth <= 0 || damageHeight <= 0) {
+            // Nothing changed, the previous image is simply repeated.
+            return;
+        }
+        // Reuse the pending frame if the worker didn't pick it up yet.
+        Frame* frame;
+        mLock.lock();
+        if (mPending) {
+            frame = mPending;
+            mPending = NULL;
+        } else {
+            frame = mSpare;
+            mSpare = NULL;
+        }
+        mLock.unlock();
+
+        if (!frame) {
+            frame = new Frame();
+        }
+        frame->copyFrom(width, height, pixels);
+        frame->timeUs = timeUs;
+
+        mLock.lock();
+        mPending = frame;
+        mCond.signal();
+        mLock.unlock();
+    }
+
+private:
+    class WorkerThread : public Thread {
+    public:
+        explicit WorkerThread(Recorder* recorder) :
+                Thread(), mRecorder(recorder) {}
+
+        virtual intptr_t main() {
+            mRecorder->workerMain();
+            return 0;
+        }
+
+    private:
+        Recorder* mRecorder;
+    };
+
+    void workerMain() {
+        for (;;) {
+            mLock.lock();
+            while (!mPending && !mQuit) {
+                mCond.wait(&mLock);
+            }
+            Frame* frame = mPending;
+            mPending = NULL;
+            mLock.unlock();
+
+            if (!frame) {
+                break;
+            }
+            releaseFrame(processFrame(frame));
+        }
+
+        if (mHeld) {
+            writeImage(mHeld);
+        }
+        if (!writeIndex() || ::fseek(mFile, 0, SEEK_SET) != 0 ||
+            !writeHeaders()) {
+            LOG(ERROR) << "Could not finalize screen recording";
+        }
+    }
+
+    // Give back a frame that the worker doesn't need anymore.
+    void releaseFrame(Frame* frame) {
+        if (!frame) {
+            return;
+        }
+        mLock.lock();
+        if (!mSpare) {
+            mSpare = frame;
+            frame = NULL;
+        }
+        mLock.unlock();
+        delete frame;
+    }
+
+    // Record |frame| in its time slot. Return a frame that can be
+    // recycled, or NULL.
+    Frame* processFrame(Frame* frame) {
+        if (!mStarted) {
+            mStarted = true;
+            mWidth = frame->width;
+            mHeight = frame->height;
+            mStartUs = frame->timeUs;
+        }
+        if (frame->width != mWidth || frame->height != mHeight) {
+            return frame;
+        }
+        int64_t slot = (frame->timeUs - mStartUs) * mFps / 1000000LL;
+        if (slot < static_cast<int64_t>(mIndex.size())) {
+            // The slot of this frame was already written. Keep it for the
+            // next one, so that the last image before an idle period is
+            // not lost, but drop the one that was kept previously.
+            Frame* old = mHeld;
+            mHeld = frame;
+            return old;
+        }
+        Frame* result = NULL;
+        if (mHeld) {
+            writeImage(mHeld);
+            result = mHeld;
+            mHeld = NULL;
+        }
+        while (static_cast<int64_t>(mIndex.size()) < slot && !mFailed) {
+            writeChunk(NULL, 0U, 0U);
+        }
+        writeImage(frame);
+        releaseFrame(result);
+        return frame;
+    }
+
+    // Compress |frame| and write it as the next chunk. If compression
+    // fails, the previous image is repeated instead.
+    void writeImage(const Frame* frame) {
+        const void* data = NULL;
+        size_t size = 0U;
+        if (!mEncode(mEncodeOpaque, frame->width, frame->height,
+                     frame->pixels, &data, &size)) {
+            writeChunk(NULL, 0U, 0U);
+            return;
+        }
+        writeChunk(data, size, kAviKeyFrame);
+    }
+
+    // Append a '00dc' chunk of |size| bytes from |data| to the 'movi'
+    // list, and a matching entry to the index.
+    void writeChunk(const void* data, size_t size, uint32_t flags) {
+        if (mFailed) {
+            return;
+        }
+        size_t paddedSize = size + (size & 1U);
+        if (paddedSize + 8U > kMaxMoviSize - mMoviSize) {
+            LOG(WARNING) << "Screen recording too large, stopping";
+            mFailed = true;
+            return;
+        }
+        uint8_t header[8];
+        ByteWriter writer(header);
+        writer.putTag("00dc");
+        writer.put32(static_cast<uint32_t>(size));
+
+        static const uint8_t kPadding = 0;
+        if (::fwrite(header, sizeof(header), 1, mFile) != 1 ||
+            (size > 0U && ::fwrite(data, size, 1, mFile) != 1) ||
+            ((size & 1U) && ::fwrite(&kPadding, 1, 1, mFile) != 1)) {
+            PLOG(ERROR) << "Could not write screen recording";
+            mFailed = true;
+            return;
+        }
+
+        IndexEntry entry;
+        entry.flags = flags;
+        // Offsets are relative to the 'movi' tag.
+        entry.offset = 4U + mMoviSize;
+        entry.size = static_cast<uint32_t>(size);
+        mIndex.push_back(entry);
+
+        mMoviSize += static_cast<uint32_t>(paddedSize + 8U);
+        if (size > mMaxChunkSize) {
+            mMaxChunkSize = static_cast<uint32_t>(size);
+        }
+    }
+
+    // Write the 'idx1' chunk at the end of the file.
+    bool writeIndex() {
+        const size_t count = mIndex.size();
+        PodVector<uint8_t> buffer;
+        buffer.resize(8U + 16U * count);
+        ByteWriter writer(buffer.begin());
+        writer.putTag("idx1");
+        writer.put32(static_cast<uint32_t>(16U * count));
+        for (size_t n = 0; n < count; ++n) {
+            writer.putTag("00dc");
+            writer.put32(mIndex[n].flags);
+            writer.put32(mIndex[n].offset);
+            writer.put32(mIndex[n].size);
+        }
+        return ::fwrite(buffer.begin(), buffer.size(), 1, mFile) == 1;
+    }
+
+    // Write the AVI headers at the current file position, using the
+    // current frame count and sizes.
+    bool writeHeaders() {
+        const uint32_t frames = static_cast<uint32_t>(mIndex.size());
+        const uint32_t width = static_cast<uint32_t>(mWidth);
+        const uint32_t height = static_cast<uint32_t>(mHeight);
+        const uint32_t bufferSize = mMaxChunkSize + 8U;
+
+        uint8_t header[kHeaderSize];
+        ByteWriter writer(header);
+        writer.putTag("RIFF");
+        writer.put32(static_cast<uint32_t>(kHeaderSize - 8U) + mMoviSize +
+                     8U + 16U * frames);
+        writer.putTag("AVI ");
+
+        writer.putTag("LIST");
+        writer.put32(192U);
+        writer.putTag("hdrl");
+
+        writer.putTag("avih");
+        writer.put32(56U);
+        writer.put32(static_cast<uint32_t>(1000000 / mFps));
+        writer.put32(bufferSize * static_cast<uint32_t>(mFps));
+        writer.put32(0U);             // dwPaddingGranularity
+        writer.put32(kAviHasIndex);
+        writer.put32(frames);
+        writer.put32(0U);             // dwInitialFrames
+        writer.put32(1U);             // dwStreams
+        writer.put32(bufferSize);
+        writer.put32(width);
+        writer.put32(height);
+        for (int n = 0; n < 4; ++n) {
+            writer.put32(0U);         // dwReserved
+        }
+
+        writer.putTag("LIST");
+        writer.put32(116U);
+        writer.putTag("strl");
+
+        writer.putTag("strh");
+        writer.put32(56U);
+        writer.putTag("vids");
+        writer.putTag("MJPG");
+        writer.put32(0U);             // dwFlags
+        writer.put16(0U);             // wPriority
+        writer.put16(0U);             // wLanguage
+        writer.put32(0U);             // dwInitialFrames
+        writer.put32(1U);             // dwScale
+        writer.put32(static_cast<uint32_t>(mFps));
+        writer.put32(0U);             // dwStart
+        writer.put32(frames);
+        writer.put32(bufferSize);
+        writer.put32(0xffffffffU);    // dwQuality
+        writer.put32(0U);             // dwSampleSize
+        writer.put16(0U);
+        writer.put16(0U);
+        writer.put16(static_cast<uint16_t>(width));
+        writer.put16(static_cast<uint16_t>(height));
+
+        writer.putTag("strf");
+        writer.put32(40U);
+        writer.put32(40U);            // biSize
+        writer.put32(width);
+        writer.put32(height);
+        writer.put16(1U);             // biPlanes
+        writer.put16(24U);            // biBitCount
+        writer.putTag("MJPG");
+        writer.put32(width * height * 3U);
+        for (int n = 0; n < 4; ++n) {
+            writer.put32(0U);         // Resolution and palette.
+        }
+
+        writer.putTag("LIST");
+        writer.put32(4U + mMoviSize);
+        writer.putTag("movi");
+
+        return ::fwrite(header, sizeof(header), 1, mFile) == 1;
+    }
+
+    WorkerThread mThread;
+
+    // Shared with the EmuGL thread.
+    Lock mLock;
+    ConditionVariable mCond;
+    Frame* mPending;
+    Frame* mSpare;
+    bool mQuit;
+
+    // Owned by the worker thread once started.
+    FILE* mFile;
+    int mFps;
+    EncodeFunc* mEncode;
+    void* mEncodeOpaque;
+    bool mStarted;
+    bool mFailed;
+    int mWidth;
+    int mHeight;
+    int64_t mStartUs;
+    // Latest frame whose time slot was already written, if any.
+    Frame* mHeld;
+    uint32_t mMoviSize;
+    uint32_t mMaxChunkSize;
+    PodVector<IndexEntry> mIndex;
+};
+
+}  // namespace
+
+// static
+GpuFrameRecorder* GpuFrameRecorder::create(const char* path,
+                                           int fps,
+                                           EncodeFunc* encode,
+                                           void* encodeOpaque) {
+    if (fps <= 0) {
+        LOG(ERROR) << "Invalid screen recording frame rate: " << fps;
+        return NULL;
+    }
+    FILE* file = ::fopen(path, "wb");
+    if (!file) {
+        PLOG(ERROR) << "Could not create screen recording file " << path;
+        return NULL;
+    }
+    Recorder* recorder = new Recorder(file, fps, encode, encodeOpaque);
+    if (!recorder->start()) {
+        LOG(ERROR) << "Could not start screen recording";
+        delete recorder;
+        return NULL;
+    }
+    return recorder;
+}
+
+}  // namespace opengl
+}  // namespace android
@@ -0,0 +1,93 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_OPENGL_GPU_FRAME_RECORDER_H
+#define ANDROID_OPENGL_GPU_FRAME_RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace opengl {
+
+// GpuFrameRecorder records the frames of the GPU display into a
+// Motion-JPEG AVI file, at a fixed frame rate.
+//
+// Frames are posted from the EmuGL thread, but only copied there: they are
+// compressed and written to disk by a dedicated worker thread. As with
+// GpuFrameBridge, only the latest posted frame is kept, so a slow encoder
+// drops frames instead of slowing down rendering. Frames whose damage
+// rectangle is empty are ignored, and the time slots without a new frame
+// are filled with empty chunks, which players display as a repeat of the
+// previous image.
+//
+// Usage is the following:
+//
+//  1) Create a new instance with create(), passing the output file path,
+//     the frame rate, and a function used to compress a single frame.
+//
+//  2) Call postFrame() from the EmuGL thread for each new frame.
+//
+//  3) Delete the instance to stop recording. This waits for the pending
+//     frame to be written, and finalizes the file.
+//
+class GpuFrameRecorder {
+public:
+    // Type of function used to compress a single frame into a JPEG image,
+    // called from the worker thread. |opaque| is a user-provided pointer,
+    // |width| and |height| are dimensions in pixels, and |pixels| is a
+    // buffer of 32-bit RGBA bottom-up image data, as provided by EmuGL.
+    // On success, must set |*data| and |*size| to the compressed image,
+    // which must remain valid until the next call, and return true.
+    typedef bool (EncodeFunc)(void* opaque,
+                              int width,
+                              int height,
+                              const void* pixels,
+                              const void** data,
+                              size_t* size);
+
+    // Create a new recorder writing to the file at |path|, at |fps| frames
+    // per second. |encode| and |encodeOpaque| are used to compress frames.
+    // Return NULL if the file, or the worker thread, could not be created.
+    static GpuFrameRecorder* create(const char* path,
+                                    int fps,
+                                    EncodeFunc* encode,
+                                    void* encodeOpaque);
+
+    // Destructor. Stops recording and finalizes the file.
+    virtual ~GpuFrameRecorder() {}
+
+    // Post a new frame from the EmuGL thread. |timeUs| is the time of the
+    // frame in microseconds, from any monotonic clock, and the damage
+    // rectangle is the area that changed since the previous post. All
+    // frames must have the same dimensions as the first one, others are
+    // dropped.
+    virtual void postFrame(int64_t timeUs,
+                           int width,
+                           int height,
+                           const void* pixels,
+                           int damageX,
+                           int damageY,
+                           int damageWidth,
+                           int damageHeight) = 0;
+
+protected:
+    GpuFrameRecorder() {}
+    GpuFrameRecorder(const GpuFrameRecorder& other);
+};
+
+}  // namespace opengl
+}  // namespace android
+
+#endif  // ANDROID_OPENGL_GPU_FRAME_RECORDER_H
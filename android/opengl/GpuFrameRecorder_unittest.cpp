@@ -0,0 +1,243 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/opengl/GpuFrameRecorder.h"
+
+#include "android/base/containers/PodVector.h"
+#include "android/base/memory/ScopedPtr.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/String.h"
+#include "android/base/StringFormat.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+namespace android {
+namespace opengl {
+
+using android::base::ConditionVariable;
+using android::base::Lock;
+using android::base::PodVector;
+using android::base::ScopedPtr;
+using android::base::String;
+using android::base::StringFormat;
+using android::base::TestTempDir;
+
+namespace {
+
+const int kWidth = 4;
+const int kHeight = 2;
+
+// A fake encoder that 'compresses' a frame into a string holding the
+// value of its first pixel, and counts the calls.
+class FakeEncoder {
+public:
+    FakeEncoder() : mLock(), mCond(), mCount(0), mData() {}
+
+    static bool encode(void* opaque,
+                       int width,
+                       int height,
+                       const void* pixels,
+                       const void** data,
+                       size_t* size) {
+        FakeEncoder* encoder = static_cast<FakeEncoder*>(opaque);
+        encoder->mData = StringFormat("frame%d",
+                                      *static_cast<const uint8_t*>(pixels));
+        *data = encoder->mData.c_str();
+        *size = encoder->mData.size();
+
+        encoder->mLock.lock();
+        encoder->mCount++;
+        encoder->mCond.signal();
+        encoder->mLock.unlock();
+        return true;
+    }
+
+    // Wait until |count| frames have been encoded.
+    void waitForCount(int count) {
+        mLock.lock();
+        while (mCount < count) {
+            mCond.wait(&mLock);
+        }
+        mLock.unlock();
+    }
+
+private:
+    Lock mLock;
+    ConditionVariable mCond;
+    int mCount;
+    String mData;
+};
+
+class GpuFrameRecorderTest : public ::testing::Test {
+public:
+    GpuFrameRecorderTest() :
+            mTempDir("GpuFrameRecorderTest"),
+            mPath(mTempDir.makeSubPath("recording.avi")),
+            mEncoder(),
+            mRecorder() {}
+
+    virtual void SetUp() {
+        ASSERT_TRUE(mTempDir.path());
+        mRecorder.reset(GpuFrameRecorder::create(
+                mPath.c_str(), 10, &FakeEncoder::encode, &mEncoder));
+        ASSERT_TRUE(mRecorder.get());
+    }
+
+    // Post a frame whose pixels are all set to |value|.
+    void post(int64_t timeUs, uint8_t value) {
+        uint8_t pixels[kWidth * kHeight * 4];
+        ::memset(pixels, value, sizeof(pixels));
+        mRecorder->postFrame(timeUs, kWidth, kHeight, pixels,
+                             0, 0, kWidth, kHeight);
+    }
+
+    // Stop recording, and read the content of the file.
+    void finish(PodVector<uint8_t>* data) {
+        mRecorder.reset(NULL);
+        FILE* file = ::fopen(mPath.c_str(), "rb");
+        ASSERT_TRUE(file);
+        uint8_t buffer[4096];
+        size_t size;
+        while ((size = ::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            size_t pos = data->size();
+            data->resize(pos + size);
+            ::memcpy(&(*data)[pos], buffer, size);
+        }
+        ::fclose(file);
+    }
+
+    static uint32_t get32(const PodVector<uint8_t>& data, size_t pos) {
+        return data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16) |
+               (static_cast<uint32_t>(data[pos + 3]) << 24);
+    }
+
+    static String getTag(const PodVector<uint8_t>& data, size_t pos) {
+        return String(reinterpret_cast<const char*>(&data[pos]), 4U);
+    }
+
+    // Parse the AVI file in |data| and return the content of its frames,
+    // as listed by the index, checking the headers on the way.
+    static void parseFrames(const PodVector<uint8_t>& data,
+                            std::vector<String>* frames) {
+        ASSERT_LE(224U, data.size());
+        EXPECT_STREQ("RIFF", getTag(data, 0).c_str());
+        EXPECT_EQ(data.size() - 8U, get32(data, 4));
+        EXPECT_STREQ("AVI ", getTag(data, 8).c_str());
+        EXPECT_STREQ("avih", getTag(data, 24).c_str());
+        const uint32_t count = get32(data, 48);
+        EXPECT_EQ(static_cast<uint32_t>(kWidth), get32(data, 64));
+        EXPECT_EQ(static_cast<uint32_t>(kHeight), get32(data, 68));
+        EXPECT_STREQ("strh", getTag(data, 100).c_str());
+        EXPECT_STREQ("MJPG", getTag(data, 112).c_str());
+        EXPECT_EQ(count, get32(data, 140));
+        EXPECT_STREQ("movi", getTag(data, 220).c_str());
+
+        const size_t indexPos = 220U + get32(data, 216);
+        ASSERT_GE(data.size(), indexPos + 8U);
+        EXPECT_STREQ("idx1", getTag(data, indexPos).c_str());
+        EXPECT_EQ(count * 16U, get32(data, indexPos + 4));
+        ASSERT_EQ(data.size(), indexPos + 8U + count * 16U);
+
+        for (uint32_t n = 0; n < count; ++n) {
+            size_t entry = indexPos + 8U + n * 16U;
+            EXPECT_STREQ("00dc", getTag(data, entry).c_str());
+            size_t chunk = 220U + get32(data, entry + 8);
+            uint32_t size = get32(data, entry + 12);
+            EXPECT_STREQ("00dc", getTag(data, chunk).c_str());
+            EXPECT_EQ(size, get32(data, chunk + 4));
+            EXPECT_EQ(size ? 0x10U : 0U, get32(data, entry + 4));
+            frames->push_back(String(
+                    reinterpret_cast<const char*>(&data[chunk + 8]), size));
+        }
+    }
+
+protected:
+    TestTempDir mTempDir;
+    String mPath;
+    FakeEncoder mEncoder;
+    ScopedPtr<GpuFrameRecorder> mRecorder;
+};
+
+}  // namespace
+
+TEST_F(GpuFrameRecorderTest, NoFrames) {
+    PodVector<uint8_t> data;
+    mRecorder->postFrame(0, kWidth, kHeight, NULL, 0, 0, 0, 0);
+    finish(&data);
+    // Without frames, the headers don't know the dimensions.
+    EXPECT_EQ(224U + 8U, data.size());
+    EXPECT_EQ(0U, get32(data, 48));
+}
+
+TEST_F(GpuFrameRecorderTest, FramesAndRepeats) {
+    post(0, 1);
+    mEncoder.waitForCount(1);
+    post(100000, 2);
+    mEncoder.waitForCount(2);
+    // No new frame for two slots.
+    post(420000, 3);
+    mEncoder.waitForCount(3);
+
+    PodVector<uint8_t> data;
+    finish(&data);
+    std::vector<String> frames;
+    parseFrames(data, &frames);
+    ASSERT_EQ(5U, frames.size());
+    EXPECT_STREQ("frame1", frames[0].c_str());
+    EXPECT_STREQ("frame2", frames[1].c_str());
+    EXPECT_STREQ("", frames[2].c_str());
+    EXPECT_STREQ("", frames[3].c_str());
+    EXPECT_STREQ("frame3", frames[4].c_str());
+}
+
+TEST_F(GpuFrameRecorderTest, LateFrameInSameSlotIsKept) {
+    post(0, 1);
+    mEncoder.waitForCount(1);
+    // Same slot as the first one, this must still be the last image.
+    post(50000, 2);
+
+    PodVector<uint8_t> data;
+    finish(&data);
+    std::vector<String> frames;
+    parseFrames(data, &frames);
+    ASSERT_EQ(2U, frames.size());
+    EXPECT_STREQ("frame1", frames[0].c_str());
+    EXPECT_STREQ("frame2", frames[1].c_str());
+}
+
+TEST_F(GpuFrameRecorderTest, IgnoresOtherSizes) {
+    post(0, 1);
+    mEncoder.waitForCount(1);
+    uint8_t pixels[16 * 16 * 4] = {};
+    mRecorder->postFrame(200000, 16, 16, pixels, 0, 0, 16, 16);
+    mRecorder->postFrame(200000, kWidth, kHeight, pixels, 0, 0, 0, 0);
+
+    PodVector<uint8_t> data;
+    finish(&data);
+    std::vector<String> frames;
+    parseFrames(data, &frames);
+    ASSERT_EQ(1U, frames.size());
+    EXPECT_STREQ("frame1", frames[0].c_str());
+}
+
+}  // namespace opengl
+}  // namespace android
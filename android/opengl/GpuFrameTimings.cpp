@@ -0,0 +1,206 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/opengl/GpuFrameTimings.h"
+
+#include "android/base/Log.h"
+#include "android/base/StringFormat.h"
+
+#include <string.h>
+
+namespace android {
+namespace opengl {
+
+using android::base::AutoLock;
+using android::base::String;
+using android::base::StringAppendFormat;
+
+void GpuFrameTimings::Histogram::add(int64_t durationUs) {
+    if (durationUs < 0) {
+        // Can happen when a frame is replaced while it is delivered.
+        durationUs = 0;
+    }
+    count++;
+    totalUs += durationUs;
+    if (durationUs > maxUs) {
+        maxUs = durationUs;
+    }
+    int bucket = 0;
+    while (bucket < kBucketCount - 1 && durationUs >= (1LL << bucket)) {
+        bucket++;
+    }
+    buckets[bucket]++;
+}
+
+int64_t GpuFrameTimings::Histogram::percentile(int percent) const {
+    uint32_t target = (count * percent + 99) / 100;
+    uint32_t sum = 0;
+    for (int n = 0; n < kBucketCount - 1; ++n) {
+        sum += buckets[n];
+        if (sum >= target) {
+            return 1LL << n;
+        }
+    }
+    return maxUs;
+}
+
+GpuFrameTimings::GpuFrameTimings() :
+        mLock(),
+        mHasPending(false),
+        mDropped(0U),
+        mTrace(NULL),
+        mTraceEmpty(true) {
+    ::memset(mPending, 0, sizeof(mPending));
+    ::memset(mHistograms, 0, sizeof(mHistograms));
+}
+
+GpuFrameTimings::~GpuFrameTimings() {
+    stopTrace();
+}
+
+void GpuFrameTimings::framePosted(const int64_t* timesUs) {
+    AutoLock lock(mLock);
+    if (mHasPending) {
+        mDropped++;
+    }
+    for (int n = 0; n <= kBridgePost; ++n) {
+        mPending[n] = timesUs[n];
+    }
+    mHasPending = true;
+}
+
+void GpuFrameTimings::frameDisplayed(int64_t deliveredUs,
+                                     int64_t displayedUs) {
+    AutoLock lock(mLock);
+    if (!mHasPending) {
+        return;
+    }
+    mHasPending = false;
+    mPending[kDelivered] = deliveredUs;
+    mPending[kDisplayed] = displayedUs;
+
+    int first = -1;
+    int prev = -1;
+    for (int n = 0; n < kStageCount; ++n) {
+        if (mPending[n] < 0) {
+            continue;
+        }
+        if (prev >= 0) {
+            mHistograms[n].add(mPending[n] - mPending[prev]);
+        } else {
+            first = n;
+        }
+        prev = n;
+    }
+    if (first >= 0 && prev > first) {
+        mHistograms[0].add(mPending[prev] - mPending[first]);
+    }
+    if (mTrace) {
+        writeTraceEvents_locked(mPending);
+    }
+}
+
+void GpuFrameTimings::reset() {
+    AutoLock lock(mLock);
+    mDropped = 0U;
+    ::memset(mHistograms, 0, sizeof(mHistograms));
+}
+
+void GpuFrameTimings::getReport(String* report) {
+    AutoLock lock(mLock);
+    StringAppendFormat(report, "frames: %u displayed, %u dropped\n",
+                       mHistograms[0].count, mDropped);
+    for (int n = 0; n < kStageCount; ++n) {
+        const Histogram& h = mHistograms[n];
+        if (n > 0 && !h.count) {
+            continue;
+        }
+        StringAppendFormat(
+                report,
+                "%-22s avg %6lld us, p50 < %6lld us, p90 < %6lld us, "
+                "p99 < %6lld us, max %6lld us\n",
+                intervalName(n),
+                h.count ? (long long)(h.totalUs / h.count) : 0LL,
+                (long long)h.percentile(50),
+                (long long)h.percentile(90),
+                (long long)h.percentile(99),
+                (long long)h.maxUs);
+    }
+}
+
+bool GpuFrameTimings::startTrace(const char* path) {
+    stopTrace();
+    FILE* trace = ::fopen(path, "w");
+    if (!trace) {
+        PLOG(ERROR) << "Could not create trace file " << path;
+        return false;
+    }
+    ::fputs("[", trace);
+
+    AutoLock lock(mLock);
+    mTrace = trace;
+    mTraceEmpty = true;
+    return true;
+}
+
+void GpuFrameTimings::stopTrace() {
+    AutoLock lock(mLock);
+    if (!mTrace) {
+        return;
+    }
+    ::fputs("\n]\n", mTrace);
+    ::fclose(mTrace);
+    mTrace = NULL;
+}
+
+// static
+const char* GpuFrameTimings::intervalName(int stage) {
+    static const char* const kNames[kStageCount] = {
+        "guest post -> UI",
+        "guest post -> render",
+        "render -> readback",
+        "readback",
+        "readback -> bridge",
+        "bridge -> main loop",
+        "main loop -> UI",
+    };
+    return kNames[stage];
+}
+
+void GpuFrameTimings::writeTraceEvents_locked(const int64_t* timesUs) {
+    // Each interval is a 'complete' event, on its own track so that
+    // overlapping frames remain readable.
+    int prev = -1;
+    for (int n = 0; n < kStageCount; ++n) {
+        if (timesUs[n] < 0) {
+            continue;
+        }
+        if (prev >= 0) {
+            int64_t duration = timesUs[n] - timesUs[prev];
+            ::fprintf(mTrace,
+                      "%s\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\","
+                      "\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%d}",
+                      mTraceEmpty ? "" : ",",
+                      intervalName(n),
+                      (long long)timesUs[prev],
+                      (long long)(duration > 0 ? duration : 0),
+                      n);
+            mTraceEmpty = false;
+        }
+        prev = n;
+    }
+}
+
+}  // namespace opengl
+}  // namespace android
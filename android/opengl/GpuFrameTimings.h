@@ -0,0 +1,119 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_OPENGL_GPU_FRAME_TIMINGS_H
+#define ANDROID_OPENGL_GPU_FRAME_TIMINGS_H
+
+#include "android/base/String.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace android {
+namespace opengl {
+
+// GpuFrameTimings measures the latency of the GPU display pipeline, from
+// the moment the guest posts a frame to the moment the UI receives it.
+//
+// The EmuGL thread reports the times of the first stages of each frame it
+// passes to the GpuFrameBridge, and the main loop thread reports the last
+// ones when the frame is delivered. Frames replaced by a newer one before
+// their delivery are counted as dropped.
+//
+// The duration between consecutive stages is accumulated into histograms,
+// which can be dumped with getReport(), and each delivered frame can also
+// be written to a trace file in the Chrome trace event format, which can
+// be loaded in chrome://tracing.
+class GpuFrameTimings {
+public:
+    // The stages of a frame, in order.
+    enum Stage {
+        kGuestPost = 0,     // The guest posted the frame.
+        kPostStart,         // The renderer started processing it.
+        kReadbackStart,     // The readback of its pixels started.
+        kReadbackEnd,       // The readback completed.
+        kBridgePost,        // The frame was passed to the GpuFrameBridge.
+        kDelivered,         // The main loop received the frame.
+        kDisplayed,         // The UI was updated with the frame.
+        kStageCount
+    };
+
+    // Number of histogram buckets. Bucket 0 counts durations below 1us,
+    // bucket n > 0 the ones in [2^(n-1), 2^n) us, and the last one all
+    // longer durations.
+    static const int kBucketCount = 22;
+
+    GpuFrameTimings();
+
+    // Destructor. Closes the trace file, if any.
+    ~GpuFrameTimings();
+
+    // Called from the EmuGL thread: record the times of the stages up to
+    // kBridgePost, included, of a frame about to be sent to the bridge.
+    // |timesUs| has kBridgePost + 1 entries, negative values are unknown
+    // stages. All times must use the same clock, in microseconds.
+    void framePosted(const int64_t* timesUs);
+
+    // Called from the main loop thread when the last posted frame was
+    // received at |deliveredUs|, and the UI updated at |displayedUs|.
+    void frameDisplayed(int64_t deliveredUs, int64_t displayedUs);
+
+    // Clear all the statistics.
+    void reset();
+
+    // Append a human-readable report of the statistics to |*report|, one
+    // line per stage, with lines separated by '\n'.
+    void getReport(android::base::String* report);
+
+    // Start writing each displayed frame into a new trace file at |path|,
+    // replacing the current one if any. Return false on failure.
+    bool startTrace(const char* path);
+
+    // Stop writing the current trace file, if any.
+    void stopTrace();
+
+private:
+    struct Histogram {
+        uint32_t count;
+        int64_t totalUs;
+        int64_t maxUs;
+        uint32_t buckets[kBucketCount];
+
+        void add(int64_t durationUs);
+        // Return the upper bound of the bucket that contains the
+        // |percent|-th percentile duration.
+        int64_t percentile(int percent) const;
+    };
+
+    // Return the name of the interval that ends with |stage|.
+    static const char* intervalName(int stage);
+
+    void writeTraceEvents_locked(const int64_t* timesUs);
+
+    android::base::Lock mLock;
+    int64_t mPending[kStageCount];
+    bool mHasPending;
+    uint32_t mDropped;
+    // Per-stage histograms, entry n > 0 measures the time between the
+    // previous known stage and stage n, entry 0 the whole pipeline.
+    Histogram mHistograms[kStageCount];
+    FILE* mTrace;
+    bool mTraceEmpty;
+};
+
+}  // namespace opengl
+}  // namespace android
+
+#endif  // ANDROID_OPENGL_GPU_FRAME_TIMINGS_H
@@ -0,0 +1,124 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/opengl/GpuFrameTimings.h"
+
+#include "android/base/String.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace android {
+namespace opengl {
+
+using android::base::String;
+using android::base::TestTempDir;
+
+namespace {
+
+// Post a frame whose stages are |step| us apart, starting at |startUs|.
+void postFrame(GpuFrameTimings* timings, int64_t startUs, int64_t step) {
+    int64_t times[GpuFrameTimings::kBridgePost + 1];
+    for (int n = 0; n <= GpuFrameTimings::kBridgePost; ++n) {
+        times[n] = startUs + n * step;
+    }
+    timings->framePosted(times);
+}
+
+}  // namespace
+
+TEST(GpuFrameTimings, Report) {
+    GpuFrameTimings timings;
+    postFrame(&timings, 1000, 10);
+    timings.frameDisplayed(1050, 1060);
+    // Dropped, replaced by the next one before delivery.
+    postFrame(&timings, 2000, 100);
+    postFrame(&timings, 3000, 100);
+    timings.frameDisplayed(3500, 3600);
+    // Nothing pending, ignored.
+    timings.frameDisplayed(4000, 4000);
+
+    String report;
+    timings.getReport(&report);
+    EXPECT_TRUE(::strstr(report.c_str(), "frames: 2 displayed, 1 dropped\n"))
+            << report.c_str();
+    // Total: 60us then 600us.
+    EXPECT_TRUE(::strstr(report.c_str(),
+                         "guest post -> UI       avg    330 us, "
+                         "p50 <     64 us, p90 <   1024 us, "
+                         "p99 <   1024 us, max    600 us\n"))
+            << report.c_str();
+    EXPECT_TRUE(::strstr(report.c_str(), "readback               avg     55 us"))
+            << report.c_str();
+
+    timings.reset();
+    report.clear();
+    timings.getReport(&report);
+    EXPECT_STREQ("frames: 0 displayed, 0 dropped\n"
+                 "guest post -> UI       avg      0 us, p50 <      1 us, "
+                 "p90 <      1 us, p99 <      1 us, max      0 us\n",
+                 report.c_str());
+}
+
+TEST(GpuFrameTimings, UnknownStages) {
+    GpuFrameTimings timings;
+    int64_t times[GpuFrameTimings::kBridgePost + 1] = { -1, -1, -1, 100, 110 };
+    timings.framePosted(times);
+    timings.frameDisplayed(200, 210);
+
+    String report;
+    timings.getReport(&report);
+    EXPECT_TRUE(::strstr(report.c_str(), "guest post -> UI       avg    110 us"))
+            << report.c_str();
+    EXPECT_FALSE(::strstr(report.c_str(), "render -> readback"))
+            << report.c_str();
+    EXPECT_TRUE(::strstr(report.c_str(), "bridge -> main loop    avg     90 us"))
+            << report.c_str();
+}
+
+TEST(GpuFrameTimings, Trace) {
+    TestTempDir tempDir("GpuFrameTimingsTest");
+    ASSERT_TRUE(tempDir.path());
+    String path = tempDir.makeSubPath("trace.json");
+
+    GpuFrameTimings timings;
+    ASSERT_TRUE(timings.startTrace(path.c_str()));
+    postFrame(&timings, 1000, 10);
+    timings.frameDisplayed(1050, 1060);
+    timings.stopTrace();
+
+    FILE* file = ::fopen(path.c_str(), "r");
+    ASSERT_TRUE(file);
+    char buffer[4096];
+    size_t size = ::fread(buffer, 1, sizeof(buffer) - 1, file);
+    ::fclose(file);
+    buffer[size] = 0;
+
+    EXPECT_EQ('[', buffer[0]);
+    EXPECT_TRUE(::strstr(buffer, "\n]\n"));
+    EXPECT_TRUE(::strstr(buffer,
+            "\n{\"name\":\"guest post -> render\",\"cat\":\"gpu\","
+            "\"ph\":\"X\",\"ts\":1000,\"dur\":10,\"pid\":1,\"tid\":1},"))
+            << buffer;
+    EXPECT_TRUE(::strstr(buffer,
+            "\n{\"name\":\"main loop -> UI\",\"cat\":\"gpu\","
+            "\"ph\":\"X\",\"ts\":1050,\"dur\":10,\"pid\":1,\"tid\":6}\n]"))
+            << buffer;
+}
+
+}  // namespace opengl
+}  // namespace android
@@ -0,0 +1,214 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/opengl/ScreenshotWriter.h"
+
+#include "android/base/containers/TailQueueList.h"
+#include "android/base/Log.h"
+#include "android/base/String.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/Thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#undef ERROR
+#endif
+
+namespace android {
+namespace opengl {
+
+using android::base::ConditionVariable;
+using android::base::Lock;
+using android::base::String;
+using android::base::TailQueueLink;
+using android::base::TailQueueList;
+using android::base::Thread;
+
+namespace {
+
+// A single screenshot waiting to be written.
+struct Job {
+    Job(const char* path, int w, int h, const void* src) :
+            link(),
+            path(path),
+            width(w),
+            height(h),
+            pixels(NULL) {
+        size_t size = static_cast<size_t>(w) * 4U * static_cast<size_t>(h);
+        pixels = ::malloc(size);
+        ::memcpy(pixels, src, size);
+    }
+
+    ~Job() {
+        ::free(pixels);
+    }
+
+    TailQueueLink<Job> link;
+    String path;
+    int width;
+    int height;
+    void* pixels;
+
+    TAIL_QUEUE_LIST_TRAITS(Traits, Job, link);
+};
+
+typedef TailQueueList<Job> JobList;
+
+// Real implementation of the ScreenshotWriter interface.
+class Writer : public ScreenshotWriter {
+public:
+    Writer(EncodeFunc* encode, void* encodeOpaque) :
+            ScreenshotWriter(),
+            mThread(this),
+            mLock(),
+            mCond(),
+            mJobs(),
+            mJobCount(0U),
+            mQuit(false),
+            mEncode(encode),
+            mEncodeOpaque(encodeOpaque) {}
+
+    bool start() {
+        return mThread.start();
+    }
+
+    virtual ~Writer() {
+        mLock.lock();
+        mQuit = true;
+        mCond.signal();
+        mLock.unlock();
+        mThread.wait(NULL);
+    }
+
+    virtual bool saveFrame(const char* path,
+                           int width,
+                           int height,
+                           const void* pixels) {
+        mLock.lock();
+        bool full = (mJobCount >= kMaxPending);
+        mLock.unlock();
+        if (full) {
+            return false;
+        }
+        Job* job = new Job(path, width, height, pixels);
+
+        mLock.lock();
+        mJobs.insertTail(job);
+        mJobCount++;
+        mCond.signal();
+        mLock.unlock();
+        return true;
+    }
+
+private:
+    class WorkerThread : public Thread {
+    public:
+        explicit WorkerThread(Writer* writer) : Thread(), mWriter(writer) {}
+
+        virtual intptr_t main() {
+            mWriter->workerMain();
+            return 0;
+        }
+
+    private:
+        Writer* mWriter;
+    };
+
+    // Write all queued screenshots until the instance is destroyed.
+    void workerMain() {
+        for (;;) {
+            mLock.lock();
+            while (mJobs.empty() && !mQuit) {
+                mCond.wait(&mLock);
+            }
+            Job* job = mJobs.popFront();
+            mLock.unlock();
+
+            if (!job) {
+                break;
+            }
+            writeJob(job);
+            delete job;
+
+            mLock.lock();
+            mJobCount--;
+            mLock.unlock();
+        }
+    }
+
+    void writeJob(const Job* job) {
+        const void* data = NULL;
+        size_t size = 0U;
+        if (!mEncode(mEncodeOpaque, job->width, job->height, job->pixels,
+                     &data, &size)) {
+            LOG(ERROR) << "Could not compress screenshot "
+                       << job->path.c_str();
+            return;
+        }
+
+        String tempPath(job->path);
+        tempPath += ".tmp";
+        FILE* file = ::fopen(tempPath.c_str(), "wb");
+        if (!file) {
+            PLOG(ERROR) << "Could not create screenshot file "
+                        << tempPath.c_str();
+            return;
+        }
+        bool ok = (::fwrite(data, size, 1, file) == 1);
+        if (::fclose(file) != 0) {
+            ok = false;
+        }
+#ifdef _WIN32
+        // rename() doesn't replace existing files on Windows.
+        if (ok) {
+            ::remove(job->path.c_str());
+        }
+#endif
+        if (!ok || ::rename(tempPath.c_str(), job->path.c_str()) != 0) {
+            PLOG(ERROR) << "Could not write screenshot file "
+                        << job->path.c_str();
+            ::remove(tempPath.c_str());
+        }
+    }
+
+    WorkerThread mThread;
+    Lock mLock;
+    ConditionVariable mCond;
+    JobList mJobs;
+    size_t mJobCount;
+    bool mQuit;
+    EncodeFunc* mEncode;
+    void* mEncodeOpaque;
+};
+
+}  // namespace
+
+// static
+ScreenshotWriter* ScreenshotWriter::create(EncodeFunc* encode,
+                                           void* encodeOpaque) {
+    Writer* writer = new Writer(encode, encodeOpaque);
+    if (!writer->start()) {
+        LOG(ERROR) << "Could not start screenshot thread";
+        delete writer;
+        return NULL;
+    }
+    return writer;
+}
+
+}  // namespace opengl
+}  // namespace android
@@ -0,0 +1,64 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_OPENGL_SCREENSHOT_WRITER_H
+#define ANDROID_OPENGL_SCREENSHOT_WRITER_H
+
+#include "android/opengl/GpuFrameRecorder.h"
+
+namespace android {
+namespace opengl {
+
+// ScreenshotWriter saves frames of the GPU display into image files.
+//
+// The caller only pays for a copy of the pixels: compressing the image
+// and writing the file are done by a dedicated worker thread, in the
+// order of the requests. Each image is first written to a temporary file,
+// then renamed, so that the final path only appears once the file is
+// complete.
+class ScreenshotWriter {
+public:
+    // Type of function used to compress a frame, called from the worker
+    // thread. See GpuFrameRecorder::EncodeFunc.
+    typedef GpuFrameRecorder::EncodeFunc EncodeFunc;
+
+    // Maximum number of screenshots waiting to be written.
+    static const size_t kMaxPending = 8;
+
+    // Create a new instance that uses |encode| and |encodeOpaque| to
+    // compress frames. Return NULL if the worker thread could not be
+    // started.
+    static ScreenshotWriter* create(EncodeFunc* encode, void* encodeOpaque);
+
+    // Destructor. Waits for all pending screenshots to be written.
+    virtual ~ScreenshotWriter() {}
+
+    // Queue the |width| x |height| 32-bit RGBA bottom-up |pixels|, as
+    // provided by EmuGL, to be saved into the file at |path|. Can be
+    // called from any thread. Return false if kMaxPending screenshots are
+    // already waiting to be written.
+    virtual bool saveFrame(const char* path,
+                           int width,
+                           int height,
+                           const void* pixels) = 0;
+
+protected:
+    ScreenshotWriter() {}
+    ScreenshotWriter(const ScreenshotWriter& other);
+};
+
+}  // namespace opengl
+}  // namespace android
+
+#endif  // ANDROID_OPENGL_SCREENSHOT_WRITER_H
@@ -0,0 +1,157 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/opengl/ScreenshotWriter.h"
+
+#include "android/base/memory/ScopedPtr.h"
+#include "android/base/String.h"
+#include "android/base/StringFormat.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace android {
+namespace opengl {
+
+using android::base::ConditionVariable;
+using android::base::Lock;
+using android::base::ScopedPtr;
+using android::base::String;
+using android::base::StringFormat;
+using android::base::TestTempDir;
+
+namespace {
+
+// A fake encoder that 'compresses' a frame into a string holding its
+// dimensions and the value of its first pixel. It can also be blocked,
+// to fill the queue of the writer.
+class FakeEncoder {
+public:
+    FakeEncoder() : mLock(), mCond(), mBlocked(false), mData() {}
+
+    static bool encode(void* opaque,
+                       int width,
+                       int height,
+                       const void* pixels,
+                       const void** data,
+                       size_t* size) {
+        FakeEncoder* encoder = static_cast<FakeEncoder*>(opaque);
+        encoder->mLock.lock();
+        while (encoder->mBlocked) {
+            encoder->mCond.wait(&encoder->mLock);
+        }
+        encoder->mLock.unlock();
+
+        encoder->mData = StringFormat("%dx%d:%d", width, height,
+                                      *static_cast<const uint8_t*>(pixels));
+        *data = encoder->mData.c_str();
+        *size = encoder->mData.size();
+        return true;
+    }
+
+    void setBlocked(bool blocked) {
+        mLock.lock();
+        mBlocked = blocked;
+        mCond.signal();
+        mLock.unlock();
+    }
+
+private:
+    Lock mLock;
+    ConditionVariable mCond;
+    bool mBlocked;
+    String mData;
+};
+
+String readFile(const String& path) {
+    String result;
+    FILE* file = ::fopen(path.c_str(), "rb");
+    if (!file) {
+        return result;
+    }
+    char buffer[256];
+    size_t size = ::fread(buffer, 1, sizeof(buffer), file);
+    result.assign(buffer, size);
+    ::fclose(file);
+    return result;
+}
+
+bool fileExists(const String& path) {
+    FILE* file = ::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    ::fclose(file);
+    return true;
+}
+
+}  // namespace
+
+TEST(ScreenshotWriter, SaveFrames) {
+    TestTempDir tempDir("ScreenshotWriterTest");
+    ASSERT_TRUE(tempDir.path());
+    FakeEncoder encoder;
+    ScopedPtr<ScreenshotWriter> writer(
+            ScreenshotWriter::create(&FakeEncoder::encode, &encoder));
+    ASSERT_TRUE(writer.get());
+
+    const int kCount = 3;
+    uint8_t pixels[4 * 4 * 4];
+    for (int n = 0; n < kCount; ++n) {
+        ::memset(pixels, n + 1, sizeof(pixels));
+        String path = tempDir.makeSubPath(
+                StringFormat("shot%d.jpg", n).c_str());
+        EXPECT_TRUE(writer->saveFrame(path.c_str(), 4, 4 - n, pixels));
+    }
+    // The destructor waits for all screenshots to be written.
+    writer.reset(NULL);
+
+    for (int n = 0; n < kCount; ++n) {
+        String path = tempDir.makeSubPath(
+                StringFormat("shot%d.jpg", n).c_str());
+        EXPECT_STREQ(StringFormat("4x%d:%d", 4 - n, n + 1).c_str(),
+                     readFile(path).c_str());
+        path += ".tmp";
+        EXPECT_FALSE(fileExists(path));
+    }
+}
+
+TEST(ScreenshotWriter, QueueLimit) {
+    TestTempDir tempDir("ScreenshotWriterTest");
+    ASSERT_TRUE(tempDir.path());
+    FakeEncoder encoder;
+    encoder.setBlocked(true);
+    ScopedPtr<ScreenshotWriter> writer(
+            ScreenshotWriter::create(&FakeEncoder::encode, &encoder));
+    ASSERT_TRUE(writer.get());
+
+    uint8_t pixels[4] = { 7, 7, 7, 7 };
+    String path = tempDir.makeSubPath("shot.jpg");
+    for (size_t n = 0; n < ScreenshotWriter::kMaxPending; ++n) {
+        EXPECT_TRUE(writer->saveFrame(path.c_str(), 1, 1, pixels));
+    }
+    EXPECT_FALSE(writer->saveFrame(path.c_str(), 1, 1, pixels));
+
+    encoder.setBlocked(false);
+    writer.reset(NULL);
+    EXPECT_STREQ("1x1:7", readFile(path).c_str());
+}
+
+}  // namespace opengl
+}  // namespace android
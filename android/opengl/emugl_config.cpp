@@ -15,6 +15,8 @@
 #include "android/base/StringFormat.h"
 #include "android/base/system/System.h"
 #include "android/opengl/EmuglBackendList.h"
+#include "android/utils/bufprint.h"
+#include "android/utils/path.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,6 +39,10 @@ using android::opengl::EmuglBackendList;
 
 static EmuglBackendList* sBackendList = NULL;
 
+// Maximum number of llvmpipe rasterizer threads, beyond which it scales
+// poorly.
+static const int kMaxSoftwareRendererThreads = 8;
+
 static void resetBackendList(int bitness) {
     delete sBackendList;
     sBackendList = new EmuglBackendList(
@@ -54,6 +60,35 @@ static bool stringVectorContains(const StringVector& list,
     return false;
 }
 
+// The backends that render on the host CPU, from the most to the least
+// preferred one. Both SwiftShader and Mesa's llvmpipe rasterize on several
+// threads, which makes them usable on hosts without a GPU.
+static const char* const kSoftwareBackends[] = {
+    "swiftshader",
+    "mesa",
+};
+
+static bool isSoftwareBackend(const char* name) {
+    for (size_t n = 0; n < sizeof(kSoftwareBackends) /
+                           sizeof(kSoftwareBackends[0]); ++n) {
+        if (!strcmp(name, kSoftwareBackends[n])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Return the name of the preferred software backend available, or NULL.
+static const char* findSoftwareBackend() {
+    for (size_t n = 0; n < sizeof(kSoftwareBackends) /
+                           sizeof(kSoftwareBackends[0]); ++n) {
+        if (sBackendList->contains(kSoftwareBackends[n])) {
+            return kSoftwareBackends[n];
+        }
+    }
+    return NULL;
+}
+
 bool emuglConfig_init(EmuglConfig* config,
                       bool gpu_enabled,
                       const char* gpu_mode,
@@ -97,28 +132,29 @@ bool emuglConfig_init(EmuglConfig* config,
 
     // Check that the GPU mode is a valid value. 'auto' means determine
     // the best mode depending on the environment. Its purpose is to
-    // enable 'mesa' mode automatically when NX or Chrome Remote Desktop
-    // is detected.
+    // enable a software mode automatically when NX or Chrome Remote Desktop
+    // is detected, or when running headless.
     if (!strcmp(gpu_mode, "auto") && !gpu_option) {
         // The default will be 'host' unless NX or Chrome Remote Desktop
         // is detected, or |no_window| is true.
         String sessionType;
+        const char* softwareBackend = findSoftwareBackend();
         if (System::get()->isRemoteSession(&sessionType)) {
             D("%s: %s session detected\n", __FUNCTION__, sessionType.c_str());
-            if (!sBackendList->contains("mesa")) {
+            if (!softwareBackend) {
                 config->enabled = false;
                 snprintf(config->status, sizeof(config->status),
                         "GPU emulation is disabled under %s without Mesa",
                         sessionType.c_str());
                 return true;
             }
-            D("%s: 'mesa' mode auto-selected\n", __FUNCTION__);
-            gpu_mode = "mesa";
+            D("%s: '%s' mode auto-selected\n", __FUNCTION__, softwareBackend);
+            gpu_mode = softwareBackend;
         } else if (no_window) {
-            if (stringVectorContains(sBackendList->names(), "mesa")) {
-                D("%s: Headless (-no-window) mode, using Mesa backend\n",
-                  __FUNCTION__);
-                gpu_mode = "mesa";
+            if (softwareBackend) {
+                D("%s: Headless (-no-window) mode, using '%s' backend\n",
+                  __FUNCTION__, softwareBackend);
+                gpu_mode = softwareBackend;
             } else {
                 D("%s: Headless (-no-window) mode without Mesa, forcing '-gpu off'\n",
                   __FUNCTION__);
@@ -192,6 +228,17 @@ void emuglConfig_setupEnv(const EmuglConfig* config) {
     D("Adding to the library search path: %s\n", newDirs.c_str());
     system->addLibrarySearchDir(newDirs.c_str());
 
+    // Let the GLES translator keep the program binaries it links across
+    // runs, unless the user selected another directory already.
+    if (!system->envGet("ANDROID_EMUGL_PROGRAM_CACHE_DIR")) {
+        char path[PATH_MAX];
+        char* end = bufprint_config_file(path, path + sizeof(path),
+                                         "emugl-program-cache");
+        if (end < path + sizeof(path)) {
+            system->envSet("ANDROID_EMUGL_PROGRAM_CACHE_DIR", path);
+        }
+    }
+
     if (!strcmp(config->backend, "host")) {
         // Nothing more to do for the 'host' backend.
         return;
@@ -219,8 +266,26 @@ void emuglConfig_setupEnv(const EmuglConfig* config) {
         system->envSet("ANDROID_GLESv2_LIB", lib.c_str());
     }
 
+    if (isSoftwareBackend(config->backend)) {
+        system->envSet("ANDROID_GL_SOFTWARE_RENDERER", "1");
+    }
+
     if (!strcmp(config->backend, "mesa")) {
         system->envSet("ANDROID_GL_LIB", "mesa");
-        system->envSet("ANDROID_GL_SOFTWARE_RENDERER", "1");
+
+        // llvmpipe starts one rasterizer thread per host core by default.
+        // That oversubscribes hosts that run several instances, and leaves
+        // no core to the vCPU and render threads of this one, so use half
+        // of them unless the user chose otherwise.
+        if (!system->envGet("LP_NUM_THREADS")) {
+            int threads = system->getCpuCoreCount() / 2;
+            if (threads < 1) {
+                threads = 1;
+            } else if (threads > kMaxSoftwareRendererThreads) {
+                threads = kMaxSoftwareRendererThreads;
+            }
+            system->envSet("LP_NUM_THREADS",
+                           StringFormat("%d", threads).c_str());
+        }
     }
 }
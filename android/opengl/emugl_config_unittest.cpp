@@ -240,8 +240,54 @@ TEST(EmuglConfig, initNoWindowWithoutMesa) {
                  config.status);
 }
 
+TEST(EmuglConfig, initNoWindowPrefersSwiftShader) {
+    TestSystem testSys("foo", System::kProgramBitness);
+    TestTempDir* myDir = testSys.getTempRoot();
+    myDir->makeSubDir(System::get()->getProgramDirectory().c_str());
+    makeLibSubDir(myDir, "");
+
+    makeLibSubDir(myDir, "gles_mesa");
+    makeLibSubFile(myDir, "gles_mesa/libGLES.so");
+    makeLibSubDir(myDir, "gles_swiftshader");
+    makeLibSubFile(myDir, "gles_swiftshader/libGLES.so");
+
+    EmuglConfig config;
+    EXPECT_TRUE(emuglConfig_init(&config, true, "auto", NULL, 0, true));
+    EXPECT_TRUE(config.enabled);
+    EXPECT_STREQ("swiftshader", config.backend);
+    EXPECT_STREQ("GPU emulation enabled using 'swiftshader' mode",
+                 config.status);
+}
+
 TEST(EmuglConfig, setupEnv) {
 }
 
+TEST(EmuglConfig, setupEnvMesaThreads) {
+    TestSystem testSys("foo", System::kProgramBitness);
+    TestTempDir* myDir = testSys.getTempRoot();
+    myDir->makeSubDir(System::get()->getProgramDirectory().c_str());
+    makeLibSubDir(myDir, "");
+    makeLibSubDir(myDir, "gles_mesa");
+    makeLibSubFile(myDir, "gles_mesa/libGLES.so");
+
+    EmuglConfig config;
+    EXPECT_TRUE(emuglConfig_init(&config, true, "mesa", NULL, 0, false));
+
+    testSys.setCpuCoreCount(12);
+    emuglConfig_setupEnv(&config);
+    EXPECT_STREQ("1", testSys.envGet("ANDROID_GL_SOFTWARE_RENDERER"));
+    EXPECT_STREQ("6", testSys.envGet("LP_NUM_THREADS"));
+
+    // The value is capped, and never replaces the user's one.
+    testSys.envSet("LP_NUM_THREADS", NULL);
+    testSys.setCpuCoreCount(64);
+    emuglConfig_setupEnv(&config);
+    EXPECT_STREQ("8", testSys.envGet("LP_NUM_THREADS"));
+
+    testSys.envSet("LP_NUM_THREADS", "3");
+    emuglConfig_setupEnv(&config);
+    EXPECT_STREQ("3", testSys.envGet("LP_NUM_THREADS"));
+}
+
 }  // namespace base
 }  // namespace android
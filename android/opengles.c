@@ -16,12 +16,20 @@
 
 /* Declared in "android/globals.h" */
 int  android_gles_fast_pipes = 1;
+int  android_gles_ring_pipes = 0;
 
+#include "android/android.h"
 #include "android/globals.h"
+#include "hw/hw.h"
+#include "qemu/thread.h"
 #include <android/utils/debug.h>
 #include <android/utils/path.h>
 #include <android/utils/bufprint.h>
 #include <android/utils/dll.h>
+#include <android/utils/metrics.h>
+#include <android/utils/probe_cache.h>
+#include <android/utils/thread_pool.h>
+#include <android/utils/trace.h>
 
 // NOTE: The declarations below should be equivalent to those in
 // <libOpenglRender/render_api_platform_types.h>
@@ -48,20 +56,61 @@ typedef void* FBNativeWindowType;
 #define STREAM_MODE_UNIX      2
 #define STREAM_MODE_PIPE      3
 
+/* frame layouts passed to updateColorBufferYuv() */
+#define RENDER_YUV_FORMAT_YU12    0
+#define RENDER_YUV_FORMAT_YV12    1
+#define RENDER_YUV_FORMAT_NV12    2
+#define RENDER_YUV_FORMAT_NV21    3
+
+typedef void (*RenderChannelWakeFn)(void* context);
+
+typedef void (*TraceFn)(int category, int type, const char* name,
+                        long long value);
+
+typedef void (*MetricsFn)(int metric, long long value);
+
+typedef void (*SnapshotWriteFn)(void* context, const void* data, size_t size);
+
+typedef size_t (*SnapshotReadFn)(void* context, void* data, size_t size);
+
 #define RENDERER_FUNCTIONS_LIST \
   FUNCTION_(int, initLibrary, (void), ()) \
   FUNCTION_(int, setStreamMode, (int mode), (mode)) \
   FUNCTION_(int, initOpenGLRenderer, (int width, int height, bool useSubWindow, char* addr, size_t addrLen), (width, height, addr, addrLen)) \
   FUNCTION_VOID_(getHardwareStrings, (const char** vendors, const char** renderer, const char** version), (vendors, renderer, version)) \
   FUNCTION_VOID_(setPostCallback, (OnPostFunc onPost, void* onPostContext), (onPost, onPostContext)) \
+  FUNCTION_VOID_(setDisplayPostCallback, (int displayId, OnPostFunc onPost, void* onPostContext), (displayId, onPost, onPostContext)) \
+  FUNCTION_(int, getPostTimings, (long long* agesUs, int count), (agesUs, count)) \
+  FUNCTION_(bool, getVsyncTiming, (long long* ageUs, long long* periodUs), (ageUs, periodUs)) \
+  FUNCTION_VOID_(setVsyncOffset, (long long offsetUs), (offsetUs)) \
+  FUNCTION_VOID_(setTraceCallback, (TraceFn traceFn, const unsigned* categories), (traceFn, categories)) \
+  FUNCTION_VOID_(setMetricsCallback, (MetricsFn metricsFn), (metricsFn)) \
+  FUNCTION_VOID_(setSharedMemory, (void* base, size_t size), (base, size)) \
+  FUNCTION_VOID_(setRenderThreadPriority, (int priority), (priority)) \
+  FUNCTION_(bool, updateColorBufferYuv, (uint32_t colorBuffer, int width, int height, int format, const void* pixels), (colorBuffer, width, height, format, pixels)) \
+  FUNCTION_(bool, saveSnapshot, (SnapshotWriteFn writeFn, void* context), (writeFn, context)) \
+  FUNCTION_(bool, loadSnapshot, (SnapshotReadFn readFn, void* context), (readFn, context)) \
   FUNCTION_(bool, createOpenGLSubwindow, (FBNativeWindowType window, int x, int y, int width, int height, float zRot), (window, x, y, width, height, zRot)) \
+  FUNCTION_(bool, attachOpenGLWindow, (FBNativeWindowType window, int width, int height, float zRot), (window, width, height, zRot)) \
   FUNCTION_(bool, destroyOpenGLSubwindow, (void), ()) \
   FUNCTION_VOID_(setOpenGLDisplayRotation, (float zRot), (zRot)) \
   FUNCTION_VOID_(repaintOpenGLDisplay, (void), ()) \
+  FUNCTION_(void*, createRenderChannel, (RenderChannelWakeFn onWake, void* onWakeContext), (onWake, onWakeContext)) \
+  FUNCTION_(int, renderChannelWrite, (void* channel, const void* data, size_t size), (channel, data, size)) \
+  FUNCTION_(int, renderChannelRead, (void* channel, void* data, size_t size), (channel, data, size)) \
+  FUNCTION_(unsigned, renderChannelPoll, (void* channel), (channel)) \
+  FUNCTION_(unsigned, renderChannelSpin, (void* channel, unsigned flags), (channel, flags)) \
+  FUNCTION_VOID_(renderChannelWakeOn, (void* channel, unsigned flags), (channel, flags)) \
+  FUNCTION_VOID_(destroyRenderChannel, (void* channel), (channel)) \
   FUNCTION_(int, stopOpenGLRenderer, (void), ()) \
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
 
 #define D(...)  VERBOSE_PRINT(init,__VA_ARGS__)
 #define DD(...) VERBOSE_PRINT(gles,__VA_ARGS__)
@@ -113,13 +162,65 @@ RENDERER_FUNCTIONS_LIST
 /* Defined in android/hw-pipe-net.c */
 extern int android_init_opengles_pipes(void);
 
+/* The renderer starts in the background, see
+ * android_startOpenglesRendererAsync(). The functions that need it wait
+ * for the start to complete with renderer_wait_started(). */
+typedef enum {
+    RENDERER_STOPPED = 0,
+    RENDERER_STARTING,
+    RENDERER_STARTED,
+} RendererState;
+
 static ADynamicLibrary*  rendererLib;
 static bool              rendererUsesSubWindow;
-static int               rendererStarted;
+static volatile int      rendererState;
+static QemuMutex         rendererLock;
+static QemuCond          rendererCond;
+static int               rendererWidth;
+static int               rendererHeight;
 static char              rendererAddress[256];
+/* True if the guest is served by an emugl_render_service process at
+ * rendererAddress instead of the in-process renderer. */
+static bool              rendererExternal;
+
+/* Key of the GL strings in the probe cache, see gl_strings_cache_init(). */
+static char              glStringsProbe[32];
+static char              glStringsLibPath[1024];
+
+/* Record the renderer's trace events with the emulator's ones. The
+ * renderer uses the same category and event type values. */
+static void
+renderer_trace(int category, int type, const char* name, long long value)
+{
+    trace_record((TraceCategory)category, (TraceEventType)type, name, value);
+}
+
+/* The renderer's metrics, indexed by the values it passes to
+ * renderer_metrics(). */
+#define RENDERER_METRIC_COUNT  2
+static Metric* rendererMetrics[RENDERER_METRIC_COUNT];
+
+static void
+renderer_metrics(int metric, long long value)
+{
+    if (metric >= 0 && metric < RENDERER_METRIC_COUNT && value >= 0) {
+        metric_record(rendererMetrics[metric], (uint64_t)value);
+    }
+}
+
+static void
+renderer_init_metrics(void)
+{
+    rendererMetrics[0] = metrics_histogram(
+            "emulator_render_decode_us", NULL,
+            "Duration of the render thread decode passes, in microseconds");
+    rendererMetrics[1] = metrics_histogram(
+            "emulator_framebuffer_post_us", NULL,
+            "Duration of the frame posts, in microseconds");
+}
 
 int
-android_initOpenglesEmulation(void)
+android_loadOpenglesEmulation(void)
 {
     char* error = NULL;
 
@@ -128,6 +229,9 @@ android_initOpenglesEmulation(void)
 
     D("Initializing hardware OpenGLES emulation support");
 
+    qemu_mutex_init(&rendererLock);
+    qemu_cond_init(&rendererCond);
+
     rendererLib = adynamicLibrary_open(RENDERER_LIB_NAME, &error);
     if (rendererLib == NULL) {
         derror("Could not load OpenGLES emulation library [%s]: %s",
@@ -135,8 +239,6 @@ android_initOpenglesEmulation(void)
         return -1;
     }
 
-    android_init_opengles_pipes();
-
     /* Resolve the functions */
     if (initOpenglesEmulationFuncs(rendererLib) < 0) {
         derror("OpenGLES emulation library mismatch. Be sure to use the correct version!");
@@ -148,12 +250,37 @@ android_initOpenglesEmulation(void)
         goto BAD_EXIT;
     }
 
+    setTraceCallback(renderer_trace, &android_trace_categories);
+    renderer_init_metrics();
+    setMetricsCallback(renderer_metrics);
+
     rendererUsesSubWindow = true;
     const char* env = getenv("ANDROID_GL_SOFTWARE_RENDERER");
     if (env && env[0] != '\0' && env[0] != '0') {
         rendererUsesSubWindow = false;
     }
 
+    /* Define ANDROID_GLES_RING_PIPES to send the opengles pipe traffic
+     * through in-process ring buffers instead of a local socket. */
+    env = getenv("ANDROID_GLES_RING_PIPES");
+    if (env && env[0] != '\0' && env[0] != '0') {
+        android_gles_ring_pipes = 1;
+    }
+
+#ifndef _WIN32
+    /* Define ANDROID_EMUGL_RENDER_SERVICE to the address printed by
+     * emugl_render_service to share its renderer with other emulators
+     * instead of starting one in this process. Its frames aren't shown. */
+    env = getenv("ANDROID_EMUGL_RENDER_SERVICE");
+    if (env && env[0] != '\0') {
+        D("Using the render service at %s", env);
+        snprintf(rendererAddress, sizeof(rendererAddress), "%s", env);
+        rendererExternal = true;
+        android_gles_ring_pipes = 0;
+        android_gles_fast_pipes = 1;
+    }
+#endif
+
     if (android_gles_fast_pipes) {
 #ifdef _WIN32
         /* XXX: NEED Win32 pipe implementation */
@@ -174,36 +301,18 @@ BAD_EXIT:
 }
 
 int
-android_startOpenglesRenderer(int width, int height)
+android_initOpenglesEmulation(void)
 {
-    if (!rendererLib) {
-        D("Can't start OpenGLES renderer without support libraries");
-        return -1;
-    }
-
-    if (rendererStarted) {
-        return 0;
-    }
+    static bool pipesRegistered;
 
-    if (!initOpenGLRenderer(width,
-                            height,
-                            rendererUsesSubWindow,
-                            rendererAddress,
-                            sizeof(rendererAddress))) {
-        D("Can't start OpenGLES renderer?");
+    if (android_loadOpenglesEmulation() < 0)
         return -1;
-    }
-
-    rendererStarted = 1;
-    return 0;
-}
 
-void
-android_setPostCallback(OnPostFunc onPost, void* onPostContext)
-{
-    if (rendererLib) {
-        setPostCallback(onPost, onPostContext);
+    if (!pipesRegistered) {
+        android_init_opengles_pipes();
+        pipesRegistered = true;
     }
+    return 0;
 }
 
 static void strncpy_safe(char* dst, const char* src, size_t n)
@@ -235,21 +344,386 @@ static void extractBaseString(char* dst, const char* src, size_t dstSize)
     strncpy_safe(dst, begin, end - begin + 1);
 }
 
-void
-android_getOpenglesHardwareStrings(char* vendor, size_t vendorBufSize,
+/* Return true once the renderer is started, after waiting for its
+ * background start to complete if needed. */
+static bool
+renderer_wait_started(void)
+{
+    if (rendererState == RENDERER_STARTING) {
+        qemu_mutex_lock(&rendererLock);
+        while (rendererState == RENDERER_STARTING) {
+            qemu_cond_wait(&rendererCond, &rendererLock);
+        }
+        qemu_mutex_unlock(&rendererLock);
+    }
+    return rendererState == RENDERER_STARTED;
+}
+
+static void renderer_probe_strings(char* vendor, size_t vendorBufSize,
                                    char* renderer, size_t rendererBufSize,
-                                   char* version, size_t versionBufSize)
+                                   char* version, size_t versionBufSize);
+
+/* The GL strings are probed from the host GPU driver, which takes starting
+ * the renderer, i.e. the very work they are cached to avoid. So they are
+ * keyed by what selects the driver instead: the GL environment set up by
+ * -gpu, the host display and, where it is cheap to read, the GPU's PCI
+ * identity and the driver version. The probe cache entry is attached to
+ * the renderer library itself, so that a new emulator version probes them
+ * again. Each successful start refreshes the entry, so a stale one never
+ * survives more than one run. Must be called from the main thread, as it
+ * reads the environment. */
+static void
+gl_strings_cache_init(void)
 {
-    const char *vendorSrc, *rendererSrc, *versionSrc;
+    static const char* const kEnvVars[] = {
+        "ANDROID_GL_LIB", "ANDROID_EGL_LIB", "ANDROID_GLESv1_LIB",
+        "ANDROID_GLESv2_LIB", "ANDROID_GL_SOFTWARE_RENDERER",
+#ifdef __linux__
+        "DISPLAY",
+#endif
+    };
+    char identity[2048];
+    char* p = identity;
+    char* end = identity + sizeof(identity);
+    size_t n;
 
-    assert(vendorBufSize > 0 && rendererBufSize > 0 && versionBufSize > 0);
-    assert(vendor != NULL && renderer != NULL && version != NULL);
+    glStringsProbe[0] = glStringsLibPath[0] = '\0';
+#ifdef _WIN32
+    {
+        HMODULE module = NULL;
+        if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                                GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                                (LPCSTR)initLibrary, &module) ||
+            !GetModuleFileNameA(module, glStringsLibPath,
+                                sizeof(glStringsLibPath))) {
+            return;
+        }
+    }
+#else
+    {
+        Dl_info info;
+        if (!dladdr((void*)initLibrary, &info) || !info.dli_fname) {
+            return;
+        }
+        strncpy_safe(glStringsLibPath, info.dli_fname,
+                     sizeof(glStringsLibPath));
+    }
+#endif
 
-    if (!rendererStarted) {
-        D("Can't get OpenGL ES hardware strings when renderer not started");
-        vendor[0] = renderer[0] = version[0] = '\0';
+    for (n = 0; n < sizeof(kEnvVars) / sizeof(kEnvVars[0]); n++) {
+        const char* value = getenv(kEnvVars[n]);
+        p = bufprint(p, end, "%s=%s;", kEnvVars[n], value ? value : "");
+    }
+#ifdef __linux__
+    {
+        static const char* const kFiles[] = {
+            "/proc/driver/nvidia/version",
+            "/sys/class/drm/card0/device/vendor",
+            "/sys/class/drm/card0/device/device",
+            "/sys/class/drm/card1/device/vendor",
+            "/sys/class/drm/card1/device/device",
+        };
+        for (n = 0; n < sizeof(kFiles) / sizeof(kFiles[0]); n++) {
+            size_t size;
+            char* data = path_load_file(kFiles[n], &size);
+            if (data) {
+                /* Only the first line, the version file has more. */
+                p = bufprint(p, end, "%.*s;", (int)strcspn(data, "\n"), data);
+                free(data);
+            }
+        }
+    }
+#elif defined(_WIN32)
+    {
+        DISPLAY_DEVICEA device;
+        device.cb = sizeof(device);
+        if (EnumDisplayDevicesA(NULL, 0, &device, 0)) {
+            p = bufprint(p, end, "%s;%s;", device.DeviceString,
+                         device.DeviceID);
+        }
+    }
+#endif
+    if (p >= end) {
+        return;
+    }
+
+    /* 64-bit FNV-1a hash of the identity. */
+    uint64_t hash = 14695981039346656037ULL;
+    for (p = identity; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 1099511628211ULL;
+    }
+    snprintf(glStringsProbe, sizeof(glStringsProbe), "gl-strings-%016llx",
+             (unsigned long long)hash);
+}
+
+/* Look for the GL strings in the probe cache. Return true on success. */
+static bool
+gl_strings_cache_find(char* vendor, size_t vendorBufSize,
+                      char* renderer, size_t rendererBufSize,
+                      char* version, size_t versionBufSize)
+{
+    const char* cacheDir = probe_cache_default_dir();
+    char* data;
+    size_t size;
+    char* strings[3];
+    int n;
+
+    if (!cacheDir || !glStringsProbe[0] ||
+        !probe_cache_find(cacheDir, glStringsProbe, glStringsLibPath,
+                          &data, &size)) {
+        return false;
+    }
+    /* The entry is made of three lines. */
+    strings[0] = data;
+    for (n = 1; n < 3; n++) {
+        strings[n] = strchr(strings[n - 1], '\n');
+        if (!strings[n]) {
+            free(data);
+            return false;
+        }
+        *strings[n]++ = '\0';
+    }
+    strings[2][strcspn(strings[2], "\n")] = '\0';
+    strncpy_safe(vendor, strings[0], vendorBufSize);
+    strncpy_safe(renderer, strings[1], rendererBufSize);
+    strncpy_safe(version, strings[2], versionBufSize);
+    free(data);
+    D("Using cached OpenGL strings from %s", glStringsProbe);
+    return true;
+}
+
+static void
+gl_strings_cache_store(const char* vendor,
+                       const char* renderer,
+                       const char* version)
+{
+    const char* cacheDir = probe_cache_default_dir();
+    char data[3 * ANDROID_GLSTRING_BUF_SIZE + 3];
+    char* end = data + sizeof(data);
+    char* p;
+
+    if (!cacheDir || !glStringsProbe[0] ||
+        strchr(vendor, '\n') || strchr(renderer, '\n') ||
+        strchr(version, '\n')) {
         return;
     }
+    p = bufprint(data, end, "%s\n%s\n%s\n", vendor, renderer, version);
+    if (p < end) {
+        probe_cache_store(cacheDir, glStringsProbe, glStringsLibPath,
+                          data, p - data);
+    }
+}
+
+static void
+renderer_start_task(void* opaque)
+{
+    bool ok = initOpenGLRenderer(rendererWidth,
+                                 rendererHeight,
+                                 rendererUsesSubWindow,
+                                 rendererAddress,
+                                 sizeof(rendererAddress));
+
+    qemu_mutex_lock(&rendererLock);
+    rendererState = ok ? RENDERER_STARTED : RENDERER_STOPPED;
+    qemu_cond_broadcast(&rendererCond);
+    qemu_mutex_unlock(&rendererLock);
+
+    if (!ok) {
+        /* The guest can't run without the GPU emulation it was told
+         * about with qemu.gles=1. */
+        derror("Could not start the OpenGLES renderer, use '-gpu off' to "
+               "disable GPU emulation.");
+        exit(1);
+    }
+
+    /* Refresh the cache for the next runs. */
+    char vendor[ANDROID_GLSTRING_BUF_SIZE];
+    char renderer[ANDROID_GLSTRING_BUF_SIZE];
+    char version[ANDROID_GLSTRING_BUF_SIZE];
+    renderer_probe_strings(vendor, sizeof(vendor),
+                           renderer, sizeof(renderer),
+                           version, sizeof(version));
+    gl_strings_cache_store(vendor, renderer, version);
+}
+
+/* Version of the "opengles" snapshot section */
+#define  OPENGLES_STATE_SAVE_VERSION  1
+
+static void
+renderer_snapshot_write(void* context, const void* data, size_t size)
+{
+    qemu_put_buffer((QEMUFile*)context, data, (int)size);
+}
+
+static size_t
+renderer_snapshot_read(void* context, void* data, size_t size)
+{
+    return (size_t)qemu_get_buffer((QEMUFile*)context, data, (int)size);
+}
+
+/* Save the renderer's color buffers with the VM state, after a byte that
+ * tells whether the renderer was running. */
+static void
+renderer_save(QEMUFile* f, void* opaque)
+{
+    int started = renderer_wait_started();
+
+    qemu_put_byte(f, started);
+    if (started && !saveSnapshot(renderer_snapshot_write, f)) {
+        derror("Could not save the OpenGLES emulation state");
+    }
+}
+
+static int
+renderer_load(QEMUFile* f, void* opaque, int version_id)
+{
+    if (version_id != OPENGLES_STATE_SAVE_VERSION) {
+        return -EINVAL;
+    }
+    if (!qemu_get_byte(f)) {
+        return 0;
+    }
+    if (!renderer_wait_started() ||
+        !loadSnapshot(renderer_snapshot_read, f)) {
+        derror("Could not load the OpenGLES emulation state");
+        return -EIO;
+    }
+    return 0;
+}
+
+int
+android_startOpenglesRendererAsync(int width, int height)
+{
+    if (!rendererLib) {
+        D("Can't start OpenGLES renderer without support libraries");
+        return -1;
+    }
+
+    if (rendererState != RENDERER_STOPPED) {
+        return 0;
+    }
+
+    /* The state of the render service can't be saved with the VM's. */
+    if (rendererExternal) {
+        rendererState = RENDERER_STARTED;
+        return 0;
+    }
+
+    gl_strings_cache_init();
+    rendererWidth = width;
+    rendererHeight = height;
+    rendererState = RENDERER_STARTING;
+    thread_pool_post(renderer_start_task, NULL, THREAD_POOL_PRIORITY_HIGH,
+                     THREAD_POOL_ANY_WORKER);
+
+    register_savevm(NULL,
+                    "opengles",
+                    0,
+                    OPENGLES_STATE_SAVE_VERSION,
+                    renderer_save,
+                    renderer_load,
+                    NULL);
+    return 0;
+}
+
+int
+android_startOpenglesRenderer(int width, int height)
+{
+    if (android_startOpenglesRendererAsync(width, height) < 0) {
+        return -1;
+    }
+    return renderer_wait_started() ? 0 : -1;
+}
+
+void
+android_setOpenglesSharedMemory(void* base, size_t size)
+{
+    if (rendererLib) {
+        setSharedMemory(base, size);
+    }
+}
+
+void
+android_setOpenglesRenderPriority(int priority)
+{
+    if (rendererLib) {
+        setRenderThreadPriority(priority);
+    }
+}
+
+void
+android_setOpenglesVsyncOffset(int offsetUs)
+{
+    if (rendererLib) {
+        setVsyncOffset(offsetUs);
+    }
+}
+
+int
+android_getOpenglesVsyncTiming(long long* ageUs, long long* periodUs)
+{
+    /* Never wait for a renderer starting in the background, the caller
+     * falls back to its own timer in the meantime. */
+    if (!rendererLib || rendererState != RENDERER_STARTED) {
+        return -1;
+    }
+    return getVsyncTiming(ageUs, periodUs) ? 0 : -1;
+}
+
+int
+android_updateOpenglesColorBufferYuv(uint32_t colorBuffer, int width,
+                                      int height, uint32_t fourcc,
+                                      const void* pixels)
+{
+    int format;
+
+    switch (fourcc) {
+        case ANDROID_GLES_FOURCC('Y','U','1','2'): format = RENDER_YUV_FORMAT_YU12; break;
+        case ANDROID_GLES_FOURCC('Y','V','1','2'): format = RENDER_YUV_FORMAT_YV12; break;
+        case ANDROID_GLES_FOURCC('N','V','1','2'): format = RENDER_YUV_FORMAT_NV12; break;
+        case ANDROID_GLES_FOURCC('N','V','2','1'): format = RENDER_YUV_FORMAT_NV21; break;
+        default:
+            return -1;
+    }
+    if (!rendererLib || !renderer_wait_started()) {
+        return -1;
+    }
+    return updateColorBufferYuv(colorBuffer, width, height, format, pixels)
+            ? 0 : -1;
+}
+
+void
+android_setPostCallback(OnPostFunc onPost, void* onPostContext)
+{
+    if (rendererLib) {
+        setPostCallback(onPost, onPostContext);
+    }
+}
+
+void
+android_setDisplayPostCallback(int displayId, OnPostFunc onPost, void* onPostContext)
+{
+    if (rendererLib) {
+        setDisplayPostCallback(displayId, onPost, onPostContext);
+    }
+}
+
+int
+android_getPostTimings(long long* agesUs, int count)
+{
+    if (!rendererLib) {
+        return 0;
+    }
+    return getPostTimings(agesUs, count);
+}
+
+/* Query the GL strings of the started renderer. */
+static void
+renderer_probe_strings(char* vendor, size_t vendorBufSize,
+                       char* renderer, size_t rendererBufSize,
+                       char* version, size_t versionBufSize)
+{
+    const char *vendorSrc, *rendererSrc, *versionSrc;
 
     getHardwareStrings(&vendorSrc, &rendererSrc, &versionSrc);
     if (!vendorSrc) vendorSrc = "";
@@ -274,19 +748,48 @@ android_getOpenglesHardwareStrings(char* vendor, size_t vendorBufSize,
     }
 }
 
+void
+android_getOpenglesHardwareStrings(char* vendor, size_t vendorBufSize,
+                                   char* renderer, size_t rendererBufSize,
+                                   char* version, size_t versionBufSize)
+{
+    assert(vendorBufSize > 0 && rendererBufSize > 0 && versionBufSize > 0);
+    assert(vendor != NULL && renderer != NULL && version != NULL);
+
+    /* Don't wait for the renderer if the strings are cached. */
+    if (rendererState == RENDERER_STARTING &&
+        gl_strings_cache_find(vendor, vendorBufSize,
+                              renderer, rendererBufSize,
+                              version, versionBufSize)) {
+        return;
+    }
+
+    if (!renderer_wait_started()) {
+        D("Can't get OpenGL ES hardware strings when renderer not started");
+        vendor[0] = renderer[0] = version[0] = '\0';
+        return;
+    }
+
+    renderer_probe_strings(vendor, vendorBufSize,
+                           renderer, rendererBufSize,
+                           version, versionBufSize);
+}
+
 void
 android_stopOpenglesRenderer(void)
 {
-    if (rendererStarted) {
-        stopOpenGLRenderer();
-        rendererStarted = 0;
+    if (renderer_wait_started()) {
+        if (!rendererExternal) {
+            stopOpenGLRenderer();
+        }
+        rendererState = RENDERER_STOPPED;
     }
 }
 
 int
 android_showOpenglesWindow(void* window, int x, int y, int width, int height, float rotation)
 {
-    if (!rendererStarted) {
+    if (!renderer_wait_started()) {
         return -1;
     }
     FBNativeWindowType win = (FBNativeWindowType)(uintptr_t)window;
@@ -295,10 +798,21 @@ android_showOpenglesWindow(void* window, int x, int y, int width, int height, fl
     return success ? 0 : -1;
 }
 
+int
+android_attachOpenglesWindow(void* window, int width, int height, float rotation)
+{
+    if (!renderer_wait_started()) {
+        return -1;
+    }
+    FBNativeWindowType win = (FBNativeWindowType)(uintptr_t)window;
+    bool success = attachOpenGLWindow(win, width, height, rotation);
+    return success ? 0 : -1;
+}
+
 int
 android_hideOpenglesWindow(void)
 {
-    if (!rendererStarted) {
+    if (!renderer_wait_started()) {
         return -1;
     }
     bool success = destroyOpenGLSubwindow();
@@ -308,7 +822,7 @@ android_hideOpenglesWindow(void)
 void
 android_redrawOpenglesWindow(void)
 {
-    if (rendererStarted) {
+    if (renderer_wait_started()) {
         repaintOpenGLDisplay();
     }
 }
@@ -316,5 +830,54 @@ android_redrawOpenglesWindow(void)
 void
 android_gles_server_path(char* buff, size_t buffsize)
 {
+    /* The address is only known once the renderer started. */
+    renderer_wait_started();
     strncpy_safe(buff, rendererAddress, buffsize);
 }
+
+void*
+android_openglesChannelOpen(AndroidGlesChannelWakeFunc onWake,
+                            void* onWakeContext)
+{
+    if (!renderer_wait_started()) {
+        D("Can't open OpenGLES channel when renderer not started");
+        return NULL;
+    }
+    return createRenderChannel(onWake, onWakeContext);
+}
+
+int
+android_openglesChannelWrite(void* channel, const void* data, size_t size)
+{
+    return renderChannelWrite(channel, data, size);
+}
+
+int
+android_openglesChannelRead(void* channel, void* data, size_t size)
+{
+    return renderChannelRead(channel, data, size);
+}
+
+unsigned
+android_openglesChannelPoll(void* channel)
+{
+    return renderChannelPoll(channel);
+}
+
+unsigned
+android_openglesChannelSpin(void* channel, unsigned flags)
+{
+    return renderChannelSpin(channel, flags);
+}
+
+void
+android_openglesChannelWakeOn(void* channel, unsigned flags)
+{
+    renderChannelWakeOn(channel, flags);
+}
+
+void
+android_openglesChannelClose(void* channel)
+{
+    destroyRenderChannel(channel);
+}
@@ -13,6 +13,7 @@
 #define ANDROID_OPENGLES_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "android/utils/compiler.h"
 
@@ -24,19 +25,100 @@ ANDROID_BEGIN_HEADER
  */
 int android_initOpenglesEmulation(void);
 
+/* Load and initialize the hardware opengles emulation libraries, like
+ * android_initOpenglesEmulation(), but without registering the opengles
+ * pipe service. This doesn't touch the rest of the emulator's state, so
+ * that it can run on any thread, e.g. in the background during startup,
+ * as long as android_initOpenglesEmulation() is called after it. Returns
+ * 0 on success, -1 on error.
+ */
+int android_loadOpenglesEmulation(void);
+
 /* Tries to start the renderer process. Returns 0 on success, -1 on error.
  * At the moment, this must be done before the VM starts. The onPost callback
  * may be NULL.
  */
 int android_startOpenglesRenderer(int width, int height);
 
+/* Same as android_startOpenglesRenderer(), but starts the renderer in the
+ * background, so that the VM can start before the host GPU driver is
+ * initialized. The functions below that need the renderer, e.g. to open
+ * an opengles pipe connection, wait for it to be started. As the guest
+ * can't run without the GPU emulation it was configured with, the
+ * emulator exits if the start fails. Returns -1 if the libraries aren't
+ * loaded, 0 otherwise.
+ */
+int android_startOpenglesRendererAsync(int width, int height);
+
+/* Set the host address |base| and the |size| of the memory region of the
+ * goldfish_address_space device, so that the renderer can exchange the
+ * pixels of the guest color buffers through it instead of the pipe. Must
+ * be called after android_initOpenglesEmulation(), before the VM starts.
+ */
+void android_setOpenglesSharedMemory(void* base, size_t size);
+
+/* Limit the scheduling priority of the render threads to |priority|, one of
+ * 0 (low), 1 (normal) or 2 (high, the default). Can be called at any time,
+ * but has no effect on the threads of an external render service.
+ */
+void android_setOpenglesRenderPriority(int priority);
+
+/* Make the guest vsync, i.e. the goldfish framebuffer VSYNC interrupt and
+ * the rcGetVsyncTiming() renderControl command, happen |offsetUs|
+ * microseconds before the host vsync. Must be called after
+ * android_initOpenglesEmulation().
+ */
+void android_setOpenglesVsyncOffset(int offsetUs);
+
+/* Store into |*ageUs| the number of microseconds since the last guest vsync,
+ * and into |*periodUs| the vsync period, as estimated from the host
+ * presentations of the guest frames. Returns 0 on success, or -1 if the
+ * renderer isn't started, or didn't present enough frames yet. Never blocks.
+ */
+int android_getOpenglesVsyncTiming(long long* ageUs, long long* periodUs);
+
+/* Builds the little-endian FOURCC code of a pixel format, the same value
+ * as the V4L2_PIX_FMT_XXX constants. */
+#define ANDROID_GLES_FOURCC(a,b,c,d) \
+    ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | \
+     ((uint32_t)(d) << 24))
+
+/* Replace the content of the guest color buffer whose host handle is
+ * |colorBuffer| with a |width| x |height| YUV 4:2:0 frame of |fourcc|
+ * pixels: YU12, YV12, NV12 or NV21. The frame is converted to RGB by the
+ * GPU, and scaled to the size of the color buffer. Returns 0 on success,
+ * or -1 if the format isn't supported, the handle is invalid or the
+ * renderer isn't running, e.g. with an external render service.
+ */
+int android_updateOpenglesColorBufferYuv(uint32_t colorBuffer, int width,
+                                         int height, uint32_t fourcc,
+                                         const void* pixels);
+
 /* See the description in render_api.h. */
 typedef void (*OnPostFunc)(void* context, int width, int height, int ydir,
-                           int format, int type, unsigned char* pixels);
+                           int format, int type, unsigned char* pixels,
+                           int damageX, int damageY, int damageWidth,
+                           int damageHeight);
 void android_setPostCallback(OnPostFunc onPost, void* onPostContext);
 
+/* Same as android_setPostCallback(), for the GPU display |displayId|. 0 is
+ * the primary display, others are secondary displays created by the guest,
+ * e.g. for presentation or cast features.
+ */
+void android_setDisplayPostCallback(int displayId, OnPostFunc onPost, void* onPostContext);
+
+/* Only valid when called from a post callback: store into |agesUs| the
+ * number of microseconds elapsed since each stage of the frame being
+ * delivered (guest post, renderer start, readback start, readback end),
+ * up to |count| values. Return the number of values stored.
+ */
+int android_getPostTimings(long long* agesUs, int count);
+
 /* Retrieve the Vendor/Renderer/Version strings describing the underlying GL
- * implementation. The call only works while the renderer is started.
+ * implementation. The call only works while the renderer is started, or
+ * starting in the background. In the latter case, the strings come from an
+ * on-disk cache of the previous runs if possible, the call waits for the
+ * renderer otherwise.
  *
  * Each string is copied into the corresponding buffer. If the original string
  * (including NUL terminator) is more than xxBufSize bytes, it will be
@@ -49,6 +131,13 @@ void android_getOpenglesHardwareStrings(char* vendor, size_t vendorBufSize,
 
 int android_showOpenglesWindow(void* window, int x, int y, int width, int height, float rotation);
 
+/* Same as android_showOpenglesWindow(), but render straight into |window|,
+ * a native window of the UI reserved for the GPU display, instead of a new
+ * sub-window of it. The UI keeps ownership of |window|, and must call
+ * android_hideOpenglesWindow() before destroying it.
+ */
+int android_attachOpenglesWindow(void* window, int width, int height, float rotation);
+
 int android_hideOpenglesWindow(void);
 
 void android_redrawOpenglesWindow(void);
@@ -64,9 +153,57 @@ extern int  android_gles_fast_pipes;
 /* Get the address of the socket that clients should connect to to access GLES.
  * For TCP this is just the port number (as a string) on the loopback address.
  * For UNIX and Win32 pipes it is the full pathname of the pipe.
+ * Waits for the renderer if it is starting in the background.
  */
 void android_gles_server_path(char* buff, size_t buffsize);
 
+/* Set to TRUE if opengles pipes should use in-process render channels
+ * (see below) instead of connecting to android_gles_server_path().
+ * This is enabled by defining ANDROID_GLES_RING_PIPES in the environment.
+ */
+extern int  android_gles_ring_pipes;
+
+/* A render channel is an in-process transport to a new renderer thread,
+ * see the description of createRenderChannel() in render_api.entries.
+ * None of the functions below block. The values of the flags must match
+ * the RENDER_CHANNEL_XXX constants from render_api.h.
+ */
+#define ANDROID_GLES_CHANNEL_CAN_READ   1
+#define ANDROID_GLES_CHANNEL_CAN_WRITE  2
+#define ANDROID_GLES_CHANNEL_CLOSED     4
+
+/* Callback invoked, from any thread, when a condition requested through
+ * android_openglesChannelWakeOn() is met. It must not call any of the
+ * android_openglesChannelXXX() functions. */
+typedef void (*AndroidGlesChannelWakeFunc)(void* context);
+
+/* Open a new channel. Returns NULL if the renderer is not started. Waits
+ * for the renderer if it is starting in the background. */
+void* android_openglesChannelOpen(AndroidGlesChannelWakeFunc onWake,
+                                  void* onWakeContext);
+
+/* Send or receive up to |size| bytes. Return the number of bytes
+ * transferred, 0 if this would block, or a negative value if the
+ * renderer side was closed. */
+int android_openglesChannelWrite(void* channel, const void* data, size_t size);
+int android_openglesChannelRead(void* channel, void* data, size_t size);
+
+/* Return the current ANDROID_GLES_CHANNEL_XXX state of |channel|. */
+unsigned android_openglesChannelPoll(void* channel);
+
+/* Poll |channel| for a short, self-tuned interval until one of the
+ * conditions in |flags| is met or it is closed, and return its state like
+ * android_openglesChannelPoll(). Returns right away when the host is
+ * oversubscribed. */
+unsigned android_openglesChannelSpin(void* channel, unsigned flags);
+
+/* Request a single call to the channel's wake callback once one of the
+ * conditions in |flags| is met. */
+void android_openglesChannelWakeOn(void* channel, unsigned flags);
+
+/* Close |channel|. Its wake callback will not be called anymore. */
+void android_openglesChannelClose(void* channel);
+
 ANDROID_END_HEADER
 
 #endif /* ANDROID_OPENGLES_H */
@@ -18,6 +18,7 @@
 
 #include "android/android.h"
 #include "android/globals.h"
+#include "android/hw-balloon.h"
 #include "android/hw-sensors.h"
 #include "android/hw-fingerprint.h"
 #include "android/utils/debug.h"
@@ -472,6 +473,8 @@ void  android_emulation_setup( void )
     /* initilize fingperprint here */
     android_hw_fingerprint_init();
 
+    android_hw_balloon_init();
+
    /* cool, now try to run the "ddms ping" command, which will take care of pinging usage
     * if the user agreed for it. the emulator itself never sends anything to any outside
     * machine
@@ -0,0 +1,228 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+#include "android/qos.h"
+#include "android/opengles.h"
+#include "android/utils/debug.h"
+#include "block/block.h"
+#include "hw/android/goldfish/nand.h"
+#include "sysemu/cpus.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define  D(...)  VERBOSE_PRINT(init,__VA_ARGS__)
+
+static const char* const  qos_render_names[] = { "low", "normal", "high" };
+
+static AndroidQosRenderPriority  qos_render_priority = ANDROID_QOS_RENDER_HIGH;
+
+int
+android_qos_set_cpu( int  percent )
+{
+    if (percent < 1 || percent > 100)
+        return -1;
+    qemu_cpu_set_throttle(percent);
+    D("qos: vCPUs limited to %d%%", percent);
+    return 0;
+}
+
+typedef struct {
+    uint64_t  bps;
+    uint64_t  iops;
+} QosIoLimits;
+
+static void
+qos_set_block_limits( void*  opaque, BlockDriverState*  bs )
+{
+    QosIoLimits*  limits = opaque;
+    bdrv_set_io_limits(bs, limits->bps, limits->iops);
+}
+
+int
+android_qos_set_io( const char*  device, uint64_t  bps, uint64_t  iops )
+{
+    int  found = (nand_dev_set_io_limits(device, bps, iops) == 0);
+
+    if (device == NULL) {
+        QosIoLimits  limits = { bps, iops };
+        bdrv_iterate(qos_set_block_limits, &limits);
+        found = 1;
+    } else {
+        BlockDriverState*  bs = bdrv_find(device);
+        if (bs != NULL) {
+            bdrv_set_io_limits(bs, bps, iops);
+            found = 1;
+        }
+    }
+    if (!found)
+        return -1;
+    D("qos: %s limited to %" PRIu64 " bytes/s, %" PRIu64 " ops/s",
+      device ? device : "all devices", bps, iops);
+    return 0;
+}
+
+void
+android_qos_set_render( AndroidQosRenderPriority  priority )
+{
+    qos_render_priority = priority;
+    android_setOpenglesRenderPriority((int)priority);
+    D("qos: render threads limited to %s priority",
+      qos_render_names[priority]);
+}
+
+/* Parse '<bps>[:<iops>]', where <bps> accepts a K, M or G suffix. */
+static int
+qos_parse_io_limits( const char*  value, uint64_t*  bps, uint64_t*  iops )
+{
+    char*  end;
+
+    *bps = strtoull(value, &end, 0);
+    if (end == value)
+        return -1;
+    switch (*end) {
+        case 'K': *bps <<= 10; end++; break;
+        case 'M': *bps <<= 20; end++; break;
+        case 'G': *bps <<= 30; end++; break;
+    }
+    *iops = 0;
+    if (*end == ':') {
+        value = end + 1;
+        *iops = strtoull(value, &end, 0);
+        if (end == value)
+            return -1;
+    }
+    return (*end == '\0') ? 0 : -1;
+}
+
+int
+android_qos_parse( const char*  spec )
+{
+    char*  copy = strdup(spec);
+    char*  item = copy;
+    int    ret = 0;
+
+    while (item && *item) {
+        char*  next = strchr(item, ',');
+        char*  value;
+
+        if (next != NULL)
+            *next++ = 0;
+
+        value = strchr(item, '=');
+        if (value == NULL) {
+            derror("bad -qos item '%s', expecting <name>=<value>", item);
+            ret = -1;
+            break;
+        }
+        *value++ = 0;
+
+        if (!strcmp(item, "cpu")) {
+            char*  end;
+            long   percent = strtol(value, &end, 10);
+            if (end == value || *end || android_qos_set_cpu((int)percent) < 0) {
+                derror("bad -qos cpu value '%s', expecting 1 to 100", value);
+                ret = -1;
+                break;
+            }
+        } else if (!strcmp(item, "io") || !strncmp(item, "io.", 3)) {
+            const char*  device = item[2] ? item + 3 : NULL;
+            uint64_t     bps, iops;
+            if (qos_parse_io_limits(value, &bps, &iops) < 0) {
+                derror("bad -qos io value '%s', expecting <bps>[:<iops>]",
+                       value);
+                ret = -1;
+                break;
+            }
+            if (android_qos_set_io(device, bps, iops) < 0) {
+                derror("bad -qos item: no '%s' device", device);
+                ret = -1;
+                break;
+            }
+        } else if (!strcmp(item, "render")) {
+            int  n;
+            for (n = 0; n <= ANDROID_QOS_RENDER_HIGH; n++) {
+                if (!strcmp(value, qos_render_names[n]))
+                    break;
+            }
+            if (n > ANDROID_QOS_RENDER_HIGH) {
+                derror("bad -qos render value '%s', expecting low, normal "
+                       "or high", value);
+                ret = -1;
+                break;
+            }
+            android_qos_set_render((AndroidQosRenderPriority)n);
+        } else {
+            derror("bad -qos item '%s' (see -help-qos)", item);
+            ret = -1;
+            break;
+        }
+        item = next;
+    }
+    free(copy);
+    return ret;
+}
+
+typedef struct {
+    void (*write)(void* opaque, const char* line);
+    void*  opaque;
+} QosDump;
+
+static void
+qos_dump_io( QosDump*  dump, const char*  type, const char*  name,
+             uint64_t  bps, uint64_t  iops )
+{
+    char  line[128];
+
+    if (bps == 0 && iops == 0) {
+        snprintf(line, sizeof(line), "io %s %s: no limit\r\n", type, name);
+    } else {
+        snprintf(line, sizeof(line),
+                 "io %s %s: %" PRIu64 " bytes/s, %" PRIu64 " ops/s\r\n",
+                 type, name, bps, iops);
+    }
+    dump->write(dump->opaque, line);
+}
+
+static void
+qos_dump_nand( void*  opaque, const char*  devname, uint64_t  bps,
+               uint64_t  iops )
+{
+    qos_dump_io(opaque, "nand", devname, bps, iops);
+}
+
+static void
+qos_dump_block( void*  opaque, BlockDriverState*  bs )
+{
+    uint64_t  bps, iops;
+
+    bdrv_get_io_limits(bs, &bps, &iops);
+    qos_dump_io(opaque, "block", bdrv_get_device_name(bs), bps, iops);
+}
+
+void
+android_qos_dump( void (*write)(void* opaque, const char* line),
+                  void*  opaque )
+{
+    QosDump  dump = { write, opaque };
+    char     line[64];
+
+    snprintf(line, sizeof(line), "cpu: %d%%\r\n", qemu_cpu_get_throttle());
+    write(opaque, line);
+    snprintf(line, sizeof(line), "render: %s\r\n",
+             qos_render_names[qos_render_priority]);
+    write(opaque, line);
+    nand_dev_iterate_io_limits(qos_dump_nand, &dump);
+    bdrv_iterate(qos_dump_block, &dump);
+}
@@ -0,0 +1,62 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _android_qos_h
+#define _android_qos_h
+
+#include <stdint.h>
+
+/* Quality of service limits of an emulator instance, for hosts that run
+ * many of them, so that a busy one doesn't starve the others:
+ *
+ *  - the share of the time the vCPUs run, see qemu_cpu_set_throttle();
+ *  - the bandwidth and operation rate of the NAND and block devices, see
+ *    nand_dev_set_io_limits() and bdrv_set_io_limits();
+ *  - the scheduling priority of the GPU emulation render threads.
+ *
+ * All of them can be changed at any time, from the -qos option or the
+ * 'qos' console command.
+ */
+
+typedef enum {
+    ANDROID_QOS_RENDER_LOW = 0,
+    ANDROID_QOS_RENDER_NORMAL,
+    ANDROID_QOS_RENDER_HIGH,   /* the default, no limit */
+} AndroidQosRenderPriority;
+
+/* Let the vCPUs run |percent| of the time, from 1 to 100. Returns -1 if
+ * |percent| is out of range, 0 otherwise. */
+extern int   android_qos_set_cpu( int  percent );
+
+/* Limit the NAND or block device named |device|, or all of them if it is
+ * NULL, to |bps| bytes and |iops| operations per second, 0 meaning no
+ * limit. Returns -1 if there is no such device, 0 otherwise. */
+extern int   android_qos_set_io( const char*  device, uint64_t  bps, uint64_t  iops );
+
+/* Limit the scheduling priority of the render threads. */
+extern void  android_qos_set_render( AndroidQosRenderPriority  priority );
+
+/* Apply the comma-separated limits of |spec|, in the format of the -qos
+ * option:
+ *
+ *     cpu=<percent>
+ *     io=<bps>[:<iops>]                bps accepts K, M and G suffixes
+ *     io.<device>=<bps>[:<iops>]
+ *     render=low|normal|high
+ *
+ * Returns -1 and prints an error on the first invalid item, 0 otherwise. */
+extern int   android_qos_parse( const char*  spec );
+
+/* Call |write| with the lines that describe the current limits. */
+extern void  android_qos_dump( void (*write)(void* opaque, const char* line),
+                               void*  opaque );
+
+#endif /* _android_qos_h */
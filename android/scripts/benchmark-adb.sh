@@ -0,0 +1,91 @@
+#!/bin/sh
+
+# Copyright 2015 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+. $(dirname "$0")/utils/common.shi
+
+shell_import utils/option_parser.shi
+
+###
+###  Command-line parsing
+###
+
+PROGRAM_DESCRIPTION=\
+"Measure the 'adb push' and 'adb pull' throughput of a running emulator.
+
+This pushes a file of random data to the device, pulls it back, checks that
+the data is unchanged, and prints the transfer rates reported by adb. Use it
+to compare the QEMUD 'adb' service with the 'adb' pipe service, or two
+emulator builds."
+
+PROGRAM_PARAMETERS=""
+
+OPT_SERIAL=
+option_register_var "--serial=<serial>" OPT_SERIAL "Emulator serial, e.g. emulator-5554."
+
+OPT_SIZE=64
+option_register_var "--size=<MiB>" OPT_SIZE "File size in MiB."
+
+OPT_COUNT=3
+option_register_var "--count=<count>" OPT_COUNT "Number of push/pull rounds."
+
+OPT_DEVICE_DIR=/data/local/tmp
+option_register_var "--device-dir=<path>" OPT_DEVICE_DIR "Device directory for the file."
+
+option_parse "$@"
+
+if [ "$PARAMETER_COUNT" != "0" ]; then
+    panic "This script doesn't take arguments. See --help."
+fi
+
+ADB=$(find_program adb)
+if [ -z "$ADB" ]; then
+    panic "Could not find 'adb' in your PATH."
+fi
+if [ "$OPT_SERIAL" ]; then
+    ADB="$ADB -s $OPT_SERIAL"
+fi
+
+TEMP_DIR=/tmp/$USER-benchmark-adb-$$
+silent_run mkdir -p "$TEMP_DIR" ||
+        panic "Could not create temporary directory: $TEMP_DIR"
+trap 'rm -rf "$TEMP_DIR"' EXIT
+
+LOCAL_FILE=$TEMP_DIR/data.bin
+DEVICE_FILE=$OPT_DEVICE_DIR/benchmark-adb.bin
+
+dump "Creating $OPT_SIZE MiB file."
+run dd if=/dev/urandom of="$LOCAL_FILE" bs=1048576 count=$OPT_SIZE ||
+        panic "Could not create $LOCAL_FILE"
+
+run $ADB wait-for-device || panic "No device found."
+
+ROUND=1
+while [ "$ROUND" -le "$OPT_COUNT" ]; do
+    dump "Round $ROUND/$OPT_COUNT:"
+    # adb prints the transfer rate, e.g. "1234 KB/s (67108864 bytes in 53s)".
+    PUSH=$($ADB push "$LOCAL_FILE" "$DEVICE_FILE" 2>&1 | tail -n 1)
+    dump "  push: $PUSH"
+    rm -f "$LOCAL_FILE.pulled"
+    PULL=$($ADB pull "$DEVICE_FILE" "$LOCAL_FILE.pulled" 2>&1 | tail -n 1)
+    dump "  pull: $PULL"
+    if ! cmp -s "$LOCAL_FILE" "$LOCAL_FILE.pulled"; then
+        panic "Pulled file differs from the pushed one!"
+    fi
+    ROUND=$(( $ROUND + 1 ))
+done
+
+run $ADB shell rm -f "$DEVICE_FILE"
+dump "Done."
@@ -0,0 +1,175 @@
+#!/bin/sh
+
+# Copyright 2015 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+. $(dirname "$0")/utils/common.shi
+
+shell_import utils/option_parser.shi
+
+###
+###  Command-line parsing
+###
+
+PROGRAM_DESCRIPTION=\
+"Compare the disk throughput of the emulator with each block AIO engine.
+
+For each engine, this starts a headless emulator with an extra scratch disk
+attached through '-drive ...,cache=none,aio=<engine>', waits for it to boot,
+and runs fio-like jobs on the raw disk from the guest with 'dd':
+
+    seqread    sequential reads of 1 MiB blocks.
+    seqwrite   sequential writes of 1 MiB blocks.
+    smallread  sequential reads of 4 KiB blocks.
+
+The reported times include the 'adb shell' overhead, so use a disk size
+large enough for it to be negligible. The 'native' engine is only available
+on Linux hosts, other hosts silently use 'threads' instead.
+
+The scratch disk appears as --guest-device in the guest, which depends on the
+emulated board and the kernel, and all of its content is overwritten."
+
+PROGRAM_PARAMETERS=""
+
+OPT_AVD=
+option_register_var "--avd=<name>" OPT_AVD "AVD to start (required)."
+
+OPT_EMULATOR=
+option_register_var "--emulator=<path>" OPT_EMULATOR "Emulator program to use."
+
+OPT_ENGINES="threads native"
+option_register_var "--engines=<list>" OPT_ENGINES "AIO engines to compare."
+
+OPT_PORT=5580
+option_register_var "--port=<port>" OPT_PORT "Console port of the emulators."
+
+OPT_SIZE=256
+option_register_var "--size=<MiB>" OPT_SIZE "Size of the scratch disk."
+
+OPT_GUEST_DEVICE=/dev/block/sdc
+option_register_var "--guest-device=<path>" OPT_GUEST_DEVICE "Scratch disk in the guest."
+
+option_parse "$@"
+
+if [ "$PARAMETER_COUNT" != "0" ]; then
+    panic "This script doesn't take arguments. See --help."
+fi
+
+if [ -z "$OPT_AVD" ]; then
+    panic "Please use --avd=<name> to select an AVD. See --help."
+fi
+
+ADB=$(find_program adb)
+if [ -z "$ADB" ]; then
+    panic "Could not find 'adb' in your PATH."
+fi
+ADB="$ADB -s emulator-$OPT_PORT"
+
+EMULATOR=$OPT_EMULATOR
+if [ -z "$EMULATOR" ]; then
+    EMULATOR=$(find_program emulator)
+    if [ -z "$EMULATOR" ]; then
+        panic "Could not find 'emulator' in your PATH, use --emulator=<path>."
+    fi
+fi
+
+TEMP_DIR=/tmp/$USER-benchmark-block-aio-$$
+silent_run mkdir -p "$TEMP_DIR" ||
+        panic "Could not create temporary directory: $TEMP_DIR"
+trap 'rm -rf "$TEMP_DIR"' EXIT
+
+DISK=$TEMP_DIR/scratch.img
+run dd if=/dev/zero of="$DISK" bs=1048576 count=$OPT_SIZE ||
+        panic "Could not create scratch disk: $DISK"
+
+# Wait up to 300 seconds for the emulator to boot. Return 1 on timeout.
+wait_for_boot () {
+    local TIMEOUT=300
+    while [ "$TIMEOUT" -gt 0 ]; do
+        if [ "$($ADB shell getprop sys.boot_completed 2>/dev/null |
+                tr -d '\r')" = "1" ]; then
+            return 0
+        fi
+        sleep 2
+        TIMEOUT=$(( $TIMEOUT - 2 ))
+    done
+    return 1
+}
+
+# Print the guest command of job $1.
+job_command () {
+    local DEV=$OPT_GUEST_DEVICE
+    case $1 in
+        seqread)
+            echo "dd if=$DEV of=/dev/null bs=1048576 count=$OPT_SIZE"
+            ;;
+        seqwrite)
+            echo "dd if=/dev/zero of=$DEV bs=1048576 count=$OPT_SIZE"
+            ;;
+        smallread)
+            echo "dd if=$DEV of=/dev/null bs=4096 count=$(( $OPT_SIZE * 256 ))"
+            ;;
+    esac
+}
+
+# Run job $1 and print its throughput.
+run_job () {
+    local START END
+    # Drop the guest page cache, so that reads reach the emulated disk.
+    $ADB shell "sync; echo 3 > /proc/sys/vm/drop_caches"
+    START=$(date +%s.%N)
+    $ADB shell "$(job_command $1) 2>/dev/null; sync" > /dev/null
+    END=$(date +%s.%N)
+    awk -v job=$1 -v start=$START -v end=$END -v size=$OPT_SIZE '
+    BEGIN {
+        printf "  %-10s %6.2fs  %7.1f MiB/s\n", job, end - start,
+               size / (end - start);
+    }'
+}
+
+# Run the benchmark for AIO engine $1.
+benchmark_engine () {
+    local LOG="$TEMP_DIR/emulator-$1.log"
+    dump "Engine $1:"
+    "$EMULATOR" -avd "$OPT_AVD" -port $OPT_PORT -no-window -no-audio \
+            -no-boot-anim -no-snapshot \
+            -qemu -drive file="$DISK",index=2,media=disk,cache=none,aio=$1 \
+            > "$LOG" 2>&1 &
+    local PID=$!
+    if ! wait_for_boot; then
+        dump "  Emulator failed to boot, see below:"
+        kill $PID 2>/dev/null
+        sed -e 's/^/    /' "$LOG"
+        return
+    fi
+
+    $ADB root > /dev/null 2>&1
+    $ADB wait-for-device
+    if [ -z "$($ADB shell ls $OPT_GUEST_DEVICE 2>/dev/null |
+            tr -d '\r' | grep -v 'No such')" ]; then
+        dump "  No $OPT_GUEST_DEVICE in the guest, use --guest-device."
+    else
+        for JOB in seqread seqwrite smallread; do
+            run_job $JOB
+        done
+    fi
+
+    $ADB emu kill > /dev/null 2>&1
+    wait $PID
+}
+
+for ENGINE in $OPT_ENGINES; do
+    benchmark_engine $ENGINE
+done
+dump "Done."
@@ -0,0 +1,138 @@
+#!/bin/sh
+
+# Copyright 2015 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+. $(dirname "$0")/utils/common.shi
+
+shell_import utils/option_parser.shi
+
+###
+###  Command-line parsing
+###
+
+PROGRAM_DESCRIPTION=\
+"Compare the guest frame times of several GPU emulation modes.
+
+For each mode, this starts a headless emulator with '-gpu <mode>', waits for
+it to boot, scrolls the launcher with 'input swipe' for a while, and prints
+the frame statistics that 'dumpsys gfxinfo' reports for it. Use it to compare
+software backends like 'swiftshader' or 'mesa' with '-gpu off' on hosts
+without a GPU.
+
+The system image must be Android 6.0 or higher for 'dumpsys gfxinfo' to
+report frame time percentiles. Modes that the emulator doesn't support are
+reported as failures."
+
+PROGRAM_PARAMETERS=""
+
+OPT_AVD=
+option_register_var "--avd=<name>" OPT_AVD "AVD to start (required)."
+
+OPT_EMULATOR=
+option_register_var "--emulator=<path>" OPT_EMULATOR "Emulator program to use."
+
+OPT_MODES="off swiftshader mesa"
+option_register_var "--modes=<list>" OPT_MODES "GPU modes to compare."
+
+OPT_PORT=5580
+option_register_var "--port=<port>" OPT_PORT "Console port of the emulators."
+
+OPT_SWIPES=50
+option_register_var "--swipes=<count>" OPT_SWIPES "Number of swipes per mode."
+
+OPT_PACKAGE=com.android.launcher3
+option_register_var "--package=<name>" OPT_PACKAGE "Package to measure."
+
+option_parse "$@"
+
+if [ "$PARAMETER_COUNT" != "0" ]; then
+    panic "This script doesn't take arguments. See --help."
+fi
+
+if [ -z "$OPT_AVD" ]; then
+    panic "Please use --avd=<name> to select an AVD. See --help."
+fi
+
+ADB=$(find_program adb)
+if [ -z "$ADB" ]; then
+    panic "Could not find 'adb' in your PATH."
+fi
+ADB="$ADB -s emulator-$OPT_PORT"
+
+EMULATOR=$OPT_EMULATOR
+if [ -z "$EMULATOR" ]; then
+    EMULATOR=$(find_program emulator)
+    if [ -z "$EMULATOR" ]; then
+        panic "Could not find 'emulator' in your PATH, use --emulator=<path>."
+    fi
+fi
+
+TEMP_DIR=/tmp/$USER-benchmark-gpu-backends-$$
+silent_run mkdir -p "$TEMP_DIR" ||
+        panic "Could not create temporary directory: $TEMP_DIR"
+trap 'rm -rf "$TEMP_DIR"' EXIT
+
+# Wait up to 300 seconds for the emulator to boot. Return 1 on timeout.
+wait_for_boot () {
+    local TIMEOUT=300
+    while [ "$TIMEOUT" -gt 0 ]; do
+        if [ "$($ADB shell getprop sys.boot_completed 2>/dev/null |
+                tr -d '\r')" = "1" ]; then
+            return 0
+        fi
+        sleep 2
+        TIMEOUT=$(( $TIMEOUT - 2 ))
+    done
+    return 1
+}
+
+# Run the benchmark for GPU mode $1.
+benchmark_mode () {
+    local LOG="$TEMP_DIR/emulator-$1.log"
+    dump "Mode $1:"
+    "$EMULATOR" -avd "$OPT_AVD" -port $OPT_PORT -gpu $1 -no-window \
+            -no-audio -no-boot-anim -no-snapshot > "$LOG" 2>&1 &
+    local PID=$!
+    if ! wait_for_boot; then
+        dump "  Emulator failed to boot, see below:"
+        kill $PID 2>/dev/null
+        sed -e 's/^/    /' "$LOG"
+        return
+    fi
+
+    # Let the post-boot activity settle down first.
+    sleep 20
+    $ADB shell input keyevent HOME
+    $ADB shell dumpsys gfxinfo $OPT_PACKAGE reset > /dev/null
+
+    local SWIPE=0
+    while [ "$SWIPE" -lt "$OPT_SWIPES" ]; do
+        $ADB shell input swipe 600 500 100 500 200
+        $ADB shell input swipe 100 500 600 500 200
+        SWIPE=$(( $SWIPE + 2 ))
+    done
+
+    $ADB shell dumpsys gfxinfo $OPT_PACKAGE | tr -d '\r' |
+            grep -e "Total frames rendered" -e "Janky frames" \
+                 -e "percentile" | sed -e 's/^/  /'
+
+    $ADB emu kill > /dev/null 2>&1
+    wait $PID
+}
+
+for MODE in $OPT_MODES; do
+    benchmark_mode $MODE
+done
+dump "Done."
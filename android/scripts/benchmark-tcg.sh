@@ -0,0 +1,185 @@
+#!/bin/sh
+
+# Copyright 2015 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+. $(dirname "$0")/utils/common.shi
+
+shell_import utils/option_parser.shi
+
+###
+###  Command-line parsing
+###
+
+PROGRAM_DESCRIPTION=\
+"Measure the TCG performance of a running emulator on fixed guest workloads.
+
+This runs a set of workloads through 'adb shell' and samples the emulator's
+'profile counters' console command before and after each of them, to report
+the guest MIPS, the share of the time spent translating code and the softmmu
+TLB miss rate. Use it to compare two emulator builds on the same system image.
+
+For reproducible instruction counts, start the emulator with
+'-qemu -icount <shift>', otherwise no guest instruction count is available and
+only times and rates per second are reported.
+
+Available workloads are:
+    integer    shell arithmetic loop.
+    memory     large block copies from /dev/zero.
+    syscalls   one-byte reads and writes.
+    neon       the binary given with --neon-binary, e.g. a NEON kernel built
+               with the NDK. Skipped if there is none."
+
+PROGRAM_PARAMETERS=""
+
+OPT_SERIAL=emulator-5554
+option_register_var "--serial=<serial>" OPT_SERIAL "Emulator serial."
+
+OPT_WORKLOADS="integer memory syscalls neon"
+option_register_var "--workloads=<list>" OPT_WORKLOADS "Workloads to run."
+
+OPT_COUNT=3
+option_register_var "--count=<count>" OPT_COUNT "Number of rounds of each workload."
+
+OPT_NEON_BINARY=
+option_register_var "--neon-binary=<path>" OPT_NEON_BINARY "Guest binary for the neon workload."
+
+OPT_DEVICE_DIR=/data/local/tmp
+option_register_var "--device-dir=<path>" OPT_DEVICE_DIR "Device directory for the neon binary."
+
+option_parse "$@"
+
+if [ "$PARAMETER_COUNT" != "0" ]; then
+    panic "This script doesn't take arguments. See --help."
+fi
+
+ADB=$(find_program adb)
+if [ -z "$ADB" ]; then
+    panic "Could not find 'adb' in your PATH."
+fi
+ADB="$ADB -s $OPT_SERIAL"
+
+NC=$(find_program nc)
+if [ -z "$NC" ]; then
+    panic "Could not find 'nc' in your PATH."
+fi
+
+CONSOLE_PORT=${OPT_SERIAL##emulator-}
+case $CONSOLE_PORT in
+    ""|*[!0-9]*)
+        panic "Not an emulator serial: $OPT_SERIAL"
+        ;;
+esac
+
+TEMP_DIR=/tmp/$USER-benchmark-tcg-$$
+silent_run mkdir -p "$TEMP_DIR" ||
+        panic "Could not create temporary directory: $TEMP_DIR"
+trap 'rm -rf "$TEMP_DIR"' EXIT
+
+# Save the emulator counters to file $1.
+sample_counters () {
+    printf "profile counters\r\nquit\r\n" |
+            $NC localhost $CONSOLE_PORT | tr -d '\r' > "$1"
+    grep -q "^host_time_ns: " "$1" ||
+            panic "Could not read counters from console port $CONSOLE_PORT"
+}
+
+# Print the value of counter $2 in file $1.
+counter () {
+    sed -n -e "s/^$2: //p" "$1"
+}
+
+# Print the shell command that runs workload $1, or nothing to skip it.
+workload_command () {
+    case $1 in
+        integer)
+            echo 'i=0; while [ $i -lt 200000 ]; do i=$((i + 1)); done'
+            ;;
+        memory)
+            echo 'dd if=/dev/zero of=/dev/null bs=1048576 count=512 2>/dev/null'
+            ;;
+        syscalls)
+            echo 'dd if=/dev/zero of=/dev/null bs=1 count=100000 2>/dev/null'
+            ;;
+        neon)
+            if [ "$OPT_NEON_BINARY" ]; then
+                echo "$OPT_DEVICE_DIR/benchmark-neon"
+            fi
+            ;;
+        *)
+            panic "Unknown workload: $1"
+            ;;
+    esac
+}
+
+# Print the results of a workload from the counter files $1 and $2.
+report () {
+    awk -v t0=$(counter $1 host_time_ns) -v t1=$(counter $2 host_time_ns) \
+        -v i0=$(counter $1 guest_insns) -v i1=$(counter $2 guest_insns) \
+        -v n0=$(counter $1 translations) -v n1=$(counter $2 translations) \
+        -v g0=$(counter $1 translation_time_ns) \
+        -v g1=$(counter $2 translation_time_ns) \
+        -v m0=$(counter $1 tlb_misses) -v m1=$(counter $2 tlb_misses) \
+        -v f0=$(counter $1 tb_flushes) -v f1=$(counter $2 tb_flushes) '
+    BEGIN {
+        secs = (t1 - t0) / 1e9;
+        misses = m1 - m0;
+        if (i0 >= 0) {
+            printf "  %.2fs, %.1f guest MIPS, ", secs, (i1 - i0) / secs / 1e6;
+            tlb = sprintf("%.2f TLB misses per 1000 insns", \
+                          1000 * misses / (i1 - i0));
+        } else {
+            printf "  %.2fs, ", secs;
+            tlb = sprintf("%.0f TLB misses/s", misses / secs);
+        }
+        printf "%d translations in %.1fms (%.1f%%), %d flushes, %s\n",
+               n1 - n0, (g1 - g0) / 1e6, (g1 - g0) / (t1 - t0) * 100,
+               f1 - f0, tlb;
+    }'
+}
+
+run $ADB wait-for-device || panic "No device found."
+
+if [ "$OPT_NEON_BINARY" ]; then
+    run $ADB push "$OPT_NEON_BINARY" "$OPT_DEVICE_DIR/benchmark-neon" ||
+            panic "Could not push $OPT_NEON_BINARY"
+    run $ADB shell chmod 755 "$OPT_DEVICE_DIR/benchmark-neon"
+fi
+
+sample_counters "$TEMP_DIR/before"
+if [ "$(counter "$TEMP_DIR/before" guest_insns)" = "-1" ]; then
+    dump "WARNING: No guest instruction count, use '-qemu -icount <shift>'."
+fi
+
+for WORKLOAD in $OPT_WORKLOADS; do
+    COMMAND=$(workload_command $WORKLOAD)
+    if [ -z "$COMMAND" ]; then
+        dump "Skipping $WORKLOAD workload."
+        continue
+    fi
+    dump "Workload $WORKLOAD:"
+    ROUND=1
+    while [ "$ROUND" -le "$OPT_COUNT" ]; do
+        sample_counters "$TEMP_DIR/before"
+        $ADB shell "$COMMAND" > /dev/null || panic "Workload $WORKLOAD failed."
+        sample_counters "$TEMP_DIR/after"
+        report "$TEMP_DIR/before" "$TEMP_DIR/after"
+        ROUND=$(( $ROUND + 1 ))
+    done
+done
+
+if [ "$OPT_NEON_BINARY" ]; then
+    run $ADB shell rm -f "$OPT_DEVICE_DIR/benchmark-neon"
+fi
+dump "Done."
@@ -316,8 +316,8 @@ _on_sensor_event(AndroidSensorsPort* asp, const SensorEvent* event)
           event->fvalues[0], event->fvalues[1],
           event->fvalues[2]);
         /* Fire up sensor change in the guest. */
-        android_sensors_set(desc->emulator_id, event->fvalues[0],
-                            event->fvalues[1], event->fvalues[2]);
+        android_sensors_add_sample(desc->emulator_id, event->fvalues[0],
+                                   event->fvalues[1], event->fvalues[2]);
     } else {
         W("Sensors: No descriptor for sensor %d", event->sensor_id);
     }
@@ -416,9 +416,15 @@ _on_sensors_message(void* client_opaque,
 {
     AndroidSensorsPort* const asp = (AndroidSensorsPort*)client_opaque;
     switch (msg_type) {
-        case SDKCTL_SENSORS_SENSOR_EVENT:
-            _on_sensor_event(asp, (const SensorEvent*)msg_data);
+        case SDKCTL_SENSORS_SENSOR_EVENT: {
+            /* A message may carry several events from a fast sensor. */
+            const SensorEvent* event = (const SensorEvent*)msg_data;
+            int n;
+            for (n = msg_size / sizeof(SensorEvent); n > 0; n--, event++) {
+                _on_sensor_event(asp, event);
+            }
             break;
+        }
 
         default:
             E("Sensors: Unknown message type %d", msg_type);
@@ -10,7 +10,10 @@
 ** GNU General Public License for more details.
 */
 #include "android/skin/image.h"
+#include "android/skin/pixel-cache.h"
 #include "android/skin/resource.h"
+#include "android/utils/bufprint.h"
+#include "android/utils/path.h"
 
 #include <assert.h>
 #include <limits.h>
@@ -219,6 +222,7 @@ struct SkinImage {
     unsigned         flags;
     unsigned         w, h;
     void*            pixels;  /* 32-bit ARGB */
+    SkinPixelCacheMapping  mapping;  /* if pixels are mapped from the cache */
     SkinImageDesc    desc;
 };
 
@@ -235,6 +239,7 @@ static const SkinImage _no_image[1] = {
         .w = 0,
         .h = 0,
         .pixels = NULL,
+        .mapping = { NULL, 0 },
         .desc = (SkinImageDesc){
             .path = "<none>",
             .rotation = SKIN_ROTATION_0,
@@ -252,10 +257,12 @@ skin_image_free( SkinImage*  image )
     {
         skin_surface_unrefp(&image->surface);
 
-        if (image->pixels) {
+        if (image->mapping.base) {
+            skin_pixel_cache_unmap(&image->mapping);
+        } else if (image->pixels) {
             free( image->pixels );
-            image->pixels = NULL;
         }
+        image->pixels = NULL;
 
         free(image);
     }
@@ -282,20 +289,43 @@ skin_image_alloc( SkinImageDesc*  desc, unsigned  hash )
 }
 
 
-extern void *loadpng(const char *fn, unsigned *_width, unsigned *_height);
 extern void *readpng(const unsigned char*  base, size_t  size, unsigned *_width, unsigned *_height);
 
+/* Return the directory of the decoded image cache, or NULL if it can't be
+ * used. */
+static const char*
+skin_image_cache_dir( void )
+{
+    static char  dir[PATH_MAX];
+    static int   init;
+
+    if (!init) {
+        char*  end = dir + sizeof(dir);
+        char*  p   = bufprint_config_path(dir, end);
+
+        init = 1;
+        p = bufprint(p, end, PATH_SEP "skin-cache");
+        if (p >= end || path_mkdir_if_needed(dir, 0755) < 0) {
+            D("cannot use decoded skin image cache '%s'\n", dir);
+            dir[0] = 0;
+        }
+    }
+    return dir[0] ? dir : NULL;
+}
+
 static int
 skin_image_load( SkinImage*  image )
 {
-    void*     data;
-    unsigned  w, h;
+    void*       data;
+    unsigned    w, h;
     const char*  path = image->desc.path;
+    const unsigned char*  base;
+    size_t      size;
+    void*       file_data = NULL;
+    const char*  cache_dir = skin_image_cache_dir();
+    uint64_t    key = 0;
 
     if (path[0] == ':') {
-        size_t                size;
-        const unsigned char*  base;
-
         if (path[1] == '/' || path[1] == '\\')
             path += 1;
 
@@ -304,18 +334,39 @@ skin_image_load( SkinImage*  image )
             fprintf(stderr, "failed to locate built-in image file '%s'\n", path );
             return -1;
         }
-
-        data = readpng(base, size, &w, &h);
-        if (data == NULL) {
-            fprintf(stderr, "failed to load built-in image file '%s'\n", path );
-            return -1;
-        }
     } else {
-        data = loadpng(path, &w, &h);
-        if (data == NULL) {
+        file_data = path_load_file(path, &size);
+        if (file_data == NULL) {
             fprintf(stderr, "failed to load image file '%s'\n", path );
             return -1;
         }
+        base = file_data;
+    }
+
+    /* Hashing the file is much faster than decoding it, so look for the
+     * decoded pixels in the cache first. */
+    if (cache_dir != NULL) {
+        const uint32_t*  pixels;
+
+        key = skin_pixel_cache_key(base, size);
+        pixels = skin_pixel_cache_find(cache_dir, key, &w, &h,
+                                       &image->mapping);
+        if (pixels != NULL) {
+            D("using cached pixels for '%s'\n", path);
+            free(file_data);
+            image->pixels = (void*)pixels;
+            image->w      = w;
+            image->h      = h;
+            goto CreateSurface;
+        }
+    }
+
+    data = readpng(base, size, &w, &h);
+    free(file_data);
+    if (data == NULL) {
+        fprintf(stderr, "failed to load %simage file '%s'\n",
+                (path[0] == ':') ? "built-in " : "", path );
+        return -1;
     }
 
    /* the data is loaded into memory as RGBA bytes by libpng. we want to manage
@@ -343,7 +394,15 @@ skin_image_load( SkinImage*  image )
     image->w      = w;
     image->h      = h;
 
-    image->surface = skin_surface_create_argb32_from(w, h, w * 4, image->pixels);
+    if (cache_dir != NULL &&
+        skin_pixel_cache_store(cache_dir, key, w, h, data) < 0) {
+        D("could not cache pixels for '%s'\n", path);
+    }
+
+CreateSurface:
+    image->surface = skin_surface_create_argb32_from(image->w, image->h,
+                                                     image->w * 4,
+                                                     image->pixels);
     if (image->surface == NULL) {
         fprintf(stderr, "failed to create skin surface for '%s' image\n", path);
         return -1;
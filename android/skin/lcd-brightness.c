@@ -0,0 +1,237 @@
+/* Copyright (C) 2007-2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/skin/lcd-brightness.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* technical note about the lightness emulation
+ *
+ * we try to emulate something that looks like the Dream's
+ * non-linear LCD lightness, without going too dark or bright.
+ *
+ * the default lightness is around 105 (about 40%) and we prefer
+ * to keep full RGB colors at that setting, to not alleviate
+ * developers who will not understand why the emulator's colors
+ * look slightly too dark.
+ *
+ * we also want to implement a 'bright' mode by de-saturating
+ * colors towards bright white.
+ *
+ * All of this leads to the implementation below that looks like
+ * the following:
+ *
+ * if (level == MIN)
+ *     screen is off
+ *
+ * if (level > MIN && level < LOW)
+ *     interpolate towards black, with
+ *     MINALPHA = 0.2
+ *     alpha = MINALPHA + (1-MINALPHA)*(level-MIN)/(LOW-MIN)
+ *
+ * if (level >= LOW && level <= HIGH)
+ *     keep full RGB colors
+ *
+ * if (level > HIGH)
+ *     interpolate towards bright white, with
+ *     MAXALPHA = 0.6
+ *     alpha = MAXALPHA*(level-HIGH)/(MAX-HIGH)
+ *
+ * we probably want some sort of power law instead of interpolating
+ * linearly, but frankly, this is sufficient for most uses.
+ */
+
+#define  LCD_BRIGHTNESS_LOW   80
+#define  LCD_BRIGHTNESS_HIGH  180
+
+#define  LCD_ALPHA_LOW_MIN      0.2
+#define  LCD_ALPHA_HIGH_MAX     0.6
+
+/* Both modes compute, for each 8-bit channel c (including alpha):
+ *
+ *     c' = (c * mul + add) >> 8
+ *
+ * with mul = alpha, add = 0 to darken, and mul = 255 - alpha,
+ * add = 255 * alpha to brighten. The sum never exceeds 255*255, so
+ * it can be computed in 16-bit lanes without overflow. */
+static void lcd_modulate_line(uint32_t* line, int w, unsigned mul,
+                              unsigned add)
+{
+    int nn = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vmul = _mm_set1_epi16((short)mul);
+    const __m128i vadd = _mm_set1_epi16((short)add);
+
+    for (; nn + 4 <= w; nn += 4) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(line + nn));
+        __m128i lo = _mm_unpacklo_epi8(c, zero);
+        __m128i hi = _mm_unpackhi_epi8(c, zero);
+        lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, vmul), vadd), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, vmul), vadd), 8);
+        _mm_storeu_si128((__m128i*)(line + nn), _mm_packus_epi16(lo, hi));
+    }
+#endif  /* __SSE2__ */
+
+    for (; nn < w; nn++) {
+        unsigned c = line[nn];
+        unsigned ag = (c >> 8) & 0x00ff00ff;
+        unsigned rb = (c)      & 0x00ff00ff;
+
+        ag = (ag * mul + add * 0x00010001) & 0xff00ff00;
+        rb = ((rb * mul + add * 0x00010001) >> 8) & 0x00ff00ff;
+
+        line[nn] = (unsigned)(ag | rb);
+    }
+}
+
+/* Compute the |mul| and |add| factors of lcd_modulate_line() for a given
+ * |brightness|. Returns 0 if the pixels must be left unchanged. */
+static int lcd_brightness_factors(int brightness,
+                                  unsigned* pmul,
+                                  unsigned* padd)
+{
+    const unsigned  b_min  = LCD_BRIGHTNESS_MIN;
+    const unsigned  b_max  = LCD_BRIGHTNESS_MAX;
+    const unsigned  b_low  = LCD_BRIGHTNESS_LOW;
+    const unsigned  b_high = LCD_BRIGHTNESS_HIGH;
+
+    unsigned        alpha = brightness;
+
+    if (alpha <= b_min)
+        alpha = b_min;
+    else if (alpha > b_max)
+        alpha = b_max;
+
+    if (alpha < b_low)
+    {
+        const unsigned  alpha_min   = (255 * LCD_ALPHA_LOW_MIN);
+        const unsigned  alpha_range = (255 - alpha_min);
+
+        *pmul = alpha_min + ((alpha - b_min) * alpha_range) / (b_low - b_min);
+        *padd = 0;
+    }
+    else if (alpha > b_high) /* 'superluminous' mode */
+    {
+        const unsigned  alpha_max   = (255 * LCD_ALPHA_HIGH_MAX);
+        const unsigned  alpha_range = (255 - alpha_max);
+
+        alpha = ((alpha - b_high) * alpha_range) / (b_max - b_high);
+        *pmul = 255 - alpha;
+        *padd = 255 * alpha;
+    }
+    else
+    {
+        /* full RGB colors, nothing to do */
+        return 0;
+    }
+    return 1;
+}
+
+void skin_lcd_brightness_argb32(uint32_t* pixels,
+                                int w,
+                                int h,
+                                int pitch,
+                                int brightness)
+{
+    unsigned  mul, add;
+
+    if (!lcd_brightness_factors(brightness, &mul, &add)) {
+        return;
+    }
+
+    for (; h > 0; h--) {
+        lcd_modulate_line(pixels, w, mul, add);
+        pixels += (pitch / sizeof(uint32_t));
+    }
+}
+
+/* Expand the 5 or 6-bit channels of the RGB565 pixels to 8 bits by
+ * replicating their top bits, then apply the same modulation as
+ * lcd_modulate_line(). A |mul| of 256 with an |add| of 0 leaves the
+ * expanded channels unchanged, the alpha channel is always 0xff before
+ * modulation. */
+static void lcd_convert_rgb565_line(uint32_t* dst, const uint16_t* src,
+                                    int w, unsigned mul, unsigned add)
+{
+    const unsigned  a8 = (255 * mul + add) >> 8;
+    int nn = 0;
+
+#ifdef __SSE2__
+    const __m128i vmul = _mm_set1_epi16((short)mul);
+    const __m128i vadd = _mm_set1_epi16((short)add);
+    const __m128i va   = _mm_set1_epi16((short)(a8 << 8));
+    const __m128i m5   = _mm_set1_epi16(0xf8);
+    const __m128i m6   = _mm_set1_epi16(0xfc);
+    const __m128i m2   = _mm_set1_epi16(0x03);
+    const __m128i m3   = _mm_set1_epi16(0x07);
+
+    for (; nn + 8 <= w; nn += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + nn));
+        __m128i r = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 8), m5),
+                                 _mm_srli_epi16(p, 13));
+        __m128i g = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 3), m6),
+                                 _mm_and_si128(_mm_srli_epi16(p, 9), m2));
+        __m128i b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(p, 3), m5),
+                                 _mm_and_si128(_mm_srli_epi16(p, 2), m3));
+        __m128i bg, ra;
+
+        r = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(r, vmul), vadd), 8);
+        g = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(g, vmul), vadd), 8);
+        b = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(b, vmul), vadd), 8);
+
+        /* Interleave the 16-bit B|G<<8 and R|A<<8 lanes into 32-bit
+         * pixels, which are 0xAARRGGBB in memory order B,G,R,A. */
+        bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+        ra = _mm_or_si128(r, va);
+        _mm_storeu_si128((__m128i*)(dst + nn), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i*)(dst + nn + 4), _mm_unpackhi_epi16(bg, ra));
+    }
+#endif  /* __SSE2__ */
+
+    for (; nn < w; nn++) {
+        unsigned pix = src[nn];
+        unsigned r8 = ((pix & 0xf800) >> 8) | ((pix & 0xe000) >> 13);
+        unsigned g8 = ((pix & 0x07e0) >> 3) | ((pix & 0x0600) >>  9);
+        unsigned b8 = ((pix & 0x001f) << 3) | ((pix & 0x001c) >>  2);
+
+        r8 = (r8 * mul + add) >> 8;
+        g8 = (g8 * mul + add) >> 8;
+        b8 = (b8 * mul + add) >> 8;
+
+        dst[nn] = (a8 << 24) | (r8 << 16) | (g8 << 8) | b8;
+    }
+}
+
+void skin_lcd_rgb565_to_argb32(uint32_t* dst,
+                               int dst_pitch,
+                               const uint16_t* src,
+                               int src_pitch,
+                               int w,
+                               int h,
+                               int brightness)
+{
+    unsigned  mul, add;
+
+    if (!lcd_brightness_factors(brightness, &mul, &add)) {
+        mul = 256;
+        add = 0;
+    }
+
+    for (; h > 0; h--) {
+        lcd_convert_rgb565_line(dst, src, w, mul, add);
+        dst = (uint32_t*)((uint8_t*)dst + dst_pitch);
+        src = (const uint16_t*)((const uint8_t*)src + src_pitch);
+    }
+}
@@ -0,0 +1,60 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _ANDROID_SKIN_LCD_BRIGHTNESS_H
+#define _ANDROID_SKIN_LCD_BRIGHTNESS_H
+
+#include "android/utils/compiler.h"
+
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* range of LCD brightness values */
+#define  LCD_BRIGHTNESS_MIN      0
+#define  LCD_BRIGHTNESS_DEFAULT  128
+#define  LCD_BRIGHTNESS_MAX      255
+
+/* treat as special value to turn screen off */
+#define  LCD_BRIGHTNESS_OFF   LCD_BRIGHTNESS_MIN
+
+/* Apply the emulated LCD |brightness| to the |w| x |h| ARGB32 pixels at
+ * |pixels|, whose lines are |pitch| bytes apart. Brightness values in the
+ * middle of the range leave the pixels unchanged, lower ones darken them
+ * and higher ones interpolate them towards white.
+ *
+ * Uses SSE2 when the host compiler supports it.
+ */
+void skin_lcd_brightness_argb32(uint32_t* pixels,
+                                int w,
+                                int h,
+                                int pitch,
+                                int brightness);
+
+/* Convert the |w| x |h| RGB565 pixels at |src|, whose lines are
+ * |src_pitch| bytes apart, to ARGB32 pixels at |dst|, whose lines are
+ * |dst_pitch| bytes apart, applying the LCD |brightness| in the same pass.
+ * The result is the same as converting each pixel, then calling
+ * skin_lcd_brightness_argb32().
+ *
+ * Uses SSE2 when the host compiler supports it.
+ */
+void skin_lcd_rgb565_to_argb32(uint32_t* dst,
+                               int dst_pitch,
+                               const uint16_t* src,
+                               int src_pitch,
+                               int w,
+                               int h,
+                               int brightness);
+
+ANDROID_END_HEADER
+
+#endif /* _ANDROID_SKIN_LCD_BRIGHTNESS_H */
@@ -0,0 +1,153 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+#include "android/skin/lcd-brightness.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+namespace android_skin {
+
+namespace {
+
+// Per-channel reference implementation of the brightness modulation.
+uint32_t referencePixel(uint32_t c, int brightness) {
+    unsigned alpha = brightness;
+    unsigned mul, add;
+    if (alpha < 80) {
+        const unsigned alpha_min = 255 * 0.2;
+        mul = alpha_min + (alpha * (255 - alpha_min)) / 80;
+        add = 0;
+    } else if (alpha > 180) {
+        alpha = ((alpha - 180) * (255 - (unsigned)(255 * 0.6))) / (255 - 180);
+        mul = 255 - alpha;
+        add = 255 * alpha;
+    } else {
+        return c;
+    }
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t channel = (c >> shift) & 0xff;
+        result |= (((channel * mul + add) >> 8) & 0xff) << shift;
+    }
+    return result;
+}
+
+uint32_t testPixel(int x, int y) {
+    uint32_t seed = (uint32_t)(x * 7919 + y * 104729 + 1);
+    seed = seed * 1103515245U + 12345U;
+    return seed ^ (seed >> 13);
+}
+
+}  // namespace
+
+TEST(lcd_brightness, MatchesReference) {
+    const int kPitchPixels = 40;
+    uint32_t pixels[kPitchPixels * 3];
+    static const int kBrightness[] = {
+        LCD_BRIGHTNESS_MIN, 1, 40, 79, 80, 128, 180, 181, 220,
+        LCD_BRIGHTNESS_MAX,
+    };
+    for (size_t b = 0; b < sizeof(kBrightness) / sizeof(kBrightness[0]);
+         ++b) {
+        // Widths that exercise partial vectors at the end of each line.
+        for (int w = 1; w <= 37; w += 3) {
+            for (int n = 0; n < kPitchPixels * 3; ++n) {
+                pixels[n] = testPixel(n % kPitchPixels, n / kPitchPixels);
+            }
+            skin_lcd_brightness_argb32(pixels, w, 3, kPitchPixels * 4,
+                                       kBrightness[b]);
+            for (int y = 0; y < 3; ++y) {
+                for (int x = 0; x < kPitchPixels; ++x) {
+                    uint32_t expected = testPixel(x, y);
+                    if (x < w) {
+                        expected = referencePixel(expected, kBrightness[b]);
+                    }
+                    ASSERT_EQ(expected, pixels[y * kPitchPixels + x])
+                            << "brightness " << kBrightness[b]
+                            << " w " << w << " x " << x << " y " << y;
+                }
+            }
+        }
+    }
+}
+
+TEST(lcd_brightness, Rgb565MatchesReference) {
+    const int kPitchPixels = 40;
+    uint16_t src[kPitchPixels * 3];
+    uint32_t dst[kPitchPixels * 3];
+    static const int kBrightness[] = {
+        LCD_BRIGHTNESS_MIN, 40, 128, 181, LCD_BRIGHTNESS_MAX,
+    };
+    for (int n = 0; n < kPitchPixels * 3; ++n) {
+        src[n] = (uint16_t)testPixel(n % kPitchPixels, n / kPitchPixels);
+    }
+    for (size_t b = 0; b < sizeof(kBrightness) / sizeof(kBrightness[0]);
+         ++b) {
+        for (int w = 1; w <= 37; w += 3) {
+            memset(dst, 0x5a, sizeof(dst));
+            skin_lcd_rgb565_to_argb32(dst, kPitchPixels * 4,
+                                      src, kPitchPixels * 2,
+                                      w, 3, kBrightness[b]);
+            for (int y = 0; y < 3; ++y) {
+                for (int x = 0; x < kPitchPixels; ++x) {
+                    uint32_t expected = 0x5a5a5a5a;
+                    if (x < w) {
+                        uint32_t pix = src[y * kPitchPixels + x];
+                        uint32_t r = (pix >> 11) & 0x1f;
+                        uint32_t g = (pix >> 5) & 0x3f;
+                        uint32_t bl = pix & 0x1f;
+                        expected = 0xff000000U |
+                                   (((r << 3) | (r >> 2)) << 16) |
+                                   (((g << 2) | (g >> 4)) << 8) |
+                                   ((bl << 3) | (bl >> 2));
+                        expected = referencePixel(expected, kBrightness[b]);
+                    }
+                    ASSERT_EQ(expected, dst[y * kPitchPixels + x])
+                            << "brightness " << kBrightness[b]
+                            << " w " << w << " x " << x << " y " << y;
+                }
+            }
+        }
+    }
+}
+
+TEST(lcd_brightness, DISABLED_Benchmark) {
+    const int kWidth = 1080;
+    const int kHeight = 1920;
+    const int kFrames = 100;
+    uint32_t* pixels = new uint32_t[kWidth * kHeight];
+    for (int n = 0; n < kWidth * kHeight; ++n) {
+        pixels[n] = testPixel(n % kWidth, n / kWidth);
+    }
+    static const int kBrightness[] = { 40, 220 };
+    for (int b = 0; b < 2; ++b) {
+        struct timeval start, end;
+        gettimeofday(&start, NULL);
+        for (int n = 0; n < kFrames; ++n) {
+            skin_lcd_brightness_argb32(pixels, kWidth, kHeight, kWidth * 4,
+                                       kBrightness[b]);
+        }
+        gettimeofday(&end, NULL);
+        double ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+                    (end.tv_usec - start.tv_usec) / 1000.0;
+        printf("brightness %d: %.2f ms per %dx%d frame, %.1f fps\n",
+               kBrightness[b], ms / kFrames, kWidth, kHeight,
+               kFrames * 1000.0 / ms);
+    }
+    delete[] pixels;
+}
+
+}  // namespace android_skin
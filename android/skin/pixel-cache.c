@@ -0,0 +1,183 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/skin/pixel-cache.h"
+
+#include "android/utils/bufprint.h"
+#include "android/utils/mapfile.h"
+#include "android/utils/path.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+/* Each cache file starts with this header, followed by the pixels. */
+typedef struct {
+    char      magic[4];
+    uint32_t  byte_order;  /* SKIN_PIXEL_CACHE_BYTE_ORDER in host order */
+    uint32_t  version;
+    uint32_t  width;
+    uint32_t  height;
+    uint32_t  reserved;
+    uint64_t  key;
+} SkinPixelCacheHeader;
+
+#define  SKIN_PIXEL_CACHE_MAGIC       "SKPX"
+#define  SKIN_PIXEL_CACHE_BYTE_ORDER  0x01020304U
+#define  SKIN_PIXEL_CACHE_VERSION     1
+
+/* Limit the size of cached images to something reasonable. */
+#define  SKIN_PIXEL_CACHE_MAX_SIZE    8192
+
+uint64_t
+skin_pixel_cache_key(const void* data, size_t size)
+{
+    /* 64-bit FNV-1a hash, which is fast and good enough for this. */
+    const uint8_t*  p   = data;
+    const uint8_t*  end = p + size;
+    uint64_t        hash = 0xcbf29ce484222325ULL;
+
+    for ( ; p < end; p++) {
+        hash ^= *p;
+        hash *= 0x100000001b3ULL;
+    }
+    /* Also mix the size, to make collisions even less likely. */
+    hash ^= (uint64_t)size;
+    hash *= 0x100000001b3ULL;
+    return hash;
+}
+
+static char*
+bufprint_cache_file(char* buff, char* end, const char* cache_dir,
+                    uint64_t key, const char* suffix)
+{
+    return bufprint(buff, end, "%s" PATH_SEP "%08x%08x.argb%s", cache_dir,
+                    (unsigned)(key >> 32), (unsigned)key, suffix);
+}
+
+const uint32_t*
+skin_pixel_cache_find(const char* cache_dir,
+                      uint64_t key,
+                      unsigned* w,
+                      unsigned* h,
+                      SkinPixelCacheMapping* mapping)
+{
+    char                  path[PATH_MAX], *end = path + sizeof(path);
+    SkinPixelCacheHeader  header;
+    MapFile*              file;
+    uint64_t              file_size;
+    size_t                size;
+    void*                 base;
+    void*                 pixels = NULL;
+    size_t                mapped_size;
+
+    if (bufprint_cache_file(path, end, cache_dir, key, "") >= end)
+        return NULL;
+
+    if (path_get_size(path, &file_size) < 0)
+        return NULL;
+
+    file = mapfile_open(path, O_RDONLY, S_IREAD);
+    if (!mapfile_is_valid(file))
+        return NULL;
+
+    if (mapfile_read(file, &header, sizeof(header)) != sizeof(header) ||
+        memcmp(header.magic, SKIN_PIXEL_CACHE_MAGIC, 4) != 0 ||
+        header.byte_order != SKIN_PIXEL_CACHE_BYTE_ORDER ||
+        header.version != SKIN_PIXEL_CACHE_VERSION ||
+        header.key != key ||
+        header.width == 0 || header.width > SKIN_PIXEL_CACHE_MAX_SIZE ||
+        header.height == 0 || header.height > SKIN_PIXEL_CACHE_MAX_SIZE) {
+        mapfile_close(file);
+        return NULL;
+    }
+
+    size = (size_t)header.width * header.height * 4;
+    if (file_size != sizeof(header) + size) {
+        mapfile_close(file);
+        return NULL;
+    }
+
+    base = mapfile_map(file, sizeof(header), size, PROT_READ,
+                       &pixels, &mapped_size);
+    /* The mapping holds its own reference to the file. */
+    mapfile_close(file);
+    if (base == NULL)
+        return NULL;
+
+    mapping->base = base;
+    mapping->size = (size_t)((char*)pixels - (char*)base) + size;
+    *w = header.width;
+    *h = header.height;
+    return pixels;
+}
+
+int
+skin_pixel_cache_store(const char* cache_dir,
+                       uint64_t key,
+                       unsigned w,
+                       unsigned h,
+                       const uint32_t* pixels)
+{
+    char                  path[PATH_MAX], *end = path + sizeof(path);
+    char                  temp[PATH_MAX], *temp_end = temp + sizeof(temp);
+    SkinPixelCacheHeader  header;
+    size_t                size = (size_t)w * h * 4;
+    FILE*                 file;
+    int                   ok;
+
+    if (w == 0 || w > SKIN_PIXEL_CACHE_MAX_SIZE ||
+        h == 0 || h > SKIN_PIXEL_CACHE_MAX_SIZE)
+        return -1;
+
+    if (bufprint_cache_file(path, end, cache_dir, key, "") >= end ||
+        bufprint_cache_file(temp, temp_end, cache_dir, key, ".tmp") >= temp_end)
+        return -1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SKIN_PIXEL_CACHE_MAGIC, 4);
+    header.byte_order = SKIN_PIXEL_CACHE_BYTE_ORDER;
+    header.version    = SKIN_PIXEL_CACHE_VERSION;
+    header.width      = w;
+    header.height     = h;
+    header.key        = key;
+
+    file = fopen(temp, "wb");
+    if (file == NULL)
+        return -1;
+
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(pixels, size, 1, file) == 1;
+    if (fclose(file) != 0)
+        ok = 0;
+
+    if (!ok || rename(temp, path) != 0) {
+        /* On Windows, rename() fails if another instance already created
+         * the file, which is fine since it has the same content. */
+        remove(temp);
+        return -1;
+    }
+    return 0;
+}
+
+void
+skin_pixel_cache_unmap(SkinPixelCacheMapping* mapping)
+{
+    if (mapping->base) {
+        mapfile_unmap(mapping->base, mapping->size);
+        mapping->base = NULL;
+        mapping->size = 0;
+    }
+}
@@ -0,0 +1,67 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _ANDROID_SKIN_PIXEL_CACHE_H
+#define _ANDROID_SKIN_PIXEL_CACHE_H
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* A small on-disk cache of decoded skin images.
+ *
+ * Decoding the PNG files of a skin is a large part of the UI startup
+ * time. Instead, the 32-bit ARGB pixels of each image are stored in a
+ * file of the cache directory, named after a hash of the content of the
+ * PNG file, so that the next runs can simply map them into memory.
+ */
+
+/* Describes a memory mapping of a cache file. */
+typedef struct SkinPixelCacheMapping {
+    void*   base;
+    size_t  size;
+} SkinPixelCacheMapping;
+
+/* Return the cache key of an image file whose content is the |size|
+ * bytes at |data|. */
+extern uint64_t skin_pixel_cache_key(const void* data, size_t size);
+
+/* Look for the image with cache |key| in |cache_dir|. On success, set
+ * |*w|, |*h| and |*mapping|, and return the address of its read-only
+ * pixels, which remain valid until skin_pixel_cache_unmap(mapping) is
+ * called. Return NULL if the image isn't in the cache.
+ */
+extern const uint32_t* skin_pixel_cache_find(const char* cache_dir,
+                                             uint64_t key,
+                                             unsigned* w,
+                                             unsigned* h,
+                                             SkinPixelCacheMapping* mapping);
+
+/* Store the |w| x |h| ARGB |pixels| of the image with cache |key| into
+ * |cache_dir|. The file only appears once completely written, so that
+ * concurrent emulator instances never see partial images.
+ * Return 0 on success, -1 otherwise.
+ */
+extern int skin_pixel_cache_store(const char* cache_dir,
+                                  uint64_t key,
+                                  unsigned w,
+                                  unsigned h,
+                                  const uint32_t* pixels);
+
+/* Release a mapping returned by skin_pixel_cache_find(). */
+extern void skin_pixel_cache_unmap(SkinPixelCacheMapping* mapping);
+
+ANDROID_END_HEADER
+
+#endif /* _ANDROID_SKIN_PIXEL_CACHE_H */
@@ -0,0 +1,97 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+#include "android/skin/pixel-cache.h"
+
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+namespace android_skin {
+
+using android::base::String;
+using android::base::TestTempDir;
+
+TEST(SkinPixelCache, Key) {
+    const char kData1[] = "some PNG data";
+    const char kData2[] = "some PNG datA";
+    uint64_t key1 = skin_pixel_cache_key(kData1, sizeof(kData1));
+    EXPECT_EQ(key1, skin_pixel_cache_key(kData1, sizeof(kData1)));
+    EXPECT_NE(key1, skin_pixel_cache_key(kData2, sizeof(kData2)));
+    EXPECT_NE(key1, skin_pixel_cache_key(kData1, sizeof(kData1) - 1));
+}
+
+TEST(SkinPixelCache, StoreAndFind) {
+    TestTempDir tempDir("SkinPixelCacheTest");
+    ASSERT_TRUE(tempDir.path());
+
+    const unsigned kWidth = 3;
+    const unsigned kHeight = 2;
+    uint32_t pixels[kWidth * kHeight];
+    for (unsigned n = 0; n < kWidth * kHeight; ++n) {
+        pixels[n] = 0xff000000U + n * 0x010203U;
+    }
+
+    SkinPixelCacheMapping mapping = { NULL, 0 };
+    unsigned w = 0, h = 0;
+    EXPECT_FALSE(skin_pixel_cache_find(tempDir.path(), 1234, &w, &h,
+                                       &mapping));
+
+    ASSERT_EQ(0, skin_pixel_cache_store(tempDir.path(), 1234, kWidth, kHeight,
+                                        pixels));
+
+    // Another key must not match.
+    EXPECT_FALSE(skin_pixel_cache_find(tempDir.path(), 1235, &w, &h,
+                                       &mapping));
+
+    const uint32_t* cached = skin_pixel_cache_find(tempDir.path(), 1234,
+                                                   &w, &h, &mapping);
+    ASSERT_TRUE(cached);
+    EXPECT_TRUE(mapping.base);
+    EXPECT_EQ(kWidth, w);
+    EXPECT_EQ(kHeight, h);
+    for (unsigned n = 0; n < kWidth * kHeight; ++n) {
+        EXPECT_EQ(pixels[n], cached[n]) << "pixel #" << n;
+    }
+    skin_pixel_cache_unmap(&mapping);
+    EXPECT_FALSE(mapping.base);
+}
+
+TEST(SkinPixelCache, IgnoresTruncatedFiles) {
+    TestTempDir tempDir("SkinPixelCacheTest");
+    ASSERT_TRUE(tempDir.path());
+
+    uint32_t pixels[16] = {};
+    ASSERT_EQ(0, skin_pixel_cache_store(tempDir.path(), 0x123456789abcdefULL,
+                                        4, 4, pixels));
+
+    // Only keep the header of the file.
+    String path = tempDir.makeSubPath("0123456789abcdef.argb");
+    FILE* file = ::fopen(path.c_str(), "rb");
+    ASSERT_TRUE(file);
+    char header[32];
+    ASSERT_EQ(1U, ::fread(header, sizeof(header), 1, file));
+    ::fclose(file);
+    file = ::fopen(path.c_str(), "wb");
+    ASSERT_TRUE(file);
+    ASSERT_EQ(1U, ::fwrite(header, sizeof(header), 1, file));
+    ::fclose(file);
+
+    SkinPixelCacheMapping mapping = { NULL, 0 };
+    unsigned w = 0, h = 0;
+    EXPECT_FALSE(skin_pixel_cache_find(tempDir.path(), 0x123456789abcdefULL,
+                                       &w, &h, &mapping));
+}
+
+}  // namespace android_skin
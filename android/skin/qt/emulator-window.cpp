@@ -41,11 +41,25 @@
 
 static EmulatorWindow *instance;
 
+GpuDisplayWidget::GpuDisplayWidget(QWidget *parent) :
+        QWidget(parent)
+{
+    // The GPU emulation needs a native window of its own, that Qt neither
+    // paints nor clears. Input still goes to the emulator window.
+    setAttribute(Qt::WA_NativeWindow);
+    setAttribute(Qt::WA_PaintOnScreen);
+    setAttribute(Qt::WA_NoSystemBackground);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setFocusPolicy(Qt::NoFocus);
+}
+
 EmulatorWindow::EmulatorWindow(QWidget *parent) :
         QFrame(parent)
 {
     instance = this;
     backing_surface = NULL;
+    gpu_widget = NULL;
     tool_window = new ToolWindow(this);
 
     QObject::connect(this, &EmulatorWindow::blit, this, &EmulatorWindow::slot_blit);
@@ -56,6 +70,8 @@ EmulatorWindow::EmulatorWindow(QWidget *parent) :
     QObject::connect(this, &EmulatorWindow::getScreenDimensions, this, &EmulatorWindow::slot_getScreenDimensions);
     QObject::connect(this, &EmulatorWindow::getWindowId, this, &EmulatorWindow::slot_getWindowId);
     QObject::connect(this, &EmulatorWindow::getWindowPos, this, &EmulatorWindow::slot_getWindowPos);
+    QObject::connect(this, &EmulatorWindow::hideGpuWindow, this, &EmulatorWindow::slot_hideGpuWindow);
+    QObject::connect(this, &EmulatorWindow::hideWindow, this, &EmulatorWindow::slot_hideWindow);
     QObject::connect(this, &EmulatorWindow::isWindowFullyVisible, this, &EmulatorWindow::slot_isWindowFullyVisible);
     QObject::connect(this, &EmulatorWindow::pollEvent, this, &EmulatorWindow::slot_pollEvent);
     QObject::connect(this, &EmulatorWindow::queueEvent, this, &EmulatorWindow::slot_queueEvent);
@@ -65,6 +81,7 @@ EmulatorWindow::EmulatorWindow(QWidget *parent) :
     QObject::connect(this, &EmulatorWindow::setWindowIcon, this, &EmulatorWindow::slot_setWindowIcon);
     QObject::connect(this, &EmulatorWindow::setWindowPos, this, &EmulatorWindow::slot_setWindowPos);
     QObject::connect(this, &EmulatorWindow::setTitle, this, &EmulatorWindow::slot_setWindowTitle);
+    QObject::connect(this, &EmulatorWindow::showGpuWindow, this, &EmulatorWindow::slot_showGpuWindow);
     QObject::connect(this, &EmulatorWindow::showWindow, this, &EmulatorWindow::slot_showWindow);
     QObject::connect(QApplication::instance(), &QCoreApplication::aboutToQuit, this, &EmulatorWindow::slot_clearInstance);
 }
@@ -110,12 +127,22 @@ void EmulatorWindow::mouseReleaseEvent(QMouseEvent *event)
     handleEvent(kEventMouseButtonUp, event);
 }
 
-void EmulatorWindow::paintEvent(QPaintEvent *)
+void EmulatorWindow::paintEvent(QPaintEvent *event)
 {
     if (backing_surface) {
+        // Only scale the parts of the backing bitmap that cover the area
+        // to repaint, instead of the whole bitmap on every update. The
+        // region can be made of several disjoint bands of the display.
         QPainter painter(this);
-        QRect r(0, 0, backing_surface->w, backing_surface->h);
-        painter.drawImage(r, *backing_surface->bitmap);
+        qreal sx = (qreal)backing_surface->original_w / backing_surface->w;
+        qreal sy = (qreal)backing_surface->original_h / backing_surface->h;
+        const QVector<QRect> rects = event->region().rects();
+        for (int i = 0; i < rects.size(); i++) {
+            const QRect &r = rects[i];
+            QRectF source(r.x() * sx, r.y() * sy,
+                          r.width() * sx, r.height() * sy);
+            painter.drawImage(QRectF(r), *backing_surface->bitmap, source);
+        }
     } else {
         D("Painting emulator window, but no backing bitmap");
     }
@@ -218,6 +245,21 @@ void EmulatorWindow::slot_getWindowPos(int *xx, int *yy, QSemaphore *semaphore)
     if (semaphore != NULL) semaphore->release();
 }
 
+void EmulatorWindow::slot_hideGpuWindow(QSemaphore *semaphore)
+{
+    if (gpu_widget) {
+        gpu_widget->hide();
+    }
+    if (semaphore != NULL) semaphore->release();
+}
+
+void EmulatorWindow::slot_hideWindow(QSemaphore *semaphore)
+{
+    tool_window->hide();
+    hide();
+    if (semaphore != NULL) semaphore->release();
+}
+
 void EmulatorWindow::slot_isWindowFullyVisible(bool *out_value, QSemaphore *semaphore)
 {
     *out_value = ((QApplication*)QApplication::instance())->desktop()->screenGeometry().contains(geometry());
@@ -260,11 +302,15 @@ void EmulatorWindow::slot_requestClose(QSemaphore *semaphore)
 
 void EmulatorWindow::slot_requestUpdate(const QRect *rect, QSemaphore *semaphore)
 {
-    QRect r(rect->x()  *backing_surface->w / backing_surface->original_w,
-            rect->y()  *backing_surface->h / backing_surface->original_h,
-            rect->width()  *backing_surface->w / backing_surface->original_w,
-            rect->height()  *backing_surface->h / backing_surface->original_h);
-    update(r);
+    // Round the scaled rectangle outwards, so that partial repaints
+    // always cover all the window pixels touched by |rect|.
+    int w = backing_surface->w, ow = backing_surface->original_w;
+    int h = backing_surface->h, oh = backing_surface->original_h;
+    int left = rect->x() * w / ow;
+    int top = rect->y() * h / oh;
+    int right = ((rect->x() + rect->width()) * w + ow - 1) / ow;
+    int bottom = ((rect->y() + rect->height()) * h + oh - 1) / oh;
+    update(QRect(left, top, right - left, bottom - top));
     if (semaphore != NULL) semaphore->release();
 }
 
@@ -283,6 +329,20 @@ void EmulatorWindow::slot_setWindowIcon(const unsigned char *, int, QSemaphore *
     if (semaphore != NULL) semaphore->release();
 }
 
+void EmulatorWindow::slot_showGpuWindow(const QRect *rect, WId *out_id, QSemaphore *semaphore)
+{
+    if (!gpu_widget) {
+        gpu_widget = new GpuDisplayWidget(this);
+    }
+    gpu_widget->setGeometry(*rect);
+    gpu_widget->show();
+    // Unlike slot_getWindowId(), return the widget's own window, i.e. its
+    // NSView on OS X, which is what the GPU emulation renders into.
+    *out_id = gpu_widget->winId();
+    D("GPU window ID is %lx", *out_id);
+    if (semaphore != NULL) semaphore->release();
+}
+
 void EmulatorWindow::slot_setWindowTitle(const QString *title, QSemaphore *semaphore)
 {
     setWindowTitle(*title);
@@ -292,6 +352,12 @@ void EmulatorWindow::slot_setWindowTitle(const QString *title, QSemaphore *semap
 void EmulatorWindow::slot_showWindow(SkinSurface* surface, const QRect* rect, int is_fullscreen, QSemaphore *semaphore)
 {
     backing_surface = surface;
+    // The window content is opaque, so use a format that lets QPainter
+    // take its fast path when scaling it in paintEvent(), instead of
+    // blending each pixel.
+    if (surface->bitmap->format() != QImage::Format_RGB32) {
+        *surface->bitmap = surface->bitmap->convertToFormat(QImage::Format_RGB32);
+    }
     if (is_fullscreen) {
         showFullScreen();
     } else {
@@ -43,6 +43,18 @@ private:
     char **argv;
 };
 
+// A native child widget covering the emulated display, that the GPU
+// emulation renders into directly through its own GL context, see
+// skin_winsys_get_gpu_window_handle(). Qt never paints it, so there is no
+// readback, no QImage conversion, and nothing to overwrite the GL content
+// when the window is composited.
+class GpuDisplayWidget : public QWidget
+{
+public:
+    explicit GpuDisplayWidget(QWidget *parent);
+    QPaintEngine *paintEngine() const Q_DECL_OVERRIDE { return NULL; }
+};
+
 class EmulatorWindow : public QFrame
 {
     Q_OBJECT
@@ -84,6 +96,8 @@ signals:
     void getScreenDimensions(QRect *out_rect, QSemaphore *semaphore = NULL);
     void getWindowId(WId *out_id, QSemaphore *semaphore = NULL);
     void getWindowPos(int *x, int *y, QSemaphore *semaphore = NULL);
+    void hideGpuWindow(QSemaphore *semaphore = NULL);
+    void hideWindow(QSemaphore *semaphore = NULL);
     void isWindowFullyVisible(bool *out_value, QSemaphore *semaphore = NULL);
     void pollEvent(SkinEvent *event, bool *hasEvent, QSemaphore *semaphore = NULL);
     void queueEvent(SkinEvent *event, QSemaphore *semaphore = NULL);
@@ -93,6 +107,7 @@ signals:
     void setWindowIcon(const unsigned char *data, int size, QSemaphore *semaphore = NULL);
     void setWindowPos(int x, int y, QSemaphore *semaphore = NULL);
     void setTitle(const QString *title, QSemaphore *semaphore = NULL);
+    void showGpuWindow(const QRect *rect, WId *out_id, QSemaphore *semaphore = NULL);
     void showWindow(SkinSurface* surface, const QRect* rect, int is_fullscreen, QSemaphore *semaphore = NULL);
 private slots:
     void slot_blit(QImage *src, QRect *srcRect, QImage *dst, QPoint *dstPos, QPainter::CompositionMode *op, QSemaphore *semaphore = NULL);
@@ -104,6 +119,8 @@ private slots:
     void slot_getScreenDimensions(QRect *out_rect, QSemaphore *semaphore = NULL);
     void slot_getWindowId(WId *out_id, QSemaphore *semaphore = NULL);
     void slot_getWindowPos(int *x, int *y, QSemaphore *semaphore = NULL);
+    void slot_hideGpuWindow(QSemaphore *semaphore = NULL);
+    void slot_hideWindow(QSemaphore *semaphore = NULL);
     void slot_isWindowFullyVisible(bool *out_value, QSemaphore *semaphore = NULL);
     void slot_pollEvent(SkinEvent *event, bool *hasEvent, QSemaphore *semaphore = NULL);
     void slot_queueEvent(SkinEvent *event, QSemaphore *semaphore = NULL);
@@ -113,6 +130,7 @@ private slots:
     void slot_setWindowIcon(const unsigned char *data, int size, QSemaphore *semaphore = NULL);
     void slot_setWindowPos(int x, int y, QSemaphore *semaphore = NULL);
     void slot_setWindowTitle(const QString *title, QSemaphore *semaphore = NULL);
+    void slot_showGpuWindow(const QRect *rect, WId *out_id, QSemaphore *semaphore = NULL);
     void slot_showWindow(SkinSurface* surface, const QRect* rect, int is_fullscreen, QSemaphore *semaphore = NULL);
 
     /*
@@ -152,6 +170,7 @@ private:
     void simulateKeyPress(int keyCode, int modifiers);
 
     SkinSurface *backing_surface;
+    GpuDisplayWidget *gpu_widget;
     QQueue<SkinEvent*> event_queue;
     ToolWindow *tool_window;
 };
@@ -126,6 +126,49 @@ extern void *skin_winsys_get_window_handle(void)
     return (void*)handle;
 }
 
+extern void *skin_winsys_get_gpu_window_handle(const SkinRect *rect)
+{
+    D("skin_winsys_get_gpu_window_handle");
+    WId handle;
+    QSemaphore semaphore;
+    EmulatorWindow *window = EmulatorWindow::getInstance();
+    if (window == NULL) {
+        D("%s: Could not get window handle", __FUNCTION__);
+        return NULL;
+    }
+    QRect qrect(rect->pos.x, rect->pos.y, rect->size.w, rect->size.h);
+    window->showGpuWindow(&qrect, &handle, &semaphore);
+    semaphore.acquire();
+    D("%s: result = 0x%p", __FUNCTION__, (void*)handle);
+    return (void*)handle;
+}
+
+extern void skin_winsys_release_gpu_window(void)
+{
+    D("skin_winsys_release_gpu_window");
+    QSemaphore semaphore;
+    EmulatorWindow *window = EmulatorWindow::getInstance();
+    if (window == NULL) {
+        D("%s: Could not get window handle", __FUNCTION__);
+        return;
+    }
+    window->hideGpuWindow(&semaphore);
+    semaphore.acquire();
+}
+
+extern void skin_winsys_hide_window(void)
+{
+    D("skin_winsys_hide_window");
+    QSemaphore semaphore;
+    EmulatorWindow *window = EmulatorWindow::getInstance();
+    if (window == NULL) {
+        D("%s: Could not get window handle", __FUNCTION__);
+        return;
+    }
+    window->hideWindow(&semaphore);
+    semaphore.acquire();
+}
+
 extern void skin_winsys_get_window_pos(int *x, int *y)
 {
     D("skin_winsys_get_window_pos");
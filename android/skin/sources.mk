@@ -15,6 +15,8 @@ ANDROID_SKIN_SOURCES := \
     android/skin/keycode.c \
     android/skin/keycode-buffer.c \
     android/skin/keyset.c \
+    android/skin/lcd-brightness.c \
+    android/skin/pixel-cache.c \
     android/skin/file.c \
     android/skin/window.c \
     android/skin/resource.c \
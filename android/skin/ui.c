@@ -470,9 +470,13 @@ void skin_ui_update_display(SkinUI* ui, int x, int y, int w, int h) {
     }
 }
 
-void skin_ui_update_gpu_frame(SkinUI* ui, int w, int h, const void* pixels) {
+void skin_ui_update_gpu_frame(SkinUI* ui,
+                              int w,
+                              int h,
+                              const void* pixels,
+                              const SkinRect* damage) {
     if (ui->window) {
-        skin_window_update_gpu_frame(ui->window, w, h, pixels);
+        skin_window_update_gpu_frame(ui->window, w, h, pixels, damage);
     }
 }
 
@@ -117,7 +117,14 @@ void skin_ui_set_scale(SkinUI* ui, double scale);
 
 void skin_ui_update_display(SkinUI* ui, int x, int y, int w, int h);
 
-void skin_ui_update_gpu_frame(SkinUI* ui, int w, int h, const void* pixels);
+// Update the display with a new GPU frame of |w| x |h| pixels. |damage| is
+// the rectangle that changed since the previous frame, or NULL to indicate
+// the whole frame.
+void skin_ui_update_gpu_frame(SkinUI* ui,
+                              int w,
+                              int h,
+                              const void* pixels,
+                              const SkinRect* damage);
 
 // Return the current SkinLayout used by the user interface.
 struct SkinLayout* skin_ui_get_current_layout(SkinUI* ui);
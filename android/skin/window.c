@@ -14,6 +14,7 @@
 #include "android/skin/charmap.h"
 #include "android/skin/event.h"
 #include "android/skin/image.h"
+#include "android/skin/lcd-brightness.h"
 #include "android/skin/scaler.h"
 #include "android/skin/winsys.h"
 #include "android/utils/debug.h"
@@ -28,11 +29,6 @@
 /* when shrinking, we reduce the pixel ratio by this fixed amount */
 #define  SHRINK_SCALE  0.6
 
-/* maximum value of LCD brighness */
-#define  LCD_BRIGHTNESS_MIN      0
-#define  LCD_BRIGHTNESS_DEFAULT  128
-#define  LCD_BRIGHTNESS_MAX      255
-
 typedef struct Background {
     SkinImage*   image;
     SkinRect     rect;
@@ -259,124 +255,9 @@ static void dotmatrix_dither_argb32(unsigned char* pixels,
 
 #endif /* DOT_MATRIX */
 
-/* technical note about the lightness emulation
- *
- * we try to emulate something that looks like the Dream's
- * non-linear LCD lightness, without going too dark or bright.
- *
- * the default lightness is around 105 (about 40%) and we prefer
- * to keep full RGB colors at that setting, to not alleviate
- * developers who will not understand why the emulator's colors
- * look slightly too dark.
- *
- * we also want to implement a 'bright' mode by de-saturating
- * colors towards bright white.
- *
- * All of this leads to the implementation below that looks like
- * the following:
- *
- * if (level == MIN)
- *     screen is off
- *
- * if (level > MIN && level < LOW)
- *     interpolate towards black, with
- *     MINALPHA = 0.2
- *     alpha = MINALPHA + (1-MINALPHA)*(level-MIN)/(LOW-MIN)
- *
- * if (level >= LOW && level <= HIGH)
- *     keep full RGB colors
- *
- * if (level > HIGH)
- *     interpolate towards bright white, with
- *     MAXALPHA = 0.6
- *     alpha = MAXALPHA*(level-HIGH)/(MAX-HIGH)
- *
- * we probably want some sort of power law instead of interpolating
- * linearly, but frankly, this is sufficient for most uses.
- */
-
-#define  LCD_BRIGHTNESS_LOW   80
-#define  LCD_BRIGHTNESS_HIGH  180
-
-#define  LCD_ALPHA_LOW_MIN      0.2
-#define  LCD_ALPHA_HIGH_MAX     0.6
-
-/* treat as special value to turn screen off */
-#define  LCD_BRIGHTNESS_OFF   LCD_BRIGHTNESS_MIN
-
-static void lcd_brightness_argb32(uint32_t* pixels,
-                                  int w,
-                                  int h,
-                                  int pitch,
-                                  int brightness)
-{
-    const unsigned  b_min  = LCD_BRIGHTNESS_MIN;
-    const unsigned  b_max  = LCD_BRIGHTNESS_MAX;
-    const unsigned  b_low  = LCD_BRIGHTNESS_LOW;
-    const unsigned  b_high = LCD_BRIGHTNESS_HIGH;
-
-    unsigned        alpha = brightness;
-
-    if (alpha <= b_min)
-        alpha = b_min;
-    else if (alpha > b_max)
-        alpha = b_max;
-
-    if (alpha < b_low)
-    {
-        const unsigned  alpha_min   = (255 * LCD_ALPHA_LOW_MIN);
-        const unsigned  alpha_range = (255 - alpha_min);
-
-        alpha = alpha_min + ((alpha - b_min) * alpha_range) / (b_low - b_min);
-
-        for (; h > 0; h--) {
-            unsigned* line = (unsigned*) pixels;
-            int nn = 0;
-
-            DUFF4(w, {
-                unsigned c = line[nn];
-                unsigned ag = (c >> 8) & 0x00ff00ff;
-                unsigned rb = (c)      & 0x00ff00ff;
-
-                ag = (ag * alpha)        & 0xff00ff00;
-                rb = ((rb * alpha) >> 8) & 0x00ff00ff;
-
-                line[nn] = (unsigned)(ag | rb);
-                nn++;
-            });
-            pixels += (pitch / sizeof(uint32_t));
-        }
-    }
-    else if (alpha > LCD_BRIGHTNESS_HIGH) /* 'superluminous' mode */
-    {
-        const unsigned  alpha_max   = (255 * LCD_ALPHA_HIGH_MAX);
-        const unsigned  alpha_range = (255 - alpha_max);
-        unsigned ialpha;
-
-        alpha  = ((alpha - b_high) * alpha_range) / (b_max - b_high);
-        ialpha = 255 - alpha;
-
-        for ( ; h > 0; h-- ) {
-            unsigned* line = (unsigned*) pixels;
-            int nn = 0;
-
-            DUFF4(w, {
-                unsigned c = line[nn];
-                unsigned ag = (c >> 8) & 0x00ff00ff;
-                unsigned rb = (c)      & 0x00ff00ff;
-
-                /* interpolate towards bright white, i.e. 0x00ffffff */
-                ag = ((ag*ialpha + 0x00ff00ff*alpha)) & 0xff00ff00;
-                rb = ((rb*ialpha + 0x00ff00ff*alpha) >> 8) & 0x00ff00ff;
-
-                line[nn] = (unsigned)(ag | rb);
-                nn++;
-            });
-            pixels += (pitch / sizeof(uint32_t));
-        }
-    }
-}
-
+// Convert the content of the emulated framebuffer to ARGB32 pixels, taking
+// care of the display rotation and brightness. Only the |dst_rect| area of
+// the display surface is converted, into |dst_pixels|.
 static void adisplay_update_surface_pixels_16(ADisplay* disp,
                                               SkinRect* dst_rect,
                                               uint8_t* dst_pixels,
@@ -390,26 +271,18 @@ static void adisplay_update_surface_pixels_16(ADisplay* disp,
     int           src_pitch = src_w * 2;
     uint8_t*      src_line  = (uint8_t*)disp->data;
     uint8_t*      dst_line  = dst_pixels;
-    int           yy, xx;
+    int           yy;
 
     switch ( disp->rotation & 3 )
     {
     case SKIN_ROTATION_0:
+        // Source lines are contiguous, convert them and apply the
+        // brightness in a single vectorized pass.
         src_line += (x * 2) + (y * src_pitch);
-
-        for (yy = h; yy > 0; yy--) {
-            uint32_t* dst = (uint32_t*)dst_line;
-            uint16_t* src = (uint16_t*)src_line;
-
-            xx = 0;
-            DUFF4(w, {
-                dst[xx] = rgb565_to_argb32(src[xx]);
-                xx++;
-            });
-            src_line += src_pitch;
-            dst_line += dst_pitch;
-        }
-        break;
+        skin_lcd_rgb565_to_argb32((uint32_t*)dst_line, dst_pitch,
+                                  (const uint16_t*)src_line, src_pitch,
+                                  w, h, disp->brightness);
+        return;
 
     case SKIN_ROTATION_90:
         src_line += (y * 2) + ((src_h - x - 1) * src_pitch);
@@ -461,6 +334,9 @@ static void adisplay_update_surface_pixels_16(ADisplay* disp,
             dst_line += dst_pitch;
         }
     }
+
+    skin_lcd_brightness_argb32((uint32_t*)dst_pixels, w, h, dst_pitch,
+                               disp->brightness);
 }
 
 static void adisplay_update_surface_pixels_32(ADisplay* disp,
@@ -549,6 +425,9 @@ static void adisplay_update_surface_pixels_32(ADisplay* disp,
             dst_line += dst_pitch;
         }
     }
+
+    skin_lcd_brightness_argb32((uint32_t*)dst_pixels, w, h, dst_pitch,
+                               disp->brightness);
 }
 
 // Update the content of the display surface from the framebuffer content.
@@ -576,7 +455,7 @@ static void adisplay_update_surface(ADisplay* disp,
         h -= delta;
     }
     if (y < 0) {
-        h += delta;
+        h += y;
         y = 0;
     }
     if (w <= 0 || h <= 0) {
@@ -584,10 +463,10 @@ static void adisplay_update_surface(ADisplay* disp,
     }
 
     // Allocate a temporary buffer to get the potentially rotated / converted
-    // content.
-    int sz = disp->datasize.h > disp->datasize.w ? disp->datasize.h : disp->datasize.w;
-    int dst_pitch = 4 * sz;
-    uint8_t* dst_pixels = calloc(sz, dst_pitch);
+    // content. Only the updated rectangle is converted, so it doesn't need
+    // to be larger than that.
+    int dst_pitch = 4 * w;
+    uint8_t* dst_pixels = malloc(h * dst_pitch);
 
     SkinRect dst_r = {
         .pos.x = x,
@@ -610,13 +489,6 @@ static void adisplay_update_surface(ADisplay* disp,
         }
     }
 
-    // Apply brightness modulation.
-    lcd_brightness_argb32((uint32_t*)dst_pixels,
-                          disp->datasize.w,
-                          disp->datasize.h,
-                          dst_pitch,
-                          disp->brightness);
-
     // Update the display surface content
     skin_surface_upload(disp->surface, &dst_r, dst_pixels, dst_pitch);
     free(dst_pixels);
@@ -1197,6 +1069,7 @@ skin_window_hide_opengles( SkinWindow* window )
 {
     window->win_funcs->opengles_hide();
     //android_hideOpenglesWindow();
+    skin_winsys_release_gpu_window();
 }
 
 /* Show the OpenGL ES framebuffer window */
@@ -1206,10 +1079,23 @@ skin_window_show_opengles( SkinWindow* window )
     {
         ADisplay* disp = window->layout.displays;
         SkinRect drect = disp->rect;
-        void* winhandle = skin_winsys_get_window_handle();
+        void* winhandle;
 
         skin_surface_get_scaled_rect(window->surface, &drect, &drect);
 
+        /* Render straight into a window of the UI toolkit if it provides
+         * one, rather than overlaying a sub-window on top of its own. */
+        winhandle = skin_winsys_get_gpu_window_handle(&drect);
+        if (winhandle &&
+            window->win_funcs->opengles_attach(winhandle,
+                                               drect.size.w,
+                                               drect.size.h,
+                                               disp->rotation * -90.) == 0) {
+            return;
+        }
+        skin_winsys_release_gpu_window();
+
+        winhandle = skin_winsys_get_window_handle();
         window->win_funcs->opengles_show(winhandle,
                                          drect.pos.x,
                                          drect.pos.y,
@@ -1746,7 +1632,8 @@ skin_window_update_display( SkinWindow*  window, int  x, int  y, int  w, int  h
 void skin_window_update_gpu_frame(SkinWindow* window,
                                   int w,
                                   int h,
-                                  const void* pixels) {
+                                  const void* pixels,
+                                  const SkinRect* damage) {
     if (!window) {
         return;
     }
@@ -1757,24 +1644,35 @@ void skin_window_update_gpu_frame(SkinWindow* window,
         return;
     }
 
+    // Only the damaged area needs to be converted and redrawn, unless
+    // this is the first GPU frame.
+    SkinRect r = { .pos.x = 0, .pos.y = 0, .size.w = w, .size.h = h };
     if (!disp->gpu_frame) {
         disp->gpu_frame = calloc(w * 4, h);
         if (!disp->gpu_frame) {
             return;
         }
+    } else if (damage) {
+        if (!skin_rect_intersect(&r, &r, damage)) {
+            return;
+        }
     }
     // Convert from GL_RGBA to 32-bit ARGB.
     {
-        const uint8_t* src = pixels;
-        uint32_t* dst = (uint32_t*)disp->gpu_frame;
-        uint32_t* dst_end = dst + w * h;
-        for (; dst < dst_end; src += 4, dst += 1) {
-            dst[0] = ((uint32_t)src[3] << 24) |
-                     ((uint32_t)src[0] << 16) |
-                     ((uint32_t)src[1] << 8) |
-                      (uint32_t)src[2];
+        int yy;
+        for (yy = r.pos.y; yy < r.pos.y + r.size.h; yy++) {
+            const uint8_t* src =
+                    (const uint8_t*)pixels + (yy * w + r.pos.x) * 4;
+            uint32_t* dst = (uint32_t*)disp->gpu_frame + yy * w + r.pos.x;
+            uint32_t* dst_end = dst + r.size.w;
+            for (; dst < dst_end; src += 4, dst += 1) {
+                dst[0] = ((uint32_t)src[3] << 24) |
+                         ((uint32_t)src[0] << 16) |
+                         ((uint32_t)src[1] << 8) |
+                          (uint32_t)src[2];
+            }
         }
     }
 
-    skin_window_update_display(window, 0, 0, w, h);
+    skin_window_update_display(window, r.pos.x, r.pos.y, r.size.w, r.size.h);
 }
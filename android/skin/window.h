@@ -28,6 +28,12 @@ typedef struct SkinWindowFuncs {
                          int width,
                          int height,
                          float rotation_degrees);
+    // Same as opengles_show, but render into |winhandle| itself, a window
+    // returned by skin_winsys_get_gpu_window_handle().
+    int (*opengles_attach)(void* winhandle,
+                           int width,
+                           int height,
+                           float rotation_degrees);
     int (*opengles_hide)(void);
     void (*opengles_redraw)(void);
     void (*opengles_free)(void);
@@ -83,6 +89,10 @@ typedef struct {
 extern void             skin_window_get_display( SkinWindow*  window, ADisplayInfo  *info );
 extern void             skin_window_update_display( SkinWindow*  window, int  x, int  y, int  w, int  h );
 
-extern void skin_window_update_gpu_frame(SkinWindow* window, int w, int h, const void* pixels);
+extern void skin_window_update_gpu_frame(SkinWindow* window,
+                                         int w,
+                                         int h,
+                                         const void* pixels,
+                                         const SkinRect* damage);
 
 #endif /* _SKIN_WINDOW_H */
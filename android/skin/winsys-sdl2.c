@@ -93,6 +93,21 @@ void skin_winsys_set_relative_mouse_mode(bool enabled) {
     SDL_SetRelativeMouseMode(enabled ? SDL_TRUE : SDL_FALSE);
 }
 
+// SDL2 has no child windows, the GPU emulation creates its own sub-window.
+void* skin_winsys_get_gpu_window_handle(const SkinRect* rect) {
+    (void)rect;
+    return NULL;
+}
+
+void skin_winsys_release_gpu_window(void) {
+}
+
+void skin_winsys_hide_window(void) {
+    if (s_window) {
+        SDL_HideWindow(s_window);
+    }
+}
+
 // Return window handle of main UI.
 void* skin_winsys_get_window_handle(void) {
     if (!s_window) {
@@ -29,6 +29,20 @@ void skin_winsys_set_relative_mouse_mode(bool enabled);
 // Return window handle of main UI.
 void* skin_winsys_get_window_handle(void);
 
+// Return the handle of a native child window of the main UI covering |rect|,
+// in window coordinates, that the GPU emulation can render into directly,
+// or NULL if the window system doesn't provide one. The UI never paints
+// over it. Calling this again moves the same window to the new |rect|.
+void* skin_winsys_get_gpu_window_handle(const SkinRect* rect);
+
+// Hide the window returned by skin_winsys_get_gpu_window_handle(), once the
+// GPU emulation no longer renders into it. Does nothing if there is none.
+void skin_winsys_release_gpu_window(void);
+
+// Hide the main window, e.g. while the emulator saves its state on exit,
+// without closing it. Does nothing if there is none.
+void skin_winsys_hide_window(void);
+
 // Return rectangle of current monitor in pixels.
 void skin_winsys_get_monitor_rect(SkinRect* rect);
 
@@ -14,6 +14,7 @@
 #include "android/globals.h"
 #include "android/snaphost-android.h"
 #include "android/utils/debug.h"
+#include "android/utils/probe_cache.h"
 
 #define  E(...)    derror(__VA_ARGS__)
 #define  W(...)    dwarning(__VA_ARGS__)
@@ -83,28 +84,118 @@ _cmp_hw_config(IniFile* current, IniFile* saved)
  * snapshot storage file path, snapshot name, and an 'ini' extension. This
  * way we can track HW configuration for different snapshot names store in
  * different storage files.
+ * The snapshot manifest is stored the same way, with a 'manifest.ini'
+ * extension.
  * Param:
  *  name - Name of the snapshot inside the snapshot storage file.
+ *  ext - Extension of the file.
  * Return:
  *  Path to the HW config backup file on success, or NULL on an error.
  */
 static char*
-_build_hwcfg_path(const char* name)
+_build_hwcfg_path(const char* name, const char* ext)
 {
     const int path_len = strlen(android_hw->disk_snapStorage_path) +
-                         strlen(name) + 6;
+                         strlen(name) + strlen(ext) + 3;
     char* bkp_path = malloc(path_len);
     if (bkp_path == NULL) {
         E("Unable to allocate %d bytes for HW config path!", path_len);
         return NULL;
     }
 
-    snprintf(bkp_path, path_len, "%s.%s.ini",
-             android_hw->disk_snapStorage_path, name);
+    snprintf(bkp_path, path_len, "%s.%s.%s",
+             android_hw->disk_snapStorage_path, name, ext);
 
     return bkp_path;
 }
 
+/* Partition types resolved at startup, see snaphost_set_partition_types. */
+static AndroidPartitionType _partition_types[3];
+
+static const char* const _partition_type_keys[3] = {
+    "partition.system.type",
+    "partition.userdata.type",
+    "partition.cache.type",
+};
+
+/* Returns the path of the system partition image the VM runs from. */
+static const char*
+_system_image_path(void)
+{
+    const char* path = android_hw->disk_systemPartition_initPath;
+    if (path == NULL || *path == '\0') {
+        path = android_hw->disk_systemPartition_path;
+    }
+    return path;
+}
+
+/* Images whose content the guest state saved in a snapshot depends on,
+ * and which the VM doesn't modify. Their identities are stored in the
+ * snapshot manifest. */
+static const char*
+_manifest_image_path(int index)
+{
+    switch (index) {
+    case 0: return android_hw->kernel_path;
+    case 1: return android_hw->disk_ramdisk_path;
+    case 2: return _system_image_path();
+    default: return NULL;
+    }
+}
+
+static const char* const _manifest_image_keys[3] = {
+    "kernel.identity",
+    "ramdisk.identity",
+    "system.identity",
+};
+
+/* Saves the manifest of the snapshot |name|, see snaphost_load_manifest. */
+static void
+_save_manifest(const char* name)
+{
+    char* path = _build_hwcfg_path(name, "manifest.ini");
+    if (path == NULL) {
+        return;
+    }
+
+    IniFile* manifest = iniFile_newFromMemory("", path);
+    if (manifest == NULL) {
+        free(path);
+        return;
+    }
+
+    int n;
+    for (n = 0; n < (int)ARRAY_SIZE(_manifest_image_keys); n++) {
+        const char* image = _manifest_image_path(n);
+        char identity[128];
+        if (image == NULL || *image == '\0' ||
+            probe_cache_file_identity(image, identity, sizeof(identity)) < 0) {
+            /* Without the identity of an image, the manifest can't be
+             * validated, don't leave a stale one behind. */
+            D("Cannot get identity of '%s', not saving snapshot manifest",
+              image ? image : "");
+            iniFile_free(manifest);
+            remove(path);
+            free(path);
+            return;
+        }
+        iniFile_setValue(manifest, _manifest_image_keys[n], identity);
+    }
+    for (n = 0; n < (int)ARRAY_SIZE(_partition_type_keys); n++) {
+        iniFile_setValue(manifest, _partition_type_keys[n],
+                         androidPartitionType_toString(_partition_types[n]));
+    }
+
+    if (!iniFile_saveToFile(manifest, path)) {
+        D("Snapshot manifest has been saved to '%s'", path);
+    } else {
+        W("Unable to save snapshot manifest '%s'. Error: %s",
+          path, strerror(errno));
+    }
+    iniFile_free(manifest);
+    free(path);
+}
+
 int
 snaphost_match_configs(IniFile* hw_ini, const char* name)
 {
@@ -115,7 +206,7 @@ snaphost_match_configs(IniFile* hw_ini, const char* name)
     }
 
     /* Build path to the HW config for the loading VM. */
-    char* bkp_path = _build_hwcfg_path(name);
+    char* bkp_path = _build_hwcfg_path(name, "ini");
     if (bkp_path == NULL) {
         return 0;
     }
@@ -153,7 +244,7 @@ snaphost_save_config(const char* name)
     }
 
     /* Build path to the HW config for the saving VM. */
-    char* bkp_path = _build_hwcfg_path(name);
+    char* bkp_path = _build_hwcfg_path(name, "ini");
     if (bkp_path == NULL) {
         return;
     }
@@ -185,4 +276,74 @@ snaphost_save_config(const char* name)
     }
     iniFile_free(hwcfg_bkp);
     free(bkp_path);
+
+    _save_manifest(name);
+}
+
+void
+snaphost_set_partition_types(AndroidPartitionType system_type,
+                             AndroidPartitionType userdata_type,
+                             AndroidPartitionType cache_type)
+{
+    _partition_types[0] = system_type;
+    _partition_types[1] = userdata_type;
+    _partition_types[2] = cache_type;
+}
+
+int
+snaphost_load_manifest(const char* name,
+                       AndroidPartitionType* system_type,
+                       AndroidPartitionType* userdata_type,
+                       AndroidPartitionType* cache_type)
+{
+    if (android_hw->disk_snapStorage_path == NULL ||
+        *android_hw->disk_snapStorage_path == '\0') {
+        return 0;
+    }
+
+    char* path = _build_hwcfg_path(name, "manifest.ini");
+    if (path == NULL) {
+        return 0;
+    }
+    IniFile* manifest = iniFile_newFromFile(path);
+    if (manifest == NULL) {
+        D("Missing snapshot manifest '%s'", path);
+        free(path);
+        return 0;
+    }
+    free(path);
+
+    int ok = 1;
+    int n;
+    for (n = 0; n < (int)ARRAY_SIZE(_manifest_image_keys) && ok; n++) {
+        const char* image = _manifest_image_path(n);
+        const char* saved = iniFile_getValue(manifest, _manifest_image_keys[n]);
+        char identity[128];
+        if (saved == NULL || image == NULL || *image == '\0' ||
+            probe_cache_file_identity(image, identity, sizeof(identity)) < 0 ||
+            strcmp(saved, identity) != 0) {
+            W("%s has changed since snapshot '%s' was saved",
+              image ? image : _manifest_image_keys[n], name);
+            ok = 0;
+        }
+    }
+
+    AndroidPartitionType types[ARRAY_SIZE(_partition_type_keys)];
+    for (n = 0; n < (int)ARRAY_SIZE(_partition_type_keys) && ok; n++) {
+        const char* saved = iniFile_getValue(manifest, _partition_type_keys[n]);
+        types[n] = saved ? androidPartitionType_fromString(saved)
+                         : ANDROID_PARTITION_TYPE_UNKNOWN;
+        /* The system and data partitions always have a known type. */
+        if (n < 2 && types[n] == ANDROID_PARTITION_TYPE_UNKNOWN) {
+            ok = 0;
+        }
+    }
+    iniFile_free(manifest);
+
+    if (ok) {
+        *system_type = types[0];
+        *userdata_type = types[1];
+        *cache_type = types[2];
+    }
+    return ok;
 }
@@ -13,6 +13,7 @@
 #ifndef _ANDROID_SNAPHOST_ANDROID_H_
 #define _ANDROID_SNAPHOST_ANDROID_H_
 
+#include "android/filesystems/partition_types.h"
 #include "android/utils/ini.h"
 
 /* Matches HW config saved for a VM snapshot against the current HW config.
@@ -30,5 +31,29 @@ extern int snaphost_match_configs(IniFile* hw_ini, const char* name);
  */
 extern void snaphost_save_config(const char* name);
 
+/* Records the partition types resolved at startup. snaphost_save_config()
+ * stores them in the manifest of the saved snapshot, along with the
+ * identities of the kernel, ramdisk and system images.
+ */
+extern void snaphost_set_partition_types(AndroidPartitionType system_type,
+                                         AndroidPartitionType userdata_type,
+                                         AndroidPartitionType cache_type);
+
+/* Loads the manifest saved with a VM snapshot, so that starting from the
+ * snapshot can skip probing the ramdisk and partition images: the guest
+ * state in the snapshot was set up for them anyway.
+ * Param:
+ *  name - Name of the snapshot for which the VM is loading.
+ *  system_type, userdata_type, cache_type - Receive the partition types
+ *      resolved when the snapshot was saved.
+ * Return:
+ *  Boolean: 1 if the manifest exists and the kernel, ramdisk and system
+ *  images are the ones it was saved for, or 0 otherwise.
+ */
+extern int snaphost_load_manifest(const char* name,
+                                  AndroidPartitionType* system_type,
+                                  AndroidPartitionType* userdata_type,
+                                  AndroidPartitionType* cache_type);
+
 #endif  /* _ANDROID_SNAPHOST_ANDROID_H_ */
 
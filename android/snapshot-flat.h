@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SNAPSHOT_FLAT_H
+#define ANDROID_SNAPSHOT_FLAT_H
+
+#include <stdint.h>
+
+/*
+ * Layout of the flat snapshot files, an alternative to the internal
+ * snapshots of the qcow2 snapshot storage, selected with the
+ * -snapshot-flat <dir> option. Each snapshot is a <dir>/<name>.snap file
+ * made of:
+ *
+ *   - A SnapshotFlatHeader, padded to SNAPSHOT_FLAT_HEADER_SIZE bytes.
+ *
+ *   - The device-state section, at 'state_offset': a regular VM state
+ *     stream, as read by qemu_loadvm_state(), without the "ram" section.
+ *
+ *   - The RAM section, at 'ram_offset': the raw content of each RAM block,
+ *     at the offset given by its SnapshotFlatRamBlock, a multiple of
+ *     SNAPSHOT_FLAT_ALIGN. Zero pages are left as holes, so the file is
+ *     sparse on file systems that support it.
+ *
+ * RAM blocks can thus be mapped copy-on-write from the file, and tools can
+ * read the header without parsing qcow2 metadata. All the integers are
+ * stored big-endian.
+ */
+
+#define SNAPSHOT_FLAT_MAGIC    (('A' << 24) | ('S' << 16) | ('N' << 8) | 'P')
+#define SNAPSHOT_FLAT_VERSION  1
+
+#define SNAPSHOT_FLAT_HEADER_SIZE  4096
+
+/* Alignment of the RAM blocks in the file. This is larger than the page
+ * size of all supported hosts, so that they can always be mapped. */
+#define SNAPSHOT_FLAT_ALIGN  65536
+
+#define SNAPSHOT_FLAT_MAX_RAM_BLOCKS  12
+
+/* Suffix of the snapshot files */
+#define SNAPSHOT_FLAT_SUFFIX  ".snap"
+
+typedef struct {
+    char      idstr[256];
+    uint64_t  length;
+    uint64_t  offset;
+} SnapshotFlatRamBlock;
+
+typedef struct SnapshotFlatHeader {
+    uint32_t  magic;
+    uint32_t  version;
+    uint32_t  header_size;
+    uint32_t  alignment;
+    char      name[256];
+    uint32_t  date_sec;
+    uint32_t  date_nsec;
+    uint64_t  vm_clock_nsec;
+    uint64_t  state_offset;
+    uint64_t  state_size;
+    uint64_t  ram_offset;
+    uint64_t  ram_size;
+    uint32_t  ram_block_count;
+    uint32_t  reserved;
+    SnapshotFlatRamBlock ram_blocks[SNAPSHOT_FLAT_MAX_RAM_BLOCKS];
+} SnapshotFlatHeader;
+
+#endif /* ANDROID_SNAPSHOT_FLAT_H */
@@ -38,6 +38,7 @@
 #include "android/utils/eintr_wrapper.h"
 #include "android/utils/system.h"
 #include "android/snapshot.h"
+#include "android/snapshot-flat.h"
 
 /* "Magic" sequence of four bytes required by spec to be the first four bytes
  * of any Qcow file.
@@ -303,8 +304,40 @@ snapshot_read_qcow_header( int fd, uint32_t *nb_snapshots, uint64_t *snapshots_o
     be64_to_cpus(snapshots_offset);
 }
 
+/* Prints the information of the flat snapshot file 'fd', whose header is
+ * described in android/snapshot-flat.h, and that doesn't need the qcow2
+ * machinery above.
+ */
+static void
+snapshot_print_flat( int fd, const char *snapstorage )
+{
+    SnapshotFlatHeader header;
+    SnapshotInfo info;
+
+    seek_or_die(fd, 0, SEEK_SET);
+    if (read_or_die(fd, &header, sizeof(header)) != sizeof(header) ||
+        be32_to_cpu(header.version) != SNAPSHOT_FLAT_VERSION) {
+        derror("Unsupported flat snapshot file '%s'.", snapstorage);
+        exit(1);
+    }
+    header.name[sizeof(header.name) - 1] = 0;
+
+    info.id_str = (char *)"-";
+    info.name = header.name;
+    info.date_sec = be32_to_cpu(header.date_sec);
+    info.date_nsec = be32_to_cpu(header.date_nsec);
+    info.vm_clock_nsec = be64_to_cpu(header.vm_clock_nsec);
+    info.vm_state_size = (uint32_t)(be64_to_cpu(header.state_size) +
+                                    be64_to_cpu(header.ram_size));
+
+    printf("Snapshot in file '%s':\n", snapstorage);
+    printf(" %-10s%-20s%7s%20s%15s\n",
+           "ID", "TAG", "VM SIZE", "DATE", "VM CLOCK");
+    snapshot_info_print(&info);
+}
+
 /* Prints a table with information on the snapshots in the qcow2-formatted file
- * 'snapstorage', then exit()s.
+ * 'snapstorage', or on the flat snapshot file 'snapstorage', then exit()s.
  */
 void
 snapshot_print_and_exit( const char *snapstorage )
@@ -316,6 +349,15 @@ snapshot_print_and_exit( const char *snapstorage )
         exit(1);
     }
 
+    uint32_t magic = 0;
+    read_or_die(fd, &magic, sizeof(magic));
+    if (be32_to_cpu(magic) == SNAPSHOT_FLAT_MAGIC) {
+        snapshot_print_flat(fd, snapstorage);
+        close(fd);
+        exit(0);
+    }
+    seek_or_die(fd, 0, SEEK_SET);
+
     /* read snapshot info from file header */
     uint32_t nb_snapshots;
     uint64_t snapshots_offset;
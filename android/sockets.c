@@ -968,6 +968,44 @@ socket_send(int  fd, const void*  buf, int  buflen)
     SOCKET_CALL(send(fd, buf, buflen, 0))
 }
 
+int
+socket_sendv(int  fd, const SocketBuffer*  bufs, int  count)
+{
+    int  n;
+#ifdef _WIN32
+    WSABUF  wbufs[SOCKET_SENDV_MAX];
+    DWORD   sent = 0;
+    int     ret;
+
+    if (count > SOCKET_SENDV_MAX)
+        return set_errno(EINVAL);
+
+    for (n = 0; n < count; n++) {
+        wbufs[n].buf = (char*)bufs[n].base;
+        wbufs[n].len = bufs[n].len;
+    }
+    QSOCKET_CALL(ret, WSASend(fd, wbufs, count, &sent, 0, NULL, NULL));
+    if (ret != 0)
+        return fix_errno();
+    return (int)sent;
+#else
+    struct iovec   iov[SOCKET_SENDV_MAX];
+    struct msghdr  msg;
+
+    if (count > SOCKET_SENDV_MAX)
+        return set_errno(EINVAL);
+
+    for (n = 0; n < count; n++) {
+        iov[n].iov_base = (void*)bufs[n].base;
+        iov[n].iov_len  = bufs[n].len;
+    }
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = count;
+    SOCKET_CALL(sendmsg(fd, &msg, 0))
+#endif
+}
+
 int
 socket_send_oob( int  fd, const void*  buf, int  buflen )
 {
@@ -992,6 +1030,12 @@ socket_recv(int  fd, void*  buf, int  len)
     SOCKET_CALL(recv(fd, buf, len, 0));
 }
 
+int
+socket_recv_peek(int  fd, void*  buf, int  len)
+{
+    SOCKET_CALL(recv(fd, buf, len, MSG_PEEK));
+}
+
 int
 socket_recvfrom(int  fd, void*  buf, int  len, SockAddress*  from)
 {
@@ -11,8 +11,11 @@
 */
 #include "android/user-events.h"
 #include "android/utils/debug.h"
+#include "qemu/timer.h"
 #include "ui/console.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 void
 user_event_keycodes(int *kcodes, int count)
@@ -62,3 +65,115 @@ user_event_generic(int type, int code, int value)
     if (generic_event_callback)
         generic_event_callback(generic_event_opaque, type, code, value);
 }
+
+/* Events closer than this are considered due at the same time, which
+ * also absorbs the timer latency. */
+#define  REPLAY_SLACK_NS    200000LL
+
+/* Upper bound on the number of pending events. */
+#define  REPLAY_MAX_EVENTS  65536
+
+typedef struct {
+    int64_t  due;   /* QEMU_CLOCK_HOST time, in ns */
+    int      type;
+    int      code;
+    int      value;
+} ReplayEvent;
+
+static struct {
+    QEMUTimer*    timer;
+    ReplayEvent*  events;
+    int           first;
+    int           count;
+} _replay;
+
+static void
+_replay_arm(void)
+{
+    if (_replay.first < _replay.count)
+        timer_mod(_replay.timer, _replay.events[_replay.first].due);
+    else
+        timer_del(_replay.timer);
+}
+
+static void
+_replay_tick(void* opaque)
+{
+    int64_t  limit = qemu_clock_get_ns(QEMU_CLOCK_HOST) + REPLAY_SLACK_NS;
+
+    while (_replay.first < _replay.count &&
+           _replay.events[_replay.first].due <= limit) {
+        const ReplayEvent*  e = &_replay.events[_replay.first++];
+
+        user_event_generic(e->type, e->code, e->value);
+    }
+    if (_replay.first == _replay.count)
+        _replay.first = _replay.count = 0;
+    _replay_arm();
+}
+
+int
+user_event_replay(const UserTimedEvent* events, int count)
+{
+    int64_t       now = qemu_clock_get_ns(QEMU_CLOCK_HOST);
+    int           pending = _replay.count - _replay.first;
+    ReplayEvent*  merged;
+    int           nn, i, j;
+
+    for (nn = 1; nn < count; nn++) {
+        if (events[nn].time_us < events[nn - 1].time_us)
+            return -1;
+    }
+    if (count <= 0)
+        return 0;
+    if (pending + count > REPLAY_MAX_EVENTS)
+        return -1;
+
+    if (_replay.timer == NULL)
+        _replay.timer = timer_new_ns(QEMU_CLOCK_HOST, _replay_tick, NULL);
+
+    merged = malloc((pending + count) * sizeof(*merged));
+    if (merged == NULL)
+        return -1;
+
+    /* Both lists are sorted, keep the pending events first on ties. */
+    i = _replay.first;
+    j = 0;
+    for (nn = 0; nn < pending + count; nn++) {
+        int64_t  due = (j < count) ? now + events[j].time_us * 1000LL : 0;
+
+        if (j == count ||
+            (i < _replay.count && _replay.events[i].due <= due)) {
+            merged[nn] = _replay.events[i++];
+        } else {
+            merged[nn].due   = due;
+            merged[nn].type  = events[j].type;
+            merged[nn].code  = events[j].code;
+            merged[nn].value = events[j].value;
+            j++;
+        }
+    }
+
+    free(_replay.events);
+    _replay.events   = merged;
+    _replay.first    = 0;
+    _replay.count    = pending + count;
+
+    /* Send the events that are already due right away. */
+    _replay_tick(NULL);
+    return 0;
+}
+
+void
+user_event_replay_cancel(void)
+{
+    _replay.first = _replay.count = 0;
+    if (_replay.timer)
+        timer_del(_replay.timer);
+}
+
+int
+user_event_replay_pending(void)
+{
+    return _replay.count - _replay.first;
+}
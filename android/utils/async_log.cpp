@@ -0,0 +1,38 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/async_log.h"
+
+#include "android/base/AsyncLog.h"
+
+using android::base::AsyncLog;
+
+void async_log_start(void) {
+    AsyncLog::start();
+}
+
+bool async_log_is_started(void) {
+    return AsyncLog::isStarted();
+}
+
+void async_log_vprintf(FILE* file, const char* format, va_list args) {
+    AsyncLog::get()->vprint(file, format, args);
+}
+
+void async_log_flush(void) {
+    if (AsyncLog::isStarted()) {
+        AsyncLog::get()->flush();
+    }
+}
+
+uint64_t async_log_get_dropped_count(void) {
+    return AsyncLog::isStarted() ? AsyncLog::get()->getDroppedCount() : 0;
+}
@@ -0,0 +1,49 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_ASYNC_LOG_H
+#define ANDROID_UTILS_ASYNC_LOG_H
+
+#include "android/utils/compiler.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+ANDROID_BEGIN_HEADER
+
+// C wrapper around the asynchronous log shared by the whole program, see
+// android/base/AsyncLog.h for more details.
+
+// Start the background log writer. Until this is called,
+// async_log_is_started() returns false and log messages should be written
+// directly to their file.
+void async_log_start(void);
+
+// Return true if async_log_start() was called.
+bool async_log_is_started(void);
+
+// Queue a printf()-like message for |file|. It is written later by the
+// writer thread, or dropped if the calling thread's ring is full.
+void async_log_vprintf(FILE* file, const char* format, va_list args);
+
+// Wait until all the queued messages are written and their files flushed.
+// Call this before closing a file that messages were queued for, or
+// writing to it directly. Does nothing if the log isn't started.
+void async_log_flush(void);
+
+// Return the number of messages dropped so far.
+uint64_t async_log_get_dropped_count(void);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_ASYNC_LOG_H
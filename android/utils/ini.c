@@ -27,16 +27,26 @@
 /* a simple .ini file parser and container for Android
  * no sections support. see android/utils/ini.h for
  * more details on the supported file format.
+ *
+ * The strings of the pairs read from a file are stored in a single
+ * copy of its content, terminated in place, instead of allocating
+ * them one by one. Lookups use a hash table of pair indices, since
+ * reading a hardware configuration queries each of its keys.
  */
 typedef struct {
-    char*  key;
-    char*  value;
+    char*     key;
+    char*     value;
+    unsigned  hash;
+    int       allocated;  /* 1 if 'key' is heap-allocated, 0 if in 'text' */
 } IniPair;
 
 struct IniFile {
     int       numPairs;
     int       maxPairs;
     IniPair*  pairs;
+    char*     text;       /* parsed content, or NULL */
+    int*      index;      /* pair index + 1 for each used slot, or 0 */
+    int       indexSize;  /* number of slots, a power of 2 */
 };
 
 void
@@ -44,11 +54,14 @@ iniFile_free( IniFile*  i )
 {
     int  nn;
     for (nn = 0; nn < i->numPairs; nn++) {
-        AFREE(i->pairs[nn].key);
+        if (i->pairs[nn].allocated)
+            AFREE(i->pairs[nn].key);
         i->pairs[nn].key   = NULL;
         i->pairs[nn].value = NULL;
     }
     AFREE(i->pairs);
+    AFREE(i->text);
+    AFREE(i->index);
     AFREE(i);
 }
 
@@ -61,6 +74,18 @@ iniFile_alloc( void )
     return i;
 }
 
+/* FNV-1a hash of a key */
+static unsigned
+iniKey_hash( const char* key )
+{
+    unsigned  hash = 2166136261U;
+    for ( ; *key; key++) {
+        hash ^= (unsigned char)*key;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
 static void
 iniPair_init( IniPair* pair, const char* key, int keyLen,
                              const char* value, int valueLen )
@@ -72,26 +97,78 @@ iniPair_init( IniPair* pair, const char* key, int keyLen,
     pair->value = pair->key + keyLen + 1;
     memcpy(pair->value, value, valueLen);
     pair->value[valueLen] = 0;
+    pair->allocated = 1;
 }
 
 static void
 iniPair_replaceValue( IniPair* pair, const char* value )
 {
-    char* key      = pair->key;
-    int   keyLen   = strlen(key);
-    int   valueLen = strlen(value);
+    char* key       = pair->key;
+    int   keyLen    = strlen(key);
+    int   valueLen  = strlen(value);
+    int   allocated = pair->allocated;
 
     iniPair_init(pair, key, keyLen, value, valueLen);
-    AFREE(key);
+    if (allocated)
+        AFREE(key);
 }
 
+/* find the index slot of 'key', i.e. the slot that holds its pair, or the
+ * empty slot where it must be inserted */
+static int*
+iniFile_findSlot( IniFile* i, const char* key, unsigned hash )
+{
+    unsigned  mask = (unsigned)i->indexSize - 1;
+    unsigned  nn   = hash & mask;
+
+    for (;;) {
+        int*      slot = &i->index[nn];
+        IniPair*  pair;
+
+        if (*slot == 0)
+            return slot;
+
+        pair = &i->pairs[*slot - 1];
+        if (pair->hash == hash && !strcmp(pair->key, key))
+            return slot;
+
+        nn = (nn + 1) & mask;
+    }
+}
+
+/* add the last pair to the index, growing it to keep it at most half full.
+ * if a key appears several times, lookups return its first pair */
 static void
-iniFile_addPair( IniFile*  i,
-                 const char*  key,   int  keyLen,
-                 const char*  value, int  valueLen )
+iniFile_indexLastPair( IniFile* i )
 {
     IniPair*  pair;
+    int*      slot;
+
+    if (i->numPairs * 2 > i->indexSize) {
+        int  nn;
+        int  newSize = i->indexSize ? i->indexSize * 2 : 64;
+
+        AFREE(i->index);
+        AARRAY_NEW0(i->index, newSize);
+        i->indexSize = newSize;
+        for (nn = 0; nn < i->numPairs - 1; nn++) {
+            IniPair*  pair = &i->pairs[nn];
+            int*      slot = iniFile_findSlot(i, pair->key, pair->hash);
+            if (*slot == 0)
+                *slot = nn + 1;
+        }
+    }
 
+    pair = &i->pairs[i->numPairs - 1];
+    slot = iniFile_findSlot(i, pair->key, pair->hash);
+    if (*slot == 0)
+        *slot = i->numPairs;
+}
+
+/* append a new pair, the caller must set its strings, then index it */
+static IniPair*
+iniFile_appendPair( IniFile*  i )
+{
     if (i->numPairs >= i->maxPairs) {
         int       oldMax = i->maxPairs;
         int       newMax = oldMax + (oldMax >> 1) + 4;
@@ -100,22 +177,29 @@ iniFile_addPair( IniFile*  i,
         i->maxPairs = newMax;
     }
 
-    pair = i->pairs + i->numPairs;
-    iniPair_init(pair, key, keyLen, value, valueLen);
-
     i->numPairs += 1;
+    return i->pairs + i->numPairs - 1;
+}
+
+static void
+iniFile_addPair( IniFile*  i,
+                 const char*  key,   int  keyLen,
+                 const char*  value, int  valueLen )
+{
+    IniPair*  pair = iniFile_appendPair(i);
+
+    iniPair_init(pair, key, keyLen, value, valueLen);
+    pair->hash = iniKey_hash(pair->key);
+    iniFile_indexLastPair(i);
 }
 
 static IniPair*
 iniFile_getPair( IniFile* i, const char* key )
 {
-    if (i && key) {
-        int  nn;
-
-        for (nn = 0; nn < i->numPairs; nn++) {
-            if (!strcmp(i->pairs[nn].key,key))
-                return &i->pairs[nn];
-        }
+    if (i && key && i->numPairs > 0) {
+        int*  slot = iniFile_findSlot(i, key, iniKey_hash(key));
+        if (*slot != 0)
+            return &i->pairs[*slot - 1];
     }
     return NULL;
 }
@@ -140,16 +224,16 @@ iniFile_getPairCount( IniFile*  i )
  *       behaviour that can be the source of strange bugs.
  */
 
-static const char*
-skipSpaces( const char* p )
+static char*
+skipSpaces( char* p )
 {
     while (*p == ' ' || *p == '\t')
         p ++;
     return p;
 }
 
-static const char*
-skipToEOL( const char*  p )
+static char*
+skipToEOL( char*  p )
 {
     while (*p && (*p != '\n' && *p != '\r'))
         p ++;
@@ -176,23 +260,25 @@ isKeyChar( int  c )
     return isKeyStartChar(c) || ((unsigned)(c-'0') < 10) || (c == '.') || (c == '-');
 }
 
-IniFile*
-iniFile_newFromMemory( const char*  text, const char*  fileName )
+/* parse 'text', a zero-terminated string that becomes owned by the new
+ * IniFile, and holds the strings of its pairs once parsed */
+static IniFile*
+iniFile_newFromText( char*  text, const char*  fileName )
 {
-    const char*  p      = text;
+    char*        p      = text;
     IniFile*     ini    = iniFile_alloc();
     int          lineno = 0;
 
-    if (!fileName)
-        fileName = "<memoryFile>";
+    ini->text = text;
 
     D("%s: parsing as .ini file", fileName);
 
     while (*p) {
-        const char*  key;
+        char*        key;
         int          keyLen;
-        const char*  value;
+        char*        value;
         int          valueLen;
+        IniPair*     pair;
 
         lineno += 1;
 
@@ -243,11 +329,20 @@ iniFile_newFromMemory( const char*  text, const char*  fileName )
 
         valueLen = p - value;
 
-        iniFile_addPair(ini, key, keyLen, value, valueLen);
         D("%4d: KEY='%.*s' VALUE='%.*s'", lineno,
           keyLen, key, valueLen, value);
 
+        /* terminate the strings in place, after finding the next line */
         p = skipToEOL(p);
+        key[keyLen]     = 0;
+        value[valueLen] = 0;
+
+        pair            = iniFile_appendPair(ini);
+        pair->key       = key;
+        pair->value     = value;
+        pair->hash      = iniKey_hash(key);
+        pair->allocated = 0;
+        iniFile_indexLastPair(ini);
     }
 
     D("%s: parsing finished", fileName);
@@ -255,6 +350,15 @@ iniFile_newFromMemory( const char*  text, const char*  fileName )
     return ini;
 }
 
+IniFile*
+iniFile_newFromMemory( const char*  text, const char*  fileName )
+{
+    if (!fileName)
+        fileName = "<memoryFile>";
+
+    return iniFile_newFromText(ASTRDUP(text), fileName);
+}
+
 IniFile*
 iniFile_newFromFile( const char*  filepath )
 {
@@ -290,8 +394,7 @@ iniFile_newFromFile( const char*  filepath )
     len = fread(text, 1, size, fp);
     text[len] = 0;
 
-    ini = iniFile_newFromMemory(text, filepath);
-    AFREE(text);
+    ini = iniFile_newFromText(text, filepath);
 
 EXIT:
     fclose(fp);
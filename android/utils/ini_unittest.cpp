@@ -0,0 +1,156 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/ini.h"
+
+#include "android/base/String.h"
+#include "android/base/StringFormat.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+using android::base::String;
+using android::base::StringFormat;
+
+namespace {
+
+class ScopedIniFile {
+public:
+    explicit ScopedIniFile(IniFile* ini) : mIni(ini) {}
+
+    ~ScopedIniFile() {
+        if (mIni) {
+            iniFile_free(mIni);
+        }
+    }
+
+    IniFile* get() const { return mIni; }
+
+private:
+    IniFile* mIni;
+};
+
+// Return the content of an .ini file with |count| pairs, similar to the
+// hardware configuration of an AVD.
+String makeIniText(int count) {
+    String text("# Generated file\n");
+    for (int n = 0; n < count; ++n) {
+        text += StringFormat("hw.property%d.value = value %d\r\n", n, n);
+    }
+    return text;
+}
+
+}  // namespace
+
+TEST(IniFile, ParseFromMemory) {
+    static const char kText[] =
+            "; comment\n"
+            "  # another comment\n"
+            "\n"
+            "key1=value1\n"
+            "key2 = value 2  \r\n"
+            "key.three\t=\tvalue3\n"
+            "key-4=\n"
+            "1invalid=value\n"
+            "missing equal\n"
+            "last=end";
+    ScopedIniFile ini(iniFile_newFromMemory(kText, NULL));
+    ASSERT_TRUE(ini.get());
+    EXPECT_EQ(5, iniFile_getPairCount(ini.get()));
+    EXPECT_STREQ("value1", iniFile_getValue(ini.get(), "key1"));
+    EXPECT_STREQ("value 2", iniFile_getValue(ini.get(), "key2"));
+    EXPECT_STREQ("value3", iniFile_getValue(ini.get(), "key.three"));
+    EXPECT_STREQ("", iniFile_getValue(ini.get(), "key-4"));
+    EXPECT_STREQ("end", iniFile_getValue(ini.get(), "last"));
+    EXPECT_FALSE(iniFile_getValue(ini.get(), "1invalid"));
+    EXPECT_FALSE(iniFile_getValue(ini.get(), "missing"));
+    EXPECT_FALSE(iniFile_getValue(ini.get(), "key"));
+
+    char* key = NULL;
+    char* value = NULL;
+    ASSERT_EQ(0, iniFile_getEntry(ini.get(), 1, &key, &value));
+    EXPECT_STREQ("key2", key);
+    EXPECT_STREQ("value 2", value);
+    free(key);
+    free(value);
+    EXPECT_EQ(-1, iniFile_getEntry(ini.get(), 5, &key, &value));
+}
+
+TEST(IniFile, FirstDefinitionWins) {
+    ScopedIniFile ini(iniFile_newFromMemory("a=1\nb=2\na=3\n", NULL));
+    EXPECT_EQ(3, iniFile_getPairCount(ini.get()));
+    EXPECT_STREQ("1", iniFile_getValue(ini.get(), "a"));
+}
+
+TEST(IniFile, SetValue) {
+    ScopedIniFile ini(iniFile_newFromMemory("a=1\nb=2\n", NULL));
+    iniFile_setValue(ini.get(), "a", "a much longer value");
+    iniFile_setValue(ini.get(), "c", "3");
+    iniFile_setInteger(ini.get(), "b", 42);
+    EXPECT_EQ(3, iniFile_getPairCount(ini.get()));
+    EXPECT_STREQ("a much longer value", iniFile_getValue(ini.get(), "a"));
+    EXPECT_EQ(42, iniFile_getInteger(ini.get(), "b", 0));
+    EXPECT_STREQ("3", iniFile_getValue(ini.get(), "c"));
+}
+
+TEST(IniFile, ManyKeys) {
+    const int kCount = 1000;
+    String text = makeIniText(kCount);
+    ScopedIniFile ini(iniFile_newFromMemory(text.c_str(), NULL));
+    ASSERT_EQ(kCount, iniFile_getPairCount(ini.get()));
+    for (int n = 0; n < kCount; ++n) {
+        String key = StringFormat("hw.property%d.value", n);
+        String value = StringFormat("value %d", n);
+        EXPECT_STREQ(value.c_str(), iniFile_getValue(ini.get(), key.c_str()));
+    }
+
+    // Keys added later are found too.
+    for (int n = 0; n < kCount; ++n) {
+        String key = StringFormat("added%d", n);
+        iniFile_setInteger(ini.get(), key.c_str(), n);
+    }
+    for (int n = 0; n < kCount; ++n) {
+        String key = StringFormat("added%d", n);
+        EXPECT_EQ(n, iniFile_getInteger(ini.get(), key.c_str(), -1));
+    }
+}
+
+// Parse a large configuration and query all its keys, as done when
+// reading an AVD's config and hardware-qemu.ini at startup.
+// Run with --gtest_also_run_disabled_tests.
+TEST(IniFile, DISABLED_ParseBenchmark) {
+    const int kCount = 2000;
+    const int kLoops = 200;
+    String text = makeIniText(kCount);
+    String* keys = new String[kCount];
+    for (int n = 0; n < kCount; ++n) {
+        keys[n] = StringFormat("hw.property%d.value", n);
+    }
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    for (int loop = 0; loop < kLoops; ++loop) {
+        IniFile* ini = iniFile_newFromMemory(text.c_str(), NULL);
+        for (int n = 0; n < kCount; ++n) {
+            EXPECT_TRUE(iniFile_getValue(ini, keys[n].c_str()));
+        }
+        iniFile_free(ini);
+    }
+    gettimeofday(&end, NULL);
+    double ms = (end.tv_sec - start.tv_sec) * 1000. +
+                (end.tv_usec - start.tv_usec) / 1000.;
+    printf("%d keys: %.3f ms per parse and full lookup\n",
+           kCount, ms / kLoops);
+    delete [] keys;
+}
@@ -0,0 +1,160 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/log_broker.h"
+
+#include "android/utils/system.h"
+
+#include <string.h>
+
+// Positions in the stream are absolute byte offsets, the position of a
+// byte in the ring buffer is its offset modulo the capacity.
+struct LogBrokerReader {
+    LogBrokerReader* next;
+    LogBroker* broker;
+    LogBrokerReaderFunc func;
+    void* opaque;
+    uint64_t pos;
+    uint64_t dropped;
+};
+
+struct LogBroker {
+    uint8_t* data;
+    int capacity;
+    uint64_t end;
+    LogBrokerReader* readers;
+};
+
+LogBroker* logBroker_new(int capacity) {
+    LogBroker* broker;
+    ANEW0(broker);
+    broker->data = android_alloc(capacity);
+    broker->capacity = capacity;
+    return broker;
+}
+
+void logBroker_free(LogBroker* broker) {
+    if (!broker) {
+        return;
+    }
+    while (broker->readers) {
+        logBroker_removeReader(broker, broker->readers);
+    }
+    AFREE(broker->data);
+    AFREE(broker);
+}
+
+// Return the offset of the oldest byte still in the ring buffer.
+static uint64_t logBroker_start(const LogBroker* broker) {
+    return (broker->end > (uint64_t)broker->capacity)
+            ? broker->end - broker->capacity : 0;
+}
+
+void logBrokerReader_flush(LogBrokerReader* reader) {
+    LogBroker* broker = reader->broker;
+    uint64_t start = logBroker_start(broker);
+
+    if (reader->pos < start) {
+        reader->dropped += start - reader->pos;
+        reader->pos = start;
+    }
+    while (reader->pos < broker->end) {
+        int offset = (int)(reader->pos % broker->capacity);
+        int avail = broker->capacity - offset;
+        int ret;
+
+        if ((uint64_t)avail > broker->end - reader->pos) {
+            avail = (int)(broker->end - reader->pos);
+        }
+        ret = reader->func(reader->opaque, broker->data + offset, avail);
+        if (ret <= 0) {
+            break;
+        }
+        reader->pos += ret;
+        if (ret < avail) {
+            break;
+        }
+    }
+}
+
+void logBroker_write(LogBroker* broker, const void* data, int len) {
+    const uint8_t* p = data;
+    LogBrokerReader* reader;
+
+    if (len <= 0) {
+        return;
+    }
+    if (len > broker->capacity) {
+        broker->end += len - broker->capacity;
+        p += len - broker->capacity;
+        len = broker->capacity;
+    }
+    while (len > 0) {
+        int offset = (int)(broker->end % broker->capacity);
+        int avail = broker->capacity - offset;
+
+        if (avail > len) {
+            avail = len;
+        }
+        memcpy(broker->data + offset, p, avail);
+        broker->end += avail;
+        p += avail;
+        len -= avail;
+    }
+    for (reader = broker->readers; reader; reader = reader->next) {
+        logBrokerReader_flush(reader);
+    }
+}
+
+LogBrokerReader* logBroker_addReader(LogBroker* broker,
+                                     LogBrokerReaderFunc func,
+                                     void* opaque) {
+    LogBrokerReader* reader;
+    ANEW0(reader);
+    reader->broker = broker;
+    reader->func = func;
+    reader->opaque = opaque;
+    reader->pos = logBroker_start(broker);
+    reader->next = broker->readers;
+    broker->readers = reader;
+    return reader;
+}
+
+void logBroker_removeReader(LogBroker* broker, LogBrokerReader* reader) {
+    LogBrokerReader** pnode = &broker->readers;
+
+    while (*pnode) {
+        if (*pnode == reader) {
+            *pnode = reader->next;
+            AFREE(reader);
+            return;
+        }
+        pnode = &(*pnode)->next;
+    }
+}
+
+uint64_t logBrokerReader_getDropped(const LogBrokerReader* reader) {
+    uint64_t start = logBroker_start(reader->broker);
+    uint64_t dropped = reader->dropped;
+
+    if (reader->pos < start) {
+        dropped += start - reader->pos;
+    }
+    return dropped;
+}
+
+int logBrokerReader_getPending(const LogBrokerReader* reader) {
+    const LogBroker* broker = reader->broker;
+    uint64_t start = logBroker_start(broker);
+    uint64_t pos = (reader->pos < start) ? start : reader->pos;
+
+    return (int)(broker->end - pos);
+}
@@ -0,0 +1,78 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_LOG_BROKER_H
+#define ANDROID_UTILS_LOG_BROKER_H
+
+#include "android/utils/compiler.h"
+
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+// A LogBroker receives a log stream from the guest once, and fans it out
+// to any number of readers (console, file, socket...).
+//
+// The data is kept in a bounded ring buffer. Each reader has its own
+// position in it, and a reader that can't keep up doesn't slow down the
+// writer or the other readers: when the writer wraps around past data the
+// reader hasn't consumed yet, that data is dropped for this reader and
+// counted in its drop counter.
+//
+// A new reader first receives the data still in the ring buffer, i.e. the
+// most recent messages, then everything written after it was added.
+//
+// None of these functions are thread-safe.
+typedef struct LogBroker LogBroker;
+typedef struct LogBrokerReader LogBrokerReader;
+
+// Reader callback. Called with |len| new bytes at |data|, return the
+// number of bytes consumed, which can be less than |len| (e.g. when a
+// socket is full). Bytes that aren't consumed are passed again on the
+// next call. Must not add or remove readers.
+typedef int (*LogBrokerReaderFunc)(void* opaque, const uint8_t* data, int len);
+
+// Create a new LogBroker instance with a ring buffer of |capacity| bytes.
+LogBroker* logBroker_new(int capacity);
+
+// Destroy a LogBroker and all its readers.
+void logBroker_free(LogBroker* broker);
+
+// Append |len| bytes from |data| to the stream, and deliver them to all
+// readers. If |len| is larger than the ring buffer, only its last bytes
+// are kept.
+void logBroker_write(LogBroker* broker, const void* data, int len);
+
+// Add a new reader that will receive the stream through |func|, with
+// |opaque| as its first parameter. Returns the new reader, which is owned
+// by |broker|.
+LogBrokerReader* logBroker_addReader(LogBroker* broker,
+                                     LogBrokerReaderFunc func,
+                                     void* opaque);
+
+// Remove |reader| from |broker| and free it.
+void logBroker_removeReader(LogBroker* broker, LogBrokerReader* reader);
+
+// Try to deliver the data pending for |reader|, e.g. once its socket can
+// be written to again.
+void logBrokerReader_flush(LogBrokerReader* reader);
+
+// Return the number of bytes dropped for |reader| because it didn't
+// consume them before they were overwritten.
+uint64_t logBrokerReader_getDropped(const LogBrokerReader* reader);
+
+// Return the number of bytes written to |broker| but not consumed yet by
+// |reader|.
+int logBrokerReader_getPending(const LogBrokerReader* reader);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_LOG_BROKER_H
@@ -0,0 +1,149 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/log_broker.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <string.h>
+
+namespace {
+
+// A test reader which consumes at most |mLimit| bytes per call, or
+// everything when |mLimit| is negative.
+class TestReader {
+public:
+    TestReader() : mLimit(-1) {}
+
+    static int onData(void* opaque, const uint8_t* data, int len) {
+        TestReader* reader = static_cast<TestReader*>(opaque);
+        if (reader->mLimit >= 0 && len > reader->mLimit) {
+            len = reader->mLimit;
+        }
+        reader->mText.append(reinterpret_cast<const char*>(data), len);
+        return len;
+    }
+
+    std::string mText;
+    int mLimit;
+};
+
+void writeString(LogBroker* broker, const char* str) {
+    logBroker_write(broker, str, strlen(str));
+}
+
+}  // namespace
+
+TEST(LogBroker, FanOut) {
+    LogBroker* broker = logBroker_new(16);
+    TestReader a, b;
+    LogBrokerReader* ra = logBroker_addReader(broker, TestReader::onData, &a);
+    LogBrokerReader* rb = logBroker_addReader(broker, TestReader::onData, &b);
+
+    writeString(broker, "hello ");
+    writeString(broker, "world\n");
+    EXPECT_EQ("hello world\n", a.mText);
+    EXPECT_EQ("hello world\n", b.mText);
+    EXPECT_EQ(0U, logBrokerReader_getDropped(ra));
+    EXPECT_EQ(0U, logBrokerReader_getDropped(rb));
+    EXPECT_EQ(0, logBrokerReader_getPending(ra));
+
+    logBroker_free(broker);
+}
+
+TEST(LogBroker, NewReaderGetsRecentData) {
+    LogBroker* broker = logBroker_new(8);
+    writeString(broker, "0123456789");
+
+    TestReader a;
+    LogBrokerReader* ra = logBroker_addReader(broker, TestReader::onData, &a);
+    EXPECT_EQ(8, logBrokerReader_getPending(ra));
+    logBrokerReader_flush(ra);
+    EXPECT_EQ("23456789", a.mText);
+    EXPECT_EQ(0U, logBrokerReader_getDropped(ra));
+
+    logBroker_free(broker);
+}
+
+TEST(LogBroker, SlowReaderDropsData) {
+    LogBroker* broker = logBroker_new(8);
+    TestReader fast, slow;
+    logBroker_addReader(broker, TestReader::onData, &fast);
+    LogBrokerReader* rslow =
+            logBroker_addReader(broker, TestReader::onData, &slow);
+
+    // The slow reader doesn't consume anything.
+    slow.mLimit = 0;
+    writeString(broker, "abcdef");
+    EXPECT_EQ(6, logBrokerReader_getPending(rslow));
+    writeString(broker, "ghijkl");
+    EXPECT_EQ(8, logBrokerReader_getPending(rslow));
+    EXPECT_EQ(4U, logBrokerReader_getDropped(rslow));
+
+    // The fast reader isn't affected.
+    EXPECT_EQ("abcdefghijkl", fast.mText);
+
+    // Once it can read again, the slow reader gets what remains, including
+    // the bytes that wrap around the end of the ring buffer.
+    slow.mLimit = -1;
+    logBrokerReader_flush(rslow);
+    EXPECT_EQ("efghijkl", slow.mText);
+    EXPECT_EQ(4U, logBrokerReader_getDropped(rslow));
+
+    logBroker_free(broker);
+}
+
+TEST(LogBroker, PartialReads) {
+    LogBroker* broker = logBroker_new(8);
+    TestReader a;
+    a.mLimit = 3;
+    LogBrokerReader* ra = logBroker_addReader(broker, TestReader::onData, &a);
+
+    writeString(broker, "abcdef");
+    EXPECT_EQ("abc", a.mText);
+    EXPECT_EQ(3, logBrokerReader_getPending(ra));
+    writeString(broker, "g");
+    EXPECT_EQ("abcdef", a.mText);
+    logBrokerReader_flush(ra);
+    EXPECT_EQ("abcdefg", a.mText);
+    EXPECT_EQ(0U, logBrokerReader_getDropped(ra));
+
+    logBroker_free(broker);
+}
+
+TEST(LogBroker, LargeWrite) {
+    LogBroker* broker = logBroker_new(4);
+    TestReader a;
+    LogBrokerReader* ra = logBroker_addReader(broker, TestReader::onData, &a);
+
+    writeString(broker, "0123456789");
+    EXPECT_EQ("6789", a.mText);
+    EXPECT_EQ(6U, logBrokerReader_getDropped(ra));
+
+    logBroker_free(broker);
+}
+
+TEST(LogBroker, RemoveReader) {
+    LogBroker* broker = logBroker_new(8);
+    TestReader a, b;
+    LogBrokerReader* ra = logBroker_addReader(broker, TestReader::onData, &a);
+    logBroker_addReader(broker, TestReader::onData, &b);
+
+    writeString(broker, "ab");
+    logBroker_removeReader(broker, ra);
+    writeString(broker, "cd");
+    EXPECT_EQ("ab", a.mText);
+    EXPECT_EQ("abcd", b.mText);
+
+    logBroker_free(broker);
+}
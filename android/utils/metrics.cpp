@@ -0,0 +1,93 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/metrics.h"
+
+#include "android/base/Metrics.h"
+#include "android/base/MetricsServer.h"
+
+using android::base::Counter;
+using android::base::Gauge;
+using android::base::Histogram;
+using android::base::MetricsRegistry;
+using android::base::MetricsServer;
+
+namespace {
+
+Metric* toC(android::base::Metric* metric) {
+    return reinterpret_cast<Metric*>(metric);
+}
+
+android::base::Metric* fromC(Metric* metric) {
+    return reinterpret_cast<android::base::Metric*>(metric);
+}
+
+MetricsServer* sServer = NULL;
+
+}  // namespace
+
+Metric* metrics_counter(const char* name,
+                        const char* labels,
+                        const char* help) {
+    return toC(MetricsRegistry::get()->counter(name, labels, help));
+}
+
+Metric* metrics_gauge(const char* name, const char* labels, const char* help) {
+    return toC(MetricsRegistry::get()->gauge(name, labels, help));
+}
+
+Metric* metrics_histogram(const char* name,
+                          const char* labels,
+                          const char* help) {
+    return toC(MetricsRegistry::get()->histogram(name, labels, help));
+}
+
+void metrics_add_callback(MetricType type,
+                          const char* name,
+                          const char* labels,
+                          const char* help,
+                          int64_t (*func)(void* opaque),
+                          void* opaque) {
+    MetricsRegistry::get()->addCallback(
+            type == METRIC_GAUGE ? android::base::Metric::kTypeGauge
+                                 : android::base::Metric::kTypeCounter,
+            name, labels, help, func, opaque);
+}
+
+void metric_add(Metric* metric, int64_t delta) {
+    android::base::Metric* m = fromC(metric);
+    if (m->type() == android::base::Metric::kTypeCounter) {
+        static_cast<Counter*>(m)->add(delta);
+    } else {
+        static_cast<Gauge*>(m)->add(delta);
+    }
+}
+
+void metric_set(Metric* metric, int64_t value) {
+    static_cast<Gauge*>(fromC(metric))->set(value);
+}
+
+void metric_record(Metric* metric, uint64_t value) {
+    static_cast<Histogram*>(fromC(metric))->record(value);
+}
+
+void metrics_print(const char* prefix,
+                   void (*func)(void* opaque, const char* line),
+                   void* opaque) {
+    MetricsRegistry::get()->print(prefix, func, opaque);
+}
+
+bool metrics_start_server(int port) {
+    if (!sServer) {
+        sServer = MetricsServer::create(MetricsRegistry::get(), port);
+    }
+    return sServer != NULL;
+}
@@ -0,0 +1,81 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_METRICS_H
+#define ANDROID_UTILS_METRICS_H
+
+#include "android/utils/compiler.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+// C wrapper around the metrics registry shared by the whole program, see
+// android/base/Metrics.h for more details.
+//
+// Usage example:
+//
+//    static Metric* reads;
+//    if (!reads) {
+//        reads = metrics_counter("emulator_nand_ops_total", "op=\"read\"",
+//                                "Number of NAND operations");
+//    }
+//    metric_add(reads, 1);
+
+typedef struct Metric Metric;
+
+typedef enum {
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+} MetricType;
+
+// Return the metric of the given type with |name| and |labels|, creating
+// it with the description |help| on first use. |labels| can be NULL.
+// The result is valid until the program exits.
+Metric* metrics_counter(const char* name, const char* labels, const char* help);
+Metric* metrics_gauge(const char* name, const char* labels, const char* help);
+Metric* metrics_histogram(const char* name,
+                          const char* labels,
+                          const char* help);
+
+// Add a METRIC_COUNTER or METRIC_GAUGE whose value is computed by
+// |func(opaque)| each time it is printed, from any thread.
+void metrics_add_callback(MetricType type,
+                          const char* name,
+                          const char* labels,
+                          const char* help,
+                          int64_t (*func)(void* opaque),
+                          void* opaque);
+
+// Add |delta| to a counter or gauge.
+void metric_add(Metric* metric, int64_t delta);
+
+// Set the value of a gauge.
+void metric_set(Metric* metric, int64_t value);
+
+// Record |value| in a histogram.
+void metric_record(Metric* metric, uint64_t value);
+
+// Print the metrics whose name starts with |prefix|, or all of them if it
+// is NULL, through |func|, one line at a time terminated by '\r\n'.
+void metrics_print(const char* prefix,
+                   void (*func)(void* opaque, const char* line),
+                   void* opaque);
+
+// Start serving the metrics in the Prometheus text format on the loopback
+// TCP |port|. Return false if the port can't be bound.
+bool metrics_start_server(int port);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_METRICS_H
@@ -36,6 +36,13 @@
 #include <signal.h>
 #endif
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+#ifndef FICLONE
+#define FICLONE  _IOW(0x94, 9, int)
+#endif
+#endif
+
 #define  D(...)  VERBOSE_PRINT(init,__VA_ARGS__)
 
 /** PATH HANDLING ROUTINES
@@ -490,7 +497,9 @@ path_get_absolute( const char* path )
  **
  **  path_copy_file() copies one file into another.
  **
- **  both functions return 0 on success, and -1 on error
+ **  path_clone_file() makes a copy-on-write clone of a file.
+ **
+ **  all functions return 0 on success, and -1 on error
  **/
 
 APosixStatus
@@ -562,6 +571,39 @@ path_copy_file( const char*  dest, const char*  source )
 }
 
 
+APosixStatus
+path_clone_file( const char*  dest, const char*  source )
+{
+#ifdef __linux__
+    int  fd, fs, result = -1;
+
+    fs = HANDLE_EINTR(open(source, O_RDONLY));
+    if (fs < 0) {
+        return -1;
+    }
+    fd = HANDLE_EINTR(open(dest, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR));
+    if (fd >= 0) {
+        /* Only file systems sharing extents between files support this,
+         * e.g. btrfs or XFS. The clone takes no space until modified. */
+        result = ioctl(fd, FICLONE, fs) == 0 ? 0 : -1;
+        close(fd);
+        if (result < 0) {
+            int  saved_errno = errno;
+            unlink(dest);
+            errno = saved_errno;
+        }
+    }
+    close(fs);
+    return result;
+#else
+    (void)dest;
+    (void)source;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
 APosixStatus
 path_delete_file( const char*  path )
 {
@@ -134,6 +134,8 @@ extern char*  path_get_absolute( const char* path );
  **
  **  path_copy_file() copies one file into another.
  **
+ **  path_clone_file() makes a copy-on-write clone of a file.
+ **
  **  unlink_file() is equivalent to unlink() on Unix, on Windows,
  **  it will handle the case where _unlink() fails because the file is
  **  read-only by trying to change its access rights then calling _unlink()
@@ -155,6 +157,12 @@ extern APosixStatus   path_empty_file( const char*  path );
  * (error code in errno). Does not work on directories */
 extern APosixStatus   path_copy_file( const char*  dest, const char*  source );
 
+/* creates |dest| as a copy-on-write clone of |source|, which shares its
+ * data blocks until either file is modified. This is only supported on
+ * Linux, by some file systems. 0 on success, -1 on failure (error code
+ * in errno), in which case |dest| is not created. |dest| must not exist */
+extern APosixStatus   path_clone_file( const char*  dest, const char*  source );
+
 /* unlink/delete a given file. Note that on Win32, this will
  * fail if the program has an opened handle to the file
  */
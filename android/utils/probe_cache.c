@@ -0,0 +1,263 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/utils/probe_cache.h"
+
+#include "android/utils/bufprint.h"
+#include "android/utils/debug.h"
+#include "android/utils/path.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define  D(...)  VERBOSE_PRINT(init,__VA_ARGS__)
+
+/* Each cache file starts with this header, followed by the |key_size|
+ * bytes of the key, i.e. the probe name and the file path separated by
+ * a zero, then by the |data_size| bytes of the result. */
+typedef struct {
+    char      magic[4];
+    uint32_t  version;
+    uint64_t  file_size;
+    int64_t   file_mtime_sec;
+    int64_t   file_mtime_nsec;
+    uint64_t  file_inode;
+    uint32_t  key_size;
+    uint32_t  data_size;
+} ProbeCacheHeader;
+
+#define  PROBE_CACHE_MAGIC     "PRBC"
+#define  PROBE_CACHE_VERSION   1
+
+/* Results are small, anything larger is a corrupted file. */
+#define  PROBE_CACHE_MAX_KEY_SIZE   (PATH_MAX + 64)
+#define  PROBE_CACHE_MAX_DATA_SIZE  (1024 * 1024)
+
+/* Fill the file identity fields of |header| for the file at |file_path|.
+ * Return 0 on success, -1 otherwise. */
+static int
+probe_cache_stat(const char* file_path, ProbeCacheHeader* header)
+{
+    struct stat  st;
+
+    if (stat(file_path, &st) < 0)
+        return -1;
+
+    header->file_size      = (uint64_t)st.st_size;
+    header->file_mtime_sec = (int64_t)st.st_mtime;
+#if defined(__APPLE__)
+    header->file_mtime_nsec = (int64_t)st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+    header->file_mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+#else
+    header->file_mtime_nsec = 0;
+#endif
+    /* Always 0 on Windows, where the size and time must be enough. */
+    header->file_inode = (uint64_t)st.st_ino;
+    return 0;
+}
+
+/* Build the key of the result of |probe| for |file_path| into |key|.
+ * Return its size, or 0 if it doesn't fit. */
+static size_t
+probe_cache_make_key(char* key, size_t key_max, const char* probe,
+                     const char* file_path)
+{
+    size_t  probe_len = strlen(probe);
+    size_t  path_len  = strlen(file_path);
+    size_t  size      = probe_len + 1 + path_len;
+
+    if (size > key_max)
+        return 0;
+
+    memcpy(key, probe, probe_len);
+    key[probe_len] = 0;
+    memcpy(key + probe_len + 1, file_path, path_len);
+    return size;
+}
+
+static char*
+bufprint_cache_file(char* buff, char* end, const char* cache_dir,
+                    const char* key, size_t key_size, const char* suffix)
+{
+    /* 64-bit FNV-1a hash of the key. */
+    const uint8_t*  p    = (const uint8_t*)key;
+    const uint8_t*  pend = p + key_size;
+    uint64_t        hash = 0xcbf29ce484222325ULL;
+
+    for ( ; p < pend; p++) {
+        hash ^= *p;
+        hash *= 0x100000001b3ULL;
+    }
+    return bufprint(buff, end, "%s" PATH_SEP "%08x%08x.probe%s", cache_dir,
+                    (unsigned)(hash >> 32), (unsigned)hash, suffix);
+}
+
+const char*
+probe_cache_default_dir(void)
+{
+    static char  dir[PATH_MAX];
+    static int   init;
+
+    if (!init) {
+        char*  end = dir + sizeof(dir);
+        char*  p   = bufprint_config_path(dir, end);
+
+        init = 1;
+        p = bufprint(p, end, PATH_SEP "probe-cache");
+        if (p >= end || path_mkdir_if_needed(dir, 0755) < 0) {
+            D("cannot use probe cache '%s'\n", dir);
+            dir[0] = 0;
+        }
+    }
+    return dir[0] ? dir : NULL;
+}
+
+bool
+probe_cache_find(const char* cache_dir,
+                 const char* probe,
+                 const char* file_path,
+                 char** out,
+                 size_t* out_size)
+{
+    char              path[PATH_MAX], *end = path + sizeof(path);
+    char              key[PROBE_CACHE_MAX_KEY_SIZE];
+    char              stored_key[PROBE_CACHE_MAX_KEY_SIZE];
+    size_t            key_size;
+    ProbeCacheHeader  current;
+    ProbeCacheHeader  header;
+    FILE*             file;
+    char*             data;
+
+    *out = NULL;
+    *out_size = 0;
+
+    key_size = probe_cache_make_key(key, sizeof(key), probe, file_path);
+    if (key_size == 0 ||
+        bufprint_cache_file(path, end, cache_dir, key, key_size, "") >= end)
+        return false;
+
+    if (probe_cache_stat(file_path, &current) < 0)
+        return false;
+
+    file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, PROBE_CACHE_MAGIC, 4) != 0 ||
+        header.version != PROBE_CACHE_VERSION ||
+        header.file_size != current.file_size ||
+        header.file_mtime_sec != current.file_mtime_sec ||
+        header.file_mtime_nsec != current.file_mtime_nsec ||
+        header.file_inode != current.file_inode ||
+        header.key_size != key_size ||
+        header.data_size > PROBE_CACHE_MAX_DATA_SIZE ||
+        fread(stored_key, key_size, 1, file) != 1 ||
+        memcmp(stored_key, key, key_size) != 0) {
+        fclose(file);
+        return false;
+    }
+
+    data = malloc(header.data_size + 1);
+    if (data == NULL ||
+        (header.data_size > 0 &&
+         fread(data, header.data_size, 1, file) != 1) ||
+        fgetc(file) != EOF) {
+        free(data);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+
+    data[header.data_size] = 0;
+    *out = data;
+    *out_size = header.data_size;
+    return true;
+}
+
+int
+probe_cache_file_identity(const char* file_path, char* buf, size_t size)
+{
+    ProbeCacheHeader  header;
+    int               len;
+
+    if (probe_cache_stat(file_path, &header) < 0)
+        return -1;
+
+    len = snprintf(buf, size, "%llu:%lld.%09lld:%llu",
+                   (unsigned long long)header.file_size,
+                   (long long)header.file_mtime_sec,
+                   (long long)header.file_mtime_nsec,
+                   (unsigned long long)header.file_inode);
+    if (len < 0 || (size_t)len >= size)
+        return -1;
+    return 0;
+}
+
+int
+probe_cache_store(const char* cache_dir,
+                  const char* probe,
+                  const char* file_path,
+                  const void* data,
+                  size_t size)
+{
+    char              path[PATH_MAX], *end = path + sizeof(path);
+    char              temp[PATH_MAX], *temp_end = temp + sizeof(temp);
+    char              key[PROBE_CACHE_MAX_KEY_SIZE];
+    size_t            key_size;
+    ProbeCacheHeader  header;
+    FILE*             file;
+    int               ok;
+
+    if (size > PROBE_CACHE_MAX_DATA_SIZE)
+        return -1;
+
+    key_size = probe_cache_make_key(key, sizeof(key), probe, file_path);
+    if (key_size == 0 ||
+        bufprint_cache_file(path, end, cache_dir, key, key_size, "") >= end ||
+        bufprint_cache_file(temp, temp_end, cache_dir, key, key_size,
+                            ".tmp") >= temp_end)
+        return -1;
+
+    memset(&header, 0, sizeof(header));
+    if (probe_cache_stat(file_path, &header) < 0)
+        return -1;
+    memcpy(header.magic, PROBE_CACHE_MAGIC, 4);
+    header.version   = PROBE_CACHE_VERSION;
+    header.key_size  = (uint32_t)key_size;
+    header.data_size = (uint32_t)size;
+
+    file = fopen(temp, "wb");
+    if (file == NULL)
+        return -1;
+
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(key, key_size, 1, file) == 1 &&
+         (size == 0 || fwrite(data, size, 1, file) == 1);
+    if (fclose(file) != 0)
+        ok = 0;
+
+#ifdef _WIN32
+    /* On Windows, rename() fails if the file already exists, e.g. when
+     * replacing a stale result. */
+    if (ok)
+        remove(path);
+#endif
+    if (!ok || rename(temp, path) != 0) {
+        remove(temp);
+        return -1;
+    }
+    return 0;
+}
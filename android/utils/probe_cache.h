@@ -0,0 +1,75 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef ANDROID_UTILS_PROBE_CACHE_H
+#define ANDROID_UTILS_PROBE_CACHE_H
+
+#include "android/utils/compiler.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+ANDROID_BEGIN_HEADER
+
+/* A small on-disk cache of the results of probing system image files.
+ *
+ * At startup, the emulator decompresses the kernel image to find its
+ * version string, and the ramdisk image to extract its fstab, even though
+ * these files almost never change between runs. Instead, each result is
+ * stored in a file of the cache directory, along with the identity of the
+ * probed file (its path, size, modification time and inode number), so
+ * that the next runs can reuse it as long as the file is left untouched.
+ *
+ * |probe| is a short string naming the kind of result, e.g.
+ * "kernel-version", so that several results can be cached for a file.
+ */
+
+/* Return the default cache directory, i.e. <config-dir>/probe-cache,
+ * creating it if needed. Return NULL if it can't be used. */
+extern const char* probe_cache_default_dir(void);
+
+/* Look for the result of |probe| for the file at |file_path| in
+ * |cache_dir|. On success, return true and set |*out| to a heap-allocated
+ * copy of the result, followed by a terminating zero that isn't counted
+ * in |*out_size|, which the caller must free(). Return false if there is
+ * no such result, or if the file changed since it was stored.
+ */
+extern bool probe_cache_find(const char* cache_dir,
+                             const char* probe,
+                             const char* file_path,
+                             char** out,
+                             size_t* out_size);
+
+/* Store the |size| bytes at |data| as the result of |probe| for the
+ * current version of the file at |file_path| into |cache_dir|. The entry
+ * only appears once completely written, so that concurrent emulator
+ * instances never see partial results.
+ * Return 0 on success, -1 otherwise.
+ */
+extern int probe_cache_store(const char* cache_dir,
+                             const char* probe,
+                             const char* file_path,
+                             const void* data,
+                             size_t size);
+
+/* Format the identity of the file at |file_path|, i.e. its size,
+ * modification time and inode number, as a string into the |size| bytes
+ * at |buf|, so that callers can tell whether a file changed without
+ * reading it. Return 0 on success, -1 if the file can't be accessed or
+ * if the string doesn't fit.
+ */
+extern int probe_cache_file_identity(const char* file_path,
+                                     char* buf,
+                                     size_t size);
+
+ANDROID_END_HEADER
+
+#endif /* ANDROID_UTILS_PROBE_CACHE_H */
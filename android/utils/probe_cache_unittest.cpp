@@ -0,0 +1,121 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/probe_cache.h"
+
+#include "android/base/String.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using android::base::String;
+using android::base::TestTempDir;
+
+namespace {
+
+void writeFile(const char* path, const char* content) {
+    FILE* file = ::fopen(path, "wb");
+    ASSERT_TRUE(file);
+    ::fputs(content, file);
+    ::fclose(file);
+}
+
+}  // namespace
+
+TEST(ProbeCache, StoreAndFind) {
+    TestTempDir tempDir("ProbeCacheTest");
+    ASSERT_TRUE(tempDir.path());
+    String filePath = tempDir.makeSubPath("kernel");
+    writeFile(filePath.c_str(), "some kernel image");
+
+    char* out = NULL;
+    size_t outSize = 0;
+    EXPECT_FALSE(probe_cache_find(tempDir.path(), "version", filePath.c_str(),
+                                  &out, &outSize));
+
+    const char kResult[] = "Linux version 3.10.0+";
+    ASSERT_EQ(0, probe_cache_store(tempDir.path(), "version", filePath.c_str(),
+                                   kResult, sizeof(kResult) - 1));
+
+    // Another probe must not match.
+    EXPECT_FALSE(probe_cache_find(tempDir.path(), "other", filePath.c_str(),
+                                  &out, &outSize));
+
+    ASSERT_TRUE(probe_cache_find(tempDir.path(), "version", filePath.c_str(),
+                                 &out, &outSize));
+    EXPECT_EQ(sizeof(kResult) - 1, outSize);
+    EXPECT_STREQ(kResult, out);
+    ::free(out);
+
+    // Empty results can be stored too.
+    ASSERT_EQ(0, probe_cache_store(tempDir.path(), "other", filePath.c_str(),
+                                   NULL, 0));
+    ASSERT_TRUE(probe_cache_find(tempDir.path(), "other", filePath.c_str(),
+                                 &out, &outSize));
+    EXPECT_EQ(0U, outSize);
+    EXPECT_STREQ("", out);
+    ::free(out);
+}
+
+TEST(ProbeCache, IgnoresModifiedFiles) {
+    TestTempDir tempDir("ProbeCacheTest");
+    ASSERT_TRUE(tempDir.path());
+    String filePath = tempDir.makeSubPath("ramdisk.img");
+    writeFile(filePath.c_str(), "some ramdisk");
+
+    ASSERT_EQ(0, probe_cache_store(tempDir.path(), "fstab", filePath.c_str(),
+                                   "data", 4));
+
+    // A different size is enough to invalidate the result.
+    writeFile(filePath.c_str(), "another ramdisk");
+
+    char* out = NULL;
+    size_t outSize = 0;
+    EXPECT_FALSE(probe_cache_find(tempDir.path(), "fstab", filePath.c_str(),
+                                  &out, &outSize));
+    EXPECT_FALSE(out);
+
+    // As well as a missing file.
+    ::remove(filePath.c_str());
+    EXPECT_FALSE(probe_cache_find(tempDir.path(), "fstab", filePath.c_str(),
+                                  &out, &outSize));
+}
+
+TEST(ProbeCache, FileIdentity) {
+    TestTempDir tempDir("ProbeCacheTest");
+    ASSERT_TRUE(tempDir.path());
+    String filePath = tempDir.makeSubPath("system.img");
+    writeFile(filePath.c_str(), "some system image");
+
+    char identity[64];
+    char same[64];
+    ASSERT_EQ(0, probe_cache_file_identity(filePath.c_str(), identity,
+                                           sizeof(identity)));
+    ASSERT_EQ(0, probe_cache_file_identity(filePath.c_str(), same,
+                                           sizeof(same)));
+    EXPECT_STREQ(identity, same);
+
+    writeFile(filePath.c_str(), "another system image");
+    ASSERT_EQ(0, probe_cache_file_identity(filePath.c_str(), same,
+                                           sizeof(same)));
+    EXPECT_STRNE(identity, same);
+
+    // Too small a buffer.
+    EXPECT_EQ(-1, probe_cache_file_identity(filePath.c_str(), same, 4));
+
+    ::remove(filePath.c_str());
+    EXPECT_EQ(-1, probe_cache_file_identity(filePath.c_str(), same,
+                                            sizeof(same)));
+}
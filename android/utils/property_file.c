@@ -32,9 +32,17 @@ void propertyFileIterator_init(PropertyFileIterator* iter,
 }
 
 
-bool propertyFileIterator_next(PropertyFileIterator* iter) {
-    const char* p = iter->p;
-    const char* end = iter->end;
+// Find the next property definition between |*pp| and |end|. On success,
+// return true, set |*name|, |*nameLen|, |*value| and |*valueLen| to the
+// location of its name and value in the file, and |*pp| to the start of
+// the next line. Nothing is copied.
+static bool propertyFile_nextSpan(const char** pp,
+                                  const char* end,
+                                  const char** name,
+                                  size_t* nameLen,
+                                  const char** value,
+                                  size_t* valueLen) {
+    const char* p = *pp;
     while (p < end) {
         // Get end of line, and compute next line position.
         const char* line = p;
@@ -58,18 +66,33 @@ bool propertyFileIterator_next(PropertyFileIterator* iter) {
         if (lineEnd == line || line[0] == '#')
             continue;
 
-        const char* name = line;
         const char* nameEnd =
-                (const char*)memchr(name, '=', lineEnd - name);
+                (const char*)memchr(line, '=', lineEnd - line);
         if (!nameEnd) {
             // Skipping lines without a =
             continue;
         }
-        const char* value = nameEnd + 1;
-        while (nameEnd > name && isspace(nameEnd[-1]))
+        *value = nameEnd + 1;
+        *valueLen = (size_t)(lineEnd - *value);
+        while (nameEnd > line && isspace(nameEnd[-1]))
             nameEnd--;
 
-        size_t nameLen = nameEnd - name;
+        *name = line;
+        *nameLen = (size_t)(nameEnd - line);
+        *pp = p;
+        return true;
+    }
+    *pp = p;
+    return false;
+}
+
+bool propertyFileIterator_next(PropertyFileIterator* iter) {
+    const char* name;
+    const char* value;
+    size_t nameLen;
+    size_t valueLen;
+    while (propertyFile_nextSpan(&iter->p, iter->end,
+                                 &name, &nameLen, &value, &valueLen)) {
         if (nameLen == 0 || nameLen >= MAX_PROPERTY_NAME_LEN) {
             // Skip lines without names, or with names too long.
             continue;
@@ -79,17 +102,13 @@ bool propertyFileIterator_next(PropertyFileIterator* iter) {
         iter->name[nameLen] = '\0';
 
         // Truncate value's length.
-        size_t valueLen = (lineEnd - value);
         if (valueLen >= MAX_PROPERTY_VALUE_LEN)
             valueLen = (MAX_PROPERTY_VALUE_LEN - 1);
 
         memcpy(iter->value, value, valueLen);
         iter->value[valueLen] = '\0';
-
-        iter->p = p;
         return true;
     }
-    iter->p = p;
     return false;
 }
 
@@ -97,17 +116,34 @@ char* propertyFile_getValue(const char* propFile,
                             size_t propFileLen,
                             const char* propName) {
     size_t propNameLen = strlen(propName);
-    if (propNameLen >= MAX_PROPERTY_NAME_LEN)
+    if (propNameLen == 0 || propNameLen >= MAX_PROPERTY_NAME_LEN)
         return NULL;
 
-    char* ret = NULL;
-    PropertyFileIterator iter[1];
-    propertyFileIterator_init(iter, propFile, propFileLen);
-    while (propertyFileIterator_next(iter)) {
-        if (!strcmp(iter->name, propName)) {
-            free(ret);
-            ret = ASTRDUP(iter->value);
+    // Compare the names in place, and only copy the last matching value.
+    const char* p = propFile;
+    const char* end = p + propFileLen;
+    const char* name;
+    const char* value;
+    size_t nameLen;
+    size_t valueLen;
+    const char* result = NULL;
+    size_t resultLen = 0;
+    while (propertyFile_nextSpan(&p, end,
+                                 &name, &nameLen, &value, &valueLen)) {
+        if (nameLen == propNameLen && !memcmp(name, propName, nameLen)) {
+            result = value;
+            resultLen = valueLen;
         }
     }
+    if (!result)
+        return NULL;
+
+    if (resultLen >= MAX_PROPERTY_VALUE_LEN)
+        resultLen = (MAX_PROPERTY_VALUE_LEN - 1);
+
+    char* ret;
+    AARRAY_NEW(ret, resultLen + 1U);
+    memcpy(ret, result, resultLen);
+    ret[resultLen] = '\0';
     return ret;
 }
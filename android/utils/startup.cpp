@@ -0,0 +1,192 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/startup.h"
+
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/TaskGraph.h"
+#include "android/base/threads/ThreadPool.h"
+#include "android/utils/trace.h"
+
+#include <stdint.h>
+
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+using android::base::TaskGraph;
+using android::base::ThreadPool;
+
+namespace {
+
+enum EntryKind {
+    kEntryPhase = 0,  // A main thread phase.
+    kEntryTask,       // A background task.
+    kEntryWait,       // The main thread waiting for a task.
+};
+
+struct Entry {
+    const char* name;
+    EntryKind kind;
+    uint64_t startNs;
+    uint64_t endNs;  // 0 while the entry is running.
+};
+
+// Startup has a few dozen phases at most, later ones are not profiled.
+const int kMaxEntries = 64;
+
+struct StartupState {
+    StartupState() :
+            lock(),
+            graph(ThreadPool::get()),
+            originNs(trace_now_ns()),
+            entryCount(0),
+            currentPhase(-1),
+            taskEntries() {}
+
+    // Add a new entry and return its index, or -1 if there is no room.
+    int addEntry(const char* name, EntryKind kind) {
+        AutoLock locker(lock);
+        if (entryCount == kMaxEntries) {
+            return -1;
+        }
+        Entry* e = &entries[entryCount];
+        e->name = name;
+        e->kind = kind;
+        e->startNs = trace_now_ns();
+        e->endNs = 0;
+        return entryCount++;
+    }
+
+    void endEntry(int index) {
+        if (index < 0) {
+            return;
+        }
+        AutoLock locker(lock);
+        entries[index].endNs = trace_now_ns();
+    }
+
+    Lock lock;
+    TaskGraph graph;
+    uint64_t originNs;
+    Entry entries[kMaxEntries];
+    int entryCount;
+    int currentPhase;
+    android::base::PodVector<int> taskEntries;  // Indexed by StartupTask.
+};
+
+LazyInstance<StartupState> sState = LAZY_INSTANCE_INIT;
+
+bool sProfileEnabled = false;
+
+struct TaskParams {
+    StartupFunc func;
+    void* opaque;
+    int entry;
+};
+
+void runTask(void* opaque) {
+    TaskParams* params = static_cast<TaskParams*>(opaque);
+    StartupState* state = sState.ptr();
+    // Tasks are profiled from the time they actually start running.
+    {
+        AutoLock locker(state->lock);
+        if (params->entry >= 0) {
+            state->entries[params->entry].startNs = trace_now_ns();
+        }
+    }
+    params->func(params->opaque);
+    state->endEntry(params->entry);
+    delete params;
+}
+
+}  // namespace
+
+void startup_phase_begin(const char* name) {
+    StartupState* state = sState.ptr();
+    state->endEntry(state->currentPhase);
+    state->currentPhase = state->addEntry(name, kEntryPhase);
+}
+
+void startup_phase_end(void) {
+    StartupState* state = sState.ptr();
+    state->endEntry(state->currentPhase);
+    state->currentPhase = -1;
+}
+
+StartupTask startup_task_start(const char* name,
+                               StartupFunc func,
+                               void* opaque,
+                               const StartupTask* deps,
+                               int depCount) {
+    StartupState* state = sState.ptr();
+    TaskParams* params = new TaskParams;
+    params->func = func;
+    params->opaque = opaque;
+    params->entry = state->addEntry(name, kEntryTask);
+    StartupTask task = state->graph.add(runTask, params, deps, depCount);
+    state->taskEntries.push_back(params->entry);
+    return task;
+}
+
+void startup_task_wait(StartupTask task) {
+    StartupState* state = sState.ptr();
+    if (state->graph.isDone(task)) {
+        return;
+    }
+    int taskEntry = state->taskEntries[task];
+    int entry = state->addEntry(
+            taskEntry >= 0 ? state->entries[taskEntry].name : "task",
+            kEntryWait);
+    state->graph.wait(task);
+    state->endEntry(entry);
+}
+
+void startup_profile_set_enabled(bool enabled) {
+    sProfileEnabled = enabled;
+}
+
+bool startup_profile_enabled(void) {
+    return sProfileEnabled;
+}
+
+void startup_profile_write(FILE* out) {
+    static const char* const kKindNames[] = { "main", "pool", "wait" };
+    StartupState* state = sState.ptr();
+    AutoLock locker(state->lock);
+    uint64_t lastNs = state->originNs;
+    fprintf(out, "Startup profile:\n");
+    fprintf(out, "  %-24s %10s %10s  %s\n",
+            "phase", "start-ms", "time-ms", "thread");
+    for (int n = 0; n < state->entryCount; ++n) {
+        const Entry* e = &state->entries[n];
+        uint64_t endNs = e->endNs ? e->endNs : trace_now_ns();
+        if (endNs > lastNs) {
+            lastNs = endNs;
+        }
+        fprintf(out, "  %-24s %10.1f %10.1f  %s%s\n",
+                e->name,
+                (e->startNs - state->originNs) / 1e6,
+                (endNs - e->startNs) / 1e6,
+                kKindNames[e->kind],
+                e->endNs ? "" : " (running)");
+    }
+    fprintf(out, "  %-24s %10s %10.1f\n",
+            "total", "", (lastNs - state->originNs) / 1e6);
+}
+
+void startup_profile_print(void) {
+    startup_phase_end();
+    if (sProfileEnabled) {
+        startup_profile_write(stdout);
+        fflush(stdout);
+    }
+}
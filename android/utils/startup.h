@@ -0,0 +1,75 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_STARTUP_H
+#define ANDROID_UTILS_STARTUP_H
+
+#include "android/utils/compiler.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+ANDROID_BEGIN_HEADER
+
+// Emulator startup: an initialization graph whose independent steps run
+// concurrently on the shared thread pool, and a profile of the time spent
+// in each phase, printed with -startup-profile.
+//
+// The main thread marks its own phases with startup_phase_begin(), and
+// starts background tasks with startup_task_start(), which it waits for
+// with startup_task_wait() before using their results, e.g.:
+//
+//    StartupTask gl = startup_task_start("gl-load", loadGL, NULL, NULL, 0);
+//    startup_phase_begin("nand");
+//    ... set up the partitions.
+//    startup_task_wait(gl);
+//
+// Phase and task names are not copied, and must be string literals.
+
+// Identifies a background startup task.
+typedef int StartupTask;
+
+typedef void (*StartupFunc)(void* opaque);
+
+// Begin the main thread phase |name|, ending the current one, if any.
+void startup_phase_begin(const char* name);
+
+// End the current main thread phase, if any.
+void startup_phase_end(void);
+
+// Start a background task |name| that calls |func(opaque)| in the shared
+// thread pool once the |depCount| tasks of |deps| have completed. |deps|
+// can be NULL if |depCount| is 0. Must be called from the main thread.
+StartupTask startup_task_start(const char* name,
+                               StartupFunc func,
+                               void* opaque,
+                               const StartupTask* deps,
+                               int depCount);
+
+// Block until |task| has completed. The time spent waiting is part of the
+// profile. Must be called from the main thread.
+void startup_task_wait(StartupTask task);
+
+// Enable or disable printing the profile with startup_profile_print().
+void startup_profile_set_enabled(bool enabled);
+bool startup_profile_enabled(void);
+
+// Write the profile of all the phases and tasks recorded so far to
+// |out|, with their start time and duration in milliseconds.
+void startup_profile_write(FILE* out);
+
+// End the current main thread phase, and print the profile to stdout if
+// it is enabled.
+void startup_profile_print(void);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_STARTUP_H
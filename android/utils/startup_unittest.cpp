@@ -0,0 +1,95 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/startup.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <stdio.h>
+
+namespace {
+
+std::string writeProfile() {
+    std::string result;
+    FILE* file = tmpfile();
+    EXPECT_TRUE(file);
+    if (!file) {
+        return result;
+    }
+    startup_profile_write(file);
+    rewind(file);
+    char buffer[256];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        result.append(buffer, len);
+    }
+    fclose(file);
+    return result;
+}
+
+void setFlag(void* opaque) {
+    __sync_fetch_and_add(static_cast<int*>(opaque), 1);
+}
+
+struct Ordered {
+    int* flag;
+    int sawFlag;
+
+    static void run(void* opaque) {
+        Ordered* o = static_cast<Ordered*>(opaque);
+        o->sawFlag = *o->flag;
+    }
+};
+
+}  // namespace
+
+TEST(startup, RunsTasksInDependencyOrder) {
+    int flag = 0;
+    Ordered ordered = { &flag, -1 };
+    StartupTask first = startup_task_start("test-first", setFlag, &flag,
+                                           NULL, 0);
+    StartupTask second = startup_task_start("test-second", Ordered::run,
+                                            &ordered, &first, 1);
+    startup_task_wait(second);
+    EXPECT_EQ(1, flag);
+    EXPECT_EQ(1, ordered.sawFlag);
+    startup_task_wait(first);
+}
+
+TEST(startup, ProfilesPhasesAndTasks) {
+    int flag = 0;
+    startup_phase_begin("test-phase-a");
+    StartupTask task = startup_task_start("test-task", setFlag, &flag,
+                                          NULL, 0);
+    startup_phase_begin("test-phase-b");
+    startup_task_wait(task);
+    startup_phase_end();
+
+    std::string profile = writeProfile();
+    EXPECT_NE(std::string::npos, profile.find("test-phase-a"));
+    EXPECT_NE(std::string::npos, profile.find("test-phase-b"));
+    EXPECT_NE(std::string::npos, profile.find("test-task"));
+    EXPECT_NE(std::string::npos, profile.find(" main\n"));
+    EXPECT_NE(std::string::npos, profile.find(" pool\n"));
+    EXPECT_NE(std::string::npos, profile.find("total"));
+    // All entries have ended.
+    EXPECT_EQ(std::string::npos, profile.find("(running)"));
+}
+
+TEST(startup, ProfileEnabled) {
+    EXPECT_FALSE(startup_profile_enabled());
+    startup_profile_set_enabled(true);
+    EXPECT_TRUE(startup_profile_enabled());
+    startup_profile_set_enabled(false);
+    EXPECT_FALSE(startup_profile_enabled());
+}
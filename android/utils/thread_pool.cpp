@@ -0,0 +1,30 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/thread_pool.h"
+
+#include "android/base/threads/ThreadPool.h"
+
+using android::base::ThreadPool;
+
+void thread_pool_post(ThreadPoolFunc func,
+                      void* opaque,
+                      ThreadPoolPriority priority,
+                      int affinity) {
+    ThreadPool::get()->post(func,
+                            opaque,
+                            static_cast<ThreadPool::Priority>(priority),
+                            affinity);
+}
+
+int thread_pool_get_worker_count(void) {
+    return ThreadPool::get()->getWorkerCount();
+}
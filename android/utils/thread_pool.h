@@ -0,0 +1,46 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_THREAD_POOL_H
+#define ANDROID_UTILS_THREAD_POOL_H
+
+#include "android/utils/compiler.h"
+
+ANDROID_BEGIN_HEADER
+
+// C wrapper around the thread pool shared by the whole program, see
+// android/base/threads/ThreadPool.h for more details.
+
+typedef void (*ThreadPoolFunc)(void* opaque);
+
+typedef enum {
+    THREAD_POOL_PRIORITY_LOW = 0,
+    THREAD_POOL_PRIORITY_NORMAL,
+    THREAD_POOL_PRIORITY_HIGH,
+} ThreadPoolPriority;
+
+// Affinity value to use when any worker can run a task.
+#define THREAD_POOL_ANY_WORKER  (-1)
+
+// Run |func(opaque)| in a worker thread of the shared pool. |priority| is
+// the task priority, and |affinity| a hint for the worker that should run
+// it, or THREAD_POOL_ANY_WORKER. Can be called from any thread.
+void thread_pool_post(ThreadPoolFunc func,
+                      void* opaque,
+                      ThreadPoolPriority priority,
+                      int affinity);
+
+// Return the number of worker threads of the shared pool.
+int thread_pool_get_worker_count(void);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_THREAD_POOL_H
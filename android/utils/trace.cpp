@@ -0,0 +1,265 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/trace.h"
+
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/threads/ThreadStore.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN 1
+#  include <windows.h>
+#elif defined(__APPLE__)
+#  include <mach/mach_time.h>
+#else
+#  include <time.h>
+#endif
+
+using android::base::LazyInstance;
+using android::base::ThreadStoreBase;
+
+unsigned android_trace_categories = 0;
+
+namespace {
+
+const char* const kCategoryNames[TRACE_CATEGORY_COUNT] = {
+    "pipe", "emugl", "fb", "nand", "mmc", "slirp", "timers", "tcg",
+};
+
+struct TraceEvent {
+    uint64_t timeNs;
+    const char* name;
+    int64_t value;
+    uint8_t category;
+    uint8_t type;
+};
+
+// Number of events kept per thread, must be a power of 2.
+const uint32_t kRingEvents = 8192;
+
+// The ring of a thread. Only its thread writes events, and updates
+// |writePos|, a free-running counter whose value modulo kRingEvents is the
+// next slot to write. Events before |startPos| were cleared.
+// Rings are never freed: when its thread exits, a ring is released and
+// reused by the next new thread that records an event.
+struct TraceRing {
+    TraceRing* next;
+    volatile int owned;
+    volatile uint32_t writePos;
+    volatile uint32_t startPos;
+    int tid;
+    TraceEvent events[kRingEvents];
+};
+
+TraceRing* volatile sRings = NULL;
+volatile int sLastTid = 0;
+
+void releaseRing(void* opaque) {
+    TraceRing* ring = static_cast<TraceRing*>(opaque);
+    __sync_synchronize();
+    ring->owned = 0;
+}
+
+struct RingStore : public ThreadStoreBase {
+    RingStore() : ThreadStoreBase(releaseRing) {}
+};
+
+LazyInstance<RingStore> sRingStore = LAZY_INSTANCE_INIT;
+
+uint64_t nowNs() {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart * (1e9 / freq.QuadPart));
+#elif defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
+    if (!timebase.denom) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+TraceRing* getRing() {
+    TraceRing* ring = static_cast<TraceRing*>(sRingStore->get());
+    if (ring) {
+        return ring;
+    }
+    // Reuse the ring of a thread that exited, if any. Its events are
+    // dropped, as they would be shown on the track of the new thread.
+    for (TraceRing* r = sRings; r; r = r->next) {
+        if (!r->owned && __sync_bool_compare_and_swap(&r->owned, 0, 1)) {
+            ring = r;
+            ring->startPos = ring->writePos;
+            break;
+        }
+    }
+    if (!ring) {
+        ring = static_cast<TraceRing*>(::calloc(1, sizeof(*ring)));
+        if (!ring) {
+            return NULL;
+        }
+        ring->owned = 1;
+        // Rings are only ever added at the head of the list.
+        do {
+            ring->next = sRings;
+        } while (!__sync_bool_compare_and_swap(&sRings, ring->next, ring));
+    }
+    ring->tid = __sync_add_and_fetch(&sLastTid, 1);
+    sRingStore->set(ring);
+    return ring;
+}
+
+// Write the event |e| recorded by thread |tid| as a JSON object.
+void writeEvent(FILE* file, const TraceEvent* e, int tid) {
+    static const char kPhases[] = { 'B', 'E', 'i', 'C' };
+    fprintf(file,
+            ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+            "\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+            e->name,
+            kCategoryNames[e->category],
+            kPhases[e->type],
+            e->timeNs / 1000.,
+            tid);
+    if (e->type == TRACE_EVENT_INSTANT) {
+        fprintf(file, ",\"s\":\"t\"");
+    } else if (e->type == TRACE_EVENT_COUNTER) {
+        fprintf(file, ",\"args\":{\"value\":%lld}", (long long)e->value);
+    }
+    fprintf(file, "}");
+}
+
+}  // namespace
+
+void trace_record(TraceCategory category,
+                  TraceEventType type,
+                  const char* name,
+                  int64_t value) {
+    TraceRing* ring = getRing();
+    if (!ring) {
+        return;
+    }
+    uint32_t pos = ring->writePos;
+    TraceEvent* e = &ring->events[pos & (kRingEvents - 1)];
+    e->timeNs = nowNs();
+    e->name = name;
+    e->value = value;
+    e->category = (uint8_t)category;
+    e->type = (uint8_t)type;
+    // Publish the event.
+    __sync_synchronize();
+    ring->writePos = pos + 1;
+}
+
+uint64_t trace_now_ns(void) {
+    return nowNs();
+}
+
+void trace_set_categories(unsigned categories) {
+    android_trace_categories = categories & TRACE_ALL_CATEGORIES;
+}
+
+const char* trace_category_name(TraceCategory category) {
+    if ((unsigned)category >= TRACE_CATEGORY_COUNT) {
+        return "unknown";
+    }
+    return kCategoryNames[category];
+}
+
+bool trace_parse_categories(const char* list, unsigned* categories) {
+    unsigned result = 0;
+    const char* p = list;
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        if (len == 3 && !memcmp(p, "all", 3)) {
+            result = TRACE_ALL_CATEGORIES;
+        } else if (len > 0) {
+            int n;
+            for (n = 0; n < TRACE_CATEGORY_COUNT; ++n) {
+                if (strlen(kCategoryNames[n]) == len &&
+                    !memcmp(p, kCategoryNames[n], len)) {
+                    break;
+                }
+            }
+            if (n == TRACE_CATEGORY_COUNT) {
+                return false;
+            }
+            result |= 1U << n;
+        }
+        p += len;
+        if (*p == ',') {
+            p++;
+        }
+    }
+    *categories = result;
+    return true;
+}
+
+void trace_clear(void) {
+    for (TraceRing* ring = sRings; ring; ring = ring->next) {
+        ring->startPos = ring->writePos;
+    }
+}
+
+int trace_write_json(FILE* file) {
+    TraceEvent* events = static_cast<TraceEvent*>(
+            ::malloc(kRingEvents * sizeof(TraceEvent)));
+    if (!events) {
+        return -1;
+    }
+    fprintf(file,
+            "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\","
+            "\"pid\":1,\"args\":{\"name\":\"emulator\"}}");
+    for (TraceRing* ring = sRings; ring; ring = ring->next) {
+        // Copy the events, then drop the ones that the thread may have
+        // overwritten in the meantime.
+        uint32_t start = ring->startPos;
+        uint32_t end = ring->writePos;
+        __sync_synchronize();
+        if (end - start > kRingEvents) {
+            start = end - kRingEvents;
+        }
+        int tid = ring->tid;
+        for (uint32_t pos = start; pos != end; ++pos) {
+            events[pos - start] = ring->events[pos & (kRingEvents - 1)];
+        }
+        __sync_synchronize();
+        uint32_t newEnd = ring->writePos;
+        uint32_t valid = start;
+        if (newEnd - start >= kRingEvents) {
+            valid = newEnd - kRingEvents + 1;
+        }
+        if (valid - start >= end - start) {
+            continue;
+        }
+        fprintf(file,
+                ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                tid, tid);
+        for (uint32_t pos = valid; pos != end; ++pos) {
+            writeEvent(file, &events[pos - start], tid);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    ::free(events);
+    return ferror(file) ? -1 : 0;
+}
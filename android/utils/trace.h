@@ -0,0 +1,121 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_TRACE_H
+#define ANDROID_UTILS_TRACE_H
+
+#include "android/utils/compiler.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+ANDROID_BEGIN_HEADER
+
+// Static tracepoints, that can be enabled at runtime per category, e.g.
+// with the 'trace' console command.
+//
+// A disabled tracepoint only costs a test of the global category mask.
+// An enabled one records a timestamped event in a ring buffer owned by
+// the calling thread, without taking any lock. Each ring keeps the most
+// recent events of its thread only, older ones are overwritten.
+//
+// The recorded events can be written at any time in the Chrome trace
+// event format, which chrome://tracing and the Perfetto UI can load.
+//
+// Usage example:
+//
+//    TRACE_BEGIN(TRACE_CATEGORY_NAND, "nand read");
+//    ... do the read.
+//    TRACE_END(TRACE_CATEGORY_NAND, "nand read");
+//
+// Event names are not copied, and must be string literals.
+
+// NOTE: The values of TRACE_CATEGORY_EMUGL and TRACE_CATEGORY_FB are also
+// used by the EmuGL libraries, see emugl/common/trace.h.
+typedef enum {
+    TRACE_CATEGORY_PIPE = 0,
+    TRACE_CATEGORY_EMUGL,
+    TRACE_CATEGORY_FB,
+    TRACE_CATEGORY_NAND,
+    TRACE_CATEGORY_MMC,
+    TRACE_CATEGORY_SLIRP,
+    TRACE_CATEGORY_TIMERS,
+    TRACE_CATEGORY_TCG,
+    TRACE_CATEGORY_COUNT
+} TraceCategory;
+
+#define TRACE_ALL_CATEGORIES  ((1U << TRACE_CATEGORY_COUNT) - 1)
+
+typedef enum {
+    TRACE_EVENT_BEGIN = 0,  // Start of a slice on the thread's track.
+    TRACE_EVENT_END,        // End of the last slice started.
+    TRACE_EVENT_INSTANT,    // A single point in time.
+    TRACE_EVENT_COUNTER,    // New value of a counter.
+} TraceEventType;
+
+// Mask of the enabled categories, don't modify directly.
+extern unsigned android_trace_categories;
+
+#define TRACE_ENABLED(category) \
+    ((android_trace_categories >> (category)) & 1U)
+
+#define TRACE_EVENT_(category, type, name, value) \
+    do { \
+        if (TRACE_ENABLED(category)) { \
+            trace_record(category, type, name, value); \
+        } \
+    } while (0)
+
+#define TRACE_BEGIN(category, name) \
+    TRACE_EVENT_(category, TRACE_EVENT_BEGIN, name, 0)
+
+#define TRACE_END(category, name) \
+    TRACE_EVENT_(category, TRACE_EVENT_END, name, 0)
+
+#define TRACE_INSTANT(category, name) \
+    TRACE_EVENT_(category, TRACE_EVENT_INSTANT, name, 0)
+
+#define TRACE_COUNTER(category, name, value) \
+    TRACE_EVENT_(category, TRACE_EVENT_COUNTER, name, value)
+
+// Record an event in the calling thread's ring. Use the macros above
+// instead, which check whether |category| is enabled first.
+void trace_record(TraceCategory category,
+                  TraceEventType type,
+                  const char* name,
+                  int64_t value);
+
+// Return the current time of the monotonic clock that timestamps the
+// events, in nanoseconds.
+uint64_t trace_now_ns(void);
+
+// Set the mask of enabled categories. Events already recorded are kept.
+void trace_set_categories(unsigned categories);
+
+// Return the name of |category|, e.g. "nand".
+const char* trace_category_name(TraceCategory category);
+
+// Parse a comma-separated list of category names, or "all", into a mask.
+// Return false if |list| contains an unknown name.
+bool trace_parse_categories(const char* list, unsigned* categories);
+
+// Discard all the recorded events.
+void trace_clear(void);
+
+// Write all the recorded events to |file| as a JSON trace. Events that
+// are recorded concurrently may or may not be included. Return 0 on
+// success, or -1 on error.
+int trace_write_json(FILE* file);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_TRACE_H
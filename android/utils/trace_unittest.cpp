@@ -0,0 +1,118 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/trace.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <stdio.h>
+
+namespace {
+
+std::string writeTrace() {
+    std::string result;
+    FILE* file = tmpfile();
+    EXPECT_TRUE(file);
+    if (!file) {
+        return result;
+    }
+    EXPECT_EQ(0, trace_write_json(file));
+    rewind(file);
+    char buffer[256];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        result.append(buffer, len);
+    }
+    fclose(file);
+    return result;
+}
+
+size_t countOccurrences(const std::string& str, const char* pattern) {
+    size_t count = 0;
+    size_t pos = 0;
+    while ((pos = str.find(pattern, pos)) != std::string::npos) {
+        count++;
+        pos++;
+    }
+    return count;
+}
+
+}  // namespace
+
+TEST(trace, ParseCategories) {
+    unsigned categories = 1234;
+    EXPECT_TRUE(trace_parse_categories("", &categories));
+    EXPECT_EQ(0U, categories);
+
+    EXPECT_TRUE(trace_parse_categories("all", &categories));
+    EXPECT_EQ(TRACE_ALL_CATEGORIES, categories);
+
+    EXPECT_TRUE(trace_parse_categories("nand,tcg", &categories));
+    EXPECT_EQ((1U << TRACE_CATEGORY_NAND) | (1U << TRACE_CATEGORY_TCG),
+              categories);
+
+    categories = 1234;
+    EXPECT_FALSE(trace_parse_categories("nand,foo", &categories));
+    EXPECT_FALSE(trace_parse_categories("tc", &categories));
+    EXPECT_EQ(1234U, categories);
+
+    EXPECT_STREQ("pipe", trace_category_name(TRACE_CATEGORY_PIPE));
+    EXPECT_STREQ("timers", trace_category_name(TRACE_CATEGORY_TIMERS));
+}
+
+TEST(trace, RecordsEnabledCategoriesOnly) {
+    trace_clear();
+    trace_set_categories(1U << TRACE_CATEGORY_MMC);
+    EXPECT_TRUE(TRACE_ENABLED(TRACE_CATEGORY_MMC));
+    EXPECT_FALSE(TRACE_ENABLED(TRACE_CATEGORY_NAND));
+
+    TRACE_BEGIN(TRACE_CATEGORY_MMC, "mmc test");
+    TRACE_BEGIN(TRACE_CATEGORY_NAND, "nand test");
+    TRACE_END(TRACE_CATEGORY_MMC, "mmc test");
+    TRACE_INSTANT(TRACE_CATEGORY_MMC, "mmc instant");
+    TRACE_COUNTER(TRACE_CATEGORY_MMC, "mmc counter", 42);
+    trace_set_categories(0);
+    TRACE_INSTANT(TRACE_CATEGORY_MMC, "mmc disabled");
+
+    std::string json = writeTrace();
+    EXPECT_EQ(0U, json.find("{\"traceEvents\":["));
+    EXPECT_EQ(2U, countOccurrences(json, "\"name\":\"mmc test\""));
+    EXPECT_EQ(1U, countOccurrences(json, "\"ph\":\"B\""));
+    EXPECT_EQ(1U, countOccurrences(json, "\"ph\":\"E\""));
+    EXPECT_EQ(1U, countOccurrences(json, "\"name\":\"mmc instant\""));
+    EXPECT_EQ(1U, countOccurrences(json, "\"args\":{\"value\":42}"));
+    EXPECT_EQ(0U, countOccurrences(json, "nand test"));
+    EXPECT_EQ(0U, countOccurrences(json, "mmc disabled"));
+    EXPECT_EQ(4U, countOccurrences(json, "\"cat\":\"mmc\""));
+
+    trace_clear();
+    json = writeTrace();
+    EXPECT_EQ(0U, countOccurrences(json, "\"cat\":"));
+}
+
+TEST(trace, KeepsMostRecentEvents) {
+    trace_clear();
+    trace_set_categories(1U << TRACE_CATEGORY_TCG);
+    for (int n = 0; n < 100000; ++n) {
+        TRACE_INSTANT(TRACE_CATEGORY_TCG, "tcg instant");
+    }
+    TRACE_INSTANT(TRACE_CATEGORY_TCG, "tcg last");
+    trace_set_categories(0);
+
+    std::string json = writeTrace();
+    size_t count = countOccurrences(json, "\"cat\":\"tcg\"");
+    EXPECT_GT(count, 1000U);
+    EXPECT_LT(count, 100000U);
+    EXPECT_EQ(1U, countOccurrences(json, "tcg last"));
+    trace_clear();
+}
@@ -67,18 +67,14 @@ private:
          // wait for "OKAY" from adb, then send the query command(which is transferred
          // by adb to the device), and read reply from adb until adb disconnect
 
-         // get product name to distinguish wear from phone
-         TO_GET_PRODUCT_NAME_INIT_XFER,
-         TO_GET_PRODUCT_NAME_WAIT_OKAY,
-         TO_GET_PRODUCT_NAME_SEND_CMD,
-         TO_GET_PRODUCT_NAME_READ_REPLY,
-
-         // find out if the phone has wearable app, which is responsible for communication
-         // with wear
-         TO_GET_WEARABLE_APP_INIT_XFER,
-         TO_GET_WEARABLE_APP_WAIT_OKAY,
-         TO_GET_WEARABLE_APP_SEND_CMD,
-         TO_GET_WEARABLE_APP_READ_REPLY,
+         // get product name to distinguish wear from phone, and find out if
+         // the phone has wearable app, which is responsible for communication
+         // with wear. Both are asked in a single shell command, so that each
+         // device costs a single adb connection
+         TO_PROBE_DEVICE_INIT_XFER,
+         TO_PROBE_DEVICE_WAIT_OKAY,
+         TO_PROBE_DEVICE_SEND_CMD,
+         TO_PROBE_DEVICE_READ_REPLY,
 
          // perform ip forwarding on real device
          // "host-serial:phone-serial-number:forward:tcp:5601;5601"
@@ -98,8 +94,7 @@ private:
     enum MessageType {
          TRANSFER = 1,
          FORWARDIP,
-         PROPERTY,
-         WEARABLE_APP_PKG
+         PROBE
     };
     static const int READ_BUFFER_SIZE  = 1024;
     static const int WRITE_BUFFER_SIZE = 1024;
@@ -206,31 +201,16 @@ static void _on_emulator_console_socket_fd(void* opaque, int fd, unsigned events
 void PairUpWearPhoneImpl::readAdbServerSocket() {
 
     switch(mState) {
-        case TO_GET_PRODUCT_NAME_WAIT_OKAY:
+        case TO_PROBE_DEVICE_WAIT_OKAY:
             if (!completeReadHeaderFromAdb()) return;
-            if (!startWriteCommandToAdb(PROPERTY, "ro.product.name")) return;
-            mState = TO_GET_PRODUCT_NAME_SEND_CMD;
+            if (!startWriteCommandToAdb(PROBE, kWearableAppName)) return;
+            mState = TO_PROBE_DEVICE_SEND_CMD;
             return;
 
-        case TO_GET_PRODUCT_NAME_READ_REPLY:
+        case TO_PROBE_DEVICE_READ_REPLY:
             if (!completeReadAllDataFromAdb()) return;
-            if (checkForWearDevice()) {
-                startConnectWearAndPhone();
-                return;
-            }
-            if (!startWriteCommandToAdb(TRANSFER, mDeviceInProbing.c_str())) return;
-            mState = TO_GET_WEARABLE_APP_INIT_XFER;
-            return;
-
-        case TO_GET_WEARABLE_APP_WAIT_OKAY:
-            if (!completeReadHeaderFromAdb()) return;
-            if (!startWriteCommandToAdb(WEARABLE_APP_PKG, kWearableAppName)) return;
-            mState = TO_GET_WEARABLE_APP_SEND_CMD;
-            return;
-
-        case TO_GET_WEARABLE_APP_READ_REPLY:
-            if (!completeReadAllDataFromAdb()) return;
-            if (checkForCompatiblePhone()) {
+            // A watch may have the wearable app too, so check for it first.
+            if (checkForWearDevice() || checkForCompatiblePhone()) {
                 startConnectWearAndPhone();
                 return;
             }
@@ -251,28 +231,15 @@ void PairUpWearPhoneImpl::readAdbServerSocket() {
 void PairUpWearPhoneImpl::writeAdbServerSocket() {
 
     switch (mState) {
-        case TO_GET_PRODUCT_NAME_INIT_XFER:
+        case TO_PROBE_DEVICE_INIT_XFER:
             if (!completeWriteCommandToAdb()) return;
             if (!startReadHeaderFromAdb()) return;
-            mState = TO_GET_PRODUCT_NAME_WAIT_OKAY;
+            mState = TO_PROBE_DEVICE_WAIT_OKAY;
             return;
 
-        case TO_GET_PRODUCT_NAME_SEND_CMD:
+        case TO_PROBE_DEVICE_SEND_CMD:
             if (!completeWriteCommandToAdb()) return;
-            mState = TO_GET_PRODUCT_NAME_READ_REPLY;
-            mReply.clear();
-            switchToRead(&mAdbWatch);
-            return;
-
-        case TO_GET_WEARABLE_APP_INIT_XFER:
-            if (!completeWriteCommandToAdb()) return;
-            if (!startReadHeaderFromAdb()) return;
-            mState = TO_GET_WEARABLE_APP_WAIT_OKAY;
-            return;
-
-        case TO_GET_WEARABLE_APP_SEND_CMD:
-            if (!completeWriteCommandToAdb()) return;
-            mState = TO_GET_WEARABLE_APP_READ_REPLY;
+            mState = TO_PROBE_DEVICE_READ_REPLY;
             mReply.clear();
             switchToRead(&mAdbWatch);
             return;
@@ -384,11 +351,10 @@ bool PairUpWearPhoneImpl::startWriteCommandToAdb(int queryType,
         case TRANSFER:
             snprintf(buf2, sizeof(buf2), "host:transport:%s", message);
             break;
-        case PROPERTY:
-            snprintf(buf2, sizeof(buf2), "shell:getprop %s", message);
-            break;
-        case WEARABLE_APP_PKG:
-            snprintf(buf2, sizeof(buf2), "shell:pm list packages %s", message);
+        case PROBE:
+            snprintf(buf2, sizeof(buf2),
+                     "shell:getprop ro.product.name;pm list packages %s",
+                     message);
             break;
         case FORWARDIP:
             snprintf(buf2, sizeof(buf2), "host-serial:%s:forward:tcp:5601;tcp:5601", message);
@@ -508,7 +474,7 @@ void PairUpWearPhoneImpl::startProbeNextDevice() {
     mUnprobedDevices.pop();
 
     if (startWriteCommandToAdb(TRANSFER, mDeviceInProbing.c_str())) {
-        mState = TO_GET_PRODUCT_NAME_INIT_XFER;
+        mState = TO_PROBE_DEVICE_INIT_XFER;
     } else {
         mState = PAIRUP_ERROR;
     }
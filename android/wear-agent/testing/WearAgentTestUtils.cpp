@@ -110,7 +110,8 @@ bool testRunMockAdbServer(int adbServerSocket,
                           const char* phoneDevice,
                           bool usbPhone) {
     char buf[1024] = {'\0'};
-    const char kProperty[] = "shell:getprop ro.product.name";
+    const char kProbe[] = "shell:getprop ro.product.name;"
+                          "pm list packages com.google.android.wearable";
 
     // query regarding the watch
     {
@@ -124,8 +125,9 @@ bool testRunMockAdbServer(int adbServerSocket,
 
         if (!testExpectMessageFromSocket(s.get(), buf) ||
             !testSendToSocket(s.get(), "OKAY") ||
-            !testExpectMessageFromSocket(s.get(), kProperty) ||
-            !testSendToSocket(s.get(), "OKAYclockwork")) {
+            !testExpectMessageFromSocket(s.get(), kProbe) ||
+            !testSendToSocket(s.get(), "OKAYclockwork\r\n"
+                              "package:com.google.android.wearable.app")) {
             return false;
         }
     }
@@ -140,26 +142,9 @@ bool testRunMockAdbServer(int adbServerSocket,
         snprintf(buf, sizeof(buf), "host:transport:%s", phoneDevice);
         if (!testExpectMessageFromSocket(s.get(), buf) ||
             !testSendToSocket(s.get(), "OKAY") ||
-            !testExpectMessageFromSocket(s.get(), kProperty) ||
-            !testSendToSocket(s.get(), "OKAYsdk")) {
-            return false;
-        }
-    }
-
-    const char kPackages[] =
-            "shell:pm list packages com.google.android.wearable";
-
-    {
-        ScopedSocket s(socketAcceptAny(adbServerSocket));
-        if (!s.valid()) {
-            return false;
-        }
-
-        snprintf(buf, sizeof(buf), "host:transport:%s", phoneDevice);
-        if (!testExpectMessageFromSocket(s.get(), buf) ||
-            !testSendToSocket(s.get(), "OKAY") ||
-            !testExpectMessageFromSocket(s.get(), kPackages) ||
-            !testSendToSocket(s.get(), "com.google.android.wearable.app")) {
+            !testExpectMessageFromSocket(s.get(), kProbe) ||
+            !testSendToSocket(s.get(), "OKAYsdk\r\n"
+                              "package:com.google.android.wearable.app")) {
             return false;
         }
     }
@@ -40,9 +40,15 @@
 #include "migration/migration.h"
 #include "migration/qemu-file.h"
 #include "net/net.h"
+#include "qemu/thread.h"
 #include "exec/gdbstub.h"
 #include "exec/ram_addr.h"
+#include "exec/hax.h"
 #include "hw/i386/smbios.h"
+#include "qemu/timer.h"
+#include "qemu/bufferiszero.h"
+#include "android/snapshot-flat.h"
+#include <zlib.h>
 
 #ifdef TARGET_SPARC
 int graphic_width = 1024;
@@ -94,83 +100,298 @@ const uint32_t arch_type = QEMU_ARCH;
 #define RAM_SAVE_FLAG_PAGE     0x08
 #define RAM_SAVE_FLAG_EOS      0x10
 #define RAM_SAVE_FLAG_CONTINUE 0x20
+#define RAM_SAVE_FLAG_ZPAGE    0x40 /* zlib-compressed page, version 5 */
+#define RAM_SAVE_FLAG_BATCH    0x80 /* page index then page data, version 6 */
 
 static int is_dup_page(uint8_t *page, uint8_t ch)
 {
-    uint32_t val = ch << 24 | ch << 16 | ch << 8 | ch;
-    uint32_t *array = (uint32_t *)page;
-    int i;
+    return buffer_is_filled(page, TARGET_PAGE_SIZE, ch);
+}
+
+/*
+ * Pages are not written to the stream as soon as they are found dirty.
+ * Instead, they are queued into a batch which is processed by a pool of
+ * worker threads: each page is either detected as a duplicate, compressed
+ * with zlib, or kept raw if it doesn't compress. The batch is then written
+ * to the stream in order. Loading uses the same pool to decompress batches
+ * of consecutive RAM_SAVE_FLAG_ZPAGE records in parallel.
+ *
+ * A page never appears twice in a batch: batches are always flushed before
+ * the end of a ram_save_live() pass, and a page is only sent once per pass.
+ */
 
-    for (i = 0; i < (TARGET_PAGE_SIZE / 4); i++) {
-        if (array[i] != val) {
-            return 0;
+#define RAM_ZPAGE_BATCH        256
+#define RAM_ZPAGE_MAX_THREADS  8
+
+typedef struct {
+    RAMBlock *block;
+    ram_addr_t offset;
+    uint8_t *host;
+    int dup;                /* save only: page is filled with host[0] */
+    int failed;             /* load only: decompression error */
+    int mapped;             /* load only: mapped from the snapshot file */
+    uLongf zlen;            /* 0 if the page isn't compressed */
+    uint8_t zbuf[TARGET_PAGE_SIZE];
+} RamZPage;
+
+static struct {
+    QemuMutex lock;
+    QemuCond work_cond;
+    QemuCond done_cond;
+    int started;
+    int nthreads;
+    int decompress;
+    int count;              /* number of pages in the current job */
+    int next;               /* next page to be picked by a thread */
+    int done;               /* number of processed pages */
+} ram_zpool;
+
+static RamZPage ram_zbatch[RAM_ZPAGE_BATCH];
+static int ram_zbatch_count;
+
+static void ram_zpage_process(RamZPage *page, int decompress)
+{
+    if (decompress) {
+        uLongf len = TARGET_PAGE_SIZE;
+        if (page->zlen == 0) {
+            /* raw page, already copied to guest memory */
+            page->failed = 0;
+            return;
+        }
+        page->failed = uncompress(page->host, &len, page->zbuf,
+                                  page->zlen) != Z_OK ||
+                       len != TARGET_PAGE_SIZE;
+        return;
+    }
+    page->dup = is_dup_page(page->host, *page->host);
+    page->zlen = 0;
+    /* Raw pages can be shared when the snapshot is restored */
+    if (!page->dup && !ram_shared_restore) {
+        uLongf len = sizeof(page->zbuf) - 1;
+        if (compress2(page->zbuf, &len, page->host, TARGET_PAGE_SIZE,
+                      Z_BEST_SPEED) == Z_OK) {
+            page->zlen = len;
         }
     }
+}
 
-    return 1;
+/* Process pages from the current job until there are none left.
+ * Must be called with ram_zpool.lock held. */
+static void ram_zpool_work_locked(void)
+{
+    while (ram_zpool.next < ram_zpool.count) {
+        int i = ram_zpool.next++;
+        int decompress = ram_zpool.decompress;
+        qemu_mutex_unlock(&ram_zpool.lock);
+        ram_zpage_process(&ram_zbatch[i], decompress);
+        qemu_mutex_lock(&ram_zpool.lock);
+        if (++ram_zpool.done == ram_zpool.count) {
+            qemu_cond_signal(&ram_zpool.done_cond);
+        }
+    }
+}
+
+static void *ram_zpool_thread(void *opaque)
+{
+    qemu_mutex_lock(&ram_zpool.lock);
+    for (;;) {
+        while (ram_zpool.next >= ram_zpool.count) {
+            qemu_cond_wait(&ram_zpool.work_cond, &ram_zpool.lock);
+        }
+        ram_zpool_work_locked();
+    }
+    qemu_mutex_unlock(&ram_zpool.lock);
+    return NULL;
+}
+
+static int ram_zpool_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+#endif
+}
+
+/* Process the first |count| pages of ram_zbatch, using the calling thread
+ * and the worker threads, which are started on first use. */
+static void ram_zpool_run(int count, int decompress)
+{
+    if (!ram_zpool.started) {
+        int i;
+        ram_zpool.started = 1;
+        qemu_mutex_init(&ram_zpool.lock);
+        qemu_cond_init(&ram_zpool.work_cond);
+        qemu_cond_init(&ram_zpool.done_cond);
+        ram_zpool.nthreads = ram_zpool_cpu_count() - 1;
+        if (ram_zpool.nthreads > RAM_ZPAGE_MAX_THREADS) {
+            ram_zpool.nthreads = RAM_ZPAGE_MAX_THREADS;
+        }
+        for (i = 0; i < ram_zpool.nthreads; i++) {
+            QemuThread thread;
+            qemu_thread_create(&thread, ram_zpool_thread, NULL,
+                               QEMU_THREAD_DETACHED);
+        }
+    }
+
+    qemu_mutex_lock(&ram_zpool.lock);
+    ram_zpool.decompress = decompress;
+    ram_zpool.count = count;
+    ram_zpool.next = 0;
+    ram_zpool.done = 0;
+    qemu_cond_broadcast(&ram_zpool.work_cond);
+    ram_zpool_work_locked();
+    while (ram_zpool.done < ram_zpool.count) {
+        qemu_cond_wait(&ram_zpool.done_cond, &ram_zpool.lock);
+    }
+    ram_zpool.count = 0;
+    ram_zpool.next = 0;
+    qemu_mutex_unlock(&ram_zpool.lock);
+}
+
+/* Block of the last page written to the stream, for RAM_SAVE_FLAG_CONTINUE */
+static RAMBlock *last_sent_block;
+
+/* Cluster size of the snapshot image the stream is written to, or 0 */
+static int ram_save_align;
+
+static void ram_put_page_header(QEMUFile *f, RAMBlock *block,
+                                ram_addr_t offset, int flags)
+{
+    if (block == last_sent_block) {
+        qemu_put_be64(f, offset | flags | RAM_SAVE_FLAG_CONTINUE);
+    } else {
+        qemu_put_be64(f, offset | flags);
+        qemu_put_byte(f, strlen(block->idstr));
+        qemu_put_buffer(f, (uint8_t *)block->idstr, strlen(block->idstr));
+        last_sent_block = block;
+    }
+}
+
+/* Compress the queued pages and write them to the stream as a single
+ * RAM_SAVE_FLAG_BATCH record. The record starts with an index giving the
+ * kind and size of each page, followed by the data of all non-duplicate
+ * pages, so that a reader can locate any page without reading the data of
+ * the others (see ram_load_batch()).
+ *
+ * When writing a snapshot, the data is aligned on a cluster boundary with
+ * some padding. Since pages are always compressed the same way and sent in
+ * the same order, a batch whose pages didn't change since the previous
+ * snapshot then produces the same clusters, which the image can share
+ * instead of storing them again. */
+static void ram_save_flush(QEMUFile *f)
+{
+    int i, pad = 0;
+    int64_t data_size = 0;
+
+    if (ram_zbatch_count == 0) {
+        return;
+    }
+    ram_zpool_run(ram_zbatch_count, 0);
+
+    qemu_put_be64(f, RAM_SAVE_FLAG_BATCH);
+    qemu_put_be16(f, ram_zbatch_count);
+    for (i = 0; i < ram_zbatch_count; i++) {
+        RamZPage *page = &ram_zbatch[i];
+        if (page->dup) {
+            ram_put_page_header(f, page->block, page->offset,
+                                RAM_SAVE_FLAG_COMPRESS);
+            qemu_put_byte(f, *page->host);
+        } else if (page->zlen) {
+            ram_put_page_header(f, page->block, page->offset,
+                                RAM_SAVE_FLAG_ZPAGE);
+            qemu_put_be16(f, page->zlen);
+        } else {
+            ram_put_page_header(f, page->block, page->offset,
+                                RAM_SAVE_FLAG_PAGE);
+        }
+        if (!page->dup) {
+            data_size += page->zlen ? page->zlen : TARGET_PAGE_SIZE;
+        }
+    }
+    if (ram_save_align && data_size >= ram_save_align) {
+        pad = ram_save_align - (qemu_file_get_pos(f) + 4) % ram_save_align;
+        pad %= ram_save_align;
+    }
+    qemu_put_be32(f, pad);
+    for (i = 0; i < pad; i++) {
+        qemu_put_byte(f, 0);
+    }
+    for (i = 0; i < ram_zbatch_count; i++) {
+        RamZPage *page = &ram_zbatch[i];
+        if (page->dup) {
+            continue;
+        }
+        if (page->zlen) {
+            qemu_put_buffer_async(f, page->zbuf, page->zlen);
+        } else {
+            qemu_put_buffer_async(f, page->host, TARGET_PAGE_SIZE);
+        }
+    }
+    /* The pages were queued without being copied, hand them to the file
+     * before the next batch reuses the compression buffers. */
+    qemu_fflush(f);
+    ram_zbatch_count = 0;
 }
 
 static RAMBlock *last_block;
 static ram_addr_t last_offset;
 
+/* Queue the next dirty page, searching from where the previous call
+ * stopped, and wrapping around once. Dirty pages are found a bitmap word
+ * at a time, so that passes over mostly clean RAM are cheap. */
 static int ram_save_block(QEMUFile *f)
 {
     RAMBlock *block = last_block;
     ram_addr_t offset = last_offset;
-    ram_addr_t current_addr;
+    RAMBlock *start_block;
+    ram_addr_t start_offset;
+    bool wrapped = false;
     int bytes_sent = 0;
 
     if (!block)
         block = QTAILQ_FIRST(&ram_list.blocks);
+    start_block = block;
+    start_offset = offset;
 
-    current_addr = block->offset + offset;
+    for (;;) {
+        /* When back to the first block, only search up to the start */
+        ram_addr_t end = block->offset +
+                         (wrapped ? start_offset : block->length);
+        ram_addr_t addr = cpu_physical_memory_next_dirty(
+                block->offset + offset, end, DIRTY_MEMORY_MIGRATION);
 
-    do {
-        if (cpu_physical_memory_get_dirty(current_addr, TARGET_PAGE_SIZE,
-                                          DIRTY_MEMORY_MIGRATION)) {
-            uint8_t *p;
-            int cont = (block == last_block) ? RAM_SAVE_FLAG_CONTINUE : 0;
+        if (addr < end) {
+            RamZPage *page;
 
-            cpu_physical_memory_reset_dirty(current_addr,
-                                            TARGET_PAGE_SIZE,
+            offset = addr - block->offset;
+            cpu_physical_memory_reset_dirty(addr, TARGET_PAGE_SIZE,
                                             DIRTY_MEMORY_MIGRATION);
 
-            p = block->host + offset;
-
-            if (is_dup_page(p, *p)) {
-                qemu_put_be64(f, offset | cont | RAM_SAVE_FLAG_COMPRESS);
-                if (!cont) {
-                    qemu_put_byte(f, strlen(block->idstr));
-                    qemu_put_buffer(f, (uint8_t *)block->idstr,
-                                    strlen(block->idstr));
-                }
-                qemu_put_byte(f, *p);
-                bytes_sent = 1;
-            } else {
-                qemu_put_be64(f, offset | cont | RAM_SAVE_FLAG_PAGE);
-                if (!cont) {
-                    qemu_put_byte(f, strlen(block->idstr));
-                    qemu_put_buffer(f, (uint8_t *)block->idstr,
-                                    strlen(block->idstr));
-                }
-                qemu_put_buffer(f, p, TARGET_PAGE_SIZE);
-                bytes_sent = TARGET_PAGE_SIZE;
+            page = &ram_zbatch[ram_zbatch_count++];
+            page->block = block;
+            page->offset = offset;
+            page->host = block->host + offset;
+            if (ram_zbatch_count == RAM_ZPAGE_BATCH) {
+                ram_save_flush(f);
             }
-
+            bytes_sent = TARGET_PAGE_SIZE;
             break;
         }
-
-        offset += TARGET_PAGE_SIZE;
-        if (offset >= block->length) {
-            offset = 0;
-            block = QTAILQ_NEXT(block, next);
-            if (!block)
-                block = QTAILQ_FIRST(&ram_list.blocks);
+        if (wrapped) {
+            offset = start_offset;
+            break;
         }
 
-        current_addr = block->offset + offset;
-
-    } while (current_addr != last_block->offset + last_offset);
+        offset = 0;
+        block = QTAILQ_NEXT(block, next);
+        if (!block)
+            block = QTAILQ_FIRST(&ram_list.blocks);
+        wrapped = (block == start_block);
+    }
 
     last_block = block;
     last_offset = offset;
@@ -186,14 +407,8 @@ static ram_addr_t ram_save_remaining(void)
     ram_addr_t count = 0;
 
     QTAILQ_FOREACH(block, &ram_list.blocks, next) {
-        ram_addr_t addr;
-        for (addr = block->offset; addr < block->offset + block->length;
-             addr += TARGET_PAGE_SIZE) {
-            if (cpu_physical_memory_get_dirty(addr, TARGET_PAGE_SIZE,
-                                              DIRTY_MEMORY_MIGRATION)) {
-                count++;
-            }
-        }
+        count += cpu_physical_memory_count_dirty(block->offset, block->length,
+                                                 DIRTY_MEMORY_MIGRATION);
     }
 
     return count;
@@ -255,12 +470,12 @@ static void sort_ram_list(void)
 
 int ram_save_live(QEMUFile *f, int stage, void *opaque)
 {
-    ram_addr_t addr;
     uint64_t bytes_transferred_last;
     double bwidth = 0;
     uint64_t expected_time = 0;
 
     if (stage < 0) {
+        ram_zbatch_count = 0;
         cpu_physical_memory_set_dirty_tracking(0);
         return 0;
     }
@@ -272,21 +487,20 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
 
     if (stage == 1) {
         RAMBlock *block;
+        ram_lazy_load_all();
         bytes_transferred = 0;
         last_block = NULL;
         last_offset = 0;
+        last_sent_block = NULL;
+        ram_zbatch_count = 0;
+        ram_save_align = qemu_file_get_cluster_size(f);
         sort_ram_list();
 
         /* Make sure all dirty bits are set */
         QTAILQ_FOREACH(block, &ram_list.blocks, next) {
-            for (addr = block->offset; addr < block->offset + block->length;
-                 addr += TARGET_PAGE_SIZE) {
-                if (!cpu_physical_memory_get_dirty(addr, TARGET_PAGE_SIZE,
-                                                   DIRTY_MEMORY_MIGRATION)) {
-                    cpu_physical_memory_set_dirty_flag(
-                            addr, DIRTY_MEMORY_MIGRATION);
-                }
-            }
+            bitmap_set(ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION],
+                       block->offset >> TARGET_PAGE_BITS,
+                       block->length >> TARGET_PAGE_BITS);
         }
 
         /* Enable dirty memory tracking */
@@ -334,6 +548,7 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
         cpu_physical_memory_set_dirty_tracking(0);
     }
 
+    ram_save_flush(f);
     qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
 
     expected_time = ram_save_remaining() * TARGET_PAGE_SIZE / bwidth;
@@ -341,9 +556,9 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
     return (stage == 2) && (expected_time <= migrate_max_downtime());
 }
 
-static inline void *host_from_stream_offset(QEMUFile *f,
-                                            ram_addr_t offset,
-                                            int flags)
+static RAMBlock *block_from_stream_offset(QEMUFile *f,
+                                          ram_addr_t offset,
+                                          int flags)
 {
     static RAMBlock *block = NULL;
     char id[256];
@@ -355,7 +570,7 @@ static inline void *host_from_stream_offset(QEMUFile *f,
             return NULL;
         }
 
-        return block->host + offset;
+        return offset < block->length ? block : NULL;
     }
 
     len = qemu_get_byte(f);
@@ -364,21 +579,723 @@ static inline void *host_from_stream_offset(QEMUFile *f,
 
     QTAILQ_FOREACH(block, &ram_list.blocks, next) {
         if (!strncmp(id, block->idstr, sizeof(id)))
-            return block->host + offset;
+            return offset < block->length ? block : NULL;
     }
 
     fprintf(stderr, "Can't find block %s!\n", id);
     return NULL;
 }
 
+static inline void *host_from_stream_offset(QEMUFile *f,
+                                            ram_addr_t offset,
+                                            int flags)
+{
+    RAMBlock *block = block_from_stream_offset(f, offset, flags);
+
+    return block ? block->host + offset : NULL;
+}
+
+/* Decompress the queued compressed pages into guest memory.
+ * Returns 0 on success, or -EINVAL if one of them is corrupted. */
+static int ram_load_flush(void)
+{
+    int i, count = ram_zbatch_count;
+
+    if (count == 0) {
+        return 0;
+    }
+    ram_zbatch_count = 0;
+    ram_zpool_run(count, 1);
+    for (i = 0; i < count; i++) {
+        if (ram_zbatch[i].failed) {
+            fprintf(stderr, "Corrupted compressed RAM page!\n");
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Shared restore: when loading a snapshot with ram_shared_restore set, the
+ * raw pages of each RAM_SAVE_FLAG_BATCH record that are stored as-is in the
+ * image file are mapped copy-on-write over guest memory with MAP_PRIVATE,
+ * instead of being read. Until the guest writes to them, they are backed by
+ * the host page cache, so several emulators restoring the same snapshot
+ * file share a single copy of them. The pages the guest modifies become
+ * anonymous, and are marked with MADV_MERGEABLE like the rest of guest
+ * memory, so that KSM can still merge the identical ones.
+ *
+ * Snapshots only contain raw pages when saved with ram_shared_restore set,
+ * since pages are otherwise compressed whenever possible. Mapping requires
+ * the data of a page to be aligned on a host page boundary in the file,
+ * which the padding of version 7 batches provides.
+ *
+ * The image file must not change while pages are mapped from it. Before
+ * the emulator writes to or deletes a snapshot, ram_lazy_load_all() calls
+ * ram_shared_detach() to copy them back into anonymous memory.
+ */
+
+int ram_shared_restore;
+
+typedef struct RamSharedRange {
+    uint8_t *host;
+    size_t len;
+} RamSharedRange;
+
+static struct {
+    int fd;                 /* image file the pages are mapped from */
+    char *filename;
+    RamSharedRange *ranges;
+    int count;
+    int max;
+} ram_shared = { .fd = -1 };
+
+static bool ram_shared_block_ok(RAMBlock *block)
+{
+#ifndef _WIN32
+    return !hax_enabled() && (!kvm_enabled() || kvm_has_sync_mmu()) &&
+           block->fd < 0 && !(block->flags & RAM_PREALLOC_MASK) &&
+           !block->page_size;
+#else
+    return false;
+#endif
+}
+
+#ifndef _WIN32
+/* Map |len| bytes at |offset| in |filename| over the guest memory at
+ * |host|. Returns 0 on success, -errno otherwise. */
+static int ram_shared_map(uint8_t *host, size_t len, const char *filename,
+                          int64_t offset)
+{
+    RamSharedRange *last;
+    void *addr;
+
+    if (ram_shared.fd < 0 || strcmp(ram_shared.filename, filename)) {
+        if (ram_shared.fd >= 0) {
+            close(ram_shared.fd);
+            g_free(ram_shared.filename);
+        }
+        ram_shared.fd = qemu_open(filename, O_RDONLY);
+        if (ram_shared.fd < 0) {
+            return -errno;
+        }
+        ram_shared.filename = g_strdup(filename);
+    }
+
+    addr = mmap(host, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                ram_shared.fd, offset);
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        /* The previous mapping may be gone, but the page data will still
+         * be read into a new anonymous one. */
+        if (mmap(host, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) ==
+            MAP_FAILED) {
+            fprintf(stderr, "Could not restore guest memory mapping: %s\n",
+                    strerror(errno));
+            abort();
+        }
+        qemu_madvise(host, len, QEMU_MADV_MERGEABLE);
+        return -err;
+    }
+    qemu_madvise(host, len, QEMU_MADV_MERGEABLE);
+
+    last = ram_shared.count ? &ram_shared.ranges[ram_shared.count - 1] : NULL;
+    if (last && last->host + last->len == host) {
+        last->len += len;
+        return 0;
+    }
+    if (ram_shared.count == ram_shared.max) {
+        ram_shared.max = ram_shared.max ? ram_shared.max * 2 : 64;
+        ram_shared.ranges = g_renew(RamSharedRange, ram_shared.ranges,
+                                    ram_shared.max);
+    }
+    ram_shared.ranges[ram_shared.count].host = host;
+    ram_shared.ranges[ram_shared.count].len = len;
+    ram_shared.count++;
+    return 0;
+}
+#endif
+
+/* Map the |count| raw pages starting at |pages|, which are consecutive in
+ * both guest memory and the stream, where their data starts at |pos|.
+ * Sets the |mapped| field of the pages that could be mapped. */
+static void ram_shared_map_run(QEMUFile *f, RamZPage *pages, int count,
+                               int64_t pos)
+{
+#ifndef _WIN32
+    uintptr_t mask = qemu_real_host_page_size - 1;
+    uint8_t *host = pages[0].host;
+    size_t len = (size_t)count * TARGET_PAGE_SIZE;
+    size_t head = -(uintptr_t)host & mask;
+
+    /* Only whole host pages can be mapped */
+    if (head >= len) {
+        return;
+    }
+    host += head;
+    pos += head;
+    len = (len - head) & ~mask;
+
+    while (len > 0) {
+        const char *filename;
+        int size = len;
+        int64_t offset = qemu_file_map(f, pos, &size, &filename);
+        int i;
+
+        if (offset < 0 || (offset & mask)) {
+            return;
+        }
+        size &= ~mask;
+        if (size == 0 || ram_shared_map(host, size, filename, offset) < 0) {
+            return;
+        }
+        for (i = (host - pages[0].host) >> TARGET_PAGE_BITS;
+             i < count && pages[i].host < host + size; i++) {
+            pages[i].mapped = 1;
+        }
+        host += size;
+        pos += size;
+        len -= size;
+    }
+#endif
+}
+
+/* Map the raw pages of the current batch, whose data starts at the current
+ * position of |f|. */
+static void ram_shared_map_batch(QEMUFile *f)
+{
+    int64_t pos = qemu_file_get_pos(f);
+    int i = 0, j;
+
+    while (i < ram_zbatch_count) {
+        RamZPage *first = &ram_zbatch[i];
+
+        for (j = i; j < ram_zbatch_count; j++) {
+            RamZPage *page = &ram_zbatch[j];
+            if (page->zlen || page->block != first->block ||
+                page->offset != first->offset + (j - i) * TARGET_PAGE_SIZE) {
+                break;
+            }
+        }
+        if (j == i) {
+            pos += ram_zbatch[i++].zlen;
+            continue;
+        }
+        if (ram_shared_block_ok(first->block)) {
+            ram_shared_map_run(f, first, j - i, pos);
+        }
+        pos += (int64_t)(j - i) * TARGET_PAGE_SIZE;
+        i = j;
+    }
+}
+
+/* Copy the pages mapped from the snapshot file into anonymous memory. */
+static void ram_shared_detach(void)
+{
+#ifndef _WIN32
+    int i;
+
+    for (i = 0; i < ram_shared.count; i++) {
+        RamSharedRange *range = &ram_shared.ranges[i];
+        uint8_t *copy = g_malloc(range->len);
+
+        memcpy(copy, range->host, range->len);
+        if (mmap(range->host, range->len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) ==
+            MAP_FAILED) {
+            fprintf(stderr, "Could not copy shared RAM pages: %s\n",
+                    strerror(errno));
+            abort();
+        }
+        qemu_madvise(range->host, range->len, QEMU_MADV_MERGEABLE);
+        memcpy(range->host, copy, range->len);
+        g_free(copy);
+    }
+    ram_shared.count = 0;
+    if (ram_shared.fd >= 0) {
+        close(ram_shared.fd);
+        ram_shared.fd = -1;
+        g_free(ram_shared.filename);
+        ram_shared.filename = NULL;
+    }
+#endif
+}
+
+static void ram_load_dup_page(void *host, uint8_t ch)
+{
+    memset(host, ch, TARGET_PAGE_SIZE);
+#ifndef _WIN32
+    /* Discarding a page mapped from the snapshot file would bring its
+     * previous content back. */
+    if (ch == 0 && ram_shared.count == 0 &&
+        (!kvm_enabled() || kvm_has_sync_mmu())) {
+        qemu_madvise(host, TARGET_PAGE_SIZE, QEMU_MADV_DONTNEED);
+    }
+#endif
+}
+
+/*
+ * Flat snapshots: the RAM section of the files described in
+ * android/snapshot-flat.h stores each RAM block as-is, so that loading it
+ * only means mapping it copy-on-write with ram_shared_map(), which reads
+ * pages on first access and shares them between emulators through the
+ * host page cache. Blocks that can't be mapped are read instead.
+ */
+
+#ifndef _WIN32
+static int ram_flat_pwrite(int fd, const uint8_t *buf, size_t len,
+                           int64_t offset)
+{
+    while (len > 0) {
+        ssize_t ret = pwrite(fd, buf, len, offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+static int ram_flat_pread(int fd, uint8_t *buf, size_t len, int64_t offset)
+{
+    while (len > 0) {
+        ssize_t ret = pread(fd, buf, len, offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (ret == 0) {
+            return -EIO;
+        }
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+int ram_save_flat(int fd, struct SnapshotFlatHeader *header)
+{
+    int64_t start = be64_to_cpu(header->ram_offset);
+    int64_t offset = start;
+    RAMBlock *block;
+    int count = 0, ret;
+
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        SnapshotFlatRamBlock *entry;
+        ram_addr_t addr;
+
+        if (count == SNAPSHOT_FLAT_MAX_RAM_BLOCKS) {
+            return -E2BIG;
+        }
+        entry = &header->ram_blocks[count++];
+        pstrcpy(entry->idstr, sizeof(entry->idstr), block->idstr);
+        entry->length = cpu_to_be64(block->length);
+        entry->offset = cpu_to_be64(offset);
+
+        for (addr = 0; addr < block->length; addr += SNAPSHOT_FLAT_ALIGN) {
+            size_t len = MIN(SNAPSHOT_FLAT_ALIGN, block->length - addr);
+            if (buffer_is_zero(block->host + addr, len)) {
+                continue;
+            }
+            ret = ram_flat_pwrite(fd, block->host + addr, len, offset + addr);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        offset += ROUND_UP(block->length, SNAPSHOT_FLAT_ALIGN);
+    }
+    /* Extend the file over the trailing zero pages */
+    if (ftruncate(fd, offset) < 0) {
+        return -errno;
+    }
+    header->ram_block_count = cpu_to_be32(count);
+    header->ram_size = cpu_to_be64(offset - start);
+    return 0;
+}
+
+int ram_load_flat(int fd, const char *filename,
+                  const struct SnapshotFlatHeader *header)
+{
+    int count = be32_to_cpu(header->ram_block_count);
+    int i, ret;
+
+    if (count > SNAPSHOT_FLAT_MAX_RAM_BLOCKS) {
+        return -EINVAL;
+    }
+    for (i = 0; i < count; i++) {
+        const SnapshotFlatRamBlock *entry = &header->ram_blocks[i];
+        int64_t offset = be64_to_cpu(entry->offset);
+        RAMBlock *block;
+
+        QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+            if (!strncmp(entry->idstr, block->idstr, sizeof(entry->idstr))) {
+                break;
+            }
+        }
+        if (!block || block->length != be64_to_cpu(entry->length)) {
+            fprintf(stderr, "Snapshot RAM block %.256s doesn't match\n",
+                    entry->idstr);
+            return -EINVAL;
+        }
+        if (ram_shared_block_ok(block) &&
+            !(((uintptr_t)block->host | block->length) &
+              (qemu_real_host_page_size - 1)) &&
+            ram_shared_map(block->host, block->length, filename, offset) == 0) {
+            continue;
+        }
+        ret = ram_flat_pread(fd, block->host, block->length, offset);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+#endif  /* !_WIN32 */
+
+/*
+ * Lazy restore: when loading a version 6 stream from a seekable file
+ * (i.e. a snapshot), the index of each RAM_SAVE_FLAG_BATCH record is used
+ * to remember where the data of every page is, and the data itself is
+ * skipped. Pages are then restored when qemu_get_ram_ptr() is first called
+ * for them, which the softmmu does before creating a TLB entry, and by a
+ * timer that restores the remaining ones in the background.
+ *
+ * This only works when all guest memory accesses go through the softmmu,
+ * and is disabled with KVM and HAX. Everything runs on the main loop
+ * thread, so no locking is needed.
+ */
+
+#define RAM_LAZY_PREFETCH_MS   1
+
+typedef struct RamLazyPage {
+    int64_t pos;            /* position of the page data in the file */
+    uint32_t len;           /* 0 if restored, or size of the data */
+} RamLazyPage;
+
+int ram_lazy_restore;
+ram_addr_t ram_lazy_remaining;
+
+static struct {
+    QEMUFile *file;
+    QEMUTimer *timer;
+    RAMBlock *next_block;   /* prefetch position */
+    ram_addr_t next_offset;
+} ram_lazy;
+
+static void ram_lazy_reset(void)
+{
+    RAMBlock *block;
+
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        g_free(block->lazy_pages);
+        block->lazy_pages = NULL;
+    }
+    ram_lazy_remaining = 0;
+    ram_lazy.next_block = NULL;
+    ram_lazy.next_offset = 0;
+    if (ram_lazy.timer) {
+        timer_del(ram_lazy.timer);
+    }
+    if (ram_lazy.file) {
+        qemu_fclose(ram_lazy.file);
+        ram_lazy.file = NULL;
+    }
+}
+
+static RamLazyPage *ram_lazy_find(RAMBlock *block, ram_addr_t offset)
+{
+    RamLazyPage *page;
+
+    if (!block->lazy_pages) {
+        return NULL;
+    }
+    page = &block->lazy_pages[offset >> TARGET_PAGE_BITS];
+    return page->len ? page : NULL;
+}
+
+static void ram_lazy_done(RamLazyPage *page)
+{
+    page->len = 0;
+    if (--ram_lazy_remaining == 0) {
+        ram_lazy_reset();
+    }
+}
+
+/* Mark a page as restored, because newer data was found in the stream. */
+static void ram_lazy_drop(RAMBlock *block, ram_addr_t offset)
+{
+    RamLazyPage *page = ram_lazy_find(block, offset);
+
+    if (page) {
+        ram_lazy_done(page);
+    }
+}
+
+static void ram_lazy_add(RAMBlock *block, ram_addr_t offset,
+                         int64_t pos, uint32_t len)
+{
+    RamLazyPage *page;
+
+    if (!block->lazy_pages) {
+        block->lazy_pages = g_malloc0((block->length >> TARGET_PAGE_BITS) *
+                                      sizeof(RamLazyPage));
+    }
+    page = &block->lazy_pages[offset >> TARGET_PAGE_BITS];
+    if (!page->len) {
+        ram_lazy_remaining++;
+    }
+    page->pos = pos;
+    page->len = len;
+    if (!timer_pending(ram_lazy.timer)) {
+        timer_mod(ram_lazy.timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                  RAM_LAZY_PREFETCH_MS);
+    }
+}
+
+/* Read the data of a pending page into |zpage|, which is decompressed
+ * later by ram_zpage_process(). Raw pages are read into guest memory. */
+static void ram_lazy_read(RAMBlock *block, ram_addr_t offset,
+                          RamLazyPage *page, RamZPage *zpage)
+{
+    uint8_t *dst;
+    int ret;
+
+    zpage->host = block->host + offset;
+    zpage->zlen = page->len < TARGET_PAGE_SIZE ? page->len : 0;
+    dst = zpage->zlen ? zpage->zbuf : zpage->host;
+    ret = qemu_file_pread(ram_lazy.file, dst, page->pos, page->len);
+    if (ret != (int)page->len) {
+        fprintf(stderr, "Could not restore RAM page from snapshot: %s\n",
+                strerror(ret < 0 ? -ret : EIO));
+        abort();
+    }
+}
+
+void ram_lazy_load_page(RAMBlock *block, ram_addr_t offset)
+{
+    RamLazyPage *page;
+    RamZPage zpage;
+
+    offset &= TARGET_PAGE_MASK;
+    page = ram_lazy_find(block, offset);
+    if (!page) {
+        return;
+    }
+    ram_lazy_read(block, offset, page, &zpage);
+    ram_zpage_process(&zpage, 1);
+    if (zpage.failed) {
+        fprintf(stderr, "Corrupted compressed RAM page!\n");
+        abort();
+    }
+    ram_lazy_done(page);
+}
+
+void ram_lazy_load_range(ram_addr_t addr, ram_addr_t length)
+{
+    ram_addr_t end = addr + length;
+
+    addr &= TARGET_PAGE_MASK;
+    while (ram_lazy_remaining && addr < end) {
+        qemu_get_ram_ptr(addr);
+        addr += TARGET_PAGE_SIZE;
+    }
+}
+
+/* Restore up to |max| pending pages, using the compression thread pool.
+ * Returns the number of pages restored. */
+static int ram_lazy_prefetch(int max)
+{
+    RAMBlock *block = ram_lazy.next_block;
+    ram_addr_t offset = ram_lazy.next_offset;
+    RamLazyPage *pages[RAM_ZPAGE_BATCH];
+    int i, count = 0;
+
+    if (max > RAM_ZPAGE_BATCH) {
+        max = RAM_ZPAGE_BATCH;
+    }
+    if (!block) {
+        block = QTAILQ_FIRST(&ram_list.blocks);
+        offset = 0;
+    }
+    while (count < max && count < ram_lazy_remaining) {
+        RamLazyPage *page = ram_lazy_find(block, offset);
+        if (page) {
+            ram_lazy_read(block, offset, page, &ram_zbatch[count]);
+            pages[count++] = page;
+        }
+        offset += TARGET_PAGE_SIZE;
+        if (offset >= block->length) {
+            offset = 0;
+            block = QTAILQ_NEXT(block, next);
+            if (!block) {
+                block = QTAILQ_FIRST(&ram_list.blocks);
+            }
+        }
+    }
+    ram_lazy.next_block = block;
+    ram_lazy.next_offset = offset;
+
+    ram_zpool_run(count, 1);
+    for (i = 0; i < count; i++) {
+        if (ram_zbatch[i].failed) {
+            fprintf(stderr, "Corrupted compressed RAM page!\n");
+            abort();
+        }
+    }
+    /* This may reset the lazy state when the last page is restored */
+    for (i = 0; i < count; i++) {
+        ram_lazy_done(pages[i]);
+    }
+    return count;
+}
+
+static void ram_lazy_timer_cb(void *opaque)
+{
+    ram_lazy_prefetch(RAM_ZPAGE_BATCH);
+    if (ram_lazy_remaining) {
+        timer_mod(ram_lazy.timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                  RAM_LAZY_PREFETCH_MS);
+    }
+}
+
+void ram_lazy_load_all(void)
+{
+    while (ram_lazy_remaining) {
+        ram_lazy_prefetch(RAM_ZPAGE_BATCH);
+    }
+    ram_shared_detach();
+}
+
+/* Read a RAM_SAVE_FLAG_BATCH record. Duplicate pages are restored right
+ * away, the other ones are either recorded for a lazy restore, or read and
+ * decompressed with the thread pool. */
+static int ram_load_batch(QEMUFile *f, int version_id)
+{
+    int i, count, ret;
+
+    count = qemu_get_be16(f);
+    if (count > RAM_ZPAGE_BATCH) {
+        return -EINVAL;
+    }
+    ram_zbatch_count = 0;
+    for (i = 0; i < count; i++) {
+        RamZPage *page;
+        RAMBlock *block;
+        ram_addr_t offset;
+        int flags;
+
+        offset = qemu_get_be64(f);
+        flags = offset & ~TARGET_PAGE_MASK;
+        offset &= TARGET_PAGE_MASK;
+        block = block_from_stream_offset(f, offset, flags);
+        if (!block) {
+            return -EINVAL;
+        }
+        if (ram_lazy.file) {
+            ram_lazy_drop(block, offset);
+        }
+        if (flags & RAM_SAVE_FLAG_COMPRESS) {
+            ram_load_dup_page(block->host + offset, qemu_get_byte(f));
+            continue;
+        }
+        page = &ram_zbatch[ram_zbatch_count++];
+        page->block = block;
+        page->offset = offset;
+        page->host = block->host + offset;
+        page->mapped = 0;
+        if (flags & RAM_SAVE_FLAG_ZPAGE) {
+            page->zlen = qemu_get_be16(f);
+            if (page->zlen == 0 || page->zlen >= TARGET_PAGE_SIZE) {
+                return -EINVAL;
+            }
+        } else if (flags & RAM_SAVE_FLAG_PAGE) {
+            page->zlen = 0;
+        } else {
+            return -EINVAL;
+        }
+    }
+    if (version_id >= 7) {
+        ret = qemu_file_skip_forward(f, qemu_get_be32(f));
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    if (qemu_file_get_error(f)) {
+        return -EIO;
+    }
+
+    if (ram_shared_restore) {
+        ram_shared_map_batch(f);
+    }
+
+    if (ram_lazy.file) {
+        int64_t pos = qemu_file_get_pos(f);
+        int64_t start = pos;
+        for (i = 0; i < ram_zbatch_count; i++) {
+            RamZPage *page = &ram_zbatch[i];
+            uint32_t len = page->zlen ? page->zlen : TARGET_PAGE_SIZE;
+            if (!page->mapped) {
+                ram_lazy_add(page->block, page->offset, pos, len);
+            }
+            pos += len;
+        }
+        ram_zbatch_count = 0;
+        return qemu_file_skip_forward(f, pos - start);
+    }
+
+    for (i = 0; i < ram_zbatch_count; i++) {
+        RamZPage *page = &ram_zbatch[i];
+        if (page->mapped) {
+            qemu_file_skip_forward(f, TARGET_PAGE_SIZE);
+        } else if (page->zlen) {
+            qemu_get_buffer(f, page->zbuf, page->zlen);
+        } else {
+            qemu_get_buffer(f, page->host, TARGET_PAGE_SIZE);
+        }
+    }
+    ret = ram_load_flush();
+    if (ret < 0) {
+        return ret;
+    }
+    return qemu_file_get_error(f) ? -EIO : 0;
+}
+
 int ram_load(QEMUFile *f, void *opaque, int version_id)
 {
     ram_addr_t addr;
     int flags;
+    int ret;
 
-    if (version_id < 3 || version_id > 4) {
+    /* Version 4 identifies pages by RAM address, while the others use a
+     * RAM block name and offset. Version 5 adds RAM_SAVE_FLAG_ZPAGE,
+     * version 6 sends all pages in RAM_SAVE_FLAG_BATCH records, and
+     * version 7 adds padding before the data of each batch. */
+    if (version_id < 3 || version_id > 7) {
         return -EINVAL;
     }
+    ram_zbatch_count = 0;
+
+    /* ram_load() is called for each part of the RAM section, only set up
+     * the lazy restore for the first one. */
+    if (version_id >= 6 && ram_lazy_restore && !ram_lazy.file &&
+        !kvm_enabled() && !hax_enabled()) {
+        ram_lazy.file = qemu_file_dup_reader(f);
+        if (ram_lazy.file && !ram_lazy.timer) {
+            ram_lazy.timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                          ram_lazy_timer_cb, NULL);
+        }
+    }
 
     do {
         addr = qemu_get_be64(f);
@@ -386,8 +1303,31 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
         flags = addr & ~TARGET_PAGE_MASK;
         addr &= TARGET_PAGE_MASK;
 
-        if (flags & RAM_SAVE_FLAG_MEM_SIZE) {
-            if (version_id != 3) {
+        /* Keep the stream order: compressed pages must reach guest memory
+         * before any other record is processed. */
+        if (!(flags & RAM_SAVE_FLAG_ZPAGE)) {
+            ret = ram_load_flush();
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        if (version_id >= 6 &&
+            (flags & (RAM_SAVE_FLAG_COMPRESS | RAM_SAVE_FLAG_PAGE |
+                      RAM_SAVE_FLAG_ZPAGE))) {
+            return -EINVAL;
+        }
+
+        if (flags & RAM_SAVE_FLAG_BATCH) {
+            if (version_id < 6) {
+                return -EINVAL;
+            }
+            ret = ram_load_batch(f, version_id);
+            if (ret < 0) {
+                return ret;
+            }
+        } else if (flags & RAM_SAVE_FLAG_MEM_SIZE) {
+            if (version_id == 4) {
                 if (addr != ram_bytes_total()) {
                     return -EINVAL;
                 }
@@ -427,7 +1367,7 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
             void *host;
             uint8_t ch;
 
-            if (version_id != 3)
+            if (version_id == 4)
                 host = qemu_get_ram_ptr(addr);
             else
                 host = host_from_stream_offset(f, addr, flags);
@@ -436,22 +1376,39 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
             }
 
             ch = qemu_get_byte(f);
-            memset(host, ch, TARGET_PAGE_SIZE);
-#ifndef _WIN32
-            if (ch == 0 &&
-                (!kvm_enabled() || kvm_has_sync_mmu())) {
-                qemu_madvise(host, TARGET_PAGE_SIZE, QEMU_MADV_DONTNEED);
-            }
-#endif
+            ram_load_dup_page(host, ch);
         } else if (flags & RAM_SAVE_FLAG_PAGE) {
             void *host;
 
-            if (version_id != 3)
+            if (version_id == 4)
                 host = qemu_get_ram_ptr(addr);
             else
                 host = host_from_stream_offset(f, addr, flags);
 
             qemu_get_buffer(f, host, TARGET_PAGE_SIZE);
+        } else if (flags & RAM_SAVE_FLAG_ZPAGE) {
+            RamZPage *page;
+            void *host;
+            unsigned int zlen;
+
+            if (version_id != 5) {
+                return -EINVAL;
+            }
+            host = host_from_stream_offset(f, addr, flags);
+            zlen = qemu_get_be16(f);
+            if (!host || zlen > TARGET_PAGE_SIZE) {
+                return -EINVAL;
+            }
+            page = &ram_zbatch[ram_zbatch_count++];
+            page->host = host;
+            page->zlen = zlen;
+            qemu_get_buffer(f, page->zbuf, zlen);
+            if (ram_zbatch_count == RAM_ZPAGE_BATCH) {
+                ret = ram_load_flush();
+                if (ret < 0) {
+                    return ret;
+                }
+            }
         }
         if (qemu_file_get_error(f)) {
             return -EIO;
@@ -44,6 +44,7 @@
 static struct audio_driver *drvtab[] = {
 #ifdef CONFIG_PULSEAUDIO
     &pa_audio_driver,
+    &pa_lowlat_audio_driver,
 #endif
 #ifdef CONFIG_ESD
     &esd_audio_driver,
@@ -1428,6 +1429,10 @@ static int audio_get_free (SWVoiceOut *sw)
     }
 
     dead = sw->hw->samples - live;
+    if (sw->hw->max_live) {
+        dead = audio_MAX (audio_MIN (sw->hw->max_live, sw->hw->samples) - live,
+                          0);
+    }
 
 #ifdef DEBUG_OUT
     dolog ("%s: get_free live %d dead %d ret %" PRId64 "\n",
@@ -1964,6 +1969,8 @@ static void audio_init (void)
     QLIST_INIT (&s->cap_head);
     atexit (audio_atexit);
 
+    mixeng_init ();
+
     s->ts = timer_new(QEMU_CLOCK_VIRTUAL, SCALE_NS, audio_timer, s);
     if (!s->ts) {
         dolog ("Could not create audio timer\n");
@@ -2203,6 +2210,18 @@ void AUD_set_volume_out (SWVoiceOut *sw, int mute, uint8_t lvol, uint8_t rvol)
     }
 }
 
+int AUD_get_out_stats (AudioOutStats *stats)
+{
+    HWVoiceOut *hw = NULL;
+
+    while ((hw = audio_pcm_hw_find_any_out (hw))) {
+        if (hw->pcm_ops->stats_out && !hw->pcm_ops->stats_out (hw, stats)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
 void AUD_set_volume_in (SWVoiceIn *sw, int mute, uint8_t lvol, uint8_t rvol)
 {
     if (sw) {
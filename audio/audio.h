@@ -123,6 +123,18 @@ void     AUD_init_time_stamp_out (SWVoiceOut *sw, QEMUAudioTimeStamp *ts);
 uint64_t AUD_get_elapsed_usec_out (SWVoiceOut *sw, QEMUAudioTimeStamp *ts);
 
 void AUD_set_volume_out (SWVoiceOut *sw, int mute, uint8_t lvol, uint8_t rvol);
+
+/* Playback statistics, for the backends that measure them. */
+typedef struct AudioOutStats {
+    int64_t latency_usec;       /* from mixing to the speakers, -1 if unknown */
+    int64_t buffer_usec;        /* current size of the jitter buffer */
+    uint64_t underruns;         /* times the backend ran out of samples */
+    uint64_t frames;            /* frames played so far */
+} AudioOutStats;
+
+/* Fill |stats| for the first playback voice whose backend measures them.
+ * Returns -1 if there is no such voice, 0 otherwise. */
+int  AUD_get_out_stats (AudioOutStats *stats);
 void AUD_set_volume_in (SWVoiceIn *sw, int mute, uint8_t lvol, uint8_t rvol);
 
 SWVoiceIn *AUD_open_in (
@@ -82,6 +82,9 @@ typedef struct HWVoiceOut {
     struct st_sample *mix_buf;
 
     int samples;
+    /* If not 0, the voices are only asked for more samples while fewer
+     * than this are mixed, which bounds the latency below |samples|. */
+    int max_live;
     QLIST_HEAD (sw_out_listhead, SWVoiceOut) sw_head;
     QLIST_HEAD (sw_cap_listhead, SWVoiceCap) cap_head;
     struct audio_pcm_ops *pcm_ops;
@@ -160,6 +163,7 @@ struct audio_pcm_ops {
     int  (*run_out) (HWVoiceOut *hw, int live);
     int  (*write)   (SWVoiceOut *sw, void *buf, int size);
     int  (*ctl_out) (HWVoiceOut *hw, int cmd, ...);
+    int  (*stats_out) (HWVoiceOut *hw, AudioOutStats *stats);
 
     int  (*init_in) (HWVoiceIn *hw, struct audsettings *as);
     void (*fini_in) (HWVoiceIn *hw);
@@ -212,6 +216,7 @@ extern struct audio_driver coreaudio_audio_driver;
 extern struct audio_driver dsound_audio_driver;
 extern struct audio_driver esd_audio_driver;
 extern struct audio_driver pa_audio_driver;
+extern struct audio_driver pa_lowlat_audio_driver;
 extern struct audio_driver winwave_audio_driver;
 extern struct mixeng_volume nominal_volume;
 
@@ -28,6 +28,18 @@
 #define AUDIO_CAP "mixeng"
 #include "audio_int.h"
 
+/* The SSE2 routines below only handle the fixed-point mixing engine without
+ * per-voice volume, which is what all non-CoreAudio builds use. */
+#if !defined(FLOAT_MIXENG) && !defined(CONFIG_MIXEMU) && \
+    !defined(HOST_WORDS_BIGENDIAN) && defined(__SSE2__)
+#define MIXENG_USE_SSE2
+#include <emmintrin.h>
+#include "android/utils/x86_cpuid.h"
+
+/* Set by mixeng_init() when the host CPU supports SSE2. */
+static int mixeng_sse2;
+#endif
+
 /* 8 bit */
 #define ENDIAN_CONVERSION natural
 #define ENDIAN_CONVERT(v) (v)
@@ -143,6 +155,120 @@
 #undef IN_T
 #undef SHIFT
 
+#ifdef MIXENG_USE_SSE2
+/*
+ * SSE2 versions of the signed 16 bit native endian conversion routines,
+ * which is by far the most common format for both guest and host voices.
+ * They produce exactly the same results as the generic ones above.
+ */
+
+static void conv_sse2_int16_t_to_stereo (struct st_sample *dst, const void *src,
+                                         int samples, struct mixeng_volume *vol)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const int16_t *in = src;
+    __m128i *out = (__m128i *) dst;
+
+    /* Each iteration converts 4 stereo samples, i.e. 8 int16_t values to
+       8 int64_t ones. Note that (int16_t << 16) always fits in an int32_t. */
+    for (; samples >= 4; samples -= 4, in += 8, out += 4) {
+        __m128i x = _mm_loadu_si128 ((const __m128i *) in);
+        __m128i lo = _mm_unpacklo_epi16 (zero, x);
+        __m128i hi = _mm_unpackhi_epi16 (zero, x);
+        __m128i lo_sign = _mm_srai_epi32 (lo, 31);
+        __m128i hi_sign = _mm_srai_epi32 (hi, 31);
+        _mm_storeu_si128 (out + 0, _mm_unpacklo_epi32 (lo, lo_sign));
+        _mm_storeu_si128 (out + 1, _mm_unpackhi_epi32 (lo, lo_sign));
+        _mm_storeu_si128 (out + 2, _mm_unpacklo_epi32 (hi, hi_sign));
+        _mm_storeu_si128 (out + 3, _mm_unpackhi_epi32 (hi, hi_sign));
+    }
+    conv_natural_int16_t_to_stereo ((struct st_sample *) out, in, samples, vol);
+}
+
+static void conv_sse2_int16_t_to_mono (struct st_sample *dst, const void *src,
+                                       int samples, struct mixeng_volume *vol)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const int16_t *in = src;
+    __m128i *out = (__m128i *) dst;
+
+    for (; samples >= 4; samples -= 4, in += 4, out += 4) {
+        __m128i x = _mm_unpacklo_epi16 (zero,
+                                        _mm_loadl_epi64 ((const __m128i *) in));
+        __m128i sign = _mm_srai_epi32 (x, 31);
+        __m128i lo = _mm_unpacklo_epi32 (x, sign);
+        __m128i hi = _mm_unpackhi_epi32 (x, sign);
+        _mm_storeu_si128 (out + 0, _mm_unpacklo_epi64 (lo, lo));
+        _mm_storeu_si128 (out + 1, _mm_unpackhi_epi64 (lo, lo));
+        _mm_storeu_si128 (out + 2, _mm_unpacklo_epi64 (hi, hi));
+        _mm_storeu_si128 (out + 3, _mm_unpackhi_epi64 (hi, hi));
+    }
+    conv_natural_int16_t_to_mono ((struct st_sample *) out, in, samples, vol);
+}
+
+/*
+ * Clip the four int64_t values held by a and b like clip_natural_int16_t()
+ * does, and return them as four int32_t values in the [-32768, 32767] range.
+ * SSE2 has no 64 bit comparisons, so values are first saturated to 32 bits
+ * by checking that their high half is the sign extension of the low one.
+ */
+static inline __m128i clip_sse2_int16_t_4 (__m128i a, __m128i b)
+{
+    __m128i sa = _mm_shuffle_epi32 (a, _MM_SHUFFLE (3, 1, 2, 0));
+    __m128i sb = _mm_shuffle_epi32 (b, _MM_SHUFFLE (3, 1, 2, 0));
+    __m128i lo = _mm_unpacklo_epi64 (sa, sb);
+    __m128i hi = _mm_unpackhi_epi64 (sa, sb);
+    __m128i fits = _mm_cmpeq_epi32 (hi, _mm_srai_epi32 (lo, 31));
+    __m128i sat = _mm_xor_si128 (_mm_set1_epi32 (INT32_MAX),
+                                 _mm_srai_epi32 (hi, 31));
+    __m128i v = _mm_or_si128 (_mm_and_si128 (fits, lo),
+                              _mm_andnot_si128 (fits, sat));
+    __m128i big = _mm_cmpgt_epi32 (v, _mm_set1_epi32 (0x7f000000 - 1));
+    v = _mm_srai_epi32 (v, 16);
+    return _mm_or_si128 (_mm_andnot_si128 (big, v),
+                         _mm_and_si128 (big, _mm_set1_epi32 (SHRT_MAX)));
+}
+
+static void clip_sse2_int16_t_from_stereo (void *dst, const struct st_sample *src,
+                                           int samples)
+{
+    const __m128i *in = (const __m128i *) src;
+    int16_t *out = dst;
+
+    for (; samples >= 4; samples -= 4, in += 4, out += 8) {
+        __m128i lo = clip_sse2_int16_t_4 (_mm_loadu_si128 (in + 0),
+                                          _mm_loadu_si128 (in + 1));
+        __m128i hi = clip_sse2_int16_t_4 (_mm_loadu_si128 (in + 2),
+                                          _mm_loadu_si128 (in + 3));
+        _mm_storeu_si128 ((__m128i *) out, _mm_packs_epi32 (lo, hi));
+    }
+    clip_natural_int16_t_from_stereo (out, (const struct st_sample *) in,
+                                      samples);
+}
+
+static void clip_sse2_int16_t_from_mono (void *dst, const struct st_sample *src,
+                                         int samples)
+{
+    const __m128i *in = (const __m128i *) src;
+    int16_t *out = dst;
+
+    for (; samples >= 4; samples -= 4, in += 4, out += 4) {
+        __m128i s0 = _mm_loadu_si128 (in + 0);
+        __m128i s1 = _mm_loadu_si128 (in + 1);
+        __m128i s2 = _mm_loadu_si128 (in + 2);
+        __m128i s3 = _mm_loadu_si128 (in + 3);
+        __m128i a = _mm_add_epi64 (_mm_unpacklo_epi64 (s0, s1),
+                                   _mm_unpackhi_epi64 (s0, s1));
+        __m128i b = _mm_add_epi64 (_mm_unpacklo_epi64 (s2, s3),
+                                   _mm_unpackhi_epi64 (s2, s3));
+        __m128i v = clip_sse2_int16_t_4 (a, b);
+        _mm_storel_epi64 ((__m128i *) out, _mm_packs_epi32 (v, v));
+    }
+    clip_natural_int16_t_from_mono (out, (const struct st_sample *) in,
+                                    samples);
+}
+#endif /* MIXENG_USE_SSE2 */
+
 t_sample *mixeng_conv[2][2][2][3] = {
     {
         {
@@ -318,10 +444,16 @@ void *st_rate_start (int inrate, int outrate)
 
 #define NAME st_rate_flow_mix
 #define OP(a, b) a += b
+#ifdef MIXENG_USE_SSE2
+#define OP_SSE2(a, b) _mm_add_epi64 (a, b)
+#endif
 #include "rate_template.h"
 
 #define NAME st_rate_flow
 #define OP(a, b) a = b
+#ifdef MIXENG_USE_SSE2
+#define OP_SSE2(a, b) (b)
+#endif
 #include "rate_template.h"
 
 void st_rate_stop (void *opaque)
@@ -333,3 +465,21 @@ void mixeng_clear (struct st_sample *buf, int len)
 {
     memset (buf, 0, len * sizeof (struct st_sample));
 }
+
+void mixeng_init (void)
+{
+#ifdef MIXENG_USE_SSE2
+    uint32_t edx = 0;
+
+    android_get_x86_cpuid (1, 0, NULL, NULL, NULL, &edx);
+    if (!(edx & CPUID_EDX_SSE2)) {
+        return;
+    }
+    mixeng_sse2 = 1;
+    /* [stereo][signed][swap_endianness][bits index] */
+    mixeng_conv[1][1][0][1] = conv_sse2_int16_t_to_stereo;
+    mixeng_conv[0][1][0][1] = conv_sse2_int16_t_to_mono;
+    mixeng_clip[1][1][0][1] = clip_sse2_int16_t_from_stereo;
+    mixeng_clip[0][1][0][1] = clip_sse2_int16_t_from_mono;
+#endif
+}
@@ -3,6 +3,8 @@
 #include "audio.h"
 
 #include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
 #include <pulse/pulseaudio.h>
 
 #define AUDIO_CAP "pulseaudio"
@@ -18,6 +20,14 @@ typedef struct {
     pa_stream *stream;
     void *pcm_buf;
     struct audio_pt pt;
+    /* Only used by the low-latency driver, under the mainloop lock. */
+    int active;
+    int primed;
+    int target;
+    int realtime_tried;
+    int64_t stable_frames;
+    uint64_t underruns;
+    uint64_t frames;
 } PAVoiceOut;
 
 typedef struct {
@@ -288,6 +298,159 @@ static int qpa_write (SWVoiceOut *sw, void *buf, int len)
     return audio_pcm_sw_write (sw, buf, len);
 }
 
+/*
+ * Low-latency playback.
+ *
+ * Rather than pushing the mixed samples from a thread of its own, the
+ * "pa_lowlat" driver lets the PulseAudio mainloop thread pull them from
+ * the stream write callback, when the server asks for them, and only lets
+ * the voices mix |target| samples ahead of it (see hw->max_live). That
+ * jitter buffer grows by a step at each underrun, and shrinks back by a
+ * step after a while without any, so its size follows the underrun rate.
+ */
+
+/* All in milliseconds. */
+#define QPA_LL_SERVER_LATENCY  10
+#define QPA_LL_BUFFER_MIN      15
+#define QPA_LL_BUFFER_START    30
+#define QPA_LL_BUFFER_STEP     5
+#define QPA_LL_STABLE_PERIOD   10000
+
+static int qpa_ll_samples (HWVoiceOut *hw, int ms)
+{
+    return audio_MIN ((int) ((int64_t) hw->info.freq * ms / 1000),
+                      hw->samples);
+}
+
+static int64_t qpa_ll_usec (HWVoiceOut *hw, int64_t samples)
+{
+    return samples * 1000000 / hw->info.freq;
+}
+
+static void qpa_ll_make_realtime (void)
+{
+    struct sched_param param;
+
+    memset (&param, 0, sizeof (param));
+    param.sched_priority = sched_get_priority_min (SCHED_FIFO);
+    if (pthread_setschedparam (pthread_self (), SCHED_FIFO, &param)) {
+        ldebug ("could not give the mainloop thread a real-time priority\n");
+    }
+}
+
+static void qpa_ll_adapt (PAVoiceOut *pa, int played, int underrun)
+{
+    HWVoiceOut *hw = &pa->hw;
+    int step = qpa_ll_samples (hw, QPA_LL_BUFFER_STEP);
+
+    if (underrun) {
+        pa->target = audio_MIN (pa->target + step, hw->samples);
+        pa->stable_frames = 0;
+        return;
+    }
+
+    pa->stable_frames += played;
+    if (pa->stable_frames >=
+        (int64_t) hw->info.freq * QPA_LL_STABLE_PERIOD / 1000) {
+        pa->target = audio_MAX (pa->target - step,
+                                qpa_ll_samples (hw, QPA_LL_BUFFER_MIN));
+        pa->stable_frames = 0;
+    }
+}
+
+/* Called from the mainloop thread, with the mainloop lock held. */
+static void qpa_ll_write_cb (pa_stream *s, size_t length, void *userdata)
+{
+    PAVoiceOut *pa = userdata;
+    HWVoiceOut *hw = &pa->hw;
+    int samples = audio_MIN ((int) (length >> hw->info.shift), hw->samples);
+    int avail = audio_MIN (pa->live, samples);
+    int to_mix = avail;
+    int rpos = pa->rpos;
+    uint8_t *dst = pa->pcm_buf;
+
+    if (!pa->realtime_tried) {
+        pa->realtime_tried = 1;
+        qpa_ll_make_realtime ();
+    }
+
+    if (!samples) {
+        return;
+    }
+
+    while (to_mix) {
+        int chunk = audio_MIN (to_mix, hw->samples - rpos);
+
+        hw->clip (dst, hw->mix_buf + rpos, chunk);
+        dst += chunk << hw->info.shift;
+        rpos = (rpos + chunk) % hw->samples;
+        to_mix -= chunk;
+    }
+
+    pa->rpos = rpos;
+    pa->live -= avail;
+    pa->decr += avail;
+    pa->frames += avail;
+
+    if (avail < samples) {
+        /* Keep the stream running with silence, the server would
+         * otherwise stop it and wait for a full buffer again. */
+        audio_pcm_info_clear_buf (&hw->info, dst, samples - avail);
+        /* A gap while playing is an underrun, count each one once. */
+        if (pa->primed) {
+            pa->primed = 0;
+            pa->underruns++;
+            qpa_ll_adapt (pa, avail, 1);
+        }
+    } else if (pa->active) {
+        pa->primed = 1;
+        qpa_ll_adapt (pa, avail, 0);
+    }
+
+    if (pa_stream_write (s, pa->pcm_buf, samples << hw->info.shift,
+                         NULL, 0LL, PA_SEEK_RELATIVE) < 0) {
+        qpa_logerr (pa_context_errno (glob_paaudio.context),
+                    "pa_stream_write failed\n");
+    }
+}
+
+static int qpa_ll_run_out (HWVoiceOut *hw, int live)
+{
+    int decr;
+    PAVoiceOut *pa = (PAVoiceOut *) hw;
+    paaudio *g = &glob_paaudio;
+
+    pa_threaded_mainloop_lock (g->mainloop);
+    decr = audio_MIN (live, pa->decr);
+    pa->decr -= decr;
+    pa->live = live - decr;
+    hw->rpos = pa->rpos;
+    hw->max_live = pa->target;
+    pa_threaded_mainloop_unlock (g->mainloop);
+    return decr;
+}
+
+static int qpa_ll_stats_out (HWVoiceOut *hw, AudioOutStats *stats)
+{
+    PAVoiceOut *pa = (PAVoiceOut *) hw;
+    paaudio *g = &glob_paaudio;
+    pa_usec_t usec;
+    int negative;
+
+    pa_threaded_mainloop_lock (g->mainloop);
+    if (pa_stream_get_latency (pa->stream, &usec, &negative) < 0) {
+        stats->latency_usec = -1;
+    } else {
+        stats->latency_usec = (negative ? 0 : (int64_t) usec) +
+                              qpa_ll_usec (hw, pa->live);
+    }
+    stats->buffer_usec = qpa_ll_usec (hw, pa->target);
+    stats->underruns = pa->underruns;
+    stats->frames = pa->frames;
+    pa_threaded_mainloop_unlock (g->mainloop);
+    return 0;
+}
+
 /* capture */
 static void *qpa_thread_in (void *arg)
 {
@@ -602,6 +765,63 @@ static int qpa_init_out (HWVoiceOut *hw, struct audsettings *as)
     return -1;
 }
 
+static int qpa_ll_init_out (HWVoiceOut *hw, struct audsettings *as)
+{
+    int error;
+    static pa_sample_spec ss;
+    static pa_buffer_attr ba;
+    struct audsettings obt_as = *as;
+    PAVoiceOut *pa = (PAVoiceOut *) hw;
+    paaudio *g = &glob_paaudio;
+
+    ss.format = audfmt_to_pa (as->fmt, as->endianness);
+    ss.channels = as->nchannels;
+    ss.rate = as->freq;
+
+    /* The jitter buffer is on our side, so keep the server one small. */
+    ba.tlength = pa_usec_to_bytes (QPA_LL_SERVER_LATENCY * 1000, &ss);
+    ba.minreq = pa_usec_to_bytes (2 * 1000, &ss);
+    ba.maxlength = -1;
+    ba.prebuf = -1;
+
+    obt_as.fmt = pa_to_audfmt (ss.format, &obt_as.endianness);
+
+    pa->stream = qpa_simple_new (
+        glob_paaudio.server,
+        "qemu",
+        PA_STREAM_PLAYBACK,
+        glob_paaudio.sink,
+        "pcm.playback",
+        &ss,
+        NULL,                   /* channel map */
+        &ba,                    /* buffering attributes */
+        &error
+        );
+    if (!pa->stream) {
+        qpa_logerr (error, "pa_simple_new for playback failed\n");
+        return -1;
+    }
+
+    audio_pcm_init_info (&hw->info, &obt_as);
+    hw->samples = glob_paaudio.samples;
+    pa->pcm_buf = audio_calloc (AUDIO_FUNC, hw->samples, 1 << hw->info.shift);
+    if (!pa->pcm_buf) {
+        dolog ("Could not allocate buffer (%d bytes)\n",
+               hw->samples << hw->info.shift);
+        pa_stream_unref (pa->stream);
+        pa->stream = NULL;
+        return -1;
+    }
+
+    pa_threaded_mainloop_lock (g->mainloop);
+    pa->rpos = hw->rpos;
+    pa->target = audio_MAX (qpa_ll_samples (hw, QPA_LL_BUFFER_START), 1);
+    hw->max_live = pa->target;
+    pa_stream_set_write_callback (pa->stream, qpa_ll_write_cb, pa);
+    pa_threaded_mainloop_unlock (g->mainloop);
+    return 0;
+}
+
 static int qpa_init_in (HWVoiceIn *hw, struct audsettings *as)
 {
     int error;
@@ -679,6 +899,23 @@ static void qpa_fini_out (HWVoiceOut *hw)
     pa->pcm_buf = NULL;
 }
 
+static void qpa_ll_fini_out (HWVoiceOut *hw)
+{
+    PAVoiceOut *pa = (PAVoiceOut *) hw;
+    paaudio *g = &glob_paaudio;
+
+    if (pa->stream) {
+        pa_threaded_mainloop_lock (g->mainloop);
+        pa_stream_set_write_callback (pa->stream, NULL, NULL);
+        pa_stream_unref (pa->stream);
+        pa->stream = NULL;
+        pa_threaded_mainloop_unlock (g->mainloop);
+    }
+
+    g_free (pa->pcm_buf);
+    pa->pcm_buf = NULL;
+}
+
 static void qpa_fini_in (HWVoiceIn *hw)
 {
     void *ret;
@@ -711,6 +948,14 @@ static int qpa_ctl_out (HWVoiceOut *hw, int cmd, ...)
 #endif
 
     switch (cmd) {
+    case VOICE_ENABLE:
+    case VOICE_DISABLE:
+        pa_threaded_mainloop_lock (g->mainloop);
+        pa->active = (cmd == VOICE_ENABLE);
+        pa->primed = 0;
+        pa_threaded_mainloop_unlock (g->mainloop);
+        break;
+
     case VOICE_VOLUME:
         {
             SWVoiceOut *sw;
@@ -954,3 +1199,31 @@ struct audio_driver pa_audio_driver = {
     .voice_size_in  = sizeof (PAVoiceIn),
 //    .ctl_caps       = VOICE_VOLUME_CAP
 };
+
+static struct audio_pcm_ops qpa_ll_pcm_ops = {
+    .init_out  = qpa_ll_init_out,
+    .fini_out  = qpa_ll_fini_out,
+    .run_out   = qpa_ll_run_out,
+    .write     = qpa_write,
+    .ctl_out   = qpa_ctl_out,
+    .stats_out = qpa_ll_stats_out,
+    .init_in   = qpa_init_in,
+    .fini_in   = qpa_fini_in,
+    .run_in    = qpa_run_in,
+    .read      = qpa_read,
+    .ctl_in    = qpa_ctl_in
+};
+
+struct audio_driver pa_lowlat_audio_driver = {
+    .name           = "pa_lowlat",
+    .descr          = "PulseAudio, low-latency playback",
+    .options        = qpa_options,
+    .init           = qpa_audio_init,
+    .fini           = qpa_audio_fini,
+    .pcm_ops        = &qpa_ll_pcm_ops,
+    .can_be_default = 0,
+    .max_voices_out = INT_MAX,
+    .max_voices_in  = INT_MAX,
+    .voice_size_out = sizeof (PAVoiceOut),
+    .voice_size_in  = sizeof (PAVoiceIn),
+};
@@ -49,8 +49,18 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
     oend = obuf + *osamp;
 
     if (rate->opos_inc == (1ULL + UINT_MAX)) {
-        int i, n = *isamp > *osamp ? *osamp : *isamp;
-        for (i = 0; i < n; i++) {
+        int i = 0, n = *isamp > *osamp ? *osamp : *isamp;
+#ifdef OP_SSE2
+        if (mixeng_sse2) {
+            /* One st_sample (two int64_t) per vector. */
+            for (; i < n; i++) {
+                __m128i *o = (__m128i *) &obuf[i];
+                __m128i v = _mm_loadu_si128 ((const __m128i *) &ibuf[i]);
+                _mm_storeu_si128 (o, OP_SSE2 (_mm_loadu_si128 (o), v));
+            }
+        }
+#endif
+        for (; i < n; i++) {
             OP (obuf[i].l, ibuf[i].l);
             OP (obuf[i].r, ibuf[i].r);
         }
@@ -109,3 +119,4 @@ the_end:
 
 #undef NAME
 #undef OP
+#undef OP_SSE2
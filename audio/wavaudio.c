@@ -36,6 +36,7 @@
 typedef struct WAVVoiceOut {
     HWVoiceOut hw;
     FILE *f;
+    FILE *timestamps;
     int64_t old_ticks;
     void *pcm_buf;
     int total_samples;
@@ -44,6 +45,14 @@ typedef struct WAVVoiceOut {
 static struct {
     struct audsettings settings;
     const char *wav_path;
+    /* Write the samples as soon as the guest plays them, instead of at the
+     * pace of the virtual clock, e.g. to run media tests faster than real
+     * time. */
+    int unpaced;
+    /* Path of a text file receiving, for each run that writes samples, the
+     * virtual time in ns, the index of the first sample frame and the
+     * number of frames, or NULL. */
+    const char *timestamps_path;
 } conf_out = {
     {
         44100,
@@ -51,9 +60,16 @@ static struct {
         AUD_FMT_S16,
         0
     },
-    "qemu.wav"
+    "qemu.wav",
+    0,
+    NULL
 };
 
+/* Size of the mixing buffer, in sample frames. In unpaced mode, it bounds
+ * the number of frames taken from the guest at each audio timer period. */
+#define  WAV_OUT_SAMPLES          1024
+#define  WAV_OUT_UNPACED_SAMPLES  8192
+
 static int wav_out_run (HWVoiceOut *hw, int live)
 {
     WAVVoiceOut *wav = (WAVVoiceOut *) hw;
@@ -65,7 +81,10 @@ static int wav_out_run (HWVoiceOut *hw, int live)
     int64_t bytes =
         muldiv64 (ticks, hw->info.bytes_per_second, get_ticks_per_sec ());
 
-    if (bytes > INT_MAX) {
+    if (conf_out.unpaced) {
+        samples = live;
+    }
+    else if (bytes > INT_MAX) {
         samples = INT_MAX >> hw->info.shift;
     }
     else {
@@ -75,6 +94,10 @@ static int wav_out_run (HWVoiceOut *hw, int live)
     wav->old_ticks = now;
     decr = audio_MIN (live, samples);
     samples = decr;
+    if (wav->timestamps && decr > 0) {
+        fprintf (wav->timestamps, "%" PRId64 " %d %d\n",
+                 now, wav->total_samples, decr);
+    }
     rpos = hw->rpos;
     while (samples) {
         int left_till_end_samples = hw->samples - rpos;
@@ -150,7 +173,7 @@ static int wav_out_init (HWVoiceOut *hw, struct audsettings *as)
     wav_as.endianness = 0;
     audio_pcm_init_info (&hw->info, &wav_as);
 
-    hw->samples = 1024;
+    hw->samples = conf_out.unpaced ? WAV_OUT_UNPACED_SAMPLES : WAV_OUT_SAMPLES;
     wav->pcm_buf = audio_calloc (AUDIO_FUNC, hw->samples, 1 << hw->info.shift);
     if (!wav->pcm_buf) {
         dolog ("Could not allocate buffer (%d bytes)\n",
@@ -177,6 +200,14 @@ static int wav_out_init (HWVoiceOut *hw, struct audsettings *as)
                strerror(errno));
         return -1;
     }
+
+    if (conf_out.timestamps_path) {
+        wav->timestamps = fopen (conf_out.timestamps_path, "w");
+        if (!wav->timestamps) {
+            dolog ("Failed to open timestamps file `%s'\nReason: %s\n",
+                   conf_out.timestamps_path, strerror (errno));
+        }
+    }
     return 0;
 }
 
@@ -204,6 +235,11 @@ static void wav_out_fini (HWVoiceOut *hw)
     fclose (wav->f);
     wav->f = NULL;
 
+    if (wav->timestamps) {
+        fclose (wav->timestamps);
+        wav->timestamps = NULL;
+    }
+
     g_free (wav->pcm_buf);
     wav->pcm_buf = NULL;
 }
@@ -440,6 +476,12 @@ static struct audio_option wav_options[] = {
     {"PATH", AUD_OPT_STR, &conf_out.wav_path,
      "Path to output .wav file", NULL, 0},
 
+    {"UNPACED", AUD_OPT_BOOL, &conf_out.unpaced,
+     "Write samples as fast as the guest plays them", NULL, 0},
+
+    {"TIMESTAMPS", AUD_OPT_STR, &conf_out.timestamps_path,
+     "Path to output virtual time stamps of the samples", NULL, 0},
+
 #if WAV_AUDIO_IN
     {"IN_PATH", AUD_OPT_STR, &conf_in.wav_path,
      "Path to input .wav file", NULL, 0},
@@ -453,6 +495,7 @@ struct audio_pcm_ops wav_pcm_ops = {
     wav_out_run,
     wav_out_write,
     wav_out_ctl,
+    NULL,
 
 #if WAV_AUDIO_IN
     wav_in_init,
@@ -26,6 +26,7 @@ static int (*__dll_pa_stream_connect_record)(pa_stream * s, const char * dev, co
 static int (*__dll_pa_stream_drop)(pa_stream * p) = 0;
 static uint32_t (*__dll_pa_stream_get_device_index)(pa_stream * s) = 0;
 static uint32_t (*__dll_pa_stream_get_index)(pa_stream * s) = 0;
+static int (*__dll_pa_stream_get_latency)(pa_stream * s, pa_usec_t * r_usec, int * negative) = 0;
 static pa_stream_state_t (*__dll_pa_stream_get_state)(pa_stream * p) = 0;
 static pa_stream* (*__dll_pa_stream_new)(pa_context * c, const char * name, const pa_sample_spec * ss, const pa_channel_map * map) = 0;
 static int (*__dll_pa_stream_peek)(pa_stream * p, const void ** data, size_t * nbytes) = 0;
@@ -123,6 +124,10 @@ uint32_t pa_stream_get_index(pa_stream * s) {
   return __dll_pa_stream_get_index(s);
 }
 
+int pa_stream_get_latency(pa_stream * s, pa_usec_t * r_usec, int * negative) {
+  return __dll_pa_stream_get_latency(s, r_usec, negative);
+}
+
 pa_stream_state_t pa_stream_get_state(pa_stream * p) {
   return __dll_pa_stream_get_state(p);
 }
@@ -245,6 +250,8 @@ int pulse_audio_dynlink_init(void* lib) {
   if (!__dll_pa_stream_get_device_index) return -1;
   __dll_pa_stream_get_index = (uint32_t(*)(pa_stream * s))dlsym(lib, "pa_stream_get_index");
   if (!__dll_pa_stream_get_index) return -1;
+  __dll_pa_stream_get_latency = (int(*)(pa_stream * s, pa_usec_t * r_usec, int * negative))dlsym(lib, "pa_stream_get_latency");
+  if (!__dll_pa_stream_get_latency) return -1;
   __dll_pa_stream_get_state = (pa_stream_state_t(*)(pa_stream * p))dlsym(lib, "pa_stream_get_state");
   if (!__dll_pa_stream_get_state) return -1;
   __dll_pa_stream_new = (pa_stream*(*)(pa_context * c, const char * name, const pa_sample_spec * ss, const pa_channel_map * map))dlsym(lib, "pa_stream_new");
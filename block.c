@@ -27,7 +27,9 @@
 #include "block/block_int.h"
 #include "qemu/iov.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
 //#include "qapi/qmp/types.h"
+#include "qapi/qmp/qint.h"
 #include "qapi/qmp/qjson.h"
 
 #ifdef CONFIG_BSD
@@ -54,6 +56,13 @@ static BlockDriverAIOCB *bdrv_aio_flush_em(BlockDriverState *bs,
         BlockDriverCompletionFunc *cb, void *opaque);
 static BlockDriverAIOCB *bdrv_aio_noop_em(BlockDriverState *bs,
         BlockDriverCompletionFunc *cb, void *opaque);
+static BlockDriverAIOCB *bdrv_merge_rw(BlockDriverState *bs,
+        int64_t sector_num, QEMUIOVector *qiov, int nb_sectors,
+        BlockDriverCompletionFunc *cb, void *opaque, int is_write);
+static int bdrv_merge_enabled(BlockDriverState *bs);
+static void bdrv_merge_submit(BlockDriverState *bs);
+static void bdrv_merge_invalidate(BlockDriverState *bs, int64_t sector_num,
+                                  int nb_sectors);
 static int bdrv_read_em(BlockDriverState *bs, int64_t sector_num,
                         uint8_t *buf, int nb_sectors);
 static int bdrv_write_em(BlockDriverState *bs, int64_t sector_num,
@@ -160,6 +169,8 @@ BlockDriverState *bdrv_new(const char *device_name)
 
     bs = g_malloc0(sizeof(BlockDriverState));
     pstrcpy(bs->device_name, sizeof(bs->device_name), device_name);
+    QTAILQ_INIT(&bs->merge_queue);
+    throttle_init(&bs->io_throttle);
     if (device_name[0] != '\0') {
         QTAILQ_INSERT_TAIL(&bdrv_states, bs, list);
     }
@@ -649,6 +660,11 @@ unlink_and_fail:
 void bdrv_close(BlockDriverState *bs)
 {
     if (bs->drv) {
+        bdrv_merge_submit(bs);
+        bs->ra_generation++;
+        qemu_vfree(bs->ra_buf);
+        bs->ra_buf = NULL;
+        bs->ra_nb_sectors = 0;
         if (bs == bs_snapshots) {
             bs_snapshots = NULL;
         }
@@ -699,6 +715,12 @@ void bdrv_delete(BlockDriverState *bs)
     if (bs->file != NULL) {
         bdrv_delete(bs->file);
     }
+    if (bs->merge_bh) {
+        qemu_bh_delete(bs->merge_bh);
+    }
+    if (bs->throttle_timer) {
+        timer_free(bs->throttle_timer);
+    }
 
     assert(bs != bs_snapshots);
     g_free(bs);
@@ -969,9 +991,36 @@ int bdrv_write(BlockDriverState *bs, int64_t sector_num,
         bs->wr_highest_sector = sector_num + nb_sectors - 1;
     }
 
+    bdrv_merge_submit(bs);
+    bdrv_merge_invalidate(bs, sector_num, nb_sectors);
+
     return drv->bdrv_write(bs, sector_num, buf, nb_sectors);
 }
 
+int bdrv_discard(BlockDriverState *bs, int64_t sector_num, int nb_sectors)
+{
+    BlockDriver *drv = bs->drv;
+    if (!drv)
+        return -ENOMEDIUM;
+    if (bs->read_only)
+        return -EACCES;
+    if (bdrv_check_request(bs, sector_num, nb_sectors))
+        return -EIO;
+
+    if (bs->dirty_bitmap) {
+        set_dirty_bitmap(bs, sector_num, nb_sectors, 1);
+    }
+
+    /* Queued writes were issued before the discard, and the cached sectors
+     * no longer hold what the driver would return. */
+    bdrv_merge_submit(bs);
+    bdrv_merge_invalidate(bs, sector_num, nb_sectors);
+
+    if (!drv->bdrv_discard)
+        return 0;
+    return drv->bdrv_discard(bs, sector_num, nb_sectors);
+}
+
 int bdrv_pread(BlockDriverState *bs, int64_t offset,
                void *buf, int count1)
 {
@@ -1459,6 +1508,7 @@ void bdrv_flush(BlockDriverState *bs)
         return;
     }
 
+    bdrv_merge_submit(bs);
     if (bs->drv && bs->drv->bdrv_flush)
         bs->drv->bdrv_flush(bs);
 }
@@ -1652,6 +1702,17 @@ static void bdrv_stats_iter(QObject *data, void *opaque)
                         qdict_get_int(qdict, "wr_bytes"),
                         qdict_get_int(qdict, "rd_operations"),
                         qdict_get_int(qdict, "wr_operations"));
+    if (qdict_haskey(qdict, "l2_cache_hits")) {
+        monitor_printf(mon, "    l2_cache_hits=%" PRId64
+                            " l2_cache_misses=%" PRId64
+                            " refcount_cache_hits=%" PRId64
+                            " refcount_cache_misses=%" PRId64
+                            "\n",
+                            qdict_get_int(qdict, "l2_cache_hits"),
+                            qdict_get_int(qdict, "l2_cache_misses"),
+                            qdict_get_int(qdict, "refcount_cache_hits"),
+                            qdict_get_int(qdict, "refcount_cache_misses"));
+    }
 }
 
 void bdrv_stats_print(Monitor *mon, const QObject *data)
@@ -1663,6 +1724,7 @@ static QObject* bdrv_info_stats_bs(BlockDriverState *bs)
 {
     QObject *res;
     QDict *dict;
+    BlockDriverInfo bdi;
 
     res = qobject_from_jsonf("{ 'stats': {"
                              "'rd_bytes': %" PRId64 ","
@@ -1677,6 +1739,18 @@ static QObject* bdrv_info_stats_bs(BlockDriverState *bs)
                              (uint64_t)BDRV_SECTOR_SIZE);
     dict  = qobject_to_qdict(res);
 
+    if (bdrv_get_info(bs, &bdi) == 0 &&
+        (bdi.l2_cache_hits || bdi.l2_cache_misses)) {
+        QDict *stats = qobject_to_qdict(qdict_get(dict, "stats"));
+        qdict_put(stats, "l2_cache_hits", qint_from_int(bdi.l2_cache_hits));
+        qdict_put(stats, "l2_cache_misses",
+                  qint_from_int(bdi.l2_cache_misses));
+        qdict_put(stats, "refcount_cache_hits",
+                  qint_from_int(bdi.refcount_cache_hits));
+        qdict_put(stats, "refcount_cache_misses",
+                  qint_from_int(bdi.refcount_cache_misses));
+    }
+
     if (*bs->device_name) {
         qdict_put(dict, "device", qstring_from_str(bs->device_name));
     }
@@ -1767,6 +1841,22 @@ int bdrv_save_vmstate(BlockDriverState *bs, const uint8_t *buf,
     return -ENOTSUP;
 }
 
+int bdrv_aio_save_vmstate(BlockDriverState *bs, const uint8_t *buf,
+                          int64_t pos, int size,
+                          BlockDriverCompletionFunc *cb, void *opaque)
+{
+    BlockDriver *drv = bs->drv;
+    if (!drv)
+        return -ENOMEDIUM;
+    if (drv->bdrv_aio_save_vmstate &&
+        !(pos & ~BDRV_SECTOR_MASK) && !(size & ~BDRV_SECTOR_MASK))
+        return drv->bdrv_aio_save_vmstate(bs, buf, pos, size, cb, opaque);
+    if (!drv->bdrv_save_vmstate && bs->file)
+        return bdrv_aio_save_vmstate(bs->file, buf, pos, size, cb, opaque);
+    cb(opaque, bdrv_save_vmstate(bs, buf, pos, size));
+    return 0;
+}
+
 int bdrv_load_vmstate(BlockDriverState *bs, uint8_t *buf,
                       int64_t pos, int size)
 {
@@ -1780,6 +1870,25 @@ int bdrv_load_vmstate(BlockDriverState *bs, uint8_t *buf,
     return -ENOTSUP;
 }
 
+int64_t bdrv_map_vmstate(BlockDriverState *bs, int64_t pos, int *size,
+                         const char **filename)
+{
+    BlockDriver *drv = bs->drv;
+    BlockDriverState *file = bs->file;
+    int64_t offset;
+
+    if (!drv)
+        return -ENOMEDIUM;
+    /* Only plain files can be mapped into memory */
+    if (!drv->bdrv_map_vmstate || !file || !file->drv ||
+        !file->drv->protocol_name || strcmp(file->drv->protocol_name, "file"))
+        return -ENOTSUP;
+    offset = drv->bdrv_map_vmstate(bs, pos, size);
+    if (offset >= 0)
+        *filename = file->filename;
+    return offset;
+}
+
 void bdrv_debug_event(BlockDriverState *bs, BlkDebugEvent event)
 {
     BlockDriver *drv = bs->drv;
@@ -1988,8 +2097,12 @@ BlockDriverAIOCB *bdrv_aio_readv(BlockDriverState *bs, int64_t sector_num,
     if (bdrv_check_request(bs, sector_num, nb_sectors))
         return NULL;
 
-    ret = drv->bdrv_aio_readv(bs, sector_num, qiov, nb_sectors,
-                              cb, opaque);
+    if (bdrv_merge_enabled(bs)) {
+        ret = bdrv_merge_rw(bs, sector_num, qiov, nb_sectors, cb, opaque, 0);
+    } else {
+        ret = drv->bdrv_aio_readv(bs, sector_num, qiov, nb_sectors,
+                                  cb, opaque);
+    }
 
     if (ret) {
 	/* Update stats even though technically transfer has not happened. */
@@ -2018,8 +2131,12 @@ BlockDriverAIOCB *bdrv_aio_writev(BlockDriverState *bs, int64_t sector_num,
         set_dirty_bitmap(bs, sector_num, nb_sectors, 1);
     }
 
-    ret = drv->bdrv_aio_writev(bs, sector_num, qiov, nb_sectors,
-                               cb, opaque);
+    if (bdrv_merge_enabled(bs)) {
+        ret = bdrv_merge_rw(bs, sector_num, qiov, nb_sectors, cb, opaque, 1);
+    } else {
+        ret = drv->bdrv_aio_writev(bs, sector_num, qiov, nb_sectors,
+                                   cb, opaque);
+    }
 
     if (ret) {
         /* Update stats even though technically transfer has not happened. */
@@ -2256,6 +2373,415 @@ fail:
     return -1;
 }
 
+/**************************************************************/
+/* request merging and readahead */
+
+/*
+ * The requests of guest devices, i.e. of block devices with a name, don't
+ * go to the driver right away. They are queued until the main loop runs the
+ * bottom half of the device, which submits each run of adjacent requests in
+ * the same direction as a single driver request. The queue is never
+ * reordered, so merging can't change the outcome of overlapping requests.
+ *
+ * Sequential reads are also extended with an adaptive readahead window, and
+ * the extra sectors are kept in a small per-device cache that serves the
+ * next reads without reaching the driver. Writes drop the cached sectors
+ * they overlap, and a readahead is discarded if any write was issued while
+ * it was in flight.
+ */
+
+/* Largest driver request built by merging, in sectors. */
+#define MERGE_MAX_SECTORS       2048
+
+/* Bounds of the readahead window, in sectors. */
+#define READAHEAD_MIN_SECTORS   64
+#define READAHEAD_MAX_SECTORS   512
+
+enum {
+    MERGE_QUEUED,       /* in bs->merge_queue */
+    MERGE_SUBMITTED,    /* part of a driver request */
+    MERGE_CACHED,       /* served by the readahead cache, completes in a BH */
+    MERGE_DONE,         /* completed, but cancelled */
+};
+
+typedef struct BlockMergeAIOCB {
+    BlockDriverAIOCB common;
+    int64_t sector_num;
+    int nb_sectors;
+    QEMUIOVector *qiov;
+    int is_write;
+    int state;
+    int cancelled;
+    QEMUBH *bh;
+    QTAILQ_ENTRY(BlockMergeAIOCB) node;
+} BlockMergeAIOCB;
+
+typedef struct BlockMergeReq {
+    BlockDriverState *bs;
+    QEMUIOVector qiov;
+    int is_write;
+    /* readahead part of the request, if any */
+    uint8_t *ra_buf;
+    int64_t ra_sector;
+    int ra_nb_sectors;
+    uint64_t ra_generation;
+    struct BlockMergeQueue acbs;
+} BlockMergeReq;
+
+static int bdrv_merge_enabled(BlockDriverState *bs)
+{
+    return bs->device_name[0] != '\0' && !bs->sg;
+}
+
+static void bdrv_merge_complete(BlockMergeAIOCB *acb, int ret)
+{
+    acb->state = MERGE_DONE;
+    /* bdrv_merge_cancel() releases cancelled requests */
+    if (!acb->cancelled) {
+        acb->common.cb(acb->common.opaque, ret);
+        qemu_aio_release(acb);
+    }
+}
+
+/* Drop the cached sectors that overlap a write, and discard the readahead
+ * in flight. */
+static void bdrv_merge_invalidate(BlockDriverState *bs, int64_t sector_num,
+                                  int nb_sectors)
+{
+    bs->ra_generation++;
+    if (bs->ra_buf &&
+        sector_num < bs->ra_sector + bs->ra_nb_sectors &&
+        sector_num + nb_sectors > bs->ra_sector) {
+        qemu_vfree(bs->ra_buf);
+        bs->ra_buf = NULL;
+        bs->ra_nb_sectors = 0;
+    }
+}
+
+static void bdrv_merge_cancel(BlockDriverAIOCB *blockacb)
+{
+    BlockMergeAIOCB *acb = container_of(blockacb, BlockMergeAIOCB, common);
+
+    switch (acb->state) {
+    case MERGE_QUEUED:
+        QTAILQ_REMOVE(&acb->common.bs->merge_queue, acb, node);
+        break;
+    case MERGE_CACHED:
+        qemu_bh_delete(acb->bh);
+        acb->bh = NULL;
+        break;
+    case MERGE_SUBMITTED:
+        /* The other requests merged with this one still need the driver
+         * request, so wait for it. */
+        acb->cancelled = 1;
+        while (acb->state != MERGE_DONE) {
+            qemu_aio_wait();
+        }
+        break;
+    }
+    qemu_aio_release(acb);
+}
+
+static AIOPool bdrv_merge_aio_pool = {
+    .aiocb_size         = sizeof(BlockMergeAIOCB),
+    .cancel             = bdrv_merge_cancel,
+};
+
+static void bdrv_merge_req_cb(void *opaque, int ret)
+{
+    BlockMergeReq *req = opaque;
+    BlockDriverState *bs = req->bs;
+    BlockMergeAIOCB *acb;
+
+    if (req->is_write) {
+        bs->writes_in_flight--;
+        bs->ra_generation++;
+    }
+
+    if (req->ra_buf) {
+        bs->ra_in_flight = 0;
+        if (ret == 0 && req->ra_generation == bs->ra_generation) {
+            qemu_vfree(bs->ra_buf);
+            bs->ra_buf = req->ra_buf;
+            bs->ra_sector = req->ra_sector;
+            bs->ra_nb_sectors = req->ra_nb_sectors;
+            bs->merge_stats.readahead_bytes +=
+                (uint64_t)req->ra_nb_sectors * BDRV_SECTOR_SIZE;
+        } else {
+            qemu_vfree(req->ra_buf);
+        }
+    }
+
+    while ((acb = QTAILQ_FIRST(&req->acbs)) != NULL) {
+        QTAILQ_REMOVE(&req->acbs, acb, node);
+        bdrv_merge_complete(acb, ret);
+    }
+    qemu_iovec_destroy(&req->qiov);
+    g_free(req);
+}
+
+/* Extend the read request |req| of |nb_sectors| at |sector_num| with the
+ * readahead window, if the reads of the device are sequential. */
+static void bdrv_merge_readahead(BlockDriverState *bs, BlockMergeReq *req,
+                                 int64_t sector_num, int nb_sectors)
+{
+    int64_t end = sector_num + nb_sectors;
+    BlockMergeAIOCB *acb;
+    int nb;
+
+    if (sector_num == bs->ra_next_sector) {
+        bs->ra_window = bs->ra_window ?
+                MIN(bs->ra_window * 2, READAHEAD_MAX_SECTORS) :
+                READAHEAD_MIN_SECTORS;
+    } else {
+        bs->ra_window = 0;
+    }
+    bs->ra_next_sector = end;
+
+    if (!bs->ra_window || bs->ra_in_flight || bs->writes_in_flight ||
+        req->qiov.niov >= IOV_MAX) {
+        return;
+    }
+    /* The queued writes will run concurrently with the readahead. */
+    QTAILQ_FOREACH(acb, &bs->merge_queue, node) {
+        if (acb->is_write) {
+            return;
+        }
+    }
+
+    nb = MIN(bs->ra_window, bs->total_sectors - end);
+    if (nb <= 0) {
+        return;
+    }
+    req->ra_buf = qemu_blockalign(bs, nb * BDRV_SECTOR_SIZE);
+    req->ra_sector = end;
+    req->ra_nb_sectors = nb;
+    req->ra_generation = bs->ra_generation;
+    qemu_iovec_add(&req->qiov, req->ra_buf, nb * BDRV_SECTOR_SIZE);
+    bs->ra_in_flight = 1;
+}
+
+/* Submit the requests of |queue| to the driver, merging adjacent ones. */
+static void bdrv_merge_submit_queue(BlockDriverState *bs,
+                                    struct BlockMergeQueue *queue)
+{
+    BlockMergeAIOCB *first, *acb;
+
+    while ((first = QTAILQ_FIRST(queue)) != NULL) {
+        BlockMergeReq *req;
+        BlockDriverAIOCB *ret;
+        int64_t sector_num = first->sector_num;
+        int nb_sectors = 0, niov = 0;
+
+        req = g_malloc0(sizeof(*req));
+        req->bs = bs;
+        req->is_write = first->is_write;
+        QTAILQ_INIT(&req->acbs);
+
+        /* Take the run of adjacent requests at the head of the queue. */
+        while ((acb = QTAILQ_FIRST(queue)) != NULL) {
+            if (acb != first) {
+                if (acb->is_write != first->is_write ||
+                    acb->sector_num != sector_num + nb_sectors ||
+                    nb_sectors + acb->nb_sectors > MERGE_MAX_SECTORS ||
+                    niov + acb->qiov->niov + 1 > IOV_MAX) {
+                    break;
+                }
+                bs->merge_stats.merged++;
+            }
+            nb_sectors += acb->nb_sectors;
+            niov += acb->qiov->niov;
+            QTAILQ_REMOVE(queue, acb, node);
+            QTAILQ_INSERT_TAIL(&req->acbs, acb, node);
+            acb->state = MERGE_SUBMITTED;
+        }
+
+        qemu_iovec_init(&req->qiov, niov + 1);
+        QTAILQ_FOREACH(acb, &req->acbs, node) {
+            qemu_iovec_concat(&req->qiov, acb->qiov, 0,
+                              acb->nb_sectors * BDRV_SECTOR_SIZE);
+        }
+
+        if (!bs->drv) {
+            bdrv_merge_req_cb(req, -ENOMEDIUM);
+            continue;
+        }
+        if (req->is_write) {
+            bs->writes_in_flight++;
+            ret = bs->drv->bdrv_aio_writev(bs, sector_num, &req->qiov,
+                                           nb_sectors, bdrv_merge_req_cb, req);
+        } else {
+            bdrv_merge_readahead(bs, req, sector_num, nb_sectors);
+            ret = bs->drv->bdrv_aio_readv(bs, sector_num, &req->qiov,
+                                          req->qiov.size >> BDRV_SECTOR_BITS,
+                                          bdrv_merge_req_cb, req);
+        }
+        if (!ret) {
+            bdrv_merge_req_cb(req, -EIO);
+        }
+    }
+}
+
+/* Submit the queued requests of |bs| now, to order them before a flush or
+ * a synchronous write. */
+static void bdrv_merge_submit(BlockDriverState *bs)
+{
+    /* In nested async contexts, the requests would complete in the wrong
+     * context, leave them to the bottom half. */
+    if (get_async_context_id() == 0) {
+        bdrv_merge_submit_queue(bs, &bs->merge_queue);
+    }
+}
+
+/* Submit the queued requests of |bs| that its I/O limits allow now, and
+ * retry the other ones when they allow the next one. */
+static void bdrv_merge_throttle(BlockDriverState *bs)
+{
+    struct BlockMergeQueue queue = QTAILQ_HEAD_INITIALIZER(queue);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t delay = 0;
+    BlockMergeAIOCB *acb;
+
+    while ((acb = QTAILQ_FIRST(&bs->merge_queue)) != NULL) {
+        delay = throttle_delay(&bs->io_throttle, now);
+        if (delay > 0) {
+            break;
+        }
+        throttle_account(&bs->io_throttle,
+                         (uint64_t)acb->nb_sectors * BDRV_SECTOR_SIZE, now);
+        QTAILQ_REMOVE(&bs->merge_queue, acb, node);
+        QTAILQ_INSERT_TAIL(&queue, acb, node);
+    }
+    bdrv_merge_submit_queue(bs, &queue);
+
+    if (acb) {
+        timer_mod(bs->throttle_timer, now + delay);
+    }
+}
+
+static void bdrv_merge_bh(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+
+    if (throttle_enabled(&bs->io_throttle)) {
+        bdrv_merge_throttle(bs);
+    } else {
+        bdrv_merge_submit(bs);
+    }
+}
+
+static void bdrv_merge_cached_bh(void *opaque)
+{
+    BlockMergeAIOCB *acb = opaque;
+
+    qemu_bh_delete(acb->bh);
+    acb->bh = NULL;
+    bdrv_merge_complete(acb, 0);
+}
+
+/* Serve the read |acb| from the readahead cache. Return 1 on success, or 0
+ * if the cache doesn't hold all of its sectors. */
+static int bdrv_merge_read_cached(BlockDriverState *bs, BlockMergeAIOCB *acb)
+{
+    int64_t end = acb->sector_num + acb->nb_sectors;
+
+    if (!bs->ra_buf || acb->sector_num < bs->ra_sector ||
+        end > bs->ra_sector + bs->ra_nb_sectors) {
+        return 0;
+    }
+    qemu_iovec_from_buf(acb->qiov, 0,
+            bs->ra_buf + (acb->sector_num - bs->ra_sector) * BDRV_SECTOR_SIZE,
+            acb->nb_sectors * BDRV_SECTOR_SIZE);
+    bs->ra_next_sector = end;
+    bs->merge_stats.readahead_hits++;
+
+    acb->state = MERGE_CACHED;
+    acb->bh = qemu_bh_new(bdrv_merge_cached_bh, acb);
+    qemu_bh_schedule(acb->bh);
+    return 1;
+}
+
+static BlockDriverAIOCB *bdrv_merge_rw(BlockDriverState *bs,
+        int64_t sector_num, QEMUIOVector *qiov, int nb_sectors,
+        BlockDriverCompletionFunc *cb, void *opaque, int is_write)
+{
+    BlockMergeAIOCB *acb;
+
+    acb = qemu_aio_get(&bdrv_merge_aio_pool, bs, cb, opaque);
+    acb->sector_num = sector_num;
+    acb->nb_sectors = nb_sectors;
+    acb->qiov = qiov;
+    acb->is_write = is_write;
+    acb->cancelled = 0;
+
+    bs->merge_stats.requests++;
+    if (is_write) {
+        bdrv_merge_invalidate(bs, sector_num, nb_sectors);
+    } else {
+        bs->merge_stats.reads++;
+        if (bdrv_merge_read_cached(bs, acb)) {
+            return &acb->common;
+        }
+    }
+
+    acb->state = MERGE_QUEUED;
+    if (get_async_context_id() != 0) {
+        /* The bottom half doesn't run in nested async contexts, and the
+         * queued requests must complete in their own context. */
+        struct BlockMergeQueue queue = QTAILQ_HEAD_INITIALIZER(queue);
+
+        QTAILQ_INSERT_TAIL(&queue, acb, node);
+        bdrv_merge_submit_queue(bs, &queue);
+        return &acb->common;
+    }
+
+    QTAILQ_INSERT_TAIL(&bs->merge_queue, acb, node);
+    if (!bs->merge_bh) {
+        bs->merge_bh = qemu_bh_new(bdrv_merge_bh, bs);
+    }
+    qemu_bh_schedule(bs->merge_bh);
+    return &acb->common;
+}
+
+void bdrv_get_merge_stats(BlockDriverState *bs, BlockMergeStats *stats)
+{
+    *stats = bs->merge_stats;
+}
+
+void bdrv_set_io_limits(BlockDriverState *bs, uint64_t bps, uint64_t iops)
+{
+    throttle_set_limits(&bs->io_throttle, bps, iops);
+    if (throttle_enabled(&bs->io_throttle) && !bs->throttle_timer) {
+        bs->throttle_timer = timer_new(QEMU_CLOCK_REALTIME, SCALE_NS,
+                                       bdrv_merge_bh, bs);
+    }
+    /* The requests waiting for the previous limits follow the new ones. */
+    if (!QTAILQ_EMPTY(&bs->merge_queue)) {
+        if (bs->throttle_timer) {
+            timer_del(bs->throttle_timer);
+        }
+        qemu_bh_schedule(bs->merge_bh);
+    }
+}
+
+void bdrv_get_io_limits(BlockDriverState *bs, uint64_t *bps, uint64_t *iops)
+{
+    *bps = bs->io_throttle.bps;
+    *iops = bs->io_throttle.iops;
+}
+
+void bdrv_throttle_drain(void)
+{
+    BlockDriverState *bs;
+
+    QTAILQ_FOREACH(bs, &bdrv_states, list) {
+        if (throttle_enabled(&bs->io_throttle) &&
+            !QTAILQ_EMPTY(&bs->merge_queue)) {
+            bdrv_merge_submit(bs);
+        }
+    }
+}
+
 BlockDriverAIOCB *bdrv_aio_flush(BlockDriverState *bs,
         BlockDriverCompletionFunc *cb, void *opaque)
 {
@@ -2267,6 +2793,7 @@ BlockDriverAIOCB *bdrv_aio_flush(BlockDriverState *bs,
 
     if (!drv)
         return NULL;
+    bdrv_merge_submit(bs);
     return drv->bdrv_aio_flush(bs, cb, opaque);
 }
 
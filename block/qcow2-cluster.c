@@ -94,23 +94,31 @@ void qcow2_l2_cache_reset(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
 
-    memset(s->l2_cache, 0, s->l2_size * L2_CACHE_SIZE * sizeof(uint64_t));
-    memset(s->l2_cache_offsets, 0, L2_CACHE_SIZE * sizeof(uint64_t));
-    memset(s->l2_cache_counts, 0, L2_CACHE_SIZE * sizeof(uint32_t));
+    memset(s->l2_cache, 0,
+           s->l2_size * s->l2_cache_size * sizeof(uint64_t));
+    memset(s->l2_cache_offsets, 0, s->l2_cache_size * sizeof(uint64_t));
+    memset(s->l2_cache_lru, 0, s->l2_cache_size * sizeof(uint64_t));
+}
+
+/* Marks a cache entry as the most recently used one */
+static inline void l2_cache_touch(BDRVQcowState *s, int index)
+{
+    s->l2_cache_lru[index] = ++s->l2_cache_clock;
 }
 
 static inline int l2_cache_new_entry(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
-    uint32_t min_count;
+    uint64_t min_lru;
     int min_index, i;
 
-    /* find a new entry in the least used one */
+    /* find a new entry in the least recently used one, unused entries
+     * have never been touched and come first */
     min_index = 0;
-    min_count = 0xffffffff;
-    for(i = 0; i < L2_CACHE_SIZE; i++) {
-        if (s->l2_cache_counts[i] < min_count) {
-            min_count = s->l2_cache_counts[i];
+    min_lru = UINT64_MAX;
+    for(i = 0; i < s->l2_cache_size; i++) {
+        if (s->l2_cache_lru[i] < min_lru) {
+            min_lru = s->l2_cache_lru[i];
             min_index = i;
         }
     }
@@ -123,27 +131,23 @@ static inline int l2_cache_new_entry(BlockDriverState *bs)
  * seek l2_offset in the l2_cache table
  * if not found, return NULL,
  * if found,
- *   increments the l2 cache hit count of the entry,
- *   if counter overflow, divide by two all counters
+ *   marks the entry as the most recently used one
  *   return the pointer to the l2 cache entry
  *
  */
 
 static uint64_t *seek_l2_table(BDRVQcowState *s, uint64_t l2_offset)
 {
-    int i, j;
+    int i;
 
-    for(i = 0; i < L2_CACHE_SIZE; i++) {
+    for(i = 0; i < s->l2_cache_size; i++) {
         if (l2_offset == s->l2_cache_offsets[i]) {
-            /* increment the hit count */
-            if (++s->l2_cache_counts[i] == 0xffffffff) {
-                for(j = 0; j < L2_CACHE_SIZE; j++) {
-                    s->l2_cache_counts[j] >>= 1;
-                }
-            }
+            s->l2_cache_hits++;
+            l2_cache_touch(s, i);
             return s->l2_cache + (i << s->l2_bits);
         }
     }
+    s->l2_cache_misses++;
     return NULL;
 }
 
@@ -171,11 +175,16 @@ static int l2_load(BlockDriverState *bs, uint64_t l2_offset,
         return 0;
     }
 
-    /* not found: load a new entry in the least used one */
+    /* not found: load a new entry in the least recently used one */
 
     min_index = l2_cache_new_entry(bs);
     *l2_table = s->l2_cache + (min_index << s->l2_bits);
 
+    /* the entry doesn't describe its old table anymore, even if the read
+     * fails */
+    s->l2_cache_offsets[min_index] = 0;
+    s->l2_cache_lru[min_index] = 0;
+
     BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
     ret = bdrv_pread(bs->file, l2_offset, *l2_table,
         s->l2_size * sizeof(uint64_t));
@@ -184,7 +193,7 @@ static int l2_load(BlockDriverState *bs, uint64_t l2_offset,
     }
 
     s->l2_cache_offsets[min_index] = l2_offset;
-    s->l2_cache_counts[min_index] = 1;
+    l2_cache_touch(s, min_index);
 
     return 0;
 }
@@ -279,7 +288,7 @@ static int l2_allocate(BlockDriverState *bs, int l1_index, uint64_t **table)
     /* update the l2 cache entry */
 
     s->l2_cache_offsets[min_index] = l2_offset;
-    s->l2_cache_counts[min_index] = 1;
+    l2_cache_touch(s, min_index);
 
     *table = l2_table;
     return 0;
@@ -516,6 +525,44 @@ out:
     return 0;
 }
 
+/*
+ * get_cluster_entry
+ *
+ * For a given offset of the disk image, return in *l2_entry the L2 table
+ * entry of its cluster, including the QCOW_OFLAG_COPIED and
+ * QCOW_OFLAG_COMPRESSED flags, or 0 if the cluster isn't allocated.
+ *
+ * Return 0 on success, -errno otherwise.
+ */
+
+int qcow2_get_cluster_entry(BlockDriverState *bs, uint64_t offset,
+    uint64_t *l2_entry)
+{
+    BDRVQcowState *s = bs->opaque;
+    unsigned int l1_index, l2_index;
+    uint64_t l2_offset, *l2_table;
+    int ret;
+
+    *l2_entry = 0;
+
+    l1_index = offset >> (s->l2_bits + s->cluster_bits);
+    if (l1_index >= s->l1_size)
+        return 0;
+
+    l2_offset = s->l1_table[l1_index] & ~QCOW_OFLAG_COPIED;
+    if (!l2_offset)
+        return 0;
+
+    ret = l2_load(bs, l2_offset, &l2_table);
+    if (ret < 0) {
+        return ret;
+    }
+
+    l2_index = (offset >> s->cluster_bits) & (s->l2_size - 1);
+    *l2_entry = be64_to_cpu(l2_table[l2_index]);
+    return 0;
+}
+
 /*
  * get_cluster_table
  *
@@ -728,6 +775,112 @@ err:
     return ret;
  }
 
+/*
+ * Frees |nb_clusters| clusters from |offset|, all covered by the L2 table of
+ * L1 entry |l1_index|, which isn't shared with a snapshot.
+ */
+static int discard_single_l2(BlockDriverState *bs, int l1_index,
+    uint64_t offset, int nb_clusters)
+{
+    BDRVQcowState *s = bs->opaque;
+    uint64_t l2_offset = s->l1_table[l1_index] & ~QCOW_OFLAG_COPIED;
+    uint64_t *l2_table, *old_cluster;
+    int i, j = 0, l2_index, ret;
+
+    ret = l2_load(bs, l2_offset, &l2_table);
+    if (ret < 0) {
+        return ret;
+    }
+    l2_index = (offset >> s->cluster_bits) & (s->l2_size - 1);
+
+    old_cluster = g_malloc(nb_clusters * sizeof(uint64_t));
+    for (i = 0; i < nb_clusters; i++) {
+        if (l2_table[l2_index + i] != 0) {
+            old_cluster[j++] = be64_to_cpu(l2_table[l2_index + i]);
+            l2_table[l2_index + i] = 0;
+        }
+    }
+    if (j == 0) {
+        goto out;
+    }
+
+    /* Clear the L2 entries before freeing the clusters, so that they are
+     * never referenced with a zero refcount. */
+    ret = write_l2_entries(bs, l2_table, l2_offset, l2_index, nb_clusters);
+    if (ret < 0) {
+        qcow2_l2_cache_reset(bs);
+        goto out;
+    }
+
+    for (i = 0; i < j; i++) {
+        uint64_t cluster_offset = old_cluster[i] & ~QCOW_OFLAG_COPIED;
+
+        if (old_cluster[i] & QCOW_OFLAG_COMPRESSED) {
+            qcow2_free_any_clusters(bs, old_cluster[i], 1);
+            continue;
+        }
+        qcow2_free_clusters(bs, cluster_offset, s->cluster_size);
+        /* The copied flag means that the refcount was 1, so the cluster is
+         * now unused and its space can be freed in the image file too.
+         * Shared clusters remain in use by a snapshot. */
+        if (old_cluster[i] & QCOW_OFLAG_COPIED) {
+            bdrv_discard(bs->file, cluster_offset >> BDRV_SECTOR_BITS,
+                         s->cluster_sectors);
+        }
+    }
+
+out:
+    g_free(old_cluster);
+    return ret;
+}
+
+/*
+ * discard_clusters
+ *
+ * Deallocates the clusters entirely covered by |nb_sectors| sectors from
+ * |offset|, which then read as zeroes.
+ *
+ * Images with a backing file are left unchanged, since unallocated clusters
+ * read from the backing file instead. The L2 tables shared with snapshots
+ * are left unchanged too: their clusters are still used by the snapshots,
+ * and discarding them would only allocate a copy of the table.
+ *
+ * Return 0 on success and -errno in error cases
+ */
+int qcow2_discard_clusters(BlockDriverState *bs, uint64_t offset,
+    int nb_sectors)
+{
+    BDRVQcowState *s = bs->opaque;
+    uint64_t end = offset + ((uint64_t)nb_sectors << BDRV_SECTOR_BITS);
+    int ret;
+
+    if (bs->backing_hd) {
+        return 0;
+    }
+
+    offset = (offset + s->cluster_size - 1) & ~(uint64_t)(s->cluster_size - 1);
+    end &= ~(uint64_t)(s->cluster_size - 1);
+
+    while (offset < end) {
+        int l1_index = offset >> (s->l2_bits + s->cluster_bits);
+        uint64_t l2_end = (uint64_t)(l1_index + 1) <<
+                          (s->l2_bits + s->cluster_bits);
+        uint64_t chunk_end = MIN(end, l2_end);
+
+        if (l1_index < s->l1_size &&
+            (s->l1_table[l1_index] & QCOW_OFLAG_COPIED)) {
+            ret = discard_single_l2(bs, l1_index, offset,
+                                    (chunk_end - offset) >> s->cluster_bits);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        offset = chunk_end;
+    }
+
+    return 0;
+}
+
 /*
  * alloc_cluster_offset
  *
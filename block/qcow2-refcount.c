@@ -34,34 +34,136 @@ static int QEMU_WARN_UNUSED_RESULT update_refcount(BlockDriverState *bs,
 
 static int cache_refcount_updates = 0;
 
-static int write_refcount_block(BlockDriverState *bs)
+/*
+ * The refcount block cache keeps several refcount blocks in memory and evicts
+ * the least recently used one. The block that is being worked on is the
+ * current entry, refcount_block_cache and refcount_block_cache_offset point
+ * to it.
+ *
+ * Entries are normally written back by update_refcount as soon as it is done
+ * with them, so that refcounts are on disk before the L2 entries that depend
+ * on them. While cache_refcount_updates is set, updates only mark the entries
+ * dirty and they are written back in one batch by write_refcount_block (or
+ * when they are evicted).
+ */
+
+static inline uint16_t *refcount_cache_entry(BDRVQcowState *s, int index)
+{
+    return s->refcount_cache + ((size_t)index << (s->cluster_bits -
+                                                  REFCOUNT_SHIFT));
+}
+
+static void refcount_cache_set_current(BDRVQcowState *s, int index)
+{
+    s->refcount_cache_current = index;
+    s->refcount_cache_lru[index] = ++s->refcount_cache_clock;
+    s->refcount_block_cache = refcount_cache_entry(s, index);
+    s->refcount_block_cache_offset = s->refcount_cache_offsets[index];
+}
+
+static int refcount_cache_write_entry(BlockDriverState *bs, int index)
 {
     BDRVQcowState *s = bs->opaque;
-    size_t size = s->cluster_size;
+    int ret;
 
-    if (s->refcount_block_cache_offset == 0) {
+    if (!s->refcount_cache_dirty[index]) {
         return 0;
     }
 
     BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_UPDATE);
-    if (bdrv_pwrite_sync(bs->file, s->refcount_block_cache_offset,
-            s->refcount_block_cache, size) < 0)
-    {
-        return -EIO;
+    ret = bdrv_pwrite(bs->file, s->refcount_cache_offsets[index],
+                      refcount_cache_entry(s, index), s->cluster_size);
+    if (ret < 0) {
+        return ret;
+    }
+
+    s->refcount_cache_dirty[index] = 0;
+    return 0;
+}
+
+/* Writes all dirty refcount blocks to disk */
+static int write_refcount_block(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    int i, ret, written = 0;
+
+    for (i = 0; i < s->refcount_cache_size; i++) {
+        if (s->refcount_cache_dirty[i]) {
+            ret = refcount_cache_write_entry(bs, i);
+            if (ret < 0) {
+                return -EIO;
+            }
+            written = 1;
+        }
     }
 
+    /* One barrier for the whole batch, like bdrv_pwrite_sync() */
+    if (written && (bs->file->open_flags & BDRV_O_CACHE_MASK) != 0) {
+        bdrv_flush(bs->file);
+    }
     return 0;
 }
 
+/*
+ * Makes the least recently used entry of the refcount block cache the
+ * current entry for the given block, writing back its old content if
+ * needed. The content of the entry is undefined.
+ */
+static int refcount_cache_claim(BlockDriverState *bs, uint64_t offset)
+{
+    BDRVQcowState *s = bs->opaque;
+    uint64_t min_lru = UINT64_MAX;
+    int min_index = 0;
+    int i, ret;
+
+    for (i = 0; i < s->refcount_cache_size; i++) {
+        if (s->refcount_cache_lru[i] < min_lru) {
+            min_lru = s->refcount_cache_lru[i];
+            min_index = i;
+        }
+    }
+
+    ret = refcount_cache_write_entry(bs, min_index);
+    if (ret < 0) {
+        return ret;
+    }
+
+    s->refcount_cache_offsets[min_index] = offset;
+    refcount_cache_set_current(s, min_index);
+    return 0;
+}
+
+/* Drops the current entry without writing it back */
+static void refcount_cache_drop_current(BDRVQcowState *s)
+{
+    int index = s->refcount_cache_current;
+
+    s->refcount_cache_offsets[index] = 0;
+    s->refcount_cache_lru[index] = 0;
+    s->refcount_cache_dirty[index] = 0;
+    s->refcount_block_cache_offset = 0;
+}
+
 /*********************************************************/
 /* refcount handling */
 
-int qcow2_refcount_init(BlockDriverState *bs)
+int qcow2_refcount_init(BlockDriverState *bs, int cache_size)
 {
     BDRVQcowState *s = bs->opaque;
     int ret, refcount_table_size2, i;
 
-    s->refcount_block_cache = g_malloc(s->cluster_size);
+    s->refcount_cache_size = cache_size;
+    s->refcount_cache = g_malloc((size_t)cache_size * s->cluster_size);
+    s->refcount_cache_offsets = g_malloc0(cache_size * sizeof(uint64_t));
+    s->refcount_cache_lru = g_malloc0(cache_size * sizeof(uint64_t));
+    s->refcount_cache_dirty = g_malloc0(cache_size);
+    s->refcount_cache_clock = 0;
+    s->refcount_cache_hits = 0;
+    s->refcount_cache_misses = 0;
+    s->refcount_cache_current = 0;
+    s->refcount_block_cache = s->refcount_cache;
+    s->refcount_block_cache_offset = 0;
+
     refcount_table_size2 = s->refcount_table_size * sizeof(uint64_t);
     s->refcount_table = g_malloc(refcount_table_size2);
     if (s->refcount_table_size > 0) {
@@ -81,7 +183,14 @@ int qcow2_refcount_init(BlockDriverState *bs)
 void qcow2_refcount_close(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
-    g_free(s->refcount_block_cache);
+
+    if (s->refcount_cache_dirty) {
+        write_refcount_block(bs);
+    }
+    g_free(s->refcount_cache);
+    g_free(s->refcount_cache_offsets);
+    g_free(s->refcount_cache_lru);
+    g_free(s->refcount_cache_dirty);
     g_free(s->refcount_table);
 }
 
@@ -90,23 +199,35 @@ static int load_refcount_block(BlockDriverState *bs,
                                int64_t refcount_block_offset)
 {
     BDRVQcowState *s = bs->opaque;
-    int ret;
+    int i, ret;
 
-    if (cache_refcount_updates) {
-        ret = write_refcount_block(bs);
-        if (ret < 0) {
-            return ret;
+    if (refcount_block_offset == s->refcount_block_cache_offset) {
+        s->refcount_cache_hits++;
+        return 0;
+    }
+
+    for (i = 0; i < s->refcount_cache_size; i++) {
+        if (s->refcount_cache_offsets[i] == refcount_block_offset) {
+            s->refcount_cache_hits++;
+            refcount_cache_set_current(s, i);
+            return 0;
         }
     }
+    s->refcount_cache_misses++;
+
+    ret = refcount_cache_claim(bs, refcount_block_offset);
+    if (ret < 0) {
+        return ret;
+    }
 
     BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_LOAD);
     ret = bdrv_pread(bs->file, refcount_block_offset, s->refcount_block_cache,
                      s->cluster_size);
     if (ret < 0) {
+        refcount_cache_drop_current(s);
         return ret;
     }
 
-    s->refcount_block_cache_offset = refcount_block_offset;
     return 0;
 }
 
@@ -128,12 +249,10 @@ static int get_refcount(BlockDriverState *bs, int64_t cluster_index)
     refcount_block_offset = s->refcount_table[refcount_table_index];
     if (!refcount_block_offset)
         return 0;
-    if (refcount_block_offset != s->refcount_block_cache_offset) {
-        /* better than nothing: return allocated if read error */
-        ret = load_refcount_block(bs, refcount_block_offset);
-        if (ret < 0) {
-            return ret;
-        }
+    /* better than nothing: return allocated if read error */
+    ret = load_refcount_block(bs, refcount_block_offset);
+    if (ret < 0) {
+        return ret;
     }
     block_index = cluster_index &
         ((1 << (s->cluster_bits - REFCOUNT_SHIFT)) - 1);
@@ -193,11 +312,9 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
 
         /* If it's already there, we're done */
         if (refcount_block_offset) {
-            if (refcount_block_offset != s->refcount_block_cache_offset) {
-                ret = load_refcount_block(bs, refcount_block_offset);
-                if (ret < 0) {
-                    return ret;
-                }
+            ret = load_refcount_block(bs, refcount_block_offset);
+            if (ret < 0) {
+                return ret;
             }
             return refcount_block_offset;
         }
@@ -246,8 +363,11 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
 
     if (in_same_refcount_block(s, new_block, cluster_index << s->cluster_bits)) {
         /* Zero the new refcount block before updating it */
+        ret = refcount_cache_claim(bs, new_block);
+        if (ret < 0) {
+            goto fail_block;
+        }
         memset(s->refcount_block_cache, 0, s->cluster_size);
-        s->refcount_block_cache_offset = new_block;
 
         /* The block describes itself, need to update the cache */
         int block_index = (new_block >> s->cluster_bits) &
@@ -263,8 +383,11 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
 
         /* Initialize the new refcount block only after updating its refcount,
          * update_refcount uses the refcount cache itself */
+        ret = refcount_cache_claim(bs, new_block);
+        if (ret < 0) {
+            goto fail_block;
+        }
         memset(s->refcount_block_cache, 0, s->cluster_size);
-        s->refcount_block_cache_offset = new_block;
     }
 
     /* Now the new refcount block needs to be written to disk */
@@ -417,7 +540,9 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
 fail_table:
     g_free(new_table);
 fail_block:
-    s->refcount_block_cache_offset = 0;
+    if (s->refcount_block_cache_offset == new_block) {
+        refcount_cache_drop_current(s);
+    }
     return ret;
 }
 
@@ -427,8 +552,9 @@ static int write_refcount_block_entries(BlockDriverState *bs,
 {
     BDRVQcowState *s = bs->opaque;
     size_t size;
-    int ret;
+    int i, ret;
 
+    /* Dirty entries are written back later in batched mode */
     if (cache_refcount_updates) {
         return 0;
     }
@@ -437,6 +563,16 @@ static int write_refcount_block_entries(BlockDriverState *bs,
         return 0;
     }
 
+    /* An entry that was evicted has already been written back */
+    for (i = 0; i < s->refcount_cache_size; i++) {
+        if (s->refcount_cache_offsets[i] == refcount_block_offset) {
+            break;
+        }
+    }
+    if (i == s->refcount_cache_size) {
+        return 0;
+    }
+
     first_index &= ~(REFCOUNTS_PER_SECTOR - 1);
     last_index = (last_index + REFCOUNTS_PER_SECTOR)
         & ~(REFCOUNTS_PER_SECTOR - 1);
@@ -446,15 +582,15 @@ static int write_refcount_block_entries(BlockDriverState *bs,
     BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_UPDATE_PART);
     ret = bdrv_pwrite_sync(bs->file,
         refcount_block_offset + (first_index << REFCOUNT_SHIFT),
-        &s->refcount_block_cache[first_index], size);
+        refcount_cache_entry(s, i) + first_index, size);
     if (ret < 0) {
         return ret;
     }
 
+    s->refcount_cache_dirty[i] = 0;
     return 0;
 }
 
-/* XXX: cache several refcount block clusters ? */
 static int QEMU_WARN_UNUSED_RESULT update_refcount(BlockDriverState *bs,
     int64_t offset, int64_t length, int addend)
 {
@@ -527,6 +663,7 @@ static int QEMU_WARN_UNUSED_RESULT update_refcount(BlockDriverState *bs,
             s->free_cluster_index = cluster_index;
         }
         s->refcount_block_cache[block_index] = cpu_to_be16(refcount);
+        s->refcount_cache_dirty[s->refcount_cache_current] = 1;
     }
 
     ret = 0;
@@ -741,134 +878,308 @@ void qcow2_create_refcount_update(QCowCreateState *s, int64_t offset,
     }
 }
 
+/* Number of modified L2 tables that are written back together */
+#define L2_WRITE_BATCH 16
+
+/*
+ * Updates the refcounts of the clusters mapped by l2_table, merging runs of
+ * contiguous clusters into a single update. If update_flags is set, the
+ * copied flags of the entries are then recomputed from the new refcounts.
+ *
+ * Returns 1 if l2_table was modified, 0 if not, or -errno.
+ */
+static int update_l2_refcounts(BlockDriverState *bs, uint64_t *l2_table,
+    int addend, int update_flags)
+{
+    BDRVQcowState *s = bs->opaque;
+    int64_t run_offset = 0, run_length = 0;
+    int j, nb_csectors, refcount, ret, modified = 0;
+    uint64_t offset, old_offset;
+
+    if (addend != 0) {
+        for (j = 0; j < s->l2_size; j++) {
+            offset = be64_to_cpu(l2_table[j]) & ~QCOW_OFLAG_COPIED;
+            if (offset == 0) {
+                continue;
+            }
+            if (offset & QCOW_OFLAG_COMPRESSED) {
+                nb_csectors = ((offset >> s->csize_shift) &
+                               s->csize_mask) + 1;
+                ret = update_refcount(bs,
+                    (offset & s->cluster_offset_mask) & ~511,
+                    nb_csectors * 512, addend);
+                if (ret < 0) {
+                    return ret;
+                }
+                continue;
+            }
+            if (run_length > 0 && offset == run_offset + run_length) {
+                run_length += s->cluster_size;
+                continue;
+            }
+            ret = update_refcount(bs, run_offset, run_length, addend);
+            if (ret < 0) {
+                return ret;
+            }
+            run_offset = offset;
+            run_length = s->cluster_size;
+        }
+        ret = update_refcount(bs, run_offset, run_length, addend);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    if (!update_flags) {
+        return 0;
+    }
+
+    for (j = 0; j < s->l2_size; j++) {
+        offset = be64_to_cpu(l2_table[j]);
+        if (offset == 0) {
+            continue;
+        }
+        old_offset = offset;
+        offset &= ~QCOW_OFLAG_COPIED;
+        if (offset & QCOW_OFLAG_COMPRESSED) {
+            /* compressed clusters are never modified */
+            refcount = 2;
+        } else {
+            refcount = get_refcount(bs, offset >> s->cluster_bits);
+            if (refcount < 0) {
+                return refcount;
+            }
+        }
+        if (refcount == 1) {
+            offset |= QCOW_OFLAG_COPIED;
+        }
+        if (offset != old_offset) {
+            l2_table[j] = cpu_to_be64(offset);
+            modified = 1;
+        }
+    }
+    return modified;
+}
+
+static int write_l2_batch(BlockDriverState *bs, uint64_t *l2_batch,
+    uint64_t *l2_offsets, int count)
+{
+    BDRVQcowState *s = bs->opaque;
+    int l2_size = s->l2_size * sizeof(uint64_t);
+    int i, ret;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    /* The copied flags must not reach the disk before the refcounts */
+    ret = write_refcount_block(bs);
+    if (ret < 0) {
+        return ret;
+    }
+    for (i = 0; i < count; i++) {
+        ret = bdrv_pwrite(bs->file, l2_offsets[i],
+                          l2_batch + (size_t)i * s->l2_size, l2_size);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Updates the refcounts of the L2 tables referenced by the entries
+ * [start, end) of l1_table, which is in host byte order, and of the clusters
+ * they map. If update_flags is set, the copied flags of the L2 tables and of
+ * the L1 entries are recomputed, the modified L2 tables are written back in
+ * batches and *l1_modified is set if l1_table changed.
+ *
+ * Returns the number of L2 tables written, or -errno.
+ */
+static int update_l1_refcounts(BlockDriverState *bs, uint64_t *l1_table,
+    int start, int end, int addend, int update_flags, int *l1_modified)
+{
+    BDRVQcowState *s = bs->opaque;
+    int l2_size = s->l2_size * sizeof(uint64_t);
+    uint64_t *l2_batch, l2_offsets[L2_WRITE_BATCH];
+    uint64_t l2_offset, new_entry;
+    int i, ret, refcount, nb_batched = 0, nb_written = 0;
+
+    l2_batch = g_malloc((size_t)L2_WRITE_BATCH * l2_size);
+    for (i = start; i < end; i++) {
+        uint64_t *l2_table = l2_batch + (size_t)nb_batched * s->l2_size;
+        int l2_modified;
+
+        l2_offset = l1_table[i] & ~QCOW_OFLAG_COPIED;
+        if (l2_offset == 0) {
+            continue;
+        }
+        if (bdrv_pread(bs->file, l2_offset, l2_table, l2_size) != l2_size) {
+            ret = -EIO;
+            goto out;
+        }
+        l2_modified = update_l2_refcounts(bs, l2_table, addend, update_flags);
+        if (l2_modified < 0) {
+            ret = l2_modified;
+            goto out;
+        }
+
+        if (addend != 0) {
+            refcount = update_cluster_refcount(bs,
+                l2_offset >> s->cluster_bits, addend);
+        } else {
+            refcount = get_refcount(bs, l2_offset >> s->cluster_bits);
+        }
+        if (refcount < 0) {
+            ret = refcount;
+            goto out;
+        }
+
+        if (!update_flags) {
+            continue;
+        }
+        /* A table that was just freed may already be reused, don't write
+         * it back */
+        if (l2_modified && refcount > 0) {
+            l2_offsets[nb_batched++] = l2_offset;
+            if (nb_batched == L2_WRITE_BATCH) {
+                ret = write_l2_batch(bs, l2_batch, l2_offsets, nb_batched);
+                if (ret < 0) {
+                    goto out;
+                }
+                nb_written += nb_batched;
+                nb_batched = 0;
+            }
+        }
+        new_entry = l2_offset | (refcount == 1 ? QCOW_OFLAG_COPIED : 0);
+        if (new_entry != l1_table[i]) {
+            l1_table[i] = new_entry;
+            *l1_modified = 1;
+        }
+    }
+
+    ret = write_l2_batch(bs, l2_batch, l2_offsets, nb_batched);
+    if (ret == 0) {
+        ret = nb_written + nb_batched;
+    }
+out:
+    g_free(l2_batch);
+    return ret;
+}
+
+/* Writes l1_table, in host byte order, to l1_table_offset */
+static int write_l1_table(BlockDriverState *bs, int64_t l1_table_offset,
+    const uint64_t *l1_table, int l1_size)
+{
+    uint64_t *buf;
+    int i, ret;
+
+    buf = g_malloc(l1_size * sizeof(uint64_t));
+    for (i = 0; i < l1_size; i++) {
+        buf[i] = cpu_to_be64(l1_table[i]);
+    }
+    ret = bdrv_pwrite_sync(bs->file, l1_table_offset, buf,
+                           l1_size * sizeof(uint64_t));
+    g_free(buf);
+    return ret;
+}
+
+/*
+ * Runs update_l1_refcounts() with batched refcount updates, then writes
+ * back the refcounts and, if update_flags is set, l1_table.
+ */
+static int update_l1_refcounts_batched(BlockDriverState *bs,
+    int64_t l1_table_offset, uint64_t *l1_table, int l1_size,
+    int start, int end, int addend, int update_flags)
+{
+    int l1_modified = 0;
+    int ret, wret;
+
+    if (update_flags) {
+        /* The L2 tables are rewritten behind the back of the cache */
+        qcow2_l2_cache_reset(bs);
+    }
+    cache_refcount_updates = 1;
+    ret = update_l1_refcounts(bs, l1_table, start, end, addend, update_flags,
+                              &l1_modified);
+    cache_refcount_updates = 0;
+
+    wret = write_refcount_block(bs);
+    if (ret >= 0 && wret < 0) {
+        ret = wret;
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (l1_modified) {
+        return write_l1_table(bs, l1_table_offset, l1_table, l1_size);
+    }
+    /* The L2 tables are flushed with the L1 table otherwise */
+    if (ret > 0 && (bs->file->open_flags & BDRV_O_CACHE_MASK) != 0) {
+        bdrv_flush(bs->file);
+    }
+    return 0;
+}
+
 /* update the refcounts of snapshots and the copied flag */
 int qcow2_update_snapshot_refcount(BlockDriverState *bs,
     int64_t l1_table_offset, int l1_size, int addend)
 {
     BDRVQcowState *s = bs->opaque;
-    uint64_t *l1_table, *l2_table, l2_offset, offset, l1_size2, l1_allocated;
-    int64_t old_offset, old_l2_offset;
-    int l2_size, i, j, l1_modified, l2_modified, nb_csectors, refcount;
-
-    qcow2_l2_cache_reset(bs);
-    cache_refcount_updates = 1;
+    uint64_t *l1_table;
+    int l1_size2, i, ret;
 
-    l2_table = NULL;
-    l1_table = NULL;
     l1_size2 = l1_size * sizeof(uint64_t);
     if (l1_table_offset != s->l1_table_offset) {
-        if (l1_size2 != 0) {
-            l1_table = g_malloc0(align_offset(l1_size2, 512));
-        } else {
-            l1_table = NULL;
-        }
-        l1_allocated = 1;
+        l1_table = g_malloc0(align_offset(l1_size2, 512));
         if (bdrv_pread(bs->file, l1_table_offset,
-                       l1_table, l1_size2) != l1_size2)
-            goto fail;
+                       l1_table, l1_size2) != l1_size2) {
+            g_free(l1_table);
+            return -EIO;
+        }
         for(i = 0;i < l1_size; i++)
             be64_to_cpus(&l1_table[i]);
     } else {
         assert(l1_size == s->l1_size);
         l1_table = s->l1_table;
-        l1_allocated = 0;
     }
 
-    l2_size = s->l2_size * sizeof(uint64_t);
-    l2_table = g_malloc(l2_size);
-    l1_modified = 0;
-    for(i = 0; i < l1_size; i++) {
-        l2_offset = l1_table[i];
-        if (l2_offset) {
-            old_l2_offset = l2_offset;
-            l2_offset &= ~QCOW_OFLAG_COPIED;
-            l2_modified = 0;
-            if (bdrv_pread(bs->file, l2_offset, l2_table, l2_size) != l2_size)
-                goto fail;
-            for(j = 0; j < s->l2_size; j++) {
-                offset = be64_to_cpu(l2_table[j]);
-                if (offset != 0) {
-                    old_offset = offset;
-                    offset &= ~QCOW_OFLAG_COPIED;
-                    if (offset & QCOW_OFLAG_COMPRESSED) {
-                        nb_csectors = ((offset >> s->csize_shift) &
-                                       s->csize_mask) + 1;
-                        if (addend != 0) {
-                            int ret;
-                            ret = update_refcount(bs,
-                                (offset & s->cluster_offset_mask) & ~511,
-                                nb_csectors * 512, addend);
-                            if (ret < 0) {
-                                goto fail;
-                            }
-                        }
-                        /* compressed clusters are never modified */
-                        refcount = 2;
-                    } else {
-                        if (addend != 0) {
-                            refcount = update_cluster_refcount(bs, offset >> s->cluster_bits, addend);
-                        } else {
-                            refcount = get_refcount(bs, offset >> s->cluster_bits);
-                        }
-
-                        if (refcount < 0) {
-                            goto fail;
-                        }
-                    }
+    ret = update_l1_refcounts_batched(bs, l1_table_offset, l1_table, l1_size,
+                                      0, l1_size, addend, 1);
 
-                    if (refcount == 1) {
-                        offset |= QCOW_OFLAG_COPIED;
-                    }
-                    if (offset != old_offset) {
-                        l2_table[j] = cpu_to_be64(offset);
-                        l2_modified = 1;
-                    }
-                }
-            }
-            if (l2_modified) {
-                if (bdrv_pwrite_sync(bs->file,
-                                l2_offset, l2_table, l2_size) < 0)
-                    goto fail;
-            }
-
-            if (addend != 0) {
-                refcount = update_cluster_refcount(bs, l2_offset >> s->cluster_bits, addend);
-            } else {
-                refcount = get_refcount(bs, l2_offset >> s->cluster_bits);
-            }
-            if (refcount < 0) {
-                goto fail;
-            } else if (refcount == 1) {
-                l2_offset |= QCOW_OFLAG_COPIED;
-            }
-            if (l2_offset != old_l2_offset) {
-                l1_table[i] = l2_offset;
-                l1_modified = 1;
-            }
-        }
+    if (l1_table != s->l1_table) {
+        g_free(l1_table);
     }
-    if (l1_modified) {
-        for(i = 0; i < l1_size; i++)
-            cpu_to_be64s(&l1_table[i]);
-        if (bdrv_pwrite_sync(bs->file, l1_table_offset, l1_table,
-                        l1_size2) < 0)
-            goto fail;
-        for(i = 0; i < l1_size; i++)
-            be64_to_cpus(&l1_table[i]);
+    return ret < 0 ? -EIO : 0;
+}
+
+/*
+ * Drops the references that the entries [start, end) of the L1 table of a
+ * deleted snapshot hold on L2 tables and clusters. l1_table is in host byte
+ * order. No table is written, the copied flags of the current L1 table are
+ * recomputed separately by qcow2_update_copied_flags().
+ */
+int qcow2_drop_snapshot_refcounts(BlockDriverState *bs, uint64_t *l1_table,
+    int start, int end)
+{
+    return update_l1_refcounts_batched(bs, 0, l1_table, 0, start, end,
+                                       -1, 0);
+}
+
+/*
+ * Recomputes the copied flags of the entries [start, end) of the current L1
+ * table and of the L2 tables they reference. No request may be in flight.
+ */
+int qcow2_update_copied_flags(BlockDriverState *bs, int start, int end)
+{
+    BDRVQcowState *s = bs->opaque;
+
+    if (end > s->l1_size) {
+        end = s->l1_size;
     }
-    if (l1_allocated)
-        g_free(l1_table);
-    g_free(l2_table);
-    cache_refcount_updates = 0;
-    write_refcount_block(bs);
-    return 0;
- fail:
-    if (l1_allocated)
-        g_free(l1_table);
-    g_free(l2_table);
-    cache_refcount_updates = 0;
-    write_refcount_block(bs);
-    return -EIO;
+    return update_l1_refcounts_batched(bs, s->l1_table_offset, s->l1_table,
+                                       s->l1_size, start, end, 0, 1);
 }
 
 
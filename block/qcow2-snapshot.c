@@ -23,8 +23,10 @@
  */
 
 #include "qemu-common.h"
+#include "block/aio.h"
 #include "block/block_int.h"
 #include "block/qcow2.h"
+#include "qemu/timer.h"
 
 typedef struct __attribute__((packed)) QCowSnapshotHeader {
     /* header is 8 byte aligned */
@@ -322,6 +324,9 @@ int qcow2_snapshot_goto(BlockDriverState *bs, const char *snapshot_id)
         return -ENOENT;
     sn = &s->snapshots[snapshot_index];
 
+    /* The copied flags pass works on the current L1 table */
+    qcow2_snapshot_drain(bs);
+
     if (qcow2_update_snapshot_refcount(bs, s->l1_table_offset, s->l1_size, -1) < 0)
         goto fail;
 
@@ -352,25 +357,150 @@ int qcow2_snapshot_goto(BlockDriverState *bs, const char *snapshot_id)
     return -EIO;
 }
 
+/*
+ * Deleting a snapshot drops a reference on each of its clusters, which
+ * means reading all of its L2 tables. To avoid blocking the guest for that
+ * long, qcow2_snapshot_delete() only removes the snapshot from the snapshot
+ * table, and a timer drops the references a few L2 tables at a time. If the
+ * emulator exits before that's done, the remaining clusters are leaked,
+ * which 'qemu-img check -r' repairs.
+ *
+ * Dropping references doesn't write any L1 or L2 table, so it can run while
+ * guest requests are in flight. Once no deletion is left, the timer goes
+ * through the current L1 table to set the copied flags of the clusters that
+ * aren't shared anymore; that part waits for the requests in flight before
+ * each step, because it rewrites L2 tables.
+ */
+
+/* Number of L1 entries handled by each step of the timer. */
+#define SNAPSHOT_FREE_STEP_ENTRIES  8
+
+/* Delay between two steps, to let the guest run. */
+#define SNAPSHOT_FREE_STEP_MS       5
+
+/*
+ * Runs one step of the pending deletions, handling at most max_entries L1
+ * entries. Returns 1 if there is work left, 0 otherwise.
+ */
+static int qcow2_snapshot_free_step(BlockDriverState *bs, int max_entries)
+{
+    BDRVQcowState *s = bs->opaque;
+    QCowSnapshotFree *sf = QTAILQ_FIRST(&s->snapshot_frees);
+    int end, ret;
+
+    if (sf) {
+        end = sf->l1_size;
+        if (end - sf->next_index > max_entries) {
+            end = sf->next_index + max_entries;
+        }
+        ret = qcow2_drop_snapshot_refcounts(bs, sf->l1_table,
+                                            sf->next_index, end);
+        if (ret < 0) {
+            /* Leak the clusters that are left */
+            fprintf(stderr, "qcow2: could not free snapshot clusters: %s\n",
+                    strerror(-ret));
+            end = sf->l1_size;
+        }
+        sf->next_index = end;
+        if (sf->next_index < sf->l1_size) {
+            return 1;
+        }
+
+        if (ret >= 0) {
+            qcow2_free_clusters(bs, sf->l1_table_offset,
+                                sf->l1_size * sizeof(uint64_t));
+        }
+        QTAILQ_REMOVE(&s->snapshot_frees, sf, next);
+        g_free(sf->l1_table);
+        g_free(sf);
+        if (QTAILQ_EMPTY(&s->snapshot_frees)) {
+            s->copied_flags_index = 0;
+        }
+        return 1;
+    }
+
+    if (s->copied_flags_index < 0) {
+        return 0;
+    }
+
+    qemu_aio_flush();
+    end = s->l1_size;
+    if (end - s->copied_flags_index > max_entries) {
+        end = s->copied_flags_index + max_entries;
+    }
+    if (qcow2_update_copied_flags(bs, s->copied_flags_index, end) < 0 ||
+        end >= s->l1_size) {
+        /* Missing copied flags only cost extra copy-on-writes */
+        s->copied_flags_index = -1;
+#ifdef DEBUG_ALLOC
+        qcow2_check_refcounts(bs);
+#endif
+        return 0;
+    }
+    s->copied_flags_index = end;
+    return 1;
+}
+
+static void qcow2_snapshot_free_timer_cb(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVQcowState *s = bs->opaque;
+
+    if (qcow2_snapshot_free_step(bs, SNAPSHOT_FREE_STEP_ENTRIES)) {
+        timer_mod(s->snapshot_free_timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                  SNAPSHOT_FREE_STEP_MS);
+    }
+}
+
+void qcow2_snapshot_init(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+
+    QTAILQ_INIT(&s->snapshot_frees);
+    s->copied_flags_index = -1;
+    s->snapshot_free_timer = NULL;
+}
+
+/* Completes the pending deletions before returning. */
+void qcow2_snapshot_drain(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+
+    while (qcow2_snapshot_free_step(bs, INT_MAX)) {
+    }
+    if (s->snapshot_free_timer) {
+        timer_del(s->snapshot_free_timer);
+        timer_free(s->snapshot_free_timer);
+        s->snapshot_free_timer = NULL;
+    }
+}
+
 int qcow2_snapshot_delete(BlockDriverState *bs, const char *snapshot_id)
 {
     BDRVQcowState *s = bs->opaque;
     QCowSnapshot *sn;
-    int snapshot_index, ret;
+    QCowSnapshotFree *sf;
+    int snapshot_index, ret, i, l1_size2;
 
     snapshot_index = find_snapshot_by_id_or_name(bs, snapshot_id);
     if (snapshot_index < 0)
         return -ENOENT;
     sn = &s->snapshots[snapshot_index];
 
-    ret = qcow2_update_snapshot_refcount(bs, sn->l1_table_offset, sn->l1_size, -1);
-    if (ret < 0)
-        return ret;
-    /* must update the copied flag on the current cluster offsets */
-    ret = qcow2_update_snapshot_refcount(bs, s->l1_table_offset, s->l1_size, 0);
-    if (ret < 0)
-        return ret;
-    qcow2_free_clusters(bs, sn->l1_table_offset, sn->l1_size * sizeof(uint64_t));
+    sf = g_malloc0(sizeof(*sf));
+    sf->l1_table_offset = sn->l1_table_offset;
+    sf->l1_size = sn->l1_size;
+    l1_size2 = sn->l1_size * sizeof(uint64_t);
+    sf->l1_table = g_malloc0(align_offset(l1_size2, 512));
+    if (bdrv_pread(bs->file, sn->l1_table_offset,
+                   sf->l1_table, l1_size2) != l1_size2) {
+        g_free(sf->l1_table);
+        g_free(sf);
+        return -EIO;
+    }
+    for(i = 0; i < sf->l1_size; i++)
+        be64_to_cpus(&sf->l1_table[i]);
 
     g_free(sn->id_str);
     g_free(sn->name);
@@ -379,11 +509,20 @@ int qcow2_snapshot_delete(BlockDriverState *bs, const char *snapshot_id)
     ret = qcow_write_snapshots(bs);
     if (ret < 0) {
         /* XXX: restore snapshot if error ? */
+        g_free(sf->l1_table);
+        g_free(sf);
         return ret;
     }
-#ifdef DEBUG_ALLOC
-    qcow2_check_refcounts(bs);
-#endif
+
+    /* The snapshot is gone from the image, its clusters are freed later */
+    QTAILQ_INSERT_TAIL(&s->snapshot_frees, sf, next);
+    s->copied_flags_index = -1;
+    if (!s->snapshot_free_timer) {
+        s->snapshot_free_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                              qcow2_snapshot_free_timer_cb,
+                                              bs);
+    }
+    timer_mod(s->snapshot_free_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME));
     return 0;
 }
 
@@ -136,6 +136,28 @@ static int qcow_read_extensions(BlockDriverState *bs, uint64_t start_offset,
 }
 
 
+/* Size of the metadata caches of images opened from now on, in bytes */
+static int64_t cache_size = DEFAULT_CACHE_SIZE;
+
+void qcow2_set_cache_size(int64_t size)
+{
+    cache_size = size;
+}
+
+/* Number of cache entries of entry_size bytes that fit in size bytes */
+static int qcow_cache_entries(int64_t size, int entry_size, int min, int max)
+{
+    int64_t entries = size / entry_size;
+
+    if (entries < min) {
+        return min;
+    }
+    if (entries > max) {
+        return max;
+    }
+    return entries;
+}
+
 static int qcow_open(BlockDriverState *bs, int flags)
 {
     BDRVQcowState *s = bs->opaque;
@@ -204,14 +226,26 @@ static int qcow_open(BlockDriverState *bs, int flags)
         }
     }
     /* alloc L2 cache */
-    s->l2_cache = g_malloc(s->l2_size * L2_CACHE_SIZE * sizeof(uint64_t));
+    s->l2_cache_size = qcow_cache_entries(cache_size, s->cluster_size,
+                                          MIN_L2_CACHE_SIZE,
+                                          MAX_L2_CACHE_SIZE);
+    s->l2_cache = g_malloc0((size_t)s->l2_size * s->l2_cache_size *
+                            sizeof(uint64_t));
+    s->l2_cache_offsets = g_malloc0(s->l2_cache_size * sizeof(uint64_t));
+    s->l2_cache_lru = g_malloc0(s->l2_cache_size * sizeof(uint64_t));
+    s->l2_cache_clock = 0;
+    s->l2_cache_hits = 0;
+    s->l2_cache_misses = 0;
     s->cluster_cache = g_malloc(s->cluster_size);
     /* one more sector for decompressed data alignment */
     s->cluster_data = g_malloc(QCOW_MAX_CRYPT_CLUSTERS * s->cluster_size
                                   + 512);
     s->cluster_cache_offset = -1;
 
-    if (qcow2_refcount_init(bs) < 0)
+    if (qcow2_refcount_init(bs,
+            qcow_cache_entries(cache_size / 4, s->cluster_size,
+                               MIN_REFCOUNT_CACHE_SIZE,
+                               MAX_REFCOUNT_CACHE_SIZE)) < 0)
         goto fail;
 
     QLIST_INIT(&s->cluster_allocs);
@@ -235,6 +269,7 @@ static int qcow_open(BlockDriverState *bs, int flags)
     }
     if (qcow2_read_snapshots(bs) < 0)
         goto fail;
+    qcow2_snapshot_init(bs);
 
 #ifdef DEBUG_ALLOC
     qcow2_check_refcounts(bs);
@@ -246,6 +281,8 @@ static int qcow_open(BlockDriverState *bs, int flags)
     qcow2_refcount_close(bs);
     g_free(s->l1_table);
     g_free(s->l2_cache);
+    g_free(s->l2_cache_offsets);
+    g_free(s->l2_cache_lru);
     g_free(s->cluster_cache);
     g_free(s->cluster_data);
     return -1;
@@ -661,8 +698,11 @@ static BlockDriverAIOCB *qcow_aio_writev(BlockDriverState *bs,
 static void qcow_close(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
+    qcow2_snapshot_drain(bs);
     g_free(s->l1_table);
     g_free(s->l2_cache);
+    g_free(s->l2_cache_offsets);
+    g_free(s->l2_cache_lru);
     g_free(s->cluster_cache);
     g_free(s->cluster_data);
     qcow2_refcount_close(bs);
@@ -1107,6 +1147,13 @@ static int qcow_make_empty(BlockDriverState *bs)
     return 0;
 }
 
+static int qcow_discard(BlockDriverState *bs, int64_t sector_num,
+                        int nb_sectors)
+{
+    return qcow2_discard_clusters(bs, sector_num << BDRV_SECTOR_BITS,
+                                  nb_sectors);
+}
+
 static int qcow2_truncate(BlockDriverState *bs, int64_t offset)
 {
     BDRVQcowState *s = bs->opaque;
@@ -1235,12 +1282,18 @@ static int qcow_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
     BDRVQcowState *s = bs->opaque;
     bdi->cluster_size = s->cluster_size;
     bdi->vm_state_offset = qcow_vm_state_offset(s);
+    bdi->l2_cache_hits = s->l2_cache_hits;
+    bdi->l2_cache_misses = s->l2_cache_misses;
+    bdi->refcount_cache_hits = s->refcount_cache_hits;
+    bdi->refcount_cache_misses = s->refcount_cache_misses;
     return 0;
 }
 
 
 static int qcow_check(BlockDriverState *bs, BdrvCheckResult *result)
 {
+    /* The refcounts are only consistent once deletions are done */
+    qcow2_snapshot_drain(bs);
     return qcow2_check_refcounts(bs, result);
 }
 
@@ -1265,19 +1318,192 @@ static void dump_refcounts(BlockDriverState *bs)
 }
 #endif
 
+/* Return 1 if writing |size| bytes of |buf| at |offset| wouldn't change
+ * the content of the image. The range must not cross a cluster boundary.
+ *
+ * Only clusters that are shared with a snapshot are compared, since
+ * writing to them would allocate and copy a new cluster. Others are
+ * simply overwritten in place. */
+static int qcow_vmstate_unchanged(BlockDriverState *bs, int64_t offset,
+                                  const uint8_t *buf, int size)
+{
+    BDRVQcowState *s = bs->opaque;
+    uint64_t l2_entry;
+    uint8_t *data;
+    int ret;
+
+    if (s->crypt_method ||
+        qcow2_get_cluster_entry(bs, offset, &l2_entry) < 0) {
+        return 0;
+    }
+    if (!l2_entry) {
+        /* unallocated clusters read as zeroes */
+        return !bs->backing_hd && buffer_is_zero(buf, size);
+    }
+    if (l2_entry & (QCOW_OFLAG_COPIED | QCOW_OFLAG_COMPRESSED)) {
+        return 0;
+    }
+
+    data = g_malloc(size);
+    ret = bdrv_pread(bs->file, l2_entry + (offset & (s->cluster_size - 1)),
+                     data, size);
+    ret = (ret == size && !memcmp(data, buf, size));
+    g_free(data);
+    return ret;
+}
+
+/*
+ * Successive snapshots of the same VM mostly contain the same data. The
+ * VM state is thus written one cluster at a time, skipping the clusters
+ * whose content wouldn't change. These remain shared with the previous
+ * snapshots through their refcount, instead of being copied, so saving
+ * a snapshot only allocates space for the clusters that actually changed.
+ */
 static int qcow_save_vmstate(BlockDriverState *bs, const uint8_t *buf,
                            int64_t pos, int size)
 {
     BDRVQcowState *s = bs->opaque;
     int growable = bs->growable;
-    int ret;
+    int64_t offset = qcow_vm_state_offset(s) + pos;
+    int start = 0, done = 0;
+    int ret = 0;
 
     BLKDBG_EVENT(bs->file, BLKDBG_VMSTATE_SAVE);
     bs->growable = 1;
-    ret = bdrv_pwrite(bs, qcow_vm_state_offset(s) + pos, buf, size);
+    while (done < size) {
+        int n = s->cluster_size - ((offset + done) & (s->cluster_size - 1));
+        if (n > size - done) {
+            n = size - done;
+        }
+        if (qcow_vmstate_unchanged(bs, offset + done, buf + done, n)) {
+            /* write the pending changed clusters in one request */
+            if (done > start) {
+                ret = bdrv_pwrite(bs, offset + start, buf + start,
+                                  done - start);
+                if (ret < 0) {
+                    break;
+                }
+            }
+            start = done + n;
+        }
+        done += n;
+    }
+    if (ret >= 0 && size > start) {
+        ret = bdrv_pwrite(bs, offset + start, buf + start, size - start);
+    }
     bs->growable = growable;
 
-    return ret;
+    return ret < 0 ? ret : size;
+}
+
+/*
+ * Asynchronous version of qcow_save_vmstate(), which lets the caller
+ * serialize the next part of the VM state while this one is written. The
+ * clusters are compared in the same way, and each run of changed clusters
+ * is written with an AIO request, scanning the rest of the buffer from its
+ * completion callback.
+ */
+typedef struct QcowVmstateWrite {
+    BlockDriverState *bs;
+    const uint8_t *buf;
+    int64_t offset;
+    int size;
+    int start;      /* start of the pending run of changed clusters */
+    int done;       /* bytes compared so far */
+    struct iovec iov;
+    QEMUIOVector qiov;
+    BlockDriverCompletionFunc *cb;
+    void *opaque;
+} QcowVmstateWrite;
+
+static void qcow_vmstate_write_next(QcowVmstateWrite *w);
+
+static void qcow_vmstate_write_cb(void *opaque, int ret)
+{
+    QcowVmstateWrite *w = opaque;
+
+    if (ret < 0) {
+        w->cb(w->opaque, ret);
+        g_free(w);
+        return;
+    }
+    qcow_vmstate_write_next(w);
+}
+
+/* Start writing the |len| bytes at |run| of the buffer. */
+static int qcow_vmstate_write_run(QcowVmstateWrite *w, int run, int len)
+{
+    BlockDriverState *bs = w->bs;
+    int growable = bs->growable;
+    BlockDriverAIOCB *acb;
+
+    w->iov.iov_base = (void *)(w->buf + run);
+    w->iov.iov_len = len;
+    qemu_iovec_init_external(&w->qiov, &w->iov, 1);
+    bs->growable = 1;
+    acb = bdrv_aio_writev(bs, (w->offset + run) >> BDRV_SECTOR_BITS,
+                          &w->qiov, len >> BDRV_SECTOR_BITS,
+                          qcow_vmstate_write_cb, w);
+    bs->growable = growable;
+    return acb ? 0 : -EIO;
+}
+
+static void qcow_vmstate_write_next(QcowVmstateWrite *w)
+{
+    BDRVQcowState *s = w->bs->opaque;
+    int run, ret = 0;
+
+    while (w->done < w->size) {
+        int n = s->cluster_size - ((w->offset + w->done) &
+                                   (s->cluster_size - 1));
+        if (n > w->size - w->done) {
+            n = w->size - w->done;
+        }
+        if (qcow_vmstate_unchanged(w->bs, w->offset + w->done,
+                                   w->buf + w->done, n)) {
+            run = w->start;
+            w->start = w->done + n;
+            if (w->done > run) {
+                /* write the pending changed clusters, and resume from
+                 * qcow_vmstate_write_cb() */
+                ret = qcow_vmstate_write_run(w, run, w->done - run);
+                w->done += n;
+                if (ret == 0) {
+                    return;
+                }
+                break;
+            }
+        }
+        w->done += n;
+    }
+    if (ret == 0 && w->size > w->start) {
+        run = w->start;
+        w->start = w->size;
+        ret = qcow_vmstate_write_run(w, run, w->size - run);
+        if (ret == 0) {
+            return;
+        }
+    }
+    w->cb(w->opaque, ret < 0 ? ret : w->size);
+    g_free(w);
+}
+
+static int qcow_aio_save_vmstate(BlockDriverState *bs, const uint8_t *buf,
+                                 int64_t pos, int size,
+                                 BlockDriverCompletionFunc *cb, void *opaque)
+{
+    BDRVQcowState *s = bs->opaque;
+    QcowVmstateWrite *w = g_malloc0(sizeof(*w));
+
+    BLKDBG_EVENT(bs->file, BLKDBG_VMSTATE_SAVE);
+    w->bs = bs;
+    w->buf = buf;
+    w->offset = qcow_vm_state_offset(s) + pos;
+    w->size = size;
+    w->cb = cb;
+    w->opaque = opaque;
+    qcow_vmstate_write_next(w);
+    return 0;
 }
 
 static int qcow_load_vmstate(BlockDriverState *bs, uint8_t *buf,
@@ -1295,6 +1521,51 @@ static int qcow_load_vmstate(BlockDriverState *bs, uint8_t *buf,
     return ret;
 }
 
+/* Clusters that are neither compressed nor encrypted store the VM state
+ * as-is, so the caller can read or map it directly from the image file. */
+static int64_t qcow_map_vmstate(BlockDriverState *bs, int64_t pos, int *size)
+{
+    BDRVQcowState *s = bs->opaque;
+    int64_t offset = qcow_vm_state_offset(s) + pos;
+    int64_t start = 0;
+    int done = 0;
+
+    if (s->crypt_method) {
+        return -ENOTSUP;
+    }
+    while (done < *size) {
+        int in_cluster = (offset + done) & (s->cluster_size - 1);
+        uint64_t l2_entry;
+        int64_t host;
+        int ret;
+
+        ret = qcow2_get_cluster_entry(bs, offset + done, &l2_entry);
+        if (ret < 0) {
+            if (done == 0) {
+                return ret;
+            }
+            break;
+        }
+        if (!l2_entry || (l2_entry & QCOW_OFLAG_COMPRESSED)) {
+            break;
+        }
+        host = (l2_entry & ~QCOW_OFLAG_COPIED) + in_cluster;
+        if (done == 0) {
+            start = host;
+        } else if (host != start + done) {
+            break;
+        }
+        done += s->cluster_size - in_cluster;
+    }
+    if (done == 0) {
+        return -ENOTSUP;
+    }
+    if (done < *size) {
+        *size = done;
+    }
+    return start;
+}
+
 static QEMUOptionParameter qcow_create_options[] = {
     {
         .name = BLOCK_OPT_SIZE,
@@ -1346,6 +1617,7 @@ static BlockDriver bdrv_qcow2 = {
     .bdrv_aio_flush	= qcow_aio_flush,
 
     .bdrv_truncate          = qcow2_truncate,
+    .bdrv_discard           = qcow_discard,
     .bdrv_write_compressed  = qcow_write_compressed,
 
     .bdrv_snapshot_create   = qcow2_snapshot_create,
@@ -1355,7 +1627,9 @@ static BlockDriver bdrv_qcow2 = {
     .bdrv_get_info	= qcow_get_info,
 
     .bdrv_save_vmstate    = qcow_save_vmstate,
+    .bdrv_aio_save_vmstate = qcow_aio_save_vmstate,
     .bdrv_load_vmstate    = qcow_load_vmstate,
+    .bdrv_map_vmstate     = qcow_map_vmstate,
 
     .bdrv_change_backing_file   = qcow2_change_backing_file,
 
@@ -49,7 +49,17 @@
 #define MIN_CLUSTER_BITS 9
 #define MAX_CLUSTER_BITS 21
 
-#define L2_CACHE_SIZE 16
+/* Bounds of the L2 table cache, in tables. The cache is sized from the
+ * total metadata cache size set with qcow2_set_cache_size(). */
+#define MIN_L2_CACHE_SIZE 16
+#define MAX_L2_CACHE_SIZE 4096
+
+/* Bounds of the refcount block cache, in blocks. It gets a quarter of the
+ * metadata cache size. */
+#define MIN_REFCOUNT_CACHE_SIZE 4
+#define MAX_REFCOUNT_CACHE_SIZE 1024
+
+#define DEFAULT_CACHE_SIZE (2 * 1024 * 1024)
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -78,6 +88,15 @@ typedef struct QCowSnapshot {
     uint64_t vm_clock_nsec;
 } QCowSnapshot;
 
+/* A deleted snapshot whose references are still being dropped */
+typedef struct QCowSnapshotFree {
+    uint64_t *l1_table;         /* in host byte order */
+    uint64_t l1_table_offset;
+    int l1_size;
+    int next_index;             /* next L1 entry to drop */
+    QTAILQ_ENTRY(QCowSnapshotFree) next;
+} QCowSnapshotFree;
+
 typedef struct BDRVQcowState {
     BlockDriverState *hd;
     int cluster_bits;
@@ -93,8 +112,12 @@ typedef struct BDRVQcowState {
     uint64_t l1_table_offset;
     uint64_t *l1_table;
     uint64_t *l2_cache;
-    uint64_t l2_cache_offsets[L2_CACHE_SIZE];
-    uint32_t l2_cache_counts[L2_CACHE_SIZE];
+    uint64_t *l2_cache_offsets;
+    uint64_t *l2_cache_lru; /* last use of each entry, see l2_cache_clock */
+    uint64_t l2_cache_clock;
+    int l2_cache_size;
+    uint64_t l2_cache_hits;
+    uint64_t l2_cache_misses;
     uint8_t *cluster_cache;
     uint8_t *cluster_data;
     uint64_t cluster_cache_offset;
@@ -103,8 +126,17 @@ typedef struct BDRVQcowState {
     uint64_t *refcount_table;
     uint64_t refcount_table_offset;
     uint32_t refcount_table_size;
-    uint64_t refcount_block_cache_offset;
-    uint16_t *refcount_block_cache;
+    uint64_t refcount_block_cache_offset; /* block of the current entry */
+    uint16_t *refcount_block_cache;       /* data of the current entry */
+    uint16_t *refcount_cache;
+    uint64_t *refcount_cache_offsets;
+    uint64_t *refcount_cache_lru;
+    uint8_t *refcount_cache_dirty;
+    uint64_t refcount_cache_clock;
+    int refcount_cache_size;
+    int refcount_cache_current;
+    uint64_t refcount_cache_hits;
+    uint64_t refcount_cache_misses;
     int64_t free_cluster_index;
     int64_t free_byte_offset;
 
@@ -116,6 +148,11 @@ typedef struct BDRVQcowState {
     int snapshots_size;
     int nb_snapshots;
     QCowSnapshot *snapshots;
+
+    /* Background work of snapshot deletion, see qcow2-snapshot.c */
+    QTAILQ_HEAD(, QCowSnapshotFree) snapshot_frees;
+    int copied_flags_index;     /* next L1 entry to fix, or -1 */
+    QEMUTimer *snapshot_free_timer;
 } BDRVQcowState;
 
 /* XXX: use std qcow open function ? */
@@ -170,7 +207,7 @@ int qcow2_backing_read1(BlockDriverState *bs,
                   int64_t sector_num, uint8_t *buf, int nb_sectors);
 
 /* qcow2-refcount.c functions */
-int qcow2_refcount_init(BlockDriverState *bs);
+int qcow2_refcount_init(BlockDriverState *bs, int cache_size);
 void qcow2_refcount_close(BlockDriverState *bs);
 
 int64_t qcow2_alloc_clusters(BlockDriverState *bs, int64_t size);
@@ -184,6 +221,9 @@ void qcow2_create_refcount_update(QCowCreateState *s, int64_t offset,
     int64_t size);
 int qcow2_update_snapshot_refcount(BlockDriverState *bs,
     int64_t l1_table_offset, int l1_size, int addend);
+int qcow2_drop_snapshot_refcounts(BlockDriverState *bs, uint64_t *l1_table,
+    int start, int end);
+int qcow2_update_copied_flags(BlockDriverState *bs, int start, int end);
 
 int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res);
 
@@ -198,6 +238,8 @@ void qcow2_encrypt_sectors(BDRVQcowState *s, int64_t sector_num,
 
 int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
     int *num, uint64_t *cluster_offset);
+int qcow2_get_cluster_entry(BlockDriverState *bs, uint64_t offset,
+    uint64_t *l2_entry);
 int qcow2_alloc_cluster_offset(BlockDriverState *bs, uint64_t offset,
     int n_start, int n_end, int *num, QCowL2Meta *m);
 uint64_t qcow2_alloc_compressed_cluster_offset(BlockDriverState *bs,
@@ -205,6 +247,8 @@ uint64_t qcow2_alloc_compressed_cluster_offset(BlockDriverState *bs,
                                          int compressed_size);
 
 int qcow2_alloc_cluster_link_l2(BlockDriverState *bs, QCowL2Meta *m);
+int qcow2_discard_clusters(BlockDriverState *bs, uint64_t offset,
+    int nb_sectors);
 
 /* qcow2-snapshot.c functions */
 int qcow2_snapshot_create(BlockDriverState *bs, QEMUSnapshotInfo *sn_info);
@@ -214,5 +258,7 @@ int qcow2_snapshot_list(BlockDriverState *bs, QEMUSnapshotInfo **psn_tab);
 
 void qcow2_free_snapshots(BlockDriverState *bs);
 int qcow2_read_snapshots(BlockDriverState *bs);
+void qcow2_snapshot_init(BlockDriverState *bs);
+void qcow2_snapshot_drain(BlockDriverState *bs);
 
 #endif
@@ -118,6 +118,8 @@ typedef struct BDRVRawState {
     void *aio_ctx;
 #endif
     uint8_t* aligned_buf;
+    /* set once the file system has refused to punch a hole */
+    int discard_unsupported;
 } BDRVRawState;
 
 static int fd_open(BlockDriverState *bs);
@@ -576,6 +578,41 @@ static int raw_truncate(BlockDriverState *bs, int64_t offset)
     return 0;
 }
 
+#ifdef __linux__
+/* Older C libraries don't define the hole punching mode of fallocate(),
+ * which is supported since Linux 2.6.38. */
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE   0x01
+#endif
+#ifndef FALLOC_FL_PUNCH_HOLE
+#define FALLOC_FL_PUNCH_HOLE  0x02
+#endif
+#endif
+
+/* Deallocates the discarded sectors of the image file, so that it stays
+ * sparse. They read back as zeroes. */
+static int raw_discard(BlockDriverState *bs, int64_t sector_num,
+                       int nb_sectors)
+{
+#ifdef __linux__
+    BDRVRawState *s = bs->opaque;
+
+    if (s->type != FTYPE_FILE || s->discard_unsupported)
+        return 0;
+    if (fallocate(s->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  sector_num * BDRV_SECTOR_SIZE,
+                  (int64_t)nb_sectors * BDRV_SECTOR_SIZE) < 0) {
+        if (errno == EOPNOTSUPP || errno == ENOSYS) {
+            /* The file system can't do it, don't try again. */
+            s->discard_unsupported = 1;
+            return 0;
+        }
+        return -errno;
+    }
+#endif
+    return 0;
+}
+
 #ifdef __OpenBSD__
 static int64_t raw_getlength(BlockDriverState *bs)
 {
@@ -753,6 +790,7 @@ static BlockDriver bdrv_file = {
     .bdrv_aio_flush = raw_aio_flush,
 
     .bdrv_truncate = raw_truncate,
+    .bdrv_discard = raw_discard,
     .bdrv_getlength = raw_getlength,
 
     .create_options = raw_create_options,
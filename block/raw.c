@@ -190,6 +190,12 @@ static int raw_truncate(BlockDriverState *bs, int64_t offset)
     return bdrv_truncate(bs->file, offset);
 }
 
+static int raw_discard(BlockDriverState *bs, int64_t sector_num,
+                       int nb_sectors)
+{
+    return bdrv_discard(bs->file, sector_num, nb_sectors);
+}
+
 static int raw_probe(const uint8_t *buf, int buf_size, const char *filename)
 {
    return 1; /* everything can be opened as raw image */
@@ -256,6 +262,7 @@ static BlockDriver bdrv_raw = {
     .bdrv_probe         = raw_probe,
     .bdrv_getlength     = raw_getlength,
     .bdrv_truncate      = raw_truncate,
+    .bdrv_discard       = raw_discard,
 
     .bdrv_aio_readv     = raw_aio_readv,
     .bdrv_aio_writev    = raw_aio_writev,
@@ -12,6 +12,8 @@
 
 #include "exec/code-profile.h"
 
+#include "android/utils/metrics.h"
+
 // IMPORTANT: Initializers are required to ensure that these
 // variables are properly linked into the final executables on
 // Darwin. Otherwise, the build will succeed, but trying to run
@@ -20,3 +22,471 @@
 CodeProfileRecordFunc code_profile_record_func = NULL;
 
 const char *code_profile_dirname = NULL;
+
+/***********************************************************************/
+/***********************************************************************/
+/*****                                                             *****/
+/*****         T R A N S L A T I O N   B L O C K   P R O F I L E   *****/
+/*****                                                             *****/
+/***********************************************************************/
+/***********************************************************************/
+
+#include "disas/disas.h"
+#include "exec/exec-all.h"
+#include "exec/cputlb.h"
+#include "qemu/timer.h"
+#include "tcg.h"
+#include "translate-all.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int tb_profile_enabled = 0;
+
+static int tb_profile_symbolize_default(target_ulong pc, char* buf,
+                                        size_t size) {
+    const char* name = lookup_symbol(pc);
+    if (!name || !name[0]) {
+        return -1;
+    }
+    snprintf(buf, size, "%s", name);
+    return 0;
+}
+
+TbProfileSymbolizeFunc tb_profile_symbolize_func =
+        tb_profile_symbolize_default;
+
+// Counters of the TBs starting at a given guest PC, merged from the
+// TranslationBlocks that were flushed.
+typedef struct {
+    target_ulong pc;
+    uint32_t size;
+    uint64_t exec_count;
+    uint64_t exec_ticks;
+} TbProfileEntry;
+
+static struct {
+    GHashTable* entries;  // key and value are the same TbProfileEntry
+    uint64_t translate_count;
+    int64_t translate_ticks;
+    uint64_t lookup_count;
+    uint64_t lookup_chain_total;  // TBs compared by all the lookups
+    unsigned int lookup_chain_max;
+    uint64_t lookup_miss_count;
+    int flush_count;
+    int evict_count;
+    int has_data;  // set once enabled, until the next reset
+} tb_profile;
+
+static guint tb_profile_entry_hash(gconstpointer key) {
+    uint64_t pc = ((const TbProfileEntry*)key)->pc;
+    return (guint)(pc ^ (pc >> 32));
+}
+
+static gboolean tb_profile_entry_equal(gconstpointer a, gconstpointer b) {
+    return ((const TbProfileEntry*)a)->pc == ((const TbProfileEntry*)b)->pc;
+}
+
+static void tb_profile_entry_free(gpointer key, gpointer value,
+                                  gpointer opaque) {
+    g_free(value);
+}
+
+// Move the counters of |count| TBs to the profile.
+static void tb_profile_fold_range(TranslationBlock* tbs, int count) {
+    int n;
+
+    if (!tb_profile.entries) {
+        tb_profile.entries = g_hash_table_new(tb_profile_entry_hash,
+                                              tb_profile_entry_equal);
+    }
+    for (n = 0; n < count; n++) {
+        TranslationBlock* tb = &tbs[n];
+        TbProfileEntry key;
+        TbProfileEntry* entry;
+
+        if (!tb->exec_count) {
+            continue;
+        }
+        key.pc = tb->pc;
+        entry = g_hash_table_lookup(tb_profile.entries, &key);
+        if (!entry) {
+            entry = g_new0(TbProfileEntry, 1);
+            entry->pc = tb->pc;
+            g_hash_table_insert(tb_profile.entries, entry, entry);
+        }
+        if (tb->size > entry->size) {
+            entry->size = tb->size;
+        }
+        entry->exec_count += tb->exec_count;
+        entry->exec_ticks += tb->exec_ticks;
+        tb->exec_count = 0;
+        tb->exec_ticks = 0;
+    }
+}
+
+// Move the counters of all live TBs to the profile.
+static void tb_profile_fold_tbs(void) {
+    TBContext* ctx = &tcg_ctx.tb_ctx;
+    int n;
+
+    for (n = 0; n < ctx->nb_regions; n++) {
+        const TBRegion* r = &ctx->regions[n];
+        tb_profile_fold_range(&ctx->tbs[r->first_tb], r->nb_tbs);
+    }
+}
+
+void tb_profile_start(void) {
+    if (tb_profile_enabled) {
+        return;
+    }
+    // Flushing the TB cache unchains all TBs, new ones are not chained
+    // while profiling.
+    if (tcg_enabled()) {
+        tb_flush(first_cpu->env_ptr);
+    }
+    tb_profile.has_data = 1;
+    tb_profile_enabled = 1;
+}
+
+void tb_profile_stop(void) {
+    tb_profile_enabled = 0;
+}
+
+void tb_profile_reset(void) {
+    TBContext* ctx = &tcg_ctx.tb_ctx;
+    int n, i;
+
+    if (tb_profile.entries) {
+        g_hash_table_foreach(tb_profile.entries, tb_profile_entry_free, NULL);
+        g_hash_table_destroy(tb_profile.entries);
+        tb_profile.entries = NULL;
+    }
+    for (n = 0; n < ctx->nb_regions; n++) {
+        const TBRegion* r = &ctx->regions[n];
+        for (i = 0; i < r->nb_tbs; i++) {
+            ctx->tbs[r->first_tb + i].exec_count = 0;
+            ctx->tbs[r->first_tb + i].exec_ticks = 0;
+        }
+    }
+    tb_profile.translate_count = 0;
+    tb_profile.translate_ticks = 0;
+    tb_profile.lookup_count = 0;
+    tb_profile.lookup_chain_total = 0;
+    tb_profile.lookup_chain_max = 0;
+    tb_profile.lookup_miss_count = 0;
+    tb_profile.flush_count = 0;
+    tb_profile.evict_count = 0;
+    tb_profile.has_data = tb_profile_enabled;
+}
+
+void tb_profile_save_tbs(void) {
+    if (!tb_profile.has_data) {
+        return;
+    }
+    if (tb_profile_enabled) {
+        tb_profile.flush_count++;
+    }
+    tb_profile_fold_tbs();
+}
+
+void tb_profile_save_region(TranslationBlock* tbs, int count) {
+    if (!tb_profile.has_data) {
+        return;
+    }
+    if (tb_profile_enabled) {
+        tb_profile.evict_count++;
+    }
+    tb_profile_fold_range(tbs, count);
+}
+
+void tb_profile_record_translation(int64_t ticks) {
+    tb_profile.translate_count++;
+    tb_profile.translate_ticks += ticks;
+}
+
+void tb_profile_record_lookup(unsigned int chain_length, int found) {
+    tb_profile.lookup_count++;
+    tb_profile.lookup_chain_total += chain_length;
+    if (chain_length > tb_profile.lookup_chain_max) {
+        tb_profile.lookup_chain_max = chain_length;
+    }
+    if (!found) {
+        tb_profile.lookup_miss_count++;
+    }
+}
+
+// Print the current occupancy of the physical PC hash table.
+static void tb_profile_dump_hash(void (*callback)(void* opaque,
+                                                  const char* line),
+                                 void* opaque) {
+    const TBContext* ctx = &tcg_ctx.tb_ctx;
+    unsigned int n, used = 0, longest = 0;
+    char line[256];
+
+    for (n = 0; n < ctx->tb_phys_hash_size; n++) {
+        const TranslationBlock* tb;
+        unsigned int length = 0;
+
+        for (tb = ctx->tb_phys_hash[n]; tb; tb = tb->phys_hash_next) {
+            length++;
+        }
+        if (length) {
+            used++;
+        }
+        if (length > longest) {
+            longest = length;
+        }
+    }
+    snprintf(line, sizeof(line),
+             "hash table: %u buckets (%d resizes), %u used, "
+             "%.2f TBs per used bucket, longest chain %u\r\n",
+             ctx->tb_phys_hash_size, ctx->tb_phys_hash_resize_count, used,
+             used ? (double)ctx->nb_tbs / used : 0., longest);
+    callback(opaque, line);
+}
+
+typedef struct {
+    TbProfileEntry** entries;
+    int count;
+    uint64_t exec_count;
+    uint64_t exec_ticks;
+} TbProfileList;
+
+static void tb_profile_list_add(gpointer key, gpointer value,
+                                gpointer opaque) {
+    TbProfileList* list = opaque;
+    TbProfileEntry* entry = value;
+
+    list->entries[list->count++] = entry;
+    list->exec_count += entry->exec_count;
+    list->exec_ticks += entry->exec_ticks;
+}
+
+// Sort by decreasing host time.
+static int tb_profile_entry_compare(const void* a, const void* b) {
+    const TbProfileEntry* ea = *(const TbProfileEntry* const*)a;
+    const TbProfileEntry* eb = *(const TbProfileEntry* const*)b;
+
+    if (ea->exec_ticks != eb->exec_ticks) {
+        return ea->exec_ticks > eb->exec_ticks ? -1 : 1;
+    }
+    return ea->exec_count > eb->exec_count ? -1 :
+           ea->exec_count < eb->exec_count;
+}
+
+static double tb_profile_percent(uint64_t part, uint64_t total) {
+    return total ? 100. * part / total : 0.;
+}
+
+void tb_profile_dump(int max_entries,
+                     void (*callback)(void* opaque, const char* line),
+                     void* opaque) {
+    TbProfileList list;
+    char line[256];
+    char symbol[128];
+    int n;
+
+    tb_profile_fold_tbs();
+
+    list.entries = g_new(TbProfileEntry*,
+                         g_hash_table_size(tb_profile.entries) + 1);
+    list.count = 0;
+    list.exec_count = 0;
+    list.exec_ticks = 0;
+    g_hash_table_foreach(tb_profile.entries, tb_profile_list_add, &list);
+    qsort(list.entries, list.count, sizeof(list.entries[0]),
+          tb_profile_entry_compare);
+
+    snprintf(line, sizeof(line),
+             "TB profiling %s: %" PRIu64 " executions of %d guest PCs, "
+             "%" PRIu64 " host ticks\r\n",
+             tb_profile_enabled ? "enabled" : "disabled",
+             list.exec_count, list.count, list.exec_ticks);
+    callback(opaque, line);
+
+    if (list.count > 0) {
+        callback(opaque, "          guest pc  size   executions  "
+                         "host ticks  time  symbol\r\n");
+    }
+    for (n = 0; n < list.count && n < max_entries; n++) {
+        const TbProfileEntry* entry = list.entries[n];
+
+        if (!tb_profile_symbolize_func ||
+            tb_profile_symbolize_func(entry->pc, symbol, sizeof(symbol)) < 0) {
+            symbol[0] = '\0';
+        }
+        snprintf(line, sizeof(line),
+                 "%4d  %12" PRIx64 "  %4u  %11" PRIu64 "  %10" PRIu64
+                 "  %4.1f%%  %s\r\n",
+                 n + 1, (uint64_t)entry->pc, entry->size,
+                 entry->exec_count, entry->exec_ticks,
+                 tb_profile_percent(entry->exec_ticks, list.exec_ticks),
+                 symbol);
+        callback(opaque, line);
+    }
+
+    snprintf(line, sizeof(line),
+             "translations: %" PRIu64 ", %" PRId64 " host ticks "
+             "(%.1f%% of the profiled time)\r\n",
+             tb_profile.translate_count, tb_profile.translate_ticks,
+             tb_profile_percent(tb_profile.translate_ticks,
+                                list.exec_ticks + tb_profile.translate_ticks));
+    callback(opaque, line);
+    snprintf(line, sizeof(line),
+             "tb_flush count: %d, region evictions: %d\r\n",
+             tb_profile.flush_count, tb_profile.evict_count);
+    callback(opaque, line);
+
+    // TBs aren't chained while profiling, so each execution goes through
+    // the jump cache, and each jump cache miss does a hash lookup.
+    snprintf(line, sizeof(line),
+             "hash lookups: %" PRIu64 " (%.1f%% of the executions), "
+             "%.2f TBs compared on average, %u at most, "
+             "%" PRIu64 " not found\r\n",
+             tb_profile.lookup_count,
+             tb_profile_percent(tb_profile.lookup_count, list.exec_count),
+             tb_profile.lookup_count ?
+                     (double)tb_profile.lookup_chain_total /
+                             tb_profile.lookup_count : 0.,
+             tb_profile.lookup_chain_max, tb_profile.lookup_miss_count);
+    callback(opaque, line);
+    if (tcg_enabled()) {
+        tb_profile_dump_hash(callback, opaque);
+    }
+
+    // These are counted since boot, profiling doesn't change them.
+    snprintf(line, sizeof(line),
+             "softmmu TLB misses: %" PRIu64 " victim TLB hits (%.1f%%), "
+             "%" PRIu64 " tlb_fill calls, %d flushes\r\n",
+             tlb_victim_hit_count,
+             tb_profile_percent(tlb_victim_hit_count,
+                                tlb_victim_hit_count + tlb_victim_miss_count),
+             tlb_victim_miss_count, tlb_flush_count);
+    callback(opaque, line);
+
+    g_free(list.entries);
+}
+
+void tb_profile_dump_counters(void (*callback)(void* opaque,
+                                               const char* line),
+                              void* opaque) {
+    const TBContext* ctx = &tcg_ctx.tb_ctx;
+    char line[128];
+
+    snprintf(line, sizeof(line), "host_time_ns: %" PRId64 "\r\n",
+             get_clock());
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "guest_insns: %" PRId64 "\r\n",
+             use_icount ? cpu_get_icount_raw() : -1);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "translations: %" PRIu64 "\r\n",
+             ctx->tb_gen_count);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "translation_time_ns: %" PRId64 "\r\n",
+             ctx->tb_gen_time_ns);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "tb_flushes: %d\r\n", ctx->tb_flush_count);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "tlb_misses: %" PRIu64 "\r\n",
+             tlb_victim_hit_count + tlb_victim_miss_count);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "tlb_fills: %" PRIu64 "\r\n",
+             tlb_victim_miss_count);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "tlb_flushes: %d\r\n", tlb_flush_count);
+    callback(opaque, line);
+#if defined(TARGET_ARM) && !defined(CONFIG_USER_ONLY)
+    snprintf(line, sizeof(line), "arm_bulk_loops: %" PRIu64 "\r\n",
+             arm_bulk_loop_stats.calls);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "arm_bulk_loop_bytes: %" PRIu64 "\r\n",
+             arm_bulk_loop_stats.bytes);
+    callback(opaque, line);
+#endif
+#if defined(TARGET_MIPS) && !defined(CONFIG_USER_ONLY)
+    snprintf(line, sizeof(line), "mips_guest_tlb_hits: %" PRIu64 "\r\n",
+             mips_tlb_stats.guest_tlb_hits);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "mips_tlb_refills: %" PRIu64 "\r\n",
+             mips_tlb_stats.refills);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "mips_tlb_refill_exceptions: %" PRIu64 "\r\n",
+             mips_tlb_stats.refill_exceptions);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "mips_tlb_other_exceptions: %" PRIu64 "\r\n",
+             mips_tlb_stats.other_exceptions);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "mips_guest_tlbwr: %" PRIu64 "\r\n",
+             mips_tlb_stats.guest_tlbwr);
+    callback(opaque, line);
+    snprintf(line, sizeof(line), "mips_guest_tlbwi: %" PRIu64 "\r\n",
+             mips_tlb_stats.guest_tlbwi);
+    callback(opaque, line);
+#endif
+}
+
+// The counters of tb_profile_dump_counters() exposed as metrics.
+enum {
+    TB_METRIC_TRANSLATIONS = 0,
+    TB_METRIC_TRANSLATION_TIME,
+    TB_METRIC_TB_FLUSHES,
+    TB_METRIC_TLB_MISSES,
+    TB_METRIC_TLB_FILLS,
+    TB_METRIC_TLB_FLUSHES,
+    TB_METRIC_COUNT
+};
+
+static int64_t tb_profile_metric_value(void* opaque) {
+    const TBContext* ctx = &tcg_ctx.tb_ctx;
+
+    switch ((intptr_t)opaque) {
+    case TB_METRIC_TRANSLATIONS:
+        return (int64_t)ctx->tb_gen_count;
+    case TB_METRIC_TRANSLATION_TIME:
+        return ctx->tb_gen_time_ns;
+    case TB_METRIC_TB_FLUSHES:
+        return ctx->tb_flush_count;
+    case TB_METRIC_TLB_MISSES:
+        return (int64_t)(tlb_victim_hit_count + tlb_victim_miss_count);
+    case TB_METRIC_TLB_FILLS:
+        return (int64_t)tlb_victim_miss_count;
+    case TB_METRIC_TLB_FLUSHES:
+        return tlb_flush_count;
+    }
+    return 0;
+}
+
+void tb_profile_register_metrics(void) {
+    static const struct {
+        const char* name;
+        const char* help;
+    } metrics[TB_METRIC_COUNT] = {
+        [TB_METRIC_TRANSLATIONS] = {
+            "emulator_tb_translations_total",
+            "Translation blocks generated" },
+        [TB_METRIC_TRANSLATION_TIME] = {
+            "emulator_tb_translation_time_ns_total",
+            "Host time spent translating guest code, in nanoseconds" },
+        [TB_METRIC_TB_FLUSHES] = {
+            "emulator_tb_flushes_total",
+            "Flushes of the whole translation cache" },
+        [TB_METRIC_TLB_MISSES] = {
+            "emulator_tlb_misses_total",
+            "Softmmu TLB misses, including victim TLB hits" },
+        [TB_METRIC_TLB_FILLS] = {
+            "emulator_tlb_fills_total",
+            "Softmmu TLB misses that called tlb_fill()" },
+        [TB_METRIC_TLB_FLUSHES] = {
+            "emulator_tlb_flushes_total",
+            "Softmmu TLB flushes" },
+    };
+    intptr_t n;
+
+    for (n = 0; n < TB_METRIC_COUNT; ++n) {
+        metrics_add_callback(METRIC_COUNTER, metrics[n].name, NULL,
+                             metrics[n].help, tb_profile_metric_value,
+                             (void*)n);
+    }
+}
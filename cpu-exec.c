@@ -23,6 +23,8 @@
 #include "sysemu/kvm.h"
 #include "exec/hax.h"
 #include "qemu/atomic.h"
+#include "qemu/timer.h"
+#include "exec/code-profile.h"
 
 #if !defined(CONFIG_SOFTMMU)
 #undef EAX
@@ -121,7 +123,7 @@ static TranslationBlock *tb_find_slow(CPUArchState *env,
                                       uint64_t flags)
 {
     TranslationBlock *tb, **ptb1;
-    unsigned int h;
+    unsigned int h, chain_length = 0;
     target_ulong phys_pc, phys_page1, phys_page2, virt_page2;
 
     tcg_ctx.tb_ctx.tb_invalidated_flag = 0;
@@ -130,12 +132,13 @@ static TranslationBlock *tb_find_slow(CPUArchState *env,
     phys_pc = get_page_addr_code(env, pc);
     phys_page1 = phys_pc & TARGET_PAGE_MASK;
     phys_page2 = -1;
-    h = tb_phys_hash_func(phys_pc);
+    h = tb_phys_hash_func(&tcg_ctx.tb_ctx, phys_pc);
     ptb1 = &tcg_ctx.tb_ctx.tb_phys_hash[h];
     for(;;) {
         tb = *ptb1;
         if (!tb)
             goto not_found;
+        chain_length++;
         if (tb->pc == pc &&
             tb->page_addr[0] == phys_page1 &&
             tb->cs_base == cs_base &&
@@ -154,21 +157,56 @@ static TranslationBlock *tb_find_slow(CPUArchState *env,
         ptb1 = &tb->phys_hash_next;
     }
  not_found:
-   /* if no translated code available, then translate it now */
+    if (unlikely(tb_profile_enabled)) {
+        tb_profile_record_lookup(chain_length, 0);
+    }
+   /* if no translated code available, then translate it now. The new TB
+      is added at the head of its hash chain, in a table that may have
+      been resized, so ptb1 must not be used anymore. */
     tb = tb_gen_code(env, pc, cs_base, flags, 0);
+    goto add_jmp_cache;
 
  found:
+    if (unlikely(tb_profile_enabled)) {
+        tb_profile_record_lookup(chain_length, 1);
+    }
     /* Move the last found TB to the head of the list */
     if (likely(*ptb1)) {
         *ptb1 = tb->phys_hash_next;
         tb->phys_hash_next = tcg_ctx.tb_ctx.tb_phys_hash[h];
         tcg_ctx.tb_ctx.tb_phys_hash[h] = tb;
     }
+ add_jmp_cache:
     /* we add the TB in the virtual pc hash table */
     env->tb_jmp_cache[tb_jmp_cache_hash_func(pc)] = tb;
     return tb;
 }
 
+/* Return the host code of the TB matching the current CPU state if it is in
+   the jump cache, or tcg_ctx.code_gen_epilogue to go back to cpu_exec()
+   otherwise.  Translators use it with goto_ptr after indirect branches, so
+   that e.g. function returns jump straight to the next TB instead of going
+   through the main loop.  Nothing is translated from here: missing TBs are
+   left to tb_find_slow().  */
+void *tb_lookup_ptr(CPUArchState *env)
+{
+    TranslationBlock *tb;
+    target_ulong cs_base, pc;
+    int flags;
+
+    /* The profiler needs each TB to return to the main loop.  */
+    if (unlikely(tb_profile_enabled)) {
+        return tcg_ctx.code_gen_epilogue;
+    }
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    tb = env->tb_jmp_cache[tb_jmp_cache_hash_func(pc)];
+    if (unlikely(!tb || tb->pc != pc || tb->cs_base != cs_base ||
+                 tb->flags != flags)) {
+        return tcg_ctx.code_gen_epilogue;
+    }
+    return tb->tc_ptr;
+}
+
 static inline TranslationBlock *tb_find_fast(CPUArchState *env)
 {
     TranslationBlock *tb;
@@ -576,8 +614,9 @@ int cpu_exec(CPUOldState *env)
 #endif
                 /* see if we can patch the calling TB. When the TB
                    spans two pages, we cannot safely do a direct
-                   jump. */
-                if (next_tb != 0 && tb->page_addr[1] == -1) {
+                   jump. The profiler needs each TB to return here. */
+                if (next_tb != 0 && tb->page_addr[1] == -1 &&
+                    !tb_profile_enabled) {
                     tb_add_jump((TranslationBlock *)(next_tb & ~3), next_tb & 3, tb);
                 }
                 spin_unlock(&tcg_ctx.tb_ctx.tb_lock);
@@ -591,7 +630,15 @@ int cpu_exec(CPUOldState *env)
                 if (likely(!cpu->exit_request)) {
                     tc_ptr = tb->tc_ptr;
                 /* execute the generated code */
-                    next_tb = tcg_qemu_tb_exec(env, tc_ptr);
+                    if (unlikely(tb_profile_enabled)) {
+                        TranslationBlock *profiled_tb = tb;
+                        int64_t ticks = cpu_get_real_ticks();
+                        profiled_tb->exec_count++;
+                        next_tb = tcg_qemu_tb_exec(env, tc_ptr);
+                        profiled_tb->exec_ticks += cpu_get_real_ticks() - ticks;
+                    } else {
+                        next_tb = tcg_qemu_tb_exec(env, tc_ptr);
+                    }
                     switch (next_tb & TB_EXIT_MASK) {
                     case TB_EXIT_REQUESTED:
                         /* Something asked us to stop executing
@@ -33,12 +33,57 @@
 #include "sysemu/kvm.h"
 #include "exec/exec-all.h"
 #include "exec/hax.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
 
+#include "android/utils/metrics.h"
 #include "sysemu/cpus.h"
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifdef CONFIG_KVM
+#include <pthread.h>
+#include <signal.h>
+
+/* Used to kick a KVM vCPU thread out of KVM_RUN. SIGUSR1 is used by
+   the log rotation, and SIGUSR2 by the AIO emulation. */
+#define SIG_IPI  (SIGRTMIN + 4)
+#endif
+
 static CPUState *cur_cpu;
 static CPUState *next_cpu;
 
+/* With -iothread, all the TCG vCPUs run in tcg_cpu_thread, while the main
+ * thread runs the main loop. The global mutex serializes them: the vCPU
+ * thread holds it while executing guest code, and the main thread holds it
+ * except while it waits for events in main_loop_wait(). To get it back, the
+ * main thread kicks the vCPUs out of the translated code.
+ *
+ * With KVM or HAX, each vCPU runs in its own thread instead. That's the
+ * default for SMP guests, and the -iothread behaviour for UP ones. These
+ * threads only drop the global mutex while the guest runs in the kernel
+ * module, so device emulation, and emulation mode under HAX, stay
+ * serialized. A vCPU is kicked out of the kernel with SIG_IPI under KVM,
+ * and with a HAX user event under HAX.
+ */
+int use_iothread;
+
+static bool iothread_enabled;
+static bool vcpu_threads_enabled;
+static QemuMutex qemu_global_mutex;
+static QemuCond qemu_halt_cond;
+static QemuCond qemu_io_proceeded_cond;
+static QemuCond qemu_pause_cond;
+static QemuThread tcg_cpu_thread;
+static volatile bool iothread_requesting_mutex;
+
+bool qemu_iothread_enabled(void)
+{
+    return iothread_enabled;
+}
+
 /***********************************************************/
 void hw_error(const char *fmt, ...)
 {
@@ -71,6 +116,138 @@ static void do_vm_stop(int reason)
     }
 }
 
+/* vCPU QoS throttling. With a duty-cycle limit below 100%, each vCPU
+ * pauses after running for CPU_THROTTLE_SLICE_NS, long enough for its run
+ * time to be the limit's share of the elapsed host time. The I/O limits
+ * also pause the vCPU that does synchronous I/O too fast, through
+ * qemu_cpu_throttle_pause(). A paused vCPU is handled like a halted one,
+ * so the main loop and the other vCPUs keep running. */
+#define CPU_THROTTLE_SLICE_NS  (10 * 1000000LL)
+
+static int cpu_throttle_percent = 100;
+static QEMUTimer *cpu_throttle_timer;
+static Metric *cpu_throttle_metric;
+
+static bool qemu_cpu_throttled(CPUState *cpu)
+{
+    if (!cpu->throttle_until_ns) {
+        return false;
+    }
+    if (get_clock() < cpu->throttle_until_ns) {
+        return true;
+    }
+    cpu->throttle_until_ns = 0;
+    return false;
+}
+
+void qemu_cpu_throttle_pause(CPUState *cpu, int64_t pause_ns)
+{
+    int64_t until = get_clock() + pause_ns;
+
+    if (pause_ns <= 0) {
+        return;
+    }
+    if (!cpu_throttle_metric) {
+        cpu_throttle_metric = metrics_counter(
+                "emulator_vcpu_throttled_ns_total", NULL,
+                "Time the vCPUs were paused by the QoS limits.");
+    }
+    metric_add(cpu_throttle_metric, pause_ns);
+    if (until > cpu->throttle_until_ns) {
+        cpu->throttle_until_ns = until;
+    }
+    cpu_exit(cpu);
+}
+
+/* Time until the first paused vCPU can run again, in ns, or -1. */
+int64_t qemu_cpu_throttle_deadline_ns(void)
+{
+    int64_t now = get_clock();
+    int64_t deadline = -1;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu->throttle_until_ns > now &&
+            (deadline < 0 || cpu->throttle_until_ns - now < deadline)) {
+            deadline = cpu->throttle_until_ns - now;
+        }
+    }
+    return deadline;
+}
+
+/* Sleep without the global mutex, while the vCPUs of the thread are
+ * paused. */
+static void qemu_cpu_throttle_sleep(int64_t ns)
+{
+    qemu_mutex_unlock(&qemu_global_mutex);
+#ifdef _WIN32
+    Sleep((DWORD)((ns + 999999) / 1000000));
+#else
+    usleep((useconds_t)((ns + 999) / 1000));
+#endif
+    qemu_mutex_lock(&qemu_global_mutex);
+}
+
+static void qemu_cpu_throttle_account(CPUState *cpu, int64_t start_ns)
+{
+    int percent = cpu_throttle_percent;
+
+    cpu->throttle_run_ns += get_clock() - start_ns;
+    if (cpu->throttle_run_ns >= CPU_THROTTLE_SLICE_NS) {
+        qemu_cpu_throttle_pause(cpu, cpu->throttle_run_ns *
+                                     (100 - percent) / percent);
+        cpu->throttle_run_ns = 0;
+    }
+}
+
+/* Accelerated vCPUs only return from the kernel module on I/O, kick them
+ * out at each slice to account for their run time. */
+static void qemu_cpu_throttle_tick(void *opaque)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (!cpu->halted) {
+            qemu_cpu_kick(cpu);
+            cpu_exit(cpu);
+        }
+    }
+    timer_mod(cpu_throttle_timer,
+              qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + CPU_THROTTLE_SLICE_NS);
+}
+
+void qemu_cpu_set_throttle(int percent)
+{
+    CPUState *cpu;
+
+    if (percent < 1) {
+        percent = 1;
+    } else if (percent > 100) {
+        percent = 100;
+    }
+    cpu_throttle_percent = percent;
+    CPU_FOREACH(cpu) {
+        cpu->throttle_run_ns = 0;
+    }
+
+    if (!cpu_throttle_timer) {
+        cpu_throttle_timer = timer_new(QEMU_CLOCK_REALTIME, SCALE_NS,
+                                       qemu_cpu_throttle_tick, NULL);
+    }
+    if (percent < 100) {
+        timer_mod(cpu_throttle_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                  CPU_THROTTLE_SLICE_NS);
+    } else {
+        timer_del(cpu_throttle_timer);
+    }
+}
+
+int qemu_cpu_get_throttle(void)
+{
+    return cpu_throttle_percent;
+}
+
 static int cpu_can_run(CPUArchState *env)
 {
     CPUState *cpu = ENV_GET_CPU(env);
@@ -78,6 +255,8 @@ static int cpu_can_run(CPUArchState *env)
         return 0;
     if (cpu->stopped)
         return 0;
+    if (qemu_cpu_throttled(cpu))
+        return 0;
     return 1;
 }
 
@@ -85,20 +264,215 @@ int tcg_has_work(void)
 {
     CPUState *cpu;
 
+    /* Any vCPU that can run keeps the loop busy, not just the first. */
     CPU_FOREACH(cpu) {
         if (cpu->stop)
             return 1;
         if (cpu->stopped)
-            return 0;
+            continue;
+        if (qemu_cpu_throttled(cpu))
+            continue;
         if (!cpu->halted)
             return 1;
         if (cpu_has_work(cpu))
             return 1;
-        return 0;
     }
     return 0;
 }
 
+static int64_t idle_epoch_ns;
+static int64_t idle_total_ns;
+/* Start of the current idle period, or 0. */
+static int64_t idle_start_ns;
+
+void qemu_cpu_idle_init(void)
+{
+    idle_epoch_ns = get_clock();
+    idle_total_ns = 0;
+    idle_start_ns = 0;
+}
+
+void qemu_cpu_idle_enter(void)
+{
+    if (!idle_start_ns) {
+        idle_start_ns = get_clock();
+    }
+}
+
+void qemu_cpu_idle_leave(void)
+{
+    if (idle_start_ns) {
+        idle_total_ns += get_clock() - idle_start_ns;
+        idle_start_ns = 0;
+    }
+}
+
+void qemu_cpu_idle_get_stats(int64_t *idle_ns, int64_t *elapsed_ns)
+{
+    int64_t now = get_clock();
+
+    *idle_ns = idle_total_ns;
+    if (idle_start_ns) {
+        *idle_ns += now - idle_start_ns;
+    }
+    *elapsed_ns = now - idle_epoch_ns;
+}
+
+/* Make the vCPU thread leave the translated code as soon as possible. */
+static void qemu_tcg_kick_thread(void)
+{
+    CPUState *cpu;
+
+    exit_request = 1;
+    CPU_FOREACH(cpu) {
+        cpu_exit(cpu);
+    }
+}
+
+static void qemu_tcg_wait_io_event(void)
+{
+    while (!vm_running || !tcg_has_work()) {
+        int64_t throttle_ns = vm_running ? qemu_cpu_throttle_deadline_ns()
+                                         : -1;
+        if (throttle_ns > 0) {
+            qemu_cpu_throttle_sleep(throttle_ns);
+            continue;
+        }
+        if (vm_running) {
+            qemu_cpu_idle_enter();
+        }
+        qemu_cond_wait(&qemu_halt_cond, &qemu_global_mutex);
+        qemu_cpu_idle_leave();
+    }
+    /* Let the main thread take the mutex. */
+    while (iothread_requesting_mutex) {
+        qemu_cond_wait(&qemu_io_proceeded_cond, &qemu_global_mutex);
+    }
+}
+
+static void *qemu_tcg_cpu_thread_fn(void *arg)
+{
+    qemu_mutex_lock(&qemu_global_mutex);
+    for (;;) {
+        qemu_tcg_wait_io_event();
+        tcg_cpu_exec();
+        exit_request = 0;
+    }
+    return NULL;
+}
+
+static int qemu_cpu_exec(CPUOldState *env);
+
+static bool qemu_vcpu_thread_is_idle(CPUState *cpu)
+{
+    if (cpu->stop) {
+        return false;
+    }
+    if (cpu->stopped || !vm_running) {
+        return true;
+    }
+    return cpu->halted && !cpu_has_work(cpu);
+}
+
+static void qemu_vcpu_wait_io_event(CPUState *cpu)
+{
+    for (;;) {
+        if (!cpu->stop && vm_running && qemu_cpu_throttled(cpu)) {
+            qemu_cpu_throttle_sleep(cpu->throttle_until_ns - get_clock());
+            continue;
+        }
+        if (!qemu_vcpu_thread_is_idle(cpu)) {
+            break;
+        }
+        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+    }
+    if (cpu->stop) {
+        cpu->stop = 0;
+        cpu->stopped = 1;
+        qemu_cond_broadcast(&qemu_pause_cond);
+    }
+}
+
+#ifdef CONFIG_KVM
+static void dummy_signal(int sig)
+{
+}
+
+/* SIG_IPI stays blocked while the thread runs in user space, and is only
+   accepted inside KVM_RUN: a kick sent just before the vCPU enters the
+   guest makes KVM_RUN return immediately instead of being lost. */
+static void qemu_kvm_init_cpu_signals(CPUState *cpu)
+{
+    struct sigaction sigact;
+    sigset_t set;
+
+    memset(&sigact, 0, sizeof(sigact));
+    sigact.sa_handler = dummy_signal;
+    sigaction(SIG_IPI, &sigact, NULL);
+
+    pthread_sigmask(SIG_BLOCK, NULL, &set);
+    sigdelset(&set, SIG_IPI);
+    if (kvm_set_signal_mask(cpu, &set) < 0) {
+        fprintf(stderr, "kvm_set_signal_mask: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+#endif
+
+static void *qemu_vcpu_thread_fn(void *arg)
+{
+    CPUState *cpu = arg;
+    CPUOldState *env = cpu->env_ptr;
+
+    qemu_mutex_lock(&qemu_global_mutex);
+#ifdef CONFIG_KVM
+    if (kvm_enabled()) {
+        qemu_kvm_init_cpu_signals(cpu);
+    }
+#endif
+    for (;;) {
+        qemu_vcpu_wait_io_event(cpu);
+        if (cpu_can_run(env) && qemu_cpu_exec(env) == EXCP_DEBUG) {
+            gdb_set_stop_cpu(cpu);
+            debug_requested = 1;
+            qemu_notify_event();
+        }
+    }
+    return NULL;
+}
+
+/* The vCPU threads wait for vm_start(), and for the main thread to
+   enter main_loop_wait(). */
+static void qemu_iothread_init(void)
+{
+    qemu_mutex_init(&qemu_global_mutex);
+    qemu_cond_init(&qemu_halt_cond);
+    qemu_cond_init(&qemu_io_proceeded_cond);
+    qemu_cond_init(&qemu_pause_cond);
+    qemu_mutex_lock(&qemu_global_mutex);
+    iothread_enabled = true;
+}
+
+static void qemu_tcg_init_cpu_thread(void)
+{
+    qemu_iothread_init();
+    qemu_thread_create(&tcg_cpu_thread, qemu_tcg_cpu_thread_fn, NULL,
+                       QEMU_THREAD_JOINABLE);
+}
+
+static void qemu_vcpu_init_thread(CPUState *cpu)
+{
+    if (!iothread_enabled) {
+        qemu_iothread_init();
+        vcpu_threads_enabled = true;
+    }
+    cpu->halt_cond = g_malloc0(sizeof(QemuCond));
+    qemu_cond_init(cpu->halt_cond);
+    cpu->thread = g_malloc0(sizeof(QemuThread));
+    qemu_thread_create(cpu->thread, qemu_vcpu_thread_fn, cpu,
+                       QEMU_THREAD_JOINABLE);
+}
+
 void qemu_init_vcpu(CPUState *cpu)
 {
     if (kvm_enabled())
@@ -107,25 +481,113 @@ void qemu_init_vcpu(CPUState *cpu)
     if (hax_enabled())
         hax_init_vcpu(cpu);
 #endif
+    if (kvm_enabled() || hax_enabled()) {
+        if (use_iothread || smp_cpus > 1) {
+            qemu_vcpu_init_thread(cpu);
+        }
+    } else if (use_iothread && !iothread_enabled) {
+        qemu_tcg_init_cpu_thread();
+    }
     return;
 }
 
 bool qemu_cpu_is_self(CPUState *cpu)
 {
+    if (!iothread_enabled) {
+        return true;
+    }
+    if (vcpu_threads_enabled) {
+        return qemu_thread_is_self(cpu->thread);
+    }
+    return qemu_thread_is_self(&tcg_cpu_thread);
+}
+
+/* Make a vCPU thread leave the kernel module. The exit request makes
+   kvm_cpu_exec() and hax_vcpu_exec() return to cpu_exec() instead of
+   re-entering the guest. */
+static void qemu_vcpu_kick_thread(CPUState *cpu)
+{
+    cpu->exit_request = 1;
+#ifdef CONFIG_KVM
+    if (kvm_enabled()) {
+        pthread_kill(cpu->thread->thread, SIG_IPI);
+    }
+#endif
+#ifdef CONFIG_HAX
+    /* The HAX module returns to user space at the next VM exit once it
+       sees the event, host timer interrupts making sure there's one. */
+    if (hax_enabled()) {
+        hax_raise_event(cpu);
+    }
+#endif
+}
+
+static bool all_vcpus_paused(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (!cpu->stopped) {
+            return false;
+        }
+    }
     return true;
 }
 
 void resume_all_vcpus(void)
 {
+    CPUState *cpu;
+
+    if (vcpu_threads_enabled) {
+        CPU_FOREACH(cpu) {
+            cpu->stop = 0;
+            cpu->stopped = 0;
+            qemu_cpu_kick(cpu);
+        }
+    } else if (iothread_enabled) {
+        qemu_cond_broadcast(&qemu_halt_cond);
+    }
 }
 
+/* Nothing to do with a single TCG vCPU thread: it can only run guest
+   code while the caller doesn't hold the global mutex, and it stops
+   once it sees that vm_running is 0. The KVM and HAX vCPU threads run
+   the guest without the mutex, so they must be kicked and waited for.
+   This can be called from a vCPU thread, e.g. on a KVM debug exit. */
 void pause_all_vcpus(void)
 {
+    CPUState *cpu;
+
+    if (!vcpu_threads_enabled) {
+        return;
+    }
+    CPU_FOREACH(cpu) {
+        if (qemu_cpu_is_self(cpu)) {
+            cpu->stopped = 1;
+            cpu_exit(cpu);
+        } else {
+            cpu->stop = 1;
+            qemu_cpu_kick(cpu);
+        }
+    }
+    while (!all_vcpus_paused()) {
+        qemu_cond_wait(&qemu_pause_cond, &qemu_global_mutex);
+    }
+    qemu_cond_broadcast(&qemu_pause_cond);
 }
 
+/* Called with the global mutex held. The TCG vCPU isn't running guest
+   code then, so it only needs to be woken up if it's halted. */
 void qemu_cpu_kick(CPUState *cpu)
 {
-    return;
+    if (vcpu_threads_enabled) {
+        qemu_cond_broadcast(cpu->halt_cond);
+        if (!qemu_cpu_is_self(cpu)) {
+            qemu_vcpu_kick_thread(cpu);
+        }
+    } else if (iothread_enabled) {
+        qemu_cond_broadcast(&qemu_halt_cond);
+    }
 }
 
 // In main-loop.c
@@ -137,6 +599,13 @@ void qemu_notify_event(void)
 {
     CPUState *cpu = current_cpu;
 
+    if (iothread_enabled) {
+        /* The main loop kicks the vCPU thread when it needs the global
+           mutex to handle the event. */
+        qemu_event_increment();
+        return;
+    }
+
     if (cpu) {
         cpu_exit(cpu);
     /*
@@ -164,10 +633,28 @@ void qemu_notify_event(void)
 
 void qemu_mutex_lock_iothread(void)
 {
+    if (!iothread_enabled) {
+        return;
+    }
+    if (vcpu_threads_enabled) {
+        qemu_mutex_lock(&qemu_global_mutex);
+        return;
+    }
+    iothread_requesting_mutex = true;
+    if (qemu_mutex_trylock(&qemu_global_mutex)) {
+        qemu_tcg_kick_thread();
+        qemu_mutex_lock(&qemu_global_mutex);
+    }
+    iothread_requesting_mutex = false;
+    qemu_cond_broadcast(&qemu_io_proceeded_cond);
 }
 
 void qemu_mutex_unlock_iothread(void)
 {
+    if (!iothread_enabled) {
+        return;
+    }
+    qemu_mutex_unlock(&qemu_global_mutex);
 }
 
 void vm_stop(int reason)
@@ -177,6 +664,7 @@ void vm_stop(int reason)
 
 static int qemu_cpu_exec(CPUOldState *env)
 {
+    int64_t throttle_start = cpu_throttle_percent < 100 ? get_clock() : 0;
     int ret;
 
 #ifdef CONFIG_PROFILER
@@ -200,6 +688,9 @@ static int qemu_cpu_exec(CPUOldState *env)
     }
 #endif
     ret = cpu_exec(env);
+    if (throttle_start) {
+        qemu_cpu_throttle_account(ENV_GET_CPU(env), throttle_start);
+    }
 #ifdef CONFIG_PROFILER
     qemu_time += profile_getclock() - ti;
 #endif
@@ -228,7 +719,8 @@ void tcg_cpu_exec(void)
 
         if (!vm_running)
             break;
-        if (qemu_timer_alarm_pending()) {
+        /* Timers run in the main thread when there's an I/O thread. */
+        if (!iothread_enabled && qemu_timer_alarm_pending()) {
             break;
         }
         if (cpu_can_run(env))
@@ -236,6 +728,7 @@ void tcg_cpu_exec(void)
         if (ret == EXCP_DEBUG) {
             gdb_set_stop_cpu(cur_cpu);
             debug_requested = 1;
+            qemu_notify_event();
             break;
         }
     }
@@ -294,11 +787,10 @@ void qemu_timer_register_savevm(void) {
                     &timers_state);
 }
 
-/* Return the virtual CPU time, based on the instruction counter.  */
-int64_t cpu_get_icount(void)
+int64_t cpu_get_icount_raw(void)
 {
     int64_t icount;
-    CPUOldState *env = cpu_single_env;;
+    CPUOldState *env = cpu_single_env;
 
     icount = qemu_icount;
     if (env) {
@@ -307,7 +799,13 @@ int64_t cpu_get_icount(void)
         }
         icount -= (env->icount_decr.u16.low + env->icount_extra);
     }
-    return qemu_icount_bias + (icount << icount_time_shift);
+    return icount;
+}
+
+/* Return the virtual CPU time, based on the instruction counter.  */
+int64_t cpu_get_icount(void)
+{
+    return qemu_icount_bias + (cpu_get_icount_raw() << icount_time_shift);
 }
 
 /* return the host CPU cycle counter and handle stop/restart */
@@ -25,6 +25,8 @@
 
 /* statistics */
 int tlb_flush_count;
+uint64_t tlb_victim_hit_count;
+uint64_t tlb_victim_miss_count;
 
 static const CPUTLBEntry s_cputlb_empty_entry = {
     .addr_read  = -1,
@@ -47,8 +49,6 @@ static const CPUTLBEntry s_cputlb_empty_entry = {
  */
 void tlb_flush(CPUArchState *env, int flush_global)
 {
-    int i;
-
 #if defined(DEBUG_TLB)
     printf("tlb_flush:\n");
 #endif
@@ -56,13 +56,10 @@ void tlb_flush(CPUArchState *env, int flush_global)
        links while we are modifying them */
     env->current_tb = NULL;
 
-    for (i = 0; i < CPU_TLB_SIZE; i++) {
-        int mmu_idx;
-
-        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-            env->tlb_table[mmu_idx][i] = s_cputlb_empty_entry;
-        }
-    }
+    /* all the fields of s_cputlb_empty_entry are -1 */
+    memset(env->tlb_table, -1, sizeof(env->tlb_table));
+    memset(env->tlb_v_table, -1, sizeof(env->tlb_v_table));
+    env->vtlb_index = 0;
 
     memset(env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
 
@@ -83,6 +80,16 @@ static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
     }
 }
 
+static inline void tlb_flush_vtlb_page(CPUArchState *env, int mmu_idx,
+                                       target_ulong addr)
+{
+    int k;
+
+    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        tlb_flush_entry(&env->tlb_v_table[mmu_idx][k], addr);
+    }
+}
+
 void tlb_flush_page(CPUArchState *env, target_ulong addr)
 {
     int i;
@@ -109,6 +116,7 @@ void tlb_flush_page(CPUArchState *env, target_ulong addr)
     i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
+        tlb_flush_vtlb_page(env, mmu_idx, addr);
     }
 
     tb_flush_jmp_cache(env, addr);
@@ -165,6 +173,10 @@ void cpu_tlb_reset_dirty_all(ram_addr_t start1, ram_addr_t length)
                 tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
                                       start1, length);
             }
+            for (i = 0; i < CPU_VTLB_SIZE; i++) {
+                tlb_reset_dirty_range(&env->tlb_v_table[mmu_idx][i],
+                                      start1, length);
+            }
         }
     }
 }
@@ -186,7 +198,12 @@ void tlb_set_dirty(CPUArchState *env, target_ulong vaddr)
     vaddr &= TARGET_PAGE_MASK;
     i = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        int k;
+
         tlb_set_dirty1(&env->tlb_table[mmu_idx][i], vaddr);
+        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+            tlb_set_dirty1(&env->tlb_v_table[mmu_idx][k], vaddr);
+        }
     }
 }
 
@@ -222,7 +239,7 @@ void tlb_set_page(CPUArchState *env, target_ulong vaddr,
 {
     PhysPageDesc *p;
     unsigned long pd;
-    unsigned int index;
+    unsigned int index, vidx;
     target_ulong address;
     target_ulong code_address;
     ptrdiff_t addend;
@@ -287,8 +304,16 @@ void tlb_set_page(CPUArchState *env, target_ulong vaddr,
     }
 
     index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-    env->iotlb[mmu_idx][index] = iotlb - vaddr;
     te = &env->tlb_table[mmu_idx][index];
+
+    /* Keep the previous entry in the victim TLB, which must not hold
+       another entry for vaddr. */
+    tlb_flush_vtlb_page(env, mmu_idx, vaddr);
+    vidx = env->vtlb_index++ % CPU_VTLB_SIZE;
+    env->tlb_v_table[mmu_idx][vidx] = *te;
+    env->iotlb_v[mmu_idx][vidx] = env->iotlb[mmu_idx][index];
+
+    env->iotlb[mmu_idx][index] = iotlb - vaddr;
     te->addend = addend - vaddr;
     if (prot & PAGE_READ) {
         te->addr_read = address;
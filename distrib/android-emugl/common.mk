@@ -229,7 +229,7 @@ GEN := $$(_emugl_dec)_dec.cpp \
        $$(_emugl_dec)_server_context.cpp
 
 $$(GEN): PRIVATE_PATH := $$(LOCAL_PATH)
-$$(GEN): PRIVATE_CUSTOM_TOOL := $$(EMUGL_EMUGEN) -D $$1 -i $$2 $$3
+$$(GEN): PRIVATE_CUSTOM_TOOL := $$(EMUGL_EMUGEN) -g -D $$1 -i $$2 $$3
 $$(GEN): $$(EMUGL_EMUGEN) $$(_emugl_src).attrib $$(_emugl_src).in $$(_emugl_src).types
 	$$(transform-generated-source)
 
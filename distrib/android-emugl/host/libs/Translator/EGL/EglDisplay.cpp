@@ -19,6 +19,12 @@
 #include "EglOsApi.h"
 #include <GLcommon/GLutils.h>
 
+// Maximum number of released native pbuffers kept for reuse. The guest
+// destroys and creates window surfaces of the same sizes in bursts, e.g.
+// on activity transitions, and creating a GLX pbuffer can take several
+// milliseconds.
+static const size_t kMaxPooledPbuffers = 8;
+
 EglDisplay::EglDisplay(EGLNativeDisplayType dpy,
                        EglOS::Display* idpy) :
     m_dpy(dpy),
@@ -43,6 +49,8 @@ EglDisplay::~EglDisplay() {
         m_idpy->destroyContext(m_globalSharedContext);
     }
 
+    clearPbufferPool();
+
     m_idpy->release();
 
     for(ConfigsList::iterator it = m_configs.begin();
@@ -70,9 +78,67 @@ void EglDisplay::terminate(){
     emugl::Mutex::AutoLock mutex(m_lock);
      m_contexts.clear();
      m_surfaces.clear();
+     clearPbufferPool();
      m_initialized = false;
 }
 
+static bool pbufferInfoEquals(const EglOS::PbufferInfo& a,
+                              const EglOS::PbufferInfo& b) {
+    return a.width == b.width && a.height == b.height &&
+           a.largest == b.largest && a.format == b.format &&
+           a.target == b.target && a.hasMipmap == b.hasMipmap;
+}
+
+EglOS::Surface* EglDisplay::createPbuffer(
+        const EglOS::PixelFormat* pixelFormat,
+        const EglOS::PbufferInfo& info) {
+    {
+        emugl::Mutex::AutoLock mutex(m_pbufferLock);
+        for (PbufferPool::reverse_iterator it = m_pbufferPool.rbegin();
+             it != m_pbufferPool.rend(); ++it) {
+            if (it->pixelFormat == pixelFormat &&
+                pbufferInfoEquals(it->info, info)) {
+                EglOS::Surface* pb = it->surface;
+                m_pbufferPool.erase(--(it.base()));
+                return pb;
+            }
+        }
+    }
+    return m_idpy->createPbufferSurface(pixelFormat, &info);
+}
+
+void EglDisplay::releasePbuffer(const EglOS::PixelFormat* pixelFormat,
+                                const EglOS::PbufferInfo& info,
+                                EglOS::Surface* pb) {
+    EglOS::Surface* evicted = NULL;
+    {
+        emugl::Mutex::AutoLock mutex(m_pbufferLock);
+        if (m_pbufferPool.size() == kMaxPooledPbuffers) {
+            evicted = m_pbufferPool.front().surface;
+            m_pbufferPool.pop_front();
+        }
+        PooledPbuffer entry;
+        entry.pixelFormat = pixelFormat;
+        entry.info = info;
+        entry.surface = pb;
+        m_pbufferPool.push_back(entry);
+    }
+    if (evicted) {
+        m_idpy->releasePbuffer(evicted);
+        delete evicted;
+    }
+}
+
+void EglDisplay::clearPbufferPool() {
+    emugl::Mutex::AutoLock mutex(m_pbufferLock);
+    for (PbufferPool::iterator it = m_pbufferPool.begin();
+         it != m_pbufferPool.end(); ++it) {
+        m_idpy->releasePbuffer(it->surface);
+        delete it->surface;
+    }
+    m_pbufferPool.clear();
+}
+
 static bool compareEglConfigsPtrs(EglConfig* first,EglConfig* second) {
     return *first < *second ;
 }
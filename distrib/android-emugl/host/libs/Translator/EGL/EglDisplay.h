@@ -88,12 +88,34 @@ public:
     bool destroyImageKHR(EGLImageKHR img);
     EglOS::Context* getGlobalSharedContext() const;
 
+    // Return a native pbuffer of format |pixelFormat| described by |info|,
+    // reusing one released by releasePbuffer() if possible, or NULL if
+    // none could be created.
+    EglOS::Surface* createPbuffer(const EglOS::PixelFormat* pixelFormat,
+                                  const EglOS::PbufferInfo& info);
+
+    // Release a native pbuffer |pb| returned by createPbuffer() with the
+    // same |pixelFormat| and |info|. It is kept for reuse by the next
+    // matching createPbuffer() call, or destroyed if there are too many.
+    void releasePbuffer(const EglOS::PixelFormat* pixelFormat,
+                        const EglOS::PbufferInfo& info,
+                        EglOS::Surface* pb);
+
 private:
    static void addConfig(void* opaque, const EglOS::ConfigInfo* configInfo);
 
    int doChooseConfigs(const EglConfig& dummy,EGLConfig* configs,int config_size) const;
    void addMissingConfigs(void);
    void initConfigurations(int renderableType);
+   void clearPbufferPool();
+
+   // A released native pbuffer, kept for reuse.
+   struct PooledPbuffer {
+       const EglOS::PixelFormat* pixelFormat;
+       EglOS::PbufferInfo        info;
+       EglOS::Surface*           surface;
+   };
+   typedef std::list<PooledPbuffer> PbufferPool;
 
    EGLNativeDisplayType    m_dpy;
    EglOS::Display*         m_idpy;
@@ -108,6 +130,11 @@ private:
    ImagesHndlMap           m_eglImages;
    unsigned int            m_nextEglImageId;
    mutable EglOS::Context* m_globalSharedContext;
+   // Released pbuffers, from the least to the most recently released one.
+   // This has its own lock, since surfaces are released from methods
+   // that hold |m_lock|.
+   PbufferPool             m_pbufferPool;
+   emugl::Mutex            m_pbufferLock;
 };
 
 #endif
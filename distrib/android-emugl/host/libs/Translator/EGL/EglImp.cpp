@@ -586,14 +586,13 @@ EGLAPI EGLSurface EGLAPIENTRY eglCreatePbufferSurface(
 
     tmpPbSurfacePtr->getAttrib(EGL_MIPMAP_TEXTURE, &pbinfo.hasMipmap);
 
-    EglOS::Surface* pb = dpy->nativeType()->createPbufferSurface(
-            cfg->nativeFormat(), &pbinfo);
+    EglOS::Surface* pb = dpy->createPbuffer(cfg->nativeFormat(), pbinfo);
     if(!pb) {
         //TODO: RETURN_ERROR(EGL_NO_SURFACE,EGL_BAD_VALUE); dont have bad value
         RETURN_ERROR(EGL_NO_SURFACE,EGL_BAD_ATTRIBUTE);
     }
 
-    tmpPbSurfacePtr->setNativePbuffer(pb);
+    tmpPbSurfacePtr->setNativePbuffer(pb, pbinfo);
     return dpy->addSurface(pbSurface);
 }
 
@@ -15,6 +15,17 @@
 */
 #include "EglPbufferSurface.h"
 
+#include "EglDisplay.h"
+
+EglPbufferSurface::~EglPbufferSurface() {
+    if (m_native) {
+        m_dpy->releasePbuffer(m_config->nativeFormat(), m_pbufferInfo,
+                              m_native);
+        // Ownership was transferred to the display.
+        m_native = NULL;
+    }
+}
+
 bool EglPbufferSurface::setAttrib(EGLint attrib,EGLint val) {
     switch(attrib) {
     case EGL_WIDTH:
@@ -29,7 +29,16 @@ public:
                                          m_texMipmap(EGL_FALSE),
                                          m_largest(EGL_FALSE){};
 
-    void  setNativePbuffer(EglOS::Surface* srfc) { m_native = srfc; }
+    // Return the native pbuffer |srfc| to the display's pool.
+    ~EglPbufferSurface();
+
+    // Set the native pbuffer of this surface, as returned by
+    // EglDisplay::createPbuffer() for |info|.
+    void  setNativePbuffer(EglOS::Surface* srfc,
+                           const EglOS::PbufferInfo& info) {
+        m_native = srfc;
+        m_pbufferInfo = info;
+    }
     bool  setAttrib(EGLint attrib,EGLint val);
     bool  getAttrib(EGLint attrib,EGLint* val);
     void  getDim(EGLint* width,EGLint* height,EGLint* largest){
@@ -45,5 +54,6 @@ private:
     EGLint               m_texTarget;
     EGLint               m_texMipmap;
     EGLint               m_largest;
+    EglOS::PbufferInfo   m_pbufferInfo;
 };
 #endif
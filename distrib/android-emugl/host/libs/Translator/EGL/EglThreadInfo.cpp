@@ -21,12 +21,21 @@
 
 namespace {
 
+#ifdef EMUGL_THREAD_LOCAL
+// Cache of the value of |s_tls|, which EglThreadInfo::get() returns on
+// every EGL call.
+EMUGL_THREAD_LOCAL EglThreadInfo* s_threadInfo = NULL;
+#endif
+
 class EglThreadInfoStore : public emugl::ThreadStore {
 public:
     EglThreadInfoStore() : emugl::ThreadStore(&destructor) {}
 private:
     static void destructor(void* value) {
         delete static_cast<EglThreadInfo*>(value);
+#ifdef EMUGL_THREAD_LOCAL
+        s_threadInfo = NULL;
+#endif
     }
 };
 
@@ -39,11 +48,19 @@ static emugl::LazyInstance<EglThreadInfoStore> s_tls = LAZY_INSTANCE_INIT;
 
 EglThreadInfo* EglThreadInfo::get(void)
 {
+#ifdef EMUGL_THREAD_LOCAL
+    if (s_threadInfo) {
+        return s_threadInfo;
+    }
+#endif
     EglThreadInfo *ti = static_cast<EglThreadInfo*>(s_tls->get());
     if (!ti) {
         ti = new EglThreadInfo();
         s_tls->set(ti);
     }
+#ifdef EMUGL_THREAD_LOCAL
+    s_threadInfo = ti;
+#endif
     return ti;
 }
 
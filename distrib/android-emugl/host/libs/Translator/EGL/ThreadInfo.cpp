@@ -33,6 +33,12 @@
 
 namespace {
 
+#ifdef EMUGL_THREAD_LOCAL
+// Cache of the value of |s_tls|, which getThreadInfo() returns on most GL
+// calls.
+EMUGL_THREAD_LOCAL ThreadInfo* s_threadInfo = NULL;
+#endif
+
 class ThreadInfoStore : public ::emugl::ThreadStore {
 public:
     ThreadInfoStore() : ::emugl::ThreadStore(&destructor) {}
@@ -45,6 +51,9 @@ private:
                        value, mNumInstances);
         delete static_cast<ThreadInfo*>(value);
         mNumInstances--;
+#ifdef EMUGL_THREAD_LOCAL
+        s_threadInfo = NULL;
+#endif
     }
 
     static size_t mNumInstances;
@@ -72,6 +81,11 @@ static ::emugl::LazyInstance<ThreadInfoStore> s_tls = LAZY_INSTANCE_INIT;
 
 ThreadInfo *getThreadInfo()
 {
+#ifdef EMUGL_THREAD_LOCAL
+    if (s_threadInfo) {
+        return s_threadInfo;
+    }
+#endif
     ThreadInfo *ti = static_cast<ThreadInfo*>(s_tls->get());
     if (!ti) {
         ti = new ThreadInfo();
@@ -79,5 +93,8 @@ ThreadInfo *getThreadInfo()
         LOG_THREADINFO("%s: EGL %p (%d instances)\n", __FUNCTION__,
                        ti, (int)ThreadInfoStore::getInstanceCount());
     }
+#ifdef EMUGL_THREAD_LOCAL
+    s_threadInfo = ti;
+#endif
     return ti;
 }
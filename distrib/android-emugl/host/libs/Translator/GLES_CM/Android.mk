@@ -4,6 +4,7 @@ host_common_SRC_FILES := \
      GLEScmImp.cpp       \
      GLEScmUtils.cpp     \
      GLEScmContext.cpp   \
+     GLEScmPipeline.cpp  \
      GLEScmValidate.cpp
 
 
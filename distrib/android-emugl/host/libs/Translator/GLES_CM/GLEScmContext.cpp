@@ -18,6 +18,7 @@
 #include "GLEScmUtils.h"
 #include <GLcommon/GLutils.h>
 #include <GLcommon/GLconversion_macros.h>
+#include <GLcommon/TranslatorIfaces.h>
 #include <string.h>
 #include <GLES/gl.h>
 #include <GLES/glext.h>
@@ -35,11 +36,13 @@ void GLEScmContext::init(GlLibrary* glLib) {
                      (const char*)dispatcher().glGetString(GL_RENDERER),
                      (const char*)dispatcher().glGetString(GL_VERSION),
                      "OpenGL ES-CM 1.1");
+        m_useShaders = GLEScmPipeline::isSupported(s_glDispatch,s_glSupport.glslVersion);
     }
     m_initialized = true;
 }
 
-GLEScmContext::GLEScmContext():GLEScontext(),m_texCoords(NULL),m_pointsIndex(-1), m_clientActiveTexture(0) {
+GLEScmContext::GLEScmContext():GLEScontext(),m_texCoords(NULL),m_pointsIndex(-1), m_clientActiveTexture(0),
+                                   m_useShaders(false) {
 
     m_map[GL_COLOR_ARRAY]          = new GLESpointer();
     m_map[GL_NORMAL_ARRAY]         = new GLESpointer();
@@ -52,6 +55,104 @@ void GLEScmContext::setActiveTexture(GLenum tex) {
    m_activeTexture = tex - GL_TEXTURE0;
 }
 
+void GLEScmContext::setPipelineCap(GLenum cap,bool enable) {
+    unsigned int bit = 0;
+    unsigned int* bits = &m_pipelineState.caps;
+
+    if(cap >= GL_LIGHT0 && cap < GL_LIGHT0 + GLEScmPipelineState::kMaxLights) {
+        bits = &m_pipelineState.lights;
+        bit = 1 << (cap - GL_LIGHT0);
+    } else if(cap >= GL_CLIP_PLANE0 && cap <= GL_CLIP_PLANE5) {
+        bits = &m_pipelineState.clipPlanes;
+        bit = 1 << (cap - GL_CLIP_PLANE0);
+    } else if(cap == GL_TEXTURE_2D || cap == GL_TEXTURE_CUBE_MAP_OES ||
+              cap == GL_TEXTURE_GEN_STR_OES) {
+        if(m_activeTexture >= GLEScmPipelineState::kMaxUnits) {
+            if(cap == GL_TEXTURE_GEN_STR_OES) return;
+            unsigned int index = 2 * (m_activeTexture - GLEScmPipelineState::kMaxUnits) +
+                                 (cap == GL_TEXTURE_2D ? 0 : 1);
+            bits = &m_pipelineState.otherUnits;
+            bit = 1U << (index < 32 ? index : 31);
+        } else {
+            GLEScmPipelineState::Unit& unit = m_pipelineState.units[m_activeTexture];
+            if(cap == GL_TEXTURE_2D) unit.texture2D = enable;
+            else if(cap == GL_TEXTURE_CUBE_MAP_OES) unit.cubeMap = enable;
+            else unit.texGen = enable;
+            return;
+        }
+    } else {
+        switch(cap) {
+        case GL_LIGHTING:           bit = GLEScmPipelineState::kCapLighting; break;
+        case GL_COLOR_MATERIAL:     bit = GLEScmPipelineState::kCapColorMaterial; break;
+        case GL_NORMALIZE:          bit = GLEScmPipelineState::kCapNormalize; break;
+        case GL_RESCALE_NORMAL:     bit = GLEScmPipelineState::kCapRescaleNormal; break;
+        case GL_FOG:                bit = GLEScmPipelineState::kCapFog; break;
+        case GL_ALPHA_TEST:         bit = GLEScmPipelineState::kCapAlphaTest; break;
+        case GL_MATRIX_PALETTE_OES: bit = GLEScmPipelineState::kCapMatrixPalette; break;
+        default:                    return;
+        }
+    }
+    if(enable) *bits |= bit;
+    else *bits &= ~bit;
+}
+
+void GLEScmContext::setTexEnvMode(GLenum mode) {
+    if(m_activeTexture < GLEScmPipelineState::kMaxUnits) {
+        m_pipelineState.units[m_activeTexture].envMode = mode;
+    }
+}
+
+// Return the base format of the 2D texture bound to |unit|, which selects
+// the components replaced by its texture environment.
+GLenum GLEScmContext::getTextureFormat(GLenum unit) {
+    if(!shareGroup().Ptr()) return GL_RGBA;
+
+    unsigned int tex = getBindedTexture(unit,GL_TEXTURE_2D);
+    ObjectLocalName name = tex ? tex : getDefaultTextureName(GL_TEXTURE_2D);
+    ObjectDataPtr objData = shareGroup()->getObjectData(TEXTURE,name);
+    const TextureData* texData = (const TextureData*)objData.Ptr();
+    if(!texData) return GL_RGBA;
+
+    switch(texData->internalFormat) {
+    case GL_ALPHA:
+    case GL_LUMINANCE:
+    case GL_LUMINANCE_ALPHA:
+        return texData->internalFormat;
+    case GL_RGB:
+    case GL_RGB565_OES:
+    case GL_RGB8_OES:
+    case GL_ETC1_RGB8_OES:
+    case GL_PALETTE4_RGB8_OES:
+    case GL_PALETTE4_R5_G6_B5_OES:
+    case GL_PALETTE8_RGB8_OES:
+    case GL_PALETTE8_R5_G6_B5_OES:
+        return GL_RGB;
+    default:
+        return GL_RGBA;
+    }
+}
+
+void GLEScmContext::setupDrawPipeline(GLenum mode) {
+    if(!m_useShaders) return;
+
+    for(int i = 0; i < GLEScmPipelineState::kMaxUnits; i++) {
+        GLEScmPipelineState::Unit& unit = m_pipelineState.units[i];
+        if(unit.texture2D) {
+            unit.format = getTextureFormat(GL_TEXTURE0 + i);
+        }
+    }
+    uint64_t key;
+    if(!GLEScmPipeline::getKey(m_pipelineState,mode,&key)) {
+        m_pipeline.unbind(s_glDispatch);
+        return;
+    }
+    m_pipeline.use(s_glDispatch,key,m_pipelineState.alphaRef);
+}
+
+void GLEScmContext::useFixedFunction() {
+    m_pipeline.unbind(s_glDispatch);
+}
+
 void GLEScmContext::setClientActiveTexture(GLenum tex) {
    m_clientActiveTexture = tex - GL_TEXTURE0;
    m_map[GL_TEXTURE_COORD_ARRAY] = &m_texCoords[m_clientActiveTexture];
@@ -228,12 +329,7 @@ bool GLEScmContext::needConvert(GLESConversionArrays& cArrs,GLint first,GLsizei
        (arrType == GL_BYTE   && (array_id != GL_TEXTURE_COORD_ARRAY)) ) return false;
 
 
-    bool byteVBO = (arrType == GL_BYTE) && usingVBO;
-    if(byteVBO){
-        p->redirectPointerData();
-    }
-
-    if(!usingVBO || byteVBO) {
+    if(!usingVBO) {
         if (direct) {
             convertDirect(cArrs,first,count,array_id,p);
         } else {
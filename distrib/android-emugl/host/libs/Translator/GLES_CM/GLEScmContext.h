@@ -20,6 +20,7 @@
 #include <GLcommon/GLESpointer.h>
 #include <GLcommon/GLESbuffer.h>
 #include <GLcommon/GLEScontext.h>
+#include "GLEScmPipeline.h"
 
 #include <map>
 #include <vector>
@@ -51,6 +52,18 @@ public:
     virtual bool glGetFloatv(GLenum pname, GLfloat *params);
     virtual bool glGetFixedv(GLenum pname, GLfixed *params);
 
+    // Record the fixed-function state which selects the program drawing
+    // with the shader emulation of the pipeline, see GLEScmPipeline.
+    void setPipelineCap(GLenum cap,bool enable);
+    void setTexEnvMode(GLenum mode);
+    GLEScmPipelineState& pipelineState() { return m_pipelineState; }
+    // Bind the program drawing |mode| primitives with the current state,
+    // or unbind it if the draw needs the fixed-function pipeline. Does
+    // nothing unless the shader emulation is enabled.
+    void setupDrawPipeline(GLenum mode);
+    // Unbind the program before a draw with the fixed-function pipeline.
+    void useFixedFunction();
+
     ~GLEScmContext();
 protected:
 
@@ -61,10 +74,14 @@ private:
     void drawPoints(PointSizeIndices* points);
     void drawPointsData(GLESConversionArrays& arrs,GLint first,GLsizei count,GLenum type,const GLvoid* indices_in,bool isElemsDraw);
     void initExtensionString();
+    GLenum getTextureFormat(GLenum unit);
 
     GLESpointer*          m_texCoords;
     int                   m_pointsIndex;
     unsigned int          m_clientActiveTexture;
+    bool                  m_useShaders;
+    GLEScmPipelineState   m_pipelineState;
+    GLEScmPipeline        m_pipeline;
 };
 
 #endif
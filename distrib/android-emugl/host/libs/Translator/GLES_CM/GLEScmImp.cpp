@@ -178,6 +178,14 @@ GLESiface* __translator_getIfaces(EGLiface* eglIface) {
     return &s_glesIface;
 }
 
+// Return the number of GL calls skipped by the redundant state filter of
+// all contexts since the previous call.
+GL_APICALL unsigned int GL_APIENTRY __translator_takeElidedCallCount(void);
+
+unsigned int __translator_takeElidedCallCount(void) {
+    return GLEScontext::takeElidedCallCount();
+}
+
 }
 
 static ObjectLocalName TextureLocalName(GLenum target, unsigned int tex) {
@@ -280,16 +288,16 @@ GL_API void GL_APIENTRY  glActiveTexture( GLenum texture) {
 }
 
 GL_API void GL_APIENTRY  glAlphaFunc( GLenum func, GLclampf ref) {
-    GET_CTX()
+    GET_CTX_CM()
     SET_ERROR_IF(!GLEScmValidate::alphaFunc(func),GL_INVALID_ENUM);
+    ctx->pipelineState().alphaFunc = func;
+    ctx->pipelineState().alphaRef = ref < 0 ? 0 : (ref > 1 ? 1 : ref);
     ctx->dispatcher().glAlphaFunc(func,ref);
 }
 
 
 GL_API void GL_APIENTRY  glAlphaFuncx( GLenum func, GLclampx ref) {
-    GET_CTX()
-    SET_ERROR_IF(!GLEScmValidate::alphaFunc(func),GL_INVALID_ENUM);
-    ctx->dispatcher().glAlphaFunc(func,X2F(ref));
+    glAlphaFunc(func,X2F(ref));
 }
 
 
@@ -335,12 +343,14 @@ GL_API void GL_APIENTRY  glBindTexture( GLenum target, GLuint texture) {
     }
 
     ctx->setBindedTexture(target,texture);
+    if (ctx->filterBindTexture(target,globalTextureName)) return;
     ctx->dispatcher().glBindTexture(target,globalTextureName);
 }
 
 GL_API void GL_APIENTRY  glBlendFunc( GLenum sfactor, GLenum dfactor) {
     GET_CTX()
     SET_ERROR_IF(!GLEScmValidate::blendSrc(sfactor) || !GLEScmValidate::blendDst(dfactor),GL_INVALID_ENUM)
+    if (ctx->filterBlendFunc(sfactor,dfactor,sfactor,dfactor)) return;
     ctx->dispatcher().glBlendFunc(sfactor,dfactor);
 }
 
@@ -516,16 +526,19 @@ GL_API void GL_APIENTRY  glDeleteTextures( GLsizei n, const GLuint *textures) {
                     ctx->setBindedTexture(GL_TEXTURE_CUBE_MAP,0);
             }
         }
+        GLEScontext::onTexturesDeleted();
     }
 }
 
 GL_API void GL_APIENTRY  glDepthFunc( GLenum func) {
     GET_CTX()
+    if (ctx->filterDepthFunc(func)) return;
     ctx->dispatcher().glDepthFunc(func);
 }
 
 GL_API void GL_APIENTRY  glDepthMask( GLboolean flag) {
     GET_CTX()
+    if (ctx->filterDepthMask(flag)) return;
     ctx->dispatcher().glDepthMask(flag);
 }
 
@@ -540,13 +553,14 @@ GL_API void GL_APIENTRY  glDepthRangex( GLclampx zNear, GLclampx zFar) {
 }
 
 GL_API void GL_APIENTRY  glDisable( GLenum cap) {
-    GET_CTX()
+    GET_CTX_CM()
+    ctx->setPipelineCap(cap,false);
     if (cap==GL_TEXTURE_GEN_STR_OES) {
         ctx->dispatcher().glDisable(GL_TEXTURE_GEN_S);
         ctx->dispatcher().glDisable(GL_TEXTURE_GEN_T);
         ctx->dispatcher().glDisable(GL_TEXTURE_GEN_R);
     }
-    else ctx->dispatcher().glDisable(cap);
+    else if (!ctx->filterEnable(cap,false)) ctx->dispatcher().glDisable(cap);
     if (cap==GL_TEXTURE_2D || cap==GL_TEXTURE_CUBE_MAP_OES)
         ctx->setTextureEnabled(cap,false);
 }
@@ -571,6 +585,7 @@ GL_API void GL_APIENTRY  glDrawArrays( GLenum mode, GLint first, GLsizei count)
 
     GLESConversionArrays tmpArrs;
     ctx->setupArraysPointers(tmpArrs,first,count,0,NULL,true);
+    ctx->setupDrawPipeline(mode);
     if(mode == GL_POINTS && ctx->isArrEnabled(GL_POINT_SIZE_ARRAY_OES)){
         ctx->drawPointsArrs(tmpArrs,first,count);
     }
@@ -596,6 +611,7 @@ GL_API void GL_APIENTRY  glDrawElements( GLenum mode, GLsizei count, GLenum type
     }
 
     ctx->setupArraysPointers(tmpArrs,0,count,type,indices,false);
+    ctx->setupDrawPipeline(mode);
     if(mode == GL_POINTS && ctx->isArrEnabled(GL_POINT_SIZE_ARRAY_OES)){
         ctx->drawPointsElems(tmpArrs,count,type,indices);
     }
@@ -605,13 +621,14 @@ GL_API void GL_APIENTRY  glDrawElements( GLenum mode, GLsizei count, GLenum type
 }
 
 GL_API void GL_APIENTRY  glEnable( GLenum cap) {
-    GET_CTX()
+    GET_CTX_CM()
+    ctx->setPipelineCap(cap,true);
     if (cap==GL_TEXTURE_GEN_STR_OES) {
         ctx->dispatcher().glEnable(GL_TEXTURE_GEN_S);
         ctx->dispatcher().glEnable(GL_TEXTURE_GEN_T);
         ctx->dispatcher().glEnable(GL_TEXTURE_GEN_R);
     }
-    else
+    else if (!ctx->filterEnable(cap,true))
         ctx->dispatcher().glEnable(cap);
     if (cap==GL_TEXTURE_2D || cap==GL_TEXTURE_CUBE_MAP_OES)
         ctx->setTextureEnabled(cap,true);
@@ -636,23 +653,27 @@ GL_API void GL_APIENTRY  glFlush( void) {
 }
 
 GL_API void GL_APIENTRY  glFogf( GLenum pname, GLfloat param) {
-    GET_CTX()
+    GET_CTX_CM()
+    if(pname == GL_FOG_MODE) ctx->pipelineState().fogMode = static_cast<GLenum>(param);
     ctx->dispatcher().glFogf(pname,param);
 }
 
 GL_API void GL_APIENTRY  glFogfv( GLenum pname, const GLfloat *params) {
-    GET_CTX()
+    GET_CTX_CM()
+    if(pname == GL_FOG_MODE) ctx->pipelineState().fogMode = static_cast<GLenum>(params[0]);
     ctx->dispatcher().glFogfv(pname,params);
 }
 
 GL_API void GL_APIENTRY  glFogx( GLenum pname, GLfixed param) {
-    GET_CTX()
+    GET_CTX_CM()
+    if(pname == GL_FOG_MODE) ctx->pipelineState().fogMode = static_cast<GLenum>(param);
     ctx->dispatcher().glFogf(pname,(pname == GL_FOG_MODE)? static_cast<GLfloat>(param):X2F(param));
 }
 
 GL_API void GL_APIENTRY  glFogxv( GLenum pname, const GLfixed *params) {
-    GET_CTX()
+    GET_CTX_CM()
     if(pname == GL_FOG_MODE) {
+        ctx->pipelineState().fogMode = static_cast<GLenum>(params[0]);
         GLfloat tmpParam = static_cast<GLfloat>(params[0]);
         ctx->dispatcher().glFogfv(pname,&tmpParam);
     } else {
@@ -874,7 +895,6 @@ GL_API void GL_APIENTRY  glGetIntegerv( GLenum pname, GLint *params) {
         return;
     }
     
-    GLint i;
     GLfloat f;
 
     switch(pname)
@@ -882,17 +902,13 @@ GL_API void GL_APIENTRY  glGetIntegerv( GLenum pname, GLint *params) {
     case GL_TEXTURE_GEN_STR_OES:
         ctx->dispatcher().glGetIntegerv(GL_TEXTURE_GEN_S,&params[0]);
         break;
+    // Answer the bindings from the translator state, querying the driver
+    // forces a sync with threaded host drivers.
     case GL_FRAMEBUFFER_BINDING_OES:
-        if (ctx->shareGroup().Ptr()) {
-            ctx->dispatcher().glGetIntegerv(pname,&i);
-            *params = ctx->shareGroup()->getLocalName(FRAMEBUFFER,i);
-        }
+        *params = ctx->getFramebufferBinding();
         break;
     case GL_RENDERBUFFER_BINDING_OES:
-        if (ctx->shareGroup().Ptr()) {
-            ctx->dispatcher().glGetIntegerv(pname,&i);
-            *params = ctx->shareGroup()->getLocalName(RENDERBUFFER,i);
-        }
+        *params = ctx->getRenderbufferBinding();
         break;
     case GL_NUM_COMPRESSED_TEXTURE_FORMATS:
         *params = getCompressedFormats(NULL);
@@ -900,8 +916,14 @@ GL_API void GL_APIENTRY  glGetIntegerv( GLenum pname, GLint *params) {
     case GL_COMPRESSED_TEXTURE_FORMATS:
         getCompressedFormats(params);
         break;
+    case GL_MAX_LIGHTS:
+    case GL_MAX_MODELVIEW_STACK_DEPTH:
+    case GL_MAX_PROJECTION_STACK_DEPTH:
+    case GL_MAX_TEXTURE_STACK_DEPTH:
+        GLEScontext::getHostLimit(pname,params);
+        break;
     case GL_MAX_CLIP_PLANES:
-        ctx->dispatcher().glGetIntegerv(pname,params);
+        GLEScontext::getHostLimit(pname,params);
         if(*params > 6)
         {
             // GLES spec requires only 6, and the ATI driver erronously
@@ -917,7 +939,7 @@ GL_API void GL_APIENTRY  glGetIntegerv( GLenum pname, GLint *params) {
         *params = (int)(f * (float)0x7fffffff);
         break;
     case GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS:
-        ctx->dispatcher().glGetIntegerv(pname,params);
+        GLEScontext::getHostLimit(pname,params);
         if(*params > 16)
         {
             // GLES spec requires only 2, and the ATI driver erronously
@@ -1081,25 +1103,29 @@ GL_API void GL_APIENTRY  glHint( GLenum target, GLenum mode) {
 }
 
 GL_API void GL_APIENTRY  glLightModelf( GLenum pname, GLfloat param) {
-    GET_CTX()
+    GET_CTX_CM()
+    if(pname == GL_LIGHT_MODEL_TWO_SIDE) ctx->pipelineState().lightTwoSide = param != 0;
     ctx->dispatcher().glLightModelf(pname,param);
 }
 
 GL_API void GL_APIENTRY  glLightModelfv( GLenum pname, const GLfloat *params) {
-    GET_CTX()
+    GET_CTX_CM()
+    if(pname == GL_LIGHT_MODEL_TWO_SIDE) ctx->pipelineState().lightTwoSide = params[0] != 0;
     ctx->dispatcher().glLightModelfv(pname,params);
 }
 
 GL_API void GL_APIENTRY  glLightModelx( GLenum pname, GLfixed param) {
-    GET_CTX()
+    GET_CTX_CM()
+    if(pname == GL_LIGHT_MODEL_TWO_SIDE) ctx->pipelineState().lightTwoSide = param != 0;
     GLfloat tmpParam = static_cast<GLfloat>(param);
     ctx->dispatcher().glLightModelf(pname,tmpParam);
 }
 
 GL_API void GL_APIENTRY  glLightModelxv( GLenum pname, const GLfixed *params) {
-    GET_CTX()
+    GET_CTX_CM()
     GLfloat tmpParams[4];
     if(pname == GL_LIGHT_MODEL_TWO_SIDE) {
+        ctx->pipelineState().lightTwoSide = params[0] != 0;
         tmpParams[0] = X2F(params[0]);
     } else if (pname == GL_LIGHT_MODEL_AMBIENT) {
         for(int i=0;i<4;i++) {
@@ -1383,7 +1409,8 @@ GL_API void GL_APIENTRY  glScissor( GLint x, GLint y, GLsizei width, GLsizei hei
 }
 
 GL_API void GL_APIENTRY  glShadeModel( GLenum mode) {
-    GET_CTX()
+    GET_CTX_CM()
+    ctx->pipelineState().shadeModel = mode;
     ctx->dispatcher().glShadeModel(mode);
 }
 
@@ -1411,39 +1438,45 @@ GL_API void GL_APIENTRY  glTexCoordPointer( GLint size, GLenum type, GLsizei str
 }
 
 GL_API void GL_APIENTRY  glTexEnvf( GLenum target, GLenum pname, GLfloat param) {
-    GET_CTX()
+    GET_CTX_CM()
     SET_ERROR_IF(!GLEScmValidate::texEnv(target,pname),GL_INVALID_ENUM);
+    if(pname == GL_TEXTURE_ENV_MODE) ctx->setTexEnvMode(static_cast<GLenum>(param));
     ctx->dispatcher().glTexEnvf(target,pname,param);
 }
 
 GL_API void GL_APIENTRY  glTexEnvfv( GLenum target, GLenum pname, const GLfloat *params) {
-    GET_CTX()
+    GET_CTX_CM()
     SET_ERROR_IF(!GLEScmValidate::texEnv(target,pname),GL_INVALID_ENUM);
+    if(pname == GL_TEXTURE_ENV_MODE) ctx->setTexEnvMode(static_cast<GLenum>(params[0]));
     ctx->dispatcher().glTexEnvfv(target,pname,params);
 }
 
 GL_API void GL_APIENTRY  glTexEnvi( GLenum target, GLenum pname, GLint param) {
-    GET_CTX()
+    GET_CTX_CM()
     SET_ERROR_IF(!GLEScmValidate::texEnv(target,pname),GL_INVALID_ENUM);
+    if(pname == GL_TEXTURE_ENV_MODE) ctx->setTexEnvMode(param);
     ctx->dispatcher().glTexEnvi(target,pname,param);
 }
 
 GL_API void GL_APIENTRY  glTexEnviv( GLenum target, GLenum pname, const GLint *params) {
-    GET_CTX()
+    GET_CTX_CM()
     SET_ERROR_IF(!GLEScmValidate::texEnv(target,pname),GL_INVALID_ENUM);
+    if(pname == GL_TEXTURE_ENV_MODE) ctx->setTexEnvMode(params[0]);
     ctx->dispatcher().glTexEnviv(target,pname,params);
 }
 
 GL_API void GL_APIENTRY  glTexEnvx( GLenum target, GLenum pname, GLfixed param) {
-    GET_CTX()
+    GET_CTX_CM()
     SET_ERROR_IF(!GLEScmValidate::texEnv(target,pname),GL_INVALID_ENUM);
+    if(pname == GL_TEXTURE_ENV_MODE) ctx->setTexEnvMode(param);
     GLfloat tmpParam = static_cast<GLfloat>(param);
     ctx->dispatcher().glTexEnvf(target,pname,tmpParam);
 }
 
 GL_API void GL_APIENTRY  glTexEnvxv( GLenum target, GLenum pname, const GLfixed *params) {
-    GET_CTX()
+    GET_CTX_CM()
     SET_ERROR_IF(!GLEScmValidate::texEnv(target,pname),GL_INVALID_ENUM);
+    if(pname == GL_TEXTURE_ENV_MODE) ctx->setTexEnvMode(params[0]);
 
     GLfloat tmpParams[4];
     if(pname == GL_TEXTURE_ENV_COLOR) {
@@ -1493,6 +1526,7 @@ GL_API void GL_APIENTRY  glTexImage2D( GLenum target, GLint level, GLint interna
                                                      tex,
                                                      texData->oldGlobal);
                 ctx->dispatcher().glBindTexture(GL_TEXTURE_2D, texData->oldGlobal);
+                ctx->invalidateTextureBinding(GL_TEXTURE_2D);
                 texData->sourceEGLImage = 0;
                 texData->oldGlobal = 0;
             }
@@ -1677,6 +1711,7 @@ GL_API void GL_APIENTRY glEGLImageTargetTexture2DOES(GLenum target, GLeglImageOE
             // replace mapping and bind the new global object
             ctx->shareGroup()->replaceGlobalName(TEXTURE, tex,img->globalTexName);
             ctx->dispatcher().glBindTexture(GL_TEXTURE_2D, img->globalTexName);
+            ctx->invalidateTextureBinding(GL_TEXTURE_2D);
             TextureData *texData = getTextureTargetData(target);
             SET_ERROR_IF(texData==NULL,GL_INVALID_OPERATION);
             texData->width = img->width;
@@ -1742,6 +1777,7 @@ GL_API void GL_APIENTRY glEGLImageTargetRenderbufferStorageOES(GLenum target, GL
 GL_API void GL_APIENTRY glBlendEquationOES(GLenum mode) {
     GET_CTX()
     SET_ERROR_IF(!(GLEScmValidate::blendEquationMode(mode)), GL_INVALID_ENUM);
+    if (ctx->filterBlendEquation(mode,mode)) return;
     ctx->dispatcher().glBlendEquation(mode);
 }
 
@@ -1749,6 +1785,7 @@ GL_API void GL_APIENTRY glBlendEquationOES(GLenum mode) {
 GL_API void GL_APIENTRY glBlendEquationSeparateOES (GLenum modeRGB, GLenum modeAlpha) {
     GET_CTX()
     SET_ERROR_IF(!(GLEScmValidate::blendEquationMode(modeRGB) && GLEScmValidate::blendEquationMode(modeAlpha)), GL_INVALID_ENUM);
+    if (ctx->filterBlendEquation(modeRGB,modeAlpha)) return;
     ctx->dispatcher().glBlendEquationSeparate(modeRGB,modeAlpha);
 }
 
@@ -1757,6 +1794,7 @@ GL_API void GL_APIENTRY glBlendFuncSeparateOES(GLenum srcRGB, GLenum dstRGB, GLe
     GET_CTX()
     SET_ERROR_IF(!GLEScmValidate::blendSrc(srcRGB) || !GLEScmValidate::blendDst(dstRGB) ||
                  !GLEScmValidate::blendSrc(srcAlpha) || ! GLEScmValidate::blendDst(dstAlpha) ,GL_INVALID_ENUM);
+    if (ctx->filterBlendFunc(srcRGB,dstRGB,srcAlpha,dstAlpha)) return;
     ctx->dispatcher().glBlendFuncSeparate(srcRGB,dstRGB,srcAlpha,dstAlpha);
 }
 
@@ -1796,6 +1834,9 @@ GL_API void GLAPIENTRY glDeleteRenderbuffersOES(GLsizei n, const GLuint *renderb
     for (int i=0;i<n;++i) {
         GLuint globalBufferName = ctx->shareGroup()->getGlobalName(RENDERBUFFER,renderbuffers[i]);
         ctx->dispatcher().glDeleteRenderbuffersEXT(1,&globalBufferName);
+        if (renderbuffers[i] == ctx->getRenderbufferBinding()) {
+            ctx->setRenderbufferBinding(0);
+        }
     }
 }
 
@@ -1936,6 +1977,9 @@ GL_API void GLAPIENTRY glDeleteFramebuffersOES(GLsizei n, const GLuint *framebuf
     for (int i=0;i<n;++i) {
         GLuint globalBufferName = ctx->shareGroup()->getGlobalName(FRAMEBUFFER,framebuffers[i]);
         ctx->dispatcher().glDeleteFramebuffersEXT(1,&globalBufferName);
+        if (framebuffers[i] == ctx->getFramebufferBinding()) {
+            ctx->setFramebufferBinding(0);
+        }
     }
 }
 
@@ -2229,11 +2273,12 @@ GL_API void GL_APIENTRY glGetTexGenxvOES (GLenum coord, GLenum pname, GLfixed *p
 
 template <class T, GLenum TypeName>
 void glDrawTexOES (T x, T y, T z, T width, T height) {
-    GET_CTX()
+    GET_CTX_CM()
 
     SET_ERROR_IF((width<=0 || height<=0),GL_INVALID_VALUE);
 
     ctx->drawValidate();
+    ctx->useFixedFunction();
 
     int numClipPlanes;
 
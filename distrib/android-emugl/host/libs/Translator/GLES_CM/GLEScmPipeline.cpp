@@ -0,0 +1,422 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "GLEScmPipeline.h"
+
+#include <OpenglCodecCommon/ErrorLog.h>
+#include <GLES/gl.h>
+#include <GLES/glext.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Layout of the program keys.
+enum {
+    kKeyLighting      = 1 << 0,
+    kKeyColorMaterial = 1 << 1,
+    kKeyNormalize     = 1 << 2,
+    kKeyLightsShift   = 3,      // 8 bits, one per light
+    kKeyFog           = 1 << 11,
+    kKeyFogModeShift  = 12,     // 2 bits, see fogModes
+    kKeyAlphaTest     = 1 << 14,
+    kKeyAlphaFuncShift = 15,    // 3 bits, func - GL_NEVER
+    kKeyUnitsShift    = 18,     // 7 bits per unit, see below
+    kKeyUnitBits      = 7,
+};
+
+// Layout of the bits of each texture unit in a key.
+enum {
+    kUnitEnabled     = 1 << 0,
+    kUnitModeShift   = 1,       // 3 bits, see envModes
+    kUnitFormatShift = 4,       // 3 bits, see formats
+};
+
+static const GLenum fogModes[] = { GL_LINEAR, GL_EXP, GL_EXP2 };
+static const GLenum envModes[] = { GL_MODULATE, GL_REPLACE, GL_DECAL, GL_BLEND, GL_ADD };
+static const GLenum formats[] = { GL_RGBA, GL_RGB, GL_ALPHA, GL_LUMINANCE, GL_LUMINANCE_ALPHA };
+
+static int indexOf(const GLenum* values,int count,GLenum value) {
+    for(int i = 0; i < count; i++) {
+        if(values[i] == value) return i;
+    }
+    return -1;
+}
+
+#define ARRAY_COUNT(a)  (int)(sizeof(a) / sizeof(a[0]))
+
+GLEScmPipelineState::GLEScmPipelineState():caps(0),lights(0),clipPlanes(0),otherUnits(0),
+                                           fogMode(GL_EXP),alphaFunc(GL_ALWAYS),alphaRef(0),
+                                           shadeModel(GL_SMOOTH),lightTwoSide(false) {
+    for(int i = 0; i < kMaxUnits; i++) {
+        units[i].texture2D = false;
+        units[i].cubeMap = false;
+        units[i].texGen = false;
+        units[i].envMode = GL_MODULATE;
+        units[i].format = GL_RGBA;
+    }
+}
+
+GLEScmPipeline::GLEScmPipeline():m_current(0) {}
+
+bool GLEScmPipeline::isSupported(const GLDispatch& dispatch,const Version& glslVersion) {
+    if(!getenv("ANDROID_EMUGL_GLES1_SHADERS")) {
+        return false;
+    }
+    if(glslVersion < Version(1,20,0)) {
+        ERR("GLES1 shaders need GLSL 1.20, using the fixed-function pipeline\n");
+        return false;
+    }
+    // The shader functions are optional in the GLES 1.x dispatch.
+    return dispatch.glCreateShader && dispatch.glShaderSource &&
+           dispatch.glCompileShader && dispatch.glGetShaderiv &&
+           dispatch.glCreateProgram && dispatch.glAttachShader &&
+           dispatch.glLinkProgram && dispatch.glGetProgramiv &&
+           dispatch.glDeleteShader && dispatch.glUseProgram &&
+           dispatch.glGetUniformLocation && dispatch.glUniform1i &&
+           dispatch.glUniform1f;
+}
+
+bool GLEScmPipeline::getKey(const GLEScmPipelineState& state,GLenum mode,uint64_t* key) {
+    // Points need the point size and sprite state of the fixed-function
+    // pipeline, and the other features below aren't emulated.
+    if(mode == GL_POINTS || state.clipPlanes || state.otherUnits ||
+       (state.caps & GLEScmPipelineState::kCapMatrixPalette) ||
+       state.shadeModel != GL_SMOOTH) {
+        return false;
+    }
+
+    uint64_t k = 0;
+    if(state.caps & GLEScmPipelineState::kCapLighting) {
+        if(state.lightTwoSide) return false;
+        k |= kKeyLighting;
+        if(state.caps & GLEScmPipelineState::kCapColorMaterial) k |= kKeyColorMaterial;
+        // Rescaling is a cheaper normalization for uniform scales, so
+        // normalizing gives the same result.
+        if(state.caps & (GLEScmPipelineState::kCapNormalize |
+                         GLEScmPipelineState::kCapRescaleNormal)) {
+            k |= kKeyNormalize;
+        }
+        k |= (uint64_t)(state.lights & 0xff) << kKeyLightsShift;
+    }
+    if(state.caps & GLEScmPipelineState::kCapFog) {
+        int fogMode = indexOf(fogModes,ARRAY_COUNT(fogModes),state.fogMode);
+        if(fogMode < 0) return false;
+        k |= kKeyFog | ((uint64_t)fogMode << kKeyFogModeShift);
+    }
+    if((state.caps & GLEScmPipelineState::kCapAlphaTest) && state.alphaFunc != GL_ALWAYS) {
+        k |= kKeyAlphaTest | ((uint64_t)(state.alphaFunc - GL_NEVER) << kKeyAlphaFuncShift);
+    }
+    for(int i = 0; i < GLEScmPipelineState::kMaxUnits; i++) {
+        const GLEScmPipelineState::Unit& unit = state.units[i];
+        if(unit.cubeMap || unit.texGen) return false;
+        if(!unit.texture2D) continue;
+
+        int mode = indexOf(envModes,ARRAY_COUNT(envModes),unit.envMode);
+        int format = indexOf(formats,ARRAY_COUNT(formats),unit.format);
+        if(mode < 0) return false;      // GL_COMBINE
+        if(format < 0) format = 0;
+        uint64_t bits = kUnitEnabled | (mode << kUnitModeShift) | (format << kUnitFormatShift);
+        k |= bits << (kKeyUnitsShift + i * kKeyUnitBits);
+    }
+    *key = k;
+    return true;
+}
+
+static unsigned int unitBits(uint64_t key,int unit) {
+    return (key >> (kKeyUnitsShift + unit * kKeyUnitBits)) & ((1 << kKeyUnitBits) - 1);
+}
+
+static void appendf(std::string& s,const char* format,int value) {
+    char buf[512];
+    snprintf(buf,sizeof(buf),format,value,value,value,value,value,value);
+    s += buf;
+}
+
+std::string GLEScmPipeline::vertexShader(uint64_t key) {
+    std::string s = "#version 120\n"
+                    "varying vec4 v_color;\n";
+    for(int i = 0; i < GLEScmPipelineState::kMaxUnits; i++) {
+        if(unitBits(key,i) & kUnitEnabled) {
+            appendf(s,"varying vec4 v_texCoord%d;\n",i);
+        }
+    }
+    if(key & kKeyFog) {
+        s += "varying float v_fogFactor;\n";
+    }
+
+    if(key & kKeyLighting) {
+        // Light |i| for the infinite viewer of GLES 1.x, see section 2.12.1
+        // of the OpenGL ES 1.1 specification.
+        s += "vec4 light(int i, vec3 eye, vec3 n, vec4 ambient, vec4 diffuse) {\n"
+             "    vec3 l;\n"
+             "    float att = 1.0;\n"
+             "    if (gl_LightSource[i].position.w != 0.0) {\n"
+             "        vec3 d = gl_LightSource[i].position.xyz - eye;\n"
+             "        float dist = length(d);\n"
+             "        l = d / dist;\n"
+             "        att = 1.0 / (gl_LightSource[i].constantAttenuation +\n"
+             "                     gl_LightSource[i].linearAttenuation * dist +\n"
+             "                     gl_LightSource[i].quadraticAttenuation * dist * dist);\n"
+             "        if (gl_LightSource[i].spotCutoff != 180.0) {\n"
+             "            float spot = dot(-l, normalize(gl_LightSource[i].spotDirection));\n"
+             "            att *= spot >= gl_LightSource[i].spotCosCutoff ?\n"
+             "                   pow(max(spot, 0.0), gl_LightSource[i].spotExponent) : 0.0;\n"
+             "        }\n"
+             "    } else {\n"
+             "        l = normalize(gl_LightSource[i].position.xyz);\n"
+             "    }\n"
+             "    float nDotL = max(dot(n, l), 0.0);\n"
+             "    vec4 c = gl_LightSource[i].ambient * ambient +\n"
+             "             nDotL * gl_LightSource[i].diffuse * diffuse;\n"
+             "    if (nDotL > 0.0) {\n"
+             "        float nDotH = max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0);\n"
+             "        float shininess = gl_FrontMaterial.shininess;\n"
+             "        c += (shininess == 0.0 ? 1.0 : pow(nDotH, shininess)) *\n"
+             "             gl_LightSource[i].specular * gl_FrontMaterial.specular;\n"
+             "    }\n"
+             "    return att * c;\n"
+             "}\n";
+    }
+
+    s += "void main() {\n"
+         "    gl_Position = ftransform();\n";
+    if(key & (kKeyLighting | kKeyFog)) {
+        s += "    vec4 eyePos = gl_ModelViewMatrix * gl_Vertex;\n";
+    }
+    if(key & kKeyLighting) {
+        s += (key & kKeyNormalize) ?
+             "    vec3 n = normalize(gl_NormalMatrix * gl_Normal);\n" :
+             "    vec3 n = gl_NormalMatrix * gl_Normal;\n";
+        s += (key & kKeyColorMaterial) ?
+             "    vec4 ambient = gl_Color;\n"
+             "    vec4 diffuse = gl_Color;\n" :
+             "    vec4 ambient = gl_FrontMaterial.ambient;\n"
+             "    vec4 diffuse = gl_FrontMaterial.diffuse;\n";
+        s += "    vec3 eye = eyePos.xyz / eyePos.w;\n"
+             "    vec4 color = gl_FrontMaterial.emission + ambient * gl_LightModel.ambient;\n";
+        for(int i = 0; i < GLEScmPipelineState::kMaxLights; i++) {
+            if(key & (1ULL << (kKeyLightsShift + i))) {
+                appendf(s,"    color += light(%d, eye, n, ambient, diffuse);\n",i);
+            }
+        }
+        s += "    v_color = vec4(clamp(color.rgb, 0.0, 1.0), clamp(diffuse.a, 0.0, 1.0));\n";
+    } else {
+        s += "    v_color = gl_Color;\n";
+    }
+    for(int i = 0; i < GLEScmPipelineState::kMaxUnits; i++) {
+        if(unitBits(key,i) & kUnitEnabled) {
+            appendf(s,"    v_texCoord%d = gl_TextureMatrix[%d] * gl_MultiTexCoord%d;\n",i);
+        }
+    }
+    if(key & kKeyFog) {
+        s += "    float z = abs(eyePos.z);\n";
+        switch(fogModes[(key >> kKeyFogModeShift) & 3]) {
+        case GL_LINEAR:
+            s += "    v_fogFactor = clamp((gl_Fog.end - z) * gl_Fog.scale, 0.0, 1.0);\n";
+            break;
+        case GL_EXP:
+            s += "    v_fogFactor = clamp(exp(-gl_Fog.density * z), 0.0, 1.0);\n";
+            break;
+        default:
+            s += "    float fz = gl_Fog.density * z;\n"
+                 "    v_fogFactor = clamp(exp(-fz * fz), 0.0, 1.0);\n";
+            break;
+        }
+    }
+    s += "}\n";
+    return s;
+}
+
+// Append the texture environment of |unit|, see table 3.15 of the OpenGL
+// ES 1.1 specification. Only the formats with components take them from
+// the texture, e.g. GL_ALPHA textures keep the color.
+static void appendTexEnv(std::string& s,int unit,unsigned int bits) {
+    GLenum mode = envModes[(bits >> kUnitModeShift) & 7];
+    GLenum format = formats[(bits >> kUnitFormatShift) & 7];
+    bool hasColor = format != GL_ALPHA;
+    bool hasAlpha = format == GL_ALPHA || format == GL_LUMINANCE_ALPHA || format == GL_RGBA;
+    const char* rgb = "color.rgb";
+    const char* alpha = "color.a";
+
+    switch(mode) {
+    case GL_REPLACE:
+        if(hasColor) rgb = "t.rgb";
+        if(hasAlpha) alpha = "t.a";
+        break;
+    case GL_MODULATE:
+        if(hasColor) rgb = "color.rgb * t.rgb";
+        if(hasAlpha) alpha = "color.a * t.a";
+        break;
+    case GL_DECAL:
+        if(format == GL_RGB) rgb = "t.rgb";
+        else if(format == GL_RGBA) rgb = "mix(color.rgb, t.rgb, t.a)";
+        break;
+    case GL_BLEND:
+        if(hasColor) rgb = "mix(color.rgb, gl_TextureEnvColor[%d].rgb, t.rgb)";
+        if(hasAlpha) alpha = "color.a * t.a";
+        break;
+    case GL_ADD:
+        if(hasColor) rgb = "color.rgb + t.rgb";
+        if(hasAlpha) alpha = "color.a * t.a";
+        break;
+    }
+    appendf(s,"    t = texture2DProj(u_texture%d, v_texCoord%d);\n",unit);
+    s += "    color = clamp(vec4(";
+    appendf(s,rgb,unit);
+    s += ", ";
+    s += alpha;
+    s += "), 0.0, 1.0);\n";
+}
+
+std::string GLEScmPipeline::fragmentShader(uint64_t key) {
+    static const char* const alphaTests[] = {
+        "    discard;\n",                                   // GL_NEVER
+        "    if (!(color.a < u_alphaRef)) discard;\n",      // GL_LESS
+        "    if (!(color.a == u_alphaRef)) discard;\n",     // GL_EQUAL
+        "    if (!(color.a <= u_alphaRef)) discard;\n",     // GL_LEQUAL
+        "    if (!(color.a > u_alphaRef)) discard;\n",      // GL_GREATER
+        "    if (!(color.a != u_alphaRef)) discard;\n",     // GL_NOTEQUAL
+        "    if (!(color.a >= u_alphaRef)) discard;\n",     // GL_GEQUAL
+    };
+    bool textured = false;
+
+    std::string s = "#version 120\n"
+                    "varying vec4 v_color;\n";
+    for(int i = 0; i < GLEScmPipelineState::kMaxUnits; i++) {
+        if(unitBits(key,i) & kUnitEnabled) {
+            appendf(s,"varying vec4 v_texCoord%d;\n"
+                      "uniform sampler2D u_texture%d;\n",i);
+            textured = true;
+        }
+    }
+    if(key & kKeyFog) {
+        s += "varying float v_fogFactor;\n";
+    }
+    if(key & kKeyAlphaTest) {
+        s += "uniform float u_alphaRef;\n";
+    }
+
+    s += "void main() {\n"
+         "    vec4 color = v_color;\n";
+    if(textured) {
+        s += "    vec4 t;\n";
+    }
+    for(int i = 0; i < GLEScmPipelineState::kMaxUnits; i++) {
+        unsigned int bits = unitBits(key,i);
+        if(bits & kUnitEnabled) {
+            appendTexEnv(s,i,bits);
+        }
+    }
+    if(key & kKeyAlphaTest) {
+        s += alphaTests[(key >> kKeyAlphaFuncShift) & 7];
+    }
+    if(key & kKeyFog) {
+        s += "    color.rgb = mix(gl_Fog.color.rgb, color.rgb, v_fogFactor);\n";
+    }
+    s += "    gl_FragColor = color;\n"
+         "}\n";
+    return s;
+}
+
+static GLuint compileShader(GLDispatch& dispatch,GLenum type,const std::string& source) {
+    GLuint shader = dispatch.glCreateShader(type);
+    const GLchar* text = source.c_str();
+    GLint status = GL_FALSE;
+
+    dispatch.glShaderSource(shader,1,&text,NULL);
+    dispatch.glCompileShader(shader);
+    dispatch.glGetShaderiv(shader,GL_COMPILE_STATUS,&status);
+    if(status != GL_TRUE) {
+        char log[1024] = "";
+        if(dispatch.glGetShaderInfoLog) {
+            dispatch.glGetShaderInfoLog(shader,sizeof(log),NULL,log);
+        }
+        ERR("Could not compile GLES1 %s shader: %s\n",
+            type == GL_VERTEX_SHADER ? "vertex" : "fragment",log);
+        dispatch.glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLEScmPipeline::Program GLEScmPipeline::build(GLDispatch& dispatch,uint64_t key) {
+    Program program = { 0, -1, 0 };
+    GLuint vshader = compileShader(dispatch,GL_VERTEX_SHADER,vertexShader(key));
+    GLuint fshader = compileShader(dispatch,GL_FRAGMENT_SHADER,fragmentShader(key));
+
+    if(vshader && fshader) {
+        GLint status = GL_FALSE;
+        program.name = dispatch.glCreateProgram();
+        dispatch.glAttachShader(program.name,vshader);
+        dispatch.glAttachShader(program.name,fshader);
+        dispatch.glLinkProgram(program.name);
+        dispatch.glGetProgramiv(program.name,GL_LINK_STATUS,&status);
+        if(status != GL_TRUE) {
+            ERR("Could not link GLES1 program %llx\n",(unsigned long long)key);
+            dispatch.glDeleteProgram(program.name);
+            program.name = 0;
+        }
+    }
+    // The program keeps the shaders until it is deleted.
+    if(vshader) dispatch.glDeleteShader(vshader);
+    if(fshader) dispatch.glDeleteShader(fshader);
+    if(!program.name) {
+        return program;
+    }
+
+    dispatch.glUseProgram(program.name);
+    for(int i = 0; i < GLEScmPipelineState::kMaxUnits; i++) {
+        if(unitBits(key,i) & kUnitEnabled) {
+            char name[16];
+            snprintf(name,sizeof(name),"u_texture%d",i);
+            dispatch.glUniform1i(dispatch.glGetUniformLocation(program.name,name),i);
+        }
+    }
+    if(key & kKeyAlphaTest) {
+        program.alphaRefLocation = dispatch.glGetUniformLocation(program.name,"u_alphaRef");
+        dispatch.glUniform1f(program.alphaRefLocation,program.alphaRef);
+    }
+    return program;
+}
+
+bool GLEScmPipeline::use(GLDispatch& dispatch,uint64_t key,GLfloat alphaRef) {
+    ProgramMap::iterator it = m_programs.find(key);
+    if(it == m_programs.end()) {
+        it = m_programs.insert(std::make_pair(key,build(dispatch,key))).first;
+        // build() leaves the new program bound.
+        m_current = it->second.name;
+    }
+    Program& program = it->second;
+    if(!program.name) {
+        unbind(dispatch);
+        return false;
+    }
+    if(m_current != program.name) {
+        dispatch.glUseProgram(program.name);
+        m_current = program.name;
+    }
+    if(program.alphaRefLocation >= 0 && program.alphaRef != alphaRef) {
+        dispatch.glUniform1f(program.alphaRefLocation,alphaRef);
+        program.alphaRef = alphaRef;
+    }
+    return true;
+}
+
+void GLEScmPipeline::unbind(GLDispatch& dispatch) {
+    if(m_current) {
+        dispatch.glUseProgram(0);
+        m_current = 0;
+    }
+}
@@ -0,0 +1,127 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef GLES_CM_PIPELINE_H
+#define GLES_CM_PIPELINE_H
+
+#include <GLcommon/GLDispatch.h>
+#include <GLcommon/GLEScontext.h>
+
+#include <map>
+#include <string>
+#include <stdint.h>
+
+// Emulation of the GLES 1.x fixed-function pipeline with GLSL programs.
+//
+// Many desktop drivers implement the legacy fixed-function entry points
+// by generating shaders behind the scenes, and recompiling them when the
+// state changes, which causes stalls in the middle of a frame. Instead,
+// GLEScmContext can draw with programs generated here from the state that
+// selects the shading code: texture environments, lighting, fog and alpha
+// test. Programs are cached by the key of that state, so each combination
+// is only compiled once per context.
+//
+// The values of the state, e.g. the matrices, light parameters or fog
+// color, are still set through the legacy entry points, and the programs
+// read them from the built-in uniforms of GLSL 1.20, which the driver
+// keeps up to date. This also keeps them for the draws that still need
+// the fixed-function pipeline, see getKey().
+//
+// This is enabled by defining ANDROID_EMUGL_GLES1_SHADERS in the
+// environment, on hosts that support GLSL 1.20.
+
+// The fixed-function state tracked by GLEScmContext to select a program.
+struct GLEScmPipelineState {
+    enum {
+        kMaxUnits = 4,      // texture units handled by the programs
+        kMaxLights = 8,
+    };
+
+    enum {
+        kCapLighting      = 1 << 0,
+        kCapColorMaterial = 1 << 1,
+        kCapNormalize     = 1 << 2,
+        kCapRescaleNormal = 1 << 3,
+        kCapFog           = 1 << 4,
+        kCapAlphaTest     = 1 << 5,
+        kCapMatrixPalette = 1 << 6,
+    };
+
+    struct Unit {
+        bool   texture2D;
+        bool   cubeMap;
+        bool   texGen;
+        GLenum envMode;
+        GLenum format;      // base format of the bound texture, set per draw
+    };
+
+    GLEScmPipelineState();
+
+    unsigned int caps;          // kCapXXX
+    unsigned int lights;        // bit i for GL_LIGHTi
+    unsigned int clipPlanes;    // bit i for GL_CLIP_PLANEi
+    unsigned int otherUnits;    // bits 2i and 2i+1 for the 2D and cube map
+                                // textures of unit kMaxUnits + i, which the
+                                // programs don't handle
+    GLenum       fogMode;
+    GLenum       alphaFunc;
+    GLfloat      alphaRef;
+    GLenum       shadeModel;
+    bool         lightTwoSide;
+    Unit         units[kMaxUnits];
+};
+
+class GLEScmPipeline {
+public:
+    GLEScmPipeline();
+
+    // Return true if ANDROID_EMUGL_GLES1_SHADERS is defined and the host
+    // supports the GLSL version of the programs.
+    static bool isSupported(const GLDispatch& dispatch,const Version& glslVersion);
+
+    // Store into |*key| the key of the program which draws |mode|
+    // primitives with |state|. Return false if the state, e.g. point
+    // sprites, user clip planes or texture combiners, needs the
+    // fixed-function pipeline.
+    static bool getKey(const GLEScmPipelineState& state,GLenum mode,uint64_t* key);
+
+    // Return the GLSL source of the shaders of the program of |key|.
+    static std::string vertexShader(uint64_t key);
+    static std::string fragmentShader(uint64_t key);
+
+    // Bind the program of |key|, and set |alphaRef| if it does the alpha
+    // test. Return false if the program doesn't build, in which case the
+    // draw must use the fixed-function pipeline.
+    bool use(GLDispatch& dispatch,uint64_t key,GLfloat alphaRef);
+
+    // Unbind the program bound by use(), if any, before a draw with the
+    // fixed-function pipeline.
+    void unbind(GLDispatch& dispatch);
+
+private:
+    struct Program {
+        GLuint  name;       // 0 if the program couldn't be built
+        GLint   alphaRefLocation;
+        GLfloat alphaRef;
+    };
+    typedef std::map<uint64_t,Program> ProgramMap;
+
+    Program build(GLDispatch& dispatch,uint64_t key);
+
+    ProgramMap m_programs;
+    GLuint     m_current;
+};
+
+#endif
@@ -36,7 +36,7 @@ void GLESv2Context::init(GlLibrary* glLib) {
     m_initialized = true;
 }
 
-GLESv2Context::GLESv2Context():GLEScontext(), m_att0Array(NULL), m_att0ArrayLength(0), m_att0NeedsDisable(false){};
+GLESv2Context::GLESv2Context():GLEScontext(), m_att0Array(NULL), m_att0ArrayLength(0), m_att0NeedsDisable(false), m_currentProgram(0){};
 
 GLESv2Context::~GLESv2Context()
 {
@@ -38,6 +38,9 @@ public:
     void validateAtt0PostDraw(void);
     const float* getAtt0(void) {return m_attribute0value;}
 
+    void setCurrentProgram(GLuint program) { m_currentProgram = program; }
+    GLuint getCurrentProgram() const { return m_currentProgram; }
+
 protected:
     bool needConvert(GLESConversionArrays& fArrs,GLint first,GLsizei count,GLenum type,const GLvoid* indices,bool direct,GLESpointer* p,GLenum array_id);
 private:
@@ -48,6 +51,7 @@ private:
     GLfloat* m_att0Array;
     unsigned int m_att0ArrayLength;
     bool m_att0NeedsDisable;
+    GLuint m_currentProgram;
 };
 
 #endif
@@ -33,6 +33,7 @@
 #include "ProgramData.h"
 #include <GLcommon/TextureUtils.h>
 #include <GLcommon/FramebufferData.h>
+#include <GLcommon/ProgramBinaryCache.h>
 
 extern "C" {
 
@@ -124,6 +125,14 @@ GLESiface* __translator_getIfaces(EGLiface* eglIface) {
     return & s_glesIface;
 }
 
+// Return the number of GL calls skipped by the redundant state filter of
+// all contexts since the previous call.
+GL_APICALL unsigned int GL_APIENTRY __translator_takeElidedCallCount(void);
+
+unsigned int __translator_takeElidedCallCount(void) {
+    return GLEScontext::takeElidedCallCount();
+}
+
 }  // extern "C"
 
 static void s_attachShader(GLEScontext* ctx, GLuint program, GLuint shader) {
@@ -211,6 +220,7 @@ GL_APICALL void  GL_APIENTRY glBindAttribLocation(GLuint program, GLuint index,
         ObjectDataPtr objData = ctx->shareGroup()->getObjectData(SHADER,program);
         SET_ERROR_IF(objData.Ptr()->getDataType()!=PROGRAM_DATA,GL_INVALID_OPERATION);
 
+        ((ProgramData*)objData.Ptr())->bindAttribLocation(name,index);
         ctx->dispatcher().glBindAttribLocation(globalProgramName,index,name);
     }
 }
@@ -298,6 +308,7 @@ GL_APICALL void  GL_APIENTRY glBindTexture(GLenum target, GLuint texture){
     }
 
     ctx->setBindedTexture(target,texture);
+    if (ctx->filterBindTexture(target,globalTextureName)) return;
     ctx->dispatcher().glBindTexture(target,globalTextureName);
 }
 
@@ -309,18 +320,21 @@ GL_APICALL void  GL_APIENTRY glBlendColor(GLclampf red, GLclampf green, GLclampf
 GL_APICALL void  GL_APIENTRY glBlendEquation( GLenum mode ){
     GET_CTX();
     SET_ERROR_IF(!GLESv2Validate::blendEquationMode(mode),GL_INVALID_ENUM)
+    if (ctx->filterBlendEquation(mode,mode)) return;
     ctx->dispatcher().glBlendEquation(mode);
 }
 
 GL_APICALL void  GL_APIENTRY glBlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha){
     GET_CTX();
     SET_ERROR_IF(!(GLESv2Validate::blendEquationMode(modeRGB) && GLESv2Validate::blendEquationMode(modeAlpha)),GL_INVALID_ENUM);
+    if (ctx->filterBlendEquation(modeRGB,modeAlpha)) return;
     ctx->dispatcher().glBlendEquationSeparate(modeRGB,modeAlpha);
 }
 
 GL_APICALL void  GL_APIENTRY glBlendFunc(GLenum sfactor, GLenum dfactor){
     GET_CTX();
     SET_ERROR_IF(!GLESv2Validate::blendSrc(sfactor) || !GLESv2Validate::blendDst(dfactor),GL_INVALID_ENUM)
+    if (ctx->filterBlendFunc(sfactor,dfactor,sfactor,dfactor)) return;
     ctx->dispatcher().glBlendFunc(sfactor,dfactor);
 }
 
@@ -328,6 +342,7 @@ GL_APICALL void  GL_APIENTRY glBlendFuncSeparate(GLenum srcRGB, GLenum dstRGB, G
     GET_CTX();
     SET_ERROR_IF(
 !(GLESv2Validate::blendSrc(srcRGB) && GLESv2Validate::blendDst(dstRGB) && GLESv2Validate::blendSrc(srcAlpha) && GLESv2Validate::blendDst(dstAlpha)),GL_INVALID_ENUM);
+    if (ctx->filterBlendFunc(srcRGB,dstRGB,srcAlpha,dstAlpha)) return;
     ctx->dispatcher().glBlendFuncSeparate(srcRGB,dstRGB,srcAlpha,dstAlpha);
 }
 
@@ -389,6 +404,7 @@ GL_APICALL void  GL_APIENTRY glCompileShader(GLuint shader){
         SET_ERROR_IF(objData.Ptr()->getDataType()!= SHADER_DATA,GL_INVALID_OPERATION);
         ShaderParser* sp = (ShaderParser*)objData.Ptr();
         ctx->dispatcher().glCompileShader(globalShaderName);
+        sp->setCompiledSrc();
 
         GLsizei infoLogLength=0;
         GLchar* infoLog;
@@ -486,6 +502,9 @@ GL_APICALL void  GL_APIENTRY glDeleteFramebuffers(GLsizei n, const GLuint* frame
            const GLuint globalFrameBufferName = ctx->shareGroup()->getGlobalName(FRAMEBUFFER,framebuffers[i]);
            ctx->shareGroup()->deleteName(FRAMEBUFFER,framebuffers[i]);
            ctx->dispatcher().glDeleteFramebuffersEXT(1,&globalFrameBufferName);
+           if (framebuffers[i] == ctx->getFramebufferBinding()) {
+               ctx->setFramebufferBinding(0);
+           }
         }
     }
 }
@@ -520,6 +539,9 @@ GL_APICALL void  GL_APIENTRY glDeleteRenderbuffers(GLsizei n, const GLuint* rend
            ctx->shareGroup()->deleteName(RENDERBUFFER,renderbuffers[i]);
            ctx->dispatcher().glDeleteRenderbuffersEXT(1,&globalRenderBufferName);
            s_detachFromFramebuffer(RENDERBUFFER, renderbuffers[i]);
+           if (renderbuffers[i] == ctx->getRenderbufferBinding()) {
+               ctx->setRenderbufferBinding(0);
+           }
         }
     }
 }
@@ -546,6 +568,7 @@ GL_APICALL void  GL_APIENTRY glDeleteTextures(GLsizei n, const GLuint* textures)
                 s_detachFromFramebuffer(TEXTURE, textures[i]);
             }
         }
+        GLEScontext::onTexturesDeleted();
     }
 }
 
@@ -590,10 +613,12 @@ GL_APICALL void  GL_APIENTRY glDeleteShader(GLuint shader){
 
 GL_APICALL void  GL_APIENTRY glDepthFunc(GLenum func){
     GET_CTX();
+    if (ctx->filterDepthFunc(func)) return;
     ctx->dispatcher().glDepthFunc(func);
 }
 GL_APICALL void  GL_APIENTRY glDepthMask(GLboolean flag){
     GET_CTX();
+    if (ctx->filterDepthMask(flag)) return;
     ctx->dispatcher().glDepthMask(flag);
 }
 GL_APICALL void  GL_APIENTRY glDepthRangef(GLclampf zNear, GLclampf zFar){
@@ -625,6 +650,7 @@ GL_APICALL void  GL_APIENTRY glDetachShader(GLuint program, GLuint shader){
 
 GL_APICALL void  GL_APIENTRY glDisable(GLenum cap){
     GET_CTX();
+    if (ctx->filterEnable(cap,false)) return;
     ctx->dispatcher().glDisable(cap);
 }
 
@@ -680,7 +706,8 @@ GL_APICALL void  GL_APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum t
     GLESConversionArrays tmpArrs;
     ctx->setupArraysPointers(tmpArrs,0,count,type,indices,false);
 
-    int maxIndex = ctx->findMaxIndex(count, type, indices);
+    int minIndex, maxIndex;
+    ctx->getIndexRange(count, type, indices, &minIndex, &maxIndex);
     ctx->validateAtt0PreDraw(maxIndex);
     
     //See glDrawArrays
@@ -701,6 +728,7 @@ GL_APICALL void  GL_APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum t
 
 GL_APICALL void  GL_APIENTRY glEnable(GLenum cap){
     GET_CTX();
+    if (ctx->filterEnable(cap,true)) return;
     ctx->dispatcher().glEnable(cap);
 }
 
@@ -1051,26 +1079,19 @@ GL_APICALL void  GL_APIENTRY glGetIntegerv(GLenum pname, GLint* params){
     }
   
     bool es2 = ctx->getCaps()->GL_ARB_ES2_COMPATIBILITY;
-    GLint i;
 
     switch (pname) {
+    // The bindings are tracked by the translator, answer from that state
+    // instead of querying the driver and mapping the name back, which
+    // forces a sync with threaded host drivers.
     case GL_CURRENT_PROGRAM:
-        if (ctx->shareGroup().Ptr()) {
-            ctx->dispatcher().glGetIntegerv(pname,&i);
-            *params = ctx->shareGroup()->getLocalName(SHADER,i);
-        }
+        *params = static_cast<GLESv2Context*>(ctx)->getCurrentProgram();
         break;
     case GL_FRAMEBUFFER_BINDING:
-        if (ctx->shareGroup().Ptr()) {
-            ctx->dispatcher().glGetIntegerv(pname,&i);
-            *params = ctx->shareGroup()->getLocalName(FRAMEBUFFER,i);
-        }
+        *params = ctx->getFramebufferBinding();
         break;
     case GL_RENDERBUFFER_BINDING:
-        if (ctx->shareGroup().Ptr()) {
-            ctx->dispatcher().glGetIntegerv(pname,&i);
-            *params = ctx->shareGroup()->getLocalName(RENDERBUFFER,i);
-        }
+        *params = ctx->getRenderbufferBinding();
         break;
 
     case GL_NUM_COMPRESSED_TEXTURE_FORMATS:
@@ -1094,34 +1115,42 @@ GL_APICALL void  GL_APIENTRY glGetIntegerv(GLenum pname, GLint* params){
 
     case GL_NUM_SHADER_BINARY_FORMATS:
         if(es2)
-            ctx->dispatcher().glGetIntegerv(pname,params);
+            GLEScontext::getHostLimit(pname,params);
         else
             *params = 0;
         break;
 
     case GL_MAX_VERTEX_UNIFORM_VECTORS:
         if(es2)
-            ctx->dispatcher().glGetIntegerv(pname,params);
+            GLEScontext::getHostLimit(pname,params);
         else
             *params = 128;
         break;
 
     case GL_MAX_VARYING_VECTORS:
         if(es2)
-            ctx->dispatcher().glGetIntegerv(pname,params);
+            GLEScontext::getHostLimit(pname,params);
         else
             *params = 8;
         break;
 
     case GL_MAX_FRAGMENT_UNIFORM_VECTORS:
         if(es2)
-            ctx->dispatcher().glGetIntegerv(pname,params);
+            GLEScontext::getHostLimit(pname,params);
         else
             *params = 16;
         break;
 
+    case GL_MAX_VERTEX_ATTRIBS:
+    case GL_MAX_TEXTURE_IMAGE_UNITS:
+    case GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS:
+    case GL_MAX_CUBE_MAP_TEXTURE_SIZE:
+    case GL_MAX_RENDERBUFFER_SIZE:
+        GLEScontext::getHostLimit(pname,params);
+        break;
+
     case GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS:
-        ctx->dispatcher().glGetIntegerv(pname,params);
+        GLEScontext::getHostLimit(pname,params);
         if(*params > 16)
         {
             // GLES spec requires only 2, and the ATI driver erronously
@@ -1691,6 +1720,95 @@ GL_APICALL void  GL_APIENTRY glLineWidth(GLfloat width){
     ctx->dispatcher().glLineWidth(width);
 }
 
+// Return the program binary cache if it can be used with the host driver.
+static ProgramBinaryCache* s_getProgramBinaryCache(GLEScontext* ctx) {
+    if (!GLEScontext::isProgramBinarySupported() ||
+        !ctx->dispatcher().glGetProgramBinary ||
+        !ctx->dispatcher().glProgramBinary ||
+        !ctx->dispatcher().glProgramParameteri) {
+        return NULL;
+    }
+    GLint numFormats = 0;
+    GLEScontext::getHostLimit(GL_NUM_PROGRAM_BINARY_FORMATS,&numFormats);
+    ProgramBinaryCache* cache = ProgramBinaryCache::get();
+    return (numFormats > 0 && cache->isEnabled()) ? cache : NULL;
+}
+
+// Build the key of a program in the binary cache: everything the host
+// driver links, and the driver itself.
+static std::string s_programBinaryKey(GLEScontext* ctx,
+                                      ProgramData* programData,
+                                      ShaderParser* vertexShader,
+                                      ShaderParser* fragmentShader) {
+    std::string key;
+    key.append(ctx->getRendererString()).push_back('\0');
+    key.append(ctx->getVendorString()).push_back('\0');
+    key.append(ctx->getVersionString()).push_back('\0');
+    key.append(vertexShader->getCompiledSrc()).push_back('\0');
+    key.append(fragmentShader->getCompiledSrc()).push_back('\0');
+    const ProgramData::AttribBindings& bindings =
+            programData->getAttribBindings();
+    for (ProgramData::AttribBindings::const_iterator it = bindings.begin();
+         it != bindings.end(); ++it) {
+        char index[16];
+        snprintf(index, sizeof(index), "=%u", it->second);
+        key.append(it->first).append(index).push_back('\0');
+    }
+    return key;
+}
+
+// Link |globalProgramName| on the host, loading it from the binary cache
+// when possible, and storing it there otherwise. Return the link status.
+static GLint s_linkProgram(GLEScontext* ctx, ProgramData* programData,
+                           GLuint globalProgramName,
+                           ShaderParser* vertexShader,
+                           ShaderParser* fragmentShader) {
+    GLint linkStatus = GL_FALSE;
+    ProgramBinaryCache* cache = s_getProgramBinaryCache(ctx);
+    if (!cache) {
+        ctx->dispatcher().glLinkProgram(globalProgramName);
+        ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
+        return linkStatus;
+    }
+
+    const std::string key = s_programBinaryKey(ctx, programData,
+                                               vertexShader, fragmentShader);
+    GLenum format = 0;
+    std::vector<char> binary;
+    if (cache->load(key, &format, &binary)) {
+        ctx->dispatcher().glProgramBinary(globalProgramName, format,
+                                          &binary[0], binary.size());
+        ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
+        if (linkStatus) {
+            return linkStatus;
+        }
+        // The driver may reject binaries after an update that kept its
+        // version string, link the program normally instead.
+        cache->remove(key);
+    }
+
+    ctx->dispatcher().glProgramParameteri(globalProgramName,
+                                          GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                          GL_TRUE);
+    ctx->dispatcher().glLinkProgram(globalProgramName);
+    ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
+    if (linkStatus) {
+        GLint length = 0;
+        ctx->dispatcher().glGetProgramiv(globalProgramName,GL_PROGRAM_BINARY_LENGTH,&length);
+        if (length > 0) {
+            binary.resize(length);
+            GLsizei written = 0;
+            ctx->dispatcher().glGetProgramBinary(globalProgramName, length,
+                                                 &written, &format,
+                                                 &binary[0]);
+            if (written > 0) {
+                cache->store(key, format, &binary[0], written);
+            }
+        }
+    }
+    return linkStatus;
+}
+
 GL_APICALL void  GL_APIENTRY glLinkProgram(GLuint program){
     GET_CTX();
     GLint linkStatus = GL_FALSE;
@@ -1714,8 +1832,9 @@ GL_APICALL void  GL_APIENTRY glLinkProgram(GLuint program){
             ctx->dispatcher().glGetShaderiv(vertexShaderGlobal,GL_COMPILE_STATUS,&vCompileStatus);
 
             if(fCompileStatus != 0 && vCompileStatus != 0){
-                ctx->dispatcher().glLinkProgram(globalProgramName);
-                ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
+                ShaderParser* vsp = (ShaderParser*)ctx->shareGroup()->getObjectData(SHADER,vertexShader).Ptr();
+                ShaderParser* fsp = (ShaderParser*)ctx->shareGroup()->getObjectData(SHADER,fragmentShader).Ptr();
+                linkStatus = s_linkProgram(ctx, programData, globalProgramName, vsp, fsp);
             }
         }
         programData->setLinkStatus(linkStatus);
@@ -1915,6 +2034,7 @@ GL_APICALL void  GL_APIENTRY glTexImage2D(GLenum target, GLint level, GLint inte
                                                      tex,
                                                      texData->oldGlobal);
                 ctx->dispatcher().glBindTexture(GL_TEXTURE_2D, texData->oldGlobal);
+                ctx->invalidateTextureBinding(GL_TEXTURE_2D);
                 texData->sourceEGLImage = 0;
                 texData->oldGlobal = 0;
             }
@@ -2054,9 +2174,8 @@ GL_APICALL void  GL_APIENTRY glUniformMatrix4fv(GLint location, GLsizei count, G
 }
 
 static void s_unUseCurrentProgram() {
-    GET_CTX();
-    GLint localCurrentProgram = 0;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &localCurrentProgram);
+    GET_CTX_V2();
+    GLuint localCurrentProgram = ctx->getCurrentProgram();
     if (!localCurrentProgram) return;
 
     ObjectDataPtr objData = ctx->shareGroup()->getObjectData(SHADER,localCurrentProgram);
@@ -2067,19 +2186,25 @@ static void s_unUseCurrentProgram() {
 }
 
 GL_APICALL void  GL_APIENTRY glUseProgram(GLuint program){
-    GET_CTX();
+    GET_CTX_V2();
     if(ctx->shareGroup().Ptr()) {
         const GLuint globalProgramName = ctx->shareGroup()->getGlobalName(SHADER,program);
         SET_ERROR_IF(program!=0 && globalProgramName==0,GL_INVALID_VALUE);
         ObjectDataPtr objData = ctx->shareGroup()->getObjectData(SHADER,program);
         SET_ERROR_IF(objData.Ptr() && (objData.Ptr()->getDataType()!=PROGRAM_DATA),GL_INVALID_OPERATION);
 
+        if (program == ctx->getCurrentProgram()) {
+            GLEScontext::countElidedCall();
+            return;
+        }
+
         s_unUseCurrentProgram();
 
         ProgramData* programData = (ProgramData*)objData.Ptr();
         if (programData) programData->setInUse(true);
 
         ctx->dispatcher().glUseProgram(globalProgramName);
+        ctx->setCurrentProgram(program);
     }
 }
 
@@ -2193,6 +2318,7 @@ GL_APICALL void GL_APIENTRY glEGLImageTargetTexture2DOES(GLenum target, GLeglIma
             // replace mapping and bind the new global object
             ctx->shareGroup()->replaceGlobalName(TEXTURE, tex,img->globalTexName);
             ctx->dispatcher().glBindTexture(GL_TEXTURE_2D, img->globalTexName);
+            ctx->invalidateTextureBinding(GL_TEXTURE_2D);
             TextureData *texData = getTextureTargetData(target);
             SET_ERROR_IF(texData==NULL,GL_INVALID_OPERATION);
             texData->width = img->width;
@@ -89,6 +89,10 @@ bool ProgramData::detachShader(GLuint shader) {
     return false;
 }
 
+void ProgramData::bindAttribLocation(const std::string& name, GLuint index) {
+    AttribLocations[name] = index;
+}
+
 void ProgramData::setLinkStatus(GLint status) {
     LinkStatus = status;
 }
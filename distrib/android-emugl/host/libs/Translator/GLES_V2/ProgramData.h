@@ -16,6 +16,9 @@
 #ifndef PROGRAM_DATA_H
 #define PROGRAM_DATA_H
 
+#include <map>
+#include <string>
+
 class ProgramData:public ObjectData{
 public:
     ProgramData();
@@ -32,6 +35,12 @@ public:
     void setLinkStatus(GLint status);
     GLint getLinkStatus();
 
+    // Attribute locations bound with glBindAttribLocation(), which are
+    // applied by the next link.
+    typedef std::map<std::string, GLuint> AttribBindings;
+    void bindAttribLocation(const std::string& name, GLuint index);
+    const AttribBindings& getAttribBindings() const { return AttribLocations; }
+
     void setInfoLog(GLchar *log);
     GLchar* getInfoLog();
 
@@ -44,6 +53,7 @@ private:
     GLuint AttachedVertexShader;
     GLuint AttachedFragmentShader;
     GLint  LinkStatus;
+    AttribBindings AttribLocations;
     GLchar* infoLog;
     bool    IsInUse;
     bool    DeleteStatus;
@@ -30,6 +30,11 @@ public:
     const char*    getOriginalSrc();
     const GLchar** parsedLines();
     GLenum         getType();
+
+    // Keep the parsed source sent to the host driver by the last
+    // glCompileShader(), which is the one used by the next link.
+    void               setCompiledSrc() { m_compiledSrc = m_parsedSrc; }
+    const std::string& getCompiledSrc() const { return m_compiledSrc; }
     ~ShaderParser();
 
     void setInfoLog(GLchar * infoLog);
@@ -53,6 +58,7 @@ private:
     char*       m_originalSrc;
     std::string m_src;
     std::string m_parsedSrc;
+    std::string m_compiledSrc;
     GLchar*     m_parsedLines;
     GLchar*     m_infoLog;
     bool        m_deleteStatus;
@@ -10,9 +10,12 @@ host_common_SRC_FILES :=     \
      RangeManip.cpp          \
      TextureUtils.cpp        \
      PaletteTexture.cpp      \
+     ProgramBinaryCache.cpp  \
      etc1.cpp                \
+     Etc1Decoder.cpp         \
      objectNameManager.cpp   \
-     FramebufferData.cpp
+     FramebufferData.cpp     \
+     VertexConversion.cpp
 
 host_GL_COMMON_LINKER_FLAGS :=
 host_common_LDLIBS :=
@@ -54,3 +57,23 @@ $(call emugl-export,C_INCLUDES,$(LOCAL_PATH)/../include $(EMUGL_PATH)/shared)
 $(call emugl-export,STATIC_LIBRARIES, lib64emugl_common)
 
 $(call emugl-end-module)
+
+
+### GLcommon unit tests ############################################
+
+host_common_unittests_SRC_FILES := \
+     etc1_unittest.cpp \
+     GLEScontext_unittest.cpp \
+     objectNameManager_unittest.cpp \
+     ProgramBinaryCache_unittest.cpp \
+     VertexConversion_unittest.cpp
+
+$(call emugl-begin-host-executable,emugl_GLcommon_host_unittests)
+LOCAL_SRC_FILES := $(host_common_unittests_SRC_FILES)
+$(call emugl-import,libGLcommon libemugl_gtest)
+$(call emugl-end-module)
+
+$(call emugl-begin-host64-executable,emugl64_GLcommon_host_unittests)
+LOCAL_SRC_FILES := $(host_common_unittests_SRC_FILES)
+$(call emugl-import,lib64GLcommon lib64emugl_gtest)
+$(call emugl-end-module)
@@ -0,0 +1,189 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include <GLcommon/Etc1Decoder.h>
+
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/thread.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Smaller images are decoded by the calling thread only, starting threads
+// would take longer than decoding them.
+const etc1_uint32 kMinParallelPixels = 256 * 256;
+const int kMaxDecodeThreads = 4;
+
+// Smaller images are not cached, decoding them again is cheap.
+const etc1_uint32 kMinCachedPixels = 64 * 64;
+const size_t kGlobalCacheBytes = 32 * 1024 * 1024;
+
+int getCpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+class Etc1DecodeThread : public emugl::Thread {
+public:
+    Etc1DecodeThread(const etc1_byte* pIn, etc1_byte* pOut,
+                     etc1_uint32 width, etc1_uint32 height,
+                     etc1_uint32 stride) :
+            Thread(), m_in(pIn), m_out(pOut), m_width(width),
+            m_height(height), m_stride(stride) {}
+
+    virtual intptr_t main() {
+        return etc1_decode_image(m_in, m_out, m_width, m_height, 3, m_stride);
+    }
+
+private:
+    const etc1_byte* m_in;
+    etc1_byte* m_out;
+    etc1_uint32 m_width;
+    etc1_uint32 m_height;
+    etc1_uint32 m_stride;
+};
+
+// FNV-1a, over the bytes of |data|.
+unsigned int hashData(const etc1_byte* data, size_t size) {
+    unsigned int hash = 2166136261U;
+    for (size_t n = 0; n < size; ++n) {
+        hash = (hash ^ data[n]) * 16777619U;
+    }
+    return hash;
+}
+
+struct GlobalCache {
+    GlobalCache() : cache(kGlobalCacheBytes) {}
+    Etc1DecodeCache cache;
+};
+
+emugl::LazyInstance<GlobalCache> sGlobalCache = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+void decodeEtc1Image(const etc1_byte* pIn, etc1_byte* pOut,
+                     etc1_uint32 width, etc1_uint32 height,
+                     etc1_uint32 stride) {
+    const etc1_uint32 blockRows = (height + 3) / 4;
+    int numThreads = 1;
+    if (width * height >= kMinParallelPixels) {
+        static const int cpuCount = getCpuCount();
+        numThreads = cpuCount < kMaxDecodeThreads ? cpuCount
+                                                  : kMaxDecodeThreads;
+        if ((etc1_uint32)numThreads > blockRows) {
+            numThreads = blockRows;
+        }
+    }
+    if (numThreads <= 1) {
+        etc1_decode_image(pIn, pOut, width, height, 3, stride);
+        return;
+    }
+
+    // Each band is a number of complete block rows, except the last one.
+    const etc1_uint32 bandRows = 4 * ((blockRows + numThreads - 1) / numThreads);
+    const size_t bandEncodedSize = etc1_get_encoded_data_size(width, bandRows);
+    std::vector<Etc1DecodeThread*> threads;
+    for (etc1_uint32 y = bandRows; y < height; y += bandRows) {
+        const etc1_uint32 rows = (height - y < bandRows) ? height - y
+                                                         : bandRows;
+        Etc1DecodeThread* thread = new Etc1DecodeThread(
+                pIn + (y / bandRows) * bandEncodedSize,
+                pOut + (size_t)y * stride, width, rows, stride);
+        if (thread->start()) {
+            threads.push_back(thread);
+        } else {
+            delete thread;
+            etc1_decode_image(pIn + (y / bandRows) * bandEncodedSize,
+                              pOut + (size_t)y * stride, width, rows, 3,
+                              stride);
+        }
+    }
+    etc1_decode_image(pIn, pOut, width, bandRows, 3, stride);
+    for (size_t n = 0; n < threads.size(); ++n) {
+        threads[n]->wait(NULL);
+        delete threads[n];
+    }
+}
+
+Etc1DecodeCache::Etc1DecodeCache(size_t maxBytes) :
+        m_maxBytes(maxBytes), m_bytes(0), m_hits(0) {}
+
+// static
+Etc1DecodeCache* Etc1DecodeCache::get() {
+    return &sGlobalCache->cache;
+}
+
+Etc1DecodeCache::ImagePtr Etc1DecodeCache::decode(const etc1_byte* data,
+                                                  size_t size,
+                                                  etc1_uint32 width,
+                                                  etc1_uint32 height,
+                                                  etc1_uint32 stride) {
+    const size_t decodedSize = (size_t)stride * height;
+    const bool cacheable = width * height >= kMinCachedPixels &&
+                           decodedSize + size <= m_maxBytes;
+    const unsigned int hash = cacheable ? hashData(data, size) : 0;
+    if (cacheable) {
+        emugl::Mutex::AutoLock lock(m_lock);
+        for (EntryList::iterator it = m_entries.begin();
+             it != m_entries.end(); ++it) {
+            if (it->hash == hash && it->width == width &&
+                it->height == height && it->stride == stride &&
+                it->compressed.size() == size &&
+                !memcmp(&it->compressed[0], data, size)) {
+                m_entries.splice(m_entries.begin(), m_entries, it);
+                m_hits++;
+                return m_entries.front().decoded;
+            }
+        }
+    }
+
+    ImagePtr decoded(new std::vector<etc1_byte>(decodedSize));
+    if (decodedSize) {
+        decodeEtc1Image(data, &(*decoded.Ptr())[0], width, height, stride);
+    }
+    if (!cacheable) {
+        return decoded;
+    }
+
+    emugl::Mutex::AutoLock lock(m_lock);
+    m_entries.push_front(Entry());
+    Entry& entry = m_entries.front();
+    entry.hash = hash;
+    entry.width = width;
+    entry.height = height;
+    entry.stride = stride;
+    entry.compressed.assign(data, data + size);
+    entry.decoded = decoded;
+    m_bytes += decodedSize + size;
+    while (m_bytes > m_maxBytes) {
+        const Entry& last = m_entries.back();
+        m_bytes -= last.decoded.Ptr()->size() + last.compressed.size();
+        m_entries.pop_back();
+    }
+    return decoded;
+}
@@ -105,6 +105,8 @@ void GLDispatch::dispatchFuncs(GLESVersion version, GlLibrary* glLib) {
     if(version == GLES_1_1){
         LIST_GLES1_ONLY_FUNCTIONS(LOAD_GL_FUNC)
         LIST_GLES1_EXTENSIONS_FUNCTIONS(LOAD_GLEXT_FUNC)
+        /* Optional, for the shader emulation of the fixed-function pipeline */
+        LIST_GLES2_ONLY_FUNCTIONS(LOAD_GLEXT_FUNC)
     } else if (version == GLES_2_0){
         LIST_GLES2_ONLY_FUNCTIONS(LOAD_GL_FUNC)
         LIST_GLES2_EXTENSIONS_FUNCTIONS(LOAD_GLEXT_FUNC)
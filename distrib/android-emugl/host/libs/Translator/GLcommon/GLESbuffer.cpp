@@ -14,6 +14,7 @@
 * limitations under the License.
 */
 #include <GLcommon/GLESbuffer.h>
+#include <GLcommon/VertexConversion.h>
 #include <string.h>
 
 bool  GLESbuffer::setBuffer(GLuint size,GLuint usage,const GLvoid* data) {
@@ -30,6 +31,8 @@ bool  GLESbuffer::setBuffer(GLuint size,GLuint usage,const GLvoid* data) {
         }
         m_conversionManager.clear();
         m_conversionManager.addRange(Range(0,m_size));
+        clearByteConversions();
+        m_indexRanges.clear();
         return true;
     }
     return false;
@@ -40,6 +43,8 @@ bool  GLESbuffer::setSubBuffer(GLint offset,GLuint size,const GLvoid* data) {
     memcpy(m_data+offset,data,size);
     m_conversionManager.addRange(Range(offset,size));
     m_conversionManager.merge();
+    clearByteConversions();
+    clearIndexRanges(offset,size);
     return true;
 }
 
@@ -48,7 +53,102 @@ void  GLESbuffer::getConversions(const RangeList& rIn,RangeList& rOut) {
         rOut.merge();
 }
 
+GLshort* GLESbuffer::getByteConversion(unsigned int offset,GLsizei stride,GLint size,
+                                       unsigned int count) {
+    if(!count) count = 1;
+
+    std::vector<ByteConversion>::iterator it = m_byteConversions.begin();
+    for(; it != m_byteConversions.end(); it++) {
+        if((*it).offset == offset && (*it).stride == stride && (*it).size == size) {
+            break;
+        }
+    }
+    if(it != m_byteConversions.end()) {
+        if((*it).count >= count) {
+            return (*it).data;
+        }
+        delete [] (*it).data;
+        m_byteConversions.erase(it);
+    } else if(m_byteConversions.size() >= kMaxByteConversions) {
+        delete [] m_byteConversions.front().data;
+        m_byteConversions.erase(m_byteConversions.begin());
+    }
+
+    ByteConversion conv;
+    conv.offset = offset;
+    conv.stride = stride;
+    conv.size   = size;
+    conv.count  = count;
+    conv.data   = new GLshort[count * size];
+
+    // Don't read past the end of the buffer.
+    unsigned int step = stride ? stride : size;
+    unsigned int available = 0;
+    if(m_data && offset + size <= m_size) {
+        available = (m_size - offset - size) / step + 1;
+    }
+    if(available > count) available = count;
+    convertByteToShort(m_data + offset,step,conv.data,size * sizeof(GLshort),available,size);
+    memset(conv.data + available * size,0,(count - available) * size * sizeof(GLshort));
+    m_byteConversions.push_back(conv);
+    return conv.data;
+}
+
+static unsigned int indexSize(GLenum type) {
+    return type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+bool GLESbuffer::getIndexRange(GLenum type,unsigned int offset,GLsizei count,
+                               int* minIndex,int* maxIndex) {
+    if(!m_data || count < 0 || offset > m_size ||
+       (m_size - offset) / indexSize(type) < (unsigned int)count) {
+        return false;
+    }
+
+    for(unsigned int i = 0; i < m_indexRanges.size(); i++) {
+        const IndexRange& range = m_indexRanges[i];
+        if(range.type == type && range.offset == offset && range.count == count) {
+            *minIndex = range.minIndex;
+            *maxIndex = range.maxIndex;
+            return true;
+        }
+    }
+    if(m_indexRanges.size() >= kMaxIndexRanges) {
+        m_indexRanges.erase(m_indexRanges.begin());
+    }
+
+    IndexRange range;
+    range.type   = type;
+    range.offset = offset;
+    range.count  = count;
+    computeIndexRange(m_data + offset,type,count,&range.minIndex,&range.maxIndex);
+    m_indexRanges.push_back(range);
+    *minIndex = range.minIndex;
+    *maxIndex = range.maxIndex;
+    return true;
+}
+
+void GLESbuffer::clearIndexRanges(unsigned int offset,unsigned int size) {
+    std::vector<IndexRange>::iterator it = m_indexRanges.begin();
+    while(it != m_indexRanges.end()) {
+        unsigned int end = (*it).offset + (*it).count * indexSize((*it).type);
+        if((*it).offset < offset + size && offset < end) {
+            it = m_indexRanges.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+void GLESbuffer::clearByteConversions() {
+    for(unsigned int i = 0; i < m_byteConversions.size(); i++) {
+        delete [] m_byteConversions[i].data;
+    }
+    m_byteConversions.clear();
+}
+
 GLESbuffer::~GLESbuffer() {
+    clearByteConversions();
     if(m_data) {
         delete [] m_data;
     }
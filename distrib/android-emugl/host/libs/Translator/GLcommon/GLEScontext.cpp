@@ -22,54 +22,63 @@
 #include <GLcommon/GLESvalidate.h>
 #include <GLcommon/TextureUtils.h>
 #include <GLcommon/FramebufferData.h>
+#include <GLcommon/VertexConversion.h>
 #include <strings.h>
 #include <string.h>
 
-//decleration
-static void convertFixedDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize);
-static void convertFixedIndirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,GLenum indices_type,const GLvoid* indices,unsigned int strideOut,int attribSize);
-static void convertByteDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize);
-static void convertByteIndirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,GLenum indices_type,const GLvoid* indices,unsigned int strideOut,int attribSize);
-
-GLESConversionArrays::~GLESConversionArrays() {
-    for(std::map<GLenum,ArrayData>::iterator it = m_arrays.begin(); it != m_arrays.end();it++) {
-        if((*it).second.allocated){
-            if((*it).second.type == GL_FLOAT){
-                GLfloat* p = (GLfloat *)((*it).second.data);
-                if(p) delete[] p;
-            } else if((*it).second.type == GL_SHORT){
-                GLshort* p = (GLshort *)((*it).second.data);
-                if(p) delete[] p;
-            }
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+GLESConversionArrays::GLESConversionArrays():
+        m_frame(emugl::Arena::getThreadLocal()),
+        m_arrays(NULL),
+        m_capacity(0),
+        m_current(0){};
+
+ArrayData& GLESConversionArrays::getArray(unsigned int i){
+    if(i >= m_capacity){
+        // Grow the table, the old one is released with the frame.
+        unsigned int capacity = m_capacity ? 2*m_capacity : 16;
+        if(capacity <= i) capacity = i + 1;
+        ArrayData* arrays = m_frame.arena()->allocArray<ArrayData>(capacity);
+        for(unsigned int n = 0; n < capacity; n++) {
+            arrays[n] = (n < m_capacity) ? m_arrays[n] : ArrayData();
         }
+        m_arrays = arrays;
+        m_capacity = capacity;
     }
+    return m_arrays[i];
 }
 
 void GLESConversionArrays::allocArr(unsigned int size,GLenum type){
+    ArrayData& arr = getArray(m_current);
     if(type == GL_FIXED){
-        m_arrays[m_current].data = new GLfloat[size];
-        m_arrays[m_current].type = GL_FLOAT;
+        arr.data = m_frame.arena()->allocArray<GLfloat>(size);
+        arr.type = GL_FLOAT;
     } else if(type == GL_BYTE){
-        m_arrays[m_current].data = new GLshort[size];
-        m_arrays[m_current].type = GL_SHORT;
+        arr.data = m_frame.arena()->allocArray<GLshort>(size);
+        arr.type = GL_SHORT;
     }
-    m_arrays[m_current].stride = 0;
-    m_arrays[m_current].allocated = true;
+    arr.stride = 0;
+    arr.allocated = true;
 }
 
 void GLESConversionArrays::setArr(void* data,unsigned int stride,GLenum type){
-   m_arrays[m_current].type = type;
-   m_arrays[m_current].data = data;
-   m_arrays[m_current].stride = stride;
-   m_arrays[m_current].allocated = false;
+   ArrayData& arr = getArray(m_current);
+   arr.type = type;
+   arr.data = data;
+   arr.stride = stride;
+   arr.allocated = false;
 }
 
 void* GLESConversionArrays::getCurrentData(){
-    return m_arrays[m_current].data;
+    return getArray(m_current).data;
 }
 
 ArrayData& GLESConversionArrays::getCurrentArray(){
-    return m_arrays[m_current];
+    return getArray(m_current);
 }
 
 unsigned int GLESConversionArrays::getCurrentIndex(){
@@ -77,7 +86,7 @@ unsigned int GLESConversionArrays::getCurrentIndex(){
 }
 
 ArrayData& GLESConversionArrays::operator[](int i){
-    return m_arrays[i];
+    return getArray(i);
 }
 
 void GLESConversionArrays::operator++(){
@@ -91,6 +100,12 @@ std::string    GLEScontext::s_glVendor;
 std::string    GLEScontext::s_glRenderer;
 std::string    GLEScontext::s_glVersion;
 GLSupport      GLEScontext::s_glSupport;
+std::map<GLenum,GLint> GLEScontext::s_hostLimits;
+volatile unsigned int GLEScontext::s_textureDeletions = 0;
+volatile unsigned int GLEScontext::s_elidedCalls = 0;
+
+// Marks a textureTargetState::hostTexture that isn't known.
+static const GLuint kUnknownTexture = ~0U;
 
 Version::Version():m_major(0),
                    m_minor(0),
@@ -148,6 +163,7 @@ void GLEScontext::init(GlLibrary* glLib) {
             {
                 m_texState[i][j].texture = 0;
                 m_texState[i][j].enabled = GL_FALSE;
+                m_texState[i][j].hostTexture = kUnknownTexture;
             }
         }
     }
@@ -161,6 +177,15 @@ GLEScontext::GLEScontext():
                            m_texState(0)          ,
                            m_arrayBuffer(0)        ,
                            m_elementBuffer(0),
+                           m_knownCaps(0),
+                           m_enabledCaps(0),
+                           m_blendFuncKnown(false),
+                           m_blendEquationKnown(false),
+                           m_depthFuncKnown(false),
+                           m_depthFunc(GL_LESS),
+                           m_depthMaskKnown(false),
+                           m_depthMask(GL_TRUE),
+                           m_textureDeletions(s_textureDeletions),
                            m_renderbuffer(0),
                            m_framebuffer(0)
 {
@@ -214,60 +239,11 @@ const GLESpointer* GLEScontext::getPointer(GLenum arrType) {
     return NULL;
 }
 
-static void convertFixedDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize) {
-
-    for(unsigned int i = 0; i < nBytes;i+=strideOut) {
-        const GLfixed* fixed_data = (const GLfixed *)dataIn;
-        //filling attrib
-        for(int j=0;j<attribSize;j++) {
-            reinterpret_cast<GLfloat*>(&static_cast<unsigned char*>(dataOut)[i])[j] = X2F(fixed_data[j]);
-        }
-        dataIn += strideIn;
-    }
-}
-
-static void convertFixedIndirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,GLenum indices_type,const GLvoid* indices,unsigned int strideOut,int attribSize) {
-    for(int i = 0 ;i < count ;i++) {
-        unsigned short index = indices_type == GL_UNSIGNED_BYTE? ((GLubyte *)indices)[i]:
-                                                             ((GLushort *)indices)[i];
-        const GLfixed* fixed_data = (GLfixed *)(dataIn  + index*strideIn);
-        GLfloat* float_data = reinterpret_cast<GLfloat*>(static_cast<unsigned char*>(dataOut) + index*strideOut);
-
-        for(int j=0;j<attribSize;j++) {
-            float_data[j] = X2F(fixed_data[j]);
-         }
-    }
-}
-
-static void convertByteDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize) {
-
-    for(unsigned int i = 0; i < nBytes;i+=strideOut) {
-        const GLbyte* byte_data = (const GLbyte *)dataIn;
-        //filling attrib
-        for(int j=0;j<attribSize;j++) {
-            reinterpret_cast<GLshort*>(&static_cast<unsigned char*>(dataOut)[i])[j] = B2S(byte_data[j]);
-        }
-        dataIn += strideIn;
-    }
-}
-
-static void convertByteIndirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,GLenum indices_type,const GLvoid* indices,unsigned int strideOut,int attribSize) {
-    for(int i = 0 ;i < count ;i++) {
-        unsigned short index = indices_type == GL_UNSIGNED_BYTE? ((GLubyte *)indices)[i]:
-                                                             ((GLushort *)indices)[i];
-        const GLbyte* bytes_data = (GLbyte *)(dataIn  + index*strideIn);
-        GLshort* short_data = reinterpret_cast<GLshort*>(static_cast<unsigned char*>(dataOut) + index*strideOut);
-
-        for(int j=0;j<attribSize;j++) {
-            short_data[j] = B2S(bytes_data[j]);
-         }
-    }
-}
 static void directToBytesRanges(GLint first,GLsizei count,GLESpointer* p,RangeList& list) {
 
     int attribSize = p->getSize()*4; //4 is the sizeof GLfixed or GLfloat in bytes
     int stride = p->getStride()?p->getStride():attribSize;
-    int start  = p->getBufferOffset()+first*attribSize;
+    int start  = p->getBufferOffset()+first*stride;
     if(!p->getStride()) {
         list.addRange(Range(start,count*attribSize));
     } else {
@@ -291,83 +267,89 @@ static void indirectToBytesRanges(const GLvoid* indices,GLenum indices_type,GLsi
     }
 }
 
-int bytesRangesToIndices(RangeList& ranges,GLESpointer* p,GLushort* indices) {
+// Convert in place the GL_FIXED vertices of the buffer ranges in |ranges|.
+static void convertBytesRanges(RangeList& ranges,GLESpointer* p) {
 
     int attribSize = p->getSize() * 4; //4 is the sizeof GLfixed or GLfloat in bytes
     int stride = p->getStride()?p->getStride():attribSize;
     int offset = p->getBufferOffset();
+    char* data = static_cast<char*>(p->getBufferData());
 
-    int n = 0;
     for(int i=0;i<ranges.size();i++) {
         int startIndex = (ranges[i].getStart() - offset) / stride;
         int nElements = ranges[i].getSize()/attribSize;
-        for(int j=0;j<nElements;j++) {
-            indices[n++] = startIndex+j;
-        }
+        char* start = data + startIndex*stride;
+        convertFixedToFloat(start,stride,start,stride,nElements,p->getSize());
     }
-    return n;
 }
 
 void GLEScontext::convertDirect(GLESConversionArrays& cArrs,GLint first,GLsizei count,GLenum array_id,GLESpointer* p) {
 
     GLenum type    = p->getType();
     int attribSize = p->getSize();
-    unsigned int size = attribSize*count + first;
+    unsigned int size = attribSize*(count + first);
     unsigned int bytes = type == GL_FIXED ? sizeof(GLfixed):sizeof(GLbyte);
     cArrs.allocArr(size,type);
     int stride = p->getStride()?p->getStride():bytes*attribSize;
     const char* data = (const char*)p->getArrayData() + (first*stride);
 
+    // The draw call reads the vertices starting at |first|, so put them
+    // at the same index in the converted array.
     if(type == GL_FIXED) {
-        convertFixedDirectLoop(data,stride,cArrs.getCurrentData(),size*sizeof(GLfloat),attribSize*sizeof(GLfloat),attribSize);
+        GLfloat* out = static_cast<GLfloat*>(cArrs.getCurrentData()) + first*attribSize;
+        convertFixedToFloat(data,stride,out,attribSize*sizeof(GLfloat),count,attribSize);
     } else if(type == GL_BYTE) {
-        convertByteDirectLoop(data,stride,cArrs.getCurrentData(),size*sizeof(GLshort),attribSize*sizeof(GLshort),attribSize);
+        GLshort* out = static_cast<GLshort*>(cArrs.getCurrentData()) + first*attribSize;
+        convertByteToShort(data,stride,out,attribSize*sizeof(GLshort),count,attribSize);
     }
 }
 
 void GLEScontext::convertDirectVBO(GLESConversionArrays& cArrs,GLint first,GLsizei count,GLenum array_id,GLESpointer* p) {
 
+    if(p->getType() == GL_BYTE) {
+        convertByteVBO(cArrs,first + count,p);
+        return;
+    }
+
     RangeList ranges;
     RangeList conversions;
-    GLushort* indices = NULL;
-    int attribSize = p->getSize();
-    int stride = p->getStride()?p->getStride():sizeof(GLfixed)*attribSize;
-    char* data = (char*)p->getBufferData() + (first*stride);
+    char* data = (char*)p->getBufferData();
 
     if(p->bufferNeedConversion()) {
         directToBytesRanges(first,count,p,ranges); //converting indices range to buffer bytes ranges by offset
         p->getBufferConversions(ranges,conversions); // getting from the buffer the relevant ranges that still needs to be converted
 
         if(conversions.size()) { // there are some elements to convert
-           indices = new GLushort[count];
-           int nIndices = bytesRangesToIndices(conversions,p,indices); //converting bytes ranges by offset to indices in this array
-           convertFixedIndirectLoop(data,stride,data,nIndices,GL_UNSIGNED_SHORT,indices,stride,attribSize);
+            convertBytesRanges(conversions,p);
         }
     }
-    if(indices) delete[] indices;
     cArrs.setArr(data,p->getStride(),GL_FLOAT);
 }
 
-int GLEScontext::findMaxIndex(GLsizei count,GLenum type,const GLvoid* indices) {
-    //finding max index
-    int max = 0;
-    if(type == GL_UNSIGNED_BYTE) {
-        GLubyte*  b_indices  =(GLubyte *)indices;
-        for(int i=0;i<count;i++) {
-            if(b_indices[i] > max) max = b_indices[i];
-        }
-    } else {
-        GLushort* us_indices =(GLushort *)indices;
-        for(int i=0;i<count;i++) {
-            if(us_indices[i] > max) max = us_indices[i];
+void GLEScontext::convertByteVBO(GLESConversionArrays& cArrs,unsigned int nVertices,GLESpointer* p) {
+    // GL_BYTE vertices can't be converted in place, since each GL_SHORT
+    // takes twice the space. The buffer keeps a converted copy instead.
+    cArrs.setArr(p->getBufferByteConversion(nVertices),0,GL_SHORT);
+}
+
+void GLEScontext::getIndexRange(GLsizei count,GLenum type,const GLvoid* indices,int* minIndex,int* maxIndex) {
+    if(m_elementBuffer) {
+        GLESbuffer* vbo = static_cast<GLESbuffer*>(m_shareGroup->getObjectData(VERTEXBUFFER,m_elementBuffer).Ptr());
+        const unsigned char* data = static_cast<const unsigned char*>(vbo->getData());
+        const unsigned char* ptr = static_cast<const unsigned char*>(indices);
+        if(data && ptr >= data && ptr <= data + vbo->getSize() &&
+           vbo->getIndexRange(type,ptr - data,count,minIndex,maxIndex)) {
+            return;
         }
     }
-    return max;
+    computeIndexRange(indices,type,count,minIndex,maxIndex);
 }
 
 void GLEScontext::convertIndirect(GLESConversionArrays& cArrs,GLsizei count,GLenum indices_type,const GLvoid* indices,GLenum array_id,GLESpointer* p) {
     GLenum type    = p->getType();
-    int maxElements = findMaxIndex(count,type,indices) + 1;
+    int minIndex, maxIndex;
+    getIndexRange(count,indices_type,indices,&minIndex,&maxIndex);
+    int maxElements = maxIndex + 1;
 
     int attribSize = p->getSize();
     int size = attribSize * maxElements;
@@ -375,31 +357,38 @@ void GLEScontext::convertIndirect(GLESConversionArrays& cArrs,GLsizei count,GLen
     cArrs.allocArr(size,type);
     int stride = p->getStride()?p->getStride():bytes*attribSize;
 
-    const char* data = (const char*)p->getArrayData();
+    // Indices usually refer to each vertex several times, so converting
+    // all the vertices between the smallest and the largest index once is
+    // faster than converting them index by index.
+    const char* data = (const char*)p->getArrayData() + minIndex*stride;
+    int nVertices = maxElements - minIndex;
     if(type == GL_FIXED) {
-        convertFixedIndirectLoop(data,stride,cArrs.getCurrentData(),count,indices_type,indices,attribSize*sizeof(GLfloat),attribSize);
+        GLfloat* out = static_cast<GLfloat*>(cArrs.getCurrentData()) + minIndex*attribSize;
+        convertFixedToFloat(data,stride,out,attribSize*sizeof(GLfloat),nVertices,attribSize);
     } else if(type == GL_BYTE){
-        convertByteIndirectLoop(data,stride,cArrs.getCurrentData(),count,indices_type,indices,attribSize*sizeof(GLshort),attribSize);
+        GLshort* out = static_cast<GLshort*>(cArrs.getCurrentData()) + minIndex*attribSize;
+        convertByteToShort(data,stride,out,attribSize*sizeof(GLshort),nVertices,attribSize);
     }
 }
 
 void GLEScontext::convertIndirectVBO(GLESConversionArrays& cArrs,GLsizei count,GLenum indices_type,const GLvoid* indices,GLenum array_id,GLESpointer* p) {
+    if(p->getType() == GL_BYTE) {
+        int minIndex, maxIndex;
+        getIndexRange(count,indices_type,indices,&minIndex,&maxIndex);
+        convertByteVBO(cArrs,maxIndex + 1,p);
+        return;
+    }
+
     RangeList ranges;
     RangeList conversions;
-    GLushort* conversionIndices = NULL;
-    int attribSize = p->getSize();
-    int stride = p->getStride()?p->getStride():sizeof(GLfixed)*attribSize;
     char* data = static_cast<char*>(p->getBufferData());
     if(p->bufferNeedConversion()) {
         indirectToBytesRanges(indices,indices_type,count,p,ranges); //converting indices range to buffer bytes ranges by offset
         p->getBufferConversions(ranges,conversions); // getting from the buffer the relevant ranges that still needs to be converted
         if(conversions.size()) { // there are some elements to convert
-            conversionIndices = new GLushort[count];
-            int nIndices = bytesRangesToIndices(conversions,p,conversionIndices); //converting bytes ranges by offset to indices in this array
-            convertFixedIndirectLoop(data,stride,data,nIndices,GL_UNSIGNED_SHORT,conversionIndices,stride,attribSize);
+            convertBytesRanges(conversions,p);
         }
     }
-    if(conversionIndices) delete[] conversionIndices;
     cArrs.setArr(data,p->getStride(),GL_FLOAT);
 }
 
@@ -562,6 +551,9 @@ void GLEScontext::initCapsLocked(const GLubyte * extensionString)
 
     if (!(Version((const char*)glVersion) < Version("3.0")) || strstr(cstring,"GL_OES_rgb8_rgba8")!=NULL)
         s_glSupport.GL_OES_RGB8_RGBA8 = true;
+
+    if (!(Version((const char*)glVersion) < Version("4.1")) || strstr(cstring,"GL_ARB_get_program_binary ")!=NULL)
+        s_glSupport.GL_ARB_GET_PROGRAM_BINARY = true;
 }
 
 void GLEScontext::buildStrings(const char* baseVendor,
@@ -697,6 +689,22 @@ bool GLEScontext::glGetIntegerv(GLenum pname, GLint *params)
     return true;
 }
 
+void GLEScontext::getHostLimit(GLenum pname, GLint* params) {
+    emugl::Mutex::AutoLock mutex(s_lock);
+    std::map<GLenum,GLint>::const_iterator it = s_hostLimits.find(pname);
+    if (it != s_hostLimits.end()) {
+        *params = it->second;
+        return;
+    }
+    GLint value = 0;
+    s_glDispatch.glGetIntegerv(pname, &value);
+    // Don't cache a failed query, e.g. without a current host context.
+    if (value) {
+        s_hostLimits[pname] = value;
+    }
+    *params = value;
+}
+
 TextureTarget GLEScontext::GLTextureTargetToLocal(GLenum target) {
     TextureTarget value=TEXTURE_2D;
     switch (target) {
@@ -736,6 +744,153 @@ void GLEScontext::setTextureEnabled(GLenum target, GLenum enable) {
     m_texState[m_activeTexture][pos].enabled = enable;
 }
 
+// Return the bit for |cap| in m_knownCaps and m_enabledCaps, or 0 if its
+// state isn't tracked.
+static unsigned int capBit(GLenum cap) {
+    switch (cap) {
+    case GL_BLEND:                    return 1U << 0;
+    case GL_CULL_FACE:                return 1U << 1;
+    case GL_DEPTH_TEST:               return 1U << 2;
+    case GL_DITHER:                   return 1U << 3;
+    case GL_POLYGON_OFFSET_FILL:      return 1U << 4;
+    case GL_SAMPLE_ALPHA_TO_COVERAGE: return 1U << 5;
+    case GL_SAMPLE_COVERAGE:          return 1U << 6;
+    case GL_SCISSOR_TEST:             return 1U << 7;
+    case GL_STENCIL_TEST:             return 1U << 8;
+    default:                          return 0;
+    }
+}
+
+bool GLEScontext::filterEnable(GLenum cap, bool enable) {
+    unsigned int bit = capBit(cap);
+    if (!bit) {
+        return false;
+    }
+    if ((m_knownCaps & bit) && ((m_enabledCaps & bit) != 0) == enable) {
+        countElidedCall();
+        return true;
+    }
+    m_knownCaps |= bit;
+    if (enable) {
+        m_enabledCaps |= bit;
+    } else {
+        m_enabledCaps &= ~bit;
+    }
+    return false;
+}
+
+bool GLEScontext::filterBlendFunc(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha) {
+    if (m_blendFuncKnown &&
+        m_blendFunc[0] == srcRGB && m_blendFunc[1] == dstRGB &&
+        m_blendFunc[2] == srcAlpha && m_blendFunc[3] == dstAlpha) {
+        countElidedCall();
+        return true;
+    }
+    m_blendFuncKnown = true;
+    m_blendFunc[0] = srcRGB;
+    m_blendFunc[1] = dstRGB;
+    m_blendFunc[2] = srcAlpha;
+    m_blendFunc[3] = dstAlpha;
+    return false;
+}
+
+bool GLEScontext::filterBlendEquation(GLenum modeRGB, GLenum modeAlpha) {
+    if (m_blendEquationKnown &&
+        m_blendEquation[0] == modeRGB && m_blendEquation[1] == modeAlpha) {
+        countElidedCall();
+        return true;
+    }
+    m_blendEquationKnown = true;
+    m_blendEquation[0] = modeRGB;
+    m_blendEquation[1] = modeAlpha;
+    return false;
+}
+
+bool GLEScontext::filterDepthFunc(GLenum func) {
+    if (func < GL_NEVER || func > GL_ALWAYS) {
+        // Let the driver report the error.
+        return false;
+    }
+    if (m_depthFuncKnown && m_depthFunc == func) {
+        countElidedCall();
+        return true;
+    }
+    m_depthFuncKnown = true;
+    m_depthFunc = func;
+    return false;
+}
+
+bool GLEScontext::filterDepthMask(GLboolean flag) {
+    flag = flag ? GL_TRUE : GL_FALSE;
+    if (m_depthMaskKnown && m_depthMask == flag) {
+        countElidedCall();
+        return true;
+    }
+    m_depthMaskKnown = true;
+    m_depthMask = flag;
+    return false;
+}
+
+bool GLEScontext::filterBindTexture(GLenum target, GLuint globalTextureName) {
+    if (!m_texState) {
+        return false;
+    }
+    if (m_textureDeletions != s_textureDeletions) {
+        // A deleted texture may have been bound to any unit, and its name
+        // reused since.
+        m_textureDeletions = s_textureDeletions;
+        for (int i = 0; i < getMaxTexUnits(); ++i) {
+            for (int j = 0; j < NUM_TEXTURE_TARGETS; ++j) {
+                m_texState[i][j].hostTexture = kUnknownTexture;
+            }
+        }
+    }
+    TextureTarget pos = GLTextureTargetToLocal(target);
+    GLuint& hostTexture = m_texState[m_activeTexture][pos].hostTexture;
+    if (target != GL_TEXTURE_2D && target != GL_TEXTURE_CUBE_MAP) {
+        // Other targets share the 2D state here but not in the host.
+        hostTexture = kUnknownTexture;
+        return false;
+    }
+    if (hostTexture == globalTextureName) {
+        countElidedCall();
+        return true;
+    }
+    hostTexture = globalTextureName;
+    return false;
+}
+
+void GLEScontext::invalidateTextureBinding(GLenum target) {
+    if (m_texState) {
+        TextureTarget pos = GLTextureTargetToLocal(target);
+        m_texState[m_activeTexture][pos].hostTexture = kUnknownTexture;
+    }
+}
+
+void GLEScontext::onTexturesDeleted() {
+#ifdef _WIN32
+    InterlockedIncrement((volatile LONG*)&s_textureDeletions);
+#else
+    __sync_fetch_and_add(&s_textureDeletions, 1);
+#endif
+}
+
+void GLEScontext::countElidedCall() {
+#ifdef _WIN32
+    InterlockedIncrement((volatile LONG*)&s_elidedCalls);
+#else
+    __sync_fetch_and_add(&s_elidedCalls, 1);
+#endif
+}
+
+unsigned int GLEScontext::takeElidedCallCount() {
+#ifdef _WIN32
+    return (unsigned int)InterlockedExchange((volatile LONG*)&s_elidedCalls, 0);
+#else
+    return __sync_lock_test_and_set(&s_elidedCalls, 0);
+#endif
+}
+
 #define INTERNAL_NAME(x) (x +0x100000000ll);
 
 ObjectLocalName GLEScontext::getDefaultTextureName(GLenum target) {
@@ -0,0 +1,163 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <GLcommon/GLEScontext.h>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const int kMaxTexUnits = 2;
+
+// Answer the queries made by GLEScontext::init() without a GL library.
+void GL_APIENTRY fakeGetIntegerv(GLenum pname, GLint* params) {
+    *params = kMaxTexUnits;
+}
+
+const GLubyte* GL_APIENTRY fakeGetString(GLenum name) {
+    return (const GLubyte*)(name == GL_EXTENSIONS ? "" : "2.0");
+}
+
+class TestContext : public GLEScontext {
+public:
+    TestContext() {
+        GLDispatch::glGetIntegerv = fakeGetIntegerv;
+        GLDispatch::glGetString = fakeGetString;
+        init(NULL);
+        // Start each test from a zero count.
+        takeElidedCallCount();
+    }
+
+    virtual void setupArraysPointers(GLESConversionArrays& fArrs,
+                                     GLint first, GLsizei count, GLenum type,
+                                     const GLvoid* indices, bool direct) {}
+    virtual int getMaxTexUnits() { return kMaxTexUnits; }
+
+protected:
+    virtual bool needConvert(GLESConversionArrays& fArrs, GLint first,
+                             GLsizei count, GLenum type,
+                             const GLvoid* indices, bool direct,
+                             GLESpointer* p, GLenum array_id) {
+        return false;
+    }
+
+private:
+    virtual void setupArr(const GLvoid* arr, GLenum arrayType,
+                          GLenum dataType, GLint size, GLsizei stride,
+                          GLboolean normalized, int pointsIndex) {}
+    virtual void initExtensionString() {}
+};
+
+}  // namespace
+
+TEST(GLEScontext, FilterEnable) {
+    TestContext ctx;
+    // The initial state isn't assumed, the first calls always go through.
+    EXPECT_FALSE(ctx.filterEnable(GL_BLEND, false));
+    EXPECT_FALSE(ctx.filterEnable(GL_DEPTH_TEST, true));
+    EXPECT_TRUE(ctx.filterEnable(GL_BLEND, false));
+    EXPECT_TRUE(ctx.filterEnable(GL_DEPTH_TEST, true));
+    EXPECT_FALSE(ctx.filterEnable(GL_BLEND, true));
+    EXPECT_TRUE(ctx.filterEnable(GL_BLEND, true));
+    EXPECT_TRUE(ctx.filterEnable(GL_DEPTH_TEST, true));
+    EXPECT_FALSE(ctx.filterEnable(GL_DEPTH_TEST, false));
+
+    // Capabilities that aren't tracked are never filtered.
+    EXPECT_FALSE(ctx.filterEnable(GL_TEXTURE_2D, true));
+    EXPECT_FALSE(ctx.filterEnable(GL_TEXTURE_2D, true));
+
+    EXPECT_EQ(4U, GLEScontext::takeElidedCallCount());
+    EXPECT_EQ(0U, GLEScontext::takeElidedCallCount());
+}
+
+TEST(GLEScontext, FilterBlendAndDepthState) {
+    TestContext ctx;
+    EXPECT_FALSE(ctx.filterBlendFunc(GL_ONE, GL_ZERO, GL_ONE, GL_ZERO));
+    EXPECT_TRUE(ctx.filterBlendFunc(GL_ONE, GL_ZERO, GL_ONE, GL_ZERO));
+    EXPECT_FALSE(ctx.filterBlendFunc(GL_ONE, GL_ZERO, GL_ONE, GL_ONE));
+
+    EXPECT_FALSE(ctx.filterBlendEquation(GL_FUNC_ADD, GL_FUNC_ADD));
+    EXPECT_TRUE(ctx.filterBlendEquation(GL_FUNC_ADD, GL_FUNC_ADD));
+
+    EXPECT_FALSE(ctx.filterDepthFunc(GL_LEQUAL));
+    EXPECT_TRUE(ctx.filterDepthFunc(GL_LEQUAL));
+    EXPECT_FALSE(ctx.filterDepthFunc(GL_LESS));
+    // Invalid values are left to the driver, which reports the error.
+    EXPECT_FALSE(ctx.filterDepthFunc(GL_ZERO));
+    EXPECT_FALSE(ctx.filterDepthFunc(GL_ZERO));
+
+    EXPECT_FALSE(ctx.filterDepthMask(GL_FALSE));
+    EXPECT_TRUE(ctx.filterDepthMask(GL_FALSE));
+    EXPECT_FALSE(ctx.filterDepthMask(GL_TRUE));
+    // Any non-zero value means GL_TRUE.
+    EXPECT_TRUE(ctx.filterDepthMask(42));
+
+    EXPECT_EQ(5U, GLEScontext::takeElidedCallCount());
+}
+
+TEST(GLEScontext, FilterBindTexture) {
+    TestContext ctx;
+    EXPECT_FALSE(ctx.filterBindTexture(GL_TEXTURE_2D, 10));
+    EXPECT_TRUE(ctx.filterBindTexture(GL_TEXTURE_2D, 10));
+    EXPECT_FALSE(ctx.filterBindTexture(GL_TEXTURE_CUBE_MAP, 10));
+    EXPECT_TRUE(ctx.filterBindTexture(GL_TEXTURE_CUBE_MAP, 10));
+
+    // Each texture unit has its own bindings.
+    ctx.setActiveTexture(GL_TEXTURE1);
+    EXPECT_FALSE(ctx.filterBindTexture(GL_TEXTURE_2D, 10));
+    ctx.setActiveTexture(GL_TEXTURE0);
+    EXPECT_TRUE(ctx.filterBindTexture(GL_TEXTURE_2D, 10));
+
+    ctx.invalidateTextureBinding(GL_TEXTURE_2D);
+    EXPECT_FALSE(ctx.filterBindTexture(GL_TEXTURE_2D, 10));
+    EXPECT_TRUE(ctx.filterBindTexture(GL_TEXTURE_2D, 10));
+
+    // Deleted texture names can be reused by the driver.
+    GLEScontext::onTexturesDeleted();
+    EXPECT_FALSE(ctx.filterBindTexture(GL_TEXTURE_2D, 10));
+    EXPECT_FALSE(ctx.filterBindTexture(GL_TEXTURE_CUBE_MAP, 10));
+
+    EXPECT_EQ(4U, GLEScontext::takeElidedCallCount());
+}
+
+TEST(GLESConversionArrays, UsesThreadArena) {
+    emugl::Arena* arena = emugl::Arena::getThreadLocal();
+    size_t chunkCount = 0;
+    for (int n = 0; n < 10; ++n) {
+        GLESConversionArrays arrs;
+        for (int i = 0; i < 40; ++i) {
+            arrs.allocArr(1000, (i & 1) ? GL_BYTE : GL_FIXED);
+            EXPECT_EQ(arrs.getCurrentData(), arrs[i].data);
+            EXPECT_EQ((i & 1) ? (GLenum)GL_SHORT : (GLenum)GL_FLOAT,
+                      arrs[i].type);
+            ++arrs;
+        }
+        EXPECT_EQ(40U, arrs.getCurrentIndex());
+        EXPECT_TRUE(arrs[0].allocated);
+        if (n == 0) {
+            chunkCount = arena->getChunkAllocationCount();
+        }
+    }
+    // Later draws reuse the memory of the first one.
+    EXPECT_EQ(chunkCount, arena->getChunkAllocationCount());
+
+    GLESConversionArrays arrs;
+    GLfloat data[4];
+    arrs.setArr(data, 8, GL_FLOAT);
+    EXPECT_EQ(data, arrs.getCurrentArray().data);
+    EXPECT_EQ(8U, arrs.getCurrentArray().stride);
+    EXPECT_FALSE(arrs.getCurrentArray().allocated);
+    // Arrays that were never set are empty.
+    EXPECT_EQ(NULL, arrs[5].data);
+}
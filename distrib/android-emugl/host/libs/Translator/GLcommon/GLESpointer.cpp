@@ -107,3 +107,7 @@ void GLESpointer::setBuffer(GLint size,GLenum type,GLsizei stride,GLESbuffer* bu
 void GLESpointer::getBufferConversions(const RangeList& rl,RangeList& rlOut) {
     m_buffer->getConversions(rl,rlOut);
 }
+
+GLshort* GLESpointer::getBufferByteConversion(unsigned int count) {
+    return m_buffer->getByteConversion(m_buffOffset,m_stride,m_size,count);
+}
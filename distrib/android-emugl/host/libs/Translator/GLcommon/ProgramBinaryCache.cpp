@@ -0,0 +1,158 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include <GLcommon/ProgramBinaryCache.h>
+
+#include "emugl/common/lazy_instance.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace {
+
+// Increment kVersion whenever the file layout changes.
+const uint32_t kMagic = 0x43425045;  // 'EPBC'
+const uint32_t kVersion = 1;
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t format;
+    uint32_t binarySize;
+};
+
+// 64-bit FNV-1a, only used to name the files.
+uint64_t hashKey(const std::string& key) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t n = 0; n < key.size(); ++n) {
+        hash ^= (unsigned char)key[n];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void makeDirectory(const std::string& dir) {
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+}
+
+struct GlobalCache {
+    GlobalCache() : cache(getenv("ANDROID_EMUGL_PROGRAM_CACHE_DIR") ?
+                          getenv("ANDROID_EMUGL_PROGRAM_CACHE_DIR") : "") {}
+    ProgramBinaryCache cache;
+};
+
+emugl::LazyInstance<GlobalCache> sGlobalCache = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+ProgramBinaryCache::ProgramBinaryCache(const std::string& dir) : m_dir(dir) {
+    if (!m_dir.empty()) {
+        makeDirectory(m_dir);
+    }
+}
+
+// static
+ProgramBinaryCache* ProgramBinaryCache::get() {
+    return &sGlobalCache->cache;
+}
+
+std::string ProgramBinaryCache::pathFor(const std::string& key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin",
+             (unsigned long long)hashKey(key));
+    return m_dir + name;
+}
+
+bool ProgramBinaryCache::load(const std::string& key,
+                              GLenum* format,
+                              std::vector<char>* binary) {
+    if (!isEnabled()) {
+        return false;
+    }
+    FILE* file = fopen(pathFor(key).c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    bool found = false;
+    FileHeader header;
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == kMagic && header.version == kVersion &&
+        header.keySize == key.size() && header.binarySize > 0) {
+        std::vector<char> storedKey(header.keySize + 1);
+        binary->resize(header.binarySize);
+        found = fread(&storedKey[0], 1, header.keySize, file) ==
+                        header.keySize &&
+                !memcmp(&storedKey[0], key.data(), key.size()) &&
+                fread(&(*binary)[0], header.binarySize, 1, file) == 1;
+        *format = header.format;
+    }
+    fclose(file);
+    return found;
+}
+
+void ProgramBinaryCache::store(const std::string& key,
+                               GLenum format,
+                               const void* binary,
+                               size_t size) {
+    if (!isEnabled() || !size) {
+        return;
+    }
+    // Write a temporary file and rename it, so that a reader never sees
+    // an incomplete entry.
+    const std::string path = pathFor(key);
+    const std::string tmpPath = path + ".tmp";
+    FileHeader header = { kMagic, kVersion, (uint32_t)key.size(),
+                          format, (uint32_t)size };
+
+    emugl::Mutex::AutoLock lock(m_lock);
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(key.data(), 1, key.size(), file) == key.size() &&
+              fwrite(binary, size, 1, file) == 1;
+    ok = (fclose(file) == 0) && ok;
+#ifdef _WIN32
+    // rename() doesn't replace existing files on Windows.
+    if (ok) {
+        ::remove(path.c_str());
+    }
+#endif
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        ::remove(tmpPath.c_str());
+    }
+}
+
+void ProgramBinaryCache::remove(const std::string& key) {
+    if (!isEnabled()) {
+        return;
+    }
+    emugl::Mutex::AutoLock lock(m_lock);
+    ::remove(pathFor(key).c_str());
+}
@@ -0,0 +1,180 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <GLcommon/ProgramBinaryCache.h>
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const GLenum kFormat = 0x1234;
+
+// A temporary directory, removed with its files on destruction.
+class TempDir {
+public:
+    TempDir() {
+#ifdef _WIN32
+        char pattern[] = "emugl-program-cache-XXXXXX";
+        m_path = _mktemp(pattern);
+        _mkdir(m_path.c_str());
+#else
+        char pattern[] = "/tmp/emugl-program-cache-XXXXXX";
+        m_path = mkdtemp(pattern);
+#endif
+    }
+
+    ~TempDir() {
+#ifdef _WIN32
+        struct _finddata_t data;
+        intptr_t handle = _findfirst((m_path + "/*.*").c_str(), &data);
+        if (handle != -1) {
+            do {
+                ::remove((m_path + "/" + data.name).c_str());
+            } while (_findnext(handle, &data) == 0);
+            _findclose(handle);
+        }
+        _rmdir(m_path.c_str());
+#else
+        DIR* dir = opendir(m_path.c_str());
+        if (dir) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+                ::remove((m_path + "/" + entry->d_name).c_str());
+            }
+            closedir(dir);
+        }
+        rmdir(m_path.c_str());
+#endif
+    }
+
+    const std::string& path() const { return m_path; }
+
+private:
+    std::string m_path;
+};
+
+std::string makeBinary(size_t size, char seed) {
+    std::string binary(size, '\0');
+    for (size_t n = 0; n < size; ++n) {
+        binary[n] = (char)(seed + n * 7);
+    }
+    return binary;
+}
+
+}  // namespace
+
+TEST(ProgramBinaryCache, Disabled) {
+    ProgramBinaryCache cache("");
+    EXPECT_FALSE(cache.isEnabled());
+    const std::string binary = makeBinary(16, 1);
+    cache.store("key", kFormat, binary.data(), binary.size());
+
+    GLenum format = 0;
+    std::vector<char> loaded;
+    EXPECT_FALSE(cache.load("key", &format, &loaded));
+}
+
+TEST(ProgramBinaryCache, StoreAndLoad) {
+    TempDir dir;
+    const std::string binary = makeBinary(1000, 3);
+    const std::string key = std::string("renderer\0vertex\0fragment", 24);
+    {
+        ProgramBinaryCache cache(dir.path());
+        EXPECT_TRUE(cache.isEnabled());
+        cache.store(key, kFormat, binary.data(), binary.size());
+    }
+
+    // Entries persist across instances, as they do across runs.
+    ProgramBinaryCache cache(dir.path());
+    GLenum format = 0;
+    std::vector<char> loaded;
+    ASSERT_TRUE(cache.load(key, &format, &loaded));
+    EXPECT_EQ(kFormat, format);
+    ASSERT_EQ(binary.size(), loaded.size());
+    EXPECT_EQ(0, memcmp(binary.data(), &loaded[0], loaded.size()));
+
+    // Keys that only differ after a NUL are different.
+    EXPECT_FALSE(cache.load(std::string("renderer\0vertex\0other", 21),
+                            &format, &loaded));
+    EXPECT_FALSE(cache.load("renderer", &format, &loaded));
+}
+
+TEST(ProgramBinaryCache, ReplaceAndRemove) {
+    TempDir dir;
+    ProgramBinaryCache cache(dir.path());
+    const std::string first = makeBinary(100, 5);
+    const std::string second = makeBinary(50, 9);
+    cache.store("key", kFormat, first.data(), first.size());
+    cache.store("key", kFormat + 1, second.data(), second.size());
+    cache.store("other", kFormat, first.data(), first.size());
+
+    GLenum format = 0;
+    std::vector<char> loaded;
+    ASSERT_TRUE(cache.load("key", &format, &loaded));
+    EXPECT_EQ(kFormat + 1, format);
+    ASSERT_EQ(second.size(), loaded.size());
+    EXPECT_EQ(0, memcmp(second.data(), &loaded[0], loaded.size()));
+
+    cache.remove("key");
+    EXPECT_FALSE(cache.load("key", &format, &loaded));
+    EXPECT_TRUE(cache.load("other", &format, &loaded));
+}
+
+TEST(ProgramBinaryCache, IgnoresTruncatedFiles) {
+    TempDir dir;
+    ProgramBinaryCache cache(dir.path());
+    const std::string binary = makeBinary(256, 11);
+    cache.store("key", kFormat, binary.data(), binary.size());
+
+    // Truncate the only file of the directory.
+    std::string path;
+#ifdef _WIN32
+    struct _finddata_t data;
+    intptr_t handle = _findfirst((dir.path() + "/*.bin").c_str(), &data);
+    ASSERT_NE(-1, handle);
+    path = dir.path() + "/" + data.name;
+    _findclose(handle);
+#else
+    DIR* d = opendir(dir.path().c_str());
+    ASSERT_TRUE(d != NULL);
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strstr(entry->d_name, ".bin")) {
+            path = dir.path() + "/" + entry->d_name;
+        }
+    }
+    closedir(d);
+#endif
+    ASSERT_FALSE(path.empty());
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(file != NULL);
+    fwrite(binary.data(), 1, 10, file);
+    fclose(file);
+
+    GLenum format = 0;
+    std::vector<char> loaded;
+    EXPECT_FALSE(cache.load("key", &format, &loaded));
+}
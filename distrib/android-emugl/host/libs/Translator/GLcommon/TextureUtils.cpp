@@ -14,6 +14,7 @@
 * limitations under the License.
 */
 #include <GLcommon/TextureUtils.h>
+#include <GLcommon/Etc1Decoder.h>
 #include <GLcommon/GLESmacros.h>
 #include <GLcommon/GLDispatch.h>
 #include <GLcommon/GLESvalidate.h>
@@ -61,13 +62,13 @@ void  doCompressedTexImage2D(GLEScontext * ctx, GLenum target, GLint level,
 
                 const int32_t align = ctx->getUnpackAlignment()-1;
                 const int32_t bpr = ((width * 3) + align) & ~align;
-                const size_t size = bpr * height;
 
-                etc1_byte* pOut = new etc1_byte[size];
-                int res = etc1_decode_image((const etc1_byte*)data, pOut, width, height, 3, bpr);
-                SET_ERROR_IF(res!=0, GL_INVALID_VALUE);
+                Etc1DecodeCache::ImagePtr decoded =
+                        Etc1DecodeCache::get()->decode((const etc1_byte*)data,
+                                                       compressedSize,
+                                                       width, height, bpr);
+                const etc1_byte* pOut = decoded.Ptr()->empty() ? NULL : &(*decoded.Ptr())[0];
                 glTexImage2DPtr(target,level,format,width,height,border,format,type,pOut);
-                delete [] pOut;
             }
             break;
             
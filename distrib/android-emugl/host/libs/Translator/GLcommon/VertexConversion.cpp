@@ -0,0 +1,268 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include <GLcommon/VertexConversion.h>
+#include <GLcommon/GLconversion_macros.h>
+#include <GLES/gl.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// Convert |n| contiguous GL_FIXED values. Multiplying by 1/65536 gives
+// exactly the same result as X2F(), since it is a power of two.
+static void convertFixedArray(const GLfixed* in,GLfloat* out,unsigned int n) {
+    unsigned int i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(1.0f / 65536.0f);
+    for(; i + 8 <= n; i += 8) {
+        __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 4));
+        _mm_storeu_ps(out + i,     _mm_mul_ps(_mm_cvtepi32_ps(x0),scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(x1),scale));
+    }
+    for(; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_ps(out + i,_mm_mul_ps(_mm_cvtepi32_ps(x),scale));
+    }
+#elif defined(__ARM_NEON__)
+    for(; i + 4 <= n; i += 4) {
+        float32x4_t f = vcvtq_f32_s32(vld1q_s32(in + i));
+        vst1q_f32(out + i,vmulq_n_f32(f,1.0f / 65536.0f));
+    }
+#endif
+    for(; i < n; i++) {
+        out[i] = X2F(in[i]);
+    }
+}
+
+// Convert |n| contiguous GL_BYTE values.
+static void convertByteArray(const GLbyte* in,GLshort* out,unsigned int n) {
+    unsigned int i = 0;
+#if defined(__SSE2__)
+    for(; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        // Put each byte in the high half of a 16-bit lane, then shift it
+        // back to extend its sign.
+        __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(x,x),8);
+        __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(x,x),8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8),hi);
+    }
+#elif defined(__ARM_NEON__)
+    for(; i + 8 <= n; i += 8) {
+        vst1q_s16(out + i,vmovl_s8(vld1_s8(in + i)));
+    }
+#endif
+    for(; i < n; i++) {
+        out[i] = B2S(in[i]);
+    }
+}
+
+void convertFixedToFloat(const void* dataIn,unsigned int strideIn,
+                         void* dataOut,unsigned int strideOut,
+                         unsigned int count,int attribSize) {
+    const unsigned int vertexSize = attribSize * sizeof(GLfixed);
+    const unsigned char* in = static_cast<const unsigned char*>(dataIn);
+    unsigned char* out = static_cast<unsigned char*>(dataOut);
+
+    if(strideIn == vertexSize && strideOut == vertexSize) {
+        convertFixedArray(reinterpret_cast<const GLfixed*>(in),
+                          reinterpret_cast<GLfloat*>(out),count * attribSize);
+        return;
+    }
+    for(unsigned int i = 0; i < count; i++,in += strideIn,out += strideOut) {
+        const GLfixed* fixed_data = reinterpret_cast<const GLfixed*>(in);
+        GLfloat* float_data = reinterpret_cast<GLfloat*>(out);
+#if defined(__SSE2__)
+        if(attribSize == 4) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fixed_data));
+            _mm_storeu_ps(float_data,_mm_mul_ps(_mm_cvtepi32_ps(x),
+                                                _mm_set1_ps(1.0f / 65536.0f)));
+            continue;
+        }
+#endif
+        for(int j = 0; j < attribSize; j++) {
+            float_data[j] = X2F(fixed_data[j]);
+        }
+    }
+}
+
+void convertByteToShort(const void* dataIn,unsigned int strideIn,
+                        void* dataOut,unsigned int strideOut,
+                        unsigned int count,int attribSize) {
+    const unsigned char* in = static_cast<const unsigned char*>(dataIn);
+    unsigned char* out = static_cast<unsigned char*>(dataOut);
+
+    if(strideIn == (unsigned int)attribSize &&
+       strideOut == attribSize * sizeof(GLshort)) {
+        convertByteArray(reinterpret_cast<const GLbyte*>(in),
+                         reinterpret_cast<GLshort*>(out),count * attribSize);
+        return;
+    }
+    for(unsigned int i = 0; i < count; i++,in += strideIn,out += strideOut) {
+        const GLbyte* byte_data = reinterpret_cast<const GLbyte*>(in);
+        GLshort* short_data = reinterpret_cast<GLshort*>(out);
+        for(int j = 0; j < attribSize; j++) {
+            short_data[j] = B2S(byte_data[j]);
+        }
+    }
+}
+
+// Fold the |n| values of |in| into the range [*lo, *hi].
+template <typename T>
+static void scanIndices(const T* in,unsigned int n,unsigned int* lo,unsigned int* hi) {
+    for(unsigned int i = 0; i < n; i++) {
+        if(in[i] < *lo) *lo = in[i];
+        if(in[i] > *hi) *hi = in[i];
+    }
+}
+
+static void byteIndexRange(const GLubyte* in,unsigned int n,unsigned int* lo,unsigned int* hi) {
+    unsigned int i = 0;
+#if defined(__SSE2__)
+    if(n >= 16) {
+        __m128i vmin = _mm_set1_epi8((char)0xff);
+        __m128i vmax = _mm_setzero_si128();
+        for(; i + 16 <= n; i += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            vmin = _mm_min_epu8(vmin,x);
+            vmax = _mm_max_epu8(vmax,x);
+        }
+        GLubyte mins[16], maxs[16];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mins),vmin);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs),vmax);
+        scanIndices(mins,16,lo,hi);
+        scanIndices(maxs,16,lo,hi);
+    }
+#elif defined(__ARM_NEON__)
+    if(n >= 16) {
+        uint8x16_t vmin = vdupq_n_u8(0xff);
+        uint8x16_t vmax = vdupq_n_u8(0);
+        for(; i + 16 <= n; i += 16) {
+            uint8x16_t x = vld1q_u8(in + i);
+            vmin = vminq_u8(vmin,x);
+            vmax = vmaxq_u8(vmax,x);
+        }
+        GLubyte mins[16], maxs[16];
+        vst1q_u8(mins,vmin);
+        vst1q_u8(maxs,vmax);
+        scanIndices(mins,16,lo,hi);
+        scanIndices(maxs,16,lo,hi);
+    }
+#endif
+    scanIndices(in + i,n - i,lo,hi);
+}
+
+static void shortIndexRange(const GLushort* in,unsigned int n,unsigned int* lo,unsigned int* hi) {
+    unsigned int i = 0;
+#if defined(__SSE2__)
+    if(n >= 8) {
+        // SSE2 only compares signed 16-bit values: flip the sign bit of
+        // the indices to keep their order, and flip it back at the end.
+        const __m128i bias = _mm_set1_epi16((short)0x8000);
+        __m128i vmin = _mm_set1_epi16(0x7fff);
+        __m128i vmax = bias;
+        for(; i + 8 <= n; i += 8) {
+            __m128i x = _mm_xor_si128(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)),bias);
+            vmin = _mm_min_epi16(vmin,x);
+            vmax = _mm_max_epi16(vmax,x);
+        }
+        GLushort mins[8], maxs[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mins),_mm_xor_si128(vmin,bias));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs),_mm_xor_si128(vmax,bias));
+        scanIndices(mins,8,lo,hi);
+        scanIndices(maxs,8,lo,hi);
+    }
+#elif defined(__ARM_NEON__)
+    if(n >= 8) {
+        uint16x8_t vmin = vdupq_n_u16(0xffff);
+        uint16x8_t vmax = vdupq_n_u16(0);
+        for(; i + 8 <= n; i += 8) {
+            uint16x8_t x = vld1q_u16(in + i);
+            vmin = vminq_u16(vmin,x);
+            vmax = vmaxq_u16(vmax,x);
+        }
+        GLushort mins[8], maxs[8];
+        vst1q_u16(mins,vmin);
+        vst1q_u16(maxs,vmax);
+        scanIndices(mins,8,lo,hi);
+        scanIndices(maxs,8,lo,hi);
+    }
+#endif
+    scanIndices(in + i,n - i,lo,hi);
+}
+
+static void intIndexRange(const GLuint* in,unsigned int n,unsigned int* lo,unsigned int* hi) {
+    unsigned int i = 0;
+#if defined(__SSE2__)
+    if(n >= 4) {
+        // Same sign trick as above, with a compare and select since SSE2
+        // has no 32-bit min and max.
+        const __m128i bias = _mm_set1_epi32((int)0x80000000);
+        __m128i vmin = _mm_set1_epi32(0x7fffffff);
+        __m128i vmax = bias;
+        for(; i + 4 <= n; i += 4) {
+            __m128i x = _mm_xor_si128(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)),bias);
+            __m128i less = _mm_cmplt_epi32(x,vmin);
+            __m128i more = _mm_cmpgt_epi32(x,vmax);
+            vmin = _mm_or_si128(_mm_and_si128(less,x),_mm_andnot_si128(less,vmin));
+            vmax = _mm_or_si128(_mm_and_si128(more,x),_mm_andnot_si128(more,vmax));
+        }
+        GLuint mins[4], maxs[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mins),_mm_xor_si128(vmin,bias));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs),_mm_xor_si128(vmax,bias));
+        scanIndices(mins,4,lo,hi);
+        scanIndices(maxs,4,lo,hi);
+    }
+#elif defined(__ARM_NEON__)
+    if(n >= 4) {
+        uint32x4_t vmin = vdupq_n_u32(0xffffffff);
+        uint32x4_t vmax = vdupq_n_u32(0);
+        for(; i + 4 <= n; i += 4) {
+            uint32x4_t x = vld1q_u32(in + i);
+            vmin = vminq_u32(vmin,x);
+            vmax = vmaxq_u32(vmax,x);
+        }
+        GLuint mins[4], maxs[4];
+        vst1q_u32(mins,vmin);
+        vst1q_u32(maxs,vmax);
+        scanIndices(mins,4,lo,hi);
+        scanIndices(maxs,4,lo,hi);
+    }
+#endif
+    scanIndices(in + i,n - i,lo,hi);
+}
+
+void computeIndexRange(const void* indices,unsigned int type,
+                       unsigned int count,int* minIndex,int* maxIndex) {
+    unsigned int lo = 0xffffffff;
+    unsigned int hi = 0;
+
+    if(type == GL_UNSIGNED_BYTE) {
+        byteIndexRange(static_cast<const GLubyte*>(indices),count,&lo,&hi);
+    } else if(type == GL_UNSIGNED_SHORT) {
+        shortIndexRange(static_cast<const GLushort*>(indices),count,&lo,&hi);
+    } else {
+        intIndexRange(static_cast<const GLuint*>(indices),count,&lo,&hi);
+    }
+    if(lo > hi) lo = hi;
+    *minIndex = static_cast<int>(lo);
+    *maxIndex = static_cast<int>(hi);
+}
@@ -0,0 +1,262 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <GLcommon/VertexConversion.h>
+#include <GLcommon/GLconversion_macros.h>
+#include <GLcommon/GLESbuffer.h>
+#include <GLES/glext.h>
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace {
+
+const unsigned int kMaxVertices = 37;
+const unsigned int kMaxStride = 24;
+
+GLfixed fixedValue(unsigned int n) {
+    return static_cast<GLfixed>((n * 2654435761U) ^ (n << 7));
+}
+
+GLbyte byteValue(unsigned int n) {
+    return static_cast<GLbyte>(n * 37 + 11);
+}
+
+}  // namespace
+
+TEST(VertexConversion, FixedToFloat) {
+    // One extra byte to test unaligned input.
+    static unsigned char input[kMaxVertices * kMaxStride + 1];
+    static GLfloat output[kMaxVertices * 4 + 1];
+
+    for (int attribSize = 1; attribSize <= 4; attribSize++) {
+        for (unsigned int stride = attribSize * 4; stride <= kMaxStride;
+             stride += 4) {
+            for (unsigned int misalign = 0; misalign <= 1; misalign++) {
+                unsigned char* in = input + misalign;
+                for (unsigned int n = 0; n < sizeof(input) / 4; n++) {
+                    GLfixed value = fixedValue(n);
+                    memcpy(input + n * 4, &value, sizeof(value));
+                }
+                for (unsigned int count = 0; count <= kMaxVertices; count++) {
+                    memset(output, 0, sizeof(output));
+                    convertFixedToFloat(in, stride, output, attribSize * 4,
+                                        count, attribSize);
+                    for (unsigned int i = 0; i < count; i++) {
+                        for (int j = 0; j < attribSize; j++) {
+                            GLfixed value;
+                            memcpy(&value, in + i * stride + j * 4,
+                                   sizeof(value));
+                            ASSERT_EQ(X2F(value), output[i * attribSize + j])
+                                    << "size " << attribSize << " stride "
+                                    << stride << " count " << count;
+                        }
+                    }
+                    EXPECT_EQ(0.0f, output[count * attribSize]);
+                }
+            }
+        }
+    }
+}
+
+TEST(VertexConversion, FixedToFloatInPlace) {
+    static GLfixed data[kMaxVertices * 6];
+    static GLfixed expected[kMaxVertices * 6];
+
+    for (int attribSize = 1; attribSize <= 4; attribSize++) {
+        for (unsigned int stride = attribSize * 4; stride <= kMaxStride;
+             stride += 4) {
+            for (unsigned int n = 0; n < kMaxVertices * 6; n++) {
+                data[n] = fixedValue(n);
+                expected[n] = data[n];
+            }
+            unsigned int step = stride / 4;
+            for (unsigned int i = 0; i < kMaxVertices; i++) {
+                for (int j = 0; j < attribSize; j++) {
+                    GLfloat value = X2F(data[i * step + j]);
+                    memcpy(&expected[i * step + j], &value, sizeof(value));
+                }
+            }
+            convertFixedToFloat(data, stride, data, stride, kMaxVertices,
+                                attribSize);
+            // Conversions are exact, so the bits must match, and values
+            // between the vertices must be unchanged.
+            ASSERT_EQ(0, memcmp(expected, data, sizeof(data)))
+                    << "size " << attribSize << " stride " << stride;
+        }
+    }
+}
+
+TEST(VertexConversion, ByteToShort) {
+    static GLbyte input[kMaxVertices * kMaxStride];
+    static GLshort output[kMaxVertices * 4 + 1];
+
+    for (unsigned int n = 0; n < sizeof(input); n++) {
+        input[n] = byteValue(n);
+    }
+    for (int attribSize = 1; attribSize <= 4; attribSize++) {
+        for (unsigned int stride = attribSize; stride <= kMaxStride; stride++) {
+            for (unsigned int count = 0; count <= kMaxVertices; count++) {
+                memset(output, 0x55, sizeof(output));
+                convertByteToShort(input, stride, output,
+                                   attribSize * sizeof(GLshort), count,
+                                   attribSize);
+                for (unsigned int i = 0; i < count; i++) {
+                    for (int j = 0; j < attribSize; j++) {
+                        ASSERT_EQ(B2S(input[i * stride + j]),
+                                  output[i * attribSize + j])
+                                << "size " << attribSize << " stride "
+                                << stride << " count " << count;
+                    }
+                }
+                EXPECT_EQ(0x5555, output[count * attribSize]);
+            }
+        }
+    }
+}
+
+TEST(VertexConversion, BufferByteConversionCache) {
+    GLbyte data[64];
+    for (unsigned int n = 0; n < sizeof(data); n++) {
+        data[n] = byteValue(n);
+    }
+    GLESbuffer buffer;
+    ASSERT_TRUE(buffer.setBuffer(sizeof(data), GL_STATIC_DRAW, data));
+
+    // 3 components at offset 4, with a stride of 8.
+    GLshort* conv = buffer.getByteConversion(4, 8, 3, 5);
+    ASSERT_TRUE(conv);
+    for (unsigned int i = 0; i < 5; i++) {
+        for (unsigned int j = 0; j < 3; j++) {
+            EXPECT_EQ(data[4 + i * 8 + j], conv[i * 3 + j]);
+        }
+    }
+
+    // The same and smaller conversions are cached.
+    EXPECT_EQ(conv, buffer.getByteConversion(4, 8, 3, 5));
+    EXPECT_EQ(conv, buffer.getByteConversion(4, 8, 3, 2));
+    // Another attribute array is converted separately.
+    GLshort* other = buffer.getByteConversion(0, 8, 2, 5);
+    EXPECT_NE(conv, other);
+    EXPECT_EQ(data[8], other[2]);
+
+    // New data is converted again.
+    GLbyte value = -42;
+    ASSERT_TRUE(buffer.setSubBuffer(4 + 8, 1, &value));
+    conv = buffer.getByteConversion(4, 8, 3, 5);
+    EXPECT_EQ(-42, conv[3]);
+
+    // Vertices past the end of the buffer are zero.
+    conv = buffer.getByteConversion(4, 8, 3, 10);
+    EXPECT_EQ(data[4 + 7 * 8 + 2], conv[7 * 3 + 2]);
+    for (unsigned int n = 8 * 3; n < 10 * 3; n++) {
+        EXPECT_EQ(0, conv[n]);
+    }
+}
+
+TEST(VertexConversion, IndexRange) {
+    const unsigned int kMaxIndices = 67;
+    // One extra index to test unaligned input.
+    static GLubyte bytes[kMaxIndices + 1];
+    static GLushort shorts[kMaxIndices + 1];
+    static GLuint ints[kMaxIndices + 1];
+
+    for (unsigned int n = 0; n <= kMaxIndices; n++) {
+        unsigned int value = (n * 2654435761U) >> 8;
+        bytes[n] = static_cast<GLubyte>(value);
+        shorts[n] = static_cast<GLushort>(value);
+        ints[n] = value & 0x7fffffff;
+    }
+    for (unsigned int first = 0; first <= 1; first++) {
+        for (unsigned int count = 0; count <= kMaxIndices - first; count++) {
+            unsigned int minByte = 0xff, maxByte = 0;
+            unsigned int minShort = 0xffff, maxShort = 0;
+            unsigned int minInt = 0xffffffff, maxInt = 0;
+            for (unsigned int i = first; i < first + count; i++) {
+                if (bytes[i] < minByte) minByte = bytes[i];
+                if (bytes[i] > maxByte) maxByte = bytes[i];
+                if (shorts[i] < minShort) minShort = shorts[i];
+                if (shorts[i] > maxShort) maxShort = shorts[i];
+                if (ints[i] < minInt) minInt = ints[i];
+                if (ints[i] > maxInt) maxInt = ints[i];
+            }
+            if (!count) {
+                minByte = minShort = minInt = 0;
+            }
+
+            int minIndex, maxIndex;
+            computeIndexRange(bytes + first, GL_UNSIGNED_BYTE, count,
+                              &minIndex, &maxIndex);
+            ASSERT_EQ((int)minByte, minIndex) << "count " << count;
+            ASSERT_EQ((int)maxByte, maxIndex) << "count " << count;
+            computeIndexRange(shorts + first, GL_UNSIGNED_SHORT, count,
+                              &minIndex, &maxIndex);
+            ASSERT_EQ((int)minShort, minIndex) << "count " << count;
+            ASSERT_EQ((int)maxShort, maxIndex) << "count " << count;
+            computeIndexRange(ints + first, GL_UNSIGNED_INT, count,
+                              &minIndex, &maxIndex);
+            ASSERT_EQ((int)minInt, minIndex) << "count " << count;
+            ASSERT_EQ((int)maxInt, maxIndex) << "count " << count;
+        }
+    }
+}
+
+TEST(VertexConversion, BufferIndexRangeCache) {
+    GLushort data[32];
+    for (unsigned int n = 0; n < 32; n++) {
+        data[n] = static_cast<GLushort>(100 + n);
+    }
+    GLESbuffer buffer;
+    ASSERT_TRUE(buffer.setBuffer(sizeof(data), GL_STATIC_DRAW, data));
+
+    int minIndex, maxIndex;
+    ASSERT_TRUE(buffer.getIndexRange(GL_UNSIGNED_SHORT, 8, 16, &minIndex,
+                                     &maxIndex));
+    EXPECT_EQ(104, minIndex);
+    EXPECT_EQ(119, maxIndex);
+
+    // The range is cached: writes that bypass setSubBuffer() aren't seen.
+    static_cast<GLushort*>(buffer.getData())[10] = 7;
+    ASSERT_TRUE(buffer.getIndexRange(GL_UNSIGNED_SHORT, 8, 16, &minIndex,
+                                     &maxIndex));
+    EXPECT_EQ(104, minIndex);
+
+    // Other index arrays of the same buffer are scanned separately.
+    ASSERT_TRUE(buffer.getIndexRange(GL_UNSIGNED_SHORT, 0, 32, &minIndex,
+                                     &maxIndex));
+    EXPECT_EQ(7, minIndex);
+    EXPECT_EQ(131, maxIndex);
+
+    // New indices are scanned again.
+    GLushort value = 5000;
+    ASSERT_TRUE(buffer.setSubBuffer(12 * sizeof(GLushort), sizeof(value),
+                                    &value));
+    ASSERT_TRUE(buffer.getIndexRange(GL_UNSIGNED_SHORT, 8, 16, &minIndex,
+                                     &maxIndex));
+    EXPECT_EQ(7, minIndex);
+    EXPECT_EQ(5000, maxIndex);
+
+    ASSERT_TRUE(buffer.setBuffer(sizeof(data), GL_STATIC_DRAW, data));
+    ASSERT_TRUE(buffer.getIndexRange(GL_UNSIGNED_SHORT, 8, 16, &minIndex,
+                                     &maxIndex));
+    EXPECT_EQ(104, minIndex);
+    EXPECT_EQ(119, maxIndex);
+
+    // Indices past the end of the buffer aren't read.
+    EXPECT_FALSE(buffer.getIndexRange(GL_UNSIGNED_SHORT, 8, 29, &minIndex,
+                                      &maxIndex));
+    EXPECT_FALSE(buffer.getIndexRange(GL_UNSIGNED_BYTE, 65, 0, &minIndex,
+                                      &maxIndex));
+}
@@ -164,40 +164,22 @@ inline int convertDiff(int base, int diff) {
 }
 
 static
-void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
-        etc1_uint32 low, bool second, bool flipped) {
-    int baseX = 0;
-    int baseY = 0;
-    if (second) {
-        if (flipped) {
-            baseY = 2;
-        } else {
-            baseX = 2;
-        }
-    }
-    for (int i = 0; i < 8; i++) {
-        int x, y;
-        if (flipped) {
-            x = baseX + (i >> 1);
-            y = baseY + (i & 1);
-        } else {
-            x = baseX + (i >> 2);
-            y = baseY + (i & 3);
-        }
-        int k = y + (x * 4);
-        int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
-        int delta = table[offset];
-        etc1_byte* q = pOut + 3 * (x + 4 * y);
-        *q++ = clamp(r + delta);
-        *q++ = clamp(g + delta);
-        *q++ = clamp(b + delta);
+void decode_subblock_colors(etc1_byte* pColors, int r, int g, int b,
+        const int* table) {
+    for (int i = 0; i < 4; i++) {
+        int delta = table[i];
+        *pColors++ = clamp(r + delta);
+        *pColors++ = clamp(g + delta);
+        *pColors++ = clamp(b + delta);
     }
 }
 
-// Input is an ETC1 compressed version of the data.
-// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
+// Decode a block to 4 rows of 4 3-byte pixels, |stride| bytes apart. Each
+// sub-block only has 4 possible colors, so they're computed first, and
+// each pixel is a copy of the one selected by its index bits.
 
-void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+static
+void decode_block(const etc1_byte* pIn, etc1_byte* pOut, etc1_uint32 stride) {
     etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
     etc1_uint32 low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
     int r1, r2, g1, g2, b1, b2;
@@ -223,11 +205,35 @@ void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
     }
     int tableIndexA = 7 & (high >> 5);
     int tableIndexB = 7 & (high >> 2);
-    const int* tableA = kModifierTable + tableIndexA * 4;
-    const int* tableB = kModifierTable + tableIndexB * 4;
+    etc1_byte colors[2][12];
+    decode_subblock_colors(colors[0], r1, g1, b1, kModifierTable + tableIndexA * 4);
+    decode_subblock_colors(colors[1], r2, g2, b2, kModifierTable + tableIndexB * 4);
     bool flipped = (high & 1) != 0;
-    decode_subblock(pOut, r1, g1, b1, tableA, low, false, flipped);
-    decode_subblock(pOut, r2, g2, b2, tableB, low, true, flipped);
+    for (int y = 0; y < 4; y++) {
+        etc1_byte* q = pOut + stride * y;
+        // The left and right halves of the row, both in the same sub-block
+        // when the block is flipped.
+        const etc1_byte* left = colors[flipped ? (y >> 1) : 0];
+        const etc1_byte* right = colors[flipped ? (y >> 1) : 1];
+        etc1_uint32 bits = (low >> y) & 0x1111;
+        etc1_uint32 msb = (low >> (y + 15)) & 0x2222;
+        bits |= msb;
+        const etc1_byte* c0 = left + 3 * (bits & 3);
+        const etc1_byte* c1 = left + 3 * ((bits >> 4) & 3);
+        const etc1_byte* c2 = right + 3 * ((bits >> 8) & 3);
+        const etc1_byte* c3 = right + 3 * ((bits >> 12) & 3);
+        q[0] = c0[0]; q[1] = c0[1]; q[2] = c0[2];
+        q[3] = c1[0]; q[4] = c1[1]; q[5] = c1[2];
+        q[6] = c2[0]; q[7] = c2[1]; q[8] = c2[2];
+        q[9] = c3[0]; q[10] = c3[1]; q[11] = c3[2];
+    }
+}
+
+// Input is an ETC1 compressed version of the data.
+// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
+
+void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+    decode_block(pIn, pOut, 4 * 3);
 }
 
 typedef struct {
@@ -586,6 +592,12 @@ int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
             if (xEnd > 4) {
                 xEnd = 4;
             }
+            if (pixelSize == 3 && xEnd == 4 && yEnd == 4) {
+                // Complete RGB blocks are decoded in place.
+                decode_block(pIn, pOut + 3 * x + stride * y, stride);
+                pIn += ETC1_ENCODED_BLOCK_SIZE;
+                continue;
+            }
             etc1_decode_block(pIn, block);
             pIn += ETC1_ENCODED_BLOCK_SIZE;
             for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
@@ -0,0 +1,252 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <GLcommon/Etc1Decoder.h>
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <vector>
+
+namespace {
+
+// The per-pixel block decoder used before the color tables, straight from
+// the OES_compressed_ETC1_RGB8_texture specification.
+const int kModifierTable[] = {
+    2, 8, -2, -8,     5, 17, -5, -17,    9, 29, -9, -29,
+    13, 42, -13, -42, 18, 60, -18, -60,  24, 80, -24, -80,
+    33, 106, -33, -106, 47, 183, -47, -183 };
+
+const int kLookup[8] = { 0, 1, 2, 3, -4, -3, -2, -1 };
+
+etc1_byte clamp(int x) {
+    return (etc1_byte) (x >= 0 ? (x < 255 ? x : 255) : 0);
+}
+
+int convert4To8(int b) {
+    int c = b & 0xf;
+    return (c << 4) | c;
+}
+
+int convert5To8(int b) {
+    int c = b & 0x1f;
+    return (c << 3) | (c >> 2);
+}
+
+int convertDiff(int base, int diff) {
+    return convert5To8((0x1f & base) + kLookup[0x7 & diff]);
+}
+
+void referenceDecodeSubblock(etc1_byte* pOut, int r, int g, int b,
+                             const int* table, etc1_uint32 low,
+                             bool second, bool flipped) {
+    int baseX = 0;
+    int baseY = 0;
+    if (second) {
+        if (flipped) {
+            baseY = 2;
+        } else {
+            baseX = 2;
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        int x, y;
+        if (flipped) {
+            x = baseX + (i >> 1);
+            y = baseY + (i & 1);
+        } else {
+            x = baseX + (i >> 2);
+            y = baseY + (i & 3);
+        }
+        int k = y + (x * 4);
+        int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
+        int delta = table[offset];
+        etc1_byte* q = pOut + 3 * (x + 4 * y);
+        *q++ = clamp(r + delta);
+        *q++ = clamp(g + delta);
+        *q++ = clamp(b + delta);
+    }
+}
+
+void referenceDecodeBlock(const etc1_byte* pIn, etc1_byte* pOut) {
+    etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
+    etc1_uint32 low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
+    int r1, r2, g1, g2, b1, b2;
+    if (high & 2) {
+        int rBase = high >> 27;
+        int gBase = high >> 19;
+        int bBase = high >> 11;
+        r1 = convert5To8(rBase);
+        r2 = convertDiff(rBase, high >> 24);
+        g1 = convert5To8(gBase);
+        g2 = convertDiff(gBase, high >> 16);
+        b1 = convert5To8(bBase);
+        b2 = convertDiff(bBase, high >> 8);
+    } else {
+        r1 = convert4To8(high >> 28);
+        r2 = convert4To8(high >> 24);
+        g1 = convert4To8(high >> 20);
+        g2 = convert4To8(high >> 16);
+        b1 = convert4To8(high >> 12);
+        b2 = convert4To8(high >> 8);
+    }
+    const int* tableA = kModifierTable + (7 & (high >> 5)) * 4;
+    const int* tableB = kModifierTable + (7 & (high >> 2)) * 4;
+    bool flipped = (high & 1) != 0;
+    referenceDecodeSubblock(pOut, r1, g1, b1, tableA, low, false, flipped);
+    referenceDecodeSubblock(pOut, r2, g2, b2, tableB, low, true, flipped);
+}
+
+// Fill |size| bytes with a deterministic pseudo-random sequence.
+void fillRandom(etc1_byte* data, size_t size, etc1_uint32 seed) {
+    for (size_t n = 0; n < size; ++n) {
+        seed = seed * 1103515245U + 12345U;
+        data[n] = (etc1_byte)(seed >> 16);
+    }
+}
+
+}  // namespace
+
+TEST(Etc1, DecodeBlockMatchesReference) {
+    etc1_byte encoded[ETC1_ENCODED_BLOCK_SIZE];
+    for (etc1_uint32 n = 0; n < 20000; ++n) {
+        fillRandom(encoded, sizeof(encoded), n);
+        etc1_byte expected[ETC1_DECODED_BLOCK_SIZE];
+        etc1_byte decoded[ETC1_DECODED_BLOCK_SIZE];
+        referenceDecodeBlock(encoded, expected);
+        etc1_decode_block(encoded, decoded);
+        ASSERT_EQ(0, memcmp(expected, decoded, sizeof(decoded)))
+                << "block " << n;
+    }
+}
+
+TEST(Etc1, DecodeImageMatchesReference) {
+    // Sizes which aren't multiples of the block size have partial blocks
+    // on the right and bottom edges.
+    const etc1_uint32 kSizes[][2] = { {1, 1}, {4, 4}, {7, 5}, {16, 12},
+                                      {33, 18} };
+    for (size_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); ++s) {
+        const etc1_uint32 width = kSizes[s][0];
+        const etc1_uint32 height = kSizes[s][1];
+        const etc1_uint32 blocksX = (width + 3) / 4;
+        const etc1_uint32 blocksY = (height + 3) / 4;
+        std::vector<etc1_byte> encoded(etc1_get_encoded_data_size(width, height));
+        fillRandom(&encoded[0], encoded.size(), width * 100 + height);
+
+        for (etc1_uint32 pixelSize = 2; pixelSize <= 3; ++pixelSize) {
+            // Use padded rows to check the stride.
+            const etc1_uint32 stride = width * pixelSize + 5;
+            std::vector<etc1_byte> decoded(stride * height, 0xcd);
+            ASSERT_EQ(0, etc1_decode_image(&encoded[0], &decoded[0],
+                                           width, height, pixelSize, stride));
+
+            for (etc1_uint32 by = 0; by < blocksY; ++by) {
+                for (etc1_uint32 bx = 0; bx < blocksX; ++bx) {
+                    etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
+                    referenceDecodeBlock(
+                            &encoded[(by * blocksX + bx) * ETC1_ENCODED_BLOCK_SIZE],
+                            block);
+                    for (etc1_uint32 y = by * 4; y < by * 4 + 4 && y < height; ++y) {
+                        for (etc1_uint32 x = bx * 4; x < bx * 4 + 4 && x < width; ++x) {
+                            const etc1_byte* q = block + 3 * ((x - bx * 4) + 4 * (y - by * 4));
+                            const etc1_byte* p = &decoded[y * stride + x * pixelSize];
+                            if (pixelSize == 3) {
+                                ASSERT_EQ(q[0], p[0]);
+                                ASSERT_EQ(q[1], p[1]);
+                                ASSERT_EQ(q[2], p[2]);
+                            } else {
+                                etc1_uint32 pixel = ((q[0] >> 3) << 11) |
+                                                    ((q[1] >> 2) << 5) |
+                                                    (q[2] >> 3);
+                                ASSERT_EQ(pixel, (etc1_uint32)(p[0] | (p[1] << 8)));
+                            }
+                        }
+                    }
+                }
+            }
+            // The row padding is left untouched.
+            for (etc1_uint32 y = 0; y < height; ++y) {
+                for (etc1_uint32 x = width * pixelSize; x < stride; ++x) {
+                    ASSERT_EQ(0xcd, decoded[y * stride + x]);
+                }
+            }
+        }
+    }
+}
+
+TEST(Etc1, ParallelDecodeMatchesSerialDecode) {
+    // Large enough to use several threads, with a partial last band.
+    const etc1_uint32 width = 517;
+    const etc1_uint32 height = 301;
+    const etc1_uint32 stride = width * 3 + 1;
+    std::vector<etc1_byte> encoded(etc1_get_encoded_data_size(width, height));
+    fillRandom(&encoded[0], encoded.size(), 42);
+
+    std::vector<etc1_byte> expected(stride * height, 0);
+    std::vector<etc1_byte> decoded(stride * height, 0);
+    ASSERT_EQ(0, etc1_decode_image(&encoded[0], &expected[0],
+                                   width, height, 3, stride));
+    decodeEtc1Image(&encoded[0], &decoded[0], width, height, stride);
+    EXPECT_TRUE(expected == decoded);
+}
+
+TEST(Etc1, DecodeCache) {
+    const etc1_uint32 width = 64;
+    const etc1_uint32 height = 64;
+    const etc1_uint32 stride = width * 3;
+    const size_t encodedSize = etc1_get_encoded_data_size(width, height);
+    const size_t entrySize = encodedSize + stride * height;
+    // Room for two images.
+    Etc1DecodeCache cache(2 * entrySize);
+
+    std::vector<etc1_byte> images[3];
+    for (int n = 0; n < 3; ++n) {
+        images[n].resize(encodedSize);
+        fillRandom(&images[n][0], encodedSize, n + 1);
+    }
+
+    Etc1DecodeCache::ImagePtr first =
+            cache.decode(&images[0][0], encodedSize, width, height, stride);
+    std::vector<etc1_byte> expected(stride * height);
+    etc1_decode_image(&images[0][0], &expected[0], width, height, 3, stride);
+    EXPECT_TRUE(expected == *first.Ptr());
+    EXPECT_EQ(0U, cache.hits());
+
+    // The same data, from another buffer, is found in the cache.
+    std::vector<etc1_byte> copy(images[0]);
+    Etc1DecodeCache::ImagePtr again =
+            cache.decode(&copy[0], encodedSize, width, height, stride);
+    EXPECT_EQ(1U, cache.hits());
+    EXPECT_EQ(first.Ptr(), again.Ptr());
+
+    // A different stride is a different image.
+    cache.decode(&images[0][0], encodedSize, width, height - 4, stride);
+    EXPECT_EQ(1U, cache.hits());
+
+    // One changed byte is enough to miss.
+    copy[encodedSize / 2] ^= 1;
+    cache.decode(&copy[0], encodedSize, width, height, stride);
+    EXPECT_EQ(1U, cache.hits());
+
+    // Adding two images drops the least recently used one, but the images
+    // returned before remain valid.
+    cache.decode(&images[1][0], encodedSize, width, height, stride);
+    cache.decode(&images[2][0], encodedSize, width, height, stride);
+    cache.decode(&images[0][0], encodedSize, width, height, stride);
+    EXPECT_EQ(1U, cache.hits());
+    EXPECT_TRUE(expected == *first.Ptr());
+    cache.decode(&images[2][0], encodedSize, width, height, stride);
+    EXPECT_EQ(2U, cache.hits());
+}
@@ -17,19 +17,92 @@
 #include <GLcommon/objectNameManager.h>
 #include <GLcommon/GLEScontext.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+
+// Full memory barrier, used to publish a new page of names to the
+// threads reading it without the lock.
+inline void memoryBarrier() {
+#ifdef _WIN32
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+}
+
+}  // namespace
 
 NameSpace::NameSpace(NamedObjectType p_type,
                      GlobalNameSpace *globalNameSpace) :
     m_nextName(0),
+    m_sparseNames(),
     m_type(p_type),
-    m_globalNameSpace(globalNameSpace) {}
+    m_globalNameSpace(globalNameSpace) {
+    for (int i = 0; i < kMaxPages; i++) {
+        m_pages[i] = NULL;
+    }
+}
 
 NameSpace::~NameSpace()
 {
-    for (NamesMap::iterator n = m_localToGlobalMap.begin();
-         n != m_localToGlobalMap.end();
+    for (int i = 0; i < kMaxPages; i++) {
+        NamePage *page = m_pages[i];
+        if (!page) continue;
+        for (int j = 0; j < kPageSize; j++) {
+            if (page->entries[j].isObject) {
+                m_globalNameSpace->deleteName(m_type,
+                                              page->entries[j].globalName);
+            }
+        }
+        delete page;
+    }
+    for (SparseNamesMap::iterator n = m_sparseNames.begin();
+         n != m_sparseNames.end();
          n++) {
-        m_globalNameSpace->deleteName(m_type, (*n).second);
+        if ((*n).second.isObject) {
+            m_globalNameSpace->deleteName(m_type, (*n).second.globalName);
+        }
+    }
+}
+
+NameSpace::NameEntry *
+NameSpace::findEntry(ObjectLocalName p_localName)
+{
+    if (p_localName < kDenseNames) {
+        NamePage *page = m_pages[p_localName >> kPageShift];
+        if (!page) return NULL;
+        return &page->entries[p_localName & (kPageSize - 1)];
+    }
+    SparseNamesMap::iterator n( m_sparseNames.find(p_localName) );
+    if (n == m_sparseNames.end()) return NULL;
+    return &(*n).second;
+}
+
+NameSpace::NameEntry *
+NameSpace::getEntry(ObjectLocalName p_localName)
+{
+    if (p_localName < kDenseNames) {
+        NamePage *page = m_pages[p_localName >> kPageShift];
+        if (!page) {
+            page = new NamePage();
+            // Make the initialized page visible before its pointer.
+            memoryBarrier();
+            m_pages[p_localName >> kPageShift] = page;
+        }
+        return &page->entries[p_localName & (kPageSize - 1)];
+    }
+    return &m_sparseNames[p_localName];
+}
+
+void
+NameSpace::releaseEntry(ObjectLocalName p_localName, NameEntry *entry)
+{
+    // Dense entries stay allocated, since they may be read without lock.
+    if (p_localName >= kDenseNames && !entry->isObject && !entry->data.Ptr()) {
+        m_sparseNames.erase(p_localName);
     }
 }
 
@@ -41,14 +114,14 @@ NameSpace::genName(ObjectLocalName p_localName,
     if (genLocal) {
         do {
             localName = ++m_nextName;
-        } while(localName == 0 ||
-                m_localToGlobalMap.find(localName) !=
-                        m_localToGlobalMap.end() );
+        } while(localName == 0 || isObject(localName));
     }
 
     if (genGlobal) {
         unsigned int globalName = m_globalNameSpace->genName(m_type);
-        m_localToGlobalMap[localName] = globalName;
+        NameEntry *entry = getEntry(localName);
+        entry->globalName = globalName;
+        entry->isObject = true;
     }
 
     return localName;
@@ -64,21 +137,46 @@ NameSpace::genGlobalName(void)
 unsigned int
 NameSpace::getGlobalName(ObjectLocalName p_localName)
 {
-    NamesMap::iterator n( m_localToGlobalMap.find(p_localName) );
-    if (n != m_localToGlobalMap.end()) {
+    NameEntry *entry = findEntry(p_localName);
+    if (entry && entry->isObject) {
         // object found - return its global name map
-        return (*n).second;
+        return entry->globalName;
     }
 
     // object does not exist;
     return 0;
 }
 
+bool
+NameSpace::getDenseGlobalName(ObjectLocalName p_localName,
+                              unsigned int *p_globalName) const
+{
+    if (p_localName >= kDenseNames) return false;
+
+    // The global name of an entry which isn't an object is always 0, so
+    // there is no need to look at isObject.
+    const NamePage *page = m_pages[p_localName >> kPageShift];
+    *p_globalName = page ?
+            page->entries[p_localName & (kPageSize - 1)].globalName : 0;
+    return true;
+}
+
 ObjectLocalName
 NameSpace::getLocalName(unsigned int p_globalName)
 {
-    for(NamesMap::iterator it = m_localToGlobalMap.begin(); it != m_localToGlobalMap.end();it++){
-        if((*it).second == p_globalName){
+    for (int i = 0; i < kMaxPages; i++) {
+        const NamePage *page = m_pages[i];
+        if (!page) continue;
+        for (int j = 0; j < kPageSize; j++) {
+            if (page->entries[j].isObject &&
+                page->entries[j].globalName == p_globalName) {
+                // object found - return its local name
+                return ((ObjectLocalName)i << kPageShift) + j;
+            }
+        }
+    }
+    for(SparseNamesMap::iterator it = m_sparseNames.begin(); it != m_sparseNames.end();it++){
+        if((*it).second.isObject && (*it).second.globalName == p_globalName){
             // object found - return its local name
             return (*it).first;
         }
@@ -91,27 +189,50 @@ NameSpace::getLocalName(unsigned int p_globalName)
 void
 NameSpace::deleteName(ObjectLocalName p_localName)
 {
-    NamesMap::iterator n( m_localToGlobalMap.find(p_localName) );
-    if (n != m_localToGlobalMap.end()) {
-        m_globalNameSpace->deleteName(m_type, (*n).second);
-        m_localToGlobalMap.erase(p_localName);
+    NameEntry *entry = findEntry(p_localName);
+    if (!entry) return;
+    if (entry->isObject) {
+        m_globalNameSpace->deleteName(m_type, entry->globalName);
+        entry->isObject = false;
+        entry->globalName = 0;
     }
+    entry->data = ObjectDataPtr();
+    releaseEntry(p_localName, entry);
 }
 
 bool
 NameSpace::isObject(ObjectLocalName p_localName)
 {
-    return (m_localToGlobalMap.find(p_localName) != m_localToGlobalMap.end() );
+    NameEntry *entry = findEntry(p_localName);
+    return entry && entry->isObject;
 }
 
 void
 NameSpace::replaceGlobalName(ObjectLocalName p_localName, unsigned int p_globalName)
 {
-    NamesMap::iterator n( m_localToGlobalMap.find(p_localName) );
-    if (n != m_localToGlobalMap.end()) {
-        m_globalNameSpace->deleteName(m_type, (*n).second);
-        (*n).second = p_globalName;
+    NameEntry *entry = findEntry(p_localName);
+    if (entry && entry->isObject) {
+        m_globalNameSpace->deleteName(m_type, entry->globalName);
+        entry->globalName = p_globalName;
+    }
+}
+
+void
+NameSpace::setObjectData(ObjectLocalName p_localName, ObjectDataPtr data)
+{
+    // Like std::map::insert(), this doesn't replace existing data.
+    NameEntry *entry = getEntry(p_localName);
+    if (!entry->data.Ptr()) {
+        entry->data = data;
     }
+    releaseEntry(p_localName, entry);
+}
+
+ObjectDataPtr
+NameSpace::getObjectData(ObjectLocalName p_localName)
+{
+    NameEntry *entry = findEntry(p_localName);
+    return entry ? entry->data : ObjectDataPtr();
 }
 
 
@@ -151,15 +272,10 @@ GlobalNameSpace::deleteName(NamedObjectType p_type, unsigned int p_name)
 {
 }
 
-typedef std::pair<NamedObjectType, ObjectLocalName> ObjectIDPair;
-typedef std::map<ObjectIDPair, ObjectDataPtr> ObjectDataMap;
-
 ShareGroup::ShareGroup(GlobalNameSpace *globalNameSpace) : m_lock() {
     for (int i=0; i < NUM_OBJECT_TYPES; i++) {
         m_nameSpace[i] = new NameSpace((NamedObjectType)i, globalNameSpace);
     }
-
-    m_objectsData = NULL;
 }
 
 ShareGroup::~ShareGroup()
@@ -168,8 +284,6 @@ ShareGroup::~ShareGroup()
     for (int t = 0; t < NUM_OBJECT_TYPES; t++) {
         delete m_nameSpace[t];
     }
-
-    delete (ObjectDataMap *)m_objectsData;
 }
 
 ObjectLocalName
@@ -200,6 +314,11 @@ ShareGroup::getGlobalName(NamedObjectType p_type,
 {
     if (p_type >= NUM_OBJECT_TYPES) return 0;
 
+    unsigned int globalName;
+    if (m_nameSpace[p_type]->getDenseGlobalName(p_localName, &globalName)) {
+        return globalName;
+    }
+
     emugl::Mutex::AutoLock _lock(m_lock);
     return m_nameSpace[p_type]->getGlobalName(p_localName);
 }
@@ -221,10 +340,6 @@ ShareGroup::deleteName(NamedObjectType p_type, ObjectLocalName p_localName)
 
     emugl::Mutex::AutoLock _lock(m_lock);
     m_nameSpace[p_type]->deleteName(p_localName);
-    ObjectDataMap *map = (ObjectDataMap *)m_objectsData;
-    if (map) {
-        map->erase( ObjectIDPair(p_type, p_localName) );
-    }
 }
 
 bool
@@ -255,15 +370,7 @@ ShareGroup::setObjectData(NamedObjectType p_type,
     if (p_type >= NUM_OBJECT_TYPES) return;
 
     emugl::Mutex::AutoLock _lock(m_lock);
-
-    ObjectDataMap *map = (ObjectDataMap *)m_objectsData;
-    if (!map) {
-        map = new ObjectDataMap();
-        m_objectsData = map;
-    }
-
-    ObjectIDPair id( p_type, p_localName );
-    map->insert( std::pair<ObjectIDPair, ObjectDataPtr>(id, data) );
+    m_nameSpace[p_type]->setObjectData(p_localName, data);
 }
 
 ObjectDataPtr
@@ -275,14 +382,7 @@ ShareGroup::getObjectData(NamedObjectType p_type,
     if (p_type >= NUM_OBJECT_TYPES) return ret;
 
     emugl::Mutex::AutoLock _lock(m_lock);
-
-    ObjectDataMap *map = (ObjectDataMap *)m_objectsData;
-    if (map) {
-        ObjectDataMap::iterator i =
-                map->find( ObjectIDPair(p_type, p_localName) );
-        if (i != map->end()) ret = (*i).second;
-    }
-    return ret;
+    return m_nameSpace[p_type]->getObjectData(p_localName);
 }
 
 ObjectNameManager::ObjectNameManager(GlobalNameSpace *globalNameSpace) :
@@ -0,0 +1,180 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <GLcommon/objectNameManager.h>
+
+#include "emugl/common/mutex.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <stdio.h>
+#include <time.h>
+
+namespace {
+
+// The SHADER name space doesn't allocate names from the GL dispatcher,
+// so it can be used without a GL library. Global names are assigned with
+// replaceGlobalName() instead.
+const NamedObjectType kType = SHADER;
+
+class TestData : public ObjectData {
+public:
+    explicit TestData(int value) : ObjectData(BUFFER_DATA), mValue(value) {}
+    int value() const { return mValue; }
+private:
+    int mValue;
+};
+
+int dataValue(const ObjectDataPtr& data) {
+    return data.Ptr() ? static_cast<TestData*>(data.Ptr())->value() : -1;
+}
+
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+}  // namespace
+
+TEST(ObjectNameManager, GenAndDeleteNames) {
+    GlobalNameSpace globalNameSpace;
+    ObjectNameManager manager(&globalNameSpace);
+    ShareGroupPtr group = manager.createShareGroup(&manager);
+
+    // Small names, large names and names out of the 32-bit range.
+    const ObjectLocalName kNames[] = {
+        1, 2, 255, 256, 1000, 65535, 65536, 1000000, 1ULL << 40,
+    };
+    const size_t kCount = sizeof(kNames) / sizeof(kNames[0]);
+    for (size_t n = 0; n < kCount; n++) {
+        EXPECT_FALSE(group->isObject(kType, kNames[n]));
+        EXPECT_EQ(0U, group->getGlobalName(kType, kNames[n]));
+        EXPECT_EQ(kNames[n], group->genName(kType, kNames[n], false));
+        EXPECT_TRUE(group->isObject(kType, kNames[n]));
+        group->replaceGlobalName(kType, kNames[n], 100 + n);
+    }
+    for (size_t n = 0; n < kCount; n++) {
+        EXPECT_EQ(100 + n, group->getGlobalName(kType, kNames[n]));
+        EXPECT_EQ(kNames[n], group->getLocalName(kType, 100 + n));
+        // Other name spaces are separate.
+        EXPECT_EQ(0U, group->getGlobalName(TEXTURE, kNames[n]));
+    }
+    for (size_t n = 0; n < kCount; n += 2) {
+        group->deleteName(kType, kNames[n]);
+    }
+    for (size_t n = 0; n < kCount; n++) {
+        bool deleted = (n % 2) == 0;
+        EXPECT_EQ(!deleted, group->isObject(kType, kNames[n]));
+        EXPECT_EQ(deleted ? 0U : 100 + n,
+                  group->getGlobalName(kType, kNames[n]));
+    }
+    // replaceGlobalName() ignores names which don't exist.
+    group->replaceGlobalName(kType, kNames[0], 42);
+    EXPECT_FALSE(group->isObject(kType, kNames[0]));
+    EXPECT_EQ(0U, group->getGlobalName(kType, kNames[0]));
+
+    manager.deleteShareGroup(&manager);
+}
+
+TEST(ObjectNameManager, GenLocalNamesSkipsExistingOnes) {
+    GlobalNameSpace globalNameSpace;
+    ObjectNameManager manager(&globalNameSpace);
+    ShareGroupPtr group = manager.createShareGroup(&manager);
+
+    group->genName(kType, 2, false);
+    group->genName(kType, 3, false);
+    EXPECT_EQ(1U, group->genName(kType, 0, true));
+    EXPECT_EQ(4U, group->genName(kType, 0, true));
+    EXPECT_EQ(5U, group->genName(kType, 0, true));
+
+    manager.deleteShareGroup(&manager);
+}
+
+TEST(ObjectNameManager, ObjectData) {
+    GlobalNameSpace globalNameSpace;
+    ObjectNameManager manager(&globalNameSpace);
+    ShareGroupPtr group = manager.createShareGroup(&manager);
+
+    const ObjectLocalName kNames[] = { 7, 300000, 1ULL << 33 };
+    for (size_t n = 0; n < 3; n++) {
+        group->genName(kType, kNames[n], false);
+        EXPECT_EQ(-1, dataValue(group->getObjectData(kType, kNames[n])));
+        group->setObjectData(kType, kNames[n],
+                             ObjectDataPtr(new TestData(n)));
+        // Existing data isn't replaced.
+        group->setObjectData(kType, kNames[n],
+                             ObjectDataPtr(new TestData(10 + n)));
+    }
+    for (size_t n = 0; n < 3; n++) {
+        EXPECT_EQ((int)n, dataValue(group->getObjectData(kType, kNames[n])));
+        EXPECT_EQ(-1, dataValue(group->getObjectData(TEXTURE, kNames[n])));
+    }
+    for (size_t n = 0; n < 3; n++) {
+        group->deleteName(kType, kNames[n]);
+        EXPECT_EQ(-1, dataValue(group->getObjectData(kType, kNames[n])));
+    }
+
+    manager.deleteShareGroup(&manager);
+}
+
+// Compare the cost of ShareGroup::getGlobalName() with the previous
+// implementation, a std::map lookup under a mutex. Run it explicitly with
+// --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+TEST(ObjectNameManager, DISABLED_Benchmark) {
+    GlobalNameSpace globalNameSpace;
+    ObjectNameManager manager(&globalNameSpace);
+    ShareGroupPtr group = manager.createShareGroup(&manager);
+
+    const unsigned int kNames = 1000;
+    const int kRounds = 10000;
+    std::map<ObjectLocalName, unsigned int> reference;
+    emugl::Mutex referenceLock;
+    for (unsigned int n = 1; n <= kNames; n++) {
+        group->genName(kType, n, false);
+        group->replaceGlobalName(kType, n, n + 1);
+        reference[n] = n + 1;
+    }
+
+    unsigned long long sum = 0;
+    double start = nowSeconds();
+    for (int round = 0; round < kRounds; round++) {
+        for (unsigned int n = 1; n <= kNames; n++) {
+            emugl::Mutex::AutoLock lock(referenceLock);
+            std::map<ObjectLocalName, unsigned int>::iterator it =
+                    reference.find(n);
+            sum += it != reference.end() ? it->second : 0;
+        }
+    }
+    double referenceTime = nowSeconds() - start;
+
+    start = nowSeconds();
+    for (int round = 0; round < kRounds; round++) {
+        for (unsigned int n = 1; n <= kNames; n++) {
+            sum += group->getGlobalName(kType, n);
+        }
+    }
+    double currentTime = nowSeconds() - start;
+
+    unsigned long long expected = (kNames + 3ULL) * kNames / 2 * kRounds;
+    EXPECT_EQ(2 * expected, sum);
+    double lookups = (double)kNames * kRounds;
+    printf("std::map with lock: %.1f ns/lookup\n",
+           referenceTime * 1e9 / lookups);
+    printf("ShareGroup::getGlobalName: %.1f ns/lookup\n",
+           currentTime * 1e9 / lookups);
+
+    manager.deleteShareGroup(&manager);
+}
@@ -0,0 +1,81 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef ETC1_DECODER_H
+#define ETC1_DECODER_H
+
+#include "emugl/common/mutex.h"
+#include "emugl/common/smart_ptr.h"
+
+#include "etc1.h"
+
+#include <stddef.h>
+
+#include <list>
+#include <vector>
+
+// Decode |width| x |height| ETC1 pixels from |pIn| to RGB rows of |stride|
+// bytes at |pOut|, like etc1_decode_image(). Large images are split in
+// bands of blocks, which are decoded by several threads.
+void decodeEtc1Image(const etc1_byte* pIn, etc1_byte* pOut,
+                     etc1_uint32 width, etc1_uint32 height,
+                     etc1_uint32 stride);
+
+// A cache of recently decoded ETC1 images. Guests upload the same
+// textures again, e.g. after they lost their context, and finding the
+// decoded image here is much faster than decoding it again.
+//
+// Entries are compared on their complete compressed data, so a matching
+// hash is not enough to return the wrong image. The least recently used
+// entries are dropped to keep the decoded images under a size budget.
+class Etc1DecodeCache {
+public:
+    typedef emugl::SmartPtr<std::vector<etc1_byte> > ImagePtr;
+
+    // Keep at most |maxBytes| of decoded images.
+    explicit Etc1DecodeCache(size_t maxBytes);
+
+    // Return the cache shared by all contexts.
+    static Etc1DecodeCache* get();
+
+    // Return the RGB image decoded from the |size| bytes at |data|, with
+    // rows of |stride| bytes, decoding it if it isn't in the cache. The
+    // image remains valid until the returned pointer is released.
+    ImagePtr decode(const etc1_byte* data, size_t size,
+                    etc1_uint32 width, etc1_uint32 height,
+                    etc1_uint32 stride);
+
+    // Number of decode() calls served from the cache.
+    size_t hits() const { return m_hits; }
+
+private:
+    struct Entry {
+        unsigned int hash;
+        etc1_uint32 width;
+        etc1_uint32 height;
+        etc1_uint32 stride;
+        std::vector<etc1_byte> compressed;
+        ImagePtr decoded;
+    };
+    typedef std::list<Entry> EntryList;
+
+    size_t       m_maxBytes;
+    size_t       m_bytes;
+    size_t       m_hits;
+    EntryList    m_entries;  // Most recently used first.
+    emugl::Mutex m_lock;
+};
+
+#endif
@@ -20,6 +20,7 @@
 #include <GLES/gl.h>
 #include <GLcommon/objectNameManager.h>
 #include <GLcommon/RangeManip.h>
+#include <vector>
 
 class GLESbuffer: public ObjectData {
 public:
@@ -31,16 +32,57 @@ public:
    bool  setSubBuffer(GLint offset,GLuint size,const GLvoid* data);
    void  getConversions(const RangeList& rIn,RangeList& rOut);
    bool  fullyConverted(){return m_conversionManager.size() == 0;};
+   // Returns a packed GL_SHORT copy of the first |count| vertices of the
+   // GL_BYTE attribute array with |size| components and |stride| at
+   // |offset| in this buffer. The copy is kept until the buffer data
+   // changes, so unchanged buffers are converted only once. Vertices past
+   // the end of the buffer are set to zero.
+   GLshort* getByteConversion(unsigned int offset,GLsizei stride,GLint size,
+                              unsigned int count);
+   // Store into |*minIndex| and |*maxIndex| the range of the |count|
+   // indices of |type| at |offset| in this buffer, see computeIndexRange().
+   // As the same element array is usually drawn every frame, the ranges
+   // are kept until the indices change. Returns false if the indices are
+   // past the end of the buffer.
+   bool  getIndexRange(GLenum type,unsigned int offset,GLsizei count,
+                       int* minIndex,int* maxIndex);
    void  setBinded(){m_wasBound = true;};
    bool  wasBinded(){return m_wasBound;};
    ~GLESbuffer();
 
 private:
+    struct ByteConversion {
+        unsigned int offset;
+        GLsizei      stride;
+        GLint        size;
+        unsigned int count;
+        GLshort*     data;
+    };
+    // Maximum number of byte array copies kept for a buffer.
+    static const unsigned int kMaxByteConversions = 4;
+
+    struct IndexRange {
+        GLenum       type;
+        unsigned int offset;
+        GLsizei      count;
+        int          minIndex;
+        int          maxIndex;
+    };
+    // Maximum number of index ranges kept for a buffer, which may hold the
+    // indices of several meshes.
+    static const unsigned int kMaxIndexRanges = 8;
+
+    void clearByteConversions();
+    // Forget the index ranges which overlap |size| bytes at |offset|.
+    void clearIndexRanges(unsigned int offset,unsigned int size);
+
     GLuint         m_size;
     GLuint         m_usage;
     unsigned char* m_data;
     RangeList      m_conversionManager;
     bool           m_wasBound;
+    std::vector<ByteConversion> m_byteConversions;
+    std::vector<IndexRange> m_indexRanges;
 };
 
 typedef emugl::SmartPtr<GLESbuffer> GLESbufferPtr;
@@ -20,7 +20,9 @@
 #include "GLDispatch.h"
 #include "GLESpointer.h"
 #include "objectNameManager.h"
+#include "emugl/common/arena.h"
 #include "emugl/common/mutex.h"
+#include <map>
 #include <string>
 
 typedef std::map<GLenum,GLESpointer*>  ArraysMap;
@@ -34,6 +36,7 @@ NUM_TEXTURE_TARGETS
 typedef struct _textureTargetState {
     GLuint texture;
     GLboolean enabled;
+    GLuint hostTexture; // global name bound in the host context, if known
 } textureTargetState;
 
 typedef textureTargetState textureUnitState[NUM_TEXTURE_TARGETS];
@@ -61,7 +64,8 @@ struct GLSupport {
                 GL_ARB_HALF_FLOAT_PIXEL(false), GL_NV_HALF_FLOAT(false), \
                 GL_ARB_HALF_FLOAT_VERTEX(false),GL_SGIS_GENERATE_MIPMAP(false),
                 GL_ARB_ES2_COMPATIBILITY(false),GL_OES_STANDARD_DERIVATIVES(false),
-                GL_OES_TEXTURE_NPOT(false), GL_OES_RGB8_RGBA8(false) {} ;
+                GL_OES_TEXTURE_NPOT(false), GL_OES_RGB8_RGBA8(false),
+                GL_ARB_GET_PROGRAM_BINARY(false) {} ;
     int  maxLights;
     int  maxVertexAttribs;
     int  maxClipPlane;
@@ -84,6 +88,7 @@ struct GLSupport {
     bool GL_OES_TEXTURE_NPOT;
     bool GL_OES_RGB8_RGBA8;
     bool GL_EXT_TEXTURE_STORAGE;
+    bool GL_ARB_GET_PROGRAM_BINARY;
 
 };
 
@@ -99,10 +104,14 @@ struct ArrayData{
     bool         allocated;
 };
 
+// The client arrays converted for a single draw call. The converted data
+// and the table of arrays are taken from the thread's arena, and released
+// all at once when the instance goes out of scope, so that drawing doesn't
+// touch the heap once the arena has grown large enough.
 class GLESConversionArrays
 {
 public:
-    GLESConversionArrays():m_current(0){};
+    GLESConversionArrays();
     void setArr(void* data,unsigned int stride,GLenum type);
     void allocArr(unsigned int size,GLenum type);
     ArrayData& operator[](int i);
@@ -111,9 +120,12 @@ public:
     unsigned int getCurrentIndex();
     void operator++();
 
-    ~GLESConversionArrays();
 private:
-    std::map<GLenum,ArrayData> m_arrays;
+    ArrayData& getArray(unsigned int i);
+
+    emugl::Arena::Frame m_frame;
+    ArrayData* m_arrays;
+    unsigned int m_capacity;
     unsigned int m_current;
 };
 
@@ -168,13 +180,41 @@ public:
 
     static GLDispatch& dispatcher(){return s_glDispatch;};
 
+    // Redundant state filter: each filter*() method records the state set
+    // by a call and returns true if the host context already has it, in
+    // which case the call isn't forwarded to the driver.
+    bool filterEnable(GLenum cap, bool enable);
+    bool filterBlendFunc(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha);
+    bool filterBlendEquation(GLenum modeRGB, GLenum modeAlpha);
+    bool filterDepthFunc(GLenum func);
+    bool filterDepthMask(GLboolean flag);
+    bool filterBindTexture(GLenum target, GLuint globalTextureName);
+    // Forget the host texture bound to |target| on the active unit, after
+    // binding one without going through filterBindTexture().
+    void invalidateTextureBinding(GLenum target);
+    // Must be called when textures are deleted in any context, since the
+    // driver may then give their names to new textures.
+    static void onTexturesDeleted();
+    // Count a call elided by the caller's own state tracking.
+    static void countElidedCall();
+    // Return the number of calls elided in all the contexts since the
+    // previous call.
+    static unsigned int takeElidedCallCount();
+
     static int getMaxLights(){return s_glSupport.maxLights;}
     static int getMaxClipPlanes(){return s_glSupport.maxClipPlane;}
     static int getMaxTexSize(){return s_glSupport.maxTexSize;}
     static Version glslVersion(){return s_glSupport.glslVersion;}
     static bool isAutoMipmapSupported(){return s_glSupport.GL_SGIS_GENERATE_MIPMAP;}
+    static bool isProgramBinarySupported(){return s_glSupport.GL_ARB_GET_PROGRAM_BINARY;}
     static TextureTarget GLTextureTargetToLocal(GLenum target);
-    static int findMaxIndex(GLsizei count,GLenum type,const GLvoid* indices);
+    // Store into |*minIndex| and |*maxIndex| the range of the |count|
+    // indices of |type| at |indices|. The range of the indices of the
+    // bound element array buffer is cached by the buffer.
+    void getIndexRange(GLsizei count,GLenum type,const GLvoid* indices,int* minIndex,int* maxIndex);
+    // Return the host implementation limit |pname| in |*params|. Limits
+    // can't change, so the driver is only queried the first time.
+    static void getHostLimit(GLenum pname, GLint* params);
 
     virtual bool glGetIntegerv(GLenum pname, GLint *params);
     virtual bool glGetBooleanv(GLenum pname, GLboolean *params);
@@ -188,6 +228,7 @@ protected:
     void convertDirectVBO(GLESConversionArrays& fArrs,GLint first,GLsizei count,GLenum array_id,GLESpointer* p);
     void convertIndirect(GLESConversionArrays& fArrs,GLsizei count,GLenum type,const GLvoid* indices,GLenum array_id,GLESpointer* p);
     void convertIndirectVBO(GLESConversionArrays& fArrs,GLsizei count,GLenum indices_type,const GLvoid* indices,GLenum array_id,GLESpointer* p);
+    void convertByteVBO(GLESConversionArrays& fArrs,unsigned int nVertices,GLESpointer* p);
     void initCapsLocked(const GLubyte * extensionString);
     virtual void initExtensionString() =0;
 
@@ -199,6 +240,7 @@ protected:
     ArraysMap             m_map;
     static std::string*   s_glExtensions;
     static GLSupport      s_glSupport;
+    static std::map<GLenum,GLint> s_hostLimits;
 
 private:
 
@@ -210,6 +252,19 @@ private:
     textureUnitState*     m_texState;
     unsigned int          m_arrayBuffer;
     unsigned int          m_elementBuffer;
+    unsigned int          m_knownCaps;
+    unsigned int          m_enabledCaps;
+    bool                  m_blendFuncKnown;
+    GLenum                m_blendFunc[4];
+    bool                  m_blendEquationKnown;
+    GLenum                m_blendEquation[2];
+    bool                  m_depthFuncKnown;
+    GLenum                m_depthFunc;
+    bool                  m_depthMaskKnown;
+    GLboolean             m_depthMask;
+    unsigned int          m_textureDeletions;
+    static volatile unsigned int s_textureDeletions;
+    static volatile unsigned int s_elidedCalls;
     GLuint                m_renderbuffer;
     GLuint                m_framebuffer;
 
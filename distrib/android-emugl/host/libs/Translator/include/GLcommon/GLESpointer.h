@@ -36,6 +36,7 @@ public:
     void          redirectPointerData();
     void          getBufferConversions(const RangeList& rl,RangeList& rlOut);
     bool          bufferNeedConversion(){ return !m_buffer->fullyConverted();}
+    GLshort*      getBufferByteConversion(unsigned int count);
     void          setArray (GLint size,GLenum type,GLsizei stride,const GLvoid* data,bool normalize = false);
     void          setBuffer(GLint size,GLenum type,GLsizei stride,GLESbuffer* buf,GLuint bufferName,int offset,bool normalize = false);
     bool          isEnable() const;
@@ -0,0 +1,68 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include "emugl/common/mutex.h"
+
+#include <GLES2/gl2.h>
+
+#include <string>
+#include <vector>
+
+// An on-disk store of linked program binaries, as returned by the host
+// driver's glGetProgramBinary(). Guests link the same programs on every
+// boot, and loading them back with glProgramBinary() is much faster than
+// linking them again.
+//
+// Entries are looked up by an opaque |key| built by the caller, which
+// must contain everything the binary depends on: the translated shader
+// sources, the attribute bindings, and the host renderer and driver
+// version. Each file stores its complete key, so hash collisions and
+// files from another driver can't be mistaken for a match.
+class ProgramBinaryCache {
+public:
+    // Use the files in |dir|, which is created if needed. An empty |dir|
+    // disables the cache.
+    explicit ProgramBinaryCache(const std::string& dir);
+
+    // Return the cache shared by all contexts, which uses the directory
+    // given by ANDROID_EMUGL_PROGRAM_CACHE_DIR, and is disabled if this
+    // variable is not defined.
+    static ProgramBinaryCache* get();
+
+    bool isEnabled() const { return !m_dir.empty(); }
+
+    // Find the binary stored for |key|. On success, return true and set
+    // |*format| and |*binary|.
+    bool load(const std::string& key, GLenum* format, std::vector<char>* binary);
+
+    // Store |size| bytes of |binary| in |format| for |key|, replacing any
+    // previous entry. Errors are ignored, the cache is only an optimization.
+    void store(const std::string& key, GLenum format,
+               const void* binary, size_t size);
+
+    // Remove the entry for |key|, e.g. when the driver rejected it.
+    void remove(const std::string& key);
+
+private:
+    std::string pathFor(const std::string& key) const;
+
+    std::string  m_dir;
+    emugl::Mutex m_lock;
+};
+
+#endif
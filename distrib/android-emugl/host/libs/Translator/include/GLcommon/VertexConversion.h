@@ -0,0 +1,46 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef VERTEX_CONVERSION_H
+#define VERTEX_CONVERSION_H
+
+// Conversion of the vertex attribute types of GLES which desktop GL
+// doesn't support: GL_FIXED is converted to GL_FLOAT, and GL_BYTE
+// to GL_SHORT, and scan of the index arrays of glDrawElements(). These
+// use SSE2 or NEON when the host supports them.
+//
+// Each function converts |count| vertices of |attribSize| components,
+// read every |strideIn| bytes from |dataIn|, and written every |strideOut|
+// bytes to |dataOut|. A stride equal to the size of a vertex is the
+// fastest case, since the vertices are converted as a single array.
+
+// Convert GL_FIXED components to GL_FLOAT. |dataIn| and |dataOut| may be
+// the same array, with the same stride, to convert it in place.
+void convertFixedToFloat(const void* dataIn,unsigned int strideIn,
+                         void* dataOut,unsigned int strideOut,
+                         unsigned int count,int attribSize);
+
+// Convert GL_BYTE components to GL_SHORT.
+void convertByteToShort(const void* dataIn,unsigned int strideIn,
+                        void* dataOut,unsigned int strideOut,
+                        unsigned int count,int attribSize);
+
+// Store into |*minIndex| and |*maxIndex| the smallest and largest of the
+// |count| indices of |type|, GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or
+// GL_UNSIGNED_INT, at |indices|. Both are 0 if |count| is 0.
+void computeIndexRange(const void* indices,unsigned int type,
+                       unsigned int count,int* minIndex,int* maxIndex);
+
+#endif
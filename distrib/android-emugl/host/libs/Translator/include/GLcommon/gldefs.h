@@ -40,3 +40,6 @@ typedef double      GLdouble;   /* double precision float */
 #define GL_TEXTURE_ALPHA_SIZE			0x805F
 #define GL_TEXTURE_DEPTH_SIZE             0x884A
 #define GL_TEXTURE_INTERNAL_FORMAT		0x1003
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH          0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS     0x87FE
@@ -49,7 +49,6 @@ private:
 };
 typedef emugl::SmartPtr<ObjectData> ObjectDataPtr;
 typedef unsigned long long ObjectLocalName;
-typedef std::map<ObjectLocalName, unsigned int> NamesMap;
 
 //
 // Class NameSpace - this class manages allocations and deletions of objects
@@ -91,6 +90,14 @@ private:
     //
     unsigned int getGlobalName(ObjectLocalName p_localName);
 
+    //
+    // getDenseGlobalName - same as getGlobalName, without requiring the
+    //                 ShareGroup lock, for names stored in the dense pages.
+    //                 Returns false if p_localName isn't one of them.
+    //
+    bool getDenseGlobalName(ObjectLocalName p_localName,
+                            unsigned int *p_globalName) const;
+
     //
     // getLocaalName - returns the local name of an object or 0 if the object
     //                 does not exist.
@@ -113,9 +120,47 @@ private:
     //
     void replaceGlobalName(ObjectLocalName p_localName, unsigned int p_globalName);
 
+    //
+    // setObjectData / getObjectData - object global data, see ShareGroup.
+    //
+    void setObjectData(ObjectLocalName p_localName, ObjectDataPtr data);
+    ObjectDataPtr getObjectData(ObjectLocalName p_localName);
+
 private:
+    // State of a local name. An entry can hold object data for a name
+    // which isn't an object.
+    struct NameEntry {
+        NameEntry() : globalName(0), isObject(false), data() {}
+        volatile unsigned int globalName;
+        bool isObject;
+        ObjectDataPtr data;
+    };
+
+    // GL names are small integers, so names below kDenseNames are stored
+    // in pages of entries indexed by name, which are allocated on first
+    // use and never moved, so that getDenseGlobalName() can read them
+    // without locking. Other names are kept in m_sparseNames.
+    enum {
+        kPageShift = 8,
+        kPageSize = 1 << kPageShift,
+        kMaxPages = 256,
+        kDenseNames = kPageSize * kMaxPages
+    };
+    struct NamePage {
+        NameEntry entries[kPageSize];
+    };
+    typedef std::map<ObjectLocalName, NameEntry> SparseNamesMap;
+
+    // Returns the entry of p_localName, or NULL if there is none.
+    NameEntry *findEntry(ObjectLocalName p_localName);
+    // Returns the entry of p_localName, creating it if needed.
+    NameEntry *getEntry(ObjectLocalName p_localName);
+    // Frees the entry of p_localName if it is no longer used.
+    void releaseEntry(ObjectLocalName p_localName, NameEntry *entry);
+
     ObjectLocalName m_nextName;
-    NamesMap m_localToGlobalMap;
+    NamePage * volatile m_pages[kMaxPages];
+    SparseNamesMap m_sparseNames;
     const NamedObjectType m_type;
     GlobalNameSpace *m_globalNameSpace;
 };
@@ -162,7 +207,8 @@ public:
 
     //
     // getGlobalName - retrieves the "global" name of an object or 0 if the
-    //                 object does not exist.
+    //                 object does not exist. This doesn't take the lock for
+    //                 small local names, which most GL names are.
     //
     unsigned int getGlobalName(NamedObjectType p_type, ObjectLocalName p_localName);
 
@@ -206,7 +252,6 @@ private:
 private:
     emugl::Mutex m_lock;
     NameSpace *m_nameSpace[NUM_OBJECT_TYPES];
-    void *m_objectsData;
 };
 
 typedef emugl::SmartPtr<ShareGroup> ShareGroupPtr;
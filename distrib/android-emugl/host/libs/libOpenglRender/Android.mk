@@ -20,6 +20,7 @@ endif
 host_common_SRC_FILES := \
     $(host_OS_SRCS) \
     ColorBuffer.cpp \
+    Compositor.cpp \
     EGLDispatch.cpp \
     FbConfig.cpp \
     FrameBuffer.cpp \
@@ -34,6 +35,7 @@ host_common_SRC_FILES := \
     render_api.cpp \
     RenderWindow.cpp \
     TextureDraw.cpp \
+    VsyncClock.cpp \
     WindowSurface.cpp \
 
 host_common_CFLAGS :=
@@ -84,3 +86,83 @@ LOCAL_STATIC_LIBRARIES += lib64emugl_common
 $(call emugl-export,CFLAGS,$(host_common_CFLAGS))
 
 $(call emugl-end-module)
+
+
+### emugl_render_replay ##################################################
+# Replays the GLES streams recorded with RENDERER_DUMP_DIR=<dir> against a
+# FrameBuffer without a window, to benchmark the renderer.
+$(call emugl-begin-host-executable,emugl_render_replay)
+
+$(call emugl-import,libGLESv1_dec libGLESv2_dec lib_renderControl_dec libOpenglCodecCommon)
+
+LOCAL_LDLIBS += $(host_common_LDLIBS)
+
+LOCAL_SRC_FILES := $(host_common_SRC_FILES) render_replay.cpp
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/include
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/libs/Translator/include
+
+LOCAL_STATIC_LIBRARIES += libemugl_common
+
+LOCAL_CFLAGS += $(host_common_CFLAGS)
+
+$(call emugl-end-module)
+
+
+### emugl_render_replay, 64-bit ##########################################
+$(call emugl-begin-host64-executable,emugl64_render_replay)
+
+$(call emugl-import,lib64GLESv1_dec lib64GLESv2_dec lib64_renderControl_dec lib64OpenglCodecCommon)
+
+LOCAL_LDLIBS += $(host_common_LDLIBS)
+
+LOCAL_SRC_FILES := $(host_common_SRC_FILES) render_replay.cpp
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/include
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/libs/Translator/include
+
+LOCAL_STATIC_LIBRARIES += lib64emugl_common
+
+LOCAL_CFLAGS += $(host_common_CFLAGS)
+
+$(call emugl-end-module)
+
+
+ifneq ($(HOST_OS),windows)
+
+### emugl_render_service #################################################
+# Serves the GPU emulation of several emulators from a single process, see
+# render_service.cpp.
+$(call emugl-begin-host-executable,emugl_render_service)
+
+$(call emugl-import,libGLESv1_dec libGLESv2_dec lib_renderControl_dec libOpenglCodecCommon)
+
+LOCAL_LDLIBS += $(host_common_LDLIBS)
+
+LOCAL_SRC_FILES := $(host_common_SRC_FILES) render_service.cpp
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/include
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/libs/Translator/include
+
+LOCAL_STATIC_LIBRARIES += libemugl_common
+
+LOCAL_CFLAGS += $(host_common_CFLAGS)
+
+$(call emugl-end-module)
+
+
+### emugl_render_service, 64-bit #########################################
+$(call emugl-begin-host64-executable,emugl64_render_service)
+
+$(call emugl-import,lib64GLESv1_dec lib64GLESv2_dec lib64_renderControl_dec lib64OpenglCodecCommon)
+
+LOCAL_LDLIBS += $(host_common_LDLIBS)
+
+LOCAL_SRC_FILES := $(host_common_SRC_FILES) render_service.cpp
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/include
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/libs/Translator/include
+
+LOCAL_STATIC_LIBRARIES += lib64emugl_common
+
+LOCAL_CFLAGS += $(host_common_CFLAGS)
+
+$(call emugl-end-module)
+
+endif  # HOST_OS != windows
@@ -21,8 +21,15 @@
 #include "GLESv2Dispatch.h"
 #include "RenderThreadInfo.h"
 #include "TextureDraw.h"
+#include "TimeUtils.h"
+
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/mutex.h"
+#include "emugl/common/pixel_rle.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 namespace {
 
@@ -58,6 +65,150 @@ void unbindFbo() {
     s_gles2.glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+// The host GL objects of a destroyed ColorBuffer, kept for reuse by the
+// next ColorBuffer of the same size and format. Guests tend to free and
+// allocate buffers in bursts of identical sizes, e.g. on rotation, and
+// creating textures and EGLImages is way more expensive than clearing one.
+struct PooledTextures {
+    EGLDisplay display;
+    ColorBuffer::Helper* helper;
+    GLuint width;
+    GLuint height;
+    GLenum internalFormat;
+    GLuint tex;
+    GLuint blitTex;
+    EGLImageKHR eglImage;
+    EGLImageKHR blitEGLImage;
+    GLuint fbo;
+    long long releaseTimeMs;
+};
+
+// Deletes the GL objects of |t|, requires a current helper context.
+void deletePooledTextures(const PooledTextures& t) {
+    if (t.blitEGLImage) {
+        s_egl.eglDestroyImageKHR(t.display, t.blitEGLImage);
+    }
+    if (t.eglImage) {
+        s_egl.eglDestroyImageKHR(t.display, t.eglImage);
+    }
+    if (t.fbo) {
+        s_gles2.glDeleteFramebuffers(1, &t.fbo);
+    }
+    GLuint tex[2] = {t.tex, t.blitTex};
+    s_gles2.glDeleteTextures(2, tex);
+}
+
+size_t pooledTexturesSize(const PooledTextures& t) {
+    // Two textures of 3 or 4 bytes per pixel.
+    return 2 * t.width * t.height * (t.internalFormat == GL_RGB ? 3 : 4);
+}
+
+// Entries are kept from the least to the most recently released one, so
+// that lookups prefer the most recent match and trimming starts with the
+// least recently used entries.
+class TexturePool {
+public:
+    // Bounds of the pool, beyond which the oldest entries are deleted.
+    static const int kMaxEntries = 8;
+    static const size_t kMaxBytes = 64 * 1024 * 1024;
+    // Entries released for longer than this are deleted on the next call.
+    // This is long enough to cover a display reconfiguration, and short
+    // enough to not hold onto host memory after the guest has settled.
+    static const long long kMaxAgeMs = 5000;
+
+    TexturePool() : mLock(), mCount(0), mBytes(0), mHits(0), mMisses(0) {}
+
+    // Move the entry matching |display|, |helper|, |width|, |height| and
+    // |internalFormat| to |out| and return true, or return false.
+    // Requires a current context of |helper|.
+    bool take(EGLDisplay display, ColorBuffer::Helper* helper,
+              GLuint width, GLuint height, GLenum internalFormat,
+              PooledTextures* out) {
+        emugl::Mutex::AutoLock lock(mLock);
+        trimLocked(helper, GetCurrentTimeMS());
+        for (int n = mCount - 1; n >= 0; --n) {
+            const PooledTextures& t = mEntries[n];
+            if (t.display == display && t.helper == helper &&
+                t.width == width && t.height == height &&
+                t.internalFormat == internalFormat) {
+                *out = t;
+                removeLocked(n);
+                mHits++;
+                return true;
+            }
+        }
+        mMisses++;
+        return false;
+    }
+
+    // Add |entry| to the pool, or delete its objects if it is too large.
+    // Requires a current context of |entry.helper|.
+    void put(PooledTextures entry) {
+        emugl::Mutex::AutoLock lock(mLock);
+        entry.releaseTimeMs = GetCurrentTimeMS();
+        trimLocked(entry.helper, entry.releaseTimeMs);
+        size_t size = pooledTexturesSize(entry);
+        if (size > kMaxBytes / 2) {
+            deletePooledTextures(entry);
+            return;
+        }
+        while (mCount > 0 &&
+               (mCount == kMaxEntries || mBytes + size > kMaxBytes)) {
+            deletePooledTextures(mEntries[0]);
+            removeLocked(0);
+        }
+        mEntries[mCount++] = entry;
+        mBytes += size;
+    }
+
+    // Delete all the entries of |helper|, whose context must be current.
+    void clear(ColorBuffer::Helper* helper) {
+        emugl::Mutex::AutoLock lock(mLock);
+        for (int n = mCount - 1; n >= 0; --n) {
+            if (mEntries[n].helper == helper) {
+                deletePooledTextures(mEntries[n]);
+                removeLocked(n);
+            }
+        }
+    }
+
+    // Return the number of create() calls served from and missed by
+    // the pool.
+    void getStats(unsigned* hits, unsigned* misses) {
+        emugl::Mutex::AutoLock lock(mLock);
+        *hits = mHits;
+        *misses = mMisses;
+    }
+
+private:
+    // Delete the entries of |helper| released before |now| - kMaxAgeMs.
+    void trimLocked(ColorBuffer::Helper* helper, long long now) {
+        for (int n = mCount - 1; n >= 0; --n) {
+            if (mEntries[n].helper == helper &&
+                now - mEntries[n].releaseTimeMs > kMaxAgeMs) {
+                deletePooledTextures(mEntries[n]);
+                removeLocked(n);
+            }
+        }
+    }
+
+    void removeLocked(int n) {
+        mBytes -= pooledTexturesSize(mEntries[n]);
+        for (--mCount; n < mCount; ++n) {
+            mEntries[n] = mEntries[n + 1];
+        }
+    }
+
+    emugl::Mutex mLock;
+    PooledTextures mEntries[kMaxEntries];
+    int mCount;
+    size_t mBytes;
+    unsigned mHits;
+    unsigned mMisses;
+};
+
+emugl::LazyInstance<TexturePool> sTexturePool = LAZY_INSTANCE_INIT;
+
 // Helper class to use a ColorBuffer::Helper context.
 // Usage is pretty simple:
 //
@@ -127,20 +278,48 @@ ColorBuffer* ColorBuffer::create(EGLDisplay p_display,
     }
 
     ColorBuffer *cb = new ColorBuffer(p_display, helper);
+    cb->m_width = p_width;
+    cb->m_height = p_height;
+    cb->m_internalFormat = texInternalFormat;
+    cb->m_hasEglImageTexture2d = has_eglimage_texture_2d;
+    // Two textures of 3 or 4 bytes per pixel.
+    cb->m_memorySize = 2 * (size_t)p_width * p_height *
+                       (texInternalFormat == GL_RGB ? 3 : 4);
+    cb->allocTextures();
+    return cb;
+}
+
+void ColorBuffer::allocTextures() {
+    PooledTextures pooled;
+    if (sTexturePool->take(m_display, m_helper, m_width, m_height,
+                           m_internalFormat, &pooled)) {
+        m_tex = pooled.tex;
+        m_blitTex = pooled.blitTex;
+        m_eglImage = pooled.eglImage;
+        m_blitEGLImage = pooled.blitEGLImage;
+        m_fbo = pooled.fbo;
+        // New color buffers start zero-filled, which is also the default
+        // clear color of the helper context.
+        if (bindFbo(&m_fbo, m_tex)) {
+            s_gles2.glClear(GL_COLOR_BUFFER_BIT);
+            unbindFbo();
+        }
+        return;
+    }
 
-    s_gles2.glGenTextures(1, &cb->m_tex);
-    s_gles2.glBindTexture(GL_TEXTURE_2D, cb->m_tex);
+    s_gles2.glGenTextures(1, &m_tex);
+    s_gles2.glBindTexture(GL_TEXTURE_2D, m_tex);
 
-    int nComp = (texInternalFormat == GL_RGB ? 3 : 4);
+    int nComp = (m_internalFormat == GL_RGB ? 3 : 4);
 
-    char* zBuff = static_cast<char*>(::calloc(nComp * p_width * p_height, 1));
+    char* zBuff = static_cast<char*>(::calloc(nComp * m_width * m_height, 1));
     s_gles2.glTexImage2D(GL_TEXTURE_2D,
                          0,
-                         texInternalFormat,
-                         p_width,
-                         p_height,
+                         m_internalFormat,
+                         m_width,
+                         m_height,
                          0,
-                         texInternalFormat,
+                         m_internalFormat,
                          GL_UNSIGNED_BYTE,
                          zBuff);
     ::free(zBuff);
@@ -153,15 +332,15 @@ ColorBuffer* ColorBuffer::create(EGLDisplay p_display,
     //
     // create another texture for that colorbuffer for blit
     //
-    s_gles2.glGenTextures(1, &cb->m_blitTex);
-    s_gles2.glBindTexture(GL_TEXTURE_2D, cb->m_blitTex);
+    s_gles2.glGenTextures(1, &m_blitTex);
+    s_gles2.glBindTexture(GL_TEXTURE_2D, m_blitTex);
     s_gles2.glTexImage2D(GL_TEXTURE_2D,
                          0,
-                         texInternalFormat,
-                         p_width,
-                         p_height,
+                         m_internalFormat,
+                         m_width,
+                         m_height,
                          0,
-                         texInternalFormat,
+                         m_internalFormat,
                          GL_UNSIGNED_BYTE,
                          NULL);
 
@@ -170,26 +349,21 @@ ColorBuffer* ColorBuffer::create(EGLDisplay p_display,
     s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    cb->m_width = p_width;
-    cb->m_height = p_height;
-    cb->m_internalFormat = texInternalFormat;
-
-    if (has_eglimage_texture_2d) {
-        cb->m_eglImage = s_egl.eglCreateImageKHR(
-                p_display,
+    if (m_hasEglImageTexture2d) {
+        m_eglImage = s_egl.eglCreateImageKHR(
+                m_display,
                 s_egl.eglGetCurrentContext(),
                 EGL_GL_TEXTURE_2D_KHR,
-                (EGLClientBuffer)SafePointerFromUInt(cb->m_tex),
+                (EGLClientBuffer)SafePointerFromUInt(m_tex),
                 NULL);
 
-        cb->m_blitEGLImage = s_egl.eglCreateImageKHR(
-                p_display,
+        m_blitEGLImage = s_egl.eglCreateImageKHR(
+                m_display,
                 s_egl.eglGetCurrentContext(),
                 EGL_GL_TEXTURE_2D_KHR,
-                (EGLClientBuffer)SafePointerFromUInt(cb->m_blitTex),
+                (EGLClientBuffer)SafePointerFromUInt(m_blitTex),
                 NULL);
     }
-    return cb;
 }
 
 ColorBuffer::ColorBuffer(EGLDisplay display, Helper* helper) :
@@ -200,24 +374,121 @@ ColorBuffer::ColorBuffer(EGLDisplay display, Helper* helper) :
         m_fbo(0),
         m_internalFormat(0),
         m_display(display),
-        m_helper(helper) {}
+        m_helper(helper),
+        m_hasEglImageTexture2d(false),
+        m_memorySize(0),
+        m_evicted(false),
+        m_evictedPixels(),
+        m_alwaysDamaged(false) {
+    memset(m_damage, 0, sizeof(m_damage));
+}
 
 ColorBuffer::~ColorBuffer() {
+    if (m_evicted) {
+        return;
+    }
     ScopedHelperContext context(m_helper);
+    releaseTextures(context.isOk());
+}
+
+void ColorBuffer::releaseTextures(bool hasContext) {
+    PooledTextures t;
+    t.display = m_display;
+    t.helper = m_helper;
+    t.width = m_width;
+    t.height = m_height;
+    t.internalFormat = m_internalFormat;
+    t.tex = m_tex;
+    t.blitTex = m_blitTex;
+    t.eglImage = m_eglImage;
+    t.blitEGLImage = m_blitEGLImage;
+    t.fbo = m_fbo;
+    t.releaseTimeMs = 0;
+    if (hasContext) {
+        sTexturePool->put(t);
+    } else {
+        deletePooledTextures(t);
+    }
+    m_tex = m_blitTex = m_fbo = 0;
+    m_eglImage = m_blitEGLImage = NULL;
+}
 
-    if (m_blitEGLImage) {
-        s_egl.eglDestroyImageKHR(m_display, m_blitEGLImage);
+bool ColorBuffer::evict() {
+    // The EGLImage of a ColorBuffer bound to guest textures or
+    // renderbuffers must stay alive, since they share its storage.
+    if (m_evicted || m_alwaysDamaged) {
+        return false;
+    }
+    ScopedHelperContext context(m_helper);
+    if (!context.isOk() || !bindFbo(&m_fbo, m_tex)) {
+        return false;
+    }
+    const size_t count = (size_t)m_width * m_height;
+    uint32_t* pixels = static_cast<uint32_t*>(::malloc(count * 4U));
+    if (!pixels) {
+        unbindFbo();
+        return false;
+    }
+    s_gles2.glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE,
+                         pixels);
+    unbindFbo();
+    emugl::pixelRleEncode(pixels, count, &m_evictedPixels);
+    ::free(pixels);
+
+    // The textures go to the pool, from which the restore will likely
+    // take them back if it comes soon.
+    releaseTextures(true);
+    m_evicted = true;
+    return true;
+}
+
+bool ColorBuffer::restore() {
+    if (!m_evicted) {
+        return true;
+    }
+    ScopedHelperContext context(m_helper);
+    if (!context.isOk()) {
+        return false;
     }
-    if (m_eglImage) {
-        s_egl.eglDestroyImageKHR(m_display, m_eglImage);
+    const size_t count = (size_t)m_width * m_height;
+    uint32_t* pixels = static_cast<uint32_t*>(::malloc(count * 4U));
+    if (!pixels) {
+        return false;
+    }
+    if (!emugl::pixelRleDecode(m_evictedPixels.begin(),
+                               m_evictedPixels.size(), pixels, count)) {
+        ERR("ColorBuffer::restore: corrupted pixels\n");
+        memset(pixels, 0, count * 4U);
+    }
+    allocTextures();
+    s_gles2.glBindTexture(GL_TEXTURE_2D, m_tex);
+    s_gles2.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (m_internalFormat == GL_RGB) {
+        // Texture uploads can't convert between formats in GLES.
+        uint8_t* rgb = reinterpret_cast<uint8_t*>(pixels);
+        for (size_t n = 0; n < count; ++n) {
+            memmove(rgb + n * 3, rgb + n * 4, 3);
+        }
     }
+    s_gles2.glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_width, m_height,
+                            m_internalFormat, GL_UNSIGNED_BYTE, pixels);
+    ::free(pixels);
+    m_evictedPixels.resize(0);
+    m_evicted = false;
+    return true;
+}
 
-    if (m_fbo) {
-        s_gles2.glDeleteFramebuffers(1, &m_fbo);
+// static
+void ColorBuffer::clearPool(Helper* helper) {
+    ScopedHelperContext context(helper);
+    if (context.isOk()) {
+        sTexturePool->clear(helper);
     }
+}
 
-    GLuint tex[2] = {m_tex, m_blitTex};
-    s_gles2.glDeleteTextures(2, tex);
+// static
+void ColorBuffer::getPoolStats(unsigned* hits, unsigned* misses) {
+    sTexturePool->getStats(hits, misses);
 }
 
 void ColorBuffer::readPixels(int x,
@@ -238,6 +509,35 @@ void ColorBuffer::readPixels(int x,
     }
 }
 
+bool ColorBuffer::readPixelsWithFbo(GLuint* fbo,
+                                    int x,
+                                    int y,
+                                    int width,
+                                    int height,
+                                    GLenum p_format,
+                                    GLenum p_type,
+                                    void* pixels) {
+    if (!*fbo) {
+        s_gles2.glGenFramebuffers(1, fbo);
+    }
+    s_gles2.glBindFramebuffer(GL_FRAMEBUFFER, *fbo);
+    s_gles2.glFramebufferTexture2D(GL_FRAMEBUFFER,
+                                   GL_COLOR_ATTACHMENT0_OES,
+                                   GL_TEXTURE_2D, m_tex, 0);
+    bool ret = (s_gles2.glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+                GL_FRAMEBUFFER_COMPLETE_OES);
+    if (ret) {
+        s_gles2.glReadPixels(x, y, width, height, p_format, p_type, pixels);
+    }
+    // Detach the texture, so that its storage can go away as soon as it
+    // is deleted in the context that owns it.
+    s_gles2.glFramebufferTexture2D(GL_FRAMEBUFFER,
+                                   GL_COLOR_ATTACHMENT0_OES,
+                                   GL_TEXTURE_2D, 0, 0);
+    unbindFbo();
+    return ret;
+}
+
 void ColorBuffer::subUpdate(int x,
                             int y,
                             int width,
@@ -254,6 +554,33 @@ void ColorBuffer::subUpdate(int x,
     s_gles2.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     s_gles2.glTexSubImage2D(
             GL_TEXTURE_2D, 0, x, y, width, height, p_format, p_type, pixels);
+    addDamage(x, y, width, height);
+}
+
+bool ColorBuffer::subUpdateYuv(int width,
+                               int height,
+                               int format,
+                               const void* pixels) {
+    ScopedHelperContext context(m_helper);
+    if (!context.isOk() || !bindFbo(&m_fbo, m_tex)) {
+        return false;
+    }
+
+    GLint vport[4] = { 0, };
+    s_gles2.glGetIntegerv(GL_VIEWPORT, vport);
+    s_gles2.glViewport(0, 0, m_width, m_height);
+
+    bool ret = m_helper->getTextureDraw()->drawYuv(
+            width, height, static_cast<TextureDraw::YuvFormat>(format),
+            pixels);
+
+    s_gles2.glViewport(vport[0], vport[1], vport[2], vport[3]);
+    unbindFbo();
+
+    if (ret) {
+        addDamage(0, 0, m_width, m_height);
+    }
+    return ret;
 }
 
 bool ColorBuffer::blitFromCurrentReadBuffer()
@@ -311,6 +638,7 @@ bool ColorBuffer::blitFromCurrentReadBuffer()
     s_gles2.glViewport(vport[0], vport[1], vport[2], vport[3]);
     unbindFbo();
 
+    addDamage(0, 0, m_width, m_height);
     return true;
 }
 
@@ -328,6 +656,7 @@ bool ColorBuffer::bindToTexture() {
     else {
         s_gles1.glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, m_eglImage);
     }
+    m_alwaysDamaged = true;
     return true;
 }
 
@@ -345,6 +674,7 @@ bool ColorBuffer::bindToRenderbuffer() {
     else {
         s_gles1.glEGLImageTargetRenderbufferStorageOES(GL_RENDERBUFFER_OES, m_eglImage);
     }
+    m_alwaysDamaged = true;
     return true;
 }
 
@@ -354,6 +684,15 @@ bool ColorBuffer::post(float rotation) {
 }
 
 void ColorBuffer::readback(unsigned char* img) {
+    if (m_evicted) {
+        if (!emugl::pixelRleDecode(m_evictedPixels.begin(),
+                                   m_evictedPixels.size(),
+                                   reinterpret_cast<uint32_t*>(img),
+                                   (size_t)m_width * m_height)) {
+            memset(img, 0, (size_t)m_width * m_height * 4U);
+        }
+        return;
+    }
     ScopedHelperContext context(m_helper);
     if (!context.isOk()) {
         return;
@@ -364,3 +703,84 @@ void ColorBuffer::readback(unsigned char* img) {
         unbindFbo();
     }
 }
+
+void ColorBuffer::readbackRows(int y, int height, unsigned char* img) {
+    if (y < 0) {
+        height += y;
+        y = 0;
+    }
+    if (y + height > (int)m_height) {
+        height = (int)m_height - y;
+    }
+    if (height <= 0) {
+        return;
+    }
+    ScopedHelperContext context(m_helper);
+    if (!context.isOk()) {
+        return;
+    }
+    if (bindFbo(&m_fbo, m_tex)) {
+        s_gles2.glReadPixels(0, y, m_width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                             img + (size_t)y * m_width * 4U);
+        unbindFbo();
+    }
+}
+
+bool ColorBuffer::takeDamage(int display, int* x, int* y,
+                             int* width, int* height) {
+    if (m_alwaysDamaged) {
+        addDamage(0, 0, m_width, m_height);
+    }
+    Damage& damage = m_damage[display];
+    if (damage.x0 >= damage.x1) {
+        return false;
+    }
+    *x = damage.x0;
+    *y = damage.y0;
+    *width = damage.x1 - damage.x0;
+    *height = damage.y1 - damage.y0;
+    damage.x0 = damage.y0 = damage.x1 = damage.y1 = 0;
+    return true;
+}
+
+void ColorBuffer::addDamage(int x, int y, int width, int height) {
+    int x1 = x + width;
+    int y1 = y + height;
+    if (x < 0) {
+        x = 0;
+    }
+    if (y < 0) {
+        y = 0;
+    }
+    if (x1 > (int)m_width) {
+        x1 = (int)m_width;
+    }
+    if (y1 > (int)m_height) {
+        y1 = (int)m_height;
+    }
+    if (x >= x1 || y >= y1) {
+        return;
+    }
+    for (int n = 0; n < kMaxDisplays; ++n) {
+        Damage& damage = m_damage[n];
+        if (damage.x0 >= damage.x1) {
+            damage.x0 = x;
+            damage.y0 = y;
+            damage.x1 = x1;
+            damage.y1 = y1;
+            continue;
+        }
+        if (x < damage.x0) {
+            damage.x0 = x;
+        }
+        if (y < damage.y0) {
+            damage.y0 = y;
+        }
+        if (x1 > damage.x1) {
+            damage.x1 = x1;
+        }
+        if (y1 > damage.y1) {
+            damage.y1 = y1;
+        }
+    }
+}
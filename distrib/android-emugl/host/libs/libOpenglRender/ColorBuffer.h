@@ -19,8 +19,12 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <GLES/gl.h>
+#include "emugl/common/pod_vector.h"
 #include "emugl/common/smart_ptr.h"
 
+#include <stddef.h>
+#include <stdint.h>
+
 class TextureDraw;
 
 // A class used to model a guest color buffer, and used to implement several
@@ -80,13 +84,49 @@ public:
                                bool has_eglimage_texture_2d,
                                Helper* helper);
 
-    // Destructor.
+    // Destructor. The host textures of the ColorBuffer are kept in a small
+    // process-wide pool, and reused by the next create() call with the same
+    // |helper|, dimensions and format.
     ~ColorBuffer();
 
+    // Delete the pooled textures of |helper|. Call this before destroying
+    // the context that |helper| sets up.
+    static void clearPool(Helper* helper);
+
+    // Return the number of create() calls that reused pooled textures in
+    // |*hits|, and the number of those that allocated new ones in |*misses|.
+    static void getPoolStats(unsigned* hits, unsigned* misses);
+
     // Return ColorBuffer width and height in pixels
     GLuint getWidth() const { return m_width; }
     GLuint getHeight() const { return m_height; }
 
+    // Return the internal format passed to create().
+    GLenum getInternalFormat() const { return m_internalFormat; }
+
+    // Return the size in bytes of the host GPU memory used by the
+    // ColorBuffer while it is resident, as estimated by create().
+    size_t getMemorySize() const { return m_memorySize; }
+
+    // Move the content of the ColorBuffer to host memory, compressed, and
+    // release its textures. Nothing else can be done with it until it is
+    // restored, except readback(). Returns false if it can't be evicted,
+    // e.g. because its EGLImage is bound to guest textures.
+    bool evict();
+
+    // Move the content of an evicted ColorBuffer back to new textures.
+    // Does nothing if it isn't evicted. Returns false on failure.
+    bool restore();
+
+    // Return true iff the ColorBuffer is evicted.
+    bool isEvicted() const { return m_evicted; }
+
+    // Return the size in bytes of the compressed content of an evicted
+    // ColorBuffer.
+    size_t getEvictedSize() const {
+        return m_evictedPixels.size() * sizeof(uint32_t);
+    }
+
     // Read the ColorBuffer instance's pixel values into host memory.
     void readPixels(int x,
                     int y,
@@ -96,6 +136,20 @@ public:
                     GLenum p_type,
                     void *pixels);
 
+    // Same as readPixels(), but in the current EGL context of the calling
+    // thread instead of the helper one, through the framebuffer object
+    // |*fbo| of that context, which is created if it is 0. This does not
+    // need the FrameBuffer lock, so the transfer doesn't block the other
+    // render threads. Return true on success, false otherwise.
+    bool readPixelsWithFbo(GLuint* fbo,
+                           int x,
+                           int y,
+                           int width,
+                           int height,
+                           GLenum p_format,
+                           GLenum p_type,
+                           void *pixels);
+
     // Update the ColorBuffer instance's pixel values from host memory.
     void subUpdate(int x,
                    int y,
@@ -105,6 +159,12 @@ public:
                    GLenum p_type,
                    void *pixels);
 
+    // Replace the whole ColorBuffer content with a |width| x |height| YUV
+    // frame from host memory, see TextureDraw::drawYuv(). The conversion
+    // runs on the GPU, and the frame is scaled to the ColorBuffer's size.
+    // |format| is a TextureDraw::YuvFormat value. Return true on success.
+    bool subUpdateYuv(int width, int height, int format, const void* pixels);
+
     // Draw a ColorBuffer instance, i.e. blit it to the current guest
     // framebuffer object / window surface. This doesn't display anything.
     bool draw();
@@ -133,11 +193,35 @@ public:
     // |img| must be a buffer large enough (i.e. width * height * 4).
     void readback(unsigned char* img);
 
+    // Same as readback(), but only read the |height| rows starting at row
+    // |y|, into the corresponding rows of |img|. The other rows of |img|
+    // are left untouched.
+    void readbackRows(int y, int height, unsigned char* img);
+
+    // Maximum number of displays that can post the same ColorBuffer, each
+    // one tracking its damage independently.
+    static const int kMaxDisplays = 4;
+
+    // Retrieve the rectangle of pixels that was modified since the last
+    // call for the same |display|, and reset it for that display only.
+    // Returns false if nothing was modified. Note that rendering through
+    // bindToTexture() / bindToRenderbuffer() cannot be tracked, so these
+    // mark the whole ColorBuffer as always damaged.
+    bool takeDamage(int display, int* x, int* y, int* width, int* height);
+
 private:
     ColorBuffer();  // no default constructor.
 
     explicit ColorBuffer(EGLDisplay display, Helper* helper);
 
+    // Create the textures and EGLImages, or take them from the pool.
+    // Requires a current helper context.
+    void allocTextures();
+
+    // Give the textures and EGLImages back to the pool if |hasContext|,
+    // i.e. the helper context is current, or delete them otherwise.
+    void releaseTextures(bool hasContext);
+
 private:
     GLuint m_tex;
     GLuint m_blitTex;
@@ -149,6 +233,24 @@ private:
     GLenum m_internalFormat;
     EGLDisplay m_display;
     Helper* m_helper;
+    bool m_hasEglImageTexture2d;
+    size_t m_memorySize;
+    // True when the content is in |m_evictedPixels|, see evict().
+    bool m_evicted;
+    emugl::PodVector<uint32_t> m_evictedPixels;
+    // Damaged rectangle, as [x0,x1) x [y0,y1). Empty if x0 >= x1.
+    struct Damage {
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+    };
+    // Area damaged since the last takeDamage() call of each display.
+    Damage m_damage[kMaxDisplays];
+    bool m_alwaysDamaged;
+
+    // Add a rectangle to the damaged area of all displays.
+    void addDamage(int x, int y, int width, int height);
 };
 
 typedef emugl::SmartPtr<ColorBuffer> ColorBufferPtr;
@@ -0,0 +1,99 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Compositor.h"
+
+#include "EGLDispatch.h"
+#include "FrameBuffer.h"
+
+Compositor::Compositor(FrameBuffer* fb) :
+        Thread(),
+        m_fb(fb),
+        m_lock(),
+        m_cond(),
+        m_pending(0),
+        m_pendingTimeUs(0),
+        m_dropped(0),
+        m_started(false),
+        m_exiting(false) {}
+
+// static
+Compositor* Compositor::create(FrameBuffer* fb) {
+    Compositor* compositor = new Compositor(fb);
+    if (!compositor->start()) {
+        delete compositor;
+        return NULL;
+    }
+    compositor->m_started = true;
+    return compositor;
+}
+
+Compositor::~Compositor() {
+    stop();
+}
+
+void Compositor::post(uint32_t colorBuffer, long long guestPostUs) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    if (m_pending) {
+        m_dropped++;
+    }
+    m_pending = colorBuffer;
+    m_pendingTimeUs = guestPostUs;
+    m_cond.signal();
+}
+
+void Compositor::stop() {
+    if (!m_started) {
+        return;
+    }
+    {
+        emugl::Mutex::AutoLock lock(m_lock);
+        m_exiting = true;
+        m_pending = 0;
+        m_cond.signal();
+    }
+    wait(NULL);
+    m_started = false;
+}
+
+unsigned int Compositor::takeDroppedFrameCount() {
+    emugl::Mutex::AutoLock lock(m_lock);
+    unsigned int dropped = m_dropped;
+    m_dropped = 0;
+    return dropped;
+}
+
+intptr_t Compositor::main() {
+    for (;;) {
+        uint32_t colorBuffer;
+        long long guestPostUs;
+        {
+            emugl::Mutex::AutoLock lock(m_lock);
+            while (!m_pending && !m_exiting) {
+                m_cond.wait(&m_lock);
+            }
+            if (m_exiting) {
+                break;
+            }
+            colorBuffer = m_pending;
+            guestPostUs = m_pendingTimeUs;
+            m_pending = 0;
+        }
+        // Frames posted while this one is displayed replace each other,
+        // only the last one is displayed next.
+        m_fb->post(colorBuffer, true, guestPostUs);
+    }
+    s_egl.eglReleaseThread();
+    return 0;
+}
@@ -0,0 +1,71 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include "emugl/common/condition_variable.h"
+#include "emugl/common/mutex.h"
+#include "emugl/common/thread.h"
+
+#include <stdint.h>
+
+class FrameBuffer;
+
+// A thread used to display the color buffers posted by the guest through
+// FrameBuffer::post(), so that the guest's render thread doesn't wait for
+// the composition and eglSwapBuffers(), which blocks until the next host
+// vsync on most drivers.
+//
+// Only the latest posted color buffer is kept: a frame which is replaced
+// before the thread got to it is dropped, so that a guest which renders
+// faster than the host refresh rate never builds up latency.
+class Compositor : public emugl::Thread {
+public:
+    // Create a new instance which displays frames on |fb|, and start its
+    // thread. Return NULL on failure.
+    static Compositor* create(FrameBuffer* fb);
+
+    // Destructor. Calls stop().
+    virtual ~Compositor();
+
+    // Queue |colorBuffer| for display, replacing the frame queued before
+    // if it wasn't displayed yet, and return immediately. |guestPostUs| is
+    // the GetCurrentTimeUS() value at which the guest posted it.
+    void post(uint32_t colorBuffer, long long guestPostUs);
+
+    // Stop the thread, dropping the queued frame if any, and wait for it
+    // to exit.
+    void stop();
+
+    // Return the number of frames dropped since the last call, because a
+    // newer one was posted before they could be displayed.
+    unsigned int takeDroppedFrameCount();
+
+private:
+    explicit Compositor(FrameBuffer* fb);
+
+    virtual intptr_t main();
+
+    FrameBuffer* m_fb;
+    emugl::Mutex m_lock;
+    emugl::ConditionVariable m_cond;
+    uint32_t m_pending;      // Color buffer to display next, or 0.
+    long long m_pendingTimeUs;  // Time at which it was posted.
+    unsigned int m_dropped;
+    bool m_started;
+    bool m_exiting;
+};
+
+#endif  // COMPOSITOR_H
@@ -16,6 +16,7 @@
 
 #include "FrameBuffer.h"
 
+#include "Compositor.h"
 #include "EGLDispatch.h"
 #include "GLESv1Dispatch.h"
 #include "GLESv2Dispatch.h"
@@ -23,7 +24,13 @@
 #include "RenderThreadInfo.h"
 #include "TimeUtils.h"
 
+#include "emugl/common/metrics.h"
+#include "emugl/common/trace.h"
+
+#include <vector>
+
 #include <stdio.h>
+#include <string.h>
 
 namespace {
 
@@ -84,6 +91,10 @@ private:
 
 FrameBuffer *FrameBuffer::s_theFrameBuffer = NULL;
 HandleType FrameBuffer::s_nextHandle = 0;
+uint8_t* FrameBuffer::s_sharedMemory = NULL;
+size_t FrameBuffer::s_sharedMemorySize = 0;
+uint64_t FrameBuffer::s_instanceMemoryLimit = 0;
+uint32_t FrameBuffer::s_evictIdleFrames = 0;
 
 static char* getGLES1ExtensionString(EGLDisplay p_dpy)
 {
@@ -150,11 +161,18 @@ static char* getGLES1ExtensionString(EGLDisplay p_dpy)
 }
 
 void FrameBuffer::finalize(){
+    if (m_compositor) {
+        m_compositor->stop();
+    }
     m_colorbuffers.clear();
+    m_handleInstances.clear();
+    m_instances.clear();
+    resetInstanceInfo(&m_defaultInstance);
     if (m_useSubWindow) {
         removeSubWindow();
     }
     m_windows.clear();
+    ColorBuffer::clearPool(m_colorBufferHelper);
     m_contexts.clear();
     s_egl.eglMakeCurrent(m_eglDisplay, NULL, NULL, NULL);
     s_egl.eglDestroyContext(m_eglDisplay, m_eglContext);
@@ -168,6 +186,18 @@ bool FrameBuffer::initialize(int width, int height, bool useSubWindow)
         return true;
     }
 
+    // Define ANDROID_EMUGL_MEMORY_LIMIT_MB to bound the ColorBuffers of
+    // a single emulator, and ANDROID_EMUGL_EVICT_IDLE_FRAMES to move those
+    // which haven't been used for that many frames to host memory.
+    const char* env = getenv("ANDROID_EMUGL_MEMORY_LIMIT_MB");
+    if (env && !s_instanceMemoryLimit) {
+        s_instanceMemoryLimit = (uint64_t)atol(env) << 20;
+    }
+    env = getenv("ANDROID_EMUGL_EVICT_IDLE_FRAMES");
+    if (env && !s_evictIdleFrames) {
+        s_evictIdleFrames = (uint32_t)atoi(env);
+    }
+
     //
     // allocate space for the FrameBuffer object
     //
@@ -411,6 +441,12 @@ bool FrameBuffer::initialize(int width, int height, bool useSubWindow)
     // Keep the singleton framebuffer pointer
     //
     s_theFrameBuffer = fb;
+
+    // Start the thread which displays the frames posted by the guest.
+    fb->m_compositor = Compositor::create(fb);
+    if (!fb->m_compositor) {
+        ERR("Could not start compositor thread, posting synchronously\n");
+    }
     return true;
 }
 
@@ -427,52 +463,116 @@ FrameBuffer::FrameBuffer(int p_width, int p_height, bool useSubWindow) :
     m_prevContext(EGL_NO_CONTEXT),
     m_prevReadSurf(EGL_NO_SURFACE),
     m_prevDrawSurf(EGL_NO_SURFACE),
+    m_skippedBinds(0),
     m_subWin((EGLNativeWindowType)0),
+    m_subWinHosted(false),
     m_textureDraw(NULL),
+    m_compositor(NULL),
     m_lastPostedColorBuffer(0),
+    m_frameCount(0),
     m_zRot(0.0f),
     m_eglContextInitialized(false),
     m_statsNumFrames(0),
     m_statsStartTime(0LL),
-    m_onPost(NULL),
-    m_onPostContext(NULL),
-    m_fbImage(NULL),
+    m_postLock(),
     m_glVendor(NULL),
     m_glRenderer(NULL),
     m_glVersion(NULL)
 {
     m_fpsStats = getenv("SHOW_FPS_STATS") != NULL;
+    memset(m_displays, 0, sizeof(m_displays));
+    memset(m_postTimesUs, 0, sizeof(m_postTimesUs));
+    resetInstanceInfo(&m_defaultInstance);
+    m_displays[0].used = true;
+    m_displays[0].width = p_width;
+    m_displays[0].height = p_height;
 }
 
 FrameBuffer::~FrameBuffer() {
+    delete m_compositor;
     delete m_textureDraw;
     delete m_configs;
     delete m_colorBufferHelper;
-    free(m_fbImage);
+    for (int n = 0; n < kMaxDisplays; ++n) {
+        free(m_displays[n].fbImage[0]);
+        free(m_displays[n].fbImage[1]);
+    }
 }
 
-void FrameBuffer::setPostCallback(OnPostFn onPost, void* onPostContext)
+void FrameBuffer::setDisplayPostCallback(int id,
+                                         OnPostFn onPost,
+                                         void* onPostContext)
 {
     emugl::Mutex::AutoLock mutex(m_lock);
-    m_onPost = onPost;
-    m_onPostContext = onPostContext;
-    if (m_onPost && !m_fbImage) {
-        m_fbImage = (unsigned char*)malloc(4 * m_width * m_height);
-        if (!m_fbImage) {
+    if (id < 0 || id >= kMaxDisplays || !m_displays[id].used) {
+        ERR("%s: invalid display id %d\n", __FUNCTION__, id);
+        return;
+    }
+    // Wait for any pending call to the previous callback.
+    emugl::Mutex::AutoLock postMutex(m_postLock);
+    Display& display = m_displays[id];
+    display.onPost = onPost;
+    display.onPostContext = onPostContext;
+    display.lastReadbackColorBuffer = 0;
+    if (display.onPost && !display.fbImage[0]) {
+        size_t size = 4 * display.width * display.height;
+        display.fbImage[0] = (unsigned char*)malloc(size);
+        display.fbImage[1] = (unsigned char*)malloc(size);
+        if (!display.fbImage[0] || !display.fbImage[1]) {
             ERR("out of memory, cancelling OnPost callback");
-            m_onPost = NULL;
-            m_onPostContext = NULL;
+            free(display.fbImage[0]);
+            free(display.fbImage[1]);
+            display.fbImage[0] = display.fbImage[1] = NULL;
+            display.onPost = NULL;
+            display.onPostContext = NULL;
             return;
         }
     }
 }
 
+int FrameBuffer::createDisplay(int width, int height)
+{
+    if (width <= 0 || height <= 0) {
+        return -1;
+    }
+    emugl::Mutex::AutoLock mutex(m_lock);
+    for (int n = 1; n < kMaxDisplays; ++n) {
+        Display& display = m_displays[n];
+        if (!display.used) {
+            memset(&display, 0, sizeof(display));
+            display.used = true;
+            display.width = width;
+            display.height = height;
+            return n;
+        }
+    }
+    ERR("%s: too many displays\n", __FUNCTION__);
+    return -1;
+}
+
+bool FrameBuffer::destroyDisplay(int id)
+{
+    emugl::Mutex::AutoLock mutex(m_lock);
+    // The primary display can't be destroyed.
+    if (id <= 0 || id >= kMaxDisplays || !m_displays[id].used) {
+        return false;
+    }
+    // Wait for any pending call to the display's callback.
+    emugl::Mutex::AutoLock postMutex(m_postLock);
+    Display& display = m_displays[id];
+    free(display.fbImage[0]);
+    free(display.fbImage[1]);
+    memset(&display, 0, sizeof(display));
+    return true;
+}
+
 bool FrameBuffer::setupSubWindow(FBNativeWindowType p_window,
                                  int p_x,
                                  int p_y,
                                  int p_width,
                                  int p_height,
-                                 float zRot) {
+                                 float zRot,
+                                 bool hosted) {
     bool success = false;
 
     if (!m_useSubWindow) {
@@ -483,8 +583,14 @@ bool FrameBuffer::setupSubWindow(FBNativeWindowType p_window,
 
     m_lock.lock();
     if (!m_subWin) {
-        // create native subwindow for FB display output
-        m_subWin = createSubWindow(p_window, p_x, p_y, p_width, p_height);
+        // create native subwindow for FB display output, unless the UI
+        // provides a window to render into.
+        if (hosted) {
+            m_subWin = (EGLNativeWindowType)p_window;
+        } else {
+            m_subWin = createSubWindow(p_window, p_x, p_y, p_width, p_height);
+        }
+        m_subWinHosted = hosted;
         if (m_subWin) {
             m_nativeWindow = p_window;
 
@@ -496,7 +602,9 @@ bool FrameBuffer::setupSubWindow(FBNativeWindowType p_window,
 
             if (m_eglSurface == EGL_NO_SURFACE) {
                 // NOTE: This can typically happen with software-only renderers like OSMesa.
-                destroySubWindow(m_subWin);
+                if (!hosted) {
+                    destroySubWindow(m_subWin);
+                }
                 m_subWin = (EGLNativeWindowType)0;
             } else {
                 if (bindSubwin_locked()) {
@@ -534,7 +642,9 @@ bool FrameBuffer::removeSubWindow() {
     if (m_subWin) {
         s_egl.eglMakeCurrent(m_eglDisplay, NULL, NULL, NULL);
         s_egl.eglDestroySurface(m_eglDisplay, m_eglSurface);
-        destroySubWindow(m_subWin);
+        if (!m_subWinHosted) {
+            destroySubWindow(m_subWin);
+        }
 
         m_eglSurface = EGL_NO_SURFACE;
         m_subWin = (EGLNativeWindowType)0;
@@ -550,18 +660,264 @@ HandleType FrameBuffer::genHandle()
     do {
         id = ++s_nextHandle;
     } while( id == 0 ||
-             m_contexts.find(id) != m_contexts.end() ||
-             m_windows.find(id) != m_windows.end() );
+             m_contexts.contains(id) ||
+             m_windows.contains(id) ||
+             m_colorbuffers.contains(id) );
 
     return id;
 }
 
+// static
+void FrameBuffer::setInstanceMemoryLimit(uint64_t bytes)
+{
+    s_instanceMemoryLimit = bytes;
+}
+
+void FrameBuffer::addInstanceThread(uint32_t instanceId)
+{
+    if (!instanceId) {
+        return;
+    }
+    emugl::Mutex::AutoLock mutex(m_lock);
+    InstanceInfo* instance = m_instances.find(instanceId);
+    if (instance) {
+        instance->threads++;
+        return;
+    }
+    InstanceInfo info;
+    resetInstanceInfo(&info);
+    info.threads = 1;
+    m_instances.set(instanceId, info);
+    DBG("FB: new instance %u\n", instanceId);
+}
+
+void FrameBuffer::releaseInstanceThread(uint32_t instanceId)
+{
+    if (!instanceId) {
+        return;
+    }
+    emugl::Mutex::AutoLock mutex(m_lock);
+    InstanceInfo* instance = m_instances.find(instanceId);
+    if (!instance || --instance->threads > 0) {
+        return;
+    }
+
+    // The emulator has exited or closed all its connections, nobody can
+    // use its ColorBuffers anymore, so free them even if the guest didn't.
+    std::vector<HandleType> handles;
+    ColorBufferMap::Iterator iter(&m_colorbuffers);
+    while (iter.hasNext()) {
+        iter.next();
+        const uint32_t* owner = m_handleInstances.find(iter.key());
+        if (owner && *owner == instanceId) {
+            handles.push_back(iter.key());
+        }
+    }
+    for (size_t n = 0; n < handles.size(); ++n) {
+        eraseColorBuffer_locked(handles[n]);
+        if (m_lastPostedColorBuffer == handles[n]) {
+            m_lastPostedColorBuffer = 0;
+        }
+    }
+    DBG("FB: instance %u exited, freed %zu color buffers\n",
+        instanceId, handles.size());
+    m_instances.erase(instanceId);
+}
+
+FrameBuffer::InstanceInfo* FrameBuffer::getInstance_locked()
+{
+    RenderThreadInfo* tInfo = RenderThreadInfo::get();
+    if (!tInfo || !tInfo->m_instanceId) {
+        return &m_defaultInstance;
+    }
+    return m_instances.find(tInfo->m_instanceId);
+}
+
+FrameBuffer::InstanceInfo* FrameBuffer::getOwner_locked(HandleType handle)
+{
+    const uint32_t* owner = m_handleInstances.find(handle);
+    if (!owner) {
+        return &m_defaultInstance;
+    }
+    return m_instances.find(*owner);
+}
+
+// static
+void FrameBuffer::resetInstanceInfo(InstanceInfo* info)
+{
+    memset(info, 0, sizeof(*info));
+}
+
+bool FrameBuffer::canAccess_locked(HandleType handle)
+{
+    RenderThreadInfo* tInfo = RenderThreadInfo::get();
+    if (!tInfo || !tInfo->m_instanceId) {
+        // The renderer itself, e.g. the thread that reposts, or a stream
+        // of a single emulator.
+        return true;
+    }
+    const uint32_t* owner = m_handleInstances.find(handle);
+    return owner && *owner == tInfo->m_instanceId;
+}
+
+void FrameBuffer::setOwner_locked(HandleType handle)
+{
+    RenderThreadInfo* tInfo = RenderThreadInfo::get();
+    if (tInfo && tInfo->m_instanceId) {
+        m_handleInstances.set(handle, tInfo->m_instanceId);
+    }
+}
+
+ColorBufferRef* FrameBuffer::findColorBuffer_locked(HandleType p_colorbuffer)
+{
+    ColorBufferRef* c = m_colorbuffers.find(p_colorbuffer);
+    if (!c || !canAccess_locked(p_colorbuffer)) {
+        return NULL;
+    }
+    c->lastUsedFrame = m_frameCount;
+    if (c->cb->isEvicted()) {
+        restoreColorBuffer_locked(p_colorbuffer, c);
+    }
+    return c;
+}
+
+void FrameBuffer::eraseColorBuffer_locked(HandleType p_colorbuffer)
+{
+    ColorBufferRef* c = m_colorbuffers.find(p_colorbuffer);
+    if (!c) {
+        return;
+    }
+    InstanceInfo* instance = getOwner_locked(p_colorbuffer);
+    if (instance) {
+        if (c->cb->isEvicted()) {
+            instance->evictedBytes -= c->cb->getEvictedSize();
+        } else {
+            instance->residentBytes -= c->cb->getMemorySize();
+        }
+    }
+    m_handleInstances.erase(p_colorbuffer);
+    m_colorbuffers.erase(p_colorbuffer);
+}
+
+// static
+void FrameBuffer::setEvictIdleFrames(uint32_t frames)
+{
+    s_evictIdleFrames = frames;
+}
+
+bool FrameBuffer::isEvictable_locked(HandleType p_colorbuffer,
+                                     const ColorBufferRef& ref)
+{
+    // Only the map holds a reference to an unused ColorBuffer, others are
+    // held by window surfaces, the compositor and readColorBuffer().
+    return !ref.cb->isEvicted() &&
+           ref.cb.getRefCount() == 1 &&
+           p_colorbuffer != m_lastPostedColorBuffer;
+}
+
+bool FrameBuffer::evictColorBuffer_locked(HandleType p_colorbuffer,
+                                          ColorBufferRef* c)
+{
+    InstanceInfo* instance = getOwner_locked(p_colorbuffer);
+    const size_t size = c->cb->getMemorySize();
+    if (!instance || !c->cb->evict()) {
+        return false;
+    }
+    instance->residentBytes -= size;
+    instance->evictedBytes += c->cb->getEvictedSize();
+    instance->evictions++;
+    DBG("FB: evicted color buffer %#x, %zu bytes compressed to %zu\n",
+        p_colorbuffer, size, c->cb->getEvictedSize());
+    return true;
+}
+
+void FrameBuffer::restoreColorBuffer_locked(HandleType p_colorbuffer,
+                                            ColorBufferRef* c)
+{
+    InstanceInfo* instance = getOwner_locked(p_colorbuffer);
+    const size_t size = c->cb->getMemorySize();
+    const size_t evictedSize = c->cb->getEvictedSize();
+    if (!instance) {
+        return;
+    }
+    // Exceeding the budget is better than failing the guest's command.
+    makeRoom_locked(instance, size);
+    if (!c->cb->restore()) {
+        ERR("FB: could not restore color buffer %#x\n", p_colorbuffer);
+        return;
+    }
+    instance->evictedBytes -= evictedSize;
+    instance->residentBytes += size;
+    instance->restores++;
+}
+
+bool FrameBuffer::makeRoom_locked(InstanceInfo* instance, size_t bytes)
+{
+    if (!s_instanceMemoryLimit) {
+        return true;
+    }
+    while (instance->residentBytes + bytes > s_instanceMemoryLimit) {
+        // Evict the least recently used ColorBuffer of the instance.
+        HandleType lru = 0;
+        ColorBufferRef* lruRef = NULL;
+        ColorBufferMap::Iterator iter(&m_colorbuffers);
+        while (iter.hasNext()) {
+            iter.next();
+            ColorBufferRef& ref = iter.value();
+            if (getOwner_locked(iter.key()) == instance &&
+                isEvictable_locked(iter.key(), ref) &&
+                (!lruRef || (int32_t)(ref.lastUsedFrame -
+                                      lruRef->lastUsedFrame) < 0)) {
+                lru = iter.key();
+                lruRef = &ref;
+            }
+        }
+        if (!lruRef || !evictColorBuffer_locked(lru, lruRef)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FrameBuffer::printInstanceStats_locked(uint32_t instanceId,
+                                            InstanceInfo* instance)
+{
+    if (!instance->residentBytes && !instance->evictedBytes &&
+        !instance->evictions) {
+        return;
+    }
+    printf("Color buffers of instance %u: %.1f MB resident, %.1f MB "
+           "evicted, %u evictions and %u restores\n", instanceId,
+           instance->residentBytes / 1048576., instance->evictedBytes / 1048576.,
+           instance->evictions, instance->restores);
+    instance->evictions = 0;
+    instance->restores = 0;
+}
+
+void FrameBuffer::evictIdleColorBuffers_locked()
+{
+    ColorBufferMap::Iterator iter(&m_colorbuffers);
+    while (iter.hasNext()) {
+        iter.next();
+        ColorBufferRef& ref = iter.value();
+        if (m_frameCount - ref.lastUsedFrame >= s_evictIdleFrames &&
+            isEvictable_locked(iter.key(), ref)) {
+            evictColorBuffer_locked(iter.key(), &ref);
+        }
+    }
+}
+
 HandleType FrameBuffer::createColorBuffer(int p_width, int p_height,
                                           GLenum p_internalFormat)
 {
     emugl::Mutex::AutoLock mutex(m_lock);
     HandleType ret = 0;
 
+    InstanceInfo* instance = getInstance_locked();
+    if (!instance) {
+        return 0;
+    }
+
     ColorBufferPtr cb(ColorBuffer::create(
             getDisplay(),
             p_width,
@@ -570,9 +926,24 @@ HandleType FrameBuffer::createColorBuffer(int p_width, int p_height,
             getCaps().has_eglimage_texture_2d,
             m_colorBufferHelper));
     if (cb.Ptr() != NULL) {
+        // Make room for the new ColorBuffer in the budget of its instance.
+        // If that isn't possible, it goes back to the texture pool.
+        if (!makeRoom_locked(instance, cb->getMemorySize())) {
+            ERR("%s: %dx%d color buffer exceeds the memory limit\n",
+                __FUNCTION__, p_width, p_height);
+            return 0;
+        }
         ret = genHandle();
-        m_colorbuffers[ret].cb = cb;
-        m_colorbuffers[ret].refcount = 1;
+        ColorBufferRef ref;
+        ref.cb = cb;
+        ref.refcount = 1;
+        ref.sharedOffset = RC_SHARED_MEMORY_NONE;
+        ref.sharedFormat = 0;
+        ref.sharedType = 0;
+        ref.lastUsedFrame = m_frameCount;
+        m_colorbuffers.set(ret, ref);
+        instance->residentBytes += cb->getMemorySize();
+        setOwner_locked(ret);
     }
     return ret;
 }
@@ -590,11 +961,11 @@ HandleType FrameBuffer::createRenderContext(int p_config, HandleType p_share,
 
     RenderContextPtr share(NULL);
     if (p_share != 0) {
-        RenderContextMap::iterator s(m_contexts.find(p_share));
-        if (s == m_contexts.end()) {
+        RenderContextPtr* s = m_contexts.find(p_share);
+        if (!s || !canAccess_locked(p_share)) {
             return ret;
         }
-        share = (*s).second;
+        share = *s;
     }
     EGLContext sharedContext =
             share.Ptr() ? share->getEGLContext() : EGL_NO_CONTEXT;
@@ -603,7 +974,8 @@ HandleType FrameBuffer::createRenderContext(int p_config, HandleType p_share,
         m_eglDisplay, config->getEglConfig(), sharedContext, p_isGL2));
     if (rctx.Ptr() != NULL) {
         ret = genHandle();
-        m_contexts[ret] = rctx;
+        m_contexts.set(ret, rctx);
+        setOwner_locked(ret);
         RenderThreadInfo *tinfo = RenderThreadInfo::get();
         tinfo->m_contextSet.insert(ret);
     }
@@ -625,7 +997,8 @@ HandleType FrameBuffer::createWindowSurface(int p_config, int p_width, int p_hei
             getDisplay(), config->getEglConfig(), p_width, p_height));
     if (win.Ptr() != NULL) {
         ret = genHandle();
-        m_windows[ret] = std::pair<WindowSurfacePtr, HandleType>(win,0);
+        m_windows.set(ret, WindowSurfaceRef(win, 0));
+        setOwner_locked(ret);
         RenderThreadInfo *tinfo = RenderThreadInfo::get();
         tinfo->m_windowSet.insert(ret);
     }
@@ -642,6 +1015,7 @@ void FrameBuffer::drainRenderContext()
             it != tinfo->m_contextSet.end(); ++it) {
         HandleType contextHandle = *it;
         m_contexts.erase(contextHandle);
+        m_handleInstances.erase(contextHandle);
     }
     tinfo->m_contextSet.clear();
 }
@@ -654,15 +1028,19 @@ void FrameBuffer::drainWindowSurface()
     for (std::set<HandleType>::iterator it = tinfo->m_windowSet.begin();
             it != tinfo->m_windowSet.end(); ++it) {
         HandleType windowHandle = *it;
-        if (m_windows.find(windowHandle) != m_windows.end()) {
-            HandleType oldColorBufferHandle = m_windows[windowHandle].second;
+        WindowSurfaceRef* w = m_windows.find(windowHandle);
+        if (w) {
+            HandleType oldColorBufferHandle = w->second;
             if (oldColorBufferHandle) {
-                ColorBufferMap::iterator cit(m_colorbuffers.find(oldColorBufferHandle));
-                if (cit != m_colorbuffers.end()) {
-                    if (--(*cit).second.refcount == 0) { m_colorbuffers.erase(cit); }
+                ColorBufferRef* c = m_colorbuffers.find(oldColorBufferHandle);
+                if (c) {
+                    if (--c->refcount == 0) {
+                        eraseColorBuffer_locked(oldColorBufferHandle);
+                    }
                 }
             }
             m_windows.erase(windowHandle);
+            m_handleInstances.erase(windowHandle);
         }
     }
     tinfo->m_windowSet.clear();
@@ -671,7 +1049,11 @@ void FrameBuffer::drainWindowSurface()
 void FrameBuffer::DestroyRenderContext(HandleType p_context)
 {
     emugl::Mutex::AutoLock mutex(m_lock);
+    if (!canAccess_locked(p_context)) {
+        return;
+    }
     m_contexts.erase(p_context);
+    m_handleInstances.erase(p_context);
     RenderThreadInfo *tinfo = RenderThreadInfo::get();
     if (tinfo->m_contextSet.empty()) return;
     tinfo->m_contextSet.erase(p_context);
@@ -680,8 +1062,11 @@ void FrameBuffer::DestroyRenderContext(HandleType p_context)
 void FrameBuffer::DestroyWindowSurface(HandleType p_surface)
 {
     emugl::Mutex::AutoLock mutex(m_lock);
-    if (m_windows.find(p_surface) != m_windows.end()) {
-        m_windows.erase(p_surface);
+    if (!canAccess_locked(p_surface)) {
+        return;
+    }
+    if (m_windows.erase(p_surface)) {
+        m_handleInstances.erase(p_surface);
         RenderThreadInfo *tinfo = RenderThreadInfo::get();
         if (tinfo->m_windowSet.empty()) return;
         tinfo->m_windowSet.erase(p_surface);
@@ -691,29 +1076,29 @@ void FrameBuffer::DestroyWindowSurface(HandleType p_surface)
 int FrameBuffer::openColorBuffer(HandleType p_colorbuffer)
 {
     emugl::Mutex::AutoLock mutex(m_lock);
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (!c) {
         // bad colorbuffer handle
         ERR("FB: openColorBuffer cb handle %#x not found\n", p_colorbuffer);
         return -1;
     }
-    (*c).second.refcount++;
+    c->refcount++;
     return 0;
 }
 
 void FrameBuffer::closeColorBuffer(HandleType p_colorbuffer)
 {
     emugl::Mutex::AutoLock mutex(m_lock);
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (!c) {
         // This is harmless: it is normal for guest system to issue
         // closeColorBuffer command when the color buffer is already
         // garbage collected on the host. (we dont have a mechanism
         // to give guest a notice yet)
         return;
     }
-    if (--(*c).second.refcount == 0) {
-        m_colorbuffers.erase(c);
+    if (--c->refcount == 0) {
+        eraseColorBuffer_locked(p_colorbuffer);
     }
 }
 
@@ -721,14 +1106,14 @@ bool FrameBuffer::flushWindowSurfaceColorBuffer(HandleType p_surface)
 {
     emugl::Mutex::AutoLock mutex(m_lock);
 
-    WindowSurfaceMap::iterator w( m_windows.find(p_surface) );
-    if (w == m_windows.end()) {
+    WindowSurfaceRef* w = m_windows.find(p_surface);
+    if (!w || !canAccess_locked(p_surface)) {
         ERR("FB::flushWindowSurfaceColorBuffer: window handle %#x not found\n", p_surface);
         // bad surface handle
         return false;
     }
 
-    WindowSurface* surface = (*w).second.first.Ptr();
+    WindowSurface* surface = w->first.Ptr();
     surface->flushColorBuffer();
 
     return true;
@@ -739,22 +1124,22 @@ bool FrameBuffer::setWindowSurfaceColorBuffer(HandleType p_surface,
 {
     emugl::Mutex::AutoLock mutex(m_lock);
 
-    WindowSurfaceMap::iterator w( m_windows.find(p_surface) );
-    if (w == m_windows.end()) {
+    WindowSurfaceRef* w = m_windows.find(p_surface);
+    if (!w || !canAccess_locked(p_surface)) {
         // bad surface handle
         ERR("%s: bad window surface handle %#x\n", __FUNCTION__, p_surface);
         return false;
     }
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (!c) {
         DBG("%s: bad color buffer handle %#x\n", __FUNCTION__, p_colorbuffer);
         // bad colorbuffer handle
         return false;
     }
 
-    (*w).second.first->setColorBuffer((*c).second.cb);
-    (*w).second.second = p_colorbuffer;
+    w->first->setColorBuffer(c->cb);
+    w->second = p_colorbuffer;
     return true;
 }
 
@@ -762,15 +1147,105 @@ void FrameBuffer::readColorBuffer(HandleType p_colorbuffer,
                                     int x, int y, int width, int height,
                                     GLenum format, GLenum type, void *pixels)
 {
+    // Waiting for the GPU to complete the transfer can take a while, so
+    // this only holds |m_lock| to look up the color buffer and to switch
+    // to a context private to the calling thread, then reads through a
+    // framebuffer object of that context without the lock. Other render
+    // threads keep decoding meanwhile, and the caller only waits for the
+    // commands that the read depends on.
+    ColorBufferPtr cb;
+    RenderThreadInfo *tInfo = RenderThreadInfo::get();
+    EGLContext prevContext = s_egl.eglGetCurrentContext();
+    EGLSurface prevReadSurf = s_egl.eglGetCurrentSurface(EGL_READ);
+    EGLSurface prevDrawSurf = s_egl.eglGetCurrentSurface(EGL_DRAW);
+    {
+        emugl::Mutex::AutoLock mutex(m_lock);
+
+        ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+        if (!c) {
+            // bad colorbuffer handle
+            return;
+        }
+
+        // Submit the pending updates of the helper context, which the
+        // readback context can't otherwise see.
+        if (bind_locked()) {
+            s_gles2.glFlush();
+            unbind_locked();
+        }
+
+        if (!tInfo || !bindReadback_locked(tInfo)) {
+            c->cb->readPixels(x, y, width, height, format, type, pixels);
+            return;
+        }
+        cb = c->cb;
+    }
+
+    if (!cb->readPixelsWithFbo(&tInfo->m_readbackFbo, x, y, width, height,
+                               format, type, pixels)) {
+        ERR("%s: Could not read color buffer %u\n", __FUNCTION__,
+            p_colorbuffer);
+    }
+    s_egl.eglMakeCurrent(m_eglDisplay, prevDrawSurf, prevReadSurf,
+                         prevContext);
+
+    // Dropping the last reference destroys the ColorBuffer, which requires
+    // the helper context.
     emugl::Mutex::AutoLock mutex(m_lock);
+    cb = ColorBufferPtr();
+}
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
-        // bad colorbuffer handle
-        return;
+bool FrameBuffer::bindReadback_locked(RenderThreadInfo* tInfo)
+{
+    if (tInfo->m_readbackContext == EGL_NO_CONTEXT) {
+        static const EGLint pbufAttribs[] = {
+            EGL_WIDTH, 1,
+            EGL_HEIGHT, 1,
+            EGL_NONE
+        };
+        static const GLint glContextAttribs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, 2,
+            EGL_NONE
+        };
+
+        tInfo->m_readbackSurface = s_egl.eglCreatePbufferSurface(
+                m_eglDisplay, m_eglConfig, pbufAttribs);
+        if (tInfo->m_readbackSurface == EGL_NO_SURFACE) {
+            return false;
+        }
+        tInfo->m_readbackContext = s_egl.eglCreateContext(
+                m_eglDisplay, m_eglConfig, m_eglContext, glContextAttribs);
+        if (tInfo->m_readbackContext == EGL_NO_CONTEXT) {
+            s_egl.eglDestroySurface(m_eglDisplay, tInfo->m_readbackSurface);
+            tInfo->m_readbackSurface = EGL_NO_SURFACE;
+            return false;
+        }
     }
+    return s_egl.eglMakeCurrent(m_eglDisplay, tInfo->m_readbackSurface,
+                                tInfo->m_readbackSurface,
+                                tInfo->m_readbackContext);
+}
 
-    (*c).second.cb->readPixels(x, y, width, height, format, type, pixels);
+void FrameBuffer::drainReadbackContext()
+{
+    RenderThreadInfo *tInfo = RenderThreadInfo::get();
+    if (tInfo->m_readbackContext == EGL_NO_CONTEXT) {
+        return;
+    }
+    emugl::Mutex::AutoLock mutex(m_lock);
+    if (tInfo->m_readbackFbo &&
+        s_egl.eglMakeCurrent(m_eglDisplay, tInfo->m_readbackSurface,
+                             tInfo->m_readbackSurface,
+                             tInfo->m_readbackContext)) {
+        s_gles2.glDeleteFramebuffers(1, &tInfo->m_readbackFbo);
+        s_egl.eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                             EGL_NO_CONTEXT);
+    }
+    s_egl.eglDestroyContext(m_eglDisplay, tInfo->m_readbackContext);
+    s_egl.eglDestroySurface(m_eglDisplay, tInfo->m_readbackSurface);
+    tInfo->m_readbackContext = EGL_NO_CONTEXT;
+    tInfo->m_readbackSurface = EGL_NO_SURFACE;
+    tInfo->m_readbackFbo = 0;
 }
 
 bool FrameBuffer::updateColorBuffer(HandleType p_colorbuffer,
@@ -779,14 +1254,115 @@ bool FrameBuffer::updateColorBuffer(HandleType p_colorbuffer,
 {
     emugl::Mutex::AutoLock mutex(m_lock);
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (!c) {
+        // bad colorbuffer handle
+        return false;
+    }
+
+    c->cb->subUpdate(x, y, width, height, format, type, pixels);
+
+    return true;
+}
+
+bool FrameBuffer::updateColorBufferYuv(HandleType p_colorbuffer,
+                                       int width, int height, int format,
+                                       const void* pixels)
+{
+    emugl::Mutex::AutoLock mutex(m_lock);
+
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (!c) {
         // bad colorbuffer handle
         return false;
     }
 
-    (*c).second.cb->subUpdate(x, y, width, height, format, type, pixels);
+    return c->cb->subUpdateYuv(width, height, format, pixels);
+}
+
+// static
+void FrameBuffer::setSharedMemory(void* base, size_t size)
+{
+    s_sharedMemory = static_cast<uint8_t*>(base);
+    s_sharedMemorySize = base ? size : 0;
+}
 
+bool FrameBuffer::bindColorBufferSharedMemory(HandleType p_colorbuffer,
+                                              uint32_t offset,
+                                              GLenum format, GLenum type)
+{
+    emugl::Mutex::AutoLock mutex(m_lock);
+
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (!c) {
+        // bad colorbuffer handle
+        return false;
+    }
+
+    if (offset != RC_SHARED_MEMORY_NONE) {
+        uint64_t size = (uint64_t)c->cb->getWidth() * c->cb->getHeight() *
+                        (glUtilsPixelBitSize(format, type) >> 3);
+        if (size == 0 || (uint64_t)offset + size > s_sharedMemorySize) {
+            ERR("%s: color buffer %#x doesn't fit at offset %#x of the "
+                "shared memory\n", __FUNCTION__, p_colorbuffer, offset);
+            return false;
+        }
+    }
+    c->sharedOffset = offset;
+    c->sharedFormat = format;
+    c->sharedType = type;
+    return true;
+}
+
+void* FrameBuffer::getSharedPixels(HandleType p_colorbuffer,
+                                   int y, int height, int* width,
+                                   GLenum* format, GLenum* type)
+{
+    emugl::Mutex::AutoLock mutex(m_lock);
+
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (!c || c->sharedOffset == RC_SHARED_MEMORY_NONE) {
+        return NULL;
+    }
+    if (y < 0 || height <= 0 || (GLuint)(y + height) > c->cb->getHeight()) {
+        return NULL;
+    }
+    // The binding checked that the whole ColorBuffer fits in the region.
+    size_t stride = c->cb->getWidth() *
+                    (glUtilsPixelBitSize(c->sharedFormat, c->sharedType) >> 3);
+    *width = c->cb->getWidth();
+    *format = c->sharedFormat;
+    *type = c->sharedType;
+    return s_sharedMemory + c->sharedOffset + stride * y;
+}
+
+bool FrameBuffer::updateColorBufferFromSharedMemory(HandleType p_colorbuffer,
+                                                    int y, int height)
+{
+    int width;
+    GLenum format, type;
+    void* pixels = getSharedPixels(p_colorbuffer, y, height, &width,
+                                   &format, &type);
+    if (!pixels) {
+        return false;
+    }
+    // Whole rows are contiguous in the shared memory, so they can be
+    // uploaded without GL_UNPACK_ROW_LENGTH, which GLES 2.0 lacks.
+    return updateColorBuffer(p_colorbuffer, 0, y, width, height,
+                             format, type, pixels);
+}
+
+bool FrameBuffer::readColorBufferToSharedMemory(HandleType p_colorbuffer,
+                                                int y, int height)
+{
+    int width;
+    GLenum format, type;
+    void* pixels = getSharedPixels(p_colorbuffer, y, height, &width,
+                                   &format, &type);
+    if (!pixels) {
+        return false;
+    }
+    readColorBuffer(p_colorbuffer, 0, y, width, height, format, type, pixels);
     return true;
 }
 
@@ -794,26 +1370,26 @@ bool FrameBuffer::bindColorBufferToTexture(HandleType p_colorbuffer)
 {
     emugl::Mutex::AutoLock mutex(m_lock);
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (!c) {
         // bad colorbuffer handle
         return false;
     }
 
-    return (*c).second.cb->bindToTexture();
+    return c->cb->bindToTexture();
 }
 
 bool FrameBuffer::bindColorBufferToRenderbuffer(HandleType p_colorbuffer)
 {
     emugl::Mutex::AutoLock mutex(m_lock);
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (!c) {
         // bad colorbuffer handle
         return false;
     }
 
-    return (*c).second.cb->bindToRenderbuffer();
+    return c->cb->bindToRenderbuffer();
 }
 
 bool FrameBuffer::bindContext(HandleType p_context,
@@ -829,45 +1405,59 @@ bool FrameBuffer::bindContext(HandleType p_context,
     // if this is not an unbind operation - make sure all handles are good
     //
     if (p_context || p_drawSurface || p_readSurface) {
-        RenderContextMap::iterator r( m_contexts.find(p_context) );
-        if (r == m_contexts.end()) {
+        RenderContextPtr* r = m_contexts.find(p_context);
+        if (!r || !canAccess_locked(p_context)) {
             // bad context handle
             return false;
         }
 
-        ctx = (*r).second;
-        WindowSurfaceMap::iterator w( m_windows.find(p_drawSurface) );
-        if (w == m_windows.end()) {
+        ctx = *r;
+        WindowSurfaceRef* w = m_windows.find(p_drawSurface);
+        if (!w || !canAccess_locked(p_drawSurface)) {
             // bad surface handle
             return false;
         }
-        draw = (*w).second.first;
+        draw = w->first;
 
         if (p_readSurface != p_drawSurface) {
-            WindowSurfaceMap::iterator w( m_windows.find(p_readSurface) );
-            if (w == m_windows.end()) {
+            WindowSurfaceRef* w = m_windows.find(p_readSurface);
+            if (!w || !canAccess_locked(p_readSurface)) {
                 // bad surface handle
                 return false;
             }
-            read = (*w).second.first;
+            read = w->first;
         }
         else {
             read = draw;
         }
     }
 
-    if (!s_egl.eglMakeCurrent(m_eglDisplay,
-                              draw ? draw->getEGLSurface() : EGL_NO_SURFACE,
-                              read ? read->getEGLSurface() : EGL_NO_SURFACE,
-                              ctx ? ctx->getEGLContext() : EGL_NO_CONTEXT)) {
-        ERR("eglMakeCurrent failed\n");
-        return false;
+    EGLSurface eglDraw = draw ? draw->getEGLSurface() : EGL_NO_SURFACE;
+    EGLSurface eglRead = read ? read->getEGLSurface() : EGL_NO_SURFACE;
+    EGLContext eglContext = ctx ? ctx->getEGLContext() : EGL_NO_CONTEXT;
+
+    //
+    // Guests often make the same context current again, e.g. on every
+    // eglSwapBuffers(), skip the switch when nothing changes. The EGL
+    // handles are compared, since a resized surface gets a new one.
+    //
+    RenderThreadInfo *tinfo = RenderThreadInfo::get();
+    if (tinfo->currEglContext != eglContext ||
+        tinfo->currEglDrawSurf != eglDraw ||
+        tinfo->currEglReadSurf != eglRead) {
+        if (!s_egl.eglMakeCurrent(m_eglDisplay, eglDraw, eglRead,
+                                  eglContext)) {
+            ERR("eglMakeCurrent failed\n");
+            return false;
+        }
+        tinfo->currEglContext = eglContext;
+        tinfo->currEglDrawSurf = eglDraw;
+        tinfo->currEglReadSurf = eglRead;
     }
 
     //
     // Bind the surface(s) to the context
     //
-    RenderThreadInfo *tinfo = RenderThreadInfo::get();
     WindowSurfacePtr bindDraw, bindRead;
     if (draw.Ptr() == NULL && read.Ptr() == NULL) {
         // Unbind the current read and draw surfaces from the context
@@ -914,6 +1504,14 @@ bool FrameBuffer::bind_locked()
     EGLSurface prevReadSurf = s_egl.eglGetCurrentSurface(EGL_READ);
     EGLSurface prevDrawSurf = s_egl.eglGetCurrentSurface(EGL_DRAW);
 
+    if (prevContext == m_pbufContext && prevReadSurf == m_pbufSurface &&
+        prevDrawSurf == m_pbufSurface) {
+        // Already current, e.g. when called from a ColorBuffer method
+        // while the framebuffer is bound.
+        m_skippedBinds++;
+        return true;
+    }
+
     if (!s_egl.eglMakeCurrent(m_eglDisplay, m_pbufSurface,
                               m_pbufSurface, m_pbufContext)) {
         ERR("eglMakeCurrent failed\n");
@@ -932,6 +1530,13 @@ bool FrameBuffer::bindSubwin_locked()
     EGLSurface prevReadSurf = s_egl.eglGetCurrentSurface(EGL_READ);
     EGLSurface prevDrawSurf = s_egl.eglGetCurrentSurface(EGL_DRAW);
 
+    if (prevContext == m_eglContext && prevReadSurf == m_eglSurface &&
+        prevDrawSurf == m_eglSurface) {
+        // Already current, there is nothing to restore either.
+        m_skippedBinds++;
+        return true;
+    }
+
     if (!s_egl.eglMakeCurrent(m_eglDisplay, m_eglSurface,
                               m_eglSurface, m_eglContext)) {
         ERR("eglMakeCurrent failed\n");
@@ -953,6 +1558,11 @@ bool FrameBuffer::bindSubwin_locked()
 
 bool FrameBuffer::unbind_locked()
 {
+    if (m_skippedBinds > 0) {
+        m_skippedBinds--;
+        return true;
+    }
+
     if (!s_egl.eglMakeCurrent(m_eglDisplay, m_prevDrawSurf,
                               m_prevReadSurf, m_prevContext)) {
         return false;
@@ -964,20 +1574,31 @@ bool FrameBuffer::unbind_locked()
     return true;
 }
 
-bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock)
+bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock,
+                       long long guestPostUs)
 {
+    emugl::ScopedTrace trace(emugl::kTraceCategoryFb, "post");
+    emugl::ScopedMetricTimer timer(emugl::kMetricPostUs);
+    long long postTimesUs[kPostStageCount];
+    postTimesUs[kPostGuest] = guestPostUs ? guestPostUs : GetCurrentTimeUS();
     if (needLock) {
         m_lock.lock();
     }
+    postTimesUs[kPostStart] = GetCurrentTimeUS();
     bool ret = false;
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (!c) {
         goto EXIT;
     }
 
     m_lastPostedColorBuffer = p_colorbuffer;
 
+    m_frameCount++;
+    if (s_evictIdleFrames && m_frameCount % kEvictionCheckFrames == 0) {
+        evictIdleColorBuffers_locked();
+    }
+
     if (m_subWin) {
         // bind the subwindow eglSurface
         if (!bindSubwin_locked()) {
@@ -991,17 +1612,19 @@ bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock)
         if (m_zRot != 0.0f) {
             s_gles2.glClear(GL_COLOR_BUFFER_BIT);
         }
-        ret = (*c).second.cb->post(m_zRot);
+        ret = c->cb->post(m_zRot);
         if (ret) {
             s_egl.eglSwapBuffers(m_eglDisplay, m_eglSurface);
+            m_vsyncClock.onPresent(GetCurrentTimeUS());
         }
 
         // restore previous binding
         unbind_locked();
     } else {
         // If there is no sub-window, don't display anything, the client will
-        // rely on m_onPost to get the pixels instead.
+        // rely on the post callback to get the pixels instead.
         ret = true;
+        m_vsyncClock.onPresent(GetCurrentTimeUS());
     }
 
     //
@@ -1013,6 +1636,24 @@ bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock)
         if (currTime - m_statsStartTime >= 1000) {
             float dt = (float)(currTime - m_statsStartTime) / 1000.0f;
             printf("FPS: %5.3f\n", (float)m_statsNumFrames / dt);
+            unsigned int elided = gles1_dispatch_take_elided_call_count() +
+                                  gles2_dispatch_take_elided_call_count();
+            printf("Redundant GL state calls elided: %.1f per frame\n",
+                   (float)elided / (float)m_statsNumFrames);
+            if (m_compositor) {
+                printf("Frames dropped by compositor: %u\n",
+                       m_compositor->takeDroppedFrameCount());
+            }
+            unsigned int poolHits, poolMisses;
+            ColorBuffer::getPoolStats(&poolHits, &poolMisses);
+            printf("Color buffers reused from pool: %u of %u\n",
+                   poolHits, poolHits + poolMisses);
+            printInstanceStats_locked(0, &m_defaultInstance);
+            InstanceMap::Iterator iter(&m_instances);
+            while (iter.hasNext()) {
+                iter.next();
+                printInstanceStats_locked(iter.key(), &iter.value());
+            }
             m_statsStartTime = currTime;
             m_statsNumFrames = 0;
         }
@@ -1021,16 +1662,7 @@ bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock)
     //
     // Send framebuffer (without FPS overlay) to callback
     //
-    if (m_onPost) {
-        (*c).second.cb->readback(m_fbImage);
-        m_onPost(m_onPostContext,
-                 m_width,
-                 m_height,
-                 -1,
-                 GL_RGBA,
-                 GL_UNSIGNED_BYTE,
-                 m_fbImage);
-    }
+    sendPostCallback_locked(0, p_colorbuffer, c->cb, postTimesUs, &needLock);
 
 EXIT:
     if (needLock) {
@@ -1039,6 +1671,267 @@ EXIT:
     return ret;
 }
 
+void FrameBuffer::sendPostCallback_locked(int id,
+                                          HandleType p_colorbuffer,
+                                          const ColorBufferPtr& cb,
+                                          long long* postTimesUs,
+                                          bool* needLock)
+{
+    Display& display = m_displays[id];
+    if (!display.onPost) {
+        return;
+    }
+    if ((int)cb->getWidth() != display.width ||
+        (int)cb->getHeight() != display.height) {
+        ERR("%s: ColorBuffer size doesn't match display %d\n",
+            __FUNCTION__, id);
+        return;
+    }
+
+    // Read back into the image that is not used by the previous post,
+    // then call the callback without holding |m_lock|, so that the
+    // next frame can be rendered and read back in the meantime.
+    // Acquiring |m_postLock| before releasing |m_lock| ensures that
+    // an image is never overwritten while it is being delivered.
+    int dx = 0, dy = 0, dw = 0, dh = 0;
+    bool damaged = cb->takeDamage(id, &dx, &dy, &dw, &dh);
+    if (p_colorbuffer != display.lastReadbackColorBuffer) {
+        // Another ColorBuffer, both images must be refreshed.
+        dx = dy = 0;
+        dw = display.width;
+        dh = display.height;
+        damaged = true;
+        display.prevDamageY0 = 0;
+        display.prevDamageY1 = display.height;
+        display.lastReadbackColorBuffer = p_colorbuffer;
+    }
+    if (!damaged) {
+        // Nothing changed since the last post.
+        return;
+    }
+
+    // The image was last filled two posts ago, so read back the rows
+    // damaged by both this post and the previous one.
+    int y0 = dy < display.prevDamageY0 ? dy : display.prevDamageY0;
+    int y1 = dy + dh > display.prevDamageY1 ? dy + dh : display.prevDamageY1;
+    display.prevDamageY0 = dy;
+    display.prevDamageY1 = dy + dh;
+
+    unsigned char* image = display.fbImage[display.fbImageIndex];
+    display.fbImageIndex ^= 1;
+    postTimesUs[kPostReadbackStart] = GetCurrentTimeUS();
+    if (y0 == 0 && y1 == display.height) {
+        cb->readback(image);
+    } else {
+        cb->readbackRows(y0, y1 - y0, image);
+    }
+    postTimesUs[kPostReadbackEnd] = GetCurrentTimeUS();
+
+    OnPostFn onPost = display.onPost;
+    void* onPostContext = display.onPostContext;
+    int width = display.width;
+    int height = display.height;
+
+    m_postLock.lock();
+    if (*needLock) {
+        m_lock.unlock();
+        *needLock = false;
+    }
+    memcpy(m_postTimesUs, postTimesUs, sizeof(m_postTimesUs));
+    onPost(onPostContext,
+           width,
+           height,
+           -1,
+           GL_RGBA,
+           GL_UNSIGNED_BYTE,
+           image,
+           dx,
+           dy,
+           dw,
+           dh);
+    m_postLock.unlock();
+}
+
+bool FrameBuffer::postDisplay(int id, HandleType p_colorbuffer)
+{
+    if (id == 0) {
+        return post(p_colorbuffer);
+    }
+    long long postTimesUs[kPostStageCount];
+    postTimesUs[kPostGuest] = GetCurrentTimeUS();
+    bool needLock = true;
+    m_lock.lock();
+    postTimesUs[kPostStart] = GetCurrentTimeUS();
+    bool ret = false;
+    ColorBufferRef* c = findColorBuffer_locked(p_colorbuffer);
+    if (id > 0 && id < kMaxDisplays && m_displays[id].used && c) {
+        sendPostCallback_locked(id, p_colorbuffer, c->cb, postTimesUs,
+                                &needLock);
+        ret = true;
+    }
+    if (needLock) {
+        m_lock.unlock();
+    }
+    return ret;
+}
+
+void FrameBuffer::postAsync(HandleType p_colorbuffer)
+{
+    if (m_compositor) {
+        m_compositor->post(p_colorbuffer, GetCurrentTimeUS());
+    } else {
+        post(p_colorbuffer);
+    }
+}
+
+int FrameBuffer::getPostTimings(long long* agesUs, int count) const
+{
+    if (count > kPostStageCount) {
+        count = kPostStageCount;
+    }
+    long long now = GetCurrentTimeUS();
+    for (int n = 0; n < count; ++n) {
+        agesUs[n] = now - m_postTimesUs[n];
+    }
+    return count;
+}
+
+bool FrameBuffer::getVsyncTiming(long long* ageUs, long long* periodUs)
+{
+    return m_vsyncClock.getTiming(GetCurrentTimeUS(), ageUs, periodUs);
+}
+
+// Version of the snapshot data, increment it when the layout changes.
+static const uint32_t kSnapshotVersion = 1;
+
+// Largest ColorBuffer dimension accepted when loading a snapshot.
+static const uint32_t kSnapshotMaxDimension = 16384;
+
+bool FrameBuffer::saveSnapshot(SnapshotWriteFn writeFn, void* context)
+{
+    emugl::Mutex::AutoLock mutex(m_lock);
+
+    // All the values are 32-bit words in host byte order, as snapshots
+    // are only loaded on the host that saved them:
+    //   version, next handle, last posted ColorBuffer, ColorBuffer count,
+    // then for each ColorBuffer:
+    //   handle, width, height, internal format, reference count,
+    // followed by its width * height RGBA pixels, bottom to top.
+    uint32_t header[4];
+    header[0] = kSnapshotVersion;
+    header[1] = s_nextHandle;
+    header[2] = m_lastPostedColorBuffer;
+    header[3] = (uint32_t)m_colorbuffers.size();
+    writeFn(context, header, sizeof(header));
+
+    unsigned char* pixels = NULL;
+    size_t pixelsSize = 0;
+    ColorBufferMap::Iterator iter(&m_colorbuffers);
+    while (iter.hasNext()) {
+        iter.next();
+        const ColorBufferPtr& cb = iter.value().cb;
+        uint32_t info[5];
+        info[0] = iter.key();
+        info[1] = cb->getWidth();
+        info[2] = cb->getHeight();
+        info[3] = cb->getInternalFormat();
+        info[4] = iter.value().refcount;
+        writeFn(context, info, sizeof(info));
+
+        size_t size = 4U * info[1] * info[2];
+        if (size > pixelsSize) {
+            free(pixels);
+            pixels = (unsigned char*)malloc(size);
+            pixelsSize = size;
+        }
+        cb->readPixels(0, 0, info[1], info[2], GL_RGBA, GL_UNSIGNED_BYTE,
+                       pixels);
+        writeFn(context, pixels, size);
+    }
+    free(pixels);
+    return true;
+}
+
+bool FrameBuffer::loadSnapshot(SnapshotReadFn readFn, void* context)
+{
+    emugl::Mutex::AutoLock mutex(m_lock);
+
+    uint32_t header[4];
+    if (readFn(context, header, sizeof(header)) != sizeof(header) ||
+        header[0] != kSnapshotVersion) {
+        ERR("%s: Unsupported snapshot data\n", __FUNCTION__);
+        return false;
+    }
+
+    // The ColorBuffers of the current session are unreachable once the
+    // guest state is replaced.
+    m_colorbuffers.clear();
+    m_defaultInstance.residentBytes = 0;
+    m_defaultInstance.evictedBytes = 0;
+    m_lastPostedColorBuffer = 0;
+    s_nextHandle = header[1];
+
+    bool ok = true;
+    unsigned char* pixels = NULL;
+    size_t pixelsSize = 0;
+    for (uint32_t n = 0; n < header[3]; ++n) {
+        uint32_t info[5];
+        if (readFn(context, info, sizeof(info)) != sizeof(info) ||
+            info[0] == 0 ||
+            info[1] == 0 || info[1] > kSnapshotMaxDimension ||
+            info[2] == 0 || info[2] > kSnapshotMaxDimension) {
+            ok = false;
+            break;
+        }
+        size_t size = 4U * info[1] * info[2];
+        if (size > pixelsSize) {
+            free(pixels);
+            pixels = (unsigned char*)malloc(size);
+            pixelsSize = size;
+        }
+        if (readFn(context, pixels, size) != size) {
+            ok = false;
+            break;
+        }
+
+        ColorBufferPtr cb(ColorBuffer::create(
+                getDisplay(),
+                info[1],
+                info[2],
+                info[3],
+                getCaps().has_eglimage_texture_2d,
+                m_colorBufferHelper));
+        if (cb.Ptr() == NULL) {
+            ERR("%s: Could not restore color buffer %#x\n", __FUNCTION__,
+                info[0]);
+            ok = false;
+            break;
+        }
+        cb->subUpdate(0, 0, info[1], info[2], GL_RGBA, GL_UNSIGNED_BYTE,
+                      pixels);
+
+        ColorBufferRef ref;
+        ref.cb = cb;
+        ref.refcount = info[4];
+        ref.sharedOffset = RC_SHARED_MEMORY_NONE;
+        ref.sharedFormat = 0;
+        ref.sharedType = 0;
+        ref.lastUsedFrame = m_frameCount;
+        m_colorbuffers.set(info[0], ref);
+        m_defaultInstance.residentBytes += cb->getMemorySize();
+    }
+    free(pixels);
+
+    if (!ok) {
+        ERR("%s: Truncated or malformed snapshot data\n", __FUNCTION__);
+        return false;
+    }
+    if (header[2] && m_colorbuffers.contains(header[2])) {
+        post(header[2], false);
+    }
+    return true;
+}
+
 bool FrameBuffer::repost() {
     if (m_lastPostedColorBuffer) {
         return post(m_lastPostedColorBuffer);
@@ -17,19 +17,25 @@
 #define _LIBRENDER_FRAMEBUFFER_H
 
 #include "ColorBuffer.h"
+#include "emugl/common/hash_map.h"
 #include "emugl/common/mutex.h"
 #include "FbConfig.h"
 #include "RenderContext.h"
 #include "render_api.h"
+#include "renderControl_types.h"
 #include "TextureDraw.h"
+#include "VsyncClock.h"
 #include "WindowSurface.h"
 
 #include <EGL/egl.h>
 
-#include <map>
+#include <utility>
 
 #include <stdint.h>
 
+class Compositor;
+struct RenderThreadInfo;
+
 // Type of handles, a.k.a. "object names" in the GL specification.
 // These are integers used to uniquely identify a resource of a given type.
 typedef uint32_t HandleType;
@@ -37,10 +43,21 @@ typedef uint32_t HandleType;
 struct ColorBufferRef {
     ColorBufferPtr cb;
     uint32_t refcount;  // number of client-side references
+    // Offset of the pixels of the ColorBuffer in the shared memory region,
+    // or RC_SHARED_MEMORY_NONE, and their format and type. See
+    // FrameBuffer::bindColorBufferSharedMemory().
+    uint32_t sharedOffset;
+    GLenum sharedFormat;
+    GLenum sharedType;
+    // Value of FrameBuffer::m_frameCount when the ColorBuffer was last
+    // looked up, used to find the idle ones.
+    uint32_t lastUsedFrame;
 };
-typedef std::map<HandleType, RenderContextPtr> RenderContextMap;
-typedef std::map<HandleType, std::pair<WindowSurfacePtr, HandleType> > WindowSurfaceMap;
-typedef std::map<HandleType, ColorBufferRef> ColorBufferMap;
+// A window surface, and the handle of its color buffer, or 0.
+typedef std::pair<WindowSurfacePtr, HandleType> WindowSurfaceRef;
+typedef emugl::HashMap<HandleType, RenderContextPtr> RenderContextMap;
+typedef emugl::HashMap<HandleType, WindowSurfaceRef> WindowSurfaceMap;
+typedef emugl::HashMap<HandleType, ColorBufferRef> ColorBufferMap;
 
 // A structure used to list the capabilities of the underlying EGL
 // implementation that the FrameBuffer instance depends on.
@@ -83,14 +100,21 @@ public:
     // used to initialize the framebuffer (in which case scaling will be
     // applied automatically). |zRot| is a rotation angle in degrees,
     // (clockwise in the Y-upwards GL coordinate space).
+    // If |hosted| is true, |p_window| is instead a native window that the UI
+    // reserved for the GPU display, e.g. a widget of a composited toolkit,
+    // and the content is rendered straight into it: no sub-window is
+    // created, |x| and |y| are ignored, and the UI remains responsible for
+    // the window's lifetime.
     // Return true on success, false otherwise.
     //
     // NOTE: This can return NULL for software-only EGL engines like OSMesa.
     bool setupSubWindow(FBNativeWindowType p_window,
                         int x, int y,
-                        int width, int height, float zRot);
+                        int width, int height, float zRot,
+                        bool hosted);
 
-    // Remove the sub-window created by setupSubWindow(), if any.
+    // Remove the sub-window created by setupSubWindow(), if any, or stop
+    // rendering into the hosted window.
     // Return true on success, false otherwise.
     bool removeSubWindow();
 
@@ -116,7 +140,28 @@ public:
     // Set a callback that will be called each time the emulated GPU content
     // is updated. This can be relatively slow with host-based GPU emulation,
     // so only do this when you need to.
-    void setPostCallback(OnPostFn onPost, void* onPostContext);
+    void setPostCallback(OnPostFn onPost, void* onPostContext) {
+        setDisplayPostCallback(0, onPost, onPostContext);
+    }
+
+    // Maximum number of displays, including the primary one, whose id is
+    // always 0.
+    static const int kMaxDisplays = ColorBuffer::kMaxDisplays;
+
+    // Create a new secondary display of |width| x |height| pixels. Unlike
+    // the primary display, it is never shown in the sub-window, and its
+    // content is only available through setDisplayPostCallback(). All
+    // displays share the same ColorBuffers, which are never copied between
+    // them. Returns the id of the new display, or -1 on failure.
+    int createDisplay(int width, int height);
+
+    // Destroy the secondary display |id|. Returns false if it doesn't
+    // exist.
+    bool destroyDisplay(int id);
+
+    // Same as setPostCallback(), for the display |id|. Each display has
+    // its own readback images and damage tracking.
+    void setDisplayPostCallback(int id, OnPostFn onPost, void* onPostContext);
 
     // Retrieve the GL strings of the underlying EGL/GLES implementation.
     // On return, |*vendor|, |*renderer| and |*version| will point to strings
@@ -163,6 +208,10 @@ public:
     // host buffers when a guest application crashes, for example.
     void drainWindowSurface();
 
+    // Call this function when a render thread terminates to destroy the
+    // context it used to read color buffers, if any.
+    void drainReadbackContext();
+
     // Destroy a given RenderContext instance. |p_context| is its handle
     // value as returned by createRenderContext().
     void DestroyRenderContext(HandleType p_context);
@@ -245,12 +294,126 @@ public:
                            int x, int y, int width, int height,
                            GLenum format, GLenum type, void *pixels);
 
+    // Replace the content of a given ColorBuffer with a |width| x |height|
+    // YUV 4:2:0 frame from host memory, converted to RGB on the GPU, e.g.
+    // a camera frame. |format| is a TextureDraw::YuvFormat value. Returns
+    // true on success, false if the handle is invalid or the upload fails.
+    bool updateColorBufferYuv(HandleType p_colorbuffer,
+                              int width, int height, int format,
+                              const void* pixels);
+
+    // Several emulator instances can share a single renderer process, see
+    // emugl_render_service. Each one is identified by a non-zero id, that
+    // of the RenderThreadInfo of the threads serving its streams. Their
+    // contexts, window surfaces and ColorBuffers are only visible to the
+    // threads of the same instance, and are freed when it disconnects.
+
+    // Register a new thread serving |instanceId|. Does nothing for 0.
+    void addInstanceThread(uint32_t instanceId);
+
+    // Unregister a thread registered with addInstanceThread(), and free
+    // the remaining ColorBuffers of |instanceId| if it was the last one.
+    void releaseInstanceThread(uint32_t instanceId);
+
+    // Set the budget in bytes of the host GPU memory used by the resident
+    // ColorBuffers of each instance, or 0 for no limit, the default. The
+    // threads that don't belong to an instance, e.g. those of a single
+    // emulator, share another budget. When a new ColorBuffer doesn't fit,
+    // the least recently used ones of the same instance are evicted, and
+    // createColorBuffer() only fails if that isn't enough. This can be
+    // called before the FrameBuffer is initialized.
+    static void setInstanceMemoryLimit(uint64_t bytes);
+
+    // Evict the ColorBuffers that haven't been used for |frames| posted
+    // frames, or never if 0, the default. Evicted ColorBuffers are kept
+    // compressed in host memory, and restored on their next use. This can
+    // be called before the FrameBuffer is initialized.
+    static void setEvictIdleFrames(uint32_t frames);
+
+    // Set the memory region shared with the guest, through which the
+    // pixels of the ColorBuffers bound with bindColorBufferSharedMemory()
+    // are exchanged. |base| is its host address and |size| its size in
+    // bytes. This can be called before the FrameBuffer is initialized.
+    static void setSharedMemory(void* base, size_t size);
+
+    // Bind the pixels of a given ColorBuffer to |offset| in the shared
+    // memory region: tightly packed rows of |format| and |type| pixels,
+    // bottom to top as with glReadPixels(). Pass RC_SHARED_MEMORY_NONE as
+    // |offset| to unbind them. Returns true on success, false if the
+    // handle is invalid or the pixels don't fit in the region.
+    bool bindColorBufferSharedMemory(HandleType p_colorbuffer,
+                                     uint32_t offset,
+                                     GLenum format, GLenum type);
+
+    // Upload the rows |y| to |y + height| of a ColorBuffer bound with
+    // bindColorBufferSharedMemory() from the shared memory, after the
+    // guest wrote them. Returns true on success, false otherwise.
+    bool updateColorBufferFromSharedMemory(HandleType p_colorbuffer,
+                                           int y, int height);
+
+    // Read the rows |y| to |y + height| of a ColorBuffer bound with
+    // bindColorBufferSharedMemory() into the shared memory, before the
+    // guest reads them. Returns true on success, false otherwise.
+    bool readColorBufferToSharedMemory(HandleType p_colorbuffer,
+                                       int y, int height);
+
     // Display the content of a given ColorBuffer into the framebuffer's
     // sub-window. |p_colorbuffer| is a handle value.
     // |needLock| is used to indicate whether the operation requires
     // acquiring/releasing the FrameBuffer instance's lock. It should be
-    // false only when called internally.
-    bool post(HandleType p_colorbuffer, bool needLock = true);
+    // false only when called internally. |guestPostUs| is the
+    // GetCurrentTimeUS() value at which the guest posted the ColorBuffer,
+    // if it was queued for later display, or 0 to use the current time.
+    bool post(HandleType p_colorbuffer, bool needLock = true,
+              long long guestPostUs = 0);
+
+    // Queue |p_colorbuffer| for display by the compositor thread and return
+    // immediately, without waiting for the composition nor the buffer swap.
+    // If a previously queued ColorBuffer wasn't displayed yet, it is
+    // dropped. Falls back to post() if the compositor thread couldn't be
+    // started.
+    void postAsync(HandleType p_colorbuffer);
+
+    // Display the content of |p_colorbuffer| on display |id|. This is the
+    // same as post() for the primary display. For secondary displays,
+    // this only passes its content to the display's post callback, if any,
+    // and the ColorBuffer must have the dimensions of the display.
+    bool postDisplay(int id, HandleType p_colorbuffer);
+
+    // Stages of a post, as reported by getPostTimings().
+    enum PostStage {
+        kPostGuest = 0,         // The guest posted the ColorBuffer.
+        kPostStart,             // post() acquired the FrameBuffer lock.
+        kPostReadbackStart,     // The readback for the callback started.
+        kPostReadbackEnd,       // The readback completed.
+        kPostStageCount
+    };
+
+    // Only valid when called from a post callback: store into |agesUs|
+    // the number of microseconds elapsed since each PostStage of the
+    // frame being delivered, up to |count| values, and return the number
+    // of values stored.
+    int getPostTimings(long long* agesUs, int count) const;
+
+    // Store into |*ageUs| the number of microseconds since the last guest
+    // vsync, and into |*periodUs| the vsync period, as estimated from the
+    // presentations of the primary display, see VsyncClock. Return false
+    // if the guest didn't post enough frames yet.
+    bool getVsyncTiming(long long* ageUs, long long* periodUs);
+
+    // Save the ColorBuffers, with their handles, reference counts and
+    // contents, through |writeFn|, along with the handle counter and the
+    // last posted ColorBuffer. Render contexts and window surfaces are
+    // not saved: they belong to the render threads of the guest
+    // connections, which don't survive a snapshot. Must be called while
+    // the guest is stopped. Returns true on success.
+    bool saveSnapshot(SnapshotWriteFn writeFn, void* context);
+
+    // Replace the ColorBuffers with those saved by saveSnapshot(), read
+    // through |readFn|, and re-post the last posted one. Returns true on
+    // success, false if the data is truncated or malformed, in which case
+    // the ColorBuffers read so far are kept.
+    bool loadSnapshot(SnapshotReadFn readFn, void* context);
 
     // Re-post the last ColorBuffer that was displayed through post().
     // This is useful if you detect that the sub-window content needs to
@@ -281,14 +444,104 @@ private:
 
     bool bindSubwin_locked();
 
+    // Make the readback context of |tInfo| current, creating it if needed.
+    // Must be called with |m_lock| held. Return true on success.
+    bool bindReadback_locked(RenderThreadInfo* tInfo);
+
+    // Pass the content of |p_colorbuffer| to the post callback of display
+    // |id|, if any. Must be called with |m_lock| held, and releases it
+    // before calling the callback if |*needLock| is true, setting it to
+    // false in this case. |postTimesUs| holds the times of the kPostGuest
+    // and kPostStart stages, and is updated with the readback ones.
+    void sendPostCallback_locked(int id,
+                                 HandleType p_colorbuffer,
+                                 const ColorBufferPtr& cb,
+                                 long long* postTimesUs,
+                                 bool* needLock);
+
 private:
+    // Return the address of the rows |y| to |y + height| of a ColorBuffer
+    // bound to the shared memory, and their format and type, or NULL.
+    void* getSharedPixels(HandleType p_colorbuffer, int y, int height,
+                          int* width, GLenum* format, GLenum* type);
+
+    // Per-instance state, see addInstanceThread().
+    struct InstanceInfo {
+        int threads;
+        // Sizes of the resident and evicted ColorBuffers.
+        uint64_t residentBytes;
+        uint64_t evictedBytes;
+        // Counts since the last printInstanceStats_locked() call.
+        unsigned evictions;
+        unsigned restores;
+    };
+    typedef emugl::HashMap<uint32_t, InstanceInfo> InstanceMap;
+
+    static void resetInstanceInfo(InstanceInfo* info);
+
+    // Return the state of the instance of the current thread, which is
+    // |m_defaultInstance| if it doesn't belong to one, or NULL if the
+    // instance is gone. Must be called with |m_lock| held.
+    InstanceInfo* getInstance_locked();
+
+    // Same as getInstance_locked(), for the owner of the object |handle|.
+    InstanceInfo* getOwner_locked(HandleType handle);
+
+    // Return true iff the current thread can use the object |handle|.
+    // Must be called with |m_lock| held.
+    bool canAccess_locked(HandleType handle);
+
+    // Make the instance of the current thread, if any, the owner of the
+    // new object |handle|. Must be called with |m_lock| held.
+    void setOwner_locked(HandleType handle);
+
+    // Look up a ColorBuffer that the current thread can use, or return
+    // NULL. Must be called with |m_lock| held.
+    ColorBufferRef* findColorBuffer_locked(HandleType p_colorbuffer);
+
+    // Remove a ColorBuffer from the map and from the accounting of its
+    // instance. Must be called with |m_lock| held.
+    void eraseColorBuffer_locked(HandleType p_colorbuffer);
+
+    // Eviction of the ColorBuffers, see setEvictIdleFrames(). These must
+    // be called with |m_lock| held.
+
+    // Return true iff the ColorBuffer |ref| can be evicted now.
+    bool isEvictable_locked(HandleType p_colorbuffer,
+                            const ColorBufferRef& ref);
+    // Evict a ColorBuffer and update the accounting of its owner.
+    bool evictColorBuffer_locked(HandleType p_colorbuffer,
+                                 ColorBufferRef* c);
+    // Restore an evicted ColorBuffer and update the accounting of its
+    // owner, evicting others to stay in its budget if possible.
+    void restoreColorBuffer_locked(HandleType p_colorbuffer,
+                                   ColorBufferRef* c);
+    // Evict the least recently used ColorBuffers of |instance| until
+    // |bytes| more fit in its budget. Return false if they can't.
+    bool makeRoom_locked(InstanceInfo* instance, size_t bytes);
+    // Evict the ColorBuffers idle for at least |s_evictIdleFrames|.
+    void evictIdleColorBuffers_locked();
+    // Print the memory usage of an instance for SHOW_FPS_STATS.
+    void printInstanceStats_locked(uint32_t instanceId,
+                                   InstanceInfo* instance);
+
+    // Number of frames between two evictIdleColorBuffers_locked() calls.
+    static const uint32_t kEvictionCheckFrames = 60;
+
     static FrameBuffer *s_theFrameBuffer;
     static HandleType s_nextHandle;
+    static uint8_t* s_sharedMemory;
+    static size_t s_sharedMemorySize;
+    static uint64_t s_instanceMemoryLimit;
+    static uint32_t s_evictIdleFrames;
     int m_x;
     int m_y;
     int m_width;
     int m_height;
     bool m_useSubWindow;
+    // Protects the context, window surface and color buffer maps, as well
+    // as the internal EGL contexts used through bind_locked(). This is the
+    // only lock shared by RenderThreads when they decode in parallel.
     emugl::Mutex m_lock;
     FbConfigList* m_configs;
     FBNativeWindowType m_nativeWindow;
@@ -297,6 +550,10 @@ private:
     RenderContextMap m_contexts;
     WindowSurfaceMap m_windows;
     ColorBufferMap m_colorbuffers;
+    // Owners of the objects created by instances, see addInstanceThread().
+    emugl::HashMap<HandleType, uint32_t> m_handleInstances;
+    InstanceMap m_instances;
+    InstanceInfo m_defaultInstance;
     ColorBuffer::Helper* m_colorBufferHelper;
 
     EGLSurface m_eglSurface;
@@ -307,10 +564,19 @@ private:
     EGLContext m_prevContext;
     EGLSurface m_prevReadSurf;
     EGLSurface m_prevDrawSurf;
+    // Number of pending bind_locked() / bindSubwin_locked() calls which
+    // found their context already current, so that the matching
+    // unbind_locked() has nothing to restore.
+    int        m_skippedBinds;
     EGLNativeWindowType m_subWin;
+    // True if |m_subWin| belongs to the UI, see setupSubWindow().
+    bool m_subWinHosted;
     TextureDraw* m_textureDraw;
+    Compositor* m_compositor;
     EGLConfig  m_eglConfig;
     HandleType m_lastPostedColorBuffer;
+    // Number of frames posted so far.
+    uint32_t   m_frameCount;
     float      m_zRot;
     bool       m_eglContextInitialized;
 
@@ -318,9 +584,36 @@ private:
     long long m_statsStartTime;
     bool m_fpsStats;
 
-    OnPostFn m_onPost;
-    void* m_onPostContext;
-    unsigned char* m_fbImage;
+    // State of a display, as used to send its content to a post callback.
+    struct Display {
+        bool used;
+        int width;
+        int height;
+        OnPostFn onPost;
+        void* onPostContext;
+        // Readback images, used alternately so that one can be filled
+        // while the other is being passed to |onPost|.
+        unsigned char* fbImage[2];
+        int fbImageIndex;
+        // Handle of the ColorBuffer read back by the last post, or 0 if
+        // the content of the images must be entirely refreshed.
+        HandleType lastReadbackColorBuffer;
+        // Rows damaged by the previous post, as [y0,y1). The next readback
+        // must also refresh them, since it goes to the other image.
+        int prevDamageY0;
+        int prevDamageY1;
+    };
+
+    // All displays, indexed by id. The first one is the primary display,
+    // the others are only valid if their |used| field is true.
+    Display m_displays[kMaxDisplays];
+    // Serializes the calls to the post callbacks, which are performed
+    // without holding |m_lock|. Always acquired after |m_lock|.
+    emugl::Mutex m_postLock;
+    // GetCurrentTimeUS() values of each PostStage of the frame being
+    // passed to a post callback, protected by |m_postLock|.
+    long long m_postTimesUs[kPostStageCount];
+    VsyncClock m_vsyncClock;
 
     const char* m_glVendor;
     const char* m_glRenderer;
@@ -24,6 +24,9 @@ gles1_decoder_context_t s_gles1;
 
 static emugl::SharedLibrary *s_gles1_lib = NULL;
 
+typedef unsigned int (*take_elided_call_count_t)(void);
+static take_elided_call_count_t s_gles1_take_elided_call_count = NULL;
+
 //
 // This function is called only once during initialiation before
 // any thread has been created - hence it should NOT be thread safe.
@@ -48,6 +51,8 @@ bool init_gles1_dispatch()
     // init the GLES dispatch table
     //
     s_gles1.initDispatchByName(gles1_dispatch_get_proc_func, NULL);
+    s_gles1_take_elided_call_count = (take_elided_call_count_t)
+            s_gles1_lib->findSymbol("__translator_takeElidedCallCount");
     return true;
 }
 
@@ -62,3 +67,11 @@ void *gles1_dispatch_get_proc_func(const char *name, void *userData)
     }
     return (void *)s_gles1_lib->findSymbol(name);
 }
+
+unsigned int gles1_dispatch_take_elided_call_count()
+{
+    if (!s_gles1_take_elided_call_count) {
+        return 0;
+    }
+    return s_gles1_take_elided_call_count();
+}
@@ -21,6 +21,10 @@
 bool init_gles1_dispatch();
 void *gles1_dispatch_get_proc_func(const char *name, void *userData);
 
+// Return the number of calls skipped by the translator's redundant state
+// filter since the previous call, or 0 if the library doesn't report it.
+unsigned int gles1_dispatch_take_elided_call_count();
+
 extern gles1_decoder_context_t s_gles1;
 
 #endif  // _GLES_V1_DISPATCH_H
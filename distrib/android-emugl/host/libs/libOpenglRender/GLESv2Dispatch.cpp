@@ -24,6 +24,9 @@ gles2_decoder_context_t s_gles2;
 
 static emugl::SharedLibrary *s_gles2_lib = NULL;
 
+typedef unsigned int (*take_elided_call_count_t)(void);
+static take_elided_call_count_t s_gles2_take_elided_call_count = NULL;
+
 #define DEFAULT_GLES_V2_LIB EMUGL_LIBNAME("GLES_V2_translator")
 
 //
@@ -50,6 +53,8 @@ bool init_gles2_dispatch()
     // init the GLES dispatch table
     //
     s_gles2.initDispatchByName(gles2_dispatch_get_proc_func, NULL);
+    s_gles2_take_elided_call_count = (take_elided_call_count_t)
+            s_gles2_lib->findSymbol("__translator_takeElidedCallCount");
     return true;
 }
 
@@ -64,3 +69,11 @@ void *gles2_dispatch_get_proc_func(const char *name, void *userData)
     }
     return (void *)s_gles2_lib->findSymbol(name);
 }
+
+unsigned int gles2_dispatch_take_elided_call_count()
+{
+    if (!s_gles2_take_elided_call_count) {
+        return 0;
+    }
+    return s_gles2_take_elided_call_count();
+}
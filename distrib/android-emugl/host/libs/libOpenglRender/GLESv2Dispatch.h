@@ -21,6 +21,10 @@
 bool init_gles2_dispatch();
 void *gles2_dispatch_get_proc_func(const char *name, void *userData);
 
+// Return the number of calls skipped by the translator's redundant state
+// filter since the previous call, or 0 if the library doesn't report it.
+unsigned int gles2_dispatch_take_elided_call_count();
+
 extern gles2_decoder_context_t s_gles2;
 
 #endif  // _GLES_V2_DISPATCH_H
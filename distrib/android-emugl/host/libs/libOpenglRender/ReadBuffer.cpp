@@ -17,15 +17,26 @@
 #include <string.h>
 #include <assert.h>
 #include <limits.h>
+#include <stdint.h>
 #include "ErrorLog.h"
 
+// Every render packet starts with a 32-bit opcode and its 32-bit total size.
+static const size_t kPacketHeaderSize = 8;
+
+// The buffer shrinks when none of the last kShrinkInterval calls to
+// getData() needed more than a quarter of it.
+static const unsigned int kShrinkInterval = 256;
+
 ReadBuffer::ReadBuffer(IOStream *stream, size_t bufsize)
 {
     m_size = bufsize;
+    m_minSize = bufsize;
     m_stream = stream;
     m_buf = (unsigned char*)malloc(m_size*sizeof(unsigned char));
     m_validData = 0;
     m_readPtr = m_buf;
+    m_highWater = 0;
+    m_getDataCount = 0;
 }
 
 ReadBuffer::~ReadBuffer()
@@ -33,32 +44,90 @@ ReadBuffer::~ReadBuffer()
     free(m_buf);
 }
 
-int ReadBuffer::getData()
+bool ReadBuffer::resize(size_t newSize)
 {
     if ((m_validData > 0) && (m_readPtr > m_buf)) {
         memmove(m_buf, m_readPtr, m_validData);
     }
-    // get fresh data into the buffer;
-    size_t len = m_size - m_validData;
-    if (len==0) {
-        //we need to inc our buffer
-        size_t new_size = m_size*2;
-        unsigned char* new_buf;
+    m_readPtr = m_buf;
+    if (newSize == m_size) {
+        return true;
+    }
+    unsigned char* new_buf = (unsigned char*)realloc(m_buf, newSize);
+    if (!new_buf) {
+        ERR("Failed to alloc %zu bytes for ReadBuffer\n", newSize);
+        return false;
+    }
+    m_buf = new_buf;
+    m_readPtr = m_buf;
+    m_size = newSize;
+    return true;
+}
+
+void ReadBuffer::maybeShrink()
+{
+    if (++m_getDataCount < kShrinkInterval) {
+        return;
+    }
+    if (m_size > m_minSize && m_highWater <= m_size / 4) {
+        size_t new_size = m_size / 2;
+        while (new_size / 2 >= m_highWater && new_size / 2 >= m_minSize) {
+            new_size /= 2;
+        }
+        if (new_size < m_minSize) {
+            new_size = m_minSize;
+        }
+        if (m_validData < new_size / 2) {
+            resize(new_size);
+        }
+    }
+    m_getDataCount = 0;
+    m_highWater = m_validData;
+}
+
+int ReadBuffer::getData()
+{
+    maybeShrink();
+
+    // Room needed from the read pointer: the whole packet at the front if
+    // its size is known, or at least one more byte.
+    size_t needed = m_validData + 1;
+    if (m_validData >= kPacketHeaderSize) {
+        size_t packetSize = *(const uint32_t*)(m_readPtr + 4);
+        if (packetSize > needed) {
+            needed = packetSize;
+        }
+    }
+    if (needed > m_highWater) {
+        m_highWater = needed;
+    }
+
+    if (needed > m_size) {
+        // Grow at least twice, so that a stream of packets slightly larger
+        // than the buffer doesn't realloc each time.
+        size_t new_size = m_size * 2;
         if (new_size < m_size) { // overflow check
             new_size = INT_MAX;
         }
-
-        new_buf = (unsigned char*)realloc(m_buf, new_size);
-        if (!new_buf) {
-            ERR("Failed to alloc %zu bytes for ReadBuffer\n", new_size);
+        if (new_size < needed) {
+            new_size = needed;
+        }
+        if (!resize(new_size)) {
             return -1;
         }
-        m_size = new_size;
-        m_buf  = new_buf;
-        len    = m_size - m_validData;
+    } else {
+        // Only move the leftover data to the front when the rest of the
+        // packet doesn't fit after it, or the free space gets too small
+        // for efficient reads.
+        size_t tail = m_size - (m_readPtr - m_buf) - m_validData;
+        if (tail < needed - m_validData || tail < m_size / 8) {
+            resize(m_size);
+        }
     }
-    m_readPtr = m_buf;
-    if (NULL != m_stream->read(m_buf + m_validData, &len)) {
+
+    unsigned char* end = m_readPtr + m_validData;
+    size_t len = m_size - (end - m_buf);
+    if (NULL != m_stream->read(end, &len)) {
         m_validData += len;
         return len;
     }
@@ -70,4 +139,8 @@ void ReadBuffer::consume(size_t amount)
     assert(amount <= m_validData);
     m_validData -= amount;
     m_readPtr += amount;
+    if (m_validData == 0) {
+        // Nothing to move, start over from the beginning of the buffer.
+        m_readPtr = m_buf;
+    }
 }
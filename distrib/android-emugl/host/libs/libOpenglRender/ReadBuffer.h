@@ -18,6 +18,12 @@
 
 #include "IOStream.h"
 
+// Buffers the data of a render stream so it can be handed to the decoders
+// in whole packets. Consumed data is only compacted away when the free
+// space after the valid data runs low, and when the packet at the front is
+// larger than the buffer, the buffer grows to fit it in a single step, so
+// its payload is read from the stream directly into its final location.
+// The buffer shrinks back towards |bufSize| once large packets stop coming.
 class ReadBuffer {
 public:
     ReadBuffer(IOStream *stream, size_t bufSize);
@@ -26,11 +32,18 @@ public:
     unsigned char *buf() { return m_readPtr; } // return the next read location
     size_t validData() { return m_validData; } // return the amount of valid data in readptr
     void consume(size_t amount); // notify that 'amount' data has been consumed;
+    size_t size() const { return m_size; } // return the current buffer size
 private:
+    bool resize(size_t newSize); // compact and realloc to newSize bytes
+    void maybeShrink();
+
     unsigned char *m_buf;
     unsigned char *m_readPtr;
     size_t m_size;
     size_t m_validData;
+    size_t m_minSize;
+    size_t m_highWater;  // largest space needed since the last shrink check
+    unsigned int m_getDataCount;
     IOStream *m_stream;
 };
 #endif
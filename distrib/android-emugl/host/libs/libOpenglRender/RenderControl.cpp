@@ -22,6 +22,11 @@
 #include "GLESv1Dispatch.h"
 #include "RenderThreadInfo.h"
 
+#include "emugl/common/thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
 static const GLint rendererVersion = 1;
 
 static GLint rcGetRendererVersion()
@@ -280,7 +285,194 @@ static void rcFBPost(uint32_t colorBuffer)
         return;
     }
 
-    fb->post(colorBuffer);
+    fb->postAsync(colorBuffer);
+}
+
+static int rcCreateDisplay(uint32_t width, uint32_t height)
+{
+    FrameBuffer *fb = FrameBuffer::getFB();
+    if (!fb) {
+        return -1;
+    }
+
+    return fb->createDisplay(width, height);
+}
+
+static int rcDestroyDisplay(uint32_t display)
+{
+    FrameBuffer *fb = FrameBuffer::getFB();
+    if (!fb) {
+        return -1;
+    }
+
+    return fb->destroyDisplay(display) ? 0 : -1;
+}
+
+static void rcFBPostDisplay(uint32_t display, uint32_t colorBuffer)
+{
+    FrameBuffer *fb = FrameBuffer::getFB();
+    if (!fb) {
+        return;
+    }
+
+    if (display == 0) {
+        fb->postAsync(colorBuffer);
+    } else {
+        fb->postDisplay(display, colorBuffer);
+    }
+}
+
+// Return the host CPU mask found in environment variable |varName|, as a
+// hexadecimal number, or 0 if it is not defined.
+static uint64_t getCpuMaskFromEnv(const char* varName)
+{
+    const char* value = getenv(varName);
+    if (!value) {
+        return 0;
+    }
+    return strtoull(value, NULL, 16);
+}
+
+// Limit of setRenderThreadMaxPriority(), and the number of times it was
+// changed, which the render threads compare with the last one they applied.
+static emugl::Thread::Priority s_maxPriority = emugl::Thread::kPriorityHigh;
+static uint32_t s_maxPriorityGeneration = 0;
+
+static emugl::Thread::Priority streamHintPriority(uint32_t hint)
+{
+    emugl::Thread::Priority priority;
+    switch (hint) {
+    case RC_STREAM_HINT_COMPOSITOR:
+        priority = emugl::Thread::kPriorityHigh;
+        break;
+    case RC_STREAM_HINT_BACKGROUND:
+        priority = emugl::Thread::kPriorityLow;
+        break;
+    default:
+        priority = emugl::Thread::kPriorityNormal;
+        break;
+    }
+    emugl::Thread::Priority maxPriority = s_maxPriority;
+    return priority < maxPriority ? priority : maxPriority;
+}
+
+void setRenderThreadMaxPriority(emugl::Thread::Priority priority)
+{
+    s_maxPriority = priority;
+    __sync_add_and_fetch(&s_maxPriorityGeneration, 1);
+}
+
+void updateRenderThreadPriority(RenderThreadInfo* tInfo)
+{
+    uint32_t generation = __sync_add_and_fetch(&s_maxPriorityGeneration, 0);
+    if (generation == tInfo->m_priorityGeneration) {
+        return;
+    }
+    tInfo->m_priorityGeneration = generation;
+    emugl::Thread::setCurrentPriority(streamHintPriority(tInfo->m_streamHint));
+}
+
+// Called by the guest on a new stream, to tell what kind of client renders
+// through it. The compositor stream gets a higher priority than the others,
+// so that the frames it posts keep their latency when apps render in the
+// background. Its host CPUs can also be set with the hexadecimal mask in
+// ANDROID_EMUGL_COMPOSITOR_CPUS, and those of background streams with
+// ANDROID_EMUGL_BACKGROUND_CPUS.
+static int rcSetStreamHint(uint32_t hint)
+{
+    RenderThreadInfo *tInfo = RenderThreadInfo::get();
+    if (!tInfo) {
+        return -1;
+    }
+
+    uint64_t cpuMask;
+    switch (hint) {
+    case RC_STREAM_HINT_DEFAULT:
+        cpuMask = 0;
+        break;
+    case RC_STREAM_HINT_COMPOSITOR:
+        cpuMask = getCpuMaskFromEnv("ANDROID_EMUGL_COMPOSITOR_CPUS");
+        break;
+    case RC_STREAM_HINT_BACKGROUND:
+        cpuMask = getCpuMaskFromEnv("ANDROID_EMUGL_BACKGROUND_CPUS");
+        break;
+    default:
+        return -1;
+    }
+
+    // Failures only mean that the host doesn't let us change the
+    // scheduling of the thread, which still renders correctly. The priority
+    // stays within the limit of setRenderThreadMaxPriority().
+    emugl::Thread::setCurrentPriority(streamHintPriority(hint));
+    if (cpuMask || tInfo->m_streamHint != RC_STREAM_HINT_DEFAULT) {
+        emugl::Thread::setCurrentAffinity(cpuMask);
+    }
+    tInfo->m_streamHint = hint;
+    return 0;
+}
+
+// Run the buffer queue operations of a whole frame, encoded in the |opsSize|
+// bytes at |ops| as described in renderControl_types.h, so that the guest
+// pays for a single round trip. Stop at the first operation that fails,
+// or at RC_PRESENT_END. Return 0 on success, or the 1-based index of the
+// failed or malformed operation.
+static int rcPresent(void* ops, uint32_t opsSize)
+{
+    const uint32_t* op = static_cast<const uint32_t*>(ops);
+    const uint32_t* end = op + opsSize / sizeof(uint32_t);
+    int index = 1;
+    for (; op < end; ++index) {
+        uint32_t code = *op++;
+        int argCount;
+        switch (code) {
+        case RC_PRESENT_END:
+            return 0;
+        case RC_PRESENT_SET_WINDOW_COLOR_BUFFER:
+        case RC_PRESENT_FB_POST_DISPLAY:
+            argCount = 2;
+            break;
+        case RC_PRESENT_FLUSH_WINDOW_COLOR_BUFFER:
+        case RC_PRESENT_FB_POST:
+        case RC_PRESENT_OPEN_COLOR_BUFFER:
+        case RC_PRESENT_CLOSE_COLOR_BUFFER:
+            argCount = 1;
+            break;
+        default:
+            return index;
+        }
+        if (end - op < argCount) {
+            return index;
+        }
+
+        bool ok = true;
+        switch (code) {
+        case RC_PRESENT_SET_WINDOW_COLOR_BUFFER: {
+            FrameBuffer *fb = FrameBuffer::getFB();
+            ok = fb && fb->setWindowSurfaceColorBuffer(op[0], op[1]);
+            break;
+        }
+        case RC_PRESENT_FLUSH_WINDOW_COLOR_BUFFER:
+            ok = rcFlushWindowColorBuffer(op[0]) == 0;
+            break;
+        case RC_PRESENT_FB_POST:
+            rcFBPost(op[0]);
+            break;
+        case RC_PRESENT_FB_POST_DISPLAY:
+            rcFBPostDisplay(op[0], op[1]);
+            break;
+        case RC_PRESENT_OPEN_COLOR_BUFFER:
+            ok = rcOpenColorBuffer2(op[0]) == 0;
+            break;
+        case RC_PRESENT_CLOSE_COLOR_BUFFER:
+            rcCloseColorBuffer(op[0]);
+            break;
+        }
+        if (!ok) {
+            return index;
+        }
+        op += argCount;
+    }
+    return 0;
 }
 
 static void rcFBSetSwapInterval(EGLint interval)
@@ -342,6 +534,70 @@ static int rcUpdateColorBuffer(uint32_t colorBuffer,
     return 0;
 }
 
+// The three commands below let the guest access the pixels of a color
+// buffer in the memory region of the goldfish_address_space device, which
+// the guest maps directly, instead of copying them through the pipe with
+// rcReadColorBuffer and rcUpdateColorBuffer. Only the rows that the guest
+// reports as changed, or wants to read, are transferred to the GPU.
+static int rcBindColorBufferSharedMemory(uint32_t colorBuffer,
+                                         uint32_t offset,
+                                         GLenum format, GLenum type)
+{
+    FrameBuffer *fb = FrameBuffer::getFB();
+    if (!fb) {
+        return -1;
+    }
+
+    return fb->bindColorBufferSharedMemory(colorBuffer, offset,
+                                           format, type) ? 0 : -1;
+}
+
+static int rcUpdateColorBufferShared(uint32_t colorBuffer,
+                                     GLint y, GLint height)
+{
+    FrameBuffer *fb = FrameBuffer::getFB();
+    if (!fb) {
+        return -1;
+    }
+
+    return fb->updateColorBufferFromSharedMemory(colorBuffer, y,
+                                                 height) ? 0 : -1;
+}
+
+static int rcReadColorBufferShared(uint32_t colorBuffer,
+                                   GLint y, GLint height)
+{
+    FrameBuffer *fb = FrameBuffer::getFB();
+    if (!fb) {
+        return -1;
+    }
+
+    return fb->readColorBufferToSharedMemory(colorBuffer, y,
+                                             height) ? 0 : -1;
+}
+
+// Store the guest vsync timing into the |timingSize| bytes at |timing|, as
+// RC_VSYNC_XXX words, so that the guest can align its frames with the host
+// presentations like the goldfish_fb VSYNC interrupt. Return the number of
+// words stored, or 0 if the timing isn't known yet.
+static int rcGetVsyncTiming(uint32_t* timing, uint32_t timingSize)
+{
+    FrameBuffer *fb = FrameBuffer::getFB();
+    long long ageUs, periodUs;
+    if (!fb || !fb->getVsyncTiming(&ageUs, &periodUs)) {
+        return 0;
+    }
+    uint32_t values[RC_VSYNC_COUNT];
+    values[RC_VSYNC_AGE_US] = (uint32_t)ageUs;
+    values[RC_VSYNC_PERIOD_US] = (uint32_t)periodUs;
+    int count = timingSize / sizeof(uint32_t);
+    if (count > RC_VSYNC_COUNT) {
+        count = RC_VSYNC_COUNT;
+    }
+    memcpy(timing, values, count * sizeof(uint32_t));
+    return count;
+}
+
 void initRenderControlContext(renderControl_decoder_context_t *dec)
 {
     dec->rcGetRendererVersion = rcGetRendererVersion;
@@ -370,4 +626,13 @@ void initRenderControlContext(renderControl_decoder_context_t *dec)
     dec->rcReadColorBuffer = rcReadColorBuffer;
     dec->rcUpdateColorBuffer = rcUpdateColorBuffer;
     dec->rcOpenColorBuffer2 = rcOpenColorBuffer2;
+    dec->rcCreateDisplay = rcCreateDisplay;
+    dec->rcDestroyDisplay = rcDestroyDisplay;
+    dec->rcFBPostDisplay = rcFBPostDisplay;
+    dec->rcSetStreamHint = rcSetStreamHint;
+    dec->rcPresent = rcPresent;
+    dec->rcBindColorBufferSharedMemory = rcBindColorBufferSharedMemory;
+    dec->rcUpdateColorBufferShared = rcUpdateColorBufferShared;
+    dec->rcReadColorBufferShared = rcReadColorBufferShared;
+    dec->rcGetVsyncTiming = rcGetVsyncTiming;
 }
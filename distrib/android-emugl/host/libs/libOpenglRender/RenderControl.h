@@ -18,6 +18,19 @@
 
 #include "renderControl_dec.h"
 
+#include "emugl/common/thread.h"
+
+class RenderThreadInfo;
+
 void initRenderControlContext(renderControl_decoder_context_t *dec);
 
+// Limit the scheduling priority of all render threads to |priority|. Each
+// thread applies it in updateRenderThreadPriority(). Thread-safe.
+void setRenderThreadMaxPriority(emugl::Thread::Priority priority);
+
+// Apply the priority of the stream hint of the calling render thread,
+// within the limit of setRenderThreadMaxPriority(), if the limit changed
+// since the last call on this thread.
+void updateRenderThreadPriority(RenderThreadInfo* tInfo);
+
 #endif
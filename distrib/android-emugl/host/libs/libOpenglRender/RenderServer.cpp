@@ -27,16 +27,17 @@
 #include "Win32PipeStream.h"
 #endif
 
-#include <set>
-
+#include <stdlib.h>
 #include <string.h>
 
-typedef std::set<RenderThread *> RenderThreadsSet;
-
 RenderServer::RenderServer() :
     m_lock(),
     m_listenSock(NULL),
-    m_exiting(false)
+    m_exiting(false),
+    m_serializeDecoding(true),
+    m_multiInstance(false),
+    m_threadsLock(),
+    m_threads()
 {
 }
 
@@ -55,6 +56,13 @@ RenderServer *RenderServer::create(char* addr, size_t addrLen)
         return NULL;
     }
 
+    // Define ANDROID_EMUGL_PARALLEL_DECODING in the environment to let
+    // each RenderThread decode its stream concurrently with the other ones.
+    if (getenv("ANDROID_EMUGL_PARALLEL_DECODING") != NULL) {
+        DBG("RenderServer: using per-thread decoding\n");
+        server->m_serializeDecoding = false;
+    }
+
     if (gRendererStreamMode == STREAM_MODE_TCP) {
         server->m_listenSock = new TcpStream();
     } else {
@@ -84,10 +92,57 @@ RenderServer *RenderServer::create(char* addr, size_t addrLen)
     return server;
 }
 
-intptr_t RenderServer::main()
+bool RenderServer::addStream(IOStream* stream, uint32_t instanceId)
 {
-    RenderThreadsSet threads;
+    RenderThread *rt = RenderThread::create(
+            stream, m_serializeDecoding ? &m_lock : NULL, instanceId);
+    if (!rt) {
+        fprintf(stderr,"Failed to create RenderThread\n");
+        return false;
+    }
+
+    emugl::Mutex::AutoLock lock(m_threadsLock);
+    if (m_exiting) {
+        delete rt;
+        return false;
+    }
+    if (!rt->start()) {
+        fprintf(stderr,"Failed to start RenderThread\n");
+        delete rt;
+        return false;
+    }
 
+    reapFinishedThreads_locked();
+
+    m_threads.insert(rt);
+    DBG("Started new RenderThread\n");
+    return true;
+}
+
+void RenderServer::reapFinishedThreads_locked()
+{
+    //
+    // remove from the threads list threads which are
+    // no longer running
+    //
+    for (RenderThreadsSet::iterator n,t = m_threads.begin();
+         t != m_threads.end();
+         t = n) {
+        // first find next iterator
+        n = t;
+        n++;
+
+        // delete and erase the current iterator
+        // if thread is no longer running
+        if ((*t)->isFinished()) {
+            delete (*t);
+            m_threads.erase(t);
+        }
+    }
+}
+
+intptr_t RenderServer::main()
+{
 #ifndef _WIN32
     sigset_t set;
     sigfillset(&set);
@@ -112,52 +167,30 @@ intptr_t RenderServer::main()
 
         // check if we have been requested to exit while waiting on accept
         if ((clientFlags & IOSTREAM_CLIENT_EXIT_SERVER) != 0) {
-            m_exiting = true;
             delete stream;
             break;
         }
 
-        RenderThread *rt = RenderThread::create(stream, &m_lock);
-        if (!rt) {
-            fprintf(stderr,"Failed to create RenderThread\n");
+        // All the connections of an emulator process belong to the same
+        // instance, whatever the guest process they serve.
+        uint32_t instanceId = m_multiInstance ? stream->getPeerPid() : 0;
+        if (m_multiInstance && !instanceId) {
+            fprintf(stderr,"Could not identify the client of a stream\n");
             delete stream;
-        } else if (!rt->start()) {
-            fprintf(stderr,"Failed to start RenderThread\n");
-            delete rt;
-            delete stream;
-        }
-
-        //
-        // remove from the threads list threads which are
-        // no longer running
-        //
-        for (RenderThreadsSet::iterator n,t = threads.begin();
-             t != threads.end();
-             t = n) {
-            // first find next iterator
-            n = t;
-            n++;
-
-            // delete and erase the current iterator
-            // if thread is no longer running
-            if ((*t)->isFinished()) {
-                delete (*t);
-                threads.erase(t);
-            }
+            continue;
         }
-
-        // if the thread has been created and started, insert it to the list
-        if (rt) {
-            threads.insert(rt);
-            DBG("Started new RenderThread\n");
+        if (!addStream(stream, instanceId)) {
+            delete stream;
         }
     }
 
     //
     // Wait for all threads to finish
     //
-    for (RenderThreadsSet::iterator t = threads.begin();
-         t != threads.end();
+    emugl::Mutex::AutoLock lock(m_threadsLock);
+    m_exiting = true;
+    for (RenderThreadsSet::iterator t = m_threads.begin();
+         t != m_threads.end();
          t++) {
 #ifndef _WIN32
         // Note: temporarily disable following steps so emulator does not
@@ -167,7 +200,7 @@ intptr_t RenderServer::main()
 #endif
         delete (*t);
     }
-    threads.clear();
+    m_threads.clear();
 
     return 0;
 }
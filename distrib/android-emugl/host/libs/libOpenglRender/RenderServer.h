@@ -20,6 +20,12 @@
 #include "emugl/common/mutex.h"
 #include "emugl/common/thread.h"
 
+#include <set>
+
+#include <stdint.h>
+
+class RenderThread;
+
 class RenderServer : public emugl::Thread
 {
 public:
@@ -30,13 +36,42 @@ public:
 
     bool isExiting() const { return m_exiting; }
 
+    // Start a new RenderThread to decode the commands received from
+    // |stream|, which is owned by the thread on success. This can be called
+    // from any thread, e.g. to serve in-process streams that don't go
+    // through the listening socket. Returns false on failure, in which
+    // case the caller still owns |stream|.
+    // |instanceId| is passed to RenderThread::create().
+    bool addStream(IOStream* stream, uint32_t instanceId = 0);
+
+    // Tell whether the streams accepted from the listening socket come
+    // from several emulator instances, in which case each process that
+    // connects is served as its own instance. See emugl_render_service.
+    void setMultiInstance(bool multiInstance) {
+        m_multiInstance = multiInstance;
+    }
+
 private:
     RenderServer();
 
+    typedef std::set<RenderThread*> RenderThreadsSet;
+
+    // Delete the threads of |m_threads| which are no longer running.
+    // Must be called with |m_threadsLock| held.
+    void reapFinishedThreads_locked();
+
 private:
     emugl::Mutex m_lock;
     SocketStream *m_listenSock;
     bool m_exiting;
+    // True iff all RenderThreads must serialize their decoding passes
+    // through |m_lock|. False means each thread decodes on its own, and
+    // only the FrameBuffer's internal lock protects the shared state.
+    bool m_serializeDecoding;
+    bool m_multiInstance;
+    // Protects |m_threads|, which can be modified by addStream().
+    emugl::Mutex m_threadsLock;
+    RenderThreadsSet m_threads;
 };
 
 #endif
@@ -24,20 +24,29 @@
 #include "RenderThreadInfo.h"
 #include "TimeUtils.h"
 
-#define STREAM_BUFFER_SIZE 4*1024*1024
+#include "emugl/common/metrics.h"
+#include "emugl/common/trace.h"
 
-RenderThread::RenderThread(IOStream *stream, emugl::Mutex *lock) :
+// Initial size of the stream buffer, it grows to fit larger packets.
+#define STREAM_BUFFER_SIZE 128*1024
+
+RenderThread::RenderThread(IOStream *stream,
+                           emugl::Mutex *lock,
+                           uint32_t instanceId) :
         emugl::Thread(),
         m_lock(lock),
-        m_stream(stream) {}
+        m_stream(stream),
+        m_instanceId(instanceId) {}
 
 RenderThread::~RenderThread() {
     delete m_stream;
 }
 
 // static
-RenderThread* RenderThread::create(IOStream *stream, emugl::Mutex *lock) {
-    return new RenderThread(stream, lock);
+RenderThread* RenderThread::create(IOStream *stream,
+                                   emugl::Mutex *lock,
+                                   uint32_t instanceId) {
+    return new RenderThread(stream, lock, instanceId);
 }
 
 void RenderThread::forceStop() {
@@ -46,6 +55,8 @@ void RenderThread::forceStop() {
 
 intptr_t RenderThread::main() {
     RenderThreadInfo tInfo;
+    tInfo.m_instanceId = m_instanceId;
+    FrameBuffer::getFB()->addInstanceThread(m_instanceId);
 
     //
     // initialize decoders
@@ -60,10 +71,14 @@ intptr_t RenderThread::main() {
     long long stats_t0 = GetCurrentTimeMS();
 
     //
-    // open dump file if RENDER_DUMP_DIR is defined
+    // open dump file if RENDER_DUMP_DIR is defined, along with a
+    // <dump>.timing file that records the time in microseconds and the
+    // size of each chunk of the stream, one "<time> <size>" line per chunk,
+    // so that emugl_render_replay can replay it with its original timing.
     //
     const char *dump_dir = getenv("RENDERER_DUMP_DIR");
     FILE *dumpFP = NULL;
+    FILE *timingFP = NULL;
     if (dump_dir) {
         size_t bsize = strlen(dump_dir) + 32;
         char *fname = new char[bsize];
@@ -71,6 +86,9 @@ intptr_t RenderThread::main() {
         dumpFP = fopen(fname, "wb");
         if (!dumpFP) {
             fprintf(stderr,"Warning: stream dump failed to open file %s\n",fname);
+        } else {
+            snprintf(fname,bsize,"%s/stream_%p.timing", dump_dir, this);
+            timingFP = fopen(fname, "w");
         }
         delete [] fname;
     }
@@ -81,6 +99,7 @@ intptr_t RenderThread::main() {
         if (stat <= 0) {
             break;
         }
+        updateRenderThreadPriority(&tInfo);
 
         //
         // log received bandwidth statistics
@@ -101,50 +120,56 @@ intptr_t RenderThread::main() {
             int skip = readBuf.validData() - stat;
             fwrite(readBuf.buf()+skip, 1, readBuf.validData()-skip, dumpFP);
             fflush(dumpFP);
+            if (timingFP) {
+                fprintf(timingFP, "%lld %d\n", GetCurrentTimeUS(), stat);
+            }
         }
 
-        bool progress;
-        do {
-            progress = false;
-
+        emugl::ScopedTrace trace(emugl::kTraceCategoryEmugl, "decode");
+        emugl::ScopedMetricTimer timer(emugl::kMetricDecodeUs);
+        if (m_lock) {
             m_lock->lock();
-            //
-            // try to process some of the command buffer using the GLESv1 decoder
-            //
-            size_t last = tInfo.m_glDec.decode(readBuf.buf(), readBuf.validData(), m_stream);
-            if (last > 0) {
-                progress = true;
-                readBuf.consume(last);
-            }
+        }
 
-            //
-            // try to process some of the command buffer using the GLESv2 decoder
-            //
-            last = tInfo.m_gl2Dec.decode(readBuf.buf(), readBuf.validData(), m_stream);
-            if (last > 0) {
-                progress = true;
-                readBuf.consume(last);
+        //
+        // hand each run of packets to the decoder of its protocol, which
+        // consumes it up to the first packet that belongs to another one
+        // or that is incomplete.
+        //
+        while (readBuf.validData() >= 8) {
+            uint32_t opcode = *(const uint32_t *)readBuf.buf();
+            size_t last = 0;
+            if (tInfo.m_gl2Dec.handlesOpcode(opcode)) {
+                last = tInfo.m_gl2Dec.decode(readBuf.buf(), readBuf.validData(), m_stream);
+            } else if (tInfo.m_glDec.handlesOpcode(opcode)) {
+                last = tInfo.m_glDec.decode(readBuf.buf(), readBuf.validData(), m_stream);
+            } else if (tInfo.m_rcDec.handlesOpcode(opcode)) {
+                last = tInfo.m_rcDec.decode(readBuf.buf(), readBuf.validData(), m_stream);
             }
-
-            //
-            // try to process some of the command buffer using the
-            // renderControl decoder
-            //
-            last = tInfo.m_rcDec.decode(readBuf.buf(), readBuf.validData(), m_stream);
-            if (last > 0) {
-                readBuf.consume(last);
-                progress = true;
+            if (last == 0) {
+                break;
             }
+            readBuf.consume(last);
+        }
 
+        if (m_lock) {
             m_lock->unlock();
+        }
 
-        } while( progress );
-
+        //
+        // the decoders leave their replies in the stream's buffer, send
+        // them all at once before blocking for more data. The guest waits
+        // for them, so they can't be held any longer.
+        //
+        m_stream->flush();
     }
 
     if (dumpFP) {
         fclose(dumpFP);
     }
+    if (timingFP) {
+        fclose(timingFP);
+    }
 
     //
     // Release references to the current thread's context/surfaces if any
@@ -158,5 +183,9 @@ intptr_t RenderThread::main() {
 
     FrameBuffer::getFB()->drainRenderContext();
 
+    FrameBuffer::getFB()->drainReadbackContext();
+
+    FrameBuffer::getFB()->releaseInstanceThread(m_instanceId);
+
     return 0;
 }
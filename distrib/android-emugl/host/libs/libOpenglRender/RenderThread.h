@@ -21,6 +21,8 @@
 #include "emugl/common/mutex.h"
 #include "emugl/common/thread.h"
 
+#include <stdint.h>
+
 // A class used to model a thread of the RenderServer. Each one of them
 // handles a single guest client / protocol byte stream.
 class RenderThread : public emugl::Thread {
@@ -29,10 +31,16 @@ public:
     // |stream| is an input stream that will be read from the thread,
     // and deleted by it when it exits.
     // |mutex| is a pointer to a shared mutex used to serialize
-    // decoding operations between all threads.
-    // TODO(digit): Why is this needed here? Shouldn't this be handled
-    //              by the decoders themselves or at a lower-level?
-    static RenderThread* create(IOStream* stream, emugl::Mutex* mutex);
+    // decoding operations between all threads, or NULL to let this
+    // thread decode concurrently with the other ones. In the latter case,
+    // the shared state (i.e. the FrameBuffer's context, window surface and
+    // color buffer maps) is only protected by the FrameBuffer's own lock.
+    // |instanceId| identifies the emulator instance that the stream comes
+    // from when several of them share the renderer, or is 0 otherwise.
+    // See FrameBuffer::addInstanceThread().
+    static RenderThread* create(IOStream* stream,
+                                emugl::Mutex* mutex,
+                                uint32_t instanceId = 0);
 
     // Destructor.
     virtual ~RenderThread();
@@ -47,12 +55,13 @@ public:
 private:
     RenderThread();  // No default constructor
 
-    RenderThread(IOStream* stream, emugl::Mutex* mutex);
+    RenderThread(IOStream* stream, emugl::Mutex* mutex, uint32_t instanceId);
 
     virtual intptr_t main();
 
     emugl::Mutex* m_lock;
     IOStream* m_stream;
+    uint32_t m_instanceId;
 };
 
 #endif
@@ -19,6 +19,14 @@
 #include "emugl/common/lazy_instance.h"
 #include "emugl/common/thread_store.h"
 
+#ifdef EMUGL_THREAD_LOCAL
+
+// get() is called for nearly every decoded command, so avoid a lookup in
+// a ThreadStore, which isn't needed to destroy the values anyway.
+static EMUGL_THREAD_LOCAL RenderThreadInfo* s_threadInfo = NULL;
+
+#else  // !EMUGL_THREAD_LOCAL
+
 namespace {
 
 class ThreadInfoStore : public ::emugl::ThreadStore {
@@ -30,14 +38,37 @@ public:
 
 static ::emugl::LazyInstance<ThreadInfoStore> s_tls = LAZY_INSTANCE_INIT;
 
-RenderThreadInfo::RenderThreadInfo() {
+#endif  // !EMUGL_THREAD_LOCAL
+
+RenderThreadInfo::RenderThreadInfo() :
+        currEglContext(EGL_NO_CONTEXT),
+        currEglDrawSurf(EGL_NO_SURFACE),
+        currEglReadSurf(EGL_NO_SURFACE),
+        m_streamHint(0),
+        m_priorityGeneration(0),
+        m_instanceId(0),
+        m_readbackContext(EGL_NO_CONTEXT),
+        m_readbackSurface(EGL_NO_SURFACE),
+        m_readbackFbo(0) {
+#ifdef EMUGL_THREAD_LOCAL
+    s_threadInfo = this;
+#else
     s_tls->set(this);
+#endif
 }
 
 RenderThreadInfo::~RenderThreadInfo() {
+#ifdef EMUGL_THREAD_LOCAL
+    s_threadInfo = NULL;
+#else
     s_tls->set(NULL);
+#endif
 }
 
 RenderThreadInfo* RenderThreadInfo::get() {
+#ifdef EMUGL_THREAD_LOCAL
+    return s_threadInfo;
+#else
     return static_cast<RenderThreadInfo*>(s_tls->get());
+#endif
 }
@@ -46,6 +46,13 @@ struct RenderThreadInfo {
     WindowSurfacePtr currDrawSurf;
     WindowSurfacePtr currReadSurf;
 
+    // EGL context and surfaces last made current by
+    // FrameBuffer::bindContext() on this thread, used to skip redundant
+    // eglMakeCurrent() calls.
+    EGLContext currEglContext;
+    EGLSurface currEglDrawSurf;
+    EGLSurface currEglReadSurf;
+
     // Decoder states.
     GLESv1Decoder                   m_glDec;
     GLESv2Decoder                   m_gl2Dec;
@@ -55,6 +62,24 @@ struct RenderThreadInfo {
     ThreadContextSet                m_contextSet;
     // all the window surfaces that are created by this render thread
     WindowSurfaceSet                m_windowSet;
+
+    // last RC_STREAM_HINT_XXX value set by the guest on this thread
+    uint32_t                        m_streamHint;
+
+    // value of the priority limit generation last applied by this thread,
+    // see updateRenderThreadPriority()
+    uint32_t                        m_priorityGeneration;
+
+    // emulator instance served by this thread when several of them share
+    // the renderer, 0 otherwise
+    uint32_t                        m_instanceId;
+
+    // EGL context, surface and framebuffer object used to read color
+    // buffers from this thread without the FrameBuffer lock, created by
+    // the first FrameBuffer::readColorBuffer() call.
+    EGLContext                      m_readbackContext;
+    EGLSurface                      m_readbackSurface;
+    GLuint                          m_readbackFbo;
 };
 
 #endif
@@ -89,6 +89,7 @@ struct RenderWindowMessage {
             int w;
             int h;
             float rotation;
+            bool hosted;
         } subwindow;
 
         // CMD_SET_ROTATION
@@ -127,20 +128,22 @@ struct RenderWindowMessage {
                 break;
 
             case CMD_SETUP_SUBWINDOW:
-                D("CMD_SETUP_SUBWINDOW: parent=%p x=%d y=%d w=%d h=%d rotation=%f\n",
+                D("CMD_SETUP_SUBWINDOW: parent=%p x=%d y=%d w=%d h=%d rotation=%f hosted=%d\n",
                     (void*)msg.subwindow.parent,
                     msg.subwindow.x,
                     msg.subwindow.y,
                     msg.subwindow.w,
                     msg.subwindow.h,
-                    msg.subwindow.rotation);
+                    msg.subwindow.rotation,
+                    msg.subwindow.hosted);
                 result = FrameBuffer::getFB()->setupSubWindow(
                         msg.subwindow.parent,
                         msg.subwindow.x,
                         msg.subwindow.y,
                         msg.subwindow.w,
                         msg.subwindow.h,
-                        msg.subwindow.rotation);
+                        msg.subwindow.rotation,
+                        msg.subwindow.hosted);
                 break;
 
             case CMD_REMOVE_SUBWINDOW:
@@ -348,7 +351,8 @@ bool RenderWindow::setupSubWindow(FBNativeWindowType window,
                                   int y,
                                   int width,
                                   int height,
-                                  float zRot) {
+                                  float zRot,
+                                  bool hosted) {
     D("Entering mHasSubWindow=%s\n", mHasSubWindow ? "true" : "false");
     if (mHasSubWindow) {
         return false;
@@ -362,6 +366,7 @@ bool RenderWindow::setupSubWindow(FBNativeWindowType window,
     msg.subwindow.w = width;
     msg.subwindow.h = height;
     msg.subwindow.rotation = zRot;
+    msg.subwindow.hosted = hosted;
 
     mHasSubWindow = processMessage(msg);
     D("Exiting mHasSubWindow=%s\n", mHasSubWindow ? "true" : "false");
@@ -84,7 +84,9 @@ public:
     // parent |window| id. |x|, |y|, |width| and |height| are the position
     // and dimension of the sub-window, relative to its parent.
     // |rotation| is a clockwise-rotation for the content. Only multiples of
-    // 90. are accepted. Returns true on success, false otherwise.
+    // 90. are accepted. If |hosted| is true, render into |window| itself
+    // instead, see FrameBuffer::setupSubWindow(). Returns true on success,
+    // false otherwise.
     //
     // One can call removeSubWindow() to remove the sub-window.
     bool setupSubWindow(FBNativeWindowType window,
@@ -92,7 +94,8 @@ public:
                         int y,
                         int width,
                         int height,
-                        float rotation);
+                        float rotation,
+                        bool hosted);
 
     // Remove the sub-window created by calling setupSubWindow().
     // Note that this doesn't discard the content of the emulated framebuffer,
@@ -89,6 +89,47 @@ const Vertex kVertices[] = {
     {{ -1, -1, +0 }, { +0, +1 }},
 };
 
+// Unlike kVertices, these map row 0 of the texture to the bottom of the
+// viewport, i.e. row 0 of the framebuffer, as glTexSubImage2D() does.
+const Vertex kYuvVertices[] = {
+    {{ +1, -1, +0 }, { +1, +0 }},
+    {{ +1, +1, +0 }, { +1, +1 }},
+    {{ -1, +1, +0 }, { +0, +1 }},
+    {{ -1, -1, +0 }, { +0, +0 }},
+};
+
+// Convert YUV 4:2:0 samples to RGB. Each plane is a GL_LUMINANCE texture,
+// except the interleaved chroma of NV12 / NV21, a GL_LUMINANCE_ALPHA one
+// bound to both chroma samplers: |uSelect| and |vSelect| pick the channel
+// of each sample, luminance (1, 0) or alpha (0, 1).
+const char kYuvVertexShaderSource[] =
+    "attribute vec4 position;\n"
+    "attribute vec2 inCoord;\n"
+    "varying vec2 outCoord;\n"
+
+    "void main(void) {\n"
+    "  gl_Position = position;\n"
+    "  outCoord = inCoord;\n"
+    "}\n";
+
+const char kYuvFragmentShaderSource[] =
+    "precision mediump float;\n"
+    "varying vec2 outCoord;\n"
+    "uniform sampler2D ySampler;\n"
+    "uniform sampler2D uSampler;\n"
+    "uniform sampler2D vSampler;\n"
+    "uniform vec2 uSelect;\n"
+    "uniform vec2 vSelect;\n"
+
+    "void main(void) {\n"
+    "  float y = 1.164 * (texture2D(ySampler, outCoord).r - 0.0625);\n"
+    "  float u = dot(texture2D(uSampler, outCoord).ra, uSelect) - 0.5;\n"
+    "  float v = dot(texture2D(vSampler, outCoord).ra, vSelect) - 0.5;\n"
+    "  gl_FragColor = vec4(clamp(vec3(y + 1.596 * v,\n"
+    "                                 y - 0.391 * u - 0.813 * v,\n"
+    "                                 y + 2.018 * u), 0.0, 1.0), 1.0);\n"
+    "}\n";
+
 const GLubyte kIndices[] = { 0, 1, 2, 2, 3, 0 };
 const GLint kIndicesLen = sizeof(kIndices) / sizeof(kIndices[0]);
 
@@ -102,7 +143,20 @@ TextureDraw::TextureDraw(EGLDisplay display) :
         mPositionSlot(-1),
         mInCoordSlot(-1),
         mTextureSlot(-1),
-        mRotationSlot(-1) {
+        mRotationSlot(-1),
+        mYuvVertexShader(0),
+        mYuvFragmentShader(0),
+        mYuvProgram(0),
+        mYuvPositionSlot(-1),
+        mYuvInCoordSlot(-1),
+        mYuvUSelectSlot(-1),
+        mYuvVSelectSlot(-1),
+        mYuvVertexBuffer(0) {
+    for (int n = 0; n < 3; ++n) {
+        mYuvSamplerSlots[n] = -1;
+        mYuvTextures[n] = 0;
+    }
+
     // Create shaders and program.
     mVertexShader = createShader(GL_VERTEX_SHADER, kVertexShaderSource);
     mFragmentShader = createShader(GL_FRAGMENT_SHADER, kFragmentShaderSource);
@@ -247,10 +301,186 @@ bool TextureDraw::draw(GLuint texture, float rotation) {
     return true;
 }
 
+bool TextureDraw::setupYuv() {
+    if (mYuvProgram) {
+        return true;
+    }
+    if (!mYuvVertexShader) {
+        mYuvVertexShader = createShader(GL_VERTEX_SHADER,
+                                        kYuvVertexShaderSource);
+    }
+    if (!mYuvFragmentShader) {
+        mYuvFragmentShader = createShader(GL_FRAGMENT_SHADER,
+                                          kYuvFragmentShaderSource);
+    }
+    if (!mYuvVertexShader || !mYuvFragmentShader) {
+        ERR("%s: Could not compile shaders\n", __FUNCTION__);
+        return false;
+    }
+
+    GLuint program = s_gles2.glCreateProgram();
+    s_gles2.glAttachShader(program, mYuvVertexShader);
+    s_gles2.glAttachShader(program, mYuvFragmentShader);
+
+    GLint success;
+    s_gles2.glLinkProgram(program);
+    s_gles2.glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (success == GL_FALSE) {
+        GLchar messages[256];
+        s_gles2.glGetProgramInfoLog(
+                program, sizeof(messages), 0, &messages[0]);
+        ERR("%s: Could not create/link program: %s\n", __FUNCTION__, messages);
+        s_gles2.glDeleteProgram(program);
+        return false;
+    }
+
+    mYuvPositionSlot = s_gles2.glGetAttribLocation(program, "position");
+    mYuvInCoordSlot = s_gles2.glGetAttribLocation(program, "inCoord");
+    mYuvSamplerSlots[0] = s_gles2.glGetUniformLocation(program, "ySampler");
+    mYuvSamplerSlots[1] = s_gles2.glGetUniformLocation(program, "uSampler");
+    mYuvSamplerSlots[2] = s_gles2.glGetUniformLocation(program, "vSampler");
+    mYuvUSelectSlot = s_gles2.glGetUniformLocation(program, "uSelect");
+    mYuvVSelectSlot = s_gles2.glGetUniformLocation(program, "vSelect");
+
+    s_gles2.glGenBuffers(1, &mYuvVertexBuffer);
+    s_gles2.glBindBuffer(GL_ARRAY_BUFFER, mYuvVertexBuffer);
+    s_gles2.glBufferData(GL_ARRAY_BUFFER, sizeof(kYuvVertices), kYuvVertices,
+                         GL_STATIC_DRAW);
+
+    // The planes rarely have power-of-two sizes, hence no mipmaps and
+    // clamping, as GLES 2.0 requires.
+    s_gles2.glGenTextures(3, mYuvTextures);
+    for (int n = 0; n < 3; ++n) {
+        s_gles2.glBindTexture(GL_TEXTURE_2D, mYuvTextures[n]);
+        s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                                GL_LINEAR);
+        s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                                GL_LINEAR);
+        s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                                GL_CLAMP_TO_EDGE);
+        s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                                GL_CLAMP_TO_EDGE);
+    }
+
+    mYuvProgram = program;
+    return true;
+}
+
+bool TextureDraw::drawYuv(int width, int height, YuvFormat format,
+                          const void* pixels) {
+    if (width < 2 || height < 2 || !pixels) {
+        return false;
+    }
+    if (!setupYuv()) {
+        return false;
+    }
+
+    const int chromaWidth = width / 2;
+    const int chromaHeight = height / 2;
+    const GLubyte* y = static_cast<const GLubyte*>(pixels);
+    const GLubyte* chroma = y + width * height;
+    const GLubyte* planes[3] = { y, chroma, NULL };
+    bool interleaved = false;
+    switch (format) {
+        case kYuvYU12:
+            planes[2] = chroma + chromaWidth * chromaHeight;
+            break;
+        case kYuvYV12:
+            planes[2] = chroma;
+            planes[1] = chroma + chromaWidth * chromaHeight;
+            break;
+        case kYuvNV12:
+        case kYuvNV21:
+            interleaved = true;
+            break;
+        default:
+            ERR("%s: Unknown YUV format %d\n", __FUNCTION__, format);
+            return false;
+    }
+
+    // Upload the planes, in texture units 0 to 2.
+    s_gles2.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    s_gles2.glActiveTexture(GL_TEXTURE0);
+    s_gles2.glBindTexture(GL_TEXTURE_2D, mYuvTextures[0]);
+    s_gles2.glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0,
+                         GL_LUMINANCE, GL_UNSIGNED_BYTE, planes[0]);
+    if (interleaved) {
+        s_gles2.glActiveTexture(GL_TEXTURE1);
+        s_gles2.glBindTexture(GL_TEXTURE_2D, mYuvTextures[1]);
+        s_gles2.glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA,
+                             chromaWidth, chromaHeight, 0,
+                             GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, planes[1]);
+        s_gles2.glActiveTexture(GL_TEXTURE2);
+        s_gles2.glBindTexture(GL_TEXTURE_2D, mYuvTextures[1]);
+    } else {
+        for (int n = 1; n < 3; ++n) {
+            s_gles2.glActiveTexture(GL_TEXTURE0 + n);
+            s_gles2.glBindTexture(GL_TEXTURE_2D, mYuvTextures[n]);
+            s_gles2.glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
+                                 chromaWidth, chromaHeight, 0,
+                                 GL_LUMINANCE, GL_UNSIGNED_BYTE, planes[n]);
+        }
+    }
+
+    s_gles2.glUseProgram(mYuvProgram);
+    for (int n = 0; n < 3; ++n) {
+        s_gles2.glUniform1i(mYuvSamplerSlots[n], n);
+    }
+    // The luminance channel of NV12 holds U and that of NV21 holds V.
+    const bool uInAlpha = (format == kYuvNV21);
+    const bool vInAlpha = (format == kYuvNV12);
+    s_gles2.glUniform2f(mYuvUSelectSlot, uInAlpha ? 0. : 1., uInAlpha ? 1. : 0.);
+    s_gles2.glUniform2f(mYuvVSelectSlot, vInAlpha ? 0. : 1., vInAlpha ? 1. : 0.);
+
+    s_gles2.glBindBuffer(GL_ARRAY_BUFFER, mYuvVertexBuffer);
+    s_gles2.glEnableVertexAttribArray(mYuvPositionSlot);
+    s_gles2.glVertexAttribPointer(mYuvPositionSlot,
+                                  3,
+                                  GL_FLOAT,
+                                  GL_FALSE,
+                                  sizeof(Vertex),
+                                  0);
+    s_gles2.glEnableVertexAttribArray(mYuvInCoordSlot);
+    s_gles2.glVertexAttribPointer(mYuvInCoordSlot,
+                                  2,
+                                  GL_FLOAT,
+                                  GL_FALSE,
+                                  sizeof(Vertex),
+                                  reinterpret_cast<GLvoid*>(
+                                        static_cast<uintptr_t>(
+                                                sizeof(float) * 3)));
+
+    s_gles2.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+    s_gles2.glDrawElements(GL_TRIANGLES, kIndicesLen, GL_UNSIGNED_BYTE, 0);
+    GLenum err = s_gles2.glGetError();
+
+    // draw() expects texture unit 0 to be the active one.
+    s_gles2.glActiveTexture(GL_TEXTURE0);
+
+    if (err != GL_NO_ERROR) {
+        ERR("%s: Could not glDrawElements() error=0x%x\n",
+            __FUNCTION__, err);
+        return false;
+    }
+    return true;
+}
+
 TextureDraw::~TextureDraw() {
     s_gles2.glDeleteBuffers(1, &mIndexBuffer);
     s_gles2.glDeleteBuffers(1, &mVertexBuffer);
 
+    if (mYuvProgram) {
+        s_gles2.glDeleteProgram(mYuvProgram);
+        s_gles2.glDeleteBuffers(1, &mYuvVertexBuffer);
+        s_gles2.glDeleteTextures(3, mYuvTextures);
+    }
+    if (mYuvFragmentShader) {
+        s_gles2.glDeleteShader(mYuvFragmentShader);
+    }
+    if (mYuvVertexShader) {
+        s_gles2.glDeleteShader(mYuvVertexShader);
+    }
+
     if (mFragmentShader) {
         s_gles2.glDeleteShader(mFragmentShader);
     }
@@ -29,8 +29,21 @@
 //      in the GL y-upwards coordinate space. This function fills the whole
 //      framebuffer with texture content.
 //
+//   3) To fill it with a YUV 4:2:0 frame from host memory instead, call
+//      drawYuv(), which uploads the planes and converts them to RGB in the
+//      fragment shader.
+//
 class TextureDraw {
 public:
+    // Layouts of the YUV 4:2:0 frames accepted by drawYuv(). The values
+    // match the RENDER_YUV_FORMAT_XXX constants of render_api.h.
+    enum YuvFormat {
+        kYuvYU12 = 0,   // Y plane, then U and V planes.
+        kYuvYV12 = 1,   // Y plane, then V and U planes.
+        kYuvNV12 = 2,   // Y plane, then interleaved U and V samples.
+        kYuvNV21 = 3,   // Y plane, then interleaved V and U samples.
+    };
+
     // Create a new instance.
     TextureDraw(EGLDisplay display);
 
@@ -43,7 +56,18 @@ public:
     // coordinate space).
     bool draw(GLuint texture, float rotationDegrees);
 
+    // Fill the current framebuffer with a |width| x |height| frame of
+    // |format| pixels, converted with the BT.601 limited range matrix, as
+    // the camera format converters do. Row 0 of |pixels| goes to row 0 of
+    // the framebuffer, as with glTexSubImage2D(), and the frame is scaled
+    // to the viewport. The program and plane textures are created on the
+    // first call. Returns false on failure.
+    bool drawYuv(int width, int height, YuvFormat format, const void* pixels);
+
 private:
+    // Create the YUV program and plane textures, if not done yet.
+    bool setupYuv();
+
     EGLDisplay mDisplay;
     GLuint mVertexShader;
     GLuint mFragmentShader;
@@ -54,6 +78,16 @@ private:
     GLint mRotationSlot;
     GLuint mVertexBuffer;
     GLuint mIndexBuffer;
+    GLuint mYuvVertexShader;
+    GLuint mYuvFragmentShader;
+    GLuint mYuvProgram;
+    GLint mYuvPositionSlot;
+    GLint mYuvInCoordSlot;
+    GLint mYuvSamplerSlots[3];
+    GLint mYuvUSelectSlot;
+    GLint mYuvVSelectSlot;
+    GLuint mYuvVertexBuffer;
+    GLuint mYuvTextures[3];
 };
 
 #endif  // TEXTURE_DRAW_H
@@ -0,0 +1,94 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "VsyncClock.h"
+
+namespace {
+
+// Period assumed to tell how many vsyncs the first interval spans.
+const long long kDefaultPeriodUs = 16667;
+
+// Range of the accepted periods, from 200 to 20 Hz.
+const long long kMinPeriodUs = 5000;
+const long long kMaxPeriodUs = 50000;
+
+// Presentations further apart than this many periods, e.g. after the
+// guest stopped posting frames for a while, only reset the phase.
+const long long kMaxSkippedVsyncs = 8;
+
+volatile long long sOffsetUs = 0;
+
+}  // namespace
+
+VsyncClock::VsyncClock() :
+        m_lock(), m_phaseUs(0), m_periodUs(0), m_lastPresentUs(0) {}
+
+void VsyncClock::onPresent(long long timeUs) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    long long intervalUs = timeUs - m_lastPresentUs;
+    m_lastPresentUs = timeUs;
+
+    if (!m_periodUs) {
+        long long count = (intervalUs + kDefaultPeriodUs / 2) / kDefaultPeriodUs;
+        if (m_phaseUs && count >= 1 && count <= kMaxSkippedVsyncs &&
+            intervalUs / count >= kMinPeriodUs &&
+            intervalUs / count <= kMaxPeriodUs) {
+            m_periodUs = intervalUs / count;
+        }
+        m_phaseUs = timeUs;
+        return;
+    }
+
+    // Number of vsyncs since the previous presentation, and distance to
+    // the predicted one.
+    long long count = (timeUs - m_phaseUs + m_periodUs / 2) / m_periodUs;
+    if (count < 1) {
+        // Several presentations during the same vsync, e.g. the host
+        // doesn't wait for it, there is nothing to learn.
+        return;
+    }
+    if (count > kMaxSkippedVsyncs) {
+        m_phaseUs = timeUs;
+        return;
+    }
+    long long errorUs = timeUs - (m_phaseUs + count * m_periodUs);
+    m_phaseUs += count * m_periodUs + errorUs / 4;
+    m_periodUs += errorUs / (8 * count);
+    if (m_periodUs < kMinPeriodUs) {
+        m_periodUs = kMinPeriodUs;
+    } else if (m_periodUs > kMaxPeriodUs) {
+        m_periodUs = kMaxPeriodUs;
+    }
+}
+
+bool VsyncClock::getTiming(long long nowUs, long long* ageUs,
+                           long long* periodUs) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    if (!m_periodUs) {
+        return false;
+    }
+    long long vsyncUs = m_phaseUs - sOffsetUs % m_periodUs;
+    long long age = (nowUs - vsyncUs) % m_periodUs;
+    if (age < 0) {
+        age += m_periodUs;
+    }
+    *ageUs = age;
+    *periodUs = m_periodUs;
+    return true;
+}
+
+// static
+void VsyncClock::setOffsetUs(long long offsetUs) {
+    sOffsetUs = offsetUs;
+}
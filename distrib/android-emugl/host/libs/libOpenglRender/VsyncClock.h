@@ -0,0 +1,57 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef VSYNC_CLOCK_H
+#define VSYNC_CLOCK_H
+
+#include "emugl/common/mutex.h"
+
+// An estimate of the host display's vsync, derived from the times at which
+// FrameBuffer presents frames: eglSwapBuffers() returns right after a
+// vblank on most drivers, or the UI receives the post callback right
+// before painting.
+//
+// The presentations only happen when the guest posts frames, and some
+// vblanks are skipped, so the clock is a phase-locked loop: each
+// presentation corrects the period and phase predicted from the previous
+// ones, which also filters the jitter of the individual measurements.
+//
+// The guest vsync is the host one shifted earlier by an offset, so that
+// the guest has that much time to post its frame before the next vblank.
+//
+// All methods are thread-safe.
+class VsyncClock {
+public:
+    VsyncClock();
+
+    // Record a presentation at |timeUs|, a GetCurrentTimeUS() value.
+    void onPresent(long long timeUs);
+
+    // Store into |*ageUs| the number of microseconds elapsed at |nowUs|
+    // since the last guest vsync, and into |*periodUs| the vsync period.
+    // Return false if there were not enough presentations to know them.
+    bool getTiming(long long nowUs, long long* ageUs, long long* periodUs);
+
+    // Set the offset of the guest vsync before the host one, for all the
+    // instances. It is taken modulo the period.
+    static void setOffsetUs(long long offsetUs);
+
+private:
+    emugl::Mutex m_lock;
+    long long m_phaseUs;    // Time of a host vsync, or 0 if unknown.
+    long long m_periodUs;   // Vsync period, or 0 if unknown.
+    long long m_lastPresentUs;
+};
+
+#endif  // VSYNC_CLOCK_H
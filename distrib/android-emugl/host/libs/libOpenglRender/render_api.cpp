@@ -15,9 +15,12 @@
 */
 #include "render_api.h"
 
+#include "FrameBuffer.h"
 #include "IOStream.h"
+#include "RenderControl.h"
 #include "RenderServer.h"
 #include "RenderWindow.h"
+#include "RingStream.h"
 #include "TimeUtils.h"
 
 #include "TcpStream.h"
@@ -31,6 +34,9 @@
 #include "GLESv1Dispatch.h"
 #include "GLESv2Dispatch.h"
 
+#include "emugl/common/metrics.h"
+#include "emugl/common/trace.h"
+
 #include <string.h>
 
 static RenderServer* s_renderThread = NULL;
@@ -136,6 +142,91 @@ RENDER_APICALL void RENDER_APIENTRY setPostCallback(
     }
 }
 
+RENDER_APICALL void RENDER_APIENTRY setDisplayPostCallback(
+        int displayId, OnPostFn onPost, void* onPostContext) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (fb) {
+        fb->setDisplayPostCallback(displayId, onPost, onPostContext);
+    } else {
+        ERR("Calling setDisplayPostCallback() before creating render window!");
+    }
+}
+
+RENDER_APICALL int RENDER_APIENTRY getPostTimings(
+        long long* agesUs, int count) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (!fb) {
+        return 0;
+    }
+    return fb->getPostTimings(agesUs, count);
+}
+
+RENDER_APICALL bool RENDER_APIENTRY getVsyncTiming(
+        long long* ageUs, long long* periodUs) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (!fb) {
+        return false;
+    }
+    return fb->getVsyncTiming(ageUs, periodUs);
+}
+
+RENDER_APICALL void RENDER_APIENTRY setVsyncOffset(long long offsetUs) {
+    VsyncClock::setOffsetUs(offsetUs);
+}
+
+RENDER_APICALL void RENDER_APIENTRY setTraceCallback(
+        TraceFn traceFn, const unsigned* categories) {
+    emugl::setTraceCallback(traceFn, categories);
+}
+
+RENDER_APICALL void RENDER_APIENTRY setMetricsCallback(MetricsFn metricsFn) {
+    emugl::setMetricsCallback(metricsFn);
+}
+
+RENDER_APICALL void RENDER_APIENTRY setSharedMemory(void* base, size_t size) {
+    FrameBuffer::setSharedMemory(base, size);
+}
+
+RENDER_APICALL void RENDER_APIENTRY setRenderThreadPriority(int priority) {
+    if (priority <= 0) {
+        setRenderThreadMaxPriority(emugl::Thread::kPriorityLow);
+    } else if (priority == 1) {
+        setRenderThreadMaxPriority(emugl::Thread::kPriorityNormal);
+    } else {
+        setRenderThreadMaxPriority(emugl::Thread::kPriorityHigh);
+    }
+}
+
+RENDER_APICALL bool RENDER_APIENTRY updateColorBufferYuv(
+        uint32_t colorBuffer, int width, int height, int format,
+        const void* pixels) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (!fb || format < RENDER_YUV_FORMAT_YU12 ||
+        format > RENDER_YUV_FORMAT_NV21) {
+        return false;
+    }
+    return fb->updateColorBufferYuv(colorBuffer, width, height, format,
+                                    pixels);
+}
+
+RENDER_APICALL bool RENDER_APIENTRY saveSnapshot(SnapshotWriteFn writeFn,
+                                                 void* context) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (!fb) {
+        return false;
+    }
+    return fb->saveSnapshot(writeFn, context);
+}
+
+RENDER_APICALL bool RENDER_APIENTRY loadSnapshot(SnapshotReadFn readFn,
+                                                 void* context) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (!fb) {
+        return false;
+    }
+    return fb->loadSnapshot(readFn, context);
+}
+
 RENDER_APICALL void RENDER_APIENTRY getHardwareStrings(
         const char** vendor,
         const char** renderer,
@@ -147,6 +238,55 @@ RENDER_APICALL void RENDER_APIENTRY getHardwareStrings(
     *vendor = *renderer = *version = NULL;
 }
 
+// Size in bytes of each ring buffer used by a render channel.
+static const size_t kRenderChannelRingSize = 256 * 1024;
+
+RENDER_APICALL void* RENDER_APIENTRY createRenderChannel(
+        RenderChannelWakeFn onWake, void* onWakeContext) {
+    if (!s_renderThread) {
+        ERR("Calling createRenderChannel() before initOpenGLRenderer()!");
+        return NULL;
+    }
+    RingChannel* channel =
+            new RingChannel(kRenderChannelRingSize, onWake, onWakeContext);
+    RingStream* stream = new RingStream(channel);
+    if (!s_renderThread->addStream(stream)) {
+        ERR("createRenderChannel failed to start a render thread\n");
+        delete stream;
+        channel->guestClose();
+        return NULL;
+    }
+    return channel;
+}
+
+RENDER_APICALL int RENDER_APIENTRY renderChannelWrite(
+        void* channel, const void* data, size_t size) {
+    return static_cast<RingChannel*>(channel)->guestWrite(data, size);
+}
+
+RENDER_APICALL int RENDER_APIENTRY renderChannelRead(
+        void* channel, void* data, size_t size) {
+    return static_cast<RingChannel*>(channel)->guestRead(data, size);
+}
+
+RENDER_APICALL unsigned RENDER_APIENTRY renderChannelPoll(void* channel) {
+    return static_cast<RingChannel*>(channel)->guestPoll();
+}
+
+RENDER_APICALL unsigned RENDER_APIENTRY renderChannelSpin(
+        void* channel, unsigned flags) {
+    return static_cast<RingChannel*>(channel)->guestSpin(flags);
+}
+
+RENDER_APICALL void RENDER_APIENTRY renderChannelWakeOn(
+        void* channel, unsigned flags) {
+    static_cast<RingChannel*>(channel)->guestWakeOn(flags);
+}
+
+RENDER_APICALL void RENDER_APIENTRY destroyRenderChannel(void* channel) {
+    static_cast<RingChannel*>(channel)->guestClose();
+}
+
 RENDER_APICALL int RENDER_APIENTRY stopOpenGLRenderer(void)
 {
     bool ret = false;
@@ -196,7 +336,7 @@ RENDER_APICALL bool RENDER_APIENTRY createOpenGLSubwindow(
     RenderWindow* window = s_renderWindow;
 
     if (window) {
-       return window->setupSubWindow(window_id,x,y,width,height, zRot);
+       return window->setupSubWindow(window_id,x,y,width,height, zRot, false);
     }
     // XXX: should be implemented by sending the renderer process
     //      a request
@@ -205,6 +345,23 @@ RENDER_APICALL bool RENDER_APIENTRY createOpenGLSubwindow(
     return false;
 }
 
+RENDER_APICALL bool RENDER_APIENTRY attachOpenGLWindow(
+        FBNativeWindowType window_id,
+        int width,
+        int height,
+        float zRot)
+{
+    RenderWindow* window = s_renderWindow;
+
+    if (window) {
+       return window->setupSubWindow(window_id, 0, 0, width, height, zRot,
+                                     true);
+    }
+    ERR("%s not implemented for separate renderer process !!!\n",
+        __FUNCTION__);
+    return false;
+}
+
 RENDER_APICALL bool RENDER_APIENTRY destroyOpenGLSubwindow(void)
 {
     RenderWindow* window = s_renderWindow;
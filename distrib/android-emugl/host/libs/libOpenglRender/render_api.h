@@ -45,6 +45,17 @@ extern "C" {
 #define STREAM_MODE_UNIX      2
 #define STREAM_MODE_PIPE      3
 
+/* flags returned by renderChannelPoll() and passed to renderChannelWakeOn() */
+#define RENDER_CHANNEL_CAN_READ   1
+#define RENDER_CHANNEL_CAN_WRITE  2
+#define RENDER_CHANNEL_CLOSED     4
+
+/* frame layouts passed to updateColorBufferYuv() */
+#define RENDER_YUV_FORMAT_YU12    0
+#define RENDER_YUV_FORMAT_YV12    1
+#define RENDER_YUV_FORMAT_NV12    2
+#define RENDER_YUV_FORMAT_NV21    3
+
 
 #define RENDER_API_DECLARE(return_type, func_name, signature) \
     typedef return_type (RENDER_APIENTRY *func_name ## Fn) signature; \
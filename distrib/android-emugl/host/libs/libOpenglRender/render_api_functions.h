@@ -9,17 +9,45 @@
 #include <stddef.h>
 #include <stdint.h>
 typedef void (*OnPostFn)(void* context, int width, int height, int ydir,
-                         int format, int type, unsigned char* pixels);
+                         int format, int type, unsigned char* pixels,
+                         int damageX, int damageY, int damageWidth,
+                         int damageHeight);
+typedef void (*RenderChannelWakeFn)(void* context);
+typedef void (*TraceFn)(int category, int type, const char* name,
+                        long long value);
+typedef void (*MetricsFn)(int metric, long long value);
+typedef void (*SnapshotWriteFn)(void* context, const void* data,
+                                size_t size);
+typedef size_t (*SnapshotReadFn)(void* context, void* data, size_t size);
 #define LIST_RENDER_API_FUNCTIONS(X) \
   X(int, initLibrary, ()) \
   X(int, setStreamMode, (int mode)) \
   X(int, initOpenGLRenderer, (int width, int height, bool useSubWindow, char* addr, size_t addrLen)) \
   X(void, getHardwareStrings, (const char** vendor, const char** renderer, const char** version)) \
   X(void, setPostCallback, (OnPostFn onPost, void* onPostContext)) \
+  X(void, setDisplayPostCallback, (int displayId, OnPostFn onPost, void* onPostContext)) \
+  X(int, getPostTimings, (long long* agesUs, int count)) \
+  X(bool, getVsyncTiming, (long long* ageUs, long long* periodUs)) \
+  X(void, setVsyncOffset, (long long offsetUs)) \
+  X(void, setTraceCallback, (TraceFn traceFn, const unsigned* categories)) \
+  X(void, setMetricsCallback, (MetricsFn metricsFn)) \
+  X(void, setSharedMemory, (void* base, size_t size)) \
+  X(void, setRenderThreadPriority, (int priority)) \
+  X(bool, updateColorBufferYuv, (uint32_t colorBuffer, int width, int height, int format, const void* pixels)) \
+  X(bool, saveSnapshot, (SnapshotWriteFn writeFn, void* context)) \
+  X(bool, loadSnapshot, (SnapshotReadFn readFn, void* context)) \
   X(bool, createOpenGLSubwindow, (FBNativeWindowType window, int x, int y, int width, int height, float zRot)) \
+  X(bool, attachOpenGLWindow, (FBNativeWindowType window, int width, int height, float zRot)) \
   X(bool, destroyOpenGLSubwindow, ()) \
   X(void, setOpenGLDisplayRotation, (float zRot)) \
   X(void, repaintOpenGLDisplay, ()) \
+  X(void*, createRenderChannel, (RenderChannelWakeFn onWake, void* onWakeContext)) \
+  X(int, renderChannelWrite, (void* channel, const void* data, size_t size)) \
+  X(int, renderChannelRead, (void* channel, void* data, size_t size)) \
+  X(unsigned, renderChannelPoll, (void* channel)) \
+  X(unsigned, renderChannelSpin, (void* channel, unsigned flags)) \
+  X(void, renderChannelWakeOn, (void* channel, unsigned flags)) \
+  X(void, destroyRenderChannel, (void* channel)) \
   X(int, stopOpenGLRenderer, ()) \
 
 
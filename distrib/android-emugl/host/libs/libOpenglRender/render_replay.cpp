@@ -0,0 +1,399 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// emugl_render_replay feeds the GLES streams recorded by RenderThread when
+// RENDERER_DUMP_DIR is defined to the decoders of new RenderThreads, against
+// a FrameBuffer without a window, and reports how fast they are decoded.
+// This measures the renderer and the host GL driver without a guest.
+//
+// Streams are replayed at full speed, or with their original timing when
+// their .timing file is available. Several streams are replayed
+// concurrently, each by its own RenderThread. Note that the handles of the
+// objects shared between streams (e.g. color buffers) only match those of
+// the recording when they are created in the same order, which replaying
+// with the original timing makes likely.
+
+#include "FrameBuffer.h"
+#include "IOStream.h"
+#include "RenderThread.h"
+#include "TimeUtils.h"
+#include "render_api.h"
+
+#include "emugl/common/metrics.h"
+#include "emugl/common/mutex.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// Every render packet starts with a 32-bit opcode and its 32-bit total size.
+const size_t kPacketHeaderSize = 8;
+
+// A chunk of a stream, as received by the recording RenderThread.
+struct Chunk {
+    long long timeUs;
+    size_t size;
+};
+
+// A recorded stream, and the results of its replay.
+struct Replay {
+    const char* path;
+    std::vector<unsigned char> data;
+    std::vector<Chunk> chunks;  // Empty to replay at full speed.
+    size_t calls;
+    size_t replyBytes;
+    long long endUs;
+};
+
+// An IOStream that serves the data of a Replay to a RenderThread, and
+// discards the replies of the decoders.
+class ReplayStream : public IOStream {
+public:
+    ReplayStream(Replay* replay, long long startUs) :
+            IOStream(16384),
+            m_replay(replay),
+            m_startUs(startUs),
+            m_pos(0),
+            m_chunk(0),
+            m_chunkLeft(0),
+            m_stopped(false) {}
+
+    // The RenderThread deletes its stream when it exits, which marks the
+    // end of the replay.
+    virtual ~ReplayStream() {
+        m_replay->endUs = GetCurrentTimeUS();
+    }
+
+    virtual void* allocBuffer(size_t minSize) {
+        if (m_reply.size() < minSize) {
+            m_reply.resize(minSize);
+        }
+        return &m_reply[0];
+    }
+
+    virtual int commitBuffer(size_t size) {
+        m_replay->replyBytes += size;
+        return (int)size;
+    }
+
+    virtual const unsigned char* readFully(void* buf, size_t len) {
+        unsigned char* dst = static_cast<unsigned char*>(buf);
+        while (len > 0) {
+            size_t n = len;
+            if (!read(dst, &n)) {
+                return NULL;
+            }
+            dst += n;
+            len -= n;
+        }
+        return static_cast<unsigned char*>(buf);
+    }
+
+    virtual const unsigned char* read(void* buf, size_t* inout_len) {
+        const size_t total = m_replay->data.size();
+        if (m_stopped || m_pos == total) {
+            return NULL;
+        }
+        size_t n = total - m_pos;
+        if (m_chunk < m_replay->chunks.size() || m_chunkLeft > 0) {
+            if (m_chunkLeft == 0) {
+                waitForChunk(m_replay->chunks[m_chunk]);
+                m_chunkLeft = m_replay->chunks[m_chunk].size;
+                m_chunk++;
+            }
+            if (n > m_chunkLeft) {
+                n = m_chunkLeft;
+            }
+        }
+        if (n > *inout_len) {
+            n = *inout_len;
+        }
+        memcpy(buf, &m_replay->data[m_pos], n);
+        m_pos += n;
+        if (m_chunkLeft > 0) {
+            m_chunkLeft -= (n < m_chunkLeft) ? n : m_chunkLeft;
+        }
+        *inout_len = n;
+        return static_cast<const unsigned char*>(buf);
+    }
+
+    virtual int writeFully(const void* buf, size_t len) {
+        m_replay->replyBytes += len;
+        return 0;
+    }
+
+    virtual void forceStop() {
+        m_stopped = true;
+    }
+
+private:
+    // Sleep until the time |chunk| was received at, relative to the
+    // first chunk of the stream.
+    void waitForChunk(const Chunk& chunk) {
+        long long due = m_startUs + chunk.timeUs - m_replay->chunks[0].timeUs;
+        long long now = GetCurrentTimeUS();
+        if (due > now + 1000) {
+            TimeSleepMS((int)((due - now) / 1000));
+        }
+    }
+
+    Replay* m_replay;
+    long long m_startUs;
+    size_t m_pos;
+    size_t m_chunk;
+    size_t m_chunkLeft;
+    volatile bool m_stopped;
+    std::vector<unsigned char> m_reply;
+};
+
+// The renderer metrics recorded during the replay.
+emugl::Mutex s_metricsLock;
+std::vector<long long> s_decodeUs;
+std::vector<long long> s_postUs;
+
+void onMetric(int metric, long long value) {
+    emugl::Mutex::AutoLock lock(s_metricsLock);
+    if (metric == emugl::kMetricDecodeUs) {
+        s_decodeUs.push_back(value);
+    } else if (metric == emugl::kMetricPostUs) {
+        s_postUs.push_back(value);
+    }
+}
+
+// A post callback that does nothing, used to include the readback of the
+// frames in the post times.
+void onPost(void* context, int width, int height, int ydir, int format,
+            int type, unsigned char* pixels, int damageX, int damageY,
+            int damageWidth, int damageHeight) {}
+
+bool readFile(const char* path, std::vector<unsigned char>* data) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    unsigned char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data->insert(data->end(), buffer, buffer + n);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+// Load the "<time> <size>" lines of the timing file of |replay|, if any.
+void readTiming(Replay* replay) {
+    size_t len = strlen(replay->path) + 8;
+    char* path = new char[len];
+    snprintf(path, len, "%s.timing", replay->path);
+    FILE* file = fopen(path, "r");
+    delete [] path;
+    if (!file) {
+        return;
+    }
+    long long timeUs;
+    int size;
+    while (fscanf(file, "%lld %d", &timeUs, &size) == 2 && size > 0) {
+        Chunk chunk = { timeUs, (size_t)size };
+        replay->chunks.push_back(chunk);
+    }
+    fclose(file);
+}
+
+// Count the packets, i.e. the GLES and renderControl calls, of a stream.
+size_t countCalls(const std::vector<unsigned char>& data) {
+    size_t calls = 0;
+    size_t pos = 0;
+    while (pos + kPacketHeaderSize <= data.size()) {
+        uint32_t size;
+        memcpy(&size, &data[pos + 4], sizeof(size));
+        if (size < kPacketHeaderSize) {
+            break;
+        }
+        pos += size;
+        calls++;
+    }
+    return calls;
+}
+
+// Print the count, average and percentiles of |values|, in microseconds.
+void printDistribution(const char* name, std::vector<long long>* values) {
+    if (values->empty()) {
+        printf("%-8s none\n", name);
+        return;
+    }
+    std::sort(values->begin(), values->end());
+    const size_t count = values->size();
+    long long total = 0;
+    for (size_t n = 0; n < count; ++n) {
+        total += (*values)[n];
+    }
+    printf("%-8s %7zu, total %lld us, avg %.1f us, p50 %lld us, "
+           "p90 %lld us, p99 %lld us, max %lld us\n",
+           name, count, total, (double)total / count,
+           (*values)[count / 2],
+           (*values)[count * 9 / 10],
+           (*values)[count * 99 / 100],
+           (*values)[count - 1]);
+}
+
+void usage(const char* program) {
+    printf("Usage: %s [options] <stream>...\n\n"
+           "Replay GLES streams recorded by the emulator with\n"
+           "RENDERER_DUMP_DIR=<dir> defined, and report decode throughput,\n"
+           "per-call latency and post times.\n\n"
+           "Options:\n"
+           "  --timing          replay with the original timing, using the\n"
+           "                    <stream>.timing files\n"
+           "  --readback        read the frames back on post, like the\n"
+           "                    emulator does without a subwindow\n"
+           "  --width=<pixels>  width of the framebuffer (default 720)\n"
+           "  --height=<pixels> height of the framebuffer (default 1280)\n\n"
+           "Decoding is serialized between streams, unless\n"
+           "ANDROID_EMUGL_PARALLEL_DECODING is defined, like in the "
+           "emulator.\n",
+           program);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bool useTiming = false;
+    bool readback = false;
+    int width = 720;
+    int height = 1280;
+    std::vector<Replay*> replays;
+
+    for (int n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        if (!strcmp(arg, "--timing")) {
+            useTiming = true;
+        } else if (!strcmp(arg, "--readback")) {
+            readback = true;
+        } else if (!strncmp(arg, "--width=", 8)) {
+            width = atoi(arg + 8);
+        } else if (!strncmp(arg, "--height=", 9)) {
+            height = atoi(arg + 9);
+        } else if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) {
+            usage(argv[0]);
+            return 0;
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return 1;
+        } else {
+            Replay* replay = new Replay();
+            replay->path = arg;
+            replay->calls = 0;
+            replay->replyBytes = 0;
+            replay->endUs = 0;
+            replays.push_back(replay);
+        }
+    }
+    if (replays.empty() || width <= 0 || height <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (size_t n = 0; n < replays.size(); ++n) {
+        Replay* replay = replays[n];
+        if (!readFile(replay->path, &replay->data)) {
+            fprintf(stderr, "Could not read %s\n", replay->path);
+            return 1;
+        }
+        if (useTiming) {
+            readTiming(replay);
+            if (replay->chunks.empty()) {
+                fprintf(stderr, "No timing for %s, replaying it at full "
+                        "speed\n", replay->path);
+            }
+        }
+        replay->calls = countCalls(replay->data);
+    }
+
+    if (!initLibrary()) {
+        fprintf(stderr, "Could not load the GLES translator libraries\n");
+        return 1;
+    }
+    if (!FrameBuffer::initialize(width, height, false)) {
+        fprintf(stderr, "Could not initialize the framebuffer\n");
+        return 1;
+    }
+    if (readback) {
+        FrameBuffer::getFB()->setPostCallback(onPost, NULL);
+    }
+    emugl::setMetricsCallback(onMetric);
+
+    emugl::Mutex decodeLock;
+    emugl::Mutex* lock =
+            getenv("ANDROID_EMUGL_PARALLEL_DECODING") ? NULL : &decodeLock;
+
+    const long long startUs = GetCurrentTimeUS();
+    std::vector<RenderThread*> threads;
+    for (size_t n = 0; n < replays.size(); ++n) {
+        RenderThread* thread = RenderThread::create(
+                new ReplayStream(replays[n], startUs), lock);
+        if (!thread->start()) {
+            fprintf(stderr, "Could not start a render thread\n");
+            return 1;
+        }
+        threads.push_back(thread);
+    }
+    for (size_t n = 0; n < threads.size(); ++n) {
+        threads[n]->wait(NULL);
+        delete threads[n];
+    }
+    emugl::setMetricsCallback(NULL);
+
+    size_t totalBytes = 0;
+    size_t totalCalls = 0;
+    long long endUs = startUs;
+    for (size_t n = 0; n < replays.size(); ++n) {
+        const Replay* replay = replays[n];
+        printf("%s: %zu bytes, %zu calls, %zu reply bytes, %.1f ms\n",
+               replay->path, replay->data.size(), replay->calls,
+               replay->replyBytes, (replay->endUs - startUs) / 1000.);
+        totalBytes += replay->data.size();
+        totalCalls += replay->calls;
+        endUs = std::max(endUs, replay->endUs);
+    }
+
+    long long decodeUs = 0;
+    for (size_t n = 0; n < s_decodeUs.size(); ++n) {
+        decodeUs += s_decodeUs[n];
+    }
+    const double wallUs = (double)std::max(endUs - startUs, 1LL);
+    printf("\nwall time %.1f ms, %.2f MB/s, %.0f calls/s\n",
+           wallUs / 1000., totalBytes / wallUs, totalCalls * 1e6 / wallUs);
+    if (decodeUs > 0) {
+        printf("decoding %.1f ms, %.2f MB/s, %.3f us per call\n",
+               decodeUs / 1000., (double)totalBytes / decodeUs,
+               totalCalls ? (double)decodeUs / totalCalls : 0.);
+    }
+    printDistribution("decode", &s_decodeUs);
+    printDistribution("post", &s_postUs);
+
+    FrameBuffer::getFB()->finalize();
+    for (size_t n = 0; n < replays.size(); ++n) {
+        delete replays[n];
+    }
+    return 0;
+}
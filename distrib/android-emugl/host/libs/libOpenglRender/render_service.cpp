@@ -0,0 +1,139 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// emugl_render_service runs a RenderServer in its own process, against a
+// FrameBuffer without a window, so that several emulators started with
+// ANDROID_EMUGL_RENDER_SERVICE=<address> share a single EGL display, the
+// GL driver's per-process state and the translator's shader compiler.
+//
+// Each emulator process that connects is served as its own instance: the
+// objects it creates are invisible to the other ones, its ColorBuffers can
+// be limited in size, and they are freed when it exits. The emulators
+// don't show the frames rendered for them, so this is meant for headless
+// instances, e.g. test farms.
+
+#include "FrameBuffer.h"
+#include "RenderServer.h"
+#include "render_api.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+
+// Address of the listening socket, unlinked on exit.
+char s_address[256];
+
+void onSignal(int) {
+    unlink(s_address);
+    _exit(0);
+}
+
+void usage(const char* program) {
+    printf("Usage: %s [options]\n\n"
+           "Serve the GPU emulation of the emulators started with\n"
+           "ANDROID_EMUGL_RENDER_SERVICE=<address> defined, where <address>\n"
+           "is the one printed on startup.\n\n"
+           "Options:\n"
+           "  --memory-limit-mb=<mb>  GPU memory budget of the color buffers\n"
+           "                          of each emulator (default: no limit)\n"
+           "  --evict-idle-frames=<n> move the color buffers unused for <n>\n"
+           "                          frames to host memory (default: never)\n"
+           "  --width=<pixels>        width of the framebuffer (default 720)\n"
+           "  --height=<pixels>       height of the framebuffer (default "
+           "1280)\n\n"
+           "Streams are decoded in parallel, unless "
+           "ANDROID_EMUGL_PARALLEL_DECODING=0\nis defined.\n",
+           program);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int width = 720;
+    int height = 1280;
+    long memoryLimitMb = 0;
+    int evictIdleFrames = 0;
+
+    for (int n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        if (!strncmp(arg, "--memory-limit-mb=", 18)) {
+            memoryLimitMb = atol(arg + 18);
+        } else if (!strncmp(arg, "--evict-idle-frames=", 20)) {
+            evictIdleFrames = atoi(arg + 20);
+        } else if (!strncmp(arg, "--width=", 8)) {
+            width = atoi(arg + 8);
+        } else if (!strncmp(arg, "--height=", 9)) {
+            height = atoi(arg + 9);
+        } else if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) {
+            usage(argv[0]);
+            return 0;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return 1;
+        }
+    }
+    if (width <= 0 || height <= 0 || memoryLimitMb < 0 ||
+        evictIdleFrames < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // One emulator must not wait for the decoding passes of the others.
+    const char* parallel = getenv("ANDROID_EMUGL_PARALLEL_DECODING");
+    if (parallel && !strcmp(parallel, "0")) {
+        unsetenv("ANDROID_EMUGL_PARALLEL_DECODING");
+    } else {
+        setenv("ANDROID_EMUGL_PARALLEL_DECODING", "1", 1);
+    }
+
+    if (!initLibrary()) {
+        fprintf(stderr, "Could not load the GLES translator libraries\n");
+        return 1;
+    }
+    FrameBuffer::setInstanceMemoryLimit((uint64_t)memoryLimitMb << 20);
+    FrameBuffer::setEvictIdleFrames((uint32_t)evictIdleFrames);
+    if (!FrameBuffer::initialize(width, height, false)) {
+        fprintf(stderr, "Could not initialize the framebuffer\n");
+        return 1;
+    }
+
+    setStreamMode(STREAM_MODE_UNIX);
+    RenderServer* server = RenderServer::create(s_address,
+                                                sizeof(s_address));
+    if (!server) {
+        fprintf(stderr, "Could not create the render server\n");
+        return 1;
+    }
+    server->setMultiInstance(true);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    if (!server->start()) {
+        fprintf(stderr, "Could not start the render server\n");
+        return 1;
+    }
+    printf("ANDROID_EMUGL_RENDER_SERVICE=%s\n", s_address);
+    fflush(stdout);
+
+    server->wait(NULL);
+    delete server;
+    FrameBuffer::getFB()->finalize();
+    return 0;
+}
@@ -26,3 +26,28 @@
 #define FB_FPS      5
 #define FB_MIN_SWAP_INTERVAL 6
 #define FB_MAX_SWAP_INTERVAL 7
+
+// values for 'hint' argument of rcSetStreamHint
+#define RC_STREAM_HINT_DEFAULT     0
+#define RC_STREAM_HINT_COMPOSITOR  1
+#define RC_STREAM_HINT_BACKGROUND  2
+
+// operation codes in the 'ops' buffer of rcPresent. Each one is a 32-bit
+// word followed by its 32-bit arguments, named after the renderControl
+// command that it replaces.
+#define RC_PRESENT_END                      0  // no arguments
+#define RC_PRESENT_SET_WINDOW_COLOR_BUFFER  1  // windowSurface, colorBuffer
+#define RC_PRESENT_FLUSH_WINDOW_COLOR_BUFFER 2 // windowSurface
+#define RC_PRESENT_FB_POST                  3  // colorBuffer
+#define RC_PRESENT_FB_POST_DISPLAY          4  // display, colorBuffer
+#define RC_PRESENT_OPEN_COLOR_BUFFER        5  // colorBuffer
+#define RC_PRESENT_CLOSE_COLOR_BUFFER       6  // colorBuffer
+
+// indices of the words stored by rcGetVsyncTiming
+#define RC_VSYNC_AGE_US     0  // microseconds since the last guest vsync
+#define RC_VSYNC_PERIOD_US  1  // vsync period in microseconds
+#define RC_VSYNC_COUNT      2
+
+// 'offset' argument of rcBindColorBufferSharedMemory that unbinds the color
+// buffer from the memory region of the goldfish_address_space device.
+#define RC_SHARED_MEMORY_NONE  0xffffffffU
@@ -356,6 +356,12 @@ int ApiGen::genEncoderHeader(const std::string &filename)
             classname.c_str(), m_basename.c_str(), sideString(CLIENT_SIDE));
     fprintf(fp, "\tIOStream *m_stream;\n\n");
 
+    if (m_encoderBufferSize > 0) {
+        fprintf(fp, "\t// Size of the IOStream buffer to create for this encoder.\n");
+        fprintf(fp, "\tenum { kStreamBufferSize = %u };\n\n",
+                (unsigned int)m_encoderBufferSize);
+    }
+
     fprintf(fp, "\t%s(IOStream *stream);\n", classname.c_str());
     fprintf(fp, "};\n\n");
 
@@ -548,6 +554,11 @@ int ApiGen::genEncoderImpl(const std::string &filename)
         }
         fprintf(fp, ";\n");
 
+        // Calls without pointer parameters have a packet size known at
+        // compile time, so their header is a constant template copied at
+        // once.
+        bool fixedSize = (npointers == 0);
+
         // We need to divide the packet into fragments. Each fragment contains
         // either copied arguments to a temporary buffer, or direct writes for
         // large variables.
@@ -593,7 +604,10 @@ int ApiGen::genEncoderImpl(const std::string &filename)
                 }
 
                 // encode packet header if needed.
-                if (nvars == 0) {
+                if (nvars == 0 && fixedSize) {
+                    fprintf(fp, "\tstatic const unsigned int __header[2] = { OP_%s, (unsigned int)packetSize };\n", e->name().c_str());
+                    fprintf(fp, "\tmemcpy(ptr, __header, 8); ptr += 8;\n\n");
+                } else if (nvars == 0) {
                     fprintf(fp, "\tint tmp = OP_%s;memcpy(ptr, &tmp, 4); ptr += 4;\n",  e->name().c_str());
                     fprintf(fp, "\tmemcpy(ptr, &packetSize, 4);  ptr += 4;\n\n");
                 }
@@ -733,6 +747,11 @@ int ApiGen::genDecoderHeader(const std::string &filename)
     fprintf(fp, "struct %s : public %s_%s_context_t {\n\n",
             classname.c_str(), m_basename.c_str(), sideString(SERVER_SIDE));
     fprintf(fp, "\tsize_t decode(void *buf, size_t bufsize, IOStream *stream);\n");
+    fprintf(fp, "\n\t// Return true if |opcode| is one of this protocol's opcodes.\n");
+    fprintf(fp, "\tstatic bool handlesOpcode(unsigned int opcode) {\n");
+    fprintf(fp, "\t\treturn opcode - %uU < %uU;\n",
+            (unsigned int)m_baseOpcode, (unsigned int)size());
+    fprintf(fp, "\t}\n");
     fprintf(fp, "\n};\n\n");
     fprintf(fp, "#endif  // GUARD_%s\n", classname.c_str());
 
@@ -810,6 +829,55 @@ int ApiGen::genDecoderImpl(const std::string &filename)
     // helper templates
     fprintf(fp, "using namespace emugl;\n\n");
 
+    if (m_threadedDecoder) {
+        // Checks the header of the packet at |ptr| and jumps to its handler,
+        // or returns the number of bytes consumed if the packet is
+        // incomplete or belongs to another protocol.
+        fprintf(fp,
+                "#define DECODE_NEXT_PACKET() \\\n"
+                "\tdo { \\\n"
+                "\t\tif (len - pos < 8) return pos; \\\n"
+                "\t\topcode = *(uint32_t *)ptr; \\\n"
+                "\t\tpacketLen = *(uint32_t *)(ptr + 4); \\\n"
+                "\t\tif (len - pos < packetLen || packetLen < 8) return pos; \\\n"
+                "\t\tif (opcode - %uU >= %uU) return pos; \\\n"
+                "\t\tgoto *s_handlers[opcode - %uU]; \\\n"
+                "\t} while (0)\n\n",
+                (unsigned int)m_baseOpcode, (unsigned int)n,
+                (unsigned int)m_baseOpcode);
+        if (strstr(m_basename.c_str(), "gl")) {
+            fprintf(fp,
+                    "#ifdef CHECK_GL_ERROR\n"
+                    "#  define CHECK_LASTCALL_ERROR() \\\n"
+                    "\tdo { \\\n"
+                    "\t\tint err = lastCall[0] ? this->glGetError() : GL_NO_ERROR; \\\n"
+                    "\t\tif (err) fprintf(stderr, \"%s Error: 0x%%X in %%s\\n\", err, lastCall); \\\n"
+                    "\t} while (0)\n"
+                    "#else\n"
+                    "#  define CHECK_LASTCALL_ERROR()  ((void)0)\n"
+                    "#endif\n\n",
+                    m_basename.c_str());
+        } else {
+            fprintf(fp, "#define CHECK_LASTCALL_ERROR()  ((void)0)\n\n");
+        }
+
+        fprintf(fp, "size_t %s::decode(void *buf, size_t len, IOStream *stream)\n{\n", classname.c_str());
+        fprintf(fp, "\tstatic void* const s_handlers[] = {\n");
+        for (size_t f = 0; f < n; f++) {
+            fprintf(fp, "\t\t&&op_%s,\n", at(f).name().c_str());
+        }
+        fprintf(fp, "\t};\n");
+        fprintf(fp,
+                "\tsize_t pos = 0;\n"
+                "\tunsigned char *ptr = (unsigned char *)buf;\n"
+                "\tuint32_t opcode;\n"
+                "\tsize_t packetLen;\n"
+                "#ifdef CHECK_GL_ERROR \n"
+                "\tchar lastCall[256] = {0}; \n"
+                "#endif \n"
+                "\tDECODE_NEXT_PACKET();\n"
+                "\t{\n");
+    } else {
     // decoder switch;
     fprintf(fp, "size_t %s::decode(void *buf, size_t len, IOStream *stream)\n{\n", classname.c_str());
     fprintf(fp,
@@ -826,6 +894,7 @@ int ApiGen::genDecoderImpl(const std::string &filename)
 \t\tsize_t packetLen = *(uint32_t *)(ptr + 4);\n\
 \t\tif (len - pos < packetLen)  return pos; \n\
 \t\tswitch(opcode) {\n");
+    }
 
     for (size_t f = 0; f < n; f++) {
         enum Pass_t {
@@ -849,7 +918,11 @@ int ApiGen::genDecoderImpl(const std::string &filename)
         printString += "";
         // TODO - add for return value;
 
-        fprintf(fp, "\t\tcase OP_%s: {\n", e->name().c_str());
+        if (m_threadedDecoder) {
+            fprintf(fp, "\t\top_%s: {\n", e->name().c_str());
+        } else {
+            fprintf(fp, "\t\tcase OP_%s: {\n", e->name().c_str());
+        }
 
         bool totalTmpBuffExist = false;
         std::string totalTmpBuffOffset = "0";
@@ -936,11 +1009,15 @@ int ApiGen::genDecoderImpl(const std::string &filename)
                     v->pointerDir() == Var::POINTER_INOUT) {
                     if (pass == PASS_VariableDeclarations) {
 #if USE_ALIGNED_BUFFERS
+                        // Parameters are 4-byte aligned in the stream unless
+                        // a previous packet had an odd data size, so 'align4'
+                        // variables are almost never copied.
                         fprintf(fp,
-                                "\t\t\tInputBuffer inptr_%s(ptr + %s + 4, size_%s);\n",
+                                "\t\t\tInputBuffer inptr_%s(ptr + %s + 4, size_%s%s);\n",
                                 var_name,
                                 varoffset.c_str(),
-                                var_name);
+                                var_name,
+                                v->align4() ? ", 4" : "");
                     }
                     if (pass == PASS_FunctionCall) {
                         if (v->nullAllowed()) {
@@ -1096,20 +1173,32 @@ int ApiGen::genDecoderImpl(const std::string &filename)
                 }
             }
 
-            if (pass == PASS_Epilog) {
-                // send back out pointers data as well as retval
-                if (totalTmpBuffExist) {
-                    fprintf(fp, "\t\t\tstream->flush();\n");
-                }
-            }
-
+            // The out pointers data and retval stay in the stream's buffer,
+            // with the replies of the following packets: the caller flushes
+            // the stream once it has decoded all the data it has.
         } // pass;
         fprintf(fp, "\t\t\tSET_LASTCALL(\"%s\");\n", e->name().c_str());
-        fprintf(fp, "\t\t\tbreak;\n");
-        fprintf(fp, "\t\t}\n");
+        if (m_threadedDecoder) {
+            // Leave the handler's scope first, so that its buffers are
+            // destroyed before jumping to the next handler.
+            fprintf(fp, "\t\t}\n");
+            fprintf(fp, "\t\tCHECK_LASTCALL_ERROR();\n");
+            fprintf(fp, "\t\tpos += packetLen;\n");
+            fprintf(fp, "\t\tptr += packetLen;\n");
+            fprintf(fp, "\t\tDECODE_NEXT_PACKET();\n");
+        } else {
+            fprintf(fp, "\t\t\tbreak;\n");
+            fprintf(fp, "\t\t}\n");
+        }
 
         delete [] tmpBufOffset;
     }
+    if (m_threadedDecoder) {
+        fprintf(fp, "\t}\n");
+        fprintf(fp, "}\n");
+        fclose(fp);
+        return 0;
+    }
     fprintf(fp, "\t\t\tdefault:\n");
     fprintf(fp, "\t\t\t\tunknownOpcode = true;\n");
     fprintf(fp, "\t\t} //switch\n");
@@ -1221,6 +1310,13 @@ int ApiGen::setGlobalAttribute(const std::string & line, size_t lc)
         } else {
             setBaseOpcode(atoi(str.c_str()));
         }
+    } else if (token == "encoder_buffer_size") {
+        std::string str = getNextToken(line, pos, &last, WHITESPACE);
+        if (str.size() == 0) {
+            fprintf(stderr, "line %u: missing value for encoder_buffer_size\n", (unsigned) lc);
+        } else {
+            setEncoderBufferSize(atoi(str.c_str()));
+        }
     } else  if (token == "encoder_headers") {
         std::string str = getNextToken(line, pos, &last, WHITESPACE);
         pos = last;
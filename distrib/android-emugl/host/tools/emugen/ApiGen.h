@@ -30,7 +30,9 @@ public:
     ApiGen(const std::string & basename) :
         m_basename(basename),
         m_maxEntryPointsParams(0),
-        m_baseOpcode(0)
+        m_baseOpcode(0),
+        m_encoderBufferSize(0),
+        m_threadedDecoder(false)
     { }
     virtual ~ApiGen() {}
     int readSpec(const std::string & filename);
@@ -41,6 +43,14 @@ public:
     }
     int baseOpcode() { return m_baseOpcode; }
     void setBaseOpcode(int base) { m_baseOpcode = base; }
+    // Size of the stream buffer advertised by the generated encoder, in
+    // bytes, or 0 to let the guest use its default.
+    int encoderBufferSize() { return m_encoderBufferSize; }
+    void setEncoderBufferSize(int size) { m_encoderBufferSize = size; }
+    // When set, genDecoderImpl() emits a decoder that dispatches the packets
+    // through a table of label addresses (GCC's computed goto) instead of a
+    // switch, each handler jumping directly to the next packet's handler.
+    void setThreadedDecoder(bool threaded) { m_threadedDecoder = threaded; }
 
     const char *sideString(SideType side) {
         const char *retval;
@@ -92,6 +102,8 @@ protected:
     StringVec m_decoderHeaders;
     size_t m_maxEntryPointsParams; // record the maximum number of parameters in the entry points;
     int m_baseOpcode;
+    int m_encoderBufferSize;
+    bool m_threadedDecoder;
     int setGlobalAttribute(const std::string & line, size_t lc);
 };
 
@@ -284,6 +284,13 @@ int EntryPoint::setAttribute(const std::string &line, size_t lc)
                     fprintf(stderr, "WARNING: %u: setting isLarge flag for a non-pointer variable %s\n",
                             (unsigned int) lc, v->name().c_str());
                 }
+            } else if (flag == "align4") {
+                if (v->isPointer()) {
+                    v->setAlign4(true);
+                } else {
+                    fprintf(stderr, "WARNING: %u: setting align4 flag for a non-pointer variable %s\n",
+                            (unsigned int) lc, v->name().c_str());
+                }
             } else {
                 fprintf(stderr, "WARNING: %u: unknow flag %s\n", (unsigned int)lc, flag.c_str());
             }
@@ -31,6 +31,7 @@ public:
         m_pointerDir(POINTER_IN),
         m_nullAllowed(false),
         m_isLarge(false),
+        m_align4(false),
         m_packExpression(""),
         m_writeExpression(""),
         m_paramCheckExpression("")
@@ -50,6 +51,7 @@ public:
         m_pointerDir(dir),
         m_nullAllowed(false),
         m_isLarge(false),
+        m_align4(false),
         m_packExpression(packExpression),
         m_writeExpression(writeExpression),
 	m_paramCheckExpression("")
@@ -69,6 +71,7 @@ public:
         m_pointerDir = dir;
         m_nullAllowed = false;
         m_isLarge = false;
+        m_align4 = false;
 
     }
 
@@ -90,6 +93,8 @@ public:
     void setIsLarge(bool state) { m_isLarge = state; }
     bool nullAllowed() const { return m_nullAllowed; }
     bool isLarge() const { return m_isLarge; }
+    void setAlign4(bool state) { m_align4 = state; }
+    bool align4() const { return m_align4; }
     void printType(FILE *fp) { fprintf(fp, "%s", m_type->name().c_str()); }
     void printTypeName(FILE *fp) { printType(fp); fprintf(fp, " %s", m_name.c_str()); }
 
@@ -101,6 +106,7 @@ private:
     PointerDir m_pointerDir;
     bool m_nullAllowed;
     bool m_isLarge;
+    bool m_align4; // 4-byte alignment is enough for the decoder.
     std::string m_packExpression; // an expression to pack data into the stream
     std::string m_writeExpression; // an expression to write data into the stream
     std::string m_paramCheckExpression; //an expression to check parameter value
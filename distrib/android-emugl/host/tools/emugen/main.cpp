@@ -36,6 +36,7 @@ void usage(const char *filename)
     fprintf(stderr, "\t-i: input dir, local directory by default\n");
     fprintf(stderr, "\t-T : generate attribute template into the input directory\n\t\tno other files are generated\n");
     fprintf(stderr, "\t-W : generate wrapper into dir\n");
+    fprintf(stderr, "\t-g : use computed-goto dispatch in the generated decoder\n");
 }
 
 int main(int argc, char *argv[])
@@ -45,9 +46,10 @@ int main(int argc, char *argv[])
     std::string wrapperDir = "";
     std::string inDir = ".";
     bool generateAttributesTemplate = false;
+    bool threadedDecoder = false;
 
     int c;
-    while((c = getopt(argc, argv, "TE:D:i:hW:")) != -1) {
+    while((c = getopt(argc, argv, "TE:D:i:hW:g")) != -1) {
         switch(c) {
         case 'W':
             wrapperDir = std::string(optarg);
@@ -55,6 +57,9 @@ int main(int argc, char *argv[])
         case 'T':
             generateAttributesTemplate = true;
             break;
+        case 'g':
+            threadedDecoder = true;
+            break;
         case 'h':
             usage(argv[0]);
             exit(0);
@@ -92,6 +97,7 @@ int main(int argc, char *argv[])
 
     std::string baseName = std::string(argv[optind]);
     ApiGen apiEntries(baseName);
+    apiEntries.setThreadedDecoder(threadedDecoder);
 
     // init types;
     std::string typesFilename = inDir + "/" + baseName + TYPES_EXTENTION;
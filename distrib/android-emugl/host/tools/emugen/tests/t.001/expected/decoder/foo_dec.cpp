@@ -53,12 +53,11 @@ size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 		}
 		case OP_fooIsBuffer: {
 			uint32_t size_stuff __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
-			InputBuffer inptr_stuff(ptr + 8 + 4, size_stuff);
+			InputBuffer inptr_stuff(ptr + 8 + 4, size_stuff, 4);
 			size_t totalTmpSize = sizeof(FooBoolean);
 			unsigned char *tmpBuf = stream->alloc(totalTmpSize);
 			DEBUG("foo(%p): fooIsBuffer(%p(%u) )\n", stream,(void*)(inptr_stuff.get()), size_stuff);
 			*(FooBoolean *)(&tmpBuf[0]) = 			this->fooIsBuffer((void*)(inptr_stuff.get()));
-			stream->flush();
 			SET_LASTCALL("fooIsBuffer");
 			break;
 		}
@@ -13,6 +13,11 @@ struct foo_decoder_context_t : public foo_server_context_t {
 
 	size_t decode(void *buf, size_t bufsize, IOStream *stream);
 
+	// Return true if |opcode| is one of this protocol's opcodes.
+	static bool handlesOpcode(unsigned int opcode) {
+		return opcode - 200U < 5U;
+	}
+
 };
 
 #endif  // GUARD_foo_decoder_context_t
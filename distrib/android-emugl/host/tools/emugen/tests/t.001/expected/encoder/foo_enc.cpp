@@ -26,8 +26,8 @@ void fooAlphaFunc_enc(void *self , FooInt func, FooFloat ref)
 	 unsigned char *ptr;
 	 const size_t packetSize = 8 + 4 + 4;
 	ptr = stream->alloc(packetSize);
-	int tmp = OP_fooAlphaFunc;memcpy(ptr, &tmp, 4); ptr += 4;
-	memcpy(ptr, &packetSize, 4);  ptr += 4;
+	static const unsigned int __header[2] = { OP_fooAlphaFunc, (unsigned int)packetSize };
+	memcpy(ptr, __header, 8); ptr += 8;
 
 		memcpy(ptr, &func, 4); ptr += 4;
 		memcpy(ptr, &ref, 4); ptr += 4;
@@ -63,8 +63,8 @@ void fooDoEncoderFlush_enc(void *self , FooInt param)
 	 unsigned char *ptr;
 	 const size_t packetSize = 8 + 4;
 	ptr = stream->alloc(packetSize);
-	int tmp = OP_fooDoEncoderFlush;memcpy(ptr, &tmp, 4); ptr += 4;
-	memcpy(ptr, &packetSize, 4);  ptr += 4;
+	static const unsigned int __header[2] = { OP_fooDoEncoderFlush, (unsigned int)packetSize };
+	memcpy(ptr, __header, 8); ptr += 8;
 
 		memcpy(ptr, &param, 4); ptr += 4;
 	stream->flush();
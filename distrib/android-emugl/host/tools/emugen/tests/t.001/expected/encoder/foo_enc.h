@@ -15,6 +15,9 @@ struct foo_encoder_context_t : public foo_client_context_t {
 
 	IOStream *m_stream;
 
+	// Size of the IOStream buffer to create for this encoder.
+	enum { kStreamBufferSize = 1048576 };
+
 	foo_encoder_context_t(IOStream *stream);
 };
 
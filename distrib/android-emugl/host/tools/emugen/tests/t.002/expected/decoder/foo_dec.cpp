@@ -0,0 +1,118 @@
+// Generated Code - DO NOT EDIT !!
+// generated by 'emugen'
+
+
+#include <string.h>
+#include "foo_opcodes.h"
+
+#include "foo_dec.h"
+
+
+#include "ProtocolUtils.h"
+
+#include <stdio.h>
+
+typedef unsigned int tsize_t; // Target "size_t", which is 32-bit for now. It may or may not be the same as host's size_t when emugen is compiled.
+
+#ifdef DEBUG_PRINTOUT
+#  define DEBUG(...) fprintf(stderr, __VA_ARGS__)
+#else
+#  define DEBUG(...)  ((void)0)
+#endif
+
+#ifdef CHECK_GLERROR
+#  define SET_LASTCALL(name)  sprintf(lastCall, #name)
+#else
+#  define SET_LASTCALL(name)  ((void)0)
+#endif
+
+using namespace emugl;
+
+#define DECODE_NEXT_PACKET() \
+	do { \
+		if (len - pos < 8) return pos; \
+		opcode = *(uint32_t *)ptr; \
+		packetLen = *(uint32_t *)(ptr + 4); \
+		if (len - pos < packetLen || packetLen < 8) return pos; \
+		if (opcode - 200U >= 5U) return pos; \
+		goto *s_handlers[opcode - 200U]; \
+	} while (0)
+
+#define CHECK_LASTCALL_ERROR()  ((void)0)
+
+size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
+{
+	static void* const s_handlers[] = {
+		&&op_fooAlphaFunc,
+		&&op_fooIsBuffer,
+		&&op_fooUnsupported,
+		&&op_fooDoEncoderFlush,
+		&&op_fooTakeConstVoidPtrConstPtr,
+	};
+	size_t pos = 0;
+	unsigned char *ptr = (unsigned char *)buf;
+	uint32_t opcode;
+	size_t packetLen;
+#ifdef CHECK_GL_ERROR 
+	char lastCall[256] = {0}; 
+#endif 
+	DECODE_NEXT_PACKET();
+	{
+		op_fooAlphaFunc: {
+			FooInt var_func = Unpack<FooInt,uint32_t>(ptr + 8);
+			FooFloat var_ref = Unpack<FooFloat,uint32_t>(ptr + 8 + 4);
+			DEBUG("foo(%p): fooAlphaFunc(%d %f )\n", stream,var_func, var_ref);
+			this->fooAlphaFunc(var_func, var_ref);
+			SET_LASTCALL("fooAlphaFunc");
+		}
+		CHECK_LASTCALL_ERROR();
+		pos += packetLen;
+		ptr += packetLen;
+		DECODE_NEXT_PACKET();
+		op_fooIsBuffer: {
+			uint32_t size_stuff __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
+			InputBuffer inptr_stuff(ptr + 8 + 4, size_stuff);
+			size_t totalTmpSize = sizeof(FooBoolean);
+			unsigned char *tmpBuf = stream->alloc(totalTmpSize);
+			DEBUG("foo(%p): fooIsBuffer(%p(%u) )\n", stream,(void*)(inptr_stuff.get()), size_stuff);
+			*(FooBoolean *)(&tmpBuf[0]) = 			this->fooIsBuffer((void*)(inptr_stuff.get()));
+			SET_LASTCALL("fooIsBuffer");
+		}
+		CHECK_LASTCALL_ERROR();
+		pos += packetLen;
+		ptr += packetLen;
+		DECODE_NEXT_PACKET();
+		op_fooUnsupported: {
+			uint32_t size_params __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
+			InputBuffer inptr_params(ptr + 8 + 4, size_params);
+			DEBUG("foo(%p): fooUnsupported(%p(%u) )\n", stream,(void*)(inptr_params.get()), size_params);
+			this->fooUnsupported((void*)(inptr_params.get()));
+			SET_LASTCALL("fooUnsupported");
+		}
+		CHECK_LASTCALL_ERROR();
+		pos += packetLen;
+		ptr += packetLen;
+		DECODE_NEXT_PACKET();
+		op_fooDoEncoderFlush: {
+			FooInt var_param = Unpack<FooInt,uint32_t>(ptr + 8);
+			DEBUG("foo(%p): fooDoEncoderFlush(%d )\n", stream,var_param);
+			this->fooDoEncoderFlush(var_param);
+			SET_LASTCALL("fooDoEncoderFlush");
+		}
+		CHECK_LASTCALL_ERROR();
+		pos += packetLen;
+		ptr += packetLen;
+		DECODE_NEXT_PACKET();
+		op_fooTakeConstVoidPtrConstPtr: {
+			uint32_t size_param __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
+			InputBuffer inptr_param(ptr + 8 + 4, size_param);
+			DEBUG("foo(%p): fooTakeConstVoidPtrConstPtr(%p(%u) )\n", stream,(const void* const*)(inptr_param.get()), size_param);
+			this->fooTakeConstVoidPtrConstPtr((const void* const*)(inptr_param.get()));
+			SET_LASTCALL("fooTakeConstVoidPtrConstPtr");
+		}
+		CHECK_LASTCALL_ERROR();
+		pos += packetLen;
+		ptr += packetLen;
+		DECODE_NEXT_PACKET();
+	}
+}
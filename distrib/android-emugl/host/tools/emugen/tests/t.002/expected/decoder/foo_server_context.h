@@ -0,0 +1,15 @@
+// Generated Code - DO NOT EDIT !!
+// generated by 'emugen'
+#ifndef __foo_server_context_t_h
+#define __foo_server_context_t_h
+
+#include "foo_server_base.h"
+
+
+struct foo_server_context_t : foo_server_base_t {
+
+	 virtual ~foo_server_context_t() {}
+	int initDispatchByName( void *(*getProc)(const char *name, void *userData), void *userData);
+};
+
+#endif
@@ -7,6 +7,7 @@ commonSources := \
         GLClientState.cpp \
         GLSharedGroup.cpp \
         glUtils.cpp \
+        RingStream.cpp \
         SocketStream.cpp \
         TcpStream.cpp \
         TimeUtils.cpp
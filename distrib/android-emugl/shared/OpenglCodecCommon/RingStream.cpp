@@ -0,0 +1,335 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "RingStream.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// Bit flags for RingChannel::mClosed
+enum {
+    GUEST_CLOSED = (1 << 0),
+    HOST_CLOSED = (1 << 1)
+};
+
+inline void memoryBarrier() {
+#ifdef _WIN32
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+}
+
+inline int atomicAdd(volatile int* ptr, int delta) {
+#ifdef _WIN32
+    return (int)InterlockedExchangeAdd((volatile LONG*)ptr, delta) + delta;
+#else
+    return __sync_add_and_fetch(ptr, delta);
+#endif
+}
+
+inline void atomicOr(volatile unsigned* ptr, unsigned flags) {
+#ifdef _WIN32
+    InterlockedOr((volatile LONG*)ptr, (LONG)flags);
+#else
+    __sync_fetch_and_or(ptr, flags);
+#endif
+}
+
+inline void atomicAnd(volatile unsigned* ptr, unsigned flags) {
+#ifdef _WIN32
+    InterlockedAnd((volatile LONG*)ptr, (LONG)flags);
+#else
+    __sync_fetch_and_and(ptr, flags);
+#endif
+}
+
+}  // namespace
+
+RingChannel::RingChannel(size_t ringSize,
+                         WakeFunc onWake,
+                         void* onWakeContext) :
+        mToHost(ringSize),
+        mToGuest(ringSize),
+        mLock(),
+        mHostCond(),
+        mHostWaiting(0),
+        mGuestWanted(0),
+        mClosed(0),
+        mRefCount(1),
+        mOnWake(onWake),
+        mOnWakeContext(onWakeContext),
+        mHostSpin(),
+        mGuestSpin(),
+        mGuestSpinFlags(0),
+        mGuestSpinPending(false) {}
+
+RingChannel::~RingChannel() {}
+
+void RingChannel::acquire() {
+    atomicAdd(&mRefCount, 1);
+}
+
+void RingChannel::release() {
+    if (atomicAdd(&mRefCount, -1) == 0) {
+        delete this;
+    }
+}
+
+int RingChannel::guestWrite(const void* data, size_t size) {
+    if (mClosed) {
+        return -1;
+    }
+    size_t count = mToHost.write(data, size);
+    if (count > 0) {
+        signalHost();
+        if (mGuestSpinPending && (mGuestSpinFlags & CAN_WRITE)) {
+            mGuestSpinPending = false;
+            mGuestSpin.woken();
+        }
+    }
+    return (int)count;
+}
+
+int RingChannel::guestRead(void* data, size_t size) {
+    size_t count = mToGuest.read(data, size);
+    if (count > 0) {
+        // The host may be blocked waiting for room in the ring.
+        signalHost();
+        if (mGuestSpinPending && (mGuestSpinFlags & CAN_READ)) {
+            mGuestSpinPending = false;
+            mGuestSpin.woken();
+        }
+        return (int)count;
+    }
+    return (mClosed & HOST_CLOSED) ? -1 : 0;
+}
+
+unsigned RingChannel::guestPoll() {
+    unsigned flags = 0;
+    if (mToGuest.readAvail() > 0) {
+        flags |= CAN_READ;
+    }
+    if (mToHost.writeAvail() > 0) {
+        flags |= CAN_WRITE;
+    }
+    if (mClosed & HOST_CLOSED) {
+        flags |= CLOSED;
+    }
+    return flags;
+}
+
+unsigned RingChannel::guestSpin(unsigned flags) {
+    mGuestSpinFlags = flags;
+    // A failed spin is timed until the guest transfers data, after its
+    // wake-up.
+    mGuestSpinPending = !mGuestSpin.spin(guestCanProceed, this);
+    return guestPoll();
+}
+
+void RingChannel::guestWakeOn(unsigned flags) {
+    atomicOr(&mGuestWanted, flags);
+    // Check the current state after publishing |mGuestWanted| to avoid
+    // missing a change that happened before the host could see the flags.
+    signalGuest(guestPoll());
+}
+
+void RingChannel::guestClose() {
+    mLock.lock();
+    mOnWake = NULL;
+    mOnWakeContext = NULL;
+    mLock.unlock();
+
+    atomicOr(&mClosed, GUEST_CLOSED);
+    mLock.lock();
+    mHostCond.signal();
+    mLock.unlock();
+
+    release();
+}
+
+size_t RingChannel::hostRead(void* data, size_t size) {
+    for (;;) {
+        size_t count = mToHost.read(data, size);
+        if (count > 0) {
+            signalGuest(CAN_WRITE);
+            return count;
+        }
+        if (mClosed) {
+            return 0;
+        }
+        if (mHostSpin.spin(hostCanRead, this)) {
+            continue;
+        }
+        mLock.lock();
+        mHostWaiting = 1;
+        memoryBarrier();
+        while (mToHost.readAvail() == 0 && !mClosed) {
+            mHostCond.wait(&mLock);
+        }
+        mHostWaiting = 0;
+        mLock.unlock();
+        mHostSpin.woken();
+    }
+}
+
+bool RingChannel::hostWrite(const void* data, size_t size) {
+    const char* src = static_cast<const char*>(data);
+    while (size > 0) {
+        if (mClosed) {
+            return false;
+        }
+        size_t count = mToGuest.write(src, size);
+        if (count > 0) {
+            src += count;
+            size -= count;
+            signalGuest(CAN_READ);
+            continue;
+        }
+        mLock.lock();
+        mHostWaiting = 1;
+        memoryBarrier();
+        while (mToGuest.writeAvail() == 0 && !mClosed) {
+            mHostCond.wait(&mLock);
+        }
+        mHostWaiting = 0;
+        mLock.unlock();
+    }
+    return true;
+}
+
+void RingChannel::stopHost() {
+    atomicOr(&mClosed, HOST_CLOSED);
+    mLock.lock();
+    mHostCond.signal();
+    mLock.unlock();
+    signalGuest(CAN_READ | CAN_WRITE | CLOSED);
+}
+
+void RingChannel::signalHost() {
+    memoryBarrier();
+    if (mHostWaiting) {
+        mLock.lock();
+        mHostCond.signal();
+        mLock.unlock();
+    }
+}
+
+void RingChannel::signalGuest(unsigned flags) {
+    memoryBarrier();
+    if ((mGuestWanted & flags) == 0) {
+        return;
+    }
+    mLock.lock();
+    unsigned wanted = mGuestWanted & flags;
+    if (wanted) {
+        atomicAnd(&mGuestWanted, ~wanted);
+        if (mOnWake) {
+            mOnWake(mOnWakeContext);
+        }
+    }
+    mLock.unlock();
+}
+
+bool RingChannel::hostCanRead(void* opaque) {
+    RingChannel* channel = static_cast<RingChannel*>(opaque);
+    return channel->mToHost.readAvail() > 0 || channel->mClosed;
+}
+
+bool RingChannel::guestCanProceed(void* opaque) {
+    RingChannel* channel = static_cast<RingChannel*>(opaque);
+    return (channel->guestPoll() & (channel->mGuestSpinFlags | CLOSED)) != 0;
+}
+
+RingStream::RingStream(RingChannel* channel, size_t bufSize) :
+        IOStream(bufSize),
+        m_channel(channel),
+        m_bufsize(bufSize),
+        m_buf(NULL) {
+    m_channel->acquire();
+}
+
+RingStream::~RingStream() {
+    m_channel->stopHost();
+    m_channel->release();
+    free(m_buf);
+}
+
+void *RingStream::allocBuffer(size_t minSize) {
+    size_t allocSize = (m_bufsize < minSize ? minSize : m_bufsize);
+    if (!m_buf) {
+        m_buf = (unsigned char *)malloc(allocSize);
+    }
+    else if (m_bufsize < allocSize) {
+        unsigned char *p = (unsigned char *)realloc(m_buf, allocSize);
+        if (p != NULL) {
+            m_buf = p;
+            m_bufsize = allocSize;
+        } else {
+            ERR("%s: realloc (%zu) failed\n", __FUNCTION__, allocSize);
+            free(m_buf);
+            m_buf = NULL;
+            m_bufsize = 0;
+        }
+    }
+
+    return m_buf;
+}
+
+int RingStream::commitBuffer(size_t size) {
+    return writeFully(m_buf, size);
+}
+
+const unsigned char *RingStream::readFully(void *buf, size_t len) {
+    if (!buf) {
+        return NULL;  // do not allow NULL buf in that implementation
+    }
+    size_t res = 0;
+    while (res < len) {
+        size_t count = m_channel->hostRead((char *)buf + res, len - res);
+        if (count == 0) {
+            return NULL;
+        }
+        res += count;
+    }
+    return (const unsigned char *)buf;
+}
+
+const unsigned char *RingStream::read(void *buf, size_t *inout_len) {
+    if (!buf) {
+        return NULL;  // do not allow NULL buf in that implementation
+    }
+    size_t count = m_channel->hostRead(buf, *inout_len);
+    if (count == 0) {
+        return NULL;
+    }
+    *inout_len = count;
+    return (const unsigned char *)buf;
+}
+
+int RingStream::writeFully(const void *buf, size_t len) {
+    return m_channel->hostWrite(buf, len) ? 0 : -1;
+}
+
+void RingStream::forceStop() {
+    m_channel->stopHost();
+}
@@ -0,0 +1,157 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef __RING_STREAM_H
+#define __RING_STREAM_H
+
+#include "IOStream.h"
+
+#include "emugl/common/condition_variable.h"
+#include "emugl/common/mutex.h"
+#include "emugl/common/ring_buffer.h"
+#include "emugl/common/spin_wait.h"
+
+#include <stddef.h>
+
+// A RingChannel models an in-process, bi-directional byte stream between
+// the emulator's opengles pipe (the 'guest' end) and a RenderThread (the
+// 'host' end). Data is transferred through two lock-free single-producer
+// single-consumer ring buffers, so no syscall or kernel copy is needed.
+//
+// The guest end is never blocking: its methods return 0 when no data can
+// be transferred, and the caller should use guestWakeOn() to be notified
+// through the |onWake| callback when this changes. This callback can be
+// called from any thread, and must not call any RingChannel method.
+//
+// The host end is blocking, and is normally used through a RingStream.
+// It polls the ring for a short, self-tuned interval before blocking, see
+// emugl::SpinWait, so that a guest command sent right after the previous
+// one doesn't need a wake-up.
+//
+// Instances are reference-counted because each end can be closed
+// independently. The constructor returns an instance with a single
+// reference, and RingStream takes another one.
+class RingChannel {
+public:
+    typedef void (*WakeFunc)(void* context);
+
+    // Flags used by guestPoll() and guestWakeOn().
+    enum {
+        CAN_READ = (1 << 0),
+        CAN_WRITE = (1 << 1),
+        CLOSED = (1 << 2)
+    };
+
+    // Constructor. |ringSize| is the size in bytes of each ring buffer.
+    // |onWake| and |onWakeContext| are used to signal the guest end.
+    RingChannel(size_t ringSize, WakeFunc onWake, void* onWakeContext);
+
+    void acquire();
+    void release();
+
+    // Guest end: send up to |size| bytes from |data| to the host. Returns
+    // the number of bytes sent, 0 if the ring is full, or -1 if the host
+    // end was closed.
+    int guestWrite(const void* data, size_t size);
+
+    // Guest end: receive up to |size| bytes into |data|. Returns the
+    // number of bytes received, 0 if there is nothing to read, or -1 if
+    // the host end was closed.
+    int guestRead(void* data, size_t size);
+
+    // Guest end: return the current CAN_READ/CAN_WRITE/CLOSED state.
+    unsigned guestPoll();
+
+    // Guest end: poll the channel for a short, self-tuned interval until
+    // one of the conditions in |flags| or CLOSED becomes true, and return
+    // the current state like guestPoll(). This lets the caller get the
+    // answer of a round trip without waiting for |onWake|.
+    unsigned guestSpin(unsigned flags);
+
+    // Guest end: ask for the |onWake| callback to be called once any of
+    // the conditions in |flags| becomes true. If one of them is already
+    // true, the callback is invoked immediately.
+    void guestWakeOn(unsigned flags);
+
+    // Guest end: close the channel. The |onWake| callback will not be
+    // called anymore, and the host end will get an end-of-stream. This
+    // also releases the caller's reference.
+    void guestClose();
+
+    // Host end: block until at least one byte is available, then receive
+    // up to |size| bytes into |data|. Returns the number of bytes received,
+    // or 0 if the guest end was closed or stopHost() was called.
+    size_t hostRead(void* data, size_t size);
+
+    // Host end: send |size| bytes from |data| to the guest, blocking until
+    // there is room for all of them. Returns false if the guest end was
+    // closed or stopHost() was called.
+    bool hostWrite(const void* data, size_t size);
+
+    // Host end: force hostRead() and hostWrite() to return immediately.
+    // The guest end will see the channel as closed.
+    void stopHost();
+
+private:
+    ~RingChannel();
+
+    // Wake the host end if it is blocked.
+    void signalHost();
+
+    // Call |mOnWake| if the guest-wanted conditions in |flags| are met.
+    void signalGuest(unsigned flags);
+
+    // SpinWait conditions.
+    static bool hostCanRead(void* opaque);
+    static bool guestCanProceed(void* opaque);
+
+    emugl::RingBuffer mToHost;
+    emugl::RingBuffer mToGuest;
+    emugl::Mutex mLock;
+    emugl::ConditionVariable mHostCond;
+    volatile int mHostWaiting;
+    volatile unsigned mGuestWanted;
+    volatile unsigned mClosed;
+    volatile int mRefCount;
+    WakeFunc mOnWake;
+    void* mOnWakeContext;
+    emugl::SpinWait mHostSpin;
+    emugl::SpinWait mGuestSpin;
+    unsigned mGuestSpinFlags;
+    bool mGuestSpinPending;
+};
+
+// An IOStream implementation used by a RenderThread to read and write
+// to the host end of a RingChannel.
+class RingStream : public IOStream {
+public:
+    // Constructor. Takes a new reference to |channel|.
+    explicit RingStream(RingChannel* channel, size_t bufSize = 10000);
+    virtual ~RingStream();
+
+    virtual void *allocBuffer(size_t minSize);
+    virtual int commitBuffer(size_t size);
+    virtual const unsigned char *readFully(void *buf, size_t len);
+    virtual const unsigned char *read(void *buf, size_t *inout_len);
+    virtual int writeFully(const void *buf, size_t len);
+    virtual void forceStop();
+
+private:
+    RingChannel* m_channel;
+    size_t m_bufsize;
+    unsigned char* m_buf;
+};
+
+#endif  // __RING_STREAM_H
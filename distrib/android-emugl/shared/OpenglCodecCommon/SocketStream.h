@@ -42,6 +42,10 @@ public:
 
     virtual void forceStop();
 
+    // Return the id of the process at the other end of the connection of
+    // an accepted stream, or 0 if it is unknown.
+    virtual unsigned int getPeerPid() { return 0; }
+
 protected:
     int            m_sock;
     size_t         m_bufsize;
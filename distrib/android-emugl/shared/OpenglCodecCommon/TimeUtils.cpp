@@ -59,6 +59,34 @@ long long GetCurrentTimeMS()
 #endif
 }
 
+long long GetCurrentTimeUS()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    static bool bNotInit = true;
+    if ( bNotInit ) {
+        bNotInit = (QueryPerformanceFrequency( &freq ) == FALSE);
+    }
+    LARGE_INTEGER currVal;
+    QueryPerformanceCounter( &currVal );
+
+    return (long long)(currVal.QuadPart / (freq.QuadPart / 1000000.0));
+
+#elif defined(__linux__)
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000000LL) + now.tv_nsec/1000LL;
+
+#else /* Others, e.g. OS X */
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec * 1000000LL) + now.tv_usec;
+
+#endif
+}
+
 void TimeSleepMS(int p_mili)
 {
 #ifdef _WIN32
@@ -17,6 +17,8 @@
 #define _TIME_UTILS_H
 
 long long GetCurrentTimeMS();
+// Same as GetCurrentTimeMS(), with microsecond resolution.
+long long GetCurrentTimeUS();
 void TimeSleepMS(int p_mili);
 
 #endif
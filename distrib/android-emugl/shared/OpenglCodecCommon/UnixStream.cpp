@@ -27,6 +27,7 @@
 #include <netinet/tcp.h>
 #include <sys/un.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
 
 /* Not all systems define PATH_MAX, those who don't generally don't
  * have a limit on the maximum path size, so use a value that is
@@ -159,3 +160,21 @@ int UnixStream::connect(const char* addr)
 
     return 0;
 }
+
+unsigned int UnixStream::getPeerPid()
+{
+#if defined(SO_PEERCRED)
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (::getsockopt(m_sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0) {
+        return (unsigned int)cred.pid;
+    }
+#elif defined(LOCAL_PEERPID)
+    pid_t pid;
+    socklen_t len = sizeof(pid);
+    if (::getsockopt(m_sock, SOL_LOCAL, LOCAL_PEERPID, &pid, &len) == 0) {
+        return (unsigned int)pid;
+    }
+#endif
+    return 0;
+}
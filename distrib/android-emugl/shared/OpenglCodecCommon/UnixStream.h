@@ -25,6 +25,7 @@ public:
     virtual int listen(char addrstr[MAX_ADDRSTR_LEN]);
     virtual SocketStream *accept();
     virtual int connect(const char* addr);
+    virtual unsigned int getPeerPid();
 private:
     char *bound_socket_path;
     UnixStream(int sock, size_t bufSize);
@@ -6,14 +6,21 @@ LOCAL_PATH := $(call my-dir)
 ### emugl_common host library ###########################################
 
 commonSources := \
+        arena.cpp \
+        hash_map.cpp \
         id_to_object_map.cpp \
         lazy_instance.cpp \
         message_channel.cpp \
+        metrics.cpp \
+        pixel_rle.cpp \
         pod_vector.cpp \
+        ring_buffer.cpp \
         shared_library.cpp \
         smart_ptr.cpp \
         sockets.cpp \
+        spin_wait.cpp \
         thread_store.cpp \
+        trace.cpp \
 
 host_commonSources := $(commonSources)
 
@@ -47,14 +54,19 @@ $(call emugl-end-module)
 ### emugl_common_unittests ##############################################
 
 host_commonSources := \
+    arena_unittest.cpp \
     condition_variable_unittest.cpp \
+    hash_map_unittest.cpp \
     id_to_object_map_unittest.cpp \
     lazy_instance_unittest.cpp \
+    pixel_rle_unittest.cpp \
     pod_vector_unittest.cpp \
     message_channel_unittest.cpp \
     mutex_unittest.cpp \
+    ring_buffer_unittest.cpp \
     shared_library_unittest.cpp \
     smart_ptr_unittest.cpp \
+    spin_wait_unittest.cpp \
     thread_store_unittest.cpp \
     thread_unittest.cpp \
     unique_integer_map_unittest.cpp \
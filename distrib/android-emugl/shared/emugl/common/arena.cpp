@@ -0,0 +1,137 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/arena.h"
+
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/thread_store.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace emugl {
+
+// Chunk header, the chunk's memory follows it, at an offset rounded up to
+// kAlignment so the data is aligned too.
+struct Arena::Chunk {
+    Chunk* next;
+    size_t size;
+
+    static const size_t kHeaderSize =
+            (sizeof(Chunk*) + sizeof(size_t) + kAlignment - 1) &
+            ~(kAlignment - 1);
+
+    char* data() { return reinterpret_cast<char*>(this) + kHeaderSize; }
+};
+
+Arena::Arena(size_t chunkSize) :
+        mFirst(NULL),
+        mLast(NULL),
+        mCurrent(NULL),
+        mPos(0U),
+        mChunkSize(chunkSize),
+        mChunkAllocationCount(0U) {}
+
+Arena::~Arena() {
+    Chunk* chunk = mFirst;
+    while (chunk) {
+        Chunk* next = chunk->next;
+        ::free(chunk);
+        chunk = next;
+    }
+}
+
+void* Arena::alloc(size_t size) {
+    size = (size + kAlignment - 1) & ~(kAlignment - 1);
+    if (!mCurrent || mCurrent->size - mPos < size) {
+        // Use the next free chunk large enough, or append a new one.
+        Chunk* chunk = mCurrent ? mCurrent->next : mFirst;
+        while (chunk && chunk->size < size) {
+            chunk = chunk->next;
+        }
+        if (!chunk) {
+            size_t chunkSize = (size > mChunkSize) ? size : mChunkSize;
+            chunk = static_cast<Chunk*>(
+                    ::malloc(Chunk::kHeaderSize + chunkSize));
+            if (!chunk) {
+                fprintf(stderr, "Out of memory allocating arena chunk of "
+                        "%lu bytes\n", (unsigned long)chunkSize);
+                abort();
+            }
+            chunk->next = NULL;
+            chunk->size = chunkSize;
+            if (mLast) {
+                mLast->next = chunk;
+            } else {
+                mFirst = chunk;
+            }
+            mLast = chunk;
+            mChunkAllocationCount++;
+        }
+        mCurrent = chunk;
+        mPos = 0U;
+    }
+    void* result = mCurrent->data() + mPos;
+    mPos += size;
+    return result;
+}
+
+void Arena::reset() {
+    mCurrent = NULL;
+    mPos = 0U;
+}
+
+namespace {
+
+#ifdef EMUGL_THREAD_LOCAL
+// Cache of the value of |sThreadArenas|.
+EMUGL_THREAD_LOCAL Arena* sThreadArena = NULL;
+#endif
+
+class ArenaStore : public ThreadStore {
+public:
+    ArenaStore() : ThreadStore(&destructor) {}
+private:
+    static void destructor(void* value) {
+        delete static_cast<Arena*>(value);
+#ifdef EMUGL_THREAD_LOCAL
+        sThreadArena = NULL;
+#endif
+    }
+};
+
+LazyInstance<ArenaStore> sThreadArenas = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+// static
+Arena* Arena::getThreadLocal() {
+#ifdef EMUGL_THREAD_LOCAL
+    if (sThreadArena) {
+        return sThreadArena;
+    }
+#endif
+    ArenaStore* store = sThreadArenas.ptr();
+    Arena* arena = static_cast<Arena*>(store->get());
+    if (!arena) {
+        arena = new Arena();
+        store->set(arena);
+    }
+#ifdef EMUGL_THREAD_LOCAL
+    sThreadArena = arena;
+#endif
+    return arena;
+}
+
+}  // namespace emugl
@@ -0,0 +1,167 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/arena.h"
+
+#include "emugl/common/thread.h"
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace emugl {
+
+TEST(Arena, Alloc) {
+    Arena arena;
+    EXPECT_EQ(0U, arena.getChunkAllocationCount());
+
+    char* prev = NULL;
+    for (size_t n = 1; n < 100; ++n) {
+        char* block = static_cast<char*>(arena.alloc(n));
+        ASSERT_TRUE(block);
+        EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(block) % Arena::kAlignment);
+        memset(block, (int)n, n);
+        if (prev) {
+            EXPECT_NE(prev, block);
+            // Previous block must not have been overwritten.
+            EXPECT_EQ((char)(n - 1), prev[n - 2]);
+        }
+        prev = block;
+    }
+    EXPECT_EQ(1U, arena.getChunkAllocationCount());
+}
+
+TEST(Arena, ResetReusesChunks) {
+    Arena arena(1024);
+    for (int n = 0; n < 100; ++n) {
+        arena.alloc(100);
+    }
+    size_t count = arena.getChunkAllocationCount();
+    EXPECT_LT(1U, count);
+
+    for (int loop = 0; loop < 10; ++loop) {
+        arena.reset();
+        for (int n = 0; n < 100; ++n) {
+            arena.alloc(100);
+        }
+        EXPECT_EQ(count, arena.getChunkAllocationCount());
+    }
+}
+
+TEST(Arena, LargeAlloc) {
+    Arena arena(1024);
+    char* block = static_cast<char*>(arena.alloc(100000));
+    ASSERT_TRUE(block);
+    memset(block, 0x55, 100000);
+    EXPECT_EQ(1U, arena.getChunkAllocationCount());
+
+    // The large chunk is reused after a reset, even for small blocks.
+    arena.reset();
+    EXPECT_EQ(block, arena.alloc(10));
+    EXPECT_EQ(1U, arena.getChunkAllocationCount());
+}
+
+TEST(Arena, AllocArray) {
+    Arena arena;
+    double* values = arena.allocArray<double>(16);
+    EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(values) % sizeof(double));
+    for (int n = 0; n < 16; ++n) {
+        values[n] = n * 0.5;
+    }
+    int* other = arena.allocArray<int>(4);
+    EXPECT_LE(reinterpret_cast<char*>(values + 16),
+              reinterpret_cast<char*>(other));
+    EXPECT_EQ(7.5, values[15]);
+}
+
+TEST(Arena, Frame) {
+    Arena arena;
+    void* first;
+    {
+        Arena::Frame frame(&arena);
+        EXPECT_EQ(&arena, frame.arena());
+        first = arena.alloc(10);
+        void* nested;
+        {
+            Arena::Frame nestedFrame(&arena);
+            nested = arena.alloc(10);
+            EXPECT_NE(first, nested);
+        }
+        // Memory of the nested frame is reused.
+        EXPECT_EQ(nested, arena.alloc(10));
+    }
+    EXPECT_EQ(first, arena.alloc(10));
+    EXPECT_EQ(1U, arena.getChunkAllocationCount());
+}
+
+TEST(Arena, FrameAcrossChunks) {
+    Arena arena(256);
+    char* first = static_cast<char*>(arena.alloc(200));
+    {
+        Arena::Frame frame(&arena);
+        for (int n = 0; n < 20; ++n) {
+            arena.alloc(100);
+        }
+    }
+    size_t count = arena.getChunkAllocationCount();
+    EXPECT_LT(1U, count);
+
+    // Allocation resumes in the first chunk, just after the first block.
+    EXPECT_EQ(first + 200, arena.alloc(16));
+
+    // And the following chunks are reused.
+    {
+        Arena::Frame frame(&arena);
+        for (int n = 0; n < 20; ++n) {
+            arena.alloc(100);
+        }
+    }
+    EXPECT_EQ(count, arena.getChunkAllocationCount());
+}
+
+namespace {
+
+class ArenaThread : public Thread {
+public:
+    ArenaThread() : mArena(NULL) {}
+
+    virtual intptr_t main() {
+        mArena = Arena::getThreadLocal();
+        mArena->alloc(10);
+        return (mArena == Arena::getThreadLocal()) ? 1 : 0;
+    }
+
+    Arena* arena() const { return mArena; }
+
+private:
+    Arena* mArena;
+};
+
+}  // namespace
+
+TEST(Arena, ThreadLocal) {
+    Arena* arena = Arena::getThreadLocal();
+    ASSERT_TRUE(arena);
+    EXPECT_EQ(arena, Arena::getThreadLocal());
+
+    ArenaThread thread;
+    ASSERT_TRUE(thread.start());
+    intptr_t result = 0;
+    ASSERT_TRUE(thread.wait(&result));
+    EXPECT_EQ(1, result);
+    EXPECT_NE(arena, thread.arena());
+}
+
+}  // namespace emugl
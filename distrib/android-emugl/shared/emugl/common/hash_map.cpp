@@ -0,0 +1,114 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/hash_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace emugl {
+
+HashMapBase::HashMapBase() : mSlots(NULL), mShift(kMinShift) {}
+
+HashMapBase::~HashMapBase() {
+    clearSlots();
+}
+
+void HashMapBase::clearSlots() {
+    ::free(mSlots);
+    mSlots = NULL;
+    mShift = kMinShift;
+}
+
+void HashMapBase::placeSlot(Slot slot) {
+    size_t mask = capacity() - 1U;
+    size_t pos = slotIndex(slot.hash);
+    size_t dist = 0;
+    for (;;) {
+        Slot& current = mSlots[pos];
+        if (current.entry == kEmptyEntry) {
+            current = slot;
+            return;
+        }
+        // Robin Hood: take the place of entries closer to their ideal
+        // position, then continue with the displaced one.
+        size_t currentDist = probeDistance(current.hash, pos);
+        if (currentDist < dist) {
+            Slot tmp = current;
+            current = slot;
+            slot = tmp;
+            dist = currentDist;
+        }
+        pos = (pos + 1U) & mask;
+        dist++;
+    }
+}
+
+void HashMapBase::insertSlot(uint32_t hash, uint32_t entry, size_t count) {
+    size_t oldCapacity = capacity();
+    // Keep the index at most 75% full.
+    if (count * 4U > oldCapacity * 3U) {
+        // Grow the index, and place the existing slots again.
+        Slot* oldSlots = mSlots;
+        size_t newShift = oldSlots ? mShift + 1U : mShift;
+        size_t newCapacity = 1U << newShift;
+        mSlots = static_cast<Slot*>(::malloc(newCapacity * sizeof(Slot)));
+        if (newShift >= 32U || !mSlots) {
+            fprintf(stderr, "Out of memory growing hash map to %lu slots\n",
+                    (unsigned long)newCapacity);
+            abort();
+        }
+        mShift = newShift;
+        for (size_t n = 0; n < newCapacity; ++n) {
+            mSlots[n].entry = kEmptyEntry;
+        }
+        for (size_t n = 0; n < oldCapacity; ++n) {
+            if (oldSlots[n].entry != kEmptyEntry) {
+                placeSlot(oldSlots[n]);
+            }
+        }
+        ::free(oldSlots);
+    }
+    Slot slot;
+    slot.hash = hash;
+    slot.entry = entry;
+    placeSlot(slot);
+}
+
+void HashMapBase::removeSlot(size_t pos) {
+    // Shift the following slots back until one is empty or at its ideal
+    // position, so that no tombstones are needed.
+    size_t mask = capacity() - 1U;
+    for (;;) {
+        size_t next = (pos + 1U) & mask;
+        const Slot& slot = mSlots[next];
+        if (slot.entry == kEmptyEntry || probeDistance(slot.hash, next) == 0) {
+            mSlots[pos].entry = kEmptyEntry;
+            return;
+        }
+        mSlots[pos] = slot;
+        pos = next;
+    }
+}
+
+size_t HashMapBase::findEntrySlot(uint32_t hash, uint32_t entry) const {
+    size_t mask = capacity() - 1U;
+    size_t pos = slotIndex(hash);
+    while (mSlots[pos].entry != entry) {
+        pos = (pos + 1U) & mask;
+    }
+    return pos;
+}
+
+}  // namespace emugl
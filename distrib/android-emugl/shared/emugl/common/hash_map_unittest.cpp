@@ -0,0 +1,203 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/hash_map.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+
+namespace emugl {
+
+TEST(HashMap, Empty) {
+    HashMap<int, int> map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(0U, map.size());
+    EXPECT_FALSE(map.contains(0));
+    EXPECT_FALSE(map.find(0));
+    EXPECT_FALSE(map.erase(0));
+
+    HashMap<int, int>::Iterator iter(&map);
+    EXPECT_FALSE(iter.hasNext());
+}
+
+TEST(HashMap, SetFindErase) {
+    HashMap<int, int> map;
+    EXPECT_TRUE(map.set(1, 10));
+    EXPECT_TRUE(map.set(2, 20));
+    EXPECT_FALSE(map.set(1, 11));
+    EXPECT_EQ(2U, map.size());
+
+    ASSERT_TRUE(map.find(1));
+    EXPECT_EQ(11, *map.find(1));
+    ASSERT_TRUE(map.find(2));
+    EXPECT_EQ(20, *map.find(2));
+    EXPECT_FALSE(map.find(3));
+
+    *map.find(2) = 21;
+    const HashMap<int, int>& constMap = map;
+    EXPECT_EQ(21, *constMap.find(2));
+
+    EXPECT_TRUE(map.erase(1));
+    EXPECT_FALSE(map.erase(1));
+    EXPECT_FALSE(map.contains(1));
+    EXPECT_TRUE(map.contains(2));
+    EXPECT_EQ(1U, map.size());
+
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_FALSE(map.contains(2));
+    EXPECT_TRUE(map.set(2, 22));
+    EXPECT_EQ(22, *map.find(2));
+}
+
+TEST(HashMap, CompareWithStdMap) {
+    HashMap<unsigned, unsigned> map;
+    std::map<unsigned, unsigned> expected;
+
+    // Pseudo-random sequence of insertions and removals.
+    unsigned seed = 1;
+    for (int n = 0; n < 20000; ++n) {
+        seed = seed * 1103515245U + 12345U;
+        unsigned key = (seed >> 16) % 2000U;
+        if (seed & 0x100) {
+            bool added = map.set(key, n);
+            EXPECT_EQ(expected.find(key) == expected.end(), added);
+            expected[key] = n;
+        } else {
+            EXPECT_EQ(expected.erase(key) == 1U, map.erase(key));
+        }
+        ASSERT_EQ(expected.size(), map.size());
+    }
+
+    for (unsigned key = 0; key < 2000U; ++key) {
+        std::map<unsigned, unsigned>::iterator it = expected.find(key);
+        const unsigned* value = map.find(key);
+        if (it == expected.end()) {
+            EXPECT_FALSE(value) << "key " << key;
+        } else {
+            ASSERT_TRUE(value) << "key " << key;
+            EXPECT_EQ(it->second, *value);
+        }
+    }
+}
+
+TEST(HashMap, SequentialKeys) {
+    HashMap<unsigned, unsigned> map;
+    const unsigned kCount = 10000;
+    for (unsigned n = 1; n <= kCount; ++n) {
+        EXPECT_TRUE(map.set(n, n * 2));
+    }
+    EXPECT_EQ(kCount, map.size());
+    for (unsigned n = 1; n <= kCount; ++n) {
+        ASSERT_TRUE(map.find(n));
+        EXPECT_EQ(n * 2, *map.find(n));
+    }
+    EXPECT_FALSE(map.find(0));
+    EXPECT_FALSE(map.find(kCount + 1));
+}
+
+TEST(HashMap, Iterator) {
+    HashMap<int, int> map;
+    const int kCount = 100;
+    for (int n = 0; n < kCount; ++n) {
+        map.set(n, n + 1000);
+    }
+
+    bool seen[kCount] = {};
+    HashMap<int, int>::Iterator iter(&map);
+    while (iter.hasNext()) {
+        iter.next();
+        ASSERT_LE(0, iter.key());
+        ASSERT_GT(kCount, iter.key());
+        EXPECT_FALSE(seen[iter.key()]);
+        seen[iter.key()] = true;
+        EXPECT_EQ(iter.key() + 1000, iter.value());
+        iter.value() = iter.key();
+    }
+    for (int n = 0; n < kCount; ++n) {
+        EXPECT_TRUE(seen[n]);
+        EXPECT_EQ(n, *map.find(n));
+    }
+}
+
+TEST(HashMap, IteratorErase) {
+    HashMap<int, int> map;
+    const int kCount = 1000;
+    for (int n = 0; n < kCount; ++n) {
+        map.set(n, n);
+    }
+
+    // Erase the odd keys during the iteration, each key must still be
+    // visited exactly once.
+    int visits[kCount] = {};
+    HashMap<int, int>::Iterator iter(&map);
+    while (iter.hasNext()) {
+        iter.next();
+        visits[iter.key()]++;
+        if (iter.key() & 1) {
+            iter.erase();
+        }
+    }
+    EXPECT_EQ((size_t)kCount / 2, map.size());
+    for (int n = 0; n < kCount; ++n) {
+        EXPECT_EQ(1, visits[n]);
+        EXPECT_EQ(!(n & 1), map.contains(n));
+    }
+}
+
+TEST(HashMap, PointerKeysAndStringValues) {
+    int objects[10];
+    HashMap<int*, std::string> map;
+    for (int n = 0; n < 10; ++n) {
+        map.set(&objects[n], std::string(n, 'x'));
+    }
+    for (int n = 0; n < 10; ++n) {
+        ASSERT_TRUE(map.find(&objects[n]));
+        EXPECT_EQ(std::string(n, 'x'), *map.find(&objects[n]));
+    }
+    EXPECT_TRUE(map.erase(&objects[3]));
+    EXPECT_FALSE(map.contains(&objects[3]));
+    EXPECT_EQ(std::string(9, 'x'), *map.find(&objects[9]));
+}
+
+namespace {
+
+struct ModuloTraits {
+    // A bad hash function, to test collisions.
+    static size_t hash(int key) { return key % 4; }
+};
+
+}  // namespace
+
+TEST(HashMap, Collisions) {
+    HashMap<int, int, ModuloTraits> map;
+    for (int n = 0; n < 200; ++n) {
+        map.set(n, -n);
+    }
+    for (int n = 0; n < 200; n += 3) {
+        EXPECT_TRUE(map.erase(n));
+    }
+    for (int n = 0; n < 200; ++n) {
+        if (n % 3) {
+            ASSERT_TRUE(map.find(n));
+            EXPECT_EQ(-n, *map.find(n));
+        } else {
+            EXPECT_FALSE(map.find(n));
+        }
+    }
+}
+
+}  // namespace emugl
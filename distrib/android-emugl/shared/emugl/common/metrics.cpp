@@ -0,0 +1,74 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/metrics.h"
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN 1
+#  include <windows.h>
+#elif defined(__APPLE__)
+#  include <mach/mach_time.h>
+#else
+#  include <time.h>
+#endif
+
+namespace emugl {
+
+namespace {
+
+MetricsFunc volatile sMetricsFunc = NULL;
+
+}  // namespace
+
+void setMetricsCallback(MetricsFunc func) {
+    sMetricsFunc = func;
+}
+
+bool metricsEnabled() {
+    return sMetricsFunc != NULL;
+}
+
+void recordMetric(Metric metric, long long value) {
+    MetricsFunc func = sMetricsFunc;
+    if (func) {
+        func(metric, value);
+    }
+}
+
+long long metricsNowUs() {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    return (long long)(now.QuadPart * (1e6 / freq.QuadPart));
+#elif defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
+    if (!timebase.denom) {
+        mach_timebase_info(&timebase);
+    }
+    return (long long)(mach_absolute_time() * timebase.numer /
+                       timebase.denom / 1000);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+#endif
+}
+
+}  // namespace emugl
@@ -0,0 +1,71 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_METRICS_H
+#define EMUGL_COMMON_METRICS_H
+
+namespace emugl {
+
+// Performance metrics of the EmuGL libraries. They are not kept here, but
+// passed to a callback installed by the emulator, see setMetricsCallback()
+// in render_api.h.
+//
+// NOTE: These values are part of the render API.
+enum Metric {
+    kMetricDecodeUs = 0,  // Duration of a render thread decode pass.
+    kMetricPostUs = 1,    // Duration of FrameBuffer::post().
+};
+
+typedef void (*MetricsFunc)(int metric, long long value);
+
+// Install |func| to record metric values, or NULL to stop.
+void setMetricsCallback(MetricsFunc func);
+
+// Return true if a callback is installed, i.e. if the metrics are worth
+// measuring.
+bool metricsEnabled();
+
+// Record |value| for |metric|, if a callback is installed.
+void recordMetric(Metric metric, long long value);
+
+// Return the current value of a monotonic clock, in microseconds.
+long long metricsNowUs();
+
+// Helper class to record the duration of a scope, in microseconds, e.g.:
+//
+//     {
+//         ScopedMetricTimer timer(kMetricPostUs);
+//         ... do the post.
+//     }
+//
+// The clock is only read if a callback is installed.
+class ScopedMetricTimer {
+public:
+    explicit ScopedMetricTimer(Metric metric) :
+            mMetric(metric), mStartUs(metricsEnabled() ? metricsNowUs() : -1) {}
+
+    ~ScopedMetricTimer() {
+        if (mStartUs >= 0) {
+            recordMetric(mMetric, metricsNowUs() - mStartUs);
+        }
+    }
+
+private:
+    Metric mMetric;
+    long long mStartUs;
+};
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_METRICS_H
@@ -0,0 +1,102 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/pixel_rle.h"
+
+#include <string.h>
+
+namespace emugl {
+
+namespace {
+
+const uint32_t kRunFlag = 0x80000000U;
+const size_t kMaxBlockLength = 0x7fffffffU;
+
+// Shorter runs are stored as literals, so that a run never costs more
+// than the pixels it replaces.
+const size_t kMinRunLength = 3;
+
+}  // namespace
+
+void pixelRleEncode(const uint32_t* pixels,
+                    size_t count,
+                    PodVector<uint32_t>* out) {
+    // Each run is preceded by a literal block, and costs less than its
+    // pixels, so that the encoding needs one more word at most.
+    out->resize(count + 1);
+    uint32_t* dst = out->begin();
+    size_t n = 0;
+    // Index in |dst| of the header of the current literal block, or
+    // |count + 1| if there is none.
+    size_t literal = count + 1;
+
+    size_t i = 0;
+    while (i < count) {
+        const uint32_t pixel = pixels[i];
+        size_t run = 1;
+        while (i + run < count && pixels[i + run] == pixel &&
+               run < kMaxBlockLength) {
+            run++;
+        }
+        if (run >= kMinRunLength) {
+            dst[n++] = kRunFlag | (uint32_t)run;
+            dst[n++] = pixel;
+            literal = count + 1;
+        } else {
+            if (literal > count || dst[literal] + run > kMaxBlockLength) {
+                literal = n++;
+                dst[literal] = 0;
+            }
+            memcpy(dst + n, pixels + i, run * sizeof(pixel));
+            dst[literal] += (uint32_t)run;
+            n += run;
+        }
+        i += run;
+    }
+    out->resize(n);
+}
+
+bool pixelRleDecode(const uint32_t* data,
+                    size_t size,
+                    uint32_t* pixels,
+                    size_t count) {
+    size_t n = 0;
+    size_t i = 0;
+    while (i < size) {
+        const uint32_t header = data[i++];
+        const size_t length = header & ~kRunFlag;
+        if (length > count - n) {
+            return false;
+        }
+        if (header & kRunFlag) {
+            if (i == size) {
+                return false;
+            }
+            const uint32_t pixel = data[i++];
+            for (size_t k = 0; k < length; ++k) {
+                pixels[n + k] = pixel;
+            }
+        } else {
+            if (length > size - i) {
+                return false;
+            }
+            memcpy(pixels + n, data + i, length * sizeof(pixels[0]));
+            i += length;
+        }
+        n += length;
+    }
+    return n == count;
+}
+
+}  // namespace emugl
@@ -0,0 +1,51 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_PIXEL_RLE_H
+#define EMUGL_COMMON_PIXEL_RLE_H
+
+#include "emugl/common/pod_vector.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace emugl {
+
+// A run-length encoding of 32-bit pixels, used to keep the content of idle
+// ColorBuffers in host memory. Guest UI buffers are mostly made of large
+// areas of the same color, which this compresses well while encoding and
+// decoding at memory speed.
+//
+// The encoded data is a sequence of 32-bit words, each block starting with
+// a header word: if its top bit is set, the low 31 bits are the length of
+// a run of the pixel that follows; otherwise, they are the number of
+// literal pixels that follow. The encoding is never larger than the
+// pixels plus one word.
+
+// Encode the |count| pixels of |pixels| into |out|, replacing its content.
+void pixelRleEncode(const uint32_t* pixels,
+                    size_t count,
+                    PodVector<uint32_t>* out);
+
+// Decode the |size| words of |data| into the |count| pixels of |pixels|.
+// Returns false if the data is malformed or doesn't decode to exactly
+// |count| pixels, in which case the content of |pixels| is undefined.
+bool pixelRleDecode(const uint32_t* data,
+                    size_t size,
+                    uint32_t* pixels,
+                    size_t count);
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_PIXEL_RLE_H
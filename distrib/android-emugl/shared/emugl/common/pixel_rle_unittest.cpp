@@ -0,0 +1,106 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/pixel_rle.h"
+
+#include <gtest/gtest.h>
+
+namespace emugl {
+
+namespace {
+
+// Encode |pixels|, check the size of the encoding if |expectedSize| isn't
+// 0, and check that it decodes back to |pixels|.
+void checkRoundTrip(PodVector<uint32_t>& pixels, size_t expectedSize) {
+    PodVector<uint32_t> encoded;
+    pixelRleEncode(pixels.begin(), pixels.size(), &encoded);
+    EXPECT_LE(encoded.size(), pixels.size() + 1);
+    if (expectedSize) {
+        EXPECT_EQ(expectedSize, encoded.size());
+    }
+
+    PodVector<uint32_t> decoded;
+    decoded.resize(pixels.size());
+    ASSERT_TRUE(pixelRleDecode(encoded.begin(), encoded.size(),
+                               decoded.begin(), decoded.size()));
+    for (size_t n = 0; n < pixels.size(); ++n) {
+        EXPECT_EQ(pixels[n], decoded[n]) << "pixel " << n;
+    }
+}
+
+}  // namespace
+
+TEST(PixelRle, Empty) {
+    PodVector<uint32_t> encoded;
+    pixelRleEncode(NULL, 0, &encoded);
+    EXPECT_EQ(0U, encoded.size());
+    EXPECT_TRUE(pixelRleDecode(NULL, 0, NULL, 0));
+}
+
+TEST(PixelRle, SolidColor) {
+    PodVector<uint32_t> pixels;
+    pixels.resize(1000);
+    for (size_t n = 0; n < pixels.size(); ++n) {
+        pixels[n] = 0xff336699U;
+    }
+    checkRoundTrip(pixels, 2U);
+}
+
+TEST(PixelRle, NoRuns) {
+    PodVector<uint32_t> pixels;
+    pixels.resize(1000);
+    for (size_t n = 0; n < pixels.size(); ++n) {
+        pixels[n] = (uint32_t)n;
+    }
+    checkRoundTrip(pixels, 1001U);
+}
+
+TEST(PixelRle, MixedRuns) {
+    // Runs of 1 to 7 pixels, so that short runs are stored as literals
+    // between the longer ones.
+    PodVector<uint32_t> pixels;
+    uint32_t value = 0;
+    for (size_t run = 0; pixels.size() < 5000; run = (run + 1) % 7) {
+        for (size_t k = 0; k <= run; ++k) {
+            pixels.append(value);
+        }
+        value += 0x01010101U;
+    }
+    checkRoundTrip(pixels, 0);
+}
+
+TEST(PixelRle, DecodeRejectsMalformedData) {
+    PodVector<uint32_t> pixels;
+    pixels.resize(64);
+    for (size_t n = 0; n < pixels.size(); ++n) {
+        pixels[n] = n < 32 ? 0 : (uint32_t)n;
+    }
+    PodVector<uint32_t> encoded;
+    pixelRleEncode(pixels.begin(), pixels.size(), &encoded);
+
+    PodVector<uint32_t> decoded;
+    decoded.resize(pixels.size());
+    // Truncated.
+    EXPECT_FALSE(pixelRleDecode(encoded.begin(), encoded.size() - 1,
+                                decoded.begin(), decoded.size()));
+    // Too many pixels.
+    EXPECT_FALSE(pixelRleDecode(encoded.begin(), encoded.size(),
+                                decoded.begin(), decoded.size() - 1));
+    // Too few pixels.
+    decoded.resize(pixels.size() + 1);
+    EXPECT_FALSE(pixelRleDecode(encoded.begin(), encoded.size(),
+                                decoded.begin(), decoded.size()));
+}
+
+}  // namespace emugl
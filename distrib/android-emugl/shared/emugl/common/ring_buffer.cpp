@@ -0,0 +1,122 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/ring_buffer.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace emugl {
+
+namespace {
+
+// Full memory barrier, used to order the buffer accesses with regards to
+// the position updates seen by the other thread.
+inline void memoryBarrier() {
+#ifdef _WIN32
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+}
+
+size_t roundUpToPowerOf2(size_t value) {
+    size_t result = 1U;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}  // namespace
+
+RingBuffer::RingBuffer(size_t capacity) :
+        mBuffer(NULL), mMask(0), mReadPos(0), mWritePos(0) {
+    size_t size = roundUpToPowerOf2(capacity < 2U ? 2U : capacity);
+    mBuffer = static_cast<uint8_t*>(::malloc(size));
+    mMask = size - 1U;
+}
+
+RingBuffer::~RingBuffer() {
+    ::free(mBuffer);
+}
+
+size_t RingBuffer::writeAvail() const {
+    return capacity() - (mWritePos - mReadPos);
+}
+
+size_t RingBuffer::write(const void* data, size_t size) {
+    size_t readPos = mReadPos;
+    memoryBarrier();
+    size_t writePos = mWritePos;
+    size_t avail = capacity() - (writePos - readPos);
+    if (size > avail) {
+        size = avail;
+    }
+    if (!size) {
+        return 0;
+    }
+    size_t offset = writePos & mMask;
+    size_t chunk = capacity() - offset;
+    if (chunk > size) {
+        chunk = size;
+    }
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    ::memcpy(mBuffer + offset, src, chunk);
+    if (chunk < size) {
+        ::memcpy(mBuffer, src + chunk, size - chunk);
+    }
+    // Ensure the data is visible before the consumer sees the new position.
+    memoryBarrier();
+    mWritePos = writePos + size;
+    return size;
+}
+
+size_t RingBuffer::readAvail() const {
+    return mWritePos - mReadPos;
+}
+
+size_t RingBuffer::read(void* data, size_t size) {
+    size_t writePos = mWritePos;
+    memoryBarrier();
+    size_t readPos = mReadPos;
+    size_t avail = writePos - readPos;
+    if (size > avail) {
+        size = avail;
+    }
+    if (!size) {
+        return 0;
+    }
+    size_t offset = readPos & mMask;
+    size_t chunk = capacity() - offset;
+    if (chunk > size) {
+        chunk = size;
+    }
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    ::memcpy(dst, mBuffer + offset, chunk);
+    if (chunk < size) {
+        ::memcpy(dst + chunk, mBuffer, size - chunk);
+    }
+    // Ensure the data was read before the producer can overwrite it.
+    memoryBarrier();
+    mReadPos = readPos + size;
+    return size;
+}
+
+}  // namespace emugl
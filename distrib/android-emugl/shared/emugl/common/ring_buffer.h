@@ -0,0 +1,75 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_RING_BUFFER_H
+#define EMUGL_COMMON_RING_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace emugl {
+
+// A lock-free byte ring buffer that can be shared between exactly one
+// producer thread and one consumer thread.
+//
+// The producer can only call writeAvail() and write(), while the consumer
+// can only call readAvail() and read(). None of these calls ever block,
+// they simply return the number of bytes that could be transferred. For
+// blocking semantics, see RingStream in OpenglCodecCommon.
+//
+// The capacity is always rounded up to a power of 2.
+class RingBuffer {
+public:
+    // Constructor. |capacity| is the minimum buffer size in bytes.
+    explicit RingBuffer(size_t capacity);
+
+    // Destructor.
+    ~RingBuffer();
+
+    // Return the capacity of the buffer in bytes.
+    size_t capacity() const { return mMask + 1U; }
+
+    // Producer side: return the number of bytes that can be written
+    // without overwriting unread data.
+    size_t writeAvail() const;
+
+    // Producer side: copy up to |size| bytes from |data| into the buffer.
+    // Returns the number of bytes actually copied, which will be 0 if the
+    // buffer is full.
+    size_t write(const void* data, size_t size);
+
+    // Consumer side: return the number of bytes that can be read.
+    size_t readAvail() const;
+
+    // Consumer side: copy up to |size| bytes from the buffer into |data|.
+    // Returns the number of bytes actually copied, which will be 0 if the
+    // buffer is empty.
+    size_t read(void* data, size_t size);
+
+private:
+    RingBuffer();
+    RingBuffer(const RingBuffer& other);
+    RingBuffer& operator=(const RingBuffer& other);
+
+    uint8_t* mBuffer;
+    size_t mMask;
+    // Free-running positions, only the producer modifies |mWritePos| and
+    // only the consumer modifies |mReadPos|.
+    volatile size_t mReadPos;
+    volatile size_t mWritePos;
+};
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_RING_BUFFER_H
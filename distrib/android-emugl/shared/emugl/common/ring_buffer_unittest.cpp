@@ -0,0 +1,121 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/ring_buffer.h"
+
+#include "emugl/common/testing/test_thread.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace emugl {
+
+TEST(RingBuffer, CapacityIsPowerOf2) {
+    RingBuffer rb1(1);
+    EXPECT_EQ(2U, rb1.capacity());
+    RingBuffer rb2(100);
+    EXPECT_EQ(128U, rb2.capacity());
+    RingBuffer rb3(4096);
+    EXPECT_EQ(4096U, rb3.capacity());
+}
+
+TEST(RingBuffer, WriteAndRead) {
+    RingBuffer rb(16);
+    EXPECT_EQ(0U, rb.readAvail());
+    EXPECT_EQ(16U, rb.writeAvail());
+
+    EXPECT_EQ(5U, rb.write("Hello", 5));
+    EXPECT_EQ(5U, rb.readAvail());
+    EXPECT_EQ(11U, rb.writeAvail());
+
+    char buf[16];
+    EXPECT_EQ(5U, rb.read(buf, sizeof(buf)));
+    EXPECT_EQ(0, memcmp(buf, "Hello", 5));
+    EXPECT_EQ(0U, rb.readAvail());
+    EXPECT_EQ(0U, rb.read(buf, sizeof(buf)));
+}
+
+TEST(RingBuffer, PartialWriteWhenFull) {
+    RingBuffer rb(8);
+    EXPECT_EQ(8U, rb.write("0123456789", 10));
+    EXPECT_EQ(0U, rb.writeAvail());
+    EXPECT_EQ(0U, rb.write("x", 1));
+
+    char buf[4];
+    EXPECT_EQ(4U, rb.read(buf, sizeof(buf)));
+    EXPECT_EQ(0, memcmp(buf, "0123", 4));
+    EXPECT_EQ(4U, rb.writeAvail());
+}
+
+TEST(RingBuffer, WrapAround) {
+    RingBuffer rb(8);
+    char buf[8];
+    for (int n = 0; n < 100; ++n) {
+        EXPECT_EQ(5U, rb.write("abcde", 5));
+        EXPECT_EQ(5U, rb.read(buf, 5));
+        EXPECT_EQ(0, memcmp(buf, "abcde", 5)) << "Iteration " << n;
+    }
+}
+
+namespace {
+
+const size_t kTotalBytes = 64 * 1024;
+
+void* producerFunction(void* param) {
+    RingBuffer* rb = static_cast<RingBuffer*>(param);
+    uint8_t chunk[100];
+    size_t sent = 0;
+    while (sent < kTotalBytes) {
+        size_t count = sizeof(chunk);
+        if (count > kTotalBytes - sent) {
+            count = kTotalBytes - sent;
+        }
+        for (size_t n = 0; n < count; ++n) {
+            chunk[n] = static_cast<uint8_t>(sent + n);
+        }
+        size_t done = 0;
+        while (done < count) {
+            done += rb->write(chunk + done, count - done);
+        }
+        sent += count;
+    }
+    return NULL;
+}
+
+}  // namespace
+
+TEST(RingBuffer, ProducerConsumer) {
+    RingBuffer rb(256);
+    TestThread* thread = new TestThread(producerFunction, &rb);
+
+    size_t received = 0;
+    bool ok = true;
+    uint8_t buf[77];
+    while (received < kTotalBytes) {
+        size_t count = rb.read(buf, sizeof(buf));
+        for (size_t n = 0; n < count; ++n) {
+            if (buf[n] != static_cast<uint8_t>(received + n)) {
+                ok = false;
+            }
+        }
+        received += count;
+    }
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(kTotalBytes, received);
+    thread->join();
+    delete thread;
+}
+
+}  // namespace emugl
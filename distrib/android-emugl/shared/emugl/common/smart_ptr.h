@@ -49,7 +49,8 @@ public:
         return mPtr;
     }
 
-    // Return internal reference count value, only use for unit testing.
+    // Return internal reference count value, e.g. to tell whether the
+    // object is shared, or for unit testing.
     int getRefCount() const;
 
 protected:
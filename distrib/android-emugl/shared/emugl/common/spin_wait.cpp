@@ -0,0 +1,134 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/spin_wait.h"
+
+#include "emugl/common/metrics.h"
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN 1
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+
+namespace emugl {
+
+namespace {
+
+// Initial spin interval of new instances.
+const int kInitialSpinUs = 8;
+
+// A gap this long between two polls means that the spinning thread was
+// descheduled, spinning is then disabled for kBackoffUs.
+const long long kPreemptedUs = 4 * SpinWait::kMaxSpinUs;
+const long long kBackoffUs = 1000000;
+
+// Number of threads currently in spin().
+volatile int sSpinners = 0;
+
+// Spinning is disabled until this time. Reads may be torn on 32-bit
+// hosts, which only delays or shortens a backoff.
+volatile long long sBackoffUntilUs = 0;
+
+inline int atomicAdd(volatile int* ptr, int delta) {
+#ifdef _WIN32
+    return (int)InterlockedExchangeAdd((volatile LONG*)ptr, delta) + delta;
+#else
+    return __sync_add_and_fetch(ptr, delta);
+#endif
+}
+
+inline void cpuRelax() {
+#ifdef _WIN32
+    YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause");
+#endif
+}
+
+int getMaxSpinners() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long count = (long)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    // Spinning on a single CPU only delays the thread being waited for.
+    return count > 1 ? (int)(count / 2) : 0;
+}
+
+}  // namespace
+
+SpinWait::SpinWait() : mSpinUs(kInitialSpinUs), mWaitStartUs(0) {}
+
+bool SpinWait::spin(CheckFunc check, void* context) {
+    static const int maxSpinners = getMaxSpinners();
+
+    if (check(context)) {
+        return true;
+    }
+    long long startUs = metricsNowUs();
+    mWaitStartUs = startUs;
+    if (mSpinUs <= 0 || startUs < sBackoffUntilUs) {
+        return false;
+    }
+    if (atomicAdd(&sSpinners, 1) > maxSpinners) {
+        atomicAdd(&sSpinners, -1);
+        return false;
+    }
+
+    bool ready = false;
+    long long lastUs = startUs;
+    for (;;) {
+        cpuRelax();
+        if (check(context)) {
+            ready = true;
+            break;
+        }
+        long long nowUs = metricsNowUs();
+        if (nowUs - lastUs > kPreemptedUs) {
+            sBackoffUntilUs = nowUs + kBackoffUs;
+            break;
+        }
+        if (nowUs - startUs >= mSpinUs) {
+            break;
+        }
+        lastUs = nowUs;
+    }
+    atomicAdd(&sSpinners, -1);
+
+    if (ready) {
+        recordWait(metricsNowUs() - startUs);
+    }
+    return ready;
+}
+
+void SpinWait::woken() {
+    recordWait(metricsNowUs() - mWaitStartUs);
+}
+
+void SpinWait::recordWait(long long waitUs) {
+    if (waitUs <= kMaxSpinUs) {
+        int spinUs = (int)(2 * waitUs) + 1;
+        if (spinUs > mSpinUs) {
+            mSpinUs = spinUs < kMaxSpinUs ? spinUs : kMaxSpinUs;
+        }
+    } else {
+        mSpinUs /= 2;
+    }
+}
+
+}  // namespace emugl
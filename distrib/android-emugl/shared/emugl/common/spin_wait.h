@@ -0,0 +1,68 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_SPIN_WAIT_H
+#define EMUGL_COMMON_SPIN_WAIT_H
+
+namespace emugl {
+
+// An adaptive spin-then-block policy for a thread waiting for a condition
+// that another thread sets without a syscall, e.g. data in a RingBuffer.
+//
+// Blocking costs a wait and a wake-up syscall, plus a context switch on
+// each side, which dominates the latency of short round trips. Instead,
+// spin() polls the condition for a bounded interval first, and the caller
+// only blocks if it is still false.
+//
+// The interval tunes itself to the waits seen by each instance: a wait
+// which ended within kMaxSpinUs raises it to twice its duration, and
+// longer ones halve it, so that a thread whose peer answers quickly
+// spins, while a thread waiting for the next frame blocks right away.
+//
+// Spinning is disabled for all instances when the host is oversubscribed,
+// i.e. when a spinning thread gets descheduled, or when the instances
+// already spinning would keep half the CPUs busy.
+//
+// An instance must only be used by a single thread at a time.
+class SpinWait {
+public:
+    enum { kMaxSpinUs = 50 };
+
+    typedef bool (*CheckFunc)(void* context);
+
+    SpinWait();
+
+    // Poll |check(context)| until it returns true, or for the current
+    // spin interval. Returns true in the first case. Otherwise, the caller
+    // should block until the condition is met, then call woken().
+    bool spin(CheckFunc check, void* context);
+
+    // Call after a blocking wait which followed a failed spin().
+    void woken();
+
+    // Tune the spin interval for a wait of |waitUs| microseconds. This is
+    // called by spin() and woken(), and exposed for tests.
+    void recordWait(long long waitUs);
+
+    // Return the current spin interval, in microseconds.
+    int spinUs() const { return mSpinUs; }
+
+private:
+    int mSpinUs;
+    long long mWaitStartUs;
+};
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_SPIN_WAIT_H
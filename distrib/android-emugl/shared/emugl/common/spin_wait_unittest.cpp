@@ -0,0 +1,79 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/spin_wait.h"
+
+#include "emugl/common/metrics.h"
+
+#include <gtest/gtest.h>
+
+namespace emugl {
+
+namespace {
+
+bool isTrue(void* context) {
+    return *static_cast<bool*>(context);
+}
+
+}  // namespace
+
+TEST(SpinWait, ReadyConditionReturnsImmediately) {
+    SpinWait spinWait;
+    bool ready = true;
+    EXPECT_TRUE(spinWait.spin(isTrue, &ready));
+}
+
+TEST(SpinWait, SpinIsBounded) {
+    SpinWait spinWait;
+    bool ready = false;
+    long long startUs = metricsNowUs();
+    EXPECT_FALSE(spinWait.spin(isTrue, &ready));
+    spinWait.woken();
+    // Generous, the thread may be descheduled.
+    EXPECT_LT(metricsNowUs() - startUs, 100000LL);
+}
+
+TEST(SpinWait, ShortWaitsRaiseInterval) {
+    SpinWait spinWait;
+    int initialUs = spinWait.spinUs();
+    spinWait.recordWait(initialUs * 2);
+    EXPECT_EQ(initialUs * 4 + 1, spinWait.spinUs());
+
+    // Shorter waits don't lower it.
+    spinWait.recordWait(1);
+    EXPECT_EQ(initialUs * 4 + 1, spinWait.spinUs());
+
+    spinWait.recordWait(SpinWait::kMaxSpinUs);
+    EXPECT_EQ((int)SpinWait::kMaxSpinUs, spinWait.spinUs());
+}
+
+TEST(SpinWait, LongWaitsHalveInterval) {
+    SpinWait spinWait;
+    spinWait.recordWait(SpinWait::kMaxSpinUs);
+    EXPECT_EQ((int)SpinWait::kMaxSpinUs, spinWait.spinUs());
+    spinWait.recordWait(SpinWait::kMaxSpinUs + 1);
+    EXPECT_EQ((int)SpinWait::kMaxSpinUs / 2, spinWait.spinUs());
+    for (int i = 0; i < 10; ++i) {
+        spinWait.recordWait(1000000);
+    }
+    EXPECT_EQ(0, spinWait.spinUs());
+
+    // Polling stops, but a short wait starts it again.
+    bool ready = false;
+    EXPECT_FALSE(spinWait.spin(isTrue, &ready));
+    spinWait.recordWait(3);
+    EXPECT_EQ(7, spinWait.spinUs());
+}
+
+}  // namespace emugl
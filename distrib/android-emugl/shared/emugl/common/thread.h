@@ -79,6 +79,24 @@ public:
     // NOTE: |exitStatus| can be NULL.
     bool tryWait(intptr_t *exitStatus);
 
+    // Scheduling priorities of the current thread, see setCurrentPriority().
+    enum Priority {
+        kPriorityLow,
+        kPriorityNormal,
+        kPriorityHigh,
+    };
+
+    // Change the scheduling priority of the calling thread. Return true on
+    // success, false otherwise. Raising the priority usually requires
+    // privileges that the host doesn't grant, and lowering it can't always
+    // be undone, so callers should treat failures as harmless.
+    static bool setCurrentPriority(Priority priority);
+
+    // Restrict the calling thread to the host CPUs whose bits are set in
+    // |cpuMask|, or allow all of them if |cpuMask| is 0. Return true on
+    // success, false otherwise, e.g. on hosts without thread affinity.
+    static bool setCurrentAffinity(uint64_t cpuMask);
+
 private:
 #ifdef _WIN32
     static DWORD WINAPI thread_main(void* arg);
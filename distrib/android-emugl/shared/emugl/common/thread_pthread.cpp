@@ -19,6 +19,13 @@
 #include <assert.h>
 #include <stdio.h>
 
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace emugl {
 
 namespace {
@@ -118,6 +125,56 @@ bool Thread::tryWait(intptr_t *exitStatus) {
     return true;
 }
 
+// static
+bool Thread::setCurrentPriority(Priority priority) {
+#ifdef __linux__
+    // Linux threads have their own nice value, but the pthread scheduling
+    // parameters of SCHED_OTHER threads are ignored.
+    static const int kNiceValues[] = { 10, 0, -5 };
+    return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid),
+                       kNiceValues[priority]) == 0;
+#else
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param)) {
+        return false;
+    }
+    int minPriority = sched_get_priority_min(policy);
+    int maxPriority = sched_get_priority_max(policy);
+    int midPriority = (minPriority + maxPriority) / 2;
+    switch (priority) {
+    case kPriorityLow:
+        param.sched_priority = (minPriority + midPriority) / 2;
+        break;
+    case kPriorityNormal:
+        param.sched_priority = midPriority;
+        break;
+    case kPriorityHigh:
+        param.sched_priority = (midPriority + maxPriority + 1) / 2;
+        break;
+    }
+    return pthread_setschedparam(pthread_self(), policy, &param) == 0;
+#endif
+}
+
+// static
+bool Thread::setCurrentAffinity(uint64_t cpuMask) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int n = 0; n < 64 && n < CPU_SETSIZE; ++n) {
+        if (!cpuMask || (cpuMask & (1ULL << n))) {
+            CPU_SET(n, &cpus);
+        }
+    }
+    return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+#else
+    // Darwin only has affinity tags, which are hints for threads to share
+    // a cache, not a way to place them.
+    return cpuMask == 0;
+#endif
+}
+
 // static
 void* Thread::thread_main(void *arg) {
     Thread* self = reinterpret_cast<Thread*>(arg);
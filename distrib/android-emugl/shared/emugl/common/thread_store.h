@@ -22,6 +22,36 @@
 #  include <pthread.h>
 #endif
 
+// EMUGL_THREAD_LOCAL is defined as the compiler's native thread-local
+// storage qualifier on the hosts where it is both supported and fast, i.e.
+// where a variable declared with it is accessed without a function call.
+// It can only qualify variables with static storage and a constant
+// initializer, and doesn't run destructors, so keep using a ThreadStore
+// to destroy the values on thread exit, and the native variable as a
+// cache in front of it, e.g.:
+//
+//     #ifdef EMUGL_THREAD_LOCAL
+//     static EMUGL_THREAD_LOCAL Foo* sFoo = NULL;
+//     #endif
+//
+//     Foo* getFoo() {
+//     #ifdef EMUGL_THREAD_LOCAL
+//         if (sFoo) return sFoo;
+//     #endif
+//         ... get the value from the ThreadStore, creating it if needed.
+//     #ifdef EMUGL_THREAD_LOCAL
+//         sFoo = value;
+//     #endif
+//     }
+//
+// with the store's destructor resetting the native variable, since it
+// runs on the exiting thread. It isn't defined with MinGW, which emulates
+// it with function calls, nor with the Apple toolchains, which don't
+// support it.
+#if !defined(_WIN32) && !defined(__APPLE__) && defined(__GNUC__)
+#  define EMUGL_THREAD_LOCAL __thread
+#endif
+
 namespace emugl {
 
 // A class to model storage of thread-specific values, that can be
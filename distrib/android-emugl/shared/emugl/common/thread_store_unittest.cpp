@@ -14,11 +14,15 @@
 
 #include "emugl/common/thread_store.h"
 
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/metrics.h"
 #include "emugl/common/mutex.h"
 #include "emugl/common/testing/test_thread.h"
 
 #include <gtest/gtest.h>
 
+#include <stdio.h>
+
 namespace emugl {
 
 namespace {
@@ -143,4 +147,58 @@ TEST(ThreadStore, ThreadsWithoutDestructor) {
     }
 }
 
+namespace {
+
+class BenchmarkStore : public ThreadStore {
+public:
+    BenchmarkStore() : ThreadStore(NULL) {}
+};
+
+LazyInstance<BenchmarkStore> sBenchmarkStore = LAZY_INSTANCE_INIT;
+
+#ifdef EMUGL_THREAD_LOCAL
+EMUGL_THREAD_LOCAL void* sBenchmarkValue = NULL;
+#endif
+
+}  // namespace
+
+// Compare the cost of a thread-local lookup through a lazily created
+// ThreadStore, as RenderThreadInfo::get() and the translator's
+// getThreadInfo() do for each decoded command, with the EMUGL_THREAD_LOCAL
+// fast path. Run it explicitly with
+// --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+TEST(ThreadStore, DISABLED_Benchmark) {
+    const size_t kLookups = 100000000;
+    int value = 0;
+    sBenchmarkStore->set(&value);
+
+    size_t found = 0;
+    long long start = metricsNowUs();
+    for (size_t n = 0; n < kLookups; ++n) {
+        found += (sBenchmarkStore->get() == &value);
+        __asm__ __volatile__("" : : : "memory");
+    }
+    long long storeUs = metricsNowUs() - start;
+    EXPECT_EQ(kLookups, found);
+    printf("ThreadStore::get(): %.2f ns/lookup\n",
+           storeUs * 1e3 / kLookups);
+
+#ifdef EMUGL_THREAD_LOCAL
+    sBenchmarkValue = &value;
+    found = 0;
+    start = metricsNowUs();
+    for (size_t n = 0; n < kLookups; ++n) {
+        found += (sBenchmarkValue == &value);
+        __asm__ __volatile__("" : : : "memory");
+    }
+    long long nativeUs = metricsNowUs() - start;
+    EXPECT_EQ(kLookups, found);
+    printf("EMUGL_THREAD_LOCAL: %.2f ns/lookup\n",
+           nativeUs * 1e3 / kLookups);
+#else
+    printf("EMUGL_THREAD_LOCAL: not available on this host\n");
+#endif
+    sBenchmarkStore->set(NULL);
+}
+
 }  // namespace emugl
@@ -81,6 +81,16 @@ private:
     Mutex* mLock;
 };
 
+// A thread that lowers its own priority and resets its affinity, and
+// returns 1 if both succeeded.
+class SchedulingThread : public ::emugl::Thread {
+public:
+    intptr_t main() {
+        return Thread::setCurrentPriority(Thread::kPriorityLow) &&
+               Thread::setCurrentAffinity(0);
+    }
+};
+
 }  // namespace
 
 TEST(ThreadTest, WaitForSimpleThread) {
@@ -161,4 +171,15 @@ TEST(ThreadTest, TryWaitForMultipleThreads) {
     }
 }
 
+TEST(ThreadTest, SetCurrentPriorityAndAffinity) {
+    // Run in a separate thread, since lowering the priority of a thread
+    // can't always be undone.
+    Thread* thread = new SchedulingThread();
+    EXPECT_TRUE(thread->start());
+    intptr_t status;
+    EXPECT_TRUE(thread->wait(&status));
+    EXPECT_EQ(1, status);
+    delete thread;
+}
+
 }  // namespace emugl
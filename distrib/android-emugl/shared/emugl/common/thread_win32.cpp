@@ -101,6 +101,30 @@ bool Thread::tryWait(intptr_t* exitStatus) {
     return true;
 }
 
+// static
+bool Thread::setCurrentPriority(Priority priority) {
+    static const int kPriorities[] = {
+        THREAD_PRIORITY_BELOW_NORMAL,
+        THREAD_PRIORITY_NORMAL,
+        THREAD_PRIORITY_ABOVE_NORMAL,
+    };
+    return SetThreadPriority(GetCurrentThread(), kPriorities[priority]) != 0;
+}
+
+// static
+bool Thread::setCurrentAffinity(uint64_t cpuMask) {
+    DWORD_PTR processMask, systemMask;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask,
+                                &systemMask)) {
+        return false;
+    }
+    DWORD_PTR mask = cpuMask ? (DWORD_PTR)cpuMask & processMask : processMask;
+    if (!mask) {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
 // static
 DWORD WINAPI Thread::thread_main(void *arg)
 {
@@ -0,0 +1,59 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/trace.h"
+
+#include <stddef.h>
+
+namespace emugl {
+
+namespace {
+
+// The callback is only ever installed once the mask is, and removed
+// before it, so a non-NULL callback always has a valid mask.
+TraceFunc volatile sTraceFunc = NULL;
+const unsigned* volatile sTraceCategories = NULL;
+
+}  // namespace
+
+void setTraceCallback(TraceFunc func, const unsigned* categories) {
+    if (func && categories) {
+        sTraceCategories = categories;
+        __sync_synchronize();
+        sTraceFunc = func;
+    } else {
+        sTraceFunc = NULL;
+        __sync_synchronize();
+    }
+}
+
+bool traceEnabled(TraceCategory category) {
+    if (!sTraceFunc) {
+        return false;
+    }
+    __sync_synchronize();
+    return ((*sTraceCategories >> category) & 1U) != 0;
+}
+
+void traceEvent(TraceCategory category,
+                TraceEventType type,
+                const char* name,
+                long long value) {
+    TraceFunc func = sTraceFunc;
+    if (func && ((*sTraceCategories >> category) & 1U)) {
+        func(category, type, name, value);
+    }
+}
+
+}  // namespace emugl
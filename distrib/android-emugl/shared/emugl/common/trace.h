@@ -0,0 +1,85 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_TRACE_H
+#define EMUGL_COMMON_TRACE_H
+
+namespace emugl {
+
+// Tracepoints of the EmuGL libraries. The events are not recorded here,
+// but passed to a callback installed by the emulator, which also owns the
+// mask of enabled categories, see setTraceCallback() in render_api.h.
+//
+// NOTE: These values must match TRACE_CATEGORY_EMUGL and TRACE_CATEGORY_FB
+// in the emulator's android/utils/trace.h.
+enum TraceCategory {
+    kTraceCategoryEmugl = 1,
+    kTraceCategoryFb = 2,
+};
+
+enum TraceEventType {
+    kTraceEventBegin = 0,
+    kTraceEventEnd,
+    kTraceEventInstant,
+    kTraceEventCounter,
+};
+
+typedef void (*TraceFunc)(int category, int type, const char* name,
+                          long long value);
+
+// Install |func| to record the events of the categories enabled in the
+// mask pointed to by |categories|. Pass NULL for both to stop tracing.
+void setTraceCallback(TraceFunc func, const unsigned* categories);
+
+// Return true if |category| is currently enabled.
+bool traceEnabled(TraceCategory category);
+
+// Record an event if |category| is enabled. |name| must be a string
+// literal.
+void traceEvent(TraceCategory category,
+                TraceEventType type,
+                const char* name,
+                long long value);
+
+// Helper class to trace a slice for the lifetime of a scope, e.g.:
+//
+//     {
+//         ScopedTrace trace(kTraceCategoryFb, "post");
+//         ... do the post.
+//     }
+//
+class ScopedTrace {
+public:
+    ScopedTrace(TraceCategory category, const char* name) :
+            mCategory(category), mName(name), mEnabled(traceEnabled(category)) {
+        if (mEnabled) {
+            traceEvent(mCategory, kTraceEventBegin, mName, 0);
+        }
+    }
+
+    ~ScopedTrace() {
+        if (mEnabled) {
+            traceEvent(mCategory, kTraceEventEnd, mName, 0);
+        }
+    }
+
+private:
+    TraceCategory mCategory;
+    const char* mName;
+    bool mEnabled;
+};
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_TRACE_H
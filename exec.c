@@ -47,6 +47,8 @@
 #include "exec/hax.h"
 #include "exec/ram_addr.h"
 #include "qemu/timer.h"
+#include "migration/migration.h"
+#include "android/utils/thread_pool.h"
 #if defined(CONFIG_USER_ONLY)
 #include <qemu.h>
 #endif
@@ -539,6 +541,50 @@ void cpu_physical_memory_reset_dirty(ram_addr_t start, ram_addr_t length,
     }
 }
 
+/* Note: start and end must be within the same ram block.  */
+bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
+                                              ram_addr_t length,
+                                              unsigned client)
+{
+    unsigned long end, page;
+    bool dirty;
+
+    if (length == 0)
+        return false;
+    assert(client < DIRTY_MEMORY_NUM);
+    end = TARGET_PAGE_ALIGN(start + length) >> TARGET_PAGE_BITS;
+    page = start >> TARGET_PAGE_BITS;
+    dirty = bitmap_test_and_clear_atomic(ram_list.dirty_memory[client],
+                                         page, end - page);
+    if (dirty && tcg_enabled()) {
+        tlb_reset_dirty_range_all(start, length);
+    }
+    return dirty;
+}
+
+/* Note: start and end must be within the same ram block.  */
+bool cpu_physical_memory_snapshot_and_clear_dirty(ram_addr_t start,
+                                                  ram_addr_t length,
+                                                  unsigned client,
+                                                  unsigned long *dest)
+{
+    unsigned long end, page;
+    bool dirty;
+
+    if (length == 0)
+        return false;
+    assert(client < DIRTY_MEMORY_NUM);
+    end = TARGET_PAGE_ALIGN(start + length) >> TARGET_PAGE_BITS;
+    page = start >> TARGET_PAGE_BITS;
+    dirty = bitmap_extract_and_clear_atomic(dest,
+                                            ram_list.dirty_memory[client],
+                                            page, end - page);
+    if (dirty && tcg_enabled()) {
+        tlb_reset_dirty_range_all(start, length);
+    }
+    return dirty;
+}
+
 int cpu_physical_memory_set_dirty_tracking(int enable)
 {
     in_migration = enable;
@@ -563,6 +609,19 @@ int cpu_physical_sync_dirty_bitmap(hwaddr start_addr,
     return ret;
 }
 
+int cpu_physical_memory_start_dirty_log(hwaddr start_addr, ram_addr_t size)
+{
+    if (kvm_enabled()) {
+        return kvm_log_start_range(start_addr, size);
+    }
+    if (hax_enabled()) {
+        /* The HAXM driver can't report the pages written by the guest. */
+        return -ENOSYS;
+    }
+    /* TCG maintains the dirty bits through the soft TLB. */
+    return 0;
+}
+
 static inline void tlb_update_dirty(CPUTLBEntry *tlb_entry)
 {
     ram_addr_t ram_addr;
@@ -586,6 +645,8 @@ void cpu_tlb_update_dirty(CPUArchState *env)
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         for(i = 0; i < CPU_TLB_SIZE; i++)
             tlb_update_dirty(&env->tlb_table[mmu_idx][i]);
+        for (i = 0; i < CPU_VTLB_SIZE; i++)
+            tlb_update_dirty(&env->tlb_v_table[mmu_idx][i]);
     }
 }
 
@@ -1044,6 +1105,92 @@ static int memory_try_enable_merging(void *addr, size_t len)
 #endif  // CONFIG_ANDROID
 }
 
+/* Guest RAM is prefaulted in chunks of this size, one pool task each. */
+#define RAM_PREFAULT_CHUNK  (32 * 1024 * 1024)
+
+typedef struct RamPrefaultChunk {
+    uint8_t *host;
+    size_t len;
+} RamPrefaultChunk;
+
+/* Populate a chunk of guest RAM with host pages. This runs while the
+ * machine is being set up, or the guest boots, so the pages may be written
+ * concurrently: each one is touched with an atomic add of 0, which faults
+ * it in for writing without changing its content. */
+static void ram_prefault_task(void *opaque)
+{
+    RamPrefaultChunk *chunk = opaque;
+    size_t page_size = getpagesize();
+    size_t off;
+    bool populated = false;
+
+#if defined(__linux__) && defined(MADV_POPULATE_WRITE)
+    populated = madvise(chunk->host, chunk->len, MADV_POPULATE_WRITE) == 0;
+#endif
+    if (!populated) {
+        for (off = 0; off < chunk->len; off += page_size) {
+            __sync_fetch_and_add((volatile int *)(chunk->host + off), 0);
+        }
+    }
+
+    if (mem_lock) {
+#ifdef _WIN32
+        bool locked = VirtualLock(chunk->host, chunk->len);
+#else
+        bool locked = mlock(chunk->host, chunk->len) == 0;
+#endif
+        static bool warned;
+        if (!locked && !warned) {
+            warned = true;
+            fprintf(stderr, "-mem-lock: could not lock guest memory, "
+                    "check the locked memory limit (ulimit -l)\n");
+        }
+    }
+    g_free(chunk);
+}
+
+/* Populate the host memory of |block| in the background with -mem-prefault,
+ * so that the guest doesn't pay for a host page fault and the zeroing of a
+ * page on the first access to each of them after boot. Blocks whose memory
+ * comes from elsewhere are left alone, and so is RAM that will be mapped
+ * from a snapshot: touching it would only unshare its pages. */
+static void ram_block_prefault(RAMBlock *block)
+{
+    ram_addr_t off;
+
+    if (!mem_prefault || hax_enabled() || block->fd >= 0 ||
+        (block->flags & RAM_PREALLOC_MASK) || ram_shared_restore) {
+        return;
+    }
+    for (off = 0; off < block->length; off += RAM_PREFAULT_CHUNK) {
+        RamPrefaultChunk *chunk = g_new(RamPrefaultChunk, 1);
+        chunk->host = block->host + off;
+        chunk->len = MIN(block->length - off, RAM_PREFAULT_CHUNK);
+        thread_pool_post(ram_prefault_task, chunk, THREAD_POOL_PRIORITY_LOW,
+                         THREAD_POOL_ANY_WORKER);
+    }
+}
+
+/* Allocate the host memory of |block|, using huge pages if requested with
+ * -mem-hugepages. KVM maps guest RAM with the host pages that back it, so it
+ * directly benefits from them. HAX populates guest RAM with its own pages
+ * instead, so they can't be used there. */
+static void *ram_block_alloc(RAMBlock *block, ram_addr_t size)
+{
+    if (mem_hugepages && phys_mem_alloc == qemu_anon_ram_alloc) {
+        if (hax_enabled()) {
+            static bool warned;
+            if (!warned) {
+                fprintf(stderr, "-mem-hugepages is ignored with HAX\n");
+                warned = true;
+            }
+        } else {
+            return qemu_anon_ram_alloc_hugepages(size, &block->page_size);
+        }
+    }
+    return phys_mem_alloc(size);
+}
+
 ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
                                    ram_addr_t size, void *host)
 {
@@ -1084,7 +1231,7 @@ ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
             new_block->host = file_ram_alloc(new_block, size, mem_path);
         }
         if (!new_block->host) {
-            new_block->host = phys_mem_alloc(size);
+            new_block->host = ram_block_alloc(new_block, size);
             if (!new_block->host) {
                 fprintf(stderr, "Cannot set up guest memory '%s': %s\n",
                         name, strerror(errno));
@@ -1157,6 +1304,8 @@ ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
     if (kvm_enabled())
         kvm_setup_guest_memory(new_block->host, size);
 
+    ram_block_prefault(new_block);
+
     return new_block->offset;
 }
 
@@ -1232,6 +1381,17 @@ void qemu_ram_remap(ram_addr_t addr, ram_addr_t length)
                 abort();
             } else {
                 flags = MAP_FIXED;
+#ifdef MAP_HUGETLB
+                if (block->page_size) {
+                    /* Huge pages can only be replaced as a whole. */
+                    ram_addr_t start = offset & ~(block->page_size - 1);
+                    length = QEMU_ALIGN_UP(offset + length,
+                                           block->page_size) - start;
+                    offset = start;
+                    vaddr = block->host + offset;
+                    flags |= MAP_HUGETLB;
+                }
+#endif
                 munmap(vaddr, length);
                 if (block->fd >= 0) {
 #ifdef MAP_POPULATE
@@ -1269,6 +1429,147 @@ void qemu_ram_remap(ram_addr_t addr, ram_addr_t length)
 }
 #endif /* !_WIN32 */
 
+#ifdef __linux__
+/* Return an estimate of the number of bytes of [start, end) backed by
+ * transparent huge pages, according to /proc/self/smaps. Mappings that
+ * only partly overlap the range are accounted proportionally. */
+static uint64_t ram_host_thp_bytes(uintptr_t start, uintptr_t end)
+{
+    FILE *f = fopen("/proc/self/smaps", "r");
+    char line[1024];
+    char perms[8];
+    unsigned long vma_start = 0, vma_end = 0;
+    unsigned long lo, hi, kb;
+    double total = 0;
+
+    if (!f) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%lx-%lx %7s ", &lo, &hi, perms) == 3) {
+            vma_start = lo;
+            vma_end = hi;
+        } else if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 && kb) {
+            lo = MAX(vma_start, start);
+            hi = MIN(vma_end, end);
+            if (lo < hi) {
+                total += (double)kb * 1024 * (hi - lo) / (vma_end - vma_start);
+            }
+        }
+    }
+    fclose(f);
+    return (uint64_t)total;
+}
+#endif
+
+void qemu_ram_dump_page_stats(void (*write)(void *opaque, const char *line),
+                              void *opaque)
+{
+    /* Transparent huge pages are always 2 MB on the supported hosts. */
+    const uint64_t thp_size = 2 * 1024 * 1024;
+    const uint64_t small_size = qemu_real_host_page_size;
+    uint64_t entries = 0, small_entries = 0;
+    RAMBlock *block;
+    char line[256];
+
+    qemu_mutex_lock_ramlist();
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        uint64_t length = block->length;
+        uint64_t huge = 0;
+
+        if (block->page_size) {
+            snprintf(line, sizeof(line),
+                     "%-24s %6" PRIu64 " MB, %u KB pages\r\n",
+                     block->idstr, length >> 20,
+                     (unsigned)(block->page_size >> 10));
+            entries += (length + block->page_size - 1) / block->page_size;
+        } else {
+#ifdef __linux__
+            huge = ram_host_thp_bytes((uintptr_t)block->host,
+                                      (uintptr_t)block->host + length);
+            huge &= ~(thp_size - 1);
+#endif
+            snprintf(line, sizeof(line),
+                     "%-24s %6" PRIu64 " MB, %" PRIu64 " MB in transparent "
+                     "huge pages\r\n",
+                     block->idstr, length >> 20, huge >> 20);
+            entries += huge / thp_size +
+                       (length - huge + small_size - 1) / small_size;
+        }
+        small_entries += (length + small_size - 1) / small_size;
+        write(opaque, line);
+    }
+    qemu_mutex_unlock_ramlist();
+
+    snprintf(line, sizeof(line),
+             "TLB entries needed to map all guest RAM: %" PRIu64
+             ", instead of %" PRIu64 " with %" PRIu64 " KB pages\r\n",
+             entries, small_entries, small_size >> 10);
+    write(opaque, line);
+}
+
+/* Release the |len| bytes of host memory at |host|, whose content is no
+ * longer needed. Return 0 on success, -1 otherwise. */
+static int ram_discard_host(void *host, size_t len)
+{
+#ifdef _WIN32
+    /* The pages are only freed when the host needs memory, and keep
+     * undefined content in the meantime, which is fine for free pages. */
+    return VirtualAlloc(host, len, MEM_RESET, PAGE_READWRITE) ? 0 : -1;
+#else
+    return qemu_madvise(host, len, QEMU_MADV_DONTNEED);
+#endif
+}
+
+int64_t qemu_ram_discard_range(hwaddr addr, hwaddr len)
+{
+    hwaddr end = (addr + len) & TARGET_PAGE_MASK;
+    int64_t done = 0;
+
+#ifdef _WIN32
+    if (hax_enabled()) {
+        return -1;
+    }
+#else
+    if (hax_enabled() || QEMU_MADV_DONTNEED == QEMU_MADV_INVALID) {
+        return -1;
+    }
+#endif
+
+    addr = (addr + TARGET_PAGE_SIZE - 1) & TARGET_PAGE_MASK;
+    while (addr < end) {
+        ram_addr_t pd = cpu_get_physical_page_desc(addr);
+        ram_addr_t ram_addr = pd & TARGET_PAGE_MASK;
+        RAMBlock *block;
+        hwaddr run;
+
+        if ((pd & ~TARGET_PAGE_MASK) != IO_MEM_RAM) {
+            addr += TARGET_PAGE_SIZE;
+            continue;
+        }
+
+        /* Extend the run over the following pages of the same block. */
+        block = qemu_get_ram_block(ram_addr);
+        run = TARGET_PAGE_SIZE;
+        while (addr + run < end &&
+               ram_addr + run - block->offset < block->length &&
+               cpu_get_physical_page_desc(addr + run) ==
+                       ((ram_addr + run) | IO_MEM_RAM)) {
+            run += TARGET_PAGE_SIZE;
+        }
+
+        if ((block->flags & RAM_PREALLOC_MASK) == 0 && block->fd < 0 &&
+            ram_discard_host(block->host + (ram_addr - block->offset),
+                             run) == 0) {
+            /* The content changed behind the back of dirty tracking. */
+            cpu_physical_memory_set_dirty_range(ram_addr, run);
+            done += run;
+        }
+        addr += run;
+    }
+    return done;
+}
+
 /* Return a host pointer to ram allocated with qemu_ram_alloc.
    With the exception of the softmmu code in this file, this should
    only be used for local memory (e.g. video ram) that the device owns,
@@ -1294,6 +1595,9 @@ void *qemu_get_ram_ptr(ram_addr_t addr)
         }
     }
 #endif
+    if (unlikely(ram_lazy_remaining)) {
+        ram_lazy_load_page(block, addr - block->offset);
+    }
     return block->host + (addr - block->offset);
 }
 
@@ -1306,6 +1610,9 @@ void *qemu_safe_ram_ptr(ram_addr_t addr)
 
     QTAILQ_FOREACH(block, &ram_list.blocks, next) {
         if (addr - block->offset < block->length) {
+            if (unlikely(ram_lazy_remaining)) {
+                ram_lazy_load_page(block, addr - block->offset);
+            }
             return block->host + (addr - block->offset);
         }
     }
@@ -1459,7 +1766,7 @@ static void notdirty_mem_writew(void *opaque, hwaddr ram_addr,
                                 uint32_t val)
 {
     if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
-        tb_invalidate_phys_page_fast0(ram_addr, 1);
+        tb_invalidate_phys_page_fast0(ram_addr, 2);
     }
     stw_p(qemu_get_ram_ptr(ram_addr), val);
     cpu_physical_memory_set_dirty_flag(ram_addr, DIRTY_MEMORY_MIGRATION);
@@ -1476,7 +1783,7 @@ static void notdirty_mem_writel(void *opaque, hwaddr ram_addr,
                                 uint32_t val)
 {
     if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
-        tb_invalidate_phys_page_fast0(ram_addr, 1);
+        tb_invalidate_phys_page_fast0(ram_addr, 4);
     }
     stl_p(qemu_get_ram_ptr(ram_addr), val);
     cpu_physical_memory_set_dirty_flag(ram_addr, DIRTY_MEMORY_MIGRATION);
@@ -1858,6 +1858,202 @@ static float32 subFloat32Sigs( float32 a, float32 b, flag zSign STATUS_PARAM)
 
 }
 
+/*----------------------------------------------------------------------------
+| Host floating-point fast paths.
+|
+| Computing basic operations with the host FPU gives exactly the IEEE result
+| as long as the host rounds to nearest even without excess precision, which
+| it does by default with SSE2 or VFP, and the operation can't raise any
+| exception flag that isn't already set.  In practice, the inexact flag is set
+| by the first inexact operation the guest does, and sticks until the guest
+| clears it; then, any operation whose inputs are zero or normal and whose
+| result is normal only ever raises inexact.  Everything else, i.e. NaNs,
+| infinities, denormals, overflow, underflow or other rounding modes, goes
+| through softfloat as before.
+*----------------------------------------------------------------------------*/
+#if defined(__FLT_EVAL_METHOD__) && __FLT_EVAL_METHOD__ == 0
+#define USE_HOST_FLOAT 1
+#else
+#define USE_HOST_FLOAT 0
+#endif
+
+typedef union {
+    float32 s;
+    float h;
+} host_float32;
+
+typedef union {
+    float64 s;
+    double h;
+} host_float64;
+
+static inline flag host_float_allowed(float_status *status)
+{
+    return USE_HOST_FLOAT &&
+           STATUS(float_rounding_mode) == float_round_nearest_even &&
+           (STATUS(float_exception_flags) & float_flag_inexact);
+}
+
+static inline flag float32_is_zero_or_normal_exp(float32 a)
+{
+    uint32_t exp = (float32_val(a) >> 23) & 0xff;
+
+    return (exp != 0 && exp != 0xff) || (float32_val(a) << 1) == 0;
+}
+
+static inline flag float32_is_normal_exp(float32 a)
+{
+    uint32_t exp = (float32_val(a) >> 23) & 0xff;
+
+    return exp != 0 && exp != 0xff;
+}
+
+static inline flag float64_is_zero_or_normal_exp(float64 a)
+{
+    uint64_t exp = (float64_val(a) >> 52) & 0x7ff;
+
+    return (exp != 0 && exp != 0x7ff) || (float64_val(a) << 1) == 0;
+}
+
+static inline flag float64_is_normal_exp(float64 a)
+{
+    uint64_t exp = (float64_val(a) >> 52) & 0x7ff;
+
+    return exp != 0 && exp != 0x7ff;
+}
+
+enum {
+    host_float_add,
+    host_float_sub,
+    host_float_mul,
+    host_float_div
+};
+
+/* Try computing |op| on |a| and |b| with the host FPU. Return 1 and set |*r|
+ * on success, 0 if softfloat must be used. */
+static inline flag float32_host_op(int op, float32 a, float32 b, float32 *r
+                                   STATUS_PARAM)
+{
+    host_float32 ua, ub, ur;
+    flag aZero, bZero, zeroOk;
+
+    if (!host_float_allowed(status) ||
+        !float32_is_zero_or_normal_exp(a) ||
+        !float32_is_zero_or_normal_exp(b)) {
+        return 0;
+    }
+    ua.s = a;
+    ub.s = b;
+    aZero = (float32_val(a) << 1) == 0;
+    bZero = (float32_val(b) << 1) == 0;
+    switch (op) {
+    case host_float_add:
+        ur.h = ua.h + ub.h;
+        zeroOk = aZero && bZero;
+        break;
+    case host_float_sub:
+        ur.h = ua.h - ub.h;
+        zeroOk = aZero && bZero;
+        break;
+    case host_float_mul:
+        ur.h = ua.h * ub.h;
+        zeroOk = aZero || bZero;
+        break;
+    default:
+        /* Division by zero raises its own flag. */
+        if (bZero) {
+            return 0;
+        }
+        ur.h = ua.h / ub.h;
+        zeroOk = aZero;
+        break;
+    }
+    /* A zero result is exact only if it comes from zero inputs; a tiny,
+     * infinite or NaN result needs the flags and special cases of
+     * softfloat. */
+    if (!float32_is_normal_exp(ur.s) &&
+        !(zeroOk && (float32_val(ur.s) << 1) == 0)) {
+        return 0;
+    }
+    *r = ur.s;
+    return 1;
+}
+
+static inline flag float64_host_op(int op, float64 a, float64 b, float64 *r
+                                   STATUS_PARAM)
+{
+    host_float64 ua, ub, ur;
+    flag aZero, bZero, zeroOk;
+
+    if (!host_float_allowed(status) ||
+        !float64_is_zero_or_normal_exp(a) ||
+        !float64_is_zero_or_normal_exp(b)) {
+        return 0;
+    }
+    ua.s = a;
+    ub.s = b;
+    aZero = (float64_val(a) << 1) == 0;
+    bZero = (float64_val(b) << 1) == 0;
+    switch (op) {
+    case host_float_add:
+        ur.h = ua.h + ub.h;
+        zeroOk = aZero && bZero;
+        break;
+    case host_float_sub:
+        ur.h = ua.h - ub.h;
+        zeroOk = aZero && bZero;
+        break;
+    case host_float_mul:
+        ur.h = ua.h * ub.h;
+        zeroOk = aZero || bZero;
+        break;
+    default:
+        if (bZero) {
+            return 0;
+        }
+        ur.h = ua.h / ub.h;
+        zeroOk = aZero;
+        break;
+    }
+    if (!float64_is_normal_exp(ur.s) &&
+        !(zeroOk && (float64_val(ur.s) << 1) == 0)) {
+        return 0;
+    }
+    *r = ur.s;
+    return 1;
+}
+
+/* Square roots of positive normal numbers are always normal. */
+static inline flag float32_host_sqrt(float32 a, float32 *r STATUS_PARAM)
+{
+    host_float32 ua, ur;
+
+    if (!host_float_allowed(status) ||
+        !float32_is_zero_or_normal_exp(a) ||
+        (extractFloat32Sign(a) && (float32_val(a) << 1) != 0)) {
+        return 0;
+    }
+    ua.s = a;
+    ur.h = __builtin_sqrtf(ua.h);
+    *r = ur.s;
+    return 1;
+}
+
+static inline flag float64_host_sqrt(float64 a, float64 *r STATUS_PARAM)
+{
+    host_float64 ua, ur;
+
+    if (!host_float_allowed(status) ||
+        !float64_is_zero_or_normal_exp(a) ||
+        (extractFloat64Sign(a) && (float64_val(a) << 1) != 0)) {
+        return 0;
+    }
+    ua.s = a;
+    ur.h = __builtin_sqrt(ua.h);
+    *r = ur.s;
+    return 1;
+}
+
 /*----------------------------------------------------------------------------
 | Returns the result of adding the single-precision floating-point values `a'
 | and `b'.  The operation is performed according to the IEC/IEEE Standard for
@@ -1867,6 +2063,11 @@ static float32 subFloat32Sigs( float32 a, float32 b, flag zSign STATUS_PARAM)
 float32 float32_add( float32 a, float32 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    float32 r;
+
+    if (float32_host_op(host_float_add, a, b, &r STATUS_VAR)) {
+        return r;
+    }
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1890,6 +2091,11 @@ float32 float32_add( float32 a, float32 b STATUS_PARAM )
 float32 float32_sub( float32 a, float32 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    float32 r;
+
+    if (float32_host_op(host_float_sub, a, b, &r STATUS_VAR)) {
+        return r;
+    }
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1913,11 +2119,15 @@ float32 float32_sub( float32 a, float32 b STATUS_PARAM )
 float32 float32_mul( float32 a, float32 b STATUS_PARAM )
 {
     flag aSign, bSign, zSign;
+    float32 r;
     int_fast16_t aExp, bExp, zExp;
     uint32_t aSig, bSig;
     uint64_t zSig64;
     uint32_t zSig;
 
+    if (float32_host_op(host_float_mul, a, b, &r STATUS_VAR)) {
+        return r;
+    }
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1976,8 +2186,13 @@ float32 float32_mul( float32 a, float32 b STATUS_PARAM )
 float32 float32_div( float32 a, float32 b STATUS_PARAM )
 {
     flag aSign, bSign, zSign;
+    float32 r;
     int_fast16_t aExp, bExp, zExp;
     uint32_t aSig, bSig, zSig;
+
+    if (float32_host_op(host_float_div, a, b, &r STATUS_VAR)) {
+        return r;
+    }
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -2348,9 +2563,14 @@ float32 float32_muladd(float32 a, float32 b, float32 c, int flags STATUS_PARAM)
 float32 float32_sqrt( float32 a STATUS_PARAM )
 {
     flag aSign;
+    float32 r;
     int_fast16_t aExp, zExp;
     uint32_t aSig, zSig;
     uint64_t rem, term;
+
+    if (float32_host_sqrt(a, &r STATUS_VAR)) {
+        return r;
+    }
     a = float32_squash_input_denormal(a STATUS_VAR);
 
     aSig = extractFloat32Frac( a );
@@ -3430,6 +3650,11 @@ static float64 subFloat64Sigs( float64 a, float64 b, flag zSign STATUS_PARAM )
 float64 float64_add( float64 a, float64 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    float64 r;
+
+    if (float64_host_op(host_float_add, a, b, &r STATUS_VAR)) {
+        return r;
+    }
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3453,6 +3678,11 @@ float64 float64_add( float64 a, float64 b STATUS_PARAM )
 float64 float64_sub( float64 a, float64 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    float64 r;
+
+    if (float64_host_op(host_float_sub, a, b, &r STATUS_VAR)) {
+        return r;
+    }
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3476,9 +3706,13 @@ float64 float64_sub( float64 a, float64 b STATUS_PARAM )
 float64 float64_mul( float64 a, float64 b STATUS_PARAM )
 {
     flag aSign, bSign, zSign;
+    float64 r;
     int_fast16_t aExp, bExp, zExp;
     uint64_t aSig, bSig, zSig0, zSig1;
 
+    if (float64_host_op(host_float_mul, a, b, &r STATUS_VAR)) {
+        return r;
+    }
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3537,10 +3771,15 @@ float64 float64_mul( float64 a, float64 b STATUS_PARAM )
 float64 float64_div( float64 a, float64 b STATUS_PARAM )
 {
     flag aSign, bSign, zSign;
+    float64 r;
     int_fast16_t aExp, bExp, zExp;
     uint64_t aSig, bSig, zSig;
     uint64_t rem0, rem1;
     uint64_t term0, term1;
+
+    if (float64_host_op(host_float_div, a, b, &r STATUS_VAR)) {
+        return r;
+    }
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3921,9 +4160,14 @@ float64 float64_muladd(float64 a, float64 b, float64 c, int flags STATUS_PARAM)
 float64 float64_sqrt( float64 a STATUS_PARAM )
 {
     flag aSign;
+    float64 r;
     int_fast16_t aExp, zExp;
     uint64_t aSig, zSig, doubleZSig;
     uint64_t rem0, rem1, term0, term1;
+
+    if (float64_host_sqrt(a, &r STATUS_VAR)) {
+        return r;
+    }
     a = float64_squash_input_denormal(a STATUS_VAR);
 
     aSig = extractFloat64Frac( a );
@@ -124,6 +124,7 @@ static void android_arm_init_(ram_addr_t ram_size,
     goldfish_add_device_no_io(&nand_device);
     nand_dev_init(nand_device.base);
 #endif
+    goldfish_block_init();
 
     trace_dev_init();
 
@@ -131,6 +132,15 @@ static void android_arm_init_(ram_addr_t ram_size,
             (androidHwConfig_getKernelDeviceNaming(android_hw) >= 1);
     pipe_dev_init(newDeviceNaming);
 
+    /* Map the memory shared with the GPU emulation right above the RAM,
+     * below the goldfish devices. */
+    if (android_hw->hw_gpu_enabled) {
+        uint32_t shared_base = (ram_size + 0xfffff) & ~0xfffff;
+        if (shared_base + (uint64_t)GOLDFISH_ADDRESS_SPACE_SIZE <= 0xff000000) {
+            goldfish_address_space_init(shared_base);
+        }
+    }
+
     memset(&info, 0, sizeof info);
     info.ram_size        = ram_size;
     info.kernel_filename = kernel_filename;
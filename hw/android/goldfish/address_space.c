@@ -0,0 +1,109 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* The goldfish_address_space device exposes a region of memory that is
+ * visible to both the guest and the host renderer. The guest driver maps
+ * it, reading its physical address and size from the registers below, and
+ * hands out pieces of it to gralloc. Software-rendered color buffers bound
+ * to such a piece with the rcBindColorBufferSharedMemory renderControl
+ * command are then written and read in place by the guest, and only the
+ * changed rows are transferred to the GPU, instead of copying each frame
+ * through the opengles pipe.
+ *
+ * The region is regular guest RAM, so it is saved in snapshots along with
+ * the rest of it, and the device itself has no other state.
+ */
+
+#include "cpu.h"
+#include "exec/ram_addr.h"
+#include "hw/android/goldfish/device.h"
+#include "hw/hw.h"
+#include "android/opengles.h"
+
+enum {
+    /* read-only: physical address of the shared region */
+    ADDRESS_SPACE_START_LOW     = 0x00,
+    ADDRESS_SPACE_START_HIGH    = 0x04,
+    /* read-only: size of the shared region in bytes */
+    ADDRESS_SPACE_SIZE_LOW      = 0x08,
+    ADDRESS_SPACE_SIZE_HIGH     = 0x0c,
+};
+
+struct goldfish_address_space_state {
+    struct goldfish_device dev;
+    uint64_t start;
+    uint64_t size;
+};
+
+static uint32_t goldfish_address_space_read(void *opaque, hwaddr offset)
+{
+    struct goldfish_address_space_state *s = opaque;
+
+    switch (offset) {
+        case ADDRESS_SPACE_START_LOW:
+            return (uint32_t)s->start;
+        case ADDRESS_SPACE_START_HIGH:
+            return (uint32_t)(s->start >> 32);
+        case ADDRESS_SPACE_SIZE_LOW:
+            return (uint32_t)s->size;
+        case ADDRESS_SPACE_SIZE_HIGH:
+            return (uint32_t)(s->size >> 32);
+
+        default:
+            cpu_abort(cpu_single_env,
+                      "goldfish_address_space_read: Bad offset %" HWADDR_PRIx "\n",
+                      offset);
+            return 0;
+    }
+}
+
+static void goldfish_address_space_write(void *opaque, hwaddr offset,
+                                         uint32_t val)
+{
+    cpu_abort(cpu_single_env,
+              "goldfish_address_space_write: Bad offset %" HWADDR_PRIx "\n",
+              offset);
+}
+
+static CPUReadMemoryFunc *goldfish_address_space_readfn[] = {
+    goldfish_address_space_read,
+    goldfish_address_space_read,
+    goldfish_address_space_read
+};
+
+static CPUWriteMemoryFunc *goldfish_address_space_writefn[] = {
+    goldfish_address_space_write,
+    goldfish_address_space_write,
+    goldfish_address_space_write
+};
+
+void goldfish_address_space_init(uint32_t base)
+{
+    struct goldfish_address_space_state *s;
+    ram_addr_t ram_offset;
+
+    s = (struct goldfish_address_space_state *)g_malloc0(sizeof(*s));
+    s->dev.name = "goldfish_address_space";
+    s->dev.base = 0;    // will be allocated dynamically
+    s->dev.size = 0x1000;
+    s->dev.irq_count = 0;
+    s->start = base;
+    s->size = GOLDFISH_ADDRESS_SPACE_SIZE;
+
+    ram_offset = qemu_ram_alloc(NULL, "goldfish_address_space", s->size);
+    cpu_register_physical_memory(base, s->size, ram_offset | IO_MEM_RAM);
+
+    goldfish_device_add(&s->dev, goldfish_address_space_readfn,
+                        goldfish_address_space_writefn, s);
+
+    android_setOpenglesSharedMemory(qemu_get_ram_ptr(ram_offset), s->size);
+}
@@ -61,12 +61,32 @@ enum {
     AUDIO_SET_WRITE_BUFFER_2_HIGH = 0x30,
     AUDIO_SET_READ_BUFFER_HIGH = 0x34,
 
+    /* ring buffer output, see the comment above goldfish_audio_ring_send() */
+    AUDIO_SET_RING_BUFFER      = 0x38,
+    AUDIO_SET_RING_BUFFER_HIGH = 0x3C,
+    /* set ring buffer size in bytes, a power of 2, or 0 to disable it */
+    AUDIO_SET_RING_SIZE        = 0x40,
+    /* set number of bytes between two ring period interrupts */
+    AUDIO_SET_RING_PERIOD      = 0x44,
+    /* driver writes the number of bytes it wrote to the ring so far */
+    AUDIO_RING_WRITE_PTR       = 0x48,
+    /* number of bytes consumed from the ring so far */
+    AUDIO_RING_READ_PTR        = 0x4C,
+    /* true if ring buffer output is supported */
+    AUDIO_RING_SUPPORTED       = 0x50,
+
     /* AUDIO_INT_STATUS bits */
 
     /* this bit set when it is safe to write more bytes to the buffer */
     AUDIO_INT_WRITE_BUFFER_1_EMPTY = 1U << 0,
     AUDIO_INT_WRITE_BUFFER_2_EMPTY = 1U << 1,
     AUDIO_INT_READ_BUFFER_FULL     = 1U << 2,
+    /* this bit set each time a period of the ring buffer has been consumed */
+    AUDIO_INT_RING_PERIOD          = 1U << 3,
+
+    AUDIO_INT_OUTPUT_MASK = AUDIO_INT_WRITE_BUFFER_1_EMPTY |
+                            AUDIO_INT_WRITE_BUFFER_2_EMPTY |
+                            AUDIO_INT_RING_PERIOD,
 };
 
 struct goldfish_audio_buff {
@@ -109,6 +129,16 @@ struct goldfish_audio_state {
     struct goldfish_audio_buff  out_buff2[1];
     struct goldfish_audio_buff  in_buff[1];
 
+    // ring buffer output, used instead of the buffers above when size != 0
+    uint64_t ring_address;
+    uint32_t ring_size;
+    uint32_t ring_period;
+    // free-running byte counters
+    uint32_t ring_write_ptr;
+    uint32_t ring_read_ptr;
+    // bytes consumed since the last period interrupt
+    uint32_t ring_period_bytes;
+
     // for QEMU sound output
     QEMUSoundCard card;
     SWVoiceOut *voice;
@@ -195,6 +225,55 @@ goldfish_audio_buff_send( struct goldfish_audio_buff*  b, int  free, struct gold
     return ret;
 }
 
+/* In ring buffer mode, the driver allocates a single circular buffer of
+ * ring_size bytes in guest memory, and writes samples to it at its own pace,
+ * reporting the total number of bytes written so far in RING_WRITE_PTR.
+ * Samples are handed to the audio layer straight from guest memory, and
+ * RING_READ_PTR reports the total number of bytes consumed so far. Instead of
+ * one interrupt per buffer, a single AUDIO_INT_RING_PERIOD interrupt is
+ * raised each time ring_period bytes have been consumed.
+ */
+static int
+goldfish_audio_ring_send( struct goldfish_audio_state*  s, int  free )
+{
+    int  total = 0;
+
+    while (free > 0) {
+        uint32_t  avail  = s->ring_write_ptr - s->ring_read_ptr;
+        uint32_t  offset = s->ring_read_ptr & (s->ring_size - 1);
+        uint32_t  chunk;
+        hwaddr    len;
+        void*     data;
+        int       ret;
+
+        if (avail == 0)
+            break;
+        if (avail > s->ring_size) {
+            /* the driver overran its own ring, play what is left */
+            avail = s->ring_size;
+        }
+        chunk = s->ring_size - offset;
+        if (chunk > avail)
+            chunk = avail;
+        if (chunk > (uint32_t)free)
+            chunk = free;
+
+        len  = chunk;
+        data = cpu_physical_memory_map(s->ring_address + offset, &len, 0);
+        if (data == NULL)
+            break;
+        ret = AUD_write(s->voice, data, len);
+        cpu_physical_memory_unmap(data, len, 0, ret);
+
+        s->ring_read_ptr += ret;
+        free  -= ret;
+        total += ret;
+        if ((hwaddr)ret < len)
+            break;
+    }
+    return total;
+}
+
 static int
 goldfish_audio_buff_available( struct goldfish_audio_buff*  b )
 {
@@ -222,7 +301,7 @@ goldfish_audio_buff_recv( struct goldfish_audio_buff*  b, int  avail, struct gol
 }
 
 /* update this whenever you change the goldfish_audio_state structure */
-#define  AUDIO_STATE_SAVE_VERSION  3
+#define  AUDIO_STATE_SAVE_VERSION  4
 
 #define  QFIELD_STRUCT   struct goldfish_audio_state
 QFIELD_BEGIN(audio_state_fields)
@@ -244,7 +323,7 @@ goldfish_audio_buff_put( struct goldfish_audio_buff*  b, QEMUFile*  f )
 static void
 goldfish_audio_buff_get( struct goldfish_audio_buff*  b, QEMUFile*  f, int version_id )
 {
-    if (version_id ==  (AUDIO_STATE_SAVE_VERSION - 1))
+    if (version_id == 2)
         b->address = (uint64_t)qemu_get_be32(f);
     else
         b->address = qemu_get_be64(f);
@@ -263,6 +342,13 @@ static void  audio_state_save( QEMUFile*  f, void* opaque )
     goldfish_audio_buff_put (s->out_buff1, f);
     goldfish_audio_buff_put (s->out_buff2, f);
     goldfish_audio_buff_put (s->in_buff, f);
+
+    qemu_put_be64(f, s->ring_address);
+    qemu_put_be32(f, s->ring_size);
+    qemu_put_be32(f, s->ring_period);
+    qemu_put_be32(f, s->ring_write_ptr);
+    qemu_put_be32(f, s->ring_read_ptr);
+    qemu_put_be32(f, s->ring_period_bytes);
 }
 
 static int   audio_state_load( QEMUFile*  f, void*  opaque, int  version_id )
@@ -270,8 +356,7 @@ static int   audio_state_load( QEMUFile*  f, void*  opaque, int  version_id )
     struct goldfish_audio_state*  s = opaque;
     int                           ret;
 
-    if ((version_id != AUDIO_STATE_SAVE_VERSION) && 
-        (version_id != (AUDIO_STATE_SAVE_VERSION - 1))) {
+    if (version_id < 2 || version_id > AUDIO_STATE_SAVE_VERSION) {
         return -1;
     }
     ret = qemu_get_struct(f, audio_state_fields, s);
@@ -280,10 +365,20 @@ static int   audio_state_load( QEMUFile*  f, void*  opaque, int  version_id )
         goldfish_audio_buff_get( s->out_buff2, f, version_id);
         goldfish_audio_buff_get (s->in_buff, f, version_id);
     }
+    if (!ret && version_id >= 4) {
+        s->ring_address      = qemu_get_be64(f);
+        s->ring_size         = qemu_get_be32(f);
+        s->ring_period       = qemu_get_be32(f);
+        s->ring_write_ptr    = qemu_get_be32(f);
+        s->ring_read_ptr     = qemu_get_be32(f);
+        s->ring_period_bytes = qemu_get_be32(f);
+    } else {
+        s->ring_size = 0;
+    }
 
     // Similar to enable_audio - without the buffer reset.
     if (s->voice != NULL) {
-        AUD_set_active_out(s->voice,  (s->int_enable & (AUDIO_INT_WRITE_BUFFER_1_EMPTY | AUDIO_INT_WRITE_BUFFER_2_EMPTY)) != 0);
+        AUD_set_active_out(s->voice,  (s->int_enable & AUDIO_INT_OUTPUT_MASK) != 0);
     }
     if (s->voicein) {
         AUD_set_active_in(s->voicein, (s->int_enable & AUDIO_INT_READ_BUFFER_FULL) != 0);
@@ -298,9 +393,10 @@ static void enable_audio(struct goldfish_audio_state *s, int enable)
 {
     // enable or disable the output voice
     if (s->voice != NULL) {
-        AUD_set_active_out(s->voice,   (enable & (AUDIO_INT_WRITE_BUFFER_1_EMPTY | AUDIO_INT_WRITE_BUFFER_2_EMPTY)) != 0);
+        AUD_set_active_out(s->voice,   (enable & AUDIO_INT_OUTPUT_MASK) != 0);
         goldfish_audio_buff_reset( s->out_buff1 );
         goldfish_audio_buff_reset( s->out_buff2 );
+        s->ring_period_bytes = 0;
     }
 
     if (s->voicein) {
@@ -401,6 +497,8 @@ static uint32_t goldfish_audio_read(void *opaque, hwaddr offset)
             if(ret) {
                 goldfish_device_set_irq(&s->dev, 0, 0);
             }
+            /* ring period interrupts are acknowledged by reading the status */
+            s->int_status &= ~AUDIO_INT_RING_PERIOD;
             return ret;
 
 	case AUDIO_READ_SUPPORTED:
@@ -418,6 +516,12 @@ static uint32_t goldfish_audio_read(void *opaque, hwaddr offset)
             goldfish_audio_buff_write( s->in_buff );
 	    return s->read_buffer_available;
 
+        case AUDIO_RING_READ_PTR:
+            return s->ring_read_ptr;
+
+        case AUDIO_RING_SUPPORTED:
+            return (s->voice != NULL);
+
         default:
             cpu_abort(cpu_single_env,
                       "goldfish_audio_read: Bad offset %" HWADDR_PRIx "\n",
@@ -495,6 +599,38 @@ static void goldfish_audio_write(void *opaque, hwaddr offset, uint32_t val)
             D( "%s: AUDIO_SET_READ_BUFFER_HIGH %08x", __FUNCTION__, val );
             break;
 
+        case AUDIO_SET_RING_BUFFER:
+            D( "%s: AUDIO_SET_RING_BUFFER %08x", __FUNCTION__, val );
+            uint64_set_low(&s->ring_address, val);
+            break;
+
+        case AUDIO_SET_RING_BUFFER_HIGH:
+            D( "%s: AUDIO_SET_RING_BUFFER_HIGH %08x", __FUNCTION__, val );
+            uint64_set_high(&s->ring_address, val);
+            break;
+
+        case AUDIO_SET_RING_SIZE:
+            /* (re)starting the ring resets its pointers */
+            D( "%s: AUDIO_SET_RING_SIZE %d", __FUNCTION__, val );
+            if (val & (val - 1)) {
+                dprint("goldfish_audio: ignoring ring size %u, not a power of 2\n", val);
+                val = 0;
+            }
+            s->ring_size         = val;
+            s->ring_write_ptr    = 0;
+            s->ring_read_ptr     = 0;
+            s->ring_period_bytes = 0;
+            break;
+
+        case AUDIO_SET_RING_PERIOD:
+            D( "%s: AUDIO_SET_RING_PERIOD %d", __FUNCTION__, val );
+            s->ring_period = val;
+            break;
+
+        case AUDIO_RING_WRITE_PTR:
+            s->ring_write_ptr = val;
+            break;
+
         default:
             cpu_abort(cpu_single_env,
                       "goldfish_audio_write: Bad offset %" HWADDR_PRIx "\n",
@@ -507,6 +643,18 @@ static void goldfish_audio_callback(void *opaque, int free)
     struct goldfish_audio_state *s = opaque;
     int new_status = 0;
 
+    if (s->ring_size) {
+        int  written = goldfish_audio_ring_send( s, free );
+
+        /* only interrupt the driver at period boundaries */
+        s->ring_period_bytes += written;
+        if (s->ring_period && s->ring_period_bytes >= s->ring_period) {
+            s->ring_period_bytes %= s->ring_period;
+            new_status |= AUDIO_INT_RING_PERIOD;
+        }
+        free = 0;
+    }
+
     /* loop until free is zero or both buffers are empty */
     while (free && s->current_buffer) {
 
@@ -0,0 +1,727 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* The goldfish_block device is a paravirtual disk, used instead of NAND for
+ * the ext4 partitions when the emulator is started with -block-device.
+ *
+ * The NAND device performs one synchronous transfer per register write,
+ * and the MMC device one multi-block command at a time. Here the guest
+ * driver posts requests in a ring in guest memory, each with a table of
+ * scatter-gather segments, and notifies the device with a single register
+ * write for any number of them. All the posted requests are issued at once
+ * to the AIO block layer, directly to or from guest memory, and complete in
+ * any order. Completion interrupts are coalesced.
+ *
+ * All the structures in guest memory are little-endian. The ring, at the
+ * physical address in BLOCK_RING_ADDR, is made of, for a ring size of N
+ * (a power of 2, up to BLOCK_MAX_RING_SIZE):
+ *
+ *   uint32_t avail_idx;      // written by the guest
+ *   uint32_t used_idx;       // written by the device
+ *   uint32_t avail[N];       // slots of the posted requests
+ *   struct {
+ *       uint32_t slot;
+ *       uint32_t status;     // BLOCK_STATUS_XXX
+ *   } used[N];               // completed requests
+ *   request req[N];          // see below
+ *
+ * To post a request, the guest fills req[slot], stores the slot in
+ * avail[avail_idx % N], increments avail_idx, and writes anything to
+ * BLOCK_KICK. The device appends each completed request to the used ring
+ * and increments used_idx. Both indexes are free running. A slot can only
+ * be reused once its request has appeared in the used ring.
+ *
+ * BLOCK_INT_COMPLETION is raised once BLOCK_COALESCE_COUNT requests have
+ * completed since it was last cleared, BLOCK_COALESCE_USEC microseconds
+ * after the first of them, or as soon as no request is in flight anymore.
+ */
+
+#include "cpu.h"
+#include "qemu-common.h"
+#include "migration/qemu-file.h"
+#include "hw/android/goldfish/device.h"
+#include "hw/hw.h"
+#include "android/utils/metrics.h"
+#include "block/aio.h"
+#include "block/block.h"
+#include "sysemu/dma.h"
+#include "qemu/timer.h"
+
+enum {
+    /* read-only: BLOCK_VERSION */
+    BLOCK_VERSION_REG       = 0x00,
+    /* read-only: BLOCK_FLAG_XXX */
+    BLOCK_FLAGS             = 0x04,
+    /* read-only: size of the disk in 512-byte sectors */
+    BLOCK_CAPACITY_LOW      = 0x08,
+    BLOCK_CAPACITY_HIGH     = 0x0c,
+    /* read-only: length of the partition name */
+    BLOCK_NAME_LEN          = 0x10,
+    /* write: copy the partition name, without a terminating zero, to the
+     * guest physical address in BLOCK_NAME_ADDR */
+    BLOCK_GET_NAME          = 0x14,
+    BLOCK_NAME_ADDR_LOW     = 0x18,
+    BLOCK_NAME_ADDR_HIGH    = 0x1c,
+
+    /* read/write: guest physical address of the ring, set before its size */
+    BLOCK_RING_ADDR_LOW     = 0x20,
+    BLOCK_RING_ADDR_HIGH    = 0x24,
+    /* read/write: number of entries of the ring, 0 disables it */
+    BLOCK_RING_SIZE         = 0x28,
+    /* write: new requests were posted in the ring */
+    BLOCK_KICK              = 0x2c,
+
+    /* read: pending interrupts, write: clear these bits */
+    BLOCK_INT_STATUS        = 0x30,
+    /* read/write: interrupts that raise the IRQ */
+    BLOCK_INT_ENABLE        = 0x34,
+    /* read/write: interrupt coalescing parameters, see above. A count of 1
+     * raises an interrupt for each completed request. */
+    BLOCK_COALESCE_COUNT    = 0x38,
+    BLOCK_COALESCE_USEC     = 0x3c,
+};
+
+#define BLOCK_VERSION  1
+
+/* BLOCK_FLAGS bits */
+#define BLOCK_FLAG_READ_ONLY  (1U << 0)
+#define BLOCK_FLAG_FLUSH      (1U << 1)
+#define BLOCK_FLAG_DISCARD    (1U << 2)
+
+/* BLOCK_INT_STATUS bits */
+#define BLOCK_INT_COMPLETION  (1U << 0)
+
+/* Request types */
+#define BLOCK_REQ_READ   0
+#define BLOCK_REQ_WRITE  1
+#define BLOCK_REQ_FLUSH  2
+/* The guest no longer needs the content of the sectors, which are freed in
+ * the image file. They read back as undefined data. */
+#define BLOCK_REQ_DISCARD  3
+
+/* Completion status */
+#define BLOCK_STATUS_OK           0
+#define BLOCK_STATUS_IOERR        1
+#define BLOCK_STATUS_UNSUPPORTED  2
+
+#define BLOCK_MAX_RING_SIZE  256
+#define BLOCK_MAX_SEGMENTS   256
+
+/* Largest number of sectors passed to one bdrv_discard() call */
+#define BLOCK_MAX_DISCARD_SECTORS  (1 << 21)
+
+#define BLOCK_DEFAULT_COALESCE_COUNT  16
+#define BLOCK_DEFAULT_COALESCE_USEC   50
+
+/* A request, at req[slot] in the ring:
+ *
+ *   uint32_t type;           // BLOCK_REQ_XXX
+ *   uint32_t seg_count;      // number of segments, 0 for a flush or
+ *                            // a discard
+ *   uint64_t sector;         // first sector of the transfer
+ *   uint64_t seg_addr;       // guest physical address of the segments
+ *   uint64_t sector_count;   // number of sectors to discard
+ *
+ * Each segment is a { uint64_t addr; uint32_t len; uint32_t reserved; }
+ * range of guest memory, and the length of a transfer is a multiple of 512.
+ */
+#define BLOCK_REQUEST_SIZE       32
+#define BLOCK_REQ_TYPE           0
+#define BLOCK_REQ_SEG_COUNT      4
+#define BLOCK_REQ_SECTOR         8
+#define BLOCK_REQ_SEG_ADDR       16
+#define BLOCK_REQ_SECTOR_COUNT   24
+
+#define BLOCK_SEGMENT_SIZE       16
+#define BLOCK_SEG_ADDR           0
+#define BLOCK_SEG_LEN            8
+
+struct goldfish_block_state;
+
+/* Host side of a request slot */
+typedef struct {
+    struct goldfish_block_state* s;
+    BlockDriverAIOCB* aiocb;
+    QEMUSGList sg;
+    // Set from the time the request is issued until it completes.
+    int busy;
+    int is_write;
+    int64_t start_ns;
+} GoldfishBlockRequest;
+
+struct goldfish_block_state {
+    struct goldfish_device dev;
+    BlockDriverState* bs;
+    char* name;
+    uint64_t name_address;
+
+    uint64_t ring_address;
+    uint32_t ring_size;
+    // Next avail ring entry to read, and next used ring entry to write.
+    uint32_t last_avail;
+    uint32_t used_idx;
+
+    uint32_t int_status;
+    uint32_t int_enable;
+
+    uint32_t coalesce_count;
+    uint32_t coalesce_usec;
+    // Completions since BLOCK_INT_COMPLETION was last raised.
+    uint32_t pending;
+    QEMUTimer* coalesce_timer;
+
+    int in_flight;
+    // Indexed by slot.
+    GoldfishBlockRequest requests[BLOCK_MAX_RING_SIZE];
+};
+
+// Metrics of the reads and writes of all devices, like the MMC ones.
+typedef struct {
+    Metric* ops;
+    Metric* bytes;
+    Metric* latency_us;
+} BlockTransferMetrics;
+
+static BlockTransferMetrics block_transfer_metrics[2];
+static Metric* block_interrupts_metric;
+static Metric* block_discard_metric;
+
+static void goldfish_block_init_metrics(void)
+{
+    static const char* const labels[2] = { "op=\"read\"", "op=\"write\"" };
+    int n;
+
+    if (block_interrupts_metric) {
+        return;
+    }
+    for (n = 0; n < 2; n++) {
+        block_transfer_metrics[n].ops = metrics_counter(
+                "emulator_block_ops_total", labels[n],
+                "goldfish_block transfers");
+        block_transfer_metrics[n].bytes = metrics_counter(
+                "emulator_block_bytes_total", labels[n],
+                "Bytes transferred by goldfish_block transfers");
+        block_transfer_metrics[n].latency_us = metrics_histogram(
+                "emulator_block_op_latency_us", labels[n],
+                "Duration of goldfish_block transfers, in microseconds");
+    }
+    block_interrupts_metric = metrics_counter(
+            "emulator_block_interrupts_total", NULL,
+            "Completion interrupts raised by goldfish_block devices");
+    block_discard_metric = metrics_counter(
+            "emulator_block_discarded_bytes_total", NULL,
+            "Bytes discarded by goldfish_block devices");
+}
+
+/* Offsets in the ring */
+
+static hwaddr goldfish_block_avail(struct goldfish_block_state* s,
+                                   uint32_t idx)
+{
+    return s->ring_address + 8 + 4 * (idx & (s->ring_size - 1));
+}
+
+static hwaddr goldfish_block_used(struct goldfish_block_state* s,
+                                  uint32_t idx)
+{
+    return s->ring_address + 8 + 4 * s->ring_size +
+           8 * (idx & (s->ring_size - 1));
+}
+
+static hwaddr goldfish_block_request(struct goldfish_block_state* s,
+                                     uint32_t slot)
+{
+    return s->ring_address + 8 + 12 * s->ring_size +
+           BLOCK_REQUEST_SIZE * slot;
+}
+
+#ifdef TARGET_I386
+/* There are few IRQs available on x86, so all the devices share the one of
+ * the first device, whose level is the OR of theirs. Bit |id| is set when
+ * the device with this id has an interrupt pending. */
+static uint32_t block_shared_irq_levels;
+#endif
+
+static void goldfish_block_update_irq(struct goldfish_block_state* s)
+{
+    int level = (s->int_status & s->int_enable) != 0;
+
+#ifdef TARGET_I386
+    if (level) {
+        block_shared_irq_levels |= 1U << s->dev.id;
+    } else {
+        block_shared_irq_levels &= ~(1U << s->dev.id);
+    }
+    level = block_shared_irq_levels != 0;
+#endif
+    goldfish_device_set_irq(&s->dev, 0, level);
+}
+
+static void goldfish_block_raise(struct goldfish_block_state* s)
+{
+    timer_del(s->coalesce_timer);
+    s->pending = 0;
+    if (!(s->int_status & BLOCK_INT_COMPLETION)) {
+        metric_add(block_interrupts_metric, 1);
+    }
+    s->int_status |= BLOCK_INT_COMPLETION;
+    goldfish_block_update_irq(s);
+}
+
+static void goldfish_block_coalesce_timer(void* opaque)
+{
+    struct goldfish_block_state* s = opaque;
+
+    if (s->pending) {
+        goldfish_block_raise(s);
+    }
+}
+
+// Appends |slot| to the used ring, and decides whether to interrupt now.
+static void goldfish_block_complete(struct goldfish_block_state* s,
+                                    uint32_t slot,
+                                    uint32_t status)
+{
+    hwaddr used = goldfish_block_used(s, s->used_idx);
+
+    stl_le_phys(used, slot);
+    stl_le_phys(used + 4, status);
+    // The entry must be visible before the index that publishes it.
+    smp_wmb();
+    s->used_idx++;
+    stl_le_phys(s->ring_address + 4, s->used_idx);
+
+    s->pending++;
+    if (s->pending >= s->coalesce_count || s->in_flight == 0 ||
+        s->coalesce_usec == 0) {
+        goldfish_block_raise(s);
+    } else if (s->pending == 1) {
+        timer_mod(s->coalesce_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  (int64_t)s->coalesce_usec * 1000);
+    }
+}
+
+static void goldfish_block_bdrv_done(void* opaque, int ret)
+{
+    GoldfishBlockRequest* req = opaque;
+    struct goldfish_block_state* s = req->s;
+    uint32_t slot = req - s->requests;
+
+    if (req->sg.nsg) {
+        metric_record(block_transfer_metrics[req->is_write].latency_us,
+                      (uint64_t)(get_clock() - req->start_ns) / 1000);
+    }
+    if (ret < 0) {
+        fprintf(stderr, "goldfish_block: %s: I/O error %d\n", s->name, ret);
+    }
+    req->aiocb = NULL;
+    req->busy = 0;
+    qemu_sglist_destroy(&req->sg);
+    s->in_flight--;
+
+    goldfish_block_complete(s, slot,
+                            ret < 0 ? BLOCK_STATUS_IOERR : BLOCK_STATUS_OK);
+}
+
+// Discards are synchronous: punching a hole in a raw image, or clearing
+// L2 entries of a qcow2 one, doesn't wait for data transfers.
+static int goldfish_block_discard(struct goldfish_block_state* s,
+                                  uint64_t sector,
+                                  uint64_t count)
+{
+    uint64_t sector_count;
+
+    bdrv_get_geometry(s->bs, &sector_count);
+    if (sector > sector_count || count > sector_count - sector ||
+        bdrv_is_read_only(s->bs)) {
+        return BLOCK_STATUS_IOERR;
+    }
+    metric_add(block_discard_metric, (int64_t)count * 512);
+    while (count > 0) {
+        int n = count > BLOCK_MAX_DISCARD_SECTORS ? BLOCK_MAX_DISCARD_SECTORS
+                                                  : (int)count;
+        if (bdrv_discard(s->bs, sector, n) < 0) {
+            return BLOCK_STATUS_IOERR;
+        }
+        sector += n;
+        count -= n;
+    }
+    return BLOCK_STATUS_OK;
+}
+
+// Issues the request in |slot|. Returns the status of the request if it
+// completed immediately, or -1 if goldfish_block_bdrv_done() will be called.
+static int goldfish_block_start(struct goldfish_block_state* s, uint32_t slot)
+{
+    GoldfishBlockRequest* req = &s->requests[slot];
+    hwaddr addr = goldfish_block_request(s, slot);
+    uint32_t type = ldl_le_phys(addr + BLOCK_REQ_TYPE);
+    uint32_t seg_count = ldl_le_phys(addr + BLOCK_REQ_SEG_COUNT);
+    uint64_t sector = ldq_le_phys(addr + BLOCK_REQ_SECTOR);
+    hwaddr seg_addr = ldq_le_phys(addr + BLOCK_REQ_SEG_ADDR);
+    uint64_t sector_count;
+    uint32_t n;
+
+    req->s = s;
+    if (type == BLOCK_REQ_DISCARD) {
+        return goldfish_block_discard(s, sector,
+                ldq_le_phys(addr + BLOCK_REQ_SECTOR_COUNT));
+    }
+    qemu_sglist_init(&req->sg, seg_count ? seg_count : 1);
+
+    if (type == BLOCK_REQ_FLUSH) {
+        req->busy = 1;
+        s->in_flight++;
+        req->aiocb = bdrv_aio_flush(s->bs, goldfish_block_bdrv_done, req);
+        if (!req->aiocb) {
+            req->busy = 0;
+            s->in_flight--;
+            qemu_sglist_destroy(&req->sg);
+            return BLOCK_STATUS_IOERR;
+        }
+        return -1;
+    }
+    if (type != BLOCK_REQ_READ && type != BLOCK_REQ_WRITE) {
+        qemu_sglist_destroy(&req->sg);
+        return BLOCK_STATUS_UNSUPPORTED;
+    }
+
+    if (seg_count == 0 || seg_count > BLOCK_MAX_SEGMENTS) {
+        qemu_sglist_destroy(&req->sg);
+        return BLOCK_STATUS_IOERR;
+    }
+    for (n = 0; n < seg_count; n++) {
+        hwaddr seg = seg_addr + n * BLOCK_SEGMENT_SIZE;
+        qemu_sglist_add(&req->sg, ldq_le_phys(seg + BLOCK_SEG_ADDR),
+                        ldl_le_phys(seg + BLOCK_SEG_LEN));
+    }
+
+    bdrv_get_geometry(s->bs, &sector_count);
+    if ((req->sg.size & 511) || sector > sector_count ||
+        (req->sg.size >> 9) > sector_count - sector ||
+        (type == BLOCK_REQ_WRITE && bdrv_is_read_only(s->bs))) {
+        qemu_sglist_destroy(&req->sg);
+        return BLOCK_STATUS_IOERR;
+    }
+
+    req->is_write = (type == BLOCK_REQ_WRITE);
+    req->start_ns = get_clock();
+    metric_add(block_transfer_metrics[req->is_write].ops, 1);
+    metric_add(block_transfer_metrics[req->is_write].bytes, req->sg.size);
+
+    req->busy = 1;
+    s->in_flight++;
+    if (req->is_write) {
+        req->aiocb = dma_bdrv_write(s->bs, &req->sg, sector,
+                                    goldfish_block_bdrv_done, req);
+    } else {
+        req->aiocb = dma_bdrv_read(s->bs, &req->sg, sector,
+                                   goldfish_block_bdrv_done, req);
+    }
+    if (!req->aiocb) {
+        req->busy = 0;
+        s->in_flight--;
+        qemu_sglist_destroy(&req->sg);
+        return BLOCK_STATUS_IOERR;
+    }
+    return -1;
+}
+
+// Issues all the requests posted since the last kick.
+static void goldfish_block_kick(struct goldfish_block_state* s)
+{
+    uint32_t avail_idx;
+
+    if (!s->ring_size) {
+        return;
+    }
+    avail_idx = ldl_le_phys(s->ring_address);
+    // Read the entries after the index that publishes them.
+    smp_rmb();
+
+    while (s->last_avail != avail_idx) {
+        uint32_t slot = ldl_le_phys(goldfish_block_avail(s, s->last_avail));
+        int status;
+
+        s->last_avail++;
+        if (slot >= s->ring_size || s->requests[slot].busy) {
+            fprintf(stderr, "goldfish_block: %s: invalid request slot %u\n",
+                    s->name, slot);
+            continue;
+        }
+        status = goldfish_block_start(s, slot);
+        if (status >= 0) {
+            goldfish_block_complete(s, slot, status);
+        }
+    }
+}
+
+static void goldfish_block_set_ring_size(struct goldfish_block_state* s,
+                                         uint32_t size)
+{
+    // Requests in flight belong to the previous ring.
+    if (s->in_flight) {
+        qemu_aio_flush();
+    }
+    if (size > BLOCK_MAX_RING_SIZE || (size & (size - 1))) {
+        fprintf(stderr, "goldfish_block: %s: invalid ring size %u\n",
+                s->name, size);
+        size = 0;
+    }
+    s->ring_size = size;
+    s->last_avail = 0;
+    s->used_idx = 0;
+    s->pending = 0;
+    timer_del(s->coalesce_timer);
+}
+
+#define  GOLDFISH_BLOCK_SAVE_VERSION  1
+
+#define  QFIELD_STRUCT  struct goldfish_block_state
+QFIELD_BEGIN(goldfish_block_fields)
+    QFIELD_INT32(ring_size),
+    QFIELD_INT32(last_avail),
+    QFIELD_INT32(used_idx),
+    QFIELD_INT32(int_status),
+    QFIELD_INT32(int_enable),
+    QFIELD_INT32(coalesce_count),
+    QFIELD_INT32(coalesce_usec),
+    QFIELD_INT32(pending),
+QFIELD_END
+
+static void goldfish_block_save(QEMUFile* f, void* opaque)
+{
+    struct goldfish_block_state* s = opaque;
+
+    // The state doesn't describe requests in flight, complete them first.
+    if (s->in_flight) {
+        qemu_aio_flush();
+    }
+
+    qemu_put_be64(f, s->name_address);
+    qemu_put_be64(f, s->ring_address);
+    qemu_put_struct(f, goldfish_block_fields, s);
+}
+
+static int goldfish_block_load(QEMUFile* f, void* opaque, int version_id)
+{
+    struct goldfish_block_state* s = opaque;
+    int ret;
+
+    if (version_id != GOLDFISH_BLOCK_SAVE_VERSION) {
+        return -1;
+    }
+    s->name_address = qemu_get_be64(f);
+    s->ring_address = qemu_get_be64(f);
+    ret = qemu_get_struct(f, goldfish_block_fields, s);
+    if (ret < 0) {
+        return ret;
+    }
+    if (s->ring_size > BLOCK_MAX_RING_SIZE ||
+        (s->ring_size & (s->ring_size - 1))) {
+        return -1;
+    }
+    // The coalescing timer isn't saved, interrupt right away instead.
+    timer_del(s->coalesce_timer);
+    if (s->pending) {
+        goldfish_block_raise(s);
+    }
+    goldfish_block_update_irq(s);
+    return 0;
+}
+
+static uint32_t goldfish_block_read(void* opaque, hwaddr offset)
+{
+    struct goldfish_block_state* s = opaque;
+    uint64_t sector_count;
+
+    switch (offset) {
+        case BLOCK_VERSION_REG:
+            return BLOCK_VERSION;
+        case BLOCK_FLAGS:
+            return (bdrv_is_read_only(s->bs) ? BLOCK_FLAG_READ_ONLY : 0) |
+                   BLOCK_FLAG_FLUSH | BLOCK_FLAG_DISCARD;
+        case BLOCK_CAPACITY_LOW:
+            bdrv_get_geometry(s->bs, &sector_count);
+            return (uint32_t)sector_count;
+        case BLOCK_CAPACITY_HIGH:
+            bdrv_get_geometry(s->bs, &sector_count);
+            return (uint32_t)(sector_count >> 32);
+        case BLOCK_NAME_LEN:
+            return strlen(s->name);
+        case BLOCK_NAME_ADDR_LOW:
+            return (uint32_t)s->name_address;
+        case BLOCK_NAME_ADDR_HIGH:
+            return (uint32_t)(s->name_address >> 32);
+        case BLOCK_RING_ADDR_LOW:
+            return (uint32_t)s->ring_address;
+        case BLOCK_RING_ADDR_HIGH:
+            return (uint32_t)(s->ring_address >> 32);
+        case BLOCK_RING_SIZE:
+            return s->ring_size;
+        case BLOCK_INT_STATUS:
+            return s->int_status;
+        case BLOCK_INT_ENABLE:
+            return s->int_enable;
+        case BLOCK_COALESCE_COUNT:
+            return s->coalesce_count;
+        case BLOCK_COALESCE_USEC:
+            return s->coalesce_usec;
+
+        default:
+            cpu_abort(cpu_single_env,
+                      "goldfish_block_read: Bad offset %" HWADDR_PRIx "\n",
+                      offset);
+            return 0;
+    }
+}
+
+static void goldfish_block_write(void* opaque, hwaddr offset, uint32_t val)
+{
+    struct goldfish_block_state* s = opaque;
+
+    switch (offset) {
+        case BLOCK_GET_NAME:
+            cpu_physical_memory_write(s->name_address, (uint8_t*)s->name,
+                                      strlen(s->name));
+            break;
+        case BLOCK_NAME_ADDR_LOW:
+            uint64_set_low(&s->name_address, val);
+            break;
+        case BLOCK_NAME_ADDR_HIGH:
+            uint64_set_high(&s->name_address, val);
+            break;
+        case BLOCK_RING_ADDR_LOW:
+            uint64_set_low(&s->ring_address, val);
+            break;
+        case BLOCK_RING_ADDR_HIGH:
+            uint64_set_high(&s->ring_address, val);
+            break;
+        case BLOCK_RING_SIZE:
+            goldfish_block_set_ring_size(s, val);
+            break;
+        case BLOCK_KICK:
+            goldfish_block_kick(s);
+            break;
+        case BLOCK_INT_STATUS:
+            s->int_status &= ~val;
+            goldfish_block_update_irq(s);
+            break;
+        case BLOCK_INT_ENABLE:
+            s->int_enable = val;
+            goldfish_block_update_irq(s);
+            break;
+        case BLOCK_COALESCE_COUNT:
+            s->coalesce_count = val ? val : 1;
+            break;
+        case BLOCK_COALESCE_USEC:
+            s->coalesce_usec = val;
+            break;
+
+        default:
+            cpu_abort(cpu_single_env,
+                      "goldfish_block_write: Bad offset %" HWADDR_PRIx "\n",
+                      offset);
+    }
+}
+
+static CPUReadMemoryFunc *goldfish_block_readfn[] = {
+   goldfish_block_read,
+   goldfish_block_read,
+   goldfish_block_read
+};
+
+static CPUWriteMemoryFunc *goldfish_block_writefn[] = {
+   goldfish_block_write,
+   goldfish_block_write,
+   goldfish_block_write
+};
+
+/* Disks added with goldfish_block_add(), before the board is created */
+typedef struct PendingBlockDevice {
+    struct PendingBlockDevice* next;
+    char* name;
+    BlockDriverState* bs;
+} PendingBlockDevice;
+
+static PendingBlockDevice* pending_block_devices;
+static PendingBlockDevice** pending_block_devices_tail =
+        &pending_block_devices;
+
+void goldfish_block_add(const char* name, BlockDriverState* bs)
+{
+    PendingBlockDevice* dev = g_malloc0(sizeof(*dev));
+
+    dev->name = g_strdup(name);
+    dev->bs = bs;
+    *pending_block_devices_tail = dev;
+    pending_block_devices_tail = &dev->next;
+}
+
+void goldfish_block_init(void)
+{
+    PendingBlockDevice* dev;
+    int id = 0;
+#ifdef TARGET_I386
+    uint32_t shared_irq = 0;
+#endif
+
+    goldfish_block_init_metrics();
+
+    while ((dev = pending_block_devices) != NULL) {
+        struct goldfish_block_state* s;
+
+#ifdef TARGET_I386
+        // One bit per device in block_shared_irq_levels.
+        if (id >= 32) {
+            fprintf(stderr, "goldfish_block: too many devices, ignoring %s\n",
+                    dev->name);
+            break;
+        }
+#endif
+        s = g_malloc0(sizeof(*s));
+        pending_block_devices = dev->next;
+
+        s->dev.name = "goldfish_block";
+        s->dev.id = id;
+        s->dev.base = 0;    // will be allocated dynamically
+        s->dev.size = 0x1000;
+        s->dev.irq_count = 1;
+        s->bs = dev->bs;
+        s->name = dev->name;
+        s->coalesce_count = BLOCK_DEFAULT_COALESCE_COUNT;
+        s->coalesce_usec = BLOCK_DEFAULT_COALESCE_USEC;
+        s->coalesce_timer = timer_new(QEMU_CLOCK_VIRTUAL, SCALE_NS,
+                                      goldfish_block_coalesce_timer, s);
+        g_free(dev);
+
+#ifdef TARGET_I386
+        s->dev.irq = shared_irq;
+#endif
+        goldfish_device_add(&s->dev, goldfish_block_readfn,
+                            goldfish_block_writefn, s);
+#ifdef TARGET_I386
+        shared_irq = s->dev.irq;
+#endif
+
+        register_savevm(NULL,
+                        "goldfish_block",
+                        id,
+                        GOLDFISH_BLOCK_SAVE_VERSION,
+                        goldfish_block_save,
+                        goldfish_block_load,
+                        s);
+        id++;
+    }
+    pending_block_devices_tail = &pending_block_devices;
+}
@@ -25,6 +25,11 @@
 
 #define MAX_EVENTS 256*4
 
+/* Maximum number of events in a packet (i.e. a group of events terminated
+ * by EV_SYN/SYN_REPORT) that can be coalesced with the previous one.
+ */
+#define MAX_PACKET_EVENTS 32
+
 enum {
     REG_READ        = 0x00,
     REG_SET_PAGE    = 0x00,
@@ -63,6 +68,36 @@ typedef struct
     unsigned last;
     unsigned state;
 
+    /* Motion coalescing. When the guest is slower than the UI, consecutive
+     * packets that only carry pointer motion are merged into a single one
+     * while the guest hasn't started reading them, so that it only sees
+     * the latest position instead of replaying every intermediate one.
+     *
+     * |packet_start| is the index in |events| of the packet being built
+     * (i.e. the events enqueued after the last SYN_REPORT), |packet_len|
+     * its number of events, |packet_slot| the value of its last
+     * ABS_MT_SLOT event (or -1), and |packet_motion| is true if it only
+     * contains motion events so far.
+     *
+     * |prev_packet| and |prev_motion| describe the last complete packet,
+     * which is only valid if |prev_valid| is true, i.e. while the guest
+     * hasn't started reading it. |prev_slot| is the slot selected after
+     * it, or -1 if unknown.
+     *
+     * |btn_touch| is the last BTN_TOUCH value sent, or -1.
+     *
+     * None of these are saved in snapshots, see events_reset_coalescing().
+     */
+    unsigned packet_start;
+    int packet_len;
+    int packet_slot;
+    int packet_motion;
+    unsigned prev_packet;
+    int prev_slot;
+    int prev_motion;
+    int prev_valid;
+    int btn_touch;
+
     const char *name;
 
     struct {
@@ -103,6 +138,18 @@ QFIELD_BEGIN(events_state_fields)
     QFIELD_INT32(state),
 QFIELD_END
 
+/* Forget about the packets in the queue, which will not be coalesced. */
+static void events_reset_coalescing(events_state *s)
+{
+    s->packet_start = s->last;
+    s->packet_len = 0;
+    s->packet_slot = -1;
+    s->packet_motion = 1;
+    s->prev_slot = -1;
+    s->prev_valid = 0;
+    s->btn_touch = -1;
+}
+
 static void  events_state_save(QEMUFile*  f, void*  opaque)
 {
     events_state*  s = opaque;
@@ -113,11 +160,128 @@ static void  events_state_save(QEMUFile*  f, void*  opaque)
 static int  events_state_load(QEMUFile*  f, void* opaque, int  version_id)
 {
     events_state*  s = opaque;
+    int ret;
 
     if (version_id != EVENTS_STATE_SAVE_VERSION)
         return -1;
 
-    return qemu_get_struct(f, events_state_fields, s);
+    ret = qemu_get_struct(f, events_state_fields, s);
+    if (ret == 0)
+        events_reset_coalescing(s);
+    return ret;
+}
+
+/* Return true if an event doesn't change the state of the device beyond
+ * pointer motion, i.e. if it can be merged with the same event from a
+ * previous packet. |index| is the position of the event in its packet.
+ */
+static int events_is_motion(events_state *s, unsigned type, unsigned code,
+                            int value, int index)
+{
+    switch (type) {
+    case EV_REL:
+        return 1;
+    case EV_ABS:
+        if (code == ABS_MT_TRACKING_ID)
+            return 0;
+        if (code == ABS_MT_SLOT)
+            return index == 0;
+        return 1;
+    case EV_KEY:
+        /* The single-touch screen repeats BTN_TOUCH in each packet. */
+        return code == BTN_TOUCH && value == s->btn_touch;
+    default:
+        return 0;
+    }
+}
+
+/* Try to merge the packet being built into the previous one, a SYN_REPORT
+ * having been enqueued. Return true on success, in which case |last| has
+ * been moved back.
+ */
+static int events_merge_packet(events_state *s)
+{
+    unsigned merged[MAX_PACKET_EVENTS * 3];
+    int count = 0;
+    int n, i;
+    unsigned pos;
+
+    if (!s->prev_valid || !s->prev_motion || !s->packet_motion)
+        return 0;
+    /* If the new packet selects a slot, it must be the current one. */
+    if (s->packet_slot >= 0 && s->packet_slot != s->prev_slot)
+        return 0;
+
+    /* Copy the previous packet, without its SYN_REPORT. */
+    for (pos = s->prev_packet; pos != s->packet_start;
+         pos = (pos + 3) & (MAX_EVENTS - 1)) {
+        if (count == MAX_PACKET_EVENTS)
+            return 0;
+        merged[count * 3]     = s->events[pos];
+        merged[count * 3 + 1] = s->events[(pos + 1) & (MAX_EVENTS - 1)];
+        merged[count * 3 + 2] = s->events[(pos + 2) & (MAX_EVENTS - 1)];
+        count++;
+    }
+    count--;
+
+    /* Update it with the new events, again without the SYN_REPORT. */
+    pos = s->packet_start;
+    for (n = 0; n < s->packet_len - 1; n++) {
+        unsigned type = s->events[pos];
+        unsigned code = s->events[(pos + 1) & (MAX_EVENTS - 1)];
+        unsigned value = s->events[(pos + 2) & (MAX_EVENTS - 1)];
+        pos = (pos + 3) & (MAX_EVENTS - 1);
+
+        for (i = 0; i < count; i++) {
+            if (merged[i * 3] == type && merged[i * 3 + 1] == code)
+                break;
+        }
+        if (i < count) {
+            if (type == EV_REL)
+                merged[i * 3 + 2] += value;
+            else
+                merged[i * 3 + 2] = value;
+            continue;
+        }
+        if (count == MAX_PACKET_EVENTS - 1)
+            return 0;
+        merged[count * 3]     = type;
+        merged[count * 3 + 1] = code;
+        merged[count * 3 + 2] = value;
+        count++;
+    }
+    merged[count * 3]     = EV_SYN;
+    merged[count * 3 + 1] = SYN_REPORT;
+    merged[count * 3 + 2] = 0;
+    count++;
+
+    pos = s->prev_packet;
+    for (n = 0; n < count * 3; n++) {
+        s->events[pos] = merged[n];
+        pos = (pos + 1) & (MAX_EVENTS - 1);
+    }
+    s->last = pos;
+    return 1;
+}
+
+/* Called when a SYN_REPORT has been enqueued to complete the packet. */
+static void events_end_packet(events_state *s)
+{
+    if (!events_merge_packet(s)) {
+        unsigned enqueued = (s->last - s->first) & (MAX_EVENTS - 1);
+        unsigned size = (s->last - s->packet_start) & (MAX_EVENTS - 1);
+
+        s->prev_packet = s->packet_start;
+        if (s->packet_slot >= 0)
+            s->prev_slot = s->packet_slot;
+        s->prev_motion = s->packet_motion;
+        /* The guest may have started reading it already. */
+        s->prev_valid = (enqueued >= size);
+    }
+    s->packet_start = s->last;
+    s->packet_len = 0;
+    s->packet_slot = -1;
+    s->packet_motion = 1;
 }
 
 static void enqueue_event(events_state *s, unsigned int type, unsigned int code, int value)
@@ -129,6 +293,8 @@ static void enqueue_event(events_state *s, unsigned int type, unsigned int code,
 
     if (enqueued + 3 > MAX_EVENTS) {
         fprintf(stderr, "##KBD: Full queue, lose event\n");
+        /* The packet being built is now incomplete. */
+        s->packet_motion = 0;
         return;
     }
 
@@ -148,6 +314,19 @@ static void enqueue_event(events_state *s, unsigned int type, unsigned int code,
     s->last = (s->last + 1) & (MAX_EVENTS-1);
     s->events[s->last] = value;
     s->last = (s->last + 1) & (MAX_EVENTS-1);
+
+    if (type == EV_SYN && code == SYN_REPORT) {
+        s->packet_len++;
+        events_end_packet(s);
+        return;
+    }
+    if (!events_is_motion(s, type, code, value, s->packet_len))
+        s->packet_motion = 0;
+    if (type == EV_ABS && code == ABS_MT_SLOT)
+        s->packet_slot = value;
+    if (type == EV_KEY && code == BTN_TOUCH)
+        s->btn_touch = value;
+    s->packet_len++;
 }
 
 static unsigned dequeue_event(events_state *s)
@@ -158,6 +337,11 @@ static unsigned dequeue_event(events_state *s)
         return 0;
     }
 
+    /* The guest starts reading the last complete packet, which can't be
+     * modified anymore. */
+    if (s->prev_valid && s->first == s->prev_packet)
+        s->prev_valid = 0;
+
     n = s->events[s->first];
 
     s->first = (s->first + 1) & (MAX_EVENTS - 1);
@@ -531,6 +715,7 @@ void events_dev_init(uint32_t base, qemu_irq irq)
     s->first = 0;
     s->last = 0;
     s->state = STATE_INIT;
+    events_reset_coalescing(s);
     s->name = g_strdup(config->hw_keyboard_charmap);
 
     /* This function migh fire buffered events to the device, so
@@ -12,11 +12,16 @@
 #include "cpu.h"
 #include "migration/qemu-file.h"
 #include "android/android.h"
+#include "android/opengles.h"
 #include "android/utils/debug.h"
 #include "android/utils/duff.h"
+#include "android/utils/trace.h"
+#include "exec/hax.h"
 #include "exec/ram_addr.h"
 #include "hw/android/goldfish/device.h"
 #include "hw/hw.h"
+#include "qemu/timer.h"
+#include "sysemu/kvm.h"
 #include "ui/console.h"
 
 /* These values *must* match the platform definitions found under
@@ -63,6 +68,18 @@ struct goldfish_fb_state {
     uint32_t int_enable;
     int      rotation;   /* 0, 1, 2 or 3 */
     int      dpi;
+    /* VGA dirty bits of the framebuffer pages, see
+     * compute_fb_update_rects_linear() */
+    unsigned long* dirty_pages;
+    long           dirty_pages_count;
+    /* Framebuffer range whose writes are logged by KVM, see
+     * goldfish_fb_sync_dirty() */
+    uint32_t       dirty_log_base;
+    uint32_t       dirty_log_size;
+    /* Raises FB_INT_VSYNC on the vsync of the host display while the GPU
+     * emulation knows it, see goldfish_fb_schedule_vsync() */
+    QEMUTimer*     vsync_timer;
+    int            vsync_host;
 };
 
 #define  GOLDFISH_FB_SAVE_VERSION  2
@@ -235,7 +252,7 @@ static long  stats_total_full_updates;
 #endif
 
 /* This structure is used to hold the inputs for
- * compute_fb_update_rect_linear below.
+ * compute_fb_update_rects_linear below.
  * This corresponds to the source framebuffer and destination
  * surface pixel buffers.
  */
@@ -247,56 +264,90 @@ typedef struct {
     int            src_pitch;
     uint8_t*       dst_pixels;
     int            dst_pitch;
+    unsigned long* dirty_pages;  /* room for a bit per source page */
 } FbUpdateState;
 
 /* This structure is used to hold the outputs for
- * compute_fb_update_rect_linear below.
- * This corresponds to the smalled bounding rectangle of the
- * latest framebuffer update.
+ * compute_fb_update_rects_linear below.
+ * This corresponds to the bounding rectangle of a band of lines
+ * changed by the latest framebuffer update.
  */
 typedef struct {
     int xmin, ymin, xmax, ymax;
 } FbUpdateRect;
 
-/* Determine the smallest bounding rectangle of pixels which changed
+/* Maximum number of rectangles reported for a single update. */
+#define FB_UPDATE_MAX_RECTS  8
+
+/* Bands of changed lines separated by fewer unchanged lines than this
+ * are reported as a single rectangle. */
+#define FB_UPDATE_MIN_GAP    16
+
+/* Determine the bounding rectangles of the bands of pixels which changed
  * between the source (framebuffer) and destination (surface) pixel
- * buffers.
+ * buffers. This way, a small change at the top of the screen and another
+ * one at the bottom don't require repainting everything in-between.
  *
- * Return 0 if there was no change, otherwise, populate '*rect'
- * and return 1.
+ * Return the number of rectangles stored in 'rects', which must have
+ * room for FB_UPDATE_MAX_RECTS items, or 0 if there was no change.
  *
  * If 'dirty_base' is not 0, it is a physical address that will be
  * used to speed-up the check using the VGA dirty bits. In practice
  * this is only used if your kernel driver does not implement.
+ * The dirty bits of the framebuffer are then copied and cleared at
+ * once, and the lines whose pages weren't written to are skipped by
+ * scanning the copy for the next dirty page, so that the cost of an
+ * update depends on the number of dirty pages, not on the height.
  *
  * This function assumes that the framebuffers are in linear memory.
  * This may change later when we want to support larger framebuffers
  * that exceed the max DMA aperture size though.
  */
 static int
-compute_fb_update_rect_linear(FbUpdateState*  fbs,
-                              uint32_t        dirty_base,
-                              FbUpdateRect*   rect)
+compute_fb_update_rects_linear(FbUpdateState*  fbs,
+                               uint32_t        dirty_base,
+                               FbUpdateRect*   rects)
 {
     int  yy;
     int  width = fbs->width;
     const uint8_t* src_line = fbs->src_pixels;
     uint8_t*       dst_line = fbs->dst_pixels;
-    uint32_t       dirty_addr = dirty_base;
-    rect->xmin = rect->ymin = INT_MAX;
-    rect->xmax = rect->ymax = INT_MIN;
+    /* Offset of the framebuffer in its first page */
+    uint32_t       dirty_offset = dirty_base & ~TARGET_PAGE_MASK;
+    unsigned long  dirty_count = 0;
+    int            count = 0;
+
+    if (dirty_base != 0) {
+        uint32_t size = fbs->height * fbs->src_pitch;
+        if (!cpu_physical_memory_snapshot_and_clear_dirty(
+                    dirty_base, size, DIRTY_MEMORY_VGA, fbs->dirty_pages)) {
+            return 0;
+        }
+        dirty_count = TARGET_PAGE_ALIGN(dirty_offset + size) >>
+                      TARGET_PAGE_BITS;
+    }
+
     for (yy = 0; yy < fbs->height; yy++) {
         int xx1, xx2;
-        /* If dirty_addr is != 0, then use it as a physical address to
-         * use the VGA dirty bits table to speed up the detection of
+        /* If dirty_base is != 0, skip the lines that are not part of a
+         * page whose VGA dirty bit was set, to speed up the detection of
          * changed pixels.
          */
-        if (dirty_addr != 0) {
-            int  dirty = cpu_physical_memory_get_dirty(dirty_addr,
-                                                       fbs->src_pitch,
-                                                       DIRTY_MEMORY_VGA);
-            if (!dirty) { /* this line was not modified, skip to next one */
-                goto NEXT_LINE;
+        if (dirty_base != 0) {
+            uint32_t line = dirty_offset + yy * fbs->src_pitch;
+            unsigned long last =
+                    (line + fbs->src_pitch - 1) >> TARGET_PAGE_BITS;
+            unsigned long next = find_next_bit(fbs->dirty_pages, dirty_count,
+                                               line >> TARGET_PAGE_BITS);
+            if (next >= dirty_count) {  /* no more modified lines */
+                break;
+            }
+            if (next > last) {  /* skip to the first line of that page */
+                int skip = ((next << TARGET_PAGE_BITS) - dirty_offset) /
+                           fbs->src_pitch - yy;
+                src_line += skip * fbs->src_pitch;
+                dst_line += skip * fbs->dst_pitch;
+                yy += skip;
             }
         }
 
@@ -416,29 +467,103 @@ compute_fb_update_rect_linear(FbUpdateState*  fbs,
         default:
             return 0;
         }
-        /* Update bounds if pixels on this line were modified */
+        /* Update bounds if pixels on this line were modified, starting
+         * a new band if the previous one ended long enough ago. */
         if (xx1 < width) {
-            if (xx1 < rect->xmin) rect->xmin = xx1;
-            if (xx2 > rect->xmax) rect->xmax = xx2;
-            if (yy < rect->ymin) rect->ymin = yy;
-            if (yy > rect->ymax) rect->ymax = yy;
+            FbUpdateRect* rect = &rects[count > 0 ? count - 1 : 0];
+            if (count == 0 ||
+                (yy - rect->ymax > FB_UPDATE_MIN_GAP &&
+                 count < FB_UPDATE_MAX_RECTS)) {
+                rect = &rects[count++];
+                rect->xmin = xx1;
+                rect->xmax = xx2;
+                rect->ymin = yy;
+            } else {
+                if (xx1 < rect->xmin) rect->xmin = xx1;
+                if (xx2 > rect->xmax) rect->xmax = xx2;
+            }
+            rect->ymax = yy;
         }
-    NEXT_LINE:
         src_line += fbs->src_pitch;
         dst_line += fbs->dst_pitch;
     }
 
-    if (rect->ymin > rect->ymax) { /* nothing changed */
+    return count;
+}
+
+
+/* Under KVM or HAX, the guest writes the framebuffer without going
+ * through the soft TLB, so its VGA dirty bits are only set after syncing
+ * the KVM dirty page log, which is enabled the first time a range is
+ * displayed, and HAX can't report them at all. Returns 1 if the dirty
+ * bits of the 'size' bytes at 'base' can be used for this update. */
+static int goldfish_fb_sync_dirty(struct goldfish_fb_state *s,
+                                  uint32_t base, uint32_t size)
+{
+    int ret = 1;
+
+    if (!kvm_enabled()) {
+        return !hax_enabled();
+    }
+    if (base != s->dirty_log_base || size != s->dirty_log_size) {
+        /* Starting the log of a new page-flipped buffer of the same
+         * slot is a no-op, but the writes made before it weren't logged. */
+        if (cpu_physical_memory_start_dirty_log(base, size) < 0) {
+            s->dirty_log_base = s->dirty_log_size = 0;
+            return 0;
+        }
+        s->dirty_log_base = base;
+        s->dirty_log_size = size;
+        ret = 0;
+    }
+    if (cpu_physical_sync_dirty_bitmap(base, base + size) < 0) {
         return 0;
     }
+    return ret;
+}
 
-    /* Always clear the dirty VGA bits */
-    cpu_physical_memory_reset_dirty(dirty_base + rect->ymin * fbs->src_pitch,
-                                    (rect->ymax - rect->ymin + 1) * fbs->src_pitch,
-                                    DIRTY_MEMORY_VGA);
-    return 1;
+static void goldfish_fb_raise_vsync(struct goldfish_fb_state *s)
+{
+    if((s->int_enable & FB_INT_VSYNC) && !(s->int_status & FB_INT_VSYNC)) {
+        s->int_status |= FB_INT_VSYNC;
+        goldfish_device_set_irq(&s->dev, 0, 1);
+    }
 }
 
+/* Arm vsync_timer for the next guest vsync, as estimated by the GPU
+ * emulation from the host presentations. Returns 0 on success, or -1 if
+ * it doesn't know the vsync timing, e.g. before the guest's first frames
+ * or without GPU emulation, in which case goldfish_fb_update_display()
+ * raises FB_INT_VSYNC on each display refresh instead.
+ */
+static int goldfish_fb_schedule_vsync(struct goldfish_fb_state *s)
+{
+    long long age_us, period_us, delay_us;
+
+    if (android_getOpenglesVsyncTiming(&age_us, &period_us) < 0) {
+        s->vsync_host = 0;
+        return -1;
+    }
+    /* The phase estimate moves a little with each presentation, don't
+     * raise two interrupts for the same vsync when it moves back. */
+    delay_us = period_us - age_us;
+    if (delay_us < period_us / 4)
+        delay_us += period_us;
+
+    timer_mod(s->vsync_timer,
+              qemu_clock_get_us(QEMU_CLOCK_VIRTUAL) + delay_us);
+    s->vsync_host = 1;
+    return 0;
+}
+
+static void goldfish_fb_vsync_tick(void *opaque)
+{
+    struct goldfish_fb_state *s = (struct goldfish_fb_state *)opaque;
+
+    if(s->fb_base != 0)
+        goldfish_fb_raise_vsync(s);
+    goldfish_fb_schedule_vsync(s);
+}
 
 static void goldfish_fb_update_display(void *opaque)
 {
@@ -453,9 +578,9 @@ static void goldfish_fb_update_display(void *opaque)
     if(base == 0)
         return;
 
-    if((s->int_enable & FB_INT_VSYNC) && !(s->int_status & FB_INT_VSYNC)) {
-        s->int_status |= FB_INT_VSYNC;
-        goldfish_device_set_irq(&s->dev, 0, 1);
+    if(!s->vsync_host) {
+        goldfish_fb_raise_vsync(s);
+        goldfish_fb_schedule_vsync(s);
     }
 
     if(s->need_update) {
@@ -477,7 +602,8 @@ static void goldfish_fb_update_display(void *opaque)
     height    = s->ds->surface->height;
 
     FbUpdateState  fbs;
-    FbUpdateRect   rect;
+    FbUpdateRect   rects[FB_UPDATE_MAX_RECTS];
+    int            count, nn;
 
     fbs.width      = width;
     fbs.height     = height;
@@ -488,6 +614,16 @@ static void goldfish_fb_update_display(void *opaque)
     fbs.src_pixels = src_line;
     fbs.src_pitch  = width*s->ds->surface->pf.bytes_per_pixel;
 
+    long pages = TARGET_PAGE_ALIGN((base & ~TARGET_PAGE_MASK) +
+                                   height * fbs.src_pitch) >> TARGET_PAGE_BITS;
+    if (pages > s->dirty_pages_count) {
+        g_free(s->dirty_pages);
+        s->dirty_pages = bitmap_new(pages);
+        s->dirty_pages_count = pages;
+    }
+    fbs.dirty_pages = s->dirty_pages;
+    ram_lazy_load_range(s->fb_base, height * fbs.src_pitch);
+
 
 #if STATS
     if (full_update)
@@ -505,32 +641,44 @@ static void goldfish_fb_update_display(void *opaque)
     }
 #endif /* STATS */
 
+    TRACE_BEGIN(TRACE_CATEGORY_FB, "fb update");
     if (s->blank)
     {
         memset( dst_line, 0, height*pitch );
-        rect.xmin = 0;
-        rect.ymin = 0;
-        rect.xmax = width-1;
-        rect.ymax = height-1;
+        rects[0].xmin = 0;
+        rects[0].ymin = 0;
+        rects[0].xmax = width-1;
+        rects[0].ymax = height-1;
+        count = 1;
     }
     else
     {
-        if (full_update) { /* don't use dirty-bits optimization */
+        /* Always sync under KVM, so that the next update only sees the
+         * pages written after this one. */
+        if (!goldfish_fb_sync_dirty(s, base, height * fbs.src_pitch) ||
+            full_update) { /* don't use dirty-bits optimization */
             base = 0;
         }
-        if (compute_fb_update_rect_linear(&fbs, base, &rect) == 0) {
+        count = compute_fb_update_rects_linear(&fbs, base, rects);
+        if (count == 0) {
+            TRACE_END(TRACE_CATEGORY_FB, "fb update");
             return;
         }
     }
 
-    rect.xmax += 1;
-    rect.ymax += 1;
+    for (nn = 0; nn < count; nn++) {
+        FbUpdateRect* rect = &rects[nn];
+        rect->xmax += 1;
+        rect->ymax += 1;
 #if 0
-    printf("goldfish_fb_update_display (y:%d,h:%d,x=%d,w=%d)\n",
-           rect.ymin, rect.ymax-rect.ymin, rect.xmin, rect.xmax-rect.xmin);
+        printf("goldfish_fb_update_display (y:%d,h:%d,x=%d,w=%d)\n",
+               rect->ymin, rect->ymax-rect->ymin,
+               rect->xmin, rect->xmax-rect->xmin);
 #endif
-
-    dpy_update(s->ds, rect.xmin, rect.ymin, rect.xmax-rect.xmin, rect.ymax-rect.ymin);
+        dpy_update(s->ds, rect->xmin, rect->ymin,
+                   rect->xmax-rect->xmin, rect->ymax-rect->ymin);
+    }
+    TRACE_END(TRACE_CATEGORY_FB, "fb update");
 }
 
 static void goldfish_fb_invalidate_display(void * opaque)
@@ -664,6 +812,11 @@ void goldfish_fb_init(int id)
     s->bytes_per_pixel = 0;
     s->pixel_format    = -1;
 
+    /* The virtual clock stops with the VM, and only the delays to the
+     * host vsyncs matter. */
+    s->vsync_timer = timer_new_us(QEMU_CLOCK_VIRTUAL,
+                                  goldfish_fb_vsync_tick, s);
+
     goldfish_device_add(&s->dev, goldfish_fb_readfn, goldfish_fb_writefn, s);
 
     register_savevm(NULL,
@@ -20,7 +20,30 @@ enum {
     INTERRUPT_NUMBER        = 0x04,
     INTERRUPT_DISABLE_ALL   = 0x08,
     INTERRUPT_DISABLE       = 0x0c,
-    INTERRUPT_ENABLE        = 0x10
+    INTERRUPT_ENABLE        = 0x10,
+    // Guest physical address of the status page. The high word must be
+    // written first, the page is used once the low one is written, and
+    // address 0 disables it.
+    INTERRUPT_STATUS_PAGE_LOW   = 0x14,
+    INTERRUPT_STATUS_PAGE_HIGH  = 0x18,
+    // Disable or enable all the interrupts of a mask in a single write.
+    INTERRUPT_DISABLE_MASK  = 0x1c,
+    INTERRUPT_ENABLE_MASK   = 0x20,
+    // Read-only, 1 for the registers above.
+    INTERRUPT_VERSION       = 0x24
+};
+
+/* The status page mirrors the registers in guest memory, so that the guest
+ * interrupt handler can find the pending interrupts without trapping. All
+ * fields are little-endian 32-bit values. |sequence| is odd while the page
+ * is being updated, the guest must read it again if it changed or was odd.
+ */
+enum {
+    STATUS_PAGE_SEQUENCE        = 0x00,
+    STATUS_PAGE_PENDING_COUNT   = 0x04,
+    STATUS_PAGE_PENDING         = 0x08, // level & irq_enabled
+    STATUS_PAGE_FIQ_PENDING     = 0x0c, // level & fiq_enabled
+    STATUS_PAGE_SIZE            = 0x10
 };
 
 struct goldfish_int_state {
@@ -31,9 +54,12 @@ struct goldfish_int_state {
     uint32_t fiq_enabled;
     qemu_irq parent_irq;
     qemu_irq parent_fiq;
+    uint64_t status_page;
+    uint32_t status_page_high;
+    uint32_t status_sequence;
 };
 
-#define  GOLDFISH_INT_SAVE_VERSION  1
+#define  GOLDFISH_INT_SAVE_VERSION  2
 
 #define  QFIELD_STRUCT  struct goldfish_int_state
 QFIELD_BEGIN(goldfish_int_fields)
@@ -48,22 +74,63 @@ static void goldfish_int_save(QEMUFile*  f, void*  opaque)
     struct goldfish_int_state*  s = opaque;
 
     qemu_put_struct(f, goldfish_int_fields, s);
+    qemu_put_be64(f, s->status_page);
+    qemu_put_be32(f, s->status_page_high);
+    qemu_put_be32(f, s->status_sequence);
 }
 
 static int  goldfish_int_load(QEMUFile*  f, void*  opaque, int  version_id)
 {
     struct goldfish_int_state*  s = opaque;
+    int  ret;
 
-    if (version_id != GOLDFISH_INT_SAVE_VERSION)
+    if (version_id != 1 && version_id != GOLDFISH_INT_SAVE_VERSION)
         return -1;
 
-    return qemu_get_struct(f, goldfish_int_fields, s);
+    ret = qemu_get_struct(f, goldfish_int_fields, s);
+    if (ret || version_id < 2) {
+        s->status_page = 0;
+        s->status_page_high = 0;
+        s->status_sequence = 0;
+        return ret;
+    }
+    s->status_page = qemu_get_be64(f);
+    s->status_page_high = qemu_get_be32(f);
+    s->status_sequence = qemu_get_be32(f);
+    return 0;
+}
+
+static void goldfish_int_update_status_page(struct goldfish_int_state *s)
+{
+    uint8_t  page[STATUS_PAGE_SIZE];
+
+    if (!s->status_page)
+        return;
+
+    /* Mark the page as being updated before changing it */
+    s->status_sequence |= 1;
+    stl_le_phys(s->status_page + STATUS_PAGE_SEQUENCE, s->status_sequence);
+    smp_wmb();
+
+    stl_le_p(page + STATUS_PAGE_SEQUENCE, s->status_sequence);
+    stl_le_p(page + STATUS_PAGE_PENDING_COUNT, s->pending_count);
+    stl_le_p(page + STATUS_PAGE_PENDING, s->level & s->irq_enabled);
+    stl_le_p(page + STATUS_PAGE_FIQ_PENDING, s->level & s->fiq_enabled);
+    cpu_physical_memory_write(s->status_page + STATUS_PAGE_PENDING_COUNT,
+                              page + STATUS_PAGE_PENDING_COUNT,
+                              STATUS_PAGE_SIZE - STATUS_PAGE_PENDING_COUNT);
+    smp_wmb();
+
+    s->status_sequence++;
+    stl_le_phys(s->status_page + STATUS_PAGE_SEQUENCE, s->status_sequence);
 }
 
 static void goldfish_int_update(struct goldfish_int_state *s)
 {
     uint32_t flags;
 
+    goldfish_int_update_status_page(s);
+
     flags = (s->level & s->irq_enabled);
     qemu_set_irq(s->parent_irq, flags != 0);
 
@@ -109,6 +176,12 @@ static uint32_t goldfish_int_read(void *opaque, hwaddr offset)
         }
         return 0;
     }
+    case INTERRUPT_STATUS_PAGE_LOW:
+        return (uint32_t)s->status_page;
+    case INTERRUPT_STATUS_PAGE_HIGH:
+        return (uint32_t)(s->status_page >> 32);
+    case INTERRUPT_VERSION:
+        return 1;
     default:
         cpu_abort(cpu_single_env,
                   "goldfish_int_read: Bad offset %" HWADDR_PRIx "\n",
@@ -143,6 +216,25 @@ static void goldfish_int_write(void *opaque, hwaddr offset, uint32_t value)
             }
             break;
 
+        case INTERRUPT_DISABLE_MASK:
+            s->pending_count -=
+                    __builtin_popcount(s->irq_enabled & value & s->level);
+            s->irq_enabled &= ~value;
+            break;
+        case INTERRUPT_ENABLE_MASK:
+            s->pending_count +=
+                    __builtin_popcount(~s->irq_enabled & value & s->level);
+            s->irq_enabled |= value;
+            break;
+
+        case INTERRUPT_STATUS_PAGE_HIGH:
+            s->status_page_high = value;
+            return;
+        case INTERRUPT_STATUS_PAGE_LOW:
+            s->status_page = ((uint64_t)s->status_page_high << 32) | value;
+            s->status_sequence = 0;
+            break;
+
     default:
         cpu_abort(cpu_single_env,
                   "goldfish_int_write: Bad offset %" HWADDR_PRIx "\n",
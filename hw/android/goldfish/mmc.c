@@ -15,7 +15,12 @@
 #include "hw/android/goldfish/device.h"
 #include "hw/hw.h"
 #include "hw/mmc.h"
+#include "android/utils/metrics.h"
+#include "android/utils/trace.h"
+#include "block/aio.h"
 #include "block/block.h"
+#include "sysemu/dma.h"
+#include "qemu/timer.h"
 
 // These constants come from $KERNEL/include/linux/mmc/sd.h
 
@@ -24,6 +29,10 @@
 
 #define SD_SWITCH                 6   /* adtc [31:0] See below   R1  */
 
+#define SD_ERASE_WR_BLK_START    32   /* ac   [31:0] data addr   R1  */
+#define SD_ERASE_WR_BLK_END      33   /* ac   [31:0] data addr   R1  */
+#define MMC_ERASE                38   /* ac                      R1b */
+
 #define SD_APP_SET_BUS_WIDTH      6   /* ac   [1:0] bus width    R1  */
 #define SD_APP_SEND_NUM_WR_BLKS  22   /* adtc                    R1  */
 #define SD_APP_OP_COND           41   /* bcr  [31:0] OCR         R3  */
@@ -114,10 +123,55 @@ struct goldfish_mmc_state {
     uint32_t block_count;
     int is_SDHC;
 
-    uint8_t* buf;
+    // first and last block of the next erase, as sent by the driver
+    uint32_t erase_start;
+    uint32_t erase_end;
+
+    // pending data transfer, and the guest buffer it uses
+    BlockDriverAIOCB* aiocb;
+    QEMUSGList sg;
+    // direction and start time of the pending transfer, for the metrics
+    int transfer_is_write;
+    int64_t transfer_start_ns;
 };
 
-#define  GOLDFISH_MMC_SAVE_VERSION  3
+// Metrics of the reads and writes of all devices, see
+// goldfish_mmc_init_metrics().
+typedef struct {
+    Metric* ops;
+    Metric* bytes;
+    Metric* latency_us;
+} MmcTransferMetrics;
+
+static MmcTransferMetrics mmc_transfer_metrics[2];
+static Metric* mmc_erase_metric;
+
+static void goldfish_mmc_init_metrics(void)
+{
+    static const char* const labels[2] = { "op=\"read\"", "op=\"write\"" };
+    int n;
+
+    if (mmc_transfer_metrics[0].ops) {
+        return;
+    }
+    for (n = 0; n < 2; n++) {
+        mmc_transfer_metrics[n].ops = metrics_counter(
+                "emulator_mmc_ops_total", labels[n],
+                "MMC data transfers");
+        mmc_transfer_metrics[n].bytes = metrics_counter(
+                "emulator_mmc_bytes_total", labels[n],
+                "Bytes transferred by MMC data transfers");
+        mmc_transfer_metrics[n].latency_us = metrics_histogram(
+                "emulator_mmc_op_latency_us", labels[n],
+                "Duration of MMC data transfers, in microseconds");
+    }
+    mmc_erase_metric = metrics_counter(
+            "emulator_mmc_erased_bytes_total", NULL,
+            "Bytes discarded by MMC erase commands");
+}
+
+#define  GOLDFISH_MMC_SAVE_VERSION  4
+#define  GOLDFISH_MMC_SAVE_VERSION_NO_ERASE  3
 #define  GOLDFISH_MMC_SAVE_VERSION_LEGACY  2
 
 // Note: This doesn't include |buffer_address| which is saved and loaded
@@ -142,15 +196,24 @@ static void  goldfish_mmc_save(QEMUFile*  f, void*  opaque)
 {
     struct goldfish_mmc_state*  s = opaque;
 
+    // The state doesn't describe transfers in flight, complete them first.
+    if (s->aiocb) {
+        qemu_aio_flush();
+    }
+
     qemu_put_be64(f, s->buffer_address);
     qemu_put_struct(f, goldfish_mmc_fields, s);
+    qemu_put_be32(f, s->erase_start);
+    qemu_put_be32(f, s->erase_end);
 }
 
 static int  goldfish_mmc_load(QEMUFile*  f, void*  opaque, int  version_id)
 {
     struct goldfish_mmc_state*  s = opaque;
+    int ret;
 
-    if (version_id == GOLDFISH_MMC_SAVE_VERSION) {
+    if (version_id == GOLDFISH_MMC_SAVE_VERSION ||
+        version_id == GOLDFISH_MMC_SAVE_VERSION_NO_ERASE) {
         s->buffer_address = qemu_get_be64(f);
     } else if (version_id == GOLDFISH_MMC_SAVE_VERSION_LEGACY) {
         s->buffer_address = qemu_get_be32(f);
@@ -158,7 +221,18 @@ static int  goldfish_mmc_load(QEMUFile*  f, void*  opaque, int  version_id)
         // Unsupported version!
         return -1;
     }
-    return qemu_get_struct(f, goldfish_mmc_fields, s);
+    ret = qemu_get_struct(f, goldfish_mmc_fields, s);
+    if (ret < 0) {
+        return ret;
+    }
+    if (version_id == GOLDFISH_MMC_SAVE_VERSION) {
+        s->erase_start = qemu_get_be32(f);
+        s->erase_end = qemu_get_be32(f);
+    } else {
+        s->erase_start = 0;
+        s->erase_end = 0;
+    }
+    return 0;
 }
 
 struct mmc_opcode {
@@ -214,48 +288,101 @@ static const char* get_command_name(int command)
 }
 #endif
 
-static int  goldfish_mmc_bdrv_read(struct goldfish_mmc_state *s,
-                                   int64_t                    sector_number,
-                                   hwaddr         dst_address,
-                                   int                        num_sectors)
+static void goldfish_mmc_update_irq(struct goldfish_mmc_state *s)
 {
-    int  ret;
+    if ((s->int_status & s->int_enable)) {
+        goldfish_device_set_irq(&s->dev, 0, (s->int_status & s->int_enable));
+    }
+}
 
-    while (num_sectors > 0) {
-        ret = bdrv_read(s->bs, sector_number, s->buf, 1);
-        if (ret < 0)
-            return ret;
+// Completion of a data transfer. The end of the command is only reported
+// now, with the end of the data: the kernel driver considers the transfer
+// complete as soon as it sees MMC_STAT_END_OF_CMD.
+static void goldfish_mmc_bdrv_done(void *opaque, int ret)
+{
+    struct goldfish_mmc_state *s = opaque;
 
-        cpu_physical_memory_write(dst_address, s->buf, 512);
-        dst_address   += 512;
-        num_sectors   -= 1;
-        sector_number += 1;
+    TRACE_INSTANT(TRACE_CATEGORY_MMC, "mmc transfer done");
+    metric_record(mmc_transfer_metrics[s->transfer_is_write].latency_us,
+                  (uint64_t)(get_clock() - s->transfer_start_ns) / 1000);
+    if (ret < 0) {
+        fprintf(stderr, "goldfish_mmc: I/O error %d\n", ret);
     }
-    return 0;
+    s->aiocb = NULL;
+    qemu_sglist_destroy(&s->sg);
+
+    s->int_status |= MMC_STAT_END_OF_CMD | MMC_STAT_END_OF_DATA;
+    goldfish_mmc_update_irq(s);
 }
 
-static int  goldfish_mmc_bdrv_write(struct goldfish_mmc_state *s,
+// Start an asynchronous transfer of |num_sectors| sectors between the
+// device and the guest buffer at |buffer_address|. The whole multi-block
+// command is issued as a single request, directly to or from guest memory.
+// Returns 0 if goldfish_mmc_bdrv_done() will be called, -1 otherwise.
+static int  goldfish_mmc_bdrv_start(struct goldfish_mmc_state *s,
                                     int64_t                    sector_number,
-                                    hwaddr         dst_address,
-                                    int                        num_sectors)
+                                    hwaddr         buffer_address,
+                                    int                        num_sectors,
+                                    int                        is_write)
 {
-    int  ret;
-
-    while (num_sectors > 0) {
-        cpu_physical_memory_read(dst_address, s->buf, 512);
-
-        ret = bdrv_write(s->bs, sector_number, s->buf, 1);
-        if (ret < 0)
-            return ret;
+    // The driver waits for each transfer, but don't reuse |sg| if it didn't.
+    if (s->aiocb) {
+        qemu_aio_flush();
+    }
 
-        dst_address   += 512;
-        num_sectors   -= 1;
-        sector_number += 1;
+    // The transfer completes asynchronously, possibly on another thread,
+    // so it can't be traced as a single slice.
+    TRACE_INSTANT(TRACE_CATEGORY_MMC, is_write ? "mmc write" : "mmc read");
+    TRACE_COUNTER(TRACE_CATEGORY_MMC, "mmc transfer sectors", num_sectors);
+    s->transfer_is_write = is_write ? 1 : 0;
+    s->transfer_start_ns = get_clock();
+    metric_add(mmc_transfer_metrics[s->transfer_is_write].ops, 1);
+    metric_add(mmc_transfer_metrics[s->transfer_is_write].bytes,
+               (int64_t)num_sectors * 512);
+
+    qemu_sglist_init(&s->sg, 1);
+    qemu_sglist_add(&s->sg, buffer_address, (hwaddr)num_sectors * 512);
+
+    if (is_write) {
+        s->aiocb = dma_bdrv_write(s->bs, &s->sg, sector_number,
+                                  goldfish_mmc_bdrv_done, s);
+    } else {
+        s->aiocb = dma_bdrv_read(s->bs, &s->sg, sector_number,
+                                 goldfish_mmc_bdrv_done, s);
+    }
+    if (!s->aiocb) {
+        qemu_sglist_destroy(&s->sg);
+        return -1;
     }
     return 0;
 }
 
 
+// Discards the blocks from |erase_start| to |erase_end| included.
+static void goldfish_mmc_erase(struct goldfish_mmc_state *s)
+{
+    uint64_t start = s->erase_start;
+    uint64_t end = s->erase_end;
+    uint64_t sector_count;
+    int ret;
+
+    if (!s->is_SDHC) {
+        // the addresses are byte offsets
+        start /= 512;
+        end /= 512;
+    }
+    bdrv_get_geometry(s->bs, &sector_count);
+    if (end < start || end >= sector_count || bdrv_is_read_only(s->bs)) {
+        return;
+    }
+    metric_add(mmc_erase_metric, (int64_t)(end - start + 1) * 512);
+    // The card is smaller than 128 GB, see MMC_SEND_CSD.
+    ret = bdrv_discard(s->bs, start, (int)(end - start + 1));
+    if (ret < 0) {
+        fprintf(stderr, "goldfish_mmc: erase error %d\n", ret);
+    }
+}
+
 static void goldfish_mmc_do_command(struct goldfish_mmc_state *s, uint32_t cmd, uint32_t arg)
 {
     int new_status = MMC_STAT_END_OF_CMD;
@@ -418,9 +545,13 @@ static void goldfish_mmc_do_command(struct goldfish_mmc_state *s, uint32_t cmd,
                 if (arg & 511) fprintf(stderr, "offset %d is not multiple of 512 when reading\n", arg);
                 arg /= s->block_length;
             }
-            goldfish_mmc_bdrv_read(s, arg, s->buffer_address, s->block_count);
-            new_status |= MMC_STAT_END_OF_DATA;
             s->resp[0] = SET_R1_CURRENT_STATE(4) | R1_READY_FOR_DATA; // 2304
+            if (goldfish_mmc_bdrv_start(s, arg, s->buffer_address,
+                                        s->block_count, 0) == 0) {
+                // status is reported on completion
+                return;
+            }
+            new_status |= MMC_STAT_END_OF_DATA;
             break;
         }
 
@@ -435,14 +566,34 @@ static void goldfish_mmc_do_command(struct goldfish_mmc_state *s, uint32_t cmd,
                 if (arg & 511) fprintf(stderr, "offset %d is not multiple of 512 when writing\n", arg);
                 arg /= s->block_length;
             }
-            // arg is byte offset
-            goldfish_mmc_bdrv_write(s, arg, s->buffer_address, s->block_count);
-//            bdrv_flush(s->bs);
-            new_status |= MMC_STAT_END_OF_DATA;
             s->resp[0] = SET_R1_CURRENT_STATE(4) | R1_READY_FOR_DATA; // 2304
+            if (goldfish_mmc_bdrv_start(s, arg, s->buffer_address,
+                                        s->block_count, 1) == 0) {
+                // status is reported on completion
+                return;
+            }
+            new_status |= MMC_STAT_END_OF_DATA;
             break;
         }
 
+        case SD_ERASE_WR_BLK_START:
+            s->erase_start = arg;
+            s->resp[0] = SET_R1_CURRENT_STATE(4) | R1_READY_FOR_DATA; // 2304
+            break;
+
+        case SD_ERASE_WR_BLK_END:
+            s->erase_end = arg;
+            s->resp[0] = SET_R1_CURRENT_STATE(4) | R1_READY_FOR_DATA; // 2304
+            break;
+
+        case MMC_ERASE:
+            // The card reports ERASE_BLK_EN in its CSD, so erases are in
+            // blocks. The erased blocks are discarded from the image, which
+            // frees their space, instead of being overwritten.
+            goldfish_mmc_erase(s);
+            s->resp[0] = SET_R1_CURRENT_STATE(4) | R1_READY_FOR_DATA; // 2304
+            break;
+
         case MMC_STOP_TRANSMISSION:
             s->resp[0] = SET_R1_CURRENT_STATE(5) | R1_READY_FOR_DATA; // 2816
             break;
@@ -453,10 +604,7 @@ static void goldfish_mmc_do_command(struct goldfish_mmc_state *s, uint32_t cmd,
      }
 
     s->int_status |= new_status;
-
-    if ((s->int_status & s->int_enable)) {
-        goldfish_device_set_irq(&s->dev, 0, (s->int_status & s->int_enable));
-    }
+    goldfish_mmc_update_irq(s);
 }
 
 static uint32_t goldfish_mmc_read(void *opaque, hwaddr offset)
@@ -565,7 +713,7 @@ void goldfish_mmc_init(uint32_t base, int id, BlockDriverState* bs)
     s->dev.size = 0x1000;
     s->dev.irq_count = 1;
     s->bs = bs;
-    s->buf = qemu_memalign(512,512);
+    goldfish_mmc_init_metrics();
 
     goldfish_device_add(&s->dev, goldfish_mmc_readfn, goldfish_mmc_writefn, s);
 
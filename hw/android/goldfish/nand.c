@@ -15,11 +15,33 @@
 #include "hw/android/goldfish/nand.h"
 #include "hw/android/goldfish/vmem.h"
 #include "hw/hw.h"
+#include "qemu/throttle.h"
+#include "qemu/timer.h"
+#include "sysemu/cpus.h"
 #include "android/utils/path.h"
+#include "android/utils/metrics.h"
 #include "android/utils/tempfile.h"
+#include "android/utils/trace.h"
 #include "android/qemu-debug.h"
 #include "android/android.h"
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#ifndef FICLONE
+#define FICLONE  _IOW(0x94, 9, int)
+#endif
+#include <fcntl.h>
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE   0x01
+#endif
+#ifndef FALLOC_FL_PUNCH_HOLE
+#define FALLOC_FL_PUNCH_HOLE  0x02
+#endif
+#endif
+
 #define  DEBUG  1
 #if DEBUG
 #  define  D(...)    VERBOSE_PRINT(init,__VA_ARGS__)
@@ -66,6 +88,26 @@ typedef struct {
     uint32_t   erase_size;   /* size of the data buffer mentioned above */
     uint64_t   max_size;     /* Capacity limit for the image. The actual underlying
                               * file may be smaller. */
+    /* Copy-on-write overlay: when base_fd >= 0, the image is the read-only
+     * base file, except for the erase blocks flagged in cow_bitmap, which
+     * have been copied to, and modified in, the sparse file at fd. */
+    int        base_fd;
+    uint64_t   base_size;    /* size of the base file */
+    uint8_t*   cow_bitmap;   /* one bit per erase block */
+    uint8_t*   cow_data;     /* erase_size buffer to copy blocks from the base */
+    /* Read-only mapping of the file at map_fd, which is either the image of
+     * a read-only device or the base file of a copy-on-write one. Reads from
+     * it are copied straight from the host page cache, which is shared by
+     * all the emulators that use the same image. */
+    uint8_t*   map;
+    uint64_t   map_size;
+    int        map_fd;
+    uint64_t   map_next;       /* end of the last read, to detect sequential ones */
+    uint64_t   map_prefetched; /* end of the last readahead request */
+    uint32_t   map_window;     /* size of the last readahead request */
+    void     (*wait_hook)(void); /* called before the first access, if any */
+    int        no_punch;     /* set if the file system can't punch holes */
+    ThrottleState throttle;  /* I/O limits, see nand_dev_set_io_limits() */
 } nand_dev;
 
 nand_threshold    android_nand_write_threshold;
@@ -203,6 +245,40 @@ static off_t do_lseek(int  fd, off_t offset, int whence)
     return ret;
 }
 
+/* EINTR-proof pread - due to SIGALRM in use elsewhere */
+static int  do_pread(int  fd, void*  buf, size_t  size, uint64_t  offset)
+{
+#ifdef _WIN32
+    if (do_lseek(fd, offset, SEEK_SET) == -1)
+        return -1;
+    return do_read(fd, buf, size);
+#else
+    int  ret;
+    do {
+        ret = pread(fd, buf, size, offset);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret;
+#endif
+}
+
+/* EINTR-proof pwrite - due to SIGALRM in use elsewhere */
+static int  do_pwrite(int  fd, const void*  buf, size_t  size, uint64_t  offset)
+{
+#ifdef _WIN32
+    if (do_lseek(fd, offset, SEEK_SET) == -1)
+        return -1;
+    return do_write(fd, buf, size);
+#else
+    int  ret;
+    do {
+        ret = pwrite(fd, buf, size, offset);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret;
+#endif
+}
+
 /* EINTR-proof ftruncate - due to SIGALRM in use elsewhere */
 static int  do_ftruncate(int  fd, size_t  size)
 {
@@ -214,6 +290,215 @@ static int  do_ftruncate(int  fd, size_t  size)
     return ret;
 }
 
+static size_t nand_dev_cow_bitmap_size(nand_dev *dev)
+{
+    return dev->max_size / dev->erase_size / 8 + 1;
+}
+
+/* Returns non-zero if erase block |block| of a copy-on-write device has been
+ * copied from the base file. The base file may be larger than the device.
+ */
+static int nand_dev_cow_has_block(nand_dev *dev, uint64_t block)
+{
+    if (block >= dev->max_size / dev->erase_size)
+        return 0;
+    return (dev->cow_bitmap[block >> 3] >> (block & 7)) & 1;
+}
+
+static void nand_dev_cow_set_block(nand_dev *dev, uint64_t block)
+{
+    dev->cow_bitmap[block >> 3] |= 1 << (block & 7);
+}
+
+/* Copies erase block |block| of a copy-on-write device from the base file,
+ * before it gets partially overwritten. Returns 0 on success.
+ */
+static int nand_dev_cow_copy_block(nand_dev *dev, uint64_t block)
+{
+    uint64_t start = block * dev->erase_size;
+    uint32_t len = 0;
+
+    if (start < dev->base_size) {
+        len = dev->erase_size;
+        if (len > dev->base_size - start)
+            len = dev->base_size - start;
+    }
+    if (len > 0) {
+        if (do_pread(dev->base_fd, dev->cow_data, len, start) != (int)len) {
+            XLOG("%s, read failed: %s\n", __FUNCTION__, strerror(errno));
+            return -1;
+        }
+        if (do_pwrite(dev->fd, dev->cow_data, len, start) != (int)len) {
+            XLOG("%s, write failed: %s\n", __FUNCTION__, strerror(errno));
+            return -1;
+        }
+    }
+    nand_dev_cow_set_block(dev, block);
+    return 0;
+}
+
+#define  NAND_DEV_READAHEAD_MIN  (128 * 1024)
+#define  NAND_DEV_READAHEAD_MAX  (4 * 1024 * 1024)
+
+/* Called on each read of the mapped file. While the guest reads sequentially,
+ * asks the host to prefetch a window ahead of it, doubling the size of the
+ * window each time the guest gets close to its end.
+ */
+static void nand_dev_map_readahead(nand_dev *dev, uint64_t addr, uint32_t len)
+{
+#ifndef _WIN32
+    uint64_t end = addr + len;
+    uint64_t start, page_mask = getpagesize() - 1;
+
+    if (addr != dev->map_next) {
+        dev->map_next = end;
+        dev->map_prefetched = 0;
+        dev->map_window = 0;
+        return;
+    }
+    dev->map_next = end;
+    if (end + dev->map_window / 2 < dev->map_prefetched || end >= dev->map_size)
+        return;
+
+    dev->map_window *= 2;
+    if (dev->map_window < NAND_DEV_READAHEAD_MIN)
+        dev->map_window = NAND_DEV_READAHEAD_MIN;
+    if (dev->map_window > NAND_DEV_READAHEAD_MAX)
+        dev->map_window = NAND_DEV_READAHEAD_MAX;
+    start = end > dev->map_prefetched ? end : dev->map_prefetched;
+    start &= ~page_mask;
+    dev->map_prefetched = start + dev->map_window;
+    if (dev->map_prefetched > dev->map_size)
+        dev->map_prefetched = dev->map_size;
+    if (start < dev->map_prefetched)
+        madvise(dev->map + start, dev->map_prefetched - start, MADV_WILLNEED);
+#endif
+}
+
+/* Maps the file at |fd| for reading, returns 0 on success. */
+static int nand_dev_map_file(nand_dev *dev, int fd)
+{
+#ifndef _WIN32
+    off_t size = do_lseek(fd, 0, SEEK_END);
+    void* map;
+
+    if (size <= 0 || (uint64_t)size != (size_t)size)
+        return -1;
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+    dev->map = map;
+    dev->map_size = size;
+    dev->map_fd = fd;
+    return 0;
+#else
+    (void)dev;
+    (void)fd;
+    return -1;
+#endif
+}
+
+/* Reads |len| bytes at offset |addr| of the image into |buf|. The NAND reads
+ * as erased past the end of the image file.
+ */
+static void nand_dev_image_read(nand_dev *dev, uint8_t *buf, uint32_t len, uint64_t addr)
+{
+    while (len > 0) {
+        uint32_t read_len = len;
+        int fd = dev->fd;
+        int ret;
+
+        if (dev->base_fd >= 0) {
+            uint64_t block = addr / dev->erase_size;
+            uint64_t block_end = (block + 1) * dev->erase_size;
+            if (read_len > block_end - addr)
+                read_len = block_end - addr;
+            if (!nand_dev_cow_has_block(dev, block))
+                fd = dev->base_fd;
+        }
+        if (dev->map != NULL && fd == dev->map_fd) {
+            ret = 0;
+            if (addr < dev->map_size) {
+                ret = read_len;
+                if (ret > dev->map_size - addr)
+                    ret = dev->map_size - addr;
+                memcpy(buf, dev->map + addr, ret);
+            }
+            nand_dev_map_readahead(dev, addr, read_len);
+        } else {
+            ret = do_pread(fd, buf, read_len, addr);
+            if (ret < 0)
+                ret = 0;
+        }
+        if (ret < (int)read_len)
+            memset(buf + ret, 0xff, read_len - ret);
+        buf += read_len;
+        addr += read_len;
+        len -= read_len;
+    }
+}
+
+/* Writes |len| bytes from |buf| at offset |addr| of the image. Returns the
+ * number of bytes written, which is less than |len| on error.
+ */
+static uint32_t nand_dev_image_write(nand_dev *dev, const uint8_t *buf, uint32_t len, uint64_t addr)
+{
+    uint32_t total_len = len;
+
+    while (len > 0) {
+        uint32_t write_len = len;
+        uint64_t block = 0;
+        int ret;
+
+        if (dev->base_fd >= 0) {
+            uint64_t block_start;
+            block = addr / dev->erase_size;
+            block_start = block * dev->erase_size;
+            if (write_len > block_start + dev->erase_size - addr)
+                write_len = block_start + dev->erase_size - addr;
+            /* Blocks that are entirely overwritten don't need a copy. */
+            if (!nand_dev_cow_has_block(dev, block) &&
+                (addr != block_start || write_len != dev->erase_size) &&
+                nand_dev_cow_copy_block(dev, block) < 0)
+                break;
+        }
+        ret = do_pwrite(dev->fd, buf, write_len, addr);
+        if (ret < (int)write_len) {
+            XLOG("%s, write failed: %s\n", __FUNCTION__, strerror(errno));
+            break;
+        }
+        if (dev->base_fd >= 0)
+            nand_dev_cow_set_block(dev, block);
+        buf += write_len;
+        addr += write_len;
+        len -= write_len;
+    }
+    return total_len - len;
+}
+
+/* Returns the size of the image, or -1 on error.
+ */
+static int64_t nand_dev_image_size(nand_dev *dev)
+{
+    off_t size = do_lseek(dev->fd, 0, SEEK_END);
+
+    if (size == -1)
+        return -1;
+    if (dev->base_fd >= 0 && (uint64_t)size < dev->base_size)
+        return dev->base_size;
+    return size;
+}
+
+/* Waits until the image is ready to be accessed. */
+static void nand_dev_wait_ready(nand_dev *dev)
+{
+    if (dev->wait_hook) {
+        void (*wait)(void) = dev->wait_hook;
+        dev->wait_hook = NULL;
+        wait();
+    }
+}
+
 #define NAND_DEV_SAVE_DISK_BUF_SIZE 2048
 
 
@@ -227,43 +512,31 @@ static void  nand_dev_save_disk_state(QEMUFile *f, nand_dev *dev)
 {
     int buf_size = NAND_DEV_SAVE_DISK_BUF_SIZE;
     uint8_t buffer[NAND_DEV_SAVE_DISK_BUF_SIZE] = {0};
-    off_t lseek_ret;
-    int ret;
     uint64_t total_copied = 0;
 
-    /* Size of file to restore, hence size of data block following.
-     * TODO Work out whether to use lseek64 here. */
+    nand_dev_wait_ready(dev);
 
-    lseek_ret = do_lseek(dev->fd, 0, SEEK_END);
-    if (lseek_ret == -1) {
+    /* Size of file to restore, hence size of data block following. */
+    const int64_t image_size = nand_dev_image_size(dev);
+    if (image_size < 0) {
       qemu_file_set_error(f, -errno);
       XLOG("%s EOF seek failed: %s\n", __FUNCTION__, strerror(errno));
       return;
     }
-    const uint64_t total_size = lseek_ret;
+    const uint64_t total_size = image_size;
     qemu_put_be64(f, total_size);
 
-    /* copy all data from the stream to the stored image */
-    lseek_ret = do_lseek(dev->fd, 0, SEEK_SET);
-    if (lseek_ret == -1) {
-        qemu_file_set_error(f, -errno);
-        XLOG("%s seek failed: %s\n", __FUNCTION__, strerror(errno));
-        return;
-    }
-    do {
-        ret = do_read(dev->fd, buffer, buf_size);
-        if (ret < 0) {
-            qemu_file_set_error(f, -errno);
-            XLOG("%s read failed: %s\n", __FUNCTION__, strerror(errno));
-            return;
+    /* copy all data from the image to the stream; this goes through the
+     * copy-on-write overlay, if any. */
+    while (total_copied < total_size) {
+        if (total_size - total_copied < buf_size) {
+            buf_size = total_size - total_copied;
         }
-        qemu_put_buffer(f, buffer, ret);
+        nand_dev_image_read(dev, buffer, buf_size, total_copied);
+        qemu_put_buffer(f, buffer, buf_size);
 
-        total_copied += ret;
+        total_copied += buf_size;
     }
-    while (ret == buf_size && total_copied < dev->max_size);
-
-    /* TODO Maybe check that we've written total_size bytes */
 }
 
 
@@ -289,6 +562,8 @@ static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
     off_t lseek_ret;
     int ret;
 
+    nand_dev_wait_ready(dev);
+
     /* File size for restore and truncate */
     uint64_t total_size = qemu_get_be64(f);
     if (total_size > dev->max_size) {
@@ -297,7 +572,11 @@ static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
         return -EIO;
     }
 
-    /* overwrite disk contents with snapshot contents */
+    /* overwrite disk contents with snapshot contents. With a copy-on-write
+     * overlay, the whole image now lives in the delta file. */
+    if (dev->base_fd >= 0) {
+        memset(dev->cow_bitmap, 0xff, nand_dev_cow_bitmap_size(dev));
+    }
     uint64_t next_offset = 0;
     lseek_ret = do_lseek(dev->fd, 0, SEEK_SET);
     if (lseek_ret == -1) {
@@ -385,75 +664,211 @@ static int   nand_dev_controller_state_load(QEMUFile *f, void  *opaque, int  ver
     return ret ? ret : nand_dev_load_disks(f);
 }
 
+/* Map the start of the guest buffer at virtual address |data| into host
+ * memory, so that file I/O can be performed on it directly. On entry, |*len|
+ * is the size of the guest buffer, on exit it is the size of the mapping.
+ * Returns NULL if the buffer can't be mapped, and the caller must then go
+ * through dev->data instead. The mapping must be released with
+ * cpu_physical_memory_unmap().
+ */
+static uint8_t* nand_dev_map_guest(target_ulong data, uint32_t* len, int is_write)
+{
+    target_ulong vlen = *len;
+    hwaddr plen;
+    hwaddr phys = safe_get_phys_range_debug(current_cpu, data, &vlen);
+    uint8_t* buf;
+
+    if (phys == (hwaddr)-1)
+        return NULL;
+    plen = vlen;
+    buf = cpu_physical_memory_map(phys, &plen, is_write);
+    if (buf == NULL || plen == 0)
+        return NULL;
+    *len = (uint32_t)plen;
+    return buf;
+}
+
+/* Metrics of each kind of NAND operation on an image file */
+enum {
+    NAND_OP_READ = 0,
+    NAND_OP_WRITE,
+    NAND_OP_ERASE,
+    NAND_OP_COUNT
+};
+
+typedef struct {
+    Metric*  ops;
+    Metric*  bytes;
+    Metric*  latency_us;
+} NandOpMetrics;
+
+static NandOpMetrics  nand_op_metrics[NAND_OP_COUNT];
+
+static void nand_dev_init_metrics(void)
+{
+    static const char* const  labels[NAND_OP_COUNT] = {
+        "op=\"read\"", "op=\"write\"", "op=\"erase\""
+    };
+    int  n;
+
+    if (nand_op_metrics[0].ops != NULL)
+        return;
+    for (n = 0; n < NAND_OP_COUNT; n++) {
+        nand_op_metrics[n].ops = metrics_counter(
+                "emulator_nand_ops_total", labels[n],
+                "NAND operations on image files");
+        nand_op_metrics[n].bytes = metrics_counter(
+                "emulator_nand_bytes_total", labels[n],
+                "Bytes transferred by NAND operations on image files");
+        nand_op_metrics[n].latency_us = metrics_histogram(
+                "emulator_nand_op_latency_us", labels[n],
+                "Duration of NAND operations on image files, in microseconds");
+    }
+}
+
+/* Count an operation of |len| bytes that started at |start_ns| */
+static void nand_dev_count_op(int op, uint32_t len, int64_t start_ns)
+{
+    metric_add(nand_op_metrics[op].ops, 1);
+    metric_add(nand_op_metrics[op].bytes, len);
+    metric_record(nand_op_metrics[op].latency_us,
+                  (uint64_t)(get_clock() - start_ns) / 1000);
+}
+
 static uint32_t nand_dev_read_file(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
 {
     uint32_t len = total_len;
-    size_t read_len = dev->erase_size;
-    int eof = 0;
 
     NAND_UPDATE_READ_THRESHOLD(total_len);
 
-    do_lseek(dev->fd, addr, SEEK_SET);
+    int64_t start_ns = get_clock();
+    TRACE_BEGIN(TRACE_CATEGORY_NAND, "nand read");
     while(len > 0) {
-        if(read_len < dev->erase_size) {
-            memset(dev->data, 0xff, dev->erase_size);
-            read_len = dev->erase_size;
-            eof = 1;
+        uint32_t read_len = len;
+        uint8_t* buf = nand_dev_map_guest(data, &read_len, 1);
+        if(buf == NULL) {
+            buf = dev->data;
+            if(read_len > dev->erase_size)
+                read_len = dev->erase_size;
         }
-        if(len < read_len)
-            read_len = len;
-        if(!eof) {
-            read_len = do_read(dev->fd, dev->data, read_len);
-        }
-        safe_memory_rw_debug(current_cpu, data, dev->data, read_len, 1);
+        nand_dev_image_read(dev, buf, read_len, addr);
+        if(buf == dev->data)
+            safe_memory_rw_debug(current_cpu, data, dev->data, read_len, 1);
+        else
+            cpu_physical_memory_unmap(buf, read_len, 1, read_len);
         data += read_len;
+        addr += read_len;
         len -= read_len;
     }
+    TRACE_END(TRACE_CATEGORY_NAND, "nand read");
+    nand_dev_count_op(NAND_OP_READ, total_len, start_ns);
     return total_len;
 }
 
 static uint32_t nand_dev_write_file(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
 {
     uint32_t len = total_len;
-    size_t write_len = dev->erase_size;
-    int ret;
+    uint32_t ret;
 
     NAND_UPDATE_WRITE_THRESHOLD(total_len);
 
-    do_lseek(dev->fd, addr, SEEK_SET);
+    int64_t start_ns = get_clock();
+    TRACE_BEGIN(TRACE_CATEGORY_NAND, "nand write");
     while(len > 0) {
-        if(len < write_len)
-            write_len = len;
-        safe_memory_rw_debug(current_cpu, data, dev->data, write_len, 0);
-        ret = do_write(dev->fd, dev->data, write_len);
-        if(ret < write_len) {
-            XLOG("nand_dev_write_file, write failed: %s\n", strerror(errno));
-            break;
+        uint32_t write_len = len;
+        uint8_t* buf = nand_dev_map_guest(data, &write_len, 0);
+        if(buf == NULL) {
+            buf = dev->data;
+            if(write_len > dev->erase_size)
+                write_len = dev->erase_size;
+            safe_memory_rw_debug(current_cpu, data, dev->data, write_len, 0);
         }
+        ret = nand_dev_image_write(dev, buf, write_len, addr);
+        if(buf != dev->data)
+            cpu_physical_memory_unmap(buf, write_len, 0, write_len);
+        if(ret < write_len)
+            break;
         data += write_len;
+        addr += write_len;
         len -= write_len;
     }
+    TRACE_END(TRACE_CATEGORY_NAND, "nand write");
+    nand_dev_count_op(NAND_OP_WRITE, total_len - len, start_ns);
     return total_len - len;
 }
 
+/* Account for a transfer of |len| bytes to or from the image of |dev|, and
+ * pause the vCPU that requested it if it exceeds the I/O limits of |dev|.
+ * The transfers are synchronous, so this is the only way to spread them
+ * out. Returns |len|. */
+static uint32_t nand_dev_throttle(nand_dev *dev, uint32_t len)
+{
+    int64_t now, delay;
+
+    if (!throttle_enabled(&dev->throttle))
+        return len;
+    now = get_clock();
+    throttle_account(&dev->throttle, len, now);
+    delay = throttle_delay(&dev->throttle, now);
+    if (delay > 0 && current_cpu != NULL)
+        qemu_cpu_throttle_pause(current_cpu, delay);
+    return len;
+}
+
+/* Frees the space of whole erase block |block| in the image file, instead
+ * of filling it with 0xff. It then reads as zeroes, which is only valid for
+ * the ext4 partitions: YAFFS2 relies on erased pages reading as 0xff, and
+ * ext4 doesn't expect any content after a discard. Returns 0 on success.
+ */
+static int nand_dev_punch_block(nand_dev *dev, uint64_t block)
+{
+#ifdef __linux__
+    if (dev->extra_size != 0 || dev->no_punch)
+        return -1;
+    if (fallocate(dev->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  block * dev->erase_size, dev->erase_size) < 0) {
+        /* Don't try again on file systems that can't do it. */
+        if (errno == EOPNOTSUPP || errno == ENOSYS)
+            dev->no_punch = 1;
+        return -1;
+    }
+    /* The block no longer comes from the base file. */
+    if (dev->base_fd >= 0)
+        nand_dev_cow_set_block(dev, block);
+    return 0;
+#else
+    (void)dev;
+    (void)block;
+    return -1;
+#endif
+}
+
 static uint32_t nand_dev_erase_file(nand_dev *dev, uint64_t addr, uint32_t total_len)
 {
     uint32_t len = total_len;
-    size_t write_len = dev->erase_size;
-    int ret;
+    uint32_t write_len = dev->erase_size;
+    uint32_t ret;
 
-    do_lseek(dev->fd, addr, SEEK_SET);
+    int64_t start_ns = get_clock();
+    TRACE_BEGIN(TRACE_CATEGORY_NAND, "nand erase");
     memset(dev->data, 0xff, dev->erase_size);
     while(len > 0) {
         if(len < write_len)
             write_len = len;
-        ret = do_write(dev->fd, dev->data, write_len);
-        if(ret < write_len) {
-            XLOG( "nand_dev_write_file, write failed: %s\n", strerror(errno));
-            break;
+        if (write_len == dev->erase_size && addr % dev->erase_size == 0 &&
+            nand_dev_punch_block(dev, addr / dev->erase_size) == 0) {
+            addr += write_len;
+            len -= write_len;
+            continue;
         }
+        ret = nand_dev_image_write(dev, dev->data, write_len, addr);
+        if(ret < write_len)
+            break;
+        addr += write_len;
         len -= write_len;
     }
+    TRACE_END(TRACE_CATEGORY_NAND, "nand erase");
+    nand_dev_count_op(NAND_OP_ERASE, total_len - len, start_ns);
     return total_len - len;
 }
 
@@ -502,6 +917,7 @@ uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
     if(s->dev >= nand_dev_count)
         return 0;
     dev = nand_devs + s->dev;
+    nand_dev_wait_ready(dev);
 
     switch(cmd) {
     case NAND_CMD_GET_DEV_NAME:
@@ -516,7 +932,8 @@ uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
         if(size > dev->max_size - addr)
             size = dev->max_size - addr;
         if(dev->fd >= 0)
-            return nand_dev_read_file(dev, s->data, addr, size);
+            return nand_dev_throttle(dev,
+                    nand_dev_read_file(dev, s->data, addr, size));
         safe_memory_rw_debug(current_cpu, s->data, &dev->data[addr], size, 1);
         return size;
     case NAND_CMD_WRITE_BATCH:
@@ -528,7 +945,8 @@ uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
         if(size > dev->max_size - addr)
             size = dev->max_size - addr;
         if(dev->fd >= 0)
-            return nand_dev_write_file(dev, s->data, addr, size);
+            return nand_dev_throttle(dev,
+                    nand_dev_write_file(dev, s->data, addr, size));
         safe_memory_rw_debug(current_cpu, s->data, &dev->data[addr], size, 0);
         return size;
     case NAND_CMD_ERASE_BATCH:
@@ -555,6 +973,44 @@ uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
     }
 }
 
+/* Performs the operations of a NAND_CMD_VECTOR_BATCH descriptor, returns the
+ * number of completed ones.
+ */
+static uint32_t nand_dev_do_vector_batch(nand_dev_controller_state *s)
+{
+    struct vector_batch_data vbd;
+    struct vector_batch_op op;
+    uint64_t vbd_addr = ((uint64_t)s->batch_addr_high << 32) | s->batch_addr_low;
+    uint64_t op_addr = vbd_addr + sizeof(vbd);
+    uint32_t n;
+
+    cpu_physical_memory_read(vbd_addr, (void*)&vbd, sizeof(vbd));
+    if (vbd.count > NAND_VECTOR_BATCH_MAX_OPS)
+        vbd.count = NAND_VECTOR_BATCH_MAX_OPS;
+
+    for (n = 0; n < vbd.count; n++, op_addr += sizeof(op)) {
+        cpu_physical_memory_read(op_addr, (void*)&op, sizeof(op));
+        if (op.cmd != NAND_CMD_READ && op.cmd != NAND_CMD_WRITE &&
+            op.cmd != NAND_CMD_ERASE)
+            break;
+        s->dev = op.dev;
+        s->addr_low = op.addr_low;
+        s->addr_high = op.addr_high;
+        s->transfer_size = op.transfer_size;
+        s->data = op.data;
+        op.result = nand_dev_do_cmd(s, op.cmd);
+        cpu_physical_memory_write(op_addr + offsetof(struct vector_batch_op, result),
+                                  (void*)&op.result, sizeof(op.result));
+        if (op.result != op.transfer_size)
+            break;
+    }
+
+    vbd.result = n;
+    cpu_physical_memory_write(vbd_addr + offsetof(struct vector_batch_data, result),
+                              (void*)&vbd.result, sizeof(vbd.result));
+    return n;
+}
+
 /* I/O write */
 static void nand_dev_write(void *opaque, hwaddr offset, uint32_t value)
 {
@@ -589,6 +1045,10 @@ static void nand_dev_write(void *opaque, hwaddr offset, uint32_t value)
         uint64_set_high(&s->data, value);
         break;
     case NAND_COMMAND:
+        if (value == NAND_CMD_VECTOR_BATCH) {
+            s->result = nand_dev_do_vector_batch(s);
+            break;
+        }
         s->result = nand_dev_do_cmd(s, value);
         if (value == NAND_CMD_WRITE_BATCH || value == NAND_CMD_READ_BATCH ||
             value == NAND_CMD_ERASE_BATCH) {
@@ -696,6 +1156,7 @@ void nand_dev_init(uint32_t base)
     iomemtype = cpu_register_io_memory(nand_dev_readfn, nand_dev_writefn, s);
     cpu_register_physical_memory(base, 0x00000fff, iomemtype);
     s->base = base;
+    nand_dev_init_metrics();
 
     register_savevm(NULL,
                     "nand_dev",
@@ -706,6 +1167,67 @@ void nand_dev_init(uint32_t base)
                     s);
 }
 
+/* Makes |dst_fd| share the content of |src_fd| through a reflink, which is
+ * instant on file systems that support it (e.g. Btrfs or XFS). Returns 0 on
+ * success.
+ */
+static int nand_dev_clone_file(int dst_fd, int src_fd)
+{
+#ifdef __linux__
+    return ioctl(dst_fd, FICLONE, src_fd) == 0 ? 0 : -1;
+#else
+    (void)dst_fd;
+    (void)src_fd;
+    return -1;
+#endif
+}
+
+void nand_dev_set_wait_hook(const char *devname, void (*wait)(void))
+{
+    uint32_t i;
+    for (i = 0; i < nand_dev_count; i++) {
+        nand_dev *dev = nand_devs + i;
+        if (dev->devname_len == strlen(devname) &&
+            !memcmp(dev->devname, devname, dev->devname_len)) {
+            dev->wait_hook = wait;
+            return;
+        }
+    }
+}
+
+int nand_dev_set_io_limits(const char *devname, uint64_t bps, uint64_t iops)
+{
+    uint32_t i;
+    int found = 0;
+    for (i = 0; i < nand_dev_count; i++) {
+        nand_dev *dev = nand_devs + i;
+        if (devname == NULL ||
+            (dev->devname_len == strlen(devname) &&
+             !memcmp(dev->devname, devname, dev->devname_len))) {
+            throttle_set_limits(&dev->throttle, bps, iops);
+            found = 1;
+        }
+    }
+    return found ? 0 : -1;
+}
+
+void nand_dev_iterate_io_limits(void (*it)(void *opaque, const char *devname,
+                                           uint64_t bps, uint64_t iops),
+                                void *opaque)
+{
+    char name[64];
+    uint32_t i;
+    for (i = 0; i < nand_dev_count; i++) {
+        nand_dev *dev = nand_devs + i;
+        size_t len = dev->devname_len;
+        if (len >= sizeof(name))
+            len = sizeof(name) - 1;
+        memcpy(name, dev->devname, len);
+        name[len] = 0;
+        it(opaque, name, dev->throttle.bps, dev->throttle.iops);
+    }
+}
+
 static int arg_match(const char *a, const char *b, size_t b_len)
 {
     while(*a && b_len--) {
@@ -729,6 +1251,7 @@ void nand_add_dev(const char *arg)
     int initfd = -1;
     int rwfd = -1;
     int read_only = 0;
+    int is_temp = 0;
     int pad;
     ssize_t read_size;
     uint32_t page_size = 2048;
@@ -837,6 +1360,7 @@ void nand_add_dev(const char *arg)
             exit(1);
         }
         rwfilename = (char*) tempfile_path(tmp);
+        is_temp = 1;
         if (VERBOSE_CHECK(init))
             dprint( "mapping '%.*s' NAND image to %s", devname_len, devname, rwfilename);
     }
@@ -886,6 +1410,7 @@ void nand_add_dev(const char *arg)
     dev->page_size = page_size;
     dev->extra_size = extra_size;
     dev->erase_size = erase_pages * (page_size + extra_size);
+    dev->no_punch = 0;
     pad = dev_size % dev->erase_size;
     if (pad != 0) {
         dev_size += (dev->erase_size - pad);
@@ -898,11 +1423,37 @@ void nand_add_dev(const char *arg)
     if(dev->data == NULL)
         goto out_of_memory;
     dev->flags = read_only ? NAND_DEV_FLAG_READ_ONLY : 0;
-#ifdef TARGET_I386
-    dev->flags |= NAND_DEV_FLAG_BATCH_CAP;
-#endif
-
-    if (initfd >= 0) {
+    dev->flags |= NAND_DEV_FLAG_BATCH_CAP | NAND_DEV_FLAG_VECTOR_BATCH_CAP;
+
+    dev->base_fd = -1;
+    dev->base_size = 0;
+    dev->cow_bitmap = NULL;
+    dev->cow_data = NULL;
+    dev->map = NULL;
+    dev->map_size = 0;
+    dev->map_fd = -1;
+    dev->map_next = 0;
+    dev->map_prefetched = 0;
+    dev->map_window = 0;
+    dev->wait_hook = NULL;
+    throttle_init(&dev->throttle);
+
+    if (initfd >= 0 && nand_dev_clone_file(rwfd, initfd) == 0) {
+        D("cloned %s to %s", initfilename, rwfilename);
+        close(initfd);
+    } else if (initfd >= 0 && is_temp) {
+        /* The temporary image is discarded at exit, so don't copy the init
+         * file into it: use the latter as the read-only base of a
+         * copy-on-write overlay, the temporary file only receiving the
+         * erase blocks that the guest modifies. */
+        dev->base_size = do_lseek(initfd, 0, SEEK_END);
+        dev->cow_bitmap = calloc(nand_dev_cow_bitmap_size(dev), 1);
+        dev->cow_data = malloc(dev->erase_size);
+        if(dev->cow_bitmap == NULL || dev->cow_data == NULL)
+            goto out_of_memory;
+        dev->base_fd = initfd;
+        D("using %s as copy-on-write base of %s", initfilename, rwfilename);
+    } else if (initfd >= 0) {
         do {
             read_size = do_read(initfd, dev->data, dev->erase_size);
             if(read_size < 0) {
@@ -918,6 +1469,12 @@ void nand_add_dev(const char *arg)
     }
     dev->fd = rwfd;
 
+    /* The content of read-only files doesn't change, map them. */
+    if (dev->base_fd >= 0 || read_only) {
+        if (nand_dev_map_file(dev, dev->base_fd >= 0 ? dev->base_fd : dev->fd) == 0)
+            D("mapped %.*s NAND image", devname_len, devname);
+    }
+
     nand_dev_count++;
 
     return;
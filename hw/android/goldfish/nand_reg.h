@@ -21,7 +21,8 @@ enum nand_cmd {
     NAND_CMD_BLOCK_BAD_SET,
     NAND_CMD_READ_BATCH,	// BATCH OP extensions.
     NAND_CMD_WRITE_BATCH,
-    NAND_CMD_ERASE_BATCH
+    NAND_CMD_ERASE_BATCH,
+    NAND_CMD_VECTOR_BATCH   // Several operations described at NAND_BATCH_ADDR
 };
 
 struct batch_data{
@@ -42,9 +43,32 @@ struct batch_data_64 {
     uint32_t result;
 };
 
+// A NAND_CMD_VECTOR_BATCH descriptor is a struct vector_batch_data header,
+// followed by |count| struct vector_batch_op, at the guest physical address
+// in NAND_BATCH_ADDR. The operations are performed in order until one of
+// them transfers less than its |transfer_size|, and the header's |result|
+// as well as NAND_RESULT are set to the number of completed operations.
+struct vector_batch_data {
+    uint32_t count;
+    uint32_t result;
+};
+
+struct vector_batch_op {
+    uint32_t cmd;           // NAND_CMD_READ, NAND_CMD_WRITE or NAND_CMD_ERASE
+    uint32_t dev;
+    uint32_t addr_low;
+    uint32_t addr_high;
+    uint32_t transfer_size;
+    uint32_t result;        // Number of bytes transferred
+    uint64_t data;          // Guest virtual address, for all guest CPUs
+};
+
+#define NAND_VECTOR_BATCH_MAX_OPS  256
+
 enum nand_dev_flags {
     NAND_DEV_FLAG_READ_ONLY = 0x00000001,
-    NAND_DEV_FLAG_BATCH_CAP = 0x00000002
+    NAND_DEV_FLAG_BATCH_CAP = 0x00000002,
+    NAND_DEV_FLAG_VECTOR_BATCH_CAP = 0x00000004
 };
 
 #define NAND_VERSION_CURRENT (1)
@@ -10,7 +10,9 @@
 ** GNU General Public License for more details.
 */
 #include "android/utils/panic.h"
+#include "android/utils/metrics.h"
 #include "android/utils/system.h"
+#include "android/utils/trace.h"
 #include "hw/android/goldfish/pipe.h"
 #include "hw/android/goldfish/device.h"
 #include "hw/android/goldfish/vmem.h"
@@ -71,6 +73,9 @@ typedef struct {
     const char*        name;
     void*              opaque;
     GoldfishPipeFuncs  funcs;
+    /* Counters of the bytes transferred in each direction */
+    Metric*            bytes_from_guest;
+    Metric*            bytes_to_guest;
 } PipeService;
 
 typedef struct {
@@ -100,6 +105,18 @@ goldfish_pipe_add_type(const char*               pipeName,
     list->services[count].opaque = pipeOpaque;
     list->services[count].funcs  = pipeFuncs[0];
 
+    char  labels[MAX_PIPE_SERVICE_NAME_SIZE + 48];
+    snprintf(labels, sizeof(labels),
+             "service=\"%s\",direction=\"from_guest\"", pipeName);
+    list->services[count].bytes_from_guest = metrics_counter(
+            "emulator_pipe_bytes_total", labels,
+            "Bytes transferred through the goldfish pipes, per service");
+    snprintf(labels, sizeof(labels),
+             "service=\"%s\",direction=\"to_guest\"", pipeName);
+    list->services[count].bytes_to_guest = metrics_counter(
+            "emulator_pipe_bytes_total", labels,
+            "Bytes transferred through the goldfish pipes, per service");
+
     list->count++;
 }
 
@@ -129,8 +146,13 @@ goldfish_pipe_find_type(const char*  pipeName)
 typedef struct PipeDevice  PipeDevice;
 
 typedef struct Pipe {
+    /* Links in the device's list of all pipes */
     struct Pipe*              next;
+    struct Pipe**             pprev;
+    /* Links in the device's queue of signaled pipes. |pprev_waked| is
+     * NULL iff the pipe is not in the queue. */
     struct Pipe*              next_waked;
+    struct Pipe**             pprev_waked;
     PipeDevice*                device;
     uint64_t                   channel;
     void*                      opaque;
@@ -162,63 +184,6 @@ pipe_new(uint64_t channel, PipeDevice* dev)
     return pipe;
 }
 
-static Pipe**
-pipe_list_findp_channel( Pipe** list, uint64_t channel )
-{
-    Pipe** pnode = list;
-    for (;;) {
-        Pipe* node = *pnode;
-        if (node == NULL || node->channel == channel) {
-            break;
-        }
-        pnode = &node->next;
-    }
-    return pnode;
-}
-
-#if 0
-static Pipe**
-pipe_list_findp_opaque( Pipe** list, void* opaque )
-{
-    Pipe** pnode = list;
-    for (;;) {
-        Pipe* node = *pnode;
-        if (node == NULL || node->opaque == opaque) {
-            break;
-        }
-        pnode = &node->next;
-    }
-    return pnode;
-}
-#endif
-
-static Pipe**
-pipe_list_findp_waked( Pipe** list, Pipe* pipe )
-{
-    Pipe** pnode = list;
-    for (;;) {
-        Pipe* node = *pnode;
-        if (node == NULL || node == pipe) {
-            break;
-        }
-        pnode = &node->next_waked;
-    }
-    return pnode;
-}
-
-
-static void
-pipe_list_remove_waked( Pipe** list, Pipe*  pipe )
-{
-    Pipe** lookup = pipe_list_findp_waked(list, pipe);
-    Pipe*  node   = *lookup;
-
-    if (node != NULL) {
-        (*lookup) = node->next_waked;
-        node->next_waked = NULL;
-    }
-}
-
 static void
 pipe_save( Pipe* pipe, QEMUFile* file )
 {
@@ -598,6 +563,10 @@ typedef struct {
     size_t    pos;
     size_t    count;
     unsigned  flags;
+    /* Time at which the buffer stopped being empty, in ns */
+    int64_t   sendTime;
+    /* Histogram of the round trips through the pipe, or NULL */
+    Metric*   roundTrips;
 } PingPongPipe;
 
 static void
@@ -618,6 +587,13 @@ pingPongPipe_init( void* hwpipe, void* svcOpaque, const char* args )
     D("%s: hwpipe=%p", __FUNCTION__, hwpipe);
     ANEW0(ppipe);
     pingPongPipe_init0(ppipe, hwpipe, svcOpaque);
+    /* Host benchmarks have no hardware pipe, and measure themselves */
+    if (hwpipe != NULL) {
+        ppipe->roundTrips = metrics_histogram(
+                "emulator_pipe_pingpong_roundtrip_us", NULL,
+                "Time between a guest write to a pingpong pipe and the read "
+                "that drains it");
+    }
     return ppipe;
 }
 
@@ -684,6 +660,9 @@ pingPongPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int n
             memcpy(pipe->buffer + wpos, buff->data, avail2);
             memcpy(pipe->buffer, buff->data + avail2, avail - avail2);
         }
+        if (pipe->count == 0) {
+            pipe->sendTime = get_clock();
+        }
         pipe->count += avail;
         ret += avail;
     }
@@ -732,6 +711,11 @@ pingPongPipe_recvBuffers( void* opaque, GoldfishPipeBuffer* buffers, int numBuff
         buffers++;
     }
 
+    if (ret > 0 && pipe->count == 0 && pipe->roundTrips != NULL) {
+        metric_record(pipe->roundTrips,
+                      (uint64_t)(get_clock() - pipe->sendTime) / 1000);
+    }
+
     /* Wake up any waiting readers if we wrote something */
     if (pipe->count < PINGPONG_SIZE && (pipe->flags & PIPE_WAKE_WRITE)) {
         goldfish_pipe_wake(pipe->hwpipe, PIPE_WAKE_WRITE);
@@ -944,6 +928,89 @@ static const GoldfishPipeFuncs  throttlePipe_funcs = {
 
 #endif /* DEBUG_THROTTLE_PIPE */
 
+/***********************************************************************
+ ***********************************************************************
+ *****
+ *****    P I P E   B E N C H M A R K S
+ *****
+ *****/
+
+/* Size of the buffers passed to the services by the host benchmarks, the
+ * device translates guest buffers into page-contained ones too. */
+#define PIPE_BENCH_BUFFER_SIZE  4096
+
+int
+goldfish_pipe_bench( const char* serviceName, int size, int durationMs,
+                     GoldfishPipeBenchResult* result )
+{
+    const PipeService*   service = goldfish_pipe_find_type(serviceName);
+    GoldfishPipeBuffer*  buffers;
+    uint8_t*             data;
+    void*                opaque;
+    int                  numBuffers;
+    int                  nn;
+    int64_t              start, now = 0, deadline;
+    char                 labels[MAX_PIPE_SERVICE_NAME_SIZE + 48];
+
+    memset(result, 0, sizeof(*result));
+
+    /* Only services that answer without a guest or a timer can be driven
+     * from the host. */
+    if (service == NULL || size <= 0 ||
+        (strcmp(serviceName, "zero") && strcmp(serviceName, "pingpong"))) {
+        return -1;
+    }
+    opaque = service->funcs.init(NULL, service->opaque, NULL);
+    if (opaque == NULL) {
+        return -1;
+    }
+
+    numBuffers = (size + PIPE_BENCH_BUFFER_SIZE - 1) / PIPE_BENCH_BUFFER_SIZE;
+    data = android_alloc0(size);
+    buffers = android_alloc(numBuffers * sizeof(buffers[0]));
+    for (nn = 0; nn < numBuffers; nn++) {
+        buffers[nn].data = data + nn * PIPE_BENCH_BUFFER_SIZE;
+        buffers[nn].size = PIPE_BENCH_BUFFER_SIZE;
+    }
+    buffers[numBuffers - 1].size = size - (numBuffers - 1) * PIPE_BENCH_BUFFER_SIZE;
+
+    /* Each round trip writes |size| bytes, then reads them back. */
+    start = get_clock();
+    deadline = start + (int64_t)durationMs * 1000000;
+    do {
+        int  sent = service->funcs.sendBuffers(opaque, buffers, numBuffers);
+        int  received = service->funcs.recvBuffers(opaque, buffers, numBuffers);
+        if (sent != size || received != size) {
+            break;
+        }
+        result->roundTrips++;
+        result->bytes += (uint64_t)sent + received;
+        now = get_clock();
+    } while (now < deadline);
+    result->elapsedNs = (uint64_t)(get_clock() - start);
+
+    service->funcs.close(opaque);
+    AFREE(buffers);
+    AFREE(data);
+
+    if (result->roundTrips == 0) {
+        return -1;
+    }
+
+    /* Keep the last results with the other metrics, so that they can be
+     * collected along with them. */
+    snprintf(labels, sizeof(labels), "service=\"%s\",size=\"%d\"",
+             serviceName, size);
+    metric_set(metrics_gauge("emulator_pipe_bench_bytes_per_second", labels,
+                             "Throughput of the last host-driven pipe benchmark"),
+               (int64_t)(result->bytes * 1000000000ULL / result->elapsedNs));
+    metric_set(metrics_gauge("emulator_pipe_bench_roundtrip_ns", labels,
+                             "Round trip time of the last host-driven pipe "
+                             "benchmark"),
+               (int64_t)(result->elapsedNs / result->roundTrips));
+    return 0;
+}
+
 /***********************************************************************
  ***********************************************************************
  *****
@@ -957,8 +1024,14 @@ struct PipeDevice {
     /* the list of all pipes */
     Pipe*  pipes;
 
-    /* the list of signalled pipes */
+    /* open-addressing hash table of all pipes, indexed by channel */
+    Pipe**    pipe_table;
+    uint32_t  pipe_table_size;   /* always a power of 2 */
+    uint32_t  pipe_table_count;
+
+    /* the FIFO queue of signalled pipes */
     Pipe*  signaled_pipes;
+    Pipe** signaled_tail;
 
     /* i/o registers */
     uint64_t  address;
@@ -969,11 +1042,234 @@ struct PipeDevice {
     uint64_t  params_addr;
 };
 
+/* Initial size of the pipe hash table, must be a power of 2 */
+#define PIPE_TABLE_MIN_SIZE  64
+
+static uint32_t
+pipe_hash( uint64_t channel )
+{
+    /* Channels are guest kernel pointers, so their low bits are mostly
+     * zero. Use a multiplicative hash to spread them. */
+    channel *= 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(channel >> 32);
+}
+
+/* Return the table slot holding |channel|, or the empty slot where it
+ * should be inserted. */
+static uint32_t
+pipeDevice_findSlot( PipeDevice* dev, uint64_t channel )
+{
+    uint32_t  mask = dev->pipe_table_size - 1;
+    uint32_t  n    = pipe_hash(channel) & mask;
+
+    for (;;) {
+        Pipe* node = dev->pipe_table[n];
+        if (node == NULL || node->channel == channel)
+            return n;
+        n = (n + 1) & mask;
+    }
+}
+
+static Pipe*
+pipeDevice_findPipe( PipeDevice* dev, uint64_t channel )
+{
+    if (dev->pipe_table_count == 0)
+        return NULL;
+    return dev->pipe_table[pipeDevice_findSlot(dev, channel)];
+}
+
 static void
-pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
+pipeDevice_resizeTable( PipeDevice* dev, uint32_t newSize )
+{
+    Pipe**    oldTable = dev->pipe_table;
+    uint32_t  oldSize  = dev->pipe_table_size;
+    uint32_t  n;
+
+    AARRAY_NEW0(dev->pipe_table, newSize);
+    dev->pipe_table_size = newSize;
+
+    for (n = 0; n < oldSize; n++) {
+        Pipe* node = oldTable[n];
+        if (node != NULL)
+            dev->pipe_table[pipeDevice_findSlot(dev, node->channel)] = node;
+    }
+    AFREE(oldTable);
+}
+
+/* Add |pipe| to the device's list and hash table. Its channel must not
+ * be used by another pipe. */
+static void
+pipeDevice_addPipe( PipeDevice* dev, Pipe* pipe )
+{
+    /* Keep the load factor under 1/2 */
+    if (dev->pipe_table_size == 0) {
+        pipeDevice_resizeTable(dev, PIPE_TABLE_MIN_SIZE);
+    } else if ((dev->pipe_table_count + 1) * 2 > dev->pipe_table_size) {
+        pipeDevice_resizeTable(dev, dev->pipe_table_size * 2);
+    }
+    dev->pipe_table[pipeDevice_findSlot(dev, pipe->channel)] = pipe;
+    dev->pipe_table_count++;
+
+    pipe->next  = dev->pipes;
+    pipe->pprev = &dev->pipes;
+    if (dev->pipes != NULL)
+        dev->pipes->pprev = &pipe->next;
+    dev->pipes = pipe;
+}
+
+/* Remove |pipe| from the device's list and hash table. */
+static void
+pipeDevice_removePipe( PipeDevice* dev, Pipe* pipe )
+{
+    uint32_t  mask = dev->pipe_table_size - 1;
+    uint32_t  hole = pipeDevice_findSlot(dev, pipe->channel);
+    uint32_t  n    = hole;
+
+    /* Backward-shift deletion: move the following entries of the probe
+     * sequence into the hole when this doesn't break their lookup. */
+    dev->pipe_table[hole] = NULL;
+    for (;;) {
+        Pipe*     node;
+        uint32_t  home;
+
+        n = (n + 1) & mask;
+        node = dev->pipe_table[n];
+        if (node == NULL)
+            break;
+        home = pipe_hash(node->channel) & mask;
+        if (((n - home) & mask) >= ((n - hole) & mask)) {
+            dev->pipe_table[hole] = node;
+            dev->pipe_table[n] = NULL;
+            hole = n;
+        }
+    }
+    dev->pipe_table_count--;
+
+    *pipe->pprev = pipe->next;
+    if (pipe->next != NULL)
+        pipe->next->pprev = pipe->pprev;
+    pipe->next  = NULL;
+    pipe->pprev = NULL;
+}
+
+/* Append |pipe| to the queue of signaled pipes, if not already there. */
+static void
+pipeDevice_addSignaled( PipeDevice* dev, Pipe* pipe )
+{
+    if (pipe->pprev_waked != NULL)
+        return;
+
+    if (dev->signaled_tail == NULL)
+        dev->signaled_tail = &dev->signaled_pipes;
+
+    pipe->next_waked   = NULL;
+    pipe->pprev_waked  = dev->signaled_tail;
+    *dev->signaled_tail = pipe;
+    dev->signaled_tail = &pipe->next_waked;
+}
+
+/* Remove |pipe| from the queue of signaled pipes, if it is there. */
+static void
+pipeDevice_removeSignaled( PipeDevice* dev, Pipe* pipe )
+{
+    if (pipe->pprev_waked == NULL)
+        return;
+
+    *pipe->pprev_waked = pipe->next_waked;
+    if (pipe->next_waked != NULL) {
+        pipe->next_waked->pprev_waked = pipe->pprev_waked;
+    } else {
+        dev->signaled_tail = pipe->pprev_waked;
+    }
+    pipe->next_waked  = NULL;
+    pipe->pprev_waked = NULL;
+}
+
+/* Maximum number of page-contained GoldfishPipeBuffers that a single
+ * PIPE_CMD_XXX_BUFFER_LIST command can be translated into. */
+#define PIPE_MAX_PAGE_BUFFERS  256
+
+/* Translate the guest virtual buffer at |address| of |size| bytes into
+ * page-contained buffers in emulator memory, stored into |buffers|.
+ * Returns the number of buffers used, or -1 if more than |maxBuffers|
+ * would be needed. */
+static int
+pipeDevice_translateBuffer( CPUOldState* env, target_ulong address,
+                            uint32_t size, GoldfishPipeBuffer* buffers,
+                            int maxBuffers )
+{
+    int  count = 0;
+
+    while (size > 0) {
+        target_ulong  page  = address & TARGET_PAGE_MASK;
+        uint32_t      avail = (uint32_t)(page + TARGET_PAGE_SIZE - address);
+        hwaddr        phys;
+
+        if (count == maxBuffers)
+            return -1;
+
+        if (avail > size)
+            avail = size;
+
+        phys = safe_get_phys_page_debug(ENV_GET_CPU(env), page);
+#ifdef TARGET_X86_64
+        phys = phys & TARGET_PTE_MASK;
+#endif
+        buffers[count].data = qemu_get_ram_ptr(phys) + (address - page);
+        buffers[count].size = avail;
+        count++;
+
+        address += avail;
+        size    -= avail;
+    }
+    return count;
+}
+
+/* Read the array of struct pipe_buffer_entry described by the device's
+ * address and size registers, and translate all its entries into
+ * |buffers|. Returns the number of buffers, or PIPE_ERROR_INVAL. */
+static int
+pipeDevice_readBufferList( PipeDevice* dev, CPUOldState* env,
+                           GoldfishPipeBuffer* buffers, int maxBuffers )
+{
+    struct pipe_buffer_entry  entry;
+    uint32_t  n;
+    int       count = 0;
+
+    if (dev->size == 0 || dev->size > PIPE_MAX_BUFFER_ENTRIES)
+        return PIPE_ERROR_INVAL;
+
+    for (n = 0; n < dev->size; n++) {
+        int  ret;
+
+        cpu_physical_memory_read(dev->address + n * sizeof(entry),
+                                 (void*)&entry, sizeof(entry));
+        ret = pipeDevice_translateBuffer(env,
+                                         (target_ulong)entry.address,
+                                         entry.size,
+                                         buffers + count,
+                                         maxBuffers - count);
+        if (ret < 0)
+            return PIPE_ERROR_INVAL;
+        count += ret;
+    }
+    return count;
+}
+
+/* Count the bytes transferred by a command that returned |status| */
+static void
+pipe_countBytes( Pipe* pipe, int toGuest, int status )
 {
-    Pipe** lookup = pipe_list_findp_channel(&dev->pipes, dev->channel);
-    Pipe*  pipe   = *lookup;
+    if (pipe->service == NULL || status <= 0)
+        return;
+    metric_add(toGuest ? pipe->service->bytes_to_guest
+                       : pipe->service->bytes_from_guest, status);
+}
+
+static void
+pipeDevice_runCommand( PipeDevice* dev, uint32_t command )
+{
+    Pipe*  pipe = pipeDevice_findPipe(dev, dev->channel);
     CPUOldState* env = cpu_single_env;
 
     /* Check that we're referring a known pipe channel */
@@ -996,17 +1292,15 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
             break;
         }
         pipe = pipe_new(dev->channel, dev);
-        pipe->next = dev->pipes;
-        dev->pipes = pipe;
+        pipeDevice_addPipe(dev, pipe);
         dev->status = 0;
         break;
 
     case PIPE_CMD_CLOSE:
         DD("%s: CMD_CLOSE channel=0x%llx", __FUNCTION__, (unsigned long long)dev->channel);
         /* Remove from device's lists */
-        *lookup = pipe->next;
-        pipe->next = NULL;
-        pipe_list_remove_waked(&dev->signaled_pipes, pipe);
+        pipeDevice_removePipe(dev, pipe);
+        pipeDevice_removeSignaled(dev, pipe);
         pipe_free(pipe);
         break;
 
@@ -1028,6 +1322,7 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
         buffer.data = qemu_get_ram_ptr(phys) + (address - page);
         buffer.size = dev->size;
         dev->status = pipe->funcs->recvBuffers(pipe->opaque, &buffer, 1);
+        pipe_countBytes(pipe, 1, dev->status);
         DD("%s: CMD_READ_BUFFER channel=0x%llx address=0x%16llx size=%d > status=%d",
            __FUNCTION__, (unsigned long long)dev->channel, (unsigned long long)dev->address,
            dev->size, dev->status);
@@ -1047,12 +1342,35 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
         buffer.data = qemu_get_ram_ptr(phys) + (address - page);
         buffer.size = dev->size;
         dev->status = pipe->funcs->sendBuffers(pipe->opaque, &buffer, 1);
+        pipe_countBytes(pipe, 0, dev->status);
         DD("%s: CMD_WRITE_BUFFER channel=0x%llx address=0x%16llx size=%d > status=%d",
            __FUNCTION__, (unsigned long long)dev->channel, (unsigned long long)dev->address,
            dev->size, dev->status);
         break;
     }
 
+    case PIPE_CMD_READ_BUFFER_LIST:
+    case PIPE_CMD_WRITE_BUFFER_LIST: {
+        /* Resolve all the guest buffers at once, to send a single vector
+         * to the pipe service. */
+        GoldfishPipeBuffer  buffers[PIPE_MAX_PAGE_BUFFERS];
+        int  count = pipeDevice_readBufferList(dev, env, buffers,
+                                               PIPE_MAX_PAGE_BUFFERS);
+        if (count < 0) {
+            dev->status = count;
+        } else if (command == PIPE_CMD_READ_BUFFER_LIST) {
+            dev->status = pipe->funcs->recvBuffers(pipe->opaque, buffers, count);
+            pipe_countBytes(pipe, 1, dev->status);
+        } else {
+            dev->status = pipe->funcs->sendBuffers(pipe->opaque, buffers, count);
+            pipe_countBytes(pipe, 0, dev->status);
+        }
+        DD("%s: CMD_%s_BUFFER_LIST channel=0x%llx entries=%d buffers=%d > status=%d",
+           __FUNCTION__, (command == PIPE_CMD_READ_BUFFER_LIST) ? "READ" : "WRITE",
+           (unsigned long long)dev->channel, dev->size, count, dev->status);
+        break;
+    }
+
     case PIPE_CMD_WAKE_ON_READ:
         DD("%s: CMD_WAKE_ON_READ channel=0x%llx", __FUNCTION__, (unsigned long long)dev->channel);
         if ((pipe->wanted & PIPE_WAKE_READ) == 0) {
@@ -1076,6 +1394,61 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
     }
 }
 
+/* Names of the trace events and metric labels of each command. Trace
+ * event names must be string literals. */
+static const struct {
+    const char*  trace_name;
+    const char*  label;
+} _pipe_commands[] = {
+    [PIPE_CMD_OPEN]              = { "pipe open", "open" },
+    [PIPE_CMD_CLOSE]             = { "pipe close", "close" },
+    [PIPE_CMD_POLL]              = { "pipe poll", "poll" },
+    [PIPE_CMD_WRITE_BUFFER]      = { "pipe write", "write" },
+    [PIPE_CMD_WAKE_ON_WRITE]     = { "pipe wake on write", "wake_on_write" },
+    [PIPE_CMD_READ_BUFFER]       = { "pipe read", "read" },
+    [PIPE_CMD_WAKE_ON_READ]      = { "pipe wake on read", "wake_on_read" },
+    [PIPE_CMD_WRITE_BUFFER_LIST] = { "pipe write list", "write_list" },
+    [PIPE_CMD_READ_BUFFER_LIST]  = { "pipe read list", "read_list" },
+};
+
+/* Counters of the commands of each type, see pipe_initMetrics() */
+static Metric*  _pipe_command_metrics[ARRAY_SIZE(_pipe_commands)];
+
+static void
+pipe_initMetrics(void)
+{
+    char  labels[64];
+    int   nn;
+
+    for (nn = 0; nn < (int)ARRAY_SIZE(_pipe_commands); nn++) {
+        if (_pipe_commands[nn].label == NULL)
+            continue;
+        snprintf(labels, sizeof(labels), "command=\"%s\"",
+                 _pipe_commands[nn].label);
+        _pipe_command_metrics[nn] = metrics_counter(
+                "emulator_pipe_commands_total", labels,
+                "Goldfish pipe commands run, per type");
+    }
+}
+
+static void
+pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
+{
+    const char*  name = NULL;
+
+    if (command < ARRAY_SIZE(_pipe_commands))
+        name = _pipe_commands[command].trace_name;
+    if (name == NULL) {
+        name = "pipe unknown command";
+    } else {
+        metric_add(_pipe_command_metrics[command], 1);
+    }
+
+    TRACE_BEGIN(TRACE_CATEGORY_PIPE, name);
+    pipeDevice_runCommand(dev, command);
+    TRACE_END(TRACE_CATEGORY_PIPE, name);
+}
+
 static void pipe_dev_write(void *opaque, hwaddr offset, uint32_t value)
 {
     PipeDevice *s = (PipeDevice *)opaque;
@@ -1149,7 +1522,9 @@ static void pipe_dev_write(void *opaque, hwaddr offset, uint32_t value)
             s->address = aps.address;
             cmd = aps.cmd;
         }
-        if ((cmd != PIPE_CMD_READ_BUFFER) && (cmd != PIPE_CMD_WRITE_BUFFER))
+        if ((cmd != PIPE_CMD_READ_BUFFER) && (cmd != PIPE_CMD_WRITE_BUFFER) &&
+            (cmd != PIPE_CMD_READ_BUFFER_LIST) &&
+            (cmd != PIPE_CMD_WRITE_BUFFER_LIST))
             break;
 
         pipeDevice_doCommand(s, cmd);
@@ -1189,8 +1564,7 @@ static uint32_t pipe_dev_read(void *opaque, hwaddr offset)
                (unsigned long long)pipe->channel, pipe->wanted);
             dev->wakes = pipe->wanted;
             pipe->wanted = 0;
-            dev->signaled_pipes = pipe->next_waked;
-            pipe->next_waked = NULL;
+            pipeDevice_removeSignaled(dev, pipe);
             if (dev->signaled_pipes == NULL) {
                 goldfish_device_set_irq(&dev->dev, 0, 0);
                 DD("%s: lowering IRQ", __FUNCTION__);
@@ -1298,8 +1672,7 @@ goldfish_pipe_load( QEMUFile* file, void* opaque, int version_id )
         if (pipe == NULL) {
             return -EIO;
         }
-        pipe->next = dev->pipes;
-        dev->pipes = pipe;
+        pipeDevice_addPipe(dev, pipe);
     }
 
     /* Now we need to wake/close all relevant pipes */
@@ -1327,6 +1700,17 @@ void pipe_dev_init(bool newDeviceNaming)
     s->dev.irq_count = 1;
 
     goldfish_device_add(&s->dev, pipe_dev_readfn, pipe_dev_writefn, s);
+    pipe_initMetrics();
+
+    /* Writes to the parameter registers only store a value, so under KVM
+     * they can be queued in the coalesced MMIO ring instead of exiting to
+     * the emulator. The ring is replayed before the next exit is handled,
+     * i.e. before the PIPE_REG_COMMAND write that uses them. */
+    qemu_register_coalesced_mmio(s->dev.base + PIPE_REG_CHANNEL,
+                                 PIPE_REG_ACCESS_PARAMS - PIPE_REG_CHANNEL);
+    qemu_register_coalesced_mmio(s->dev.base + PIPE_REG_CHANNEL_HIGH,
+                                 PIPE_REG_ADDRESS_HIGH + 4 -
+                                         PIPE_REG_CHANNEL_HIGH);
 
     register_savevm(NULL,
                     "goldfish_pipe",
@@ -1351,17 +1735,12 @@ void
 goldfish_pipe_wake( void* hwpipe, unsigned flags )
 {
     Pipe*  pipe = hwpipe;
-    Pipe** lookup;
     PipeDevice*  dev = pipe->device;
 
     DD("%s: channel=0x%llx flags=%d", __FUNCTION__, (unsigned long long)pipe->channel, flags);
 
     /* If not already there, add to the list of signaled pipes */
-    lookup = pipe_list_findp_waked(&dev->signaled_pipes, pipe);
-    if (!*lookup) {
-        pipe->next_waked = dev->signaled_pipes;
-        dev->signaled_pipes = pipe;
-    }
+    pipeDevice_addSignaled(dev, pipe);
     pipe->wanted |= (unsigned)flags;
 
     /* Raise IRQ to indicate there are items on our list ! */
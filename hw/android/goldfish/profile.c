@@ -12,6 +12,8 @@
 
 #include "hw/android/goldfish/profile.h"
 #include "exec/code-profile.h"
+#include "qemu/timer.h"
+#include "qom/cpu.h"
 #include "cpu.h"
 
 #include <stdlib.h>
@@ -54,6 +56,7 @@ typedef struct BinaryProfile {
 extern unsigned get_current_pid();
 
 static MmapData *mmaps[65536];
+static char *thread_names[65536];
 static BinaryProfile *head_binary = NULL;
 
 #define BUF_SIZE 4096
@@ -257,3 +260,158 @@ void profile_bb_helper(target_ulong pc, uint32_t size) {
     prev_pc = pc + size;
   }
 }
+
+void record_thread_name(unsigned tid, const char *name) {
+  tid &= 0xffff;
+  free(thread_names[tid]);
+  thread_names[tid] = strdup(name);
+}
+
+/* Samples beyond this are dropped, that's more than 15 minutes at 1kHz */
+#define MAX_SAMPLES (1 << 20)
+
+typedef struct InternedString {
+  char *str;
+  struct InternedString *next;
+} InternedString;
+
+/* Samples are resolved when they are taken, as the mappings and thread
+   names change over time. Their strings are interned and never freed. */
+typedef struct ProfileSample {
+  int64_t time_ns;
+  unsigned tid;
+  const char *comm;
+  const char *binary;   /* NULL if unknown */
+  const char *symbol;   /* NULL if unknown */
+  uint64_t addr;        /* offset in |binary|, or guest PC */
+} ProfileSample;
+
+int profile_sampling_rate = -1;
+
+static InternedString *interned_strings = NULL;
+static QEMUTimer *sampling_timer = NULL;
+static int64_t sampling_period_ns;
+static ProfileSample *samples = NULL;
+static int sample_count = 0;
+static int sample_capacity = 0;
+static int dropped_samples = 0;
+
+static const char *intern_string(const char *str) {
+  InternedString *curr = interned_strings;
+  while (curr) {
+    if (!strcmp(curr->str, str)) {
+      return curr->str;
+    }
+    curr = curr->next;
+  }
+  curr = (InternedString *)malloc(sizeof(InternedString));
+  curr->str = strdup(str);
+  curr->next = interned_strings;
+  interned_strings = curr;
+  return curr->str;
+}
+
+static void record_sample(target_ulong pc, unsigned tid, int64_t now_ns) {
+  ProfileSample *sample;
+  const MmapData *data;
+  char symbol[256];
+
+  if (sample_count == sample_capacity) {
+    if (sample_capacity == MAX_SAMPLES) {
+      dropped_samples++;
+      return;
+    }
+    sample_capacity = sample_capacity ? sample_capacity * 2 : 4096;
+    samples = (ProfileSample *)realloc(samples,
+                                       sample_capacity * sizeof(*samples));
+  }
+  sample = &samples[sample_count++];
+  sample->time_ns = now_ns;
+  sample->tid = tid;
+  sample->comm = intern_string(thread_names[tid & 0xffff] ?
+                               thread_names[tid & 0xffff] : "[unknown]");
+  sample->binary = NULL;
+  sample->symbol = NULL;
+  sample->addr = pc;
+
+  data = get_mmap_data(pc, tid & 0xffff);
+  if (data) {
+    sample->binary = intern_string(data->name);
+    sample->addr = pc + data->offset - data->start;
+  } else if (tb_profile_symbolize_func &&
+             tb_profile_symbolize_func(pc, symbol, sizeof(symbol)) == 0) {
+    sample->binary = intern_string("[kernel.kallsyms]");
+    sample->symbol = intern_string(symbol);
+  }
+}
+
+static void sampling_tick(void *opaque) {
+  int64_t now_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+  CPUState *cpu = first_cpu;
+  target_ulong pc, cs_base;
+  int flags;
+
+  /* With TCG, the timers run between translated blocks, so the PC is the
+     one of the next block to execute. */
+  cpu_get_tb_cpu_state(cpu->env_ptr, &pc, &cs_base, &flags);
+  record_sample(pc, get_current_pid(), now_ns);
+  timer_mod(sampling_timer, now_ns + sampling_period_ns);
+}
+
+int profile_sampling_start(int hz) {
+  if (code_profile_dirname == NULL && profile_sampling_rate < 0) {
+    return -1;
+  }
+  if (hz <= 0) {
+    hz = 1;
+  }
+  if (sampling_timer == NULL) {
+    sampling_timer = timer_new(QEMU_CLOCK_REALTIME, SCALE_NS,
+                               sampling_tick, NULL);
+  }
+  sample_count = 0;
+  dropped_samples = 0;
+  sampling_period_ns = 1000000000LL / hz;
+  timer_mod(sampling_timer,
+            qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + sampling_period_ns);
+  return 0;
+}
+
+void profile_sampling_stop(void) {
+  if (sampling_timer) {
+    timer_del(sampling_timer);
+  }
+}
+
+int profile_sampling_count(void) {
+  return sample_count;
+}
+
+int profile_sampling_write(const char *path) {
+  FILE *f = fopen(path, "w");
+  int i, ret;
+
+  if (f == NULL) {
+    return -1;
+  }
+  for (i = 0; i < sample_count; i++) {
+    const ProfileSample *sample = &samples[i];
+    fprintf(f, "%s %u/%u [000] %lld.%06lld: %lld cpu-clock:\n",
+            sample->comm, sample->tid, sample->tid,
+            (long long)(sample->time_ns / 1000000000LL),
+            (long long)(sample->time_ns % 1000000000LL / 1000),
+            (long long)sampling_period_ns);
+    fprintf(f, "\t%16llx %s (%s)\n\n", (unsigned long long)sample->addr,
+            sample->symbol ? sample->symbol : "[unknown]",
+            sample->binary ? sample->binary : "[unknown]");
+  }
+  if (dropped_samples) {
+    fprintf(stderr, "Profile samples: %d dropped after the first %d\n",
+            dropped_samples, MAX_SAMPLES);
+  }
+  ret = ferror(f) ? -1 : 0;
+  if (fclose(f)) {
+    ret = -1;
+  }
+  return ret;
+}
@@ -15,6 +15,7 @@
 #include "hw/arm/pic.h"
 #include "hw/android/goldfish/device.h"
 #include "hw/hw.h"
+#include "sysemu/sysemu.h"
 
 enum {
     TIMER_TIME_LOW          = 0x00, // get low bits of current time and update TIMER_TIME_HIGH
@@ -22,9 +23,48 @@ enum {
     TIMER_ALARM_LOW         = 0x08, // set low bits of alarm and activate it
     TIMER_ALARM_HIGH        = 0x0c, // set high bits of next alarm
     TIMER_CLEAR_INTERRUPT   = 0x10,
-    TIMER_CLEAR_ALARM       = 0x14
+    TIMER_CLEAR_ALARM       = 0x14,
+    // Guest physical address of the clock page. The high word must be
+    // written first, the page is used once the low one is written, and
+    // address 0 disables it.
+    TIMER_CLOCK_PAGE_LOW    = 0x18,
+    TIMER_CLOCK_PAGE_HIGH   = 0x1c,
+    // Read-only, 1 for the registers above.
+    TIMER_VERSION           = 0x20
 };
 
+/* The clock page lets the guest compute the time from one of its own
+ * free-running counters (e.g. the TSC on x86), without trapping:
+ *
+ *   delta   = (counter - COUNTER_STAMP) << SHIFT
+ *   time_ns = TIME_STAMP + ((delta * MUL) >> 32)
+ *
+ * where the multiplication needs 96 bits. All fields are little-endian.
+ * |SEQUENCE| is odd while the page is being updated, the guest must read it
+ * again if it changed or was odd, and fall back to TIMER_TIME_LOW/HIGH if
+ * FLAGS_VALID isn't set.
+ *
+ * The guest calibrates the page by writing its counter to GUEST_COUNTER just
+ * before reading TIMER_TIME_LOW, e.g. on each timer interrupt. The emulator
+ * pairs it to the time it returns, and computes the scale from the first
+ * pair since the page was set up or the VM resumed.
+ */
+enum {
+    CLOCK_PAGE_SEQUENCE         = 0x00,
+    CLOCK_PAGE_FLAGS            = 0x04,
+    CLOCK_PAGE_COUNTER_STAMP    = 0x08,
+    CLOCK_PAGE_TIME_STAMP       = 0x10,
+    CLOCK_PAGE_MUL              = 0x18,
+    CLOCK_PAGE_SHIFT            = 0x1c,
+    CLOCK_PAGE_GUEST_COUNTER    = 0x20,  // written by the guest
+    CLOCK_PAGE_SIZE             = 0x28
+};
+
+#define  CLOCK_PAGE_FLAGS_VALID  1
+
+/* Minimum time between the calibration pairs used to compute the scale */
+#define  CLOCK_CALIBRATION_NS  10000000LL
+
 struct timer_state {
     struct goldfish_device dev;
     uint32_t alarm_low_ns;
@@ -32,9 +72,16 @@ struct timer_state {
     int64_t now_ns;
     int     armed;
     QEMUTimer *timer;
+    uint64_t clock_page;
+    uint32_t clock_page_high;
+    uint32_t clock_sequence;
+    /* First calibration pair, if |clock_anchored| */
+    int      clock_anchored;
+    uint64_t clock_anchor_counter;
+    int64_t  clock_anchor_ns;
 };
 
-#define  GOLDFISH_TIMER_SAVE_VERSION  1
+#define  GOLDFISH_TIMER_SAVE_VERSION  2
 
 static void  goldfish_timer_save(QEMUFile*  f, void*  opaque)
 {
@@ -47,13 +94,16 @@ static void  goldfish_timer_save(QEMUFile*  f, void*  opaque)
         int64_t  alarm_ns = (s->alarm_low_ns | (int64_t)s->alarm_high_ns << 32);
         qemu_put_be64(f, alarm_ns - now_ns);
     }
+    qemu_put_be64(f, s->clock_page);
+    qemu_put_be32(f, s->clock_page_high);
+    qemu_put_be32(f, s->clock_sequence);
 }
 
 static int  goldfish_timer_load(QEMUFile*  f, void*  opaque, int  version_id)
 {
     struct timer_state*  s   = opaque;
 
-    if (version_id != GOLDFISH_TIMER_SAVE_VERSION)
+    if (version_id != 1 && version_id != GOLDFISH_TIMER_SAVE_VERSION)
         return -1;
 
     s->now_ns = qemu_get_be64(f);
@@ -70,18 +120,109 @@ static int  goldfish_timer_load(QEMUFile*  f, void*  opaque, int  version_id)
             timer_mod(s->timer, alarm_tks);
         }
     }
+    if (version_id >= 2) {
+        s->clock_page = qemu_get_be64(f);
+        s->clock_page_high = qemu_get_be32(f);
+        s->clock_sequence = qemu_get_be32(f);
+    } else {
+        s->clock_page = 0;
+        s->clock_page_high = 0;
+        s->clock_sequence = 0;
+    }
+    /* The page is invalidated when the VM resumes */
+    s->clock_anchored = 0;
     return 0;
 }
 
+/* Update the clock page, or only invalidate it if |valid| is 0 */
+static void goldfish_timer_write_clock_page(struct timer_state *s, int valid,
+                                            uint64_t counter, int64_t now_ns,
+                                            uint32_t mul, uint32_t shift)
+{
+    uint8_t  page[CLOCK_PAGE_GUEST_COUNTER];
+
+    if (!s->clock_page)
+        return;
+
+    s->clock_sequence |= 1;
+    stl_le_phys(s->clock_page + CLOCK_PAGE_SEQUENCE, s->clock_sequence);
+    smp_wmb();
+
+    memset(page, 0, sizeof(page));
+    if (valid) {
+        stl_le_p(page + CLOCK_PAGE_FLAGS, CLOCK_PAGE_FLAGS_VALID);
+        stq_le_p(page + CLOCK_PAGE_COUNTER_STAMP, counter);
+        stq_le_p(page + CLOCK_PAGE_TIME_STAMP, now_ns);
+        stl_le_p(page + CLOCK_PAGE_MUL, mul);
+        stl_le_p(page + CLOCK_PAGE_SHIFT, shift);
+    }
+    cpu_physical_memory_write(s->clock_page + CLOCK_PAGE_FLAGS,
+                              page + CLOCK_PAGE_FLAGS,
+                              sizeof(page) - CLOCK_PAGE_FLAGS);
+    smp_wmb();
+
+    s->clock_sequence++;
+    stl_le_phys(s->clock_page + CLOCK_PAGE_SEQUENCE, s->clock_sequence);
+}
+
+/* Pair the guest counter to |s->now_ns|, and update the clock page */
+static void goldfish_timer_calibrate_clock(struct timer_state *s)
+{
+    uint64_t  counter;
+    double    ratio;
+    uint32_t  shift = 0;
+
+    if (!s->clock_page)
+        return;
+
+    counter = ldq_le_phys(s->clock_page + CLOCK_PAGE_GUEST_COUNTER);
+    if (!s->clock_anchored || counter <= s->clock_anchor_counter ||
+        s->now_ns <= s->clock_anchor_ns) {
+        s->clock_anchored = 1;
+        s->clock_anchor_counter = counter;
+        s->clock_anchor_ns = s->now_ns;
+        return;
+    }
+    if (s->now_ns - s->clock_anchor_ns < CLOCK_CALIBRATION_NS)
+        return;
+
+    /* Nanoseconds per counter tick, as a 32-bit fraction with a shift */
+    ratio = (double)(s->now_ns - s->clock_anchor_ns) /
+            (double)(counter - s->clock_anchor_counter);
+    while (ratio >= 1.0 && shift < 31) {
+        ratio /= 2;
+        shift++;
+    }
+    goldfish_timer_write_clock_page(s, ratio < 1.0, counter, s->now_ns,
+                                    (uint32_t)(ratio * 4294967296.0), shift);
+}
+
+static void goldfish_timer_vm_state_change(void *opaque, int running,
+                                           int reason)
+{
+    struct timer_state *s = opaque;
+
+    /* The guest counter may not stop with the virtual clock */
+    s->clock_anchored = 0;
+    goldfish_timer_write_clock_page(s, 0, 0, 0, 0, 0);
+}
+
 static uint32_t goldfish_timer_read(void *opaque, hwaddr offset)
 {
     struct timer_state *s = (struct timer_state *)opaque;
     switch(offset) {
         case TIMER_TIME_LOW:
             s->now_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+            goldfish_timer_calibrate_clock(s);
             return s->now_ns;
         case TIMER_TIME_HIGH:
             return s->now_ns >> 32;
+        case TIMER_CLOCK_PAGE_LOW:
+            return (uint32_t)s->clock_page;
+        case TIMER_CLOCK_PAGE_HIGH:
+            return (uint32_t)(s->clock_page >> 32);
+        case TIMER_VERSION:
+            return 1;
         default:
             cpu_abort(cpu_single_env,
                       "goldfish_timer_read: Bad offset %" HWADDR_PRIx "\n",
@@ -101,7 +242,10 @@ static void goldfish_timer_write(void *opaque, hwaddr offset, uint32_t value_ns)
             now_ns   = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
             if (alarm_ns <= now_ns) {
                 goldfish_device_set_irq(&s->dev, 0, 1);
-            } else {
+            } else if (!s->armed || !timer_pending(s->timer) ||
+                       (int64_t)timer_expire_time_ns(s->timer) != alarm_ns) {
+                /* Idle guests often re-program the very same deadline; don't
+                   re-queue the timer and wake the main loop for nothing. */
                 timer_mod(s->timer, alarm_ns);
                 s->armed = 1;
             }
@@ -116,6 +260,15 @@ static void goldfish_timer_write(void *opaque, hwaddr offset, uint32_t value_ns)
         case TIMER_CLEAR_INTERRUPT:
             goldfish_device_set_irq(&s->dev, 0, 0);
             break;
+        case TIMER_CLOCK_PAGE_HIGH:
+            s->clock_page_high = value_ns;
+            break;
+        case TIMER_CLOCK_PAGE_LOW:
+            s->clock_page = ((uint64_t)s->clock_page_high << 32) | value_ns;
+            s->clock_sequence = 0;
+            s->clock_anchored = 0;
+            goldfish_timer_write_clock_page(s, 0, 0, 0, 0, 0);
+            break;
         default:
             cpu_abort(cpu_single_env,
                       "goldfish_timer_write: Bad offset %" HWADDR_PRIx "\n",
@@ -253,6 +406,8 @@ void goldfish_timer_and_rtc_init(uint32_t timerbase, int timerirq)
                     goldfish_timer_save,
                     goldfish_timer_load,
                     &timer_state);
+    qemu_add_vm_change_state_handler(goldfish_timer_vm_state_change,
+                                     &timer_state);
 
     goldfish_device_add(&rtc_state.dev, goldfish_rtc_readfn, goldfish_rtc_writefn, &rtc_state);
     register_savevm(NULL,
@@ -170,6 +170,7 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
         if (exec_path[len - 1] == '\n') {
             exec_path[len - 1] = 0;
         }
+        record_thread_name(tid, exec_path);
         if (trace_filename != NULL) {
             D("QEMU.trace: kernel, name %s\n", exec_path);
         }
@@ -191,6 +192,7 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
     case TRACE_DEV_REG_INIT_NAME:       // init, the comm of the init pid
         get_guest_kernel_string(exec_path, value, CLIENT_PAGE_SIZE);
         DPID("QEMU.trace: tgid=%d pid=%d name=%s\n", tgid, pid, exec_path);
+        record_thread_name(pid, exec_path);
         if (trace_filename != NULL) {
             D("QEMU.trace: kernel, init name %u [%s]\n", pid, exec_path);
         }
@@ -307,10 +309,11 @@ static CPUWriteMemoryFunc *trace_dev_writefn[] = {
 /* initialize the trace device */
 void trace_dev_init()
 {
-    if (code_profile_dirname == NULL)
+    if (code_profile_dirname == NULL && profile_sampling_rate < 0)
       return;
 
-    code_profile_record_func = profile_bb_helper;
+    if (code_profile_dirname != NULL)
+      code_profile_record_func = profile_bb_helper;
     trace_dev_state *s;
 
     s = (trace_dev_state *)g_malloc0(sizeof(trace_dev_state));
@@ -324,4 +327,7 @@ void trace_dev_init()
     goldfish_device_add(&s->dev, trace_dev_readfn, trace_dev_writefn, s);
 
     exec_path[0] = exec_arg[0] = '\0';
+
+    if (profile_sampling_rate > 0)
+      profile_sampling_start(profile_sampling_rate);
 }
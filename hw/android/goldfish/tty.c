@@ -14,6 +14,7 @@
 #include "hw/android/goldfish/device.h"
 #include "hw/android/goldfish/vmem.h"
 #include "hw/hw.h"
+#include "qemu/timer.h"
 
 enum {
     TTY_PUT_CHAR       = 0x00,
@@ -33,18 +34,30 @@ enum {
     TTY_CMD_READ_BUFFER    = 3,
 };
 
+/* Size of the ring of received bytes waiting for the guest. */
+#define  TTY_INPUT_SIZE   4096
+
+/* Characters written one at a time with TTY_PUT_CHAR are sent to the
+ * host in lines, or after TTY_OUTPUT_DELAY_MS without a newline. */
+#define  TTY_OUTPUT_SIZE      256
+#define  TTY_OUTPUT_DELAY_MS  20
+
 struct tty_state {
     struct goldfish_device dev;
     CharDriverState *cs;
     uint64_t ptr;
     uint32_t ptr_len;
     uint32_t ready;
-    uint8_t data[128];
+    uint8_t data[TTY_INPUT_SIZE];
+    uint32_t data_start;
     uint32_t data_count;
+    uint8_t out[TTY_OUTPUT_SIZE];
+    uint32_t out_count;
+    QEMUTimer *out_timer;
 };
 
 #define  TTY_DEVICE_VERSION 0
-#define  GOLDFISH_TTY_SAVE_VERSION  2
+#define  GOLDFISH_TTY_SAVE_VERSION  3
 
 #define  DEBUG 0
 
@@ -59,33 +72,73 @@ struct tty_state {
 
 #define E(...)  cpu_abort(cpu_single_env, __VA_ARGS__)
 
+static void goldfish_tty_flush_output(struct tty_state *s)
+{
+    if (s->out_count) {
+        if (s->cs)
+            qemu_chr_write(s->cs, s->out, s->out_count);
+        s->out_count = 0;
+    }
+    timer_del(s->out_timer);
+}
+
+static void goldfish_tty_output_timeout(void *opaque)
+{
+    goldfish_tty_flush_output(opaque);
+}
+
+/* Copy |len| bytes from the input ring, starting |offset| bytes after its
+ * first byte, to |buf|. */
+static void goldfish_tty_peek_input(struct tty_state *s, uint32_t offset,
+                                    uint8_t *buf, uint32_t len)
+{
+    uint32_t start = (s->data_start + offset) % TTY_INPUT_SIZE;
+    uint32_t first = TTY_INPUT_SIZE - start;
+
+    if (first > len)
+        first = len;
+    memcpy(buf, s->data + start, first);
+    memcpy(buf + first, s->data, len - first);
+}
+
 static void  goldfish_tty_save(QEMUFile*  f, void*  opaque)
 {
     struct tty_state*  s = opaque;
+    uint8_t  temp[TTY_INPUT_SIZE];
+
+    /* pending output would be lost otherwise */
+    goldfish_tty_flush_output(s);
 
     qemu_put_be64( f, s->ptr );
     qemu_put_be32( f, s->ptr_len );
     qemu_put_byte( f, s->ready );
-    qemu_put_byte( f, s->data_count );
-    qemu_put_buffer( f, s->data, s->data_count );
+    qemu_put_be32( f, s->data_count );
+    goldfish_tty_peek_input(s, 0, temp, s->data_count);
+    qemu_put_buffer( f, temp, s->data_count );
 }
 
 static int  goldfish_tty_load(QEMUFile*  f, void*  opaque, int  version_id)
 {
     struct tty_state*  s = opaque;
 
-    if ((version_id != GOLDFISH_TTY_SAVE_VERSION) && 
-        (version_id != (GOLDFISH_TTY_SAVE_VERSION - 1))) {
+    if (version_id < 1 || version_id > GOLDFISH_TTY_SAVE_VERSION) {
         return -1;
     }
-    if (version_id == (GOLDFISH_TTY_SAVE_VERSION - 1)) {
+    if (version_id == 1) {
         s->ptr    = (uint64_t)qemu_get_be32(f);
     } else {
         s->ptr    = qemu_get_be64(f);
     }
     s->ptr_len    = qemu_get_be32(f);
     s->ready      = qemu_get_byte(f);
-    s->data_count = qemu_get_byte(f);
+    if (version_id < 3) {
+        s->data_count = qemu_get_byte(f);
+    } else {
+        s->data_count = qemu_get_be32(f);
+        if (s->data_count > TTY_INPUT_SIZE)
+            return -1;
+    }
+    s->data_start = 0;
     qemu_get_buffer(f, s->data, s->data_count);
 
     return 0;
@@ -115,11 +168,18 @@ static void goldfish_tty_write(void *opaque, hwaddr offset, uint32_t value)
     D("goldfish_tty_write %" HWADDR_PRIx " %x\n", offset, value);
 
     switch(offset) {
-        case TTY_PUT_CHAR: {
-            uint8_t ch = value;
-            if(s->cs)
-                qemu_chr_write(s->cs, &ch, 1);
-        } break;
+        case TTY_PUT_CHAR:
+            if(s->cs) {
+                s->out[s->out_count++] = (uint8_t)value;
+                if ((uint8_t)value == '\n' || s->out_count == TTY_OUTPUT_SIZE) {
+                    goldfish_tty_flush_output(s);
+                } else if (!timer_pending(s->out_timer)) {
+                    timer_mod(s->out_timer,
+                              qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                              TTY_OUTPUT_DELAY_MS);
+                }
+            }
+            break;
 
         case TTY_CMD:
             switch(value) {
@@ -141,38 +201,64 @@ static void goldfish_tty_write(void *opaque, hwaddr offset, uint32_t value)
 
                 case TTY_CMD_WRITE_BUFFER:
                     if(s->cs) {
-                        int len;
+                        uint32_t len;
                         target_ulong  buf;
 
+                        /* keep the output in order */
+                        goldfish_tty_flush_output(s);
+
                         buf = s->ptr;
                         len = s->ptr_len;
 
                         while (len) {
-                            char   temp[64];
-                            int    to_write = sizeof(temp);
-                            if (to_write > len)
-                                to_write = len;
-
-                            safe_memory_rw_debug(current_cpu, buf, (uint8_t*)temp, to_write, 0);
-                            qemu_chr_write(s->cs, (const uint8_t*)temp, to_write);
-                            buf += to_write;
-                            len -= to_write;
+                            /* Write each physically contiguous span of the
+                               guest buffer straight from guest RAM. */
+                            uint8_t* span = NULL;
+                            target_ulong vlen = len;
+                            hwaddr plen = 0;
+                            hwaddr phys = safe_get_phys_range_debug(current_cpu, buf, &vlen);
+
+                            if (phys != (hwaddr)-1) {
+                                plen = vlen;
+                                span = cpu_physical_memory_map(phys, &plen, 0);
+                            }
+                            if (span != NULL && plen > 0) {
+                                qemu_chr_write(s->cs, span, (int)plen);
+                                cpu_physical_memory_unmap(span, plen, 0, plen);
+                            } else {
+                                uint8_t  temp[64];
+
+                                if (span != NULL)
+                                    cpu_physical_memory_unmap(span, plen, 0, 0);
+                                plen = sizeof(temp);
+                                if (plen > len)
+                                    plen = len;
+                                safe_memory_rw_debug(current_cpu, buf, temp, (int)plen, 0);
+                                qemu_chr_write(s->cs, temp, (int)plen);
+                            }
+                            buf += plen;
+                            len -= plen;
                         }
                         D("goldfish_tty_write: got %d bytes from %llx\n", s->ptr_len, (unsigned long long)s->ptr);
                     }
                     break;
 
-                case TTY_CMD_READ_BUFFER:
+                case TTY_CMD_READ_BUFFER: {
+                    uint8_t  temp[TTY_INPUT_SIZE];
+
                     if(s->ptr_len > s->data_count)
                         E("goldfish_tty_write: reading more data than available %d %d\n", s->ptr_len, s->data_count);
-                    safe_memory_rw_debug(current_cpu, s->ptr, s->data, s->ptr_len,1);
+                    goldfish_tty_peek_input(s, 0, temp, s->ptr_len);
+                    safe_memory_rw_debug(current_cpu, s->ptr, temp, s->ptr_len, 1);
                     D("goldfish_tty_write: read %d bytes to %llx\n", s->ptr_len, (unsigned long long)s->ptr);
-                    if(s->data_count > s->ptr_len)
-                        memmove(s->data, s->data + s->ptr_len, s->data_count - s->ptr_len);
+                    s->data_start = (s->data_start + s->ptr_len) % TTY_INPUT_SIZE;
                     s->data_count -= s->ptr_len;
                     if(s->data_count == 0 && s->ready)
                         goldfish_device_set_irq(&s->dev, 0, 0);
-                    break;
+                    /* let the backend send the data it buffered
+                     * while the input buffer was full */
+                    qemu_chr_accept_input(s->cs);
+                } break;
 
                 default:
                     E("goldfish_tty_write: Bad command %x\n", value);
@@ -206,8 +292,13 @@ static int tty_can_receive(void *opaque)
 static void tty_receive(void *opaque, const uint8_t *buf, int size)
 {
     struct tty_state *s = opaque;
+    uint32_t end = (s->data_start + s->data_count) % TTY_INPUT_SIZE;
+    uint32_t first = TTY_INPUT_SIZE - end;
 
-    memcpy(s->data + s->data_count, buf, size);
+    if (first > (uint32_t)size)
+        first = size;
+    memcpy(s->data + end, buf, first);
+    memcpy(s->data, buf + first, size - first);
     s->data_count += size;
     if(s->data_count > 0 && s->ready)
         goldfish_device_set_irq(&s->dev, 0, 1);
@@ -239,6 +330,8 @@ int goldfish_tty_add(CharDriverState *cs, int id, uint32_t base, int irq)
     s->dev.irq = irq;
     s->dev.irq_count = 1;
     s->cs = cs;
+    s->out_timer = timer_new(QEMU_CLOCK_REALTIME, SCALE_MS,
+                             goldfish_tty_output_timeout, s);
 
     if(cs) {
         qemu_chr_add_handlers(cs, tty_can_receive, tty_receive, NULL, s);
@@ -246,6 +339,7 @@ int goldfish_tty_add(CharDriverState *cs, int id, uint32_t base, int irq)
 
     ret = goldfish_device_add(&s->dev, goldfish_tty_readfn, goldfish_tty_writefn, s);
     if(ret) {
+        timer_free(s->out_timer);
         g_free(s);
     } else {
         register_savevm(NULL,
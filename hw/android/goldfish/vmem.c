@@ -49,3 +49,33 @@ hwaddr safe_get_phys_page_debug(CPUState *cpu, target_ulong addr)
     return cpu_get_phys_page_debug(env, addr);
 }
 
+hwaddr safe_get_phys_range_debug(CPUState *cpu, target_ulong addr,
+                                 target_ulong *plen)
+{
+    CPUArchState *env = cpu->env_ptr;
+    target_ulong page = addr & TARGET_PAGE_MASK;
+    target_ulong vpage, done;
+    hwaddr phys;
+
+#ifdef TARGET_I386
+    if (kvm_enabled()) {
+        kvm_get_sregs(cpu);
+    }
+#endif
+    phys = cpu_get_phys_page_debug(env, page);
+    if (phys == -1) {
+        *plen = 0;
+        return -1;
+    }
+    done = TARGET_PAGE_SIZE - (addr - page);
+    for (vpage = page + TARGET_PAGE_SIZE; done < *plen;
+         vpage += TARGET_PAGE_SIZE, done += TARGET_PAGE_SIZE) {
+        if (cpu_get_phys_page_debug(env, vpage) != phys + (vpage - page)) {
+            break;
+        }
+    }
+    if (done < *plen) {
+        *plen = done;
+    }
+    return phys + (addr - page);
+}
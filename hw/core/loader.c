@@ -50,6 +50,10 @@
 
 #include <zlib.h>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
 /* return the size or -1 if error */
 int get_image_size(const char *filename)
 {
@@ -62,21 +66,90 @@ int get_image_size(const char *filename)
     return size;
 }
 
-/* return the size or -1 if error */
-/* deprecated, because caller does not specify buffer size! */
-int load_image(const char *filename, uint8_t *addr)
+/* A read-only view of a whole image file. It is mapped private where
+ * possible, so that loading it only copies the page cache into the
+ * destination memory instead of read()ing it into a buffer first. */
+typedef struct {
+    uint8_t *data;
+    size_t   size;
+    int      mapped;
+} ImageView;
+
+/* return 0 or -1 if error */
+static int image_view_open(ImageView *view, const char *filename)
 {
-    int fd, size;
+    int fd;
+    off_t size;
+
+    view->data = NULL;
+    view->size = 0;
+    view->mapped = 0;
+
     fd = open(filename, O_RDONLY | O_BINARY);
     if (fd < 0)
         return -1;
     size = lseek(fd, 0, SEEK_END);
+    if (size < 0) {
+        close(fd);
+        return -1;
+    }
+    view->size = size;
+    if (size == 0) {
+        close(fd);
+        return 0;
+    }
+
+#ifndef _WIN32
+    {
+        void *ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            /* The whole file is copied right away. */
+            qemu_madvise(ptr, size, QEMU_MADV_WILLNEED);
+            view->data = ptr;
+            view->mapped = 1;
+            close(fd);
+            return 0;
+        }
+    }
+#endif
+
+    view->data = g_malloc(size);
     lseek(fd, 0, SEEK_SET);
-    if (read(fd, addr, size) != size) {
+    if (read(fd, view->data, size) != size) {
+        g_free(view->data);
+        view->data = NULL;
         close(fd);
         return -1;
     }
     close(fd);
+    return 0;
+}
+
+static void image_view_close(ImageView *view)
+{
+#ifndef _WIN32
+    if (view->mapped) {
+        munmap(view->data, view->size);
+        view->data = NULL;
+        return;
+    }
+#endif
+    g_free(view->data);
+    view->data = NULL;
+}
+
+/* return the size or -1 if error */
+/* deprecated, because caller does not specify buffer size! */
+int load_image(const char *filename, uint8_t *addr)
+{
+    ImageView view;
+    int size;
+
+    if (image_view_open(&view, filename) < 0)
+        return -1;
+    memcpy(addr, view.data, view.size);
+    size = view.size;
+    image_view_close(&view);
     return size;
 }
 
@@ -127,21 +200,41 @@ int read_targphys(int fd, hwaddr dst_addr, size_t nbytes)
 
 /* return the size or -1 if error */
 int load_image_targphys(const char *filename,
-			hwaddr addr, int max_sz)
+			hwaddr addr, uint64_t max_sz)
 {
-    FILE *f;
+    ImageView view;
     size_t got;
 
-    f = fopen(filename, "rb");
-    if (!f) return -1;
+    if (image_view_open(&view, filename) < 0)
+        return -1;
 
-    got = fread_targphys(addr, max_sz, f);
-    if (ferror(f)) { fclose(f); return -1; }
-    fclose(f);
+    got = view.size;
+    if (got > max_sz)
+        got = max_sz;
+    cpu_physical_memory_write_rom(addr, view.data, got);
+    image_view_close(&view);
 
     return got;
 }
 
+/* load |nbytes| of the file from |offset|, return 0 on success or -1 if
+ * error, including a file smaller than that */
+int load_image_range_targphys(const char *filename, uint64_t offset,
+                              size_t nbytes, hwaddr addr)
+{
+    ImageView view;
+
+    if (image_view_open(&view, filename) < 0)
+        return -1;
+    if (offset > view.size || nbytes > view.size - offset) {
+        image_view_close(&view);
+        return -1;
+    }
+    cpu_physical_memory_write_rom(addr, view.data + offset, nbytes);
+    image_view_close(&view);
+    return 0;
+}
+
 void pstrcpy_targphys(const char* name,
                       hwaddr dest, int buf_size,
                       const char *source)
@@ -616,7 +616,7 @@ static void load_linux(hwaddr option_rom,
     uint32_t initrd_max;
     uint8_t header[1024];
     hwaddr real_addr, prot_addr, cmdline_addr, initrd_addr = 0;
-    FILE *f, *fi;
+    FILE *f;
 
     /* Align to 16 bytes as a paranoia measure */
     cmdline_size = (strlen(kernel_cmdline)+16) & ~15;
@@ -706,22 +706,20 @@ static void load_linux(hwaddr option_rom,
 	    exit(1);
 	}
 
-	fi = fopen(initrd_filename, "rb");
-	if (!fi) {
+	initrd_size = get_image_size(initrd_filename);
+	if (initrd_size < 0) {
 	    fprintf(stderr, "qemu: could not load initial ram disk '%s'\n",
 		    initrd_filename);
 	    exit(1);
 	}
-
-	initrd_size = get_file_size(fi);
 	initrd_addr = (initrd_max-initrd_size) & ~4095;
 
-	if (!fread_targphys_ok(initrd_addr, initrd_size, fi)) {
+	if (load_image_range_targphys(initrd_filename, 0, initrd_size,
+	                              initrd_addr) < 0) {
 	    fprintf(stderr, "qemu: read error on initial ram disk '%s'\n",
 		    initrd_filename);
 	    exit(1);
 	}
-	fclose(fi);
 
 	stl_p(header+0x218, initrd_addr);
 	stl_p(header+0x21c, initrd_size);
@@ -737,13 +735,15 @@ static void load_linux(hwaddr option_rom,
     setup_size = (setup_size+1)*512;
     kernel_size -= setup_size;	/* Size of protected-mode code */
 
-    if (!fread_targphys_ok(real_addr+1024, setup_size-1024, f) ||
-	!fread_targphys_ok(prot_addr, kernel_size, f)) {
+    fclose(f);
+    if (load_image_range_targphys(kernel_filename, 1024, setup_size-1024,
+                                  real_addr+1024) < 0 ||
+	load_image_range_targphys(kernel_filename, setup_size, kernel_size,
+	                          prot_addr) < 0) {
 	fprintf(stderr, "qemu: read error on kernel '%s'\n",
 		kernel_filename);
 	exit(1);
     }
-    fclose(f);
 
     /* generate bootsector to set up the initial register state */
     real_seg = real_addr >> 4;
@@ -867,6 +867,11 @@ static struct goldfish_device nand_device = {
     .size = 0x1000
 };
 
+/* First vector of the goldfish interrupts when hw.intc.msi is enabled,
+ * the guest kernel learns it from the goldfish.msi_vector_base parameter.
+ */
+#define GOLDFISH_MSI_VECTOR_BASE  0x90
+
 /* PC hardware initialisation */
 static void pc_init1(ram_addr_t ram_size,
                      const char *boot_device,
@@ -884,6 +889,8 @@ static void pc_init1(ram_addr_t ram_size,
     CPUOldState *env;
     qemu_irq *cpu_irq;
     qemu_irq *i8259;
+    qemu_irq *goldfish_irqs;
+    char *msi_cmdline = NULL;
 #ifndef CONFIG_ANDROID
     int index;
 #endif
@@ -1013,11 +1020,19 @@ static void pc_init1(ram_addr_t ram_size,
     if (oprom_area_size < 0x8000)
         oprom_area_size = 0x8000;
 
+    if (android_hw->hw_intc_msi) {
+        msi_cmdline = g_strdup_printf("%s goldfish.msi_vector_base=0x%x",
+                                      kernel_cmdline,
+                                      GOLDFISH_MSI_VECTOR_BASE);
+        kernel_cmdline = msi_cmdline;
+    }
+
     if (linux_boot) {
         load_linux(0xc0000 + oprom_area_size,
                    kernel_filename, initrd_filename, kernel_cmdline, below_4g_mem_size);
         oprom_area_size += 2048;
     }
+    g_free(msi_cmdline);
 
     for (i = 0; i < nb_option_roms; i++) {
         oprom_area_size += load_option_rom(option_rom[i],
@@ -1034,8 +1049,17 @@ static void pc_init1(ram_addr_t ram_size,
     i8259 = i8259_init(cpu_irq[0]);
     ferr_irq = i8259[GFD_ERR_IRQ];
 
+    /* With MSI, the goldfish devices bypass the PIC, along with its mask
+     * and acknowledge port I/O, and only need an EOI to the local APIC. */
+    if (android_hw->hw_intc_msi) {
+        goldfish_irqs = apic_allocate_msi_irqs(GOLDFISH_MSI_VECTOR_BASE,
+                                               GFD_MAX_IRQ);
+    } else {
+        goldfish_irqs = i8259;
+    }
+
 #define IRQ_PDEV_BUS 4
-    goldfish_device_init(i8259, 0xff010000, 0x7f0000, 5, 5);
+    goldfish_device_init(goldfish_irqs, 0xff010000, 0x7f0000, 5, 5);
     goldfish_device_bus_init(0xff001000, IRQ_PDEV_BUS);
 
     goldfish_battery_init(android_hw->hw_battery);
@@ -1044,10 +1068,20 @@ static void pc_init1(ram_addr_t ram_size,
     goldfish_add_device_no_io(&nand_device);
     nand_dev_init(nand_device.base);
 #endif
+    goldfish_block_init();
     bool newDeviceNaming =
             (androidHwConfig_getKernelDeviceNaming(android_hw) >= 1);
     pipe_dev_init(newDeviceNaming);
 
+    /* Map the memory shared with the GPU emulation right above the RAM,
+     * below the PCI memory. */
+    if (android_hw->hw_gpu_enabled) {
+        uint32_t shared_base = (below_4g_mem_size + 0xfffff) & ~0xfffff;
+        if (shared_base + (uint64_t)GOLDFISH_ADDRESS_SPACE_SIZE <= 0xe0000000) {
+            goldfish_address_space_init(shared_base);
+        }
+    }
+
     {
         DriveInfo* info = drive_get( IF_IDE, 0, 0 );
         if (info != NULL) {
@@ -1190,7 +1224,7 @@ static void pc_init1(ram_addr_t ram_size,
     goldfish_fb_init(0);
 
     goldfish_add_device_no_io(&event0_device);
-    events_dev_init(event0_device.base, i8259[event0_device.irq]);
+    events_dev_init(event0_device.base, goldfish_irqs[event0_device.irq]);
 
 #ifdef HAS_AUDIO
 #ifndef CONFIG_ANDROID
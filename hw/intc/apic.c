@@ -94,6 +94,11 @@ static APICState *local_apics[MAX_APICS + 1];
 static int last_apic_idx = 0;
 static int apic_irq_delivered;
 
+/* Lines allocated by apic_allocate_msi_irqs() */
+static int msi_vector_base;
+static int msi_count;
+static uint32_t msi_levels;
+
 
 static void apic_set_irq(APICState *s, int vector_num, int trigger_mode);
 static void apic_update_irq(APICState *s);
@@ -277,6 +282,44 @@ void apic_deliver_irq(uint8_t dest, uint8_t dest_mode,
                      trigger_mode);
 }
 
+static void apic_msi_set_irq(void *opaque, int n, int level)
+{
+    uint32_t mask = 1U << n;
+
+    if (!level) {
+        msi_levels &= ~mask;
+        return;
+    }
+    if (msi_levels & mask)
+        return;
+    msi_levels |= mask;
+    /* Edge-triggered, fixed delivery to the boot CPU */
+    apic_deliver_irq(0, 0, APIC_DM_FIXED, msi_vector_base + n, 0,
+                     APIC_TRIGGER_EDGE);
+}
+
+static void apic_msi_save(QEMUFile *f, void *opaque)
+{
+    qemu_put_be32(f, msi_levels);
+}
+
+static int apic_msi_load(QEMUFile *f, void *opaque, int version_id)
+{
+    if (version_id != 1)
+        return -EINVAL;
+    msi_levels = qemu_get_be32(f);
+    return 0;
+}
+
+qemu_irq *apic_allocate_msi_irqs(int vector_base, int count)
+{
+    msi_vector_base = vector_base;
+    msi_count = count;
+    register_savevm(NULL, "apic_msi", 0, 1, apic_msi_save, apic_msi_load,
+                    NULL);
+    return qemu_allocate_irqs(apic_msi_set_irq, NULL, count);
+}
+
 void cpu_set_apic_base(CPUOldState *env, uint64_t val)
 {
     APICState *s = env->apic_state;
@@ -400,6 +443,13 @@ static void apic_eoi(APICState *s)
     reset_bit(s->isr, isrv);
     /* XXX: send the EOI packet to the APIC bus to allow the I/O APIC to
             set the remote IRR bit for level triggered interrupts. */
+    /* Resample the MSI lines, so that a device that is still asserting
+       its line doesn't lose its interrupt. */
+    if (isrv >= msi_vector_base && isrv < msi_vector_base + msi_count &&
+        (msi_levels & (1U << (isrv - msi_vector_base)))) {
+        set_bit(s->irr, isrv);
+        reset_bit(s->tmr, isrv);
+    }
     apic_update_irq(s);
 }
 
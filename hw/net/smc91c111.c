@@ -632,9 +632,46 @@ static uint32_t smc91c111_readb(void *opaque, hwaddr offset)
     return 0;
 }
 
+/* The drivers move packets through the data register with 16-bit or
+   32-bit accesses.  Return the packet bytes that a |size| bytes access at
+   |offset| reads or writes, and advance the pointer register as the byte
+   accesses would, or NULL if the access must be split into bytes.  */
+static uint8_t *smc91c111_data_access(smc91c111_state *s, hwaddr offset,
+                                      int size)
+{
+    int p;
+    int n;
+
+    if (s->bank != 2 || offset < 8 || offset + size > 12)
+        return NULL;
+
+    if (s->ptr & 0x8000)
+        n = s->rx_fifo[0];
+    else
+        n = s->packet_num;
+    p = s->ptr & 0x07ff;
+    if (s->ptr & 0x4000) {
+        if (p + size > 0x800)
+            return NULL;
+        s->ptr = (s->ptr & 0xf800) | ((s->ptr + size) & 0x7ff);
+    } else {
+        p += (offset & 3);
+        if (p + size > BUFFER_PER_PACKET)
+            return NULL;
+    }
+    return &s->data[n][p];
+}
+
 static void smc91c111_writew(void *opaque, hwaddr offset,
                              uint32_t value)
 {
+    uint8_t *data = smc91c111_data_access(opaque, offset, 2);
+
+    if (data) {
+        data[0] = value;
+        data[1] = value >> 8;
+        return;
+    }
     smc91c111_writeb(opaque, offset, value & 0xff);
     smc91c111_writeb(opaque, offset + 1, value >> 8);
 }
@@ -642,6 +679,15 @@ static void smc91c111_writew(void *opaque, hwaddr offset,
 static void smc91c111_writel(void *opaque, hwaddr offset,
                              uint32_t value)
 {
+    uint8_t *data = smc91c111_data_access(opaque, offset, 4);
+
+    if (data) {
+        data[0] = value;
+        data[1] = value >> 8;
+        data[2] = value >> 16;
+        data[3] = value >> 24;
+        return;
+    }
     /* 32-bit writes to offset 0xc only actually write to the bank select
        register (offset 0xe)  */
     if (offset != 0xc)
@@ -651,7 +697,11 @@ static void smc91c111_writel(void *opaque, hwaddr offset,
 
 static uint32_t smc91c111_readw(void *opaque, hwaddr offset)
 {
+    uint8_t *data = smc91c111_data_access(opaque, offset, 2);
     uint32_t val;
+
+    if (data)
+        return data[0] | (data[1] << 8);
     val = smc91c111_readb(opaque, offset);
     val |= smc91c111_readb(opaque, offset + 1) << 8;
     return val;
@@ -659,7 +709,12 @@ static uint32_t smc91c111_readw(void *opaque, hwaddr offset)
 
 static uint32_t smc91c111_readl(void *opaque, hwaddr offset)
 {
+    uint8_t *data = smc91c111_data_access(opaque, offset, 4);
     uint32_t val;
+
+    if (data)
+        return data[0] | (data[1] << 8) | (data[2] << 16) |
+               ((uint32_t)data[3] << 24);
     val = smc91c111_readw(opaque, offset);
     val |= smc91c111_readw(opaque, offset + 2) << 16;
     return val;
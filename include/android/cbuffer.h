@@ -48,10 +48,22 @@ cbuffer_read_avail( CBuffer*  cb )
     return cb->count;
 }
 
+/* cbuffer_read_peek() returns the address and size of the first contiguous
+ * run of buffered data, so that a consumer can parse it in place, and
+ * cbuffer_read_step() consumes 'len' bytes of it. The read position is
+ * rewound when the buffer becomes empty, which keeps small messages from
+ * being split at the end of the storage.
+ */
 extern int  cbuffer_read( CBuffer*  cb, void*  to, int  len );
 extern int  cbuffer_read_peek( CBuffer*  cb, uint8_t*  *pbase );
 extern void cbuffer_read_step( CBuffer*  cb, int  len );
 
+/* move the content of a cbuffer to a new storage area of 'size' bytes,
+ * which must be able to hold it. The data is stored contiguously at the
+ * start of the new storage. The old storage is not freed.
+ */
+extern void cbuffer_resize( CBuffer*  cb, void*  buff, int  size );
+
 extern const char*  cbuffer_quote( CBuffer*  cb );
 extern const char*  cbuffer_quote_data( CBuffer*  cb );
 extern void         cbuffer_print( CBuffer*  cb );
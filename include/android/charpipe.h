@@ -16,7 +16,10 @@
 
 /* open two connected character drivers that can be used to communicate by internal
  * QEMU components. For Android, this is used to connect an emulated serial port
- * with the android modem
+ * with the android modem.
+ *
+ * data that the receiving end cannot accept right away is buffered and
+ * delivered from a bottom half, so no polling from the main loop is needed.
  */
 extern int  qemu_chr_open_charpipe( CharDriverState* *pfirst, CharDriverState* *psecond );
 
@@ -27,7 +30,4 @@ extern int  qemu_chr_open_charpipe( CharDriverState* *pfirst, CharDriverState* *
  */
 extern CharDriverState*  qemu_chr_open_buffer( CharDriverState*  endpoint );
 
-/* must be called from the main event loop to poll all charpipes */
-extern void charpipe_poll( void );
-
 #endif /* _CHARPIPE_H */
@@ -26,6 +26,10 @@ enum {
 };
 void       iolooper_modify( IoLooper*  iol, int fd, int oldflags, int newflags);
 
+/* Set the IOLOOPER_XXX flags watched on |fd|, 0 to stop watching it.
+ * Nothing is done if they don't change. */
+void       iolooper_set( IoLooper*  iol, int  fd, int  flags );
+
 int        iolooper_poll( IoLooper*  iol );
 /* Wrapper around select()
  * Return:
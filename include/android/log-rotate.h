@@ -16,7 +16,8 @@
 // use in the Android emulator.
 
 // Setup log rotation, this installed a signal handler for SIGUSR1
-// which will trigger a log rotation at runtime.
+// which will trigger a log rotation at runtime. This clears the slirp
+// DNS and drop logs, as well as the file given with -D, if any.
 void qemu_log_rotation_init(void);
 
 // Perform log rotation if needed. For now, this must be called from
@@ -368,7 +368,24 @@ void  socket_close( int  fd );
 int   socket_recv    ( int  fd, void*  buf, int  buflen );
 int   socket_recvfrom( int  fd, void*  buf, int  buflen, SockAddress*  from );
 
+/* same as socket_recv(), but the data is left in the socket's receive
+ * queue, so that the next call returns it again */
+int   socket_recv_peek( int  fd, void*  buf, int  buflen );
+
 int   socket_send  ( int  fd, const void*  buf, int  buflen );
+
+/* a buffer to send with socket_sendv() */
+typedef struct {
+    const void*  base;
+    int          len;
+} SocketBuffer;
+
+/* maximum number of buffers that socket_sendv() accepts */
+#define  SOCKET_SENDV_MAX  16
+
+/* same as socket_send(), but gathers the data to send from 'count' buffers,
+ * in a single system call */
+int   socket_sendv ( int  fd, const SocketBuffer*  bufs, int  count );
 int   socket_send_oob( int  fd, const void*  buf, int  buflen );
 int   socket_sendto( int  fd, const void*  buf, int  buflen, const SockAddress*  to );
 
@@ -12,6 +12,8 @@
 #ifndef _QEMU_USEREVENTS_H
 #define _QEMU_USEREVENTS_H
 
+#include <stdint.h>
+
 /* A simple abstract interface to user-events. This is used to de-couple
  * QEMU-specific and UI-specific code.
  *
@@ -24,6 +26,29 @@ void  user_event_keycodes(int *kcodes, int count);
 void  user_event_mouse(int dx, int dy, int dz, unsigned buttons_state);
 void  user_event_generic(int type, int code, int value);
 
+/* An input event to replay, |time_us| microseconds after the start of
+ * its batch. */
+typedef struct {
+    uint32_t  time_us;
+    int       type;
+    int       code;
+    int       value;
+} UserTimedEvent;
+
+/* Replay a batch of |count| events from a host timer, each at its time
+ * relative to now, through user_event_generic(). The times must not
+ * decrease. Events due at the same time are sent together, so the guest
+ * is interrupted once for all of them. A batch sent while another one is
+ * being replayed is merged with it. Return -1 if the times aren't sorted,
+ * or if too many events are pending, 0 otherwise. */
+int   user_event_replay(const UserTimedEvent* events, int count);
+
+/* Drop all events that user_event_replay() hasn't sent yet. */
+void  user_event_replay_cancel(void);
+
+/* Return the number of events that user_event_replay() hasn't sent yet. */
+int   user_event_replay_pending(void);
+
 /* The following is used to register a callback function that will receive
  * user_event_generic() calls. This is used by
  * hw/android/goldfish/events_device.c
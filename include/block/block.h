@@ -14,6 +14,11 @@ typedef struct BlockDriverInfo {
     int cluster_size;
     /* offset at which the VM state can be saved (0 if not possible) */
     int64_t vm_state_offset;
+    /* metadata cache statistics, 0 if the format has no such cache */
+    uint64_t l2_cache_hits;
+    uint64_t l2_cache_misses;
+    uint64_t refcount_cache_hits;
+    uint64_t refcount_cache_misses;
 } BlockDriverInfo;
 
 typedef struct QEMUSnapshotInfo {
@@ -59,6 +64,9 @@ void bdrv_info_stats(Monitor *mon, QObject **ret_data);
 
 void bdrv_init(void);
 void bdrv_init_with_whitelist(void);
+/* Sets the size in bytes of the L2 and refcount caches of the qcow2 images
+ * that are opened after this call. */
+void qcow2_set_cache_size(int64_t size);
 BlockDriver *bdrv_find_protocol(const char *filename);
 BlockDriver *bdrv_find_format(const char *format_name);
 BlockDriver *bdrv_find_whitelisted_format(const char *format_name);
@@ -78,6 +86,10 @@ int bdrv_read(BlockDriverState *bs, int64_t sector_num,
               uint8_t *buf, int nb_sectors);
 int bdrv_write(BlockDriverState *bs, int64_t sector_num,
                const uint8_t *buf, int nb_sectors);
+/* Tells the driver that the guest no longer needs the content of these
+ * sectors, which then read back as undefined data. Drivers that can free
+ * the space of the image file do so, the others ignore the request. */
+int bdrv_discard(BlockDriverState *bs, int64_t sector_num, int nb_sectors);
 int bdrv_pread(BlockDriverState *bs, int64_t offset,
                void *buf, int count);
 int bdrv_pwrite(BlockDriverState *bs, int64_t offset,
@@ -135,6 +147,26 @@ typedef struct BlockRequest {
 int bdrv_aio_multiwrite(BlockDriverState *bs, BlockRequest *reqs,
     int num_reqs);
 
+/* Request merging and readahead statistics of a device, see block.c. */
+typedef struct BlockMergeStats {
+    uint64_t requests;        /* read and write requests from the device */
+    uint64_t merged;          /* requests merged into the previous one */
+    uint64_t reads;           /* read requests */
+    uint64_t readahead_hits;  /* reads served from the readahead cache */
+    uint64_t readahead_bytes; /* bytes read ahead of the requests */
+} BlockMergeStats;
+
+void bdrv_get_merge_stats(BlockDriverState *bs, BlockMergeStats *stats);
+
+/* Limit the asynchronous requests of a device to |bps| bytes and |iops|
+ * requests per second, 0 meaning no limit. */
+void bdrv_set_io_limits(BlockDriverState *bs, uint64_t bps, uint64_t iops);
+void bdrv_get_io_limits(BlockDriverState *bs, uint64_t *bps, uint64_t *iops);
+
+/* Submit the requests delayed by the I/O limits now, for the callers that
+ * wait synchronously for their requests. */
+void bdrv_throttle_drain(void);
+
 /* sg packet commands */
 int bdrv_ioctl(BlockDriverState *bs, unsigned long int req, void *buf);
 BlockDriverAIOCB *bdrv_aio_ioctl(BlockDriverState *bs,
@@ -222,9 +254,26 @@ void path_combine(char *dest, int dest_size,
 int bdrv_save_vmstate(BlockDriverState *bs, const uint8_t *buf,
                       int64_t pos, int size);
 
+/* Start writing the |size| bytes of VM state of |buf| at |pos|, and call
+ * |cb| with the number of bytes written, or a -errno value, once done.
+ * |buf| must remain valid until then. Drivers that can't write the VM
+ * state asynchronously, or unaligned requests, write it before returning,
+ * after calling |cb|. Return a -errno value if |cb| won't be called. */
+int bdrv_aio_save_vmstate(BlockDriverState *bs, const uint8_t *buf,
+                          int64_t pos, int size,
+                          BlockDriverCompletionFunc *cb, void *opaque);
+
 int bdrv_load_vmstate(BlockDriverState *bs, uint8_t *buf,
                       int64_t pos, int size);
 
+/* Find where the |*size| bytes of VM state at |pos| are stored as-is, i.e.
+ * neither compressed nor encrypted, in a host file. Return their offset in
+ * the file whose name is stored in |*filename|, and reduce |*size| to the
+ * number of bytes stored contiguously from there. Return -ENOTSUP if the
+ * data at |pos| isn't stored this way, or another -errno value on error. */
+int64_t bdrv_map_vmstate(BlockDriverState *bs, int64_t pos, int *size,
+                         const char **filename);
+
 #define BDRV_SECTORS_PER_DIRTY_CHUNK 2048
 
 void bdrv_set_dirty_tracking(BlockDriverState *bs, int enable);
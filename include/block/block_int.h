@@ -27,6 +27,7 @@
 #include "block/block.h"
 #include "qemu/option.h"
 #include "qemu/queue.h"
+#include "qemu/throttle.h"
 
 #define BLOCK_FLAG_ENCRYPT	1
 #define BLOCK_FLAG_COMPRESS	2
@@ -82,6 +83,8 @@ struct BlockDriver {
 
     const char *protocol_name;
     int (*bdrv_truncate)(BlockDriverState *bs, int64_t offset);
+    int (*bdrv_discard)(BlockDriverState *bs, int64_t sector_num,
+                        int nb_sectors);
     int64_t (*bdrv_getlength)(BlockDriverState *bs);
     int (*bdrv_write_compressed)(BlockDriverState *bs, int64_t sector_num,
                                  const uint8_t *buf, int nb_sectors);
@@ -97,8 +100,17 @@ struct BlockDriver {
 
     int (*bdrv_save_vmstate)(BlockDriverState *bs, const uint8_t *buf,
                              int64_t pos, int size);
+    /* Asynchronous bdrv_save_vmstate(), see bdrv_aio_save_vmstate().
+     * |pos| and |size| are multiples of BDRV_SECTOR_SIZE. */
+    int (*bdrv_aio_save_vmstate)(BlockDriverState *bs, const uint8_t *buf,
+                                 int64_t pos, int size,
+                                 BlockDriverCompletionFunc *cb, void *opaque);
     int (*bdrv_load_vmstate)(BlockDriverState *bs, uint8_t *buf,
                              int64_t pos, int size);
+    /* Return the offset in bs->file of the VM state at |pos|, see
+     * bdrv_map_vmstate(). */
+    int64_t (*bdrv_map_vmstate)(BlockDriverState *bs, int64_t pos,
+                                int *size);
 
     int (*bdrv_change_backing_file)(BlockDriverState *bs,
         const char *backing_file, const char *backing_fmt);
@@ -179,6 +191,23 @@ struct BlockDriverState {
     uint64_t wr_ops;
     uint64_t wr_highest_sector;
 
+    /* Request merging and readahead of device requests, see block.c. */
+    QTAILQ_HEAD(BlockMergeQueue, BlockMergeAIOCB) merge_queue;
+    QEMUBH *merge_bh;
+    int writes_in_flight;
+    int64_t ra_next_sector;     /* sector following the last read */
+    int ra_window;              /* readahead size in sectors, 0 if random */
+    int ra_in_flight;           /* if true, a readahead is in flight */
+    uint64_t ra_generation;     /* incremented by every write */
+    uint8_t *ra_buf;            /* cached sectors, or NULL */
+    int64_t ra_sector;
+    int ra_nb_sectors;
+    BlockMergeStats merge_stats;
+
+    /* I/O limits of the device requests, see bdrv_set_io_limits(). */
+    ThrottleState io_throttle;
+    QEMUTimer *throttle_timer;
+
     /* Whether the disk can expand beyond total_sectors */
     int growable;
 
@@ -30,4 +30,75 @@ extern CodeProfileRecordFunc code_profile_record_func;
 // A string to indicate where profile will be stored. Profiling will
 // be turned off if its value is NULL.
 extern const char *code_profile_dirname;
+
+// TranslationBlock-level profiling, controlled from the console with the
+// 'profile' commands. While it is enabled, the main execution loop counts
+// the executions of each TranslationBlock and the host time spent in it,
+// and the translator records the time spent generating code. Direct
+// chaining of TBs is disabled so that each executed TB goes through the
+// main loop, which makes the guest noticeably slower.
+//
+// The counters of a TB are kept in the TranslationBlock itself, and are
+// merged by guest PC into the profile when the TB cache is flushed.
+
+// Non-zero while TB profiling is enabled.
+extern int tb_profile_enabled;
+
+// Function type used to turn the guest PC of a TB into a human-readable
+// name. It should write a zero-terminated string of at most |size| bytes
+// to |buf| and return 0, or return -1 if it doesn't know |pc|.
+typedef int (*TbProfileSymbolizeFunc)(target_ulong pc, char* buf,
+                                      size_t size);
+
+// The function used to name guest PCs in profile dumps. By default, it
+// looks up the symbols loaded with the guest kernel, if any.
+extern TbProfileSymbolizeFunc tb_profile_symbolize_func;
+
+// Start TB profiling. This flushes the TB cache to unchain the TBs
+// translated so far. Does not reset the profile.
+void tb_profile_start(void);
+
+// Stop TB profiling. The profile is kept until the next reset.
+void tb_profile_stop(void);
+
+// Discard all profile data.
+void tb_profile_reset(void);
+
+// Called by tb_flush() before the TB cache is emptied.
+void tb_profile_save_tbs(void);
+
+// Called before the |count| TBs at |tbs|, from a region of the
+// translation buffer that's about to be reused, are invalidated.
+void tb_profile_save_region(TranslationBlock* tbs, int count);
+
+// Called by the translator after generating the code of a TB, with the
+// number of host ticks it took.
+void tb_profile_record_translation(int64_t ticks);
+
+// Called by tb_find_slow() after a lookup in the physical PC hash table,
+// with the number of TBs it compared and whether one matched. Lookups
+// happen when the virtual PC isn't in the CPU's tb_jmp_cache.
+void tb_profile_record_lookup(unsigned int chain_length, int found);
+
+// Print the |max_entries| guest PCs where most of the host time was spent,
+// followed by translation statistics, through |callback|. Each call
+// receives one line of text terminated by '\r\n'.
+void tb_profile_dump(int max_entries,
+                     void (*callback)(void* opaque, const char* line),
+                     void* opaque);
+
+// Print the execution counters kept since startup, whether profiling is
+// enabled or not, as "<name>: <value>" lines through |callback|. They are
+// cheap enough to be always on, and meant to be sampled by benchmark
+// scripts before and after a workload: host time, guest instructions
+// (with -icount only, -1 otherwise), translations and the host time they
+// took, and softmmu TLB misses.
+void tb_profile_dump_counters(void (*callback)(void* opaque,
+                                               const char* line),
+                              void* opaque);
+
+// Register the counters above, except host time and guest instructions,
+// in the metrics registry, see android/utils/metrics.h. Must be called
+// once.
+void tb_profile_register_metrics(void);
 #endif
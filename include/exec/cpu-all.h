@@ -473,6 +473,11 @@ typedef struct RAMBlock {
      */
     QTAILQ_ENTRY(RAMBlock) next;
     int fd;
+    /* Snapshot pages not restored yet, see ram_lazy_load_page() */
+    struct RamLazyPage *lazy_pages;
+    /* Size of the explicit huge pages backing |host|, or 0 for normal
+     * (possibly transparent huge) pages, see -mem-hugepages. */
+    size_t page_size;
 } RAMBlock;
 
 #define DIRTY_MEMORY_VGA       0
@@ -491,6 +496,16 @@ extern RAMList ram_list;
 
 extern const char *mem_path;
 extern int mem_prealloc;
+extern int mem_hugepages;
+extern int mem_prefault;
+extern int mem_lock;
+
+/* Write a description of the host pages backing each RAM block, with an
+ * estimate of the number of TLB entries needed to map them, through
+ * |write|, one line at a time. Used by the 'profile memory' console
+ * command. */
+void qemu_ram_dump_page_stats(void (*write)(void *opaque, const char *line),
+                              void *opaque);
 
 /* physical memory access */
 
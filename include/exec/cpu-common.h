@@ -105,6 +105,13 @@ void *cpu_physical_memory_map(hwaddr addr,
 void cpu_physical_memory_unmap(void *buffer, hwaddr len,
                                int is_write, hwaddr access_len);
 void *cpu_register_map_client(void *opaque, void (*callback)(void *opaque));
+/* Give the host memory backing the guest RAM pages fully contained in
+ * [addr, addr + len) back to the host, because the guest doesn't use them
+ * anymore, e.g. when reported by a balloon driver. The guest reads zeroes
+ * or undefined data from them afterwards. Other ranges are skipped.
+ * Return the number of bytes released, or -1 if this isn't supported,
+ * e.g. with HAX, which owns the guest pages. */
+int64_t qemu_ram_discard_range(hwaddr addr, hwaddr len);
 
 uint32_t ldub_phys(hwaddr addr);
 uint32_t lduw_le_phys(hwaddr addr);
@@ -23,6 +23,7 @@
 #include "qemu-common.h"
 #include "exec/cpu-common.h"
 #include "exec/cpu-all.h"
+#include "qemu/atomic.h"
 
 /* allow to see translation results - the slowdown should be negligible, so we leave it */
 #define DEBUG_DISAS
@@ -129,6 +130,8 @@ int io_mem_watch;
 
 #define CODE_GEN_ALIGN           16 /* must be >= of the size of a icache line */
 
+/* initial size of the physical PC hash table. It's doubled each time it
+   holds more TBs than buckets, up to the maximum number of TBs. */
 #define CODE_GEN_PHYS_HASH_BITS     15
 #define CODE_GEN_PHYS_HASH_SIZE     (1 << CODE_GEN_PHYS_HASH_BITS)
 
@@ -141,6 +144,10 @@ int io_mem_watch;
 #define CODE_GEN_AVG_BLOCK_SIZE 64
 #endif
 
+/* maximum number of regions the translation buffer is split into. When
+   the buffer is full, only the oldest region is evicted. */
+#define CODE_GEN_MAX_REGIONS 8
+
 #if defined(__arm__) || defined(_ARCH_PPC) \
     || defined(__x86_64__) || defined(__i386__) \
     || defined(__sparc__) || defined(__aarch64__) \
@@ -181,23 +188,55 @@ struct TranslationBlock {
     struct TranslationBlock *jmp_next[2];
     struct TranslationBlock *jmp_first;
     uint32_t icount;
+    /* executions of this TB and host ticks spent in it, only updated
+       while TB profiling is enabled (see exec/code-profile.h) */
+    uint64_t exec_count;
+    uint64_t exec_ticks;
 };
 
 #include "exec/spinlock.h"
 
+/* A part of the translation buffer, with the slice of the tbs[] array
+   describing the code generated in it. */
+typedef struct TBRegion {
+    uint8_t *code_start;
+    /* end of the generated code, for the regions other than the current
+       one (which ends at tcg_ctx.code_gen_ptr) */
+    uint8_t *code_end;
+    /* threshold to evict the next region */
+    uint8_t *code_max;
+    int first_tb;
+    int max_tbs;
+    int nb_tbs;
+} TBRegion;
+
 typedef struct TBContext TBContext;
 
 struct TBContext {
 
     TranslationBlock *tbs;
-    TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
+    TranslationBlock **tb_phys_hash;
+    /* number of buckets of tb_phys_hash, a power of 2 */
+    unsigned int tb_phys_hash_size;
+    unsigned int tb_phys_hash_max_size;
     int nb_tbs;
+    /* the translation buffer is split into nb_regions regions of
+       region_size bytes, filled in turn */
+    TBRegion regions[CODE_GEN_MAX_REGIONS];
+    int nb_regions;
+    int current_region;
+    size_t region_size;
     /* any access to the tbs or the page table must use this lock */
     spinlock_t tb_lock;
 
     /* statistics */
     int tb_flush_count;
+    int tb_region_evict_count;
     int tb_phys_invalidate_count;
+    int tb_phys_hash_resize_count;
+    /* blocks translated and host time spent doing so, since startup */
+    uint64_t tb_gen_count;
+    int64_t tb_gen_time_ns;
 
     int tb_invalidated_flag;
 };
@@ -217,13 +256,15 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 	    | (tmp & TB_JMP_ADDR_MASK));
 }
 
-static inline unsigned int tb_phys_hash_func(tb_page_addr_t pc)
+static inline unsigned int tb_phys_hash_func(const TBContext *ctx,
+                                             tb_page_addr_t pc)
 {
-    return (pc >> 2) & (CODE_GEN_PHYS_HASH_SIZE - 1);
+    return (pc >> 2) & (ctx->tb_phys_hash_size - 1);
 }
 
 void tb_free(TranslationBlock *tb);
 void tb_flush(CPUArchState *env);
+void *tb_lookup_ptr(CPUArchState *env);
 void tb_link_phys(TranslationBlock *tb,
                   target_ulong phys_pc, target_ulong phys_page2);
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
@@ -247,8 +288,10 @@ void ppc_tb_set_jmp_target(unsigned long jmp_addr, unsigned long addr);
 #elif defined(__i386__) || defined(__x86_64__)
 static inline void tb_set_jmp_target1(uintptr_t jmp_addr, uintptr_t addr)
 {
-    /* patch the branch destination */
-    *(uint32_t *)jmp_addr = addr - (jmp_addr + 4);
+    /* patch the branch destination.  The backend aligns the displacement,
+       so that a thread running the jump sees either the old or the new
+       target.  */
+    atomic_set((uint32_t *)jmp_addr, addr - (jmp_addr + 4));
     /* no need to flush icache explicitly */
 }
 #elif defined(__aarch64__)
@@ -360,6 +403,11 @@ extern void *io_mem_opaque[IO_MEM_NB_ENTRIES];
 void tlb_fill(CPUArchState *env1, target_ulong addr, int is_write, int mmu_idx,
               uintptr_t retaddr);
 
+/* TLB misses resolved by the victim TLB, and the ones that called
+   tlb_fill() (cputlb.c) */
+extern uint64_t tlb_victim_hit_count;
+extern uint64_t tlb_victim_miss_count;
+
 uint8_t helper_ldb_cmmu(CPUArchState *env, target_ulong addr, int mmu_idx);
 uint16_t helper_ldw_cmmu(CPUArchState *env, target_ulong addr, int mmu_idx);
 uint32_t helper_ldl_cmmu(CPUArchState *env, target_ulong addr, int mmu_idx);
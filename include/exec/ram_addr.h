@@ -40,6 +40,14 @@ void qemu_ram_free(ram_addr_t addr);
 void qemu_ram_remap(ram_addr_t addr, ram_addr_t length);
 ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr);
 
+/* Number of RAM pages that still have to be restored from a snapshot. */
+extern ram_addr_t ram_lazy_remaining;
+/* Restore a pending page of |block|, if needed. */
+void ram_lazy_load_page(RAMBlock *block, ram_addr_t offset);
+/* Restore all pending pages in a range of RAM addresses. Must be called
+ * before accessing more than one page through qemu_get_ram_ptr(). */
+void ram_lazy_load_range(ram_addr_t addr, ram_addr_t length);
+
 static inline int cpu_physical_memory_get_dirty(ram_addr_t start,
                                                 ram_addr_t length,
                                                 unsigned client)
@@ -55,6 +63,40 @@ static inline int cpu_physical_memory_get_dirty(ram_addr_t start,
     return next < end;
 }
 
+/* Return the address of the first page of [start, end) that is dirty for
+ * |client|, or |end| if there is none. */
+static inline ram_addr_t cpu_physical_memory_next_dirty(ram_addr_t start,
+                                                        ram_addr_t end,
+                                                        unsigned client)
+{
+    unsigned long last, next;
+
+    assert(client < DIRTY_MEMORY_NUM);
+
+    last = TARGET_PAGE_ALIGN(end) >> TARGET_PAGE_BITS;
+    next = find_next_bit(ram_list.dirty_memory[client], last,
+                         start >> TARGET_PAGE_BITS);
+    if (next >= last) {
+        return end;
+    }
+    return MAX((ram_addr_t)next << TARGET_PAGE_BITS, start);
+}
+
+/* Return the number of pages of a range that are dirty for |client|. */
+static inline ram_addr_t cpu_physical_memory_count_dirty(ram_addr_t start,
+                                                         ram_addr_t length,
+                                                         unsigned client)
+{
+    unsigned long end, page;
+
+    assert(client < DIRTY_MEMORY_NUM);
+
+    end = TARGET_PAGE_ALIGN(start + length) >> TARGET_PAGE_BITS;
+    page = start >> TARGET_PAGE_BITS;
+    return bitmap_count_one_range(ram_list.dirty_memory[client], page,
+                                  end - page);
+}
+
 static inline bool cpu_physical_memory_get_dirty_flag(ram_addr_t addr,
                                                       unsigned client)
 {
@@ -157,6 +199,21 @@ static inline void cpu_physical_memory_clear_dirty_range(ram_addr_t start,
 void cpu_physical_memory_reset_dirty(ram_addr_t start, ram_addr_t length,
                                      unsigned client);
 
+/* Like cpu_physical_memory_reset_dirty(), but return true if any page of
+ * the range was dirty. The dirty bits are cleared atomically, so that
+ * pages dirtied meanwhile by other threads are reported next time. */
+bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
+                                              ram_addr_t length,
+                                              unsigned client);
+
+/* Like cpu_physical_memory_test_and_clear_dirty(), but also store the
+ * dirty bits of the pages of the range in |dest|, the first page of the
+ * range being bit 0. */
+bool cpu_physical_memory_snapshot_and_clear_dirty(ram_addr_t start,
+                                                  ram_addr_t length,
+                                                  unsigned client,
+                                                  unsigned long *dest);
+
 int cpu_physical_memory_set_dirty_tracking(int enable);
 
 int cpu_physical_memory_get_dirty_tracking(void);
@@ -164,5 +221,13 @@ int cpu_physical_memory_get_dirty_tracking(void);
 int cpu_physical_sync_dirty_bitmap(hwaddr start_addr,
                                    hwaddr end_addr);
 
+/* Make sure that the guest writes to the range set its dirty bits, once
+ * cpu_physical_sync_dirty_bitmap() is called, when a hardware accelerator
+ * runs the guest. With KVM, this enables the dirty page log of the slots
+ * of the range, i.e. possibly of more memory. Returns 0 on success, or a
+ * negative errno value if the accelerator can't track the writes, as with
+ * HAX, in which case the dirty bits of the range can't be trusted. */
+int cpu_physical_memory_start_dirty_log(hwaddr start_addr, ram_addr_t size);
+
 #endif
 #endif
\ No newline at end of file
@@ -50,6 +50,12 @@ void goldfish_battery_init(int has_battery);
 void goldfish_battery_set_prop(int ac, int property, int value);
 void goldfish_battery_display(void (* callback)(void *data, const char* string), void *data);
 void goldfish_mmc_init(uint32_t base, int id, BlockDriverState* bs);
+/* Queues a goldfish_block disk named |name|, backed by |bs|. Call this
+ * before the board is created, which calls goldfish_block_init() to add a
+ * device for each of them. */
+void goldfish_block_add(const char* name, BlockDriverState* bs);
+void goldfish_block_init(void);
+void goldfish_address_space_init(uint32_t base);
 int goldfish_guest_is_64bit();
 
 // these do not add a device
@@ -57,6 +63,11 @@ void trace_dev_init();
 void events_dev_init(uint32_t base, qemu_irq irq);
 void nand_dev_init(uint32_t base);
 
+/* Size of the memory region of the goldfish_address_space device, which
+ * boards map at the physical address passed to goldfish_address_space_init().
+ */
+#define GOLDFISH_ADDRESS_SPACE_SIZE  (64 << 20)
+
 #ifdef TARGET_I386
 /* Maximum IRQ number available for a device on x86. */
 #define GFD_MAX_IRQ      16
@@ -14,6 +14,26 @@
 
 void nand_dev_init(uint32_t base);
 void nand_add_dev(const char *arg);
+
+/* Make the first access to the image of the NAND device named |devname|,
+ * either by the guest or for a snapshot, call |wait| first. This delays
+ * the accesses until the image is ready, e.g. after it is resized in the
+ * background.
+ */
+void nand_dev_set_wait_hook(const char *devname, void (*wait)(void));
+
+/* Limit the transfers of the NAND device named |devname|, or of all of them
+ * if it is NULL, to |bps| bytes and |iops| operations per second, 0 meaning
+ * no limit. The vCPU that exceeds them is paused until they allow its next
+ * transfer. Returns 0 on success, or -1 if there is no such device.
+ */
+int nand_dev_set_io_limits(const char *devname, uint64_t bps, uint64_t iops);
+
+/* Call |it| with the name and I/O limits of each NAND device. */
+void nand_dev_iterate_io_limits(void (*it)(void *opaque, const char *devname,
+                                           uint64_t bps, uint64_t iops),
+                                void *opaque);
+
 void parse_nand_limits(char*  limits);
 
 typedef struct {
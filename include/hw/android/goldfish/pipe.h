@@ -138,6 +138,23 @@ extern void goldfish_pipe_close( void* hwpipe );
  */
 extern void goldfish_pipe_wake( void* hwpipe, unsigned flags );
 
+/* Results of goldfish_pipe_bench() */
+typedef struct {
+    uint64_t  roundTrips;  /* number of buffers written and read back */
+    uint64_t  bytes;       /* total bytes transferred, in both directions */
+    uint64_t  elapsedNs;
+} GoldfishPipeBenchResult;
+
+/* Measure the host side of the pipe service 'serviceName', by writing
+ * and reading back buffers of 'size' bytes for about 'durationMs'
+ * milliseconds, without a guest. Only the 'zero' and 'pingpong' test
+ * services are supported. The results are also published as the
+ * emulator_pipe_bench_* metrics. Returns 0 on success, or -1 on failure.
+ */
+extern int goldfish_pipe_bench( const char* serviceName, int size,
+                                int durationMs,
+                                GoldfishPipeBenchResult* result );
+
 /* The following definitions must match those under:
  *
  *    $KERNEL/drivers/misc/qemupipe/qemu_pipe.c
@@ -184,6 +201,26 @@ extern void goldfish_pipe_wake( void* hwpipe, unsigned flags );
 #define PIPE_CMD_READ_BUFFER        6  /* receive a page-contained buffer from the emulator */
 #define PIPE_CMD_WAKE_ON_READ       7  /* tell the emulator to wake us when reading is possible */
 
+/* The following commands transfer several buffers at once. PIPE_REG_ADDRESS
+ * must contain the guest physical address of an array of
+ * struct pipe_buffer_entry, and PIPE_REG_SIZE the number of entries in it
+ * (at most PIPE_MAX_BUFFER_ENTRIES). Each entry describes a buffer in guest
+ * virtual memory which is not restricted to a single page. The status
+ * is the total number of bytes transferred, or a PIPE_ERROR_XXX value.
+ * They use the same (CMD_READ - CMD_WRITE) offset as the commands above.
+ */
+#define PIPE_CMD_WRITE_BUFFER_LIST  8  /* send several buffers to the emulator */
+#define PIPE_CMD_READ_BUFFER_LIST   10 /* receive several buffers from the emulator */
+
+#define PIPE_MAX_BUFFER_ENTRIES     64
+
+struct pipe_buffer_entry {
+    uint64_t address;
+    uint32_t size;
+    /* reserved for future extension, must be 0 */
+    uint32_t flags;
+};
+
 /* Possible status values used to signal errors - see qemu_pipe_error_convert */
 #define PIPE_ERROR_INVAL       -1
 #define PIPE_ERROR_AGAIN       -2
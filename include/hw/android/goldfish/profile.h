@@ -26,4 +26,35 @@ void record_mmap(target_ulong vstart, target_ulong vend,
 void release_mmap(unsigned pid);
 
 void profile_bb_helper(target_ulong pc, uint32_t size);
+
+// Record the name of thread |tid|, used to label its profile samples.
+void record_thread_name(unsigned tid, const char *name);
+
+// Sampling profile of the guest processes: |profile_sampling_rate| times
+// per second of host time, the guest PC and current thread are recorded,
+// and the PC is resolved to an offset in the file the thread mapped there,
+// using the mmap notifications of the trace device. Samples are only exact
+// without hardware acceleration, where the CPU state is always up to date.
+//
+// Set from the -sample-profile option, -1 without it. The trace device is
+// only present with this option or -code-profile. A value of 0 adds the
+// device without starting the sampling.
+extern int profile_sampling_rate;
+
+// Discard the current samples, and start sampling |hz| times per second.
+// Return 0 on success, or -1 if the trace device isn't present.
+int profile_sampling_start(int hz);
+
+// Stop sampling, the samples are kept until the next start.
+void profile_sampling_stop(void);
+
+// Return the number of samples recorded since the last start.
+int profile_sampling_count(void);
+
+// Write the samples to |path| in the text format of 'perf script', that
+// FlameGraph's stackcollapse-perf.pl, speedscope or pprof (through
+// perf_to_profile) read. Addresses are offsets in the mapped files, or
+// guest PCs for the kernel, together with the symbol when it is known.
+// Return 0 on success, -1 on error.
+int profile_sampling_write(const char *path);
 #endif
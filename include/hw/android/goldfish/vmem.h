@@ -23,5 +23,13 @@ int safe_memory_rw_debug(CPUState *env, target_ulong addr, uint8_t *buf,
 
 hwaddr safe_get_phys_page_debug(CPUState *env, target_ulong addr);
 
+// Translate the virtual address |addr| to a physical one, like
+// safe_get_phys_page_debug() but without rounding to a page boundary.
+// On entry, |*plen| is the size of the virtual range starting at |addr|. On
+// exit, it is the size of its leading part that is physically contiguous.
+// Returns -1 and sets |*plen| to 0 if |addr| is not mapped.
+hwaddr safe_get_phys_range_debug(CPUState *env, target_ulong addr,
+                                 target_ulong *plen);
+
 
 #endif  /* GOLDFISH_VMEM_H */
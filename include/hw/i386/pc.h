@@ -49,6 +49,12 @@ void apic_deliver_irq(uint8_t dest, uint8_t dest_mode,
                              uint8_t vector_num, uint8_t polarity,
                              uint8_t trigger_mode);
 int apic_init(CPUOldState *env);
+/* Allocate |count| interrupt lines that are delivered to the boot CPU as
+ * message-signaled interrupts, line n with vector |vector_base + n|, on
+ * their rising edge. A line that is still raised when the guest signals
+ * the end of its interrupt is delivered again.
+ */
+qemu_irq *apic_allocate_msi_irqs(int vector_base, int count);
 int apic_accept_pic_intr(CPUOldState *env);
 void apic_deliver_pic_intr(CPUOldState *env, int level);
 int apic_get_interrupt(CPUOldState *env);
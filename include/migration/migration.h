@@ -109,4 +109,25 @@ uint64_t ram_bytes_total(void);
 int ram_save_live(QEMUFile *f, int stage, void *opaque);
 int ram_load(QEMUFile *f, void *opaque, int version_id);
 
+/* When set, ram_load() doesn't read RAM pages from seekable snapshot files,
+ * but restores them on first access or from a background timer instead. */
+extern int ram_lazy_restore;
+/* When set, ram_load() maps the raw RAM pages of snapshot files
+ * copy-on-write instead of reading them, so that emulators restoring the
+ * same snapshot share them, and ram_save_live() doesn't compress pages. */
+extern int ram_shared_restore;
+/* Restore all pending RAM pages now, and copy those mapped from the
+ * snapshot storage. Must be called before the snapshot storage they are
+ * read from is modified. */
+void ram_lazy_load_all(void);
+
+struct SnapshotFlatHeader;
+/* Write the RAM section of a flat snapshot file at the 'ram_offset' of
+ * |header|, and fill its RAM fields. Return 0 or a -errno value. */
+int ram_save_flat(int fd, struct SnapshotFlatHeader *header);
+/* Restore the RAM section of the flat snapshot file |filename|, opened as
+ * |fd|, mapping the RAM blocks from it when possible. */
+int ram_load_flat(int fd, const char *filename,
+                  const struct SnapshotFlatHeader *header);
+
 #endif
@@ -116,6 +116,21 @@ QEMUFile *qemu_popen_cmd(const char *command, const char *mode);
 int qemu_get_fd(QEMUFile *f);
 int qemu_fclose(QEMUFile *f);
 int64_t qemu_ftell(QEMUFile *f);
+
+/* Random access to input files, used to restore RAM pages on demand.
+ * qemu_file_dup_reader() returns NULL if |f| is not seekable. */
+bool qemu_file_is_seekable(QEMUFile *f);
+QEMUFile *qemu_file_dup_reader(QEMUFile *f);
+/* Current position in the stream, without flushing it. */
+int64_t qemu_file_get_pos(QEMUFile *f);
+/* Cluster size of the image a VM state is written to, or 0. */
+int qemu_file_get_cluster_size(QEMUFile *f);
+/* Offset in the host file named |*filename| where the |*size| bytes at
+ * |pos| of a seekable file are stored as-is, see bdrv_map_vmstate(). */
+int64_t qemu_file_map(QEMUFile *f, int64_t pos, int *size,
+                      const char **filename);
+int qemu_file_skip_forward(QEMUFile *f, int64_t size);
+int qemu_file_pread(QEMUFile *f, uint8_t *buf, int64_t pos, int size);
 void qemu_put_buffer(QEMUFile *f, const uint8_t *buf, int size);
 void qemu_put_byte(QEMUFile *f, int v);
 
@@ -275,6 +275,20 @@ typedef void IOHandler(void *opaque);
 void qemu_iohandler_fill(int *pnfds, fd_set *readfds, fd_set *writefds, fd_set *xfds);
 void qemu_iohandler_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds, int rc);
 
+/* Same as qemu_iohandler_fill() and qemu_iohandler_poll(), but the
+ * descriptors stay registered with |looper| between calls, and only the
+ * changes are applied. Always use the same looper. */
+struct IoLooper;
+void qemu_iohandler_looper_fill(struct IoLooper *looper);
+void qemu_iohandler_looper_poll(struct IoLooper *looper, int rc);
+
+/* Call this before closing a descriptor that was watched through an
+ * IoLooper by the main loop, other than with qemu_set_fd_handler():
+ * closing it doesn't tell the looper. The change is applied by the main
+ * thread at the next qemu_iohandler_looper_fill(), which also lets other
+ * threads call this while the main loop is waiting. */
+void qemu_iohandler_forget_fd(int fd);
+
 struct ParallelIOArg {
     void *buffer;
     int count;
@@ -347,7 +361,7 @@ size_t qemu_iovec_from_buf(QEMUIOVector *qiov, size_t offset,
 size_t qemu_iovec_memset(QEMUIOVector *qiov, size_t offset,
                          int fillc, size_t bytes);
 
-bool buffer_is_zero(const void *buf, size_t len);
+#include "qemu/bufferiszero.h"
 
 #define QEMU_FILE_TYPE_BIOS   0
 #define QEMU_FILE_TYPE_KEYMAP 1
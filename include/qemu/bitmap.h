@@ -37,6 +37,9 @@
  * bitmap_set(dst, pos, nbits)			Set specified bit area
  * bitmap_clear(dst, pos, nbits)		Clear specified bit area
  * bitmap_find_next_zero_area(buf, len, pos, n, mask)	Find bit free area
+ * bitmap_count_one_range(src, pos, nbits)	Number of set bits in area
+ * bitmap_test_and_clear_atomic(dst, pos, nbits) Clear area, were bits set?
+ * bitmap_extract_and_clear_atomic(dst, src, pos, nbits) Move area to *dst
  */
 
 /*
@@ -214,6 +217,10 @@ static inline int bitmap_intersects(const unsigned long *src1,
 
 void bitmap_set(unsigned long *map, long i, long len);
 void bitmap_clear(unsigned long *map, long start, long nr);
+long bitmap_count_one_range(const unsigned long *map, long start, long nr);
+bool bitmap_test_and_clear_atomic(unsigned long *map, long start, long nr);
+bool bitmap_extract_and_clear_atomic(unsigned long *dst, unsigned long *map,
+                                     long start, long nr);
 unsigned long bitmap_find_next_zero_area(unsigned long *map,
                                          unsigned long size,
                                          unsigned long start,
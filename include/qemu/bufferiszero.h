@@ -0,0 +1,25 @@
+/*
+ * Fast checks for buffers filled with a single byte value.
+ *
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_BUFFERISZERO_H
+#define QEMU_BUFFERISZERO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return true if all |len| bytes at |buf| are equal to |c|, which is
+ * true for an empty buffer. There is no restriction on the alignment of
+ * |buf| or on |len|, but longer aligned buffers are scanned faster. */
+bool buffer_is_filled(const void *buf, size_t len, uint8_t c);
+
+/* Return true if all |len| bytes at |buf| are zero. */
+bool buffer_is_zero(const void *buf, size_t len);
+
+#endif /* QEMU_BUFFERISZERO_H */
@@ -56,13 +56,18 @@ void GCC_FMT_ATTR(1, 2) qemu_log(const char *fmt, ...);
 
 /* vfprintf-like logging function
  */
-static inline void GCC_FMT_ATTR(1, 0)
-qemu_log_vprintf(const char *fmt, va_list va)
-{
-    if (qemu_logfile) {
-        vfprintf(qemu_logfile, fmt, va);
-    }
-}
+void GCC_FMT_ATTR(1, 0) qemu_log_vprintf(const char *fmt, va_list va);
+
+/* fprintf-like logging function, for cpu_dump_state() and the like.
+ * @f must be qemu_logfile.
+ */
+int GCC_FMT_ATTR(2, 3) qemu_log_fprintf(FILE *f, const char *fmt, ...);
+
+/* Wait until the messages that were queued by qemu_log() and friends have
+ * been written to the log file. Call this before writing to qemu_logfile
+ * directly.
+ */
+void qemu_log_sync(void);
 
 /* log only if a bit is set on the current loglevel mask
  */
@@ -84,7 +89,7 @@ void GCC_FMT_ATTR(2, 3) qemu_log_mask(int mask, const char *fmt, ...);
 static inline void log_cpu_state(CPUState *cpu, int flags)
 {
     if (qemu_log_enabled()) {
-        cpu_dump_state(cpu, qemu_logfile, fprintf, flags);
+        cpu_dump_state(cpu, qemu_logfile, qemu_log_fprintf, flags);
     }
 }
 /**
@@ -108,12 +113,14 @@ void target_disas(FILE*, CPUArchState*, target_ulong, target_ulong, int);
 static inline void log_target_disas(CPUArchState *env, target_ulong start,
                                     target_ulong len, int flags)
 {
+    qemu_log_sync();
     target_disas(qemu_logfile, env, start, len, flags);
 }
 
 void disas(FILE*, void*, unsigned long);
 static inline void log_disas(void *code, unsigned long size)
 {
+    qemu_log_sync();
     disas(qemu_logfile, code, size);
 }
 
@@ -121,6 +128,7 @@ static inline void log_disas(void *code, unsigned long size)
 /* page_dump() output to the log file: */
 static inline void log_page_dump(void)
 {
+    qemu_log_sync();
     page_dump(qemu_logfile);
 }
 #endif
@@ -132,12 +140,14 @@ static inline void log_page_dump(void)
 /* fflush() the log file */
 static inline void qemu_log_flush(void)
 {
+    qemu_log_sync();
     fflush(qemu_logfile);
 }
 
 /* Close the log file */
 static inline void qemu_log_close(void)
 {
+    qemu_log_sync();
     if (qemu_logfile) {
         if (qemu_logfile != stderr) {
             fclose(qemu_logfile);
@@ -177,6 +187,9 @@ static inline void qemu_set_log(int log_flags)
 }
 
 void qemu_set_log_filename(const char *filename);
+
+/* Truncate the log file, if there is one. Used by log rotation. */
+void qemu_log_rotate(void);
 int qemu_str_to_log_mask(const char *str);
 
 /* Print a usage message listing all the valid logging categories
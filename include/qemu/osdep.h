@@ -98,6 +98,12 @@ int qemu_daemon(int nochdir, int noclose);
 void *qemu_memalign(size_t alignment, size_t size);
 void *qemu_vmalloc(size_t size);
 void *qemu_anon_ram_alloc(size_t size);
+/* Same as qemu_anon_ram_alloc(), but try to back the memory with large host
+ * pages to reduce TLB misses and page faults. Set |*page_size| to the size
+ * of these pages if explicit large pages could be allocated, or to 0 if the
+ * memory uses normal pages, which the host may still turn into transparent
+ * huge pages. The result must be released with qemu_anon_ram_free(). */
+void *qemu_anon_ram_alloc_hugepages(size_t size, size_t *page_size);
 void qemu_vfree(void *ptr);
 void qemu_anon_ram_free(void *ptr, size_t size);
 
@@ -0,0 +1,51 @@
+/*
+ * Bandwidth and operation rate limits.
+ *
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_THROTTLE_H
+#define QEMU_THROTTLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A pair of leaky buckets, one counting bytes and the other operations,
+ * each drained at its limit. Operations run while their buckets are below
+ * a burst of 1/THROTTLE_BURST_DIVISOR second worth of their limit, and
+ * wait for them to drain below it otherwise. A limit of 0 means none.
+ *
+ * A ThrottleState has no time source of its own, the callers pass the
+ * current time, in ns, of any monotonic clock. */
+typedef struct ThrottleState {
+    uint64_t bps;           /* bytes per second */
+    uint64_t iops;          /* operations per second */
+    double bytes_level;
+    double ops_level;
+    int64_t last_ns;        /* time of the last drain */
+} ThrottleState;
+
+#define THROTTLE_BURST_DIVISOR  10
+
+/* Initialize |t| without limits. */
+void throttle_init(ThrottleState *t);
+
+/* Change the limits of |t|. The buckets are emptied. */
+void throttle_set_limits(ThrottleState *t, uint64_t bps, uint64_t iops);
+
+static inline bool throttle_enabled(const ThrottleState *t)
+{
+    return t->bps != 0 || t->iops != 0;
+}
+
+/* Return the time to wait from |now_ns| before the next operation can
+ * run, in ns, or 0 if it can run now. */
+int64_t throttle_delay(ThrottleState *t, int64_t now_ns);
+
+/* Account for an operation of |bytes| bytes running at |now_ns|. */
+void throttle_account(ThrottleState *t, uint64_t bytes, int64_t now_ns);
+
+#endif /* QEMU_THROTTLE_H */
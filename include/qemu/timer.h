@@ -59,7 +59,8 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
-    QEMUTimer *next;
+    uint64_t order;             /* orders timers with the same expire_time */
+    int heap_index;             /* position in the active timers heap */
     int scale;
 };
 
@@ -695,6 +696,16 @@ static inline int64_t get_ticks_per_sec(void)
     return 1000000000LL;
 }
 
+/**
+ * qemu_set_timer_slack_ns:
+ * @slack: the slack, in nanoseconds
+ *
+ * Allow the main loop to wake up to @slack nanoseconds after a timer
+ * expires, so that the timers which expire close to each other are run
+ * after a single host wakeup. The default is 0, i.e. no slack.
+ */
+void qemu_set_timer_slack_ns(int64_t slack);
+
 /*
  * Low level clock functions
  */
@@ -744,6 +755,8 @@ static inline int64_t get_clock(void)
 
 /* icount */
 int64_t cpu_get_icount(void);
+/* Number of guest instructions executed so far, only with -icount. */
+int64_t cpu_get_icount_raw(void);
 int64_t cpu_get_clock(void);
 
 /*******************************************/
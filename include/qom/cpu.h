@@ -87,6 +87,10 @@ struct CPUState {
 
     struct hax_vcpu_state *hax_vcpu;
 
+    /* QoS throttling, see qemu_cpu_set_throttle() in cpus.c. */
+    int64_t throttle_run_ns;    /* run time since the last pause */
+    int64_t throttle_until_ns;  /* end of the current pause, or 0 */
+
     /* TODO Move common fields from CPUArchState here. */
     int cpu_index; /* used by alpha TCG */
     uint32_t halted; /* used by alpha, cris, ppc TCG */
@@ -24,14 +24,39 @@
 #ifndef QEMU_CPUS_H
 #define QEMU_CPUS_H
 
+struct CPUState;
+
 void tcg_cpu_exec(void);
 void vm_state_notify(int running, int reason);
 extern int tbflush_requested;
 extern int debug_requested;
 
+/* Set to request running the TCG vCPUs in a dedicated thread, while the
+   main loop handles I/O and timers in the main thread (-iothread). */
+extern int use_iothread;
+/* True once the TCG vCPU thread is running. */
+bool qemu_iothread_enabled(void);
+
 void resume_all_vcpus(void);
 void pause_all_vcpus(void);
 int qemu_init_main_loop(void);
+
+/* Idle accounting: the time the TCG vCPUs spend halted with nothing to do
+   while the VM runs, during which the host thread sleeps. */
+void qemu_cpu_idle_init(void);
+void qemu_cpu_idle_enter(void);
+void qemu_cpu_idle_leave(void);
+/* Return the idle time and the elapsed time since startup, in ns. */
+void qemu_cpu_idle_get_stats(int64_t *idle_ns, int64_t *elapsed_ns);
+/* QoS: limit each vCPU to |percent| of a host CPU, from 1 to 100. */
+void qemu_cpu_set_throttle(int percent);
+int qemu_cpu_get_throttle(void);
+/* Pause |cpu| for |pause_ns| ns, e.g. after too much synchronous I/O,
+   without stopping the main loop. Called from |cpu|'s thread. */
+void qemu_cpu_throttle_pause(struct CPUState *cpu, int64_t pause_ns);
+/* Time until the first paused vCPU can run again, in ns, or -1. */
+int64_t qemu_cpu_throttle_deadline_ns(void);
+void qemu_event_increment(void);
 void main_loop(void);
 
 #endif /* QEMU_CPUS_H */
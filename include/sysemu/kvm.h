@@ -52,10 +52,16 @@ int kvm_physical_sync_dirty_bitmap(hwaddr start_addr,
 
 int kvm_log_start(hwaddr phys_addr, ram_addr_t size);
 int kvm_log_stop(hwaddr phys_addr, ram_addr_t size);
+/* Same as kvm_log_start(), for all the slots overlapping the range instead
+ * of one that matches it exactly. */
+int kvm_log_start_range(hwaddr phys_addr, ram_addr_t size);
 int kvm_set_migration_log(int enable);
 
 int kvm_has_sync_mmu(void);
 
+/* Set the signals accepted while the vCPU runs the guest in KVM_RUN. */
+int kvm_set_signal_mask(CPUState *cpu, const sigset_t *sigset);
+
 void kvm_setup_guest_memory(void *start, size_t size);
 
 int kvm_coalesce_mmio_region(hwaddr start, ram_addr_t size);
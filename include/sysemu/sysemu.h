@@ -19,6 +19,13 @@
 extern const char *bios_name;
 
 extern const char* savevm_on_exit;
+/* With -fast-exit, the window is hidden as soon as a shutdown is requested,
+ * and the process exits right after the snapshot is saved, without tearing
+ * down the UI and devices, see android_fast_exit(). */
+extern int fast_exit;
+/* Directory of the flat snapshot files, or NULL to use the snapshot image,
+ * see android/snapshot-flat.h. */
+extern const char* savevm_flat_dir;
 extern int no_shutdown;
 extern int vm_running;
 extern int vm_can_run(void);
@@ -76,7 +83,12 @@ void qemu_system_powerdown(void);
 #endif
 void qemu_system_reset(void);
 
-void do_savevm(Monitor *mon, const char *name);
+/* Returns -1 if the snapshot couldn't be saved, 0 otherwise. */
+int do_savevm(Monitor *mon, const char *name);
+/* Like do_savevm(), but only stops the VM at the end of the save, see
+ * do_info_savevm_live() for its progress. */
+void do_savevm_live(Monitor *mon, const char *name);
+void do_info_savevm_live(Monitor *mon);
 void do_loadvm(Monitor *mon, const char *name);
 void do_delvm(Monitor *mon, const char *name);
 void do_info_snapshots(Monitor *mon, Monitor* err);
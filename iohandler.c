@@ -26,6 +26,7 @@
 #include "qemu-common.h"
 #include "sysemu/char.h"
 #include "qemu/queue.h"
+#include "android/iolooper.h"
 
 #ifndef _WIN32
 #include <sys/wait.h>
@@ -44,6 +45,15 @@ typedef struct IOHandlerRecord {
 static QLIST_HEAD(, IOHandlerRecord) io_handlers =
     QLIST_HEAD_INITIALIZER(io_handlers);
 
+/* Set once the main loop uses qemu_iohandler_looper_fill(). */
+static IoLooper *iohandler_looper;
+
+/* Descriptors to remove from iohandler_looper, see
+   qemu_iohandler_forget_fd(). */
+static int *forgotten_fds;
+static int nb_forgotten_fds;
+static int max_forgotten_fds;
+
 
 /* XXX: fd_read_poll should be suppressed, but an API change is
    necessary in the character devices to suppress fd_can_read(). */
@@ -59,6 +69,8 @@ int qemu_set_fd_handler2(int fd,
         QLIST_FOREACH(ioh, &io_handlers, next) {
             if (ioh->fd == fd) {
                 ioh->deleted = 1;
+                /* The descriptor is usually closed right after this. */
+                qemu_iohandler_forget_fd(fd);
                 break;
             }
         }
@@ -132,6 +144,77 @@ void qemu_iohandler_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds, int re
     }
 }
 
+void qemu_iohandler_forget_fd(int fd)
+{
+    if (!iohandler_looper || fd < 0) {
+        return;
+    }
+    if (nb_forgotten_fds == max_forgotten_fds) {
+        max_forgotten_fds = max_forgotten_fds ? 2 * max_forgotten_fds : 16;
+        forgotten_fds = g_realloc(forgotten_fds,
+                                  max_forgotten_fds * sizeof(int));
+    }
+    forgotten_fds[nb_forgotten_fds++] = fd;
+}
+
+void qemu_iohandler_looper_fill(IoLooper *looper)
+{
+    IOHandlerRecord *pioh, *ioh;
+    int i;
+
+    iohandler_looper = looper;
+
+    /* Do this first, in case a forgotten descriptor was reused. */
+    for (i = 0; i < nb_forgotten_fds; i++) {
+        iolooper_set(looper, forgotten_fds[i], 0);
+    }
+    nb_forgotten_fds = 0;
+
+    QLIST_FOREACH_SAFE(ioh, &io_handlers, next, pioh) {
+        int flags = 0;
+
+        /* The looper was updated by qemu_iohandler_forget_fd(). */
+        if (ioh->deleted) {
+            QLIST_REMOVE(ioh, next);
+            g_free(ioh);
+            continue;
+        }
+        if (ioh->fd_read &&
+            (!ioh->fd_read_poll ||
+             ioh->fd_read_poll(ioh->opaque) != 0)) {
+            flags |= IOLOOPER_READ;
+        }
+        if (ioh->fd_write) {
+            flags |= IOLOOPER_WRITE;
+        }
+        iolooper_set(looper, ioh->fd, flags);
+    }
+}
+
+void qemu_iohandler_looper_poll(IoLooper *looper, int ret)
+{
+    if (ret > 0) {
+        IOHandlerRecord *pioh, *ioh;
+
+        QLIST_FOREACH_SAFE(ioh, &io_handlers, next, pioh) {
+            if (!ioh->deleted && ioh->fd_read &&
+                iolooper_is_read(looper, ioh->fd)) {
+                ioh->fd_read(ioh->opaque);
+            }
+            if (!ioh->deleted && ioh->fd_write &&
+                iolooper_is_write(looper, ioh->fd)) {
+                ioh->fd_write(ioh->opaque);
+            }
+
+            /* Do this last in case read/write handlers marked it for deletion */
+            if (ioh->deleted) {
+                QLIST_REMOVE(ioh, next);
+                g_free(ioh);
+            }
+        }
+    }
+}
+
 /* reaping of zombies.  right now we're not passing the status to
    anyone, but it would be possible to add a callback.  */
 #ifndef _WIN32
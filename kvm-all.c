@@ -278,6 +278,40 @@ int kvm_log_stop(hwaddr phys_addr, ram_addr_t size)
                                           KVM_MEM_LOG_DIRTY_PAGES);
 }
 
+/* KVM only logs the dirty pages of whole slots, so the range doesn't need
+ * to match one: logging is changed for all the slots that overlap it. */
+static int kvm_dirty_pages_log_change_range(hwaddr phys_addr,
+                                            ram_addr_t size, int flags)
+{
+    KVMState *s = kvm_state;
+    hwaddr end_addr = phys_addr + size;
+    int ret = -EINVAL;
+
+    while (phys_addr < end_addr) {
+        KVMSlot *mem = kvm_lookup_overlapping_slot(s, phys_addr,
+                                                   end_addr - phys_addr);
+        if (mem == NULL) {
+            break;
+        }
+        ret = kvm_dirty_pages_log_change(mem->start_addr, mem->memory_size,
+                                         flags, KVM_MEM_LOG_DIRTY_PAGES);
+        if (ret) {
+            break;
+        }
+        phys_addr = mem->start_addr + mem->memory_size;
+        if (!phys_addr) {
+            break;
+        }
+    }
+    return ret;
+}
+
+int kvm_log_start_range(hwaddr phys_addr, ram_addr_t size)
+{
+    return kvm_dirty_pages_log_change_range(phys_addr, size,
+                                            KVM_MEM_LOG_DIRTY_PAGES);
+}
+
 int kvm_set_migration_log(int enable)
 {
     KVMState *s = kvm_state;
@@ -583,10 +617,12 @@ static void kvm_run_coalesced_mmio(CPUState *cpu, struct kvm_run *run)
         while (ring->first != ring->last) {
             struct kvm_coalesced_mmio *ent;
 
+            /* The ring is shared by the vCPUs that run in the guest. */
+            smp_rmb();
             ent = &ring->coalesced_mmio[ring->first];
 
             cpu_physical_memory_write(ent->phys_addr, ent->data, ent->len);
-            /* FIXME smp_wmb() */
+            smp_mb();
             ring->first = (ring->first + 1) % KVM_COALESCED_MMIO_MAX;
         }
     }
@@ -609,9 +645,16 @@ int kvm_cpu_exec(CPUState *cpu)
         }
 
         kvm_arch_pre_run(cpu, run);
+        /* Let the other vCPUs and the main loop run while in the guest. */
+        qemu_mutex_unlock_iothread();
         ret = kvm_arch_vcpu_run(cpu);
+        qemu_mutex_lock_iothread();
         kvm_arch_post_run(cpu, run);
 
+        /* Replay the coalesced writes even when the run was interrupted,
+           so device state is current while the vCPU is out of the guest. */
+        kvm_run_coalesced_mmio(cpu, run);
+
         if (ret == -EINTR || ret == -EAGAIN) {
             dprintf("io window exit\n");
             ret = 0;
@@ -623,8 +666,6 @@ int kvm_cpu_exec(CPUState *cpu)
             abort();
         }
 
-        kvm_run_coalesced_mmio(cpu, run);
-
         ret = 0; /* exit loop */
         switch (run->exit_reason) {
         case KVM_EXIT_IO:
@@ -876,6 +917,22 @@ int kvm_vcpu_ioctl(CPUState *cpu, int type, ...)
     return ret;
 }
 
+int kvm_set_signal_mask(CPUState *cpu, const sigset_t *sigset)
+{
+    struct kvm_signal_mask *sigmask;
+    int r;
+
+    sigmask = g_malloc(sizeof(*sigmask) + sizeof(*sigset));
+
+    /* The kernel's sigset_t is 8 bytes, not the size of the libc one. */
+    sigmask->len = 8;
+    memcpy(sigmask->sigset, sigset, sizeof(*sigset));
+    r = kvm_vcpu_ioctl(cpu, KVM_SET_SIGNAL_MASK, sigmask);
+    g_free(sigmask);
+
+    return r;
+}
+
 int kvm_has_sync_mmu(void)
 {
 #ifdef KVM_CAP_SYNC_MMU
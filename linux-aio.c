@@ -0,0 +1,387 @@
+/*
+ * Linux native AIO support.
+ *
+ * Copyright (C) 2009 IBM, Corp.
+ * Copyright (C) 2009 Red Hat, Inc.
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu-common.h"
+#include "qemu/queue.h"
+#include "block/block_int.h"
+#include "block/raw-posix-aio.h"
+
+#include <linux/aio_abi.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+/*
+ * The prebuilt toolchains don't ship libaio, so the kernel interface is
+ * used directly through syscall().
+ *
+ * Requests are not handed to the kernel one by one. laio_submit() only
+ * prepares their iocb and queues it, and a bottom half submits the whole
+ * queue with a single io_submit() once the caller is done issuing
+ * requests. Completions are signalled through an eventfd that is polled
+ * by the main loop.
+ */
+
+/* Maximum number of requests in flight for an image. */
+#define MAX_EVENTS 128
+
+/* Maximum number of requests that are submitted by a single io_submit(). */
+#define MAX_BATCH  32
+
+struct qemu_laiocb {
+    BlockDriverAIOCB common;
+    struct qemu_laio_state *ctx;
+    struct iocb iocb;
+    ssize_t ret;
+    size_t nbytes;
+    int async_context_id;
+    QLIST_ENTRY(qemu_laiocb) node;
+};
+
+struct qemu_laio_state {
+    aio_context_t ctx;
+    int efd;
+    int count;          /* requests in flight, including pending ones */
+    int pending_count;  /* requests not submitted to the kernel yet */
+    int submitting;     /* set while qemu_laio_submit_pending() runs */
+    QEMUBH *submit_bh;
+    struct iocb *pending[MAX_EVENTS];
+    QLIST_HEAD(, qemu_laiocb) completed_reqs;
+};
+
+static int io_setup(unsigned nr_events, aio_context_t *ctxp)
+{
+    return syscall(__NR_io_setup, nr_events, ctxp);
+}
+
+static int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+    return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static int io_getevents(aio_context_t ctx, long min_nr, long nr,
+                        struct io_event *events, struct timespec *timeout)
+{
+    return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+static int io_cancel(aio_context_t ctx, struct iocb *iocb,
+                     struct io_event *result)
+{
+    return syscall(__NR_io_cancel, ctx, iocb, result);
+}
+
+static inline ssize_t io_event_ret(struct io_event *ev)
+{
+    return (ssize_t)(((uint64_t)ev->res2 << 32) | ev->res);
+}
+
+/*
+ * Completes an AIO request (calls the callback and frees the ACB).
+ */
+static void qemu_laio_process_completion(struct qemu_laio_state *s,
+    struct qemu_laiocb *laiocb)
+{
+    int ret;
+
+    s->count--;
+
+    ret = laiocb->ret;
+    if (ret != -ECANCELED) {
+        if (ret == laiocb->nbytes)
+            ret = 0;
+        else if (ret >= 0)
+            ret = -EINVAL;
+
+        laiocb->common.cb(laiocb->common.opaque, ret);
+    }
+
+    qemu_aio_release(laiocb);
+}
+
+/*
+ * Processes all queued AIO requests, i.e. requests that have return from OS
+ * but their callback was not called yet. Requests that cannot have their
+ * callback called in the current async context remain in the queue.
+ *
+ * Returns 1 if at least one request could be completed, 0 otherwise.
+ */
+static int qemu_laio_process_requests(void *opaque)
+{
+    struct qemu_laio_state *s = opaque;
+    struct qemu_laiocb *laiocb, *next;
+    int res = 0;
+
+    QLIST_FOREACH_SAFE (laiocb, &s->completed_reqs, node, next) {
+        if (laiocb->async_context_id == get_async_context_id()) {
+            QLIST_REMOVE(laiocb, node);
+            qemu_laio_process_completion(s, laiocb);
+            res = 1;
+        }
+    }
+
+    return res;
+}
+
+/*
+ * Puts a request in the completion queue so that its callback is called the
+ * next time when it's possible. If we already are in the right AIO context,
+ * the callback is called immediately.
+ */
+static void qemu_laio_enqueue_completed(struct qemu_laio_state *s,
+    struct qemu_laiocb* laiocb)
+{
+    if (laiocb->async_context_id == get_async_context_id()) {
+        qemu_laio_process_completion(s, laiocb);
+    } else {
+        QLIST_INSERT_HEAD(&s->completed_reqs, laiocb, node);
+    }
+}
+
+/*
+ * Hands all the queued iocbs to the kernel. Requests that the kernel refuses
+ * are completed with the error it returned.
+ */
+static void qemu_laio_submit_pending(struct qemu_laio_state *s)
+{
+    int done = 0;
+
+    /* Failed requests run their callback, which may issue new requests. */
+    if (s->submitting) {
+        return;
+    }
+    s->submitting = 1;
+
+    while (done < s->pending_count) {
+        int n = s->pending_count - done;
+        int ret;
+
+        if (n > MAX_BATCH) {
+            n = MAX_BATCH;
+        }
+        ret = io_submit(s->ctx, n, &s->pending[done]);
+        if (ret < 0 && errno == EAGAIN &&
+            s->count > s->pending_count - done) {
+            /* The kernel queue is full, the remaining requests are
+             * submitted when the ones in flight complete. */
+            break;
+        }
+        if (ret <= 0) {
+            /* Fail the first request, and retry the others. */
+            struct qemu_laiocb *laiocb =
+                container_of(s->pending[done], struct qemu_laiocb, iocb);
+            laiocb->ret = ret < 0 ? -errno : -EIO;
+            qemu_laio_enqueue_completed(s, laiocb);
+            ret = 1;
+        }
+        done += ret;
+    }
+
+    s->pending_count -= done;
+    if (s->pending_count) {
+        memmove(s->pending, &s->pending[done],
+                s->pending_count * sizeof(s->pending[0]));
+    }
+    s->submitting = 0;
+}
+
+static void qemu_laio_submit_bh(void *opaque)
+{
+    qemu_laio_submit_pending(opaque);
+}
+
+static void qemu_laio_completion_cb(void *opaque)
+{
+    struct qemu_laio_state *s = opaque;
+
+    while (1) {
+        struct io_event events[MAX_EVENTS];
+        struct timespec ts = { 0 };
+        uint64_t val;
+        ssize_t ret;
+        int nevents, i;
+
+        do {
+            ret = read(s->efd, &val, sizeof(val));
+        } while (ret == -1 && errno == EINTR);
+
+        if (ret == -1 && errno == EAGAIN)
+            break;
+
+        if (ret != 8)
+            break;
+
+        do {
+            nevents = io_getevents(s->ctx, val, MAX_EVENTS, events, &ts);
+        } while (nevents == -1 && errno == EINTR);
+
+        for (i = 0; i < nevents; i++) {
+            struct iocb *iocb = (struct iocb *)(uintptr_t)events[i].obj;
+            struct qemu_laiocb *laiocb =
+                    container_of(iocb, struct qemu_laiocb, iocb);
+
+            laiocb->ret = io_event_ret(&events[i]);
+            qemu_laio_enqueue_completed(s, laiocb);
+        }
+    }
+
+    /* Completions free slots in the kernel queue. */
+    if (s->pending_count) {
+        qemu_laio_submit_pending(s);
+    }
+}
+
+static int qemu_laio_flush_cb(void *opaque)
+{
+    struct qemu_laio_state *s = opaque;
+
+    /* qemu_aio_wait() doesn't run the bottom halves of outer contexts,
+     * so make sure that it has something to wait for. */
+    if (s->pending_count) {
+        qemu_laio_submit_pending(s);
+    }
+
+    return (s->count > 0) ? 1 : 0;
+}
+
+static void laio_cancel(BlockDriverAIOCB *blockacb)
+{
+    struct qemu_laiocb *laiocb = (struct qemu_laiocb *)blockacb;
+    struct qemu_laio_state *s = laiocb->ctx;
+    struct io_event event;
+    int i, ret;
+
+    if (laiocb->ret != -EINPROGRESS)
+        return;
+
+    /* A request that is still queued has not reached the kernel yet. */
+    for (i = 0; i < s->pending_count; i++) {
+        if (s->pending[i] == &laiocb->iocb) {
+            memmove(&s->pending[i], &s->pending[i + 1],
+                    (s->pending_count - i - 1) * sizeof(s->pending[0]));
+            s->pending_count--;
+            laiocb->ret = -ECANCELED;
+            qemu_laio_process_completion(s, laiocb);
+            return;
+        }
+    }
+
+    /*
+     * Note that as of Linux 2.6.31 neither the block device code nor any
+     * filesystem implements cancellation of AIO request.
+     * Thus the polling loop below is the normal code path.
+     */
+    ret = io_cancel(s->ctx, &laiocb->iocb, &event);
+    if (ret == 0) {
+        laiocb->ret = -ECANCELED;
+        qemu_laio_process_completion(s, laiocb);
+        return;
+    }
+
+    /*
+     * We have to wait for the iocb to finish.
+     *
+     * The only way to get the iocb status update is by polling the io context.
+     * We might be able to do this slightly more optimal by removing the
+     * O_NONBLOCK flag.
+     */
+    while (laiocb->ret == -EINPROGRESS)
+        qemu_laio_completion_cb(s);
+}
+
+static AIOPool laio_pool = {
+    .aiocb_size         = sizeof(struct qemu_laiocb),
+    .cancel             = laio_cancel,
+};
+
+BlockDriverAIOCB *laio_submit(BlockDriverState *bs, void *aio_ctx, int fd,
+        int64_t sector_num, QEMUIOVector *qiov, int nb_sectors,
+        BlockDriverCompletionFunc *cb, void *opaque, int type)
+{
+    struct qemu_laio_state *s = aio_ctx;
+    struct qemu_laiocb *laiocb;
+    struct iocb *iocbs;
+    off_t offset = sector_num * 512;
+
+    if (s->count >= MAX_EVENTS)
+        return NULL;
+
+    laiocb = qemu_aio_get(&laio_pool, bs, cb, opaque);
+    if (!laiocb)
+        return NULL;
+    laiocb->nbytes = nb_sectors * 512;
+    laiocb->ctx = s;
+    laiocb->ret = -EINPROGRESS;
+    laiocb->async_context_id = get_async_context_id();
+
+    iocbs = &laiocb->iocb;
+    memset(iocbs, 0, sizeof(*iocbs));
+    switch (type) {
+    case QEMU_AIO_WRITE:
+        iocbs->aio_lio_opcode = IOCB_CMD_PWRITEV;
+        break;
+    case QEMU_AIO_READ:
+        iocbs->aio_lio_opcode = IOCB_CMD_PREADV;
+        break;
+    default:
+        fprintf(stderr, "%s: invalid AIO request type 0x%x.\n",
+                        __func__, type);
+        goto out_free_aiocb;
+    }
+    iocbs->aio_fildes = fd;
+    iocbs->aio_buf = (uintptr_t)qiov->iov;
+    iocbs->aio_nbytes = qiov->niov;
+    iocbs->aio_offset = offset;
+    iocbs->aio_flags = IOCB_FLAG_RESFD;
+    iocbs->aio_resfd = s->efd;
+
+    s->count++;
+    s->pending[s->pending_count++] = iocbs;
+
+    /* Requests issued from a nested async context are waited for right away
+     * with qemu_aio_wait(), don't delay them. */
+    if (s->pending_count >= MAX_BATCH || get_async_context_id() != 0) {
+        qemu_laio_submit_pending(s);
+    } else {
+        qemu_bh_schedule(s->submit_bh);
+    }
+    return &laiocb->common;
+
+out_free_aiocb:
+    qemu_aio_release(laiocb);
+    return NULL;
+}
+
+void *laio_init(void)
+{
+    struct qemu_laio_state *s;
+
+    s = g_malloc0(sizeof(*s));
+    QLIST_INIT(&s->completed_reqs);
+    s->efd = eventfd(0, 0);
+    if (s->efd == -1)
+        goto out_free_state;
+    fcntl(s->efd, F_SETFL, O_NONBLOCK);
+
+    if (io_setup(MAX_EVENTS, &s->ctx) != 0)
+        goto out_close_efd;
+
+    s->submit_bh = qemu_bh_new(qemu_laio_submit_bh, s);
+
+    qemu_aio_set_fd_handler(s->efd, qemu_laio_completion_cb, NULL,
+        qemu_laio_flush_cb, qemu_laio_process_requests, s);
+
+    return s;
+
+out_close_efd:
+    close(s->efd);
+out_free_state:
+    g_free(s);
+    return NULL;
+}
@@ -11,6 +11,7 @@
 
 #include "android/log-rotate.h"
 #include "net/net.h"
+#include "qemu/log.h"
 #include "slirp-android/libslirp.h"
 #include "sysemu/sysemu.h"
 
@@ -87,6 +88,9 @@ void qemu_log_rotation_poll(void) {
                                        drop_log_filename);
     slirp_dns_log_fd(new_dns_log_fd);
     slirp_drop_log_fd(new_drop_log_fd);
+
+    // This also writes the messages still queued for the old file.
+    qemu_log_rotate();
     rotate_logs_requested = 0;
 }
 
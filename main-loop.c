@@ -22,7 +22,7 @@
  * THE SOFTWARE.
  */
 
-#include "android/charpipe.h"
+#include "android/iolooper.h"
 #include "android/log-rotate.h"
 #include "android/snaphost-android.h"
 #include "block/aio.h"
@@ -100,6 +100,23 @@ fail:
     close(fds[1]);
     return err;
 }
+
+/* Wake up main_loop_wait(). This can be called from any thread, or from
+   a signal handler. */
+void qemu_event_increment(void)
+{
+    static const char byte = 0;
+    ssize_t ret;
+
+    if (io_thread_fd == -1) {
+        return;
+    }
+    do {
+        ret = write(io_thread_fd, &byte, sizeof(byte));
+    } while (ret < 0 && errno == EINTR);
+    /* EAGAIN means that the pipe is full, so main_loop_wait() will
+       wake up anyway. */
+}
 #else
 HANDLE qemu_event_handle;
 
@@ -117,10 +134,18 @@ static int qemu_main_loop_event_init(void)
     qemu_add_wait_object(qemu_event_handle, dummy_event_handler, NULL);
     return 0;
 }
+
+void qemu_event_increment(void)
+{
+    if (qemu_event_handle) {
+        SetEvent(qemu_event_handle);
+    }
+}
 #endif
 
 int qemu_init_main_loop(void)
 {
+    qemu_cpu_idle_init();
     return qemu_main_loop_event_init();
 }
 
@@ -259,6 +284,47 @@ void os_host_main_loop_wait(int *timeout)
 
 static void qemu_run_alarm_timer(void);  // forward
 
+#ifndef _WIN32
+/* Descriptors stay registered with the IoLooper between iterations, so
+   its epoll or kqueue backend only sees the ones that changed. */
+static IoLooper *main_loop_looper;
+
+void main_loop_wait(int timeout)
+{
+    int ret;
+
+    qemu_bh_update_timeout(&timeout);
+
+    os_host_main_loop_wait(&timeout);
+
+    if (!main_loop_looper) {
+        main_loop_looper = iolooper_new();
+    }
+
+    /* poll any events */
+    qemu_iohandler_looper_fill(main_loop_looper);
+    if (slirp_is_inited()) {
+        slirp_looper_fill(main_loop_looper);
+    }
+
+    qemu_mutex_unlock_iothread();
+    ret = iolooper_wait(main_loop_looper, timeout);
+    qemu_mutex_lock_iothread();
+    qemu_iohandler_looper_poll(main_loop_looper, ret);
+    if (slirp_is_inited()) {
+        slirp_looper_poll(main_loop_looper);
+    }
+
+    qemu_clock_run_all_timers();
+
+    qemu_run_alarm_timer();
+
+    /* Check bottom-halves last in case any of the earlier events triggered
+       them.  */
+    qemu_bh_poll();
+
+}
+#else
 void main_loop_wait(int timeout)
 {
     fd_set rfds, wfds, xfds;
@@ -296,7 +362,6 @@ void main_loop_wait(int timeout)
         }
         slirp_select_poll(&rfds, &wfds, &xfds);
     }
-    charpipe_poll();
 
     qemu_clock_run_all_timers();
 
@@ -307,6 +372,7 @@ void main_loop_wait(int timeout)
     qemu_bh_poll();
 
 }
+#endif  /* _WIN32 */
 
 void main_loop(void)
 {
@@ -319,14 +385,27 @@ void main_loop(void)
 
     for (;;) {
         do {
+            int timeout;
 #ifdef CONFIG_PROFILER
             int64_t ti;
 #endif
-            tcg_cpu_exec();
+            /* With an I/O thread, the vCPUs run in their own thread. */
+            if (!qemu_iothread_enabled()) {
+                tcg_cpu_exec();
+            }
 #ifdef CONFIG_PROFILER
             ti = profile_getclock();
 #endif
-            main_loop_wait(qemu_calculate_timeout());
+            timeout = qemu_calculate_timeout();
+            /* A non-zero timeout means all vCPUs are halted: the wait below
+               sleeps until the next timer deadline or I/O event. */
+            if (!qemu_iothread_enabled() && vm_running && timeout > 0) {
+                qemu_cpu_idle_enter();
+                main_loop_wait(timeout);
+                qemu_cpu_idle_leave();
+            } else {
+                main_loop_wait(timeout);
+            }
 #ifdef CONFIG_PROFILER
             dev_time += profile_getclock() - ti;
 #endif
@@ -342,7 +421,9 @@ void main_loop(void)
                 vm_stop(0);
                 no_shutdown = 0;
             } else {
-                if (savevm_on_exit != NULL) {
+                /* With -fast-exit, the snapshot is saved once the window
+                 * is hidden, see android_fast_exit() */
+                if (savevm_on_exit != NULL && !fast_exit) {
                   /* Prior to saving VM to the snapshot file, save HW config
                    * settings for that VM, so we can match them when VM gets
                    * loaded from the snapshot. */
@@ -992,7 +1073,7 @@ int qemu_calculate_timeout(void)
 
     if (!vm_running)
         timeout = 5000;
-    else if (tcg_has_work())
+    else if (!qemu_iothread_enabled() && tcg_has_work())
         timeout = 0;
     else {
 #ifdef WIN32
@@ -1012,6 +1093,11 @@ int qemu_calculate_timeout(void)
         int64_t timeout_ns = (int64_t)timeout * 1000000LL;
         timeout_ns = qemu_soonest_timeout(
                 timeout_ns, timerlistgroup_deadline_ns(&main_loop_tlg));
+        if (!qemu_iothread_enabled()) {
+            /* Wake up when a vCPU paused by the QoS limits can run. */
+            timeout_ns = qemu_soonest_timeout(
+                    timeout_ns, qemu_cpu_throttle_deadline_ns());
+        }
         timeout = (int)((timeout_ns + 999999LL) / 1000000LL);
     }
 
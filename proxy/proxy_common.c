@@ -9,6 +9,7 @@
 ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 ** GNU General Public License for more details.
 */
+#include "qemu-common.h"
 #include "proxy_int.h"
 #include "android/sockets.h"
 #include <stdarg.h>
@@ -97,6 +98,7 @@ proxy_connection_done( ProxyConnection*  conn )
 {
     stralloc_reset( conn->str );
     if (conn->socket >= 0) {
+        proxy_select_forget(conn->socket);
         socket_close(conn->socket);
         conn->socket = -1;
     }
@@ -193,14 +195,27 @@ proxy_connection_receive( ProxyConnection*  conn, int  fd, int  wanted )
 }
 
 
+/* maximum number of bytes looked at by each proxy_connection_receive_line()
+ * iteration */
+#define  MAX_LINE_PEEK  512
+
 DataStatus
 proxy_connection_receive_line( ProxyConnection*  conn, int  fd )
 {
     stralloc_t*  str = conn->str;
 
     for (;;) {
-        char  c;
-        int   n = socket_recv(fd, &c, 1);
+        char*  base;
+        char*  eol;
+        int    len;
+        int    n;
+
+        /* peek at the available data to consume the line in one call,
+         * without taking the bytes that follow it, which may belong to
+         * the message body or to a tunnel. */
+        stralloc_readyplus(str, MAX_LINE_PEEK);
+        base = str->s + str->n;
+        n    = socket_recv_peek(fd, base, MAX_LINE_PEEK);
         if (n == 0) {
             PROXY_LOG("%s: disconnected from server", conn->name );
             return DATA_ERROR;
@@ -214,8 +229,17 @@ proxy_connection_receive_line( ProxyConnection*  conn, int  fd )
             return DATA_ERROR;
         }
 
-        stralloc_add_c(str, c);
-        if (c == '\n') {
+        eol = memchr(base, '\n', n);
+        len = eol ? (eol - base) + 1 : n;
+
+        n = socket_recv(fd, base, len);
+        if (n <= 0) {
+            PROXY_LOG("%s: error: %s", conn->name, n ? errno_str : "EOF");
+            return DATA_ERROR;
+        }
+        str->n += n;
+
+        if (eol && n == len) {
             str->s[--str->n] = 0;
             if (str->n > 0 && str->s[str->n-1] == '\r')
                 str->s[--str->n] = 0;
@@ -370,6 +394,68 @@ proxy_manager_del( void*  ev_opaque )
     }
 }
 
+/* with an IoLooper, the descriptors watched during the previous
+ * proxy_manager_looper_fill(), so the ones that aren't selected anymore
+ * can be removed from it */
+typedef struct {
+    int       fd;
+    unsigned  flags;
+    int       seen;
+} ProxyWatch;
+
+static IoLooper*    s_looper;
+static ProxyWatch*  s_watches;
+static int          s_watch_count;
+static int          s_watch_max;
+
+static int
+proxy_looper_flags( unsigned  flags )
+{
+    int  result = 0;
+    if (flags & PROXY_SELECT_READ)
+        result |= IOLOOPER_READ;
+    if (flags & PROXY_SELECT_WRITE)
+        result |= IOLOOPER_WRITE;
+    return result;
+}
+
+static void
+proxy_looper_set( IoLooper*  looper, int  fd, unsigned  flags )
+{
+    int  nn;
+
+    for (nn = 0; nn < s_watch_count; nn++) {
+        if (s_watches[nn].fd == fd)
+            break;
+    }
+    if (nn == s_watch_count) {
+        if (s_watch_count == s_watch_max) {
+            s_watch_max = s_watch_max ? 2*s_watch_max : 8;
+            AARRAY_RENEW(s_watches, s_watch_max);
+        }
+        s_watches[s_watch_count++].fd = fd;
+    }
+    s_watches[nn].flags = flags;
+    s_watches[nn].seen  = 1;
+    iolooper_set(looper, fd, proxy_looper_flags(flags));
+}
+
+/* call this before closing a socket that may be watched by the IoLooper */
+void
+proxy_select_forget( int  fd )
+{
+    int  nn;
+
+    for (nn = 0; nn < s_watch_count; nn++) {
+        if (s_watches[nn].fd == fd) {
+            s_watches[nn] = s_watches[--s_watch_count];
+            break;
+        }
+    }
+    if (s_looper)
+        qemu_iohandler_forget_fd(fd);
+}
+
 void
 proxy_select_set( ProxySelect*  sel,
                   int           fd,
@@ -378,6 +464,11 @@ proxy_select_set( ProxySelect*  sel,
     if (fd < 0 || !flags)
         return;
 
+    if (sel->looper) {
+        proxy_looper_set(sel->looper, fd, flags);
+        return;
+    }
+
     if (*sel->pcount < fd+1)
         *sel->pcount = fd+1;
 
@@ -403,7 +494,12 @@ proxy_select_poll( ProxySelect*  sel, int  fd )
 {
     unsigned  flags = 0;
 
-    if (fd >= 0) {
+    if (fd >= 0 && sel->looper) {
+        if ( iolooper_is_read(sel->looper, fd) )
+            flags |= PROXY_SELECT_READ;
+        if ( iolooper_is_write(sel->looper, fd) )
+            flags |= PROXY_SELECT_WRITE;
+    } else if (fd >= 0) {
         if ( FD_ISSET(fd, sel->reads) )
             flags |= PROXY_SELECT_READ;
         if ( FD_ISSET(fd, sel->writes) )
@@ -429,6 +525,7 @@ proxy_manager_select_fill( int  *pcount, fd_set*  read_fds, fd_set*  write_fds,
     sel->reads  = read_fds;
     sel->writes = write_fds;
     sel->errors = err_fds;
+    sel->looper = NULL;
 
     conn = s_connections->next;
     while (conn != s_connections) {
@@ -449,6 +546,65 @@ proxy_manager_poll( fd_set*  read_fds, fd_set*  write_fds, fd_set*  err_fds )
     sel->reads  = read_fds;
     sel->writes = write_fds;
     sel->errors = err_fds;
+    sel->looper = NULL;
+
+    while (conn != s_connections) {
+        ProxyConnection*  next  = conn->next;
+        conn->conn_poll( conn, sel );
+        conn = next;
+    }
+}
+
+void
+proxy_manager_looper_fill( IoLooper*  looper )
+{
+    ProxyConnection*  conn;
+    ProxySelect       sel[1];
+    int               nn;
+
+    if (!s_init)
+        proxy_manager_init();
+
+    s_looper = looper;
+
+    sel->pcount = NULL;
+    sel->reads  = NULL;
+    sel->writes = NULL;
+    sel->errors = NULL;
+    sel->looper = looper;
+
+    for (nn = 0; nn < s_watch_count; nn++)
+        s_watches[nn].seen = 0;
+
+    conn = s_connections->next;
+    while (conn != s_connections) {
+        ProxyConnection*  next = conn->next;
+        conn->conn_select(conn, sel);
+        conn = next;
+    }
+
+    /* stop watching the sockets that weren't selected this time */
+    for (nn = 0; nn < s_watch_count; ) {
+        if (!s_watches[nn].seen) {
+            iolooper_set(looper, s_watches[nn].fd, 0);
+            s_watches[nn] = s_watches[--s_watch_count];
+        } else {
+            nn++;
+        }
+    }
+}
+
+void
+proxy_manager_looper_poll( IoLooper*  looper )
+{
+    ProxyConnection*  conn = s_connections->next;
+    ProxySelect       sel[1];
+
+    sel->pcount = NULL;
+    sel->reads  = NULL;
+    sel->writes = NULL;
+    sel->errors = NULL;
+    sel->looper = looper;
 
     while (conn != s_connections) {
         ProxyConnection*  next  = conn->next;
@@ -12,6 +12,7 @@
 #ifndef _PROXY_COMMON_H_
 #define _PROXY_COMMON_H_
 
+#include "android/iolooper.h"
 #include "android/sockets.h"
 
 #ifdef _WIN32
@@ -85,6 +86,11 @@ extern void  proxy_manager_poll( fd_set*  read_fds,
                                  fd_set*  write_fds,
                                  fd_set*  err_fds );
 
+/* same as proxy_manager_select_fill() and proxy_manager_poll(), but the
+ * sockets stay registered with |looper| between calls */
+extern void  proxy_manager_looper_fill( IoLooper*  looper );
+extern void  proxy_manager_looper_poll( IoLooper*  looper );
+
 /* this function checks that one can connect to a given proxy. It will simply try to connect()
  * to it, for a specified timeout, in milliseconds, then close the connection.
  *
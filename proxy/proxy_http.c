@@ -12,16 +12,81 @@
 #include "proxy_int.h"
 #include "proxy_http_int.h"
 #include "qemu-common.h"
+#include "qemu/timer.h"
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
 
 #define  HTTP_VERSION  "1.1"
 
+static void
+http_service_close_idle( HttpService*  service, int  index )
+{
+    PROXY_LOG("%s: closing idle proxy connection (%d)",
+              __FUNCTION__, service->idle[index].socket);
+    socket_close(service->idle[index].socket);
+    service->num_idle--;
+    memmove(service->idle + index, service->idle + index + 1,
+            (service->num_idle - index) * sizeof(service->idle[0]));
+}
+
+/* close the idle connections that were kept for too long */
+static void
+http_service_expire_idle( HttpService*  service )
+{
+    int64_t  now = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+
+    /* the oldest connections are at the start of the array */
+    while (service->num_idle > 0 &&
+           now - service->idle[0].since >= HTTP_IDLE_TIMEOUT_MS) {
+        http_service_close_idle(service, 0);
+    }
+}
+
+int
+http_service_get_idle( HttpService*  service )
+{
+    http_service_expire_idle(service);
+
+    while (service->num_idle > 0) {
+        int   index = service->num_idle - 1;
+        int   fd    = service->idle[index].socket;
+        char  c;
+
+        /* an idle connection is only readable if the proxy closed it */
+        if (socket_recv(fd, &c, 1) < 0 &&
+            (errno == EWOULDBLOCK || errno == EAGAIN)) {
+            PROXY_LOG("%s: reusing proxy connection (%d)", __FUNCTION__, fd);
+            service->num_idle--;
+            return fd;
+        }
+        http_service_close_idle(service, index);
+    }
+    return -1;
+}
+
+void
+http_service_put_idle( HttpService*  service, int  socket )
+{
+    HttpIdleConnection*  idle;
+
+    http_service_expire_idle(service);
+
+    if (service->num_idle == HTTP_MAX_IDLE_CONNECTIONS)
+        http_service_close_idle(service, 0);
+
+    PROXY_LOG("%s: keeping proxy connection (%d)", __FUNCTION__, socket);
+    idle         = service->idle + service->num_idle++;
+    idle->socket = socket;
+    idle->since  = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+}
+
 static void
 http_service_free( HttpService*  service )
 {
     PROXY_LOG("%s", __FUNCTION__);
+    while (service->num_idle > 0)
+        http_service_close_idle(service, service->num_idle - 1);
     if (service->footer != service->footer0)
         g_free(service->footer);
     g_free(service);
@@ -49,7 +114,7 @@ http_service_connect( HttpService*  service,
         PROXY_LOG("%s: using HTTP rewriter", __FUNCTION__);
         return http_rewriter_connect(service, address);
     } else {
-        PROXY_LOG("%s: using HTTP rewriter", __FUNCTION__);
+        PROXY_LOG("%s: using HTTP connector", __FUNCTION__);
         return http_connector_connect(service, address);
     }
 }
@@ -32,6 +32,7 @@ typedef enum {
 typedef struct Connection {
     ProxyConnection  root[1];
     ConnectorState   state;
+    char             reused;   /* socket comes from the idle connections */
 } Connection;
 
 
@@ -46,8 +47,8 @@ connection_free( ProxyConnection*  root )
 
 #define  HTTP_VERSION  "1.1"
 
-static int
-connection_init( Connection*  conn )
+static void
+connection_format_header( Connection*  conn )
 {
     HttpService*      service = (HttpService*) conn->root->service;
     ProxyConnection*  root    = conn->root;
@@ -58,6 +59,14 @@ connection_init( Connection*  conn )
                         sock_address_to_string(&root->address));
 
     stralloc_add_bytes(str, service->footer, service->footer_len);
+}
+
+/* connect the socket to the proxy server */
+static int
+connection_connect( Connection*  conn )
+{
+    HttpService*      service = (HttpService*) conn->root->service;
+    ProxyConnection*  root    = conn->root;
 
     if (!socket_connect( root->socket, &service->server_addr )) {
         /* immediate connection ?? */
@@ -77,6 +86,44 @@ connection_init( Connection*  conn )
     return 0;
 }
 
+/* the proxy closed an idle connection before answering our request,
+ * send it again on a new connection */
+static int
+connection_retry( Connection*  conn )
+{
+    ProxyConnection*  root = conn->root;
+
+    PROXY_LOG("%s: idle proxy connection was closed, retrying", root->name);
+    proxy_select_forget(root->socket);
+    socket_close(root->socket);
+    conn->reused = 0;
+
+    root->socket = socket_create_inet( SOCKET_STREAM );
+    if (root->socket < 0)
+        return -1;
+    socket_set_nonblock(root->socket);
+
+    connection_format_header(conn);
+    return connection_connect(conn);
+}
+
+static int
+connection_init( Connection*  conn )
+{
+    connection_format_header(conn);
+
+    if (conn->reused) {
+        /* already connected, and the request can be sent right away */
+        conn->state = STATE_SEND_HEADER;
+        if (proxy_connection_send(conn->root, conn->root->socket) == DATA_ERROR)
+            return connection_retry(conn);
+        if (conn->root->str->n == 0)
+            conn->state = STATE_RECEIVE_ANSWER_LINE1;
+        return 0;
+    }
+    return connection_connect(conn);
+}
+
 
 static void
 connection_select( ProxyConnection*   root,
@@ -118,10 +165,16 @@ connection_poll( ProxyConnection*   root,
         case STATE_CONNECTING:
             PROXY_LOG("%s: connected to http proxy, sending header", root->name);
             conn->state = STATE_SEND_HEADER;
-            break;
+            /* the socket is writable, don't wait for another iteration */
+            /* fall-through */
 
         case STATE_SEND_HEADER:
             ret = proxy_connection_send(root, fd);
+            if (ret == DATA_ERROR && conn->reused) {
+                if (connection_retry(conn) == 0)
+                    return;
+                break;
+            }
             if (ret == DATA_COMPLETED) {
                 conn->state = STATE_RECEIVE_ANSWER_LINE1;
                 PROXY_LOG("%s: header sent, receiving first answer line", root->name);
@@ -131,6 +184,13 @@ connection_poll( ProxyConnection*   root,
         case STATE_RECEIVE_ANSWER_LINE1:
         case STATE_RECEIVE_ANSWER_LINE2:
             ret = proxy_connection_receive_line(root, root->socket);
+            if (ret == DATA_ERROR && conn->reused &&
+                conn->state == STATE_RECEIVE_ANSWER_LINE1 &&
+                root->str->n == 0) {
+                if (connection_retry(conn) == 0)
+                    return;
+                break;
+            }
             if (ret == DATA_COMPLETED) {
                 const char*  line = root->str->s;
                 if (conn->state == STATE_RECEIVE_ANSWER_LINE1) {
@@ -183,8 +243,14 @@ http_connector_connect( HttpService*  service,
 {
     Connection*  conn;
     int          s;
-
-    s = socket_create_inet( SOCKET_STREAM );
+    int          reused = 0;
+
+    /* a CONNECT can be sent on any idle connection to the proxy */
+    s = http_service_get_idle( service );
+    if (s >= 0)
+        reused = 1;
+    else
+        s = socket_create_inet( SOCKET_STREAM );
     if (s < 0)
         return NULL;
 
@@ -198,6 +264,7 @@ http_connector_connect( HttpService*  service,
                            connection_free,
                            connection_select,
                            connection_poll );
+    conn->reused = reused;
 
     if ( connection_init( conn ) < 0 ) {
         connection_free( conn->root );
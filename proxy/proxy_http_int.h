@@ -15,6 +15,19 @@
 #include "proxy_http.h"
 #include "proxy_int.h"
 
+/* maximum number of idle connections to the proxy server that are kept
+ * for later requests */
+#define  HTTP_MAX_IDLE_CONNECTIONS  4
+
+/* idle connections are closed after this delay, in milliseconds, to stay
+ * below the keep-alive timeout of most proxy servers */
+#define  HTTP_IDLE_TIMEOUT_MS       30000
+
+typedef struct {
+    int      socket;
+    int64_t  since;   /* when the connection became idle */
+} HttpIdleConnection;
+
 /* the HttpService object */
 typedef struct HttpService {
     ProxyService        root[1];
@@ -22,8 +35,18 @@ typedef struct HttpService {
     char*               footer;      /* the footer contains the static parts of the */
     int                 footer_len;  /* connection header, we generate it only once */
     char                footer0[512];
+    HttpIdleConnection  idle[HTTP_MAX_IDLE_CONNECTIONS];
+    int                 num_idle;
 } HttpService;
 
+/* return a connected socket to the proxy server that was kept by
+ * http_service_put_idle(), or -1 if there is none */
+extern int   http_service_get_idle( HttpService*  service );
+
+/* keep a socket connected to the proxy server, at a message boundary,
+ * for a later request. the service owns the socket after this call */
+extern void  http_service_put_idle( HttpService*  service, int  socket );
+
 /* create a CONNECT connection (for port != 80) */
 extern ProxyConnection*  http_connector_connect(
                                 HttpService*   service,
@@ -56,110 +56,6 @@
 #endif
 
 
-/** *************************************************************
- **
- **   HTTP HEADERS
- **
- **/
-
-/* HttpHeader is a simple structure used to hold a (key,value)
- * pair in a linked list.
- */
-typedef struct HttpHeader {
-    struct HttpHeader*  next;
-    const char*         key;
-    const char*         value;
-} HttpHeader;
-
-static void
-http_header_free( HttpHeader*  h )
-{
-    if (h) {
-        g_free((char*)h->value);
-        g_free(h);
-    }
-}
-
-static int
-http_header_append( HttpHeader*  h, const char*  value )
-{
-    int    old = strlen(h->value);
-    int    new = strlen(value);
-    char*  s   = realloc((char*)h->value, old+new+1);
-    if (s == NULL)
-        return -1;
-    memcpy(s + old, value, new+1);
-    h->value = (const char*)s;
-    return 0;
-}
-
-static HttpHeader*
-http_header_alloc( const char*  key, const char*  value )
-{
-    int          len = strlen(key)+1;
-    HttpHeader*  h   = malloc(sizeof(*h) + len+1);
-    if (h) {
-        h->next  = NULL;
-        h->key   = (const char*)(h+1);
-        memcpy( (char*)h->key, key, len );
-        h->value = g_strdup(value);
-    }
-    return h;
-}
-
-/** *************************************************************
- **
- **   HTTP HEADERS LIST
- **
- **/
-
-typedef struct {
-    HttpHeader*   first;
-    HttpHeader*   last;
-} HttpHeaderList;
-
-static void
-http_header_list_init( HttpHeaderList*  l )
-{
-    l->first = l->last = NULL;
-}
-
-static void
-http_header_list_done( HttpHeaderList*  l )
-{
-    while (l->first) {
-        HttpHeader*  h = l->first;
-        l->first = h->next;
-        http_header_free(h);
-    }
-    l->last = NULL;
-}
-
-static void
-http_header_list_add( HttpHeaderList*  l,
-                      HttpHeader*      h )
-{
-    if (!l->first) {
-        l->first = h;
-    } else {
-        l->last->next = h;
-    }
-    h->next = NULL;
-    l->last = h;
-}
-
-static const char*
-http_header_list_find( HttpHeaderList*  l,
-                       const char*      key )
-{
-    HttpHeader*  h;
-    for (h = l->first; h; h = h->next)
-        if (!strcasecmp(h->key, key))
-            return h->value;
-
-    return NULL;
-}
-
 /** *************************************************************
  **
  **   HTTP REQUEST AND REPLY
@@ -175,34 +71,61 @@ typedef enum {
     HTTP_REQUEST_DELETE,
 } HttpRequestType;
 
+/* the strings of a request are all stored, zero-terminated, in a single
+ * buffer and referenced by their offset in it, since it moves when it
+ * grows. the buffer and the header array are kept from one request of a
+ * connection to the next, so that parsing a request doesn't normally
+ * allocate anything.
+ */
+typedef struct {
+    int   key;      /* offset of the header name */
+    int   value;    /* offset of the header value */
+} HttpHeader;
+
 /* HttpRequest is used both to store information about a specific
  * request and the corresponding reply
  */
 typedef struct {
     HttpRequestType   req_type;     /* request type */
-    char*             req_method;   /* "GET", "POST", "HEAD", etc... */
-    char*             req_uri;      /* the request URI */
-    char*             req_version;  /* "HTTP/1.0" or "HTTP/1.1" */
-    char*             rep_version;  /* reply version string */
+    int               req_method;   /* "GET", "POST", "HEAD", etc... */
+    int               req_uri;      /* the request URI */
+    int               req_version;  /* "HTTP/1.0" or "HTTP/1.1" */
+    int               rep_version;  /* reply version string */
     int               rep_code;     /* reply code as decimal */
-    char*             rep_readable; /* human-friendly reply/error message */
-    HttpHeaderList    headers[1];   /* headers */
+    int               rep_readable; /* human-friendly reply/error message */
+    stralloc_t        text[1];      /* storage for all the strings */
+    HttpHeader*       headers;      /* headers */
+    int               num_headers;
+    int               max_headers;
 } HttpRequest;
 
+/* return the string stored at a given offset of a request */
+#define  HTTP_STR(r,offset)   ((r)->text->s + (offset))
+
 
-static HttpRequest*
-http_request_alloc( const char*      method,
+static int
+http_request_add_string( HttpRequest*  r, const char*  str )
+{
+    int  offset = r->text->n;
+
+    stralloc_add_bytes( r->text, str, strlen(str)+1 );
+    return offset;
+}
+
+static void
+http_request_reset( HttpRequest*     r,
+                    const char*      method,
                     const char*      uri,
                     const char*      version )
 {
-    HttpRequest*  r = malloc(sizeof(*r));
-
-    r->req_method   = g_strdup(method);
-    r->req_uri      = g_strdup(uri);
-    r->req_version  = g_strdup(version);
-    r->rep_version  = NULL;
+    r->text->n      = 0;
+    r->num_headers  = 0;
+    r->req_method   = http_request_add_string(r, method);
+    r->req_uri      = http_request_add_string(r, uri);
+    r->req_version  = http_request_add_string(r, version);
+    r->rep_version  = -1;
     r->rep_code     = -1;
-    r->rep_readable = NULL;
+    r->rep_readable = -1;
 
     if (!strcmp(method,"GET")) {
         r->req_type = HTTP_REQUEST_GET;
@@ -216,40 +139,38 @@ http_request_alloc( const char*      method,
         r->req_type = HTTP_REQUEST_DELETE;
     } else
         r->req_type = HTTP_REQUEST_UNSUPPORTED;
-
-    http_header_list_init(r->headers);
-    return r;
 }
 
 static void
 http_request_replace_uri( HttpRequest*  r,
                           const char*   uri )
 {
-    const char*  old = r->req_uri;
-    r->req_uri = g_strdup(uri);
-    g_free((char*)old);
+    /* the old URI stays in the buffer until the next request */
+    r->req_uri = http_request_add_string(r, uri);
 }
 
 static void
-http_request_free( HttpRequest*  r )
+http_request_done( HttpRequest*  r )
 {
-    if (r) {
-        http_header_list_done(r->headers);
-
-        g_free(r->req_method);
-        g_free(r->req_uri);
-        g_free(r->req_version);
-        g_free(r->rep_version);
-        g_free(r->rep_readable);
-        g_free(r);
-    }
+    stralloc_reset(r->text);
+    g_free(r->headers);
+    r->headers     = NULL;
+    r->num_headers = 0;
+    r->max_headers = 0;
 }
 
 static char*
 http_request_find_header( HttpRequest*  r,
                           const char*   key )
 {
-    return (char*)http_header_list_find(r->headers, key);
+    int  nn;
+
+    for (nn = 0; nn < r->num_headers; nn++) {
+        HttpHeader*  h = r->headers + nn;
+        if (!strcasecmp(HTTP_STR(r, h->key), key))
+            return HTTP_STR(r, h->value);
+    }
+    return NULL;
 }
 
 
@@ -258,23 +179,35 @@ http_request_add_header( HttpRequest*  r,
                          const char*   key,
                          const char*   value )
 {
-    HttpHeader*  h = http_header_alloc(key,value);
-    if (h) {
-        http_header_list_add(r->headers, h);
-        return 0;
+    HttpHeader*  h;
+
+    if (r->num_headers == r->max_headers) {
+        r->max_headers = r->max_headers ? 2*r->max_headers : 16;
+        r->headers     = g_renew(HttpHeader, r->headers, r->max_headers);
     }
-    return -1;
+    h        = r->headers + r->num_headers++;
+    h->key   = http_request_add_string(r, key);
+    h->value = http_request_add_string(r, value);
+    return 0;
 }
 
 static int
 http_request_add_to_last_header( HttpRequest*  r,
                                  const char*   line )
 {
-    if (r->headers->last) {
-        return http_header_append( r->headers->last, line );
-    } else {
+    HttpHeader*  h;
+
+    if (r->num_headers == 0)
         return -1;
-    }
+
+    /* the last value is at the end of the buffer, extend it in place */
+    h = r->headers + r->num_headers - 1;
+    if (h->value + strlen(HTTP_STR(r, h->value)) + 1 != r->text->n)
+        return -1;
+
+    r->text->n -= 1;
+    http_request_add_string(r, line);
+    return 0;
 }
 
 static int
@@ -289,18 +222,34 @@ http_request_set_reply( HttpRequest*  r,
     }
     r->rep_code = atoi(code);
     if (r->rep_code == 0) {
-        PROXY_LOG("%s: bad reply code: %d", __FUNCTION__, code);
+        PROXY_LOG("%s: bad reply code: %s", __FUNCTION__, code);
         return -1;
     }
 
-    r->rep_version  = g_strdup(version);
-    r->rep_readable = g_strdup(readable);
+    r->rep_version  = http_request_add_string(r, version);
+    r->rep_readable = http_request_add_string(r, readable);
 
     /* reset the list of headers */
-    http_header_list_done(r->headers);
+    r->num_headers = 0;
     return 0;
 }
 
+/* returns 1 if the server keeps the connection opened after the reply */
+static int
+http_request_reply_keeps_alive( HttpRequest*  r )
+{
+    char*  connection = http_request_find_header(r, "Proxy-Connection");
+
+    if (!connection)
+        connection = http_request_find_header(r, "Connection");
+
+    if (connection)
+        return strcasecmp(connection, "Close") != 0;
+
+    /* persistent connections are the default since HTTP/1.1 */
+    return !strcmp(HTTP_STR(r, r->rep_version), "HTTP/1.1");
+}
+
 /** *************************************************************
  **
  **   REWRITER CONNECTION
@@ -344,11 +293,22 @@ enum {
     CHUNK_TRAILER    // Waiting for the chunk trailer + CR LF
 };
 
+/* on Linux, the body data is moved from one socket to the other through
+ * a pipe with splice(), so that it is never copied to user space. this
+ * is not done with -debug-proxy, which dumps all the data it sees. */
+#ifdef __linux__
+#  include <fcntl.h>
+#  include <unistd.h>
+#  define  USE_SPLICE  1
+#else
+#  define  USE_SPLICE  0
+#endif
+
 typedef struct {
     ProxyConnection   root[1];
     int               slirp_fd;
     ConnectionState   state;
-    HttpRequest*      request;
+    HttpRequest       request[1];
     BodyMode          body_mode;
     int64_t           body_length;
     int64_t           body_total;
@@ -359,21 +319,45 @@ typedef struct {
     char              body_has_data;
     char              body_is_full;
     char              body_is_closed;
-    char              parse_chunk_header;
-    char              parse_chunk_trailer;
+    char              parse_chunk_line;
+    int               body_pipe[2];      /* for splice(), or -1 */
+    int               body_pipe_count;   /* bytes in body_pipe */
+    char              no_splice;
+    char              proxy_keep_alive;  /* proxy connection can be kept */
+    char              proxy_reused;      /* proxy connection was idle */
+    stralloc_t        retry_request[1];  /* request to send again if the
+                                          * idle connection was closed */
 } RewriteConnection;
 
 
+static void
+rewrite_connection_close_pipe( RewriteConnection*  conn )
+{
+#if USE_SPLICE
+    if (conn->body_pipe[0] >= 0) {
+        close(conn->body_pipe[0]);
+        close(conn->body_pipe[1]);
+    }
+#endif
+    conn->body_pipe[0]    = -1;
+    conn->body_pipe[1]    = -1;
+    conn->body_pipe_count = 0;
+}
+
+
 static void
 rewrite_connection_free( ProxyConnection*  root )
 {
     RewriteConnection*  conn = (RewriteConnection*)root;
 
     if (conn->slirp_fd >= 0) {
+        proxy_select_forget(conn->slirp_fd);
         socket_close(conn->slirp_fd);
         conn->slirp_fd = -1;
     }
-    http_request_free(conn->request);
+    rewrite_connection_close_pipe(conn);
+    http_request_done(conn->request);
+    stralloc_reset(conn->retry_request);
     proxy_connection_done(root);
     g_free(conn);
 }
@@ -385,8 +369,17 @@ rewrite_connection_init( RewriteConnection*   conn )
     HttpService*      service = (HttpService*) conn->root->service;
     ProxyConnection*  root    = conn->root;
 
-    conn->slirp_fd = -1;
-    conn->state    = STATE_CONNECTING;
+    conn->slirp_fd         = -1;
+    conn->state            = STATE_CONNECTING;
+    conn->proxy_keep_alive = 1;
+    conn->body_pipe[0]     = -1;
+    conn->body_pipe[1]     = -1;
+
+    if (conn->proxy_reused) {
+        PROXY_LOG("%s: using idle proxy connection", root->name);
+        conn->state = STATE_CREATE_SOCKET_PAIR;
+        return 0;
+    }
 
     if (socket_connect( root->socket, &service->server_addr ) < 0) {
         if (errno == EINPROGRESS || errno == EWOULDBLOCK || errno == EAGAIN) {
@@ -404,6 +397,51 @@ rewrite_connection_init( RewriteConnection*   conn )
     return 0;
 }
 
+/* the proxy closed an idle connection before answering the request,
+ * send it again on a new connection. */
+static int
+rewrite_connection_retry( RewriteConnection*  conn )
+{
+    HttpService*      service = (HttpService*) conn->root->service;
+    ProxyConnection*  root    = conn->root;
+
+    PROXY_LOG("%s: idle proxy connection was closed, retrying", root->name);
+    proxy_select_forget(root->socket);
+    socket_close(root->socket);
+    conn->proxy_reused     = 0;
+    conn->proxy_keep_alive = 1;
+
+    root->socket = socket_create(service->server_addr.family, SOCKET_STREAM);
+    if (root->socket < 0)
+        return -1;
+    socket_set_nonblock(root->socket);
+
+    if (socket_connect( root->socket, &service->server_addr ) < 0 &&
+        errno != EINPROGRESS && errno != EWOULDBLOCK && errno != EAGAIN) {
+        PROXY_LOG("%s: cannot connect to proxy: %s", root->name, errno_str);
+        return -1;
+    }
+
+    /* the request is sent once the socket is writable */
+    proxy_connection_rewind(root);
+    stralloc_copy(root->str, conn->retry_request);
+    conn->retry_request->n = 0;
+    conn->state = STATE_REQUEST_SEND;
+    return 0;
+}
+
+/* the client closed its connection between two requests, keep the
+ * connection to the proxy for the next one. */
+static void
+rewrite_connection_keep_proxy( RewriteConnection*  conn )
+{
+    ProxyConnection*  root = conn->root;
+
+    proxy_select_forget(root->socket);
+    http_service_put_idle((HttpService*) root->service, root->socket);
+    root->socket = -1;
+}
+
 static int
 rewrite_connection_create_sockets( RewriteConnection*  conn )
 {
@@ -442,7 +480,7 @@ rewrite_connection_read_request( RewriteConnection*  conn )
 
         method = strsep(&p, " ");
         if (p == NULL) {
-            PROXY_LOG("%s: can't parse method in '%'",
+            PROXY_LOG("%s: can't parse method in '%s'",
                       root->name, line);
             return DATA_ERROR;
         }
@@ -458,12 +496,7 @@ rewrite_connection_read_request( RewriteConnection*  conn )
                        root->name, line);
             return DATA_ERROR;
         }
-        if (conn->request)
-            http_request_free(conn->request);
-
-        conn->request = http_request_alloc( method, uri, version );
-        if (!conn->request)
-            return DATA_ERROR;
+        http_request_reset( conn->request, method, uri, version );
 
         proxy_connection_rewind(root);
     }
@@ -566,12 +599,12 @@ rewrite_connection_rewrite_request( RewriteConnection*  conn )
     HttpService*     service = (HttpService*) root->service;
     HttpRequest*     r       = conn->request;
     stralloc_t*      str     = root->str;
-    HttpHeader*      h;
+    int              nn;
 
     proxy_connection_rewind(conn->root);
 
     /* only rewrite the URI if it is not absolute */
-    if (r->req_uri[0] == '/') {
+    if (HTTP_STR(r, r->req_uri)[0] == '/') {
         char*  host = http_request_find_header(r, "Host");
         if (host == NULL) {
             PROXY_LOG("%s: uh oh, not Host: in request ?", root->name);
@@ -579,15 +612,20 @@ rewrite_connection_rewrite_request( RewriteConnection*  conn )
             /* now create new URI */
             stralloc_add_str(str, "http://");
             stralloc_add_str(str, host);
-            stralloc_add_str(str, r->req_uri);
+            stralloc_add_str(str, HTTP_STR(r, r->req_uri));
             http_request_replace_uri(r, stralloc_cstr(str));
             proxy_connection_rewind(root);
         }
     }
 
-    stralloc_format( str, "%s %s %s\r\n", r->req_method, r->req_uri, r->req_version );
-    for (h = r->headers->first; h; h = h->next) {
-        stralloc_add_format( str, "%s: %s\r\n", h->key, h->value );
+    stralloc_format( str, "%s %s %s\r\n", HTTP_STR(r, r->req_method),
+                     HTTP_STR(r, r->req_uri), HTTP_STR(r, r->req_version) );
+    for (nn = 0; nn < r->num_headers; nn++) {
+        HttpHeader*  h = r->headers + nn;
+        stralloc_add_str( str, HTTP_STR(r, h->key) );
+        stralloc_add_bytes( str, ": ", 2 );
+        stralloc_add_str( str, HTTP_STR(r, h->value) );
+        stralloc_add_bytes( str, "\r\n", 2 );
     }
     /* add the service's footer - includes final \r\n */
     stralloc_add_bytes( str, service->footer, service->footer_len );
@@ -601,12 +639,17 @@ rewrite_connection_rewrite_reply( RewriteConnection*  conn )
     HttpRequest*     r    = conn->request;
     ProxyConnection* root = conn->root;
     stralloc_t*      str  = root->str;
-    HttpHeader*      h;
+    int              nn;
 
     proxy_connection_rewind(root);
-    stralloc_format(str, "%s %d %s\r\n", r->rep_version, r->rep_code, r->rep_readable);
-    for (h = r->headers->first; h; h = h->next) {
-        stralloc_add_format(str, "%s: %s\r\n", h->key, h->value);
+    stralloc_format(str, "%s %d %s\r\n", HTTP_STR(r, r->rep_version),
+                    r->rep_code, HTTP_STR(r, r->rep_readable));
+    for (nn = 0; nn < r->num_headers; nn++) {
+        HttpHeader*  h = r->headers + nn;
+        stralloc_add_str( str, HTTP_STR(r, h->key) );
+        stralloc_add_bytes( str, ": ", 2 );
+        stralloc_add_str( str, HTTP_STR(r, h->value) );
+        stralloc_add_bytes( str, "\r\n", 2 );
     }
     stralloc_add_str(str, "\r\n");
 
@@ -623,13 +666,14 @@ rewrite_connection_get_body_length( RewriteConnection*  conn,
     char*             content_length;
     char*             transfer_encoding;
 
-    conn->body_mode      = BODY_NONE;
-    conn->body_length    = 0;
-    conn->body_total     = 0;
-    conn->body_sent      = 0;
-    conn->body_is_closed = 0;
-    conn->body_is_full   = 0;
-    conn->body_has_data  = 0;
+    conn->body_mode        = BODY_NONE;
+    conn->body_length      = 0;
+    conn->body_total       = 0;
+    conn->body_sent        = 0;
+    conn->body_is_closed   = 0;
+    conn->body_is_full     = 0;
+    conn->body_has_data    = 0;
+    conn->parse_chunk_line = 0;
 
     proxy_connection_rewind(root);
 
@@ -664,8 +708,6 @@ rewrite_connection_get_body_length( RewriteConnection*  conn,
         transfer_encoding = http_request_find_header(r, "Transfer-Encoding");
         if (transfer_encoding && !strcasecmp(transfer_encoding, "Chunked")) {
             conn->body_mode           = BODY_CHUNKED;
-            conn->parse_chunk_header  = 0;
-            conn->parse_chunk_trailer = 0;
             conn->chunk_length        = -1;
             conn->chunk_total         = 0;
             conn->chunk_state         = CHUNK_HEADER;
@@ -699,12 +741,140 @@ rewrite_connection_get_body_length( RewriteConnection*  conn,
 
 #define  MAX_BODY_BUFFER  65536
 
+/* update the body flags after data was added to, or sent from, the
+ * connection's buffers */
+static void
+rewrite_connection_update_body( RewriteConnection*  conn )
+{
+    int  count = conn->root->str->n;
+
+    conn->body_has_data = (count > 0 || conn->body_pipe_count > 0);
+    conn->body_is_full  = (count >= MAX_BODY_BUFFER ||
+                           conn->body_pipe_count >= MAX_BODY_BUFFER);
+}
+
+/* return 1 if the body data can be received into the pipe */
+static int
+rewrite_connection_use_pipe( RewriteConnection*  conn )
+{
+#if USE_SPLICE
+    /* data that is already in the buffer must be sent first */
+    if (conn->no_splice || proxy_log || conn->root->str->n > 0)
+        return 0;
+
+    if (conn->body_pipe[0] < 0 && pipe(conn->body_pipe) < 0) {
+        PROXY_LOG("%s: can't create pipe: %s", conn->root->name, errno_str);
+        conn->body_pipe[0] = conn->body_pipe[1] = -1;
+        conn->no_splice = 1;
+        return 0;
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* same as proxy_connection_receive(), but into the connection's pipe */
+static DataStatus
+rewrite_connection_pipe_receive( RewriteConnection*  conn, int  fd, int  wanted )
+{
+    ProxyConnection*  root = conn->root;
+
+    root->str_recv = 0;
+
+#if USE_SPLICE
+    while (wanted > 0) {
+        ssize_t  n = splice( fd, NULL, conn->body_pipe[1], NULL, wanted,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+        if (n == 0) {
+            PROXY_LOG("%s: connection reset by peer (receive)",
+                      root->name);
+            return DATA_ERROR;
+        }
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+                return DATA_NEED_MORE;
+
+            if (errno == EINVAL && root->str_recv == 0 &&
+                conn->body_pipe_count == 0) {
+                /* this socket can't be spliced, use the buffer */
+                D("%s: splice() not supported", root->name);
+                conn->no_splice = 1;
+                rewrite_connection_close_pipe(conn);
+                return proxy_connection_receive(root, fd, wanted);
+            }
+            PROXY_LOG("%s: error: %s", root->name, errno_str);
+            return DATA_ERROR;
+        }
+        conn->body_pipe_count += n;
+        root->str_recv        += n;
+        wanted                -= n;
+    }
+#endif
+    return DATA_COMPLETED;
+}
+
+/* same as proxy_connection_send(), but from the connection's pipe */
+static DataStatus
+rewrite_connection_pipe_send( RewriteConnection*  conn, int  fd )
+{
+    ProxyConnection*  root = conn->root;
+
+    root->str_sent = 0;
+
+#if USE_SPLICE
+    while (conn->body_pipe_count > 0) {
+        ssize_t  n = splice( conn->body_pipe[0], NULL, fd, NULL,
+                             conn->body_pipe_count,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+        if (n == 0) {
+            PROXY_LOG("%s: connection reset by peer (send)",
+                      root->name);
+            return DATA_ERROR;
+        }
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+                return DATA_NEED_MORE;
+
+            PROXY_LOG("%s: error: %s", root->name, errno_str);
+            return DATA_ERROR;
+        }
+        conn->body_pipe_count -= n;
+        root->str_sent        += n;
+    }
+#endif
+    return DATA_COMPLETED;
+}
+
+/* receive a line of a chunked body. lines are read into an empty buffer,
+ * so this waits until the previous data has been sent. */
+static DataStatus
+rewrite_connection_read_chunk_line( RewriteConnection*  conn, int  fd )
+{
+    DataStatus  ret;
+
+    if (!conn->parse_chunk_line) {
+        if (conn->body_has_data)
+            return DATA_NEED_MORE;
+        conn->parse_chunk_line = 1;
+    }
+    ret = proxy_connection_receive_line(conn->root, fd);
+    if (ret == DATA_COMPLETED)
+        conn->parse_chunk_line = 0;
+
+    return ret;
+}
+
 static DataStatus
 rewrite_connection_read_body( RewriteConnection*  conn, int  fd )
 {
     ProxyConnection*  root   = conn->root;
     stralloc_t*       str    = root->str;
-    int               wanted = 0, current, avail;
+    int               wanted = 0, current, avail, use_pipe;
     DataStatus        ret;
 
     if (conn->body_is_closed) {
@@ -736,7 +906,7 @@ rewrite_connection_read_body( RewriteConnection*  conn, int  fd )
     case BODY_CHUNKED:
         if (conn->chunk_state == CHUNK_DATA_END) {
             /* We're waiting for the CR LF after the chunk data */
-            ret = proxy_connection_receive_line(root, fd);
+            ret = rewrite_connection_read_chunk_line(conn, fd);
             if (ret != DATA_COMPLETED)
                 return ret;
 
@@ -750,27 +920,21 @@ rewrite_connection_read_body( RewriteConnection*  conn, int  fd )
             * send the chunk size end to the proxy.
             */
             stralloc_add_str(root->str, "\r\n");
+            rewrite_connection_update_body(conn);
             conn->chunk_state = CHUNK_HEADER;
-            /* fall-through */
+            /* the next header is read once this has been sent */
+            return DATA_NEED_MORE;
         }
 
         if (conn->chunk_state == CHUNK_HEADER) {
             char*      line;
             char*      end;
             long long  length;
-            /* Ensure that the previous chunk was flushed before
-             * accepting a new header */
-            if (!conn->parse_chunk_header) {
-                if (conn->body_has_data)
-                    return DATA_NEED_MORE;
-                D("%s: waiting chunk header", root->name);
-                conn->parse_chunk_header = 1;
-            }
-            ret = proxy_connection_receive_line(root, fd);
+
+            ret = rewrite_connection_read_chunk_line(conn, fd);
             if (ret != DATA_COMPLETED) {
                 return ret;
             }
-            conn->parse_chunk_header = 0;
 
             line   = str->s;
             length = strtoll(line, &end, 16);
@@ -789,29 +953,31 @@ rewrite_connection_read_body( RewriteConnection*  conn, int  fd )
             * send the chunk size to the proxy.
             */
             stralloc_add_str(root->str, "\r\n");
+            rewrite_connection_update_body(conn);
 
             conn->chunk_length = length;
             conn->chunk_total  = 0;
             conn->chunk_state  = CHUNK_DATA;
             if (length == 0) {
                 /* the last chunk, no we need to add the trailer */
-                conn->chunk_state         = CHUNK_TRAILER;
-                conn->parse_chunk_trailer = 0;
+                conn->chunk_state = CHUNK_TRAILER;
             }
         }
 
         if (conn->chunk_state == CHUNK_TRAILER) {
-            /* ensure that 'str' is flushed before reading the trailer */
-            if (!conn->parse_chunk_trailer) {
-                if (conn->body_has_data)
-                    return DATA_NEED_MORE;
-                conn->parse_chunk_trailer = 1;
-            }
-            ret = rewrite_connection_read_headers(conn, fd);
-            if (ret == DATA_COMPLETED) {
+            /* forward the trailer lines, up to the final empty one */
+            ret = rewrite_connection_read_chunk_line(conn, fd);
+            if (ret != DATA_COMPLETED)
+                return ret;
+
+            if (str->s[0] == 0) {
+                D("%s: chunked body completed (%lld bytes)",
+                  root->name, conn->body_total);
                 conn->body_is_closed = 1;
             }
-            return ret;
+            stralloc_add_str(root->str, "\r\n");
+            rewrite_connection_update_body(conn);
+            return conn->body_is_closed ? DATA_COMPLETED : DATA_NEED_MORE;
         }
 
         /* if we get here, body_length > 0 */
@@ -827,8 +993,9 @@ rewrite_connection_read_body( RewriteConnection*  conn, int  fd )
 
     /* we don't want more than MAX_BODY_BUFFER bytes in the
      * buffer we used to pass the body */
-    current = str->n;
-    avail   = MAX_BODY_BUFFER - current;
+    use_pipe = rewrite_connection_use_pipe(conn);
+    current  = use_pipe ? conn->body_pipe_count : (int)str->n;
+    avail    = MAX_BODY_BUFFER - current;
     if (avail <= 0) {
         /* wait for some flush */
         conn->body_is_full = 1;
@@ -840,9 +1007,12 @@ rewrite_connection_read_body( RewriteConnection*  conn, int  fd )
     if (wanted > avail)
         wanted = avail;
 
-    ret = proxy_connection_receive(root, fd, wanted);
-    conn->body_has_data = (str->n > 0);
-    conn->body_is_full  = (str->n == MAX_BODY_BUFFER);
+    if (use_pipe)
+        ret = rewrite_connection_pipe_receive(conn, fd, wanted);
+    else
+        ret = proxy_connection_receive(root, fd, wanted);
+
+    rewrite_connection_update_body(conn);
 
     if (ret == DATA_ERROR) {
         if (conn->body_mode == BODY_UNTIL_CLOSE) {
@@ -869,7 +1039,7 @@ rewrite_connection_read_body( RewriteConnection*  conn, int  fd )
                 conn->body_total  += conn->chunk_total;
                 conn->chunk_total  = 0;
                 conn->chunk_length = -1;
-                conn->chunk_state  = CHUNK_DATA;
+                conn->chunk_state  = CHUNK_DATA_END;
             }
             break;
 
@@ -904,15 +1074,21 @@ rewrite_connection_send_body( RewriteConnection*  conn, int  fd )
     DataStatus        ret    = DATA_NEED_MORE;
 
     if (conn->body_has_data) {
-        ret = proxy_connection_send(root, fd);
-        if (ret != DATA_ERROR) {
-            int  pos = root->str_pos;
+        /* the pipe is only filled when the buffer is empty */
+        if (conn->body_pipe_count > 0) {
+            ret = rewrite_connection_pipe_send(conn, fd);
+        } else {
+            ret = proxy_connection_send(root, fd);
+            if (ret != DATA_ERROR) {
+                int  pos = root->str_pos;
 
-            memmove(str->s, str->s+pos, str->n-pos);
-            str->n         -= pos;
-            root->str_pos   = 0;
-            conn->body_is_full  = (str->n == MAX_BODY_BUFFER);
-            conn->body_has_data = (str->n > 0);
+                memmove(str->s, str->s+pos, str->n-pos);
+                str->n         -= pos;
+                root->str_pos   = 0;
+            }
+        }
+        if (ret != DATA_ERROR) {
+            rewrite_connection_update_body(conn);
             conn->body_sent    += root->str_sent;
 
             /* ensure that we return DATA_COMPLETED only when
@@ -926,10 +1102,10 @@ rewrite_connection_send_body( RewriteConnection*  conn, int  fd )
                         root->name, conn->body_sent);
                 }
             }
-            D("%s: sent closed=%d data=%d n=%d ret=%d",
+            D("%s: sent closed=%d data=%d n=%d pipe=%d ret=%d",
                 root->name, conn->body_is_closed,
                 conn->body_has_data, str->n,
-                ret);
+                conn->body_pipe_count, ret);
         }
     }
     return ret;
@@ -1039,6 +1215,12 @@ rewrite_connection_poll( ProxyConnection*  root,
                         ret = DATA_ERROR;
                     else
                         conn->state = STATE_REQUEST_SEND;
+
+                    /* keep a copy in case the idle proxy connection
+                     * was closed in the meantime */
+                    conn->retry_request->n = 0;
+                    if (conn->proxy_reused)
+                        stralloc_copy(conn->retry_request, root->str);
                 }
             }
             break;
@@ -1046,12 +1228,17 @@ rewrite_connection_poll( ProxyConnection*  root,
         case STATE_REQUEST_SEND:
             if (has_proxy) {
                 ret = proxy_connection_send(root, proxy);
-                if (ret == DATA_COMPLETED) {
+                if (ret == DATA_ERROR && conn->retry_request->n > 0) {
+                    ret = rewrite_connection_retry(conn) < 0 ? DATA_ERROR
+                                                             : DATA_NEED_MORE;
+                } else if (ret == DATA_COMPLETED) {
                     if (rewrite_connection_get_body_length(conn, 1) < 0) {
                         ret = DATA_ERROR;
                     } else if (conn->body_mode != BODY_NONE) {
                         PROXY_LOG("%s: request sent, waiting for body",
                                    root->name);
+                        /* the body can't be sent again */
+                        conn->retry_request->n = 0;
                         conn->state = STATE_REQUEST_BODY;
                     } else {
                         PROXY_LOG("%s: request sent, waiting for reply",
@@ -1079,8 +1266,14 @@ rewrite_connection_poll( ProxyConnection*  root,
         case STATE_REPLY_FIRST_LINE:
             if (has_proxy) {
                 ret = rewrite_connection_read_reply(conn);
-                if (ret == DATA_COMPLETED) {
+                if (ret == DATA_ERROR && conn->retry_request->n > 0 &&
+                    root->str->n == 0) {
+                    ret = rewrite_connection_retry(conn) < 0 ? DATA_ERROR
+                                                             : DATA_NEED_MORE;
+                } else if (ret == DATA_COMPLETED) {
                     PROXY_LOG("%s: reply first line ok", root->name);
+                    conn->retry_request->n = 0;
+                    conn->proxy_reused     = 0;
                     conn->state = STATE_REPLY_HEADERS;
                 }
             }
@@ -1105,13 +1298,20 @@ rewrite_connection_poll( ProxyConnection*  root,
                 if (ret == DATA_COMPLETED) {
                     if (rewrite_connection_get_body_length(conn, 0) < 0) {
                         ret = DATA_ERROR;
-                    } else if (conn->body_mode != BODY_NONE) {
+                        break;
+                    }
+                    conn->proxy_keep_alive =
+                            conn->body_mode != BODY_UNTIL_CLOSE &&
+                            http_request_reply_keeps_alive(conn->request);
+
+                    if (conn->body_mode != BODY_NONE) {
                         PROXY_LOG("%s: reply sent, waiting for body",
                                   root->name);
                         conn->state = STATE_REPLY_BODY;
                     } else {
                         PROXY_LOG("%s: reply sent, looping to waiting request",
                                   root->name);
+                        conn->proxy_reused = 1;
                         conn->state = STATE_REQUEST_FIRST_LINE;
                     }
                 }
@@ -1131,6 +1331,7 @@ rewrite_connection_poll( ProxyConnection*  root,
                     } else {
                         PROXY_LOG("%s: reply body ok, looping to waiting request",
                                 root->name);
+                        conn->proxy_reused = 1;
                         conn->state = STATE_REQUEST_FIRST_LINE;
                     }
                 }
@@ -1140,8 +1341,14 @@ rewrite_connection_poll( ProxyConnection*  root,
         default:
             ;
     }
-    if (ret == DATA_ERROR)
+    if (ret == DATA_ERROR) {
+        /* the client closed the connection between two requests */
+        if (conn->state == STATE_REQUEST_FIRST_LINE &&
+            conn->proxy_keep_alive && root->str->n == 0)
+            rewrite_connection_keep_proxy(conn);
+
         proxy_connection_free(root, 0, PROXY_EVENT_NONE);
+    }
 
     return;
 }
@@ -1153,8 +1360,13 @@ http_rewriter_connect( HttpService*  service,
 {
     RewriteConnection*  conn;
     int                 s;
+    int                 reused = 0;
 
-    s = socket_create(address->family, SOCKET_STREAM );
+    s = http_service_get_idle( service );
+    if (s >= 0)
+        reused = 1;
+    else
+        s = socket_create(address->family, SOCKET_STREAM );
     if (s < 0)
         return NULL;
 
@@ -1168,6 +1380,7 @@ http_rewriter_connect( HttpService*  service,
                            rewrite_connection_free,
                            rewrite_connection_select,
                            rewrite_connection_poll );
+    conn->proxy_reused = reused;
 
     if ( rewrite_connection_init( conn ) < 0 ) {
         rewrite_connection_free( conn->root );
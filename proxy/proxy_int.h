@@ -33,11 +33,14 @@ enum {
     PROXY_SELECT_ERROR = (1 << 2)
 };
 
+/* the descriptors are either watched with fd_sets, or with an IoLooper
+ * when |looper| isn't NULL. */
 typedef struct {
-    int*     pcount;
-    fd_set*  reads;
-    fd_set*  writes;
-    fd_set*  errors;
+    int*       pcount;
+    fd_set*    reads;
+    fd_set*    writes;
+    fd_set*    errors;
+    IoLooper*  looper;
 } ProxySelect;
 
 extern void     proxy_select_set( ProxySelect*  sel,
@@ -46,6 +49,9 @@ extern void     proxy_select_set( ProxySelect*  sel,
 
 extern unsigned  proxy_select_poll( ProxySelect*  sel, int  fd );
 
+/* call this before closing a socket that may have been selected */
+extern void      proxy_select_forget( int  fd );
+
 
 /* sockets proxy manager internals */
 
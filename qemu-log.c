@@ -19,20 +19,34 @@
 
 #include "qemu-common.h"
 #include "qemu/log.h"
+#include "android/utils/async_log.h"
 
 static char *logfilename;
 FILE *qemu_logfile;
 int qemu_loglevel;
 static int log_append = 0;
 
+/* Once the asynchronous log is started, messages are queued and written
+ * by its writer thread, so that heavy logging doesn't slow down the vCPU
+ * thread as much.
+ */
+void qemu_log_vprintf(const char *fmt, va_list va)
+{
+    if (qemu_logfile) {
+        if (async_log_is_started()) {
+            async_log_vprintf(qemu_logfile, fmt, va);
+        } else {
+            vfprintf(qemu_logfile, fmt, va);
+        }
+    }
+}
+
 void qemu_log(const char *fmt, ...)
 {
     va_list ap;
 
     va_start(ap, fmt);
-    if (qemu_logfile) {
-        vfprintf(qemu_logfile, fmt, ap);
-    }
+    qemu_log_vprintf(fmt, ap);
     va_end(ap);
 }
 
@@ -41,12 +55,27 @@ void qemu_log_mask(int mask, const char *fmt, ...)
     va_list ap;
 
     va_start(ap, fmt);
-    if ((qemu_loglevel & mask) && qemu_logfile) {
-        vfprintf(qemu_logfile, fmt, ap);
+    if (qemu_loglevel & mask) {
+        qemu_log_vprintf(fmt, ap);
     }
     va_end(ap);
 }
 
+int qemu_log_fprintf(FILE *f, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    qemu_log_vprintf(fmt, ap);
+    va_end(ap);
+    return 0;
+}
+
+void qemu_log_sync(void)
+{
+    async_log_flush();
+}
+
 /* enable or disable low levels log */
 void do_qemu_set_log(int log_flags, bool use_own_buffers)
 {
@@ -90,6 +119,16 @@ void qemu_set_log_filename(const char *filename)
     qemu_set_log(qemu_loglevel);
 }
 
+void qemu_log_rotate(void)
+{
+    if (!logfilename || !qemu_logfile) {
+        return;
+    }
+    qemu_log_close();
+    log_append = 0;
+    qemu_set_log(qemu_loglevel);
+}
+
 const QEMULogItem qemu_log_items[] = {
     { CPU_LOG_TB_OUT_ASM, "out_asm",
       "show generated host assembly code for each compiled TB" },
@@ -92,6 +92,7 @@ DEF("drive", HAS_ARG, QEMU_OPTION_drive,
     "-drive [file=file][,if=type][,bus=n][,unit=m][,media=d][,index=i]\n"
     "       [,cyls=c,heads=h,secs=s[,trans=t]][,snapshot=on|off]\n"
     "       [,cache=writethrough|writeback|none][,format=f][,serial=s]\n"
+    "       [,aio=threads|native]\n"
     "                use 'file' as a drive image\n")
 STEXI
 @item -drive @var{option}[,@var{option}[,@var{option}[,...]]]
@@ -126,6 +127,10 @@ the format.  Can be used to specifiy format=raw to avoid interpreting
 an untrusted format header.
 @item serial=@var{serial}
 This option specifies the serial number to assign to the device.
+@item aio=@var{aio}
+@var{aio} is "threads", or "native" and selects between pthread based disk I/O
+and native Linux AIO. Native AIO is only used with @option{cache=none}, and
+only on Linux hosts.
 @end table
 
 By default, writethrough caching is used for all block device.  This means that
@@ -1697,6 +1702,10 @@ STEXI
 Save state automatically on exit (as @code{savevm} in monitor)
 ETEXI
 
+DEF("fast-exit", 0, QEMU_OPTION_fast_exit, \
+    "-fast-exit      hide the window on exit, then save the state and exit\n" \
+    "                without tearing down the UI and devices\n")
+
 DEF("mic", HAS_ARG, QEMU_OPTION_mic, \
     "-mic <file>     read audio input from wav file\n")
 
@@ -1747,6 +1756,33 @@ DEF("audio", HAS_ARG, QEMU_OPTION_audio, \
 DEF("cpu-delay", HAS_ARG, QEMU_OPTION_cpu_delay, \
     "-cpu-delay <cpudelay> throttle CPU emulation\n")
 
+DEF("timer-slack", HAS_ARG, QEMU_OPTION_timer_slack, \
+    "-timer-slack <usecs> let timers fire up to <usecs> microseconds late\n")
+
+DEF("stats-port", HAS_ARG, QEMU_OPTION_stats_port, \
+    "-stats-port <port> serve performance metrics to Prometheus on TCP <port>\n")
+
+DEF("qos", HAS_ARG, QEMU_OPTION_qos, \
+    "-qos <limits>   limit the host CPU, disk I/O and render priority of the instance\n")
+
+DEF("startup-profile", 0, QEMU_OPTION_startup_profile, \
+    "-startup-profile print how long each startup phase takes\n")
+
+DEF("sample-profile", HAS_ARG, QEMU_OPTION_sample_profile, \
+    "-sample-profile <hz> sample the guest processes <hz> times per second\n")
+
+DEF("iothread", 0, QEMU_OPTION_iothread, \
+    "-iothread       run the emulated CPU in its own thread, separate from I/O\n")
+
+DEF("mem-hugepages", 0, QEMU_OPTION_mem_hugepages, \
+    "-mem-hugepages  back guest RAM with huge host pages when possible\n")
+
+DEF("mem-prefault", 0, QEMU_OPTION_mem_prefault, \
+    "-mem-prefault   populate guest RAM with host pages in the background at startup\n")
+
+DEF("mem-lock", 0, QEMU_OPTION_mem_lock, \
+    "-mem-lock       lock guest RAM in host memory, implies -mem-prefault\n")
+
 DEF("show-kernel", 0, QEMU_OPTION_show_kernel, \
     "-show-kernel display kernel messages\n")
 
@@ -1785,6 +1821,27 @@ DEF("audio-test-out", 0, QEMU_OPTION_audio_test_out, \
 DEF("snapshot-no-time-update", 0, QEMU_OPTION_snapshot_no_time_update, \
     "-snapshot-no-time-update Disable time update when restoring snapshots\n")
 
+DEF("snapshot-lazy-ram", 0, QEMU_OPTION_snapshot_lazy_ram, \
+    "-snapshot-lazy-ram Restore snapshot RAM pages on first access\n")
+
+DEF("snapshot-shared-ram", 0, QEMU_OPTION_snapshot_shared_ram, \
+    "-snapshot-shared-ram Map snapshot RAM pages copy-on-write to share them between instances\n")
+
+DEF("snapshot-flat", HAS_ARG, QEMU_OPTION_snapshot_flat, \
+    "-snapshot-flat <dir> Store VM state snapshots as flat, mappable files in <dir> instead of the qcow2 snapshot image\n")
+
+DEF("block-device", 0, QEMU_OPTION_block_device, \
+    "-block-device Attach the ext4 partitions to paravirtual goldfish_block devices instead of NAND\n")
+
+DEF("fstrim-interval", HAS_ARG, QEMU_OPTION_fstrim_interval, \
+    "-fstrim-interval <seconds> Ask the guest to trim its file systems every <seconds>, through the qemu.fstrim.interval boot property\n")
+
+DEF("qcow2-cache-size", HAS_ARG, QEMU_OPTION_qcow2_cache_size, \
+    "-qcow2-cache-size <size> Size of the metadata cache of each qcow2 image, in MB\n")
+
+DEF("vsync-offset", HAS_ARG, QEMU_OPTION_vsync_offset, \
+    "-vsync-offset <ms> Raise the guest display's VSYNC <ms> milliseconds before the host vsync\n")
+
 DEF("list-webcam", 0, QEMU_OPTION_list_webcam, \
     "-list-webcam List web cameras available for emulation\n")
 
@@ -30,6 +30,8 @@
 
 #include "qemu/thread.h"
 #include "qemu/timer.h"
+#include "android/utils/metrics.h"
+#include "android/utils/trace.h"
 #ifdef CONFIG_POSIX
 #include <pthread.h>
 #endif
@@ -69,7 +71,13 @@ QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
-    QEMUTimer *active_timers;
+    /* Binary min-heap of the active timers, by expire_time then order, so
+     * that modifying a timer costs O(log n) instead of walking a sorted
+     * list. active_timers[0] is the next timer to expire. */
+    QEMUTimer **active_timers;
+    int nb_active_timers;
+    int max_active_timers;
+    uint64_t next_order;
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -91,11 +99,77 @@ static inline QEMUClock *qemu_clock_ptr(QEMUClockType type)
     return &qemu_clocks[type];
 }
 
+static int64_t timer_slack_ns;
+
 static bool timer_expired_ns(QEMUTimer *timer_head, int64_t current_time)
 {
     return timer_head && (timer_head->expire_time <= current_time);
 }
 
+static QEMUTimer *timerlist_first(QEMUTimerList *timer_list)
+{
+    return timer_list->nb_active_timers ? timer_list->active_timers[0] : NULL;
+}
+
+static bool timer_before(QEMUTimer *a, QEMUTimer *b)
+{
+    if (a->expire_time != b->expire_time) {
+        return a->expire_time < b->expire_time;
+    }
+    return a->order < b->order;
+}
+
+static void timer_heap_set(QEMUTimerList *timer_list, int index,
+                           QEMUTimer *ts)
+{
+    timer_list->active_timers[index] = ts;
+    ts->heap_index = index;
+}
+
+/* Move the timer at @index up or down the heap until it is in order. */
+static void timer_heap_fix(QEMUTimerList *timer_list, int index)
+{
+    QEMUTimer **heap = timer_list->active_timers;
+    QEMUTimer *ts = heap[index];
+    int n = timer_list->nb_active_timers;
+
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!timer_before(ts, heap[parent])) {
+            break;
+        }
+        timer_heap_set(timer_list, index, heap[parent]);
+        index = parent;
+    }
+    for (;;) {
+        int child = 2 * index + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && timer_before(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!timer_before(heap[child], ts)) {
+            break;
+        }
+        timer_heap_set(timer_list, index, heap[child]);
+        index = child;
+    }
+    timer_heap_set(timer_list, index, ts);
+}
+
+static void timer_heap_remove(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    int index = ts->heap_index;
+    int last = --timer_list->nb_active_timers;
+
+    if (index != last) {
+        timer_heap_set(timer_list, index, timer_list->active_timers[last]);
+        timer_heap_fix(timer_list, index);
+    }
+    ts->heap_index = -1;
+}
+
 QEMUTimerList *timerlist_new(QEMUClockType type,
                              QEMUTimerListNotifyCB *cb,
                              void *opaque)
@@ -120,6 +194,7 @@ void timerlist_free(QEMUTimerList *timer_list)
         QLIST_REMOVE(timer_list, list);
     }
     qemu_mutex_destroy(&timer_list->active_timers_lock);
+    g_free(timer_list->active_timers);
     g_free(timer_list);
 }
 
@@ -173,7 +248,7 @@ void qemu_clock_enable(QEMUClockType type, bool enabled)
 
 bool timerlist_has_timers(QEMUTimerList *timer_list)
 {
-    return !!timer_list->active_timers;
+    return timer_list->nb_active_timers > 0;
 }
 
 bool qemu_clock_has_timers(QEMUClockType type)
@@ -187,11 +262,11 @@ bool timerlist_expired(QEMUTimerList *timer_list)
     int64_t expire_time;
 
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    if (!timer_list->active_timers) {
+    if (!timer_list->nb_active_timers) {
         qemu_mutex_unlock(&timer_list->active_timers_lock);
         return false;
     }
-    expire_time = timer_list->active_timers->expire_time;
+    expire_time = timerlist_first(timer_list)->expire_time;
     qemu_mutex_unlock(&timer_list->active_timers_lock);
 
     return expire_time < qemu_clock_get_ns(timer_list->clock->type);
@@ -222,11 +297,11 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
      * the caller should notice the change and there is no race condition.
      */
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    if (!timer_list->active_timers) {
+    if (!timer_list->nb_active_timers) {
         qemu_mutex_unlock(&timer_list->active_timers_lock);
         return -1;
     }
-    expire_time = timer_list->active_timers->expire_time;
+    expire_time = timerlist_first(timer_list)->expire_time;
     qemu_mutex_unlock(&timer_list->active_timers_lock);
 
     delta = expire_time - qemu_clock_get_ns(timer_list->clock->type);
@@ -235,7 +310,19 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
         return 0;
     }
 
-    return delta;
+    /* Waking up later lets the timers that expire in the meantime run
+     * after the same wakeup. */
+    return delta + timer_slack_ns;
+}
+
+void qemu_set_timer_slack_ns(int64_t slack)
+{
+    timer_slack_ns = MAX(slack, 0);
+#ifdef CONFIG_PRCTL_PR_SET_TIMERSLACK
+    if (timer_slack_ns > 0) {
+        prctl(PR_SET_TIMERSLACK, (unsigned long)timer_slack_ns, 0, 0, 0);
+    }
+#endif
 }
 
 /* Calculate the soonest deadline across all timerlists attached
@@ -331,6 +418,7 @@ void timer_init(QEMUTimer *ts,
     ts->opaque = opaque;
     ts->scale = scale;
     ts->expire_time = -1;
+    ts->heap_index = -1;
 }
 
 void timer_free(QEMUTimer *ts)
@@ -340,41 +428,31 @@ void timer_free(QEMUTimer *ts)
 
 static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
 {
-    QEMUTimer **pt, *t;
-
     ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            *pt = t->next;
-            break;
-        }
-        pt = &t->next;
+    if (ts->heap_index >= 0) {
+        timer_heap_remove(timer_list, ts);
     }
 }
 
 static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
                                 QEMUTimer *ts, int64_t expire_time)
 {
-    QEMUTimer **pt, *t;
+    int index = timer_list->nb_active_timers;
 
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
-    for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
-            break;
-        }
-        pt = &t->next;
+    if (index == timer_list->max_active_timers) {
+        timer_list->max_active_timers = MAX(16, 2 * index);
+        timer_list->active_timers =
+            g_realloc(timer_list->active_timers,
+                      timer_list->max_active_timers * sizeof(QEMUTimer *));
     }
+    /* Timers with the same expire_time run in the order they were set. */
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    *pt = ts;
+    ts->order = timer_list->next_order++;
+    timer_list->nb_active_timers++;
+    timer_heap_set(timer_list, index, ts);
+    timer_heap_fix(timer_list, index);
 
-    return pt == &timer_list->active_timers;
+    return ts->heap_index == 0;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -455,6 +533,11 @@ bool timer_expired(QEMUTimer *timer_head, int64_t current_time)
     return timer_expired_ns(timer_head, current_time * timer_head->scale);
 }
 
+/* Counters of the timer callbacks run, and of the timer list runs that
+ * ran at least one, per clock. See init_clocks(). */
+static Metric *timer_callback_metrics[QEMU_CLOCK_MAX];
+static Metric *timer_wakeup_metrics[QEMU_CLOCK_MAX];
+
 bool timerlist_run_timers(QEMUTimerList *timer_list)
 {
     QEMUTimer *ts;
@@ -471,26 +554,32 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     current_time = qemu_clock_get_ns(timer_list->clock->type);
     for(;;) {
         qemu_mutex_lock(&timer_list->active_timers_lock);
-        ts = timer_list->active_timers;
+        ts = timerlist_first(timer_list);
         if (!timer_expired_ns(ts, current_time)) {
             qemu_mutex_unlock(&timer_list->active_timers_lock);
             break;
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
-        ts->expire_time = -1;
+        timer_del_locked(timer_list, ts);
         cb = ts->cb;
         opaque = ts->opaque;
         qemu_mutex_unlock(&timer_list->active_timers_lock);
 
         /* run the callback (the timer list can be modified) */
+        TRACE_BEGIN(TRACE_CATEGORY_TIMERS, "timer callback");
         cb(opaque);
+        TRACE_END(TRACE_CATEGORY_TIMERS, "timer callback");
+        if (timer_callback_metrics[timer_list->clock->type]) {
+            metric_add(timer_callback_metrics[timer_list->clock->type], 1);
+        }
         progress = true;
     }
 
 out:
+    if (progress && timer_wakeup_metrics[timer_list->clock->type]) {
+        metric_add(timer_wakeup_metrics[timer_list->clock->type], 1);
+    }
     qemu_event_set(&timer_list->timers_done_ev);
     return progress;
 }
@@ -582,9 +671,20 @@ void qemu_clock_unregister_reset_notifier(QEMUClockType type,
 
 void init_clocks(void)
 {
+    static const char * const labels[QEMU_CLOCK_MAX] = {
+        [QEMU_CLOCK_REALTIME] = "clock=\"realtime\"",
+        [QEMU_CLOCK_VIRTUAL] = "clock=\"virtual\"",
+        [QEMU_CLOCK_HOST] = "clock=\"host\"",
+    };
     QEMUClockType type;
     for (type = 0; type < QEMU_CLOCK_MAX; type++) {
         qemu_clock_init(type);
+        timer_callback_metrics[type] = metrics_counter(
+                "emulator_timer_callbacks_total", labels[type],
+                "Timer callbacks run");
+        timer_wakeup_metrics[type] = metrics_counter(
+                "emulator_timer_wakeups_total", labels[type],
+                "Timer list runs that found expired timers");
     }
 
 #ifdef CONFIG_PRCTL_PR_SET_TIMERSLACK
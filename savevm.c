@@ -89,7 +89,9 @@
 #include "qemu/sockets.h"
 #include "qemu/timer.h"
 #include "qemu/queue.h"
+#include "exec/hax.h"
 #include "android/snapshot.h"
+#include "android/snapshot-flat.h"
 
 
 #define SELF_ANNOUNCE_ROUNDS 5
@@ -567,29 +569,135 @@ fail:
     return NULL;
 }
 
-#ifndef CONFIG_ANDROID
-// TODO(digit): Once bdrv_writev_vmstate() is implemented.
+/*
+ * VM states are written to the snapshot image through large buffers,
+ * so that the block driver receives a few requests of several MB instead
+ * of one per IO_BUF_SIZE. Two buffers are used in turn: once one is full,
+ * it is written asynchronously with bdrv_aio_save_vmstate(), while the
+ * next part of the state is serialized into the other one.
+ *
+ * The buffers are aligned on pages, and start at VM state positions that
+ * are multiples of their size, thus of the cluster size, so that images
+ * opened with cache=none (O_DIRECT) write them without bounce buffers.
+ */
+#define BDRV_FILE_BUF_SIZE   (4 << 20)
+#define BDRV_FILE_BUF_ALIGN  4096
+
+typedef struct QEMUFileBdrv QEMUFileBdrv;
+
+typedef struct {
+    QEMUFileBdrv *s;
+    uint8_t *data;
+    int64_t pos;        /* VM state position of data[0] */
+    int len;
+    int busy;           /* being written */
+} QEMUFileBdrvBuffer;
+
+struct QEMUFileBdrv {
+    BlockDriverState *bs;
+    QEMUFileBdrvBuffer bufs[2];
+    int cur;            /* index of the buffer being filled */
+    int error;
+};
+
+static void block_write_done(void *opaque, int ret)
+{
+    QEMUFileBdrvBuffer *b = opaque;
+
+    if (ret < 0 && b->s->error == 0) {
+        b->s->error = ret;
+    }
+    b->busy = 0;
+}
+
+static void block_wait_buffer(QEMUFileBdrvBuffer *b)
+{
+    while (b->busy) {
+        qemu_aio_wait();
+    }
+}
+
+/* Start writing the current buffer, and switch to the other one, placed
+ * at |pos|, once it's no longer written. */
+static int block_write_buffer(QEMUFileBdrv *s, int64_t pos)
+{
+    QEMUFileBdrvBuffer *b = &s->bufs[s->cur];
+    int ret;
+
+    if (b->len > 0) {
+        b->busy = 1;
+        ret = bdrv_aio_save_vmstate(s->bs, b->data, b->pos, b->len,
+                                    block_write_done, b);
+        if (ret < 0) {
+            b->busy = 0;
+            return ret;
+        }
+        s->cur ^= 1;
+        b = &s->bufs[s->cur];
+        block_wait_buffer(b);
+    }
+    b->pos = pos;
+    b->len = 0;
+    return s->error;
+}
+
 static ssize_t block_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
                                    int64_t pos)
 {
-    int ret;
-    QEMUIOVector qiov;
+    QEMUFileBdrv *s = opaque;
+    QEMUFileBdrvBuffer *b = &s->bufs[s->cur];
+    ssize_t done = 0;
+    int ret, i;
 
-    qemu_iovec_init_external(&qiov, iov, iovcnt);
-    ret = bdrv_writev_vmstate(opaque, &qiov, pos);
-    if (ret < 0) {
-        return ret;
+    if (pos != b->pos + b->len) {
+        ret = block_write_buffer(s, pos);
+        if (ret < 0) {
+            return ret;
+        }
+        b = &s->bufs[s->cur];
     }
+    for (i = 0; i < iovcnt; i++) {
+        const uint8_t *data = iov[i].iov_base;
+        size_t size = iov[i].iov_len;
 
-    return qiov.size;
+        while (size > 0) {
+            size_t l = BDRV_FILE_BUF_SIZE - b->len;
+            if (l > size) {
+                l = size;
+            }
+            memcpy(b->data + b->len, data, l);
+            b->len += l;
+            data += l;
+            size -= l;
+            done += l;
+            if (b->len == BDRV_FILE_BUF_SIZE) {
+                ret = block_write_buffer(s, b->pos + b->len);
+                if (ret < 0) {
+                    return ret;
+                }
+                b = &s->bufs[s->cur];
+            }
+        }
+    }
+    return done;
 }
-#endif
 
-static int block_put_buffer(void *opaque, const uint8_t *buf,
-                           int64_t pos, int size)
+static int block_write_close(void *opaque)
 {
-    bdrv_save_vmstate(opaque, buf, pos, size);
-    return size;
+    QEMUFileBdrv *s = opaque;
+    int ret, i;
+
+    ret = block_write_buffer(s, 0);
+    for (i = 0; i < 2; i++) {
+        block_wait_buffer(&s->bufs[i]);
+        qemu_vfree(s->bufs[i].data);
+    }
+    if (ret == 0) {
+        ret = s->error;
+    }
+    bdrv_flush(s->bs);
+    g_free(s);
+    return ret;
 }
 
 static int block_get_buffer(void *opaque, uint8_t *buf, int64_t pos, int size)
@@ -610,15 +718,24 @@ static const QEMUFileOps bdrv_read_ops = {
 };
 
 static const QEMUFileOps bdrv_write_ops = {
-    .put_buffer     = block_put_buffer,
-    //.writev_buffer  = block_writev_buffer,
-    .close          = bdrv_fclose
+    .writev_buffer  = block_writev_buffer,
+    .close          = block_write_close
 };
 
 static QEMUFile *qemu_fopen_bdrv(BlockDriverState *bs, int is_writable)
 {
-    if (is_writable)
-        return qemu_fopen_ops(bs, &bdrv_write_ops);
+    if (is_writable) {
+        QEMUFileBdrv *s = g_malloc0(sizeof(QEMUFileBdrv));
+        int i;
+
+        s->bs = bs;
+        for (i = 0; i < 2; i++) {
+            s->bufs[i].s = s;
+            s->bufs[i].data = qemu_memalign(BDRV_FILE_BUF_ALIGN,
+                                            BDRV_FILE_BUF_SIZE);
+        }
+        return qemu_fopen_ops(s, &bdrv_write_ops);
+    }
     return qemu_fopen_ops(bs, &bdrv_read_ops);
 }
 
@@ -1012,6 +1129,89 @@ int64_t qemu_ftell(QEMUFile *f)
     return f->pos;
 }
 
+/* Only VM state files opened with qemu_fopen_bdrv() support random access:
+ * their get_buffer() callback reads at an arbitrary position. */
+bool qemu_file_is_seekable(QEMUFile *f)
+{
+    return f->ops == &bdrv_read_ops;
+}
+
+QEMUFile *qemu_file_dup_reader(QEMUFile *f)
+{
+    if (!qemu_file_is_seekable(f)) {
+        return NULL;
+    }
+    return qemu_fopen_ops(f->opaque, f->ops);
+}
+
+int64_t qemu_file_get_pos(QEMUFile *f)
+{
+    if (qemu_file_is_writable(f)) {
+        return f->pos + f->buf_index;
+    }
+    return f->pos - f->buf_size + f->buf_index;
+}
+
+int qemu_file_get_cluster_size(QEMUFile *f)
+{
+    BlockDriverInfo bdi;
+
+    if (f->ops != &bdrv_write_ops ||
+        bdrv_get_info(((QEMUFileBdrv *)f->opaque)->bs, &bdi) < 0) {
+        return 0;
+    }
+    return bdi.cluster_size;
+}
+
+int64_t qemu_file_map(QEMUFile *f, int64_t pos, int *size,
+                      const char **filename)
+{
+    if (!qemu_file_is_seekable(f)) {
+        return -ENOTSUP;
+    }
+    return bdrv_map_vmstate(f->opaque, pos, size, filename);
+}
+
+int qemu_file_skip_forward(QEMUFile *f, int64_t size)
+{
+    uint8_t buf[256];
+
+    if (size <= f->buf_size - f->buf_index) {
+        f->buf_index += size;
+        return 0;
+    }
+    if (qemu_file_is_seekable(f)) {
+        f->pos = qemu_file_get_pos(f) + size;
+        f->buf_index = 0;
+        f->buf_size = 0;
+        return 0;
+    }
+    while (size > 0) {
+        int len = size < (int64_t)sizeof(buf) ? (int)size : (int)sizeof(buf);
+        if (qemu_get_buffer(f, buf, len) != len) {
+            return -EIO;
+        }
+        size -= len;
+    }
+    return 0;
+}
+
+int qemu_file_pread(QEMUFile *f, uint8_t *buf, int64_t pos, int size)
+{
+    int done = 0;
+
+    assert(qemu_file_is_seekable(f));
+    while (done < size) {
+        int len = f->ops->get_buffer(f->opaque, buf + done, pos + done,
+                                     size - done);
+        if (len <= 0) {
+            return len < 0 ? len : -EIO;
+        }
+        done += len;
+    }
+    return done;
+}
+
 int qemu_file_rate_limit(QEMUFile *f)
 {
     if (qemu_file_get_error(f)) {
@@ -2128,6 +2328,34 @@ int qemu_savevm_state_iterate(QEMUFile *f)
     return qemu_file_get_error(f);
 }
 
+/* Write the full sections, i.e. the state of all devices but the RAM. */
+static void qemu_savevm_state_devices(QEMUFile *f)
+{
+    SaveStateEntry *se;
+
+    QTAILQ_FOREACH(se, &savevm_handlers, entry) {
+        int len;
+
+        if ((!se->ops || !se->ops->save_state) && !se->vmsd) {
+            continue;
+        }
+
+        /* Section type */
+        qemu_put_byte(f, QEMU_VM_SECTION_FULL);
+        qemu_put_be32(f, se->section_id);
+
+        /* ID string */
+        len = strlen(se->idstr);
+        qemu_put_byte(f, len);
+        qemu_put_buffer(f, (uint8_t *)se->idstr, len);
+
+        qemu_put_be32(f, se->instance_id);
+        qemu_put_be32(f, se->version_id);
+
+        vmstate_save(f, se);
+    }
+}
+
 int qemu_savevm_state_complete(QEMUFile *f)
 {
     SaveStateEntry *se;
@@ -2153,27 +2381,7 @@ int qemu_savevm_state_complete(QEMUFile *f)
         se->ops->save_live_state(f, QEMU_VM_SECTION_END, se->opaque);
     }
 
-    QTAILQ_FOREACH(se, &savevm_handlers, entry) {
-        int len;
-
-        if ((!se->ops || !se->ops->save_state) && !se->vmsd) {
-            continue;
-        }
-
-        /* Section type */
-        qemu_put_byte(f, QEMU_VM_SECTION_FULL);
-        qemu_put_be32(f, se->section_id);
-
-        /* ID string */
-        len = strlen(se->idstr);
-        qemu_put_byte(f, len);
-        qemu_put_buffer(f, (uint8_t *)se->idstr, len);
-
-        qemu_put_be32(f, se->instance_id);
-        qemu_put_be32(f, se->version_id);
-
-        vmstate_save(f, se);
-    }
+    qemu_savevm_state_devices(f);
 
     qemu_put_byte(f, QEMU_VM_EOF);
     qemu_fflush(f);
@@ -2476,39 +2684,16 @@ static int bdrv_snapshot_find(BlockDriverState *bs, QEMUSnapshotInfo *sn_info,
     return ret;
 }
 
-void do_savevm(Monitor *err, const char *name)
+/* Fill |sn| for a new snapshot of |bs| named |name|. If a snapshot with this
+ * name already exists, store it into |old_sn| and return 1, so that
+ * savevm_create_snapshots() replaces it. Return 0 otherwise. */
+static int savevm_init_info(BlockDriverState *bs, const char *name,
+                            QEMUSnapshotInfo *sn, QEMUSnapshotInfo *old_sn)
 {
-    BlockDriverState *bs, *bs1;
-    QEMUSnapshotInfo sn1, *sn = &sn1, old_sn1, *old_sn = &old_sn1;
-    int must_delete, ret;
-    BlockDriverInfo bdi1, *bdi = &bdi1;
-    QEMUFile *f;
-    int saved_vm_running;
-    uint32_t vm_state_size;
-#ifdef _WIN32
-    struct _timeb tb;
-#else
-    struct timeval tv;
-#endif
-
-    bs = bdrv_snapshots();
-    if (!bs) {
-        monitor_printf(err, "No block device can accept snapshots\n");
-        return;
-    }
-
-    /* ??? Should this occur after vm_stop?  */
-    qemu_aio_flush();
+    int must_delete = 0;
 
-    saved_vm_running = vm_running;
-    vm_stop(0);
-
-    must_delete = 0;
-    if (name) {
-        ret = bdrv_snapshot_find(bs, old_sn, name);
-        if (ret >= 0) {
-            must_delete = 1;
-        }
+    if (name && bdrv_snapshot_find(bs, old_sn, name) >= 0) {
+        must_delete = 1;
     }
     memset(sn, 0, sizeof(*sn));
     if (must_delete) {
@@ -2518,40 +2703,57 @@ void do_savevm(Monitor *err, const char *name)
         if (name)
             pstrcpy(sn->name, sizeof(sn->name), name);
     }
+    return must_delete;
+}
 
-    /* fill auxiliary fields */
+/* Record the current time into |sn|. The VM must be stopped. */
+static void savevm_set_time(QEMUSnapshotInfo *sn)
+{
 #ifdef _WIN32
+    struct _timeb tb;
+
     _ftime(&tb);
     sn->date_sec = tb.time;
     sn->date_nsec = tb.millitm * 1000000;
 #else
+    struct timeval tv;
+
     gettimeofday(&tv, NULL);
     sn->date_sec = tv.tv_sec;
     sn->date_nsec = tv.tv_usec * 1000;
 #endif
     sn->vm_clock_nsec = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+}
+
+/* Open the VM state of the snapshot device |bs| for writing. */
+static QEMUFile *savevm_open_state(Monitor *err, BlockDriverState *bs)
+{
+    BlockDriverInfo bdi1, *bdi = &bdi1;
+    QEMUFile *f;
 
     if (bdrv_get_info(bs, bdi) < 0 || bdi->vm_state_offset <= 0) {
         monitor_printf(err, "Device %s does not support VM state snapshots\n",
                               bdrv_get_device_name(bs));
-        goto the_end;
+        return NULL;
     }
 
-    /* save the VM state */
     f = qemu_fopen_bdrv(bs, 1);
     if (!f) {
         monitor_printf(err, "Could not open VM state file\n");
-        goto the_end;
-    }
-    ret = qemu_savevm_state(f);
-    vm_state_size = qemu_ftell(f);
-    qemu_fclose(f);
-    if (ret < 0) {
-        monitor_printf(err, "Error %d while writing VM\n", ret);
-        goto the_end;
     }
+    return f;
+}
 
-    /* create the snapshots */
+/* Create the snapshot |sn| on all devices, once its VM state of
+ * |vm_state_size| bytes was written to |bs|. */
+/* Returns -1 if the snapshot of any of the disks couldn't be created. */
+static int savevm_create_snapshots(Monitor *err, BlockDriverState *bs,
+                                   QEMUSnapshotInfo *sn,
+                                   QEMUSnapshotInfo *old_sn,
+                                   int must_delete, uint32_t vm_state_size)
+{
+    BlockDriverState *bs1;
+    int ret, status = 0;
 
     bs1 = NULL;
     while ((bs1 = bdrv_next(bs1))) {
@@ -2570,46 +2772,670 @@ void do_savevm(Monitor *err, const char *name)
             if (ret < 0) {
                 monitor_printf(err, "Error while creating snapshot on '%s'\n",
                                       bdrv_get_device_name(bs1));
+                status = -1;
             }
         }
     }
+    return status;
+}
 
- the_end:
-    if (saved_vm_running)
-        vm_start();
+static void savevm_live_cancel(void);
+
+/*
+ * Flat snapshots: with -snapshot-flat <dir>, the VM state of each snapshot
+ * is stored in its own file, described in android/snapshot-flat.h, instead
+ * of the qcow2 snapshot storage. The RAM is written as-is, apart from the
+ * stream of the other devices, so that ram_load_flat() can map it. Disk
+ * images are not snapshotted in this mode.
+ *
+ * A snapshot is written to a temporary file, which then replaces the
+ * previous one, so that it is never left half-written.
+ */
+
+#ifndef _WIN32
+typedef struct QEMUFileFlat {
+    int fd;
+    int64_t base;       /* offset of the stream in the file */
+    int64_t size;       /* of the stream, when reading */
+} QEMUFileFlat;
+
+static int flat_put_buffer(void *opaque, const uint8_t *buf,
+                           int64_t pos, int size)
+{
+    QEMUFileFlat *s = opaque;
+    int done = 0;
+
+    while (done < size) {
+        ssize_t ret = pwrite(s->fd, buf + done, size - done,
+                             s->base + pos + done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        done += ret;
+    }
+    return size;
 }
 
-void do_loadvm(Monitor *err, const char *name)
+static int flat_get_buffer(void *opaque, uint8_t *buf, int64_t pos, int size)
 {
-    BlockDriverState *bs, *bs1;
-    BlockDriverInfo bdi1, *bdi = &bdi1;
-    QEMUSnapshotInfo sn;
-    QEMUFile *f;
-    int ret;
-    int saved_vm_running;
+    QEMUFileFlat *s = opaque;
+    ssize_t ret;
 
-    bs = bdrv_snapshots();
-    if (!bs) {
-        monitor_printf(err, "No block device supports snapshots\n");
-        return;
+    if (size > s->size - pos) {
+        size = s->size - pos;
+    }
+    if (size <= 0) {
+        return 0;
     }
+    do {
+        ret = pread(s->fd, buf, size, s->base + pos);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? -errno : ret;
+}
 
-    /* Flush all IO requests so they don't interfere with the new state.  */
-    qemu_aio_flush();
+static int flat_fclose(void *opaque)
+{
+    g_free(opaque);
+    return 0;
+}
 
-    saved_vm_running = vm_running;
-    vm_stop(0);
+static const QEMUFileOps flat_read_ops = {
+    .get_buffer = flat_get_buffer,
+    .close =      flat_fclose
+};
 
-    bs1 = bs;
-    do {
-        if (bdrv_can_snapshot(bs1)) {
-            ret = bdrv_snapshot_goto(bs1, name);
-            if (ret < 0) {
-                if (bs != bs1)
-                    monitor_printf(err, "Warning: ");
-                switch(ret) {
-                case -ENOTSUP:
-                    monitor_printf(err,
+static const QEMUFileOps flat_write_ops = {
+    .put_buffer = flat_put_buffer,
+    .close =      flat_fclose
+};
+
+static QEMUFile *qemu_fopen_flat(int fd, int64_t base, int64_t size,
+                                 int is_writable)
+{
+    QEMUFileFlat *s = g_malloc0(sizeof(QEMUFileFlat));
+
+    s->fd = fd;
+    s->base = base;
+    s->size = size;
+    return qemu_fopen_ops(s, is_writable ? &flat_write_ops : &flat_read_ops);
+}
+
+static char *savevm_flat_path(const char *name)
+{
+    return g_strdup_printf("%s/%s%s", savevm_flat_dir, name,
+                           SNAPSHOT_FLAT_SUFFIX);
+}
+
+/* Read and check the header of a flat snapshot file. */
+static int savevm_flat_read_header(int fd, SnapshotFlatHeader *header)
+{
+    ssize_t ret;
+
+    do {
+        ret = pread(fd, header, sizeof(*header), 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return -errno;
+    }
+    if (ret != sizeof(*header) ||
+        be32_to_cpu(header->magic) != SNAPSHOT_FLAT_MAGIC ||
+        be32_to_cpu(header->header_size) != SNAPSHOT_FLAT_HEADER_SIZE ||
+        be32_to_cpu(header->alignment) != SNAPSHOT_FLAT_ALIGN) {
+        return -EINVAL;
+    }
+    if (be32_to_cpu(header->version) != SNAPSHOT_FLAT_VERSION) {
+        return -ENOTSUP;
+    }
+    header->name[sizeof(header->name) - 1] = 0;
+    return 0;
+}
+
+/* Write the snapshot |name| to |fd|. */
+static int savevm_flat_write(int fd, const char *name)
+{
+    SnapshotFlatHeader *header = g_malloc0(SNAPSHOT_FLAT_HEADER_SIZE);
+    QEMUSnapshotInfo sn;
+    QEMUFile *f;
+    int64_t state_size;
+    int ret;
+
+    header->magic = cpu_to_be32(SNAPSHOT_FLAT_MAGIC);
+    header->version = cpu_to_be32(SNAPSHOT_FLAT_VERSION);
+    header->header_size = cpu_to_be32(SNAPSHOT_FLAT_HEADER_SIZE);
+    header->alignment = cpu_to_be32(SNAPSHOT_FLAT_ALIGN);
+    pstrcpy(header->name, sizeof(header->name), name);
+    savevm_set_time(&sn);
+    header->date_sec = cpu_to_be32(sn.date_sec);
+    header->date_nsec = cpu_to_be32(sn.date_nsec);
+    header->vm_clock_nsec = cpu_to_be64(sn.vm_clock_nsec);
+
+    f = qemu_fopen_flat(fd, SNAPSHOT_FLAT_HEADER_SIZE, 0, 1);
+    qemu_put_be32(f, QEMU_VM_FILE_MAGIC);
+    qemu_put_be32(f, QEMU_VM_FILE_VERSION);
+    qemu_savevm_state_devices(f);
+    qemu_put_byte(f, QEMU_VM_EOF);
+    state_size = qemu_ftell(f);
+    ret = qemu_fclose(f);
+    if (ret < 0) {
+        goto out;
+    }
+    header->state_offset = cpu_to_be64(SNAPSHOT_FLAT_HEADER_SIZE);
+    header->state_size = cpu_to_be64(state_size);
+    header->ram_offset = cpu_to_be64(
+            ROUND_UP(SNAPSHOT_FLAT_HEADER_SIZE + state_size,
+                     SNAPSHOT_FLAT_ALIGN));
+
+    ret = ram_save_flat(fd, header);
+    if (ret < 0) {
+        goto out;
+    }
+
+    /* Write the header last, the file isn't valid until then */
+    f = qemu_fopen_flat(fd, 0, 0, 1);
+    qemu_put_buffer(f, (uint8_t *)header, SNAPSHOT_FLAT_HEADER_SIZE);
+    ret = qemu_fclose(f);
+    if (ret >= 0 && qemu_fdatasync(fd) < 0) {
+        ret = -errno;
+    }
+out:
+    g_free(header);
+    return ret;
+}
+
+static int do_savevm_flat(Monitor *err, const char *name)
+{
+    char *path = savevm_flat_path(name);
+    char *tmp_path = g_strdup_printf("%s.tmp", path);
+    int saved_vm_running = vm_running;
+    int fd, ret = -1;
+
+    if (qemu_savevm_state_blocked(NULL)) {
+        monitor_printf(err, "The current state can't be saved\n");
+        goto out;
+    }
+
+    savevm_live_cancel();
+    qemu_aio_flush();
+    vm_stop(0);
+    bdrv_flush_all();
+
+    /* The new file may replace the one pages are mapped from */
+    ram_lazy_load_all();
+
+    fd = qemu_open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (fd < 0) {
+        monitor_printf(err, "Could not create '%s': %s\n", tmp_path,
+                       strerror(errno));
+        goto the_end;
+    }
+    ret = savevm_flat_write(fd, name);
+    close(fd);
+    if (ret >= 0 && rename(tmp_path, path) < 0) {
+        ret = -errno;
+    }
+    if (ret < 0) {
+        monitor_printf(err, "Error %d while writing VM to '%s'\n", ret, path);
+        unlink(tmp_path);
+    }
+
+ the_end:
+    if (saved_vm_running)
+        vm_start();
+ out:
+    g_free(tmp_path);
+    g_free(path);
+    return ret < 0 ? -1 : 0;
+}
+
+static void do_loadvm_flat(Monitor *err, const char *name)
+{
+    char *path = savevm_flat_path(name);
+    SnapshotFlatHeader *header = g_malloc0(sizeof(SnapshotFlatHeader));
+    int saved_vm_running = vm_running;
+    QEMUFile *f;
+    int fd, ret;
+
+    fd = qemu_open(path, O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        monitor_printf(err, "Could not find snapshot '%s' in '%s'\n",
+                       name, savevm_flat_dir);
+        goto out;
+    }
+    ret = savevm_flat_read_header(fd, header);
+    if (ret < 0) {
+        monitor_printf(err, "'%s' is not a valid snapshot file\n", path);
+        goto out;
+    }
+
+    /* Flush all IO requests so they don't interfere with the new state.  */
+    qemu_aio_flush();
+
+    savevm_live_cancel();
+    vm_stop(0);
+
+    /* Pending pages are read from the state that is about to be replaced */
+    ram_lazy_load_all();
+
+    ret = ram_load_flat(fd, path, header);
+    if (ret < 0) {
+        monitor_printf(err, "Error %d while loading RAM\n", ret);
+        goto the_end;
+    }
+    f = qemu_fopen_flat(fd, be64_to_cpu(header->state_offset),
+                        be64_to_cpu(header->state_size), 0);
+    ret = qemu_loadvm_state(f);
+    qemu_fclose(f);
+    if (ret < 0) {
+        monitor_printf(err, "Error %d while loading VM state\n", ret);
+    }
+
+ the_end:
+    if (saved_vm_running)
+        vm_start();
+ out:
+    if (fd >= 0) {
+        close(fd);
+    }
+    g_free(header);
+    g_free(path);
+}
+
+static void do_delvm_flat(Monitor *err, const char *name)
+{
+    char *path = savevm_flat_path(name);
+
+    savevm_live_cancel();
+    ram_lazy_load_all();
+
+    if (unlink(path) < 0) {
+        monitor_printf(err, "Error %d while deleting snapshot '%s'\n",
+                       -errno, name);
+    }
+    g_free(path);
+}
+
+static void do_info_snapshots_flat(Monitor *out, Monitor *err)
+{
+    SnapshotFlatHeader *header = g_malloc0(sizeof(SnapshotFlatHeader));
+    DIR *dir = opendir(savevm_flat_dir);
+    struct dirent *entry;
+    char buf[256];
+
+    if (!dir) {
+        monitor_printf(err, "Could not open '%s': %s\n", savevm_flat_dir,
+                       strerror(errno));
+        g_free(header);
+        return;
+    }
+    monitor_printf(out, "Snapshot list (from %s):\n", savevm_flat_dir);
+    monitor_printf(out, "%s\n", bdrv_snapshot_dump(buf, sizeof(buf), NULL));
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        size_t suffix_len = strlen(SNAPSHOT_FLAT_SUFFIX);
+        QEMUSnapshotInfo sn;
+        char *path;
+        int fd;
+
+        if (len <= suffix_len ||
+            strcmp(entry->d_name + len - suffix_len, SNAPSHOT_FLAT_SUFFIX)) {
+            continue;
+        }
+        path = g_strdup_printf("%s/%s", savevm_flat_dir, entry->d_name);
+        fd = qemu_open(path, O_RDONLY | O_BINARY);
+        g_free(path);
+        if (fd < 0) {
+            continue;
+        }
+        if (savevm_flat_read_header(fd, header) == 0) {
+            memset(&sn, 0, sizeof(sn));
+            pstrcpy(sn.name, sizeof(sn.name), header->name);
+            sn.vm_state_size = be64_to_cpu(header->state_size) +
+                               be64_to_cpu(header->ram_size);
+            sn.date_sec = be32_to_cpu(header->date_sec);
+            sn.date_nsec = be32_to_cpu(header->date_nsec);
+            sn.vm_clock_nsec = be64_to_cpu(header->vm_clock_nsec);
+            monitor_printf(out, "%s\n",
+                           bdrv_snapshot_dump(buf, sizeof(buf), &sn));
+        }
+        close(fd);
+    }
+    closedir(dir);
+    g_free(header);
+}
+#endif  /* !_WIN32 */
+
+int do_savevm(Monitor *err, const char *name)
+{
+    BlockDriverState *bs;
+    QEMUSnapshotInfo sn1, *sn = &sn1, old_sn1, *old_sn = &old_sn1;
+    int must_delete, ret = -1;
+    QEMUFile *f;
+    int saved_vm_running;
+    uint32_t vm_state_size;
+
+#ifndef _WIN32
+    if (savevm_flat_dir) {
+        return do_savevm_flat(err, name);
+    }
+#endif
+
+    bs = bdrv_snapshots();
+    if (!bs) {
+        monitor_printf(err, "No block device can accept snapshots\n");
+        return -1;
+    }
+
+    savevm_live_cancel();
+
+    /* ??? Should this occur after vm_stop?  */
+    qemu_aio_flush();
+
+    saved_vm_running = vm_running;
+    vm_stop(0);
+
+    /* The new state may overwrite the one pending pages are read from */
+    ram_lazy_load_all();
+
+    must_delete = savevm_init_info(bs, name, sn, old_sn);
+
+    /* fill auxiliary fields */
+    savevm_set_time(sn);
+
+    /* save the VM state */
+    f = savevm_open_state(err, bs);
+    if (!f) {
+        goto the_end;
+    }
+    ret = qemu_savevm_state(f);
+    vm_state_size = qemu_ftell(f);
+    qemu_fclose(f);
+    if (ret < 0) {
+        monitor_printf(err, "Error %d while writing VM\n", ret);
+        goto the_end;
+    }
+
+    /* create the snapshots */
+    ret = savevm_create_snapshots(err, bs, sn, old_sn, must_delete,
+                                  vm_state_size);
+
+ the_end:
+    if (saved_vm_running)
+        vm_start();
+    return ret < 0 ? -1 : 0;
+}
+
+/*
+ * Live snapshots: do_savevm_live() saves a snapshot while the guest keeps
+ * running, the way a live migration would send it. The RAM is written to
+ * the VM state from a timer, a chunk at a time, while dirty memory
+ * tracking records the pages the guest modifies meanwhile, which the next
+ * passes write again. Once few enough dirty pages remain, the guest is
+ * stopped to write them along with the device states, and the snapshots
+ * of the disks are taken, so that the guest only pauses for this last
+ * step.
+ *
+ * Disk writes are flushed before each chunk, since the VM state is stored
+ * in the same image. This needs dirty memory tracking, which HAX doesn't
+ * provide, so do_savevm_live() falls back to do_savevm() there, as well as
+ * for flat snapshots.
+ */
+
+#define SAVEVM_LIVE_PERIOD_MS   10
+/* Bytes of RAM written to the VM state at each period. The guest is
+ * stopped once the dirty RAM fits into a single chunk. */
+#define SAVEVM_LIVE_CHUNK       (4 << 20)
+/* Stop the guest anyway after writing this many times its RAM, when it
+ * modifies pages faster than they are saved. */
+#define SAVEVM_LIVE_MAX_PASSES  4
+
+static struct {
+    QEMUFile *file;
+    QEMUTimer *timer;
+    BlockDriverState *bs;
+    QEMUSnapshotInfo sn;
+    QEMUSnapshotInfo old_sn;
+    int must_delete;
+    int64_t start_ms;
+    char status[256];   /* result of the last live save */
+    int status_len;
+} savevm_live;
+
+static int savevm_live_error_cb(void *opaque, const char *str, int strsize)
+{
+    int avail = sizeof(savevm_live.status) - 1 - savevm_live.status_len;
+
+    if (strsize > avail) {
+        strsize = avail;
+    }
+    memcpy(savevm_live.status + savevm_live.status_len, str, strsize);
+    savevm_live.status_len += strsize;
+    savevm_live.status[savevm_live.status_len] = 0;
+    return strsize;
+}
+
+static void savevm_live_set_status(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(savevm_live.status, sizeof(savevm_live.status), fmt, ap);
+    va_end(ap);
+    savevm_live.status_len = strlen(savevm_live.status);
+}
+
+/* Stop saving the live snapshot in progress. */
+static void savevm_live_abort(void)
+{
+    SaveStateEntry *se;
+
+    QTAILQ_FOREACH(se, &savevm_handlers, entry) {
+        if (se->ops && se->ops->save_live_state) {
+            se->ops->save_live_state(savevm_live.file, -1, se->opaque);
+        }
+    }
+    timer_del(savevm_live.timer);
+    qemu_fclose(savevm_live.file);
+    savevm_live.file = NULL;
+}
+
+/* Abort the live save in progress, if any. */
+static void savevm_live_cancel(void)
+{
+    if (!savevm_live.file) {
+        return;
+    }
+    savevm_live_abort();
+    savevm_live_set_status("saving snapshot '%s' was cancelled\n",
+                           savevm_live.sn.name);
+}
+
+static void savevm_live_complete(void)
+{
+    QEMUFile *f = savevm_live.file;
+    Monitor *err;
+    int64_t stop_ms;
+    uint32_t vm_state_size;
+    int ret;
+
+    stop_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    vm_stop(0);
+    qemu_aio_flush();
+    bdrv_flush_all();
+
+    savevm_set_time(&savevm_live.sn);
+    qemu_file_set_rate_limit(f, 0);
+    qemu_savevm_state_complete(f);
+    ret = qemu_file_get_error(f);
+    vm_state_size = qemu_ftell(f);
+    timer_del(savevm_live.timer);
+    qemu_fclose(f);
+    savevm_live.file = NULL;
+
+    savevm_live.status_len = 0;
+    savevm_live.status[0] = 0;
+    err = monitor_fake_new(NULL, savevm_live_error_cb);
+    if (ret < 0) {
+        monitor_printf(err, "Error %d while writing VM\n", ret);
+    } else {
+        savevm_create_snapshots(err, savevm_live.bs, &savevm_live.sn,
+                                &savevm_live.old_sn, savevm_live.must_delete,
+                                vm_state_size);
+    }
+    monitor_fake_free(err);
+
+    vm_start();
+
+    if (savevm_live.status_len == 0) {
+        int64_t now_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+        savevm_live_set_status("saved snapshot '%s' in %" PRId64
+                               " ms, with a downtime of %" PRId64 " ms\n",
+                               savevm_live.sn.name,
+                               now_ms - savevm_live.start_ms,
+                               now_ms - stop_ms);
+    }
+}
+
+static void savevm_live_timer_cb(void *opaque)
+{
+    QEMUFile *f = savevm_live.file;
+    int ret;
+
+    qemu_aio_flush();
+    qemu_file_reset_rate_limit(f);
+    ret = qemu_savevm_state_iterate(f);
+    if (ret == 0) {
+        ret = qemu_file_get_error(f);
+    }
+    if (ret < 0) {
+        savevm_live_abort();
+        savevm_live_set_status("Error %d while writing VM\n", ret);
+        return;
+    }
+    if (ret > 0 || ram_bytes_remaining() <= SAVEVM_LIVE_CHUNK ||
+        ram_bytes_transferred() >
+                SAVEVM_LIVE_MAX_PASSES * ram_bytes_total()) {
+        savevm_live_complete();
+        return;
+    }
+    timer_mod(savevm_live.timer,
+              qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + SAVEVM_LIVE_PERIOD_MS);
+}
+
+void do_savevm_live(Monitor *err, const char *name)
+{
+    BlockDriverState *bs;
+    QEMUFile *f;
+    int ret;
+
+    if (!vm_running || hax_enabled() || savevm_flat_dir) {
+        do_savevm(err, name);
+        return;
+    }
+
+    bs = bdrv_snapshots();
+    if (!bs) {
+        monitor_printf(err, "No block device can accept snapshots\n");
+        return;
+    }
+    if (qemu_savevm_state_blocked(NULL)) {
+        monitor_printf(err, "The current state can't be saved\n");
+        return;
+    }
+
+    savevm_live_cancel();
+    qemu_aio_flush();
+
+    /* The new state may overwrite the one pending pages are read from */
+    ram_lazy_load_all();
+
+    f = savevm_open_state(err, bs);
+    if (!f) {
+        return;
+    }
+    savevm_live.bs = bs;
+    savevm_live.must_delete = savevm_init_info(bs, name, &savevm_live.sn,
+                                               &savevm_live.old_sn);
+    savevm_live.start_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    savevm_live.file = f;
+    if (!savevm_live.timer) {
+        savevm_live.timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                         savevm_live_timer_cb, NULL);
+    }
+
+    qemu_file_set_rate_limit(f, SAVEVM_LIVE_CHUNK);
+    ret = qemu_savevm_state_begin(f);
+    if (ret < 0) {
+        savevm_live_abort();
+        monitor_printf(err, "Error %d while writing VM\n", ret);
+        return;
+    }
+    savevm_live_set_status("saving snapshot '%s'\n", savevm_live.sn.name);
+    timer_mod(savevm_live.timer,
+              qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + SAVEVM_LIVE_PERIOD_MS);
+}
+
+void do_info_savevm_live(Monitor *out)
+{
+    if (savevm_live.file) {
+        monitor_printf(out, "saving snapshot '%s': %" PRId64 " ms elapsed, "
+                       "%" PRIu64 " KB of RAM remaining\n",
+                       savevm_live.sn.name,
+                       qemu_clock_get_ms(QEMU_CLOCK_REALTIME) -
+                       savevm_live.start_ms,
+                       ram_bytes_remaining() >> 10);
+    } else if (savevm_live.status_len) {
+        monitor_printf(out, "%s", savevm_live.status);
+    } else {
+        monitor_printf(out, "no snapshot was saved live\n");
+    }
+}
+
+void do_loadvm(Monitor *err, const char *name)
+{
+    BlockDriverState *bs, *bs1;
+    BlockDriverInfo bdi1, *bdi = &bdi1;
+    QEMUSnapshotInfo sn;
+    QEMUFile *f;
+    int ret;
+    int saved_vm_running;
+
+#ifndef _WIN32
+    if (savevm_flat_dir) {
+        do_loadvm_flat(err, name);
+        return;
+    }
+#endif
+
+    bs = bdrv_snapshots();
+    if (!bs) {
+        monitor_printf(err, "No block device supports snapshots\n");
+        return;
+    }
+
+    /* Flush all IO requests so they don't interfere with the new state.  */
+    qemu_aio_flush();
+
+    savevm_live_cancel();
+
+    saved_vm_running = vm_running;
+    vm_stop(0);
+
+    /* Pending pages are read from the state that is about to be replaced */
+    ram_lazy_load_all();
+
+    bs1 = bs;
+    do {
+        if (bdrv_can_snapshot(bs1)) {
+            ret = bdrv_snapshot_goto(bs1, name);
+            if (ret < 0) {
+                if (bs != bs1)
+                    monitor_printf(err, "Warning: ");
+                switch(ret) {
+                case -ENOTSUP:
+                    monitor_printf(err,
                                    "Snapshots not supported on device '%s'\n",
                                    bdrv_get_device_name(bs1));
                     break;
@@ -2662,12 +3488,22 @@ void do_delvm(Monitor *err, const char *name)
     BlockDriverState *bs, *bs1;
     int ret;
 
+#ifndef _WIN32
+    if (savevm_flat_dir) {
+        do_delvm_flat(err, name);
+        return;
+    }
+#endif
+
     bs = bdrv_snapshots();
     if (!bs) {
         monitor_printf(err, "No block device supports snapshots\n");
         return;
     }
 
+    savevm_live_cancel();
+    ram_lazy_load_all();
+
     bs1 = NULL;
     while ((bs1 = bdrv_next(bs1))) {
         if (bdrv_can_snapshot(bs1)) {
@@ -2692,6 +3528,13 @@ void do_info_snapshots(Monitor* out, Monitor* err)
     int nb_sns, i;
     char buf[256];
 
+#ifndef _WIN32
+    if (savevm_flat_dir) {
+        do_info_snapshots_flat(out, err);
+        return;
+    }
+#endif
+
     bs = bdrv_snapshots();
     if (!bs) {
         monitor_printf(err, "No available block device supports snapshots\n");
@@ -0,0 +1,228 @@
+/*
+ * dns.c - answers the guest's DNS queries from the host name cache
+ *
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * The DNS queries that the guest sends to the emulated DNS server are
+ * forwarded to the host's DNS servers. Their answers to IPv4 address
+ * queries are stored in the cache of android/async-resolver.h, along with
+ * the host names resolved by the emulator, until their TTL expires.
+ * Queries for a cached name are answered directly, with the remaining TTL.
+ */
+
+#include <slirp.h>
+#include "android/async-resolver.h"
+
+#define DNS_HEADER_SIZE   12
+
+#define DNS_FLAG_QR       0x8000
+#define DNS_FLAG_TC       0x0200
+#define DNS_FLAG_RD       0x0100
+#define DNS_FLAG_RA       0x0080
+#define DNS_OPCODE_MASK   0x7800
+#define DNS_RCODE_MASK    0x000f
+
+#define DNS_TYPE_A        1
+#define DNS_CLASS_IN      1
+
+static u_int16_t
+dns_get16(const u_int8_t *p)
+{
+    return (u_int16_t)((p[0] << 8) | p[1]);
+}
+
+static u_int32_t
+dns_get32(const u_int8_t *p)
+{
+    return ((u_int32_t)p[0] << 24) | ((u_int32_t)p[1] << 16) |
+           ((u_int32_t)p[2] << 8) | p[3];
+}
+
+static u_int8_t *
+dns_put16(u_int8_t *p, u_int16_t value)
+{
+    p[0] = (u_int8_t)(value >> 8);
+    p[1] = (u_int8_t)value;
+    return p + 2;
+}
+
+static u_int8_t *
+dns_put32(u_int8_t *p, u_int32_t value)
+{
+    p = dns_put16(p, (u_int16_t)(value >> 16));
+    return dns_put16(p, (u_int16_t)value);
+}
+
+/*
+ * Skip the possibly compressed name at 'pos' of a message, and return the
+ * position that follows it, or -1 if it is malformed.
+ */
+static int
+dns_skip_name(const u_int8_t *msg, int len, int pos)
+{
+    while (pos < len) {
+        int label = msg[pos];
+        if (label == 0)
+            return pos + 1;
+        if ((label & 0xc0) == 0xc0)
+            return (pos + 2 <= len) ? pos + 2 : -1;
+        if (label & 0xc0)
+            return -1;
+        pos += 1 + label;
+    }
+    return -1;
+}
+
+/*
+ * Parse the single question of a message, which must ask for the IPv4
+ * addresses of a name. Store the dotted name into 'name', and return the
+ * position that follows the question, or -1.
+ */
+static int
+dns_parse_question(const u_int8_t *msg, int len, char *name, int name_size)
+{
+    int pos = DNS_HEADER_SIZE;
+    int name_len = 0;
+
+    if (len < DNS_HEADER_SIZE || dns_get16(msg + 4) != 1)
+        return -1;
+
+    /* Names in questions are never compressed. */
+    while (pos < len && msg[pos] != 0) {
+        int label = msg[pos];
+        if ((label & 0xc0) || pos + 1 + label > len ||
+            name_len + label + 1 >= name_size)
+            return -1;
+        if (name_len > 0)
+            name[name_len++] = '.';
+        memcpy(name + name_len, msg + pos + 1, label);
+        name_len += label;
+        pos += 1 + label;
+    }
+    if (name_len == 0 || pos + 5 > len)
+        return -1;
+    name[name_len] = 0;
+    pos++;
+
+    if (dns_get16(msg + pos) != DNS_TYPE_A ||
+        dns_get16(msg + pos + 2) != DNS_CLASS_IN)
+        return -1;
+    return pos + 4;
+}
+
+/*
+ * Build into 'reply' the answer to the DNS 'query' from the cache.
+ * Return its size, or 0 if the query can't be answered from the cache.
+ */
+int
+dns_cache_answer(const u_int8_t *query, int len,
+                 u_int8_t *reply, int reply_size)
+{
+    char      name[256];
+    u_int32_t ips[ASYNC_RESOLVER_MAX_ADDRESSES];
+    u_int16_t flags;
+    int       question_end, count, ttl, nn;
+    u_int8_t *p;
+
+    if (len < DNS_HEADER_SIZE)
+        return 0;
+    flags = dns_get16(query + 2);
+    if ((flags & (DNS_FLAG_QR | DNS_OPCODE_MASK)) != 0)
+        return 0;
+
+    question_end = dns_parse_question(query, len, name, sizeof(name));
+    if (question_end < 0)
+        return 0;
+
+    count = async_resolver_cache_lookup(name, ips,
+                                        ASYNC_RESOLVER_MAX_ADDRESSES, &ttl);
+    if (count == 0 ||
+        question_end + count * 16 > reply_size)
+        return 0;
+
+    /* Header: same ID, and recursion desired flag. */
+    memcpy(reply, query, 2);
+    p = dns_put16(reply + 2, DNS_FLAG_QR | DNS_FLAG_RA | (flags & DNS_FLAG_RD));
+    p = dns_put16(p, 1);
+    p = dns_put16(p, (u_int16_t)count);
+    p = dns_put16(p, 0);
+    p = dns_put16(p, 0);
+
+    /* The question, then one A record per address, named after it. */
+    memcpy(p, query + DNS_HEADER_SIZE, question_end - DNS_HEADER_SIZE);
+    p += question_end - DNS_HEADER_SIZE;
+    for (nn = 0; nn < count; nn++) {
+        p = dns_put16(p, 0xc000 | DNS_HEADER_SIZE);
+        p = dns_put16(p, DNS_TYPE_A);
+        p = dns_put16(p, DNS_CLASS_IN);
+        p = dns_put32(p, (u_int32_t)ttl);
+        p = dns_put16(p, 4);
+        p = dns_put32(p, ips[nn]);
+    }
+    return p - reply;
+}
+
+/*
+ * Store the IPv4 addresses of a DNS server's 'reply' in the cache, for the
+ * smallest TTL of its answers.
+ */
+void
+dns_cache_learn(const u_int8_t *reply, int len)
+{
+    char      name[256];
+    u_int32_t ips[ASYNC_RESOLVER_MAX_ADDRESSES];
+    u_int32_t ttl = 0xffffffff;
+    u_int16_t flags;
+    int       pos, answers, count = 0;
+
+    if (len < DNS_HEADER_SIZE)
+        return;
+    flags = dns_get16(reply + 2);
+    if ((flags & (DNS_FLAG_QR | DNS_FLAG_TC | DNS_OPCODE_MASK |
+                  DNS_RCODE_MASK)) != DNS_FLAG_QR)
+        return;
+
+    pos = dns_parse_question(reply, len, name, sizeof(name));
+    if (pos < 0)
+        return;
+
+    /* Walk the answers, which may start with a CNAME chain. */
+    for (answers = dns_get16(reply + 6); answers > 0; answers--) {
+        u_int16_t type, klass, rdlen;
+        u_int32_t record_ttl;
+
+        pos = dns_skip_name(reply, len, pos);
+        if (pos < 0 || pos + 10 > len)
+            return;
+        type = dns_get16(reply + pos);
+        klass = dns_get16(reply + pos + 2);
+        record_ttl = dns_get32(reply + pos + 4);
+        rdlen = dns_get16(reply + pos + 8);
+        pos += 10;
+        if (pos + rdlen > len)
+            return;
+
+        if (record_ttl < ttl)
+            ttl = record_ttl;
+        if (type == DNS_TYPE_A && klass == DNS_CLASS_IN && rdlen == 4 &&
+            count < ASYNC_RESOLVER_MAX_ADDRESSES)
+            ips[count++] = dns_get32(reply + pos);
+        pos += rdlen;
+    }
+
+    /* Negative answers aren't cached, their TTL is in the authority
+     * section. */
+    if (count > 0 && ttl > 0 && ttl <= 0x7fffffff)
+        async_resolver_cache_add(name, ips, count, (int)ttl);
+}
@@ -0,0 +1,10 @@
+/* dns defines */
+
+#define DNS_SERVER	53
+
+/* Maximum size of a DNS message over UDP, without EDNS */
+#define DNS_MAX_UDP_SIZE	512
+
+int dns_cache_answer(const u_int8_t *query, int len,
+                     u_int8_t *reply, int reply_size);
+void dns_cache_learn(const u_int8_t *reply, int len);
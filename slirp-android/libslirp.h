@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include "android/iolooper.h"
 #include "android/sockets.h"
 #include "slirp.h"
 #ifdef _WIN32
@@ -30,6 +31,12 @@ void slirp_select_fill(int *pnfds,
 
 void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds);
 
+/* Same as slirp_select_fill() and slirp_select_poll(), but the sockets
+ * stay registered with |looper| between calls, and only the changes
+ * are applied. Always use the same looper. */
+void slirp_looper_fill(IoLooper *looper);
+void slirp_looper_poll(IoLooper *looper);
+
 void slirp_input(const uint8_t *pkt, int pkt_len);
 
 /* you must provide the following functions: */
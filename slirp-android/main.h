@@ -34,7 +34,6 @@ extern int slirp_restrict;
 extern char *slirp_tty;
 extern char *exec_shell;
 extern u_int curtime;
-extern fd_set *global_readfds, *global_writefds, *global_xfds;
 extern uint32_t ctl_addr_ip;
 extern uint32_t special_addr_ip;
 extern uint32_t alias_addr_ip;
@@ -56,5 +55,5 @@ extern int slirp_restrict;
 #define PROTO_PPP 0x2
 #endif
 
-void if_encap(const uint8_t *ip_data, int ip_data_len);
+void if_encap(struct mbuf *ifm);
 ssize_t slirp_send(struct socket *so, const void *buf, size_t len, int flags);
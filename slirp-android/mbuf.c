@@ -19,7 +19,6 @@
 
 int mbuf_alloced = 0;
 struct mbuf m_freelist, m_usedlist;
-#define MBUF_THRESH 30
 int mbuf_max = 0;
 
 /*
@@ -28,20 +27,53 @@ int mbuf_max = 0;
  */
 #define SLIRP_MSIZE (IF_MTU + IF_MAXLINKHDR + sizeof(struct m_hdr ) + 6)
 
+/*
+ * The mbufs of the pool are allocated MBUF_SLAB_COUNT at a time, and
+ * are never freed: m_free() puts them back on the free list.  Only the
+ * mbufs needed above MBUF_POOL_MAX are malloc()ed and free()d one by one.
+ */
+#define MBUF_SLAB_SIZE  ((SLIRP_MSIZE + 15) & ~15)
+#define MBUF_SLAB_COUNT 64
+#define MBUF_POOL_MAX   1024
+static int mbuf_pooled = 0;
+
+static int
+m_grow_pool(void)
+{
+	char *slab;
+	int i;
+
+	slab = (char *)malloc(MBUF_SLAB_SIZE * MBUF_SLAB_COUNT);
+	if (slab == NULL)
+		return 0;
+
+	for (i = 0; i < MBUF_SLAB_COUNT; i++) {
+		struct mbuf *m = (struct mbuf *)(slab + i * MBUF_SLAB_SIZE);
+		insque(m,&m_freelist);
+		m->m_flags = M_FREELIST;
+	}
+	mbuf_pooled += MBUF_SLAB_COUNT;
+	mbuf_alloced += MBUF_SLAB_COUNT;
+	if (mbuf_alloced > mbuf_max)
+		mbuf_max = mbuf_alloced;
+	return 1;
+}
+
 void
 m_init(void)
 {
 	m_freelist.m_next = m_freelist.m_prev = &m_freelist;
 	m_usedlist.m_next = m_usedlist.m_prev = &m_usedlist;
+	m_grow_pool();
 }
 
 /*
- * Get an mbuf from the free list, if there are none
- * malloc one
+ * Get an mbuf from the free list, growing the pool if it is empty
+ * and not too large yet, otherwise malloc one
  *
  * Because fragmentation can occur if we alloc new mbufs and
- * free old mbufs, we mark all mbufs above mbuf_thresh as M_DOFREE,
- * which tells m_free to actually free() it
+ * free old mbufs, we mark the mbufs allocated outside of the pool
+ * as M_DOFREE, which tells m_free to actually free() it
  */
 struct mbuf *
 m_get(void)
@@ -51,12 +83,15 @@ m_get(void)
 
 	DEBUG_CALL("m_get");
 
+	if (m_freelist.m_next == &m_freelist &&
+	    mbuf_pooled < MBUF_POOL_MAX)
+		m_grow_pool();
+
 	if (m_freelist.m_next == &m_freelist) {
 		m = (struct mbuf *)malloc(SLIRP_MSIZE);
 		if (m == NULL) goto end_error;
 		mbuf_alloced++;
-		if (mbuf_alloced > MBUF_THRESH)
-			flags = M_DOFREE;
+		flags = M_DOFREE;
 		if (mbuf_alloced > mbuf_max)
 			mbuf_max = mbuf_alloced;
 	} else {
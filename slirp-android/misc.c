@@ -7,6 +7,7 @@
 
 #define WANT_SYS_IOCTL_H
 #include "slirp.h"
+#include "android/async-resolver.h"
 
 #include <unistd.h>
 
@@ -45,23 +46,30 @@ char*  inet_iptostr(uint32_t  ip)
     return buff;
 }
 
+static void
+getouraddr_done(void* opaque, const SockAddress* hostaddr, int error)
+{
+    uint32_t  ip;
+
+    if (hostaddr == NULL)
+        return;
+
+    ip = sock_address_get_ip(hostaddr);
+    if (ip != (uint32_t)-1)
+        our_addr_ip = ip;
+}
+
 /*
- * Get our IP address and put it in our_addr
+ * Get our IP address and put it in our_addr. The host name is resolved
+ * asynchronously, so that a slow DNS server doesn't stall the emulator,
+ * our_addr is the loopback address until then.
  */
 void
 getouraddr()
 {
-    char*        hostname = host_name();
-    SockAddress  hostaddr;
-
     our_addr_ip = loopback_addr_ip;
 
-    if (sock_address_init_resolve( &hostaddr, hostname, 0, 0 ) < 0)
-        return;
-
-    our_addr_ip = sock_address_get_ip(&hostaddr);
-    if (our_addr_ip == (uint32_t)-1)
-        our_addr_ip = loopback_addr_ip;
+    async_resolver_resolve(host_name(), 0, 0, getouraddr_done, NULL);
 }
 
 struct quehead {
@@ -5,6 +5,7 @@
  * terms and conditions of the copyright.
  */
 
+#include "qemu-common.h"
 #include <slirp.h>
 
 static void sbappendsb(struct sbuf *sb, struct mbuf *m);
@@ -124,6 +125,24 @@ sbappend(struct socket *so, struct mbuf *m)
 	m_free(m);
 }
 
+/*
+ * Same as sbappend(), for an in-sequence TCP segment from the guest.
+ * Unless the segment has TH_PUSH set, the guest is usually about to send
+ * the next one, so it is only buffered, up to half of the buffer, and
+ * sowrite() writes the buffered segments together from slirp_select_poll().
+ */
+void
+sbappendseg(struct socket *so, struct mbuf *m, int push)
+{
+	if (push || so->so_urgc || m->m_len <= 0 ||
+	    so->so_rcv.sb_cc + m->m_len > so->so_rcv.sb_datalen / 2) {
+		sbappend(so, m);
+		return;
+	}
+	sbappendsb(&so->so_rcv, m);
+	m_free(m);
+}
+
 /*
  * Copy the data from m into sb
  * The caller is responsible to make sure there's enough room
@@ -133,6 +152,13 @@ sbappendsb(struct sbuf *sb, struct mbuf *m)
 {
 	int len, n,  nn;
 
+	/*
+	 * The main loop may be waiting in another thread without watching
+	 * the socket for writing, make it fill its descriptors again
+	 */
+	if (sb->sb_cc == 0)
+		qemu_notify_event();
+
 	len = m->m_len;
 
 	if (sb->sb_wptr < sb->sb_rptr) {
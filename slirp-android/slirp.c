@@ -29,6 +29,8 @@
 
 #include "android/utils/debug.h"  /* for dprint */
 #include "android/utils/bufprint.h"
+#include "android/utils/metrics.h"
+#include "android/utils/trace.h"
 #include "android/android.h"
 #include "android/sockets.h"
 
@@ -75,7 +77,14 @@ FILE *lfd;
 struct ex_list *exec_list;
 
 /* XXX: suppress those select globals */
-fd_set *global_readfds, *global_writefds, *global_xfds;
+/*
+ * Sockets are watched either through the fd_sets given to
+ * slirp_select_fill(), or incrementally through the IoLooper given to
+ * slirp_looper_fill(), which only changes the events that differ from
+ * the previous call.
+ */
+static IoLooper *slirp_looper;
+static fd_set *poll_readfds, *poll_writefds, *poll_xfds;
 
 char slirp_hostname[33];
 
@@ -211,6 +220,37 @@ int slirp_get_system_dns_servers(void)
 static void slirp_state_save(QEMUFile *f, void *opaque);
 static int slirp_state_load(QEMUFile *f, void *opaque, int version_id);
 
+/* Counters of the Ethernet frames exchanged with the guest */
+static Metric *slirp_packets_in;
+static Metric *slirp_packets_out;
+static Metric *slirp_bytes_in;
+static Metric *slirp_bytes_out;
+
+static void slirp_init_metrics(void)
+{
+    slirp_packets_in = metrics_counter("emulator_slirp_packets_total",
+                                       "direction=\"from_guest\"",
+                                       "Frames exchanged with the guest");
+    slirp_packets_out = metrics_counter("emulator_slirp_packets_total",
+                                        "direction=\"to_guest\"",
+                                        "Frames exchanged with the guest");
+    slirp_bytes_in = metrics_counter("emulator_slirp_bytes_total",
+                                     "direction=\"from_guest\"",
+                                     "Bytes exchanged with the guest");
+    slirp_bytes_out = metrics_counter("emulator_slirp_bytes_total",
+                                      "direction=\"to_guest\"",
+                                      "Bytes exchanged with the guest");
+}
+
+/* Send an Ethernet frame to the guest */
+static void slirp_send_frame(const uint8_t *pkt, int pkt_len)
+{
+    TRACE_INSTANT(TRACE_CATEGORY_SLIRP, "slirp output");
+    metric_add(slirp_packets_out, 1);
+    metric_add(slirp_bytes_out, pkt_len);
+    slirp_output(pkt, pkt_len);
+}
+
 void slirp_init(int restricted, const char *special_ip)
 {
 #if DEBUG
@@ -242,6 +282,7 @@ void slirp_init(int restricted, const char *special_ip)
 
     link_up = 1;
     slirp_restrict = restricted;
+    slirp_init_metrics();
 
     if_init();
     ip_init();
@@ -298,18 +339,77 @@ static void updtime(void)
 }
 #endif
 
-void slirp_select_fill(int *pnfds,
-                       fd_set *readfds, fd_set *writefds, fd_set *xfds)
+/*
+ * Watch |events| (SLIRP_POLL_*) on the descriptor of |so|, which can be 0.
+ */
+static void sowatch(struct socket *so, int events, int *pnfds)
+{
+    if (slirp_looper) {
+        /* Without exception events, urgent data is only seen by the
+         * sockets created with SO_OOBINLINE, which reads it inline. */
+        int flags = 0;
+
+        if (events & SLIRP_POLL_READ)
+            flags |= IOLOOPER_READ;
+        if (events & SLIRP_POLL_WRITE)
+            flags |= IOLOOPER_WRITE;
+        iolooper_set(slirp_looper, so->s, flags);
+        return;
+    }
+
+    if (!events)
+        return;
+    if (events & SLIRP_POLL_READ)
+        FD_SET(so->s, poll_readfds);
+    if (events & SLIRP_POLL_WRITE)
+        FD_SET(so->s, poll_writefds);
+    if (events & SLIRP_POLL_URGENT)
+        FD_SET(so->s, poll_xfds);
+    if (*pnfds < so->s)
+        *pnfds = so->s;
+}
+
+/*
+ * Stop watching the descriptor of |so|. This must be called before
+ * closing it, since closing it doesn't tell the IoLooper.
+ */
+void sounwatch(struct socket *so)
+{
+    if (so->s >= 0)
+        qemu_iohandler_forget_fd(so->s);
+}
+
+/*
+ * Return the SLIRP_POLL_* events pending on the descriptor of |so|.
+ */
+static int sopending(struct socket *so)
+{
+    int events = 0;
+
+    if (slirp_looper) {
+        if (iolooper_is_read(slirp_looper, so->s))
+            events |= SLIRP_POLL_READ;
+        if (iolooper_is_write(slirp_looper, so->s))
+            events |= SLIRP_POLL_WRITE;
+        return events;
+    }
+
+    if (FD_ISSET(so->s, poll_readfds))
+        events |= SLIRP_POLL_READ;
+    if (FD_ISSET(so->s, poll_writefds))
+        events |= SLIRP_POLL_WRITE;
+    if (FD_ISSET(so->s, poll_xfds))
+        events |= SLIRP_POLL_URGENT;
+    return events;
+}
+
+static void slirp_fill(int *pnfds)
 {
     struct socket *so, *so_next;
     struct timeval timeout;
     int nfds;
     int tmp_time;
-
-    /* fail safe */
-    global_readfds = NULL;
-    global_writefds = NULL;
-    global_xfds = NULL;
+    int events;
 
     nfds = *pnfds;
 	/*
@@ -337,8 +437,11 @@ void slirp_select_fill(int *pnfds,
 			 * NOFDREF can include still connecting to local-host,
 			 * newly socreated() sockets etc. Don't want to select these.
 	 		 */
-			if (so->so_state & SS_NOFDREF || so->s == -1)
+			if (so->so_state & SS_NOFDREF || so->s == -1) {
+			   if (so->s != -1)
+			      sowatch(so, 0, &nfds);
 			   continue;
+			}
 
             /*
              * don't register proxified socked connections here
@@ -346,42 +449,34 @@ void slirp_select_fill(int *pnfds,
             if ((so->so_state & SS_PROXIFIED) != 0)
 	            continue;
 
-			/*
-			 * Set for reading sockets which are accepting
-			 */
-			if (so->so_state & SS_FACCEPTCONN) {
-                                FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
-				continue;
-			}
+			events = 0;
 
-			/*
-			 * Set for writing sockets which are connecting
-			 */
-			if (so->so_state & SS_ISFCONNECTING) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
-				continue;
-			}
-
-			/*
-			 * Set for writing if we are connected, can send more, and
-			 * we have something to send
-			 */
-			if (CONN_CANFSEND(so) && so->so_rcv.sb_cc) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
-			}
+			if (so->so_state & SS_FACCEPTCONN) {
+				/*
+				 * Set for reading sockets which are accepting
+				 */
+				events = SLIRP_POLL_READ;
+			} else if (so->so_state & SS_ISFCONNECTING) {
+				/*
+				 * Set for writing sockets which are connecting
+				 */
+				events = SLIRP_POLL_WRITE;
+			} else {
+				/*
+				 * Set for writing if we are connected, can send more, and
+				 * we have something to send
+				 */
+				if (CONN_CANFSEND(so) && so->so_rcv.sb_cc)
+					events |= SLIRP_POLL_WRITE;
 
-			/*
-			 * Set for reading (and urgent data) if we are connected, can
-			 * receive more, and we have room for it XXX /2 ?
-			 */
-			if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2))) {
-				FD_SET(so->s, readfds);
-				FD_SET(so->s, xfds);
-				UPD_NFDS(so->s);
+				/*
+				 * Set for reading (and urgent data) if we are connected, can
+				 * receive more, and we have room for it XXX /2 ?
+				 */
+				if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2)))
+					events |= SLIRP_POLL_READ | SLIRP_POLL_URGENT;
 			}
+			sowatch(so, events, &nfds);
 		}
 
 		/*
@@ -414,10 +509,11 @@ void slirp_select_fill(int *pnfds,
 			 * if the packets needed to be fragmented
 			 * (XXX <= 4 ?)
 			 */
-			if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4) {
-				FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
-			}
+			events = 0;
+			if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4)
+				events = SLIRP_POLL_READ;
+			if (so->s != -1)
+				sowatch(so, events, &nfds);
 		}
 	}
 
@@ -454,23 +550,41 @@ void slirp_select_fill(int *pnfds,
 			   timeout.tv_usec = (u_int)tmp_time;
 		}
 	}
+
+        *pnfds = nfds;
+}
+
+void slirp_select_fill(int *pnfds,
+                       fd_set *readfds, fd_set *writefds, fd_set *xfds)
+{
+    slirp_looper = NULL;
+    poll_readfds = readfds;
+    poll_writefds = writefds;
+    poll_xfds = xfds;
+
+    slirp_fill(pnfds);
+
     /*
      * now, the proxified sockets
      */
-    proxy_manager_select_fill(&nfds, readfds, writefds, xfds);
+    proxy_manager_select_fill(pnfds, readfds, writefds, xfds);
+}
 
-        *pnfds = nfds;
+void slirp_looper_fill(IoLooper *looper)
+{
+    int nfds = -1;
+
+    slirp_looper = looper;
+    slirp_fill(&nfds);
+    proxy_manager_looper_fill(looper);
 }
 
-void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
+
+static void slirp_poll(void)
 {
     struct socket *so, *so_next;
     int ret;
 
-    global_readfds = readfds;
-    global_writefds = writefds;
-    global_xfds = xfds;
-
 	/* Update time */
 	updtime();
 
@@ -489,6 +603,24 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 		}
 	}
 
+	/*
+	 * Get the pending events of all the sockets first, since handling
+	 * one socket can clear the events of another (see sofcantsendmore)
+	 */
+	if (link_up) {
+		for (so = tcb.so_next; so != &tcb; so = so->so_next) {
+			so->so_events = 0;
+			if ((so->so_state & (SS_NOFDREF|SS_PROXIFIED)) == 0 &&
+			    so->s != -1)
+				so->so_events = sopending(so);
+		}
+		for (so = udb.so_next; so != &udb; so = so->so_next) {
+			so->so_events = 0;
+			if ((so->so_state & SS_PROXIFIED) == 0 && so->s != -1)
+				so->so_events = sopending(so);
+		}
+	}
+
 	/*
 	 * Check sockets
 	 */
@@ -518,12 +650,12 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			 * This will soread as well, so no need to
 			 * test for readfds below if this succeeds
 			 */
-			if (FD_ISSET(so->s, xfds))
+			if (so->so_events & SLIRP_POLL_URGENT)
 			   sorecvoob(so);
 			/*
 			 * Check sockets for reading
 			 */
-			else if (FD_ISSET(so->s, readfds)) {
+			else if (so->so_events & SLIRP_POLL_READ) {
 				/*
 				 * Check for incoming connections
 				 */
@@ -541,7 +673,7 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			/*
 			 * Check sockets for writing
 			 */
-			if (FD_ISSET(so->s, writefds)) {
+			if (so->so_events & SLIRP_POLL_WRITE) {
 			  /*
 			   * Check for non-blocking, still-connecting sockets
 			   */
@@ -566,14 +698,16 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			     */
 			    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so);
 			    /* continue; */
-			  } else
+			  } else {
 			    ret = sowrite(so);
-			  /*
-			   * XXXXX If we wrote something (a lot), there
-			   * could be a need for a window update.
-			   * In the worst case, the remote will send
-			   * a window probe to get things going again
-			   */
+			    /*
+			     * Segments may have been buffered by
+			     * sbappendseg(), tell the guest about the
+			     * space that was freed if it's worth it
+			     */
+			    if (ret > 0)
+			      tcp_output(sototcpcb(so));
+			  }
 			}
 
 			/*
@@ -623,12 +757,24 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
             if ((so->so_state & SS_PROXIFIED) != 0)
                 continue;
 
-			if (so->s != -1 && FD_ISSET(so->s, readfds)) {
+			if (so->s != -1 && (so->so_events & SLIRP_POLL_READ)) {
                             sorecvfrom(so);
                         }
 		}
 	}
 
+}
+
+void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
+{
+    slirp_looper = NULL;
+    poll_readfds = readfds;
+    poll_writefds = writefds;
+    poll_xfds = xfds;
+
+    TRACE_BEGIN(TRACE_CATEGORY_SLIRP, "slirp poll");
+    slirp_poll();
+
     /*
      * Now the proxified sockets
      */
@@ -639,15 +785,27 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 	 */
 	if (if_queued && link_up)
 	   if_start();
+	TRACE_END(TRACE_CATEGORY_SLIRP, "slirp poll");
 
-	/* clear global file descriptor sets.
-	 * these reside on the stack in vl.c
-	 * so they're unusable if we're not in
-	 * slirp_select_fill or slirp_select_poll.
+	/* these reside on the stack of main_loop_wait(), so they're
+	 * unusable outside of slirp_select_fill or slirp_select_poll.
 	 */
-	 global_readfds = NULL;
-	 global_writefds = NULL;
-	 global_xfds = NULL;
+	poll_readfds = NULL;
+	poll_writefds = NULL;
+	poll_xfds = NULL;
+}
+
+void slirp_looper_poll(IoLooper *looper)
+{
+    slirp_looper = looper;
+    slirp_poll();
+    proxy_manager_looper_poll(looper);
+
+	/*
+	 * See if we can start outputting
+	 */
+	if (if_queued && link_up)
+	   if_start();
 }
 
 #define ETH_ALEN 6
@@ -727,7 +885,7 @@ static void arp_input(const uint8_t *pkt, int pkt_len)
             memcpy(rah->ar_sip, ah->ar_tip, 4);
             memcpy(rah->ar_tha, ah->ar_sha, ETH_ALEN);
             memcpy(rah->ar_tip, ah->ar_sip, 4);
-            slirp_output(arp_reply, sizeof(arp_reply));
+            slirp_send_frame(arp_reply, sizeof(arp_reply));
         }
         break;
     case ARPOP_REPLY:
@@ -750,6 +908,9 @@ void slirp_input(const uint8_t *pkt, int pkt_len)
     if (pkt_len < ETH_HLEN)
         return;
 
+    TRACE_INSTANT(TRACE_CATEGORY_SLIRP, "slirp input");
+    metric_add(slirp_packets_in, 1);
+    metric_add(slirp_bytes_in, pkt_len);
     proto = ntohs(*(uint16_t *)(pkt + 12));
     switch(proto) {
     case ETH_P_ARP:
@@ -777,8 +938,12 @@ void slirp_input(const uint8_t *pkt, int pkt_len)
 }
 
 /* output the IP packet to the ethernet device */
-void if_encap(const uint8_t *ip_data, int ip_data_len)
+void if_encap(struct mbuf *ifm)
 {
+    const uint8_t *ip_data = (const uint8_t *)ifm->m_data;
+    int ip_data_len = ifm->m_len;
+    int headroom = ifm->m_data -
+                   ((ifm->m_flags & M_EXT) ? ifm->m_ext : ifm->m_dat);
     uint8_t buf[1600];
     struct ethhdr *eh = (struct ethhdr *)buf;
 
@@ -815,15 +980,23 @@ void if_encap(const uint8_t *ip_data, int ip_data_len)
         /* target IP */
         ip_write( iph->ip_dst, rah->ar_tip );
         client_ip   = iph->ip_dst;
-        slirp_output(arp_req, sizeof(arp_req));
+        slirp_send_frame(arp_req, sizeof(arp_req));
     } else {
+        /* The IP output paths reserve IF_MAXLINKHDR bytes in front of the
+           packet, so the header can usually be written there and the
+           packet sent without copying it. */
+        if (headroom >= ETH_HLEN) {
+            eh = (struct ethhdr *)(ifm->m_data - ETH_HLEN);
+        }
         memcpy(eh->h_dest, client_ethaddr, ETH_ALEN);
         memcpy(eh->h_source, special_ethaddr, ETH_ALEN - 1);
         /* XXX: not correct */
         eh->h_source[5] = CTL_ALIAS;
         eh->h_proto = htons(ETH_P_IP);
-        memcpy(buf + sizeof(struct ethhdr), ip_data, ip_data_len);
-        slirp_output(buf, ip_data_len + ETH_HLEN);
+        if ((uint8_t *)eh == buf) {
+            memcpy(buf + sizeof(struct ethhdr), ip_data, ip_data_len);
+        }
+        slirp_send_frame((const uint8_t *)eh, ip_data_len + ETH_HLEN);
     }
 }
 
@@ -177,6 +177,7 @@ void free _P((void *ptr));
 
 #include "bootp.h"
 #include "tftp.h"
+#include "dns.h"
 #include "libslirp.h"
 
 extern struct ttys *ttys_unit[MAX_INTERFACES];
@@ -28,11 +28,75 @@ so_init()
 }
 #endif
 
+/*
+ * Hash tables indexing the tcb sockets by their 4-tuple, and the udb
+ * sockets by their local address and port, for solookup() and
+ * solookup_local().  The addresses and ports of a socket are set in many
+ * places after it is queued, so the tables are only filled by the lookups:
+ * a hashed socket is checked before being returned, and a miss falls back
+ * to a scan of the list which hashes the socket found.  sofree() removes
+ * the socket from its table.
+ */
+#define SO_HASH_SIZE 256
+
+static struct socket *tcb_hash[SO_HASH_SIZE];
+static struct socket *udb_hash[SO_HASH_SIZE];
+
+static u_int
+sohash(uint32_t laddr, u_int lport, uint32_t faddr, u_int fport)
+{
+	uint32_t h = laddr ^ (faddr * 31) ^ ((lport << 16) | (fport & 0xffff));
+
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return h & (SO_HASH_SIZE - 1);
+}
+
+static void
+sohash_remove(struct socket *so)
+{
+	struct socket **pso;
+
+	if (so->so_hash_table == NULL)
+		return;
+
+	pso = &so->so_hash_table[so->so_hash_slot];
+	while (*pso != NULL && *pso != so)
+		pso = &(*pso)->so_hash_next;
+	if (*pso != NULL)
+		*pso = so->so_hash_next;
+
+	so->so_hash_next = NULL;
+	so->so_hash_table = NULL;
+}
+
+static void
+sohash_insert(struct socket **table, u_int slot, struct socket *so)
+{
+	sohash_remove(so);
+	so->so_hash_next = table[slot];
+	so->so_hash_table = table;
+	so->so_hash_slot = slot;
+	table[slot] = so;
+}
+
 struct socket *
 solookup(struct socket *head, uint32_t laddr, u_int lport,
          uint32_t faddr, u_int fport)
 {
 	struct socket *so;
+	u_int slot = sohash(laddr, lport, faddr, fport);
+
+	if (head == &tcb) {
+		for (so = tcb_hash[slot]; so != NULL; so = so->so_hash_next) {
+			if (so->so_laddr_port == lport &&
+			    so->so_laddr_ip   == laddr &&
+			    so->so_faddr_ip   == faddr &&
+			    so->so_faddr_port == fport)
+			   return so;
+		}
+	}
 
 	for (so = head->so_next; so != head; so = so->so_next) {
 		if (so->so_laddr_port == lport &&
@@ -44,10 +108,43 @@ solookup(struct socket *head, uint32_t laddr, u_int lport,
 
 	if (so == head)
 	   return (struct socket *)NULL;
+	if (head == &tcb)
+	   sohash_insert(tcb_hash, slot, so);
 	return so;
 
 }
 
+/*
+ * Same as solookup(), but only matches the local address and port,
+ * which is how udp_input() finds the socket of a datagram
+ */
+struct socket *
+solookup_local(struct socket *head, uint32_t laddr, u_int lport)
+{
+	struct socket *so;
+	u_int slot = sohash(laddr, lport, 0, 0);
+
+	if (head == &udb) {
+		for (so = udb_hash[slot]; so != NULL; so = so->so_hash_next) {
+			if (so->so_laddr_port == lport &&
+			    so->so_laddr_ip   == laddr)
+			   return so;
+		}
+	}
+
+	for (so = head->so_next; so != head; so = so->so_next) {
+		if (so->so_laddr_port == lport &&
+		    so->so_laddr_ip   == laddr)
+		   break;
+	}
+
+	if (so == head)
+	   return (struct socket *)NULL;
+	if (head == &udb)
+	   sohash_insert(udb_hash, slot, so);
+	return so;
+}
+
 /*
  * Create a new socket, initialise the fields
  * It is the responsibility of the caller to
@@ -87,6 +184,8 @@ sofree(struct socket *so)
 
   m_free(so->so_m);
 
+  sohash_remove(so);
+
   if(so->so_next && so->so_prev)
     remque(so);  /* crashes if so is not in a queue */
 
@@ -528,6 +627,10 @@ sorecvfrom(struct socket *so)
 		so->so_expire = curtime + SO_EXPIRE;
 	    }
 
+	    /* Remember the addresses returned by the DNS servers */
+	    if (so->so_faddr_port == DNS_SERVER)
+	      dns_cache_learn((const u_int8_t *)m->m_data, m->m_len);
+
 	    /*		if (m->m_len == len) {
 	     *			m_inc(m, MINCSIZE);
 	     *			m->m_len = 0;
@@ -688,6 +791,7 @@ sounlisten(u_int  port)
 
     sofcantrcvmore( so );
     sofcantsendmore( so );
+    sounwatch( so );
     close( so->s );
     so->s = -1;
     sofree( so );
@@ -748,9 +852,7 @@ sofcantrcvmore(struct socket *so)
 {
 	if ((so->so_state & SS_NOFDREF) == 0) {
 		shutdown(so->s,0);
-		if(global_writefds) {
-		  FD_CLR(so->s,global_writefds);
-		}
+		so->so_events &= ~SLIRP_POLL_WRITE;
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTSENDMORE)
@@ -764,12 +866,7 @@ sofcantsendmore(struct socket *so)
 {
 	if ((so->so_state & SS_NOFDREF) == 0) {
             shutdown(so->s,1);           /* send FIN to fhost */
-            if (global_readfds) {
-                FD_CLR(so->s,global_readfds);
-            }
-            if (global_xfds) {
-                FD_CLR(so->s,global_xfds);
-            }
+            so->so_events &= ~(SLIRP_POLL_READ|SLIRP_POLL_URGENT);
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTRCVMORE)
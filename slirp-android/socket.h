@@ -52,8 +52,21 @@ struct socket {
   struct sbuf so_rcv;		/* Receive buffer */
   struct sbuf so_snd;		/* Send buffer */
   void * extra;			/* Extra pointer */
+
+  int	so_events;		/* SLIRP_POLL_* events pending in slirp_select_poll() */
+
+  struct socket *so_hash_next;	/* Next socket in the same lookup hash slot */
+  struct socket **so_hash_table;	/* Lookup hash table holding it, or NULL */
+  u_int	so_hash_slot;		/* Slot of so_hash_table holding it */
 };
 
+/*
+ * Events watched on the socket descriptors
+ */
+#define SLIRP_POLL_READ		0x1
+#define SLIRP_POLL_WRITE	0x2
+#define SLIRP_POLL_URGENT	0x4	/* Out-of-band data */
+
 
 /*
  * Socket state bits. (peer means the host on the Internet,
@@ -77,7 +90,9 @@ struct socket {
 extern struct socket tcb;
 
 void so_init _P((void));
+void sounwatch _P((struct socket *));
 struct socket * solookup _P((struct socket *, uint32_t, u_int, uint32_t, u_int));
+struct socket * solookup_local _P((struct socket *, uint32_t, u_int));
 struct socket * socreate _P((void));
 void sofree _P((struct socket *));
 int soread _P((struct socket *));
@@ -46,8 +46,13 @@ typedef	u_int32_t	tcp_seq;
 
 extern struct socket *tcp_last_so;
 
-#define TCP_SNDSPACE 8192
-#define TCP_RCVSPACE 8192
+/*
+ * soread() and sowrite() move as much data as these buffers hold with a
+ * single host call, and tcp_output() only splits it into segments of the
+ * guest's MSS when it sends them.
+ */
+#define TCP_SNDSPACE 65536
+#define TCP_RCVSPACE 32768
 
 /*
  * TCP header.
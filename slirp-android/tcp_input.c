@@ -80,7 +80,7 @@ tcp_seq tcp_iss;                /* tcp initial send seq # */
                if (so->so_emu) { \
 		       if (tcp_emu((so),(m))) sbappend((so), (m)); \
 	       } else \
-	       	       sbappend((so), (m)); \
+	       	       sbappendseg((so), (m), (ti)->ti_flags & TH_PUSH); \
 /*               sorwakeup(so); */ \
 	} else {\
                (flags) = tcp_reass((tp), (ti), (m)); \
@@ -100,7 +100,7 @@ tcp_seq tcp_iss;                /* tcp initial send seq # */
 		if (so->so_emu) { \
 			if (tcp_emu((so),(m))) sbappend(so, (m)); \
 		} else \
-			sbappend((so), (m)); \
+			sbappendseg((so), (m), (ti)->ti_flags & TH_PUSH); \
 /*		sorwakeup(so); */ \
 	} else { \
 		(flags) = tcp_reass((tp), (ti), (m)); \
@@ -576,7 +576,7 @@ findso:
 			if (so->so_emu) {
 				if (tcp_emu(so,m)) sbappend(so, m);
 			} else
-				sbappend(so, m);
+				sbappendseg(so, m, ti->ti_flags & TH_PUSH);
 
 			/*
 			 * XXX This is called when data arrives.  Later, check
@@ -74,6 +74,45 @@ udp_init(void)
 	udb.so_next = udb.so_prev = &udb;
 	dns_num_conns = 0;
 }
+/*
+ * Answer a guest query to the emulated DNS server from the host name
+ * cache, see dns.c. Return 1 if it has been answered.
+ */
+static int
+udp_dns_answer(const struct ip *ip, const struct udphdr *uh, int len)
+{
+	uint32_t     dst_ip = ip_geth(ip->ip_dst);
+	struct mbuf *m;
+	SockAddress  saddr, daddr;
+	int          size, room;
+
+	if ((dst_ip & 0xffffff00) != special_addr_ip ||
+	    !CTL_IS_DNS(dst_ip & 0xff))
+		return 0;
+
+	if ((m = m_get()) == NULL)
+		return 0;
+	m->m_data += IF_MAXLINKHDR;
+	m->m_data += sizeof(struct udpiphdr);
+	room = M_FREEROOM(m);
+	if (room > DNS_MAX_UDP_SIZE)
+		room = DNS_MAX_UDP_SIZE;
+	size = dns_cache_answer((const u_int8_t *)(uh + 1),
+	                        len - sizeof(struct udphdr),
+	                        (u_int8_t *)m->m_data, room);
+	if (size == 0) {
+		m_free(m);
+		return 0;
+	}
+	m->m_len = size;
+
+	sock_address_init_inet(&saddr, dst_ip, DNS_SERVER);
+	sock_address_init_inet(&daddr, ip_geth(ip->ip_src),
+	                       port_geth(uh->uh_sport));
+	udp_output2_(NULL, m, &saddr, &daddr, ip->ip_tos);
+	return 1;
+}
+
 /* m->m_data  points at ip packet header
  * m->m_len   length ip packet
  * ip->ip_len length data (IPDU)
@@ -201,10 +240,12 @@ udp_input(register struct mbuf *m, int iphlen)
         }
 
         // DNS logging and FW rules
-        if (ntohs(uh->uh_dport.port) == 53) {
+        if (ntohs(uh->uh_dport.port) == DNS_SERVER) {
             if (!slirp_dump_dns(m)) {
                 DEBUG_MISC((dfd,"Error logging DNS packet"));
             }
+            if (udp_dns_answer(&save_ip, uh, len))
+                goto bad;
             dns_num_conns++;
             if (slirp_get_max_dns_conns() != -1 &&
                 dns_num_conns > (unsigned)slirp_get_max_dns_conns())
@@ -218,20 +259,11 @@ udp_input(register struct mbuf *m, int iphlen)
 	so = udp_last_so;
 	if (so->so_laddr_port != port_geth(uh->uh_sport) ||
 	    so->so_laddr_ip   != ip_geth(ip->ip_src)) {
-		struct socket *tmp;
-
-		for (tmp = udb.so_next; tmp != &udb; tmp = tmp->so_next) {
-			if (tmp->so_laddr_port == port_geth(uh->uh_sport) &&
-			    tmp->so_laddr_ip   == ip_geth(ip->ip_src)) {
-				tmp->so_faddr_ip   = ip_geth(ip->ip_dst);
-				tmp->so_faddr_port = port_geth(uh->uh_dport);
-				so = tmp;
-				break;
-			}
-		}
-		if (tmp == &udb) {
-		  so = NULL;
-		} else {
+		so = solookup_local(&udb, ip_geth(ip->ip_src),
+		                    port_geth(uh->uh_sport));
+		if (so != NULL) {
+		  so->so_faddr_ip   = ip_geth(ip->ip_dst);
+		  so->so_faddr_port = port_geth(uh->uh_dport);
 		  STAT(udpstat.udpps_pcbcachemiss++);
 		  udp_last_so = so;
 		}
@@ -406,6 +438,7 @@ udp_attach(struct socket *so)
 void
 udp_detach(struct socket *so)
 {
+	sounwatch(so);
 	socket_close(so->s);
 	/* if (so->so_m) m_free(so->so_m);    done by sofree */
 
@@ -37,6 +37,9 @@
 
 #define CPUArchState struct CPUARMState
 
+/* Android guests touch many pages between TLB flushes. */
+#define CPU_TLB_BITS 10
+
 #include "qemu-common.h"
 #include "exec/cpu-defs.h"
 
@@ -272,6 +275,37 @@ typedef struct CPUARMState {
 
 #include "cpu-qom.h"
 
+/* Guest copy and fill loops, e.g. the ones of bionic's memcpy() and
+   memset(), are recognized when they start a translation block, see
+   arm_bulk_loop_match(). Their iterations then run in helper_bulk_loop(),
+   a host page at a time, except the last one, which is translated as
+   usual so that the registers and flags end up exactly as the guest code
+   leaves them. The descriptor passed to the helper holds: */
+#define ARM_BULK_LOOP_RS(desc)     ((desc) & 0xf)          /* source base */
+#define ARM_BULK_LOOP_RD(desc)     (((desc) >> 4) & 0xf)   /* destination */
+#define ARM_BULK_LOOP_RC(desc)     (((desc) >> 8) & 0xf)   /* counter */
+#define ARM_BULK_LOOP_COND(desc)   (((desc) >> 12) & 0xf)  /* of the branch */
+#define ARM_BULK_LOOP_SIZE(desc)   (((desc) >> 16) & 0xff) /* bytes per iteration */
+#define ARM_BULK_LOOP_MODE(desc)   ((desc) >> 24)
+#define ARM_BULK_LOOP_DESC(rs, rd, rc, cond, size, mode) \
+    ((rs) | ((rd) << 4) | ((rc) << 8) | ((cond) << 12) | ((size) << 16) | \
+     ((mode) << 24))
+
+enum {
+    ARM_BULK_LOOP_COPY,         /* loads from rs, stores the same bytes to rd */
+    ARM_BULK_LOOP_FILL_CORE,    /* stores the core registers of the mask arg */
+    ARM_BULK_LOOP_FILL_NEON,    /* stores arg >> 8 D registers from D(arg & 0xff) */
+};
+
+/* Counted since startup and printed by the 'profile counters' console
+   command. */
+typedef struct ARMBulkLoopStats {
+    uint64_t calls;             /* helper_bulk_loop() calls that ran iterations */
+    uint64_t bytes;             /* bytes copied or filled by them */
+} ARMBulkLoopStats;
+
+extern ARMBulkLoopStats arm_bulk_loop_stats;
+
 CPUARMState *cpu_arm_init(const char *cpu_model);
 void arm_translate_init(void);
 int cpu_arm_exec(CPUARMState *s);
@@ -1,6 +1,5 @@
 #include "exec/def-helper.h"
 
-DEF_HELPER_1(clz, i32, i32)
 DEF_HELPER_1(sxtb16, i32, i32)
 DEF_HELPER_1(uxtb16, i32, i32)
 
@@ -52,6 +51,7 @@ DEF_HELPER_1(logicq_cc, i32, i64)
 DEF_HELPER_3(sel_flags, i32, i32, i32, i32)
 DEF_HELPER_2(exception, void, env, i32)
 DEF_HELPER_1(wfi, void, env)
+DEF_HELPER_1(lookup_tb_ptr, ptr, env)
 
 DEF_HELPER_3(cpsr_write, void, env, i32, i32)
 DEF_HELPER_1(cpsr_read, i32, env)
@@ -472,4 +472,6 @@ DEF_HELPER_2(neon_vldst_all, void, env, i32)
 
 DEF_HELPER_1(profileBB, void, ptr)
 
+DEF_HELPER_3(bulk_loop, void, env, i32, i32)
+
 #include "exec/def-helper.h"
@@ -17,6 +17,7 @@
  * License along with this library; if not, see <http://www.gnu.org/licenses/>.
  */
 #include "cpu.h"
+#include "qemu/host-utils.h"
 #include "tcg.h"
 #include "helper.h"
 
@@ -90,6 +91,135 @@ void tlb_fill(CPUARMState *env, target_ulong addr, int is_write, int mmu_idx,
     }
 }
 
+ARMBulkLoopStats arm_bulk_loop_stats;
+
+/* Most bytes copied or filled by one helper_bulk_loop() call, so that
+   interrupts aren't delayed by huge copies. */
+#define BULK_LOOP_MAX_BYTES  (64 * 1024)
+
+/* Host address of the guest address |addr|, if its page is RAM already
+   mapped for this kind of access by the softmmu TLB, NULL otherwise. The
+   pages that hold translated code aren't mapped for writes. */
+static uint8_t *bulk_loop_host_addr(CPUARMState *env, uint32_t addr,
+                                    int mmu_idx, int is_write)
+{
+    int index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    CPUTLBEntry *entry = &env->tlb_table[mmu_idx][index];
+    target_ulong tlb_addr = is_write ? entry->addr_write : entry->addr_read;
+
+    if (tlb_addr != (addr & TARGET_PAGE_MASK)) {
+        return NULL;
+    }
+    return (uint8_t *)(uintptr_t)(addr + entry->addend);
+}
+
+/* Run the iterations of the loop of |desc|, see arm_bulk_loop_match(),
+   whose branches are taken, except the last one, and as long as both the
+   source and destination pages are mapped in the TLB. The translated loop
+   body then runs the next iteration, which also handles the faults, MMIO
+   and iterations that cross pages. */
+void HELPER(bulk_loop)(CPUARMState *env, uint32_t desc, uint32_t arg)
+{
+    int rs = ARM_BULK_LOOP_RS(desc);
+    int rd = ARM_BULK_LOOP_RD(desc);
+    int rc = ARM_BULK_LOOP_RC(desc);
+    uint32_t size = ARM_BULK_LOOP_SIZE(desc);
+    int mode = ARM_BULK_LOOP_MODE(desc);
+    int mmu_idx = cpu_mmu_index(env);
+    uint32_t count = env->regs[rc];
+    uint32_t iters, done, n;
+    uint8_t pattern[256];
+
+    /* Iteration i is followed by another one if the branch after
+       SUBS rc, rc, #size is taken, which depends on count - i * size. */
+    switch (ARM_BULK_LOOP_COND(desc)) {
+    case 1:     /* NE */
+        if (count == 0 || count % size) {
+            return;
+        }
+        iters = count / size - 1;
+        break;
+    case 2:     /* HS */
+        iters = count / size;
+        break;
+    case 8:     /* HI */
+        iters = count ? (count - 1) / size : 0;
+        break;
+    case 10:    /* GE */
+        iters = (int32_t)count >= 0 ? count / size : 0;
+        break;
+    case 12:    /* GT */
+        iters = (int32_t)count > 0 ? (count - 1) / size : 0;
+        break;
+    default:
+        return;
+    }
+    iters = MIN(iters, BULK_LOOP_MAX_BYTES / size);
+    if (iters == 0) {
+        return;
+    }
+
+    if (mode == ARM_BULK_LOOP_FILL_CORE) {
+        uint32_t off = 0;
+        int r;
+        for (r = 0; r < 16; r++) {
+            if (arg & (1 << r)) {
+                stl_le_p(pattern + off, env->regs[r]);
+                off += 4;
+            }
+        }
+        for (; off < size; off++) {
+            pattern[off] = pattern[off % (4 * ctpop32(arg))];
+        }
+    } else if (mode == ARM_BULK_LOOP_FILL_NEON) {
+        uint32_t off = 0;
+        int d;
+        for (d = 0; d < (int)(arg >> 8); d++) {
+            stq_le_p(pattern + off,
+                     float64_val(env->vfp.regs[(arg & 0xff) + d]));
+            off += 8;
+        }
+        for (; off < size; off++) {
+            pattern[off] = pattern[off % (8 * (arg >> 8))];
+        }
+    }
+
+    for (done = 0; done < iters; done += n) {
+        uint32_t src = env->regs[rs];
+        uint32_t dst = env->regs[rd];
+        uint8_t *hdst = bulk_loop_host_addr(env, dst, mmu_idx, 1);
+        uint32_t i;
+
+        n = MIN(iters - done, (TARGET_PAGE_SIZE - (dst & ~TARGET_PAGE_MASK)) /
+                              size);
+        if (!hdst || !n || (dst & 3)) {
+            break;
+        }
+        if (mode == ARM_BULK_LOOP_COPY) {
+            uint8_t *hsrc = bulk_loop_host_addr(env, src, mmu_idx, 0);
+            n = MIN(n, (TARGET_PAGE_SIZE - (src & ~TARGET_PAGE_MASK)) / size);
+            /* The guest loop copies forward, one iteration at a time. */
+            if (!hsrc || !n || (src & 3) ||
+                (hdst + size > hsrc && hdst < hsrc + n * size)) {
+                break;
+            }
+            memmove(hdst, hsrc, n * size);
+            env->regs[rs] = src + n * size;
+        } else {
+            for (i = 0; i < n; i++) {
+                memcpy(hdst + i * size, pattern, size);
+            }
+        }
+        env->regs[rd] = dst + n * size;
+        env->regs[rc] -= n * size;
+    }
+
+    if (done) {
+        arm_bulk_loop_stats.calls++;
+        arm_bulk_loop_stats.bytes += (uint64_t)done * size;
+    }
+}
+
 void HELPER(set_cp)(CPUARMState *env, uint32_t insn, uint32_t val)
 {
     int cp_num = (insn >> 8) & 0xf;
@@ -269,6 +399,11 @@ void HELPER(wfi)(CPUARMState *env)
     cpu_loop_exit(env);
 }
 
+void *HELPER(lookup_tb_ptr)(CPUARMState *env)
+{
+    return tb_lookup_ptr(env);
+}
+
 void HELPER(exception)(CPUARMState *env, uint32_t excp)
 {
     env->exception_index = excp;
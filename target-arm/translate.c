@@ -721,7 +721,7 @@ static inline void gen_bx_im(DisasContext *s, uint32_t addr)
 {
     TCGv tmp;
 
-    s->is_jmp = DISAS_UPDATE;
+    s->is_jmp = DISAS_JUMP;
     if (s->thumb != (addr & 1)) {
         tmp = tcg_temp_new_i32();
         tcg_gen_movi_i32(tmp, addr & 1);
@@ -734,7 +734,7 @@ static inline void gen_bx_im(DisasContext *s, uint32_t addr)
 /* Set PC and Thumb state from var.  var is marked as dead.  */
 static inline void gen_bx(DisasContext *s, TCGv var)
 {
-    s->is_jmp = DISAS_UPDATE;
+    s->is_jmp = DISAS_JUMP;
     tcg_gen_andi_i32(cpu_R[15], var, ~1);
     tcg_gen_andi_i32(var, var, 1);
     store_cpu_field(var, thumb);
@@ -3518,6 +3518,23 @@ static inline void gen_goto_tb(DisasContext *s, int n, uint32_t dest)
     }
 }
 
+/* Jump to the TB of the new PC if it is already in the jump cache, or go
+   back to the main loop to find it otherwise.  Only used when the PC and
+   the Thumb bit are the only state that changed: anything that may unmask
+   interrupts or change the CPU mode must use exit_tb.  */
+static void gen_goto_ptr(void)
+{
+#if TCG_TARGET_HAS_goto_ptr
+    TCGv_ptr ptr = tcg_temp_new_ptr();
+
+    gen_helper_lookup_tb_ptr(ptr, cpu_env);
+    tcg_gen_goto_ptr(ptr);
+    tcg_temp_free_ptr(ptr);
+#else
+    tcg_gen_exit_tb(0);
+#endif
+}
+
 static inline void gen_jmp (DisasContext *s, uint32_t dest)
 {
     if (unlikely(s->singlestep_enabled)) {
@@ -3664,26 +3681,84 @@ static void gen_nop_hint(DisasContext *s, int val)
 
 #define CPU_V001 cpu_V0, cpu_V0, cpu_V1
 
+/* Lane-wise add and subtract of 8-bit or 16-bit elements, done inline
+   within a 32-bit value rather than with a helper call. |m| has the top
+   bit of each lane set: the low bits of the lanes are combined without
+   their top bits, so that no carry or borrow crosses a lane boundary,
+   and the top bits are then fixed up with an xor. */
+static void gen_neon_addv_mask(TCGv d, TCGv a, TCGv b, uint32_t m)
+{
+    TCGv t1 = tcg_temp_new_i32();
+    TCGv t2 = tcg_temp_new_i32();
+    TCGv t3 = tcg_temp_new_i32();
+
+    tcg_gen_andi_i32(t1, a, ~m);
+    tcg_gen_andi_i32(t2, b, ~m);
+    tcg_gen_xor_i32(t3, a, b);
+    tcg_gen_add_i32(d, t1, t2);
+    tcg_gen_andi_i32(t3, t3, m);
+    tcg_gen_xor_i32(d, d, t3);
+
+    tcg_temp_free_i32(t1);
+    tcg_temp_free_i32(t2);
+    tcg_temp_free_i32(t3);
+}
+
+static void gen_neon_subv_mask(TCGv d, TCGv a, TCGv b, uint32_t m)
+{
+    TCGv t1 = tcg_temp_new_i32();
+    TCGv t2 = tcg_temp_new_i32();
+    TCGv t3 = tcg_temp_new_i32();
+
+    tcg_gen_ori_i32(t1, a, m);
+    tcg_gen_andi_i32(t2, b, ~m);
+    tcg_gen_eqv_i32(t3, a, b);
+    tcg_gen_sub_i32(d, t1, t2);
+    tcg_gen_andi_i32(t3, t3, m);
+    tcg_gen_xor_i32(d, d, t3);
+
+    tcg_temp_free_i32(t1);
+    tcg_temp_free_i32(t2);
+    tcg_temp_free_i32(t3);
+}
+
 static inline void gen_neon_add(int size, TCGv t0, TCGv t1)
 {
     switch (size) {
-    case 0: gen_helper_neon_add_u8(t0, t0, t1); break;
-    case 1: gen_helper_neon_add_u16(t0, t0, t1); break;
+    case 0: gen_neon_addv_mask(t0, t0, t1, 0x80808080); break;
+    case 1: gen_neon_addv_mask(t0, t0, t1, 0x80008000); break;
     case 2: tcg_gen_add_i32(t0, t0, t1); break;
     default: abort();
     }
 }
 
+static inline void gen_neon_sub(int size, TCGv t0, TCGv t1)
+{
+    switch (size) {
+    case 0: gen_neon_subv_mask(t0, t0, t1, 0x80808080); break;
+    case 1: gen_neon_subv_mask(t0, t0, t1, 0x80008000); break;
+    case 2: tcg_gen_sub_i32(t0, t0, t1); break;
+    default: abort();
+    }
+}
+
 static inline void gen_neon_rsb(int size, TCGv t0, TCGv t1)
 {
     switch (size) {
-    case 0: gen_helper_neon_sub_u8(t0, t1, t0); break;
-    case 1: gen_helper_neon_sub_u16(t0, t1, t0); break;
+    case 0: gen_neon_subv_mask(t0, t1, t0, 0x80808080); break;
+    case 1: gen_neon_subv_mask(t0, t1, t0, 0x80008000); break;
     case 2: tcg_gen_sub_i32(t0, t1, t0); break;
     default: return;
     }
 }
 
+/* 32-bit lane compares, which give all ones when true.  */
+static inline void gen_neon_cmp_u32(TCGCond cond, TCGv t0, TCGv t1)
+{
+    tcg_gen_setcond_i32(cond, t0, t0, t1);
+    tcg_gen_neg_i32(t0, t0);
+}
+
 /* 32-bit pairwise ops end up the same as the elementwise versions.  */
 #define gen_helper_neon_pmax_s32  gen_helper_neon_max_s32
 #define gen_helper_neon_pmax_u32  gen_helper_neon_max_u32
@@ -4745,10 +4820,20 @@ static int disas_neon_data_insn(CPUARMState * env, DisasContext *s, uint32_t ins
             GEN_NEON_INTEGER_OP_ENV(qrshl);
             break;
         case NEON_3R_VMAX:
-            GEN_NEON_INTEGER_OP(max);
+            if (size == 2) {
+                tcg_gen_movcond_i32(u ? TCG_COND_GTU : TCG_COND_GT,
+                                    tmp, tmp, tmp2, tmp, tmp2);
+            } else {
+                GEN_NEON_INTEGER_OP(max);
+            }
             break;
         case NEON_3R_VMIN:
-            GEN_NEON_INTEGER_OP(min);
+            if (size == 2) {
+                tcg_gen_movcond_i32(u ? TCG_COND_LTU : TCG_COND_LT,
+                                    tmp, tmp, tmp2, tmp, tmp2);
+            } else {
+                GEN_NEON_INTEGER_OP(min);
+            }
             break;
         case NEON_3R_VABD:
             GEN_NEON_INTEGER_OP(abd);
@@ -4763,12 +4848,7 @@ static int disas_neon_data_insn(CPUARMState * env, DisasContext *s, uint32_t ins
             if (!u) { /* VADD */
                 gen_neon_add(size, tmp, tmp2);
             } else { /* VSUB */
-                switch (size) {
-                case 0: gen_helper_neon_sub_u8(tmp, tmp, tmp2); break;
-                case 1: gen_helper_neon_sub_u16(tmp, tmp, tmp2); break;
-                case 2: tcg_gen_sub_i32(tmp, tmp, tmp2); break;
-                default: abort();
-                }
+                gen_neon_sub(size, tmp, tmp2);
             }
             break;
         case NEON_3R_VTST_VCEQ:
@@ -4776,14 +4856,18 @@ static int disas_neon_data_insn(CPUARMState * env, DisasContext *s, uint32_t ins
                 switch (size) {
                 case 0: gen_helper_neon_tst_u8(tmp, tmp, tmp2); break;
                 case 1: gen_helper_neon_tst_u16(tmp, tmp, tmp2); break;
-                case 2: gen_helper_neon_tst_u32(tmp, tmp, tmp2); break;
+                case 2:
+                    tcg_gen_and_i32(tmp, tmp, tmp2);
+                    tcg_gen_setcondi_i32(TCG_COND_NE, tmp, tmp, 0);
+                    tcg_gen_neg_i32(tmp, tmp);
+                    break;
                 default: abort();
                 }
             } else { /* VCEQ */
                 switch (size) {
                 case 0: gen_helper_neon_ceq_u8(tmp, tmp, tmp2); break;
                 case 1: gen_helper_neon_ceq_u16(tmp, tmp, tmp2); break;
-                case 2: gen_helper_neon_ceq_u32(tmp, tmp, tmp2); break;
+                case 2: gen_neon_cmp_u32(TCG_COND_EQ, tmp, tmp2); break;
                 default: abort();
                 }
             }
@@ -5983,7 +6067,7 @@ static int disas_neon_data_insn(CPUARMState * env, DisasContext *s, uint32_t ins
                             switch (size) {
                             case 0: gen_helper_neon_clz_u8(tmp, tmp); break;
                             case 1: gen_helper_neon_clz_u16(tmp, tmp); break;
-                            case 2: gen_helper_clz(tmp, tmp); break;
+                            case 2: tcg_gen_clz_i32(tmp, tmp); break;
                             default: abort();
                             }
                             break;
@@ -6888,7 +6972,7 @@ static void disas_arm_insn(CPUARMState * env, DisasContext *s)
                 ARCH(5);
                 rd = (insn >> 12) & 0xf;
                 tmp = load_reg(s, rm);
-                gen_helper_clz(tmp, tmp);
+                tcg_gen_clz_i32(tmp, tmp);
                 store_reg(s, rd, tmp);
             } else {
                 goto illegal_op;
@@ -8350,7 +8434,7 @@ static int disas_thumb2_insn(CPUARMState *env, DisasContext *s, uint16_t insn_hw
                     tcg_temp_free_i32(tmp2);
                     break;
                 case 0x18: /* clz */
-                    gen_helper_clz(tmp, tmp);
+                    tcg_gen_clz_i32(tmp, tmp);
                     break;
                 default:
                     goto illegal_op;
@@ -9704,6 +9788,191 @@ gen_profileBB(void * tb)
 #endif
 }
 
+#if !defined(CONFIG_USER_ONLY)
+
+/* Longest loop body recognized by arm_bulk_loop_match(), in instructions. */
+#define BULK_LOOP_MAX_INSNS  8
+
+/* Units transferred by the loop: core registers 0 to 15, then D registers
+   0 to 31. */
+#define BULK_LOOP_UNITS      48
+
+typedef struct {
+    int src_off[BULK_LOOP_UNITS];   /* where each unit was loaded from, or -1 */
+    int rs, rd;
+    int load_off, store_off;        /* bytes loaded and stored so far */
+    int copy_ok;                    /* each store writes the bytes it loaded */
+    uint32_t core_mask;             /* core registers transferred */
+    uint32_t fill_insn;             /* first store, all must match it */
+    int fill_ok;
+} BulkLoop;
+
+static int bulk_loop_transfer(BulkLoop *l, uint32_t insn, int is_load,
+                              int base, const int *units, int count, int size)
+{
+    int i;
+
+    if (is_load) {
+        if (l->rs >= 0 && l->rs != base)
+            return 0;
+        l->rs = base;
+        for (i = 0; i < count; i++) {
+            l->src_off[units[i]] = l->load_off;
+            l->load_off += size;
+        }
+    } else {
+        if (l->rd >= 0 && l->rd != base)
+            return 0;
+        l->rd = base;
+        if (l->store_off == 0)
+            l->fill_insn = insn;
+        else if (insn != l->fill_insn)
+            l->fill_ok = 0;
+        for (i = 0; i < count; i++) {
+            if (l->src_off[units[i]] != l->store_off)
+                l->copy_ok = 0;
+            l->store_off += size;
+        }
+    }
+    return 1;
+}
+
+/* Number of D registers of the VLD1/VST1 multiple structures |insn|, or 0
+   for the other types. */
+static int bulk_loop_neon_regs(uint32_t insn)
+{
+    switch ((insn >> 8) & 0xf) {
+    case 7: return 1;
+    case 10: return 2;
+    case 6: return 3;
+    case 2: return 4;
+    }
+    return 0;
+}
+
+/* Check whether the ARM code at s->pc is a copy or fill loop that
+   helper_bulk_loop() can run, and return its descriptor and argument.
+   The recognized loops only contain, in any order:
+     - LDMIA rs!, {...} or VLD1 {...}, [rs]! loading from the source,
+     - STMIA rd!, {...} or VST1 {...}, [rd]! storing to the destination
+       the bytes loaded at the same offset, or storing the same registers
+       every time to fill it,
+     - PLD,
+     - a single SUBS rc, rc, #<bytes per iteration>,
+   and end with B<cond> back to s->pc, with <cond> NE, HS, HI, GE or GT. */
+static int arm_bulk_loop_match(CPUARMState *env, DisasContext *s,
+                               uint32_t *desc, uint32_t *arg)
+{
+    target_ulong page_end = (s->pc & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
+    BulkLoop l;
+    int units[16];
+    int rc = -1, size = 0, cond = -1, mode;
+    int i, n, r;
+
+    for (i = 0; i < BULK_LOOP_UNITS; i++)
+        l.src_off[i] = -1;
+    l.rs = l.rd = -1;
+    l.load_off = l.store_off = 0;
+    l.copy_ok = l.fill_ok = 1;
+    l.core_mask = 0;
+    l.fill_insn = 0;
+
+    for (i = 0; i < BULK_LOOP_MAX_INSNS && cond < 0; i++) {
+        target_ulong pc = s->pc + i * 4;
+        uint32_t insn;
+
+        if (pc + 4 > page_end)
+            return 0;
+        insn = cpu_ldl_code(env, pc);
+
+        if ((insn & 0xff70f000) == 0xf550f000 ||
+            (insn & 0xff70f010) == 0xf750f000) {
+            /* PLD */
+            continue;
+        }
+        if ((insn & 0xff900000) == 0xf4000000) {
+            /* VLD1/VST1 multiple registers, post-incremented */
+            int vd = ((insn >> 18) & 0x10) | ((insn >> 12) & 0xf);
+            n = bulk_loop_neon_regs(insn);
+            if (!n || (insn & 0xf) != 13 || !s->vfp_enabled || vd + n > 32)
+                return 0;
+            for (r = 0; r < n; r++)
+                units[r] = 16 + vd + r;
+            if (!bulk_loop_transfer(&l, insn, insn & (1 << 21),
+                                    (insn >> 16) & 0xf, units, n, 8))
+                return 0;
+            continue;
+        }
+        if ((insn & 0x0f000000) == 0x0a000000 && (insn >> 28) < 14) {
+            /* B<cond> */
+            int32_t offset = ((int32_t)(insn << 8)) >> 6;
+            if (pc + 8 + offset != s->pc)
+                return 0;
+            cond = insn >> 28;
+            continue;
+        }
+        if ((insn >> 28) != 14)
+            return 0;
+        if ((insn & 0x0ff00000) == 0x02500000) {
+            /* SUBS rc, rc, #imm */
+            int rot = ((insn >> 8) & 0xf) * 2;
+            if (rc >= 0 || ((insn >> 16) & 0xf) != ((insn >> 12) & 0xf))
+                return 0;
+            rc = (insn >> 16) & 0xf;
+            size = insn & 0xff;
+            if (rot)
+                size = ((uint32_t)size >> rot) | ((uint32_t)size << (32 - rot));
+            continue;
+        }
+        if ((insn & 0x0fe00000) == 0x08a00000 && (insn & 0xffff)) {
+            /* LDMIA/STMIA with writeback */
+            n = 0;
+            for (r = 0; r < 16; r++) {
+                if (insn & (1 << r))
+                    units[n++] = r;
+            }
+            l.core_mask |= insn & 0xffff;
+            if (!bulk_loop_transfer(&l, insn, insn & (1 << 20),
+                                    (insn >> 16) & 0xf, units, n, 4))
+                return 0;
+            continue;
+        }
+        return 0;
+    }
+
+    if (cond != 1 && cond != 2 && cond != 8 && cond != 10 && cond != 12)
+        return 0;
+    if (rc < 0 || l.rd < 0 || size <= 0 || size > 0xff || (size & 3) ||
+        l.store_off != size || rc == l.rd || rc == 15 || l.rd == 15 ||
+        (l.core_mask & ((1 << rc) | (1 << l.rd) | (1 << 15))))
+        return 0;
+
+    if (l.load_off) {
+        if (l.load_off != size || !l.copy_ok || l.rs == l.rd || l.rs == rc ||
+            l.rs == 15 || (l.core_mask & (1 << l.rs)))
+            return 0;
+        mode = ARM_BULK_LOOP_COPY;
+        *arg = 0;
+    } else {
+        if (!l.fill_ok)
+            return 0;
+        l.rs = 0;
+        if ((l.fill_insn & 0xff900000) == 0xf4000000) {
+            n = bulk_loop_neon_regs(l.fill_insn);
+            mode = ARM_BULK_LOOP_FILL_NEON;
+            *arg = (((l.fill_insn >> 18) & 0x10) | ((l.fill_insn >> 12) & 0xf)) |
+                   (n << 8);
+        } else {
+            mode = ARM_BULK_LOOP_FILL_CORE;
+            *arg = l.fill_insn & 0xffff;
+        }
+    }
+    *desc = ARM_BULK_LOOP_DESC(l.rs, l.rd, rc, cond, size, mode);
+    return 1;
+}
+
+#endif /* !CONFIG_USER_ONLY */
+
 /* generate intermediate code in gen_opc_buf and gen_opparam_buf for
    basic block 'tb'. If search_pc is TRUE, also generate PC
    information for each intermediate instruction. */
@@ -9854,6 +10123,24 @@ static inline void gen_intermediate_code_internal(CPUARMState *env,
             tcg_gen_debug_insn_start(dc->pc);
         }
 
+#if !defined(CONFIG_USER_ONLY)
+        /* The iterations of a copy or fill loop, except the last one, run
+           in the helper before the loop body. The icount and single-step
+           modes need to see every instruction. */
+        if (num_insns == 0 && !dc->thumb && !use_icount &&
+            !ENV_GET_CPU(env)->singlestep_enabled && !singlestep &&
+            !(tb->cflags & CF_LAST_IO)) {
+            uint32_t desc, arg;
+            if (arm_bulk_loop_match(env, dc, &desc, &arg)) {
+                TCGv_i32 tmp_desc = tcg_const_i32(desc);
+                TCGv_i32 tmp_arg = tcg_const_i32(arg);
+                gen_helper_bulk_loop(cpu_env, tmp_desc, tmp_arg);
+                tcg_temp_free_i32(tmp_desc);
+                tcg_temp_free_i32(tmp_arg);
+            }
+        }
+#endif
+
         if (dc->thumb) {
             disas_thumb_insn(env, dc);
             if (dc->condexec_mask) {
@@ -9941,8 +10228,10 @@ static inline void gen_intermediate_code_internal(CPUARMState *env,
         case DISAS_NEXT:
             gen_goto_tb(dc, 1, dc->pc);
             break;
-        default:
         case DISAS_JUMP:
+            gen_goto_ptr();
+            break;
+        default:
         case DISAS_UPDATE:
             /* indicate that the hash table must be used to find the next TB */
             tcg_gen_exit_tb(0);
@@ -18,6 +18,7 @@
 
 #include <inttypes.h>
 #include "hw/hw.h"
+#include "android/utils/metrics.h"
 #include "target-i386/hax-i386.h"
 
 #define HAX_EMUL_ONE    0x1
@@ -34,6 +35,44 @@ struct hax_state hax_global;
 
 int hax_support = -1;
 
+/* Exits by HAX_EXIT_XXX status, index 0 counts the unknown ones */
+static Metric *hax_exit_metrics[HAX_EXIT_FAST_MMIO + 1];
+/* HAX_EXIT_MMIO exits handled by hax_handle_mmio() and by TCG */
+static Metric *hax_mmio_decoded_metric;
+static Metric *hax_mmio_emulated_metric;
+
+static void hax_init_metrics(void)
+{
+    static const char * const labels[HAX_EXIT_FAST_MMIO + 1] = {
+        [0] = "reason=\"other\"",
+        [HAX_EXIT_IO] = "reason=\"io\"",
+        [HAX_EXIT_MMIO] = "reason=\"mmio\"",
+        [HAX_EXIT_REAL] = "reason=\"real\"",
+        [HAX_EXIT_INTERRUPT] = "reason=\"interrupt\"",
+        [HAX_EXIT_UNKNOWN_VMEXIT] = "reason=\"unknown_vmexit\"",
+        [HAX_EXIT_HLT] = "reason=\"hlt\"",
+        [HAX_EXIT_STATECHANGE] = "reason=\"statechange\"",
+        [HAX_EXIT_PAUSED] = "reason=\"paused\"",
+        [HAX_EXIT_FAST_MMIO] = "reason=\"fast_mmio\"",
+    };
+    int i;
+
+    for (i = 0; i <= HAX_EXIT_FAST_MMIO; i++)
+        hax_exit_metrics[i] = metrics_counter("emulator_hax_exits_total",
+          labels[i], "Exits of the HAXM vCPUs to the emulator");
+    hax_mmio_decoded_metric = metrics_counter("emulator_hax_mmio_total",
+      "handler=\"decoder\"", "HAXM MMIO exits, by emulation path");
+    hax_mmio_emulated_metric = metrics_counter("emulator_hax_mmio_total",
+      "handler=\"tcg\"", "HAXM MMIO exits, by emulation path");
+}
+
+static void hax_count_exit(uint32_t status)
+{
+    if (status > HAX_EXIT_FAST_MMIO)
+        status = 0;
+    metric_add(hax_exit_metrics[status], 1);
+}
+
 /* Called after hax_init */
 int hax_enabled()
 {
@@ -396,6 +435,7 @@ int hax_init(int smp_cpus)
     hax_notify_qemu_version(hax->vm->fd, &qversion);
     hax_support = 1;
     qemu_register_reset( hax_reset_vcpu_state, 0, NULL);
+    hax_init_metrics();
 
     return 0;
 error:
@@ -478,6 +518,269 @@ int hax_handle_io(CPUX86State *env, uint32_t df, uint16_t port, int direction,
     return 0;
 }
 
+static int hax_get_segments(CPUX86State *env, struct vcpu_state_t *sregs);
+static int hax_setup_qemu_emulator(CPUX86State *env);
+
+/*
+ * Most MMIO exits come from a few simple instructions, like the mov and
+ * movzx of the goldfish drivers to the device registers. Decode and
+ * execute those here, using only the general registers, the control
+ * registers and the segments, so that they need neither a full vCPU state
+ * sync with the FPU and MSRs nor a TCG flush and round trip.
+ */
+struct hax_mmio_insn
+{
+    int len;            /* instruction length */
+    int size;           /* access size, in bytes */
+    int is_write;
+    int reg;            /* register operand, or -1 for an immediate */
+    int zero_extend;    /* movzx, the register is 4 bytes wide */
+    int stos;
+    int seg;
+    uint32_t imm;
+    uint32_t ea;        /* offset in |seg| */
+};
+
+/* Return the address of the |size| bytes wide register |reg| in |state| */
+static void *hax_mmio_reg(struct vcpu_state_t *state, int reg, int size)
+{
+    /* Without REX prefix, byte registers 4 to 7 are AH, CH, DH and BH */
+    if (size == 1 && reg >= 4)
+        return (uint8_t *)&state->_regs[reg - 4] + 1;
+    return &state->_regs[reg];
+}
+
+/*
+ * Decode the ModRM operand at |p| into |insn|, for 32-bit addressing.
+ * Return the number of bytes used, or -1 for operands that are not in
+ * memory.
+ */
+static int hax_mmio_decode_modrm(struct vcpu_state_t *state,
+  const uint8_t *p, struct hax_mmio_insn *insn, int *reg)
+{
+    const uint8_t *start = p;
+    int mod = p[0] >> 6;
+    int rm = p[0] & 7;
+    int base = -1;
+    uint32_t ea = 0;
+
+    *reg = (p[0] >> 3) & 7;
+    p++;
+    if (mod == 3)
+        return -1;
+
+    if (rm == 4) {
+        int scale = p[0] >> 6;
+        int index = (p[0] >> 3) & 7;
+
+        base = p[0] & 7;
+        p++;
+        if (index != 4)
+            ea = (uint32_t)state->_regs[index] << scale;
+        if (base == 5 && mod == 0) {
+            base = -1;
+            ea += ldl_p(p);
+            p += 4;
+        }
+    } else if (rm == 5 && mod == 0) {
+        ea = ldl_p(p);
+        p += 4;
+    } else {
+        base = rm;
+    }
+
+    if (base >= 0)
+        ea += (uint32_t)state->_regs[base];
+    if (mod == 1) {
+        ea += (int8_t)p[0];
+        p++;
+    } else if (mod == 2) {
+        ea += ldl_p(p);
+        p += 4;
+    }
+
+    /* Accesses based on ESP or EBP use the stack segment by default */
+    if (insn->seg < 0)
+        insn->seg = (base == R_ESP || base == R_EBP) ? R_SS : R_DS;
+    insn->ea = ea;
+    return p - start;
+}
+
+/* Decode the instruction |code| into |insn|, return 0 on success */
+static int hax_mmio_decode(struct vcpu_state_t *state,
+  const uint8_t *code, struct hax_mmio_insn *insn)
+{
+    const uint8_t *p = code;
+    int opsize = 4;
+    int reg, len;
+
+    memset(insn, 0, sizeof(*insn));
+    insn->seg = -1;
+
+    for (;; p++) {
+        switch (*p) {
+            case 0x26: insn->seg = R_ES; continue;
+            case 0x2e: insn->seg = R_CS; continue;
+            case 0x36: insn->seg = R_SS; continue;
+            case 0x3e: insn->seg = R_DS; continue;
+            case 0x64: insn->seg = R_FS; continue;
+            case 0x65: insn->seg = R_GS; continue;
+            case 0x66: opsize = 2; continue;
+        }
+        break;
+    }
+
+    switch (*p++) {
+        case 0x88:  /* mov r/m8, r8 */
+        case 0x89:  /* mov r/m, r */
+        case 0x8a:  /* mov r8, r/m8 */
+        case 0x8b:  /* mov r, r/m */
+            len = hax_mmio_decode_modrm(state, p, insn, &reg);
+            if (len < 0)
+                return -1;
+            p += len;
+            insn->size = (p[-len - 1] & 1) ? opsize : 1;
+            insn->is_write = !(p[-len - 1] & 2);
+            insn->reg = reg;
+            break;
+        case 0xc6:  /* mov r/m8, imm8 */
+        case 0xc7:  /* mov r/m, imm */
+            len = hax_mmio_decode_modrm(state, p, insn, &reg);
+            if (len < 0 || reg != 0)
+                return -1;
+            insn->size = (p[-1] & 1) ? opsize : 1;
+            p += len;
+            insn->is_write = 1;
+            insn->reg = -1;
+            if (insn->size == 1)
+                insn->imm = p[0];
+            else if (insn->size == 2)
+                insn->imm = lduw_p(p);
+            else
+                insn->imm = ldl_p(p);
+            p += insn->size;
+            break;
+        case 0x0f:
+            if (*p != 0xb6 && *p != 0xb7)
+                return -1;
+            /* movzx r, r/m8 and movzx r, r/m16 */
+            insn->size = (*p == 0xb6) ? 1 : 2;
+            p++;
+            len = hax_mmio_decode_modrm(state, p, insn, &reg);
+            if (len < 0 || opsize != 4)
+                return -1;
+            p += len;
+            insn->reg = reg;
+            insn->zero_extend = 1;
+            break;
+        case 0xaa:  /* stosb */
+        case 0xab:  /* stos */
+            /* The destination segment can't be overridden */
+            insn->size = (p[-1] & 1) ? opsize : 1;
+            insn->is_write = 1;
+            insn->reg = R_EAX;
+            insn->stos = 1;
+            insn->seg = R_ES;
+            insn->ea = (uint32_t)state->_rdi;
+            break;
+        default:
+            return -1;
+    }
+
+    insn->len = p - code;
+    return 0;
+}
+
+/*
+ * Try to handle a HAX_EXIT_MMIO exit without QEMU's emulation.
+ * Return 0 if the instruction was executed, or -1 if it must go through
+ * the TCG emulation, in which case the HAX vCPU state is left untouched.
+ */
+static int hax_handle_mmio(CPUState *cpu)
+{
+    CPUX86State *env = cpu->env_ptr;
+    struct vcpu_state_t state;
+    struct hax_mmio_insn insn;
+    uint8_t code[16];
+    uint8_t buf[4];
+    target_ulong addr;
+    hwaddr gpa;
+
+    if (hax_sync_vcpu_state(cpu, &state, 0) < 0)
+        return -1;
+
+    /*
+     * The address translation only needs the control registers and the
+     * segments. The rest of |env| is stale until the next full sync.
+     */
+    env->cr[0] = state._cr0;
+    env->cr[2] = state._cr2;
+    env->cr[3] = state._cr3;
+    env->cr[4] = state._cr4;
+    env->eflags = state._rflags;
+    hax_get_segments(env, &state);
+    hax_setup_qemu_emulator(env);
+
+    /* Only 32-bit protected mode with paging, no single-stepping */
+    if (!(env->cr[0] & CR0_PG_MASK) || !(env->hflags & HF_CS32_MASK) ||
+      (env->hflags & HF_CS64_MASK) || (env->eflags & (VM_MASK | TF_MASK)))
+        return -1;
+
+    memset(code, 0, sizeof(code));
+    addr = env->segs[R_CS].base + (uint32_t)state._rip;
+    if (cpu_memory_rw_debug(cpu, addr, code, 15, 0) < 0)
+        return -1;
+    if (hax_mmio_decode(&state, code, &insn) < 0)
+        return -1;
+
+    addr = (uint32_t)(env->segs[insn.seg].base + insn.ea);
+    if ((addr & ~TARGET_PAGE_MASK) + insn.size > TARGET_PAGE_SIZE)
+        return -1;
+    gpa = cpu_get_phys_page_debug(env, addr & TARGET_PAGE_MASK);
+    if (gpa == -1)
+        return -1;
+    gpa += addr & ~TARGET_PAGE_MASK;
+
+    if (insn.is_write) {
+        if (insn.reg < 0)
+            memcpy(buf, &insn.imm, insn.size);
+        else
+            memcpy(buf, hax_mmio_reg(&state, insn.reg, insn.size), insn.size);
+        cpu_physical_memory_rw(gpa, buf, insn.size, 1);
+    } else {
+        uint32_t value;
+
+        cpu_physical_memory_rw(gpa, buf, insn.size, 0);
+        if (insn.size == 1)
+            value = ldub_p(buf);
+        else if (insn.size == 2)
+            value = lduw_p(buf);
+        else
+            value = ldl_p(buf);
+        if (insn.zero_extend)
+            stl_p(hax_mmio_reg(&state, insn.reg, 4), value);
+        else
+            memcpy(hax_mmio_reg(&state, insn.reg, insn.size), buf, insn.size);
+    }
+
+    if (insn.stos) {
+        if (state._rflags & DF_MASK)
+            state._edi -= insn.size;
+        else
+            state._edi += insn.size;
+    }
+    state._eip += insn.len;
+
+    /* The access was done, it can't be replayed through TCG anymore */
+    if (hax_sync_vcpu_state(cpu, &state, 1) < 0)
+    {
+        dprint("Failed to sync vcpu reg after MMIO for vcpu %x\n",
+          cpu->hax_vcpu->vcpu_id);
+        abort();
+    }
+    return 0;
+}
+
 static int hax_vcpu_interrupt(CPUState *cpu)
 {
     struct hax_vcpu_state *vcpu = cpu->hax_vcpu;
@@ -556,7 +859,10 @@ static int hax_vcpu_hax_exec(CPUState *cpu)
 
         hax_vcpu_interrupt(cpu);
 
+        /* Let the other vCPUs and the main loop run while in the guest. */
+        qemu_mutex_unlock_iothread();
         hax_ret = hax_vcpu_run(vcpu);
+        qemu_mutex_lock_iothread();
 
         /* Simply continue the vcpu_run if system call interrupted */
         if (hax_ret == -EINTR || hax_ret == -EAGAIN) {
@@ -569,6 +875,7 @@ static int hax_vcpu_hax_exec(CPUState *cpu)
             dprint("vcpu run failed for vcpu  %x\n", vcpu->vcpu_id);
             abort();
         }
+        hax_count_exit(ht->_exit_status);
         switch (ht->_exit_status)
         {
             case HAX_EXIT_IO:
@@ -579,6 +886,11 @@ static int hax_vcpu_hax_exec(CPUState *cpu)
                 }
                 break;
             case HAX_EXIT_MMIO:
+                if (!hax_handle_mmio(cpu)) {
+                    metric_add(hax_mmio_decoded_metric, 1);
+                    break;
+                }
+                metric_add(hax_mmio_emulated_metric, 1);
                 ret = HAX_EMUL_ONE;
                 break;
             case HAX_EXIT_FAST_MMIO:
@@ -6766,9 +6766,11 @@ static target_ulong disas_insn(CPUX86State *env, DisasContext *s, target_ulong p
             tcg_gen_mov_tl(t0, cpu_T[0]);
             tcg_gen_brcondi_tl(TCG_COND_EQ, t0, 0, label1);
             if (b & 1) {
-                gen_helper_bsr(cpu_T[0], t0);
+                /* The input is not zero, so clz is less than the width.  */
+                tcg_gen_clz_tl(cpu_T[0], t0);
+                tcg_gen_xori_tl(cpu_T[0], cpu_T[0], TARGET_LONG_BITS - 1);
             } else {
-                gen_helper_bsf(cpu_T[0], t0);
+                tcg_gen_ctz_tl(cpu_T[0], t0);
             }
             gen_op_mov_reg_T0(ot, reg);
             tcg_gen_movi_tl(cpu_cc_dst, 1);
@@ -657,6 +657,21 @@ void cpu_mips_update_irq (CPUMIPSState *env);
 /* helper.c */
 int cpu_mips_handle_mmu_fault (CPUMIPSState *env, target_ulong address, int rw,
                                int mmu_idx);
+
+/* Software TLB statistics, counted since startup and printed by the
+   'profile counters' console command. Each softmmu TLB miss ends up in
+   exactly one of the first four counters. */
+typedef struct MIPSTLBStats {
+    uint64_t guest_tlb_hits;    /* found in the guest TLB */
+    uint64_t refills;           /* refilled by walking the guest page table */
+    uint64_t refill_exceptions; /* left to the guest TLB refill handler */
+    uint64_t other_exceptions;  /* invalid, modified or address errors */
+    uint64_t guest_tlbwr;       /* tlbwr executed by the guest */
+    uint64_t guest_tlbwi;       /* tlbwi executed by the guest */
+} MIPSTLBStats;
+
+extern MIPSTLBStats mips_tlb_stats;
+
 #define cpu_handle_mmu_fault cpu_mips_handle_mmu_fault
 void do_interrupt (CPUMIPSState *env);
 void r4k_invalidate_tlb (CPUMIPSState *env, int idx, int use_extra);
@@ -25,6 +25,8 @@
 
 #include "cpu.h"
 
+MIPSTLBStats mips_tlb_stats;
+
 enum {
     TLBRET_DIRTY = -4,
     TLBRET_INVALID = -3,
@@ -595,16 +597,24 @@ int cpu_mips_handle_mmu_fault (CPUMIPSState *env, target_ulong address, int rw,
     qemu_log("%s address=" TARGET_FMT_lx " ret %d physical " TARGET_FMT_plx " prot %d\n",
               __func__, address, ret, physical, prot);
     if (ret == TLBRET_MATCH) {
+       mips_tlb_stats.guest_tlb_hits++;
        tlb_set_page(env, address & TARGET_PAGE_MASK,
                     physical & TARGET_PAGE_MASK, prot | PAGE_EXEC,
                     mmu_idx, TARGET_PAGE_SIZE);
        ret = 0;
-   } else if (ret == TLBRET_NOMATCH)
+   } else if (ret == TLBRET_NOMATCH) {
         ret = cpu_mips_tlb_refill(env,address,rw,mmu_idx,1);
+        if (ret == TLBRET_MATCH)
+            mips_tlb_stats.refills++;
+   }
 
     if (ret < 0)
 #endif
     {
+        if (ret == TLBRET_NOMATCH)
+            mips_tlb_stats.refill_exceptions++;
+        else
+            mips_tlb_stats.other_exceptions++;
         raise_mmu_exception(env, address, rw, ret);
         ret = 1;
     }
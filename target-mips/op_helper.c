@@ -1705,11 +1705,13 @@ void r4k_helper_tlbr(CPUMIPSState *env)
 
 void helper_tlbwi(CPUMIPSState *env)
 {
+    mips_tlb_stats.guest_tlbwi++;
     env->tlb->helper_tlbwi(env);
 }
 
 void helper_tlbwr(CPUMIPSState *env)
 {
+    mips_tlb_stats.guest_tlbwr++;
     env->tlb->helper_tlbwr(env);
 }
 
@@ -476,6 +476,12 @@ typedef struct DisasContext {
     uint32_t hflags, saved_hflags;
     int bstate;
     target_ulong btarget;
+    /* mask of the TB jump slots already used by a goto_tb */
+    int tb_slots;
+    /* set when translation may go on past a not-taken conditional branch */
+    int can_continue;
+    /* label of the code after a branch-likely's delay slot, or -1 */
+    int bl_skip_label;
 } DisasContext;
 
 enum {
@@ -2520,8 +2526,15 @@ static inline void gen_goto_tb(DisasContext *ctx, int n, target_ulong dest)
 {
     TranslationBlock *tb;
     tb = ctx->tb;
+    /* A TB that continued past a not-taken branch has already used a jump
+       slot for the taken exit: use the other one, or don't chain. */
+    if (ctx->tb_slots & (1 << n)) {
+        n ^= 1;
+    }
     if ((tb->pc & TARGET_PAGE_MASK) == (dest & TARGET_PAGE_MASK) &&
+        !(ctx->tb_slots & (1 << n)) &&
         likely(!ctx->singlestep_enabled)) {
+        ctx->tb_slots |= 1 << n;
         tcg_gen_goto_tb(n);
         gen_save_pc(dest);
         tcg_gen_exit_tb((uintptr_t)tb + n);
@@ -7717,7 +7730,14 @@ static void decode_opc (CPUMIPSState *env, DisasContext *ctx)
         MIPS_DEBUG("blikely condition (" TARGET_FMT_lx ")", ctx->pc + 4);
         tcg_gen_brcondi_tl(TCG_COND_NE, bcond, 0, l1);
         tcg_gen_movi_i32(hflags, ctx->hflags & ~MIPS_HFLAG_BMASK);
-        gen_goto_tb(ctx, 1, ctx->pc + 4);
+        if (ctx->can_continue) {
+            /* Skip the nullified delay slot, and go on translating after
+               it once the branch is completed. */
+            ctx->bl_skip_label = gen_new_label();
+            tcg_gen_br(ctx->bl_skip_label);
+        } else {
+            gen_goto_tb(ctx, 1, ctx->pc + 4);
+        }
         gen_set_label(l1);
     }
 
@@ -8301,6 +8321,10 @@ static void decode_opc (CPUMIPSState *env, DisasContext *ctx)
     }
     if (ctx->hflags & MIPS_HFLAG_BMASK) {
         int hflags = ctx->hflags & MIPS_HFLAG_BMASK;
+        /* Go on past a not-taken conditional branch, unless the delay slot
+           ended the TB. The fall-through path then starts a new basic block
+           in the same TB instead of chaining to another TB. */
+        int do_continue = ctx->can_continue && ctx->bstate == BS_NONE;
         /* Branches completion */
         ctx->hflags &= ~MIPS_HFLAG_BMASK;
         ctx->bstate = BS_BRANCH;
@@ -8316,6 +8340,17 @@ static void decode_opc (CPUMIPSState *env, DisasContext *ctx)
             /* blikely taken case */
             MIPS_DEBUG("blikely branch taken");
             gen_goto_tb(ctx, 0, ctx->btarget);
+            if (ctx->bl_skip_label >= 0) {
+                /* blikely not taken, the delay slot was skipped */
+                gen_set_label(ctx->bl_skip_label);
+                ctx->bl_skip_label = -1;
+                if (do_continue) {
+                    ctx->bstate = BS_NONE;
+                    ctx->saved_pc = -1;
+                } else {
+                    gen_goto_tb(ctx, 1, ctx->pc + 4);
+                }
+            }
             break;
         case MIPS_HFLAG_BC:
             /* Conditional branch */
@@ -8323,6 +8358,15 @@ static void decode_opc (CPUMIPSState *env, DisasContext *ctx)
             {
                 int l1 = gen_new_label();
 
+                if (do_continue) {
+                    tcg_gen_brcondi_tl(TCG_COND_EQ, bcond, 0, l1);
+                    gen_goto_tb(ctx, 0, ctx->btarget);
+                    gen_set_label(l1);
+                    ctx->bstate = BS_NONE;
+                    /* the delay slot may have saved a PC on this path */
+                    ctx->saved_pc = -1;
+                    break;
+                }
                 tcg_gen_brcondi_tl(TCG_COND_NE, bcond, 0, l1);
                 gen_goto_tb(ctx, 1, ctx->pc + 4);
                 gen_set_label(l1);
@@ -8368,6 +8412,9 @@ gen_intermediate_code_internal (CPUMIPSState *env, TranslationBlock *tb,
     ctx.singlestep_enabled = ENV_GET_CPU(env)->singlestep_enabled;
     ctx.tb = tb;
     ctx.bstate = BS_NONE;
+    ctx.tb_slots = 0;
+    ctx.can_continue = 0;
+    ctx.bl_skip_label = -1;
     /* Restore delay slot state from the tb context.  */
     ctx.hflags = (uint32_t)tb->flags; /* FIXME: maybe use 64 bits here? */
     restore_cpu_state(env, &ctx);
@@ -8416,6 +8463,16 @@ gen_intermediate_code_internal (CPUMIPSState *env, TranslationBlock *tb,
         }
         if (num_insns + 1 == max_insns && (tb->cflags & CF_LAST_IO))
             gen_io_start();
+        /* Continuing past a branch is only worth it while both jump slots
+           are free, the fall-through is on the first page of the TB, and
+           there is room left for more instructions. */
+        if (!(ctx.hflags & MIPS_HFLAG_BMASK)) {
+            ctx.can_continue =
+                ctx.tb_slots == 0 && !ctx.singlestep_enabled && !singlestep &&
+                !(tb->cflags & CF_LAST_IO) && num_insns + 3 < max_insns &&
+                ((ctx.pc + 8) & TARGET_PAGE_MASK) == (pc_start & TARGET_PAGE_MASK) &&
+                tcg_ctx.gen_opc_ptr + 2 * MAX_OP_PER_INSTR < gen_opc_end;
+        }
         ctx.opcode = cpu_ldl_code(env, ctx.pc);
         decode_opc(env, &ctx);
         ctx.pc += 4;
@@ -51,6 +51,17 @@ uint32_t tcg_helper_remu_i32(uint32_t arg1, uint32_t arg2)
     return arg1 % arg2;
 }
 
+/* ARG2 is the result for a zero ARG1.  */
+uint32_t tcg_helper_clz_i32(uint32_t arg1, uint32_t arg2)
+{
+    return arg1 ? clz32(arg1) : arg2;
+}
+
+uint32_t tcg_helper_ctz_i32(uint32_t arg1, uint32_t arg2)
+{
+    return arg1 ? ctz32(arg1) : arg2;
+}
+
 /* 64-bit helpers */
 
 int64_t tcg_helper_shl_i64(int64_t arg1, int64_t arg2)
@@ -101,3 +112,13 @@ int64_t tcg_helper_mulsh_i64(int64_t arg1, int64_t arg2)
     muls64(&l, &h, arg1, arg2);
     return h;
 }
+
+uint64_t tcg_helper_clz_i64(uint64_t arg1, uint64_t arg2)
+{
+    return arg1 ? clz64(arg1) : arg2;
+}
+
+uint64_t tcg_helper_ctz_i64(uint64_t arg1, uint64_t arg2)
+{
+    return arg1 ? ctz64(arg1) : arg2;
+}
@@ -144,6 +144,12 @@ static bool have_bmi2;
 # define have_bmi2 0
 #endif
 
+#if defined(CONFIG_CPUID_H) && defined(bit_LZCNT)
+static bool have_lzcnt;
+#else
+# define have_lzcnt 0
+#endif
+
 static uint8_t *tb_ret_addr;
 
 static void patch_reloc(uint8_t *code_ptr, int type,
@@ -311,6 +317,8 @@ static inline int tcg_target_const_match(tcg_target_long val,
 #define OPC_ARITH_GvEv	(0x03)		/* ... plus (ARITH_FOO << 3) */
 #define OPC_ANDN        (0xf2 | P_EXT38)
 #define OPC_ADD_GvEv	(OPC_ARITH_GvEv | (ARITH_ADD << 3))
+#define OPC_BSF         (0xbc | P_EXT)
+#define OPC_BSR         (0xbd | P_EXT)
 #define OPC_BSWAP	(0xc8 | P_EXT)
 #define OPC_CALL_Jz	(0xe8)
 #define OPC_CMOVCC      (0x40 | P_EXT)  /* ... plus condition code */
@@ -325,6 +333,7 @@ static inline int tcg_target_const_match(tcg_target_long val,
 #define OPC_JMP_long	(0xe9)
 #define OPC_JMP_short	(0xeb)
 #define OPC_LEA         (0x8d)
+#define OPC_LZCNT       (0xbd | P_EXT | P_SIMDF3)
 #define OPC_MOVB_EvGv	(0x88)		/* stores, more or less */
 #define OPC_MOVL_EvGv	(0x89)		/* stores, more or less */
 #define OPC_MOVL_GvEv	(0x8b)		/* loads, more or less */
@@ -351,6 +360,7 @@ static inline int tcg_target_const_match(tcg_target_long val,
 #define OPC_SHLX        (0xf7 | P_EXT38 | P_DATA16)
 #define OPC_SHRX        (0xf7 | P_EXT38 | P_SIMDF2)
 #define OPC_TESTL	(0x85)
+#define OPC_TZCNT       (0xbc | P_EXT | P_SIMDF3)
 #define OPC_XCHG_ax_r32	(0x90)
 
 #define OPC_GRP3_Ev	(0xf7)
@@ -436,6 +446,11 @@ static void tcg_out_opc(TCGContext *s, int opc, int r, int rm, int x)
     if (opc & P_ADDR32) {
         tcg_out8(s, 0x67);
     }
+    if (opc & P_SIMDF3) {
+        tcg_out8(s, 0xf3);
+    } else if (opc & P_SIMDF2) {
+        tcg_out8(s, 0xf2);
+    }
 
     rex = 0;
     rex |= (opc & P_REXW) ? 0x8 : 0x0;  /* REX.W */
@@ -469,6 +484,11 @@ static void tcg_out_opc(TCGContext *s, int opc)
     if (opc & P_DATA16) {
         tcg_out8(s, 0x66);
     }
+    if (opc & P_SIMDF3) {
+        tcg_out8(s, 0xf3);
+    } else if (opc & P_SIMDF2) {
+        tcg_out8(s, 0xf2);
+    }
     if (opc & (P_EXT | P_EXT38)) {
         tcg_out8(s, 0x0f);
         if (opc & P_EXT38) {
@@ -735,6 +755,18 @@ static void tcg_out_shifti(TCGContext *s, int subopc, int reg, int count)
     }
 }
 
+/* Emit an N-byte nop: the one-byte nop is "xchg %eax,%eax", and adding
+   operand size prefixes gives "xchg %ax,%ax", which all cores accept.  */
+static void tcg_out_nopn(TCGContext *s, int n)
+{
+    int i;
+
+    for (i = 1; i < n; ++i) {
+        tcg_out8(s, 0x66);
+    }
+    tcg_out8(s, 0x90);
+}
+
 static inline void tcg_out_bswap32(TCGContext *s, int reg)
 {
     tcg_out_opc(s, OPC_BSWAP + LOWREGMASK(reg), 0, reg, 0);
@@ -1102,6 +1134,41 @@ static void tcg_out_movcond64(TCGContext *s, TCGCond cond, TCGArg dest,
 }
 #endif
 
+/* Count leading zeros, or the operand width for a zero input.  */
+static void tcg_out_clz(TCGContext *s, int rexw, TCGArg dest, TCGArg arg)
+{
+    int bits = rexw ? 64 : 32;
+
+    if (have_lzcnt) {
+        tcg_out_modrm(s, OPC_LZCNT + rexw, dest, arg);
+    } else {
+        /* BSR gives the index of the top set bit, and leaves DEST
+           undefined and ZF set for a zero input.  Use 2 * BITS - 1
+           there, so that the final xor turns it into BITS.  */
+        int over = gen_new_label();
+        tcg_out_modrm(s, OPC_BSR + rexw, dest, arg);
+        tcg_out_jxx(s, JCC_JNE, over, 1);
+        tcg_out_movi(s, TCG_TYPE_I32, dest, 2 * bits - 1);
+        tcg_out_label(s, over, s->code_ptr);
+        tgen_arithi(s, ARITH_XOR + rexw, dest, bits - 1, 0);
+    }
+}
+
+/* Count trailing zeros, or the operand width for a zero input.  */
+static void tcg_out_ctz(TCGContext *s, int rexw, TCGArg dest, TCGArg arg)
+{
+    /* TZCNT is part of BMI1.  */
+    if (have_bmi1) {
+        tcg_out_modrm(s, OPC_TZCNT + rexw, dest, arg);
+    } else {
+        int over = gen_new_label();
+        tcg_out_modrm(s, OPC_BSF + rexw, dest, arg);
+        tcg_out_jxx(s, JCC_JNE, over, 1);
+        tcg_out_movi(s, TCG_TYPE_I32, dest, rexw ? 64 : 32);
+        tcg_out_label(s, over, s->code_ptr);
+    }
+}
+
 static void tcg_out_branch(TCGContext *s, int call, uintptr_t dest)
 {
     intptr_t disp = dest - (intptr_t)s->code_ptr - 5;
@@ -1739,7 +1806,12 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
         break;
     case INDEX_op_goto_tb:
         if (s->tb_jmp_offset) {
-            /* direct jump method */
+            /* direct jump method.  Align the displacement so that
+               tb_set_jmp_target1() can patch it with a single store.  */
+            int gap = -(uintptr_t)(s->code_ptr + 1) & 3;
+            if (gap) {
+                tcg_out_nopn(s, gap);
+            }
             tcg_out8(s, OPC_JMP_long); /* jmp im */
             s->tb_jmp_offset[args[0]] = s->code_ptr - s->code_buf;
             tcg_out32(s, 0);
@@ -1750,6 +1822,10 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
         }
         s->tb_next_offset[args[0]] = s->code_ptr - s->code_buf;
         break;
+    case INDEX_op_goto_ptr:
+        /* jmp *reg */
+        tcg_out_modrm(s, OPC_GRP5, EXT5_JMPN_Ev, args[0]);
+        break;
     case INDEX_op_call:
         if (const_args[0]) {
             tcg_out_calli(s, args[0]);
@@ -1941,6 +2017,13 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
         tcg_out_bswap32(s, args[0]);
         break;
 
+    OP_32_64(clz):
+        tcg_out_clz(s, rexw, args[0], args[1]);
+        break;
+    OP_32_64(ctz):
+        tcg_out_ctz(s, rexw, args[0], args[1]);
+        break;
+
     OP_32_64(neg):
         tcg_out_modrm(s, OPC_GRP3_Ev + rexw, EXT3_NEG, args[0]);
         break;
@@ -2082,6 +2165,7 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
 static const TCGTargetOpDef x86_op_defs[] = {
     { INDEX_op_exit_tb, { } },
     { INDEX_op_goto_tb, { } },
+    { INDEX_op_goto_ptr, { "r" } },
     { INDEX_op_call, { "ri" } },
     { INDEX_op_br, { } },
     { INDEX_op_mov_i32, { "r", "r" } },
@@ -2115,6 +2199,8 @@ static const TCGTargetOpDef x86_op_defs[] = {
 
     { INDEX_op_bswap16_i32, { "r", "0" } },
     { INDEX_op_bswap32_i32, { "r", "0" } },
+    { INDEX_op_clz_i32, { "r", "r" } },
+    { INDEX_op_ctz_i32, { "r", "r" } },
 
     { INDEX_op_neg_i32, { "r", "0" } },
 
@@ -2175,6 +2261,8 @@ static const TCGTargetOpDef x86_op_defs[] = {
     { INDEX_op_bswap16_i64, { "r", "0" } },
     { INDEX_op_bswap32_i64, { "r", "0" } },
     { INDEX_op_bswap64_i64, { "r", "0" } },
+    { INDEX_op_clz_i64, { "r", "r" } },
+    { INDEX_op_ctz_i64, { "r", "r" } },
     { INDEX_op_neg_i64, { "r", "0" } },
     { INDEX_op_not_i64, { "r", "0" } },
 
@@ -2279,6 +2367,11 @@ static void tcg_target_qemu_prologue(TCGContext *s)
     tcg_out_modrm(s, OPC_GRP5, EXT5_JMPN_Ev, tcg_target_call_iarg_regs[1]);
 #endif
 
+    /* Return path for goto_ptr: return 0 like exit_tb(0), falling through
+       to the rest of the epilogue.  */
+    s->code_gen_epilogue = s->code_ptr;
+    tcg_out_movi(s, TCG_TYPE_REG, TCG_REG_EAX, 0);
+
     /* TB epilogue */
     tb_ret_addr = s->code_ptr;
 
@@ -2326,6 +2419,16 @@ static void tcg_target_init(TCGContext *s)
 #endif
 #ifndef have_bmi2
         have_bmi2 = (b & bit_BMI2) != 0;
+#endif
+    }
+
+    max = __get_cpuid_max(0x80000000, 0);
+    if (max >= 0x80000001) {
+        __cpuid(0x80000001, a, b, c, d);
+#ifndef have_lzcnt
+        /* LZCNT was introduced with AMD Barcelona and Intel Haswell CPUs.
+           Older CPUs execute its encoding as BSR.  */
+        have_lzcnt = (c & bit_LZCNT) != 0;
 #endif
     }
 #endif
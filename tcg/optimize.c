@@ -1278,10 +1278,238 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
     return gen_args;
 }
 
+/* Accesses to the CPU state tracked by tcg_env_optimize().  */
+#define MAX_ENV_ACCESSES 32
+
+struct env_access {
+    tcg_target_long offset;
+    int size;
+    TCGArg val;            /* temp holding the value at OFFSET */
+    uint16_t *opc_ptr;     /* for pending stores: the store opcode */
+};
+
+struct env_accesses {
+    struct env_access e[MAX_ENV_ACCESSES];
+    int count;
+};
+
+static void env_accesses_add(struct env_accesses *a, tcg_target_long offset,
+                             int size, TCGArg val, uint16_t *opc_ptr)
+{
+    /* Forgetting about an access is always safe.  */
+    if (a->count < MAX_ENV_ACCESSES) {
+        a->e[a->count].offset = offset;
+        a->e[a->count].size = size;
+        a->e[a->count].val = val;
+        a->e[a->count].opc_ptr = opc_ptr;
+        a->count++;
+    }
+}
+
+static void env_accesses_remove(struct env_accesses *a, int i)
+{
+    a->e[i] = a->e[--a->count];
+}
+
+static bool env_access_overlaps(const struct env_access *e,
+                                tcg_target_long offset, int size)
+{
+    return e->offset < offset + size && offset < e->offset + e->size;
+}
+
+/* Return the number of bytes accessed by the host memory load or store OP,
+   or 0 if OP is not one.  */
+static int env_access_size(TCGOpcode op, bool *is_store)
+{
+    *is_store = false;
+    switch (op) {
+    CASE_OP_32_64(st8):
+        *is_store = true;
+        /* fall through */
+    CASE_OP_32_64(ld8u):
+    CASE_OP_32_64(ld8s):
+        return 1;
+    CASE_OP_32_64(st16):
+        *is_store = true;
+        /* fall through */
+    CASE_OP_32_64(ld16u):
+    CASE_OP_32_64(ld16s):
+        return 2;
+    case INDEX_op_st_i32:
+    case INDEX_op_st32_i64:
+        *is_store = true;
+        /* fall through */
+    case INDEX_op_ld_i32:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld32s_i64:
+        return 4;
+    case INDEX_op_st_i64:
+        *is_store = true;
+        /* fall through */
+    case INDEX_op_ld_i64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+/* Remove redundant loads and dead stores of the CPU state within each basic
+   block.  ARM guests for instance store NF/ZF/CF/VF at each flag-setting
+   instruction and reload them for each conditional one, while most flag
+   values are overwritten before anything looks at them.
+
+   Only accesses with the fixed env register as base are considered, and
+   everything is forgotten at labels, branches, helper calls and guest
+   memory accesses, since those may read or write the CPU state behind our
+   back.  Loads and stores through any other pointer are assumed to alias
+   the CPU state.
+
+   A store is dead when a later store covers it before any load that may
+   read it; it becomes a nop and liveness analysis then removes the code
+   computing its value.  A full-width load of a value that is still in a
+   temp, because it was just stored or loaded, becomes a move.  */
+static TCGArg *tcg_env_optimize(TCGContext *s, uint16_t *tcg_opc_ptr,
+                                TCGArg *args, TCGOpDef *tcg_op_defs)
+{
+    struct env_accesses stores, values;
+    int i, j, nb_args, nb_ops, op_index, size;
+    TCGOpcode op;
+    const TCGOpDef *def;
+    TCGArg *gen_args;
+    tcg_target_long offset;
+    bool is_store, full;
+
+    stores.count = 0;
+    values.count = 0;
+
+    nb_ops = tcg_opc_ptr - s->gen_opc_buf;
+    gen_args = args;
+    for (op_index = 0; op_index < nb_ops; op_index++) {
+        op = s->gen_opc_buf[op_index];
+        def = &tcg_op_defs[op];
+        if (op == INDEX_op_call) {
+            nb_args = (args[0] >> 16) + (args[0] & 0xffff) + 3;
+        } else if (op == INDEX_op_nopn) {
+            nb_args = args[0];
+        } else {
+            nb_args = def->nb_args;
+        }
+
+        size = env_access_size(op, &is_store);
+        if (op == INDEX_op_call
+            || (def->flags & (TCG_OPF_BB_END | TCG_OPF_CALL_CLOBBER
+                              | TCG_OPF_SIDE_EFFECTS))) {
+            stores.count = 0;
+            values.count = 0;
+        } else if (size && (!s->temps[args[1]].fixed_reg
+                            || s->temps[args[1]].reg != TCG_AREG0)) {
+            /* Access through another pointer, which may point anywhere
+               into the CPU state.  */
+            if (is_store) {
+                values.count = 0;
+            } else {
+                stores.count = 0;
+            }
+        } else if (size) {
+            offset = args[2];
+            full = (op == INDEX_op_ld_i32 || op == INDEX_op_st_i32
+                    || op == INDEX_op_ld_i64 || op == INDEX_op_st_i64);
+            if (is_store) {
+                for (i = stores.count - 1; i >= 0; i--) {
+                    struct env_access *e = &stores.e[i];
+                    if (e->offset >= offset
+                        && e->offset + e->size <= offset + size) {
+                        *e->opc_ptr = INDEX_op_nop3;
+                        env_accesses_remove(&stores, i);
+#ifdef CONFIG_PROFILER
+                        s->del_st_count++;
+#endif
+                    }
+                }
+                for (i = values.count - 1; i >= 0; i--) {
+                    if (env_access_overlaps(&values.e[i], offset, size)) {
+                        env_accesses_remove(&values, i);
+                    }
+                }
+                env_accesses_add(&stores, offset, size, args[0],
+                                 &s->gen_opc_buf[op_index]);
+                if (full) {
+                    env_accesses_add(&values, offset, size, args[0], NULL);
+                }
+            } else {
+                int found = -1;
+
+                for (i = stores.count - 1; i >= 0; i--) {
+                    if (env_access_overlaps(&stores.e[i], offset, size)) {
+                        env_accesses_remove(&stores, i);
+                    }
+                }
+                for (i = 0; full && i < values.count; i++) {
+                    if (values.e[i].offset == offset
+                        && values.e[i].size == size) {
+                        found = i;
+                        break;
+                    }
+                }
+                if (found >= 0 && values.e[found].val == args[0]) {
+                    /* Reloading the value of the temp it came from.  */
+                    s->gen_opc_buf[op_index] = INDEX_op_nop;
+                } else {
+                    TCGArg val = found >= 0 ? values.e[found].val : 0;
+
+                    for (j = values.count - 1; j >= 0; j--) {
+                        if (values.e[j].val == args[0]) {
+                            env_accesses_remove(&values, j);
+                        }
+                    }
+                    if (found < 0) {
+                        if (full) {
+                            env_accesses_add(&values, offset, size, args[0],
+                                             NULL);
+                        }
+                        goto copy_args;
+                    }
+                    s->gen_opc_buf[op_index] = (size == 8 ? INDEX_op_mov_i64
+                                                : INDEX_op_mov_i32);
+                    gen_args[0] = args[0];
+                    gen_args[1] = val;
+                    gen_args += 2;
+                }
+#ifdef CONFIG_PROFILER
+                s->del_ld_count++;
+#endif
+                args += nb_args;
+                continue;
+            }
+        }
+
+        /* Forget the values held by the temps this op overwrites.  */
+        if (op != INDEX_op_call && values.count) {
+            for (i = 0; i < def->nb_oargs; i++) {
+                for (j = values.count - 1; j >= 0; j--) {
+                    if (values.e[j].val == args[i]) {
+                        env_accesses_remove(&values, j);
+                    }
+                }
+            }
+        }
+
+    copy_args:
+        for (i = 0; i < nb_args; i++) {
+            gen_args[i] = args[i];
+        }
+        args += nb_args;
+        gen_args += nb_args;
+    }
+
+    return gen_args;
+}
+
 TCGArg *tcg_optimize(TCGContext *s, uint16_t *tcg_opc_ptr,
         TCGArg *args, TCGOpDef *tcg_op_defs)
 {
     TCGArg *res;
     res = tcg_constant_folding(s, tcg_opc_ptr, args, tcg_op_defs);
+    res = tcg_env_optimize(s, tcg_opc_ptr, args, tcg_op_defs);
     return res;
 }
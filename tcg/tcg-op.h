@@ -2361,6 +2361,104 @@ static inline void tcg_gen_movcond_i64(TCGCond cond, TCGv_i64 ret,
 #endif
 }
 
+/* Count leading or trailing zeros.  The result is the width of ARG when
+   ARG is zero.  */
+static inline void tcg_gen_clz_i32(TCGv_i32 ret, TCGv_i32 arg)
+{
+    if (TCG_TARGET_HAS_clz_i32) {
+        tcg_gen_op2_i32(INDEX_op_clz_i32, ret, arg);
+    } else {
+        int sizemask = 0;
+        TCGv_i32 t0 = tcg_const_i32(32);
+        /* Return value and both arguments are 32-bit and unsigned.  */
+        sizemask |= tcg_gen_sizemask(0, 0, 0);
+        sizemask |= tcg_gen_sizemask(1, 0, 0);
+        sizemask |= tcg_gen_sizemask(2, 0, 0);
+        tcg_gen_helper32(tcg_helper_clz_i32, sizemask, ret, arg, t0);
+        tcg_temp_free_i32(t0);
+    }
+}
+
+static inline void tcg_gen_ctz_i32(TCGv_i32 ret, TCGv_i32 arg)
+{
+    if (TCG_TARGET_HAS_ctz_i32) {
+        tcg_gen_op2_i32(INDEX_op_ctz_i32, ret, arg);
+    } else {
+        int sizemask = 0;
+        TCGv_i32 t0 = tcg_const_i32(32);
+        /* Return value and both arguments are 32-bit and unsigned.  */
+        sizemask |= tcg_gen_sizemask(0, 0, 0);
+        sizemask |= tcg_gen_sizemask(1, 0, 0);
+        sizemask |= tcg_gen_sizemask(2, 0, 0);
+        tcg_gen_helper32(tcg_helper_ctz_i32, sizemask, ret, arg, t0);
+        tcg_temp_free_i32(t0);
+    }
+}
+
+static inline void tcg_gen_clz_i64(TCGv_i64 ret, TCGv_i64 arg)
+{
+#if TCG_TARGET_REG_BITS == 32
+    TCGv_i32 t0 = tcg_temp_new_i32();
+    TCGv_i32 t1 = tcg_temp_new_i32();
+    TCGv_i32 zero = tcg_const_i32(0);
+
+    tcg_gen_clz_i32(t0, TCGV_LOW(arg));
+    tcg_gen_addi_i32(t0, t0, 32);
+    tcg_gen_clz_i32(t1, TCGV_HIGH(arg));
+    tcg_gen_movcond_i32(TCG_COND_EQ, TCGV_LOW(ret), TCGV_HIGH(arg), zero,
+                        t0, t1);
+    tcg_gen_movi_i32(TCGV_HIGH(ret), 0);
+    tcg_temp_free_i32(t0);
+    tcg_temp_free_i32(t1);
+    tcg_temp_free_i32(zero);
+#else
+    if (TCG_TARGET_HAS_clz_i64) {
+        tcg_gen_op2_i64(INDEX_op_clz_i64, ret, arg);
+    } else {
+        int sizemask = 0;
+        TCGv_i64 t0 = tcg_const_i64(64);
+        /* Return value and both arguments are 64-bit and unsigned.  */
+        sizemask |= tcg_gen_sizemask(0, 1, 0);
+        sizemask |= tcg_gen_sizemask(1, 1, 0);
+        sizemask |= tcg_gen_sizemask(2, 1, 0);
+        tcg_gen_helper64(tcg_helper_clz_i64, sizemask, ret, arg, t0);
+        tcg_temp_free_i64(t0);
+    }
+#endif
+}
+
+static inline void tcg_gen_ctz_i64(TCGv_i64 ret, TCGv_i64 arg)
+{
+#if TCG_TARGET_REG_BITS == 32
+    TCGv_i32 t0 = tcg_temp_new_i32();
+    TCGv_i32 t1 = tcg_temp_new_i32();
+    TCGv_i32 zero = tcg_const_i32(0);
+
+    tcg_gen_ctz_i32(t0, TCGV_HIGH(arg));
+    tcg_gen_addi_i32(t0, t0, 32);
+    tcg_gen_ctz_i32(t1, TCGV_LOW(arg));
+    tcg_gen_movcond_i32(TCG_COND_EQ, TCGV_LOW(ret), TCGV_LOW(arg), zero,
+                        t0, t1);
+    tcg_gen_movi_i32(TCGV_HIGH(ret), 0);
+    tcg_temp_free_i32(t0);
+    tcg_temp_free_i32(t1);
+    tcg_temp_free_i32(zero);
+#else
+    if (TCG_TARGET_HAS_ctz_i64) {
+        tcg_gen_op2_i64(INDEX_op_ctz_i64, ret, arg);
+    } else {
+        int sizemask = 0;
+        TCGv_i64 t0 = tcg_const_i64(64);
+        /* Return value and both arguments are 64-bit and unsigned.  */
+        sizemask |= tcg_gen_sizemask(0, 1, 0);
+        sizemask |= tcg_gen_sizemask(1, 1, 0);
+        sizemask |= tcg_gen_sizemask(2, 1, 0);
+        tcg_gen_helper64(tcg_helper_ctz_i64, sizemask, ret, arg, t0);
+        tcg_temp_free_i64(t0);
+    }
+#endif
+}
+
 static inline void tcg_gen_add2_i32(TCGv_i32 rl, TCGv_i32 rh, TCGv_i32 al,
                                     TCGv_i32 ah, TCGv_i32 bl, TCGv_i32 bh)
 {
@@ -2635,6 +2733,17 @@ static inline void tcg_gen_exit_tb(uintptr_t val)
     tcg_gen_op1i(INDEX_op_exit_tb, val);
 }
 
+/* Jump to the host code at |ptr|, which is either the start of a TB or
+   tcg_ctx.code_gen_epilogue.  Only available if TCG_TARGET_HAS_goto_ptr.  */
+static inline void tcg_gen_goto_ptr(TCGv_ptr ptr)
+{
+#if TCG_TARGET_REG_BITS == 32
+    tcg_gen_op1_i32(INDEX_op_goto_ptr, TCGV_PTR_TO_NAT(ptr));
+#else
+    tcg_gen_op1_i64(INDEX_op_goto_ptr, TCGV_PTR_TO_NAT(ptr));
+#endif
+}
+
 static inline void tcg_gen_goto_tb(unsigned idx)
 {
     /* We only support two chained exits.  */
@@ -2766,6 +2875,8 @@ static inline void tcg_gen_qemu_st64(TCGv_i64 arg, TCGv addr, int mem_index)
 #define tcg_gen_ext32s_tl tcg_gen_ext32s_i64
 #define tcg_gen_bswap16_tl tcg_gen_bswap16_i64
 #define tcg_gen_bswap32_tl tcg_gen_bswap32_i64
+#define tcg_gen_clz_tl tcg_gen_clz_i64
+#define tcg_gen_ctz_tl tcg_gen_ctz_i64
 #define tcg_gen_bswap64_tl tcg_gen_bswap64_i64
 #define tcg_gen_concat_tl_i64 tcg_gen_concat32_i64
 #define tcg_gen_extr_i64_tl tcg_gen_extr32_i64
@@ -2844,6 +2955,8 @@ static inline void tcg_gen_qemu_st64(TCGv_i64 arg, TCGv addr, int mem_index)
 #define tcg_gen_ext32s_tl tcg_gen_mov_i32
 #define tcg_gen_bswap16_tl tcg_gen_bswap16_i32
 #define tcg_gen_bswap32_tl tcg_gen_bswap32_i32
+#define tcg_gen_clz_tl tcg_gen_clz_i32
+#define tcg_gen_ctz_tl tcg_gen_ctz_i32
 #define tcg_gen_concat_tl_i64 tcg_gen_concat_i32_i64
 #define tcg_gen_extr_tl_i64 tcg_gen_extr_i32_i64
 #define tcg_gen_andc_tl tcg_gen_andc_i32
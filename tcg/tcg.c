@@ -273,6 +273,8 @@ static const TCGHelperInfo all_helpers[] = {
     { tcg_helper_rem_i32, "rem_i32" },
     { tcg_helper_divu_i32, "divu_i32" },
     { tcg_helper_remu_i32, "remu_i32" },
+    { tcg_helper_clz_i32, "clz_i32" },
+    { tcg_helper_ctz_i32, "ctz_i32" },
 
     { tcg_helper_shl_i64, "shl_i64" },
     { tcg_helper_shr_i64, "shr_i64" },
@@ -283,6 +285,8 @@ static const TCGHelperInfo all_helpers[] = {
     { tcg_helper_remu_i64, "remu_i64" },
     { tcg_helper_mulsh_i64, "mulsh_i64" },
     { tcg_helper_muluh_i64, "muluh_i64" },
+    { tcg_helper_clz_i64, "clz_i64" },
+    { tcg_helper_ctz_i64, "ctz_i64" },
 };
 
 void tcg_context_init(TCGContext *s)
@@ -2632,6 +2636,12 @@ void tcg_dump_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "deleted ops/TB      %0.2f\n",
                 s->tb_count ? 
                 (double)s->del_op_count / s->tb_count : 0);
+    cpu_fprintf(f, "deleted env st/TB   %0.2f\n",
+                s->tb_count ?
+                (double)s->del_st_count / s->tb_count : 0);
+    cpu_fprintf(f, "deleted env ld/TB   %0.2f\n",
+                s->tb_count ?
+                (double)s->del_ld_count / s->tb_count : 0);
     cpu_fprintf(f, "avg temps/TB        %0.2f max=%d\n",
                 s->tb_count ? 
                 (double)s->temp_count / s->tb_count : 0,
@@ -79,6 +79,8 @@ typedef uint64_t TCGRegSet;
 #define TCG_TARGET_HAS_bswap16_i64      0
 #define TCG_TARGET_HAS_bswap32_i64      0
 #define TCG_TARGET_HAS_bswap64_i64      0
+#define TCG_TARGET_HAS_clz_i64          0
+#define TCG_TARGET_HAS_ctz_i64          0
 #define TCG_TARGET_HAS_neg_i64          0
 #define TCG_TARGET_HAS_not_i64          0
 #define TCG_TARGET_HAS_andc_i64         0
@@ -493,6 +495,8 @@ struct TCGContext {
     int64_t temp_count;
     int temp_count_max;
     int64_t del_op_count;
+    int64_t del_st_count; /* CPU state stores removed by the optimizer */
+    int64_t del_ld_count; /* CPU state loads removed by the optimizer */
     int64_t code_in_len;
     int64_t code_out_len;
     int64_t interm_time;
@@ -520,6 +524,9 @@ struct TCGContext {
     /* Code generation */
     int code_gen_max_blocks;
     uint8_t *code_gen_prologue;
+    /* Where goto_ptr jumps to return to cpu_exec() with a 0 result, as
+       with exit_tb(0).  */
+    uint8_t *code_gen_epilogue;
     uint8_t *code_gen_buffer;
     size_t code_gen_buffer_size;
     /* threshold to flush the translated code buffer */
@@ -193,6 +193,16 @@ typedef struct {
     char             name[3][16];
 } AOperatorRec, *AOperator;
 
+/* an inbound SMS, as the "+CMT" unsolicited result to send */
+typedef struct ASmsLineRec {
+    struct ASmsLineRec*  next;
+    char                 text[1];
+} ASmsLineRec, *ASmsLine;
+
+/* how long to wait for the guest to acknowledge an inbound SMS with
+ * +CNMA before sending the next one anyway, in milliseconds */
+#define  SMS_ACK_TIMEOUT  1000
+
 typedef struct AVoiceCallRec {
     ACallRec    call;
     SysTimer    timer;
@@ -273,6 +283,13 @@ typedef struct AModemRec_
 
     SmsReceiver         sms_receiver;
 
+    /* inbound SMS, sent one at a time as the guest acknowledges them */
+    ASmsLine            sms_first;
+    ASmsLine*           sms_plast;
+    int                 sms_count;
+    int                 sms_waiting_ack;
+    SysTimer            sms_timer;
+
     int                 out_size;
     char                out_buff[1024];
 
@@ -314,31 +331,102 @@ amodem_unsol( AModem  modem, const char* format, ... )
     }
 }
 
-void
-amodem_receive_sms( AModem  modem, SmsPDU  sms )
+static void  amodem_send_next_sms( AModem  modem );  /* forward */
+
+/* called when the guest acknowledged the last SMS, or took too long to */
+static void
+amodem_sms_timer_cb( void*  opaque )
+{
+    AModem  modem = opaque;
+
+    if (modem->sms_waiting_ack)
+        D( "no acknowledgement for inbound SMS, sending the next one\n" );
+    modem->sms_waiting_ack = 0;
+    amodem_send_next_sms( modem );
+}
+
+/* send the oldest queued SMS, unless the guest hasn't acknowledged the
+ * previous one yet: the RIL only handles one new message at a time */
+static void
+amodem_send_next_sms( AModem  modem )
+{
+    ASmsLine  line = modem->sms_first;
+
+    if (modem->sms_waiting_ack || line == NULL)
+        return;
+
+    modem->sms_first = line->next;
+    if (modem->sms_first == NULL)
+        modem->sms_plast = &modem->sms_first;
+    modem->sms_count--;
+
+    R( "SMS>> %s\n", line->text );
+    modem->sms_waiting_ack = 1;
+    if (modem->sms_timer == NULL)
+        modem->sms_timer = sys_timer_create();
+    sys_timer_set( modem->sms_timer, sys_time_ms() + SMS_ACK_TIMEOUT,
+                   amodem_sms_timer_cb, modem );
+
+    modem->unsol_func( modem->unsol_opaque, line->text );
+    free( line );
+}
+
+/* encode |sms| and add it to the queue of inbound messages */
+static void
+amodem_queue_sms( AModem  modem, SmsPDU  sms )
 {
 #define  SMS_UNSOL_HEADER  "+CMT: 0\r\n"
 
-    if (modem->unsol_func) {
-        int    len, max;
-        char*  p;
+    int       len = smspdu_to_hex( sms, NULL, 0 );
+    ASmsLine  line;
+    char*     p;
 
-        strcpy( modem->out_buff, SMS_UNSOL_HEADER );
-        p   = modem->out_buff + (sizeof(SMS_UNSOL_HEADER)-1);
-        max = sizeof(modem->out_buff) - 3 - (sizeof(SMS_UNSOL_HEADER)-1);
-        len = smspdu_to_hex( sms, p, max );
-        if (len > max) /* too long */
-            return;
-        p[len]   = '\r';
-        p[len+1] = '\n';
-        p[len+2] = 0;
+    line = malloc( sizeof(*line) + (sizeof(SMS_UNSOL_HEADER)-1) + len + 2 );
+    if (line == NULL)
+        return;
 
-        R( "SMS>> %s\n", p );
+    memcpy( line->text, SMS_UNSOL_HEADER, sizeof(SMS_UNSOL_HEADER)-1 );
+    p = line->text + (sizeof(SMS_UNSOL_HEADER)-1);
+    smspdu_to_hex( sms, p, len );
+    p[len]   = '\r';
+    p[len+1] = '\n';
+    p[len+2] = 0;
 
-        modem->unsol_func( modem->unsol_opaque, modem->out_buff );
+    if (modem->sms_plast == NULL)
+        modem->sms_plast = &modem->sms_first;
+    line->next        = NULL;
+    *modem->sms_plast = line;
+    modem->sms_plast  = &line->next;
+    modem->sms_count++;
+}
+
+void
+amodem_receive_sms( AModem  modem, SmsPDU  sms )
+{
+    if (modem->unsol_func) {
+        amodem_queue_sms( modem, sms );
+        amodem_send_next_sms( modem );
+    }
+}
+
+void
+amodem_receive_sms_list( AModem  modem, SmsPDU*  pdus )
+{
+    if (modem->unsol_func) {
+        int  nn;
+
+        for (nn = 0; pdus[nn] != NULL; nn++)
+            amodem_queue_sms( modem, pdus[nn] );
+        amodem_send_next_sms( modem );
     }
 }
 
+int
+amodem_get_pending_sms_count( AModem  modem )
+{
+    return modem->sms_count + modem->sms_waiting_ack;
+}
+
 static const char*
 amodem_printf( AModem  modem, const char*  format, ... )
 {
@@ -1583,6 +1671,18 @@ handleSendSMStoSIM( const char*  cmd, AModem  modem )
     return "ERROR: unimplemented";
 }
 
+static const char*
+handleSMSAcknowledge( const char*  cmd, AModem  modem )
+{
+    /* send the next one once the OK has been sent, not before */
+    if (modem->sms_waiting_ack) {
+        modem->sms_waiting_ack = 0;
+        sys_timer_set( modem->sms_timer, sys_time_ms(),
+                       amodem_sms_timer_cb, modem );
+    }
+    return NULL;
+}
+
 static const char*
 handleSendSMS( const char*  cmd, AModem  modem )
 {
@@ -2426,8 +2526,8 @@ static const struct {
                               be polled through +CLCC instead */
 
     /* see requestSMSAcknowledge() */
-    { "+CNMA=1", NULL, NULL },
-    { "+CNMA=2", NULL, NULL },
+    { "+CNMA=1", NULL, handleSMSAcknowledge },
+    { "+CNMA=2", NULL, handleSMSAcknowledge },
 
     /* see requestSIM_IO() */
     { "!+CRSM=", NULL, handleSIM_IO },
@@ -29,9 +29,17 @@ extern void        amodem_destroy( AModem  modem );
 /* send a command to the modem */
 extern const char*  amodem_send( AModem  modem, const char*  cmd );
 
-/* simulate the receipt on an incoming SMS message */
+/* simulate the receipt on an incoming SMS message. Messages are queued and
+ * sent to the guest one at a time, each after the previous one has been
+ * acknowledged, or after a timeout */
 extern void         amodem_receive_sms( AModem  modem, SmsPDU  pdu );
 
+/* same as amodem_receive_sms() for a NULL-terminated list of PDUs */
+extern void         amodem_receive_sms_list( AModem  modem, SmsPDU*  pdus );
+
+/* return the number of inbound SMS not acknowledged by the guest yet */
+extern int          amodem_get_pending_sms_count( AModem  modem );
+
 /** RADIO STATE
  **/
 typedef enum {
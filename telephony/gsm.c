@@ -190,29 +190,69 @@ gsm_hex_to_bytes0( cbytes_t  hex, int  hexlen, bytes_t  dst )
     }
 }
 
+/* PDUs are converted in bulk when many SMS are injected, so the loops
+ * below use lookup tables rather than the per-character helpers */
+
+/* the value of each hex char, or -1 */
+static const signed char*
+gsm_hex_nibbles( void )
+{
+    static signed char  nibbles[256];
+    static int          init;
+
+    if (!init) {
+        int  nn;
+        for (nn = 0; nn < 256; nn++)
+            nibbles[nn] = (signed char) gsm_hexchar_to_int( (char)nn );
+        init = 1;
+    }
+    return nibbles;
+}
+
+/* the two hex chars of each byte value */
+static const char*
+gsm_hex_pairs( void )
+{
+    static char  pairs[512];
+    static int   init;
+
+    if (!init) {
+        int  nn;
+        for (nn = 0; nn < 256; nn++)
+            gsm_hex_from_byte( pairs + 2*nn, nn );
+        init = 1;
+    }
+    return pairs;
+}
+
 int
 gsm_hex_to_bytes( cbytes_t  hex, int  hexlen, bytes_t  dst )
 {
-    int  nn;
+    const signed char*  nibbles = gsm_hex_nibbles();
+    int                 nn, bad = 0;
 
     if (hexlen & 1)  /* must be even */
         return -1;
 
     for (nn = 0; nn < hexlen/2; nn++ ) {
-        int  c = gsm_hex2_to_byte( (const char*)hex+2*nn );
-        if (c < 0) return -1;
-        dst[nn] = (byte_t) c;
+        int  hi = nibbles[hex[2*nn]];
+        int  lo = nibbles[hex[2*nn+1]];
+
+        /* negative if any of them is invalid, checked once at the end */
+        bad |= hi | lo;
+        dst[nn] = (byte_t)( (hi << 4) | lo );
     }
-    return hexlen/2;
+    return (bad < 0) ? -1 : hexlen/2;
 }
 
 void
 gsm_hex_from_bytes( char*  hex, cbytes_t  src, int  srclen )
 {
-    int  nn;
+    const char*  pairs = gsm_hex_pairs();
+    int          nn;
 
     for (nn = 0; nn < srclen; nn++) {
-        gsm_hex_from_byte( hex + 2*nn, src[nn] );
+        memcpy( hex + 2*nn, pairs + 2*src[nn], 2 );
     }
 }
 
@@ -12,6 +12,10 @@
 #include <gtest/gtest.h>
 #include "telephony/gsm.h"
 
+#include <string.h>
+
+#include <vector>
+
 namespace gsm {
 
 TEST(Gsm, Utf8CheckGsm7) {
@@ -77,4 +81,55 @@ TEST(Gsm, Utf8CheckUcs2) {
     EXPECT_EQ((result - start), 63);
 }
 
+TEST(Gsm, HexFromBytes) {
+    byte_t bytes[256];
+    char hex[512];
+    for (int nn = 0; nn < 256; nn++) {
+        bytes[nn] = (byte_t)nn;
+    }
+    gsm_hex_from_bytes(hex, bytes, 256);
+
+    for (int nn = 0; nn < 256; nn++) {
+        char expected[2];
+        gsm_hex_from_byte(expected, nn);
+        EXPECT_EQ(expected[0], hex[2 * nn]);
+        EXPECT_EQ(expected[1], hex[2 * nn + 1]);
+    }
+}
+
+TEST(Gsm, HexToBytes) {
+    const char hex[] = "00017fFF80aBcD";
+    const byte_t expected[] = { 0x00, 0x01, 0x7f, 0xff, 0x80, 0xab, 0xcd };
+    byte_t bytes[sizeof(expected)];
+
+    EXPECT_EQ((int)sizeof(expected),
+              gsm_hex_to_bytes((cbytes_t)hex, strlen(hex), bytes));
+    EXPECT_EQ(0, memcmp(expected, bytes, sizeof(expected)));
+
+    // Odd lengths and invalid characters, anywhere in the string.
+    EXPECT_EQ(-1, gsm_hex_to_bytes((cbytes_t)hex, 3, bytes));
+    EXPECT_EQ(-1, gsm_hex_to_bytes((cbytes_t)"0g", 2, bytes));
+    EXPECT_EQ(-1, gsm_hex_to_bytes((cbytes_t)"000102 3", 8, bytes));
+    EXPECT_EQ(-1, gsm_hex_to_bytes((cbytes_t)"\xff" "0", 2, bytes));
+}
+
+// Round trips as many bytes as thousands of SMS PDUs, which also gives an
+// idea of the throughput of the bulk conversions.
+TEST(Gsm, HexBulkRoundTrip) {
+    const int kSize = 1024 * 1024;
+    std::vector<byte_t> bytes(kSize);
+    std::vector<char> hex(kSize * 2);
+    std::vector<byte_t> decoded(kSize);
+
+    for (int nn = 0; nn < kSize; nn++) {
+        bytes[nn] = (byte_t)(nn * 7 + (nn >> 8));
+    }
+    for (int pass = 0; pass < 8; pass++) {
+        gsm_hex_from_bytes(&hex[0], &bytes[0], kSize);
+        ASSERT_EQ(kSize, gsm_hex_to_bytes((cbytes_t)&hex[0], kSize * 2,
+                                          &decoded[0]));
+    }
+    EXPECT_TRUE(bytes == decoded);
+}
+
 }  // namespace gsm
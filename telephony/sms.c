@@ -1368,14 +1368,11 @@ int
 smspdu_to_hex( SmsPDU  pdu, char*  hex, int  hexlen )
 {
     int  result = (pdu->end - pdu->base)*2;
-    int  nn;
 
     if (hexlen > result)
         hexlen = result;
 
-    for (nn = 0; nn*2 < hexlen; nn++) {
-        gsm_hex_from_byte( &hex[nn*2], pdu->base[nn] );
-    }
+    gsm_hex_from_bytes( hex, pdu->base, (hexlen + 1)/2 );
     return result;
 }
 
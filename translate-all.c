@@ -40,6 +40,8 @@
 #include "exec/cputlb.h"
 #include "translate-all.h"
 #include "qemu/timer.h"
+#include "exec/code-profile.h"
+#include "android/utils/trace.h"
 
 //#define DEBUG_TB_INVALIDATE
 //#define DEBUG_FLUSH
@@ -629,6 +631,48 @@ static inline void code_gen_alloc(size_t tb_size)
             CODE_GEN_AVG_BLOCK_SIZE;
     tcg_ctx.tb_ctx.tbs =
             g_malloc(tcg_ctx.code_gen_max_blocks * sizeof(TranslationBlock));
+
+    tcg_ctx.tb_ctx.tb_phys_hash_size = CODE_GEN_PHYS_HASH_SIZE;
+    tcg_ctx.tb_ctx.tb_phys_hash_max_size = CODE_GEN_PHYS_HASH_SIZE;
+    while (tcg_ctx.tb_ctx.tb_phys_hash_max_size <
+            (unsigned int)tcg_ctx.code_gen_max_blocks) {
+        tcg_ctx.tb_ctx.tb_phys_hash_max_size <<= 1;
+    }
+    tcg_ctx.tb_ctx.tb_phys_hash =
+            g_malloc0(CODE_GEN_PHYS_HASH_SIZE * sizeof(TranslationBlock *));
+}
+
+/* Split the translation buffer and the tbs[] array into regions. The
+   code of the largest TB must fit after the eviction threshold of each
+   region, so small buffers get fewer regions, down to a single one. */
+static void code_gen_regions_init(void)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    size_t reserve = TCG_MAX_OP_SIZE * OPC_BUF_SIZE;
+    size_t nb_regions;
+    int i;
+
+    nb_regions = tcg_ctx.code_gen_buffer_size / (8 * reserve);
+    if (nb_regions < 1) {
+        nb_regions = 1;
+    }
+    if (nb_regions > CODE_GEN_MAX_REGIONS) {
+        nb_regions = CODE_GEN_MAX_REGIONS;
+    }
+    ctx->nb_regions = nb_regions;
+    ctx->current_region = 0;
+    ctx->region_size = (tcg_ctx.code_gen_buffer_size / nb_regions) &
+            ~(size_t)(CODE_GEN_ALIGN - 1);
+    for (i = 0; i < ctx->nb_regions; i++) {
+        TBRegion *r = &ctx->regions[i];
+
+        r->code_start = tcg_ctx.code_gen_buffer + i * ctx->region_size;
+        r->code_end = r->code_start;
+        r->code_max = r->code_start + ctx->region_size - reserve;
+        r->max_tbs = tcg_ctx.code_gen_max_blocks / ctx->nb_regions;
+        r->first_tb = i * r->max_tbs;
+        r->nb_tbs = 0;
+    }
 }
 
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
@@ -638,6 +682,7 @@ void tcg_exec_init(unsigned long tb_size)
 {
     cpu_gen_init();
     code_gen_alloc(tb_size);
+    code_gen_regions_init();
     tcg_ctx.code_gen_ptr = tcg_ctx.code_gen_buffer;
     page_init();
 #if !defined(CONFIG_USER_ONLY) || !defined(CONFIG_USE_GUEST_BASE)
@@ -652,20 +697,24 @@ bool tcg_enabled(void)
     return tcg_ctx.code_gen_buffer != NULL;
 }
 
-/* Allocate a new translation block. Flush the translation buffer if
-   too many translation blocks or too much generated code. */
+/* Allocate a new translation block in the current region. Return NULL
+   if the region holds too many translation blocks or too much generated
+   code, the next region must then be evicted. */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &ctx->regions[ctx->current_region];
     TranslationBlock *tb;
 
-    if (tcg_ctx.tb_ctx.nb_tbs >= tcg_ctx.code_gen_max_blocks ||
-        (tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer) >=
-         tcg_ctx.code_gen_buffer_max_size) {
+    if (r->nb_tbs >= r->max_tbs || tcg_ctx.code_gen_ptr >= r->code_max) {
         return NULL;
     }
-    tb = &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs++];
+    tb = &ctx->tbs[r->first_tb + r->nb_tbs++];
+    ctx->nb_tbs++;
     tb->pc = pc;
     tb->cflags = 0;
+    tb->exec_count = 0;
+    tb->exec_ticks = 0;
     return tb;
 }
 
@@ -674,10 +723,13 @@ void tb_free(TranslationBlock *tb)
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
        be the last one generated.  */
-    if (tcg_ctx.tb_ctx.nb_tbs > 0 &&
-            tb == &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs - 1]) {
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &ctx->regions[ctx->current_region];
+
+    if (r->nb_tbs > 0 && tb == &ctx->tbs[r->first_tb + r->nb_tbs - 1]) {
         tcg_ctx.code_gen_ptr = tb->tc_ptr;
-        tcg_ctx.tb_ctx.nb_tbs--;
+        r->nb_tbs--;
+        ctx->nb_tbs--;
     }
 }
 
@@ -728,6 +780,7 @@ static void page_flush_tb(void)
 void tb_flush(CPUArchState *env1)
 {
     CPUState *cpu;
+    int i;
 #if defined(DEBUG_FLUSH)
     printf("qemu: flush code_size=%ld nb_tbs=%d avg_tb_size=%ld\n",
            (unsigned long)(tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer),
@@ -739,7 +792,16 @@ void tb_flush(CPUArchState *env1)
         > tcg_ctx.code_gen_buffer_size) {
         cpu_abort(env1, "Internal error: code buffer overflow\n");
     }
+    TRACE_INSTANT(TRACE_CATEGORY_TCG, "tb flush");
+    tb_profile_save_tbs();
     tcg_ctx.tb_ctx.nb_tbs = 0;
+    for (i = 0; i < tcg_ctx.tb_ctx.nb_regions; i++) {
+        TBRegion *r = &tcg_ctx.tb_ctx.regions[i];
+
+        r->nb_tbs = 0;
+        r->code_end = r->code_start;
+    }
+    tcg_ctx.tb_ctx.current_region = 0;
 
     CPU_FOREACH(cpu) {
         CPUArchState *env = cpu->env_ptr;
@@ -747,7 +809,7 @@ void tb_flush(CPUArchState *env1)
     }
 
     memset(tcg_ctx.tb_ctx.tb_phys_hash, 0,
-            CODE_GEN_PHYS_HASH_SIZE * sizeof(void *));
+            tcg_ctx.tb_ctx.tb_phys_hash_size * sizeof(void *));
     page_flush_tb();
 
     tcg_ctx.code_gen_ptr = tcg_ctx.code_gen_buffer;
@@ -764,8 +826,9 @@ static void tb_invalidate_check(target_ulong address)
     int i;
 
     address &= TARGET_PAGE_MASK;
-    for (i = 0; i < CODE_GEN_PHYS_HASH_SIZE; i++) {
-        for (tb = tb_ctx.tb_phys_hash[i]; tb != NULL; tb = tb->phys_hash_next) {
+    for (i = 0; i < tcg_ctx.tb_ctx.tb_phys_hash_size; i++) {
+        for (tb = tcg_ctx.tb_ctx.tb_phys_hash[i]; tb != NULL;
+                tb = tb->phys_hash_next) {
             if (!(address + TARGET_PAGE_SIZE <= tb->pc ||
                   address >= tb->pc + tb->size)) {
                 printf("ERROR invalidate: address=" TARGET_FMT_lx
@@ -782,7 +845,7 @@ static void tb_page_check(void)
     TranslationBlock *tb;
     int i, flags1, flags2;
 
-    for (i = 0; i < CODE_GEN_PHYS_HASH_SIZE; i++) {
+    for (i = 0; i < tcg_ctx.tb_ctx.tb_phys_hash_size; i++) {
         for (tb = tcg_ctx.tb_ctx.tb_phys_hash[i]; tb != NULL;
                 tb = tb->phys_hash_next) {
             flags1 = page_get_flags(tb->pc);
@@ -875,19 +938,19 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 
     /* remove the TB from the hash list */
     phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
-    h = tb_phys_hash_func(phys_pc);
+    h = tb_phys_hash_func(&tcg_ctx.tb_ctx, phys_pc);
     tb_hash_remove(&tcg_ctx.tb_ctx.tb_phys_hash[h], tb);
 
-    /* remove the TB from the page list */
+    /* remove the TB from the page list.  The code bitmaps are left as
+       they are: a stale bit only sends a write to the slow path, and
+       tb_invalidate_phys_page_range() rebuilds them.  */
     if (tb->page_addr[0] != page_addr) {
         p = page_find(tb->page_addr[0] >> TARGET_PAGE_BITS);
         tb_page_remove(&p->first_tb, tb);
-        invalidate_page_bitmap(p);
     }
     if (tb->page_addr[1] != -1 && tb->page_addr[1] != page_addr) {
         p = page_find(tb->page_addr[1] >> TARGET_PAGE_BITS);
         tb_page_remove(&p->first_tb, tb);
-        invalidate_page_bitmap(p);
     }
 
     tcg_ctx.tb_ctx.tb_invalidated_flag = 1;
@@ -920,9 +983,45 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     }
     tb->jmp_first = (TranslationBlock *)((uintptr_t)tb | 2); /* fail safe */
 
+    /* mark the TB as invalid, so that it's skipped by tb_evict_region() */
+    tb->page_addr[0] = -1;
+
     tcg_ctx.tb_ctx.tb_phys_invalidate_count++;
 }
 
+/* Make room in the translation buffer by evicting the region that
+   follows the current one, which holds the oldest TBs. Only these TBs
+   are invalidated, the others stay valid and chained. */
+static void tb_evict_region(CPUArchState *env)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r;
+    int i;
+
+    if (ctx->nb_regions == 1) {
+        tb_flush(env);
+        return;
+    }
+    ctx->regions[ctx->current_region].code_end = tcg_ctx.code_gen_ptr;
+    ctx->current_region = (ctx->current_region + 1) % ctx->nb_regions;
+    r = &ctx->regions[ctx->current_region];
+
+    tb_profile_save_region(&ctx->tbs[r->first_tb], r->nb_tbs);
+    for (i = 0; i < r->nb_tbs; i++) {
+        TranslationBlock *tb = &ctx->tbs[r->first_tb + i];
+
+        /* skip the TBs already invalidated by code modifications */
+        if (tb->page_addr[0] != -1) {
+            tb_phys_invalidate(tb, -1);
+        }
+    }
+    ctx->nb_tbs -= r->nb_tbs;
+    r->nb_tbs = 0;
+    r->code_end = r->code_start;
+    tcg_ctx.code_gen_ptr = r->code_start;
+    ctx->tb_region_evict_count++;
+}
+
 static inline void set_bits(uint8_t *tab, int start, int len)
 {
     int end, mask, end1;
@@ -950,9 +1049,30 @@ static inline void set_bits(uint8_t *tab, int start, int len)
     }
 }
 
+/* Mark the bytes of page 'n' of 'tb' in the code bitmap of 'p'.  */
+static void page_bitmap_add_tb(PageDesc *p, TranslationBlock *tb, int n)
+{
+    int tb_start, tb_end;
+
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    if (n == 0) {
+        /* NOTE: tb_end may be after the end of the page, but
+           it is not a problem */
+        tb_start = tb->pc & ~TARGET_PAGE_MASK;
+        tb_end = tb_start + tb->size;
+        if (tb_end > TARGET_PAGE_SIZE) {
+            tb_end = TARGET_PAGE_SIZE;
+        }
+    } else {
+        tb_start = 0;
+        tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+    }
+    set_bits(p->code_bitmap, tb_start, tb_end - tb_start);
+}
+
 static void build_page_bitmap(PageDesc *p)
 {
-    int n, tb_start, tb_end;
+    int n;
     TranslationBlock *tb;
 
     p->code_bitmap = g_malloc0(TARGET_PAGE_SIZE / 8);
@@ -961,20 +1081,7 @@ static void build_page_bitmap(PageDesc *p)
     while (tb != NULL) {
         n = (uintptr_t)tb & 3;
         tb = (TranslationBlock *)((uintptr_t)tb & ~3);
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE) {
-                tb_end = TARGET_PAGE_SIZE;
-            }
-        } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
-        }
-        set_bits(p->code_bitmap, tb_start, tb_end - tb_start);
+        page_bitmap_add_tb(p, tb, n);
         tb = tb->page_next[n];
     }
 }
@@ -988,12 +1095,13 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     tb_page_addr_t phys_pc, phys_page2;
     target_ulong virt_page2;
     int code_gen_size;
+    int64_t ti;
 
     phys_pc = get_page_addr_code(env, pc);
     tb = tb_alloc(pc);
     if (!tb) {
-        /* flush must be done */
-        tb_flush(env);
+        /* the current region is full, start filling the next one */
+        tb_evict_region(env);
         /* cannot fail at this point */
         tb = tb_alloc(pc);
         /* Don't forget to invalidate previous TB info.  */
@@ -1004,7 +1112,18 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
-    cpu_gen_code(env, tb, &code_gen_size);
+    TRACE_BEGIN(TRACE_CATEGORY_TCG, "tb translate");
+    ti = get_clock();
+    if (unlikely(tb_profile_enabled)) {
+        int64_t ticks = cpu_get_real_ticks();
+        cpu_gen_code(env, tb, &code_gen_size);
+        tb_profile_record_translation(cpu_get_real_ticks() - ticks);
+    } else {
+        cpu_gen_code(env, tb, &code_gen_size);
+    }
+    tcg_ctx.tb_ctx.tb_gen_count++;
+    tcg_ctx.tb_ctx.tb_gen_time_ns += get_clock() - ti;
+    TRACE_END(TRACE_CATEGORY_TCG, "tb translate");
     tcg_ctx.code_gen_ptr = (void *)(((uintptr_t)tcg_ctx.code_gen_ptr +
             code_gen_size + CODE_GEN_ALIGN - 1) & ~(CODE_GEN_ALIGN - 1));
 
@@ -1050,7 +1169,7 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
     CPUArchState *env = cpu ? cpu->env_ptr : NULL;
     tb_page_addr_t tb_start, tb_end;
     PageDesc *p;
-    int n;
+    int n, invalidated = 0;
 #ifdef TARGET_HAS_PRECISE_SMC
     int current_tb_not_found = is_cpu_write_access;
     TranslationBlock *current_tb = NULL;
@@ -1121,6 +1240,7 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
                 env->current_tb = NULL;
             }
             tb_phys_invalidate(tb, -1);
+            invalidated = 1;
             if (env) {
                 env->current_tb = saved_tb;
                 if (cpu->interrupt_request && env->current_tb) {
@@ -1137,6 +1257,11 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
         if (is_cpu_write_access) {
             tlb_unprotect_code_phys(env, start, env->mem_io_vaddr);
         }
+    } else if (invalidated && p->code_bitmap) {
+        /* drop the bits of the TBs we just removed, so that writes to
+           the data around the remaining code stay on the fast test */
+        g_free(p->code_bitmap);
+        build_page_bitmap(p);
     }
 #endif
 #ifdef TARGET_HAS_PRECISE_SMC
@@ -1268,7 +1393,12 @@ static inline void tb_alloc_page(TranslationBlock *tb,
     page_already_protected = p->first_tb != NULL;
 #endif
     p->first_tb = (TranslationBlock *)((uintptr_t)tb | n);
-    invalidate_page_bitmap(p);
+    /* keep the code bitmap, if any, up to date instead of dropping it:
+       otherwise every new TB on a page mixing code and data would send
+       the next SMC_BITMAP_USE_THRESHOLD writes to the slow path again */
+    if (p->code_bitmap) {
+        page_bitmap_add_tb(p, tb, n);
+    }
 
 #if defined(TARGET_HAS_SMC) || 1
 
@@ -1311,6 +1441,32 @@ static inline void tb_alloc_page(TranslationBlock *tb,
 #endif /* TARGET_HAS_SMC */
 }
 
+/* Double the size of the physical PC hash table, to keep its chains short
+   while the number of TBs grows. */
+static void tb_phys_hash_grow(void)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TranslationBlock **old_hash = ctx->tb_phys_hash;
+    unsigned int old_size = ctx->tb_phys_hash_size;
+    TranslationBlock *tb, *next;
+    unsigned int i, h;
+
+    ctx->tb_phys_hash_size = old_size * 2;
+    ctx->tb_phys_hash =
+            g_malloc0(ctx->tb_phys_hash_size * sizeof(TranslationBlock *));
+    for (i = 0; i < old_size; i++) {
+        for (tb = old_hash[i]; tb != NULL; tb = next) {
+            next = tb->phys_hash_next;
+            h = tb_phys_hash_func(ctx, tb->page_addr[0] +
+                                       (tb->pc & ~TARGET_PAGE_MASK));
+            tb->phys_hash_next = ctx->tb_phys_hash[h];
+            ctx->tb_phys_hash[h] = tb;
+        }
+    }
+    g_free(old_hash);
+    ctx->tb_phys_hash_resize_count++;
+}
+
 /* add a new TB and link it to the physical page tables. phys_page2 is
    (-1) to indicate that only one page contains the TB. */
 static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
@@ -1323,7 +1479,12 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
        before we are done.  */
     mmap_lock();
     /* add in the physical hash table */
-    h = tb_phys_hash_func(phys_pc);
+    if ((unsigned int)tcg_ctx.tb_ctx.nb_tbs > tcg_ctx.tb_ctx.tb_phys_hash_size &&
+        tcg_ctx.tb_ctx.tb_phys_hash_size <
+            tcg_ctx.tb_ctx.tb_phys_hash_max_size) {
+        tb_phys_hash_grow();
+    }
+    h = tb_phys_hash_func(&tcg_ctx.tb_ctx, phys_pc);
     ptb = &tcg_ctx.tb_ctx.tb_phys_hash[h];
     tb->phys_hash_next = *ptb;
     *ptb = tb;
@@ -1358,23 +1519,30 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
    tb[1].tc_ptr. Return NULL if not found */
 TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
 {
-    int m_min, m_max, m;
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r;
+    uint8_t *code_end;
+    int m_min, m_max, m, i;
     uintptr_t v;
     TranslationBlock *tb;
 
-    if (tcg_ctx.tb_ctx.nb_tbs <= 0) {
+    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer ||
+        tc_ptr >= (uintptr_t)tcg_ctx.code_gen_buffer +
+                  ctx->nb_regions * ctx->region_size) {
         return NULL;
     }
-    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer ||
-        tc_ptr >= (uintptr_t)tcg_ctx.code_gen_ptr) {
+    i = (tc_ptr - (uintptr_t)tcg_ctx.code_gen_buffer) / ctx->region_size;
+    r = &ctx->regions[i];
+    code_end = i == ctx->current_region ? tcg_ctx.code_gen_ptr : r->code_end;
+    if (r->nb_tbs <= 0 || tc_ptr >= (uintptr_t)code_end) {
         return NULL;
     }
     /* binary search (cf Knuth) */
-    m_min = 0;
-    m_max = tcg_ctx.tb_ctx.nb_tbs - 1;
+    m_min = r->first_tb;
+    m_max = r->first_tb + r->nb_tbs - 1;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
-        tb = &tcg_ctx.tb_ctx.tbs[m];
+        tb = &ctx->tbs[m];
         v = (uintptr_t)tb->tc_ptr;
         if (v == tc_ptr) {
             return tb;
@@ -1384,7 +1552,7 @@ TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
             m_min = m + 1;
         }
     }
-    return &tcg_ctx.tb_ctx.tbs[m_max];
+    return &ctx->tbs[m_max];
 }
 
 #ifndef CONFIG_ANDROID
@@ -1527,8 +1695,10 @@ void tb_flush_jmp_cache(CPUArchState *env, target_ulong addr)
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
-    int i, target_code_size, max_target_code_size;
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    int i, n, target_code_size, max_target_code_size;
     int direct_jmp_count, direct_jmp2_count, cross_page;
+    size_t code_size;
     TranslationBlock *tb;
 
     target_code_size = 0;
@@ -1536,55 +1706,64 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
-    for (i = 0; i < tcg_ctx.tb_ctx.nb_tbs; i++) {
-        tb = &tcg_ctx.tb_ctx.tbs[i];
-        target_code_size += tb->size;
-        if (tb->size > max_target_code_size) {
-            max_target_code_size = tb->size;
-        }
-        if (tb->page_addr[1] != -1) {
-            cross_page++;
-        }
-        if (tb->tb_next_offset[0] != 0xffff) {
-            direct_jmp_count++;
-            if (tb->tb_next_offset[1] != 0xffff) {
-                direct_jmp2_count++;
+    code_size = 0;
+    for (i = 0; i < ctx->nb_regions; i++) {
+        TBRegion *r = &ctx->regions[i];
+
+        code_size += (i == ctx->current_region ? tcg_ctx.code_gen_ptr :
+                      r->code_end) - r->code_start;
+        for (n = 0; n < r->nb_tbs; n++) {
+            tb = &ctx->tbs[r->first_tb + n];
+            target_code_size += tb->size;
+            if (tb->size > max_target_code_size) {
+                max_target_code_size = tb->size;
+            }
+            if (tb->page_addr[1] != -1) {
+                cross_page++;
+            }
+            if (tb->tb_next_offset[0] != 0xffff) {
+                direct_jmp_count++;
+                if (tb->tb_next_offset[1] != 0xffff) {
+                    direct_jmp2_count++;
+                }
             }
         }
     }
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
-    cpu_fprintf(f, "gen code size       %td/%zd\n",
-                tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer,
-                tcg_ctx.code_gen_buffer_max_size);
+    cpu_fprintf(f, "gen code size       %zd/%zd\n",
+                code_size, tcg_ctx.code_gen_buffer_max_size);
+    cpu_fprintf(f, "regions             %d of %zd bytes (current=%d)\n",
+                ctx->nb_regions, ctx->region_size, ctx->current_region);
     cpu_fprintf(f, "TB count            %d/%d\n",
-            tcg_ctx.tb_ctx.nb_tbs, tcg_ctx.code_gen_max_blocks);
+            ctx->nb_tbs, tcg_ctx.code_gen_max_blocks);
+    cpu_fprintf(f, "TB hash size        %u/%u (%d resizes)\n",
+            ctx->tb_phys_hash_size, ctx->tb_phys_hash_max_size,
+            ctx->tb_phys_hash_resize_count);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
-            tcg_ctx.tb_ctx.nb_tbs ? target_code_size /
-                    tcg_ctx.tb_ctx.nb_tbs : 0,
+            ctx->nb_tbs ? target_code_size / ctx->nb_tbs : 0,
             max_target_code_size);
-    cpu_fprintf(f, "TB avg host size    %td bytes (expansion ratio: %0.1f)\n",
-            tcg_ctx.tb_ctx.nb_tbs ? (tcg_ctx.code_gen_ptr -
-                                     tcg_ctx.code_gen_buffer) /
-                                     tcg_ctx.tb_ctx.nb_tbs : 0,
-                target_code_size ? (double) (tcg_ctx.code_gen_ptr -
-                                             tcg_ctx.code_gen_buffer) /
-                                             target_code_size : 0);
+    cpu_fprintf(f, "TB avg host size    %zd bytes (expansion ratio: %0.1f)\n",
+            ctx->nb_tbs ? code_size / ctx->nb_tbs : 0,
+            target_code_size ? (double) code_size / target_code_size : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n", cross_page,
-            tcg_ctx.tb_ctx.nb_tbs ? (cross_page * 100) /
-                                    tcg_ctx.tb_ctx.nb_tbs : 0);
+            ctx->nb_tbs ? (cross_page * 100) / ctx->nb_tbs : 0);
     cpu_fprintf(f, "direct jump count   %d (%d%%) (2 jumps=%d %d%%)\n",
                 direct_jmp_count,
-                tcg_ctx.tb_ctx.nb_tbs ? (direct_jmp_count * 100) /
-                        tcg_ctx.tb_ctx.nb_tbs : 0,
+                ctx->nb_tbs ? (direct_jmp_count * 100) / ctx->nb_tbs : 0,
                 direct_jmp2_count,
-                tcg_ctx.tb_ctx.nb_tbs ? (direct_jmp2_count * 100) /
-                        tcg_ctx.tb_ctx.nb_tbs : 0);
+                ctx->nb_tbs ? (direct_jmp2_count * 100) / ctx->nb_tbs : 0);
     cpu_fprintf(f, "\nStatistics:\n");
-    cpu_fprintf(f, "TB flush count      %d\n", tcg_ctx.tb_ctx.tb_flush_count);
+    cpu_fprintf(f, "TB translations     %" PRIu64 " in %" PRId64 " ms\n",
+            ctx->tb_gen_count, ctx->tb_gen_time_ns / 1000000);
+    cpu_fprintf(f, "TB flush count      %d\n", ctx->tb_flush_count);
+    cpu_fprintf(f, "TB region evictions %d\n", ctx->tb_region_evict_count);
     cpu_fprintf(f, "TB invalidate count %d\n",
-            tcg_ctx.tb_ctx.tb_phys_invalidate_count);
+            ctx->tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
+    cpu_fprintf(f, "victim TLB hits     %" PRIu64 "/%" PRIu64 "\n",
+            tlb_victim_hit_count,
+            tlb_victim_hit_count + tlb_victim_miss_count);
     tcg_dump_info(f, cpu_fprintf);
 }
 
@@ -11,6 +11,7 @@
 
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
+#include "qemu/atomic.h"
 
 /*
  * bitmaps provide an array of bits, implemented using an an
@@ -197,6 +198,125 @@ void bitmap_clear(unsigned long *map, long start, long nr)
     }
 }
 
+/*
+ * The following functions process a word of the bitmap at a time, so
+ * that their cost depends on the size of the area rather than on its
+ * number of bits.
+ */
+
+/* Return the number of set bits among the @nr ones starting at @start. */
+long bitmap_count_one_range(const unsigned long *map, long start, long nr)
+{
+    const unsigned long *p = map + BIT_WORD(start);
+    const long size = start + nr;
+    int bits_to_count = BITS_PER_LONG - (start % BITS_PER_LONG);
+    unsigned long mask_to_count = BITMAP_FIRST_WORD_MASK(start);
+    long count = 0;
+
+    if (nr <= 0) {
+        return 0;
+    }
+    while (nr - bits_to_count >= 0) {
+        count += ctpopl(*p & mask_to_count);
+        nr -= bits_to_count;
+        bits_to_count = BITS_PER_LONG;
+        mask_to_count = ~0UL;
+        p++;
+    }
+    if (nr) {
+        mask_to_count &= BITMAP_LAST_WORD_MASK(size);
+        count += ctpopl(*p & mask_to_count);
+    }
+    return count;
+}
+
+/* Clear the @nr bits starting at @start, with atomic operations on the
+ * partial words, so that bits set concurrently outside of the area are
+ * preserved. Return true if any of them was set. */
+bool bitmap_test_and_clear_atomic(unsigned long *map, long start, long nr)
+{
+    unsigned long *p = map + BIT_WORD(start);
+    const long size = start + nr;
+    const int bits_to_clear = BITS_PER_LONG - (start % BITS_PER_LONG);
+    unsigned long mask_to_clear = BITMAP_FIRST_WORD_MASK(start);
+    unsigned long dirty = 0;
+
+    if (nr <= 0) {
+        return false;
+    }
+    /* First word, if the area covers its end */
+    if (nr - bits_to_clear >= 0) {
+        dirty |= atomic_fetch_and(p, ~mask_to_clear) & mask_to_clear;
+        nr -= bits_to_clear;
+        mask_to_clear = ~0UL;
+        p++;
+    }
+    /* Full words */
+    while (nr >= BITS_PER_LONG) {
+        if (*p) {
+            dirty |= atomic_xchg(p, 0);
+        }
+        nr -= BITS_PER_LONG;
+        p++;
+    }
+    /* Last word */
+    if (nr) {
+        mask_to_clear &= BITMAP_LAST_WORD_MASK(size);
+        dirty |= atomic_fetch_and(p, ~mask_to_clear) & mask_to_clear;
+    }
+    return dirty != 0;
+}
+
+/* Copy the @nr bits of @map starting at @start to the bits of @dst
+ * starting at 0, and clear them atomically in @map like
+ * bitmap_test_and_clear_atomic(). Return true if any of them was set. */
+bool bitmap_extract_and_clear_atomic(unsigned long *dst, unsigned long *map,
+                                     long start, long nr)
+{
+    const int shift = start % BITS_PER_LONG;
+    const long last_word = BIT_WORD(start + nr - 1);
+    const long dst_words = BITS_TO_LONGS(nr);
+    unsigned long dirty = 0;
+    long word, i;
+
+    if (nr <= 0) {
+        return false;
+    }
+    bitmap_zero(dst, nr);
+    for (word = BIT_WORD(start), i = 0; word <= last_word; word++, i++) {
+        unsigned long mask = ~0UL;
+        unsigned long bits;
+
+        if (word == BIT_WORD(start)) {
+            mask &= BITMAP_FIRST_WORD_MASK(start);
+        }
+        if (word == last_word) {
+            mask &= BITMAP_LAST_WORD_MASK(start + nr);
+        }
+        if (!(map[word] & mask)) {
+            continue;
+        }
+        if (mask == ~0UL) {
+            bits = atomic_xchg(&map[word], 0);
+        } else {
+            bits = atomic_fetch_and(&map[word], ~mask) & mask;
+        }
+        dirty |= bits;
+        /* Bit b of this word is bit (i * BITS_PER_LONG + b - shift) of @dst */
+        if (shift == 0) {
+            dst[i] |= bits;
+            continue;
+        }
+        if (i > 0) {
+            dst[i - 1] |= bits << (BITS_PER_LONG - shift);
+        }
+        if (i < dst_words) {
+            dst[i] |= bits >> shift;
+        }
+    }
+    return dirty != 0;
+}
+
 #define ALIGN_MASK(x,mask)      (((x)+(mask))&~(mask))
 
 /**
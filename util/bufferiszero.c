@@ -0,0 +1,116 @@
+/*
+ * Fast checks for buffers filled with a single byte value.
+ *
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/bufferiszero.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Number of bytes compared by each iteration of the main loop. */
+#define BUFFER_CHUNK_SIZE  64
+
+/* Check a few bytes spread over the buffer before scanning it. Buffers
+ * that aren't uniform, like most guest RAM pages, usually differ at one
+ * of these positions, so they're rejected without reading all of them. */
+static bool buffer_sample_is_filled(const uint8_t *p, size_t len, uint8_t c)
+{
+    return p[0] == c &&
+           p[len / 4] == c &&
+           p[len / 2] == c &&
+           p[len - len / 4 - 1] == c &&
+           p[len - 1] == c;
+}
+
+bool buffer_is_filled(const void *buf, size_t len, uint8_t c)
+{
+    const uint8_t *p = buf;
+
+    if (len == 0) {
+        return true;
+    }
+    if (!buffer_sample_is_filled(p, len, c)) {
+        return false;
+    }
+
+#ifdef __SSE2__
+    for (; len > 0 && ((uintptr_t)p & 15); p++, len--) {
+        if (*p != c) {
+            return false;
+        }
+    }
+    {
+        const __m128i pattern = _mm_set1_epi8((char)c);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i *v = (const __m128i *)p;
+
+        /* XOR with the pattern and OR the results: the chunk is uniform
+         * only if the accumulated value is zero. */
+        for (; len >= BUFFER_CHUNK_SIZE; v += 4, len -= BUFFER_CHUNK_SIZE) {
+            __m128i x0 = _mm_xor_si128(_mm_load_si128(v + 0), pattern);
+            __m128i x1 = _mm_xor_si128(_mm_load_si128(v + 1), pattern);
+            __m128i x2 = _mm_xor_si128(_mm_load_si128(v + 2), pattern);
+            __m128i x3 = _mm_xor_si128(_mm_load_si128(v + 3), pattern);
+            __m128i acc = _mm_or_si128(_mm_or_si128(x0, x1),
+                                       _mm_or_si128(x2, x3));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, zero)) != 0xffff) {
+                return false;
+            }
+        }
+        for (; len >= 16; v++, len -= 16) {
+            __m128i x = _mm_xor_si128(_mm_load_si128(v), pattern);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xffff) {
+                return false;
+            }
+        }
+        p = (const uint8_t *)v;
+    }
+#else
+    for (; len > 0 && ((uintptr_t)p & (sizeof(unsigned long) - 1));
+         p++, len--) {
+        if (*p != c) {
+            return false;
+        }
+    }
+    {
+        const unsigned long pattern = c * (~0UL / 255);
+        const unsigned long *w = (const unsigned long *)p;
+        const size_t n = BUFFER_CHUNK_SIZE / sizeof(unsigned long);
+        size_t i;
+
+        for (; len >= BUFFER_CHUNK_SIZE; w += n, len -= BUFFER_CHUNK_SIZE) {
+            unsigned long acc = 0;
+            for (i = 0; i < n; i++) {
+                acc |= w[i] ^ pattern;
+            }
+            if (acc) {
+                return false;
+            }
+        }
+        for (; len >= sizeof(unsigned long); w++, len -= sizeof(*w)) {
+            if (*w != pattern) {
+                return false;
+            }
+        }
+        p = (const uint8_t *)w;
+    }
+#endif
+
+    for (; len > 0; p++, len--) {
+        if (*p != c) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool buffer_is_zero(const void *buf, size_t len)
+{
+    return buffer_is_filled(buf, len, 0);
+}
@@ -57,6 +57,9 @@ extern int daemon(int, int);
 #include "trace.h"
 #include "qemu/sockets.h"
 #include <sys/mman.h>
+#ifdef __APPLE__
+#include <mach/vm_statistics.h>
+#endif
 
 #ifdef CONFIG_LINUX
 #include <sys/syscall.h>
@@ -138,6 +141,72 @@ void *qemu_anon_ram_alloc(size_t size)
     return ptr;
 }
 
+#if defined(__linux__) && defined(MAP_HUGETLB)
+/* Return the size of the default huge pages of the host, or 0 if unknown. */
+static size_t qemu_host_hugepage_size(void)
+{
+    FILE *f = fopen("/proc/meminfo", "r");
+    char line[128];
+    unsigned long kb = 0;
+
+    if (!f) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return (size_t)kb * 1024;
+}
+#endif
+
+void *qemu_anon_ram_alloc_hugepages(size_t size, size_t *page_size)
+{
+    void *ptr;
+
+    *page_size = 0;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+    {
+        /* This only works if the administrator reserved enough pages in
+         * /proc/sys/vm/nr_hugepages, otherwise mmap() fails immediately. */
+        size_t huge_size = qemu_host_hugepage_size();
+        if (huge_size && (size % huge_size) == 0) {
+            ptr = mmap(0, size, PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+            if (ptr != MAP_FAILED) {
+                *page_size = huge_size;
+                return ptr;
+            }
+        }
+    }
+#elif defined(__APPLE__) && defined(VM_FLAGS_SUPERPAGE_SIZE_2MB)
+    {
+        /* Superpages are wired, so this fails if the host is short of
+         * physical memory. */
+        const size_t huge_size = 2 * 1024 * 1024;
+        if ((size % huge_size) == 0) {
+            ptr = mmap(0, size, PROT_READ | PROT_WRITE,
+                       MAP_ANON | MAP_PRIVATE, VM_FLAGS_SUPERPAGE_SIZE_2MB, 0);
+            if (ptr != MAP_FAILED) {
+                *page_size = huge_size;
+                return ptr;
+            }
+        }
+    }
+#endif
+
+    /* Fall back to transparent huge pages, when supported. The block is
+     * already aligned on their size by qemu_anon_ram_alloc(). */
+    ptr = qemu_anon_ram_alloc(size);
+    if (ptr) {
+        qemu_madvise(ptr, size, QEMU_MADV_HUGEPAGE);
+    }
+    return ptr;
+}
+
 void qemu_vfree(void *ptr)
 {
     //trace_qemu_vfree(ptr);
@@ -85,6 +85,70 @@ void *qemu_anon_ram_alloc(size_t size)
     return ptr;
 }
 
+#ifndef MEM_LARGE_PAGES
+#define MEM_LARGE_PAGES  0x20000000
+#endif
+
+/* Return the size of the large pages of the host, or 0 if they cannot be
+ * used by this process. Allocating them requires the SeLockMemoryPrivilege
+ * privilege, which must be granted to the user, and enabled here. */
+static SIZE_T qemu_host_large_page_size(void)
+{
+    typedef SIZE_T (WINAPI *GetLargePageMinimumFunc)(void);
+    static SIZE_T page_size = (SIZE_T)-1;
+    GetLargePageMinimumFunc get_large_page_minimum;
+    HANDLE token;
+    TOKEN_PRIVILEGES privileges;
+    BOOL ok;
+
+    if (page_size != (SIZE_T)-1) {
+        return page_size;
+    }
+    page_size = 0;
+
+    /* Not available before Windows Vista. */
+    get_large_page_minimum = (GetLargePageMinimumFunc)GetProcAddress(
+            GetModuleHandle("kernel32.dll"), "GetLargePageMinimum");
+    if (!get_large_page_minimum || !get_large_page_minimum()) {
+        return 0;
+    }
+
+    if (!OpenProcessToken(GetCurrentProcess(),
+                          TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return 0;
+    }
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    ok = LookupPrivilegeValue(NULL, "SeLockMemoryPrivilege",
+                              &privileges.Privileges[0].Luid) &&
+         AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+         GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+
+    if (ok) {
+        page_size = get_large_page_minimum();
+    }
+    return page_size;
+}
+
+void *qemu_anon_ram_alloc_hugepages(size_t size, size_t *page_size)
+{
+    SIZE_T large_page_size = qemu_host_large_page_size();
+    void *ptr;
+
+    *page_size = 0;
+    if (large_page_size && (size % large_page_size) == 0) {
+        ptr = VirtualAlloc(NULL, size,
+                           MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                           PAGE_READWRITE);
+        if (ptr) {
+            *page_size = large_page_size;
+            return ptr;
+        }
+    }
+    return qemu_anon_ram_alloc(size);
+}
+
 void qemu_vfree(void *ptr)
 {
     //trace_qemu_vfree(ptr);
@@ -0,0 +1,92 @@
+/*
+ * Bandwidth and operation rate limits.
+ *
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/throttle.h"
+
+#include <string.h>
+
+#define NS_PER_SEC  1000000000.0
+
+void throttle_init(ThrottleState *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+void throttle_set_limits(ThrottleState *t, uint64_t bps, uint64_t iops)
+{
+    throttle_init(t);
+    t->bps = bps;
+    t->iops = iops;
+}
+
+static void throttle_drain(ThrottleState *t, int64_t now_ns)
+{
+    double elapsed;
+
+    if (now_ns <= t->last_ns) {
+        return;
+    }
+    elapsed = (now_ns - t->last_ns) / NS_PER_SEC;
+    t->last_ns = now_ns;
+
+    t->bytes_level -= elapsed * t->bps;
+    if (t->bytes_level < 0) {
+        t->bytes_level = 0;
+    }
+    t->ops_level -= elapsed * t->iops;
+    if (t->ops_level < 0) {
+        t->ops_level = 0;
+    }
+}
+
+/* Time for a bucket at |level| drained at |limit| to go below its burst. */
+static int64_t throttle_bucket_delay(double level, uint64_t limit)
+{
+    double burst;
+
+    if (limit == 0) {
+        return 0;
+    }
+    burst = (double)limit / THROTTLE_BURST_DIVISOR;
+    if (burst < 1) {
+        burst = 1;
+    }
+    if (level < burst) {
+        return 0;
+    }
+    /* Round up, so that the level is below the burst when woken up. */
+    return (int64_t)((level - burst) / limit * NS_PER_SEC) + 1;
+}
+
+int64_t throttle_delay(ThrottleState *t, int64_t now_ns)
+{
+    int64_t bytes_delay, ops_delay;
+
+    if (!throttle_enabled(t)) {
+        return 0;
+    }
+    throttle_drain(t, now_ns);
+    bytes_delay = throttle_bucket_delay(t->bytes_level, t->bps);
+    ops_delay = throttle_bucket_delay(t->ops_level, t->iops);
+    return bytes_delay > ops_delay ? bytes_delay : ops_delay;
+}
+
+void throttle_account(ThrottleState *t, uint64_t bytes, int64_t now_ns)
+{
+    if (!throttle_enabled(t)) {
+        return;
+    }
+    throttle_drain(t, now_ns);
+    if (t->bps) {
+        t->bytes_level += bytes;
+    }
+    if (t->iops) {
+        t->ops_level += 1;
+    }
+}
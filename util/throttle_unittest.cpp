@@ -0,0 +1,117 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+extern "C" {
+#include "qemu/throttle.h"
+}
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const int64_t kSecond = 1000000000LL;
+
+// Run as many operations of |bytes| as |t| lets through in |duration| ns,
+// starting at |*now|, and return their count.
+int runFor(ThrottleState* t, uint64_t bytes, int64_t* now, int64_t duration) {
+    int64_t end = *now + duration;
+    int count = 0;
+    while (*now < end) {
+        int64_t delay = throttle_delay(t, *now);
+        if (delay > 0) {
+            *now += delay;
+            continue;
+        }
+        throttle_account(t, bytes, *now);
+        count++;
+    }
+    return count;
+}
+
+}  // namespace
+
+TEST(Throttle, NoLimits) {
+    ThrottleState t;
+    throttle_init(&t);
+    EXPECT_FALSE(throttle_enabled(&t));
+    for (int n = 0; n < 1000; ++n) {
+        throttle_account(&t, 1 << 20, 0);
+        EXPECT_EQ(0, throttle_delay(&t, 0));
+    }
+}
+
+TEST(Throttle, Bandwidth) {
+    ThrottleState t;
+    throttle_init(&t);
+    throttle_set_limits(&t, 1 << 20, 0);
+    EXPECT_TRUE(throttle_enabled(&t));
+
+    int64_t now = kSecond;
+    // 4 KB operations at 1 MB/s: 256 per second, plus the initial burst.
+    int count = runFor(&t, 4096, &now, 10 * kSecond);
+    EXPECT_GE(count, 2560);
+    EXPECT_LE(count, 2560 + 256 / THROTTLE_BURST_DIVISOR + 2);
+}
+
+TEST(Throttle, Iops) {
+    ThrottleState t;
+    throttle_init(&t);
+    throttle_set_limits(&t, 0, 100);
+
+    int64_t now = kSecond;
+    int count = runFor(&t, 1 << 20, &now, 10 * kSecond);
+    EXPECT_GE(count, 1000);
+    EXPECT_LE(count, 1000 + 100 / THROTTLE_BURST_DIVISOR + 2);
+}
+
+TEST(Throttle, WaitsForTheLowestLimit) {
+    ThrottleState t;
+    throttle_init(&t);
+    throttle_set_limits(&t, 1 << 20, 1000);
+
+    int64_t now = kSecond;
+    // 64 KB operations are limited to 16 per second by the bandwidth.
+    int count = runFor(&t, 65536, &now, 10 * kSecond);
+    EXPECT_GE(count, 160);
+    EXPECT_LE(count, 160 + 16 / THROTTLE_BURST_DIVISOR + 2);
+}
+
+TEST(Throttle, IdleTimeDoesNotAccumulate) {
+    ThrottleState t;
+    throttle_init(&t);
+    throttle_set_limits(&t, 0, 10);
+
+    // After a long idle period, only the burst runs without waiting.
+    int64_t now = 100 * kSecond;
+    int count = 0;
+    while (throttle_delay(&t, now) == 0) {
+        throttle_account(&t, 0, now);
+        count++;
+    }
+    EXPECT_EQ(1, count);
+    EXPECT_GT(throttle_delay(&t, now), 0);
+    EXPECT_LE(throttle_delay(&t, now), kSecond / 10 + 1);
+}
+
+TEST(Throttle, SetLimitsResets) {
+    ThrottleState t;
+    throttle_init(&t);
+    throttle_set_limits(&t, 0, 1);
+    throttle_account(&t, 0, kSecond);
+    throttle_account(&t, 0, kSecond);
+    EXPECT_GT(throttle_delay(&t, kSecond), 0);
+
+    throttle_set_limits(&t, 0, 1);
+    EXPECT_EQ(0, throttle_delay(&t, kSecond));
+    throttle_set_limits(&t, 0, 0);
+    EXPECT_FALSE(throttle_enabled(&t));
+    EXPECT_EQ(0, throttle_delay(&t, kSecond));
+}
@@ -34,12 +34,14 @@
 #include "hw/audiodev.h"
 #include "hw/isa/isa.h"
 #include "hw/loader.h"
+#include "hw/android/goldfish/device.h"
 #include "hw/android/goldfish/nand.h"
 #include "net/net.h"
 #include "ui/console.h"
 #include "sysemu/sysemu.h"
 #include "exec/gdbstub.h"
 #include "exec/code-profile.h"
+#include "hw/android/goldfish/profile.h"
 #include "qemu/log.h"
 #include "qemu/timer.h"
 #include "sysemu/char.h"
@@ -65,15 +67,22 @@
 #include "android/multitouch-port.h"
 #include "android/multitouch-screen.h"
 #include "android/opengles.h"
+#include "android/qos.h"
 #include "android/opengl/emugl_config.h"
+#include "android/main-common.h"
 #include "android/skin/charmap.h"
+#include "android/skin/winsys.h"
 #include "android/snapshot.h"
 #include "android/tcpdump.h"
+#include "android/utils/async_log.h"
 #include "android/utils/bufprint.h"
 #include "android/utils/debug.h"
 #include "android/utils/filelock.h"
+#include "android/utils/metrics.h"
 #include "android/utils/path.h"
+#include "android/utils/probe_cache.h"
 #include "android/utils/socket_drainer.h"
+#include "android/utils/startup.h"
 #include "android/utils/stralloc.h"
 #include "android/utils/tempfile.h"
 #include "android/utils/timezone.h"
@@ -262,6 +271,9 @@ const char *mem_path = NULL;
 #ifdef MAP_POPULATE
 int mem_prealloc = 0; /* force preallocation of physical target memory */
 #endif
+int mem_hugepages = 0; /* back guest RAM with huge pages if possible */
+int mem_prefault = 0; /* populate guest RAM in the background at startup */
+int mem_lock = 0; /* lock guest RAM in host memory, implies mem_prefault */
 int nb_nics;
 NICInfo nd_table[MAX_NICS];
 int vm_running;
@@ -357,6 +369,18 @@ char* android_op_audio = NULL;
 /* -cpu-delay option value. */
 char* android_op_cpu_delay = NULL;
 
+/* -timer-slack option value. */
+char* android_op_timer_slack = NULL;
+
+/* -stats-port option value. */
+char* android_op_stats_port = NULL;
+
+/* -qos option value. */
+char* android_op_qos = NULL;
+
+/* -sample-profile option value. */
+char* android_op_sample_profile = NULL;
+
 #ifdef CONFIG_NAND_LIMITS
 /* -nand-limits option value. */
 char* android_op_nand_limits = NULL;
@@ -403,6 +427,10 @@ const char* dns_log_filename = NULL;
 const char* drop_log_filename = NULL;
 
 const char* savevm_on_exit = NULL;
+int fast_exit = 0;
+/* Offset of the guest vsync before the host one, see -vsync-offset */
+static int vsync_offset_us = 0;
+const char* savevm_flat_dir = NULL;
 
 #define TFR(expr) do { if ((expr) != -1) break; } while (errno == EINTR)
 
@@ -1852,6 +1880,130 @@ void android_extractPartitionFormat(const char* fstab,
     free(partFormat);
 }
 
+// Same as android_extractRamdiskFile(), but reuse the result of a previous
+// run, including the absence of the file, as long as the ramdisk image
+// didn't change, which avoids decompressing it at each startup.
+static bool android_extractCachedRamdiskFile(const char* ramdiskPath,
+                                             const char* fileName,
+                                             char** out,
+                                             size_t* outSize)
+{
+    const char* cacheDir = probe_cache_default_dir();
+    char probe[64];
+    snprintf(probe, sizeof(probe), "ramdisk:%s", fileName);
+
+    // Missing files are stored as empty results.
+    if (cacheDir &&
+        probe_cache_find(cacheDir, probe, ramdiskPath, out, outSize)) {
+        if (*outSize > 0) {
+            return true;
+        }
+        free(*out);
+        *out = NULL;
+        return false;
+    }
+
+    bool found = android_extractRamdiskFile(ramdiskPath, fileName,
+                                            out, outSize);
+    if (cacheDir) {
+        probe_cache_store(cacheDir, probe, ramdiskPath,
+                          found ? *out : NULL, found ? *outSize : 0);
+    }
+    return found;
+}
+
+// Called by the NAND device before the first access to the userdata
+// partition, when it is resized in the background.
+static void android_wait_userdata_resize(void)
+{
+    int ret = waitExt4PartitionResize();
+    if (ret != 0) {
+        fprintf(stderr,
+                "WARNING: could not resize userdata partition (%d)\n", ret);
+    }
+}
+
+
+// With -block-device, the ext4 partitions are attached to goldfish_block
+// devices instead of NAND ones. android_nand_add_image() queues them, and
+// android_block_add_images() opens them once they have been set up.
+static int android_block_device = 0;
+
+// Interval of the guest's periodic fstrim, in seconds, set with
+// -fstrim-interval, or 0 to leave it to the guest.
+static int android_fstrim_interval = 0;
+
+typedef struct {
+    char* name;
+    char* file;
+    // Set to open |file| read-only, with the writes in a temporary overlay.
+    int snapshot;
+} AndroidBlockImage;
+
+#define ANDROID_MAX_BLOCK_IMAGES  4
+
+static AndroidBlockImage android_block_images[ANDROID_MAX_BLOCK_IMAGES];
+static int android_block_image_count = 0;
+
+// Queues the ext4 partition |part_name|, whose image is |part_file|, to be
+// initialized from |part_init_file| if not NULL. A |temporary| image is
+// discarded on exit, so the initial image is used directly instead of
+// copying it into |part_file|.
+static void android_block_queue_image(const char* part_name,
+                                      const char* part_file,
+                                      const char* part_init_file,
+                                      bool temporary)
+{
+    AndroidBlockImage* image;
+
+    if (android_block_image_count == ANDROID_MAX_BLOCK_IMAGES) {
+        PANIC("Too many block device partitions");
+    }
+    image = &android_block_images[android_block_image_count++];
+    image->name = ASTRDUP(part_name);
+
+    if (part_init_file && temporary) {
+        image->file = ASTRDUP(part_init_file);
+        image->snapshot = 1;
+    } else {
+        if (part_init_file && path_copy_file(part_file, part_init_file) < 0) {
+            PANIC("Could not copy %s image %s to %s: %s", part_name,
+                  part_init_file, part_file, strerror(errno));
+        }
+        image->file = ASTRDUP(part_file);
+        image->snapshot = 0;
+    }
+    VERBOSE_PRINT(init, "Attaching '%s' partition image %s%s to a block "
+                  "device", part_name, image->file,
+                  image->snapshot ? " (temporary copy-on-write)" : "");
+}
+
+// Opens the images queued by android_block_queue_image(), for the board to
+// create their devices.
+static void android_block_add_images(void)
+{
+    BlockDriver* raw = bdrv_find_format("raw");
+    int n;
+
+    for (n = 0; n < android_block_image_count; n++) {
+        AndroidBlockImage* image = &android_block_images[n];
+        BlockDriverState* bs = bdrv_new(image->name);
+        int flags = BDRV_O_RDWR | BDRV_O_CACHE_WB;
+
+        if (image->snapshot) {
+            flags |= BDRV_O_SNAPSHOT;
+        }
+        if (bdrv_open(bs, image->file, flags, raw) < 0) {
+            PANIC("Could not open %s image: %s", image->name, image->file);
+        }
+        goldfish_block_add(image->name, bs);
+    }
+}
+
+// Set when booting from a snapshot whose manifest matches the current
+// images, see snaphost_load_manifest(). The partition types stored in the
+// manifest are then used without probing the image files.
+static bool android_partition_types_trusted = false;
 
 // List of value describing how to handle partition images in
 // android_nand_add_image() below, when no initial partition image
@@ -1902,7 +2054,9 @@ typedef enum {
 // the content of the main partition image. This is automatically handled
 // by the NAND code though.
 //
-void android_nand_add_image(const char* part_name,
+// Returns the type of the partition, once probed if needed.
+//
+AndroidPartitionType android_nand_add_image(const char* part_name,
                             AndroidPartitionType part_type,
                             AndroidPartitionOpenMode part_mode,
                             uint64_t part_size,
@@ -1952,7 +2106,7 @@ void android_nand_add_image(const char* part_name,
                         part_name, image_file);
 
             part_type = androidPartitionType_probeFile(image_file);
-        } else if (image_file) {
+        } else if (image_file && !android_partition_types_trusted) {
             // Probe the current image file to check that it is of the
             // right partition format.
             AndroidPartitionType image_type =
@@ -2070,6 +2224,12 @@ void android_nand_add_image(const char* part_name,
         }
     }
 
+    if (android_block_device && part_type == ANDROID_PARTITION_TYPE_EXT4) {
+        android_block_queue_image(part_name, part_file, part_init_file,
+                                  need_temp_partition);
+        return part_type;
+    }
+
     if (part_init_file) {
         char *escaped_part_init = path_escape_path(part_init_file);
         if (escaped_part_init) {
@@ -2086,9 +2246,17 @@ void android_nand_add_image(const char* part_name,
     }
 
     nand_add_dev(tmp);
+    return part_type;
 }
 
 
+/* Startup task that loads the OpenGLES emulation libraries in the
+ * background, while the main thread sets up the partitions. */
+static void android_load_opengles_task(void* opaque)
+{
+    *(int*)opaque = android_loadOpenglesEmulation();
+}
+
 int main(int argc, char **argv, char **envp)
 {
     const char *gdbstub_dev = NULL;
@@ -2130,6 +2298,10 @@ int main(int argc, char **argv, char **envp)
     STRALLOC_DEFINE(kernel_params);
     STRALLOC_DEFINE(kernel_config);
     int    dns_count = 0;
+    int    gles_load_status = -1;
+    StartupTask gles_load_task = -1;
+
+    startup_phase_begin("qemu-options");
 
     /* Initialize sockets before anything else, so we can properly report
      * initialization failures back to the UI. */
@@ -2599,6 +2771,9 @@ int main(int argc, char **argv, char **envp)
             case QEMU_OPTION_savevm_on_exit:
                 savevm_on_exit = optarg;
                 break;
+            case QEMU_OPTION_fast_exit:
+                fast_exit = 1;
+                break;
             case QEMU_OPTION_full_screen:
                 full_screen = 1;
                 break;
@@ -2923,6 +3098,43 @@ int main(int argc, char **argv, char **envp)
                 android_op_cpu_delay = (char*)optarg;
                 break;
 
+            case QEMU_OPTION_timer_slack:
+                android_op_timer_slack = (char*)optarg;
+                break;
+
+            case QEMU_OPTION_stats_port:
+                android_op_stats_port = (char*)optarg;
+                break;
+
+            case QEMU_OPTION_qos:
+                android_op_qos = (char*)optarg;
+                break;
+
+            case QEMU_OPTION_startup_profile:
+                startup_profile_set_enabled(true);
+                break;
+
+            case QEMU_OPTION_sample_profile:
+                android_op_sample_profile = (char*)optarg;
+                break;
+
+            case QEMU_OPTION_iothread:
+                use_iothread = 1;
+                break;
+
+            case QEMU_OPTION_mem_hugepages:
+                mem_hugepages = 1;
+                break;
+
+            case QEMU_OPTION_mem_prefault:
+                mem_prefault = 1;
+                break;
+
+            case QEMU_OPTION_mem_lock:
+                mem_prefault = 1;
+                mem_lock = 1;
+                break;
+
             case QEMU_OPTION_show_kernel:
                 android_kmsg_init(ANDROID_KMSG_PRINT_MESSAGES);
                 break;
@@ -2984,6 +3196,57 @@ int main(int argc, char **argv, char **envp)
                 android_snapshot_update_time = 0;
                 break;
 
+            case QEMU_OPTION_snapshot_lazy_ram:
+                ram_lazy_restore = 1;
+                break;
+
+            case QEMU_OPTION_snapshot_shared_ram:
+                ram_shared_restore = 1;
+                break;
+
+            case QEMU_OPTION_snapshot_flat:
+#ifdef _WIN32
+                PANIC("-snapshot-flat is not supported on Windows");
+#else
+                savevm_flat_dir = optarg;
+#endif
+                break;
+
+            case QEMU_OPTION_block_device:
+                android_block_device = 1;
+                break;
+
+            case QEMU_OPTION_fstrim_interval: {
+                char*  end;
+                long   interval = strtol(optarg, &end, 0);
+                if (end == optarg || *end || interval <= 0 ||
+                    interval > INT_MAX) {
+                    PANIC("Invalid fstrim interval '%s'", optarg);
+                }
+                android_fstrim_interval = (int)interval;
+                break;
+            }
+
+            case QEMU_OPTION_qcow2_cache_size: {
+                char*  end;
+                long   size = strtol(optarg, &end, 0);
+                if (end == optarg || *end || size <= 0) {
+                    PANIC("Invalid qcow2 cache size '%s'", optarg);
+                }
+                qcow2_set_cache_size((int64_t)size * 1024 * 1024);
+                break;
+            }
+
+            case QEMU_OPTION_vsync_offset: {
+                char*   end;
+                double  offset = strtod(optarg, &end);
+                if (end == optarg || *end || offset < 0 || offset > 50) {
+                    PANIC("Invalid vsync offset '%s'", optarg);
+                }
+                vsync_offset_us = (int)(offset * 1000);
+                break;
+            }
+
             case QEMU_OPTION_list_webcam:
                 android_list_web_cameras();
                 exit(0);
@@ -3016,6 +3279,8 @@ int main(int argc, char **argv, char **envp)
         data_dir = CONFIG_QEMU_SHAREDIR;
     }
 
+    startup_phase_begin("hw-config");
+
     if (!android_op_hwini) {
         PANIC("Missing -android-hw <file> option!");
     }
@@ -3058,6 +3323,27 @@ int main(int argc, char **argv, char **envp)
         android_display_bpp    = depth;
     }
 
+    /* Initialize audio. */
+    if (android_op_audio) {
+        if ( !audio_check_backend_name( 0, android_op_audio ) ) {
+            PANIC("'%s' is not a valid audio output backend. see -help-audio-out",
+                    android_op_audio);
+        }
+        setenv("QEMU_AUDIO_DRV", android_op_audio, 1);
+    }
+
+    /* Loading the OpenGLES emulation libraries doesn't depend on the steps
+     * below, up to the renderer start. Do it in the background. Anything
+     * that changes the environment must be done before this point, as the
+     * libraries read it while they load. */
+    if (android_hw->hw_gpu_enabled) {
+        gles_load_task = startup_task_start("gles-load",
+                                            android_load_opengles_task,
+                                            &gles_load_status, NULL, 0);
+    }
+
+    startup_phase_begin("partitions");
+
 #ifdef CONFIG_NAND_LIMITS
     /* Init nand stuff. */
     if (android_op_nand_limits) {
@@ -3082,17 +3368,28 @@ int main(int argc, char **argv, char **envp)
     AndroidPartitionType cache_partition_type =
             ANDROID_PARTITION_TYPE_UNKNOWN;
 
-    {
+    // When booting from a snapshot, the guest state was set up for the
+    // partition types resolved when it was saved, as long as the kernel,
+    // ramdisk and system images didn't change since.
+    if (loadvm && *loadvm &&
+        snaphost_load_manifest(loadvm,
+                               &system_partition_type,
+                               &userdata_partition_type,
+                               &cache_partition_type)) {
+        VERBOSE_PRINT(init, "Using partition types of snapshot '%s'",
+                      loadvm);
+        android_partition_types_trusted = true;
+    } else {
         // Starting with Android 4.4.x, the ramdisk.img contains
         // an fstab.goldfish file that lists the format of each partition.
         // If the file exists, parse it to get the appropriate values.
         char* fstab = NULL;
         size_t fstabSize = 0;
 
-        if (android_extractRamdiskFile(android_hw->disk_ramdisk_path,
-                                       "fstab.goldfish",
-                                       &fstab,
-                                       &fstabSize)) {
+        if (android_extractCachedRamdiskFile(android_hw->disk_ramdisk_path,
+                                             "fstab.goldfish",
+                                             &fstab,
+                                             &fstabSize)) {
             VERBOSE_PRINT(init, "Ramdisk image contains fstab.goldfish file");
 
             android_extractPartitionFormat(fstab,
@@ -3120,12 +3417,13 @@ int main(int argc, char **argv, char **envp)
     }
 
     /* Initialize system partition image */
-    android_nand_add_image("system",
-                           system_partition_type,
-                           ANDROID_PARTITION_OPEN_MODE_MUST_EXIST,
-                           android_hw->disk_systemPartition_size,
-                           android_hw->disk_systemPartition_path,
-                           android_hw->disk_systemPartition_initPath);
+    system_partition_type =
+            android_nand_add_image("system",
+                                   system_partition_type,
+                                   ANDROID_PARTITION_OPEN_MODE_MUST_EXIST,
+                                   android_hw->disk_systemPartition_size,
+                                   android_hw->disk_systemPartition_path,
+                                   android_hw->disk_systemPartition_initPath);
 
     /* For ext4, to extend an internal partition to more than the default size
      * you need to initialize userdata-qemu.img to the desired size and restore
@@ -3140,20 +3438,30 @@ int main(int argc, char **argv, char **envp)
     }
 
     /* Initialize data partition image */
-    android_nand_add_image("userdata",
-                           userdata_partition_type,
-                           ANDROID_PARTITION_OPEN_MODE_CREATE_IF_NEEDED,
-                           android_hw->disk_dataPartition_size,
-                           android_hw->disk_dataPartition_path,
-                           android_hw->disk_dataPartition_initPath);
+    userdata_partition_type =
+            android_nand_add_image("userdata",
+                                   userdata_partition_type,
+                                   ANDROID_PARTITION_OPEN_MODE_CREATE_IF_NEEDED,
+                                   android_hw->disk_dataPartition_size,
+                                   android_hw->disk_dataPartition_path,
+                                   android_hw->disk_dataPartition_initPath);
 
     /* Extend the userdata-qemu.img to the desired size - resize2fs can only
-     * extend partitions to fill available space
+     * extend partitions to fill available space. This is done in the
+     * background, the NAND device waits for it before the guest accesses
+     * the partition.
     */
     if(android_op_wipe_data &&
             userdata_partition_type == ANDROID_PARTITION_TYPE_EXT4) {
-        resizeExt4Partition(android_hw->disk_dataPartition_path,
-                            android_hw->disk_dataPartition_size);
+        resizeExt4PartitionAsync(android_hw->disk_dataPartition_path,
+                                 android_hw->disk_dataPartition_size);
+        if (android_block_device) {
+            // The block device reports the size of the image when it is
+            // opened below.
+            android_wait_userdata_resize();
+        } else {
+            nand_dev_set_wait_hook("userdata", android_wait_userdata_resize);
+        }
     }
 
     /* Initialize cache partition image, if any. Its type depends on the
@@ -3181,6 +3489,12 @@ int main(int argc, char **argv, char **envp)
                                NULL);
     }
 
+    snaphost_set_partition_types(system_partition_type,
+                                 userdata_partition_type,
+                                 cache_partition_type);
+
+    android_block_add_images();
+
     /* Init SD-Card stuff. For Android, it is always hda */
     /* If the -hda option was used, ignore the Android-provided one */
     if (hda_opts == NULL) {
@@ -3231,6 +3545,8 @@ int main(int argc, char **argv, char **envp)
         boot_property_add("ro.config.low_ram", "true");
     }
 
+    startup_phase_begin("services");
+
     /* Initialize net speed and delays stuff. */
     if (android_parse_network_speed(android_op_netspeed) < 0 ) {
         PANIC("invalid -netspeed parameter '%s'",
@@ -3261,6 +3577,14 @@ int main(int argc, char **argv, char **envp)
     /* Initialize presence of hardware nav button */
     boot_property_add("qemu.hw.mainkeys", android_hw->hw_mainKeys ? "1" : "0");
 
+    /* Ask the guest to trim its file systems periodically, so that the
+     * space of the deleted files is discarded from the host images. */
+    if (android_fstrim_interval > 0) {
+        char  tmp[32];
+        snprintf(tmp, sizeof(tmp), "%d", android_fstrim_interval);
+        boot_property_add("qemu.fstrim.interval", tmp);
+    }
+
     /* Initialize TCP dump */
     if (android_op_tcpdump) {
         if (qemu_tcpdump_start(android_op_tcpdump) < 0) {
@@ -3298,15 +3622,6 @@ int main(int argc, char **argv, char **envp)
         }
     }
 
-    /* Initialize audio. */
-    if (android_op_audio) {
-        if ( !audio_check_backend_name( 0, android_op_audio ) ) {
-            PANIC("'%s' is not a valid audio output backend. see -help-audio-out",
-                    android_op_audio);
-        }
-        setenv("QEMU_AUDIO_DRV", android_op_audio, 1);
-    }
-
     /* Initialize OpenGLES emulation */
     //android_hw_opengles_init();
 
@@ -3352,6 +3667,24 @@ int main(int argc, char **argv, char **envp)
         qemu_cpu_delay = (int) delay;
     }
 
+    if (android_op_timer_slack) {
+        char*   end;
+        long    slack = strtol(android_op_timer_slack, &end, 0);
+        if (end == NULL || *end || slack < 0 || slack > 100000) {
+            PANIC("option -timer-slack must be an integer between 0 and 100000");
+        }
+        qemu_set_timer_slack_ns((int64_t)slack * 1000);
+    }
+
+    if (android_op_sample_profile) {
+        char*   end;
+        long    hz = strtol(android_op_sample_profile, &end, 0);
+        if (end == NULL || *end || hz < 0 || hz > 10000) {
+            PANIC("option -sample-profile must be an integer between 0 and 10000");
+        }
+        profile_sampling_rate = (int) hz;
+    }
+
     if (android_op_dns_server) {
         char*  x = strchr(android_op_dns_server, ',');
         dns_count = 0;
@@ -3389,6 +3722,8 @@ int main(int argc, char **argv, char **envp)
         stralloc_add_format(kernel_config, " ndns=%d", dns_count);
     }
 
+    startup_phase_begin("gles-start");
+
     /* qemu.gles will be read by the OpenGL ES emulation libraries.
      * If set to 0, the software GL ES renderer will be used as a fallback.
      * If the parameter is undefined, this means the system image runs
@@ -3399,15 +3734,16 @@ int main(int argc, char **argv, char **envp)
      * the emulation engine. */
     int qemu_gles = 0;
     if (android_hw->hw_gpu_enabled) {
-        if (android_initOpenglesEmulation() == 0 &&
-            android_startOpenglesRenderer(android_hw->hw_lcd_width,
-                                          android_hw->hw_lcd_height) == 0)
+        startup_task_wait(gles_load_task);
+        /* The renderer warms up while the VM boots, the first opengles
+         * pipe connection waits for it. */
+        if (gles_load_status == 0 &&
+            android_initOpenglesEmulation() == 0 &&
+            android_startOpenglesRendererAsync(android_hw->hw_lcd_width,
+                                               android_hw->hw_lcd_height) == 0)
         {
-            android_getOpenglesHardwareStrings(
-                    android_gl_vendor, sizeof(android_gl_vendor),
-                    android_gl_renderer, sizeof(android_gl_renderer),
-                    android_gl_version, sizeof(android_gl_version));
             qemu_gles = 1;
+            android_setOpenglesVsyncOffset(vsync_offset_us);
         } else {
             derror("Could not initialize OpenglES emulation, use '-gpu off' to disable it.");
             exit(1);
@@ -3422,6 +3758,8 @@ int main(int argc, char **argv, char **envp)
         stralloc_add_str(kernel_params, " qemu.gles=0");
     }
 
+    startup_phase_begin("qemu-init");
+
     /* We always force qemu=1 when running inside QEMU */
     stralloc_add_str(kernel_params, " qemu=1");
 
@@ -3444,6 +3782,21 @@ int main(int argc, char **argv, char **envp)
         exit(1);
     }
 
+    /* From now on, log messages are written by a background thread. */
+    async_log_start();
+
+    tb_profile_register_metrics();
+    if (android_op_stats_port) {
+        char*   end;
+        long    port = strtol(android_op_stats_port, &end, 0);
+        if (end == NULL || *end || port <= 0 || port > 65535) {
+            PANIC("option -stats-port must be a TCP port number");
+        }
+        if (!metrics_start_server((int)port)) {
+            dwarning("Could not serve metrics on port %ld", port);
+        }
+    }
+
     /* Open the logfile at this point, if necessary. We can't open the logfile
      * when encountering either of the logging options (-d or -D) because the
      * other one may be encountered later on the command line, changing the
@@ -3640,7 +3993,7 @@ int main(int argc, char **argv, char **envp)
     register_savevm_live(NULL,
                          "ram",
                          0,
-                         3,
+                         7,
                          ops,
                          NULL);
 
@@ -3844,6 +4197,8 @@ int main(int argc, char **argv, char **envp)
         kernel_parameters = stralloc_cstr(kernel_params);
         VERBOSE_PRINT(init, "Kernel parameters: %s", kernel_parameters);
 
+        startup_phase_begin("machine");
+
         machine->init(ram_size,
                       boot_devices,
                       kernel_filename,
@@ -3860,6 +4215,13 @@ int main(int argc, char **argv, char **envp)
         stralloc_reset(kernel_config);
     }
 
+    /* The I/O limits apply to the devices created by the machine. */
+    if (android_op_qos && android_qos_parse(android_op_qos) < 0) {
+        PANIC("invalid -qos option, see -help-qos");
+    }
+
+    startup_phase_begin("devices");
+
     CPU_FOREACH(cpu) {
         for (i = 0; i < nb_numa_nodes; i++) {
             if (node_cpumask[i] & (1 << cpu->cpu_index)) {
@@ -4000,13 +4362,25 @@ int main(int argc, char **argv, char **envp)
                 gdbstub_dev);
     }
 
+    /* The GL strings are only needed by android_emulation_setup(). Getting
+     * them as late as possible gives the renderer more time to start, in
+     * case they aren't cached. */
+    if (qemu_gles) {
+        android_getOpenglesHardwareStrings(
+                android_gl_vendor, sizeof(android_gl_vendor),
+                android_gl_renderer, sizeof(android_gl_renderer),
+                android_gl_version, sizeof(android_gl_version));
+    }
+
     /* call android-specific setup function */
     android_emulation_setup();
 
     android_emulator_set_base_port(android_base_port);
 
-    if (loadvm)
+    if (loadvm) {
+        startup_phase_begin("loadvm");
         do_loadvm(cur_mon, loadvm);
+    }
 
     if (incoming) {
         autostart = 0; /* fixme how to deal with -daemonize */
@@ -4023,7 +4397,12 @@ int main(int argc, char **argv, char **envp)
     android_core_init_completed();
 #endif  // CONFIG_ANDROID
 
+    startup_profile_print();
+
     main_loop();
+    if (fast_exit) {
+        android_fast_exit();
+    }
     quit_timers();
     net_cleanup();
     android_wear_agent_stop();
@@ -4038,3 +4417,37 @@ android_emulation_teardown(void)
 {
     skin_charmap_done();
 }
+
+/* Called with -fast-exit once the main loop returns, instead of the
+ * teardown above and the atexit() handlers. The window is hidden first, so
+ * that the emulator is gone for the user as soon as they close it, and the
+ * snapshot is then saved while the UI thread has nothing left to draw. The
+ * rest of the teardown only frees memory or closes files, which the exit
+ * does anyway, so the process exits right after the data is on disk, with a
+ * status of 1 if the snapshot couldn't be saved. */
+void
+android_fast_exit(void)
+{
+    int  status = 0;
+
+    /* The UI saves the window position on exit, before it goes away */
+    user_config_done();
+    skin_winsys_hide_window();
+
+    /* Keep the guest stopped once the state is saved */
+    vm_stop(0);
+
+    if (savevm_on_exit != NULL) {
+        snaphost_save_config(savevm_on_exit);
+        if (do_savevm(cur_mon, savevm_on_exit) < 0) {
+            status = 1;
+        }
+    }
+    /* A flat snapshot already flushed the disks before the guest state, and
+     * synced its own file. Otherwise, sync everything once here. */
+    if (savevm_on_exit == NULL || savevm_flat_dir == NULL) {
+        bdrv_flush_all();
+    }
+    fflush(NULL);
+    _exit(status);
+}